@@ -133,9 +133,16 @@ class ArmNodelet : public ff_util::FreeFlyerNodelet {
 
     // STOWED -> DEPLOYING_PANNING
     //   [label="[5]\nGOAL_DEPLOY\nPan(DEPLOY)"];
+    // STOWED -> DEPLOYING_TILTING
+    //   [label="[5]\nGOAL_DEPLOY\nStream(DEPLOY)", style=dashed];
     fsm_.Add(STATE::STOWED,
       GOAL_DEPLOY,
       [this](FSM::Event const& event) -> FSM::State {
+        if (Streaming(false)) {
+          if (!Stream(true))
+            return Result(RESPONSE::TILT_FAILED);
+          return STATE::DEPLOYING_TILTING;
+        }
         if (!Arm(PAN))
           return Result(RESPONSE::PAN_FAILED);
         return STATE::DEPLOYING_PANNING;
@@ -161,9 +168,18 @@ class ArmNodelet : public ff_util::FreeFlyerNodelet {
 
     // DEPLOYED -> STOWING_SETTING
     //   [label="[8]\nGOAL_STOW\nGripper(CLOSE)"];
+    // DEPLOYED -> STOWING_TILTING
+    //   [label="[8]\nGOAL_STOW\nStream(STOWED)", style=dashed];
     fsm_.Add(STATE::DEPLOYED,
       GOAL_STOW,
       [this](FSM::Event const& event) -> FSM::State {
+        // Close the gripper while panning, and hold the tilt below the
+        // safe angle until both are done
+        if (Streaming(RequiresClosing())) {
+          if (!Stream(true))
+            return Result(RESPONSE::TILT_FAILED);
+          return STATE::STOWING_TILTING;
+        }
         // If the gripper is calibrated
         if (RequiresClosing()) {
           if (!Arm(GRIPPER))
@@ -542,6 +558,20 @@ class ArmNodelet : public ff_util::FreeFlyerNodelet {
     default:
       break;
     }
+    // Report how long a deploy or stow took, streamed or joint by joint
+    switch (fsm_.GetState()) {
+    case STATE::STOWING_SETTING:
+    case STATE::STOWING_PANNING:
+    case STATE::STOWING_TILTING:
+    case STATE::DEPLOYING_PANNING:
+    case STATE::DEPLOYING_TILTING:
+      NODELET_INFO_STREAM((streaming_ ? "Streamed" : "Sequential")
+        << " deploy or stow finished with response " << response << " after "
+        << (ros::Time::now() - action_start_).toSec() << " seconds");
+    default:
+      break;
+    }
+    streaming_ = false;
     // If we need to physically send a response (we are tracking a goal)
     if (send) {
       static ff_msgs::ArmResult result;
@@ -622,6 +652,65 @@ class ArmNodelet : public ff_util::FreeFlyerNodelet {
     return true;
   }
 
+  // Decide whether the deploy or stow that is starting is streamed, and
+  // whether the gripper is closed as part of it
+  bool Streaming(bool gripper) {
+    action_start_ = ros::Time::now();
+    streaming_ = cfg_.Get<bool>("enable_streaming");
+    stream_gripper_ = gripper;
+    stream_sent_.clear();
+    return streaming_;
+  }
+
+  // Send pan, tilt and (for a stow) gripper setpoints together in a single
+  // goal, so that the joints move at the same time. The tilt is held at
+  // the safe angle until the pan and gripper have reached their goals, and
+  // released as soon as they do, so this is called again on every joint
+  // state from the driver. Setpoints are only published when they change.
+  bool Stream(bool start = false) {
+    std::map<JointType, double> setpoints;
+    setpoints[PAN] = joints_[PAN].goal;
+    setpoints[TILT] = joints_[TILT].goal;
+    if (stream_gripper_)
+      setpoints[GRIPPER] = joints_[GRIPPER].goal;
+    if (setpoints[TILT] > K_TILT_SAFE && (!Equal(PAN, joints_[PAN].goal)
+      || (stream_gripper_ && !Equal(GRIPPER, joints_[GRIPPER].goal))))
+      setpoints[TILT] = K_TILT_SAFE;
+    if (setpoints == stream_sent_)
+      return true;
+    // Package up the joint state goal
+    static sensor_msgs::JointState goal;
+    goal.header.stamp = ros::Time::now();
+    goal.header.frame_id = GetPlatform();
+    goal.name.clear();
+    goal.position.clear();
+    std::map<JointType, double>::const_iterator it;
+    for (it = setpoints.begin(); it != setpoints.end(); it++) {
+      JointInfo const& joint = joints_[it->first];
+      goal.name.push_back(joint.name);
+      goal.position.push_back((it->second - joint.offset) / joint.scale);
+    }
+    pub_joint_goals_.publish(goal);
+    stream_sent_ = setpoints;
+    // The timeout covers the whole motion, not each setpoint
+    if (start) {
+      timer_goal_.stop();
+      timer_goal_.setPeriod(
+        ros::Duration(cfg_.Get<double>("timeout_goal")));
+      timer_goal_.start();
+    }
+    return true;
+  }
+
+  // Check if every streamed joint has arrived
+  bool StreamComplete() {
+    std::map<JointType, double>::const_iterator it;
+    for (it = stream_sent_.begin(); it != stream_sent_.end(); it++)
+      if (!Equal(it->first, joints_[it->first].goal))
+        return false;
+    return !stream_sent_.empty();
+  }
+
   // Called whenever the low-level driver produces updated joint states.
   void JointStateCallback(sensor_msgs::JointState::ConstPtr const& msg) {
     // Add the joint sample stamped
@@ -691,6 +780,14 @@ class ArmNodelet : public ff_util::FreeFlyerNodelet {
     case STATE::TILTING:
     case STATE::STOWING_TILTING:
     case STATE::DEPLOYING_TILTING:
+      if (streaming_ && fsm_.GetState() != STATE::TILTING) {
+        Stream();
+        if (StreamComplete()) {
+          timer_goal_.stop();
+          fsm_.Update(TILT_COMPLETE);
+        }
+        break;
+      }
       if (Equal(TILT, joints_[TILT].goal)) {
         timer_goal_.stop();
         fsm_.Update(TILT_COMPLETE);
@@ -910,6 +1007,11 @@ class ArmNodelet : public ff_util::FreeFlyerNodelet {
   ros::Publisher pub_joint_goals_;     // Joint goal publisher
   ros::Publisher pub_arm_state_;       // Executive arm state publisher
   ros::Publisher pub_joint_sample_;    // Executive joint state publisher
+  // Streamed deploy and stow
+  bool streaming_ = false;             // Current action is streamed
+  bool stream_gripper_ = false;        // Gripper is part of the stream
+  std::map<JointType, double> stream_sent_;  // Last setpoints sent
+  ros::Time action_start_;             // Start of the deploy or stow
   // Constant vales
   static constexpr double K_PAN_OFFSET      =    0.0;
   static constexpr double K_PAN_MIN         =  -90.0;
@@ -42,6 +42,7 @@
 
 // Services
 #include <ff_hw_msgs/Undock.h>
+#include <ff_msgs/SetBool.h>
 #include <ff_msgs/SetState.h>
 
 // Actions
@@ -109,7 +110,7 @@ class DockNodelet : public ff_util::FreeFlyerNodelet {
   // Constructor boostraps freeflyer nodelet and sets initial FSM state
   DockNodelet() : ff_util::FreeFlyerNodelet(NODE_DOCK, true),
     fsm_(STATE::INITIALIZING, std::bind(&DockNodelet::UpdateCallback,
-      this, std::placeholders::_1, std::placeholders::_2)) {
+      this, std::placeholders::_1, std::placeholders::_2)), ar_warm_(false) {
     // Add the berths -> frame associations
     berths_[ff_msgs::DockGoal::BERTH_1] = FRAME_NAME_DOCK_BERTH_1;
     berths_[ff_msgs::DockGoal::BERTH_2] = FRAME_NAME_DOCK_BERTH_2;
@@ -138,6 +139,8 @@ class DockNodelet : public ff_util::FreeFlyerNodelet {
     // [4]
     fsm_.Add(STATE::DOCKING_SWITCHING_TO_ML_LOC,
       SWITCH_SUCCESS, [this](FSM::Event const& event) -> FSM::State {
+        if (cfg_.Get<bool>("enable_ar_warmup"))
+          WarmUp(true);
         Move(APPROACH_POSE, ff_msgs::MotionGoal::NOMINAL);
         return STATE::DOCKING_MOVING_TO_APPROACH_POSE;
       });
@@ -379,6 +382,9 @@ class DockNodelet : public ff_util::FreeFlyerNodelet {
       ros::Duration(cfg_.Get<double>("timeout_eps_response")),
       &DockNodelet::DockTimerCallback, this, true, false);
 
+    // Enables AR tracking while approaching, before the switch to it
+    client_ar_ = nh->serviceClient<ff_msgs::SetBool>(SERVICE_LOCALIZATION_AR_ENABLE);
+
     // Create a transform buffer to listen for transforms
     tf_listener_ = std::shared_ptr<tf2_ros::TransformListener>(
       new tf2_ros::TransformListener(tf_buffer_));
@@ -545,6 +551,21 @@ class DockNodelet : public ff_util::FreeFlyerNodelet {
       str = "RECOVERY_SWITCHING_TO_ML_LOC";         break;
     }
     NODELET_DEBUG_STREAM("State changed to " << str);
+    // Once the switch to AR localization starts the localization manager owns
+    // the tracker. Anywhere else, docking has stopped, so turn it back off.
+    if (ar_warm_) {
+      switch (state) {
+      case STATE::DOCKING_SWITCHING_TO_ML_LOC:
+      case STATE::DOCKING_MOVING_TO_APPROACH_POSE:
+        break;
+      case STATE::DOCKING_SWITCHING_TO_AR_LOC:
+        ar_warm_ = false;
+        break;
+      default:
+        WarmUp(false);
+        break;
+      }
+    }
     // Send the feedback if needed
     switch (state) {
     case STATE::INITIALIZING:
@@ -647,11 +668,23 @@ class DockNodelet : public ff_util::FreeFlyerNodelet {
 
   // SWITCH action
 
+  // Turn AR tracking on ahead of the switch to it, so that the localization
+  // manager finds it already stable and the handover does not wait for it
+  void WarmUp(bool enable) {
+    ff_msgs::SetBool msg;
+    msg.request.enable = enable;
+    if (!client_ar_.call(msg))
+      NODELET_WARN_STREAM("Could not " << (enable ? "enable" : "disable") << " AR tracking");
+    ar_warm_ = enable && msg.response.success;
+  }
+
   // Helper function for localization switching
   bool Switch(std::string const& pipeline) {
     // Send the switch goal
     ff_msgs::SwitchGoal goal;
     goal.pipeline = pipeline;
+    switch_pipeline_ = pipeline;
+    switch_start_ = ros::Time::now();
     return client_s_.SendGoal(goal);
   }
 
@@ -661,6 +694,9 @@ class DockNodelet : public ff_util::FreeFlyerNodelet {
   // Do something with the switch result
   void SResultCallback(ff_util::FreeFlyerActionState::Enum result_code,
     ff_msgs::SwitchResultConstPtr const& result) {
+    // How long localization took to hand over, rather than assuming a delay
+    NODELET_INFO_STREAM("Switch to " << switch_pipeline_ << " took "
+      << (ros::Time::now() - switch_start_).toSec() << " seconds");
     switch (result_code) {
     case ff_util::FreeFlyerActionState::SUCCESS:
       return fsm_.Update(SWITCH_SUCCESS);
@@ -842,6 +878,10 @@ class DockNodelet : public ff_util::FreeFlyerNodelet {
   ros::ServiceServer server_set_state_;
   ros::Timer timer_eps_;
   ros::Timer timer_pmc_;
+  ros::ServiceClient client_ar_;
+  bool ar_warm_;
+  std::string switch_pipeline_;
+  ros::Time switch_start_;
   std::string frame_;
   int32_t err_;
 };
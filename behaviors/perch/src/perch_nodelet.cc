@@ -36,6 +36,7 @@
 
 // Software messages
 #include <ff_msgs/PerchState.h>
+#include <ff_msgs/DepthLandmarks.h>
 
 // Services
 #include <ff_msgs/SetState.h>
@@ -157,7 +158,11 @@ class PerchNodelet : public ff_util::FreeFlyerNodelet {
     // [31]
     fsm_.Add(STATE::PERCHING_SWITCHING_TO_HR_LOC,
       SWITCH_SUCCESS, [this](FSM::Event const& event) -> FSM::State {
-        Move(COMPLETE_POSE, ff_msgs::MotionGoal::PERCHING);
+        servoing_ = cfg_.Get<bool>("enable_servoing");
+        if (servoing_)
+          Servo(true);
+        else
+          Move(COMPLETE_POSE, ff_msgs::MotionGoal::PERCHING);
         return STATE::PERCHING_MOVING_TO_COMPLETE_POSE;
       });
     // [32]
@@ -385,6 +390,10 @@ class PerchNodelet : public ff_util::FreeFlyerNodelet {
     sub_s_ = nh->subscribe(TOPIC_HARDWARE_EPS_PERCH_STATE, 5,
       &PerchNodelet::PerchStateCallback, this);
 
+    // Subscribe to handrail detections, to servo on the estimate
+    sub_h_ = nh->subscribe(TOPIC_LOCALIZATION_HR_FEATURES, 1,
+      &PerchNodelet::HandrailCallback, this);
+
     // Allow the state to be manually set
     server_set_state_ = nh->advertiseService(SERVICE_BEHAVIORS_PERCH_SET_STATE,
       &PerchNodelet::SetStateCallback, this);
@@ -666,23 +675,95 @@ class PerchNodelet : public ff_util::FreeFlyerNodelet {
     default:
       return false;
     }
+    if (!Lookup(msg.header.frame_id, &msg.pose))
+      return false;
+    if (!Reconfigure())
+      return false;
+
+    // Send the goal to the mobility subsystem
+    ff_msgs::MotionGoal goal;
+    goal.command = ff_msgs::MotionGoal::MOVE;
+    goal.flight_mode = mode;
+    goal.states.push_back(msg);
+    return client_m_.SendGoal(goal);
+  }
 
-    // Get the dock -> world transform
+  // Get the pose of a frame in the world frame
+  bool Lookup(std::string const& frame, geometry_msgs::Pose *pose) {
     try {
-      // Look up the world -> berth transform
+      // Look up the world -> frame transform
       geometry_msgs::TransformStamped tf = tf_buffer_.lookupTransform(
-        "world", msg.header.frame_id, ros::Time(0));
+        "world", frame, ros::Time(0));
       // Copy the transform
-      msg.pose.position.x = tf.transform.translation.x;
-      msg.pose.position.y = tf.transform.translation.y;
-      msg.pose.position.z = tf.transform.translation.z;
-      msg.pose.orientation = tf.transform.rotation;
+      pose->position.x = tf.transform.translation.x;
+      pose->position.y = tf.transform.translation.y;
+      pose->position.z = tf.transform.translation.z;
+      pose->orientation = tf.transform.rotation;
     } catch (tf2::TransformException &ex) {
       NODELET_WARN_STREAM("Transform failed" << ex.what());
       return false;
     }
+    return true;
+  }
+
+  // Move towards the complete pose in a short segment, which ends at the
+  // complete pose once it is within one segment. The segment is started
+  // from the current pose, so it can be sent again whenever the handrail
+  // estimate moves the complete pose, and its end is the start of the next.
+  bool Servo(bool first) {
+    static geometry_msgs::PoseStamped msg;
+    msg.header.stamp = ros::Time::now();
+    msg.header.frame_id = "handrail/complete";
+    geometry_msgs::Pose body;
+    if (!Lookup(msg.header.frame_id, &msg.pose))
+      return false;
+    if (!Lookup(FRAME_NAME_BODY, &body))
+      return false;
+    servo_target_ = msg.pose.position;
+    // Shorten the motion to at most one segment
+    double dx = msg.pose.position.x - body.position.x;
+    double dy = msg.pose.position.y - body.position.y;
+    double dz = msg.pose.position.z - body.position.z;
+    double d = sqrt(dx * dx + dy * dy + dz * dz);
+    double segment = cfg_.Get<double>("servo_segment");
+    servo_final_ = (d <= segment);
+    if (!servo_final_) {
+      msg.pose.position.x = body.position.x + dx * segment / d;
+      msg.pose.position.y = body.position.y + dy * segment / d;
+      msg.pose.position.z = body.position.z + dz * segment / d;
+    }
+    NODELET_DEBUG_STREAM("Servo segment with " << d << "m to go");
+    // The choreographer only needs to be configured once per approach
+    if (first && !Reconfigure())
+      return false;
+    ff_msgs::MotionGoal goal;
+    goal.command = ff_msgs::MotionGoal::MOVE;
+    goal.flight_mode = ff_msgs::MotionGoal::PERCHING;
+    goal.states.push_back(msg);
+    return client_m_.SendGoal(goal);
+  }
+
+  // Called on a new handrail detection. If the complete pose it implies
+  // has moved, the current segment is replaced with one towards it.
+  void HandrailCallback(ff_msgs::DepthLandmarks::ConstPtr const& msg) {
+    if (!servoing_)
+      return;
+    if (fsm_.GetState() != STATE::PERCHING_MOVING_TO_COMPLETE_POSE)
+      return;
+    geometry_msgs::Pose target;
+    if (!Lookup("handrail/complete", &target))
+      return;
+    double dx = target.position.x - servo_target_.x;
+    double dy = target.position.y - servo_target_.y;
+    double dz = target.position.z - servo_target_.z;
+    if (sqrt(dx * dx + dy * dy + dz * dz) < cfg_.Get<double>("servo_replan"))
+      return;
+    if (!Servo(false))
+      return fsm_.Update(MOTION_FAILED);
+  }
 
-    // Reconfigure the choreographer
+  // Reconfigure the choreographer for the short, immediate perching motions
+  bool Reconfigure() {
     ff_util::ConfigClient cfg(GetPlatformHandle(), NODE_CHOREOGRAPHER);
     cfg.Set<bool>("enable_collision_checking", false);
     cfg.Set<bool>("enable_validation", false);
@@ -691,15 +772,7 @@ class PerchNodelet : public ff_util::FreeFlyerNodelet {
     cfg.Set<bool>("enable_timesync", false);
     cfg.Set<bool>("enable_faceforward", false);
     cfg.Set<std::string>("planner", "trapezoidal");
-    if (!cfg.Reconfigure())
-      return false;
-
-    // Send the goal to the mobility subsystem
-    ff_msgs::MotionGoal goal;
-    goal.command = ff_msgs::MotionGoal::MOVE;
-    goal.flight_mode = mode;
-    goal.states.push_back(msg);
-    return client_m_.SendGoal(goal);
+    return cfg.Reconfigure();
   }
 
   // Ignore the move feedback, for now
@@ -710,6 +783,13 @@ class PerchNodelet : public ff_util::FreeFlyerNodelet {
     ff_msgs::MotionResultConstPtr const& result) {
     switch (result_code) {
     case ff_util::FreeFlyerActionState::SUCCESS:
+      // When servoing only the last segment completes the move
+      if (servoing_ && !servo_final_
+        && fsm_.GetState() == STATE::PERCHING_MOVING_TO_COMPLETE_POSE) {
+        if (!Servo(false))
+          return fsm_.Update(MOTION_FAILED);
+        return;
+      }
       return fsm_.Update(MOTION_SUCCESS);
     default:
       return fsm_.Update(MOTION_FAILED);
@@ -795,11 +875,15 @@ class PerchNodelet : public ff_util::FreeFlyerNodelet {
   ros::Publisher pub_;
   ros::Subscriber sub_s_;
   ros::Subscriber sub_p_;
+  ros::Subscriber sub_h_;
   ros::ServiceServer server_set_state_;
   ros::Timer timer_eps_;
   ros::Timer timer_pmc_;
   std::string frame_;
   uint8_t err_;
+  bool servoing_ = false;                // Approach is servoed on the handrail
+  bool servo_final_ = false;             // Current segment ends at the handrail
+  geometry_msgs::Point servo_target_;    // Complete pose the segment was for
 };
 
 PLUGINLIB_DECLARE_CLASS(dock, PerchNodelet,
@@ -0,0 +1,69 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef DDS_ROS_BRIDGE_BANDWIDTH_GOVERNOR_H_
+#define DDS_ROS_BRIDGE_BANDWIDTH_GOVERNOR_H_
+
+#include <stddef.h>
+
+#include <mutex>  // NOLINT
+
+namespace ff {
+
+/**
+ * BandwidthGovernor shares a downlink budget, in bytes per second, between
+ * three priority classes. Faults and acks are never held back, and a fixed
+ * reserve of the budget is kept for them. State telemetry gets what it needs
+ * at its configured rates if that fits in the rest, and is scaled down
+ * otherwise. Imagery gets whatever state leaves, through a token bucket that
+ * is refilled on every update and may go into debt by one frame.
+ */
+class BandwidthGovernor {
+ public:
+  BandwidthGovernor(double budget, double reserve);
+
+  /**
+   * The bytes per second state telemetry takes at its configured rates.
+   */
+  void SetStateLoad(double load);
+
+  /**
+   * Refills the image bucket for dt seconds and updates the measured image
+   * throughput. Returns the scale to apply to the state telemetry rates.
+   */
+  double Update(double dt);
+
+  /**
+   * Returns true, and takes the bytes from the image bucket, if an image
+   * sample of that size may be sent now.
+   */
+  bool SendImage(size_t bytes);
+
+  double ImageThroughput() const;
+
+ private:
+  double budget_, reserve_;
+  double state_load_, state_scale_;
+  double tokens_;
+  double image_bytes_, image_throughput_;
+  mutable std::mutex mutex_;
+};
+
+}  // end namespace ff
+
+#endif  // DDS_ROS_BRIDGE_BANDWIDTH_GOVERNOR_H_
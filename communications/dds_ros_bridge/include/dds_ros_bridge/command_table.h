@@ -0,0 +1,75 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef DDS_ROS_BRIDGE_COMMAND_TABLE_H_
+#define DDS_ROS_BRIDGE_COMMAND_TABLE_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "config_reader/config_reader.h"
+
+#include "rapidDds/Command.h"
+
+namespace ff {
+
+/**
+ * Gets the rapid type of a command parameter type name in commands.config,
+ * for example RAPID_STRING. Returns false if it is not one.
+ */
+bool ParseParamType(std::string const& name, rapid::DataType* type);
+
+/**
+ * CommandTable holds every command in the command config with the types of
+ * its parameters, read once at startup, so an incoming command is checked
+ * with one hash lookup and a walk over its arguments.
+ */
+class CommandTable {
+ public:
+  struct Command {
+    std::string name;
+    std::vector<rapid::DataType> parameters;
+  };
+
+  CommandTable();
+
+  /**
+   * Reads the commandConfig table of commands.config. Returns false, and
+   * logs why, if it is malformed.
+   */
+  bool Load(config_reader::ConfigReader& config);
+
+  /**
+   * Returns the id of the command, its index in the table, or -1 with the
+   * reason in err_msg if it is not in the table or its arguments do not
+   * match its parameters.
+   */
+  int Validate(rapid::Command const& cmd, std::string* err_msg) const;
+
+  size_t Size() const {return commands_.size();}
+  Command const& Get(int id) const {return commands_[id];}
+
+ private:
+  std::vector<Command> commands_;
+  std::unordered_map<std::string, int> ids_;
+};
+
+}  // end namespace ff
+
+#endif  // DDS_ROS_BRIDGE_COMMAND_TABLE_H_
@@ -20,6 +20,8 @@
 #define DDS_ROS_BRIDGE_DDS_ROS_BRIDGE_H_
 
 #include <pluginlib/class_list_macros.h>
+#include <ros/callback_queue.h>
+#include <ros/spinner.h>
 
 #include <map>
 #include <memory>
@@ -28,6 +30,7 @@
 
 #include "config_reader/config_reader.h"
 
+#include "dds_ros_bridge/bandwidth_governor.h"
 #include "dds_ros_bridge/rapid_command_ros_command_plan.h"
 #include "dds_ros_bridge/rapid_compressed_file_ros_compressed_file.h"
 #include "dds_ros_bridge/rapid_pub.h"
@@ -115,7 +118,10 @@ class DdsRosBridge : public ff_util::FreeFlyerNodelet {
                                const std::string& name);
   int BuildCompressedImageToImage(const std::string& sub_topic,
                                   const std::string& pub_topic,
-                                  const std::string& name);
+                                  const std::string& name,
+                                  unsigned int chunk_size = 0,
+                                  float chunk_rate = 0,
+                                  const std::string& transport = "compressed");
   int BuildCompressedFileToRapid(const std::string& sub_topic,
                                   const std::string& pub_topic,
                                   const std::string& name);
@@ -171,10 +177,13 @@ class DdsRosBridge : public ff_util::FreeFlyerNodelet {
    */
   int BuildCommandToCommand(const std::string& sub_topic,
                             const std::string& pub_topic,
-                            const std::string& name);
+                            const std::string& name,
+                            std::shared_ptr<ff::CommandTable> table);
   int BuildCompressedFileToCompressedFile(const std::string& sub_topic,
                                           const std::string& pub_topic,
-                                          const std::string& name);
+                                          const std::string& name,
+                                          unsigned int transfer_memory = 0,
+                                          float transfer_timeout = 0);
 
 
   /**
@@ -186,6 +195,33 @@ class DdsRosBridge : public ff_util::FreeFlyerNodelet {
  protected:
   virtual void Initialize(ros::NodeHandle *nh);
   bool ReadParams();
+  bool ReadTelemetryParams(float downlink_state_sample_size);
+  bool ReadStateParams();
+
+  /**
+   * Translators are split by priority, and with translation threads on each
+   * class has its own callback queue and spinner, so a slow image cannot hold
+   * up an ack. Otherwise they all share the nodelet's queue.
+   */
+  enum Priority {
+    CRITICAL,  // acks, faults, access control and commands
+    STATE,     // telemetry
+    BULK,      // images and compressed files
+    NUM_PRIORITIES
+  };
+  ros::NodeHandle PriorityHandle(Priority priority);
+
+  /**
+   * Sets the telemetry rates to the configured ones times the scale
+   */
+  void SetTelemetryRates(float scale);
+  void GovernorCallback(ros::TimerEvent const& event);
+
+  /**
+   * Sends the stats of every translator as diagnostics, keyed by its name or,
+   * for rapid subscribers, its ros topic
+   */
+  void StatsCallback(ros::TimerEvent const& event);
 
  private:
   config_reader::ConfigReader config_params_;
@@ -194,11 +230,28 @@ class DdsRosBridge : public ff_util::FreeFlyerNodelet {
 
   ros::NodeHandle nh_;
 
+  // declared before the translators so they outlast their subscribers
+  bool translation_threads_;
+  ros::CallbackQueue queues_[NUM_PRIORITIES];
+
   std::map<std::string, ff::RosSubRapidPubPtr> ros_sub_rapid_pubs_;
   std::shared_ptr<kn::DdsEntitiesFactorySvc> dds_entities_factory_;
   std::string agent_name_, participant_name_;
   std::vector<ff::RapidPubPtr> rapid_pubs_;
   std::vector<ff::RapidSubRosPubPtr> rapid_sub_ros_pubs_;
+
+  // the configured telemetry rates, before the governor scales them
+  float comm_status_rate_, cpu_state_rate_, disk_state_rate_;
+  float ekf_state_rate_, gnc_state_rate_, position_rate_;
+  float telemetry_scale_;
+
+  std::shared_ptr<ff::BandwidthGovernor> governor_;
+  ros::Timer governor_timer_;
+  ros::Timer stats_timer_;
+  std::shared_ptr<ff::LatencyProbe> latency_probe_;
+
+  // declared last so they stop before the translators go
+  std::vector<std::shared_ptr<ros::AsyncSpinner>> spinners_;
 };
 
 }  // end namespace dds_ros_bridge
@@ -0,0 +1,109 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef DDS_ROS_BRIDGE_FILE_TRANSFER_H_
+#define DDS_ROS_BRIDGE_FILE_TRANSFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace ff {
+
+/**
+ * A large compressed file can be sent as several compressed file samples,
+ * each holding one chunk of it. A chunk starts with a header giving its
+ * transfer, the transfer's priority (0 first), its index, the number of
+ * chunks, the size of the whole file, the stride between chunks and the
+ * CRC32 of its data, followed by the data.
+ */
+struct FileChunk {
+  uint32_t transfer;
+  uint8_t priority;
+  uint32_t index, count;
+  uint32_t size, stride;
+  const uint8_t* data;
+  uint32_t length;
+};
+
+uint32_t Crc32(const uint8_t* data, size_t size);
+
+/**
+ * Splits a file into chunks of at most chunk_size bytes, header included.
+ * Returns false if the chunk size is too small or there is nothing to send.
+ */
+bool SplitFile(uint32_t transfer, uint8_t priority, const uint8_t* data,
+               size_t size, size_t chunk_size,
+               std::vector<std::vector<uint8_t>>* chunks);
+
+/**
+ * Returns false if the bytes are not a chunk, or if its data does not match
+ * its CRC. The chunk points into the bytes.
+ */
+bool DecodeFileChunk(const uint8_t* bytes, size_t size, FileChunk* chunk);
+
+/**
+ * FileAssembler puts chunked transfers back together. Several transfers can
+ * be in progress at once, interleaved in any order, and a transfer keeps its
+ * chunks through a loss of signal, until it has had none for the timeout.
+ * The sender resends whatever was not acknowledged. If a new transfer does
+ * not fit in memory, the ones that timed out are dropped first, then those
+ * of lower priority, least important and oldest first, and failing that the
+ * new one is rejected.
+ */
+class FileAssembler {
+ public:
+  enum Result {
+    REJECTED,   // no room for it, not to be acked
+    DUPLICATE,  // already had it, to be acked again
+    ADDED,
+    COMPLETE    // finished its transfer, which is returned
+  };
+
+  FileAssembler(size_t max_memory, double timeout);
+
+  Result Add(FileChunk const& chunk, double now, std::vector<uint8_t>* file);
+
+  size_t Memory() const {return memory_;}
+  size_t Transfers() const {return transfers_.size();}
+
+ private:
+  struct Transfer {
+    uint8_t priority;
+    double started, last;
+    uint32_t received;
+    std::vector<bool> have;
+    std::vector<uint8_t> data;
+  };
+
+  bool MakeRoom(size_t size, uint8_t priority, double now);
+  void Erase(std::map<uint32_t, Transfer>::iterator it);
+
+  size_t max_memory_, memory_;
+  double timeout_;
+  std::map<uint32_t, Transfer> transfers_;
+  // the transfers completed most recently, whose chunks are acked again
+  std::deque<uint32_t> completed_;
+};
+
+}  // end namespace ff
+
+#endif  // DDS_ROS_BRIDGE_FILE_TRANSFER_H_
@@ -0,0 +1,74 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef DDS_ROS_BRIDGE_IMAGE_FRAGMENT_H_
+#define DDS_ROS_BRIDGE_IMAGE_FRAGMENT_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace ff {
+
+/**
+ * Images too large for one image sensor sample are sent as several samples
+ * of this mime type. Each one starts with a header giving the frame it
+ * belongs to, its place in the frame, the size of the whole image and the
+ * mime type of the image, followed by its part of the image.
+ */
+extern const char kImageFragmentMimeType[];
+
+/**
+ * Splits an image into fragments of at most chunk_size bytes, header
+ * included. Returns false if the chunk is too small to hold the header and
+ * at least one byte, or if the image needs more fragments than fit the
+ * header.
+ */
+bool SplitImage(uint32_t frame, const std::string& mime_type,
+                const uint8_t* data, size_t size, size_t chunk_size,
+                std::vector<std::vector<uint8_t>>* fragments);
+
+/**
+ * ImageReassembler puts the fragments of an image back together on the
+ * receiving side. Only the newest frame is kept; fragments of an older frame
+ * are dropped, and a newer frame drops whatever had arrived of the last one.
+ */
+class ImageReassembler {
+ public:
+  ImageReassembler();
+
+  /**
+   * Adds one fragment. Returns true when it completes its frame, in which
+   * case the image and its mime type are returned.
+   */
+  bool Add(const uint8_t* fragment, size_t size, std::string* mime_type,
+           std::vector<uint8_t>* data);
+
+ private:
+  bool started_;
+  uint32_t frame_;
+  unsigned int received_;
+  std::string mime_type_;
+  std::vector<bool> have_;
+  std::vector<uint8_t> image_;
+};
+
+}  // end namespace ff
+
+#endif  // DDS_ROS_BRIDGE_IMAGE_FRAGMENT_H_
@@ -0,0 +1,73 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef DDS_ROS_BRIDGE_LATENCY_PROBE_H_
+#define DDS_ROS_BRIDGE_LATENCY_PROBE_H_
+
+#include <stddef.h>
+
+#include <deque>
+#include <mutex>  // NOLINT
+#include <string>
+
+#include "dds_ros_bridge/translator_stats.h"
+
+namespace ff {
+
+/**
+ * LatencyProbe times the no op commands from the ground on their way through
+ * the robot and back, split into the segments below. A command is noted when
+ * the bridge forwards it and timed when its first ack comes back. The times
+ * are in seconds; the link segment compares the ground's clock to the
+ * robot's, so it is only as good as their sync.
+ */
+class LatencyProbe {
+ public:
+  enum Segment {
+    LINK,         // ground send to dds receive
+    BRIDGE,       // dds receive to ros publish
+    EXECUTIVE,    // ros publish to the executive's ack
+    ACK,          // the executive's ack to its receipt by the bridge
+    ROBOT,        // dds receive to ack receipt, all the time on the robot
+    NUM_SEGMENTS
+  };
+
+  explicit LatencyProbe(size_t max_pending = 64);
+
+  void Forwarded(std::string const& cmd_id, double sent, double received,
+                 double forwarded);
+  void Acked(std::string const& cmd_id, double acked, double received);
+
+  TranslatorStats& Stats(Segment segment) {return stats_[segment];}
+  static const char* Name(Segment segment);
+
+ private:
+  struct Pending {
+    std::string cmd_id;
+    double received, forwarded;
+  };
+
+  std::mutex mutex_;
+  size_t max_pending_;
+  std::deque<Pending> pending_;
+  TranslatorStats stats_[NUM_SEGMENTS];
+};
+
+}  // end namespace ff
+
+#endif  // DDS_ROS_BRIDGE_LATENCY_PROBE_H_
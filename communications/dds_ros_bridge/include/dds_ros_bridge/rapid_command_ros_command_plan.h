@@ -23,15 +23,21 @@
 
 #include <ros/assert.h>
 
+#include <memory>
 #include <string>
 #include <cstring>
 #include <vector>
 
+#include "dds_ros_bridge/command_table.h"
+#include "dds_ros_bridge/latency_probe.h"
 #include "dds_ros_bridge/rapid_sub_ros_pub.h"
 #include "dds_ros_bridge/util.h"
 
+#include "ff_msgs/AckStamped.h"
 #include "ff_msgs/CommandArg.h"
+#include "ff_msgs/CommandConstants.h"
 #include "ff_msgs/CommandStamped.h"
+#include "ff_util/ff_names.h"
 
 #include "AstrobeeCommandConstants.h"
 
@@ -48,15 +54,27 @@ namespace ff {
 
 class RapidCommandRosCommand : public RapidSubRosPub {
  public:
+  /**
+   * With a command table, commands not in it or with the wrong arguments are
+   * acked as bad syntax here instead of being passed on. With a latency
+   * probe, no op commands are timed until they are acked.
+   */
   RapidCommandRosCommand(const std::string& subscribe_topic,
                          const std::string& pub_topic,
                          const ros::NodeHandle &nh,
-                         const unsigned int queue_size = 10);
+                         const unsigned int queue_size = 10,
+                         std::shared_ptr<CommandTable> table = nullptr,
+                         std::shared_ptr<LatencyProbe> probe = nullptr);
 
   /**
    * call back for ddsEventLoop
    */
   void operator() (rapid::Command const* cmd);
+
+ private:
+  std::shared_ptr<CommandTable> table_;
+  std::shared_ptr<LatencyProbe> probe_;
+  ros::Publisher ack_pub_;
 };
 
 }  // end namespace ff
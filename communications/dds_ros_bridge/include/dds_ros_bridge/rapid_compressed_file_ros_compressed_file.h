@@ -23,13 +23,17 @@
 
 #include <ros/assert.h>
 
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "dds_ros_bridge/file_transfer.h"
 #include "dds_ros_bridge/rapid_sub_ros_pub.h"
 #include "dds_ros_bridge/util.h"
 
 #include "ff_msgs/CompressedFile.h"
+#include "ff_msgs/CompressedFileAck.h"
+#include "ff_util/ff_names.h"
 
 #include "AstrobeeConstants.h"
 #include "CompressedFile.h"
@@ -37,15 +41,27 @@
 
 namespace ff {
 
+/**
+ * With transfer_memory set, compressed files sent in chunks (see
+ * file_transfer.h) are put back together using up to that many bytes, each
+ * chunk is acked with the id of its sample, and the whole file is published
+ * once complete. Files sent whole are published as they come.
+ */
 class RapidCompressedFileRosCompressedFile : public RapidSubRosPub {
  public:
   RapidCompressedFileRosCompressedFile(const std::string& subscribe_topic,
                                        const std::string& pub_topic,
                                        const ros::NodeHandle &nh,
-                                       const unsigned int queue_size = 10);
+                                       const unsigned int queue_size = 10,
+                                       const unsigned int transfer_memory = 0,
+                                       const float transfer_timeout = 0);
 
   // Callback for ddsEventLoop
   void operator() (rapid::ext::astrobee::CompressedFile const* file);
+
+ private:
+  std::unique_ptr<FileAssembler> assembler_;
+  ros::Publisher ack_pub_;
 };
 
 }  // end namespace ff
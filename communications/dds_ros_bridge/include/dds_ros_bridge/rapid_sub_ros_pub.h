@@ -23,6 +23,8 @@
 #include <string>
 #include <thread>
 
+#include "dds_ros_bridge/translator_stats.h"
+
 #include "ros/ros.h"
 
 #include "knDds/DdsEventLoop.h"
@@ -39,6 +41,14 @@ namespace ff {
  *          to m_ddsEventLoop and call startThread()
  */
 class RapidSubRosPub {
+ public:
+  /**
+   * Translators record how long each sample took from its callback to its
+   * ros publish, and its size
+   */
+  TranslatorStats& Stats() {return stats_;}
+  std::string const& PublishTopic() const {return publish_topic_;}
+
  protected:
   RapidSubRosPub(const std::string& subscribe_topic,
                  const std::string& pub_topic,
@@ -52,11 +62,23 @@ class RapidSubRosPub {
    */
   virtual void StartThread();
 
+  /**
+   * Publishes on pub_ and records the time since the sample came in to its
+   * callback, and the size of the message
+   */
+  template <class M>
+  void Publish(M const& msg, ros::Time const& received) {
+    pub_.publish(msg);
+    stats_.Record((ros::Time::now() - received).toSec(),
+                  ros::serialization::serializationLength(msg));
+  }
+
   ros::NodeHandle nh_;
   ros::Publisher pub_;
   std::string subscribe_topic_;
   std::string publish_topic_;
   unsigned int queue_size_;
+  TranslatorStats stats_;
 
   std::thread thread_;
   kn::DdsEventLoop dds_event_loop_;
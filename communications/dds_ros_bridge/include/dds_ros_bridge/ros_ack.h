@@ -24,6 +24,7 @@
 #include <memory>
 
 #include "dds_ros_bridge/enum_helper.h"
+#include "dds_ros_bridge/latency_probe.h"
 #include "dds_ros_bridge/ros_sub_rapid_pub.h"
 #include "dds_ros_bridge/util.h"
 
@@ -44,7 +45,8 @@ class RosAckToRapid : public RosSubRapidPub {
   RosAckToRapid(const std::string& subscribe_topic,
                 const std::string& pub_topic,
                 const ros::NodeHandle &nh,
-                const unsigned int queue_size = 10);
+                const unsigned int queue_size = 10,
+                std::shared_ptr<LatencyProbe> probe = nullptr);
 
   void Callback(ff_msgs::AckStamped::ConstPtr const& status);
 
@@ -53,6 +55,7 @@ class RosAckToRapid : public RosSubRapidPub {
   using StateSupplierPtr = std::unique_ptr<StateSupplier>;
 
   StateSupplierPtr state_supplier_;
+  std::shared_ptr<LatencyProbe> probe_;
 };
 
 }  // end namespace ff
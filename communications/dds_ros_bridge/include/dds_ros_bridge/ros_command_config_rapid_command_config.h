@@ -26,6 +26,7 @@
 
 #include "config_reader/config_reader.h"
 
+#include "dds_ros_bridge/command_table.h"
 #include "dds_ros_bridge/rapid_pub.h"
 
 #include "knDds/DdsTypedSupplier.h"
@@ -19,8 +19,13 @@
 #ifndef DDS_ROS_BRIDGE_ROS_COMPRESSED_IMAGE_RAPID_IMAGE_H_
 #define DDS_ROS_BRIDGE_ROS_COMPRESSED_IMAGE_RAPID_IMAGE_H_
 
+#include <deque>
+#include <mutex>  // NOLINT
 #include <string>
+#include <vector>
 
+#include "dds_ros_bridge/bandwidth_governor.h"
+#include "dds_ros_bridge/image_fragment.h"
 #include "dds_ros_bridge/ros_sub_rapid_pub.h"
 
 #include "rapidDds/MIMETypesConstants.h"
@@ -36,21 +41,45 @@ namespace ff {
 /**
  * RosCompressedImageRapidImage will use the ros::Subscriber to 
  *   subscribe to the compressed image type
+ * If chunk_size is not zero, images larger than it are split into fragments
+ *   (see image_fragment.h) rather than dropped. With a chunk_rate, the
+ *   fragments are sent at that many per second and only the latest frame is
+ *   kept waiting; otherwise they are all sent at once.
+ * With a governor, images are only sent while it has budget left for them.
+ * With the video transport, the H.264 or H.265 frames of the stream's video
+ *   topic are sent instead, and once a frame is dropped the rest are dropped
+ *   until the next key frame, since they cannot be decoded without it.
  */
 class RosCompressedImageRapidImage : public RosSubRapidPub {
  public:
   RosCompressedImageRapidImage(const std::string& subscribe_topic,
                                const std::string& pub_topic,
                                const ros::NodeHandle &nh,
-                               const unsigned int queue_size = 10);
+                               const unsigned int queue_size = 10,
+                               const unsigned int chunk_size = 0,
+                               const float chunk_rate = 0,
+                               const std::string& transport = "compressed");
 
   void CallBack(const sensor_msgs::CompressedImage::ConstPtr& msg);
+  void PubChunk(ros::TimerEvent const& event);
+  void SetGovernor(std::shared_ptr<BandwidthGovernor> const& governor);
 
  private:
   std::string GetRapidMimeType(const std::string& ros_format);
   rapid::ImageSensorProviderParameters params_;
   std::shared_ptr<rapid::ImageSensorProvider> provider_;
   const unsigned int MB_;
+
+  // drops a video frame, and the ones after it up to a key frame
+  void DropVideo(void);
+
+  unsigned int chunk_size_;
+  uint32_t frame_;
+  bool video_, wait_key_;
+  ros::Timer chunk_timer_;
+  std::mutex mutex_;
+  std::deque<std::vector<uint8_t>> pending_;
+  std::shared_ptr<BandwidthGovernor> governor_;
 };
 
 }  // end namespace ff
@@ -19,11 +19,14 @@
 #ifndef DDS_ROS_BRIDGE_ROS_ODOM_RAPID_POSITION_H_
 #define DDS_ROS_BRIDGE_ROS_ODOM_RAPID_POSITION_H_
 
+#include <cstring>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "dds_ros_bridge/ros_sub_rapid_pub.h"
 #include "dds_ros_bridge/rapid_position_provider_ros_helper.h"
+#include "dds_ros_bridge/trajectory_packer.h"
 #include "dds_ros_bridge/util.h"
 
 #include "ff_msgs/EkfState.h"
@@ -37,6 +40,7 @@
 #include "rapidUtil/RapidHelper.h"
 
 #include "AstrobeeConstants.h"
+#include "CompressedFileSupport.h"
 #include "EkfStateSupport.h"
 
 namespace ff {
@@ -54,9 +58,18 @@ class RosOdomRapidPosition : public RosSubRapidPub {
   void MsgCallback(const ff_msgs::EkfStateConstPtr& msg);
   void PubEkf(const ros::TimerEvent& event);
   void PubPosition(const ros::TimerEvent& event);
+  void PubTrajectory(const ros::Time& stamp);
   void SetEkfPublishRate(float rate);
   void SetPositionPublishRate(float rate);
 
+  /**
+   * Also sends the pose as a packed trajectory, sampled rate times a second
+   * with num_poses samples in each compressed file sample on the position
+   * compressed file topic. See trajectory_packer.h for the format. A rate of
+   * 0, the default, sends none.
+   */
+  void SetTrajectory(float rate, unsigned int num_poses);
+
  private:
   rapid::PositionTopicPairParameters params_;
   std::shared_ptr<rapid::PositionProviderRosHelper> provider_;
@@ -69,6 +82,14 @@ class RosOdomRapidPosition : public RosSubRapidPub {
 
   StateSupplierPtr state_supplier_;
 
+  using TrajectorySupplier =
+      kn::DdsTypedSupplier<rapid::ext::astrobee::CompressedFile>;
+
+  std::unique_ptr<TrajectorySupplier> trajectory_supplier_;
+  std::unique_ptr<TrajectoryPacker> packer_;
+  std::vector<uint8_t> packet_;
+  int32_t packet_id_;
+
   bool ekf_sent_, pub_ekf_;
 
   ros::Timer ekf_timer_, position_timer_;
@@ -20,14 +20,30 @@
 #ifndef DDS_ROS_BRIDGE_ROS_SUB_RAPID_PUB_H_
 #define DDS_ROS_BRIDGE_ROS_SUB_RAPID_PUB_H_
 
+#include <functional>
 #include <memory>
 #include <string>
+#include <vector>
+
+#include "dds_ros_bridge/translator_stats.h"
 
 #include "ros/ros.h"
+#include "ros/serialization.h"
 
 namespace ff {
 
 class RosSubRapidPub {
+ public:
+  /**
+   * Turns on coalesced publishing for translators that use Publish. Unchanged
+   * samples are dropped, changed ones are sent no more than once per window,
+   * and the last one is sent again if nothing went out for heartbeat seconds.
+   * Zero for both, the default, sends every sample.
+   */
+  void SetCoalescing(float window, float heartbeat);
+
+  TranslatorStats& Stats() {return stats_;}
+
  protected:
   RosSubRapidPub(const std::string& subscribe_topic,
                  const std::string& pub_topic,
@@ -36,7 +52,54 @@ class RosSubRapidPub {
     : nh_(nh),
       subscribe_topic_(subscribe_topic),
       publish_topic_(pub_topic),
-      queue_size_(queue_size) {
+      queue_size_(queue_size),
+      pending_(false) {
+  }
+
+  /**
+   * Sets how Publish sends the sample, for translators that coalesce
+   */
+  void SetupCoalescing(std::function<void()> const& send);
+
+  /**
+   * Sends the sample, or leaves it for the window, or drops it if unchanged
+   */
+  void Publish(bool changed = true);
+
+  /**
+   * Subscribes like nh_.subscribe, and records in the stats how long each
+   * message waited after it was received until its callback returned, which
+   * is when its sample was written, and its serialized size.
+   */
+  template <class M, class T>
+  ros::Subscriber Subscribe(
+                      const std::string& topic,
+                      const unsigned int queue_size,
+                      void (T::*callback)(boost::shared_ptr<M const> const&),
+                      T* obj) {
+    boost::function<void(ros::MessageEvent<M const> const&)> f =
+      [this, callback, obj](ros::MessageEvent<M const> const& event) {
+        boost::shared_ptr<M const> const& msg = event.getConstMessage();
+        (obj->*callback)(msg);
+        stats_.Record((ros::Time::now() - event.getReceiptTime()).toSec(),
+                      ros::serialization::serializationLength(*msg));
+      };
+    ros::SubscribeOptions ops;
+    ops.template initByFullCallbackType<ros::MessageEvent<M const> const&>(
+                                                        topic, queue_size, f);
+    return nh_.subscribe(ops);
+  }
+
+  // Whether the serialized ros value is different from the last one checked
+  template <class T>
+  bool Changed(T const& value) {
+    uint32_t size = ros::serialization::serializationLength(value);
+    std::vector<uint8_t> buffer(size);
+    ros::serialization::OStream stream(buffer.data(), size);
+    ros::serialization::serialize(stream, value);
+    bool changed = (buffer != last_serialized_);
+    last_serialized_.swap(buffer);
+    return changed;
   }
 
   ros::NodeHandle nh_;
@@ -44,6 +107,19 @@ class RosSubRapidPub {
   std::string subscribe_topic_;
   std::string publish_topic_;
   unsigned int queue_size_;
+  TranslatorStats stats_;
+
+ private:
+  void Send();
+  void WindowCallback(ros::TimerEvent const& event);
+  void HeartbeatCallback(ros::TimerEvent const& event);
+
+  std::function<void()> send_;
+  ros::Duration window_, heartbeat_;
+  ros::Time last_sent_;
+  bool pending_;
+  ros::Timer window_timer_, heartbeat_timer_;
+  std::vector<uint8_t> last_serialized_;
 };
 
 typedef std::shared_ptr<ff::RosSubRapidPub> RosSubRapidPubPtr;
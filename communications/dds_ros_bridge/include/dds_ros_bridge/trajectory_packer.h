@@ -0,0 +1,88 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef DDS_ROS_BRIDGE_TRAJECTORY_PACKER_H_
+#define DDS_ROS_BRIDGE_TRAJECTORY_PACKER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace ff {
+
+/**
+ * One pose of a packed trajectory, in seconds, meters and a quaternion
+ * ordered x y z w.
+ */
+struct TrajectoryPose {
+  double time;
+  double position[3];
+  double orientation[4];
+};
+
+/**
+ * TrajectoryPacker resamples pose estimates at a fixed interval and packs
+ * num_poses of them into one packet, so the ground can reconstruct the
+ * motion at the sample rate from packets sent far less often.
+ *
+ * A packet starts with a header giving the time of the first pose, the
+ * interval, the number of poses and the position resolution. The first pose
+ * follows with its position quantized to the resolution and the vector part
+ * of its quaternion, with w positive, quantized to 16 bits. Every other pose
+ * is the zig-zag varint difference of those six values from the pose before.
+ * Samples between estimates are interpolated, and a gap in the estimates
+ * longer than a packet ends the packet early.
+ */
+class TrajectoryPacker {
+ public:
+  TrajectoryPacker(double interval, unsigned int num_poses,
+                   double position_resolution = 1e-4);
+
+  /**
+   * Adds a pose estimate. Returns true when this completes a packet, in which
+   * case it is returned.
+   */
+  bool Add(const TrajectoryPose& pose, std::vector<uint8_t>* packet);
+
+  void Reset();
+
+ private:
+  void Sample(const TrajectoryPose& pose, std::vector<uint8_t>* packet,
+              bool* packed);
+  void Pack(std::vector<uint8_t>* packet);
+
+  int64_t interval_us_, resolution_um_;
+  double interval_, resolution_;
+  unsigned int num_poses_;
+  bool have_last_;
+  double start_;          // of the samples since the last gap
+  int64_t sample_;        // the next one
+  TrajectoryPose last_;
+  std::vector<TrajectoryPose> poses_;
+};
+
+/**
+ * Unpacks a packet made by TrajectoryPacker. Returns false if it is not one.
+ */
+bool UnpackTrajectory(const uint8_t* data, size_t size,
+                      std::vector<TrajectoryPose>* poses);
+
+}  // end namespace ff
+
+#endif  // DDS_ROS_BRIDGE_TRAJECTORY_PACKER_H_
@@ -0,0 +1,70 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef DDS_ROS_BRIDGE_TRANSLATOR_STATS_H_
+#define DDS_ROS_BRIDGE_TRANSLATOR_STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>  // NOLINT
+#include <string>
+
+namespace ff {
+
+/**
+ * TranslatorStats counts the messages a translator handles and their bytes,
+ * and keeps a histogram of how long each spent in the bridge, in buckets
+ * from under a millisecond to over a second. Summary gives the counts and
+ * rates since the last summary along with the latency percentiles since the
+ * start, and resets the rates.
+ */
+class TranslatorStats {
+ public:
+  static const int kNumBuckets = 11;
+
+  TranslatorStats();
+
+  void Record(double latency, size_t bytes);
+
+  /**
+   * Returns a line like "12 msgs 4.0 Hz 1024 B/s p50 2.0ms p99 20.0ms
+   * max 31.2ms", the rates for the last dt seconds since the last call.
+   */
+  std::string Summary(double dt);
+
+  uint64_t Messages() const;
+  uint64_t Bytes() const;
+
+  /**
+   * The upper bound in seconds of the bucket the percentile falls in, or
+   * the largest latency for the last bucket.
+   */
+  double Percentile(double p) const;
+
+ private:
+  mutable std::mutex mutex_;
+  uint64_t messages_, bytes_;
+  uint64_t interval_messages_, interval_bytes_;
+  uint64_t buckets_[kNumBuckets];
+  double max_latency_;
+};
+
+}  // end namespace ff
+
+#endif  // DDS_ROS_BRIDGE_TRANSLATOR_STATS_H_
@@ -49,6 +49,24 @@ namespace util {
                        ::std_msgs::Header* ros_hdr,
                        std::string const& frame_id = "world");
 
+  // Sequence-related helpers
+
+  // Sends a sample whose octet sequence borrows data for the write, which
+  // serializes it, instead of copying it in first. Returns false and sends
+  // nothing if the sequence will not take the loan.
+  template <class Seq, class Send>
+  bool SendLoaned(Seq* seq, const uint8_t* data, size_t size,
+                  Send const& send) {
+    // a sequence only takes a loan while it holds no memory of its own
+    if (seq->has_ownership() && seq->maximum() > 0 && !seq->maximum(0))
+      return false;
+    if (!seq->loan_contiguous(const_cast<uint8_t*>(data), size, size))
+      return false;
+    send();
+    seq->unloan();
+    return true;
+  }
+
 }  // end namespace util
 
 #endif  // DDS_ROS_BRIDGE_UTIL_H_
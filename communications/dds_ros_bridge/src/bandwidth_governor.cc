@@ -0,0 +1,82 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "dds_ros_bridge/bandwidth_governor.h"
+
+#include <algorithm>
+
+namespace ff {
+
+namespace {
+
+// state is never slowed below this fraction of its configured rates
+const double kMinStateScale = 0.1;
+
+// seconds that the measured image throughput is smoothed over
+const double kThroughputTime = 5.0;
+
+}  // namespace
+
+BandwidthGovernor::BandwidthGovernor(double budget, double reserve)
+  : budget_(budget),
+    reserve_(std::min(reserve, budget)),
+    state_load_(0),
+    state_scale_(1),
+    tokens_(0),
+    image_bytes_(0),
+    image_throughput_(0) {
+}
+
+void BandwidthGovernor::SetStateLoad(double load) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  state_load_ = load;
+}
+
+double BandwidthGovernor::Update(double dt) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  double available = budget_ - reserve_;
+  state_scale_ = 1;
+  if (state_load_ > available)
+    state_scale_ = std::max(kMinStateScale, available / state_load_);
+  double image_rate = std::max(0.0, available - state_scale_ * state_load_);
+
+  // no more than a second of allowance is saved up while images are idle
+  tokens_ = std::min(tokens_ + image_rate * dt, image_rate);
+
+  double alpha = std::min(1.0, dt / kThroughputTime);
+  if (dt > 0)
+    image_throughput_ += alpha * (image_bytes_ / dt - image_throughput_);
+  image_bytes_ = 0;
+  return state_scale_;
+}
+
+bool BandwidthGovernor::SendImage(size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (tokens_ <= 0)
+    return false;
+  tokens_ -= bytes;
+  image_bytes_ += bytes;
+  return true;
+}
+
+double BandwidthGovernor::ImageThroughput() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return image_throughput_;
+}
+
+}  // end namespace ff
@@ -0,0 +1,124 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "dds_ros_bridge/command_table.h"
+
+#include <ros/ros.h>
+
+namespace ff {
+
+bool ParseParamType(std::string const& name, rapid::DataType* type) {
+  if (name == "RAPID_STRING") {
+    *type = rapid::RAPID_STRING;
+  } else if (name == "RAPID_INT") {
+    *type = rapid::RAPID_INT;
+  } else if (name == "RAPID_BOOL") {
+    *type = rapid::RAPID_BOOL;
+  } else if (name == "RAPID_FLOAT") {
+    *type = rapid::RAPID_FLOAT;
+  } else if (name == "RAPID_VEC3d") {
+    *type = rapid::RAPID_VEC3d;
+  } else if (name == "RAPID_MAT33f") {
+    *type = rapid::RAPID_MAT33f;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+CommandTable::CommandTable() {
+}
+
+bool CommandTable::Load(config_reader::ConfigReader& config) {
+  commands_.clear();
+  ids_.clear();
+
+  config_reader::ConfigReader::Table cmd_config(&config, "commandConfig");
+  config_reader::ConfigReader::Table subsys_types(&cmd_config,
+                                                  "availableSubsystemTypes");
+  for (int i = 0; i < subsys_types.GetSize(); i++) {
+    config_reader::ConfigReader::Table subsys_type(&subsys_types, (i + 1));
+    config_reader::ConfigReader::Table commands(&subsys_type, "commands");
+    for (int j = 0; j < commands.GetSize(); j++) {
+      config_reader::ConfigReader::Table command(&commands, (j + 1));
+      Command cmd;
+      if (!command.GetStr("name", &cmd.name)) {
+        ROS_FATAL("DDS Bridge: name not listed for cmd %i in subsys type %i",
+                  j, i);
+        return false;
+      }
+
+      config_reader::ConfigReader::Table params(&command, "parameters");
+      cmd.parameters.resize(params.GetSize());
+      for (int k = 0; k < params.GetSize(); k++) {
+        config_reader::ConfigReader::Table param(&params, (k + 1));
+        std::string type;
+        if (!param.GetStr("type", &type) ||
+            !ParseParamType(type, &cmd.parameters[k])) {
+          ROS_FATAL("DDS Bridge: bad type for param %i of command %s!", k,
+                    cmd.name.c_str());
+          return false;
+        }
+      }
+
+      // the same command can be listed for more than one subsystem type, it
+      // has to take the same parameters in each
+      auto it = ids_.find(cmd.name);
+      if (it != ids_.end()) {
+        if (commands_[it->second].parameters != cmd.parameters) {
+          ROS_FATAL("DDS Bridge: command %s is listed with two parameter "
+                    "lists!", cmd.name.c_str());
+          return false;
+        }
+        continue;
+      }
+      ids_[cmd.name] = commands_.size();
+      commands_.push_back(cmd);
+    }
+  }
+  return true;
+}
+
+int CommandTable::Validate(rapid::Command const& cmd,
+                           std::string* err_msg) const {
+  auto it = ids_.find(cmd.cmdName);
+  if (it == ids_.end()) {
+    *err_msg = std::string("Command ") + cmd.cmdName +
+               " is not in the command config.";
+    return -1;
+  }
+
+  Command const& def = commands_[it->second];
+  if (cmd.arguments.length() != static_cast<int>(def.parameters.size())) {
+    *err_msg = "Command " + def.name + " takes " +
+               std::to_string(def.parameters.size()) + " arguments, not " +
+               std::to_string(cmd.arguments.length()) + ".";
+    return -1;
+  }
+
+  for (size_t i = 0; i < def.parameters.size(); i++) {
+    if (cmd.arguments[i]._d != def.parameters[i]) {
+      *err_msg = "Argument " + std::to_string(i + 1) + " of command " +
+                 def.name + " has the wrong type.";
+      return -1;
+    }
+  }
+  return it->second;
+}
+
+}  // end namespace ff
@@ -18,6 +18,8 @@
 
 #include "dds_ros_bridge/dds_ros_bridge.h"
 
+#include <cmath>
+
 namespace {
 
 typedef std::vector<kn::DdsNodeParameters> NodeVector;
@@ -54,19 +56,30 @@ namespace dds_ros_bridge {
 DdsRosBridge::DdsRosBridge() :
   ff_util::FreeFlyerNodelet(NODE_DDS_ROS_BRIDGE, true),
   components_(0),
-  agent_name_("Bumble") {
+  translation_threads_(false),
+  agent_name_("Bumble"),
+  telemetry_scale_(1) {
 }
 
 DdsRosBridge::~DdsRosBridge() {
+  for (std::shared_ptr<ros::AsyncSpinner> const& spinner : spinners_)
+    spinner->stop();
+}
+
+ros::NodeHandle DdsRosBridge::PriorityHandle(Priority priority) {
+  ros::NodeHandle nh = nh_;
+  if (translation_threads_)
+    nh.setCallbackQueue(&queues_[priority]);
+  return nh;
 }
 
 int DdsRosBridge::BuildAccessControlStateToRapid(const std::string& sub_topic,
                                                  const std::string& pub_topic,
                                                  const std::string& name) {
   ff::RosSubRapidPubPtr acs_to_acs(
-                                new ff::RosAccessControlStateToRapid(sub_topic,
-                                                                     pub_topic,
-                                                                     nh_));
+      new ff::RosAccessControlStateToRapid(sub_topic,
+                                           pub_topic,
+                                           PriorityHandle(CRITICAL)));
   ros_sub_rapid_pubs_[name] = acs_to_acs;
   return ros_sub_rapid_pubs_.size();
 }
@@ -74,9 +87,12 @@ int DdsRosBridge::BuildAccessControlStateToRapid(const std::string& sub_topic,
 int DdsRosBridge::BuildAckToRapid(const std::string& sub_topic,
                                   const std::string& pub_topic,
                                   const std::string& name) {
-  ff::RosSubRapidPubPtr ack_to_ack(new ff::RosAckToRapid(sub_topic,
-                                                         pub_topic,
-                                                         nh_));
+  ff::RosSubRapidPubPtr ack_to_ack(
+      new ff::RosAckToRapid(sub_topic,
+                            pub_topic,
+                            PriorityHandle(CRITICAL),
+                            10,
+                            latency_probe_));
   ros_sub_rapid_pubs_[name] = ack_to_ack;
   return ros_sub_rapid_pubs_.size();
 }
@@ -84,9 +100,10 @@ int DdsRosBridge::BuildAckToRapid(const std::string& sub_topic,
 int DdsRosBridge::BuildAgentStateToRapid(const std::string& sub_topic,
                                          const std::string& pub_topic,
                                          const std::string& name) {
-  ff::RosSubRapidPubPtr agent_to_agent(new ff::RosAgentStateToRapid(sub_topic,
-                                                                    pub_topic,
-                                                                    nh_));
+  ff::RosSubRapidPubPtr agent_to_agent(
+      new ff::RosAgentStateToRapid(sub_topic,
+                                   pub_topic,
+                                   PriorityHandle(STATE)));
   ros_sub_rapid_pubs_[name] = agent_to_agent;
   return ros_sub_rapid_pubs_.size();
 }
@@ -95,9 +112,9 @@ int DdsRosBridge::BuildArmJointSampleToRapid(const std::string& sub_topic,
                                              const std::string& pub_topic,
                                              const std::string& name) {
   ff::RosSubRapidPubPtr joint_to_joint(
-                                    new ff::RosArmJointSampleToRapid(sub_topic,
-                                                                     pub_topic,
-                                                                     nh_));
+      new ff::RosArmJointSampleToRapid(sub_topic,
+                                       pub_topic,
+                                       PriorityHandle(STATE)));
   ros_sub_rapid_pubs_[name] = joint_to_joint;
   return ros_sub_rapid_pubs_.size();
 }
@@ -105,9 +122,10 @@ int DdsRosBridge::BuildArmJointSampleToRapid(const std::string& sub_topic,
 int DdsRosBridge::BuildArmStateToRapid(const std::string& sub_topic,
                                        const std::string& pub_topic,
                                        const std::string& name) {
-  ff::RosSubRapidPubPtr arm_to_arm(new ff::RosArmStateToRapid(sub_topic,
-                                                              pub_topic,
-                                                              nh_));
+  ff::RosSubRapidPubPtr arm_to_arm(
+      new ff::RosArmStateToRapid(sub_topic,
+                                 pub_topic,
+                                 PriorityHandle(STATE)));
   ros_sub_rapid_pubs_[name] = arm_to_arm;
   return ros_sub_rapid_pubs_.size();
 }
@@ -133,18 +151,25 @@ int DdsRosBridge::BuildBatteryStateToRapid(
                                                      sub_topic_battery_temp_BL,
                                                      sub_topic_battery_temp_BR,
                                                      pub_topic,
-                                                     nh_));
+                                                     PriorityHandle(STATE)));
   ros_sub_rapid_pubs_[name] = battery_to_battery;
   return ros_sub_rapid_pubs_.size();
 }
 
 int DdsRosBridge::BuildCompressedImageToImage(const std::string& sub_topic,
                                               const std::string& pub_topic,
-                                              const std::string& name) {
+                                              const std::string& name,
+                                              unsigned int chunk_size,
+                                              float chunk_rate,
+                                              const std::string& transport) {
   ff::RosSubRapidPubPtr compressed_image_to_image(
-                                new ff::RosCompressedImageRapidImage(sub_topic,
-                                                                     pub_topic,
-                                                                     nh_));
+      new ff::RosCompressedImageRapidImage(sub_topic,
+                                           pub_topic,
+                                           PriorityHandle(BULK),
+                                           10,
+                                           chunk_size,
+                                           chunk_rate,
+                                           transport));
   ros_sub_rapid_pubs_[name] = compressed_image_to_image;
   return ros_sub_rapid_pubs_.size();
 }
@@ -152,9 +177,10 @@ int DdsRosBridge::BuildCompressedImageToImage(const std::string& sub_topic,
 int DdsRosBridge::BuildCpuStateToRapid(const std::string& sub_topic,
                                        const std::string& pub_topic,
                                        const std::string& name) {
-  ff::RosSubRapidPubPtr cpu_to_cpu(new ff::RosCpuStateToRapid(sub_topic,
-                                                              pub_topic,
-                                                              nh_));
+  ff::RosSubRapidPubPtr cpu_to_cpu(
+      new ff::RosCpuStateToRapid(sub_topic,
+                                 pub_topic,
+                                 PriorityHandle(STATE)));
   ros_sub_rapid_pubs_[name] = cpu_to_cpu;
   return ros_sub_rapid_pubs_.size();
 }
@@ -165,10 +191,10 @@ int DdsRosBridge::BuildDataToDiskStateToRapid(
                                             const std::string& pub_topic,
                                             const std::string& name) {
   ff::RosSubRapidPubPtr data_to_disk_to_data_to_disk(
-                                  new ff::RosDataToDiskToRapid(state_sub_topic,
-                                                               topics_sub_topic,
-                                                               pub_topic,
-                                                               nh_));
+      new ff::RosDataToDiskToRapid(state_sub_topic,
+                                   topics_sub_topic,
+                                   pub_topic,
+                                   PriorityHandle(STATE)));
   ros_sub_rapid_pubs_[name] = data_to_disk_to_data_to_disk;
   return ros_sub_rapid_pubs_.size();
 }
@@ -176,9 +202,10 @@ int DdsRosBridge::BuildDataToDiskStateToRapid(
 int DdsRosBridge::BuildDiskStateToRapid(const std::string& sub_topic,
                                         const std::string& pub_topic,
                                         const std::string& name) {
-  ff::RosSubRapidPubPtr disk_to_disk(new ff::RosDiskStateToRapid(sub_topic,
-                                                                 pub_topic,
-                                                                 nh_));
+  ff::RosSubRapidPubPtr disk_to_disk(
+      new ff::RosDiskStateToRapid(sub_topic,
+                                  pub_topic,
+                                  PriorityHandle(STATE)));
   ros_sub_rapid_pubs_[name] = disk_to_disk;
   return ros_sub_rapid_pubs_.size();
 }
@@ -186,9 +213,10 @@ int DdsRosBridge::BuildDiskStateToRapid(const std::string& sub_topic,
 int DdsRosBridge::BuildFaultConfigToRapid(const std::string& sub_topic,
                                           const std::string& pub_topic,
                                           const std::string& name) {
-  ff::RosSubRapidPubPtr fault_to_fault(new ff::RosFaultConfigToRapid(sub_topic,
-                                                                     pub_topic,
-                                                                     nh_));
+  ff::RosSubRapidPubPtr fault_to_fault(
+      new ff::RosFaultConfigToRapid(sub_topic,
+                                    pub_topic,
+                                    PriorityHandle(CRITICAL)));
   ros_sub_rapid_pubs_[name] = fault_to_fault;
   return ros_sub_rapid_pubs_.size();
 }
@@ -196,9 +224,10 @@ int DdsRosBridge::BuildFaultConfigToRapid(const std::string& sub_topic,
 int DdsRosBridge::BuildFaultStateToRapid(const std::string& sub_topic,
                                          const std::string& pub_topic,
                                          const std::string& name) {
-  ff::RosSubRapidPubPtr fault_to_fault(new ff::RosFaultStateToRapid(sub_topic,
-                                                                    pub_topic,
-                                                                    nh_));
+  ff::RosSubRapidPubPtr fault_to_fault(
+      new ff::RosFaultStateToRapid(sub_topic,
+                                   pub_topic,
+                                   PriorityHandle(CRITICAL)));
   ros_sub_rapid_pubs_[name] = fault_to_fault;
   return ros_sub_rapid_pubs_.size();
 }
@@ -207,9 +236,9 @@ int DdsRosBridge::BuildGncFamCmdStateToRapid(const std::string& sub_topic,
                                              const std::string& pub_topic,
                                              const std::string& name) {
   ff::RosSubRapidPubPtr gnc_fam_cmd_to_gnc_fam_cmd(
-                                    new ff::RosGncFamCmdStateToRapid(sub_topic,
-                                                                     pub_topic,
-                                                                     nh_));
+      new ff::RosGncFamCmdStateToRapid(sub_topic,
+                                       pub_topic,
+                                       PriorityHandle(STATE)));
   ros_sub_rapid_pubs_[name] = gnc_fam_cmd_to_gnc_fam_cmd;
   return ros_sub_rapid_pubs_.size();
 }
@@ -218,9 +247,9 @@ int DdsRosBridge::BuildGncControlStateToRapid(const std::string& sub_topic,
                                               const std::string& pub_topic,
                                               const std::string& name) {
   ff::RosSubRapidPubPtr gnc_control_to_gnc_control(
-                                    new ff::RosGncControlStateToRapid(sub_topic,
-                                                                      pub_topic,
-                                                                      nh_));
+      new ff::RosGncControlStateToRapid(sub_topic,
+                                        pub_topic,
+                                        PriorityHandle(STATE)));
   ros_sub_rapid_pubs_[name] = gnc_control_to_gnc_control;
   return ros_sub_rapid_pubs_.size();
 }
@@ -231,11 +260,11 @@ int DdsRosBridge::BuildGuestScienceToRapid(const std::string& state_sub_topic,
                                            const std::string& pub_topic,
                                            const std::string& name) {
   ff::RosSubRapidPubPtr guest_science_to_guest_science(
-                                new ff::RosGuestScienceToRapid(state_sub_topic,
-                                                               config_sub_topic,
-                                                               data_sub_topic,
-                                                               pub_topic,
-                                                               nh_));
+      new ff::RosGuestScienceToRapid(state_sub_topic,
+                                     config_sub_topic,
+                                     data_sub_topic,
+                                     pub_topic,
+                                     PriorityHandle(STATE)));
   ros_sub_rapid_pubs_[name] = guest_science_to_guest_science;
   return ros_sub_rapid_pubs_.size();
 }
@@ -243,9 +272,10 @@ int DdsRosBridge::BuildGuestScienceToRapid(const std::string& state_sub_topic,
 int DdsRosBridge::BuildOdomToPosition(const std::string& sub_topic,
                                       const std::string& pub_topic,
                                       const std::string& name) {
-  ff::RosSubRapidPubPtr odom_to_position(new ff::RosOdomRapidPosition(sub_topic,
-                                                                      pub_topic,
-                                                                      nh_));
+  ff::RosSubRapidPubPtr odom_to_position(
+      new ff::RosOdomRapidPosition(sub_topic,
+                                   pub_topic,
+                                   PriorityHandle(STATE)));
   ros_sub_rapid_pubs_[name] = odom_to_position;
   return ros_sub_rapid_pubs_.size();
 }
@@ -254,9 +284,9 @@ int DdsRosBridge::BuildPlanStatusToPlanStatus(const std::string& sub_topic,
                                               const std::string& pub_topic,
                                               const std::string& name) {
   ff::RosSubRapidPubPtr plan_status_to_plan_status(
-                                new ff::RosPlanStatusRapidPlanStatus(sub_topic,
-                                                                     pub_topic,
-                                                                     nh_));
+      new ff::RosPlanStatusRapidPlanStatus(sub_topic,
+                                           pub_topic,
+                                           PriorityHandle(STATE)));
   ros_sub_rapid_pubs_[name] = plan_status_to_plan_status;
   return ros_sub_rapid_pubs_.size();
 }
@@ -264,9 +294,10 @@ int DdsRosBridge::BuildPlanStatusToPlanStatus(const std::string& sub_topic,
 int DdsRosBridge::BuildStringToTextMessage(const std::string& sub_topic,
                                            const std::string& pub_topic,
                                            const std::string& name) {
-  ff::RosSubRapidPubPtr str_to_text(new ff::RosStringRapidTextMessage(sub_topic,
-                                                                      pub_topic,
-                                                                      nh_));
+  ff::RosSubRapidPubPtr str_to_text(
+      new ff::RosStringRapidTextMessage(sub_topic,
+                                        pub_topic,
+                                        PriorityHandle(STATE)));
   ros_sub_rapid_pubs_[name] = str_to_text;
   return ros_sub_rapid_pubs_.size();
 }
@@ -275,21 +306,26 @@ int DdsRosBridge::BuildTelemetryToRapid(const std::string& sub_topic,
                                         const std::string& pub_topic,
                                         const std::string& name) {
   ff::RosSubRapidPubPtr telemetry_to_telemetry(
-                            new ff::RosTelemetryRapidTelemetry(sub_topic,
-                                                               pub_topic,
-                                                               nh_,
-                                                               config_params_));
+      new ff::RosTelemetryRapidTelemetry(sub_topic,
+                                         pub_topic,
+                                         PriorityHandle(STATE),
+                                         config_params_));
   ros_sub_rapid_pubs_[name] = telemetry_to_telemetry;
   return ros_sub_rapid_pubs_.size();
 }
 
-int DdsRosBridge::BuildCommandToCommand(const std::string& sub_topic,
-                                        const std::string& pub_topic,
-                                        const std::string& name) {
+int DdsRosBridge::BuildCommandToCommand(
+                                  const std::string& sub_topic,
+                                  const std::string& pub_topic,
+                                  const std::string& name,
+                                  std::shared_ptr<ff::CommandTable> table) {
   ff::RapidSubRosPubPtr command_to_command(
-                                      new ff::RapidCommandRosCommand(sub_topic,
-                                                                     pub_topic,
-                                                                     nh_));
+      new ff::RapidCommandRosCommand(sub_topic,
+                                     pub_topic,
+                                     PriorityHandle(CRITICAL),
+                                     10,
+                                     table,
+                                     latency_probe_));
   rapid_sub_ros_pubs_.push_back(command_to_command);
   return rapid_sub_ros_pubs_.size();
 }
@@ -297,11 +333,16 @@ int DdsRosBridge::BuildCommandToCommand(const std::string& sub_topic,
 int DdsRosBridge::BuildCompressedFileToCompressedFile(
                                                   const std::string& sub_topic,
                                                   const std::string& pub_topic,
-                                                  const std::string& name) {
+                                                  const std::string& name,
+                                                  unsigned int transfer_memory,
+                                                  float transfer_timeout) {
   ff::RapidSubRosPubPtr compressed_file_to_compressed_file(
-                        new ff::RapidCompressedFileRosCompressedFile(sub_topic,
-                                                                     pub_topic,
-                                                                     nh_));
+      new ff::RapidCompressedFileRosCompressedFile(sub_topic,
+                                                   pub_topic,
+                                                   PriorityHandle(BULK),
+                                                   10,
+                                                   transfer_memory,
+                                                   transfer_timeout));
   rapid_sub_ros_pubs_.push_back(compressed_file_to_compressed_file);
   return rapid_sub_ros_pubs_.size();
 }
@@ -310,9 +351,9 @@ int DdsRosBridge::BuildCompressedFileToRapid(const std::string& sub_topic,
                                              const std::string& pub_topic,
                                              const std::string& name) {
   ff::RosSubRapidPubPtr compressed_file_to_rapid(
-                                    new ff::RosCompressedFileToRapid(sub_topic,
-                                                                     pub_topic,
-                                                                     nh_));
+      new ff::RosCompressedFileToRapid(sub_topic,
+                                       pub_topic,
+                                       PriorityHandle(BULK)));
   ros_sub_rapid_pubs_[name] = compressed_file_to_rapid;
   return ros_sub_rapid_pubs_.size();
 }
@@ -321,9 +362,9 @@ int DdsRosBridge::BuildCompressedFileAckToRapid(const std::string& sub_topic,
                                                 const std::string& pub_topic,
                                                 const std::string& name) {
   ff::RosSubRapidPubPtr compressed_file_ack_to_rapid(
-                                  new ff::RosCompressedFileAckToRapid(sub_topic,
-                                                                      pub_topic,
-                                                                      nh_));
+      new ff::RosCompressedFileAckToRapid(sub_topic,
+                                          pub_topic,
+                                          PriorityHandle(CRITICAL)));
   ros_sub_rapid_pubs_[name] = compressed_file_ack_to_rapid;
   return ros_sub_rapid_pubs_.size();
 }
@@ -495,6 +536,14 @@ void DdsRosBridge::Initialize(ros::NodeHandle *nh) {
     exit(EXIT_FAILURE);
     return;
   }
+
+  // One thread per priority, started once everything is subscribed
+  if (translation_threads_) {
+    for (int i = 0; i < NUM_PRIORITIES; i++) {
+      spinners_.push_back(std::make_shared<ros::AsyncSpinner>(1, &queues_[i]));
+      spinners_.back()->start();
+    }
+  }
 }
 
 bool DdsRosBridge::ReadParams() {
@@ -504,6 +553,21 @@ bool DdsRosBridge::ReadParams() {
 
   components_ = 0;
 
+  if (!config_params_.GetBool("translation_threads", &translation_threads_)) {
+    ROS_FATAL("DDS Bridge: translation threads not specified!");
+    return false;
+  }
+
+  // No op commands from the ground can be timed through the robot and back
+  bool latency_probe;
+  if (!config_params_.GetBool("latency_probe", &latency_probe)) {
+    ROS_FATAL("DDS Bridge: latency probe not specified!");
+    return false;
+  }
+
+  if (latency_probe)
+    latency_probe_ = std::make_shared<ff::LatencyProbe>();
+
   // rapid_command_ros_command => RCRC
   if (!config_params_.GetBool("use_RCRC", &use)) {
     ROS_FATAL("DDS Bridge: use RCRC not specified");
@@ -516,10 +580,40 @@ bool DdsRosBridge::ReadParams() {
       return false;
     }
 
-    BuildCommandToCommand(sub_topic, TOPIC_COMMUNICATIONS_DDS_COMMAND, "RCRC");
+    // Commands can be checked against the command config before they are
+    // passed on
+    bool validate;
+    if (!config_params_.GetBool("validate_commands", &validate)) {
+      ROS_FATAL("DDS Bridge: validate commands not specified!");
+      return false;
+    }
+
+    std::shared_ptr<ff::CommandTable> table;
+    if (validate) {
+      table = std::make_shared<ff::CommandTable>();
+      if (!table->Load(config_params_))
+        return false;
+    }
+
+    BuildCommandToCommand(sub_topic, TOPIC_COMMUNICATIONS_DDS_COMMAND, "RCRC",
+                          table);
     components_++;
   }
 
+  // Compressed files sent in chunks are put back together in this much memory
+  unsigned int file_transfer_memory;
+  float file_transfer_timeout;
+  if (!config_params_.GetUInt("file_transfer_memory", &file_transfer_memory)) {
+    ROS_FATAL("DDS Bridge: file transfer memory not specified!");
+    return false;
+  }
+
+  if (!config_params_.GetReal("file_transfer_timeout",
+                              &file_transfer_timeout)) {
+    ROS_FATAL("DDS Bridge: file transfer timeout not specified!");
+    return false;
+  }
+
   // rapid_compressed_file_plan_ros_compressed_file_plan => RCFPRCFP
   if (!config_params_.GetBool("use_RCFPRCFP", &use)) {
     ROS_FATAL("DDS Bridge: use RCFPRCFP not specified!");
@@ -534,7 +628,9 @@ bool DdsRosBridge::ReadParams() {
 
     BuildCompressedFileToCompressedFile(sub_topic,
                                         TOPIC_COMMUNICATIONS_DDS_PLAN,
-                                        "RCFPRCFP");
+                                        "RCFPRCFP",
+                                        file_transfer_memory,
+                                        file_transfer_timeout);
     components_++;
   } else {
     ROS_INFO("Not bridging plan compressed files");
@@ -554,7 +650,9 @@ bool DdsRosBridge::ReadParams() {
 
     BuildCompressedFileToCompressedFile(sub_topic,
                                         TOPIC_COMMUNICATIONS_DDS_ZONES,
-                                        "RCFZRCFZ");
+                                        "RCFZRCFZ",
+                                        file_transfer_memory,
+                                        file_transfer_timeout);
     components_++;
   } else {
     ROS_INFO("Not bridging zone compressed files!");
@@ -725,6 +823,50 @@ bool DdsRosBridge::ReadParams() {
     components_++;
   }
 
+  // With a downlink budget, the governor shares it between faults and acks,
+  // state telemetry and images, in that order
+  float downlink_budget, downlink_reserve, downlink_state_sample_size;
+  if (!config_params_.GetReal("downlink_budget", &downlink_budget)) {
+    ROS_FATAL("DDS Bridge: downlink budget not specified!");
+    return false;
+  }
+
+  if (!config_params_.GetReal("downlink_reserve", &downlink_reserve)) {
+    ROS_FATAL("DDS Bridge: downlink reserve not specified!");
+    return false;
+  }
+
+  if (!config_params_.GetReal("downlink_state_sample_size",
+                              &downlink_state_sample_size)) {
+    ROS_FATAL("DDS Bridge: downlink state sample size not specified!");
+    return false;
+  }
+
+  if (downlink_budget > 0)
+    governor_.reset(new ff::BandwidthGovernor(downlink_budget,
+                                              downlink_reserve));
+
+  // Images larger than the chunk size are sent in fragments
+  unsigned int image_chunk_size;
+  float image_chunk_rate;
+  if (!config_params_.GetUInt("image_chunk_size", &image_chunk_size)) {
+    ROS_FATAL("DDS Bridge: image chunk size not specified!");
+    return false;
+  }
+
+  if (!config_params_.GetReal("image_chunk_rate", &image_chunk_rate)) {
+    ROS_FATAL("DDS Bridge: image chunk rate not specified!");
+    return false;
+  }
+
+  // The cameras can be sent as the image sampler's video instead of JPEG
+  bool image_video;
+  if (!config_params_.GetBool("image_video", &image_video)) {
+    ROS_FATAL("DDS Bridge: image video not specified!");
+    return false;
+  }
+  std::string image_transport = (image_video ? "video" : "compressed");
+
   // ros_compressed_dock_cam_image_rapid_image => RCDCIRI
   if (!config_params_.GetBool("use_RCDCIRI", &use)) {
     ROS_FATAL("DDS Bridge: use RCDCIRI not specified!");
@@ -739,7 +881,13 @@ bool DdsRosBridge::ReadParams() {
 
     BuildCompressedImageToImage(TOPIC_MANAGEMENT_IMG_SAMPLER_DOCK_CAM_STREAM,
                                 pub_topic,
-                                "RCDCIRI");
+                                "RCDCIRI",
+                                image_chunk_size,
+                                image_chunk_rate,
+                                image_transport);
+    if (governor_)
+      static_cast<ff::RosCompressedImageRapidImage *>(
+                  ros_sub_rapid_pubs_["RCDCIRI"].get())->SetGovernor(governor_);
     components_++;
   }
 
@@ -757,7 +905,13 @@ bool DdsRosBridge::ReadParams() {
 
     BuildCompressedImageToImage(TOPIC_MANAGEMENT_IMG_SAMPLER_NAV_CAM_STREAM,
                                 pub_topic,
-                                "RCNCIRI");
+                                "RCNCIRI",
+                                image_chunk_size,
+                                image_chunk_rate,
+                                image_transport);
+    if (governor_)
+      static_cast<ff::RosCompressedImageRapidImage *>(
+                  ros_sub_rapid_pubs_["RCNCIRI"].get())->SetGovernor(governor_);
     components_++;
   }
 
@@ -992,105 +1146,95 @@ bool DdsRosBridge::ReadParams() {
     components_++;
   }
 
+  return ReadTelemetryParams(downlink_state_sample_size) && ReadStateParams();
+}
+
+bool DdsRosBridge::ReadTelemetryParams(float downlink_state_sample_size) {
   // Read in the telemetery rates so the bridge knows how often to publish
   // the telemmetry messages
-  float temp_rate;
   if (ros_sub_rapid_pubs_.count("RTRT") == 0) {
     ROS_ERROR("DDS Bridge: Telemetry msg stuff not added and it is needed!");
     return false;
   }
-  ff::RosTelemetryRapidTelemetry *RTRT =
-                                  static_cast<ff::RosTelemetryRapidTelemetry *>
-                                  (ros_sub_rapid_pubs_["RTRT"].get());
 
   if (ros_sub_rapid_pubs_.count("RCSRCS") == 0) {
     ROS_ERROR("DDS Bridge: Cpu state stuff not added and it is needed!");
     return false;
   }
-  ff::RosCpuStateToRapid *RCSR = static_cast<ff::RosCpuStateToRapid *>
-                                          (ros_sub_rapid_pubs_["RCSRCS"].get());
 
   if (ros_sub_rapid_pubs_.count("RDSRDS") == 0) {
     ROS_ERROR("DDS Bridge: Disk state stuff not added and it is needed!");
     return false;
   }
-  ff::RosDiskStateToRapid *RDSR = static_cast<ff::RosDiskStateToRapid *>
-                                          (ros_sub_rapid_pubs_["RDSRDS"].get());
 
   if (ros_sub_rapid_pubs_.count("RGCCRGCC") == 0) {
     ROS_ERROR("DDS Bridge: GNC control command stuff not added and is needed!");
     return false;
   }
-  ff::RosGncFamCmdStateToRapid *RGCC =
-                                    static_cast<ff::RosGncFamCmdStateToRapid *>
-                                    (ros_sub_rapid_pubs_["RGCCRGCC"].get());
 
   if (ros_sub_rapid_pubs_.count("RGCSRGCS") == 0) {
     ROS_ERROR("DDS Bridge: GNC control shaper stuff not added and is needed!");
     return false;
   }
-  ff::RosGncControlStateToRapid *RGCS =
-                                    static_cast<ff::RosGncControlStateToRapid *>
-                                    (ros_sub_rapid_pubs_["RGCSRGCS"].get());
 
   if (ros_sub_rapid_pubs_.count("RGCTRGCT") == 0) {
     ROS_ERROR("DDS Bridge: GNC control trajectory not added and it is needed!");
     return false;
   }
-  ff::RosGncControlStateToRapid *RGCT =
-                                    static_cast<ff::RosGncControlStateToRapid *>
-                                    (ros_sub_rapid_pubs_["RGCTRGCT"].get());
 
   if (ros_sub_rapid_pubs_.count("RORP") == 0) {
     ROS_ERROR("DDS Bridge: Odometry stuff not added and it is needed!");
     return false;
   }
-  ff::RosOdomRapidPosition *RORP = static_cast<ff::RosOdomRapidPosition *>
-                                            (ros_sub_rapid_pubs_["RORP"].get());
 
-  if (!config_params_.GetReal("comm_status_rate", &temp_rate)) {
+  if (!config_params_.GetReal("comm_status_rate", &comm_status_rate_)) {
     ROS_FATAL("DDS Bridge: comm state rate not specified!");
     return false;
   }
-  RTRT->SetCommStatusRate(temp_rate);
 
-  if (!config_params_.GetReal("cpu_state_rate", &temp_rate)) {
+  if (!config_params_.GetReal("cpu_state_rate", &cpu_state_rate_)) {
     ROS_FATAL("DDS Bridge: cpu state rate not specified!");
     return false;
   }
-  RTRT->SetCpuStateRate(temp_rate);
-  RCSR->SetPublishRate(temp_rate);
 
-  if (!config_params_.GetReal("disk_state_rate", &temp_rate)) {
+  if (!config_params_.GetReal("disk_state_rate", &disk_state_rate_)) {
     ROS_FATAL("DDS Bridge: disk state rate not specified!");
     return false;
   }
-  RTRT->SetDiskStateRate(temp_rate);
-  RDSR->SetPublishRate(temp_rate);
 
-  if (!config_params_.GetReal("ekf_state_rate", &temp_rate)) {
+  if (!config_params_.GetReal("ekf_state_rate", &ekf_state_rate_)) {
     ROS_FATAL("DDS Bridge: ekf state rate not specified!");
     return false;
   }
-  RTRT->SetEkfStateRate(temp_rate);
-  RORP->SetEkfPublishRate(temp_rate);
 
-  if (!config_params_.GetReal("gnc_state_rate", &temp_rate)) {
+  if (!config_params_.GetReal("gnc_state_rate", &gnc_state_rate_)) {
     ROS_FATAL("DDS Bridge: gnc state rate not specified!");
     return false;
   }
-  RTRT->SetGncStateRate(temp_rate);
-  RGCC->SetGncPublishRate(temp_rate);
-  RGCS->SetGncPublishRate(temp_rate);
-  RGCT->SetGncPublishRate(temp_rate);
 
-  if (!config_params_.GetReal("position_rate", &temp_rate)) {
+  if (!config_params_.GetReal("position_rate", &position_rate_)) {
     ROS_FATAL("DDS Bridge: position rate not specified!");
     return false;
   }
-  RTRT->SetPositionRate(temp_rate);
-  RORP->SetPositionPublishRate(temp_rate);
 
+  SetTelemetryRates(1.0);
+
+  // The governor is told how much the state telemetry takes at the configured
+  // rates, three gnc messages go out at the gnc rate
+  if (governor_) {
+    governor_->SetStateLoad(downlink_state_sample_size *
+                            (cpu_state_rate_ + disk_state_rate_ +
+                             ekf_state_rate_ + 3 * gnc_state_rate_ +
+                             position_rate_));
+    governor_timer_ = nh_.createTimer(ros::Rate(1.0),
+                                      &DdsRosBridge::GovernorCallback,
+                                      this);
+  }
+
+  return true;
+}
+
+bool DdsRosBridge::ReadStateParams() {
   // Read in the multiple that the battery estimated time remaining needs to be
   // rounded to.
   int multiple;
@@ -1109,9 +1253,147 @@ bool DdsRosBridge::ReadParams() {
 
   RBSRBS->SetBatteryTimeMultiple(multiple);
 
+  // Fault and battery states are sent when they change, and can be coalesced
+  float coalesce_window, coalesce_heartbeat;
+  if (!config_params_.GetReal("coalesce_window", &coalesce_window)) {
+    ROS_FATAL("DDS Bridge: coalesce window not specified!");
+    return false;
+  }
+
+  if (!config_params_.GetReal("coalesce_heartbeat", &coalesce_heartbeat)) {
+    ROS_FATAL("DDS Bridge: coalesce heartbeat not specified!");
+    return false;
+  }
+
+  ros_sub_rapid_pubs_["RBSRBS"]->SetCoalescing(coalesce_window,
+                                               coalesce_heartbeat);
+  if (ros_sub_rapid_pubs_.count("RFSRFS") != 0)
+    ros_sub_rapid_pubs_["RFSRFS"]->SetCoalescing(coalesce_window,
+                                                 coalesce_heartbeat);
+
+  // The pose can also be sent as a packed trajectory
+  float trajectory_rate;
+  int trajectory_poses;
+  if (!config_params_.GetReal("trajectory_rate", &trajectory_rate)) {
+    ROS_FATAL("DDS Bridge: trajectory rate not specified!");
+    return false;
+  }
+
+  if (!config_params_.GetInt("trajectory_poses", &trajectory_poses)) {
+    ROS_FATAL("DDS Bridge: trajectory poses not specified!");
+    return false;
+  }
+
+  if (ros_sub_rapid_pubs_.count("RORP") != 0) {
+    ff::RosOdomRapidPosition *RORP = static_cast<ff::RosOdomRapidPosition *>
+                                            (ros_sub_rapid_pubs_["RORP"].get());
+    RORP->SetTrajectory(trajectory_rate, trajectory_poses);
+  }
+
+  // How often the stats of the translators are sent as diagnostics
+  float stats_rate;
+  if (!config_params_.GetReal("stats_rate", &stats_rate)) {
+    ROS_FATAL("DDS Bridge: stats rate not specified!");
+    return false;
+  }
+
+  if (stats_rate > 0)
+    stats_timer_ = nh_.createTimer(ros::Rate(stats_rate),
+                                   &DdsRosBridge::StatsCallback,
+                                   this);
+
   return true;
 }
 
+void DdsRosBridge::SetTelemetryRates(float scale) {
+  telemetry_scale_ = scale;
+
+  ff::RosTelemetryRapidTelemetry *RTRT =
+                                  static_cast<ff::RosTelemetryRapidTelemetry *>
+                                  (ros_sub_rapid_pubs_["RTRT"].get());
+  ff::RosCpuStateToRapid *RCSR = static_cast<ff::RosCpuStateToRapid *>
+                                          (ros_sub_rapid_pubs_["RCSRCS"].get());
+  ff::RosDiskStateToRapid *RDSR = static_cast<ff::RosDiskStateToRapid *>
+                                          (ros_sub_rapid_pubs_["RDSRDS"].get());
+  ff::RosGncFamCmdStateToRapid *RGCC =
+                                    static_cast<ff::RosGncFamCmdStateToRapid *>
+                                    (ros_sub_rapid_pubs_["RGCCRGCC"].get());
+  ff::RosGncControlStateToRapid *RGCS =
+                                    static_cast<ff::RosGncControlStateToRapid *>
+                                    (ros_sub_rapid_pubs_["RGCSRGCS"].get());
+  ff::RosGncControlStateToRapid *RGCT =
+                                    static_cast<ff::RosGncControlStateToRapid *>
+                                    (ros_sub_rapid_pubs_["RGCTRGCT"].get());
+  ff::RosOdomRapidPosition *RORP = static_cast<ff::RosOdomRapidPosition *>
+                                            (ros_sub_rapid_pubs_["RORP"].get());
+
+  RTRT->SetCommStatusRate(comm_status_rate_ * scale);
+
+  RTRT->SetCpuStateRate(cpu_state_rate_ * scale);
+  RCSR->SetPublishRate(cpu_state_rate_ * scale);
+
+  RTRT->SetDiskStateRate(disk_state_rate_ * scale);
+  RDSR->SetPublishRate(disk_state_rate_ * scale);
+
+  RTRT->SetEkfStateRate(ekf_state_rate_ * scale);
+  RORP->SetEkfPublishRate(ekf_state_rate_ * scale);
+
+  RTRT->SetGncStateRate(gnc_state_rate_ * scale);
+  RGCC->SetGncPublishRate(gnc_state_rate_ * scale);
+  RGCS->SetGncPublishRate(gnc_state_rate_ * scale);
+  RGCT->SetGncPublishRate(gnc_state_rate_ * scale);
+
+  RTRT->SetPositionRate(position_rate_ * scale);
+  RORP->SetPositionPublishRate(position_rate_ * scale);
+}
+
+void DdsRosBridge::GovernorCallback(ros::TimerEvent const& event) {
+  double dt = (event.current_real - event.last_real).toSec();
+  if (event.last_real.isZero())
+    dt = 1.0;
+  float scale = governor_->Update(dt);
+  // only change the rates when it matters, each change restarts the timers
+  if (std::abs(scale - telemetry_scale_) > 0.05 * telemetry_scale_) {
+    ROS_INFO("DDS Bridge: Telemetry rates scaled by %.2f for the downlink",
+             scale);
+    SetTelemetryRates(scale);
+  }
+  ROS_DEBUG("DDS Bridge: Image downlink %.0f bytes per second",
+            governor_->ImageThroughput());
+}
+
+void DdsRosBridge::StatsCallback(ros::TimerEvent const& event) {
+  double dt = (event.current_real - event.last_real).toSec();
+  if (event.last_real.isZero())
+    dt = 0;
+
+  std::vector<diagnostic_msgs::KeyValue> keyval;
+  diagnostic_msgs::KeyValue kv;
+  std::map<std::string, ff::RosSubRapidPubPtr>::iterator it;
+  for (it = ros_sub_rapid_pubs_.begin(); it != ros_sub_rapid_pubs_.end();
+                                                                        ++it) {
+    kv.key = it->first;
+    kv.value = it->second->Stats().Summary(dt);
+    keyval.push_back(kv);
+  }
+
+  for (ff::RapidSubRosPubPtr const& rapid_sub_ros_pub : rapid_sub_ros_pubs_) {
+    kv.key = rapid_sub_ros_pub->PublishTopic();
+    kv.value = rapid_sub_ros_pub->Stats().Summary(dt);
+    keyval.push_back(kv);
+  }
+
+  for (int i = 0; latency_probe_ && i < ff::LatencyProbe::NUM_SEGMENTS; i++) {
+    ff::LatencyProbe::Segment segment =
+                                    static_cast<ff::LatencyProbe::Segment>(i);
+    kv.key = ff::LatencyProbe::Name(segment);
+    kv.value = latency_probe_->Stats(segment).Summary(dt);
+    keyval.push_back(kv);
+  }
+
+  SendDiagnostics(keyval);
+}
+
 }   // end namespace dds_ros_bridge
 
 PLUGINLIB_EXPORT_CLASS(dds_ros_bridge::DdsRosBridge, nodelet::Nodelet)
@@ -0,0 +1,201 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "dds_ros_bridge/file_transfer.h"
+
+#include <algorithm>
+
+namespace ff {
+
+namespace {
+
+// magic, transfer, priority, index, count, size, stride, crc, little endian
+const uint8_t kMagic[4] = {'A', 'B', 'F', 'C'};
+const size_t kHeaderSize = 4 + 4 + 1 + 4 + 4 + 4 + 4 + 4;
+
+// how many completed transfers are remembered to ack their chunks again
+const size_t kCompletedHistory = 32;
+
+void Put(uint8_t* p, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    p[i] = (value >> (8 * i)) & 0xFF;
+}
+
+uint32_t Get(const uint8_t* p) {
+  uint32_t value = 0;
+  for (int i = 0; i < 4; i++)
+    value |= static_cast<uint32_t>(p[i]) << (8 * i);
+  return value;
+}
+
+std::vector<uint32_t> CrcTable() {
+  std::vector<uint32_t> table(256);
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++)
+      c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+    table[i] = c;
+  }
+  return table;
+}
+
+}  // namespace
+
+uint32_t Crc32(const uint8_t* data, size_t size) {
+  static const std::vector<uint32_t> table = CrcTable();
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < size; i++)
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return crc ^ 0xFFFFFFFF;
+}
+
+bool SplitFile(uint32_t transfer, uint8_t priority, const uint8_t* data,
+               size_t size, size_t chunk_size,
+               std::vector<std::vector<uint8_t>>* chunks) {
+  chunks->clear();
+  if (chunk_size <= kHeaderSize || size == 0 || size > 0xFFFFFFFF)
+    return false;
+  size_t stride = chunk_size - kHeaderSize;
+  size_t count = (size + stride - 1) / stride;
+
+  chunks->resize(count);
+  for (size_t i = 0; i < count; i++) {
+    size_t offset = i * stride;
+    size_t length = std::min(stride, size - offset);
+    std::vector<uint8_t>& c = (*chunks)[i];
+    c.resize(kHeaderSize + length);
+    std::copy(kMagic, kMagic + 4, c.begin());
+    Put(&c[4], transfer);
+    c[8] = priority;
+    Put(&c[9], i);
+    Put(&c[13], count);
+    Put(&c[17], size);
+    Put(&c[21], stride);
+    Put(&c[25], Crc32(data + offset, length));
+    std::copy(data + offset, data + offset + length, c.begin() + kHeaderSize);
+  }
+  return true;
+}
+
+bool DecodeFileChunk(const uint8_t* bytes, size_t size, FileChunk* chunk) {
+  if (size <= kHeaderSize || !std::equal(kMagic, kMagic + 4, bytes))
+    return false;
+  chunk->transfer = Get(bytes + 4);
+  chunk->priority = bytes[8];
+  chunk->index = Get(bytes + 9);
+  chunk->count = Get(bytes + 13);
+  chunk->size = Get(bytes + 17);
+  chunk->stride = Get(bytes + 21);
+  chunk->data = bytes + kHeaderSize;
+  chunk->length = size - kHeaderSize;
+  if (chunk->stride == 0 || chunk->index >= chunk->count ||
+      (static_cast<uint64_t>(chunk->size) + chunk->stride - 1) / chunk->stride
+        != chunk->count)
+    return false;
+  uint64_t offset = static_cast<uint64_t>(chunk->index) * chunk->stride;
+  if (chunk->length != std::min<uint64_t>(chunk->stride, chunk->size - offset))
+    return false;
+  return Crc32(chunk->data, chunk->length) == Get(bytes + 25);
+}
+
+FileAssembler::FileAssembler(size_t max_memory, double timeout)
+  : max_memory_(max_memory), memory_(0), timeout_(timeout) {
+}
+
+FileAssembler::Result FileAssembler::Add(FileChunk const& chunk, double now,
+                                         std::vector<uint8_t>* file) {
+  if (std::find(completed_.begin(), completed_.end(), chunk.transfer) !=
+      completed_.end())
+    return DUPLICATE;
+
+  std::map<uint32_t, Transfer>::iterator it = transfers_.find(chunk.transfer);
+  if (it != transfers_.end() && (it->second.have.size() != chunk.count ||
+                                 it->second.data.size() != chunk.size)) {
+    // the sender reused the id for another file, start over
+    Erase(it);
+    it = transfers_.end();
+  }
+  if (it == transfers_.end()) {
+    if (!MakeRoom(chunk.size, chunk.priority, now))
+      return REJECTED;
+    Transfer& t = transfers_[chunk.transfer];
+    t.priority = chunk.priority;
+    t.started = now;
+    t.received = 0;
+    t.have.assign(chunk.count, false);
+    t.data.resize(chunk.size);
+    memory_ += chunk.size;
+    it = transfers_.find(chunk.transfer);
+  }
+
+  Transfer& t = it->second;
+  t.last = now;
+  if (t.have[chunk.index])
+    return DUPLICATE;
+  t.have[chunk.index] = true;
+  std::copy(chunk.data, chunk.data + chunk.length,
+            t.data.begin() + static_cast<size_t>(chunk.index) * chunk.stride);
+  if (++t.received < chunk.count)
+    return ADDED;
+
+  memory_ -= t.data.size();
+  file->swap(t.data);
+  transfers_.erase(it);
+  completed_.push_back(chunk.transfer);
+  if (completed_.size() > kCompletedHistory)
+    completed_.pop_front();
+  return COMPLETE;
+}
+
+bool FileAssembler::MakeRoom(size_t size, uint8_t priority, double now) {
+  if (size > max_memory_)
+    return false;
+
+  std::map<uint32_t, Transfer>::iterator it;
+  for (it = transfers_.begin(); it != transfers_.end() &&
+                                memory_ + size > max_memory_;) {
+    if (timeout_ > 0 && now - it->second.last > timeout_)
+      Erase(it++);
+    else
+      ++it;
+  }
+
+  while (memory_ + size > max_memory_) {
+    std::map<uint32_t, Transfer>::iterator victim = transfers_.end();
+    for (it = transfers_.begin(); it != transfers_.end(); ++it) {
+      if (it->second.priority <= priority)
+        continue;
+      if (victim == transfers_.end() ||
+          it->second.priority > victim->second.priority ||
+          (it->second.priority == victim->second.priority &&
+           it->second.started < victim->second.started))
+        victim = it;
+    }
+    if (victim == transfers_.end())
+      return false;
+    Erase(victim);
+  }
+  return true;
+}
+
+void FileAssembler::Erase(std::map<uint32_t, Transfer>::iterator it) {
+  memory_ -= it->second.data.size();
+  transfers_.erase(it);
+}
+
+}  // end namespace ff
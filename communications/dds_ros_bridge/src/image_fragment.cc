@@ -0,0 +1,137 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "dds_ros_bridge/image_fragment.h"
+
+#include <algorithm>
+
+namespace ff {
+
+const char kImageFragmentMimeType[] = "application/x-astrobee-image-fragment";
+
+namespace {
+
+// magic, frame, index, count, total size, chunk payload, mime type length,
+// all little endian, then the mime type
+const uint8_t kMagic[4] = {'A', 'B', 'I', 'F'};
+const size_t kFixedHeaderSize = 4 + 4 + 2 + 2 + 4 + 4 + 1;
+
+void Put(uint8_t* p, uint32_t value, int bytes) {
+  for (int i = 0; i < bytes; i++)
+    p[i] = (value >> (8 * i)) & 0xFF;
+}
+
+uint32_t Get(const uint8_t* p, int bytes) {
+  uint32_t value = 0;
+  for (int i = 0; i < bytes; i++)
+    value |= static_cast<uint32_t>(p[i]) << (8 * i);
+  return value;
+}
+
+}  // namespace
+
+bool SplitImage(uint32_t frame, const std::string& mime_type,
+                const uint8_t* data, size_t size, size_t chunk_size,
+                std::vector<std::vector<uint8_t>>* fragments) {
+  fragments->clear();
+  if (mime_type.size() > 0xFF)
+    return false;
+  size_t header = kFixedHeaderSize + mime_type.size();
+  if (chunk_size <= header || size == 0)
+    return false;
+  size_t payload = chunk_size - header;
+  size_t count = (size + payload - 1) / payload;
+  if (count > 0xFFFF || size > 0xFFFFFFFF)
+    return false;
+
+  fragments->resize(count);
+  for (size_t i = 0; i < count; i++) {
+    size_t offset = i * payload;
+    size_t length = std::min(payload, size - offset);
+    std::vector<uint8_t>& f = (*fragments)[i];
+    f.resize(header + length);
+    std::copy(kMagic, kMagic + 4, f.begin());
+    Put(&f[4], frame, 4);
+    Put(&f[8], i, 2);
+    Put(&f[10], count, 2);
+    Put(&f[12], size, 4);
+    Put(&f[16], payload, 4);
+    f[20] = mime_type.size();
+    std::copy(mime_type.begin(), mime_type.end(), f.begin() + kFixedHeaderSize);
+    std::copy(data + offset, data + offset + length, f.begin() + header);
+  }
+  return true;
+}
+
+ImageReassembler::ImageReassembler()
+  : started_(false), frame_(0), received_(0) {
+}
+
+bool ImageReassembler::Add(const uint8_t* fragment, size_t size,
+                           std::string* mime_type,
+                           std::vector<uint8_t>* data) {
+  if (size < kFixedHeaderSize || !std::equal(kMagic, kMagic + 4, fragment))
+    return false;
+  uint32_t frame = Get(fragment + 4, 4);
+  uint32_t index = Get(fragment + 8, 2);
+  uint32_t count = Get(fragment + 10, 2);
+  uint32_t total = Get(fragment + 12, 4);
+  uint32_t payload = Get(fragment + 16, 4);
+  size_t header = kFixedHeaderSize + fragment[20];
+  if (size <= header || index >= count || payload == 0 ||
+      (total + payload - 1) / payload != count)
+    return false;
+  size_t offset = static_cast<size_t>(index) * payload;
+  size_t length = size - header;
+  if (length != std::min<size_t>(payload, total - offset))
+    return false;
+
+  // frame ids wrap, so newer is anything less than half the range ahead
+  if (started_ && frame != frame_) {
+    if (static_cast<int32_t>(frame - frame_) < 0)
+      return false;
+    started_ = false;
+  }
+  if (!started_) {
+    started_ = true;
+    frame_ = frame;
+    received_ = 0;
+    mime_type_.assign(reinterpret_cast<const char*>(fragment) + kFixedHeaderSize, fragment[20]);
+    have_.assign(count, false);
+    image_.resize(total);
+  } else if (have_.size() != count || image_.size() != total) {
+    return false;
+  }
+
+  if (have_[index])
+    return false;
+  have_[index] = true;
+  std::copy(fragment + header, fragment + size, image_.begin() + offset);
+  if (++received_ < count)
+    return false;
+
+  *mime_type = mime_type_;
+  data->swap(image_);
+  image_.clear();
+  have_.clear();
+  // later fragments of this frame are duplicates, so keep the frame id
+  received_ = 0;
+  return true;
+}
+
+}  // end namespace ff
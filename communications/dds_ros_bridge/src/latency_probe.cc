@@ -0,0 +1,68 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "dds_ros_bridge/latency_probe.h"
+
+namespace ff {
+
+LatencyProbe::LatencyProbe(size_t max_pending) : max_pending_(max_pending) {
+}
+
+void LatencyProbe::Forwarded(std::string const& cmd_id, double sent,
+                             double received, double forwarded) {
+  stats_[LINK].Record(received - sent, 0);
+  stats_[BRIDGE].Record(forwarded - received, 0);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // commands that were never acked are forgotten, oldest first
+  if (pending_.size() >= max_pending_)
+    pending_.pop_front();
+  pending_.push_back({cmd_id, received, forwarded});
+}
+
+void LatencyProbe::Acked(std::string const& cmd_id, double acked,
+                         double received) {
+  Pending p;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::deque<Pending>::iterator it = pending_.begin();
+    while (it != pending_.end() && it->cmd_id != cmd_id)
+      ++it;
+    if (it == pending_.end())
+      return;
+    p = *it;
+    pending_.erase(it);
+  }
+
+  stats_[EXECUTIVE].Record(acked - p.forwarded, 0);
+  stats_[ACK].Record(received - acked, 0);
+  stats_[ROBOT].Record(received - p.received, 0);
+}
+
+const char* LatencyProbe::Name(Segment segment) {
+  switch (segment) {
+  case LINK:      return "latency_link";
+  case BRIDGE:    return "latency_bridge";
+  case EXECUTIVE: return "latency_executive";
+  case ACK:       return "latency_ack";
+  case ROBOT:     return "latency_robot";
+  default:        return "latency";
+  }
+}
+
+}  // end namespace ff
@@ -76,15 +76,23 @@ RapidCommandRosCommand::RapidCommandRosCommand(
                                             const std::string& subscribe_topic,
                                             const std::string& pub_topic,
                                             const ros::NodeHandle &nh,
-                                            const unsigned int queue_size)
+                                            const unsigned int queue_size,
+                                            std::shared_ptr<CommandTable> table,
+                                            std::shared_ptr<LatencyProbe> probe)
   : RapidSubRosPub(subscribe_topic,
                    pub_topic,
                    nh,
                    "RapidCommandRosCommand",
-                   queue_size) {
+                   queue_size),
+    table_(table),
+    probe_(probe) {
   // advertise ros topic
   pub_ = nh_.advertise<ff_msgs::CommandStamped>(pub_topic, queue_size);
 
+  if (table_)
+    ack_pub_ = nh_.advertise<ff_msgs::AckStamped>(TOPIC_MANAGEMENT_ACK,
+                                                  queue_size);
+
   // connect to ddsEventLoop
   // @todo confirm topic suffix has '-'
   try {
@@ -107,7 +115,22 @@ RapidCommandRosCommand::RapidCommandRosCommand(
 }
 
 void RapidCommandRosCommand::operator() (rapid::Command const* rapid_cmd) {
-  // TODO(tfmorse): Validate command against commandConfig message
+  ros::Time received = ros::Time::now();
+
+  // Commands the executive would reject for their syntax are acked here
+  std::string err_msg;
+  if (table_ && table_->Validate(*rapid_cmd, &err_msg) < 0) {
+    ff_msgs::AckStamped ack;
+    ack.header.stamp = received;
+    ack.cmd_id = rapid_cmd->cmdId;
+    ack.cmd_origin = "ground";
+    ack.status.status = ff_msgs::AckStatus::COMPLETED;
+    ack.completed_status.status = ff_msgs::AckCompletedStatus::BAD_SYNTAX;
+    ack.message = err_msg;
+    ack_pub_.publish(ack);
+    ROS_WARN("DDS Bridge: %s", err_msg.c_str());
+    return;
+  }
 
   ff_msgs::CommandStamped cmd;
   util::RapidHeader2Ros(rapid_cmd->hdr, &cmd.header);
@@ -123,7 +146,12 @@ void RapidCommandRosCommand::operator() (rapid::Command const* rapid_cmd) {
     TransferArgument(rapid_cmd->arguments[i], &cmd.args[i]);
   }
 
-  pub_.publish(cmd);
+  // noted before it is published so the ack cannot beat it
+  if (probe_ && cmd.cmd_name == ff_msgs::CommandConstants::CMD_NAME_NO_OP)
+    probe_->Forwarded(cmd.cmd_id, cmd.header.stamp.toSec(), received.toSec(),
+                      ros::Time::now().toSec());
+
+  Publish(cmd, received);
 }
 
 }  // end namespace ff
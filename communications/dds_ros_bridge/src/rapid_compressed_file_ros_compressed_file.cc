@@ -44,7 +44,9 @@ ff::RapidCompressedFileRosCompressedFile::RapidCompressedFileRosCompressedFile(
     const std::string& subscribe_topic,
     const std::string& pub_topic,
     const ros::NodeHandle &nh,
-    const unsigned int queue_size)
+    const unsigned int queue_size,
+    const unsigned int transfer_memory,
+    const float transfer_timeout)
   : ff::RapidSubRosPub(subscribe_topic,
                        pub_topic,
                        nh,
@@ -52,6 +54,12 @@ ff::RapidCompressedFileRosCompressedFile::RapidCompressedFileRosCompressedFile(
                        queue_size) {
   pub_ = nh_.advertise<ff_msgs::CompressedFile>(pub_topic, queue_size);
 
+  if (transfer_memory > 0) {
+    assembler_.reset(new FileAssembler(transfer_memory, transfer_timeout));
+    ack_pub_ = nh_.advertise<ff_msgs::CompressedFileAck>(
+                                      TOPIC_MANAGEMENT_EXEC_CF_ACK, queue_size);
+  }
+
   try {
     dds_event_loop_.connect<rapid::ext::astrobee::CompressedFile>(this,
       rapid::ext::astrobee::COMPRESSED_FILE_TOPIC + subscribe_topic,
@@ -71,6 +79,7 @@ ff::RapidCompressedFileRosCompressedFile::RapidCompressedFileRosCompressedFile(
 
 void ff::RapidCompressedFileRosCompressedFile::operator() (
   rapid::ext::astrobee::CompressedFile const* file) {
+  ros::Time received = ros::Time::now();
   ff_msgs::CompressedFile msg;
   util::RapidHeader2Ros(file->hdr, &msg.header);
 
@@ -79,10 +88,37 @@ void ff::RapidCompressedFileRosCompressedFile::operator() (
   msg.type = RapidCompression2Ros(file->compressionType);
 
   unsigned char* buf = file->compressedFile.get_contiguous_buffer();
+
+  FileChunk chunk;
+  if (assembler_ && DecodeFileChunk(buf, file->compressedFile.length(),
+                                    &chunk)) {
+    FileAssembler::Result result =
+      assembler_->Add(chunk, ros::Time::now().toSec(), &msg.file);
+    if (result == FileAssembler::REJECTED) {
+      ROS_WARN("DDS Bridge: No room for chunk %u of file transfer %u",
+               chunk.index, chunk.transfer);
+      return;
+    }
+
+    // Every chunk is acked by its own sample id, so the sender knows which
+    // to resend after a loss of signal
+    ff_msgs::CompressedFileAck ack;
+    ack.header.stamp = ros::Time::now();
+    ack.id = file->id;
+    ack_pub_.publish(ack);
+
+    if (result != FileAssembler::COMPLETE)
+      return;
+    // the whole file takes the transfer id, which the executive acks
+    msg.id = chunk.transfer;
+    Publish(msg, received);
+    return;
+  }
+
   msg.file.reserve(file->compressedFile.length());
   msg.file.resize(file->compressedFile.length());
   std::memmove(msg.file.data(), buf, file->compressedFile.length());
 
-  pub_.publish(msg);
+  Publish(msg, received);
 }
 
@@ -28,10 +28,10 @@ ff::RosAccessControlStateToRapid::RosAccessControlStateToRapid(
                                   rapid::ACCESSCONTROL_STATE_TOPIC + pub_topic,
                                   "", "RapidAccessControlStateProfile", ""));
 
-  sub_ = nh_.subscribe(subscribe_topic,
-                       queue_size,
-                       &RosAccessControlStateToRapid::Callback,
-                       this);
+  sub_ = Subscribe(subscribe_topic,
+                   queue_size,
+                   &RosAccessControlStateToRapid::Callback,
+                   this);
 
   rapid::RapidHelper::initHeader(state_supplier_->event().hdr);
 }
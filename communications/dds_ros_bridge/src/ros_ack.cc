@@ -21,22 +21,28 @@
 ff::RosAckToRapid::RosAckToRapid(const std::string& subscribe_topic,
                                  const std::string& pub_topic,
                                  const ros::NodeHandle &nh,
-                                 const unsigned int queue_size)
-  : RosSubRapidPub(subscribe_topic, pub_topic, nh, queue_size) {
+                                 const unsigned int queue_size,
+                                 std::shared_ptr<LatencyProbe> probe)
+  : RosSubRapidPub(subscribe_topic, pub_topic, nh, queue_size),
+    probe_(probe) {
   state_supplier_.reset(
     new ff::RosAckToRapid::StateSupplier(rapid::ACK_TOPIC + pub_topic,
       "", "RapidAckProfile", ""));
 
-  sub_ = nh_.subscribe(subscribe_topic,
-                       queue_size,
-                       &RosAckToRapid::Callback,
-                       this);
+  sub_ = Subscribe(subscribe_topic,
+                   queue_size,
+                   &RosAckToRapid::Callback,
+                   this);
 
   rapid::RapidHelper::initHeader(state_supplier_->event().hdr);
 }
 
 void ff::RosAckToRapid::Callback(const ff_msgs::AckStamped::ConstPtr& ack) {
   if (ack->cmd_origin == "ground") {
+    if (probe_)
+      probe_->Acked(ack->cmd_id, ack->header.stamp.toSec(),
+                    ros::Time::now().toSec());
+
     rapid::Ack &msg = state_supplier_->event();
     msg.hdr.timeStamp = util::RosTime2RapidTime(ack->header.stamp);
 
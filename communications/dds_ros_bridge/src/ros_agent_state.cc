@@ -101,10 +101,10 @@ ff::RosAgentStateToRapid::RosAgentStateToRapid(
       rapid::ext::astrobee::AGENT_STATE_TOPIC + pub_topic,
       "", "AstrobeeAgentStateProfile", ""));
 
-  sub_ = nh_.subscribe(subscribe_topic,
-                       queue_size,
-                       &RosAgentStateToRapid::Callback,
-                       this);
+  sub_ = Subscribe(subscribe_topic,
+                   queue_size,
+                   &RosAgentStateToRapid::Callback,
+                   this);
 
   rapid::RapidHelper::initHeader(state_supplier_->event().hdr);
 }
@@ -36,10 +36,10 @@ RosArmJointSampleToRapid::RosArmJointSampleToRapid(
           rapid::JOINT_SAMPLE_TOPIC + publish_topic_, "",
           "RapidJointSampleProfile", "", ""));
 
-  sub_ = nh_.subscribe(subscribe_topic,
-                       queue_size,
-                       &RosArmJointSampleToRapid::Callback,
-                       this);
+  sub_ = Subscribe(subscribe_topic,
+                   queue_size,
+                   &RosArmJointSampleToRapid::Callback,
+                   this);
 
   rapid::RapidHelper::initHeader(config_supplier_->event().hdr);
   rapid::RapidHelper::initHeader(sample_supplier_->event().hdr);
@@ -80,10 +80,10 @@ ff::RosArmStateToRapid::RosArmStateToRapid(const std::string& subscribe_topic,
         rapid::ext::astrobee::ARM_STATE_TOPIC + pub_topic,
         "", "AstrobeeArmStateProfile", ""));
 
-  sub_ = nh_.subscribe(subscribe_topic,
-                       queue_size,
-                       &RosArmStateToRapid::Callback,
-                       this);
+  sub_ = Subscribe(subscribe_topic,
+                   queue_size,
+                   &RosArmStateToRapid::Callback,
+                   this);
 
   rapid::RapidHelper::initHeader(state_supplier_->event().hdr);
 }
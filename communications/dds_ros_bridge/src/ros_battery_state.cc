@@ -40,39 +40,39 @@ ff::RosBatteryStateToRapid::RosBatteryStateToRapid(
        rapid::ext::astrobee::EPS_STATE_TOPIC + pub_topic, "",
       "AstrobeeEpsStateProfile", ""));
 
-  sub_battery_state_tl_ = nh_.subscribe(sub_topic_battery_state_TL,
-                                        queue_size,
-                                        &RosBatteryStateToRapid::StateCallback,
-                                        this);
-  sub_battery_state_tr_ = nh_.subscribe(sub_topic_battery_state_TR,
-                                        queue_size,
-                                        &RosBatteryStateToRapid::StateCallback,
-                                        this);
-  sub_battery_state_bl_ = nh_.subscribe(sub_topic_battery_state_BL,
-                                        queue_size,
-                                        &RosBatteryStateToRapid::StateCallback,
-                                        this);
-  sub_battery_state_br_ = nh_.subscribe(sub_topic_battery_state_BR,
-                                        queue_size,
-                                        &RosBatteryStateToRapid::StateCallback,
-                                        this);
-
-  sub_battery_temp_tl_ = nh_.subscribe(sub_topic_battery_temp_TL,
-                                       queue_size,
-                                       &RosBatteryStateToRapid::TempTLCallback,
-                                       this);
-  sub_battery_temp_tr_ = nh_.subscribe(sub_topic_battery_temp_TR,
-                                       queue_size,
-                                       &RosBatteryStateToRapid::TempTRCallback,
-                                       this);
-  sub_battery_temp_bl_ = nh_.subscribe(sub_topic_battery_temp_BL,
-                                       queue_size,
-                                       &RosBatteryStateToRapid::TempBLCallback,
-                                       this);
-  sub_battery_temp_br_ = nh_.subscribe(sub_topic_battery_temp_BR,
-                                       queue_size,
-                                       &RosBatteryStateToRapid::TempBRCallback,
-                                       this);
+  sub_battery_state_tl_ = Subscribe(sub_topic_battery_state_TL,
+                                    queue_size,
+                                    &RosBatteryStateToRapid::StateCallback,
+                                    this);
+  sub_battery_state_tr_ = Subscribe(sub_topic_battery_state_TR,
+                                    queue_size,
+                                    &RosBatteryStateToRapid::StateCallback,
+                                    this);
+  sub_battery_state_bl_ = Subscribe(sub_topic_battery_state_BL,
+                                    queue_size,
+                                    &RosBatteryStateToRapid::StateCallback,
+                                    this);
+  sub_battery_state_br_ = Subscribe(sub_topic_battery_state_BR,
+                                    queue_size,
+                                    &RosBatteryStateToRapid::StateCallback,
+                                    this);
+
+  sub_battery_temp_tl_ = Subscribe(sub_topic_battery_temp_TL,
+                                   queue_size,
+                                   &RosBatteryStateToRapid::TempTLCallback,
+                                   this);
+  sub_battery_temp_tr_ = Subscribe(sub_topic_battery_temp_TR,
+                                   queue_size,
+                                   &RosBatteryStateToRapid::TempTRCallback,
+                                   this);
+  sub_battery_temp_bl_ = Subscribe(sub_topic_battery_temp_BL,
+                                   queue_size,
+                                   &RosBatteryStateToRapid::TempBLCallback,
+                                   this);
+  sub_battery_temp_br_ = Subscribe(sub_topic_battery_temp_BR,
+                                   queue_size,
+                                   &RosBatteryStateToRapid::TempBRCallback,
+                                   this);
 
   rapid::RapidHelper::initHeader(config_supplier_->event().hdr);
   rapid::RapidHelper::initHeader(state_supplier_->event().hdr);
@@ -84,6 +84,8 @@ ff::RosBatteryStateToRapid::RosBatteryStateToRapid(
   config_supplier_->event().hdr.serial = 0;
   state_supplier_->event().hdr.serial = 0;
 
+  SetupCoalescing([this]() { state_supplier_->sendEvent(); });
+
   config_supplier_->sendEvent();
   state_supplier_->sendEvent();
 }
@@ -240,7 +242,7 @@ void ff::RosBatteryStateToRapid::StateCallback(sensor_msgs::BatteryStateConstPtr
                                           state_msg.estimatedMinutesRemaining) {
     // Only publish the state if the time estimated changed since
     state_msg.hdr.timeStamp = util::RosTime2RapidTime(state->header.stamp);
-    state_supplier_->sendEvent();
+    Publish();
   }
 }
 
@@ -164,19 +164,7 @@ bool RosCommandConfigRapidCommandConfig::AssembleConfig(
         }
 
         // check RAPID type
-        if (temp_type == "RAPID_STRING") {
-          cmd_def.parameters[k].type = rapid::RAPID_STRING;
-        } else if (temp_type == "RAPID_INT") {
-          cmd_def.parameters[k].type = rapid::RAPID_INT;
-        } else if (temp_type == "RAPID_BOOL") {
-          cmd_def.parameters[k].type = rapid::RAPID_BOOL;
-        } else if (temp_type == "RAPID_FLOAT") {
-          cmd_def.parameters[k].type = rapid::RAPID_FLOAT;
-        } else if (temp_type == "RAPID_VEC3d") {
-          cmd_def.parameters[k].type = rapid::RAPID_VEC3d;
-        } else if (temp_type == "RAPID_MAT33f") {
-          cmd_def.parameters[k].type = rapid::RAPID_MAT33f;
-        } else {
+        if (!ParseParamType(temp_type, &cmd_def.parameters[k].type)) {
           ROS_FATAL("DDS Bridge: %s is invalid param type.", temp_type.c_str());
           return false;
         }
@@ -31,10 +31,10 @@ ff::RosCompressedFileAckToRapid::RosCompressedFileAckToRapid(
       rapid::ext::astrobee::COMPRESSED_FILE_ACK_TOPIC + pub_topic,
       "", "AstrobeeCompressedFileAckProfile", ""));
 
-  sub_ = nh_.subscribe(subscribe_topic,
-                       queue_size,
-                       &RosCompressedFileAckToRapid::Callback,
-                       this);
+  sub_ = Subscribe(subscribe_topic,
+                   queue_size,
+                   &RosCompressedFileAckToRapid::Callback,
+                   this);
 
   rapid::RapidHelper::initHeader(state_supplier_->event().hdr);
 }
@@ -56,10 +56,10 @@ ff::RosCompressedFileToRapid::RosCompressedFileToRapid(
       rapid::ext::astrobee::COMPRESSED_FILE_TOPIC + pub_topic,
       "", "AstrobeeCurrentCompressedPlanProfile", ""));
 
-  sub_ = nh_.subscribe(subscribe_topic,
-                       queue_size,
-                       &RosCompressedFileToRapid::Callback,
-                       this);
+  sub_ = Subscribe(subscribe_topic,
+                   queue_size,
+                   &RosCompressedFileToRapid::Callback,
+                   this);
 
   rapid::RapidHelper::initHeader(state_supplier_->event().hdr);
 }
@@ -72,6 +72,12 @@ void ff::RosCompressedFileToRapid::Callback(
   msg.id = file->id;
   msg.compressionType = ConvertCompression(file->type);
 
+  // serialize straight from the ros message if the sequence allows it
+  if (util::SendLoaned(&msg.compressedFile, file->file.data(),
+                       file->file.size(),
+                       [this]() { state_supplier_->sendEvent(); }))
+    return;
+
   // resize
   msg.compressedFile.ensure_length(file->file.size(), file->file.size());
 
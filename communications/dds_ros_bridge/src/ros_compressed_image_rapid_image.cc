@@ -18,15 +18,46 @@
 
 #include "dds_ros_bridge/ros_compressed_image_rapid_image.h"
 
+#include <algorithm>
+
 namespace ff {
 
+namespace {
+
+// whether an Annex B frame holds an IDR, or for H.265 any random access, NAL
+bool IsKeyFrame(const std::string& format, const std::vector<uint8_t>& data) {
+  for (size_t i = 2; i + 1 < data.size(); i++) {
+    if (data[i] != 1 || data[i - 1] != 0 || data[i - 2] != 0)
+      continue;
+    uint8_t header = data[i + 1];
+    if (format == "hevc") {
+      int type = (header >> 1) & 0x3f;
+      if (type >= 16 && type <= 21)
+        return true;
+    } else if ((header & 0x1f) == 5) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
 RosCompressedImageRapidImage::RosCompressedImageRapidImage(
                                             const std::string& subscribe_topic,
                                             const std::string& pub_topic,
                                             const ros::NodeHandle &nh,
-                                            const unsigned int queue_size)
-  : RosSubRapidPub(subscribe_topic, pub_topic, nh, queue_size), MB_(1048576) {
-  std::string subscribe_compresed_topic = subscribe_topic + "/compressed";
+                                            const unsigned int queue_size,
+                                            const unsigned int chunk_size,
+                                            const float chunk_rate,
+                                            const std::string& transport)
+  : RosSubRapidPub(subscribe_topic, pub_topic, nh, queue_size),
+    MB_(1048576),
+    chunk_size_(std::min(chunk_size, MB_)),
+    frame_(0),
+    video_(transport == "video"),
+    wait_key_(true) {
+  std::string subscribe_compresed_topic = subscribe_topic + "/" + transport;
   // TODO(all): confirm topic suffix has '-'
   params_.topicSuffix += pub_topic;
 
@@ -39,32 +70,113 @@ RosCompressedImageRapidImage::RosCompressedImageRapidImage(
                                               "RosCompressedImageRapidImage"));
 
   // start subscriber
-  sub_ = nh_.subscribe(subscribe_compresed_topic,
-                       queue_size,
-                       &RosCompressedImageRapidImage::CallBack,
-                       this);
+  sub_ = Subscribe(subscribe_compresed_topic,
+                   queue_size,
+                   &RosCompressedImageRapidImage::CallBack,
+                   this);
+
+  if (chunk_size_ > 0 && chunk_rate > 0)
+    chunk_timer_ = nh_.createTimer(ros::Rate(chunk_rate),
+                                   &RosCompressedImageRapidImage::PubChunk,
+                                   this);
 }
 
 void RosCompressedImageRapidImage::CallBack(
                             const sensor_msgs::CompressedImage::ConstPtr& msg) {
-  provider_->setMimeType(GetRapidMimeType(msg->format).c_str());
-  if (msg->data.size() > 0 && msg->data.size() < MB_) {
+  std::string mime_type = GetRapidMimeType(msg->format);
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (video_ && wait_key_) {
+    if (!IsKeyFrame(msg->format, msg->data))
+      return;
+    wait_key_ = false;
+  }
+  // paced fragments are charged to the governor one at a time as they go
+  bool sendable = msg->data.size() > 0 &&
+                  (chunk_size_ > 0 || msg->data.size() < MB_);
+  bool paced = chunk_size_ > 0 && msg->data.size() > chunk_size_ &&
+               chunk_timer_.isValid();
+  if (governor_ && sendable && !paced &&
+      !governor_->SendImage(msg->data.size())) {
+    ROS_DEBUG("DDS ROS BRIDGE: Image dropped, over the downlink budget");
+    DropVideo();
+    return;
+  }
+
+  if (msg->data.size() > 0 && msg->data.size() <= chunk_size_) {
+    provider_->setMimeType(mime_type.c_str());
+    provider_->publishData(&msg->data.front(), msg->data.size());
+  } else if (chunk_size_ > 0 && msg->data.size() > 0) {
+    std::vector<std::vector<uint8_t>> fragments;
+    if (!SplitImage(frame_++, mime_type, &msg->data.front(), msg->data.size(),
+                    chunk_size_, &fragments)) {
+      ROS_ERROR("DDS ROS BRIDGE: Couldn't split image of size %zu!",
+                msg->data.size());
+      return;
+    }
+    // only the latest frame waits to be sent, the rest of an older one is
+    // no use without its missing fragments
+    if (!pending_.empty()) {
+      ROS_DEBUG("DDS ROS BRIDGE: Dropped %zu image fragments", pending_.size());
+      // this frame needs the one it replaces, so wait for the next key frame,
+      // unless this is one
+      if (video_ && !IsKeyFrame(msg->format, msg->data)) {
+        pending_.clear();
+        DropVideo();
+        return;
+      }
+    }
+    pending_.assign(fragments.begin(), fragments.end());
+    if (!chunk_timer_.isValid()) {
+      provider_->setMimeType(kImageFragmentMimeType);
+      for (std::vector<uint8_t> const& f : pending_)
+        provider_->publishData(&f.front(), f.size());
+      pending_.clear();
+    }
+  } else if (msg->data.size() > 0 && msg->data.size() < MB_) {
+    provider_->setMimeType(mime_type.c_str());
     provider_->publishData(&msg->data.front(), msg->data.size());
   } else {
     int size = msg->data.size();
+    DropVideo();
     ROS_ERROR("DDS ROS BRIDGE: Couldn't publish image! image size: %i > %i",
               size,
               MB_);
   }
 }
 
+void RosCompressedImageRapidImage::PubChunk(ros::TimerEvent const& event) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (pending_.empty())
+    return;
+  if (governor_ && !governor_->SendImage(pending_.front().size()))
+    return;
+  provider_->setMimeType(kImageFragmentMimeType);
+  provider_->publishData(&pending_.front().front(), pending_.front().size());
+  pending_.pop_front();
+}
+
+void RosCompressedImageRapidImage::DropVideo(void) {
+  if (video_)
+    wait_key_ = true;
+}
+
+void RosCompressedImageRapidImage::SetGovernor(
+                        std::shared_ptr<BandwidthGovernor> const& governor) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  governor_ = governor;
+}
+
 std::string RosCompressedImageRapidImage::GetRapidMimeType(
                                                 const std::string& ros_format) {
-  // only two accepted values jpeg or png
+  // jpeg or png images, or h264 or hevc video frames
   if (ros_format.compare("jpeg") == 0)
     return rapid::MIME_IMAGE_JPEG;
   if (ros_format.compare("png") == 0)
     return rapid::MIME_IMAGE_PNG;
+  if (ros_format.compare("h264") == 0)
+    return "video/h264";
+  if (ros_format.compare("hevc") == 0)
+    return "video/h265";
   return "";
 }
 
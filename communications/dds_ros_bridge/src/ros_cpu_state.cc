@@ -32,10 +32,10 @@ ff::RosCpuStateToRapid::RosCpuStateToRapid(const std::string& sub_topic,
           rapid::ext::astrobee::CPU_STATE_TOPIC + pub_topic, "",
           "AstrobeeCpuStateProfile", ""));
 
-  sub_ = nh_.subscribe(sub_topic,
-                       queue_size,
-                       &RosCpuStateToRapid::Callback,
-                       this);
+  sub_ = Subscribe(sub_topic,
+                   queue_size,
+                   &RosCpuStateToRapid::Callback,
+                   this);
 
   rapid::RapidHelper::initHeader(config_supplier_->event().hdr);
   rapid::RapidHelper::initHeader(state_supplier_->event().hdr);
@@ -60,15 +60,15 @@ ff::RosDataToDiskToRapid::RosDataToDiskToRapid(
       "AstrobeeDataTopicsListProfile",
       ""));
 
-    sub_ = nh_.subscribe(state_subscribe_topic,
-                         queue_size,
-                         &RosDataToDiskToRapid::StateCallback,
-                         this);
-
-    topics_sub_ = nh_.subscribe(topics_subscribe_topic,
-                                queue_size,
-                                &RosDataToDiskToRapid::TopicsCallback,
-                                this);
+    sub_ = Subscribe(state_subscribe_topic,
+                     queue_size,
+                     &RosDataToDiskToRapid::StateCallback,
+                     this);
+
+    topics_sub_ = Subscribe(topics_subscribe_topic,
+                            queue_size,
+                            &RosDataToDiskToRapid::TopicsCallback,
+                            this);
 
   rapid::RapidHelper::initHeader(state_supplier_->event().hdr);
   rapid::RapidHelper::initHeader(topics_supplier_->event().hdr);
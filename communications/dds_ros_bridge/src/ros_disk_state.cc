@@ -37,10 +37,10 @@ ff::RosDiskStateToRapid::RosDiskStateToRapid(const std::string& subscribe_topic,
         "AstrobeeDiskConfigProfile", ""));
 
 
-  sub_ = nh_.subscribe(subscribe_topic,
-                       queue_size,
-                       &RosDiskStateToRapid::Callback,
-                       this);
+  sub_ = Subscribe(subscribe_topic,
+                   queue_size,
+                   &RosDiskStateToRapid::Callback,
+                   this);
 
   rapid::RapidHelper::initHeader(config_supplier_->event().hdr);
   rapid::RapidHelper::initHeader(state_supplier_->event().hdr);
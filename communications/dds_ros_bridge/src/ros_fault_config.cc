@@ -29,10 +29,10 @@ ff::RosFaultConfigToRapid::RosFaultConfigToRapid(
         rapid::ext::astrobee::FAULT_CONFIG_TOPIC + pub_topic, "",
         "AstrobeeFaultConfigProfile", ""));
 
-  sub_ = nh_.subscribe(subscribe_topic,
-                       queue_size,
-                       &RosFaultConfigToRapid::Callback,
-                       this);
+  sub_ = Subscribe(subscribe_topic,
+                   queue_size,
+                   &RosFaultConfigToRapid::Callback,
+                   this);
 
   rapid::RapidHelper::initHeader(config_supplier_->event().hdr);
 }
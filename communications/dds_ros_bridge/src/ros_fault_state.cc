@@ -29,12 +29,14 @@ ff::RosFaultStateToRapid::RosFaultStateToRapid(
         rapid::ext::astrobee::FAULT_STATE_TOPIC + pub_topic,
         "", "AstrobeeFaultStateProfile", ""));
 
-  sub_ = nh_.subscribe(subscribe_topic,
-                       queue_size,
-                       &RosFaultStateToRapid::Callback,
-                       this);
+  sub_ = Subscribe(subscribe_topic,
+                   queue_size,
+                   &RosFaultStateToRapid::Callback,
+                   this);
 
   rapid::RapidHelper::initHeader(state_supplier_->event().hdr);
+
+  SetupCoalescing([this]() { state_supplier_->sendEvent(); });
 }
 
 void ff::RosFaultStateToRapid::Callback(const ff_msgs::FaultStateConstPtr&
@@ -96,6 +98,7 @@ void ff::RosFaultStateToRapid::Callback(const ff_msgs::FaultStateConstPtr&
     }
   }
 
-  state_supplier_->sendEvent();
+  // The stamp changes with every message, only the faults count as a change
+  Publish(Changed(state->faults));
 }
 
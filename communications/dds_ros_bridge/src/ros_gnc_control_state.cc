@@ -34,10 +34,10 @@ RosGncControlStateToRapid::RosGncControlStateToRapid(
       ""));
 
   // start subscriber
-  sub_ = nh_.subscribe(subscribe_topic,
-                       queue_size,
-                       &RosGncControlStateToRapid::MsgCallback,
-                       this);
+  sub_ = Subscribe(subscribe_topic,
+                   queue_size,
+                   &RosGncControlStateToRapid::MsgCallback,
+                   this);
 
   // Initialize the state message
   rapid::RapidHelper::initHeader(state_supplier_->event().hdr);
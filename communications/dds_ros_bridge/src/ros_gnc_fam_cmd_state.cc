@@ -34,10 +34,10 @@ RosGncFamCmdStateToRapid::RosGncFamCmdStateToRapid(
       ""));
 
   // start subscriber
-  sub_ = nh_.subscribe(subscribe_topic,
-                       queue_size,
-                       &RosGncFamCmdStateToRapid::MsgCallback,
-                       this);
+  sub_ = Subscribe(subscribe_topic,
+                   queue_size,
+                   &RosGncFamCmdStateToRapid::MsgCallback,
+                   this);
 
   // Initialize the state message
   rapid::RapidHelper::initHeader(state_supplier_->event().hdr);
@@ -64,20 +64,20 @@ ff::RosGuestScienceToRapid::RosGuestScienceToRapid(
         "AstrobeeGuestScienceStateProfile", ""));
 
 
-  sub_ = nh_.subscribe(state_subscribe_topic,
-                       queue_size,
-                       &RosGuestScienceToRapid::StateCallback,
-                       this);
-
-  config_sub_ = nh_.subscribe(config_subscribe_topic,
-                              queue_size,
-                              &RosGuestScienceToRapid::ConfigCallback,
-                              this);
-
-  data_sub_ = nh_.subscribe(data_subscribe_topic,
-                            queue_size,
-                            &RosGuestScienceToRapid::DataCallback,
-                            this);
+  sub_ = Subscribe(state_subscribe_topic,
+                   queue_size,
+                   &RosGuestScienceToRapid::StateCallback,
+                   this);
+
+  config_sub_ = Subscribe(config_subscribe_topic,
+                          queue_size,
+                          &RosGuestScienceToRapid::ConfigCallback,
+                          this);
+
+  data_sub_ = Subscribe(data_subscribe_topic,
+                        queue_size,
+                        &RosGuestScienceToRapid::DataCallback,
+                        this);
 
   rapid::RapidHelper::initHeader(config_supplier_->event().hdr);
   rapid::RapidHelper::initHeader(data_supplier_->event().hdr);
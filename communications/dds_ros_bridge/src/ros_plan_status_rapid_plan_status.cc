@@ -29,10 +29,10 @@ ff::RosPlanStatusRapidPlanStatus::RosPlanStatusRapidPlanStatus(
       rapid::ext::astrobee::PLAN_STATUS_TOPIC + pub_topic,
       "", "AstrobeePlanStatusProfile", ""));
 
-  sub_ = nh_.subscribe(subscribe_topic,
-                       queue_size,
-                       &RosPlanStatusRapidPlanStatus::Callback,
-                       this);
+  sub_ = Subscribe(subscribe_topic,
+                   queue_size,
+                   &RosPlanStatusRapidPlanStatus::Callback,
+                   this);
 
   rapid::RapidHelper::initHeader(status_supplier_->event().hdr);
 }
@@ -35,10 +35,10 @@ RosStringRapidTextMessage::RosStringRapidTextMessage(
   provider_.reset(new rapid::TextMessager(params_));
 
   // start subscriber
-  sub_ = nh_.subscribe(subscribe_topic,
-                       queue_size,
-                       &RosStringRapidTextMessage::CallBack,
-                       this);
+  sub_ = Subscribe(subscribe_topic,
+                   queue_size,
+                   &RosStringRapidTextMessage::CallBack,
+                   this);
 }
 
 void RosStringRapidTextMessage::CallBack(
@@ -0,0 +1,84 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "dds_ros_bridge/ros_sub_rapid_pub.h"
+
+namespace ff {
+
+void RosSubRapidPub::SetCoalescing(float window, float heartbeat) {
+  window_ = ros::Duration(window > 0 ? window : 0);
+  heartbeat_ = ros::Duration(heartbeat > 0 ? heartbeat : 0);
+
+  window_timer_ = nh_.createTimer(ros::Duration(1.0),
+                                  &RosSubRapidPub::WindowCallback,
+                                  this,
+                                  true,
+                                  false);
+  heartbeat_timer_ = ros::Timer();
+  // checked twice per heartbeat, so a quiet sample waits at most one and a half
+  if (heartbeat > 0)
+    heartbeat_timer_ = nh_.createTimer(heartbeat_ * 0.5,
+                                       &RosSubRapidPub::HeartbeatCallback,
+                                       this);
+}
+
+void RosSubRapidPub::SetupCoalescing(std::function<void()> const& send) {
+  send_ = send;
+}
+
+void RosSubRapidPub::Publish(bool changed) {
+  // Without coalescing every sample goes out as it comes
+  if (window_.isZero() && heartbeat_.isZero()) {
+    Send();
+    return;
+  }
+
+  if (!changed)
+    return;
+
+  bool was_pending = pending_;
+  pending_ = true;
+  ros::Duration since = ros::Time::now() - last_sent_;
+  if (last_sent_.isZero() || since >= window_) {
+    window_timer_.stop();
+    Send();
+  } else if (!was_pending) {
+    // the rest of the window, after which the latest sample goes out
+    window_timer_.setPeriod(window_ - since);
+    window_timer_.start();
+  }
+}
+
+void RosSubRapidPub::Send() {
+  if (send_)
+    send_();
+  last_sent_ = ros::Time::now();
+  pending_ = false;
+}
+
+void RosSubRapidPub::WindowCallback(ros::TimerEvent const& event) {
+  if (pending_)
+    Send();
+}
+
+void RosSubRapidPub::HeartbeatCallback(ros::TimerEvent const& event) {
+  if (!last_sent_.isZero() && ros::Time::now() - last_sent_ >= heartbeat_)
+    Send();
+}
+
+}  // end namespace ff
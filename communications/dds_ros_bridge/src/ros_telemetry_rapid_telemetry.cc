@@ -37,10 +37,10 @@ RosTelemetryRapidTelemetry::RosTelemetryRapidTelemetry(
           rapid::ext::astrobee::TELEMETRY_STATE_TOPIC + publish_topic_, "",
           "AstrobeeTelemetryStateProfile", "", ""));
 
-  sub_ = nh_.subscribe(subscribe_topic,
-                       queue_size,
-                       &RosTelemetryRapidTelemetry::CameraStateCallback,
-                       this);
+  sub_ = Subscribe(subscribe_topic,
+                   queue_size,
+                   &RosTelemetryRapidTelemetry::CameraStateCallback,
+                   this);
 
   rapid::RapidHelper::initHeader(config_supplier_->event().hdr);
   rapid::RapidHelper::initHeader(state_supplier_->event().hdr);
@@ -0,0 +1,242 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "dds_ros_bridge/trajectory_packer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace ff {
+
+namespace {
+
+// magic, version, pose count, interval in us, time of the first pose in us
+// and position resolution in um, all little endian
+const uint8_t kMagic[4] = {'A', 'B', 'T', 'J'};
+const uint8_t kVersion = 1;
+const size_t kHeaderSize = 4 + 1 + 1 + 4 + 8 + 4;
+// the first pose, three 32 bit positions and three 16 bit quaternion values
+const size_t kFirstPoseSize = 3 * 4 + 3 * 2;
+const double kQuatScale = 32767.0;
+
+void Put(std::vector<uint8_t>* p, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++)
+    p->push_back((value >> (8 * i)) & 0xFF);
+}
+
+uint64_t Get(const uint8_t* p, int bytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; i++)
+    value |= static_cast<uint64_t>(p[i]) << (8 * i);
+  return value;
+}
+
+void PutVarint(std::vector<uint8_t>* p, int64_t value) {
+  uint64_t v = (static_cast<uint64_t>(value) << 1) ^
+               static_cast<uint64_t>(value >> 63);
+  while (v >= 0x80) {
+    p->push_back((v & 0x7F) | 0x80);
+    v >>= 7;
+  }
+  p->push_back(v);
+}
+
+bool GetVarint(const uint8_t** p, const uint8_t* end, int64_t* value) {
+  uint64_t v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (*p == end)
+      return false;
+    uint8_t b = *(*p)++;
+    v |= static_cast<uint64_t>(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      *value = static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+int64_t Round(double value, double limit) {
+  return std::llround(std::max(-limit, std::min(limit, value)));
+}
+
+void Quantize(const TrajectoryPose& pose, double resolution, int64_t q[6]) {
+  for (int i = 0; i < 3; i++)
+    q[i] = Round(pose.position[i] / resolution, 2147483647.0);
+  double norm = 0;
+  for (int i = 0; i < 4; i++)
+    norm += pose.orientation[i] * pose.orientation[i];
+  norm = std::sqrt(norm);
+  if (norm == 0)
+    norm = 1;
+  // q and -q are the same rotation, the one with w positive is sent
+  double scale = (pose.orientation[3] < 0 ? -kQuatScale : kQuatScale) / norm;
+  for (int i = 0; i < 3; i++)
+    q[3 + i] = Round(pose.orientation[i] * scale, kQuatScale);
+}
+
+void Dequantize(const int64_t q[6], double resolution, TrajectoryPose* pose) {
+  double w = 1;
+  for (int i = 0; i < 3; i++) {
+    pose->position[i] = q[i] * resolution;
+    pose->orientation[i] = q[3 + i] / kQuatScale;
+    w -= pose->orientation[i] * pose->orientation[i];
+  }
+  pose->orientation[3] = std::sqrt(std::max(0.0, w));
+}
+
+TrajectoryPose Interpolate(const TrajectoryPose& a, const TrajectoryPose& b,
+                           double time) {
+  double s = b.time > a.time ? (time - a.time) / (b.time - a.time) : 1;
+  TrajectoryPose pose;
+  pose.time = time;
+  for (int i = 0; i < 3; i++)
+    pose.position[i] = a.position[i] + s * (b.position[i] - a.position[i]);
+  // normalized linear interpolation, close enough between estimates
+  double dot = 0;
+  for (int i = 0; i < 4; i++)
+    dot += a.orientation[i] * b.orientation[i];
+  double sign = dot < 0 ? -1 : 1;
+  double norm = 0;
+  for (int i = 0; i < 4; i++) {
+    pose.orientation[i] = (1 - s) * a.orientation[i] +
+                          s * sign * b.orientation[i];
+    norm += pose.orientation[i] * pose.orientation[i];
+  }
+  norm = std::sqrt(norm);
+  for (int i = 0; i < 4; i++)
+    pose.orientation[i] = norm > 0 ? pose.orientation[i] / norm : 0;
+  return pose;
+}
+
+}  // namespace
+
+TrajectoryPacker::TrajectoryPacker(double interval, unsigned int num_poses,
+                                   double position_resolution)
+  : num_poses_(std::max(2u, std::min(num_poses, 255u))),
+    have_last_(false),
+    sample_(0) {
+  // rounded to what the header holds so both sides agree on the times
+  interval_us_ = std::max(1ll, std::llround(interval * 1e6));
+  interval_ = interval_us_ * 1e-6;
+  resolution_um_ = std::max(1ll, std::llround(position_resolution * 1e6));
+  resolution_ = resolution_um_ * 1e-6;
+}
+
+bool TrajectoryPacker::Add(const TrajectoryPose& pose,
+                           std::vector<uint8_t>* packet) {
+  bool packed = false;
+  // the poses of a packet are only interpolated across short gaps, which also
+  // keeps this to one packet per estimate
+  if (have_last_ && (pose.time < last_.time ||
+                     pose.time - last_.time > (num_poses_ - 1) * interval_)) {
+    if (!poses_.empty()) {
+      Pack(packet);
+      packed = true;
+    }
+    have_last_ = false;
+  }
+
+  if (!have_last_) {
+    have_last_ = true;
+    last_ = pose;
+    start_ = pose.time;
+    sample_ = 0;
+  }
+
+  // times counted from the start rather than summed, so they do not drift
+  while (start_ + sample_ * interval_ <= pose.time) {
+    poses_.push_back(Interpolate(last_, pose, start_ + sample_ * interval_));
+    sample_++;
+    if (poses_.size() == num_poses_) {
+      Pack(packet);
+      packed = true;
+    }
+  }
+
+  last_ = pose;
+  return packed;
+}
+
+void TrajectoryPacker::Reset() {
+  have_last_ = false;
+  poses_.clear();
+}
+
+void TrajectoryPacker::Pack(std::vector<uint8_t>* packet) {
+  packet->clear();
+  packet->insert(packet->end(), kMagic, kMagic + 4);
+  packet->push_back(kVersion);
+  packet->push_back(poses_.size());
+  Put(packet, interval_us_, 4);
+  Put(packet, std::llround(poses_[0].time * 1e6), 8);
+  Put(packet, resolution_um_, 4);
+
+  int64_t last[6], q[6];
+  for (size_t i = 0; i < poses_.size(); i++) {
+    Quantize(poses_[i], resolution_, q);
+    for (int j = 0; j < 6; j++) {
+      if (i > 0)
+        PutVarint(packet, q[j] - last[j]);
+      else
+        Put(packet, q[j], j < 3 ? 4 : 2);
+      last[j] = q[j];
+    }
+  }
+  poses_.clear();
+}
+
+bool UnpackTrajectory(const uint8_t* data, size_t size,
+                      std::vector<TrajectoryPose>* poses) {
+  poses->clear();
+  if (size < kHeaderSize + kFirstPoseSize ||
+      std::memcmp(data, kMagic, 4) != 0 || data[4] != kVersion ||
+      data[5] == 0)
+    return false;
+  unsigned int count = data[5];
+  double interval = Get(data + 6, 4) * 1e-6;
+  double start = static_cast<int64_t>(Get(data + 10, 8)) * 1e-6;
+  double resolution = Get(data + 18, 4) * 1e-6;
+
+  const uint8_t* p = data + kHeaderSize;
+  const uint8_t* end = data + size;
+  int64_t q[6];
+  for (int j = 0; j < 3; j++) {
+    q[j] = static_cast<int32_t>(Get(p + 4 * j, 4));
+    q[3 + j] = static_cast<int16_t>(Get(p + 12 + 2 * j, 2));
+  }
+  p += kFirstPoseSize;
+
+  poses->resize(count);
+  for (unsigned int i = 0; i < count; i++) {
+    for (int j = 0; i > 0 && j < 6; j++) {
+      int64_t delta;
+      if (!GetVarint(&p, end, &delta)) {
+        poses->clear();
+        return false;
+      }
+      q[j] += delta;
+    }
+    Dequantize(q, resolution, &(*poses)[i]);
+    (*poses)[i].time = start + i * interval;
+  }
+  return p == end;
+}
+
+}  // end namespace ff
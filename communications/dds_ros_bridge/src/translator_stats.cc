@@ -0,0 +1,98 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "dds_ros_bridge/translator_stats.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+
+namespace ff {
+
+namespace {
+
+// upper bounds of the latency buckets in seconds, the last one is open
+const double kBounds[TranslatorStats::kNumBuckets - 1] = {
+  0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0};
+
+}  // namespace
+
+TranslatorStats::TranslatorStats()
+  : messages_(0),
+    bytes_(0),
+    interval_messages_(0),
+    interval_bytes_(0),
+    max_latency_(0) {
+  std::fill(buckets_, buckets_ + kNumBuckets, 0);
+}
+
+void TranslatorStats::Record(double latency, size_t bytes) {
+  int bucket = std::upper_bound(kBounds, kBounds + kNumBuckets - 1, latency)
+             - kBounds;
+  std::lock_guard<std::mutex> lock(mutex_);
+  messages_++;
+  bytes_ += bytes;
+  interval_messages_++;
+  interval_bytes_ += bytes;
+  buckets_[bucket]++;
+  max_latency_ = std::max(max_latency_, latency);
+}
+
+uint64_t TranslatorStats::Messages() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return messages_;
+}
+
+uint64_t TranslatorStats::Bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_;
+}
+
+double TranslatorStats::Percentile(double p) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (messages_ == 0)
+    return 0;
+  uint64_t target = std::max<uint64_t>(1, p * messages_ + 0.5);
+  uint64_t count = 0;
+  for (int i = 0; i < kNumBuckets - 1; i++) {
+    count += buckets_[i];
+    if (count >= target)
+      return std::min(kBounds[i], max_latency_);
+  }
+  return max_latency_;
+}
+
+std::string TranslatorStats::Summary(double dt) {
+  double p50 = Percentile(0.5), p99 = Percentile(0.99);
+  std::lock_guard<std::mutex> lock(mutex_);
+  double rate = 0, throughput = 0;
+  if (dt > 0) {
+    rate = interval_messages_ / dt;
+    throughput = interval_bytes_ / dt;
+  }
+  interval_messages_ = 0;
+  interval_bytes_ = 0;
+  char line[128];
+  snprintf(line, sizeof(line),
+           "%llu msgs %.1f Hz %.0f B/s p50 %.1fms p99 %.1fms max %.1fms",
+           static_cast<unsigned long long>(messages_), rate,  // NOLINT
+           throughput, 1000 * p50, 1000 * p99, 1000 * max_latency_);
+  return line;
+}
+
+}  // end namespace ff
@@ -37,21 +37,29 @@
 #include <ff_msgs/ControlCommand.h>
 #include <ff_msgs/FlightMode.h>
 #include <ff_msgs/EkfState.h>
+#include <ff_msgs/EkfStateCompact.h>
+#include <ff_msgs/Segment.h>
 
 // Libraries to handle flight config and segment processing
 #include <ff_util/ff_flight.h>
 #include <ff_util/ff_action.h>
 #include <ff_util/ff_fsm.h>
+#include <ff_util/metrics.h>
 #include <ff_util/perf_timer.h>
 
 // Libraries to read LIA config file
 #include <config_reader/config_reader.h>
 
+// Lock-free handoff to the control thread
+#include <ctl/triple_buffer.h>
+
 // STL includes
+#include <atomic>
 #include <string>
 #include <vector>
 #include <mutex>
 #include <memory>
+#include <thread>
 
 namespace ctl {
 
@@ -98,6 +106,11 @@ class Ctl {
 
   // Called when a pose estimate is available
   void EkfCallback(const ff_msgs::EkfState::ConstPtr& state);
+  void EkfCompactCallback(const ff_msgs::EkfStateCompact::ConstPtr& state);
+
+  // Takes the estimate from either EKF message, and steps control
+  template <typename State>
+  void Estimate(State const& state, ros::Time const& stamp);
 
   // Called when localization has a new pose data
   void PoseCallback(const geometry_msgs::PoseStamped::ConstPtr& truth);
@@ -108,8 +121,8 @@ class Ctl {
   // Called when management updates inertial info
   void InertiaCallback(const geometry_msgs::Inertia::ConstPtr& inertia);
 
-  // Called when a timer has called back to progress control to next setpoint
-  void ControlTimerCallback(const ros::TimerEvent & event);
+  // Steps control at a fixed rate on a real time thread, if configured
+  void ControlThread(void);
 
   // Called when the choreographer updates flight modes
   void FlightModeCallback(const ff_msgs::FlightMode::ConstPtr& mode);
@@ -117,6 +130,9 @@ class Ctl {
   // Used to feed segments
   void TimerCallback(const ros::TimerEvent& event);
 
+  // Called with the next setpoints of a streamed segment
+  void AppendCallback(const ff_msgs::Segment::ConstPtr& msg);
+
   // ACTION CLIENT
 
   // Called when a new goal arrives
@@ -147,13 +163,19 @@ class Ctl {
   std::string getName();
 
  private:
+  // Makes the latest inputs visible to the control thread
+  void PublishInput(void);
+
   // Proxy to gnc
   gnc_autocode::GncCtlAutocode gnc_;
 
+  // The latest inputs, written under mutex_cmd_msg_, and copied to gnc_ on each step
+  ctl_input_msg input_;
+
   std::mutex mutex_cmd_msg_, mutex_segment_;
 
   ros::Subscriber truth_pose_sub_, inertia_sub_, flight_mode_sub_;
-  ros::Subscriber twist_sub_, pose_sub_, ekf_sub_;
+  ros::Subscriber twist_sub_, pose_sub_, ekf_sub_, append_sub_;
   ros::Publisher ctl_pub_, traj_pub_, segment_pub_, progress_pub_;
   ros::Timer timer_;
 
@@ -161,16 +183,31 @@ class Ctl {
   ff_util::FSM fsm_;
   ff_util::Segment segment_;
   ff_util::Segment::iterator setpoint_;
+  bool streaming_;                    // More setpoints will be appended
   ff_msgs::ControlFeedback feedback_;
 
   config_reader::ConfigReader config_;
   ff_util::PerfTimer pt_ctl_;
+  // The camera frame traced through the last estimate, which may be read by
+  // the control thread, and the trace of the commands it ends up in
+  std::atomic<uint32_t> trace_id_;
+  std::atomic<uint64_t> trace_stamp_;
+  ff_util::MetricTrace tr_ctl_;
   ros::Timer config_timer_;
 
   std::string name_;
-  bool inertia_received_;
-  bool control_enabled_;
+  std::atomic<bool> inertia_received_;
+  std::atomic<bool> control_enabled_;
   bool use_truth_;
+
+  // Control thread, used instead of stepping on each estimate if the rate is set
+  bool use_thread_;
+  double thread_rate_;
+  int thread_priority_, thread_core_;
+  TripleBuffer<ctl_input_msg> thread_input_;
+  std::atomic<bool> thread_stop_;
+  std::thread thread_;
+  ff_util::PerfTimer pt_jitter_;
 };
 
 }  // end namespace ctl
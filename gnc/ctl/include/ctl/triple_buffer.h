@@ -0,0 +1,65 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef CTL_TRIPLE_BUFFER_H_
+#define CTL_TRIPLE_BUFFER_H_
+
+#include <atomic>
+
+namespace ctl {
+
+/**
+ * @brief Lock-free handoff of the latest value from one thread to another.
+ * @details The producer writes in Back() and calls Publish(), the consumer
+ * calls Update() and reads Front(). Neither waits, and values the consumer
+ * did not get to in time are skipped.
+ */
+template <typename T>
+class TripleBuffer {
+ public:
+  TripleBuffer() : back_(0), middle_(1), front_(2) {}
+
+  T* Back() {return &buffers_[back_];}
+  void Publish() {
+    back_ = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel) & INDEX;
+  }
+
+  /**
+   * Moves the latest published value to Front(). Returns false if there was
+   * none since the last call, and Front() is unchanged.
+   **/
+  bool Update() {
+    if (!(middle_.load(std::memory_order_relaxed) & FRESH))
+      return false;
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+    return true;
+  }
+  const T& Front() const {return buffers_[front_];}
+
+ private:
+  enum {INDEX = 3, FRESH = 4};  // the middle buffer's index, and whether it is newer than the front
+
+  T buffers_[3];
+  int back_;                 // only used by the producer
+  std::atomic<int> middle_;  // swapped by both
+  int front_;                // only used by the consumer
+};
+
+}  // end namespace ctl
+
+#endif  // CTL_TRIPLE_BUFFER_H_
@@ -17,6 +17,7 @@
  */
 
 #include <ctl/ctl.h>
+#include <fam/fam.h>
 
 #include <nodelet/nodelet.h>
 
@@ -30,6 +31,12 @@
 #include <Eigen/Dense>
 #include <Eigen/Geometry>
 
+#include <pthread.h>
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
 // parameters ctl_controller0_P are set in
 //   matlab/code_generation/ctl_controller0_ert_rtw/ctl_controller0_data.c
 
@@ -42,7 +49,9 @@ namespace ctl {  // Nodehandle for <robot>/gnc/wrapper
 Ctl::Ctl(ros::NodeHandle* nh, std::string const& name) :
   fsm_(WAITING, std::bind(&Ctl::UpdateCallback,
     this, std::placeholders::_1, std::placeholders::_2)),
-      name_(name), inertia_received_(false), control_enabled_(false) {
+      streaming_(false), trace_id_(0), trace_stamp_(0), name_(name), inertia_received_(false),
+      control_enabled_(false),
+      use_thread_(false), thread_stop_(false) {
   // Add the state transition lambda functions - refer to the FSM diagram
   // [0]
   fsm_.Add(WAITING,
@@ -87,7 +96,7 @@ Ctl::Ctl(ros::NodeHandle* nh, std::string const& name) :
   // Set the operating mode to STOP by default, so that when the speed ramps
   // up we don't drift off position because of small forces and torques
   mutex_cmd_msg_.lock();
-  gnc_.ctl_input_.ctl_mode_cmd = ff_msgs::ControlCommand::MODE_STOP;
+  input_.ctl_mode_cmd = ff_msgs::ControlCommand::MODE_STOP;
   mutex_cmd_msg_.unlock();
 
   // Initialize GNC
@@ -96,13 +105,28 @@ Ctl::Ctl(ros::NodeHandle* nh, std::string const& name) :
   config_.AddFile("gnc.config");
   config_.AddFile("geometry.config");
   ReadParams();
+
+  // Decide before any callbacks whether they step control, or a thread does
+  use_thread_ = (thread_rate_ > 0);
+  if (use_thread_) {
+    std::lock_guard<std::mutex> lock(mutex_cmd_msg_);
+    PublishInput();
+  }
   config_timer_ = nh->createTimer(ros::Duration(1), [this](ros::TimerEvent e) {
       config_.CheckFilesUpdated(std::bind(&Ctl::ReadParams, this));}, false, true);
   pt_ctl_.Initialize("ctl");
+  tr_ctl_ = ff_util::MetricsRegistry::Instance().Trace("ctl");
 
   // Subscribers
-  ekf_sub_ = nh->subscribe(
-    TOPIC_GNC_EKF, 1, &Ctl::EkfCallback, this);
+  bool compact_state = false;
+  if (!config_.GetBool("ekf_compact_state", &compact_state))
+    ROS_FATAL("ekf_compact_state not specified.");
+  if (compact_state)
+    ekf_sub_ = nh->subscribe(
+      TOPIC_GNC_EKF_COMPACT, 1, &Ctl::EkfCompactCallback, this);
+  else
+    ekf_sub_ = nh->subscribe(
+      TOPIC_GNC_EKF, 1, &Ctl::EkfCallback, this);
   pose_sub_ = nh->subscribe(
     TOPIC_LOCALIZATION_POSE, 1, &Ctl::PoseCallback, this);
   twist_sub_ = nh->subscribe(
@@ -111,6 +135,8 @@ Ctl::Ctl(ros::NodeHandle* nh, std::string const& name) :
     TOPIC_MOBILITY_INERTIA, 1, &Ctl::InertiaCallback, this);
   flight_mode_sub_ = nh->subscribe(
     TOPIC_MOBILITY_FLIGHT_MODE, 1, &Ctl::FlightModeCallback, this);
+  append_sub_ = nh->subscribe(
+    TOPIC_GNC_CTL_APPEND, 10, &Ctl::AppendCallback, this);
 
   // Advertised messages
   ctl_pub_ = nh->advertise<ff_msgs::FamCommand>(
@@ -130,11 +156,21 @@ Ctl::Ctl(ros::NodeHandle* nh, std::string const& name) :
   // This timer will be used to throttle control to GNC
   timer_ = nh->createTimer(ros::Duration(0),
     &Ctl::TimerCallback, this, true, false);
+
+  // Start stepping control at a fixed rate
+  if (use_thread_) {
+    pt_jitter_.Initialize("ctl_jitter");
+    thread_ = std::thread(&Ctl::ControlThread, this);
+  }
 }
 
 
 // Destructor
-Ctl::~Ctl() {}
+Ctl::~Ctl() {
+  thread_stop_ = true;
+  if (thread_.joinable())
+    thread_.join();
+}
 
 // Complete the current dock or undock action
 FSM::State Ctl::Result(int32_t response) {
@@ -163,6 +199,7 @@ FSM::State Ctl::Result(int32_t response) {
   timer_.stop();
   segment_.clear();
   setpoint_ = segment_.end();
+  streaming_ = false;
   mutex_segment_.unlock();
   // Always return to the waiting state
   return WAITING;
@@ -187,18 +224,33 @@ void Ctl::UpdateCallback(FSM::State const& state, FSM::Event const& event) {
 
 // Callback in regular mode
 void Ctl::EkfCallback(const ff_msgs::EkfState::ConstPtr& state) {
+  Estimate(*state, state->header.stamp);
+}
+
+// Callback in regular mode, with the compact EKF state
+void Ctl::EkfCompactCallback(const ff_msgs::EkfStateCompact::ConstPtr& state) {
+  Estimate(*state, state->stamp);
+}
+
+template <typename State>
+void Ctl::Estimate(State const& state, ros::Time const& stamp) {
   if (!use_truth_) {
     mutex_cmd_msg_.lock();
-    auto & ctl = gnc_.ctl_input_;
-    msg_conversions::ros_to_array_vector(state->omega, ctl.est_omega_B_ISS_B);
-    msg_conversions::ros_to_array_vector(state->velocity, ctl.est_V_B_ISS_ISS);
-    msg_conversions::ros_to_array_point(state->pose.position, ctl.est_P_B_ISS_ISS);
-    msg_conversions::ros_to_array_quat(state->pose.orientation, ctl.est_quat_ISS2B);
-    ctl.est_confidence = state->confidence;
-    ctl.current_time_sec = state->header.stamp.sec;
-    ctl.current_time_nsec = state->header.stamp.nsec;
+    auto & ctl = input_;
+    msg_conversions::ros_to_array_vector(state.omega, ctl.est_omega_B_ISS_B);
+    msg_conversions::ros_to_array_vector(state.velocity, ctl.est_V_B_ISS_ISS);
+    msg_conversions::ros_to_array_point(state.pose.position, ctl.est_P_B_ISS_ISS);
+    msg_conversions::ros_to_array_quat(state.pose.orientation, ctl.est_quat_ISS2B);
+    ctl.est_confidence = state.confidence;
+    ctl.current_time_sec = stamp.sec;
+    ctl.current_time_nsec = stamp.nsec;
+    trace_stamp_ = state.trace_stamp.toNSec();
+    trace_id_ = state.trace_id;
+    PublishInput();
     mutex_cmd_msg_.unlock();
     // advance control forward whenever the pose is updated
+    if (use_thread_)
+      return;
     pt_ctl_.Tick();
     Step();
     pt_ctl_.Tock();
@@ -210,14 +262,17 @@ void Ctl::EkfCallback(const ff_msgs::EkfState::ConstPtr& state) {
 void Ctl::PoseCallback(const geometry_msgs::PoseStamped::ConstPtr& truth) {
   if (use_truth_) {
     mutex_cmd_msg_.lock();
-    auto& ctl = gnc_.ctl_input_;
+    auto& ctl = input_;
     msg_conversions::ros_to_array_point(truth->pose.position, ctl.est_P_B_ISS_ISS);
     msg_conversions::ros_to_array_quat(truth->pose.orientation, ctl.est_quat_ISS2B);
     ctl.est_confidence = 0;  // Localization manager now deals with this
     ctl.current_time_sec = truth->header.stamp.sec;
     ctl.current_time_nsec = truth->header.stamp.nsec;
+    PublishInput();
     mutex_cmd_msg_.unlock();
     // advance control forward whenever the pose is updated
+    if (use_thread_)
+      return;
     pt_ctl_.Tick();
     Step();
     pt_ctl_.Tock();
@@ -228,9 +283,10 @@ void Ctl::PoseCallback(const geometry_msgs::PoseStamped::ConstPtr& truth) {
 void Ctl::TwistCallback(const geometry_msgs::TwistStamped::ConstPtr& truth) {
   if (use_truth_) {
     mutex_cmd_msg_.lock();
-    auto& ctl = gnc_.ctl_input_;
+    auto& ctl = input_;
     mc::ros_to_array_vector(truth->twist.linear, ctl.est_V_B_ISS_ISS);
     mc::ros_to_array_vector(truth->twist.angular, ctl.est_omega_B_ISS_B);
+    PublishInput();
     mutex_cmd_msg_.unlock();
     // Don't advance control, until the pose arrives
   }
@@ -239,7 +295,7 @@ void Ctl::TwistCallback(const geometry_msgs::TwistStamped::ConstPtr& truth) {
 // Called when management updates inertial info
 void Ctl::InertiaCallback(const geometry_msgs::Inertia::ConstPtr& inertia) {
   std::lock_guard<std::mutex> lock(mutex_cmd_msg_);
-  auto& input = gnc_.ctl_input_;
+  auto& input = input_;
   input.mass = inertia->m;
   // mc::ros_to_array_vector(inertia->com, input.center_of_mass);  // no longer exists
   input.inertia_matrix[0] = inertia->ixx;
@@ -251,13 +307,14 @@ void Ctl::InertiaCallback(const geometry_msgs::Inertia::ConstPtr& inertia) {
   input.inertia_matrix[6] = inertia->ixz;
   input.inertia_matrix[7] = inertia->iyz;
   input.inertia_matrix[8] = inertia->izz;
+  PublishInput();
   inertia_received_ = true;
 }
 
 // Called when choreographer updates the flight mode
 void Ctl::FlightModeCallback(const ff_msgs::FlightMode::ConstPtr& mode) {
   std::lock_guard<std::mutex> lock(mutex_cmd_msg_);
-  auto& input = gnc_.ctl_input_;
+  auto& input = input_;
   mc::ros_to_array_vector(mode->att_kp, input.att_kp);
   mc::ros_to_array_vector(mode->att_ki, input.att_ki);
   mc::ros_to_array_vector(mode->omega_kd, input.omega_kd);
@@ -265,6 +322,7 @@ void Ctl::FlightModeCallback(const ff_msgs::FlightMode::ConstPtr& mode) {
   mc::ros_to_array_vector(mode->pos_ki, input.pos_ki);
   mc::ros_to_array_vector(mode->vel_kd, input.vel_kd);
   input.speed_gain_cmd = mode->speed;
+  PublishInput();
   control_enabled_ =
     (input.speed_gain_cmd > 0 ? mode->control_enabled : false);
 }
@@ -281,7 +339,13 @@ void Ctl::TimerCallback(const ros::TimerEvent& event) {
     size_t idx = std::distance(segment_.begin(), setpoint_);
     // If the setpoint is pointing to the last segment, that's it!
     if (setpoint_ == segment_.end()) {
+      bool underrun = streaming_;
       mutex_segment_.unlock();
+      if (underrun) {
+        NODELET_WARN_STREAM("Streamed setpoints ran out at " << idx);
+        fsm_.SetState(Result(RESPONSE::STREAM_UNDERRUN));
+        return;
+      }
       NODELET_DEBUG_STREAM("Final setpoint " << idx);
       return fsm_.Update(GOAL_COMPLETE);
     }
@@ -353,6 +417,7 @@ void Ctl::GoalCallback(ff_msgs::ControlGoalConstPtr const& goal) {
       mutex_segment_.lock();
       segment_ = goal->segment;       // Copy over the segment to be processed
       setpoint_ = segment_.begin();   // We are processing the first setpoint
+      streaming_ = goal->streaming;   // Whether more setpoints will follow
       mutex_segment_.unlock();
       // Publish the segment to used by the sentinel (and perhaps others)
       static ff_msgs::Segment msg;
@@ -369,6 +434,31 @@ void Ctl::GoalCallback(ff_msgs::ControlGoalConstPtr const& goal) {
   Result(RESPONSE::INVALID_COMMAND);
 }
 
+// The next setpoints of a streamed segment, or an empty segment at its end
+void Ctl::AppendCallback(const ff_msgs::Segment::ConstPtr& msg) {
+  std::lock_guard<std::mutex> lock(mutex_segment_);
+  if (fsm_.GetState() != NOMINAL || !streaming_ || segment_.empty())
+    return;
+  if (msg->segment.empty()) {
+    NODELET_DEBUG_STREAM("End of the streamed segment");
+    streaming_ = false;
+    return;
+  }
+  // Setpoints of an older stream, or already passed
+  if (msg->segment.front().when <= segment_.back().when) {
+    NODELET_WARN_STREAM("Ignoring setpoints that do not follow the segment");
+    return;
+  }
+  // Appending may move the setpoints, so keep the position by index
+  size_t idx = std::distance(segment_.begin(), setpoint_);
+  segment_.insert(segment_.end(), msg->segment.begin(), msg->segment.end());
+  setpoint_ = segment_.begin() + idx;
+  // Let the sentinel see the rest of the segment
+  static ff_msgs::Segment seg;
+  seg.segment = segment_;
+  segment_pub_.publish(seg);
+}
+
 // Cancellation
 void Ctl::CancelCallback() {
   fsm_.Update(GOAL_CANCEL);
@@ -383,10 +473,12 @@ void Ctl::PreemptCallback() {
 bool Ctl::Control(uint8_t mode, ff_msgs::ControlCommand const& poseVel) {
   // Set the operating mode
   std::lock_guard<std::mutex> lock(mutex_cmd_msg_);
-  auto& input= gnc_.ctl_input_;
+  auto& input= input_;
   input.ctl_mode_cmd = mode;
-  if (mode != ff_msgs::ControlCommand::MODE_NOMINAL)
+  if (mode != ff_msgs::ControlCommand::MODE_NOMINAL) {
+    PublishInput();
     return true;
+  }
 
   // NOMINAL: Current setpoint
   auto& curr = poseVel.current;
@@ -413,11 +505,20 @@ bool Ctl::Control(uint8_t mode, ff_msgs::ControlCommand const& poseVel) {
     input.cmd_state_b.omega_B_ISS_B);
   mc::ros_to_array_vector(next.accel.angular,
     input.cmd_state_b.alpha_B_ISS_B);
+  PublishInput();
 
   // SUCCESS
   return true;
 }
 
+// Called with mutex_cmd_msg_ held, so there is only ever one producer
+void Ctl::PublishInput(void) {
+  if (!use_thread_)
+    return;
+  *thread_input_.Back() = input_;
+  thread_input_.Publish();
+}
+
 bool Ctl::Step(void) {
   // Step GNC forward
   {
@@ -429,7 +530,14 @@ bool Ctl::Step(void) {
       NODELET_DEBUG_STREAM_THROTTLE(10, "GNC control disabled in flight mode");
       return false;
     }
-    std::lock_guard<std::mutex> cmd_lock(mutex_cmd_msg_);
+    if (use_thread_) {
+      // the control thread never waits for the callbacks
+      thread_input_.Update();
+      gnc_.ctl_input_ = thread_input_.Front();
+    } else {
+      std::lock_guard<std::mutex> cmd_lock(mutex_cmd_msg_);
+      gnc_.ctl_input_ = input_;
+    }
     gnc_.Step();
   }
 
@@ -438,9 +546,24 @@ bool Ctl::Step(void) {
   auto& ctl = gnc_.ctl_;
   auto& input= gnc_.ctl_input_;
 
-  // Publish the FAM command
+  // Step the FAM directly if it is in the same nodelet manager, rather than
+  // waiting for it to receive the command below
   static ff_msgs::FamCommand cmd_msg_;
   cmd_msg_.header.stamp = ros::Time::now();
+  cmd_msg_.trace_id = trace_id_;
+  cmd_msg_.trace_stamp.fromNSec(trace_stamp_);
+  if (cmd_msg_.trace_id)
+    tr_ctl_.EmitOnce(cmd_msg_.trace_id, (cmd_msg_.header.stamp - cmd_msg_.trace_stamp).toNSec());
+  {
+    ex_time_msg fam_time;
+    fam_time.timestamp_sec = cmd_msg_.header.stamp.sec;
+    fam_time.timestamp_nsec = cmd_msg_.header.stamp.nsec;
+    cmd_msg fam_cmd = cmd;
+    ctl_msg fam_ctl = ctl;
+    fam::Fam::StepInProcess(&fam_time, &fam_cmd, &fam_ctl, cmd_msg_.trace_id, cmd_msg_.trace_stamp);
+  }
+
+  // Publish the FAM command, which is also still used for logging
   cmd_msg_.header.frame_id = "body";
   cmd_msg_.wrench.force = mc::array_to_ros_vector(ctl.body_force_cmd);
   cmd_msg_.wrench.torque = mc::array_to_ros_vector(ctl.body_torque_cmd);
@@ -492,6 +615,49 @@ bool Ctl::Step(void) {
   return true;
 }
 
+void Ctl::ControlThread(void) {
+  sched_param param;
+  param.sched_priority = thread_priority_;
+  int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if (err)
+    NODELET_WARN_STREAM("Control thread is not real time: " << strerror(err));
+  if (thread_core_ >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(thread_core_, &cpus);
+    err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (err)
+      NODELET_WARN_STREAM("Control thread is not pinned to core " << thread_core_ << ": " << strerror(err));
+  }
+
+  // Sleep until absolute deadlines, so that the period does not drift with
+  // the time each step takes
+  const int64_t period = static_cast<int64_t>(1e9 / thread_rate_);
+  timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  while (!thread_stop_) {
+    int64_t ns = deadline.tv_nsec + period;
+    deadline.tv_sec += ns / 1000000000;
+    deadline.tv_nsec = ns % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {}
+
+    // How late we woke up
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t late = (now.tv_sec - deadline.tv_sec) * 1000000000 + (now.tv_nsec - deadline.tv_nsec);
+    pt_jitter_.Add(late * 1e-9);
+
+    pt_ctl_.Tick();
+    Step();
+    pt_ctl_.Tock();
+    pt_jitter_.Send();
+
+    // Skip the deadlines already missed, rather than stepping to catch up
+    if (late > period)
+      deadline = now;
+  }
+}
+
 std::string Ctl::getName() { return name_; }
 
 // Chainload the readparam call
@@ -503,6 +669,13 @@ void Ctl::ReadParams(void) {
   gnc_.ReadParams(&config_);
   if (!config_.GetBool("tun_debug_ctl_use_truth", &use_truth_))
     ROS_FATAL("tun_debug_ctl_use_truth not specified.");
+  // Only read when starting
+  if (!config_.GetReal("ctl_thread_rate", &thread_rate_))
+    ROS_FATAL("ctl_thread_rate not specified.");
+  if (!config_.GetInt("ctl_thread_priority", &thread_priority_))
+    ROS_FATAL("ctl_thread_priority not specified.");
+  if (!config_.GetInt("ctl_thread_core", &thread_core_))
+    ROS_FATAL("ctl_thread_core not specified.");
 }
 
 }  // end namespace ctl
@@ -20,6 +20,7 @@
 #define EKF_EKF_H_
 
 #include <gnc_autocode/ekf.h>
+#include <ekf/of_feature_table.h>
 
 #include <Eigen/Geometry>
 #include <config_reader/config_reader.h>
@@ -35,24 +36,14 @@
 #include <ff_msgs/Feature2dArray.h>
 #include <ff_msgs/VisualLandmarks.h>
 
+#include <deque>
 #include <list>
-#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace ekf {
 
-typedef struct {
-  float x;
-  float y;
-} OFObservation;
-
-typedef struct {
-  uint32_t feature_id;
-  std::vector<OFObservation> obs;
-  int missing_frames;  // number of frames skipped
-} OFFeature;
-
 /**
  * @brief Ekf implementation using GNC module
  * @details Ekf implementation using GNC module
@@ -99,6 +90,16 @@ class Ekf {
   void VisualLandmarksUpdate(const ff_msgs::VisualLandmarks & vl);
   void VisualLandmarksRegister(const ff_msgs::CameraRegistration & reg);
 
+  /**
+   * Keeps the inputs of the last steps, and the filter after each landmark
+   * registration pulse, so that landmarks arriving after a newer registration
+   * can still be fused at the step of their own registration.
+   **/
+  void RecordStep(void);
+  void SaveCheckpoint(uint64_t step, uint32_t vl_camera_id);
+  void Replay(void);
+  void ClearHistory(void);
+
   /**
    * Writes the inputs for one time step to a file
    * that can later be parsed and tested in matlab.
@@ -128,9 +129,8 @@ class Ekf {
   geometry_msgs::Pose reset_pose_;
   bool reset_ready_;
 
-  // vector of feature ids and observations, observations are features ids and positions
-  // this list is sorted by feature id
-  std::map<int, OFFeature> optical_flow_features_;
+  // the optical flow features and their observations, in order of feature id
+  OFFeatureTable optical_flow_features_;
   // the number of features for each augmentation
   std::vector<int> optical_flow_augs_feature_counts_;
   std::vector<unsigned int> deleting_augs_;
@@ -138,6 +138,37 @@ class Ekf {
   std::vector<ros::Time> optical_flow_augs_times_;
   bool processing_of_reg_, of_inputs_delayed_;
 
+  /** Replay of late visual landmarks **/
+  // the inputs of one step of the autocode
+  struct StepInputs {
+    uint64_t step;
+    uint32_t vl_camera_id;  // the camera registered by this step, if it had a landmark pulse
+    cvs_landmark_msg vis;
+    cvs_registration_pulse reg;
+    cvs_optical_flow_msg of;
+    cvs_handrail_msg hand;
+    imu_msg imu;
+    real32_T quat[4];
+    cmc_msg cmc;
+  };
+  // the autocode after the step of a landmark registration pulse
+  struct Checkpoint {
+    uint64_t step;  // the first step after the pulse
+    uint32_t vl_camera_id;
+    DW_est_estimator_T dwork;
+    B_est_estimator_T block_io;
+    kfl_msg kfl;
+    std::vector<float> cov;
+  };
+  // steps of inputs to keep, zero disables the replay
+  int replay_steps_;
+  uint64_t step_count_;
+  std::deque<StepInputs> history_;
+  std::deque<std::shared_ptr<Checkpoint> > checkpoints_;  // oldest first
+  // the landmarks of an earlier registration, and the checkpoint to replay them from
+  cvs_landmark_msg late_vis_;
+  std::shared_ptr<Checkpoint> replay_from_;
+
   // in output to file mode, the file to output to
   FILE* output_file_;
 
@@ -158,6 +189,9 @@ class Ekf {
   uint32_t vl_camera_id_;
   uint32_t of_camera_id_;
   uint32_t dl_camera_id_;
+  // the camera frame of the visual landmarks last fused, passed on in the state
+  uint32_t trace_id_;
+  ros::Time trace_stamp_;
 
   /** handrail related work **/
   bool reset_handrail_pose_;
@@ -20,6 +20,8 @@
 #define EKF_EKF_WRAPPER_H_
 
 #include <ekf/ekf.h>
+#include <ekf/imu_predictor.h>
+#include <ff_util/spsc_queue.h>
 
 #include <Eigen/Geometry>
 #include <config_reader/config_reader.h>
@@ -34,13 +36,17 @@
 
 #include <sensor_msgs/Imu.h>
 #include <sensor_msgs/PointCloud2.h>
+#include <ff_msgs/ImuBatch.h>
 #include <ff_msgs/CameraRegistration.h>
 #include <ff_msgs/DepthLandmarks.h>
+#include <ff_msgs/EkfPrediction.h>
 #include <ff_msgs/EkfState.h>
+#include <ff_msgs/EkfStateCompact.h>
 #include <ff_msgs/Feature2dArray.h>
 #include <ff_msgs/SetEkfInput.h>
 #include <ff_msgs/VisualLandmarks.h>
 #include <ff_msgs/FlightMode.h>
+#include <ff_util/metrics.h>
 #include <ff_util/perf_timer.h>
 #include <std_srvs/Empty.h>
 
@@ -84,6 +90,16 @@ class EkfWrapper {
    * Publishes a ROS message containing the state of the EKF.
    **/
   void PublishState(const ff_msgs::EkfState & state);
+  /**
+   * Publishes the state on gnc/ekf, and with the compact state on
+   * gnc/ekf/compact, throttling the full one.
+   **/
+  void PublishFilterState(const ff_msgs::EkfState & state);
+  /**
+   * Propagates the last state with an IMU sample, and publishes the
+   * prediction. Called from the IMU callback.
+   **/
+  void PublishPrediction(sensor_msgs::Imu const& imu);
 
   /**
    * Resets the EKF.
@@ -109,6 +125,7 @@ class EkfWrapper {
    * is called.
    **/
   void ImuCallBack(sensor_msgs::Imu::ConstPtr const& imu);
+  void ImuBatchCallBack(ff_msgs::ImuBatch::ConstPtr const& batch);
   void OpticalFlowCallBack(ff_msgs::Feature2dArray::ConstPtr const& of);
   void VLVisualLandmarksCallBack(ff_msgs::VisualLandmarks::ConstPtr const& vl);
   void ARVisualLandmarksCallBack(ff_msgs::VisualLandmarks::ConstPtr const& vl);
@@ -128,6 +145,28 @@ class EkfWrapper {
   void PublishFeatures(ff_msgs::VisualLandmarks::ConstPtr const& l);
   void PublishFeatures(ff_msgs::DepthLandmarks::ConstPtr const& l);
 
+  /**
+   * Queues and applies the inputs other than the IMU.
+   **/
+  enum InputStream {
+    INPUT_OF, INPUT_OF_REGISTRATION,
+    INPUT_VL, INPUT_VL_REGISTRATION,
+    INPUT_AR, INPUT_AR_REGISTRATION,
+    INPUT_DL, INPUT_DL_REGISTRATION,
+    INPUT_TRUTH,
+    NUM_INPUT_STREAMS
+  };
+  struct Input {
+    uint64_t seq;  // arrival order across all of the streams
+    ff_msgs::Feature2dArray::ConstPtr of;
+    ff_msgs::VisualLandmarks::ConstPtr vl;
+    ff_msgs::DepthLandmarks::ConstPtr dl;
+    ff_msgs::CameraRegistration::ConstPtr reg;
+    geometry_msgs::PoseStamped::ConstPtr truth;
+  };
+  void QueueInput(InputStream stream, Input* input);
+  void ApplyInputs(void);
+
   /** Variables **/
   // the actual EKF
   Ekf ekf_;
@@ -135,15 +174,10 @@ class EkfWrapper {
 
   bool ekf_initialized_;
 
-  // most recent imu message
-  sensor_msgs::Imu imu_;
+  // most recent ground truth orientation
   geometry_msgs::Quaternion quat_;
   int imus_dropped_;
 
-  // EKF wrapper needs to capture the first landmark message to do PnP before
-  // it can initialize the EKF autocode and let it run. This variable holds
-  // that state and is atomic so that it doesn't require a mutex.
-  std::atomic<bool> have_imu_;
   std::atomic<int> input_mode_;
 
   /** Configuration Constants **/
@@ -151,6 +185,8 @@ class EkfWrapper {
   /** Ros **/
   config_reader::ConfigReader config_;
   ff_util::PerfTimer pt_ekf_;
+  ff_util::MetricTrace tr_landmarks_, tr_state_;
+  ff_util::MetricHistogram hist_predict_latency_, hist_predict_horizon_;
   ros::Timer config_timer_;
 
   ros::NodeHandle* nh_;
@@ -163,23 +199,41 @@ class EkfWrapper {
   ros::Publisher state_pub_;
   ros::Publisher feature_pub_;
   ros::Publisher pose_pub_, twist_pub_;
+  ros::Publisher predicted_pub_;
+  ros::Publisher compact_pub_;
   tf2_ros::TransformBroadcaster transform_pub_;
   ros::ServiceServer reset_srv_, bias_srv_, input_mode_srv_;
 
   /** Threading **/
 
-  // mutex for msgs, concurrency protection
-  std::mutex mutex_act_msg_;
+  // Each callback pushes its messages to its own queue, which the step drains
+  // without waiting for the callbacks. Only the step thread touches ekf_, and
+  // a slow landmark callback never delays an IMU step.
+  ff_util::SpscQueue<sensor_msgs::Imu::ConstPtr, 16> imu_queue_;
+  ff_util::SpscQueue<Input, 8> input_queues_[NUM_INPUT_STREAMS];
+  std::atomic<uint64_t> input_seq_;
+
+  // the states the step publishes, for the IMU callback to propagate
+  ff_util::SpscQueue<ff_msgs::EkfState, 4> predict_queue_;
+  ImuPredictor predictor_;
+  std::atomic<bool> predict_imu_;
+  ff_msgs::EkfPrediction prediction_;
+
+  // With the compact state, which goes out every step, the full one is only
+  // published every full_state_period_ seconds, or when the confidence changes
+  bool compact_state_;
+  std::atomic<double> full_state_period_;
+  ros::Time last_full_stamp_;
+  uint8_t last_full_confidence_;
+  ff_msgs::EkfStateCompact compact_;
+
+  // mutex and cv to wake the step up when an imu reading is queued. The
+  // callback only takes the mutex to notify the cv.
   std::mutex mutex_imu_msg_;
-  std::mutex mutex_of_msg_;
-  std::mutex mutex_vl_msg_;
-  std::mutex mutex_truth_msg_;
-
-  // cv to wait for an imu reading
   std::condition_variable cv_imu_;
 
   /** IMU Bias reset variables **/
-  std::string bias_file_;
+  std::string imu_bias_file_, bias_file_;
   bool estimating_bias_;
   float bias_reset_sums_[6];
   int bias_reset_count_;
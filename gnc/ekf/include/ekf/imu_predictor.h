@@ -0,0 +1,86 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef EKF_IMU_PREDICTOR_H_
+#define EKF_IMU_PREDICTOR_H_
+
+#include <Eigen/Geometry>
+
+#include <ff_msgs/EkfPrediction.h>
+#include <ff_msgs/EkfState.h>
+#include <sensor_msgs/Imu.h>
+
+#include <deque>
+
+namespace ekf {
+
+/**
+ * @brief Propagates the last EKF state forward with each new IMU sample.
+ * @details A plain strapdown integration of the bias corrected rates and
+ * accelerations, without covariance, so that a pose is ready as soon as a
+ * sample arrives rather than after the filter steps on it. The recent
+ * samples are kept, and a new state is caught up on those after its stamp.
+ * Only one thread may use an instance.
+ */
+class ImuPredictor {
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  ImuPredictor(void);
+
+  /**
+   * The rotation of IMU readings into the body frame, and the gravity in the
+   * world frame that is added back to the accelerations, zero in orbit.
+   **/
+  void SetParams(Eigen::Quaterniond const& body_q_imu, Eigen::Vector3d const& gravity);
+
+  /**
+   * Starts again from a filter state, propagated over the kept samples that
+   * are newer than it.
+   **/
+  void Seed(ff_msgs::EkfState const& state);
+  void Clear(void);
+
+  /**
+   * Keeps and integrates a sample. Returns false if there is no state to
+   * propagate from yet.
+   **/
+  bool Add(sensor_msgs::Imu const& imu);
+
+  /**
+   * The propagated state at the stamp of the last sample.
+   **/
+  void GetPrediction(ff_msgs::EkfPrediction* prediction) const;
+
+ private:
+  void Integrate(sensor_msgs::Imu const& imu);
+
+  Eigen::Quaterniond body_q_imu_;
+  Eigen::Vector3d gravity_;
+
+  bool seeded_;
+  ros::Time state_stamp_, stamp_;
+  uint8_t confidence_;
+  Eigen::Quaterniond world_q_body_;
+  Eigen::Vector3d position_, velocity_, omega_, gyro_bias_, accel_bias_;
+
+  std::deque<sensor_msgs::Imu> samples_;
+};
+
+}  // end namespace ekf
+
+#endif  // EKF_IMU_PREDICTOR_H_
@@ -0,0 +1,111 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef EKF_OF_FEATURE_TABLE_H_
+#define EKF_OF_FEATURE_TABLE_H_
+
+#include <gnc_autocode/ekf.h>
+
+#include <stdint.h>
+
+namespace ekf {
+
+/**
+ * @brief The optical flow features tracked over the augmentations.
+ * @details Fixed size arrays, one entry per slot, so that tracking allocates
+ * nothing. The slots are also kept in order of feature id, which is the
+ * order the features are sent to GNC in. Features removed by Remove() stay
+ * in that order until Compact().
+ */
+class OFFeatureTable {
+ public:
+  enum {
+    // enough for the maximum number of features in each augmentation
+    MAX_FEATURES = ASE_OF_NUM_AUG * ASE_OF_NUM_FEATURES,
+    // one per augmentation, and the newest before its registration
+    MAX_OBSERVATIONS = ASE_OF_NUM_AUG + 1
+  };
+
+  OFFeatureTable(void);
+
+  void Clear(void);
+
+  /**
+   * The number of features, and the slot of the feature at a position in
+   * order of feature id.
+   **/
+  int Size(void) const {return size_;}
+  int Slot(int pos) const {return order_[pos];}
+
+  /**
+   * The slot of a feature, or -1 if it is not tracked.
+   **/
+  int Find(uint32_t id) const;
+  /**
+   * The slot of a feature, added without observations if it is not
+   * tracked. Returns -1 if the table is full.
+   **/
+  int Insert(uint32_t id);
+  /**
+   * Removes the feature in a slot at the next Compact().
+   **/
+  void Remove(int slot) {removed_[slot] = true;}
+  void Compact(void);
+
+  uint32_t Id(int slot) const {return id_[slot];}
+  int MissingFrames(int slot) const {return missing_frames_[slot];}
+  void AddMissingFrame(int slot) {missing_frames_[slot]++;}
+  /**
+   * Whether a feature was observed since ClearObserved().
+   **/
+  bool Observed(int slot) const {return observed_[slot];}
+  void ClearObserved(void);
+
+  /**
+   * The observations of a feature, newest first, one per augmentation.
+   **/
+  int NumObservations(int slot) const {return num_obs_[slot];}
+  float X(int slot, int obs) const {return x_[slot][obs];}
+  float Y(int slot, int obs) const {return y_[slot][obs];}
+  /**
+   * Adds the newest observation. The oldest one is dropped if there is
+   * no room left.
+   **/
+  void AddObservation(int slot, float x, float y);
+  void EraseObservation(int slot, int obs);
+
+ private:
+  int Position(uint32_t id) const;  // the first position with an id not less than this one
+
+  // per slot
+  uint32_t id_[MAX_FEATURES];
+  uint16_t missing_frames_[MAX_FEATURES];  // number of frames skipped
+  uint8_t num_obs_[MAX_FEATURES];
+  bool removed_[MAX_FEATURES];
+  bool observed_[MAX_FEATURES];
+  float x_[MAX_FEATURES][MAX_OBSERVATIONS];
+  float y_[MAX_FEATURES][MAX_OBSERVATIONS];
+
+  uint16_t order_[MAX_FEATURES];  // the slots in order of feature id
+  uint16_t free_[MAX_FEATURES];   // the unused slots
+  int size_, num_free_;
+};
+
+}  // end namespace ekf
+
+#endif  // EKF_OF_FEATURE_TABLE_H_
@@ -33,10 +33,20 @@ DEFINE_bool(save_inputs_file, false, "Save the inputs to a file.");
 
 namespace ekf {
 
+// filter checkpoints kept for replay, at most
+static const size_t kMaxCheckpoints = 8;
+
+// whether landmarks were observed before others
+static bool ObservedBefore(const cvs_landmark_msg & a, const cvs_landmark_msg & b) {
+  return a.cvs_timestamp_sec < b.cvs_timestamp_sec ||
+         (a.cvs_timestamp_sec == b.cvs_timestamp_sec && a.cvs_timestamp_nsec < b.cvs_timestamp_nsec);
+}
+
 Ekf::Ekf(void) :
   reset_ekf_(true), reset_ready_(false),
-  processing_of_reg_(false), of_inputs_delayed_(false), output_file_(NULL),
-  vl_camera_id_(0), of_camera_id_(0), dl_camera_id_(0) {
+  processing_of_reg_(false), of_inputs_delayed_(false),
+  replay_steps_(0), step_count_(0), output_file_(NULL),
+  vl_camera_id_(0), of_camera_id_(0), dl_camera_id_(0), trace_id_(0) {
   gnc_.cmc_.speed_gain_cmd = 1;  // prevent from being invalid when running bags
   of_history_size_ = ASE_OF_NUM_AUG;
   of_max_features_ = ASE_OF_NUM_FEATURES;
@@ -47,6 +57,7 @@ Ekf::Ekf(void) :
   memset(&of_,   0, sizeof(cvs_optical_flow_msg));
   memset(&hand_, 0, sizeof(cvs_handrail_msg));
   memset(&imu_,  0, sizeof(imu_msg));
+  memset(&late_vis_, 0, sizeof(cvs_landmark_msg));
 
 
   bool output = FLAGS_save_inputs_file;
@@ -69,6 +80,8 @@ void Ekf::ReadParams(config_reader::ConfigReader* config) {
 
   if (!config->GetInt("min_of_observations", &min_of_observations_))
     ROS_FATAL("Unspecified min_of_observations.");
+  if (!config->GetInt("ekf_replay_steps", &replay_steps_))
+    ROS_FATAL("Unspecified ekf_replay_steps.");
 
   // get camera transform
   Eigen::Vector3d trans;
@@ -134,37 +147,22 @@ void Ekf::OpticalFlowUpdate(const ff_msgs::Feature2dArray & of) {
     return;
   }
 
-  // put new features in tree to make it faster
-  std::map<int, OFObservation> new_features;
+  // add the new observations, newest first, and the features we weren't tracking yet
+  OFFeatureTable & features = optical_flow_features_;
+  features.ClearObserved();
   for (size_t i = 0; i < of.feature_array.size(); i++) {
-    new_features.insert(std::pair<int, OFObservation>(of.feature_array[i].id,
-    {of.feature_array[i].x, of.feature_array[i].y}));
-  }
-
-  // delete all observations that we didn't see
-  std::map<int, OFFeature>::iterator of_iter = optical_flow_features_.begin();
-  while (of_iter != optical_flow_features_.end()) {
-    if (new_features.count((*of_iter).first) == 0) {
-      OFFeature & f = (*of_iter).second;
-      f.missing_frames++;
-    }
-    of_iter++;
+    int slot = features.Insert(of.feature_array[i].id);
+    if (slot < 0)
+      continue;  // no room left to track it
+    features.AddObservation(slot, of.feature_array[i].x, of.feature_array[i].y);
+    optical_flow_augs_feature_counts_[0]++;
   }
 
-  // now, add new features to the list of existing features
-  for (size_t i = 0; i < of.feature_array.size(); i++) {
-    uint16_t feature_id = of.feature_array[i].id;
-    float x = of.feature_array[i].x;
-    float y = of.feature_array[i].y;
-    // add new feature to list
-    if (optical_flow_features_.count(feature_id) == 0) {
-      optical_flow_features_.insert(std::pair<int, OFFeature>(
-            feature_id, {feature_id, std::vector<OFObservation>(), 0}));
-    }
-    OFFeature & f = optical_flow_features_[feature_id];
-    // add the new observations
-    f.obs.insert(f.obs.begin(), {x, y});
-    optical_flow_augs_feature_counts_[0]++;
+  // count a missing frame for the features we didn't see
+  for (int pos = 0; pos < features.Size(); pos++) {
+    int slot = features.Slot(pos);
+    if (!features.Observed(slot))
+      features.AddMissingFrame(slot);
   }
   of_camera_id_ = 0;
 
@@ -217,57 +215,35 @@ void Ekf::OpticalFlowUpdate(const ff_msgs::Feature2dArray & of) {
   } else {
     of_inputs_delayed_ = true;
   }
-  std::map<int, OFFeature>::iterator iter = optical_flow_features_.begin();
-  while (iter != optical_flow_features_.end()) {
-    OFFeature & f = (*iter).second;
-    if (f.missing_frames > 0) {
+  // in order of feature id, drop the features we lost, and send the others'
+  // observations in the augmentations being deleted, as long as there is room
+  for (int pos = 0; pos < features.Size(); pos++) {
+    int slot = features.Slot(pos);
+    if (features.MissingFrames(slot) > 0) {
       // We are no longer using these observations because we can greatly speed up
       // computation in the EKF with a sparse block H matrix
-      for (unsigned int i = 0; i < f.obs.size(); i++) {
-        unsigned int aug = i + f.missing_frames;
+      for (int i = 0; i < features.NumObservations(slot); i++) {
+        unsigned int aug = i + features.MissingFrames(slot);
         if (aug >= of_history_size_)
           break;
-      //   of_.cvs_observations[aug * of_max_features_ * 2 + index] = f.obs[i].x;
-      //   of_.cvs_observations[aug * of_max_features_ * 2 + index + of_max_features_] = f.obs[i].y;
-      //   of_.cvs_valid_flag[aug * of_max_features_ + index] = 1;
         if (optical_flow_augs_feature_counts_.size() > aug)
           optical_flow_augs_feature_counts_[aug]--;
       }
-      iter = optical_flow_features_.erase(iter);
-    } else {
+      features.Remove(slot);
+    } else if (index < of_max_features_) {
       for (unsigned int i = 0; i < deleting_augs_.size(); i++) {
         unsigned int aug = deleting_augs_[i];
-        if (aug >= f.obs.size())
+        if (aug >= static_cast<unsigned int>(features.NumObservations(slot)))
           break;
-        of_.cvs_observations[aug * of_max_features_ * 2 + index] = f.obs[aug].x;
-        of_.cvs_observations[aug * of_max_features_ * 2 + index + of_max_features_] = f.obs[aug].y;
+        of_.cvs_observations[aug * of_max_features_ * 2 + index] = features.X(slot, aug);
+        of_.cvs_observations[aug * of_max_features_ * 2 + index + of_max_features_] = features.Y(slot, aug);
         of_.cvs_valid_flag[aug * of_max_features_ + index] = 1;
-        // f.obs.erase(f.begin + aug); // feature will be deleted in registration step
+        // the observation will be deleted in registration step
       }
-      iter++;
       index++;
     }
-    if (index >= of_max_features_)
-      break;
-  }
-  // just delete any missing features we didn't have space for
-  while (iter != optical_flow_features_.end()) {
-    OFFeature & f = (*iter).second;
-    if (f.missing_frames > 0) {
-      for (unsigned int i = 0; i < f.obs.size(); i++) {
-        unsigned int aug = i + f.missing_frames;
-        if (aug >= of_history_size_)
-          break;
-      //   of_.cvs_observations[aug * of_max_features_ * 2 + index] = f.obs[i].x;
-      //   of_.cvs_observations[aug * of_max_features_ * 2 + index + of_max_features_] = f.obs[i].y;
-      //   of_.cvs_valid_flag[aug * of_max_features_ + index] = 1;
-        if (optical_flow_augs_feature_counts_.size() > aug)
-          optical_flow_augs_feature_counts_[aug]--;
-      }
-      iter = optical_flow_features_.erase(iter);
-    }
-    iter++;
   }
+  features.Compact();
 }
 
 void Ekf::SparseMapUpdate(const ff_msgs::VisualLandmarks & vl) {
@@ -287,28 +263,46 @@ void Ekf::ARTagUpdate(const ff_msgs::VisualLandmarks & vl) {
 }
 
 void Ekf::VisualLandmarksUpdate(const ff_msgs::VisualLandmarks & vl) {
-  // check that the camera frame matches the one we just registered
+  // check that the camera frame matches the one we just registered, or one
+  // registered earlier, which needs the filter to step again from there
+  cvs_landmark_msg* vis = &vis_;
   if (vl_camera_id_ != vl.camera_id) {
-    ROS_DEBUG_THROTTLE(1, "Registered visual landmark camera %d not found.", vl.camera_id);
-    return;
+    std::shared_ptr<Checkpoint> checkpoint;
+    for (size_t i = 0; i < checkpoints_.size(); i++)
+      if (checkpoints_[i]->vl_camera_id == vl.camera_id)
+        checkpoint = checkpoints_[i];
+    if (!checkpoint) {
+      ROS_DEBUG_THROTTLE(1, "Registered visual landmark camera %d not found.", vl.camera_id);
+      return;
+    }
+    // only one replay per step, of the latest landmarks
+    if (replay_from_ && replay_from_->step > checkpoint->step)
+      return;
+    replay_from_ = checkpoint;
+    vis = &late_vis_;
   }
-  if (vl.landmarks.size() < 5)
+  if (vl.landmarks.size() < 5) {
+    if (vis == &late_vis_)
+      replay_from_.reset();
     return;
+  }
   last_estimate_pose_= vl.pose;
+  trace_id_ = vl.camera_id;
+  trace_stamp_ = vl.header.stamp;
   // find better way to choose limited landmarks to send?
   for (int i = 0; i < std::min(ml_max_features_, static_cast<int>(vl.landmarks.size())); i++) {
-    vis_.cvs_landmarks[i]                        = vl.landmarks[i].x;
-    vis_.cvs_landmarks[ml_max_features_ + i]     = vl.landmarks[i].y;
-    vis_.cvs_landmarks[2 * ml_max_features_ + i] = vl.landmarks[i].z;
-    vis_.cvs_observations[i]                     = vl.landmarks[i].u;
-    vis_.cvs_observations[ml_max_features_ + i]  = vl.landmarks[i].v;
-    vis_.cvs_valid_flag[i] = true;
+    vis->cvs_landmarks[i]                        = vl.landmarks[i].x;
+    vis->cvs_landmarks[ml_max_features_ + i]     = vl.landmarks[i].y;
+    vis->cvs_landmarks[2 * ml_max_features_ + i] = vl.landmarks[i].z;
+    vis->cvs_observations[i]                     = vl.landmarks[i].u;
+    vis->cvs_observations[ml_max_features_ + i]  = vl.landmarks[i].v;
+    vis->cvs_valid_flag[i] = true;
   }
   for (int i = vl.landmarks.size(); i < ml_max_features_; i++)
-    vis_.cvs_valid_flag[i] = false;
+    vis->cvs_valid_flag[i] = false;
 
-  vis_.cvs_timestamp_sec = vl.header.stamp.sec;
-  vis_.cvs_timestamp_nsec = vl.header.stamp.nsec;
+  vis->cvs_timestamp_sec = vl.header.stamp.sec;
+  vis->cvs_timestamp_nsec = vl.header.stamp.nsec;
 }
 
 void Ekf::HandrailUpdate(const ff_msgs::DepthLandmarks & dl) {
@@ -373,17 +367,15 @@ void Ekf::OpticalFlowRegister(const ff_msgs::CameraRegistration & cr) {
       }
     }
     // delete the features from the deleted augmented state
-    std::map<int, OFFeature>::iterator of_iter = optical_flow_features_.begin();
-    while (of_iter != optical_flow_features_.end()) {
-      OFFeature & f = (*of_iter).second;
-      if (f.obs.size() > erased_aug) {
-        f.obs.erase(f.obs.begin() + erased_aug);
-      }
-      if (f.obs.size() == 0)
-        of_iter = optical_flow_features_.erase(of_iter);
-      else
-        of_iter++;
+    OFFeatureTable & features = optical_flow_features_;
+    for (int pos = 0; pos < features.Size(); pos++) {
+      int slot = features.Slot(pos);
+      if (features.NumObservations(slot) > static_cast<int>(erased_aug))
+        features.EraseObservation(slot, erased_aug);
+      if (features.NumObservations(slot) == 0)
+        features.Remove(slot);
     }
+    features.Compact();
 
     // update arrays of times and counts
     if (optical_flow_augs_feature_counts_.size() > of_history_size_) {
@@ -547,16 +539,118 @@ void Ekf::PrepareStep(const sensor_msgs::Imu & imu, const geometry_msgs::Quatern
 }
 
 int Ekf::Step(ff_msgs::EkfState* state) {
-  if (output_file_)
+  if (output_file_) {
     WriteToFile();
-  else
+  } else {
+    RecordStep();
+    if (replay_from_)
+      Replay();
     gnc_.Step();
+    if (!history_.empty() && history_.back().vl_camera_id != 0)
+      SaveCheckpoint(step_count_ + 1, history_.back().vl_camera_id);
+  }
+  step_count_++;
   if (gnc_.kfl_.confidence == 2)
     reset_ekf_ = true;
   UpdateState(state);
   return 1;
 }
 
+void Ekf::RecordStep(void) {
+  if (replay_steps_ <= 0)
+    return;
+  if (history_.size() >= static_cast<size_t>(replay_steps_))
+    history_.pop_front();
+  history_.emplace_back();
+  StepInputs & in = history_.back();
+  in.step = step_count_;
+  in.vl_camera_id = (gnc_.reg_.cvs_landmark_pulse ? vl_camera_id_ : 0);
+  memcpy(&in.vis,  &gnc_.vis_,  sizeof(cvs_landmark_msg));
+  memcpy(&in.reg,  &gnc_.reg_,  sizeof(cvs_registration_pulse));
+  memcpy(&in.of,   &gnc_.of_,   sizeof(cvs_optical_flow_msg));
+  memcpy(&in.hand, &gnc_.hand_, sizeof(cvs_handrail_msg));
+  memcpy(&in.imu,  &gnc_.imu_,  sizeof(imu_msg));
+  memcpy(in.quat,  gnc_.quat_,  sizeof(in.quat));
+  memcpy(&in.cmc,  &gnc_.cmc_,  sizeof(cmc_msg));
+
+  // the steps after these checkpoints are no longer all known
+  while (!checkpoints_.empty() && checkpoints_.front()->step < history_.front().step)
+    checkpoints_.pop_front();
+}
+
+void Ekf::SaveCheckpoint(uint64_t step, uint32_t vl_camera_id) {
+  // overwrite the checkpoint of this step if replaying, or recycle the oldest
+  std::shared_ptr<Checkpoint> c;
+  for (size_t i = 0; i < checkpoints_.size(); i++)
+    if (checkpoints_[i]->step == step)
+      c = checkpoints_[i];
+  if (!c) {
+    if (checkpoints_.size() >= kMaxCheckpoints) {
+      c = checkpoints_.front();
+      checkpoints_.pop_front();
+    } else {
+      c.reset(new Checkpoint());
+    }
+    checkpoints_.push_back(c);
+  }
+  int s = 15 + 6 + 6 * ASE_OF_NUM_AUG;
+  c->step = step;
+  c->vl_camera_id = vl_camera_id;
+  memcpy(&c->dwork, gnc_.est_->dwork, sizeof(DW_est_estimator_T));
+  memcpy(&c->block_io, gnc_.est_->blockIO, sizeof(B_est_estimator_T));
+  memcpy(&c->kfl, &gnc_.kfl_, sizeof(kfl_msg));
+  c->cov.assign(gnc_.P_, gnc_.P_ + s * s);
+}
+
+// Steps again from the checkpoint after the registration of late_vis_, with
+// late_vis_ as input, up to the current step, whose inputs are in gnc_ and
+// at the back of history_. The steps which already had later landmarks keep
+// them. The autocode stepping up to here with late_vis_ is then as if it had
+// arrived on time.
+void Ekf::Replay(void) {
+  std::shared_ptr<Checkpoint> from = replay_from_;
+  replay_from_.reset();
+  // the checkpoint may be recycled while replaying
+  const uint64_t from_step = from->step;
+  if (history_.empty() || history_.front().step > from_step)
+    return;
+  int s = 15 + 6 + 6 * ASE_OF_NUM_AUG;
+  memcpy(gnc_.est_->dwork, &from->dwork, sizeof(DW_est_estimator_T));
+  memcpy(gnc_.est_->blockIO, &from->block_io, sizeof(B_est_estimator_T));
+  memcpy(&gnc_.kfl_, &from->kfl, sizeof(kfl_msg));
+  memcpy(gnc_.P_, from->cov.data(), sizeof(float) * s * s);
+
+  for (size_t i = 0; i < history_.size(); i++) {
+    StepInputs & in = history_[i];
+    if (in.step < from_step)
+      continue;
+    if (ObservedBefore(in.vis, late_vis_))
+      memcpy(&in.vis, &late_vis_, sizeof(cvs_landmark_msg));
+    memcpy(&gnc_.vis_,  &in.vis,  sizeof(cvs_landmark_msg));
+    memcpy(&gnc_.reg_,  &in.reg,  sizeof(cvs_registration_pulse));
+    memcpy(&gnc_.of_,   &in.of,   sizeof(cvs_optical_flow_msg));
+    memcpy(&gnc_.hand_, &in.hand, sizeof(cvs_handrail_msg));
+    memcpy(&gnc_.imu_,  &in.imu,  sizeof(imu_msg));
+    memcpy(gnc_.quat_,  in.quat,  sizeof(in.quat));
+    memcpy(&gnc_.cmc_,  &in.cmc,  sizeof(cmc_msg));
+    if (i + 1 == history_.size())
+      break;  // the current step, run by Step()
+    gnc_.Step();
+    if (in.vl_camera_id != 0)
+      SaveCheckpoint(in.step + 1, in.vl_camera_id);
+  }
+
+  // so that the next steps do not see these landmarks as new again
+  if (ObservedBefore(vis_, late_vis_))
+    memcpy(&vis_, &late_vis_, sizeof(cvs_landmark_msg));
+}
+
+void Ekf::ClearHistory(void) {
+  history_.clear();
+  checkpoints_.clear();
+  replay_from_.reset();
+}
+
 void Ekf::UpdateState(ff_msgs::EkfState* state) {
   // now copy everything to the output message
   state->header.stamp.sec  = imu_.imu_timestamp_sec;
@@ -578,6 +672,8 @@ void Ekf::UpdateState(ff_msgs::EkfState* state) {
   std::copy(gnc_.kfl_.cov_diag, gnc_.kfl_.cov_diag + 15, state->cov_diag.c_array());
   state->hr_global_pose.position = msg_conversions::array_to_ros_point(gnc_.kfl_.hr_P_hr_ISS_ISS);
   state->hr_global_pose.orientation = msg_conversions::array_to_ros_quat(gnc_.kfl_.hr_quat_ISS2hr);
+  state->trace_id         = trace_id_;
+  state->trace_stamp      = trace_stamp_;
   if (state->ml_count > 0)
     std::copy(gnc_.kfl_.ml_mahal_distance, gnc_.kfl_.ml_mahal_distance + ml_max_features_,
             state->ml_mahal_dists.c_array());
@@ -634,9 +730,10 @@ void Ekf::ApplyReset(void) {
 
   // reset the EKF (especially for the covariance)
   gnc_.Initialize();
+  ClearHistory();
 
   // reset optical flow too
-  optical_flow_features_.clear();
+  optical_flow_features_.Clear();
   optical_flow_augs_feature_counts_.clear();
   optical_flow_augs_times_.clear();
   of_camera_id_ = 0;
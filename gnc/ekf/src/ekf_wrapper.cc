@@ -27,25 +27,57 @@
 
 #include <ff_util/ff_names.h>
 
+#include <algorithm>
+
 namespace ekf {
 
 EkfWrapper::EkfWrapper(ros::NodeHandle* nh, std::string const& platform_name) :
-          ekf_initialized_(false), imus_dropped_(0), have_imu_(false),
-          input_mode_(ff_msgs::SetEkfInputRequest::MODE_NONE), nh_(nh),
-          estimating_bias_(false), disp_features_(false) {
+          ekf_initialized_(false), imus_dropped_(0),
+          input_mode_(ff_msgs::SetEkfInputRequest::MODE_NONE), nh_(nh), input_seq_(0),
+          predict_imu_(false), compact_state_(false), full_state_period_(0),
+          last_full_confidence_(ff_msgs::EkfState::CONFIDENCE_LOST), estimating_bias_(false),
+          disp_features_(false) {
   platform_name_ = (platform_name.empty() ? "" : platform_name + "/");
 
   config_.AddFile("gnc.config");
   config_.AddFile("cameras.config");
   config_.AddFile("geometry.config");
+  config_.Bind("bias_required_observations", &bias_required_observations_);
+  config_.Bind("imu_bias_file", &imu_bias_file_);
   ReadParams();
+  // Only read when starting, as ctl picks its topic from it when it starts
+  if (!config_.GetBool("ekf_compact_state", &compact_state_))
+    ROS_FATAL("Unspecified ekf_compact_state.");
+  Eigen::Vector3d imu_trans, gravity = Eigen::Vector3d::Zero();
+  Eigen::Quaterniond imu_rot;
+  if (!msg_conversions::config_read_transform(&config_, "imu_transform", &imu_trans, &imu_rot))
+    ROS_FATAL("Unspecified imu_transform.");
+  bool gravity_removal = false;
+  if (config_.GetBool("tun_ase_gravity_removal", &gravity_removal) && gravity_removal &&
+      !msg_conversions::config_read_vector(&config_, "tun_ase_gravity_accel", &gravity))
+    ROS_FATAL("Unspecified tun_ase_gravity_accel.");
+  predictor_.SetParams(imu_rot, gravity);
   config_timer_ = nh->createTimer(ros::Duration(1), [this](ros::TimerEvent e) {
       config_.CheckFilesUpdated(std::bind(&EkfWrapper::ReadParams, this));}, false, true);
   pt_ekf_.Initialize("ekf");
+  tr_landmarks_ = ff_util::MetricsRegistry::Instance().Trace("ekf_landmarks");
+  tr_state_ = ff_util::MetricsRegistry::Instance().Trace("ekf_state");
+  hist_predict_latency_ = ff_util::MetricsRegistry::Instance().Histogram("ekf_predict_latency");
+  hist_predict_horizon_ = ff_util::MetricsRegistry::Instance().Histogram("ekf_predict_horizon");
+
+  // the prediction is published from the IMU callback
+  predicted_pub_ = nh_->advertise<ff_msgs::EkfPrediction>(TOPIC_GNC_EKF_PREDICTED, 5);
 
   // subscribe to IMU first, then rest once IMU is ready
   // this is so localization manager doesn't timeout
-  imu_sub_    = nh_->subscribe(TOPIC_HARDWARE_IMU, 5, &EkfWrapper::ImuCallBack, this,
+  bool imu_batch = false;
+  if (!config_.GetBool("ekf_imu_batch", &imu_batch))
+    ROS_FATAL("Unspecified ekf_imu_batch.");
+  if (imu_batch)
+    imu_sub_  = nh_->subscribe(TOPIC_HARDWARE_IMU_BATCH, 2, &EkfWrapper::ImuBatchCallBack, this,
+                              ros::TransportHints().tcpNoDelay());
+  else
+    imu_sub_  = nh_->subscribe(TOPIC_HARDWARE_IMU, 5, &EkfWrapper::ImuCallBack, this,
                               ros::TransportHints().tcpNoDelay());
 }
 
@@ -55,6 +87,8 @@ EkfWrapper::~EkfWrapper() {
 // wait to start up until the IMU is ready
 void EkfWrapper::InitializeEkf(void) {
   state_pub_   = nh_->advertise<ff_msgs::EkfState>(TOPIC_GNC_EKF, 1);
+  if (compact_state_)
+    compact_pub_ = nh_->advertise<ff_msgs::EkfStateCompact>(TOPIC_GNC_EKF_COMPACT, 1);
   pose_pub_    = nh_->advertise<geometry_msgs::PoseStamped>(TOPIC_LOCALIZATION_POSE, 1);
   twist_pub_   = nh_->advertise<geometry_msgs::TwistStamped>(TOPIC_LOCALIZATION_TWIST, 1);
   feature_pub_ = nh_->advertise<sensor_msgs::PointCloud2>(TOPIC_GNC_EKF_FEATURES, 1,
@@ -96,14 +130,15 @@ void EkfWrapper::ReadParams(void) {
     return;
   }
 
-  if (!config_.GetInt("bias_required_observations", &bias_required_observations_))
-    ROS_FATAL("Unspecified bias_required_observations.");
-
-  std::string imu_filename;
-  if (!config_.GetStr("imu_bias_file", &imu_filename)) {
-    ROS_FATAL("IMU bias file not specified.");
-  }
-  bias_file_ = std::string(common::GetConfigDir()) + std::string("/") + imu_filename;
+  if (!config_.ReadBindings())
+    ROS_FATAL("Unspecified EKF wrapper parameters.");
+  bias_file_ = std::string(common::GetConfigDir()) + std::string("/") + imu_bias_file_;
+  bool predict_imu = false;
+  if (config_.GetBool("ekf_predict_imu", &predict_imu))
+    predict_imu_ = predict_imu;
+  double full_state_rate = 0;
+  if (config_.GetReal("ekf_full_state_rate", &full_state_rate))
+    full_state_period_ = (full_state_rate > 0 ? 1.0 / full_state_rate : 0);
 
   ekf_.ReadParams(&config_);
 }
@@ -179,21 +214,42 @@ void EkfWrapper::PublishFeatures(ff_msgs::DepthLandmarks::ConstPtr const& l) {
 }
 
 void EkfWrapper::ImuCallBack(sensor_msgs::Imu::ConstPtr const& imu) {
-  // concurrency protection
-  std::unique_lock<std::mutex> lock(mutex_imu_msg_);
-  while (have_imu_ && ros::ok())
-    cv_imu_.wait_for(lock, std::chrono::milliseconds(8));
-
-  // copy IMU data
-  imu_ = *imu;
+  // every reading is stepped on, in order, unless the step falls this far behind
+  if (!imu_queue_.Push(imu))
+    ROS_WARN_THROTTLE(1, "EKF step is behind, dropping IMU messages.");
 
-  have_imu_ = true;
-  // now notify the condition variable waiting for IMU that we have it
-  lock.unlock();
+  // taking the mutex, even if only to release it, makes sure the step is
+  // either waiting on the cv or has not yet checked the queue
+  { std::lock_guard<std::mutex> lock(mutex_imu_msg_); }
   cv_imu_.notify_all();
 
   if (estimating_bias_)
     EstimateBias(imu);
+  if (predict_imu_)
+    PublishPrediction(*imu);
+}
+
+void EkfWrapper::PublishPrediction(sensor_msgs::Imu const& imu) {
+  // catch up from the newest state the step has published
+  while (predict_queue_.Size() > 1)
+    predict_queue_.Pop();
+  if (ff_msgs::EkfState* state = predict_queue_.Front()) {
+    predictor_.Seed(*state);
+    predict_queue_.Pop();
+  }
+  if (!predictor_.Add(imu))
+    return;
+  predictor_.GetPrediction(&prediction_);
+  prediction_.header.seq = imu.header.seq;
+  predicted_pub_.publish(prediction_);
+  hist_predict_latency_.Record(std::max<int64_t>(0, (ros::Time::now() - imu.header.stamp).toNSec()));
+  hist_predict_horizon_.Record((imu.header.stamp - prediction_.state_stamp).toNSec());
+}
+
+void EkfWrapper::ImuBatchCallBack(ff_msgs::ImuBatch::ConstPtr const& batch) {
+  // each sample is queued as a pointer into the batch, which it keeps alive
+  for (sensor_msgs::Imu const& sample : batch->samples)
+    ImuCallBack(sensor_msgs::Imu::ConstPtr(batch, &sample));
 }
 
 void EkfWrapper::EstimateBias(sensor_msgs::Imu::ConstPtr const& imu) {
@@ -227,67 +283,79 @@ void EkfWrapper::EstimateBias(sensor_msgs::Imu::ConstPtr const& imu) {
   }
 }
 
+void EkfWrapper::QueueInput(InputStream stream, Input* input) {
+  input->seq = input_seq_++;
+  if (!input_queues_[stream].Push(*input))
+    ROS_WARN_THROTTLE(1, "EKF step is behind, dropping inputs.");
+}
+
 void EkfWrapper::OpticalFlowCallBack(ff_msgs::Feature2dArray::ConstPtr const& of) {
-  std::lock_guard<std::mutex> lock(mutex_of_msg_);
-  ekf_.OpticalFlowUpdate(*of.get());
+  Input input;
+  input.of = of;
+  QueueInput(INPUT_OF, &input);
 }
 
 void EkfWrapper::VLVisualLandmarksCallBack(ff_msgs::VisualLandmarks::ConstPtr const& vl) {
   if (input_mode_ == ff_msgs::SetEkfInputRequest::MODE_MAP_LANDMARKS) {
-    std::lock_guard<std::mutex> lock(mutex_vl_msg_);
-    ekf_.SparseMapUpdate(*vl.get());
-    PublishFeatures(vl);
+    Input input;
+    input.vl = vl;
+    QueueInput(INPUT_VL, &input);
   }
 }
 
 void EkfWrapper::ARVisualLandmarksCallBack(ff_msgs::VisualLandmarks::ConstPtr const& vl) {
   if (input_mode_ == ff_msgs::SetEkfInputRequest::MODE_AR_TAGS) {
-    std::lock_guard<std::mutex> lock(mutex_vl_msg_);
-    ekf_.ARTagUpdate(*vl.get());
-    PublishFeatures(vl);
+    Input input;
+    input.vl = vl;
+    QueueInput(INPUT_AR, &input);
   }
 }
 
 void EkfWrapper::DepthLandmarksCallBack(ff_msgs::DepthLandmarks::ConstPtr const& dl) {
   if (input_mode_ == ff_msgs::SetEkfInputRequest::MODE_HANDRAIL) {
-    std::lock_guard<std::mutex> lock(mutex_vl_msg_);
-    ekf_.HandrailUpdate(*dl.get());
-    PublishFeatures(dl);
+    Input input;
+    input.dl = dl;
+    QueueInput(INPUT_DL, &input);
   }
 }
 
 void EkfWrapper::RegisterOpticalFlowCamera(ff_msgs::CameraRegistration::ConstPtr const& cr) {
-  std::lock_guard<std::mutex> lock(mutex_of_msg_);
-  ekf_.OpticalFlowRegister(*cr.get());
+  Input input;
+  input.reg = cr;
+  QueueInput(INPUT_OF_REGISTRATION, &input);
 }
 
 void EkfWrapper::VLRegisterCamera(ff_msgs::CameraRegistration::ConstPtr const& reg) {
   if (input_mode_ == ff_msgs::SetEkfInputRequest::MODE_MAP_LANDMARKS) {
-    std::lock_guard<std::mutex> lock(mutex_vl_msg_);
-    ekf_.SparseMapRegister(*reg.get());
+    Input input;
+    input.reg = reg;
+    QueueInput(INPUT_VL_REGISTRATION, &input);
   }
 }
 
 void EkfWrapper::ARRegisterCamera(ff_msgs::CameraRegistration::ConstPtr const& reg) {
   if (input_mode_ == ff_msgs::SetEkfInputRequest::MODE_AR_TAGS) {
-    std::lock_guard<std::mutex> lock(mutex_vl_msg_);
-    ekf_.ARTagRegister(*reg.get());
+    Input input;
+    input.reg = reg;
+    QueueInput(INPUT_AR_REGISTRATION, &input);
   }
 }
 
 void EkfWrapper::RegisterDepthCamera(ff_msgs::CameraRegistration::ConstPtr const& reg) {
   if (input_mode_ == ff_msgs::SetEkfInputRequest::MODE_HANDRAIL) {
-    std::lock_guard<std::mutex> lock(mutex_vl_msg_);
-    ekf_.HandrailRegister(*reg.get());
+    Input input;
+    input.reg = reg;
+    QueueInput(INPUT_DL_REGISTRATION, &input);
   }
 }
 
 void EkfWrapper::GroundTruthCallback(geometry_msgs::PoseStamped::ConstPtr const& truth) {
   // For certain contexts (like MGTF) we want to extract the correct orientation, and pass it to
   // GNC, so that Earth's gravity can be extracted out of the linear acceleration.
-  std::unique_lock<std::mutex> lk(mutex_truth_msg_);
   assert(truth->header.frame_id == "world");
-  quat_ = truth->pose.orientation;
+  Input input;
+  input.truth = truth;
+  QueueInput(INPUT_TRUTH, &input);
   if (input_mode_ == ff_msgs::SetEkfInputRequest::MODE_TRUTH) {
     pose_pub_.publish(truth);
   }
@@ -310,54 +378,138 @@ void EkfWrapper::Run() {
   }
 }
 
+void EkfWrapper::ApplyInputs(void) {
+  // the inputs queued by now, oldest first across the streams, as they would
+  // have been applied by the callbacks themselves
+  const uint64_t end = input_seq_;
+  while (true) {
+    int stream = -1;
+    uint64_t seq = end;
+    for (int i = 0; i < NUM_INPUT_STREAMS; i++) {
+      Input* input = input_queues_[i].Front();
+      if (input && input->seq < seq) {
+        stream = i;
+        seq = input->seq;
+      }
+    }
+    if (stream < 0)
+      break;
+
+    Input* input = input_queues_[stream].Front();
+    switch (stream) {
+    case INPUT_OF:
+      ekf_.OpticalFlowUpdate(*input->of);
+      break;
+    case INPUT_OF_REGISTRATION:
+      ekf_.OpticalFlowRegister(*input->reg);
+      break;
+    case INPUT_VL:
+      tr_landmarks_.Emit(input->vl->camera_id, (ros::Time::now() - input->vl->header.stamp).toNSec());
+      ekf_.SparseMapUpdate(*input->vl);
+      PublishFeatures(input->vl);
+      break;
+    case INPUT_VL_REGISTRATION:
+      ekf_.SparseMapRegister(*input->reg);
+      break;
+    case INPUT_AR:
+      tr_landmarks_.Emit(input->vl->camera_id, (ros::Time::now() - input->vl->header.stamp).toNSec());
+      ekf_.ARTagUpdate(*input->vl);
+      PublishFeatures(input->vl);
+      break;
+    case INPUT_AR_REGISTRATION:
+      ekf_.ARTagRegister(*input->reg);
+      break;
+    case INPUT_DL:
+      ekf_.HandrailUpdate(*input->dl);
+      PublishFeatures(input->dl);
+      break;
+    case INPUT_DL_REGISTRATION:
+      ekf_.HandrailRegister(*input->reg);
+      break;
+    case INPUT_TRUTH:
+      quat_ = input->truth->pose.orientation;
+      break;
+    default:
+      break;
+    }
+    input_queues_[stream].Pop();
+  }
+}
+
 int EkfWrapper::Step() {
-  // don't modify anything while we're copying the data
-  {
-    // wait until we get an imu reading with the condition variable
+  // wait until we get an imu reading with the condition variable
+  if (imu_queue_.Empty()) {
     std::unique_lock<std::mutex> lk(mutex_imu_msg_);
-    if (!have_imu_)
-      cv_imu_.wait_for(lk, std::chrono::milliseconds(8));
-    if (!have_imu_) {
-      imus_dropped_++;
-      // publish a failure if we stop getting imu messages
-      if (imus_dropped_ > 10 && ekf_initialized_) {
-        state_.header.stamp = ros::Time::now();
-        state_.confidence = 2;  // lost
-        state_pub_.publish<ff_msgs::EkfState>(state_);
-        ekf_.Reset();
-      }
-      return 0;   // Changed by Andrew due to 250Hz ctl messages when sim blocks (!)
+    cv_imu_.wait_for(lk, std::chrono::milliseconds(8), [this] {return !imu_queue_.Empty();});
+  }
+  sensor_msgs::Imu::ConstPtr* imu = imu_queue_.Front();
+  if (!imu) {
+    imus_dropped_++;
+    // publish a failure if we stop getting imu messages
+    if (imus_dropped_ > 10 && ekf_initialized_) {
+      state_.header.stamp = ros::Time::now();
+      state_.confidence = 2;  // lost
+      PublishFilterState(state_);
+      ekf_.Reset();
     }
-    imus_dropped_ = 0;
-    if (!ekf_initialized_)
-      InitializeEkf();
-
-    std::lock(mutex_act_msg_, mutex_vl_msg_, mutex_of_msg_, mutex_truth_msg_);
-    std::lock_guard<std::mutex> lock_actMsg(mutex_act_msg_, std::adopt_lock);
-    std::lock_guard<std::mutex> lock_vlMsg(mutex_vl_msg_, std::adopt_lock);
-    std::lock_guard<std::mutex> lock_ofMsg(mutex_of_msg_, std::adopt_lock);
-    std::lock_guard<std::mutex> lock_truthMsg(mutex_truth_msg_, std::adopt_lock);
-    // copy everything in EKF, so data structures can be modified for next
-    // step while current step processes. We pass the ground truth quaternion
-    // representing the latest ISS2BODY rotation, which is used in certain
-    // testing contexts to remove the effect of Earth's gravity.
-    ekf_.PrepareStep(imu_, quat_);
-    // don't reuse imu reading
-    have_imu_ = false;
+    return 0;   // Changed by Andrew due to 250Hz ctl messages when sim blocks (!)
   }
-  cv_imu_.notify_all();
+  imus_dropped_ = 0;
+  if (!ekf_initialized_)
+    InitializeEkf();
+
+  // copy everything in EKF, so data structures can be modified for next
+  // step while current step processes. We pass the ground truth quaternion
+  // representing the latest ISS2BODY rotation, which is used in certain
+  // testing contexts to remove the effect of Earth's gravity.
+  ApplyInputs();
+  ekf_.PrepareStep(**imu, quat_);
+  // don't reuse imu reading
+  imu_queue_.Pop();
 
   pt_ekf_.Tick();
   int ret = (input_mode_ != ff_msgs::SetEkfInputRequest::MODE_NONE ? ekf_.Step(&state_) : 1);
   pt_ekf_.Tock();
   if (ret)
     PublishState(state_);
+  // only a state the filter stepped on is propagated
+  if (ret && predict_imu_ && input_mode_ != ff_msgs::SetEkfInputRequest::MODE_NONE &&
+      !predict_queue_.Push(state_))
+    ROS_WARN_THROTTLE(1, "IMU prediction is behind, dropping EKF states.");
   return ret;
 }
 
+void EkfWrapper::PublishFilterState(const ff_msgs::EkfState & state) {
+  if (!compact_state_) {
+    state_pub_.publish<ff_msgs::EkfState>(state);
+    return;
+  }
+  compact_.stamp = state.header.stamp;
+  compact_.pose = state.pose;
+  compact_.velocity = state.velocity;
+  compact_.omega = state.omega;
+  compact_.gyro_bias = state.gyro_bias;
+  compact_.accel = state.accel;
+  compact_.accel_bias = state.accel_bias;
+  compact_.confidence = state.confidence;
+  compact_.trace_id = state.trace_id;
+  compact_.trace_stamp = state.trace_stamp;
+  compact_pub_.publish<ff_msgs::EkfStateCompact>(compact_);
+  // Subscribers to the full state still see a change of confidence at once
+  double period = full_state_period_;
+  if (period > 0 && state.confidence == last_full_confidence_ && state.header.stamp >= last_full_stamp_ &&
+      (state.header.stamp - last_full_stamp_).toSec() < period)
+    return;
+  state_pub_.publish<ff_msgs::EkfState>(state);
+  last_full_stamp_ = state.header.stamp;
+  last_full_confidence_ = state.confidence;
+}
+
 void EkfWrapper::PublishState(const ff_msgs::EkfState & state) {
   // Publish the full EKF state
-  state_pub_.publish<ff_msgs::EkfState>(state);
+  PublishFilterState(state);
+  if (state.trace_id)
+    tr_state_.EmitOnce(state.trace_id, (ros::Time::now() - state.trace_stamp).toNSec());
   // Only publish a transform if the confidence is good enough and we have
   // actually populated the state (examine the header to check)
   if (state.confidence == 0 && !state.header.frame_id.empty()) {
@@ -0,0 +1,104 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ekf/imu_predictor.h>
+
+#include <msg_conversions/msg_conversions.h>
+
+namespace ekf {
+
+namespace {
+
+// enough samples to catch up a state that took a few steps to publish
+constexpr size_t kMaxSamples = 64;
+// a longer gap between samples is not integrated over
+constexpr double kMaxStep = 0.1;
+
+}  // namespace
+
+ImuPredictor::ImuPredictor(void) : body_q_imu_(Eigen::Quaterniond::Identity()), gravity_(Eigen::Vector3d::Zero()),
+    seeded_(false), confidence_(ff_msgs::EkfState::CONFIDENCE_LOST) {}
+
+void ImuPredictor::SetParams(Eigen::Quaterniond const& body_q_imu, Eigen::Vector3d const& gravity) {
+  body_q_imu_ = body_q_imu.normalized();
+  gravity_ = gravity;
+}
+
+void ImuPredictor::Clear(void) {
+  seeded_ = false;
+  samples_.clear();
+}
+
+void ImuPredictor::Seed(ff_msgs::EkfState const& state) {
+  seeded_ = true;
+  state_stamp_ = state.header.stamp;
+  stamp_ = state.header.stamp;
+  confidence_ = state.confidence;
+  world_q_body_ = msg_conversions::ros_to_eigen_quat(state.pose.orientation).normalized();
+  position_ = msg_conversions::ros_point_to_eigen_vector(state.pose.position);
+  velocity_ = msg_conversions::ros_to_eigen_vector(state.velocity);
+  omega_ = msg_conversions::ros_to_eigen_vector(state.omega);
+  gyro_bias_ = msg_conversions::ros_to_eigen_vector(state.gyro_bias);
+  accel_bias_ = msg_conversions::ros_to_eigen_vector(state.accel_bias);
+
+  // the filter has already stepped on the samples up to its stamp
+  for (sensor_msgs::Imu const& imu : samples_)
+    if (imu.header.stamp > stamp_)
+      Integrate(imu);
+}
+
+bool ImuPredictor::Add(sensor_msgs::Imu const& imu) {
+  if (samples_.size() >= kMaxSamples)
+    samples_.pop_front();
+  samples_.push_back(imu);
+  if (!seeded_)
+    return false;
+  if (imu.header.stamp > stamp_)
+    Integrate(imu);
+  return true;
+}
+
+void ImuPredictor::Integrate(sensor_msgs::Imu const& imu) {
+  double dt = (imu.header.stamp - stamp_).toSec();
+  stamp_ = imu.header.stamp;
+  if (dt <= 0 || dt > kMaxStep)
+    return;
+
+  // the rates are held over the interval up to the sample, as in the filter
+  omega_ = body_q_imu_ * (msg_conversions::ros_to_eigen_vector(imu.angular_velocity) - gyro_bias_);
+  Eigen::Vector3d accel = world_q_body_ * (body_q_imu_ *
+      (msg_conversions::ros_to_eigen_vector(imu.linear_acceleration) - accel_bias_)) + gravity_;
+  position_ += velocity_ * dt + 0.5 * accel * dt * dt;
+  velocity_ += accel * dt;
+  double angle = omega_.norm() * dt;
+  if (angle > 0)
+    world_q_body_ = (world_q_body_ * Eigen::Quaterniond(Eigen::AngleAxisd(angle, omega_.normalized()))).normalized();
+}
+
+void ImuPredictor::GetPrediction(ff_msgs::EkfPrediction* prediction) const {
+  prediction->header.stamp = stamp_;
+  prediction->header.frame_id = "world";
+  prediction->pose.position = msg_conversions::eigen_to_ros_point(position_);
+  prediction->pose.orientation = msg_conversions::eigen_to_ros_quat(world_q_body_);
+  prediction->velocity = msg_conversions::eigen_to_ros_vector(velocity_);
+  prediction->omega = msg_conversions::eigen_to_ros_vector(omega_);
+  prediction->state_stamp = state_stamp_;
+  prediction->confidence = confidence_;
+}
+
+}  // end namespace ekf
@@ -0,0 +1,110 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ekf/of_feature_table.h>
+
+#include <string.h>
+
+namespace ekf {
+
+OFFeatureTable::OFFeatureTable(void) {
+  Clear();
+}
+
+void OFFeatureTable::Clear(void) {
+  size_ = 0;
+  num_free_ = MAX_FEATURES;
+  for (int i = 0; i < MAX_FEATURES; i++)
+    free_[i] = MAX_FEATURES - 1 - i;
+}
+
+int OFFeatureTable::Position(uint32_t id) const {
+  int low = 0, high = size_;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (id_[order_[mid]] < id)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+int OFFeatureTable::Find(uint32_t id) const {
+  int pos = Position(id);
+  if (pos < size_ && id_[order_[pos]] == id)
+    return order_[pos];
+  return -1;
+}
+
+int OFFeatureTable::Insert(uint32_t id) {
+  int pos = Position(id);
+  if (pos < size_ && id_[order_[pos]] == id)
+    return order_[pos];
+  if (num_free_ == 0)
+    return -1;
+
+  int slot = free_[--num_free_];
+  id_[slot] = id;
+  missing_frames_[slot] = 0;
+  num_obs_[slot] = 0;
+  removed_[slot] = false;
+  observed_[slot] = false;
+  memmove(&order_[pos + 1], &order_[pos], (size_ - pos) * sizeof(order_[0]));
+  order_[pos] = slot;
+  size_++;
+  return slot;
+}
+
+void OFFeatureTable::Compact(void) {
+  int kept = 0;
+  for (int pos = 0; pos < size_; pos++) {
+    int slot = order_[pos];
+    if (removed_[slot])
+      free_[num_free_++] = slot;
+    else
+      order_[kept++] = slot;
+  }
+  size_ = kept;
+}
+
+void OFFeatureTable::ClearObserved(void) {
+  for (int pos = 0; pos < size_; pos++)
+    observed_[order_[pos]] = false;
+}
+
+void OFFeatureTable::AddObservation(int slot, float x, float y) {
+  int n = num_obs_[slot];
+  if (n == MAX_OBSERVATIONS)
+    n--;
+  memmove(&x_[slot][1], &x_[slot][0], n * sizeof(float));
+  memmove(&y_[slot][1], &y_[slot][0], n * sizeof(float));
+  x_[slot][0] = x;
+  y_[slot][0] = y;
+  num_obs_[slot] = n + 1;
+  observed_[slot] = true;
+}
+
+void OFFeatureTable::EraseObservation(int slot, int obs) {
+  int n = num_obs_[slot] - obs - 1;
+  memmove(&x_[slot][obs], &x_[slot][obs + 1], n * sizeof(float));
+  memmove(&y_[slot][obs], &y_[slot][obs + 1], n * sizeof(float));
+  num_obs_[slot]--;
+}
+
+}  // end namespace ekf
@@ -29,6 +29,7 @@
 #include <ff_msgs/FlightMode.h>
 
 #include <ff_util/ff_names.h>
+#include <ff_util/metrics.h>
 #include <ff_util/perf_timer.h>
 
 #include <geometry_msgs/Inertia.h>
@@ -45,7 +46,16 @@ class Fam {
  public:
   explicit Fam(ros::NodeHandle* nh);
   ~Fam();
-  void Step(ex_time_msg* ex_time, cmd_msg* cmd, ctl_msg* ctl);
+  void Step(ex_time_msg* ex_time, cmd_msg* cmd, ctl_msg* ctl,
+            uint32_t trace_id = 0, ros::Time const& trace_stamp = ros::Time());
+
+  /**
+   * Steps the FAM loaded in this process, if any, straight from the control
+   * output instead of through TOPIC_GNC_CTL_COMMAND. Once it is stepped this
+   * way it ignores the topic. Returns false if there is no FAM in this process.
+   **/
+  static bool StepInProcess(ex_time_msg* ex_time, cmd_msg* cmd, ctl_msg* ctl,
+                            uint32_t trace_id = 0, ros::Time const& trace_stamp = ros::Time());
 
  protected:
   void ReadParams(void);
@@ -61,6 +71,7 @@ class Fam {
 
   config_reader::ConfigReader config_;
   ff_util::PerfTimer pt_fam_;
+  ff_util::MetricTrace tr_fam_;
   ros::Timer config_timer_;
 
   std::mutex mutex_speed_;
@@ -68,6 +79,7 @@ class Fam {
   std::mutex mutex_mass_;
   geometry_msgs::Vector3 center_of_mass_;
   bool inertia_received_;
+  bool in_process_;  // stepped by control through StepInProcess()
 };
 }  // end namespace fam
 
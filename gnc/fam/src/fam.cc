@@ -26,13 +26,19 @@
 
 namespace fam {
 
-Fam::Fam(ros::NodeHandle* nh) : inertia_received_(false) {
+// The FAM in this process, for control loaded in the same nodelet manager.
+// The mutex also keeps the FAM from stepping from both paths at once.
+static std::mutex instance_mutex;
+static Fam* instance = NULL;
+
+Fam::Fam(ros::NodeHandle* nh) : inertia_received_(false), in_process_(false) {
   config_.AddFile("gnc.config");
   config_.AddFile("geometry.config");
   ReadParams();
   config_timer_ = nh->createTimer(ros::Duration(1), [this](ros::TimerEvent e) {
       config_.CheckFilesUpdated(std::bind(&Fam::ReadParams, this));}, false, true);
   pt_fam_.Initialize("fam");
+  tr_fam_ = ff_util::MetricsRegistry::Instance().Trace("fam");
 
   pmc_pub_ = nh->advertise<ff_hw_msgs::PmcCommand>(TOPIC_HARDWARE_PMC_COMMAND, 1);
 
@@ -43,11 +49,36 @@ Fam::Fam(ros::NodeHandle* nh) : inertia_received_(false) {
     TOPIC_MOBILITY_INERTIA, 1, &Fam::InertiaCallback, this);
 
   ctl_sub_ = nh->subscribe(TOPIC_GNC_CTL_COMMAND, 5, &Fam::CtlCallBack, this, ros::TransportHints().tcpNoDelay());
+
+  std::lock_guard<std::mutex> lock(instance_mutex);
+  if (instance)
+    ROS_WARN("Another FAM is loaded in this process, control only steps the first one directly.");
+  else
+    instance = this;
 }
 
-Fam::~Fam() {}
+Fam::~Fam() {
+  std::lock_guard<std::mutex> lock(instance_mutex);
+  if (instance == this)
+    instance = NULL;
+}
+
+bool Fam::StepInProcess(ex_time_msg* ex_time, cmd_msg* cmd, ctl_msg* ctl,
+                        uint32_t trace_id, ros::Time const& trace_stamp) {
+  std::lock_guard<std::mutex> lock(instance_mutex);
+  if (!instance)
+    return false;
+  instance->in_process_ = true;
+  instance->Step(ex_time, cmd, ctl, trace_id, trace_stamp);
+  return true;
+}
 
 void Fam::CtlCallBack(const ff_msgs::FamCommand & c) {
+  std::lock_guard<std::mutex> lock(instance_mutex);
+  // The same command was already stepped directly by control
+  if (in_process_)
+    return;
+
   ex_time_msg time;
   cmd_msg cmd;
   ctl_msg ctl;
@@ -66,7 +97,7 @@ void Fam::CtlCallBack(const ff_msgs::FamCommand & c) {
   ctl.ctl_status  = c.status;
   cmd.cmd_mode    = c.control_mode;
 
-  Step(&time, &cmd, &ctl);
+  Step(&time, &cmd, &ctl, c.trace_id, c.trace_stamp);
 }
 
 void Fam::FlightModeCallback(const ff_msgs::FlightMode::ConstPtr& mode) {
@@ -80,7 +111,8 @@ void Fam::InertiaCallback(const geometry_msgs::Inertia::ConstPtr& inertia) {
   inertia_received_ = true;
 }
 
-void Fam::Step(ex_time_msg* ex_time, cmd_msg* cmd, ctl_msg* ctl) {
+void Fam::Step(ex_time_msg* ex_time, cmd_msg* cmd, ctl_msg* ctl,
+               uint32_t trace_id, ros::Time const& trace_stamp) {
   {
     std::lock_guard<std::mutex> lock(mutex_speed_);
     // Overwrite the speed command with the cached value, provided
@@ -105,6 +137,8 @@ void Fam::Step(ex_time_msg* ex_time, cmd_msg* cmd, ctl_msg* ctl) {
   static ff_hw_msgs::PmcCommand pmc;
   pmc.header.stamp = ros::Time::now();
   pmc.header.frame_id = "body";
+  pmc.trace_id = trace_id;
+  pmc.trace_stamp = trace_stamp;
   pmc.goals.resize(2);
   pmc.goals[0].motor_speed = gnc_.act_.act_impeller_speed_cmd[0];
   pmc.goals[1].motor_speed = gnc_.act_.act_impeller_speed_cmd[1];
@@ -113,6 +147,8 @@ void Fam::Step(ex_time_msg* ex_time, cmd_msg* cmd, ctl_msg* ctl) {
   std::copy(gnc_.act_.act_servo_pwm_cmd + 6, gnc_.act_.act_servo_pwm_cmd + 12,
       pmc.goals[1].nozzle_positions.c_array());
   pmc_pub_.publish<ff_hw_msgs::PmcCommand>(pmc);
+  if (trace_id)
+    tr_fam_.EmitOnce(trace_id, (pmc.header.stamp - trace_stamp).toNSec());
 
   pt_fam_.Send();
 }
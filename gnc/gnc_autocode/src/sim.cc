@@ -37,6 +37,12 @@ GncSimAutocode::GncSimAutocode(void) {
 }
 
 void GncSimAutocode::Initialize(void) {
+  // start the subrate scheduler over with the model
+  for (int i = 0; i < 5; i++) {
+    overrun_flags_[i] = false;
+    event_flags_[i] = false;
+    task_counter_[i] = 0;
+  }
   // initialize model
   sim_model_lib0_initialize(sim_, &act_msg_, &cmc_in_msg_, &optical_msg_, &hand_msg_, &cmc_out_msg_, &imu_msg_,
                             &env_msg_, &bpm_msg_, &reg_pulse_, &landmark_msg_, &ar_tag_msg_, &ex_time_msg_);
@@ -56,9 +62,11 @@ void GncSimAutocode::Step(void) {
   sim_model_lib0_step0(sim_, &act_msg_, &cmc_in_msg_, &optical_msg_, &hand_msg_,  &cmc_out_msg_, &imu_msg_,
                        &env_msg_, &bpm_msg_, &reg_pulse_, &landmark_msg_, &ar_tag_msg_, &ex_time_msg_);
 
-  static bool OverrunFlags[5] = { 0, 0, 0, 0, 0 };
-  static bool eventFlags[5] = { 0, 0, 0, 0, 0 };
-  static int taskCounter[5] = { 0, 0, 0, 0, 0 };
+  // The scheduler state is kept per instance, rather than in statics as in
+  // the auto code, so that several models can step independently.
+  bool* OverrunFlags = overrun_flags_;
+  bool* eventFlags = event_flags_;
+  int* taskCounter = task_counter_;
   int i;
 
   /* Check base rate for overrun */
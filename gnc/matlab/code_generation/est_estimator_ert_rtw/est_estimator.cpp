@@ -2730,6 +2730,12 @@ void est_estimator_step(RT_MODEL_est_estimator_T *const est_estimator_M,
 
   // End of MATLAB Function: '<S41>/MATLAB Function'
 
+#ifdef NATIVE_COVARIANCE_PROPAGATION
+  // Replaces '<S94>/Selector' through '<S94>/Matrix Concatenate1' below
+  propagate_covariance(&est_estimator_B->P_out_m[0], 117, &rtb_state_trans[0],
+                       &rtb_Sum_b[0], (real32_T)num_augs,
+                       rtb_BusAssignment_aug_state_enu);
+#else
   // Selector: '<S94>/Selector'
   for (i = 0; i < 15; i++) {
     for (b_m = 0; b_m < 15; b_m++) {
@@ -2956,6 +2962,7 @@ void est_estimator_step(RT_MODEL_est_estimator_T *const est_estimator_M,
   }
 
   // End of Concatenate: '<S94>/Matrix Concatenate1'
+#endif
 
   // If: '<S3>/If' incorporates:
   //   Constant: '<S11>/Constant'
@@ -25,6 +25,7 @@
 #include "apply_delta_state.h"
 #include "of_residual_and_h.h"
 #include "matrix_multiply.h"
+#include "propagate_covariance.h"
 #endif                                 // est_estimator_COMMON_INCLUDES_
 
 #include "est_estimator_types.h"
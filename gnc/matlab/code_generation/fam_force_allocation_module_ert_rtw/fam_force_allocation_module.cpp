@@ -156,8 +156,6 @@ void fam_force_allocation_module_step(RT_MODEL_fam_force_allocation_T *const
   real32_T rtb_Switch8_idx_1;
   real32_T tmp;
   real32_T tmp_0;
-  real32_T unusedExpr[36];
-  real32_T unusedExpr_0[36];
 
   // Switch: '<S19>/Switch' incorporates:
   //   Constant: '<S19>/Constant1'
@@ -287,7 +285,10 @@ void fam_force_allocation_module_step(RT_MODEL_fam_force_allocation_T *const
 
     // [-] Converts a nozzle thrust into resulting body torques
     // '<S13>:1:8'
-    pphlopppohlnphdb_pinv(rtb_thrust2torque_B, unusedExpr);
+    // The generated code also took the pseudo inverses of the torque and
+    // force matrices here, and discarded them. Removed by hand, as they were
+    // two of the three SVDs on each center of mass change. Remove them again
+    // if this file is regenerated.
 
     // [-] Converts body torques into nozzle thrust
     // '<S13>:1:9'
@@ -302,8 +303,6 @@ void fam_force_allocation_module_step(RT_MODEL_fam_force_allocation_T *const
 
     // [-] Converts a nozzle thrust into resulting body forces
     // '<S13>:1:10'
-    pphlopppohlnphdb_pinv(nozzle_moment_arm, unusedExpr_0);
-
     // [-] Converts body forces into nozzle thrust
     // '<S13>:1:12'
     for (r = 0; r < 3; r++) {
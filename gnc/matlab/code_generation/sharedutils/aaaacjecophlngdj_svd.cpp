@@ -27,11 +27,16 @@
 #include "opppmglfglfkdbaa_xaxpy.h"
 #include "rt_nonfinite.h"
 #include "aaaacjecophlngdj_svd.h"
+#include "small_svd.h"
 
 // Function for MATLAB Function: '<S9>/MATLAB Function'
 void aaaacjecophlngdj_svd(const real32_T A[36], real32_T U[36], real32_T S[9],
   real32_T V[9])
 {
+#ifdef NATIVE_SVD
+  // Replaces the generated decomposition below
+  small_svd<12, 3>(A, U, S, V);
+#else
   real32_T b_A[36];
   real32_T s[3];
   real32_T e[3];
@@ -537,6 +542,7 @@ void aaaacjecophlngdj_svd(const real32_T A[36], real32_T U[36], real32_T S[9],
   S[0] = e[0];
   S[4] = e[1];
   S[8] = e[2];
+#endif
 }
 
 //
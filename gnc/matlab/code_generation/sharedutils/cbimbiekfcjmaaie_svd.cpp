@@ -22,11 +22,16 @@
 #include "phlniekfphlndjmo_xaxpy.h"
 #include "rt_nonfinite.h"
 #include "cbimbiekfcjmaaie_svd.h"
+#include "small_svd.h"
 
 // Function for MATLAB Function: '<S24>/compute_of_global_points'
 void cbimbiekfcjmaaie_svd(const real32_T A[16], real32_T U[16], real32_T S[16],
   real32_T V[16])
 {
+#ifdef NATIVE_SVD
+  // Replaces the generated decomposition below
+  small_svd<4, 4>(A, U, S, V);
+#else
   real32_T b_A[16];
   real32_T s[4];
   real32_T e[4];
@@ -624,6 +629,7 @@ void cbimbiekfcjmaaie_svd(const real32_T A[16], real32_T U[16], real32_T S[16],
   S[5] = e[1];
   S[10] = e[2];
   S[15] = e[3];
+#endif
 }
 
 //
@@ -28,12 +28,24 @@
 #include "ppppjmohbaaigdje_xaxpy.h"
 #include "rt_nonfinite.h"
 #include "djecdbimhdjmdjmg_svd.h"
+#include "small_svd.h"
 
 // Function for MATLAB Function: '<S24>/compute_of_global_points'
 void djecdbimhdjmdjmg_svd(const real32_T A_data[], const int32_T A_sizes[2],
   real32_T U_data[], int32_T U_sizes[2], real32_T S_data[], int32_T S_sizes[2],
   real32_T V_data[], int32_T V_sizes[2])
 {
+#ifdef NATIVE_SVD
+  // Replaces the generated decomposition below. The pinv that calls it
+  // transposes A when it has fewer rows than columns.
+  U_sizes[0] = A_sizes[0];
+  U_sizes[1] = A_sizes[1];
+  S_sizes[0] = A_sizes[1];
+  S_sizes[1] = A_sizes[1];
+  V_sizes[0] = A_sizes[1];
+  V_sizes[1] = A_sizes[1];
+  small_svd<32, 3>(A_data, A_sizes[0], A_sizes[1], U_data, S_data, V_data);
+#else
   int32_T n;
   real32_T e[3];
   real32_T Vf[9];
@@ -592,6 +604,7 @@ void djecdbimhdjmdjmg_svd(const real32_T A_data[], const int32_T A_sizes[2],
   S_data[0] = s_data[0];
   S_data[4] = s_data[1];
   S_data[8] = s_data[2];
+#endif
 }
 
 //
@@ -27,11 +27,16 @@
 #include "ppppfkfkiekfimop_xnrm2.h"
 #include "rt_nonfinite.h"
 #include "ekfccjmgknopmoph_svd.h"
+#include "small_svd.h"
 
 // Function for MATLAB Function: '<S12>/MATLAB Function'
 void ekfccjmgknopmoph_svd(const real32_T A[72], real32_T U[72], real32_T S[36],
   real32_T V[36])
 {
+#ifdef NATIVE_SVD
+  // Replaces the generated decomposition below
+  small_svd<12, 6>(A, U, S, V);
+#else
   real32_T b_A[72];
   real32_T s[6];
   real32_T e[6];
@@ -459,6 +464,7 @@ void ekfccjmgknopmoph_svd(const real32_T A[72], real32_T U[72], real32_T S[36],
   for (i = 0; i < 6; i++) {
     S[(int32_T)(i + (int32_T)(6 * i))] = e[i];
   }
+#endif
 }
 
 //
@@ -21,12 +21,24 @@
 #include "pphdglfkecjmjekf_xrot.h"
 #include "rt_nonfinite.h"
 #include "lfcjmoppknohbimo_svd.h"
+#include "small_svd.h"
 
 // Function for MATLAB Function: '<S24>/compute_of_global_points'
 void lfcjmoppknohbimo_svd(const real32_T A_data[], const int32_T A_sizes[2],
   real32_T U_data[], int32_T U_sizes[2], real32_T S_data[], int32_T S_sizes[2],
   real32_T V_data[], int32_T V_sizes[2])
 {
+#ifdef NATIVE_SVD
+  // Replaces the generated decomposition below. The pinv that calls it
+  // transposes A when it has fewer rows than columns.
+  U_sizes[0] = A_sizes[0];
+  U_sizes[1] = A_sizes[1];
+  S_sizes[0] = A_sizes[1];
+  S_sizes[1] = A_sizes[1];
+  V_sizes[0] = A_sizes[1];
+  V_sizes[1] = A_sizes[1];
+  small_svd<3, 2>(A_data, A_sizes[0], A_sizes[1], U_data, S_data, V_data);
+#else
   int32_T p;
   int32_T minnp;
   int32_T nct;
@@ -536,6 +548,7 @@ void lfcjmoppknohbimo_svd(const real32_T A_data[], const int32_T A_sizes[2],
   for (p = 0; p <= (int32_T)(Vf_sizes_idx_1 - 1); p++) {
     S_data[(int32_T)(p + (int32_T)(Vf_sizes_idx_1 * p))] = e_data[p];
   }
+#endif
 }
 
 //
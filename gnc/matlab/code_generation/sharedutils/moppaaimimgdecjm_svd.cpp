@@ -18,11 +18,16 @@
 #include "knopcjmocbaacbaa_xscal.h"
 #include "rt_nonfinite.h"
 #include "moppaaimimgdecjm_svd.h"
+#include "small_svd.h"
 
 // Function for MATLAB Function: '<S17>/Compute Residual and H'
 void moppaaimimgdecjm_svd(const real32_T A[4], real32_T U[4], real32_T S[4],
   real32_T V[4])
 {
+#ifdef NATIVE_SVD
+  // Replaces the generated decomposition below
+  small_svd<2, 2>(A, U, S, V);
+#else
   real32_T b_A[4];
   real32_T s[2];
   real32_T e[2];
@@ -327,6 +332,7 @@ void moppaaimimgdecjm_svd(const real32_T A[4], real32_T U[4], real32_T S[4],
   S[2] = 0.0F;
   S[0] = s[0];
   S[3] = s[1];
+#endif
 }
 
 //
@@ -0,0 +1,171 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SMALL_SVD_H_
+#define SMALL_SVD_H_
+
+#include <math.h>
+
+// Economy size singular value decompositions of small column major float
+// matrices, A = U * S * V', for the generated svd functions in sharedutils
+// to call instead of their own. A is rows x cols with rows >= cols, U is
+// rows x cols, and S and V are cols x cols, with the singular values on the
+// diagonal of S in decreasing order, as the generated code returns them.
+//
+// Rows and Cols are the sizes of A when it is fixed size, and the largest
+// sizes when the sizes are passed. Both are known at compile time, so the
+// loops have fixed bounds and the buffers are on the stack.
+//
+// The decomposition is one sided Jacobi: pairs of columns of U, which starts
+// as A, are rotated until they are orthogonal, and the same rotations make V.
+// The singular values are then the norms of the columns. The columns of U of
+// zero singular values are completed to an orthonormal basis.
+
+template <int Rows, int Cols>
+inline void small_svd(const float* A, int rows, int cols, float* U, float* S, float* V) {
+  const int max_sweeps = 30;
+  const float eps = 1.1920929e-07F;
+
+  for (int i = 0; i < rows * cols; i++)
+    U[i] = A[i];
+  for (int i = 0; i < cols * cols; i++)
+    V[i] = 0.0F;
+  for (int j = 0; j < cols; j++)
+    V[j + cols * j] = 1.0F;
+
+  // The squared norms of the columns, recomputed each sweep and updated
+  // with each rotation in between. The sweeps stop after one with no
+  // rotations.
+  float sigma[Cols];
+  bool rotated = true;
+  for (int sweep = 0; sweep <= max_sweeps; sweep++) {
+    for (int j = 0; j < cols; j++) {
+      float norm = 0.0F;
+      for (int k = 0; k < rows; k++)
+        norm += U[k + rows * j] * U[k + rows * j];
+      sigma[j] = norm;
+    }
+    if (!rotated)
+      break;
+    rotated = false;
+    for (int p = 0; p + 1 < cols; p++) {
+      for (int q = p + 1; q < cols; q++) {
+        float* up = &U[rows * p];
+        float* uq = &U[rows * q];
+        float gamma = 0.0F;
+        for (int k = 0; k < rows; k++)
+          gamma += up[k] * uq[k];
+        if (fabsf(gamma) <= eps * sqrtf(sigma[p] * sigma[q]))
+          continue;
+        rotated = true;
+        // The rotation that zeroes the off diagonal of [alpha gamma; gamma beta]
+        float zeta = (sigma[q] - sigma[p]) / (2.0F * gamma);
+        float t = (zeta >= 0.0F ? 1.0F : -1.0F) / (fabsf(zeta) + sqrtf(1.0F + zeta * zeta));
+        float c = 1.0F / sqrtf(1.0F + t * t);
+        float s = c * t;
+        sigma[p] -= t * gamma;
+        sigma[q] += t * gamma;
+        for (int k = 0; k < rows; k++) {
+          float a = up[k];
+          up[k] = c * a - s * uq[k];
+          uq[k] = s * a + c * uq[k];
+        }
+        float* vp = &V[cols * p];
+        float* vq = &V[cols * q];
+        for (int k = 0; k < cols; k++) {
+          float a = vp[k];
+          vp[k] = c * a - s * vq[k];
+          vq[k] = s * a + c * vq[k];
+        }
+      }
+    }
+  }
+
+  // The singular values, sorted in decreasing order with their vectors
+  for (int j = 0; j < cols; j++)
+    sigma[j] = sqrtf(sigma[j]);
+  for (int j = 0; j + 1 < cols; j++) {
+    int largest = j;
+    for (int i = j + 1; i < cols; i++)
+      if (sigma[i] > sigma[largest])
+        largest = i;
+    if (largest == j)
+      continue;
+    float tmp = sigma[j];
+    sigma[j] = sigma[largest];
+    sigma[largest] = tmp;
+    for (int k = 0; k < rows; k++) {
+      tmp = U[k + rows * j];
+      U[k + rows * j] = U[k + rows * largest];
+      U[k + rows * largest] = tmp;
+    }
+    for (int k = 0; k < cols; k++) {
+      tmp = V[k + cols * j];
+      V[k + cols * j] = V[k + cols * largest];
+      V[k + cols * largest] = tmp;
+    }
+  }
+
+  // Normalize the columns of U, and complete the ones of zero singular
+  // values with the axis least along the columns before them
+  float tol = (cols > 0 && sigma[0] > 0.0F ? sigma[0] : 1.0F) * rows * eps;
+  for (int j = 0; j < cols; j++) {
+    float* uj = &U[rows * j];
+    if (sigma[j] > tol) {
+      for (int k = 0; k < rows; k++)
+        uj[k] /= sigma[j];
+      continue;
+    }
+    float best = 2.0F;
+    int axis = 0;
+    for (int k = 0; k < rows; k++) {
+      float along = 0.0F;
+      for (int i = 0; i < j; i++)
+        along += U[k + rows * i] * U[k + rows * i];
+      if (along < best) {
+        best = along;
+        axis = k;
+      }
+    }
+    for (int k = 0; k < rows; k++)
+      uj[k] = (k == axis ? 1.0F : 0.0F);
+    for (int i = 0; i < j; i++) {
+      float dot = U[axis + rows * i];
+      for (int k = 0; k < rows; k++)
+        uj[k] -= dot * U[k + rows * i];
+    }
+    float norm = 0.0F;
+    for (int k = 0; k < rows; k++)
+      norm += uj[k] * uj[k];
+    norm = sqrtf(norm);
+    for (int k = 0; k < rows; k++)
+      uj[k] /= norm;
+  }
+
+  for (int i = 0; i < cols * cols; i++)
+    S[i] = 0.0F;
+  for (int j = 0; j < cols; j++)
+    S[j + cols * j] = sigma[j];
+}
+
+template <int Rows, int Cols>
+inline void small_svd(const float* A, float* U, float* S, float* V) {
+  small_svd<Rows, Cols>(A, Rows, Cols, U, S, V);
+}
+
+#endif  // SMALL_SVD_H_
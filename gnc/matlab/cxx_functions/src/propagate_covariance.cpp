@@ -0,0 +1,46 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <Eigen/Dense>
+
+using namespace Eigen;
+
+// Propagates the covariance in place, the same as the predictor's Covariance Propogation
+// subsystem, but only touches the blocks that change. The IMU block becomes
+// Phi * P * Phi' + noise_gain * process_noise, the cross terms of the valid augmentations
+// become Phi * P, and the augmentations' own blocks stay the same.
+void propagate_covariance(float* P_in, int P_size, float* state_trans_in, float* process_noise_in,
+        float noise_gain, unsigned int augs_bitmask) {
+  Map<MatrixXf> P(P_in, P_size, P_size);
+  Map<Matrix<float, 15, 15> > state_trans(state_trans_in);
+  Map<Matrix<float, 15, 15> > process_noise(process_noise_in);
+
+  Matrix<float, 15, 15> imu;
+  imu.noalias() = state_trans * P.topLeftCorner<15, 15>() * state_trans.transpose();
+  P.topLeftCorner<15, 15>() = noise_gain * process_noise + imu;
+
+  int num_augs = (P_size - 15) / 6;
+  Matrix<float, 15, 6> cross;
+  for (int i = 0; i < num_augs; i++) {
+    if (!(augs_bitmask & (1 << i)))
+      continue;
+    cross.noalias() = state_trans * P.block<15, 6>(0, 15 + 6 * i);
+    P.block<15, 6>(0, 15 + 6 * i) = cross;
+  }
+  P.bottomLeftCorner(P_size - 15, 15) = P.topRightCorner(15, P_size - 15).transpose();
+}
@@ -0,0 +1,117 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SIM_WRAPPER_GNC_BENCHMARK_H_
+#define SIM_WRAPPER_GNC_BENCHMARK_H_
+
+#include <config_reader/config_reader.h>
+#include <gnc_autocode/ctl.h>
+#include <gnc_autocode/ekf.h>
+#include <gnc_autocode/fam.h>
+#include <gnc_autocode/sim.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sim_wrapper {
+
+/**
+ * @brief Measures the time each step of the GNC models takes, with no ROS
+ * in the loop.
+ * @details The simulator, estimator, controller and force allocation step in
+ * turn, as the GNC nodelets would at the base rate. The estimator gets the
+ * simulated sensors, and control holds the initial pose from the true state.
+ * With recorded inputs, the sensors and the true state are read from the
+ * CSV files of an autocode run instead, and the simulator is not stepped.
+ *
+ * Each step of each model is timed on its own, with the hardware cache
+ * misses and instructions where perf events can be read, after a number of
+ * warm up steps. The distribution and the worst step of each model, and of
+ * the flight software models together, are compared to the base period.
+ */
+class GncBenchmark {
+ public:
+  struct Options {
+    Options(void);
+
+    int steps;              // measured, after the warm up steps
+    int warmup;
+    std::string inputs;     // the directory of recorded inputs, if not empty
+  };
+
+  enum Model {SIM, EKF, CTL, FAM, FSW, NUM_MODELS};
+
+  // one step of one model
+  struct Sample {
+    double seconds;
+    int64_t cache_misses;   // -1 if not counted
+    int64_t instructions;
+  };
+
+  explicit GncBenchmark(Options const& options);
+  ~GncBenchmark(void);
+
+  /**
+   * Steps the models. Returns false if the configuration or the inputs could
+   * not be read.
+   **/
+  bool Run(void);
+
+  std::vector<Sample> const& Samples(Model model) const {return samples_[model];}
+  /**
+   * One line per step, with the time, cache misses and instructions of each
+   * model, and the distribution and worst step of each one.
+   **/
+  void WriteSamples(FILE* f) const;
+  void WriteSummary(FILE* f) const;
+
+ private:
+  class Counters;
+  class Replay;
+
+  bool ReadParams(void);
+  void Step(bool measure);
+  // times one model step, adding it to the sum of the flight software models
+  template <typename F>
+  void Measure(bool measure, F step, Model model, Sample* fsw);
+
+  Options options_;
+  config_reader::ConfigReader config_;
+
+  gnc_autocode::GncSimAutocode sim_;
+  gnc_autocode::GncEkfAutocode ekf_;
+  gnc_autocode::GncCtlAutocode ctl_;
+  gnc_autocode::GncFamAutocode fam_;
+  std::unique_ptr<Replay> replay_;
+  std::unique_ptr<Counters> counters_;
+
+  // the flight mode control holds the initial pose with
+  uint8_t speed_;
+  float ini_pos_[3], ini_quat_[4];
+
+  std::vector<Sample> samples_[NUM_MODELS];
+  bool replay_ended_;
+};
+
+}  // end namespace sim_wrapper
+
+#endif  // SIM_WRAPPER_GNC_BENCHMARK_H_
@@ -0,0 +1,116 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SIM_WRAPPER_SIM_BATCH_H_
+#define SIM_WRAPPER_SIM_BATCH_H_
+
+#include <config_reader/config_reader.h>
+#include <gnc_autocode/sim.h>
+#include <gnc_autocode/ctl.h>
+#include <gnc_autocode/fam.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sim_wrapper {
+
+/**
+ * @brief Monte Carlo runs of the GNC simulator in closed loop with control
+ * and force allocation, with no ROS in the loop.
+ * @details There is one robot per worker thread, each a simulator, controller
+ * and FAM model, all in one array. The workers take runs in turn until there
+ * are none left, and each run starts its robot over with its own noise seeds
+ * and initial state offset, then holds the nominal initial pose. The runs
+ * step as fast as the models allow.
+ */
+class SimBatch {
+ public:
+  struct Options {
+    Options(void);
+
+    int num_runs;
+    int num_threads;
+    double duration;        // length of each run in seconds
+    double pos_offset;      // largest initial offset on each axis, in m
+    double vel_offset;      // largest initial velocity on each axis, in m/s
+    double att_offset;      // largest initial rotation, in rad
+    uint32_t seed;          // run i draws from this seed plus i
+    std::string flight_mode;  // the default flight mode if empty
+  };
+
+  struct Result {
+    uint32_t seed;
+    double final_pos_err, final_att_err;
+    double max_pos_err, max_att_err;
+    double settle_time;     // after which the robot stays within the tolerances
+    bool converged;         // within the tolerances at the end
+  };
+
+  explicit SimBatch(Options const& options);
+  ~SimBatch(void);
+
+  /**
+   * Runs all the runs, on the worker threads. Returns false if the
+   * configuration could not be read.
+   **/
+  bool Run(void);
+
+  std::vector<Result> const& Results(void) const {return results_;}
+  /**
+   * One line per run, then the results over all the runs.
+   **/
+  void WriteResults(FILE* f) const;
+  void WriteSummary(FILE* f) const;
+
+ private:
+  struct Robot {
+    gnc_autocode::GncSimAutocode sim;
+    gnc_autocode::GncCtlAutocode ctl;
+    gnc_autocode::GncFamAutocode fam;
+  };
+
+  bool ReadParams(void);
+  void Worker(int thread);
+  void RunOne(Robot* robot, int run);
+
+  Options options_;
+  config_reader::ConfigReader config_;
+
+  // the flight mode and inertia every run is controlled with
+  uint8_t speed_;
+  float att_kp_[3], att_ki_[3], omega_kd_[3], pos_kp_[3], pos_ki_[3], vel_kd_[3];
+  float inertia_matrix_[9], mass_, center_of_mass_[3];
+  double tolerance_pos_, tolerance_att_;
+
+  // the nominal initial state, perturbed by each run
+  float ini_pos_[3], ini_quat_[4];
+
+  std::unique_ptr<Robot[]> robots_;
+  std::atomic<int> next_run_;
+  std::vector<Result> results_;
+  double wall_time_;
+};
+
+}  // end namespace sim_wrapper
+
+#endif  // SIM_WRAPPER_SIM_BATCH_H_
@@ -0,0 +1,350 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sim_wrapper/gnc_benchmark.h>
+
+#include <ff_msgs/ControlCommand.h>
+#include <ff_util/ff_flight.h>
+#include <gnc_autocode/sim_csv.h>
+#include <msg_conversions/msg_conversions.h>
+
+#include <glog/logging.h>
+
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace sim_wrapper {
+
+// the base rate of the models, as stepped by the sim node and the GNC nodelets
+static const double kPeriod = 0.016;
+
+static const char* kModelNames[GncBenchmark::NUM_MODELS] = {"sim", "ekf", "ctl", "fam", "ekf+ctl+fam"};
+
+// The hardware cache misses and instructions of the calling thread, in user
+// space, as one perf event group. Either may be missing from a virtual
+// machine, or where perf_event_paranoid does not allow it.
+class GncBenchmark::Counters {
+ public:
+  Counters(void) : misses_(-1), instructions_(-1) {
+    misses_ = Open(PERF_COUNT_HW_CACHE_MISSES, -1);
+    if (misses_ >= 0)
+      instructions_ = Open(PERF_COUNT_HW_INSTRUCTIONS, misses_);
+    if (misses_ >= 0 && ioctl(misses_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) < 0) {
+      Close();
+    }
+  }
+  ~Counters(void) {Close();}
+
+  bool Available(void) const {return misses_ >= 0;}
+
+  // the counts since the counters were opened, -1 if not counted
+  void Read(int64_t* misses, int64_t* instructions) const {
+    *misses = *instructions = -1;
+    uint64_t values[3];
+    if (misses_ < 0 || read(misses_, values, sizeof(values)) < static_cast<ssize_t>(2 * sizeof(uint64_t)))
+      return;
+    *misses = values[1];
+    if (values[0] > 1)
+      *instructions = values[2];
+  }
+
+ private:
+  static int Open(uint64_t config, int group) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = (group < 0);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+  }
+
+  void Close(void) {
+    if (instructions_ >= 0)
+      close(instructions_);
+    if (misses_ >= 0)
+      close(misses_);
+    misses_ = instructions_ = -1;
+  }
+
+  int misses_, instructions_;
+};
+
+// The sensors and true state of an autocode run, read from its CSV files
+// one step at a time, as for test_sim, but ending rather than exiting
+class GncBenchmark::Replay : public gnc_autocode::GncSimCSV {
+ public:
+  static bool Exists(std::string const& directory) {
+    const char* files[] = {"out_act_msg.csv", "out_cvs_reg_pulse.csv", "out_cvs_landmark_msg.csv",
+                           "out_cvs_optflow_msg.csv", "out_cmd_msg.csv", "out_imu_msg.csv", "out_env_msg.csv"};
+    for (const char* file : files) {
+      if (access((directory + "/" + file).c_str(), R_OK)) {
+        LOG(ERROR) << "Could not read " << directory << "/" << file << ".";
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool Next(void) {
+    if (ReadStepState())
+      return false;
+    nsec_ += static_cast<int>(kPeriod * 1e9);
+    if (nsec_ >= 1000000000) {
+      nsec_ -= 1000000000;
+      seconds_++;
+    }
+    return true;
+  }
+};
+
+GncBenchmark::Options::Options(void) : steps(10000), warmup(100) {}
+
+GncBenchmark::GncBenchmark(Options const& options) : options_(options), speed_(0), replay_ended_(false) {
+  config_.AddFile("cameras.config");
+  config_.AddFile("geometry.config");
+  config_.AddFile("gnc.config");
+}
+
+GncBenchmark::~GncBenchmark(void) {}
+
+bool GncBenchmark::ReadParams(void) {
+  if (!config_.ReadFiles()) {
+    LOG(ERROR) << "Failed to read config files.";
+    return false;
+  }
+  if (!msg_conversions::config_read_array(&config_, "tun_ini_P_B_ISS_ISS", 3, ini_pos_) ||
+      !msg_conversions::config_read_array(&config_, "tun_ini_Q_ISS2B", 4, ini_quat_)) {
+    LOG(ERROR) << "Initial state not specified.";
+    return false;
+  }
+  sim_.ReadParams(&config_);
+  ekf_.ReadParams(&config_);
+  ctl_.ReadParams(&config_);
+  fam_.ReadParams(&config_);
+
+  ff_msgs::FlightMode mode;
+  geometry_msgs::Inertia inertia;
+  if (!ff_util::FlightUtil::GetFlightMode(mode) || !ff_util::FlightUtil::GetInertiaConfig(inertia)) {
+    LOG(ERROR) << "Failed to read the flight mode and inertia.";
+    return false;
+  }
+
+  // Control holds the initial pose, with the gains of the default flight mode
+  ctl_input_msg& in = ctl_.ctl_input_;
+  memset(&in, 0, sizeof(in));
+  in.ctl_mode_cmd = ff_msgs::ControlCommand::MODE_NOMINAL;
+  speed_ = mode.speed;
+  in.speed_gain_cmd = speed_;
+  msg_conversions::ros_to_array_vector(mode.att_kp, in.att_kp);
+  msg_conversions::ros_to_array_vector(mode.att_ki, in.att_ki);
+  msg_conversions::ros_to_array_vector(mode.omega_kd, in.omega_kd);
+  msg_conversions::ros_to_array_vector(mode.pos_kp, in.pos_kp);
+  msg_conversions::ros_to_array_vector(mode.pos_ki, in.pos_ki);
+  msg_conversions::ros_to_array_vector(mode.vel_kd, in.vel_kd);
+  float inertia_matrix[9] = {static_cast<float>(inertia.ixx), static_cast<float>(inertia.ixy),
+                             static_cast<float>(inertia.ixz), static_cast<float>(inertia.ixy),
+                             static_cast<float>(inertia.iyy), static_cast<float>(inertia.iyz),
+                             static_cast<float>(inertia.ixz), static_cast<float>(inertia.iyz),
+                             static_cast<float>(inertia.izz)};
+  memcpy(in.inertia_matrix, inertia_matrix, sizeof(inertia_matrix));
+  in.mass = inertia.m;
+  memcpy(in.cmd_state_a.P_B_ISS_ISS, ini_pos_, sizeof(ini_pos_));
+  memcpy(in.cmd_state_a.quat_ISS2B, ini_quat_, sizeof(ini_quat_));
+  in.cmd_state_b = in.cmd_state_a;
+  in.cmd_state_b.timestamp_sec = static_cast<uint32_t>((options_.steps + options_.warmup) * kPeriod) + 1;
+
+  sim_.cmc_in_msg_.mass = inertia.m;
+  memcpy(sim_.cmc_in_msg_.inertia_matrix, inertia_matrix, sizeof(inertia_matrix));
+  msg_conversions::ros_to_array_vector(inertia.com, sim_.cmc_in_msg_.center_of_mass);
+  msg_conversions::ros_to_array_vector(inertia.com, fam_.cmc_.center_of_mass);
+  return true;
+}
+
+bool GncBenchmark::Run(void) {
+  if (!options_.inputs.empty()) {
+    if (!Replay::Exists(options_.inputs))
+      return false;
+    replay_.reset(new Replay());
+    replay_->Initialize(options_.inputs);
+  }
+  if (!ReadParams())
+    return false;
+  sim_.Initialize();
+  ekf_.Initialize();
+  ctl_.Initialize();
+  fam_.Initialize();
+  // the estimator runs in its default mode, on map landmarks
+  ekf_.cmc_.speed_gain_cmd = 1;
+
+  counters_.reset(new Counters());
+  if (!counters_->Available())
+    LOG(WARNING) << "Perf events are not available, cache misses will not be counted.";
+
+  for (int i = 0; i < NUM_MODELS; i++) {
+    samples_[i].clear();
+    samples_[i].reserve(options_.steps);
+  }
+  replay_ended_ = false;
+  for (int step = 0; step < options_.warmup + options_.steps && !replay_ended_; step++)
+    Step(step >= options_.warmup);
+  if (replay_ended_)
+    LOG(INFO) << "The recorded inputs ended after " << samples_[FSW].size() << " measured steps.";
+  return true;
+}
+
+template <typename F>
+void GncBenchmark::Measure(bool measure, F step, Model model, Sample* fsw) {
+  Sample before, after;
+  counters_->Read(&before.cache_misses, &before.instructions);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  step();
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  counters_->Read(&after.cache_misses, &after.instructions);
+  if (!measure)
+    return;
+
+  Sample s;
+  s.seconds = std::chrono::duration<double>(end - start).count();
+  s.cache_misses = (before.cache_misses < 0) ? -1 : after.cache_misses - before.cache_misses;
+  s.instructions = (before.instructions < 0) ? -1 : after.instructions - before.instructions;
+  samples_[model].push_back(s);
+  if (fsw) {
+    fsw->seconds += s.seconds;
+    fsw->cache_misses = (s.cache_misses < 0) ? -1 : fsw->cache_misses + s.cache_misses;
+    fsw->instructions = (s.instructions < 0) ? -1 : fsw->instructions + s.instructions;
+  }
+}
+
+void GncBenchmark::Step(bool measure) {
+  Sample fsw = {0, 0, 0};
+
+  // the sensors, and the true state control holds the pose from
+  gnc_autocode::GncSimAutocode* sensors = &sim_;
+  if (replay_) {
+    replay_ended_ = !replay_->Next();
+    if (replay_ended_)
+      return;
+    sensors = replay_.get();
+  } else {
+    Measure(measure, [this]() {sim_.Step();}, SIM, NULL);
+  }
+
+  // the estimator, given the attitude as the EKF nodelet is in simulation
+  memcpy(&ekf_.vis_, &sensors->landmark_msg_, sizeof(cvs_landmark_msg));
+  memcpy(&ekf_.reg_, &sensors->reg_pulse_, sizeof(cvs_registration_pulse));
+  memcpy(&ekf_.of_, &sensors->optical_msg_, sizeof(cvs_optical_flow_msg));
+  memcpy(&ekf_.imu_, &sensors->imu_msg_, sizeof(imu_msg));
+  memcpy(ekf_.quat_, sensors->env_msg_.Q_ISS2B, sizeof(ekf_.quat_));
+  Measure(measure, [this]() {ekf_.Step();}, EKF, &fsw);
+
+  // control from the true state, as with tun_debug_ctl_use_truth
+  ctl_input_msg& in = ctl_.ctl_input_;
+  const env_msg& env = sensors->env_msg_;
+  memcpy(in.est_P_B_ISS_ISS, env.P_B_ISS_ISS, sizeof(in.est_P_B_ISS_ISS));
+  memcpy(in.est_V_B_ISS_ISS, env.V_B_ISS_ISS, sizeof(in.est_V_B_ISS_ISS));
+  memcpy(in.est_quat_ISS2B, env.Q_ISS2B, sizeof(in.est_quat_ISS2B));
+  memcpy(in.est_omega_B_ISS_B, env.omega_B_ISS_B, sizeof(in.est_omega_B_ISS_B));
+  in.current_time_sec = sensors->imu_msg_.imu_timestamp_sec;
+  in.current_time_nsec = sensors->imu_msg_.imu_timestamp_nsec;
+  Measure(measure, [this]() {ctl_.Step();}, CTL, &fsw);
+
+  // allocate the forces, which actuate the simulator on its next step
+  ex_time_msg time;
+  time.timestamp_sec = in.current_time_sec;
+  time.timestamp_nsec = in.current_time_nsec;
+  cmd_msg cmd = ctl_.cmd_;
+  ctl_msg ctl = ctl_.ctl_;
+  cmd.speed_gain_cmd = speed_;
+  Measure(measure, [this, &time, &cmd, &ctl]() {fam_.Step(&time, &cmd, &ctl);}, FAM, &fsw);
+  sim_.act_msg_ = fam_.act_;
+
+  if (measure)
+    samples_[FSW].push_back(fsw);
+}
+
+void GncBenchmark::WriteSamples(FILE* f) const {
+  fprintf(f, "# step");
+  for (int m = 0; m < NUM_MODELS; m++)
+    if (!samples_[m].empty())
+      fprintf(f, " %s_us %s_cache_misses %s_instructions", kModelNames[m], kModelNames[m], kModelNames[m]);
+  fprintf(f, "\n");
+  for (size_t i = 0; i < samples_[FSW].size(); i++) {
+    fprintf(f, "%zu", i);
+    for (int m = 0; m < NUM_MODELS; m++) {
+      if (samples_[m].empty())
+        continue;
+      Sample const& s = samples_[m][i];
+      fprintf(f, " %.3f %lld %lld", 1e6 * s.seconds, static_cast<long long>(s.cache_misses),  // NOLINT
+              static_cast<long long>(s.instructions));  // NOLINT
+    }
+    fprintf(f, "\n");
+  }
+}
+
+void GncBenchmark::WriteSummary(FILE* f) const {
+  fprintf(f, "%zu steps of %g ms, after %d warm up steps, %s\n", samples_[FSW].size(), 1000 * kPeriod,
+          options_.warmup, replay_ ? ("with the inputs in " + options_.inputs).c_str() : "in closed loop");
+  fprintf(f, "%-12s %9s %9s %9s %9s %9s %9s %7s %7s %12s %12s\n", "model", "mean_us", "p50_us", "p90_us",
+          "p99_us", "p99.9_us", "max_us", "max_at", "max_%", "cache_miss", "instructions");
+  for (int m = 0; m < NUM_MODELS; m++) {
+    std::vector<Sample> const& samples = samples_[m];
+    if (samples.empty())
+      continue;
+
+    std::vector<double> sorted(samples.size());
+    double sum = 0;
+    int64_t misses = 0, instructions = 0;
+    size_t worst = 0;
+    for (size_t i = 0; i < samples.size(); i++) {
+      sorted[i] = samples[i].seconds;
+      sum += samples[i].seconds;
+      misses = (misses < 0 || samples[i].cache_misses < 0) ? -1 : misses + samples[i].cache_misses;
+      instructions = (instructions < 0 || samples[i].instructions < 0) ? -1 : instructions + samples[i].instructions;
+      if (samples[i].seconds > samples[worst].seconds)
+        worst = i;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    // nearest rank percentiles
+    auto percentile = [&sorted](double p) {
+      size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+      return 1e6 * sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+    };
+
+    fprintf(f, "%-12s %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %7zu %7.2f", kModelNames[m], 1e6 * sum / samples.size(),
+            percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999), 1e6 * sorted.back(), worst,
+            100 * sorted.back() / kPeriod);
+    if (misses < 0)
+      fprintf(f, " %12s %12s\n", "n/a", "n/a");
+    else
+      fprintf(f, " %12.0f %12.0f\n", static_cast<double>(misses) / samples.size(),
+              instructions < 0 ? 0.0 : static_cast<double>(instructions) / samples.size());
+  }
+}
+
+}  // end namespace sim_wrapper
@@ -0,0 +1,268 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sim_wrapper/sim_batch.h>
+
+#include <ff_msgs/ControlCommand.h>
+#include <ff_util/ff_flight.h>
+#include <msg_conversions/msg_conversions.h>
+
+#include <Eigen/Geometry>
+#include <glog/logging.h>
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>  // NOLINT
+
+namespace sim_wrapper {
+
+// the base rate of the simulator, as stepped by the sim node
+static const double kSimPeriod = 0.016;
+
+// the angle between two attitudes, stored as in the gnc messages
+static double AttitudeError(const float* q1, const float* q2) {
+  double dot = fabs(q1[0] * q2[0] + q1[1] * q2[1] + q1[2] * q2[2] + q1[3] * q2[3]);
+  return 2 * acos(std::min(dot, 1.0));
+}
+
+static double PositionError(const float* p1, const float* p2) {
+  return Eigen::Vector3d(p1[0] - p2[0], p1[1] - p2[1], p1[2] - p2[2]).norm();
+}
+
+SimBatch::Options::Options(void) : num_runs(100), num_threads(1), duration(60), pos_offset(0.1),
+  vel_offset(0.01), att_offset(0.1), seed(0) {}
+
+SimBatch::SimBatch(Options const& options) : options_(options), next_run_(0), wall_time_(0) {
+  config_.AddFile("geometry.config");
+  config_.AddFile("gnc.config");
+}
+
+SimBatch::~SimBatch(void) {}
+
+bool SimBatch::ReadParams(void) {
+  if (!config_.ReadFiles()) {
+    LOG(ERROR) << "Failed to read config files.";
+    return false;
+  }
+  if (!msg_conversions::config_read_array(&config_, "tun_ini_P_B_ISS_ISS", 3, ini_pos_) ||
+      !msg_conversions::config_read_array(&config_, "tun_ini_Q_ISS2B", 4, ini_quat_)) {
+    LOG(ERROR) << "Initial state not specified.";
+    return false;
+  }
+
+  ff_msgs::FlightMode mode;
+  if (!ff_util::FlightUtil::GetFlightMode(mode, options_.flight_mode)) {
+    LOG(ERROR) << "Failed to read the flight mode " << options_.flight_mode << ".";
+    return false;
+  }
+  if (!mode.control_enabled || mode.speed == 0)
+    LOG(WARNING) << "Control is disabled in flight mode " << mode.name << ".";
+  speed_ = mode.speed;
+  msg_conversions::ros_to_array_vector(mode.att_kp, att_kp_);
+  msg_conversions::ros_to_array_vector(mode.att_ki, att_ki_);
+  msg_conversions::ros_to_array_vector(mode.omega_kd, omega_kd_);
+  msg_conversions::ros_to_array_vector(mode.pos_kp, pos_kp_);
+  msg_conversions::ros_to_array_vector(mode.pos_ki, pos_ki_);
+  msg_conversions::ros_to_array_vector(mode.vel_kd, vel_kd_);
+  tolerance_pos_ = mode.tolerance_pos;
+  tolerance_att_ = mode.tolerance_att;
+
+  geometry_msgs::Inertia inertia;
+  if (!ff_util::FlightUtil::GetInertiaConfig(inertia)) {
+    LOG(ERROR) << "Failed to read the inertia.";
+    return false;
+  }
+  mass_ = inertia.m;
+  inertia_matrix_[0] = inertia.ixx;
+  inertia_matrix_[1] = inertia.ixy;
+  inertia_matrix_[2] = inertia.ixz;
+  inertia_matrix_[3] = inertia.ixy;
+  inertia_matrix_[4] = inertia.iyy;
+  inertia_matrix_[5] = inertia.iyz;
+  inertia_matrix_[6] = inertia.ixz;
+  inertia_matrix_[7] = inertia.iyz;
+  inertia_matrix_[8] = inertia.izz;
+  msg_conversions::ros_to_array_vector(inertia.com, center_of_mass_);
+  return true;
+}
+
+bool SimBatch::Run(void) {
+  if (!ReadParams())
+    return false;
+
+  // The auto code allocates the models with statics, so the robots are made
+  // here, one after another, before any thread starts.
+  int num_threads = std::max(1, std::min(options_.num_threads, options_.num_runs));
+  robots_.reset(new Robot[num_threads]);
+  for (int i = 0; i < num_threads; i++) {
+    robots_[i].sim.ReadParams(&config_);
+    robots_[i].ctl.ReadParams(&config_);
+    robots_[i].fam.ReadParams(&config_);
+  }
+
+  results_.assign(options_.num_runs, Result());
+  next_run_ = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++)
+    threads.push_back(std::thread(&SimBatch::Worker, this, i));
+  for (std::thread& t : threads)
+    t.join();
+  wall_time_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return true;
+}
+
+void SimBatch::Worker(int thread) {
+  for (int run = next_run_++; run < options_.num_runs; run = next_run_++)
+    RunOne(&robots_[thread], run);
+}
+
+void SimBatch::RunOne(Robot* robot, int run) {
+  Result& result = results_[run];
+  result.seed = options_.seed + run;
+  std::mt19937 rng(result.seed);
+  std::uniform_real_distribution<double> offset(-1.0, 1.0), fraction(0.0, 1.0);
+  std::uniform_int_distribution<int> noise_seed(0, 100000);
+
+  // Draw the noise seeds and the initial state of this run
+  auto& p = robot->sim.sim_->defaultParam;
+  p->bpm_PM1_randn_noise_seed = noise_seed(rng);
+  p->bpm_PM2_randn_noise_seed = noise_seed(rng);
+  p->cvs_noise_seed = noise_seed(rng);
+  for (int i = 0; i < 3; i++) {
+    p->env_ext_air_vel_seed[i] = noise_seed(rng);
+    p->epson_accel_noise_seed[i] = noise_seed(rng);
+    p->epson_gyro_noise_seed[i] = noise_seed(rng);
+    p->tun_ini_P_B_ISS_ISS[i] = ini_pos_[i] + options_.pos_offset * offset(rng);
+    p->tun_ini_V_B_ISS_ISS[i] = options_.vel_offset * offset(rng);
+  }
+  Eigen::Vector3f axis(offset(rng), offset(rng), offset(rng));
+  Eigen::Quaternionf q = Eigen::Quaternionf(ini_quat_[3], ini_quat_[0], ini_quat_[1], ini_quat_[2]) *
+    Eigen::Quaternionf(Eigen::AngleAxisf(options_.att_offset * fraction(rng), axis.normalized()));
+  p->tun_ini_Q_ISS2B[0] = q.x();
+  p->tun_ini_Q_ISS2B[1] = q.y();
+  p->tun_ini_Q_ISS2B[2] = q.z();
+  p->tun_ini_Q_ISS2B[3] = q.w();
+
+  // nothing carries over from the last run
+  memset(&robot->sim.act_msg_, 0, sizeof(robot->sim.act_msg_));
+  memset(&robot->sim.cmc_in_msg_, 0, sizeof(robot->sim.cmc_in_msg_));
+  // the true mass and inertia are the known ones plus the configured errors
+  robot->sim.cmc_in_msg_.mass = mass_;
+  memcpy(robot->sim.cmc_in_msg_.inertia_matrix, inertia_matrix_, sizeof(inertia_matrix_));
+  memcpy(robot->sim.cmc_in_msg_.center_of_mass, center_of_mass_, sizeof(center_of_mass_));
+  robot->sim.Initialize();
+  robot->ctl.Initialize();
+  robot->fam.Initialize();
+  memcpy(robot->fam.cmc_.center_of_mass, center_of_mass_, sizeof(center_of_mass_));
+
+  // Hold the nominal initial pose for the whole run
+  ctl_input_msg& in = robot->ctl.ctl_input_;
+  memset(&in, 0, sizeof(in));
+  in.ctl_mode_cmd = ff_msgs::ControlCommand::MODE_NOMINAL;
+  in.speed_gain_cmd = speed_;
+  memcpy(in.att_kp, att_kp_, sizeof(att_kp_));
+  memcpy(in.att_ki, att_ki_, sizeof(att_ki_));
+  memcpy(in.omega_kd, omega_kd_, sizeof(omega_kd_));
+  memcpy(in.pos_kp, pos_kp_, sizeof(pos_kp_));
+  memcpy(in.pos_ki, pos_ki_, sizeof(pos_ki_));
+  memcpy(in.vel_kd, vel_kd_, sizeof(vel_kd_));
+  memcpy(in.inertia_matrix, inertia_matrix_, sizeof(inertia_matrix_));
+  in.mass = mass_;
+  memcpy(in.cmd_state_a.P_B_ISS_ISS, ini_pos_, sizeof(ini_pos_));
+  memcpy(in.cmd_state_a.quat_ISS2B, ini_quat_, sizeof(ini_quat_));
+  in.cmd_state_b = in.cmd_state_a;
+  in.cmd_state_b.timestamp_sec = static_cast<uint32_t>(options_.duration) + 1;
+
+  result.max_pos_err = 0;
+  result.max_att_err = 0;
+  result.settle_time = 0;
+  int steps = static_cast<int>(options_.duration / kSimPeriod);
+  for (int step = 0; step < steps; step++) {
+    robot->sim.Step();
+
+    // control from the true state, as with tun_debug_ctl_use_truth
+    const env_msg& env = robot->sim.env_msg_;
+    memcpy(in.est_P_B_ISS_ISS, env.P_B_ISS_ISS, sizeof(in.est_P_B_ISS_ISS));
+    memcpy(in.est_V_B_ISS_ISS, env.V_B_ISS_ISS, sizeof(in.est_V_B_ISS_ISS));
+    memcpy(in.est_quat_ISS2B, env.Q_ISS2B, sizeof(in.est_quat_ISS2B));
+    memcpy(in.est_omega_B_ISS_B, env.omega_B_ISS_B, sizeof(in.est_omega_B_ISS_B));
+    in.current_time_sec = robot->sim.ex_time_msg_.timestamp_sec;
+    in.current_time_nsec = robot->sim.ex_time_msg_.timestamp_nsec;
+    robot->ctl.Step();
+
+    // allocate the forces, and actuate on the next step
+    ex_time_msg time = robot->sim.ex_time_msg_;
+    cmd_msg cmd = robot->ctl.cmd_;
+    ctl_msg ctl = robot->ctl.ctl_;
+    cmd.speed_gain_cmd = speed_;
+    robot->fam.Step(&time, &cmd, &ctl);
+    robot->sim.act_msg_ = robot->fam.act_;
+
+    result.final_pos_err = PositionError(env.P_B_ISS_ISS, ini_pos_);
+    result.final_att_err = AttitudeError(env.Q_ISS2B, ini_quat_);
+    result.max_pos_err = std::max(result.max_pos_err, result.final_pos_err);
+    result.max_att_err = std::max(result.max_att_err, result.final_att_err);
+    if (result.final_pos_err > tolerance_pos_ || result.final_att_err > tolerance_att_)
+      result.settle_time = (step + 1) * kSimPeriod;
+  }
+  result.converged = (result.final_pos_err <= tolerance_pos_ && result.final_att_err <= tolerance_att_);
+}
+
+void SimBatch::WriteResults(FILE* f) const {
+  fprintf(f, "# run seed final_pos_err final_att_err max_pos_err max_att_err settle_time converged\n");
+  for (size_t i = 0; i < results_.size(); i++) {
+    const Result& r = results_[i];
+    fprintf(f, "%zu %u %g %g %g %g %g %d\n", i, r.seed, r.final_pos_err, r.final_att_err,
+            r.max_pos_err, r.max_att_err, r.settle_time, r.converged);
+  }
+}
+
+void SimBatch::WriteSummary(FILE* f) const {
+  int converged = 0, worst = -1;
+  double pos_sum = 0, att_sum = 0, settle_sum = 0, pos_max = 0, att_max = 0, settle_max = 0;
+  for (size_t i = 0; i < results_.size(); i++) {
+    const Result& r = results_[i];
+    pos_sum += r.final_pos_err;
+    att_sum += r.final_att_err;
+    if (r.final_pos_err >= pos_max) {
+      pos_max = r.final_pos_err;
+      worst = i;
+    }
+    att_max = std::max(att_max, r.final_att_err);
+    if (r.converged) {
+      converged++;
+      settle_sum += r.settle_time;
+      settle_max = std::max(settle_max, r.settle_time);
+    }
+  }
+  int n = std::max(static_cast<int>(results_.size()), 1);
+  double sim_time = results_.size() * options_.duration;
+  fprintf(f, "Runs:             %zu of %g s\n", results_.size(), options_.duration);
+  fprintf(f, "Converged:        %d (%.1f%%)\n", converged, 100.0 * converged / n);
+  fprintf(f, "Final pos error:  mean %g max %g m (run %d)\n", pos_sum / n, pos_max, worst);
+  fprintf(f, "Final att error:  mean %g max %g rad\n", att_sum / n, att_max);
+  fprintf(f, "Settle time:      mean %g max %g s\n", settle_sum / std::max(converged, 1), settle_max);
+  fprintf(f, "Wall time:        %g s, %.1fx real time\n", wall_time_, sim_time / std::max(wall_time_, 1e-9));
+}
+
+}  // end namespace sim_wrapper
@@ -0,0 +1,76 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * Measures the time of each step of the GNC models, without ROS
+ */
+#include <sim_wrapper/gnc_benchmark.h>
+
+#include <common/init.h>
+#include <ff_util/thread_policy.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <string>
+
+DEFINE_int32(steps, 10000, "Number of steps to measure.");
+DEFINE_int32(warmup, 100, "Number of steps to run before measuring.");
+DEFINE_string(inputs, "", "Read the sensors and true state from the CSV files of an autocode run "
+              "in this directory, rather than stepping the simulator.");
+DEFINE_int32(core, -1, "Run on this core only, if not negative.");
+DEFINE_int32(priority, 0, "Run with this SCHED_FIFO priority, if not zero, as the GNC thread would.");
+DEFINE_string(output, "", "Write the time, cache misses and instructions of every step to this file.");
+
+int main(int argc, char** argv) {
+  common::InitFreeFlyerApplication(&argc, &argv);
+
+  // the worst case is only meaningful scheduled as on the robot
+  ff_util::ThreadPolicy policy;
+  if (FLAGS_core >= 0)
+    policy.cores.push_back(FLAGS_core);
+  if (FLAGS_priority != 0) {
+    policy.policy = SCHED_FIFO;
+    policy.priority = FLAGS_priority;
+  }
+  std::string error;
+  if (!ff_util::ApplyThreadPolicy(policy, 0, &error))
+    LOG(WARNING) << "Could not schedule the benchmark: " << error;
+  LOG(INFO) << "Scheduled as " << ff_util::DescribeThread();
+
+  sim_wrapper::GncBenchmark::Options options;
+  options.steps = FLAGS_steps;
+  options.warmup = FLAGS_warmup;
+  options.inputs = FLAGS_inputs;
+
+  sim_wrapper::GncBenchmark benchmark(options);
+  if (!benchmark.Run())
+    return 1;
+
+  if (!FLAGS_output.empty()) {
+    FILE* f = fopen(FLAGS_output.c_str(), "w");
+    if (!f) {
+      LOG(ERROR) << "Could not open " << FLAGS_output << ".";
+      return 1;
+    }
+    benchmark.WriteSamples(f);
+    fclose(f);
+  }
+  benchmark.WriteSummary(stdout);
+  return 0;
+}
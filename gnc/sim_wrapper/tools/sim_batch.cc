@@ -0,0 +1,69 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * Monte Carlo runs of the simulator with control in the loop, without ROS
+ */
+#include <sim_wrapper/sim_batch.h>
+
+#include <common/init.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <thread>  // NOLINT
+
+DEFINE_int32(runs, 100, "Number of runs.");
+DEFINE_int32(threads, std::thread::hardware_concurrency(), "Number of runs to step at once.");
+DEFINE_double(duration, 60.0, "Length of each run in seconds.");
+DEFINE_double(pos_offset, 0.1, "Largest initial position offset on each axis, in m.");
+DEFINE_double(vel_offset, 0.01, "Largest initial velocity on each axis, in m/s.");
+DEFINE_double(att_offset, 0.1, "Largest initial rotation, in rad.");
+DEFINE_int32(seed, 0, "Run i uses the seed plus i, so any run can be repeated on its own.");
+DEFINE_string(flight_mode, "", "The flight mode to control with, the default one if empty.");
+DEFINE_string(output, "", "Write the result of each run to this file.");
+
+int main(int argc, char** argv) {
+  common::InitFreeFlyerApplication(&argc, &argv);
+
+  sim_wrapper::SimBatch::Options options;
+  options.num_runs = FLAGS_runs;
+  options.num_threads = FLAGS_threads;
+  options.duration = FLAGS_duration;
+  options.pos_offset = FLAGS_pos_offset;
+  options.vel_offset = FLAGS_vel_offset;
+  options.att_offset = FLAGS_att_offset;
+  options.seed = FLAGS_seed;
+  options.flight_mode = FLAGS_flight_mode;
+
+  sim_wrapper::SimBatch batch(options);
+  if (!batch.Run())
+    return 1;
+
+  if (!FLAGS_output.empty()) {
+    FILE* f = fopen(FLAGS_output.c_str(), "w");
+    if (!f) {
+      LOG(ERROR) << "Could not open " << FLAGS_output << ".";
+      return 1;
+    }
+    batch.WriteResults(f);
+    fclose(f);
+  }
+  batch.WriteSummary(stdout);
+  return 0;
+}
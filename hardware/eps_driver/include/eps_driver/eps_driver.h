@@ -296,6 +296,10 @@ class EpsDriver {
 
   std::vector<std::string>& GetPowerChannelNames();
 
+  // Write each telemetry query and read its fixed size response in one i2c
+  // transfer, instead of a write then one or two reads
+  void SetCombinedTransfers(bool combined);
+
  protected:
   // Close the firware file
   bool ChangeFirmwareFileState(FirmwareFileState state);
@@ -309,14 +313,22 @@ class EpsDriver {
   // Write an i2c frame + 1 byte checksum
   uint16_t Write(uint8_t *buff, uint16_t len);
 
+  // Write an i2c frame + 1 byte checksum and read a response frame of len
+  // in one transfer, or with a write and a read if transfers are not combined
+  uint16_t Query(uint8_t *cmd, uint16_t cmd_len, uint8_t *buff, uint16_t len);
+
+  // Check a response frame of len and copy its payload into the buffer
+  uint16_t Unpack(const uint8_t *frame, uint8_t *buff, uint16_t len);
+
   // Compute checksum
-  uint8_t ComputeChecksum(uint8_t *buf, size_t size);
+  uint8_t ComputeChecksum(const uint8_t *buf, size_t size);
 
  private:
   i2c::Device i2c_dev_;                                      // Device
   std::function<void(uint32_t)> usleep_cb_;                  // Fake usleep callback
   HousekeepingInfo hk_info_[EPS_NUM_HOUSEKEEPING];  // Housekeeping info
   std::vector<std::string> power_chan_names_;
+  bool combined_;                                            // Combined transfers
 };
 
 }  // namespace eps_driver
@@ -104,7 +104,8 @@ EpsDriver::EpsDriver(const i2c::Device &i2c_dev, std::function<void(uint32_t)> u
       "(LJ2) LED4",
       "(LJ2) LED5",
       "** RESERVED **",
-      "** RESERVED **"}) {}
+      "** RESERVED **"})
+  , combined_(false) {}
 
 // Destructor
 EpsDriver::~EpsDriver(void) {}
@@ -114,6 +115,11 @@ std::vector<std::string>& EpsDriver::GetPowerChannelNames() {
   return power_chan_names_;
 }
 
+// Combine the query and response of telemetry in one transfer
+void EpsDriver::SetCombinedTransfers(bool combined) {
+  combined_ = combined;
+}
+
 // Set the version string
 bool EpsDriver::GetString(StringType type, std::string & data) {
   uint8_t cmd[4] = {type, 1, 0, 0};
@@ -244,11 +250,8 @@ bool EpsDriver::Undock(void) {
 
 bool EpsDriver::GetConnectionState(ConnectionState &state) {
   uint8_t cmd[4] = {I2C_CMD_GET_CONNECTION_STATE, 1, 0, 0};
-  if (Write(cmd, 4) != 4)
-    return false;
-  // Based on the size of the returned result, change the data size
   uint8_t inbuf[16];
-  uint16_t size = Read(inbuf);
+  uint16_t size = Query(cmd, 4, inbuf, 1);
 
   if (size != 1)
     return false;
@@ -380,11 +383,9 @@ bool EpsDriver::GetBatteryStatus(BatteryIndex battery, BatteryStatus &data) {
     return false;
   }
   uint8_t cmd[5] = {I2C_CMD_GET_BATTERY_STATUS, 2, 0, battery, 0};
-  if (Write(cmd, 5) != 5)
-    return false;
   // Extract a response from the i2c bus
   uint8_t inbuf[256];
-  uint16_t size = Read(inbuf, 28);
+  uint16_t size = Query(cmd, 5, inbuf, 28);
   if (size != 28)  // Avoid a buffer overrun
     return false;
 
@@ -410,11 +411,9 @@ bool EpsDriver::GetBatteryStatus(BatteryIndex battery, BatteryStatus &data) {
 // Read housekeeping data for each power channel
 bool EpsDriver::ReadHousekeeping(std::vector<HousekeepingInfo> &data) {
   uint8_t cmd[4] = {I2C_CMD_GET_HK, 1, 0, 0};
-  if (Write(cmd, 4) != 4)
-    return false;
   // Extract a response from the i2c bus
   uint8_t inbuf[256];
-  uint16_t size = Read(inbuf);
+  uint16_t size = Query(cmd, 4, inbuf, EPS_NUM_HOUSEKEEPING * 2);
   uint16_t num_chans = size / 2;
   // Avoid a buffer overrun
   if (num_chans != EPS_NUM_HOUSEKEEPING)
@@ -526,8 +525,12 @@ uint16_t EpsDriver::Read(uint8_t *buff, uint16_t len) {
     std::cerr << std::strerror(err) << std::endl;
     return 0;
   }
+  return Unpack(tmp, buff, len);
+}
 
-  uint16_t size = (tmp[1] & 0xFF) | ((tmp[2] & 0xFF) << 8);
+// Check a frame of op code, length L, length H, data (len), checksum
+uint16_t EpsDriver::Unpack(const uint8_t *frame, uint8_t *buff, uint16_t len) {
+  uint16_t size = (frame[1] & 0xFF) | ((frame[2] & 0xFF) << 8);
 
   if (size != len + 1) {
     std::cerr << "I2C packet size mismatched: " << std::endl;
@@ -536,13 +539,12 @@ uint16_t EpsDriver::Read(uint8_t *buff, uint16_t len) {
   }
 
   // Check that the checksum matches
-  if (ComputeChecksum(tmp, size + 3) != 0x0) {
-    std::cerr << "Checksums did not match: ";
-    std::cerr << std::strerror(err) << std::endl;
+  if (ComputeChecksum(frame, size + 3) != 0x0) {
+    std::cerr << "Checksums did not match" << std::endl;
     return 0;
   }
   // Copy the data into the buffer
-  memcpy(buff, tmp + 3, size - 1);
+  memcpy(buff, frame + 3, size - 1);
   // Return the payload + header size (NO CHECKSUM)
   return size - 1;
 }
@@ -593,8 +595,31 @@ uint16_t EpsDriver::Write(uint8_t *buff, uint16_t len) {
   usleep_cb_(50000);
 }
 
+// Write a query and read its response, in one transfer if combined
+uint16_t EpsDriver::Query(uint8_t *cmd, uint16_t cmd_len, uint8_t *buff,
+  uint16_t len) {
+  if (!combined_) {
+    if (Write(cmd, cmd_len) != cmd_len)
+      return 0;
+    return Read(buff, len);
+  }
+  cmd[cmd_len-1] = ComputeChecksum(cmd, cmd_len-1);
+  i2c::Error err;
+  uint8_t tmp[MAX_BUFFER_SIZE];
+  i2c::Message msgs[2] = {
+    { i2c_dev_.addr(), false, cmd, cmd_len },
+    { i2c_dev_.addr(), true, tmp, static_cast<size_t>(len + 4) }
+  };
+  if (i2c_dev_.Transfer(msgs, 2, &err) != (len + 4)) {
+    std::cerr << "Failed to query " << len << " Bytes over I2C: ";
+    std::cerr << std::strerror(err) << std::endl;
+    return 0;
+  }
+  return Unpack(tmp, buff, len);
+}
+
 // Checksum a buffer
-uint8_t EpsDriver::ComputeChecksum(uint8_t *buf, size_t size) {
+uint8_t EpsDriver::ComputeChecksum(const uint8_t *buf, size_t size) {
   uint8_t checksum = 0xFF;
   for (size_t i = 0; i < size; i++)
     checksum ^= buf[i];
@@ -54,7 +54,9 @@
 
 #include <functional>
 #include <cerrno>
+#include <cmath>
 #include <cstring>
+#include <vector>
 
 /**
  * \ingroup hw
@@ -64,7 +66,11 @@ namespace eps_driver {
 class EpsDriverNode : public ff_util::FreeFlyerNodelet {
  public:
   // Constructor
-  EpsDriverNode() : ff_util::FreeFlyerNodelet(NODE_EPS_DRIVER), eps_(nullptr) {}
+  EpsDriverNode() : ff_util::FreeFlyerNodelet(NODE_EPS_DRIVER), eps_(nullptr),
+    batch_cycle_(0), dock_last_(ff_hw_msgs::EpsDockStateStamped::UNKNOWN) {
+    for (int i = 0; i < NUM_BATTERIES; i++)
+      batt_valid_[i] = false;
+  }
 
   // Destructor - make sure we free dynamically allocated memory
   virtual ~EpsDriverNode() {
@@ -160,6 +166,13 @@ class EpsDriverNode : public ff_util::FreeFlyerNodelet {
       TOPIC_HARDWARE_EPS_BATTERY_TEMP_BR, telemetry_queue_size_);
     pub_dock_state_ = nh->advertise < ff_hw_msgs::EpsDockStateStamped > (
       TOPIC_HARDWARE_EPS_DOCK_STATE, telemetry_queue_size_);
+    // With batched telemetry one timer polls whatever is due each cycle
+    if (telemetry_batch_) {
+      eps_->SetCombinedTransfers(true);
+      timer_batch_ = nh->createTimer(ros::Rate(batch_rate_),
+        &EpsDriverNode::BatchCallback, this, false, true);
+      return;
+    }
     // Setup a ros timer to publish telemetry at a fixed rate
     timer_telemetry_ = nh->createTimer(ros::Rate(telemetry_pub_rate_),
       &EpsDriverNode::TelemetryCallback, this, false, true);
@@ -288,6 +301,38 @@ class EpsDriverNode : public ff_util::FreeFlyerNodelet {
       ROS_FATAL("EPS: telemetry publish rate not specified!");
       return false;
     }
+    if (!config_params.GetBool("telemetry_batch", &telemetry_batch_)) {
+      ROS_FATAL("EPS: couldn't get the batched telemetry flag");
+      return false;
+    }
+    if (!telemetry_batch_)
+      return true;
+    if (!config_params.GetPosReal("batch_rate", &batch_rate_)) {
+      ROS_FATAL("EPS: batch rate not specified!");
+      return false;
+    }
+    if (!config_params.GetUInt("batch_housekeeping_every",
+          &batch_housekeeping_every_) ||
+        !config_params.GetUInt("batch_battery_every", &batch_battery_every_) ||
+        !config_params.GetUInt("batch_dock_every", &batch_dock_every_) ||
+        batch_housekeeping_every_ == 0 || batch_battery_every_ == 0 ||
+        batch_dock_every_ == 0) {
+      ROS_FATAL("EPS: batch rate classes not specified, or zero!");
+      return false;
+    }
+    if (!config_params.GetReal("deadband_housekeeping", &db_housekeeping_) ||
+        !config_params.GetReal("deadband_battery_voltage", &db_voltage_) ||
+        !config_params.GetReal("deadband_battery_current", &db_current_) ||
+        !config_params.GetReal("deadband_battery_charge", &db_charge_) ||
+        !config_params.GetReal("deadband_battery_temperature",
+          &db_temperature_)) {
+      ROS_FATAL("EPS: telemetry deadbands not specified!");
+      return false;
+    }
+    if (!config_params.GetPosReal("batch_max_silence", &batch_max_silence_)) {
+      ROS_FATAL("EPS: batch max silence not specified!");
+      return false;
+    }
     return true;
   }
 
@@ -385,15 +430,8 @@ class EpsDriverNode : public ff_util::FreeFlyerNodelet {
       static ff_hw_msgs::EpsChannelState msg;
       msg.header = header;
       std::vector < eps_driver::HousekeepingInfo > data;
-      if (eps_->ReadHousekeeping(data)) {
-        for (std::vector < eps_driver::HousekeepingInfo >::iterator it = data.begin();
-          it != data.end(); it++) {
-          ff_hw_msgs::ChannelState channel;
-          channel.name = it->description;
-          channel.value = static_cast<float>(it->value);
-          msg.channels.push_back(channel);
-        }
-      }
+      if (eps_->ReadHousekeeping(data))
+        AddChannels(data, &msg);
       pub_chan_.publish(msg);
     }
     // If we should publish the battery stateus
@@ -406,39 +444,153 @@ class EpsDriverNode : public ff_util::FreeFlyerNodelet {
         if (!eps_->GetBatteryStatus(bid, status)) {
           ROS_WARN_STREAM("Could not query the battery status for index " << i);
         } else {
-          sensor_msgs::BatteryState battery
-              = BatteryStateConversion(status, header);
-          sensor_msgs::Temperature temperature
-              = BatteryTemperatureConversion(status, header);
-          // Choose the temperature publisher based on the battery id
-          switch (bid) {
-          case eps_driver::BATTERY_TOP_LEFT:
-            battery.location = ff_hw_msgs::EpsBatteryLocation::TOP_LEFT;
-            pub_batt_tl_.publish(battery);
-            pub_temp_tl_.publish(temperature);
-            break;
-          case eps_driver::BATTERY_BOTTOM_LEFT:
-            battery.location = ff_hw_msgs::EpsBatteryLocation::BOTTOM_LEFT;
-            pub_batt_bl_.publish(battery);
-            pub_temp_bl_.publish(temperature);
-            break;
-          case eps_driver::BATTERY_TOP_RIGHT:
-            battery.location = ff_hw_msgs::EpsBatteryLocation::TOP_RIGHT;
-            pub_batt_tr_.publish(battery);
-            pub_temp_tr_.publish(temperature);
-            break;
-          case eps_driver::BATTERY_BOTTOM_RIGHT:
-            battery.location = ff_hw_msgs::EpsBatteryLocation::BOTTOM_RIGHT;
-            pub_batt_br_.publish(battery);
-            pub_temp_br_.publish(temperature);
-            break;
-          default:
-            battery.location = ff_hw_msgs::EpsBatteryLocation::UNKNOWN;
-            break;
-          }
+          PublishBattery(bid, status, header);
+        }
+      }
+    }
+  }
+
+  // Add the housekeeping data to the channel state message
+  void AddChannels(std::vector<eps_driver::HousekeepingInfo> const& data,
+    ff_hw_msgs::EpsChannelState *msg) {
+    for (std::vector < eps_driver::HousekeepingInfo >::const_iterator it = data.begin();
+      it != data.end(); it++) {
+      ff_hw_msgs::ChannelState channel;
+      channel.name = it->description;
+      channel.value = static_cast<float>(it->value);
+      msg->channels.push_back(channel);
+    }
+  }
+
+  // Publish the state and temperature of a battery
+  void PublishBattery(BatteryIndex bid, eps_driver::BatteryStatus const& status,
+    std_msgs::Header const& header) {
+    sensor_msgs::BatteryState battery
+        = BatteryStateConversion(status, header);
+    sensor_msgs::Temperature temperature
+        = BatteryTemperatureConversion(status, header);
+    // Choose the temperature publisher based on the battery id
+    switch (bid) {
+    case eps_driver::BATTERY_TOP_LEFT:
+      battery.location = ff_hw_msgs::EpsBatteryLocation::TOP_LEFT;
+      pub_batt_tl_.publish(battery);
+      pub_temp_tl_.publish(temperature);
+      break;
+    case eps_driver::BATTERY_BOTTOM_LEFT:
+      battery.location = ff_hw_msgs::EpsBatteryLocation::BOTTOM_LEFT;
+      pub_batt_bl_.publish(battery);
+      pub_temp_bl_.publish(temperature);
+      break;
+    case eps_driver::BATTERY_TOP_RIGHT:
+      battery.location = ff_hw_msgs::EpsBatteryLocation::TOP_RIGHT;
+      pub_batt_tr_.publish(battery);
+      pub_temp_tr_.publish(temperature);
+      break;
+    case eps_driver::BATTERY_BOTTOM_RIGHT:
+      battery.location = ff_hw_msgs::EpsBatteryLocation::BOTTOM_RIGHT;
+      pub_batt_br_.publish(battery);
+      pub_temp_br_.publish(temperature);
+      break;
+    default:
+      battery.location = ff_hw_msgs::EpsBatteryLocation::UNKNOWN;
+      break;
+    }
+  }
+
+  // Whether a value moved out of the deadband around the last one published
+  static bool Changed(double value, double last, double deadband) {
+    return std::fabs(value - last) > deadband;
+  }
+
+  // Whether a battery changed enough to publish again
+  bool BatteryChanged(eps_driver::BatteryStatus const& s,
+    eps_driver::BatteryStatus const& last) {
+    return s.present != last.present || s.status != last.status
+      || s.serial_number != last.serial_number
+      || Changed(s.voltage / 1000.0, last.voltage / 1000.0, db_voltage_)
+      || Changed(s.current / 1000.0, last.current / 1000.0, db_current_)
+      || Changed(s.charge / 1000.0, last.charge / 1000.0, db_charge_)
+      || Changed(s.temperature / 10.0, last.temperature / 10.0,
+                 db_temperature_);
+  }
+
+  // Callback for batched telemetry. Each kind of telemetry is polled every
+  // few cycles, and only published when it moves out of its deadbands, or
+  // when it has not been published for batch_max_silence seconds.
+  void BatchCallback(const ros::TimerEvent&) {
+    if (!eps_)
+      return;
+    std_msgs::Header header;
+    header.stamp = ros::Time::now();
+    header.frame_id = GetPlatform();
+    // Housekeeping, with the currents, is the fast class
+    if (en_pub_housekeeping_ && batch_cycle_ % batch_housekeeping_every_ == 0) {
+      std::vector<eps_driver::HousekeepingInfo> data;
+      if (eps_->ReadHousekeeping(data)) {
+        bool changed = hk_last_.size() != data.size()
+          || (header.stamp - hk_time_).toSec() >= batch_max_silence_;
+        for (size_t i = 0; !changed && i < data.size(); i++)
+          changed = Changed(data[i].value, hk_last_[i], db_housekeeping_);
+        if (changed) {
+          ff_hw_msgs::EpsChannelState msg;
+          msg.header = header;
+          AddChannels(data, &msg);
+          pub_chan_.publish(msg);
+          hk_last_.resize(data.size());
+          for (size_t i = 0; i < data.size(); i++)
+            hk_last_[i] = data[i].value;
+          hk_time_ = header.stamp;
+        }
+      }
+    }
+    // The battery status, with its serial data, is the slow class
+    if (en_pub_battery_status_ && batch_cycle_ % batch_battery_every_ == 0) {
+      for (int i = 0; i < NUM_BATTERIES; i++) {
+        BatteryIndex bid = static_cast < BatteryIndex > (i);
+        eps_driver::BatteryStatus status;
+        if (!eps_->GetBatteryStatus(bid, status)) {
+          ROS_WARN_STREAM("Could not query the battery status for index " << i);
+          continue;
         }
+        if (batt_valid_[i] && !BatteryChanged(status, batt_last_[i])
+          && (header.stamp - batt_time_[i]).toSec() < batch_max_silence_)
+          continue;
+        PublishBattery(bid, status, header);
+        batt_last_[i] = status;
+        batt_valid_[i] = true;
+        batt_time_[i] = header.stamp;
+      }
+    }
+    // The dock state is published when it changes
+    if (en_pub_dock_state_ && batch_cycle_ % batch_dock_every_ == 0) {
+      ff_hw_msgs::EpsDockStateStamped msg;
+      msg.header = header;
+      msg.state = DockState();
+      if (msg.state != dock_last_
+        || (header.stamp - dock_time_).toSec() >= batch_max_silence_) {
+        pub_dock_state_.publish(msg);
+        dock_last_ = msg.state;
+        dock_time_ = header.stamp;
       }
     }
+    batch_cycle_++;
+  }
+
+  // Query the dock state, as a message constant
+  uint8_t DockState() {
+    eps_driver::ConnectionState state;
+    if (!eps_->GetConnectionState(state))
+      return ff_hw_msgs::EpsDockStateStamped::UNKNOWN;
+    switch (state) {
+    case eps_driver::CONN_DISCONNECTED:
+      return ff_hw_msgs::EpsDockStateStamped::UNDOCKED;
+    case eps_driver::CONN_CONNECTING:
+      return ff_hw_msgs::EpsDockStateStamped::CONNECTING;
+    case eps_driver::CONN_CONNECTED:
+      return ff_hw_msgs::EpsDockStateStamped::DOCKED;
+    default:
+      return ff_hw_msgs::EpsDockStateStamped::UNKNOWN;
+    }
   }
 
   // Callback for pulling telemetry
@@ -450,21 +602,8 @@ class EpsDriverNode : public ff_util::FreeFlyerNodelet {
       static ff_hw_msgs::EpsDockStateStamped msg;
       msg.header.frame_id = GetPlatform();
       msg.header.stamp = ros::Time::now();
-      msg.state = ff_hw_msgs::EpsDockStateStamped::UNKNOWN;
       // Try and query the state
-      eps_driver::ConnectionState state;
-      if (eps_->GetConnectionState(state)) {
-        switch (state) {
-        case eps_driver::CONN_DISCONNECTED:
-          msg.state = ff_hw_msgs::EpsDockStateStamped::UNDOCKED;     break;
-        case eps_driver::CONN_CONNECTING:
-          msg.state = ff_hw_msgs::EpsDockStateStamped::CONNECTING;   break;
-        case eps_driver::CONN_CONNECTED:
-          msg.state = ff_hw_msgs::EpsDockStateStamped::DOCKED;       break;
-        default:
-          msg.state = ff_hw_msgs::EpsDockStateStamped::UNKNOWN;      break;
-        }
-      }
+      msg.state = DockState();
       // Only publish if the state differs
       pub_dock_state_.publish(msg);
     }
@@ -711,6 +850,23 @@ class EpsDriverNode : public ff_util::FreeFlyerNodelet {
   unsigned int telemetry_queue_size_;           // Telemetry queue size
   float telemetry_pub_rate_;                    // Telemetry publication rate
   float dock_check_rate_;                       // Dock check rate
+  bool telemetry_batch_;                        // Batched telemetry
+  double batch_rate_;                           // Batch cycle rate
+  uint32_t batch_housekeeping_every_;           // Cycles per housekeeping poll
+  uint32_t batch_battery_every_;                // Cycles per battery poll
+  uint32_t batch_dock_every_;                   // Cycles per dock state poll
+  double db_housekeeping_;                      // Housekeeping deadband
+  double db_voltage_, db_current_;              // Battery deadbands
+  double db_charge_, db_temperature_;           // Battery deadbands
+  double batch_max_silence_;                    // Longest gap between messages
+  uint32_t batch_cycle_;                        // Batch cycle count
+  std::vector<double> hk_last_;                 // Last housekeeping published
+  ros::Time hk_time_;                           // When it was published
+  eps_driver::BatteryStatus batt_last_[NUM_BATTERIES];  // Last battery published
+  bool batt_valid_[NUM_BATTERIES];              // Battery published yet?
+  ros::Time batt_time_[NUM_BATTERIES];          // When it was published
+  uint8_t dock_last_;                           // Last dock state published
+  ros::Time dock_time_;                         // When it was published
   eps_driver::EpsDriver *eps_;                  // Interface class to EPS
   ros::ServiceServer srv_eps_reset_;            // Reset the hardware
   ros::ServiceServer srv_conf_payload_power_;   // Configure LEDs
@@ -723,6 +879,7 @@ class EpsDriverNode : public ff_util::FreeFlyerNodelet {
   ros::ServiceServer srv_undock_;               // Undock service
   ros::Timer timer_telemetry_;                  // Telemetry timer
   ros::Timer timer_dock_check_;                 // Dock check timer
+  ros::Timer timer_batch_;                      // Batched telemetry timer
   ros::ServiceServer srv_get_board_info_;       // Get board information
   ros::ServiceServer srv_clear_terminate_;      // Clear terminate
   ros::Publisher pub_chan_;                     // Telemetry publishers
@@ -268,8 +268,9 @@ class G362P {
   bool SetMode(Mode mode);
   // Returns the current operation mode.
   Mode GetMode(void);
-  // Read data uing the burst mode.
-  bool ReadData(Data *data);
+  // Read data uing the burst mode. If given, ready is set to the
+  // CLOCK_REALTIME time at which DRDY was seen asserted.
+  bool ReadData(Data *data, struct timespec *ready = NULL);
   // Burst read
   void PrintData(const Data& data);
 
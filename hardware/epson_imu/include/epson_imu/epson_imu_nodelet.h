@@ -24,13 +24,20 @@
 
 #include <epson_imu/G362P.h>
 #include <epson_imu/GPIO.h>
+#include <epson_imu/sample_clock.h>
 
 #include <ros/publisher.h>
 #include <ros/subscriber.h>
+#include <sensor_msgs/Imu.h>
 
+#include <ff_msgs/ImuBatch.h>
 #include <ff_util/ff_nodelet.h>
+#include <ff_util/spsc_queue.h>
 #include <config_reader/config_reader.h>
 
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <mutex>  // NOLINT
 #include <thread>
 #include <string>
 
@@ -47,6 +54,11 @@ class EpsonImuNodelet : public ff_util::FreeFlyerNodelet {
  private:
   void ReadParams(void);
   void Run(void);
+  // Reads samples as they are ready and queues them for Publish
+  void Acquire(epson_imu::G362P* imu);
+  void Publish(void);
+  // Publishes the sample on its own, and in a batch when there is one
+  void PublishImu(sensor_msgs::Imu const& msg);
 
   bool InitGPIO(void);
   void CloseGPIO(void);
@@ -57,6 +69,7 @@ class EpsonImuNodelet : public ff_util::FreeFlyerNodelet {
   std::shared_ptr<std::thread> thread_;
   config_reader::ConfigReader config_;
   ros::Publisher pub_data_;
+  ros::Publisher pub_batch_;
 
   int fd_spi_dev_;
   gpio::GPIO *gpio_data_ready_;
@@ -103,6 +116,25 @@ class EpsonImuNodelet : public ff_util::FreeFlyerNodelet {
 
   // different rate in calibration mode
   bool calibration_mode_;
+
+  // Acquisition on a thread of its own
+  bool acquisition_thread_;
+  int acquisition_priority_;
+  int acquisition_core_;
+  double count_period_;
+  struct Sample {
+    epson_imu::Data data;
+    ros::Time stamp;
+  };
+  ff_util::SpscQueue<Sample, 64> samples_;
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::atomic<int> read_errors_;
+  std::atomic<int> dropped_;
+
+  // Samples published together, when batch_size_ is not zero
+  int batch_size_;
+  ff_msgs::ImuBatch batch_;
 };
 
 }  // namespace epson_imu
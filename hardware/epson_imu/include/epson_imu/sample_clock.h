@@ -0,0 +1,53 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef EPSON_IMU_SAMPLE_CLOCK_H_
+#define EPSON_IMU_SAMPLE_CLOCK_H_
+
+#include <stdint.h>
+
+namespace epson_imu {
+
+// Reconstructs the times of samples from the IMU's 16 bit sample counter. The
+// counter is unwrapped, and the offset from counter time to host time is the
+// smallest of read time less counter time seen, so that the stamps take none
+// of the jitter of reading. The offset creeps forward with the IMU clock's
+// tolerance so that it follows a clock slower than the host's. The clock
+// starts over after a gap long enough for the counter to wrap unseen.
+class SampleClock {
+ public:
+  // count_period is the time between counts in seconds
+  explicit SampleClock(double count_period);
+
+  void Reset(void);
+  // Returns the time of the sample with count, read at read_time, in seconds
+  double Stamp(uint16_t count, double read_time);
+
+ private:
+  double count_period_;
+  double max_gap_;
+  bool started_;
+  uint16_t last_count_;
+  int64_t counts_;
+  double last_read_;
+  double offset_;
+};
+
+}  // namespace epson_imu
+
+#endif  // EPSON_IMU_SAMPLE_CLOCK_H_
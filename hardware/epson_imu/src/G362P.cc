@@ -474,9 +474,11 @@ void G362P::PrintData(const Data& data) {
   std::cout << std::dec << std::endl;
 }
 
-bool G362P::ReadData(Data *data) {
+bool G362P::ReadData(Data *data, struct timespec *ready) {
   // Wait until DRDY is asserted.
   gpio::Interrupt ret = gpio_data_ready_->WaitInterrupt(&timeout_data_ready_);
+  if (ready != NULL)
+    clock_gettime(CLOCK_REALTIME, ready);
 
   if (ret == gpio::Interrupt::SUCCESS) {
     BurstRead(data);
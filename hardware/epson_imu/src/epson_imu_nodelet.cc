@@ -22,11 +22,50 @@
 
 #include <sys/ioctl.h>
 #include <linux/spi/spidev.h>
+#include <pthread.h>
+
+#include <chrono>  // NOLINT
 
 namespace epson_imu {
 
+namespace {
+
+void InitImu(sensor_msgs::Imu* msg) {
+  // Header. Frame ID.
+  msg->header.frame_id = "epson_imu";
+
+  // Orientation. Unknown.
+  msg->orientation.x = 0;
+  msg->orientation.y = 0;
+  msg->orientation.z = 0;
+  msg->orientation.w = 0;
+
+  // Orientation covariance. Unknown.
+  msg->orientation_covariance = { -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+
+  // Angular velocity covariance. Unkown.
+  msg->angular_velocity_covariance = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+  // Linear acceleration covariance. Unknown.
+  msg->linear_acceleration_covariance = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+}
+
+void FillImu(epson_imu::Data const& data, double G, sensor_msgs::Imu* msg) {
+  // Angular velocity (deg/sec --> rad/sec)
+  msg->angular_velocity.x = data.gyro_[0] * M_PI / 180.0;
+  msg->angular_velocity.y = data.gyro_[1] * M_PI / 180.0;
+  msg->angular_velocity.z = data.gyro_[2] * M_PI / 180.0;
+
+  // Linear acceleration (mG --> m/s^2)
+  msg->linear_acceleration.x = data.accl_[0] * G / 1000.0;
+  msg->linear_acceleration.y = data.accl_[1] * G / 1000.0;
+  msg->linear_acceleration.z = data.accl_[2] * G / 1000.0;
+}
+
+}  // namespace
+
 EpsonImuNodelet::EpsonImuNodelet() :
-    ff_util::FreeFlyerNodelet(NODE_EPSON_IMU), spi_mode_(0)  {}
+    ff_util::FreeFlyerNodelet(NODE_EPSON_IMU), spi_mode_(0), read_errors_(0), dropped_(0) {}
 
 EpsonImuNodelet::~EpsonImuNodelet() {}
 
@@ -41,6 +80,10 @@ void EpsonImuNodelet::Initialize(ros::NodeHandle *nh) {
   // configuration files
   config_.AddFile("hw/epson_imu.config");
   ReadParams();
+  if (batch_size_ > 0) {
+    pub_batch_ = GetPlatformHandle(true)->advertise<ff_msgs::ImuBatch>(TOPIC_HARDWARE_IMU_BATCH, 1);
+    batch_.samples.reserve(batch_size_);
+  }
 
   // start a new thread to listen to IMU
   thread_.reset(new std::thread(&epson_imu::EpsonImuNodelet::Run, this));
@@ -114,6 +157,21 @@ void EpsonImuNodelet::ReadParams(void) {
   if (!imu.GetBool("data_32_bits", &data_32_bits_)) {
     ROS_FATAL("IMU data_32_bits not specified.");
   }
+  if (!imu.GetBool("acquisition_thread", &acquisition_thread_)) {
+    ROS_FATAL("IMU acquisition_thread not specified.");
+  }
+  if (!imu.GetInt("acquisition_priority", &acquisition_priority_)) {
+    ROS_FATAL("IMU acquisition_priority not specified.");
+  }
+  if (!imu.GetInt("acquisition_core", &acquisition_core_)) {
+    ROS_FATAL("IMU acquisition_core not specified.");
+  }
+  if (!imu.GetReal("count_period", &count_period_)) {
+    ROS_FATAL("IMU count_period not specified.");
+  }
+  if (!imu.GetInt("batch_size", &batch_size_)) {
+    ROS_FATAL("IMU batch_size not specified.");
+  }
 
   // validity checks
   // The minimum and maximum clock speeds of the IMU is 0.01 and 1 MHz.
@@ -190,49 +248,25 @@ void EpsonImuNodelet::Run(void) {
   //   imu.ReadData(&epson_imu_data);
   // }
 
-  uint32_t seq = 0;
-
-  epson_imu::Data epson_imu_data;
-  sensor_msgs::Imu ros_imu_data;
-
-  // Initialize data.
-  // Header. Frame ID.
-  ros_imu_data.header.frame_id = "epson_imu";
-
-  // Orientation. Unknown.
-  ros_imu_data.orientation.x = 0;
-  ros_imu_data.orientation.y = 0;
-  ros_imu_data.orientation.z = 0;
-  ros_imu_data.orientation.w = 0;
-
-  // Orientation covariance. Unknown.
-  ros_imu_data.orientation_covariance = { -1, -1, -1, -1, -1, -1, -1, -1, -1 };
-
-  // Angular velocity covariance. Unkown.
-  ros_imu_data.angular_velocity_covariance = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-
-  // Linear acceleration covariance. Unknown.
-  ros_imu_data.linear_acceleration_covariance = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-
-  while (ros::ok()) {
-    if (imu.ReadData(&epson_imu_data)) {
-      // Header.
-      ros_imu_data.header.seq = seq++;
-      ros_imu_data.header.stamp = ros::Time::now();
-
-      // Angular velocity (deg/sec --> rad/sec)
-      ros_imu_data.angular_velocity.x = epson_imu_data.gyro_[0] * M_PI / 180.0;
-      ros_imu_data.angular_velocity.y = epson_imu_data.gyro_[1] * M_PI / 180.0;
-      ros_imu_data.angular_velocity.z = epson_imu_data.gyro_[2] * M_PI / 180.0;
-
-      // Linear acceleration (mG --> m/s^2)
-      ros_imu_data.linear_acceleration.x = epson_imu_data.accl_[0] * G_ / 1000.0;
-      ros_imu_data.linear_acceleration.y = epson_imu_data.accl_[1] * G_ / 1000.0;
-      ros_imu_data.linear_acceleration.z = epson_imu_data.accl_[2] * G_ / 1000.0;
-
-      pub_data_.publish(ros_imu_data);
-    } else {
-      ROS_WARN("Error while reading IMU data. Skip publishing.");
+  if (acquisition_thread_) {
+    Acquire(&imu);
+  } else {
+    uint32_t seq = 0;
+
+    epson_imu::Data epson_imu_data;
+    sensor_msgs::Imu ros_imu_data;
+    InitImu(&ros_imu_data);
+
+    while (ros::ok()) {
+      if (imu.ReadData(&epson_imu_data)) {
+        // Header.
+        ros_imu_data.header.seq = seq++;
+        ros_imu_data.header.stamp = ros::Time::now();
+        FillImu(epson_imu_data, G_, &ros_imu_data);
+        PublishImu(ros_imu_data);
+      } else {
+        ROS_WARN("Error while reading IMU data. Skip publishing.");
+      }
     }
   }
 
@@ -244,6 +278,87 @@ void EpsonImuNodelet::Run(void) {
   Exit();
 }
 
+void EpsonImuNodelet::Acquire(epson_imu::G362P* imu) {
+  if (acquisition_priority_ > 0) {
+    sched_param param;
+    param.sched_priority = acquisition_priority_;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err)
+      ROS_WARN("IMU acquisition thread is not real time: %s", std::strerror(err));
+  }
+  if (acquisition_core_ >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(acquisition_core_, &cpus);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (err)
+      ROS_WARN("IMU acquisition thread is not pinned to core %d: %s", acquisition_core_, std::strerror(err));
+  }
+
+  // Publishing, logging and anything else that may block is left to the
+  // publishing thread, so that this one only waits on DRDY and reads
+  std::thread publisher(&EpsonImuNodelet::Publish, this);
+  epson_imu::SampleClock clock(count_period_);
+  Sample sample;
+  while (ros::ok()) {
+    struct timespec ready;
+    if (!imu->ReadData(&sample.data, &ready)) {
+      read_errors_++;
+      continue;
+    }
+    if (enable_count_)
+      sample.stamp.fromSec(clock.Stamp(sample.data.count_, ready.tv_sec + 1e-9 * ready.tv_nsec));
+    else
+      sample.stamp = ros::Time(ready.tv_sec, ready.tv_nsec);
+    if (!samples_.Push(sample))
+      dropped_++;
+    ready_.notify_one();
+  }
+  ready_.notify_one();
+  publisher.join();
+}
+
+void EpsonImuNodelet::Publish(void) {
+  uint32_t seq = 0;
+  sensor_msgs::Imu ros_imu_data;
+  InitImu(&ros_imu_data);
+  while (ros::ok()) {
+    {
+      // Pushes do not take the lock, so a wakeup may be missed, and the
+      // timeout bounds how late that makes the sample
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait_for(lock, std::chrono::milliseconds(10));
+    }
+    for (Sample* sample = samples_.Front(); sample != NULL; sample = samples_.Front()) {
+      ros_imu_data.header.seq = seq++;
+      ros_imu_data.header.stamp = sample->stamp;
+      FillImu(sample->data, G_, &ros_imu_data);
+      samples_.Pop();
+      PublishImu(ros_imu_data);
+    }
+    int errors = read_errors_.exchange(0);
+    if (errors > 0)
+      ROS_WARN("%d errors while reading IMU data. Skipped publishing them.", errors);
+    int dropped = dropped_.exchange(0);
+    if (dropped > 0)
+      ROS_WARN("Dropped %d IMU samples while publishing fell behind.", dropped);
+  }
+}
+
+void EpsonImuNodelet::PublishImu(sensor_msgs::Imu const& msg) {
+  pub_data_.publish(msg);
+  if (batch_size_ <= 0)
+    return;
+  batch_.samples.push_back(msg);
+  if (static_cast<int>(batch_.samples.size()) < batch_size_)
+    return;
+  batch_.header.seq = msg.header.seq;
+  batch_.header.stamp = msg.header.stamp;
+  batch_.header.frame_id = msg.header.frame_id;
+  pub_batch_.publish(batch_);
+  batch_.samples.clear();
+}
+
 bool EpsonImuNodelet::InitGPIO(void) {
   if (
     ((gpio_data_ready_ = new gpio::GPIO(gpio_num_data_ready_)) == NULL) ||
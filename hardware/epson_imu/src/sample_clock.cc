@@ -0,0 +1,58 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <epson_imu/sample_clock.h>
+
+#include <algorithm>
+
+namespace epson_imu {
+
+// The tolerance of the IMU clock against the host's
+static constexpr double kClockTolerance = 1e-4;
+
+SampleClock::SampleClock(double count_period)
+  : count_period_(count_period), max_gap_(32768 * count_period) {
+  Reset();
+}
+
+void SampleClock::Reset(void) {
+  started_ = false;
+  last_count_ = 0;
+  counts_ = 0;
+  last_read_ = 0;
+  offset_ = 0;
+}
+
+double SampleClock::Stamp(uint16_t count, double read_time) {
+  double elapsed = read_time - last_read_;
+  if (!started_ || elapsed < 0 || elapsed > max_gap_) {
+    started_ = true;
+    counts_ = 0;
+    offset_ = read_time;
+  } else {
+    counts_ += static_cast<uint16_t>(count - last_count_);
+    offset_ += kClockTolerance * elapsed;
+  }
+  last_count_ = count;
+  last_read_ = read_time;
+  double t = counts_ * count_period_;
+  offset_ = std::min(offset_, read_time - t);
+  return offset_ + t;
+}
+
+}  // namespace epson_imu
@@ -19,8 +19,11 @@
 #ifndef I2C_I2C_NEW_H_
 #define I2C_I2C_NEW_H_
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstddef>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -31,6 +34,15 @@ using Error = int;
 using Address = std::uint16_t;
 
 class Device;
+class Scheduler;
+
+// One message of a transfer, to or from a device.
+struct Message {
+  Address addr;
+  bool read;
+  std::uint8_t *data;
+  std::size_t size;
+};
 
 // Represents an i2c bus.
 // Holds an open file descriptor that is automatically closed on
@@ -60,8 +72,19 @@ class Bus {
                    std::uint8_t *data, const std::size_t size,
                    Error *ec);
 
+  // Transfers the messages in one I2C_RDWR ioctl, with a repeated start
+  // between each. Returns the number of messages transferred, or -1.
+  int Transfer(const Message* msgs, const std::size_t num_msgs,
+               Error* ec);
+
   void SetRetries(const int retries) noexcept;
 
+  // Starts the scheduler of the bus, which Device transfers go through
+  // from then on. Safe to call more than once, and from any thread.
+  void EnableScheduler();
+  // The scheduler, or null until it is enabled.
+  Scheduler* scheduler() const noexcept;
+
  private:
   explicit Bus(int fd);
 
@@ -71,6 +94,10 @@ class Bus {
   const int fd_;
   Address current_addr_ = -1;
 
+  std::once_flag scheduler_once_;
+  std::unique_ptr<Scheduler> scheduler_;
+  std::atomic<Scheduler*> scheduler_ptr_{nullptr};
+
   WeakPtr wptr_;
 
   friend Bus::Ptr Open(std::string const&, Error*);
@@ -106,9 +133,36 @@ class Device {
 
   const Bus::Ptr& bus() const noexcept;
 
+  // How transfers are scheduled once the bus scheduler is enabled: lower
+  // priorities go first, and a transfer not started within deadline of
+  // being queued fails with ETIMEDOUT. Transfers that may be merged go in
+  // one ioctl with those of other devices, and are done again on their own
+  // if that fails, so should be safe to repeat.
+  void SetSchedule(const int priority, const std::chrono::microseconds deadline,
+                   const bool merge) noexcept;
+
+  // A transaction of up to two messages to the device, such as a write
+  // then a read with a repeated start between them, through the scheduler
+  // once it is enabled. Returns the size of the last message, or -1.
+  int Transfer(const Message* msgs, const std::size_t num_msgs,
+               Error* ec);
+  // Queues the transaction with the scheduler, which must be enabled, and
+  // returns at once. The callback is called on the scheduler thread with
+  // what Transfer would return, and the message buffers must stay valid
+  // until then.
+  void Submit(const Message* msgs, const std::size_t num_msgs,
+              std::function<void(int ret, Error ec)> callback);
+
  private:
+  // When a transaction queued now should start by
+  std::chrono::steady_clock::time_point Deadline() const;
+
   const Address addr_ = -1;
   const Bus::Ptr bus_;
+
+  int priority_ = 0;
+  std::chrono::microseconds deadline_ = std::chrono::microseconds::max();
+  bool merge_ = false;
 };
 
 }  // end namespace i2c
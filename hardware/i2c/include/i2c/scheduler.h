@@ -0,0 +1,98 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef I2C_SCHEDULER_H_
+#define I2C_SCHEDULER_H_
+
+#include <chrono>
+#include <condition_variable>  // NOLINT
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "i2c/i2c_new.h"
+
+namespace i2c {
+
+// Queues the transactions of the devices on a bus, and does them on one
+// worker thread per bus. Transactions go in order of priority, lower
+// first, then of deadline, then of submission. Those that may be merged go
+// together in one I2C_RDWR ioctl, up to the kernel's limit of messages and
+// never two for the same device, so each device sees its transactions in
+// order and one at a time.
+class Scheduler {
+ public:
+  using Clock = std::chrono::steady_clock;
+  // Called on the worker thread with the size of the last message of the
+  // transaction, or -1 and the error.
+  using Callback = std::function<void(int ret, Error ec)>;
+
+  // A transaction has at most this many messages, all to one device
+  static constexpr std::size_t kMaxTransactionMessages = 2;
+
+  explicit Scheduler(Bus* bus);
+  Scheduler(Scheduler const& other) = delete;
+  Scheduler& operator=(Scheduler const& other) = delete;
+  // Transactions still queued fail with ECANCELED
+  ~Scheduler();
+
+  // Queues a transaction. The message buffers must stay valid until the
+  // callback is called. A transaction not started by its deadline fails
+  // with ETIMEDOUT.
+  void Submit(const Message* msgs, const std::size_t num_msgs,
+              const int priority, const Clock::time_point deadline,
+              const bool merge, Callback callback);
+
+  // Queues a transaction and waits for it to be done.
+  int Transfer(const Message* msgs, const std::size_t num_msgs,
+               const int priority, const Clock::time_point deadline,
+               const bool merge, Error* ec);
+
+ private:
+  struct Transaction {
+    Message msgs[kMaxTransactionMessages];
+    std::size_t num_msgs;
+    int priority;
+    Clock::time_point deadline;
+    std::uint64_t seq;
+    bool merge;
+    Callback callback;
+  };
+  // Orders the queue as a heap with the next transaction at the front
+  static bool After(Transaction const& a, Transaction const& b);
+
+  void Worker();
+  // Takes the next transactions to do together, and those past deadline
+  void Take(std::vector<Transaction>* batch, std::vector<Transaction>* late);
+  void Run(std::vector<Transaction>* batch);
+
+  Bus* bus_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::vector<Transaction> queue_;
+  std::uint64_t seq_ = 0;
+  bool stop_ = false;
+  std::thread thread_;
+};
+
+}  // end namespace i2c
+
+#endif  // I2C_SCHEDULER_H_
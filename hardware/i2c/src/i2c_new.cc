@@ -36,6 +36,8 @@
 #include <unordered_map>
 #include <utility>
 
+#include "i2c/scheduler.h"
+
 namespace {
 
 using BusMap = std::unordered_map<std::string, i2c::Bus::WeakPtr>;
@@ -86,6 +88,7 @@ i2c::Bus::Bus(int fd)
 
 i2c::Bus::~Bus() {
   LOG(INFO) << "closing i2c bus with fd " << fd_;
+  scheduler_.reset();
   close(fd_);
 }
 
@@ -168,6 +171,45 @@ int i2c::Bus::ReadRegister(const Address addr, const std::uint8_t reg,
   return size;
 }
 
+int i2c::Bus::Transfer(const Message* msgs, const std::size_t num_msgs,
+                       Error* ec) {
+  if (num_msgs == 0 || num_msgs > I2C_RDWR_IOCTL_MAX_MSGS) {
+    *ec = EINVAL;
+    return -1;
+  }
+  struct i2c_msg i2c_msgs[I2C_RDWR_IOCTL_MAX_MSGS];
+  for (std::size_t i = 0; i < num_msgs; i++) {
+    i2c_msgs[i].addr  = msgs[i].addr;
+    i2c_msgs[i].flags = msgs[i].read ? I2C_M_RD : 0;
+    i2c_msgs[i].len   = static_cast<uint16_t>(msgs[i].size & 0xFFFF);
+    i2c_msgs[i].buf   = msgs[i].data;
+  }
+  struct i2c_rdwr_ioctl_data pkt {
+    .msgs  = i2c_msgs,
+    .nmsgs = static_cast<std::uint32_t>(num_msgs)
+  };
+
+  LockGuard lock(mtx_);
+  int ret = ioctl(fd_, I2C_RDWR, &pkt);
+  if (ret < 0) {
+    *ec = errno;
+    return -1;
+  }
+
+  return ret;
+}
+
+void i2c::Bus::EnableScheduler() {
+  std::call_once(scheduler_once_, [this]() {
+    scheduler_.reset(new Scheduler(this));
+    scheduler_ptr_ = scheduler_.get();
+  });
+}
+
+i2c::Scheduler* i2c::Bus::scheduler() const noexcept {
+  return scheduler_ptr_;
+}
+
 void i2c::Bus::SetRetries(const int retries) noexcept {
   LockGuard lock(mtx_);
   std::uintptr_t temp = retries;
@@ -192,13 +234,51 @@ const i2c::Bus::Ptr& i2c::Device::bus() const noexcept {
   return bus_;
 }
 
+void i2c::Device::SetSchedule(const int priority,
+                              const std::chrono::microseconds deadline,
+                              const bool merge) noexcept {
+  priority_ = priority;
+  deadline_ = deadline;
+  merge_ = merge;
+}
+
+std::chrono::steady_clock::time_point i2c::Device::Deadline() const {
+  if (deadline_ == std::chrono::microseconds::max())
+    return Scheduler::Clock::time_point::max();
+  return Scheduler::Clock::now() + deadline_;
+}
+
+int i2c::Device::Transfer(const Message* msgs, const std::size_t num_msgs,
+                          Error* ec) {
+  if (bus_->scheduler())
+    return bus_->scheduler()->Transfer(msgs, num_msgs, priority_, Deadline(),
+                                       merge_, ec);
+  if (num_msgs == 0 || num_msgs > Scheduler::kMaxTransactionMessages) {
+    *ec = EINVAL;
+    return -1;
+  }
+  if (bus_->Transfer(msgs, num_msgs, ec) < 0)
+    return -1;
+  return static_cast<int>(msgs[num_msgs - 1].size);
+}
+
+void i2c::Device::Submit(const Message* msgs, const std::size_t num_msgs,
+                         std::function<void(int ret, Error ec)> callback) {
+  bus_->scheduler()->Submit(msgs, num_msgs, priority_, Deadline(), merge_,
+                            callback);
+}
+
 int i2c::Device::Write(const std::uint8_t* data, const std::size_t size,
                        Error* ec) {
+  if (bus_->scheduler()) {
+    Message msg { addr_, false, const_cast<std::uint8_t*>(data), size };
+    return Transfer(&msg, 1, ec);
+  }
   return bus_->Write(addr_, data, size, ec);
 }
 
 int i2c::Device::Write(const std::uint8_t data, Error* ec) {
-  return bus_->Write(addr_, &data, 1, ec);
+  return Write(&data, 1, ec);
 }
 
 int i2c::Device::WriteRegister(const std::uint8_t reg, const std::uint8_t data,
@@ -239,10 +319,22 @@ int i2c::Device::WriteRegister(const std::uint8_t reg, const std::uint8_t* data,
 }
 
 int i2c::Device::Read(std::uint8_t* data, const std::size_t size, Error* ec) {
+  if (bus_->scheduler()) {
+    Message msg { addr_, true, data, size };
+    return Transfer(&msg, 1, ec);
+  }
   return bus_->Read(addr_, data, size, ec);
 }
 
 int i2c::Device::ReadRegister(const std::uint8_t reg, std::uint8_t *data,
                               const std::size_t size, Error* ec) {
+  if (bus_->scheduler()) {
+    std::uint8_t temp = reg;
+    Message msgs[] {
+      { addr_, false, &temp, 1 },
+      { addr_, true, data, size }
+    };
+    return Transfer(msgs, 2, ec);
+  }
   return bus_->ReadRegister(addr_, reg, data, size, ec);
 }
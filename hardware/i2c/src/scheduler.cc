@@ -0,0 +1,180 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "i2c/scheduler.h"
+
+#include <linux/i2c-dev.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <future>  // NOLINT
+#include <utility>
+
+namespace {
+
+using LockGuard = std::lock_guard<std::mutex>;
+
+// The most messages the kernel takes in one I2C_RDWR ioctl
+constexpr std::size_t kMaxMessages = I2C_RDWR_IOCTL_MAX_MSGS;
+
+}  // end namespace
+
+constexpr std::size_t i2c::Scheduler::kMaxTransactionMessages;
+
+i2c::Scheduler::Scheduler(Bus* bus)
+  : bus_(bus) {
+  thread_ = std::thread(&Scheduler::Worker, this);
+}
+
+i2c::Scheduler::~Scheduler() {
+  {
+    LockGuard lock(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+  for (Transaction& t : queue_)
+    t.callback(-1, ECANCELED);
+}
+
+bool i2c::Scheduler::After(Transaction const& a, Transaction const& b) {
+  if (a.priority != b.priority)
+    return a.priority > b.priority;
+  if (a.deadline != b.deadline)
+    return a.deadline > b.deadline;
+  return a.seq > b.seq;
+}
+
+void i2c::Scheduler::Submit(const Message* msgs, const std::size_t num_msgs,
+                            const int priority,
+                            const Clock::time_point deadline,
+                            const bool merge, Callback callback) {
+  if (num_msgs == 0 || num_msgs > kMaxTransactionMessages) {
+    callback(-1, EINVAL);
+    return;
+  }
+  Transaction t;
+  for (std::size_t i = 0; i < num_msgs; i++) {
+    if (msgs[i].addr != msgs[0].addr) {
+      callback(-1, EINVAL);
+      return;
+    }
+    t.msgs[i] = msgs[i];
+  }
+  t.num_msgs = num_msgs;
+  t.priority = priority;
+  t.deadline = deadline;
+  t.merge = merge;
+  t.callback = std::move(callback);
+  {
+    LockGuard lock(mtx_);
+    t.seq = seq_++;
+    queue_.push_back(std::move(t));
+    std::push_heap(queue_.begin(), queue_.end(), After);
+  }
+  cv_.notify_one();
+}
+
+int i2c::Scheduler::Transfer(const Message* msgs, const std::size_t num_msgs,
+                             const int priority,
+                             const Clock::time_point deadline,
+                             const bool merge, Error* ec) {
+  std::promise<int> done;
+  Error err = 0;
+  Submit(msgs, num_msgs, priority, deadline, merge,
+         [&done, &err](int ret, Error e) {
+    err = e;
+    done.set_value(ret);
+  });
+  int ret = done.get_future().get();
+  if (ret < 0)
+    *ec = err;
+  return ret;
+}
+
+void i2c::Scheduler::Worker() {
+  std::vector<Transaction> batch, late;
+  while (true) {
+    batch.clear();
+    late.clear();
+    {
+      std::unique_lock<std::mutex> lock(mtx_);
+      cv_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+      if (stop_)
+        return;
+      Take(&batch, &late);
+    }
+    for (Transaction& t : late)
+      t.callback(-1, ETIMEDOUT);
+    if (!batch.empty())
+      Run(&batch);
+  }
+}
+
+void i2c::Scheduler::Take(std::vector<Transaction>* batch,
+                          std::vector<Transaction>* late) {
+  Clock::time_point now = Clock::now();
+  std::size_t num_msgs = 0;
+  while (!queue_.empty()) {
+    Transaction const& next = queue_.front();
+    bool expired = next.deadline < now;
+    if (!expired && !batch->empty()) {
+      if (!batch->front().merge || !next.merge ||
+          num_msgs + next.num_msgs > kMaxMessages)
+        break;
+      Address addr = next.msgs[0].addr;
+      if (std::any_of(batch->begin(), batch->end(),
+                      [addr](Transaction const& t) {
+                        return t.msgs[0].addr == addr;
+                      }))
+        break;
+    }
+    std::pop_heap(queue_.begin(), queue_.end(), After);
+    if (expired) {
+      late->push_back(std::move(queue_.back()));
+    } else {
+      num_msgs += queue_.back().num_msgs;
+      batch->push_back(std::move(queue_.back()));
+    }
+    queue_.pop_back();
+  }
+}
+
+void i2c::Scheduler::Run(std::vector<Transaction>* batch) {
+  Message msgs[kMaxMessages];
+  std::size_t num_msgs = 0;
+  for (Transaction const& t : *batch)
+    for (std::size_t i = 0; i < t.num_msgs; i++)
+      msgs[num_msgs++] = t.msgs[i];
+
+  Error ec = 0;
+  int ret = bus_->Transfer(msgs, num_msgs, &ec);
+  for (Transaction& t : *batch) {
+    // If a merged transfer fails, which device failed it is not known, so
+    // each transaction is done again on its own
+    if (ret < 0 && batch->size() > 1) {
+      Error err = 0;
+      int single = bus_->Transfer(t.msgs, t.num_msgs, &err);
+      t.callback(single < 0 ? -1 : static_cast<int>(t.msgs[t.num_msgs - 1].size),
+                 err);
+    } else {
+      t.callback(ret < 0 ? -1 : static_cast<int>(t.msgs[t.num_msgs - 1].size),
+                 ec);
+    }
+  }
+}
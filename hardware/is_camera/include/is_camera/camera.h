@@ -25,10 +25,14 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <ff_msgs/SetBool.h>
 #include <ff_util/ff_nodelet.h>
+#include <ff_util/capture_clock.h>
+#include <is_camera/frame_ring.h>
 
 #include <thread>
 #include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace is_camera {
 
@@ -46,18 +50,16 @@ struct V4LStruct;
 // Nodelet class
 class CameraNodelet : public ff_util::FreeFlyerNodelet {
  public:
-  static constexpr size_t kImageMsgBuffer = 15;  // 17.6 Mb of buffer space. This
-                                                 // number is so large because
-                                                 // this sets the life time for
-                                                 // each image message sent
-                                                 // out. Eventually we'll write
-                                                 // over the pointer we've
-                                                 // handed out. 15 frames means
-                                                 // .. an image will stay valid
-                                                 // for 1.0 seconds.
-                                                 // Localization can process at
-                                                 // 2 Hz, so it only needs an
-                                                 // image for 0.5 seconds.
+  static constexpr size_t kImageMsgBuffer = 15;  // 17.6 Mb of buffer space,
+                                                 // allocated up front. An
+                                                 // image message is only
+                                                 // reused once no subscriber
+                                                 // holds it any more, so the
+                                                 // pool grows, up to
+                                                 // kMaxImageMsgBuffer, if
+                                                 // subscribers keep images
+                                                 // longer than 15 frames.
+  static constexpr size_t kMaxImageMsgBuffer = 4 * kImageMsgBuffer;
   static constexpr size_t kImageWidth = 1280;
   static constexpr size_t kImageHeight = 960;
 
@@ -70,13 +72,18 @@ class CameraNodelet : public ff_util::FreeFlyerNodelet {
 
  private:
   void PublishLoop();
+  bool HasConsumers();
+  void PublishVariants(cv::Mat const& image, ros::Time const& timestamp);
+  sensor_msgs::ImagePtr NextImageMsg();
+  sensor_msgs::ImagePtr AddImageMsg();
   bool EnableService(ff_msgs::SetBool::Request& req, ff_msgs::SetBool::Response& res);  // NOLINT
 
-  sensor_msgs::ImagePtr img_msg_buffer_[kImageMsgBuffer];
+  std::vector<sensor_msgs::ImagePtr> img_msg_buffer_;
   size_t img_msg_buffer_idx_;
   std::thread thread_;
   std::atomic<bool> thread_running_;
   ros::Publisher pub_;
+  ros::Publisher pub_scaled_, pub_roi_;
   std::shared_ptr<V4LStruct> v4l_;
 
   config_reader::ConfigReader config_;
@@ -87,6 +94,13 @@ class CameraNodelet : public ff_util::FreeFlyerNodelet {
   std::string config_name_;
   int camera_gain_, camera_exposure_;
   bool calibration_mode_;
+  bool capture_timestamps_;
+  std::shared_ptr<ff_util::CaptureSyncGroup> sync_group_;
+  int frame_ring_slots_;
+  int scaled_factor_;
+  cv::Rect roi_;
+  cv::Mat frame_;   // the frame, when it goes to neither a msg nor the ring
+  FrameRing frame_ring_;
 };
 
 }  // end namespace is_camera
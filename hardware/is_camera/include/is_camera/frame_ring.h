@@ -0,0 +1,85 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef IS_CAMERA_FRAME_RING_H_
+#define IS_CAMERA_FRAME_RING_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace is_camera {
+
+// A ring of frames in POSIX shared memory, written by one camera and read by
+// any number of processes with no locks or copies. Each slot has a sequence
+// lock, odd while the writer fills it and twice the sequence number of its
+// frame once it is done. A reader checks it before and after using a frame,
+// to know the frame was not overwritten in the meantime.
+class FrameRing {
+ public:
+  struct Frame {
+    uint64_t seq;
+    uint32_t width, height, step;
+    uint32_t stamp_sec, stamp_nsec;
+    uint8_t const* data;
+  };
+
+  FrameRing(void);
+  ~FrameRing(void);
+
+  // Create the ring, as its only writer, with slots of up to max_bytes each
+  bool Create(std::string const& name, uint32_t num_slots, uint32_t max_bytes);
+  // Open a ring that was created by a writer, to read it
+  bool Open(std::string const& name);
+  void Close(void);
+  bool IsOpen(void) const {return base_ != NULL;}
+
+  // The writer fills the data of the next slot between these calls
+  uint8_t* BeginWrite(uint32_t width, uint32_t height, uint32_t step);
+  void EndWrite(uint32_t stamp_sec, uint32_t stamp_nsec);
+
+  // The sequence number of the last frame written, zero if there is none
+  uint64_t Head(void) const;
+  uint32_t NumSlots(void) const;
+
+  // Points frame at the frame with this sequence number in the ring, false if
+  // it is not written yet or was overwritten. Then Valid says whether the
+  // frame is still there, once it has been used.
+  bool Get(uint64_t seq, Frame* frame) const;
+  bool Valid(Frame const& frame) const;
+  // Copies a frame out, for readers that keep it, false if it was overwritten
+  bool Copy(uint64_t seq, Frame* frame, std::vector<uint8_t>* data) const;
+
+ private:
+  struct RingHeader;
+  struct SlotHeader;
+
+  SlotHeader* Slot(uint64_t seq) const;
+
+  std::string name_;
+  bool writer_;
+  uint8_t* base_;
+  size_t size_;
+  RingHeader* header_;
+  uint64_t writing_;    // the sequence number of the frame being written
+};
+
+}  // end namespace is_camera
+
+#endif  // IS_CAMERA_FRAME_RING_H_
@@ -162,7 +162,8 @@ namespace is_camera {
   };
 
   CameraNodelet::CameraNodelet() : ff_util::FreeFlyerNodelet(),
-    img_msg_buffer_idx_(0), thread_running_(false), camera_topic_(""), calibration_mode_(false)
+    img_msg_buffer_idx_(0), thread_running_(false), camera_topic_(""), calibration_mode_(false),
+    capture_timestamps_(false), frame_ring_slots_(0), scaled_factor_(0)
     {}
 
   CameraNodelet::~CameraNodelet() {
@@ -196,15 +197,23 @@ namespace is_camera {
       config_.CheckFilesUpdated(std::bind(&CameraNodelet::ReadParams, this));}, false, true);
 
     pub_ = nh->advertise<sensor_msgs::Image>(camera_topic_, 1);
+    if (scaled_factor_ > 1)
+      pub_scaled_ = nh->advertise<sensor_msgs::Image>(camera_topic_ + TOPIC_HARDWARE_CAM_SUFFIX_SCALED, 1);
+    if (roi_.area() > 0)
+      pub_roi_ = nh->advertise<sensor_msgs::Image>(camera_topic_ + TOPIC_HARDWARE_CAM_SUFFIX_ROI, 1);
 
     // Allocate space for our output msg buffer
-    for (size_t i = 0; i < kImageMsgBuffer; i++) {
-      img_msg_buffer_[i].reset(new sensor_msgs::Image());
-      img_msg_buffer_[i]->width  = kImageWidth;
-      img_msg_buffer_[i]->height = kImageHeight;
-      img_msg_buffer_[i]->encoding = "mono8";
-      img_msg_buffer_[i]->step   = kImageWidth;
-      img_msg_buffer_[i]->data.resize(kImageWidth * kImageHeight);
+    img_msg_buffer_.clear();
+    while (img_msg_buffer_.size() < kImageMsgBuffer)
+      AddImageMsg();
+
+    // Frames are also written to shared memory, for readers outside of ROS
+    if (frame_ring_slots_ > 0) {
+      std::string ring_name = "/frame_ring_" + config_name_;
+      if (!GetPlatform().empty())
+        ring_name += "_" + GetPlatform();
+      if (!frame_ring_.Create(ring_name, frame_ring_slots_, kImageWidth * kImageHeight))
+        ROS_ERROR_STREAM("Could not create the frame ring " << ring_name);
     }
 
     v4l_.reset(new V4LStruct(camera_device_, camera_gain_, camera_exposure_));
@@ -251,11 +260,105 @@ namespace is_camera {
       }
     }
 
+    if (!config_.GetBool("capture_timestamps", &capture_timestamps_)) {
+      FF_FATAL("Capture timestamps not specified.");
+      exit(EXIT_FAILURE);
+    }
+
+    // the sync group is shared with the other camera threads, so it is only
+    // chosen before ours starts
+    if (!thread_running_) {
+      double sync_tolerance;
+      if (!config_.GetReal("capture_sync_tolerance", &sync_tolerance)) {
+        FF_FATAL("Capture sync tolerance not specified.");
+        exit(EXIT_FAILURE);
+      }
+      if (sync_tolerance > 0)
+        sync_group_ = ff_util::CaptureSyncGroup::Get("cameras", sync_tolerance);
+      if (!config_.GetInt("frame_ring_slots", &frame_ring_slots_)) {
+        FF_FATAL("Frame ring slots not specified.");
+        exit(EXIT_FAILURE);
+      }
+
+      // the binned and cropped images published besides the full frame
+      if (!camera.GetInt("scaled_factor", &scaled_factor_)) {
+        FF_FATAL("Scaled factor not specified.");
+        exit(EXIT_FAILURE);
+      }
+      if (!camera.GetInt("roi_x", &roi_.x) || !camera.GetInt("roi_y", &roi_.y) ||
+          !camera.GetInt("roi_width", &roi_.width) || !camera.GetInt("roi_height", &roi_.height)) {
+        FF_FATAL("Region of interest not specified.");
+        exit(EXIT_FAILURE);
+      }
+      roi_ &= cv::Rect(0, 0, kImageWidth, kImageHeight);
+    }
+
     if (thread_running_) {
       v4l_->SetParameters(camera_gain_, camera_exposure_);
     }
   }
 
+  // Returns the next image message no subscriber holds, allocating one if
+  // they are all held, or nothing if the buffer is full
+  sensor_msgs::ImagePtr CameraNodelet::NextImageMsg() {
+    for (size_t i = 0; i < img_msg_buffer_.size(); i++) {
+      img_msg_buffer_idx_ = (img_msg_buffer_idx_ + 1) % img_msg_buffer_.size();
+      if (img_msg_buffer_[img_msg_buffer_idx_].unique())
+        return img_msg_buffer_[img_msg_buffer_idx_];
+    }
+    if (img_msg_buffer_.size() >= kMaxImageMsgBuffer)
+      return sensor_msgs::ImagePtr();
+    return AddImageMsg();
+  }
+
+  sensor_msgs::ImagePtr CameraNodelet::AddImageMsg() {
+    sensor_msgs::ImagePtr msg(new sensor_msgs::Image());
+    msg->width  = kImageWidth;
+    msg->height = kImageHeight;
+    msg->encoding = "mono8";
+    msg->step   = kImageWidth;
+    msg->data.resize(kImageWidth * kImageHeight);
+    img_msg_buffer_.push_back(msg);
+    img_msg_buffer_idx_ = img_msg_buffer_.size() - 1;
+    return msg;
+  }
+
+  // Frames are captured while someone subscribes or there is a frame ring
+  bool CameraNodelet::HasConsumers() {
+    return pub_.getNumSubscribers() != 0 || pub_scaled_.getNumSubscribers() != 0 ||
+           pub_roi_.getNumSubscribers() != 0 || frame_ring_.IsOpen();
+  }
+
+  // Publishes the binned and cropped images, for subscribers that would only
+  // reduce the full frame themselves
+  void CameraNodelet::PublishVariants(cv::Mat const& image, ros::Time const& timestamp) {
+    if (pub_scaled_.getNumSubscribers() != 0) {
+      sensor_msgs::ImagePtr msg(new sensor_msgs::Image());
+      msg->header.stamp = timestamp;
+      msg->width  = kImageWidth / scaled_factor_;
+      msg->height = kImageHeight / scaled_factor_;
+      msg->encoding = "mono8";
+      msg->step   = msg->width;
+      msg->data.resize(msg->step * msg->height);
+      cv::Mat scaled(msg->height, msg->width, cv::DataType<uint8_t>::type, &(msg->data[0]), msg->step);
+      // area interpolation by an integer factor averages each block of pixels
+      cv::resize(image, scaled, scaled.size(), 0, 0, cv::INTER_AREA);
+      pub_scaled_.publish(msg);
+    }
+    if (pub_roi_.getNumSubscribers() != 0) {
+      sensor_msgs::ImagePtr msg(new sensor_msgs::Image());
+      msg->header.stamp = timestamp;
+      msg->width  = roi_.width;
+      msg->height = roi_.height;
+      msg->encoding = "mono8";
+      msg->step   = msg->width;
+      msg->data.resize(msg->step * msg->height);
+      cv::Mat roi(msg->height, msg->width, cv::DataType<uint8_t>::type, &(msg->data[0]), msg->step);
+      image(roi_).copyTo(roi);
+      pub_roi_.publish(msg);
+    }
+  }
+
   void CameraNodelet::PublishLoop() {
     bool camera_running = true;
     int cur_buf = 0;
@@ -263,7 +366,7 @@ namespace is_camera {
     while (thread_running_) {
       cur_buf = (cur_buf + 1) % v4l_->req.count;
       if (!camera_running) {
-        while ((pub_.getNumSubscribers() == 0) && thread_running_)
+        while (!HasConsumers() && thread_running_)
           usleep(100000);
         if (!thread_running_)
           break;
@@ -295,33 +398,71 @@ namespace is_camera {
       v4l_->buf.memory = V4L2_MEMORY_MMAP;
       v4l_->buf.index = cur_buf;
       xioctl(v4l_->fd, VIDIOC_DQBUF, &v4l_->buf);
-      if (pub_.getNumSubscribers() != 0)
+      ros::Time timestamp;
+      if (capture_timestamps_ && (v4l_->buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK)
+          == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+        timestamp = ff_util::CaptureClock::FromMonotonic(v4l_->buf.timestamp);
+      else
+        timestamp = ros::Time::now();
+      if (sync_group_)
+        timestamp = sync_group_->Stamp(timestamp);
+
+      // Select our output msg buffer. The frame is demosaiced from the
+      // V4L buffer straight into it, and it is published by pointer, so
+      // subscribers in the same process get it with no copy. With a frame
+      // ring, the frame goes to the ring first and is copied to the msg.
+      uint8_t* ring_data = NULL;
+      if (frame_ring_.IsOpen())
+        ring_data = frame_ring_.BeginWrite(kImageWidth, kImageHeight, kImageWidth);
+      sensor_msgs::ImagePtr msg;
+      if (pub_.getNumSubscribers() != 0) {
+        msg = NextImageMsg();
+        if (!msg)
+          ROS_WARN_THROTTLE(5, "All image messages are held by subscribers, dropping frames.");
+      }
+      uint8_t* out = (ring_data ? ring_data : (msg ? &(msg->data[0]) : NULL));
+      if (!out && (pub_scaled_.getNumSubscribers() != 0 || pub_roi_.getNumSubscribers() != 0)) {
+        frame_.create(kImageHeight, kImageWidth, cv::DataType<uint8_t>::type);
+        out = frame_.data;
+      }
+      if (out) {
+        // Wrap the buffer with cv::Mat so we can manipulate it.
+        cv::Mat wrapped(v4l_->fmt.fmt.pix.height,
+            v4l_->fmt.fmt.pix.width,
+            cv::DataType<uint8_t>::type,
+            v4l_->buffers[v4l_->buf.index].start,
+            v4l_->fmt.fmt.pix.width);  // does not copy
+        cv::Mat owrapped(kImageHeight, kImageWidth,
+            cv::DataType<uint8_t>::type,
+            out,
+            kImageWidth);
+        cv::cvtColor(wrapped, owrapped,
+            CV_BayerGR2GRAY);
+      }
+      if (ring_data) {
+        frame_ring_.EndWrite(timestamp.sec, timestamp.nsec);
+        if (msg)
+          memcpy(&(msg->data[0]), ring_data, kImageWidth * kImageHeight);
+      }
+      if (out)
+        PublishVariants(cv::Mat(kImageHeight, kImageWidth, cv::DataType<uint8_t>::type, out, kImageWidth),
+                        timestamp);
+
+      // Only give the buffer back to the driver once it has been read
+      if (HasConsumers())
         xioctl(v4l_->fd, VIDIOC_QBUF, &v4l_->buf);
       else
         camera_running = false;
-      ros::Time timestamp = ros::Time::now();
-
-      // Select our output msg buffer
-      img_msg_buffer_idx_ = (img_msg_buffer_idx_ + 1) % kImageMsgBuffer;
-
-      // Wrap the buffer with cv::Mat so we can manipulate it.
-      cv::Mat wrapped(v4l_->fmt.fmt.pix.height,
-          v4l_->fmt.fmt.pix.width,
-          cv::DataType<uint8_t>::type,
-          v4l_->buffers[v4l_->buf.index].start,
-          v4l_->fmt.fmt.pix.width);  // does not copy
-      cv::Mat owrapped(kImageHeight, kImageWidth,
-          cv::DataType<uint8_t>::type,
-          &(img_msg_buffer_[img_msg_buffer_idx_]->data[0]),
-          kImageWidth);
-      cv::cvtColor(wrapped, owrapped,
-          CV_BayerGR2GRAY);
+      if (!msg) {
+        ros::spinOnce();
+        continue;
+      }
 
       // Attach the time
-      img_msg_buffer_[img_msg_buffer_idx_]->header = std_msgs::Header();
-      img_msg_buffer_[img_msg_buffer_idx_]->header.stamp = timestamp;
+      msg->header = std_msgs::Header();
+      msg->header.stamp = timestamp;
 
-      pub_.publish(img_msg_buffer_[img_msg_buffer_idx_]);
+      pub_.publish(msg);
 
       ros::spinOnce();
     }
@@ -0,0 +1,215 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <is_camera/frame_ring.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace is_camera {
+
+namespace {
+
+constexpr uint32_t kRingMagic = 0x46524e47;  // FRNG
+constexpr size_t kAlign = 64;                // a cache line
+
+size_t Align(size_t bytes) {
+  return (bytes + kAlign - 1) / kAlign * kAlign;
+}
+
+}  // namespace
+
+// The start of the shared memory, followed by the slots
+struct FrameRing::RingHeader {
+  std::atomic<uint32_t> magic;            // set last, once the ring is ready
+  uint32_t num_slots;
+  uint32_t slot_bytes;                    // the largest frame a slot holds
+  std::atomic<uint64_t> head;
+};
+
+// The start of each slot, followed by its data
+struct FrameRing::SlotHeader {
+  std::atomic<uint64_t> lock;
+  uint32_t width, height, step;
+  uint32_t stamp_sec, stamp_nsec;
+};
+
+FrameRing::FrameRing(void) : writer_(false), base_(NULL), size_(0), header_(NULL), writing_(0) {}
+
+FrameRing::~FrameRing(void) {
+  Close();
+}
+
+bool FrameRing::Create(std::string const& name, uint32_t num_slots, uint32_t max_bytes) {
+  Close();
+  if (num_slots == 0 || max_bytes == 0)
+    return false;
+  // a ring left behind by a writer that died is replaced
+  shm_unlink(name.c_str());
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0)
+    return false;
+  size_t size = Align(sizeof(RingHeader))
+              + num_slots * (Align(sizeof(SlotHeader)) + Align(max_bytes));
+  void* base = MAP_FAILED;
+  if (ftruncate(fd, size) == 0)
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return false;
+  }
+  name_ = name;
+  writer_ = true;
+  base_ = static_cast<uint8_t*>(base);
+  size_ = size;
+  header_ = new (base_) RingHeader;
+  header_->num_slots = num_slots;
+  header_->slot_bytes = Align(max_bytes);
+  header_->head.store(0, std::memory_order_relaxed);
+  for (uint32_t i = 0; i < num_slots; i++)
+    new (Slot(i)) SlotHeader;
+  for (uint32_t i = 0; i < num_slots; i++)
+    Slot(i)->lock.store(0, std::memory_order_relaxed);
+  header_->magic.store(kRingMagic, std::memory_order_release);
+  writing_ = 0;
+  return true;
+}
+
+bool FrameRing::Open(std::string const& name) {
+  Close();
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  void* base = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(RingHeader))
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return false;
+  name_ = name;
+  writer_ = false;
+  base_ = static_cast<uint8_t*>(base);
+  size_ = st.st_size;
+  header_ = reinterpret_cast<RingHeader*>(base_);
+  // the writer may still be setting the ring up, or it may be of another size
+  if (header_->magic.load(std::memory_order_acquire) != kRingMagic || header_->num_slots == 0 ||
+      Align(sizeof(RingHeader)) + header_->num_slots * (Align(sizeof(SlotHeader)) + header_->slot_bytes) > size_) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void FrameRing::Close(void) {
+  if (base_ == NULL)
+    return;
+  munmap(base_, size_);
+  if (writer_)
+    shm_unlink(name_.c_str());
+  base_ = NULL;
+  header_ = NULL;
+  size_ = 0;
+  writer_ = false;
+}
+
+FrameRing::SlotHeader* FrameRing::Slot(uint64_t seq) const {
+  size_t slot = seq % header_->num_slots;
+  return reinterpret_cast<SlotHeader*>(base_ + Align(sizeof(RingHeader))
+                                       + slot * (Align(sizeof(SlotHeader)) + header_->slot_bytes));
+}
+
+uint8_t* FrameRing::BeginWrite(uint32_t width, uint32_t height, uint32_t step) {
+  if (!writer_ || static_cast<size_t>(height) * step > header_->slot_bytes)
+    return NULL;
+  writing_ = header_->head.load(std::memory_order_relaxed) + 1;
+  SlotHeader* slot = Slot(writing_);
+  slot->lock.store(2 * writing_ + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->width = width;
+  slot->height = height;
+  slot->step = step;
+  return reinterpret_cast<uint8_t*>(slot) + Align(sizeof(SlotHeader));
+}
+
+void FrameRing::EndWrite(uint32_t stamp_sec, uint32_t stamp_nsec) {
+  if (!writer_ || writing_ == 0)
+    return;
+  SlotHeader* slot = Slot(writing_);
+  slot->stamp_sec = stamp_sec;
+  slot->stamp_nsec = stamp_nsec;
+  slot->lock.store(2 * writing_, std::memory_order_release);
+  header_->head.store(writing_, std::memory_order_release);
+  writing_ = 0;
+}
+
+uint64_t FrameRing::Head(void) const {
+  if (header_ == NULL)
+    return 0;
+  return header_->head.load(std::memory_order_acquire);
+}
+
+uint32_t FrameRing::NumSlots(void) const {
+  if (header_ == NULL)
+    return 0;
+  return header_->num_slots;
+}
+
+bool FrameRing::Get(uint64_t seq, Frame* frame) const {
+  if (header_ == NULL || seq == 0)
+    return false;
+  SlotHeader const* slot = Slot(seq);
+  if (slot->lock.load(std::memory_order_acquire) != 2 * seq)
+    return false;
+  frame->seq = seq;
+  frame->width = slot->width;
+  frame->height = slot->height;
+  frame->step = slot->step;
+  frame->stamp_sec = slot->stamp_sec;
+  frame->stamp_nsec = slot->stamp_nsec;
+  frame->data = reinterpret_cast<uint8_t const*>(slot) + Align(sizeof(SlotHeader));
+  // a frame whose header is torn is never handed out
+  return Valid(*frame) && static_cast<size_t>(frame->height) * frame->step <= header_->slot_bytes;
+}
+
+bool FrameRing::Valid(Frame const& frame) const {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return Slot(frame.seq)->lock.load(std::memory_order_relaxed) == 2 * frame.seq;
+}
+
+bool FrameRing::Copy(uint64_t seq, Frame* frame, std::vector<uint8_t>* data) const {
+  if (!Get(seq, frame))
+    return false;
+  data->resize(static_cast<size_t>(frame->height) * frame->step);
+  memcpy(data->data(), frame->data, data->size());
+  if (!Valid(*frame))
+    return false;
+  frame->data = data->data();
+  return true;
+}
+
+}  // end namespace is_camera
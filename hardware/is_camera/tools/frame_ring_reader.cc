@@ -0,0 +1,71 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Reads the frames a camera writes to its frame ring, and prints how many
+// arrive, how many are lost and how old they are when read
+
+#include <is_camera/frame_ring.h>
+
+#include <time.h>
+#include <unistd.h>
+
+// C / C++ includes
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+int main(int argc, const char* argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " /frame_ring_nav_cam [seconds]" << std::endl;
+    return 1;
+  }
+  double seconds = (argc > 2 ? atof(argv[2]) : 10.0);
+  is_camera::FrameRing ring;
+  if (!ring.Open(argv[1])) {
+    std::cerr << "Could not open the frame ring " << argv[1] << std::endl;
+    return 1;
+  }
+  struct timespec start, now;
+  clock_gettime(CLOCK_REALTIME, &start);
+  uint64_t last = ring.Head();
+  int read = 0, lost = 0;
+  double age = 0;
+  do {
+    usleep(1000);
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t head = ring.Head();
+    if (head == last)
+      continue;
+    is_camera::FrameRing::Frame frame;
+    if (last != 0)
+      lost += head - last - 1;
+    last = head;
+    if (!ring.Get(head, &frame)) {
+      lost++;
+      continue;
+    }
+    age += (now.tv_sec - static_cast<double>(frame.stamp_sec))
+         + (now.tv_nsec - static_cast<double>(frame.stamp_nsec)) * 1e-9;
+    read++;
+  } while ((now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9 < seconds);
+  std::cout << read << " frames read, " << lost << " lost";
+  if (read > 0)
+    std::cout << ", " << 1000 * age / read << " ms old on average";
+  std::cout << std::endl;
+  return 0;
+}
@@ -24,8 +24,6 @@
 #include <functional>
 #include <string>
 
-#define MAX_PACKET_SIZE 64
-
 /**
  * \ingroup hw
  */
@@ -201,16 +199,8 @@ class PerchingArm {
   static constexpr int16_t VALUE_POWER_DISABLE        = 0;
   static constexpr int16_t VALUE_POWER_ENABLE         = 1;
 
-  // Finite states of protocol
-  enum Protocol {
-    PROTOCOL_WF_HEADER_1,   // See constant above
-    PROTOCOL_WF_HEADER_2,   // See constant above
-    PROTOCOL_WF_LENGTH,     // N
-    PROTOCOL_WF_DATA,       // DATA
-    PROTOCOL_WF_CHECKSUM    // CRC
-  };
-
-  // Asynchronous callback with serial data
+  // Asynchronous callback with a complete packet, which is two header
+  // bytes, the length N, N - 1 bytes of data and the checksum
   void Read(const uint8_t *buffer, size_t len);
 
   // Asynchronous callback with serial data
@@ -222,21 +212,17 @@ class PerchingArm {
   // Process a valid packet
   void Process(const uint8_t* buf, size_t len);
 
-  // Process a packet
-  void FiniteStateMachine(uint8_t const& c);
-
   // Implementation-specific checksumming
   uint8_t Checksum(const uint8_t* buf, size_t len);
 
+  // Whether a packet has the right checksum
+  bool Valid(const uint8_t* buf, size_t len);
+
  private:
   serial::Serial serial_;                     // Serial port
   PerchingArmRawDataCallback cb_raw_data_;    // Feedback callback
   PerchingArmSleepMsCallback cb_sleep_ms_;    // Sleep callback
   PerchingArmRaw raw_;                        // Feedback data structure
-  Protocol rx_state_;                         // Receive state
-  uint8_t rx_buf_[MAX_PACKET_SIZE];           // Buffer
-  uint8_t rx_ptr_;                            // Buffer pointer
-  uint8_t rx_datalen_;                        // Data length
 };
 
 }  // namespace perching_arm
@@ -23,9 +23,12 @@ namespace perching_arm {
 
 // By default the arm is uninitialized
 PerchingArm::PerchingArm() :
-  serial_(std::bind(&PerchingArm::Read, this, std::placeholders::_1,
-    std::placeholders::_2)), cb_raw_data_({}), cb_sleep_ms_({}),
-    rx_state_(PROTOCOL_WF_HEADER_1), rx_ptr_(0), rx_datalen_(0) {
+  serial_(std::unique_ptr<serial::FrameFormat>(new serial::LengthFrameFormat(
+    {PROTOCOL_HEADER_1, PROTOCOL_HEADER_2}, 2, 3,
+    std::bind(&PerchingArm::Valid, this, std::placeholders::_1,
+      std::placeholders::_2))),
+    std::bind(&PerchingArm::Read, this, std::placeholders::_1,
+      std::placeholders::_2)), cb_raw_data_({}), cb_sleep_ms_({}) {
   serial_.SetTimeoutCallback(std::bind(&PerchingArm::Timeout, this), 5000);
   serial_.SetShutdownCallback(std::bind(&PerchingArm::Shutdown, this));
 }
@@ -231,10 +234,9 @@ void PerchingArm::Process(const uint8_t* buf, size_t len) {
     cb_raw_data_(raw_);
 }
 
-// Callback with serial data
+// Callback with a complete packet, passed on without its header and checksum
 void PerchingArm::Read(const uint8_t* buf, size_t len) {
-  for (size_t i = 0; i < len; i++)
-    FiniteStateMachine(buf[i]);
+  Process(&buf[3], len - 4);
 }
 
 // Called when we time out
@@ -247,52 +249,6 @@ void PerchingArm::Shutdown(void) {
   std::cout << "Shutdown" << std::endl;
 }
 
-// Process a single character as part of the protocol state machine
-void PerchingArm::FiniteStateMachine(uint8_t const& c) {
-  // If we are waiting for header 1, then the packet pointer is reset
-  if (rx_state_ == PROTOCOL_WF_HEADER_1)
-    rx_ptr_ = 0;
-  // Copy the data
-  if (rx_ptr_ < MAX_PACKET_SIZE)
-    rx_buf_[rx_ptr_++] = c;
-  // Advance the state machine
-  switch (rx_state_) {
-  // Wait for header 1
-  case PROTOCOL_WF_HEADER_1:
-    if (c != PROTOCOL_HEADER_1) {
-      rx_state_ = PROTOCOL_WF_HEADER_1;
-      return;
-    }
-    rx_state_ = PROTOCOL_WF_HEADER_2;
-    return;
-  // Wait for header 2
-  case PROTOCOL_WF_HEADER_2:
-    if (c != PROTOCOL_HEADER_2) {
-      rx_state_ = PROTOCOL_WF_HEADER_1;
-      return;
-    }
-    rx_state_ = PROTOCOL_WF_LENGTH;
-    return;
-  // Wait for packet length
-  case PROTOCOL_WF_LENGTH:
-    rx_datalen_ = c - 1;
-    rx_state_ = PROTOCOL_WF_DATA;
-    return;
-  // Wait until all data rx
-  case PROTOCOL_WF_DATA:
-    if (--rx_datalen_)
-      return;
-    rx_state_ = PROTOCOL_WF_CHECKSUM;
-    return;
-  // Wait for checksum
-  case PROTOCOL_WF_CHECKSUM:
-    if (Checksum(rx_buf_, rx_ptr_) == rx_buf_[rx_ptr_ - 1])
-      Process(&rx_buf_[3], rx_ptr_ - 4);
-    rx_state_ = PROTOCOL_WF_HEADER_1;
-    return;
-  }
-}
-
 // Checksum calculation
 uint8_t PerchingArm::Checksum(const uint8_t* buf, size_t len) {
   uint8_t sum = 0;
@@ -301,4 +257,9 @@ uint8_t PerchingArm::Checksum(const uint8_t* buf, size_t len) {
   return ~sum;
 }
 
+// Check a packet against its last byte
+bool PerchingArm::Valid(const uint8_t* buf, size_t len) {
+  return Checksum(buf, len) == buf[len - 1];
+}
+
 }  // namespace perching_arm
@@ -25,6 +25,7 @@
 #include <ff_util/ff_names.h>
 #include <ff_util/ff_nodelet.h>
 #include <config_reader/config_reader.h>
+#include <ff_util/capture_clock.h>
 
 // Royale SDK interface
 #include <royale/CameraManager.hpp>
@@ -37,21 +38,65 @@
 #include <sensor_msgs/PointCloud2.h>
 #include <ff_msgs/PicoflexxIntermediateData.h>
 
+// Boost includes
+#include <boost/make_shared.hpp>
+
 // C / C++ includes
+#include <chrono>
 #include <cstddef>
+#include <memory>
 #include <string>
+#include <vector>
 
 /**
  * \ingroup hardware
  */
 namespace pico_driver {
 
+// A pool of messages that are published by pointer, so that nodelets in the same
+// manager receive them with no copy or serialization. A message is reused only once
+// no subscriber still holds it, and the pool grows from the prototype up to a limit.
+template < typename MessageType >
+class MessagePool {
+ public:
+  static constexpr size_t kMaxSize = 8;
+
+  // Set the message all the others are copied from
+  void Init(MessageType const& prototype) {
+    prototype_ = prototype;
+    pool_.clear();
+  }
+
+  // Get a message that no one else holds, or nothing if there is none
+  boost::shared_ptr < MessageType > Get() {
+    for (size_t i = 0; i < pool_.size(); i++)
+      if (pool_[i].unique())
+        return pool_[i];
+    if (pool_.size() >= kMaxSize)
+      return boost::shared_ptr < MessageType > ();
+    pool_.push_back(boost::make_shared < MessageType > (prototype_));
+    return pool_.back();
+  }
+
+ private:
+  MessageType prototype_;
+  std::vector < boost::shared_ptr < MessageType > > pool_;
+};
+
+// How the frames of a camera are timestamped
+struct PicoStamping {
+  PicoStamping() : capture(false) {}
+  bool capture;                                            // Stamp with the capture time
+  std::shared_ptr < ff_util::CaptureSyncGroup > sync_group;  // Share stamps with this group
+};
+
 // Base class from which all L1, L2, L3, L4 classes are derived...
 class PicoDriver {
  public:
   // Constructor
-  PicoDriver(royale::CameraManager & manager, std::string const& uuid, std::string const& use_case, uint32_t exposure)
-    : device_(manager.createCamera(uuid.c_str())), exposure_(exposure), initialized_(false) {
+  PicoDriver(royale::CameraManager & manager, std::string const& uuid, std::string const& use_case, uint32_t exposure,
+    PicoStamping const& stamping)
+    : device_(manager.createCamera(uuid.c_str())), exposure_(exposure), initialized_(false), stamping_(stamping) {
     // Try and create the camera
     if (device_ == nullptr) {
       ROS_ERROR_STREAM("Could not create the camera device");
@@ -155,6 +200,25 @@ class PicoDriver {
     return (device_->registerDepthImageListener(listener) == royale::CameraStatus::SUCCESS);
   }
 
+  // Stamp a frame captured at this time on the camera clock
+  template < typename Duration >
+  ros::Time Stamp(Duration const& capture) {
+    ros::Time stamp = ros::Time::now();
+    if (stamping_.capture)
+      stamp = clock_.FromDevice(std::chrono::duration_cast < std::chrono::microseconds > (capture).count(), stamp);
+    if (stamping_.sync_group)
+      stamp = stamping_.sync_group->Stamp(stamp);
+    return stamp;
+  }
+
+  // Stamp a frame with no capture time
+  ros::Time Stamp() {
+    ros::Time stamp = ros::Time::now();
+    if (stamping_.sync_group)
+      stamp = stamping_.sync_group->Stamp(stamp);
+    return stamp;
+  }
+
   // Turn the capture on or off
   void Power(bool on) {
     if (!Ready()) return;
@@ -206,6 +270,8 @@ class PicoDriver {
   std::unique_ptr < royale::ICameraDevice > device_;
   uint32_t exposure_;
   bool initialized_;
+  PicoStamping stamping_;
+  ff_util::CaptureClock clock_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -215,8 +281,9 @@ class PicoDriverL1 : public PicoDriver, public royale::IDepthDataListener, publi
  public:
   // Constructor
   PicoDriverL1(royale::CameraManager & manager, std::string const& uuid, std::string const& use_case, uint32_t exposure,
-    ros::NodeHandle *nh, std::string const& robot, std::string const& name, std::string const& topic)
-      : PicoDriver(manager, uuid, use_case, exposure) {
+    PicoStamping const& stamping, ros::NodeHandle *nh, std::string const& robot, std::string const& name,
+    std::string const& topic)
+      : PicoDriver(manager, uuid, use_case, exposure, stamping) {
     if (!Ready()) {
       ROS_ERROR_STREAM("Device failed to initialize");
       return;
@@ -255,6 +322,7 @@ class PicoDriverL1 : public PicoDriver, public royale::IDepthDataListener, publi
     pub_cloud_ = nh->advertise<sensor_msgs::PointCloud2>(topic_name_c, 1,
       boost::bind(&PicoDriverL1::ToggleCamera, this),
       boost::bind(&PicoDriverL1::ToggleCamera, this));
+    cloud_pool_.Init(cloud_);
     // Register the data listener
     if (!this->Listener(this))
       ROS_WARN_STREAM("Could not register the data listener");
@@ -267,6 +335,7 @@ class PicoDriverL1 : public PicoDriver, public royale::IDepthDataListener, publi
     depth_image_.encoding = sensor_msgs::image_encodings::MONO16;
     depth_image_.step = depth_image_.width * sizeof(uint16_t);
     depth_image_.data.resize(depth_image_.height * depth_image_.step);
+    depth_image_pool_.Init(depth_image_);
     std::string topic_name_d = (std::string) TOPIC_HARDWARE_PICOFLEXX_PREFIX
                              + (std::string) topic
                              + (std::string) TOPIC_HARDWARE_PICOFLEXX_SUFFIX_DEPTH_IMAGE;
@@ -306,12 +375,17 @@ class PicoDriverL1 : public PicoDriver, public royale::IDepthDataListener, publi
     }
     // If we have depth data, use the same mechanism as L1 to push it
     if (pub_cloud_.getNumSubscribers() > 0) {
-      cloud_.header.stamp = ros::Time::now();
+      sensor_msgs::PointCloud2Ptr cloud = cloud_pool_.Get();
+      if (!cloud) {
+        ROS_WARN_THROTTLE(5, "All point clouds are held by subscribers");
+        return;
+      }
+      cloud->header.stamp = Stamp(data->timeStamp);
       std::copy(
         reinterpret_cast<const uint8_t*>(data->points.data()),
-        reinterpret_cast<const uint8_t*>(data->points.data()) + cloud_.row_step * cloud_.height,
-        cloud_.data.begin());
-      pub_cloud_.publish(cloud_);
+        reinterpret_cast<const uint8_t*>(data->points.data()) + cloud->row_step * cloud->height,
+        cloud->data.begin());
+      pub_cloud_.publish(cloud);
     }
   }
 
@@ -328,12 +402,17 @@ class PicoDriverL1 : public PicoDriver, public royale::IDepthDataListener, publi
     }
     // If we have depth data, use the same mechanism as L1 to push it
     if (pub_depth_image_.getNumSubscribers() > 0) {
-      depth_image_.header.stamp = ros::Time::now();
+      sensor_msgs::ImagePtr depth_image = depth_image_pool_.Get();
+      if (!depth_image) {
+        ROS_WARN_THROTTLE(5, "All depth images are held by subscribers");
+        return;
+      }
+      depth_image->header.stamp = Stamp();
       std::copy(
         reinterpret_cast<const uint8_t*>(data->data.data()),
-        reinterpret_cast<const uint8_t*>(data->data.data()) + depth_image_.height * depth_image_.step,
-        depth_image_.data.begin());
-      pub_depth_image_.publish(depth_image_);
+        reinterpret_cast<const uint8_t*>(data->data.data()) + depth_image->height * depth_image->step,
+        depth_image->data.begin());
+      pub_depth_image_.publish(depth_image);
     }
   }
 
@@ -341,6 +420,8 @@ class PicoDriverL1 : public PicoDriver, public royale::IDepthDataListener, publi
   sensor_msgs::PointCloud2 cloud_;                        // The point cloud
   ff_msgs::PicoflexxIntermediateData extended_;           // The extended data
   sensor_msgs::Image depth_image_;                        // The depth image
+  MessagePool < sensor_msgs::PointCloud2 > cloud_pool_;   // The point clouds published
+  MessagePool < sensor_msgs::Image > depth_image_pool_;   // The depth images published
   ros::Publisher pub_cloud_;                              // The point cloud publisher
   ros::Publisher pub_depth_image_;                        // The depth image publisher
 };
@@ -354,14 +435,23 @@ class PicoDriverL2 : public PicoDriver, public royale::IExtendedDataListener {
  public:
   // Constructor
   PicoDriverL2(royale::CameraManager & manager, std::string const& uuid, std::string const& use_case, uint32_t exposure,
-    ros::NodeHandle *nh, std::string const& robot, std::string const& name, std::string const& topic)
-      : PicoDriver(manager, uuid, use_case, exposure) {
+    PicoStamping const& stamping, ros::NodeHandle *nh, std::string const& robot, std::string const& name,
+    std::string const& topic)
+      : PicoDriver(manager, uuid, use_case, exposure, stamping) {
     if (!Ready()) {
       ROS_ERROR_STREAM("Device failed to initialize");
       return;
     }
     // Setup the extended
     extended_.header.frame_id = (robot.empty() ? name : robot + "/" + name);
+    extended_.raw.width = this->GetWidth();
+    extended_.raw.height = this->GetHeight();
+    extended_.raw.step = extended_.raw.width
+      * sizeof(struct royale::IntermediatePoint);
+    extended_.raw.encoding = sensor_msgs::image_encodings::TYPE_32FC4;
+    extended_.raw.is_bigendian = false;
+    extended_.raw.data.resize(extended_.raw.step * extended_.raw.height);
+    extended_pool_.Init(extended_);
     // Generate a nice readable name for the camera
     std::string topic_name_e = (std::string) TOPIC_HARDWARE_PICOFLEXX_PREFIX
                              + (std::string) topic
@@ -403,6 +493,7 @@ class PicoDriverL2 : public PicoDriver, public royale::IExtendedDataListener {
     pub_cloud_ = nh->advertise<sensor_msgs::PointCloud2>(topic_name_c, 1,
       boost::bind(&PicoDriverL2::ToggleCamera, this),
       boost::bind(&PicoDriverL2::ToggleCamera, this));
+    cloud_pool_.Init(cloud_);
     // Register the data listener
     if (!this->ListenerExtended(this))
       ROS_WARN_STREAM("Could not register the extended data listener");
@@ -433,45 +524,50 @@ class PicoDriverL2 : public PicoDriver, public royale::IExtendedDataListener {
     // If we have depth data, use the same mechanism as L1 to push it
     if (data->hasDepthData() && pub_cloud_.getNumSubscribers() > 0
       && data->getDepthData() != nullptr) {
-      cloud_.header.stamp = ros::Time::now();
-       std::copy(
+      sensor_msgs::PointCloud2Ptr cloud = cloud_pool_.Get();
+      if (!cloud) {
+        ROS_WARN_THROTTLE(5, "All point clouds are held by subscribers");
+      } else {
+        cloud->header.stamp = Stamp(data->getDepthData()->timeStamp);
+        std::copy(
           reinterpret_cast<const uint8_t*>(data->getDepthData()->points.data()),
-          reinterpret_cast<const uint8_t*>(data->getDepthData()->points.data()) + cloud_.row_step * cloud_.height,
-          cloud_.data.begin());
-      pub_cloud_.publish(cloud_);
+          reinterpret_cast<const uint8_t*>(data->getDepthData()->points.data()) + cloud->row_step * cloud->height,
+          cloud->data.begin());
+        pub_cloud_.publish(cloud);
+      }
     }
     // If we have a listener and the extended data contains intermediate data, publish it
     if (data->hasIntermediateData() && pub_extended_.getNumSubscribers() > 0
         && data->getIntermediateData() != nullptr) {
-      extended_.header.stamp = ros::Time::now();
+      ff_msgs::PicoflexxIntermediateDataPtr extended = extended_pool_.Get();
+      if (!extended) {
+        ROS_WARN_THROTTLE(5, "All extended data is held by subscribers");
+        return;
+      }
+      extended->header.stamp = Stamp(data->getIntermediateData()->timeStamp);
       // Populate the modulation frequencies and exposures used to produce this data
-      extended_.frequency.resize(data->getIntermediateData()->modulationFrequencies.size());
+      extended->frequency.resize(data->getIntermediateData()->modulationFrequencies.size());
       for (size_t i = 0; i < data->getIntermediateData()->modulationFrequencies.size(); i++)
-        extended_.frequency[i] = data->getIntermediateData()->modulationFrequencies[i];
-      extended_.exposure.resize(data->getIntermediateData()->exposureTimes.size());
+        extended->frequency[i] = data->getIntermediateData()->modulationFrequencies[i];
+      extended->exposure.resize(data->getIntermediateData()->exposureTimes.size());
       for (size_t i = 0; i < data->getIntermediateData()->exposureTimes.size(); i++)
-        extended_.exposure[i] = data->getIntermediateData()->exposureTimes[i];
-      // Copy the data itself
-      extended_.raw.width = this->GetWidth();
-      extended_.raw.height = this->GetHeight();
-      extended_.raw.step = extended_.raw.width
-        * sizeof(struct royale::IntermediatePoint);
-      extended_.raw.encoding = sensor_msgs::image_encodings::TYPE_32FC4;
-      extended_.raw.is_bigendian = false;
-      extended_.raw.data.resize(extended_.raw.step * extended_.raw.height);
+        extended->exposure[i] = data->getIntermediateData()->exposureTimes[i];
+      // Copy the data itself, into the raw image sized once by the prototype
       std::copy(
         reinterpret_cast<const uint8_t*>(data->getIntermediateData()->points.data()),
         reinterpret_cast<const uint8_t*>(data->getIntermediateData()->points.data())
-          + extended_.raw.step * extended_.raw.height,
-        extended_.raw.data.begin());
+          + extended->raw.step * extended->raw.height,
+        extended->raw.data.begin());
       // Publish the extended data
-      pub_extended_.publish(extended_);
+      pub_extended_.publish(extended);
     }
   }
 
  private:
   sensor_msgs::PointCloud2 cloud_;                     // The point cloud
   ff_msgs::PicoflexxIntermediateData extended_;        // The extended data
+  MessagePool < sensor_msgs::PointCloud2 > cloud_pool_;                 // The point clouds published
+  MessagePool < ff_msgs::PicoflexxIntermediateData > extended_pool_;  // The extended data published
   ros::Publisher pub_extended_;                        // The cloud publisher
   ros::Publisher pub_cloud_;                           // The cloud publisher
 };
@@ -484,8 +580,9 @@ typedef std::map < std::string, std::shared_ptr < PicoDriver > > PicoDeviceList;
 class PicoFactory {
  public:
   // Constructor
-  PicoFactory(ros::NodeHandle *nh, std::string const& robot, std::string const& api_key)
-    : nh_(nh), robot_(robot), manager_(api_key.c_str()), initialized_(false) {
+  PicoFactory(ros::NodeHandle *nh, std::string const& robot, std::string const& api_key,
+    PicoStamping const& stamping)
+    : nh_(nh), robot_(robot), manager_(api_key.c_str()), stamping_(stamping), initialized_(false) {
     // Get the camera level
     level_ = manager_.getAccessLevel(api_key.c_str());
     switch (level_) {
@@ -525,11 +622,11 @@ class PicoFactory {
     case royale::CameraAccessLevel::L4:
     case royale::CameraAccessLevel::L3:
     case royale::CameraAccessLevel::L2:
-      ptr = std::make_shared < PicoDriverL2 > (manager_, uuid, use_case, exposure, nh_, robot_, name, topic);
+      ptr = std::make_shared < PicoDriverL2 > (manager_, uuid, use_case, exposure, stamping_, nh_, robot_, name, topic);
       break;
     case royale::CameraAccessLevel::L1:
     default:
-      ptr = std::make_shared < PicoDriverL1 > (manager_, uuid, use_case, exposure, nh_, robot_, name, topic);
+      ptr = std::make_shared < PicoDriverL1 > (manager_, uuid, use_case, exposure, stamping_, nh_, robot_, name, topic);
       break;
     }
     // If the device was allocated, save it
@@ -544,6 +641,7 @@ class PicoFactory {
   std::string robot_;                  // Robot name
   royale::CameraManager manager_;      // Camera manager
   royale::CameraAccessLevel level_;    // API level
+  PicoStamping stamping_;              // How frames are stamped
   bool initialized_;                   // Are we initialized?
 };
 
@@ -567,7 +665,17 @@ class PicoDriverNodelet : public ff_util::FreeFlyerNodelet  {
     std::string api_key;
     if (!pconfig.GetStr("api_key", &api_key))
       FF_FATAL("Could get devices item in config file");
-    PicoFactory factory(nh, GetPlatform(), api_key);
+    // Stamp frames with their capture time, and share the stamps of frames
+    // captured together with the other cameras
+    PicoStamping stamping;
+    if (!config_params.GetBool("capture_timestamps", &stamping.capture))
+      FF_FATAL("Could not find capture_timestamps in config file");
+    double sync_tolerance;
+    if (!config_params.GetReal("capture_sync_tolerance", &sync_tolerance))
+      FF_FATAL("Could not find capture_sync_tolerance in config file");
+    if (sync_tolerance > 0)
+      stamping.sync_group = ff_util::CaptureSyncGroup::Get("cameras", sync_tolerance);
+    PicoFactory factory(nh, GetPlatform(), api_key, stamping);
     // Read the device information from the config table
     config_reader::ConfigReader::Table devices;
     if (!pconfig.GetTable("devices", &devices))
@@ -22,6 +22,7 @@
 #include <i2c/i2c_new.h>
 
 #include <string>
+#include <vector>
 #include <atomic>
 #include <mutex>
 #include <thread>
@@ -108,6 +109,10 @@ class PmcActuatorBase {
   // Gets the telemetry packet.
   virtual bool GetTelemetry(Telemetry *telemetry) = 0;
 
+  // Sends the command and gets the telemetry packet, which the PMC made
+  // before the command arrived.
+  virtual bool Exchange(const Command &command, Telemetry *telemetry);
+
   virtual i2c::Address GetAddress() = 0;
 
   // Get the firmware version
@@ -141,6 +146,19 @@ class PmcActuator : public PmcActuatorBase {
   // Gets the telemetry packet from the PMC over I2C.
   bool GetTelemetry(Telemetry *telemetry);
 
+  // Sends the command and gets the telemetry packet in one I2C transaction,
+  // with a repeated start between them.
+  bool Exchange(const Command &command, Telemetry *telemetry);
+
+  // Exchanges with all the PMCs at once. On a bus with no scheduler all
+  // the transactions go in one ioctl, and on one with a scheduler they are
+  // all queued before waiting on any, so that it can merge them. ok is set
+  // for each PMC whose exchange succeeded.
+  static void Exchange(const std::vector<PmcActuator*> &pmcs,
+                       const std::vector<Command*> &commands,
+                       std::vector<Telemetry> *telemetry,
+                       std::vector<bool> *ok);
+
   // Get the firmware version
   bool GetFirmwareHash(std::string & hash);
 
@@ -152,6 +170,8 @@ class PmcActuator : public PmcActuatorBase {
 
  private:
   uint8_t ComputeChecksum(const uint8_t *buf, size_t size);
+  void PackCommand(const Command &command, uint8_t *buf);
+  bool ParseTelemetry(const uint8_t *buf, Telemetry *telemetry);
 };
 
 class PmcActuatorStub : public PmcActuatorBase {
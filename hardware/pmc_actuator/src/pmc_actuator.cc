@@ -24,6 +24,7 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <future>  // NOLINT
 
 namespace pmc_actuator {
 
@@ -32,9 +33,7 @@ PmcActuator::PmcActuator(const i2c::Device &i2c_dev) :
 
 PmcActuator::~PmcActuator(void) {}
 
-bool PmcActuator::SendCommand(const Command &command) {
-  uint8_t buf[sizeof(Command)];
-  i2c::Error err;
+void PmcActuator::PackCommand(const Command &command, uint8_t *buf) {
   int pos = 0;
 
   buf[pos++] = command.motor_speed;
@@ -45,6 +44,13 @@ bool PmcActuator::SendCommand(const Command &command) {
   buf[pos++] = command.mode;
   buf[pos++] = command.command_id;
   buf[pos++] = ComputeChecksum(buf, kCommandMsgLength - 1);
+}
+
+bool PmcActuator::SendCommand(const Command &command) {
+  uint8_t buf[sizeof(Command)];
+  i2c::Error err;
+
+  PackCommand(command, buf);
 
   if (i2c_dev_.Write(buf, kCommandMsgLength, &err) != kCommandMsgLength) {
     std::cerr << "Failed to write " << kCommandMsgLength << " Bytes over I2C: ";
@@ -66,6 +72,101 @@ bool PmcActuator::GetTelemetry(Telemetry *telemetry) {
     return false;
   }
 
+  return ParseTelemetry(buf, telemetry);
+}
+
+bool PmcActuator::Exchange(const Command &command, Telemetry *telemetry) {
+  uint8_t cmd[sizeof(Command)];
+  uint8_t buf[sizeof(Telemetry)];
+  i2c::Error err;
+
+  PackCommand(command, cmd);
+
+  i2c::Message msgs[2] {
+    { i2c_dev_.addr(), false, cmd, kCommandMsgLength },
+    { i2c_dev_.addr(), true, buf, kTelemetryMsgLength }
+  };
+  if (i2c_dev_.Transfer(msgs, 2, &err) != kTelemetryMsgLength) {
+    std::cerr << "Failed to exchange " << kCommandMsgLength << " and "
+              << kTelemetryMsgLength << " Bytes over I2C: ";
+    std::cerr << std::strerror(err) << std::endl;
+    return false;
+  }
+
+  return ParseTelemetry(buf, telemetry);
+}
+
+void PmcActuator::Exchange(const std::vector<PmcActuator*> &pmcs,
+                           const std::vector<Command*> &commands,
+                           std::vector<Telemetry> *telemetry,
+                           std::vector<bool> *ok) {
+  size_t n = pmcs.size();
+  telemetry->resize(n);
+  ok->assign(n, false);
+  if (n == 0)
+    return;
+
+  // The buffers of each PMC, and its write then read
+  std::vector<uint8_t> cmds(n * kCommandMsgLength);
+  std::vector<uint8_t> bufs(n * kTelemetryMsgLength);
+  std::vector<i2c::Message> msgs(2 * n);
+  bool one_bus = true;
+  for (size_t i = 0; i < n; i++) {
+    i2c::Address addr = pmcs[i]->i2c_dev_.addr();
+    pmcs[i]->PackCommand(*commands[i], &cmds[i * kCommandMsgLength]);
+    msgs[2 * i] = { addr, false, &cmds[i * kCommandMsgLength],
+                    kCommandMsgLength };
+    msgs[2 * i + 1] = { addr, true, &bufs[i * kTelemetryMsgLength],
+                        kTelemetryMsgLength };
+    one_bus &= (pmcs[i]->i2c_dev_.bus() == pmcs[0]->i2c_dev_.bus());
+  }
+
+  // One ioctl for all of them. If it fails, they are exchanged with one at
+  // a time below, to tell which of them failed.
+  i2c::Error err;
+  const i2c::Bus::Ptr &bus = pmcs[0]->i2c_dev_.bus();
+  if (one_bus && !bus->scheduler() &&
+      bus->Transfer(msgs.data(), msgs.size(), &err)
+        == static_cast<int>(msgs.size())) {
+    for (size_t i = 0; i < n; i++)
+      (*ok)[i] = pmcs[i]->ParseTelemetry(&bufs[i * kTelemetryMsgLength],
+                                         &(*telemetry)[i]);
+    return;
+  }
+
+  // Queue those on a bus with a scheduler before waiting on any of them
+  std::vector<std::promise<int>> done(n);
+  std::vector<i2c::Error> errs(n, 0);
+  for (size_t i = 0; i < n; i++) {
+    if (!pmcs[i]->i2c_dev_.bus()->scheduler())
+      continue;
+    std::promise<int> *p = &done[i];
+    i2c::Error *e = &errs[i];
+    pmcs[i]->i2c_dev_.Submit(&msgs[2 * i], 2, [p, e](int ret, i2c::Error ec) {
+      *e = ec;
+      p->set_value(ret);
+    });
+  }
+  for (size_t i = 0; i < n; i++) {
+    int ret;
+    if (pmcs[i]->i2c_dev_.bus()->scheduler()) {
+      ret = done[i].get_future().get();
+      err = errs[i];
+    } else {
+      ret = pmcs[i]->i2c_dev_.Transfer(&msgs[2 * i], 2, &err);
+    }
+    if (ret != kTelemetryMsgLength) {
+      std::cerr << "Failed to exchange " << kCommandMsgLength << " and "
+                << kTelemetryMsgLength << " Bytes over I2C: ";
+      std::cerr << std::strerror(err) << std::endl;
+      continue;
+    }
+    (*ok)[i] = pmcs[i]->ParseTelemetry(&bufs[i * kTelemetryMsgLength],
+                                       &(*telemetry)[i]);
+  }
+}
+
+bool PmcActuator::ParseTelemetry(const uint8_t *buf, Telemetry *telemetry) {
   if (ComputeChecksum(buf, kTelemetryMsgLength) != 0) {
     std::cerr << "Telemetry data checksum failed" << std::endl;
     return false;
@@ -209,6 +310,13 @@ i2c::Address PmcActuatorStub::GetAddress() {
   return addr_;
 }
 
+bool PmcActuatorBase::Exchange(const Command &command,
+                               Telemetry *telemetry) {
+  if (!GetTelemetry(telemetry))
+    return false;
+  return SendCommand(command);
+}
+
 void PmcActuatorBase::PrintTelemetry(std::ostream &out,
                                      const Telemetry &telem) {
   out << "addr=0x" << std::hex << GetAddress() << std::dec;
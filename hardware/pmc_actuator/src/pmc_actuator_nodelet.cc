@@ -38,8 +38,12 @@
 // Services
 #include <ff_msgs/SetBool.h>
 
+#include <algorithm>
 #include <cerrno>
+#include <chrono>
+#include <cstdio>
 #include <cstring>
+#include <vector>
 
 /**
  * \ingroup hardware
@@ -50,7 +54,8 @@ class PmcActuatorNodelet : public ff_util::FreeFlyerNodelet {
  public:
   // Constructor
   PmcActuatorNodelet() : ff_util::FreeFlyerNodelet(NODE_PMC_ACTUATOR),
-    pmc_enabled_(true), cur_command_id_(0) {}
+    pmc_enabled_(true), cur_command_id_(0), i2c_cycles_(0),
+    i2c_time_sum_(0.0), i2c_time_max_(0.0) {}
 
   // Destructor - clean up the dynamically allocated PMC and command arrays
   virtual ~PmcActuatorNodelet() {
@@ -169,6 +174,18 @@ class PmcActuatorNodelet : public ff_util::FreeFlyerNodelet {
       return false;
     }
 
+    // get whether the PMCs go ahead of other devices on the bus
+    if (!config_params.GetBool("i2c_scheduler", &i2c_scheduler_)) {
+      ROS_FATAL("PMC Actuator: i2c scheduler not specified!");
+      return false;
+    }
+
+    // get whether commands and telemetry are exchanged in one transaction
+    if (!config_params.GetBool("pipelined_exchange", &pipelined_exchange_)) {
+      ROS_FATAL("PMC Actuator: pipelined exchange not specified!");
+      return false;
+    }
+
     // get control rate
     if (!config_params.GetPosReal("control_rate_hz", &control_rate_hz_)) {
       ROS_FATAL("PMC Actuator: control rate not specified!");
@@ -234,8 +251,16 @@ class PmcActuatorNodelet : public ff_util::FreeFlyerNodelet {
 
     bus->SetRetries(i2c_retries_);
 
+    // PMC transfers go ahead of those of devices left at the default
+    // priority, merged together, and must start within a control period
+    if (i2c_scheduler_)
+      bus->EnableScheduler();
     for (int i = 0; i < num_pmcs_; i++) {
-      pmcs_.push_back(new PmcActuator(bus->DeviceAt(i2c_addrs_.at(i))));
+      i2c::Device device = bus->DeviceAt(i2c_addrs_.at(i));
+      if (i2c_scheduler_)
+        device.SetSchedule(-1, std::chrono::microseconds(
+          static_cast<int64_t>(1e6 / control_rate_hz_)), true);
+      pmcs_.push_back(new PmcActuator(device));
     }
 
     // Set initial commands.
@@ -279,9 +304,25 @@ class PmcActuatorNodelet : public ff_util::FreeFlyerNodelet {
     static ff_hw_msgs::PmcState msg;
     msg.states.resize(num_pmcs_);
     bool duplicate = true;
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+    double i2c_time = 0.0;
+    // In the pipelined mode the commands go out with the telemetry read,
+    // which the PMCs made before they arrived, so the nozzles are nulled on
+    // the states of the last cycle instead of this one.
+    if (pipelined_exchange_) {
+      NullRampingUp(state_);
+      PmcActuator::Exchange(pmcs_, commands_, &exchanged_, &exchanged_ok_);
+      i2c_time += Seconds(start);
+    }
     for (int i = 0; i < num_pmcs_; i++) {
       ff_hw_msgs::PmcStatus t;
-      if (!GetStatus(i, &t)) {
+      if (pipelined_exchange_) {
+        if (exchanged_ok_[i])
+          ToStatus(exchanged_[i], &t);
+        else
+          ROS_WARN("Unable to get telemetry from PMC[%d]", i);
+      } else if (!GetStatus(i, &t)) {
         ROS_WARN("Unable to get telemetry from PMC[%d]", i);
       }
       telemetry_vector_.statuses.push_back(t);
@@ -300,17 +341,16 @@ class PmcActuatorNodelet : public ff_util::FreeFlyerNodelet {
       // One mismatch will trigger a state update
       duplicate &= (state_.states[i] == msg.states[i]);
     }
-    // If the PMC is ramping up, null the nozzles to avoid a brownout. This
-    // seems to work well, but is not a replacement for fixing the firmware.
-    for (int i = 0; i < num_pmcs_; i++) {
-      if (msg.states[i] == ff_hw_msgs::PmcState::RAMPING_UP) {
-        for (unsigned int n = 0; n < 6; n++) {
-          commands_.at(i)->nozzle_positions[n] = null_nozzle_positions_[n];
-        }
-      }
+    if (!pipelined_exchange_) {
+      i2c_time += Seconds(start);
+      NullRampingUp(msg);
+      start = std::chrono::steady_clock::now();
       // FIXME: lock required?
-      pmcs_.at(i)->SendCommand(*(commands_.at(i)));
+      for (int i = 0; i < num_pmcs_; i++)
+        pmcs_.at(i)->SendCommand(*(commands_.at(i)));
+      i2c_time += Seconds(start);
     }
+    ReportI2cTime(i2c_time);
     // Publish a high-level state
     if (!duplicate) {
       state_.header = telemetry_vector_.header;
@@ -322,6 +362,49 @@ class PmcActuatorNodelet : public ff_util::FreeFlyerNodelet {
     ros::spinOnce();
   }
 
+  // If the PMC is ramping up, null the nozzles to avoid a brownout. This
+  // seems to work well, but is not a replacement for fixing the firmware.
+  void NullRampingUp(const ff_hw_msgs::PmcState &state) {
+    for (int i = 0; i < num_pmcs_; i++) {
+      if (state.states[i] == ff_hw_msgs::PmcState::RAMPING_UP) {
+        for (unsigned int n = 0; n < 6; n++) {
+          commands_.at(i)->nozzle_positions[n] = null_nozzle_positions_[n];
+        }
+      }
+    }
+  }
+
+  // Seconds since the time point
+  static double Seconds(const std::chrono::steady_clock::time_point &start) {
+    return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  }
+
+  // Accumulate the time spent on the bus each cycle, and send the mean and
+  // the longest of the last second with the diagnostics
+  void ReportI2cTime(double seconds) {
+    i2c_cycles_++;
+    i2c_time_sum_ += seconds;
+    i2c_time_max_ = std::max(i2c_time_max_, seconds);
+    ros::WallTime now = ros::WallTime::now();
+    if (i2c_report_time_.isZero())
+      i2c_report_time_ = now;
+    if ((now - i2c_report_time_).toSec() < 1.0)
+      return;
+    char buf[128];
+    snprintf(buf, sizeof(buf), "mean %.3f ms, max %.3f ms over %d cycles",
+             1e3 * i2c_time_sum_ / i2c_cycles_, 1e3 * i2c_time_max_,
+             i2c_cycles_);
+    std::vector<diagnostic_msgs::KeyValue> keyval(1);
+    keyval[0].key = "i2c_time";
+    keyval[0].value = buf;
+    SendDiagnostics(keyval);
+    i2c_report_time_ = now;
+    i2c_cycles_ = 0;
+    i2c_time_sum_ = 0.0;
+    i2c_time_max_ = 0.0;
+  }
+
   // Get the status of the PMC
   bool GetStatus(int idx, ff_hw_msgs::PmcStatus *telemetry) {
     Telemetry t;
@@ -329,6 +412,12 @@ class PmcActuatorNodelet : public ff_util::FreeFlyerNodelet {
     if (!(pmcs_.at(idx)->GetTelemetry(&t)))
       return false;
 
+    ToStatus(t, telemetry);
+    return true;
+  }
+
+  // Convert the telemetry of a PMC to its status message
+  void ToStatus(const Telemetry &t, ff_hw_msgs::PmcStatus *telemetry) {
     telemetry->motor_speed = t.motor_speed;
     telemetry->motor_current = t.motor_current;
     telemetry->v6_current = t.v6_current;
@@ -339,8 +428,6 @@ class PmcActuatorNodelet : public ff_util::FreeFlyerNodelet {
     telemetry->status_1 = t.status_1.asUint8;
     telemetry->status_2 = t.status_2.asUint8;
     telemetry->command_id = t.command_id;
-
-    return true;
   }
 
   // Called when a new command is received
@@ -440,6 +527,8 @@ class PmcActuatorNodelet : public ff_util::FreeFlyerNodelet {
   std::string i2c_bus_file_;                       // i2c bus for all PMCss
   std::vector<int> i2c_addrs_;                     // 7-bit I2C addresses
   int i2c_retries_;                                // Number of I2C bus retries
+  bool i2c_scheduler_;                             // Schedule the PMCs first
+  bool pipelined_exchange_;                        // One transaction per PMC
   double control_rate_hz_;                         // Control rate in Hz.
   int null_fan_speed_;                          // Initial fan speed.
   std::vector<int> null_nozzle_positions_;      // Initial nozzle positions
@@ -451,6 +540,11 @@ class PmcActuatorNodelet : public ff_util::FreeFlyerNodelet {
   ff_hw_msgs::PmcState state_;                     // State of the PMCs
   bool pmc_enabled_;                               // Is the PMC enabled?
   int cur_command_id_;                             // Current command ID
+  std::vector<Telemetry> exchanged_;               // Pipelined telemetry
+  std::vector<bool> exchanged_ok_;                 // Pipelined success
+  int i2c_cycles_;                                 // Cycles since report
+  double i2c_time_sum_, i2c_time_max_;             // I2C seconds per cycle
+  ros::WallTime i2c_report_time_;                  // Last I2C time report
 };
 
 PLUGINLIB_DECLARE_CLASS(pmc_actuator, PmcActuatorNodelet,
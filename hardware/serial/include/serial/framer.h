@@ -0,0 +1,116 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SERIAL_FRAMER_H_
+#define SERIAL_FRAMER_H_
+
+// STL includes
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace serial {
+
+// Called with each complete frame, which is only valid during the call
+typedef std::function<void(const uint8_t*, size_t)> SerialFrameCallback;
+
+// Tells where the frames of a protocol are in a byte stream
+class FrameFormat {
+ public:
+  // What Check returns when the bytes are not a frame, or not yet
+  static constexpr int FRAME_INVALID    = -1;
+  static constexpr int FRAME_INCOMPLETE = 0;
+
+  virtual ~FrameFormat() {}
+
+  // Checks the bytes from a candidate start of frame. Returns the length of
+  // the frame if it is complete and valid, FRAME_INCOMPLETE if more bytes
+  // are needed to tell, and FRAME_INVALID if no frame starts here.
+  virtual int Check(const uint8_t *data, size_t size) = 0;
+
+  // The longest frame, which the buffer must hold
+  virtual size_t MaxLength() const = 0;
+};
+
+// Frames that start with a fixed header and have a length byte at a fixed
+// offset, whose length is that byte plus a constant, and which are valid if
+// the checksum function returns true for the whole frame.
+class LengthFrameFormat : public FrameFormat {
+ public:
+  typedef std::function<bool(const uint8_t*, size_t)> ChecksumFunction;
+
+  LengthFrameFormat(std::vector<uint8_t> const& header, size_t length_offset,
+    size_t length_extra, ChecksumFunction checksum);
+
+  int Check(const uint8_t *data, size_t size);
+
+  size_t MaxLength() const;
+
+ private:
+  std::vector<uint8_t> header_;                        // Start of frame
+  size_t length_offset_;                               // Length byte
+  size_t length_extra_;                                // Added to length
+  ChecksumFunction checksum_;                          // Frame check
+};
+
+// Finds the frames in a byte stream and passes them on in place. Reads go
+// straight into the space at the end of the buffer, and the bytes of a
+// frame that is not complete are only moved back to the start when that
+// space runs out. Bytes that are not part of a valid frame are skipped one
+// at a time until the next frame is found.
+class Framer {
+ public:
+  // The buffer holds at least capacity bytes, and two of the longest frame
+  Framer(std::unique_ptr<FrameFormat> format, SerialFrameCallback cb_frame,
+    size_t capacity = 4096);
+
+  // The free space to read into, moving any partial frame back first
+  uint8_t* Space(size_t *size);
+
+  // Finds the frames once size more bytes were read into the space
+  void Commit(size_t size);
+
+  // Copies bytes in, for those not read straight into the space
+  void Push(const uint8_t *data, size_t size);
+
+  // Drops any partial frame
+  void Reset();
+
+  // Counts of frames found and of bytes skipped
+  uint64_t Frames() const { return frames_; }
+  uint64_t Skipped() const { return skipped_; }
+
+ protected:
+  // Hand on all the complete frames in the buffer
+  void Parse();
+
+ private:
+  std::unique_ptr<FrameFormat> format_;                // Protocol framing
+  SerialFrameCallback cb_frame_;                       // Frame callback
+  std::vector<uint8_t> buffer_;                        // Data buffer
+  size_t head_;                                        // First unparsed byte
+  size_t tail_;                                        // End of data
+  uint64_t frames_;                                    // Frames found
+  uint64_t skipped_;                                   // Bytes skipped
+};
+
+}  // namespace serial
+
+#endif  // SERIAL_FRAMER_H_
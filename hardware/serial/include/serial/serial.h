@@ -26,8 +26,12 @@
 #include <boost/utility.hpp>
 #include <boost/function.hpp>
 
+// Framing
+#include <serial/framer.h>
+
 // STL includes
 #include <functional>
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -54,6 +58,11 @@ class Serial : private boost::noncopyable {
   // Constructor flags not ready
   explicit Serial(SerialReadCallback cb_read);
 
+  // Constructor that reads straight into a framer, and calls back with
+  // each complete frame in place instead of with each read
+  Serial(std::unique_ptr<FrameFormat> format, SerialFrameCallback cb_frame,
+    size_t capacity = 4096);
+
   // Set a callback when a read timeout occurs
   void SetTimeoutCallback(SerialTimeoutCallback cb, uint32_t ms = 1000);
 
@@ -89,6 +98,9 @@ class Serial : private boost::noncopyable {
   // Set reset pint state
   void SetResetPinState(SerialResetPinState state);
 
+  // The framer, or NULL if reads are passed on as they are
+  Framer* GetFramer();
+
  protected:
   // Start a read action (timeout = 0 implies no timeout)
   void ReadStart();
@@ -108,6 +120,7 @@ class Serial : private boost::noncopyable {
   SerialTimeoutCallback cb_timeout_;                   // Timeout callback
   SerialShutdownCallback cb_shutdown_;                 // Shutdown callback
   uint8_t buffer_[MAX_BUFFER_SIZE];                    // Data buffer
+  std::unique_ptr<Framer> framer_;                     // Frame buffer
   uint32_t timeout_ms_;                                // Ms read timeout
   bool timeout_;                                       // Was there a timeout?
 };
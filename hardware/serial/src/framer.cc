@@ -0,0 +1,124 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <serial/framer.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace serial {
+
+constexpr int FrameFormat::FRAME_INVALID;
+constexpr int FrameFormat::FRAME_INCOMPLETE;
+
+LengthFrameFormat::LengthFrameFormat(std::vector<uint8_t> const& header,
+  size_t length_offset, size_t length_extra, ChecksumFunction checksum)
+  : header_(header), length_offset_(length_offset),
+    length_extra_(length_extra), checksum_(checksum) {}
+
+int LengthFrameFormat::Check(const uint8_t *data, size_t size) {
+  // The header is checked as far as it has arrived
+  size_t n = std::min(size, header_.size());
+  if (memcmp(data, header_.data(), n) != 0)
+    return FRAME_INVALID;
+  if (size <= length_offset_)
+    return FRAME_INCOMPLETE;
+  size_t len = data[length_offset_] + length_extra_;
+  if (len <= length_offset_ || len < header_.size())
+    return FRAME_INVALID;
+  if (size < len)
+    return FRAME_INCOMPLETE;
+  if (checksum_ && !checksum_(data, len))
+    return FRAME_INVALID;
+  return static_cast<int>(len);
+}
+
+size_t LengthFrameFormat::MaxLength() const {
+  return std::max(header_.size(), length_offset_ + 1) + 255 + length_extra_;
+}
+
+Framer::Framer(std::unique_ptr<FrameFormat> format,
+  SerialFrameCallback cb_frame, size_t capacity)
+  : format_(std::move(format)), cb_frame_(cb_frame),
+    buffer_(std::max(capacity, 2 * format_->MaxLength())),
+    head_(0), tail_(0), frames_(0), skipped_(0) {}
+
+uint8_t* Framer::Space(size_t *size) {
+  // Move the partial frame back when a whole frame might not fit after it
+  if (head_ > 0 && buffer_.size() - tail_ < format_->MaxLength()) {
+    memmove(&buffer_[0], &buffer_[head_], tail_ - head_);
+    tail_ -= head_;
+    head_ = 0;
+  }
+  *size = buffer_.size() - tail_;
+  return &buffer_[tail_];
+}
+
+void Framer::Commit(size_t size) {
+  tail_ += std::min(size, buffer_.size() - tail_);
+  Parse();
+}
+
+void Framer::Push(const uint8_t *data, size_t size) {
+  while (size > 0) {
+    size_t space;
+    uint8_t* dst = Space(&space);
+    size_t n = std::min(size, space);
+    memcpy(dst, data, n);
+    Commit(n);
+    data += n;
+    size -= n;
+  }
+}
+
+void Framer::Reset() {
+  head_ = 0;
+  tail_ = 0;
+}
+
+void Framer::Parse() {
+  while (head_ < tail_) {
+    int len = format_->Check(&buffer_[head_], tail_ - head_);
+    if (len > 0 && static_cast<size_t>(len) > tail_ - head_)
+      len = FrameFormat::FRAME_INCOMPLETE;
+    if (len == FrameFormat::FRAME_INCOMPLETE) {
+      // A frame that can never complete is skipped, so that the buffer
+      // does not stay full
+      if (tail_ - head_ < format_->MaxLength())
+        break;
+      len = FrameFormat::FRAME_INVALID;
+    }
+    if (len == FrameFormat::FRAME_INVALID) {
+      head_++;
+      skipped_++;
+      continue;
+    }
+    frames_++;
+    if (cb_frame_)
+      cb_frame_(&buffer_[head_], static_cast<size_t>(len));
+    head_ += len;
+  }
+  // Start from the beginning again when everything is parsed
+  if (head_ == tail_) {
+    head_ = 0;
+    tail_ = 0;
+  }
+}
+
+}  // namespace serial
@@ -26,6 +26,13 @@ namespace serial {
 Serial::Serial(SerialReadCallback cb_read)
   : port_(asio_), timer_(asio_), cb_read_(cb_read), timeout_ms_(0) {}
 
+// Framed constructor
+Serial::Serial(std::unique_ptr<FrameFormat> format,
+  SerialFrameCallback cb_frame, size_t capacity)
+  : port_(asio_), timer_(asio_),
+    framer_(new Framer(std::move(format), cb_frame, capacity)),
+    timeout_ms_(0) {}
+
 // Destructor closes port safely
 Serial::~Serial() {
   Close();
@@ -87,7 +94,12 @@ void Serial::Close() {
 
 // Initialize a read action
 void Serial::ReadStart() {
-  port_.async_read_some(boost::asio::buffer(buffer_, MAX_BUFFER_SIZE),
+  // With a framer the data goes straight into its buffer
+  uint8_t *data = buffer_;
+  size_t size = MAX_BUFFER_SIZE;
+  if (framer_)
+    data = framer_->Space(&size);
+  port_.async_read_some(boost::asio::buffer(data, size),
     boost::bind(&Serial::ReadStop, this, boost::asio::placeholders::error,
         boost::asio::placeholders::bytes_transferred));
   // If we have specified a timeout
@@ -112,7 +124,9 @@ void Serial::ReadStop(const boost::system::error_code& error, size_t bytes) {
       cb_shutdown_();
   } else {
     timer_.cancel();
-    if (!error && cb_read_)
+    if (!error && framer_)
+      framer_->Commit(bytes);
+    else if (!error && cb_read_)
       cb_read_(buffer_, bytes);
   }
   // Start another read
@@ -133,6 +147,11 @@ size_t Serial::Write(const uint8_t *buff, size_t len) {
   return boost::asio::write(port_, boost::asio::buffer(buff, len));
 }
 
+// The framer, if there is one
+Framer* Serial::GetFramer() {
+  return framer_.get();
+}
+
 // Set reset pint state
 void Serial::SetResetPinState(SerialResetPinState state) {
   int fd = port_.native_handle();
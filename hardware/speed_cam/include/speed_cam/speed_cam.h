@@ -75,7 +75,7 @@ class SpeedCam {
   bool TimeSync();
 
  protected:
-  // Asynchronous callback with serial data
+  // Asynchronous callback with each MAVLink frame
   void ReadCallback(const uint8_t *buffer, size_t len);
 
   // Asynchronous callback for read timeout
@@ -18,13 +18,64 @@
 
 #include <speed_cam/speed_cam.h>
 
+#include <cstring>
+#include <memory>
+
 namespace speed_cam {
 
+namespace {
+
+// Frames of MAVLink 1 or 2, checked as mavlink_parse_char would check them
+class MavlinkFrameFormat : public serial::FrameFormat {
+ public:
+  int Check(const uint8_t *data, size_t size) {
+    size_t header;
+    switch (data[0]) {
+    case MAVLINK_STX_MAVLINK1:
+      header = MAVLINK_CORE_HEADER_MAVLINK1_LEN + 1;
+      break;
+    case MAVLINK_STX:
+      header = MAVLINK_CORE_HEADER_LEN + 1;
+      break;
+    default:
+      return FRAME_INVALID;
+    }
+    if (size < header)
+      return FRAME_INCOMPLETE;
+    size_t len = header + data[1] + MAVLINK_NUM_CHECKSUM_BYTES;
+    if (data[0] == MAVLINK_STX && (data[2] & MAVLINK_IFLAG_SIGNED))
+      len += MAVLINK_SIGNATURE_BLOCK_LEN;
+    if (size < len)
+      return FRAME_INCOMPLETE;
+    // The checksum covers all but the start byte, then the CRC extra
+    const mavlink_msg_entry_t *entry = mavlink_get_msg_entry(MessageId(data));
+    uint16_t crc = crc_calculate(&data[1], header - 1 + data[1]);
+    crc_accumulate(entry ? entry->crc_extra : 0, &crc);
+    if (data[header + data[1]] != (crc & 0xFF)
+      || data[header + data[1] + 1] != (crc >> 8))
+      return FRAME_INVALID;
+    return static_cast<int>(len);
+  }
+
+  size_t MaxLength() const {
+    return MAVLINK_MAX_PACKET_LEN;
+  }
+
+  static uint32_t MessageId(const uint8_t *data) {
+    if (data[0] == MAVLINK_STX_MAVLINK1)
+      return data[5];
+    return data[7] | (data[8] << 8) | (static_cast<uint32_t>(data[9]) << 16);
+  }
+};
+
+}  // namespace
+
 // By default the arm is uninitialized
 SpeedCam::SpeedCam(SpeedCamImuCallback cb_imu, SpeedCamCameraImageCallback cb_camera_image,
   SpeedCamOpticalFlowCallback cb_optical_flow, SpeedCamSpeedCallback cb_speed,
   SpeedCamStatusCallback cb_status)
-  : serial_(std::bind(&SpeedCam::ReadCallback, this, std::placeholders::_1, std::placeholders::_2))
+  : serial_(std::unique_ptr<serial::FrameFormat>(new MavlinkFrameFormat),
+      std::bind(&SpeedCam::ReadCallback, this, std::placeholders::_1, std::placeholders::_2))
   , cb_imu_(cb_imu)
   , cb_camera_image_(cb_camera_image)
   , cb_optical_flow_(cb_optical_flow)
@@ -70,83 +121,98 @@ bool SpeedCam::TimeSync() {
   return true;
 }
 
-// Callback with serial data
+// Callback with a complete MAVLink frame, whose checksum is already checked
 void SpeedCam::ReadCallback(const uint8_t* buf, size_t len) {
+  // The payload is copied once, so that it is aligned for decoding
   mavlink_message_t message;
-  mavlink_status_t status;
-
-  for (size_t i = 0; i < len; i++) {
-    bool msgReceived = mavlink_parse_char(MAVLINK_COMM_1, buf[i], &message, &status);
+  const uint8_t *payload;
+  message.magic = buf[0];
+  message.len = buf[1];
+  message.msgid = MavlinkFrameFormat::MessageId(buf);
+  if (buf[0] == MAVLINK_STX_MAVLINK1) {
+    message.incompat_flags = 0;
+    message.compat_flags = 0;
+    message.seq = buf[2];
+    message.sysid = buf[3];
+    message.compid = buf[4];
+    payload = &buf[MAVLINK_CORE_HEADER_MAVLINK1_LEN + 1];
+  } else {
+    message.incompat_flags = buf[2];
+    message.compat_flags = buf[3];
+    message.seq = buf[4];
+    message.sysid = buf[5];
+    message.compid = buf[6];
+    payload = &buf[MAVLINK_CORE_HEADER_LEN + 1];
+  }
+  memcpy(_MAV_PAYLOAD_NON_CONST(&message), payload, message.len);
+  message.checksum = payload[message.len] | (payload[message.len + 1] << 8);
 
-    if (msgReceived) {
-      system_id_ = message.sysid;
-      switch (message.msgid) {
-      // IMU
-      case MAVLINK_MSG_ID_RAW_IMU: {
-        mavlink_raw_imu_t imu;
-        mavlink_msg_raw_imu_decode(&message, &imu);
-        if (cb_imu_)
-          cb_imu_(imu);
-        break;
-        }
-      // OPTICAL FLOW
-      case MAVLINK_MSG_ID_OPTICAL_FLOW: {
-        mavlink_optical_flow_t flow;
-        mavlink_msg_optical_flow_decode(&message, &flow);
-        if (cb_optical_flow_)
-          cb_optical_flow_(flow);
-        break;
-        }
-      // CAMERA IMAGE : HANDSHAKE
-      case MAVLINK_MSG_ID_DATA_TRANSMISSION_HANDSHAKE: {
-        mavlink_data_transmission_handshake_t handshake;
-        mavlink_msg_data_transmission_handshake_decode(&message, &handshake);
-        image_size_ = handshake.size;
-        image_packets_ = handshake.packets;
-        image_payload_ = handshake.payload;
-        image_width_ = handshake.width;
-        image_height_ = handshake.height;
-        if (image_buffer_.size() < image_size_)
-          image_buffer_.resize(image_size_);
-        break;
-        }
-      // CAMERA IMAGE : DATA
-      case MAVLINK_MSG_ID_ENCAPSULATED_DATA: {
-        if (image_size_ == 0 || image_packets_ == 0)
-          break;
-        mavlink_encapsulated_data_t img;
-        mavlink_msg_encapsulated_data_decode(&message, &img);
-        size_t seq = img.seqnr;
-        size_t pos = seq * image_payload_;
-        if (seq + 1 > image_packets_)
-          break;
-        size_t bytesToCopy = image_payload_;
-        if (pos + image_payload_ >= image_size_)
-           bytesToCopy = image_size_ - pos;
-        memcpy(&image_buffer_[pos], img.data, bytesToCopy);
-        if (seq + 1 == image_packets_) {
-          if (cb_camera_image_)
-            cb_camera_image_(image_buffer_, image_width_, image_height_);
-        }
-        break;
-        }
-      // SPEED ESTIMATE
-      case MAVLINK_MSG_ID_VISION_SPEED_ESTIMATE: {
-        mavlink_vision_speed_estimate_t speed;
-        mavlink_msg_vision_speed_estimate_decode(&message, &speed);
-        if (cb_speed_)
-          cb_speed_(speed);
-        break;
-        }
-      // System status
-      case MAVLINK_MSG_ID_HEARTBEAT: {
-        mavlink_heartbeat_t status;
-        mavlink_msg_heartbeat_decode(&message, &status);
-        if (cb_status_)
-          cb_status_(status);
-        break;
-        }
-      }
+  system_id_ = message.sysid;
+  switch (message.msgid) {
+  // IMU
+  case MAVLINK_MSG_ID_RAW_IMU: {
+    mavlink_raw_imu_t imu;
+    mavlink_msg_raw_imu_decode(&message, &imu);
+    if (cb_imu_)
+      cb_imu_(imu);
+    break;
+    }
+  // OPTICAL FLOW
+  case MAVLINK_MSG_ID_OPTICAL_FLOW: {
+    mavlink_optical_flow_t flow;
+    mavlink_msg_optical_flow_decode(&message, &flow);
+    if (cb_optical_flow_)
+      cb_optical_flow_(flow);
+    break;
+    }
+  // CAMERA IMAGE : HANDSHAKE
+  case MAVLINK_MSG_ID_DATA_TRANSMISSION_HANDSHAKE: {
+    mavlink_data_transmission_handshake_t handshake;
+    mavlink_msg_data_transmission_handshake_decode(&message, &handshake);
+    image_size_ = handshake.size;
+    image_packets_ = handshake.packets;
+    image_payload_ = handshake.payload;
+    image_width_ = handshake.width;
+    image_height_ = handshake.height;
+    if (image_buffer_.size() < image_size_)
+      image_buffer_.resize(image_size_);
+    break;
+    }
+  // CAMERA IMAGE : DATA
+  case MAVLINK_MSG_ID_ENCAPSULATED_DATA: {
+    if (image_size_ == 0 || image_packets_ == 0)
+      break;
+    mavlink_encapsulated_data_t img;
+    mavlink_msg_encapsulated_data_decode(&message, &img);
+    size_t seq = img.seqnr;
+    size_t pos = seq * image_payload_;
+    if (seq + 1 > image_packets_)
+      break;
+    size_t bytesToCopy = image_payload_;
+    if (pos + image_payload_ >= image_size_)
+       bytesToCopy = image_size_ - pos;
+    memcpy(&image_buffer_[pos], img.data, bytesToCopy);
+    if (seq + 1 == image_packets_) {
+      if (cb_camera_image_)
+        cb_camera_image_(image_buffer_, image_width_, image_height_);
+    }
+    break;
+    }
+  // SPEED ESTIMATE
+  case MAVLINK_MSG_ID_VISION_SPEED_ESTIMATE: {
+    mavlink_vision_speed_estimate_t speed;
+    mavlink_msg_vision_speed_estimate_decode(&message, &speed);
+    if (cb_speed_)
+      cb_speed_(speed);
+    break;
+    }
+  // System status
+  case MAVLINK_MSG_ID_HEARTBEAT: {
+    mavlink_heartbeat_t status;
+    mavlink_msg_heartbeat_decode(&message, &status);
+    if (cb_status_)
+      cb_status_(status);
+    break;
     }
   }
 }
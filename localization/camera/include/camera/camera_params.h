@@ -70,8 +70,19 @@ namespace camera {
 
     // Used to create a remap table. This table is the same size as the
     // UNDISTORTED image, where every pixel's value is the cooresponding pixel
-    // location in the DISTORTED image.
-    void GenerateRemapMaps(cv::Mat* remap_map);
+    // location in the DISTORTED image. With a step above one, the location
+    // is only computed every step pixels and bilinearly interpolated between.
+    void GenerateRemapMaps(cv::Mat* remap_map, int step = 1);
+
+    // Precomputes the UNDISTORTED_C location of the DISTORTED image every
+    // step pixels, so that ConvertPoints from DISTORTED or DISTORTED_C
+    // interpolates in the table instead of solving for each point. Points
+    // outside the image are still converted exactly. The interpolation error
+    // grows towards the image corners, where strong distortion bends the
+    // mapping most. The table is rebuilt when the calibration changes, and a
+    // step of zero removes it.
+    void SetUndistortionTable(int step);
+    int GetUndistortionTableStep() const;
 
     // Conversion utilities
     template <int SRC, int DEST>
@@ -79,6 +90,19 @@ namespace camera {
       throw("Please use the explicitly specified conversions by using the correct enum.");
     }
 
+    // Converts every column of input, for instance all the keypoints of an
+    // image. The undistortions from DISTORTED and DISTORTED_C are done for
+    // all the points at once. The output may be the input.
+    template <int SRC, int DEST>
+    void ConvertPoints(Eigen::Matrix2Xd const& input, Eigen::Matrix2Xd* output) const {
+      output->resize(2, input.cols());
+      Eigen::Vector2d point;
+      for (int i = 0; i < input.cols(); i++) {
+        Convert<SRC, DEST>(input.col(i), &point);
+        output->col(i) = point;
+      }
+    }
+
     // Utility to create intrinsic matrix for the correct coordinate frame
     template <int FRAME>
     Eigen::Matrix3d GetIntrinsicMatrix() const {
@@ -137,6 +161,11 @@ namespace camera {
     // Converts DISTORTED_C to UNDISTORTED_C
     void UndistortCentered(Eigen::Vector2d const& distorted_c,
                            Eigen::Vector2d* undistorted_c) const;
+    void UndistortCentered(Eigen::Matrix2Xd const& distorted_c,
+                           Eigen::Matrix2Xd* undistorted_c) const;
+    void BuildUndistortionTable();
+    void InterpolateUndistortion(Eigen::Matrix2Xd const& distorted_c,
+                                 Eigen::Matrix2Xd* undistorted_c) const;
 
     // Members
     Eigen::Vector2i
@@ -159,6 +188,11 @@ namespace camera {
     // or 5 = TSAI/OpenCV model.
     Eigen::VectorXd distortion_coeffs_;
     double distortion_precalc1_, distortion_precalc2_, distortion_precalc3_;
+
+    // UNDISTORTED_C of the DISTORTED pixels every table_step_ pixels, row by
+    // row, or empty if table_step_ is zero
+    int table_step_, table_cols_, table_rows_;
+    Eigen::Matrix2Xd undistortion_table_;
   };
 
 #define DECLARE_CONVERSION(TYPEA, TYPEB) \
@@ -176,6 +210,14 @@ namespace camera {
   DECLARE_CONVERSION(UNDISTORTED_C, DISTORTED);
 #undef DECLARE_CONVERSION
 
+#define DECLARE_POINTS_CONVERSION(TYPEA, TYPEB) \
+  template <>  \
+  void CameraParameters::ConvertPoints<TYPEA, TYPEB>(Eigen::Matrix2Xd const& input, Eigen::Matrix2Xd *output) const
+  DECLARE_POINTS_CONVERSION(DISTORTED_C, UNDISTORTED_C);
+  DECLARE_POINTS_CONVERSION(DISTORTED, UNDISTORTED_C);
+  DECLARE_POINTS_CONVERSION(DISTORTED, UNDISTORTED);
+#undef DECLARE_POINTS_CONVERSION
+
 #define DECLARE_INTRINSIC(TYPE) \
   template <>  \
   Eigen::Matrix3d CameraParameters::GetIntrinsicMatrix<TYPE>() const
@@ -28,13 +28,15 @@
 #include <opencv2/calib3d/calib3d.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include <cmath>
 #include <fstream>
 #include <iostream>
 
 camera::CameraParameters::CameraParameters(Eigen::Vector2i const& image_size,
     Eigen::Vector2d const& focal_length,
     Eigen::Vector2d const& optical_center,
-    Eigen::VectorXd const& distortion) {
+    Eigen::VectorXd const& distortion) :
+  table_step_(0), table_cols_(0), table_rows_(0) {
   SetDistortedSize(image_size);
   SetUndistortedSize(image_size);
   focal_length_ = focal_length;
@@ -44,7 +46,8 @@ camera::CameraParameters::CameraParameters(Eigen::Vector2i const& image_size,
 }
 
 camera::CameraParameters::CameraParameters(std::string const& calibration_file,
-                                           std::string const & base_dir) {
+                                           std::string const & base_dir) :
+  table_step_(0), table_cols_(0), table_rows_(0) {
   std::ifstream f(calibration_file);
   // it may be a relative path to the map file's directory
   if (!f.good() && base_dir != "") {
@@ -99,7 +102,8 @@ camera::CameraParameters::CameraParameters(std::string const& calibration_file,
   crop_offset_ = size;
 }
 
-camera::CameraParameters::CameraParameters(config_reader::ConfigReader* config, const char* name) {
+camera::CameraParameters::CameraParameters(config_reader::ConfigReader* config, const char* name) :
+  table_step_(0), table_cols_(0), table_rows_(0) {
   cv::Mat cam_mat(3, 3, CV_64F);
   Eigen::Vector2i size;
 
@@ -153,6 +157,8 @@ camera::CameraParameters::CameraParameters(config_reader::ConfigReader* config,
 void camera::CameraParameters::SetDistortedSize(Eigen::Vector2i const& image_size) {
   distorted_image_size_ = image_size;
   distorted_half_size_ = image_size.cast<double>() / 2;
+  if (table_step_ > 0)
+    BuildUndistortionTable();
 }
 
 const Eigen::Vector2i& camera::CameraParameters::GetDistortedSize() const {
@@ -186,6 +192,8 @@ const Eigen::Vector2i& camera::CameraParameters::GetCropOffset() const {
 
 void camera::CameraParameters::SetOpticalOffset(Eigen::Vector2d const& offset) {
   optical_offset_ = offset;
+  if (table_step_ > 0)
+    BuildUndistortionTable();
 }
 
 const Eigen::Vector2d& camera::CameraParameters::GetOpticalOffset() const {
@@ -194,6 +202,8 @@ const Eigen::Vector2d& camera::CameraParameters::GetOpticalOffset() const {
 
 void camera::CameraParameters::SetFocalLength(Eigen::Vector2d const& f) {
   focal_length_ = f;
+  if (table_step_ > 0)
+    BuildUndistortionTable();
 }
 
 double camera::CameraParameters::GetFocalLength() const {
@@ -232,6 +242,8 @@ void camera::CameraParameters::SetDistortion(Eigen::VectorXd const& distortion)
   default:
     LOG(FATAL) << "Recieved irregular distortion vector size. Size = " << distortion_coeffs_.size();
   }
+  if (table_step_ > 0)
+    BuildUndistortionTable();
 }
 
 const Eigen::VectorXd& camera::CameraParameters::GetDistortion() const {
@@ -331,14 +343,127 @@ void camera::CameraParameters::UndistortCentered(Eigen::Vector2d const& distorte
   }
 }
 
-void camera::CameraParameters::GenerateRemapMaps(cv::Mat* remap_map) {
+void camera::CameraParameters::UndistortCentered(Eigen::Matrix2Xd const& distorted_c,
+                                                 Eigen::Matrix2Xd *undistorted_c) const {
+  // The same as for one point, on all the columns at once
+  if (distorted_c.cols() == 0) {
+    undistorted_c->resize(2, 0);
+  } else if (distortion_coeffs_.size() == 0) {
+    // No lens distortion
+    *undistorted_c = distorted_c.colwise() - (optical_offset_ - distorted_half_size_);
+  } else if (distortion_coeffs_.size() == 1) {
+    // FOV lens distortion
+    Eigen::Array2Xd norm =
+      (distorted_c.colwise() - (optical_offset_ - distorted_half_size_)).array().colwise() / focal_length_.array();
+    Eigen::ArrayXXd rd = norm.matrix().colwise().norm().array();
+    Eigen::ArrayXXd conv = (rd > 1e-5).select((rd * distortion_coeffs_[0]).tan() / (rd * distortion_precalc2_), 1.0);
+    norm.row(0) *= conv;
+    norm.row(1) *= conv;
+    *undistorted_c = (norm.colwise() * focal_length_.array()).matrix();
+  } else if (distortion_coeffs_.size() == 4 ||
+             distortion_coeffs_.size() == 5) {
+    // Tsai lens distortion, with one call to OpenCV for all the points
+    int num_points = distorted_c.cols();
+    cv::Mat src(1, num_points, CV_64FC2);
+    cv::Mat dst(1, num_points, CV_64FC2);
+    Eigen::Map<Eigen::Matrix2Xd> src_map(src.ptr<double>(), 2, num_points),
+      dst_map(dst.ptr<double>(), 2, num_points);
+    cv::Mat dist_int_mat(3, 3, cv::DataType<double>::type),
+      undist_int_mat(3, 3, cv::DataType<double>::type);
+    cv::Mat cvdist;
+    cv::eigen2cv(distortion_coeffs_, cvdist);
+    cv::eigen2cv(GetIntrinsicMatrix<DISTORTED>(), dist_int_mat);
+    cv::eigen2cv(GetIntrinsicMatrix<UNDISTORTED>(), undist_int_mat);
+    src_map = distorted_c.colwise() + distorted_half_size_;
+    cv::undistortPoints(src, dst, dist_int_mat, cvdist, cv::Mat(), undist_int_mat);
+    *undistorted_c = dst_map.colwise() - undistorted_half_size_;
+  } else {
+    LOG(ERROR) << "Unknown distortion vector size!";
+  }
+}
+
+void camera::CameraParameters::SetUndistortionTable(int step) {
+  table_step_ = std::max(step, 0);
+  if (table_step_ > 0) {
+    BuildUndistortionTable();
+  } else {
+    table_cols_ = table_rows_ = 0;
+    undistortion_table_.resize(2, 0);
+  }
+}
+
+int camera::CameraParameters::GetUndistortionTableStep() const {
+  return table_step_;
+}
+
+void camera::CameraParameters::BuildUndistortionTable() {
+  // Enough nodes to interpolate every pixel of the image, the last ones past its edge
+  table_cols_ = (distorted_image_size_[0] - 1) / table_step_ + 2;
+  table_rows_ = (distorted_image_size_[1] - 1) / table_step_ + 2;
+  Eigen::Matrix2Xd nodes(2, table_cols_ * table_rows_);
+  for (int row = 0; row < table_rows_; row++)
+    for (int col = 0; col < table_cols_; col++)
+      nodes.col(row * table_cols_ + col) =
+        Eigen::Vector2d(col * table_step_, row * table_step_) - distorted_half_size_;
+  UndistortCentered(nodes, &undistortion_table_);
+}
+
+void camera::CameraParameters::InterpolateUndistortion(Eigen::Matrix2Xd const& distorted_c,
+                                                       Eigen::Matrix2Xd *undistorted_c) const {
+  undistorted_c->resize(2, distorted_c.cols());
+  Eigen::Vector2d point;
+  for (int i = 0; i < distorted_c.cols(); i++) {
+    Eigen::Vector2d grid = (distorted_c.col(i) + distorted_half_size_) / table_step_;
+    int col = std::floor(grid[0]), row = std::floor(grid[1]);
+    if (col < 0 || row < 0 || col >= table_cols_ - 1 || row >= table_rows_ - 1) {
+      UndistortCentered(Eigen::Vector2d(distorted_c.col(i)), &point);
+    } else {
+      double fx = grid[0] - col, fy = grid[1] - row;
+      int node = row * table_cols_ + col;
+      point = (1 - fy) * ((1 - fx) * undistortion_table_.col(node) + fx * undistortion_table_.col(node + 1)) +
+        fy * ((1 - fx) * undistortion_table_.col(node + table_cols_) +
+              fx * undistortion_table_.col(node + table_cols_ + 1));
+    }
+    undistorted_c->col(i) = point;
+  }
+}
+
+void camera::CameraParameters::GenerateRemapMaps(cv::Mat* remap_map, int step) {
   remap_map->create(undistorted_image_size_[1], undistorted_image_size_[0], CV_32FC2);
   Eigen::Vector2d undistorted, distorted;
-  for (undistorted[1] = 0; undistorted[1] < undistorted_image_size_[1]; undistorted[1]++) {
-    for (undistorted[0] = 0; undistorted[0] < undistorted_image_size_[0]; undistorted[0]++) {
-      Convert<UNDISTORTED, DISTORTED>(undistorted, &distorted);
-      remap_map->at<cv::Vec2f>(undistorted[1], undistorted[0])[0] = distorted[0];
-      remap_map->at<cv::Vec2f>(undistorted[1], undistorted[0])[1] = distorted[1];
+  if (step <= 1) {
+    for (undistorted[1] = 0; undistorted[1] < undistorted_image_size_[1]; undistorted[1]++) {
+      for (undistorted[0] = 0; undistorted[0] < undistorted_image_size_[0]; undistorted[0]++) {
+        Convert<UNDISTORTED, DISTORTED>(undistorted, &distorted);
+        remap_map->at<cv::Vec2f>(undistorted[1], undistorted[0])[0] = distorted[0];
+        remap_map->at<cv::Vec2f>(undistorted[1], undistorted[0])[1] = distorted[1];
+      }
+    }
+    return;
+  }
+
+  // The exact location every step pixels, then interpolated
+  int node_cols = (undistorted_image_size_[0] - 1) / step + 2;
+  int node_rows = (undistorted_image_size_[1] - 1) / step + 2;
+  cv::Mat nodes(node_rows, node_cols, CV_64FC2);
+  for (int row = 0; row < node_rows; row++) {
+    for (int col = 0; col < node_cols; col++) {
+      Convert<UNDISTORTED, DISTORTED>(Eigen::Vector2d(col * step, row * step), &distorted);
+      nodes.at<cv::Vec2d>(row, col) = cv::Vec2d(distorted[0], distorted[1]);
+    }
+  }
+  for (int y = 0; y < undistorted_image_size_[1]; y++) {
+    int row = y / step;
+    double fy = static_cast<double>(y - row * step) / step;
+    cv::Vec2d const* top = nodes.ptr<cv::Vec2d>(row);
+    cv::Vec2d const* bottom = nodes.ptr<cv::Vec2d>(row + 1);
+    cv::Vec2f* out = remap_map->ptr<cv::Vec2f>(y);
+    for (int x = 0; x < undistorted_image_size_[0]; x++) {
+      int col = x / step;
+      double fx = static_cast<double>(x - col * step) / step;
+      cv::Vec2d value = (1 - fy) * ((1 - fx) * top[col] + fx * top[col + 1]) +
+        fy * ((1 - fx) * bottom[col] + fx * bottom[col + 1]);
+      out[x] = cv::Vec2f(value[0], value[1]);
     }
   }
 }
@@ -389,6 +514,27 @@ namespace camera {
 
 #undef DEFINE_CONVERSION
 
+#define DEFINE_POINTS_CONVERSION(TYPEA, TYPEB) \
+  template <> \
+  void camera::CameraParameters::ConvertPoints<TYPEA, TYPEB>(Eigen::Matrix2Xd const& input, \
+                                                             Eigen::Matrix2Xd *output) const
+
+  DEFINE_POINTS_CONVERSION(DISTORTED_C, UNDISTORTED_C) {
+    if (table_step_ > 0)
+      InterpolateUndistortion(input, output);
+    else
+      UndistortCentered(input, output);
+  }
+  DEFINE_POINTS_CONVERSION(DISTORTED, UNDISTORTED_C) {
+    ConvertPoints<DISTORTED_C, UNDISTORTED_C>(input.colwise() - distorted_half_size_, output);
+  }
+  DEFINE_POINTS_CONVERSION(DISTORTED, UNDISTORTED) {
+    ConvertPoints<DISTORTED_C, UNDISTORTED_C>(input.colwise() - distorted_half_size_, output);
+    output->colwise() += undistorted_half_size_;
+  }
+
+#undef DEFINE_POINTS_CONVERSION
+
   // Helper functions to give the intrinsic matrix
 #define DEFINE_INTRINSIC(TYPE) \
   template <> \
@@ -195,3 +195,52 @@ TEST(camera_params, conversion) {
   EXPECT_NEAR(input[0], output2[0], 1e-6);
   EXPECT_NEAR(input[1], output2[1], 1e-6);
 }
+
+TEST(camera_params, batch_conversion) {
+  // Close to the nav_cam calibration
+  Eigen::VectorXd distortion(1);
+  distortion[0] = 0.993308;
+  camera::CameraParameters params(
+      Eigen::Vector2i(1280, 960),
+      Eigen::Vector2d(600.8, 599.0),
+      Eigen::Vector2d(638.5, 553.9), distortion);
+  params.SetUndistortedSize(Eigen::Vector2i(1500, 1200));
+
+  Eigen::Matrix2Xd distorted(2, 200), undistorted, undistorted_c;
+  for (int i = 0; i < distorted.cols(); i++)
+    distorted.col(i) << (i * 37) % 1280 + 0.3, (i * 53) % 960 + 0.7;
+  params.ConvertPoints<camera::DISTORTED, camera::UNDISTORTED_C>(distorted, &undistorted_c);
+  params.ConvertPoints<camera::DISTORTED, camera::UNDISTORTED>(distorted, &undistorted);
+  ASSERT_EQ(distorted.cols(), undistorted_c.cols());
+  Eigen::Vector2d output;
+  for (int i = 0; i < distorted.cols(); i++) {
+    params.Convert<camera::DISTORTED, camera::UNDISTORTED_C>(distorted.col(i), &output);
+    EXPECT_VECTOR2D_NEAR(output, undistorted_c.col(i), 1e-6);
+    params.Convert<camera::DISTORTED, camera::UNDISTORTED>(distorted.col(i), &output);
+    EXPECT_VECTOR2D_NEAR(output, undistorted.col(i), 1e-6);
+  }
+
+  // Interpolated in the table, closely near the center and roughly in the corners
+  params.SetUndistortionTable(4);
+  Eigen::Matrix2Xd interpolated = distorted;
+  params.ConvertPoints<camera::DISTORTED, camera::UNDISTORTED_C>(interpolated, &interpolated);
+  for (int i = 0; i < distorted.cols(); i++) {
+    double tolerance = ((distorted.col(i) - params.GetDistortedHalfSize()).norm() < 400 ? 0.02 : 1);
+    EXPECT_VECTOR2D_NEAR(undistorted_c.col(i), interpolated.col(i), tolerance);
+  }
+
+  // Points off the image are converted exactly
+  Eigen::Matrix2Xd outside(2, 1);
+  outside << -10, 2000;
+  params.ConvertPoints<camera::DISTORTED, camera::UNDISTORTED_C>(outside, &interpolated);
+  params.Convert<camera::DISTORTED, camera::UNDISTORTED_C>(outside.col(0), &output);
+  EXPECT_VECTOR2D_NEAR(output, interpolated.col(0), 1e-6);
+
+  // The table follows the calibration
+  params.SetFocalLength(Eigen::Vector2d(650, 650));
+  Eigen::Matrix2Xd center(2, 1);
+  center << 700.2, 500.6;
+  params.ConvertPoints<camera::DISTORTED, camera::UNDISTORTED_C>(center, &interpolated);
+  params.Convert<camera::DISTORTED, camera::UNDISTORTED_C>(center.col(0), &output);
+  EXPECT_VECTOR2D_NEAR(output, interpolated.col(0), 0.02);
+}
@@ -29,6 +29,8 @@
 
 DEFINE_string(camera_calibration, "",
               "The camera calibration file, in OpenCV's XML format.");
+DEFINE_int32(remap_step, 1,
+             "Compute the undistortion exactly every this many pixels, and interpolate between.");
 
 int main(int argc, char ** argv) {
   common::InitFreeFlyerApplication(&argc, &argv);
@@ -39,7 +41,7 @@ int main(int argc, char ** argv) {
   camera::CameraParameters cam_params(FLAGS_camera_calibration);
 
   cv::Mat floating_remap, fixed_map, interp_map;
-  cam_params.GenerateRemapMaps(&floating_remap);
+  cam_params.GenerateRemapMaps(&floating_remap, FLAGS_remap_step);
   cv::convertMaps(floating_remap, cv::Mat(),
       fixed_map, interp_map, CV_16SC2);
 
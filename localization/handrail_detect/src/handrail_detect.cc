@@ -20,7 +20,9 @@
 #include <ros/ros.h>
 
 // Shared includes
+#include <common/async_log_ros.h>
 #include <common/init.h>
+#include <common/thread.h>
 #include <config_reader/config_reader.h>
 #include <msg_conversions/msg_conversions.h>
 #include <ff_util/ff_nodelet.h>
@@ -66,6 +68,7 @@
 #include <fstream>
 #include <string>
 #include <chrono>
+#include <memory>
 
 /**
  * \ingroup localization
@@ -74,12 +77,54 @@ namespace handrail_detect {
 
 enum handrailStatus {NOT_FOUND, BOTH_ENDS, FIRST_END, SECOND_END, NO_END};
 
+// The sums over a set of points that a plane can be fit to
+struct PointMoments {
+  PointMoments() : num(0), sum(Eigen::Vector3d::Zero()), sum_sq(Eigen::Matrix3d::Zero()) {}
+
+  void Add(const geometry_msgs::Point32& point) {
+    Eigen::Vector3d p(point.x, point.y, point.z);
+    ++num;
+    sum += p;
+    sum_sq += p * p.transpose();
+  }
+  void Add(const PointMoments& other) {
+    num += other.num;
+    sum += other.sum;
+    sum_sq += other.sum_sq;
+  }
+
+  // The unit normal and centroid of the plane through the points. Returns the variance of
+  // the points along the normal.
+  double FitPlane(Eigen::Vector3d* normal, Eigen::Vector3d* centroid) const {
+    (*centroid) = sum / num;
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigensolver(sum_sq / num - (*centroid) * centroid->transpose());
+    (*normal) = eigensolver.eigenvectors().col(0);
+    return eigensolver.eigenvalues()(0);
+  }
+
+  int num;
+  Eigen::Vector3d sum;
+  Eigen::Matrix3d sum_sq;
+};
+
+// The plane fit to one block of pixels
+struct BlockPlane {
+  Eigen::Vector3d normal, centroid;
+  int index;
+};
+
+// A plane a x + b y + c z + d = 0 with (a, b, c) of unit length, or a line in the xy plane with c = 0
+struct Hypothesis {
+  float a, b, c, d;
+};
+
 class HandrailDetect : public ff_util::FreeFlyerNodelet {
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
   HandrailDetect() : ff_util::FreeFlyerNodelet(NODE_HANDRAIL_DETECT, true),
     curr_handrail_status_(NOT_FOUND), x_scale_(0.001), y_scale_(0.001), dist_to_handrail_(1.5),
-    x_step_(2), y_step_(2), depth_width_(224), depth_height_(171), frame_count_(0), max_num_handrails_(1) {
+    x_step_(2), y_step_(2), depth_width_(224), depth_height_(171), frame_count_(0), max_num_handrails_(1),
+    track_valid_(false), tracking_(false) {
     // Setup iostream precision
     std::cout << std::fixed;
     std::cout.precision(6);
@@ -183,6 +228,29 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
     if (!config_.GetReal("max_depth_dist", &max_depth_dist_))
       ROS_FATAL("Unspecified max_depth_dist.");
 
+    // Fit the plane to blocks of the organized cloud instead of RANSAC
+    if (!config_.GetBool("organized_plane", &organized_plane_))
+      ROS_FATAL("Unspecified organized_plane.");
+    if (!config_.GetInt("plane_block_size", &plane_block_size_))
+      ROS_FATAL("Unspecified plane_block_size.");
+    plane_block_size_ = std::max(plane_block_size_, 2);
+
+    // Track the handrail from frame to frame, in the pixels around the last line
+    if (!config_.GetBool("track_handrail", &track_handrail_))
+      ROS_FATAL("Unspecified track_handrail.");
+    if (!config_.GetInt("track_roi_margin", &track_roi_margin_))
+      ROS_FATAL("Unspecified track_roi_margin.");
+
+    // Score the RANSAC hypotheses in batches on worker threads
+    if (!config_.GetBool("parallel_ransac", &parallel_ransac_))
+      ROS_FATAL("Unspecified parallel_ransac.");
+    int ransac_threads;
+    if (!config_.GetInt("ransac_threads", &ransac_threads))
+      ROS_FATAL("Unspecified ransac_threads.");
+    ransac_threads = std::max(ransac_threads, 1);
+    if (parallel_ransac_ && (!ransac_pool_ || static_cast<int>(ransac_pool_->NumThreads()) != ransac_threads))
+      ransac_pool_.reset(new common::ThreadPool(ransac_threads));
+
     // Maximum RANSAC iteration for line estimation
     if (!config_.GetInt("RANSAC_line_iteration", &RANSAC_line_iteration_))
       ROS_FATAL("Unspecified RANSAC_line_iteration.");
@@ -277,11 +345,11 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
   void PointCloud2Callback(const sensor_msgs::PointCloud2ConstPtr& depth_msg) {
     // Convert from pointcloud2 to pointcloud for easy access of the point cloud
     sensor_msgs::convertPointCloud2ToPointCloud(*depth_msg, cloud_);
-    HandrailCallback();
+    HandrailCallback(depth_msg);
   }
 
   // Performs handrail detection
-  void HandrailCallback() {
+  void HandrailCallback(const sensor_msgs::PointCloud2ConstPtr& depth_msg) {
     // Publish registration
     ff_msgs::CameraRegistration r;
     ros::Time timestamp = ros::Time::now();
@@ -299,7 +367,19 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
     if (disp_pcd_and_tf_)
       PublishTF(r2i_, body_frame_, perch_image_frame_);
 
-    if (!FindHandrail()) {
+    // Track from the last frame's handrail if there is one, and search the whole cloud if that fails
+    bool found = false;
+    if (track_handrail_ && track_valid_) {
+      found = FindHandrail(true);
+      // The search changes the cloud, so start again from the message
+      if (!found)
+        sensor_msgs::convertPointCloud2ToPointCloud(*depth_msg, cloud_);
+    }
+    if (!found)
+      found = FindHandrail(false);
+    track_valid_ = found;
+
+    if (!found) {
       curr_handrail_status_ = NOT_FOUND;
       if (disp_marker_)
         PublishNoMarker();
@@ -318,12 +398,14 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
     ++frame_count_;              // Increment the camera id
   }
 
-  // Code that locates the handrail in the points
-  bool FindHandrail() {
+  // Code that locates the handrail in the points. When tracking, the plane and line that were
+  // found last are tried first, and the line is only searched for near the last one.
+  bool FindHandrail(bool track) {
+    tracking_ = track;
     std::vector<int> downsample_points;
     if (!DownsamplePoints(&downsample_points)) {  // Get downsampled points
-      ROS_ERROR("[Handrail] downsample points are less than 1 percent of the pcd: %d",
-                static_cast<int>(downsample_points.size()));
+      ASYNC_ROS_ERROR_THROTTLE(1.0, "[Handrail] downsample points are less than 1 percent of the pcd: %d",
+                               static_cast<int>(downsample_points.size()));
       return false;
     }
     PublishCloud(downsample_points, cloud_, &cloud_pub_[0]);
@@ -336,7 +418,7 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
     // Find a plane first, and then find a line from points that are apart from the plane with a certain dist
     if (!FindPlane(downsample_points, cloud_, &plane_inliers, &plane_outliers,
                    &plane_parameter, &plane_vector, &plane_vector_length)) {
-      ROS_WARN("[Handrail] No plane found");
+      ASYNC_ROS_WARN_THROTTLE(1.0, "[Handrail] No plane found");
       PublishCloud(plane_inliers, cloud_, &cloud_pub_[1]);
       PublishCloud(plane_outliers, cloud_, &cloud_pub_[2]);
       return false;
@@ -346,6 +428,18 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
     PublishCloud(plane_inliers, cloud_, &cloud_pub_[1]);
     PublishCloud(plane_outliers, cloud_, &cloud_pub_[2]);
 
+    // Only look for the line in the pixels around the last one
+    if (tracking_) {
+      std::vector<int> roi_outliers;
+      roi_outliers.reserve(plane_outliers.size());
+      for (auto const& itr : plane_outliers) {
+        int u = itr % depth_width_, v = itr / depth_width_;
+        if (u >= track_roi_[0] && u <= track_roi_[1] && v >= track_roi_[2] && v <= track_roi_[3])
+          roi_outliers.push_back(itr);
+      }
+      plane_outliers.swap(roi_outliers);
+    }
+
     Eigen::Vector3f line_vector = Eigen::Vector3f::Zero();
     Eigen::Vector3f line_center = Eigen::Vector3f::Zero();
 
@@ -353,7 +447,7 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
     std::vector<int> line_inliers;
     if (!FindLine(plane_outliers, plane_parameter, plane_vector, plane_vector_length,
                   &line_vector, &line_center, &line_inliers)) {
-      ROS_WARN("[Handrail] No handrail found");
+      ASYNC_ROS_WARN_THROTTLE(1.0, "[Handrail] No handrail found");
       if (disp_marker_) {
         std::vector<int> no_pnt;
         PublishCloud(no_pnt, cloud_, &cloud_pub_[9]);
@@ -374,6 +468,19 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
     // Get features from line inliers and plane inliers
     GetFeaturePoints(plane_inliers, line_inliers);
 
+    // Keep the solution to track from in the next frame
+    track_plane_ = plane_parameter;
+    track_line_vector_ = line_vector;
+    track_line_center_ = line_center;
+    track_roi_ = {depth_width_, -1, depth_height_, -1};
+    for (auto const& itr : line_inliers) {
+      int u = itr % depth_width_, v = itr / depth_width_;
+      track_roi_[0] = std::min(track_roi_[0], u - track_roi_margin_);
+      track_roi_[1] = std::max(track_roi_[1], u + track_roi_margin_);
+      track_roi_[2] = std::min(track_roi_[2], v - track_roi_margin_);
+      track_roi_[3] = std::max(track_roi_[3], v + track_roi_margin_);
+    }
+
     Eigen::Quaternionf rtoq(i2h.linear());
     dl_.local_pose.position.x = i2h.translation()(0);
     dl_.local_pose.position.y = i2h.translation()(1);
@@ -429,12 +536,9 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
     return true;
   }
 
-  bool FindPlane(const std::vector<int>& downsample_points,
-                                 const sensor_msgs::PointCloud& filtered_cloud,
-                                 std::vector<int>* plane_inliers, std::vector<int>* plane_outliers,
-                                 Eigen::Vector4f* plane_parameter, Eigen::Vector3f* plane_vector,
-                                 float* plane_vector_length) {
-    std::vector<int> potential_plane_outliers;
+  void FindPlaneRansac(const std::vector<int>& downsample_points, const sensor_msgs::PointCloud& filtered_cloud,
+                       std::vector<int>* plane_inliers, std::vector<int>* potential_plane_outliers,
+                       Eigen::Vector4f* plane_parameter) {
     // Find plane using RANSAC
     // Set the minimum point numbers for the plane
     int plane_size_thres = downsample_points.size() * pcd_plane_rate_;
@@ -492,7 +596,7 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
         int curr_size = tmp_inliers.size();
         *plane_inliers = tmp_inliers;
         *plane_parameter = tmp_plane_parameter;
-        potential_plane_outliers = tmp_outliers;
+        *potential_plane_outliers = tmp_outliers;
 
         // Stop iteration if the plane has enough points or it converges
         if (curr_size > max_thres) {
@@ -505,11 +609,233 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
         }
       }
     }
+  }
+
+  // The same RANSAC as FindPlaneRansac, with the same samples and the same stopping rule, except that
+  // all the hypotheses are sampled first and then scored together by ScoreHypotheses.
+  void FindPlaneRansacParallel(const std::vector<int>& downsample_points,
+                               const sensor_msgs::PointCloud& filtered_cloud, std::vector<int>* plane_inliers,
+                               std::vector<int>* potential_plane_outliers, Eigen::Vector4f* plane_parameter) {
+    int plane_size_thres = downsample_points.size() * pcd_plane_rate_;
+    int r1, r2, r3, num_data = downsample_points.size();
+    int diff_thres = plane_size_thres / 20;
+    int max_thres = static_cast<int>(num_data * 0.7);
+    Eigen::MatrixX4f A(3, 4);
+    Eigen::Matrix4f ATA;
+
+    hypotheses_.clear();
+    hypothesis_iterations_.clear();
+    for (int i = 0; i < RANSAC_plane_iteration_; ++i) {
+      do {
+        r1 = rand_r(&seed_) % num_data;
+        r2 = rand_r(&seed_) % num_data;
+        r3 = rand_r(&seed_) % num_data;
+      } while (r1 == r2 || r1 == r3 || r2 == r3);
+      int ID1 = downsample_points[r1], ID2 = downsample_points[r2], ID3 = downsample_points[r3];
+      A << filtered_cloud.points[ID1].x, filtered_cloud.points[ID1].y, filtered_cloud.points[ID1].z, 1,
+      filtered_cloud.points[ID2].x, filtered_cloud.points[ID2].y, filtered_cloud.points[ID2].z, 1,
+      filtered_cloud.points[ID3].x, filtered_cloud.points[ID3].y, filtered_cloud.points[ID3].z, 1;
+      ATA = A.transpose() * A;
+      Eigen::SelfAdjointEigenSolver<Eigen::Matrix4f> eigensolver(ATA);
+      Eigen::Vector4f tmp_plane_parameter = eigensolver.eigenvectors().col(0);
+      if (fabs(tmp_plane_parameter(2)) < fabs(tmp_plane_parameter(0)) + fabs(tmp_plane_parameter(1)))
+        continue;
+      // Scaled so that the residual is the distance, as FindPlaneRansac divides by the normal length
+      tmp_plane_parameter /= tmp_plane_parameter.head<3>().norm();
+      hypotheses_.push_back({tmp_plane_parameter(0), tmp_plane_parameter(1), tmp_plane_parameter(2),
+                             tmp_plane_parameter(3)});
+      hypothesis_iterations_.push_back(i);
+    }
+    if (hypotheses_.empty())
+      return;
+    SetRansacPoints(downsample_points, filtered_cloud, true);
+    ScoreHypotheses(RANSAC_plane_thres_);
+
+    // Replay the choice FindPlaneRansac makes one iteration at a time
+    int best = -1, best_size = 0;
+    for (int h = 0; h < static_cast<int>(hypothesis_iterations_.size()); ++h) {
+      int curr_size = hypothesis_counts_[h];
+      if (curr_size <= best_size)
+        continue;
+      int prev_size = best_size;
+      best = h;
+      best_size = curr_size;
+      if (curr_size > max_thres)
+        break;
+      else if (hypothesis_iterations_[h] > RANSAC_plane_iteration_ / 2 && curr_size > plane_size_thres
+               && curr_size - prev_size < diff_thres)
+        break;
+    }
+    if (best < 0)
+      return;
+    (*plane_parameter) << hypotheses_[best].a, hypotheses_[best].b, hypotheses_[best].c, hypotheses_[best].d;
+    SplitPlanePoints(*plane_parameter, downsample_points, filtered_cloud, plane_inliers, potential_plane_outliers);
+  }
+
+  // Copies the points into the contiguous arrays ScoreHypotheses reads, with z zero for lines
+  void SetRansacPoints(const std::vector<int>& points, const sensor_msgs::PointCloud& filtered_cloud,
+                       bool with_z) {
+    ransac_x_.resize(points.size());
+    ransac_y_.resize(points.size());
+    ransac_z_.resize(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+      ransac_x_[i] = filtered_cloud.points[points[i]].x;
+      ransac_y_[i] = filtered_cloud.points[points[i]].y;
+      ransac_z_[i] = with_z ? filtered_cloud.points[points[i]].z : 0;
+    }
+  }
+
+  // Counts the points within thres of each hypothesis into hypothesis_counts_. The hypotheses are
+  // scored four to a pass over the points, in a loop simple enough for the compiler to vectorize,
+  // and the batches of four are spread over the worker threads.
+  void ScoreHypotheses(float thres) {
+    int num_hypotheses = hypotheses_.size();
+    int num_batches = (num_hypotheses + 3) / 4;
+    // Padded with hypotheses no point is near
+    hypotheses_.resize(4 * num_batches, {0, 0, 0, 2 * thres});
+    hypothesis_counts_.assign(4 * num_batches, 0);
+    int num_tasks = std::min(num_batches, static_cast<int>(ransac_pool_->NumThreads()));
+    for (int t = 0; t < num_tasks; ++t) {
+      int begin = num_batches * t / num_tasks, end = num_batches * (t + 1) / num_tasks;
+      ransac_pool_->AddTask([this, begin, end, thres]() { ScoreBatches(begin, end, thres); });
+    }
+    ransac_pool_->Join();
+    hypotheses_.resize(num_hypotheses);
+  }
+
+  void ScoreBatches(int begin, int end, float thres) {
+    const float* x = ransac_x_.data();
+    const float* y = ransac_y_.data();
+    const float* z = ransac_z_.data();
+    int num_points = ransac_x_.size();
+    for (int batch = begin; batch < end; ++batch) {
+      float a[4], b[4], c[4], d[4];
+      int count[4] = {0, 0, 0, 0};
+      for (int k = 0; k < 4; ++k) {
+        const Hypothesis& h = hypotheses_[4 * batch + k];
+        a[k] = h.a;
+        b[k] = h.b;
+        c[k] = h.c;
+        d[k] = h.d;
+      }
+      for (int i = 0; i < num_points; ++i)
+        for (int k = 0; k < 4; ++k)
+          count[k] += fabsf(a[k] * x[i] + b[k] * y[i] + c[k] * z[i] + d[k]) < thres;
+      for (int k = 0; k < 4; ++k)
+        hypothesis_counts_[4 * batch + k] = count[k];
+    }
+  }
+
+  // Finds the plane from the organized cloud instead of by RANSAC. The points are summed in square
+  // blocks of pixels, and each block flat enough to be part of a plane proposes the plane through
+  // it. The plane that passes through the most points of these blocks is refit to their sums, and
+  // the points are split into inliers and potential outliers once, as RANSAC does for its best
+  // plane. Returns false if no block is flat.
+  bool FindPlaneOrganized(const std::vector<int>& downsample_points, const sensor_msgs::PointCloud& filtered_cloud,
+                          std::vector<int>* plane_inliers, std::vector<int>* potential_plane_outliers,
+                          Eigen::Vector4f* plane_parameter) {
+    int block_cols = (depth_width_ + plane_block_size_ - 1) / plane_block_size_;
+    int block_rows = (depth_height_ + plane_block_size_ - 1) / plane_block_size_;
+    block_moments_.assign(block_cols * block_rows, PointMoments());
+    for (auto const& itr : downsample_points) {
+      int block = (itr / depth_width_ / plane_block_size_) * block_cols + (itr % depth_width_) / plane_block_size_;
+      block_moments_[block].Add(filtered_cloud.points[itr]);
+    }
+
+    // Fit a plane to each block with at least a quarter of its samples, keeping those with as
+    // little spread off the plane as the RANSAC threshold and facing the camera as RANSAC requires
+    int min_block_points = std::max(3, plane_block_size_ * plane_block_size_ / (4 * x_step_ * y_step_));
+    double max_variance = 0.25 * RANSAC_plane_thres_ * RANSAC_plane_thres_;
+    block_planes_.clear();
+    for (int i = 0; i < static_cast<int>(block_moments_.size()); ++i) {
+      BlockPlane block;
+      if (block_moments_[i].num < min_block_points ||
+          block_moments_[i].FitPlane(&block.normal, &block.centroid) > max_variance)
+        continue;
+      if (fabs(block.normal(2)) < fabs(block.normal(0)) + fabs(block.normal(1)))
+        continue;
+      block.index = i;
+      block_planes_.push_back(block);
+    }
+    if (block_planes_.empty())
+      return false;
+
+    // Choose the plane through the most points of the other blocks
+    int best = 0, best_support = 0;
+    for (int i = 0; i < static_cast<int>(block_planes_.size()); ++i) {
+      int support = 0;
+      for (auto const& other : block_planes_)
+        if (fabs(block_planes_[i].normal.dot(other.centroid - block_planes_[i].centroid)) < RANSAC_plane_thres_)
+          support += block_moments_[other.index].num;
+      if (support > best_support) {
+        best = i;
+        best_support = support;
+      }
+    }
+    PointMoments plane_moments;
+    for (auto const& other : block_planes_)
+      if (fabs(block_planes_[best].normal.dot(other.centroid - block_planes_[best].centroid)) < RANSAC_plane_thres_)
+        plane_moments.Add(block_moments_[other.index]);
+    Eigen::Vector3d normal, centroid;
+    plane_moments.FitPlane(&normal, &centroid);
+    // Scaled to unit length, as the eigenvectors RANSAC finds
+    (*plane_parameter) << normal.cast<float>(), static_cast<float>(-normal.dot(centroid));
+    (*plane_parameter) /= plane_parameter->norm();
+
+    SplitPlanePoints(*plane_parameter, downsample_points, filtered_cloud, plane_inliers, potential_plane_outliers);
+    return true;
+  }
+
+  // Splits the points into the inliers and the outliers of a plane, with the same test as RANSAC
+  void SplitPlanePoints(const Eigen::Vector4f& plane_parameter, const std::vector<int>& downsample_points,
+                        const sensor_msgs::PointCloud& filtered_cloud, std::vector<int>* plane_inliers,
+                        std::vector<int>* plane_outliers) {
+    plane_inliers->reserve(downsample_points.size());
+    plane_outliers->reserve(downsample_points.size());
+    Eigen::Vector4f pnt_homo;
+    for (auto const& itr : downsample_points) {
+      pnt_homo << filtered_cloud.points[itr].x, filtered_cloud.points[itr].y, filtered_cloud.points[itr].z, 1;
+      if (fabs(pnt_homo.dot(plane_parameter)) < RANSAC_plane_thres_)
+        plane_inliers->push_back(itr);
+      else
+        plane_outliers->push_back(itr);
+    }
+  }
+
+  bool FindPlane(const std::vector<int>& downsample_points,
+                                 const sensor_msgs::PointCloud& filtered_cloud,
+                                 std::vector<int>* plane_inliers, std::vector<int>* plane_outliers,
+                                 Eigen::Vector4f* plane_parameter, Eigen::Vector3f* plane_vector,
+                                 float* plane_vector_length) {
+    std::vector<int> potential_plane_outliers;
+    int plane_size_thres = downsample_points.size() * pcd_plane_rate_;
+    // When tracking, the last frame's plane is kept if it still has enough points
+    bool found = false;
+    if (tracking_) {
+      *plane_parameter = track_plane_;
+      SplitPlanePoints(*plane_parameter, downsample_points, filtered_cloud, plane_inliers, &potential_plane_outliers);
+      found = static_cast<int>(plane_inliers->size()) >= plane_size_thres;
+    }
+    if (!found && organized_plane_) {
+      plane_inliers->clear();
+      potential_plane_outliers.clear();
+      found = FindPlaneOrganized(downsample_points, filtered_cloud, plane_inliers, &potential_plane_outliers,
+                                 plane_parameter);
+    }
+    if (!found) {
+      plane_inliers->clear();
+      potential_plane_outliers.clear();
+      if (parallel_ransac_)
+        FindPlaneRansacParallel(downsample_points, filtered_cloud, plane_inliers, &potential_plane_outliers,
+                                plane_parameter);
+      else
+        FindPlaneRansac(downsample_points, filtered_cloud, plane_inliers, &potential_plane_outliers, plane_parameter);
+    }
 
     // If the number of plane points is less than a threshold, discard the result
     if (static_cast<int>(plane_inliers->size()) < plane_size_thres) {
-      std::cout << "[1] Small plane points: " << static_cast<int>(plane_inliers->size())
-                << " thres = " << plane_size_thres << std::endl;
+      ASYNC_ROS_INFO_STREAM_THROTTLE(1.0, "[1] Small plane points: " << static_cast<int>(plane_inliers->size())
+                                     << " thres = " << plane_size_thres);
       return false;
     }
     // std::cout << "plane points: " << static_cast<int>(plane_inliers->size()) << std::endl;
@@ -991,17 +1317,45 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
     std::array<float, 2> both_line_angs = {M_PI_2, 0};
     int r1, r2, ID1, ID2;
     float m_pi_8 = M_PI / 8.0;
+    // Sample all the lines first, so that in parallel mode they can be scored together
+    line_samples_.clear();
     for (int i = 0; i < RANSAC_line_iteration_; ++i) {
-      do {
-        r1 = rand_r(&seed_) % num_potential_data;
-        r2 = rand_r(&seed_) % num_potential_data;
-      } while (r1 == r2);
-      ID1 = potential_line_inliers[r1];
-      ID2 = potential_line_inliers[r2];
-
-      // Set z value to zero for xy plane line estimation
-      fst_line_point << filtered_cloud.points[ID1].x, filtered_cloud.points[ID1].y, 0;
-      scd_line_point << filtered_cloud.points[ID2].x, filtered_cloud.points[ID2].y, 0;
+      if (i == 0 && tracking_) {
+        // The first hypothesis is the last frame's line
+        scd_line_point << track_line_center_(0), track_line_center_(1), 0;
+        fst_line_point << scd_line_point(0) + track_line_vector_(0), scd_line_point(1) + track_line_vector_(1), 0;
+      } else {
+        do {
+          r1 = rand_r(&seed_) % num_potential_data;
+          r2 = rand_r(&seed_) % num_potential_data;
+        } while (r1 == r2);
+        ID1 = potential_line_inliers[r1];
+        ID2 = potential_line_inliers[r2];
+
+        // Set z value to zero for xy plane line estimation
+        fst_line_point << filtered_cloud.points[ID1].x, filtered_cloud.points[ID1].y, 0;
+        scd_line_point << filtered_cloud.points[ID2].x, filtered_cloud.points[ID2].y, 0;
+      }
+      line_samples_.push_back(fst_line_point);
+      line_samples_.push_back(scd_line_point);
+    }
+    if (parallel_ransac_) {
+      // The line through s along the unit vector v is v.y x - v.x y + v.x s.y - v.y s.x = 0
+      hypotheses_.clear();
+      for (int i = 0; i < RANSAC_line_iteration_; ++i) {
+        tmp_line_vector = line_samples_[2 * i] - line_samples_[2 * i + 1];
+        tmp_line_vector /= tmp_line_vector.norm();
+        const Eigen::Vector3f& s = line_samples_[2 * i + 1];
+        hypotheses_.push_back({tmp_line_vector(1), -tmp_line_vector(0), 0,
+                               tmp_line_vector(0) * s(1) - tmp_line_vector(1) * s(0)});
+      }
+      SetRansacPoints(potential_line_inliers, filtered_cloud, false);
+      ScoreHypotheses(RANSAC_line_thres_);
+    }
+
+    for (int i = 0; i < RANSAC_line_iteration_; ++i) {
+      fst_line_point = line_samples_[2 * i];
+      scd_line_point = line_samples_[2 * i + 1];
       tmp_line_vector = fst_line_point - scd_line_point;
       tmp_line_vector /= tmp_line_vector.norm();
 
@@ -1009,16 +1363,23 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
       // The dist between a line that passes x1 and x2 and a point x0 is defined as
       // d = |(x1 - x2) cross (x2 - x0)| / |(x1 - x2)|
       std::vector<int> tmp_line_inliers;
-      tmp_line_inliers.reserve(num_potential_data);
-      for (auto const& itr : potential_line_inliers) {
-        // Set z value to zero for xy plane line estimation
-        potential_point << filtered_cloud.points[itr].x, filtered_cloud.points[itr].y, 0;
-        point_diff = scd_line_point - potential_point;
-        if ((tmp_line_vector.cross(point_diff)).norm() < RANSAC_line_thres_)
-          tmp_line_inliers.push_back(itr);
+      int num_line_inliers;
+      if (parallel_ransac_) {
+        // Already counted, the inliers are only gathered for the lines that are kept
+        num_line_inliers = hypothesis_counts_[i];
+      } else {
+        tmp_line_inliers.reserve(num_potential_data);
+        for (auto const& itr : potential_line_inliers) {
+          // Set z value to zero for xy plane line estimation
+          potential_point << filtered_cloud.points[itr].x, filtered_cloud.points[itr].y, 0;
+          point_diff = scd_line_point - potential_point;
+          if ((tmp_line_vector.cross(point_diff)).norm() < RANSAC_line_thres_)
+            tmp_line_inliers.push_back(itr);
+        }
+        num_line_inliers = tmp_line_inliers.size();
       }
 
-      if (static_cast<int>(tmp_line_inliers.size()) < min_line_size_thres)
+      if (num_line_inliers < min_line_size_thres)
         continue;
 
       float tmp_line_ang = atan2(fabs(tmp_line_vector(0)), fabs(tmp_line_vector(1)));
@@ -1029,7 +1390,14 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
           continue;
         idx = 1;
       }
-      if (tmp_line_inliers.size() > both_line_inliers[idx].size()) {
+      if (num_line_inliers > static_cast<int>(both_line_inliers[idx].size())) {
+        if (parallel_ransac_) {
+          const Hypothesis& h = hypotheses_[i];
+          tmp_line_inliers.reserve(num_line_inliers);
+          for (int j = 0; j < num_potential_data; ++j)
+            if (fabsf(h.a * ransac_x_[j] + h.b * ransac_y_[j] + h.d) < RANSAC_line_thres_)
+              tmp_line_inliers.push_back(potential_line_inliers[j]);
+        }
         both_line_inliers[idx] = tmp_line_inliers;
         both_line_vectors[idx] = tmp_line_vector;
         both_line_angs[idx] = tmp_line_ang;
@@ -1136,7 +1504,7 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
     int line_size_thres = ((handrail_min_length * handrail_width_ * 0.5) /
                            (3.0 * x_scale_ * x_step_ * y_scale_ * y_step_));
     if (line_size_thres <= 0) {
-      std::cout << "[Line Fail 0] line thres is not positive: " << line_size_thres << std::endl;
+      ASYNC_ROS_INFO_STREAM_THROTTLE(1.0, "[Line Fail 0] line thres is not positive: " << line_size_thres);
       return false;
     }
 
@@ -1147,15 +1515,15 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
     std::vector<int> potential_line_inliers;
     if (!FindPotentialLinePoints(plane_outliers, plane_parameter, plane_vector, line_size_thres, plane_vector_length,
                                  &potential_line_inliers)) {
-      std::cout << "[Line Fail 1] no potential line inliers\n";
-      std::cout << "[fail] line size/thres: " << potential_line_inliers.size() << "/" << line_size_thres << std::endl;
+      ASYNC_ROS_INFO_STREAM_THROTTLE(1.0, "[Line Fail 1] no potential line inliers, line size/thres: "
+                                     << potential_line_inliers.size() << "/" << line_size_thres);
       return false;
     }
     if (disp_computation_time_) {
       std::chrono::high_resolution_clock::time_point t_potential_end = std::chrono::high_resolution_clock::now();
       auto potential_time = std::chrono::duration_cast<std::chrono::microseconds>(t_potential_end - t_strt).count();
       float potential_time_ms = static_cast<float>(potential_time) * 0.001;
-      std::cout << "[Line] potential time: "<< potential_time_ms << std::endl;
+      ASYNC_ROS_INFO_STREAM("[Line] potential time: " << potential_time_ms);
     }
 
     if (!FilterCloud(potential_line_inliers, &cloud_))
@@ -1166,14 +1534,14 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
     std::array<std::vector<int>, 2> best_line_inliers;
     if (!FindBestLinePoints(potential_line_inliers, line_size_thres, plane_vector,
                             &cloud_, &best_line_inliers)) {
-      ROS_WARN("[Handrail] [Line Fail 2] no best line inliers");
+      ASYNC_ROS_WARN_THROTTLE(1.0, "[Handrail] [Line Fail 2] no best line inliers");
       return false;
     }
     if (disp_computation_time_) {
       std::chrono::high_resolution_clock::time_point t_best_end = std::chrono::high_resolution_clock::now();
       auto best_time = std::chrono::duration_cast<std::chrono::microseconds>(t_best_end - t_strt).count();
       float best_time_ms = static_cast<float>(best_time) * 0.001;
-      std::cout << "[Line] ransac time: "<< best_time_ms << std::endl;
+      ASYNC_ROS_INFO_STREAM("[Line] ransac time: " << best_time_ms);
     }
 
     PublishCloud(best_line_inliers[0], cloud_, &cloud_pub_[5]);
@@ -1182,9 +1550,9 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
     t_strt = std::chrono::high_resolution_clock::now();
     std::array<std::vector<int>, 2> group_line_inliers;
     if (!ClusterLinePoints(best_line_inliers, plane_parameter, cloud_, line_size_thres, &group_line_inliers)) {
-      ROS_WARN("[Handrail] [Line Fail 3] no filtered line inliers");
-      std::cout << "Inp: " << best_line_inliers[0].size() << "/"  << best_line_inliers[1].size() << std::endl;
-      std::cout << "Out: " << group_line_inliers[0].size() << "/"  << group_line_inliers[1].size() << std::endl;
+      ASYNC_ROS_WARN_STREAM_THROTTLE(1.0, "[Handrail] [Line Fail 3] no filtered line inliers, inp: "
+                                     << best_line_inliers[0].size() << "/" << best_line_inliers[1].size() << ", out: "
+                                     << group_line_inliers[0].size() << "/" << group_line_inliers[1].size());
       return false;
     }
 
@@ -1233,12 +1601,12 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
     PublishCloud(clustered_line_inliers, cloud_, &cloud_pub_[9]);
 
     if (clustered_line_inliers.size() == 0) {
-      ROS_WARN("[Handrail] [Line Fail 4] Handrail length is too short: %f/%f", handrail_length_,
-               handrail_min_length);
+      ASYNC_ROS_WARN_THROTTLE(1.0, "[Handrail] [Line Fail 4] Handrail length is too short: %f/%f", handrail_length_,
+                              handrail_min_length);
       return false;
     } else if (handrail_length_ > 1.3 * fix_handrail_length_) {
-      ROS_WARN("[Handrail] [Line Fail 5] Handrail length is too long: %f/%f", handrail_length_,
-               1.3 * fix_handrail_length_);
+      ASYNC_ROS_WARN_THROTTLE(1.0, "[Handrail] [Line Fail 5] Handrail length is too long: %f/%f", handrail_length_,
+                              1.3 * fix_handrail_length_);
       return false;
     }
 
@@ -1322,7 +1690,7 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
       std::chrono::high_resolution_clock::time_point t_cluster_end = std::chrono::high_resolution_clock::now();
       auto cluster_time = std::chrono::duration_cast<std::chrono::microseconds>(t_cluster_end - t_strt).count();
       float cluster_time_ms = static_cast<float>(cluster_time) * 0.001;
-      std::cout << "[Line] cluster time: "<< cluster_time_ms << std::endl;
+      ASYNC_ROS_INFO_STREAM("[Line] cluster time: " << cluster_time_ms);
     }
 
     t_strt = std::chrono::high_resolution_clock::now();
@@ -1333,7 +1701,7 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
       std::chrono::high_resolution_clock::time_point t_corner_end = std::chrono::high_resolution_clock::now();
       auto corner_time = std::chrono::duration_cast<std::chrono::microseconds>(t_corner_end - t_strt).count();
       float corner_time_ms = static_cast<float>(corner_time) * 0.001;
-      std::cout << "[Line] corner time: "<< corner_time_ms << std::endl;
+      ASYNC_ROS_INFO_STREAM("[Line] corner time: " << corner_time_ms);
     }
     dist_to_handrail_ = std::min(std::max((*line_center)(2), min_depth_dist_), max_depth_dist_);
     return true;
@@ -1717,30 +2085,31 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
   void PrintHandrailStatus(const handrailStatus& prev_status,
       const handrailStatus& curr_status) {
     std::array<handrailStatus, 2> tmp_status = {prev_status, curr_status};
+    std::string status;
     int status_cnt = 0;
     for (auto const& itr_status : tmp_status) {
       switch (itr_status) {
       case NOT_FOUND:
-        std::cout << "NOT_FOUND";
+        status += "NOT_FOUND";
         break;
       case BOTH_ENDS:
-        std::cout << "BOTH_ENDS";
+        status += "BOTH_ENDS";
         break;
       case FIRST_END:
-        std::cout << "FIRST_END";
+        status += "FIRST_END";
         break;
       case SECOND_END:
-        std::cout << "SECOND_END";
+        status += "SECOND_END";
         break;
       case NO_END:
-        std::cout << "NO_END";
+        status += "NO_END";
         break;
       }
       ++status_cnt;
       if (status_cnt < static_cast<int>(tmp_status.size()))
-        std::cout << " -> ";
+        status += " -> ";
     }
-    std::cout << std::endl;
+    ASYNC_ROS_INFO_STREAM(status);
   }
 
   void ConvertRotMatToEuler(const Eigen::Matrix3f& r_mat, Eigen::Vector3f* euler) {
@@ -1792,6 +2161,14 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
   float RANSAC_line_thres_;
   float RANSAC_plane_thres_;
 
+  // Organized plane fitting
+  bool organized_plane_;
+  int plane_block_size_;
+
+  // Tracking
+  bool track_handrail_;
+  int track_roi_margin_;
+
   // Frame name
   std::string body_frame_;
   std::string handrail_frame_;
@@ -1840,6 +2217,24 @@ class HandrailDetect : public ff_util::FreeFlyerNodelet {
   int max_num_handrails_;
 
   Eigen::Affine3f r2h_center_;
+
+  // Kept to reuse the memory from frame to frame
+  std::vector<PointMoments> block_moments_;
+  std::vector<BlockPlane> block_planes_;
+
+  // The points and hypotheses of the parallel RANSAC, and the threads that score them
+  bool parallel_ransac_;
+  std::unique_ptr<common::ThreadPool> ransac_pool_;
+  std::vector<float> ransac_x_, ransac_y_, ransac_z_;
+  std::vector<Hypothesis> hypotheses_;
+  std::vector<int> hypothesis_iterations_, hypothesis_counts_;
+  std::vector<Eigen::Vector3f> line_samples_;
+
+  // The handrail found in the last frame, and whether it is being tracked from now
+  bool track_valid_, tracking_;
+  Eigen::Vector4f track_plane_;
+  Eigen::Vector3f track_line_vector_, track_line_center_;
+  std::array<int, 4> track_roi_;  // u min, u max, v min, v max
 };
 
 PLUGINLIB_DECLARE_CLASS(handrail_detect, HandrailDetect,
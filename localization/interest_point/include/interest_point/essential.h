@@ -26,7 +26,10 @@
 namespace interest_point {
 
   // Performs a robust, ransac, solving for the essential matrix
-  // between interest point measurements in x1 and x2.
+  // between interest point measurements in x1 and x2. With
+  // --essential_sprt, precision is a fixed threshold in pixels on the
+  // Sampson error instead of the bound on the AC-RANSAC one, and
+  // error_max is the largest error of an inlier.
   bool RobustEssential(Eigen::Matrix3d const& k1, Eigen::Matrix3d const& k2,
                        Eigen::Matrix2Xd const& x1, Eigen::Matrix2Xd const& x2,
                        Eigen::Matrix3d * e,
@@ -0,0 +1,68 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef INTEREST_POINT_HAMMING_H_
+#define INTEREST_POINT_HAMMING_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace interest_point {
+
+  /**
+   * Number of differing bits between two binary descriptors of
+   * num_bytes bytes. Uses NEON or AVX2 when compiled for them, and
+   * 64 bit popcounts otherwise.
+   **/
+  int HammingDistance(const uint8_t* a, const uint8_t* b, int num_bytes);
+
+  /**
+   * The first of num_train descriptors nearest to query, or -1 if
+   * num_train is zero, with its distance in distance if not null. Row
+   * t starts at train + t * train_stride. Keeps the query in vector
+   * registers across the rows for descriptors up to 64 bytes, the
+   * size of BRISK's.
+   **/
+  int HammingNearest(const uint8_t* query, const uint8_t* train, int num_train, int train_stride,
+                     int num_bytes, int* distance);
+
+  struct HammingMatch {
+    int query;
+    int train;
+    int distance;
+  };
+
+  /**
+   * Exact brute force matching of binary descriptors. Row i of query
+   * starts at query + i * query_stride, likewise for train. Every
+   * query and train pair is compared once, and in that same pass the
+   * best and second best train for each query and the best query for
+   * each train are recorded. A match is kept if its distance is less
+   * than max_distance, if the best distance is less than ratio times
+   * the second best (ratio >= 1 disables this), and, when mutual is
+   * set, if the query is also the nearest neighbor of its train.
+   **/
+  void BruteForceHammingMatch(const uint8_t* query, int num_query, int query_stride,
+                              const uint8_t* train, int num_train, int train_stride,
+                              int num_bytes, int max_distance, double ratio, bool mutual,
+                              std::vector<HammingMatch> * matches);
+
+}  // namespace interest_point
+
+#endif  // INTEREST_POINT_HAMMING_H_
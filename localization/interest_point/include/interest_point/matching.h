@@ -21,12 +21,30 @@
 #include <opencv2/features2d/features2d.hpp>
 #include <Eigen/Core>
 
-#include <vector>
-#include <string>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace interest_point {
 
+  /**
+   * Keeps the max_keypoints strongest keypoints, spread over the image:
+   * it is split into a grid of cols by rows cells, and the cells take
+   * turns giving up their strongest remaining keypoint.
+   **/
+  void SelectKeypointsOnGrid(cv::Size const& image_size, int cols, int rows, size_t max_keypoints,
+                             std::vector<cv::KeyPoint>* keypoints);
+
+  // With --detect_single_pass, Detect() runs the detector once per
+  // image instead of retrying with other thresholds, and keeps the
+  // best max_features keypoints over a grid. The threshold still
+  // adapts, but for the next image, and is only raised once there
+  // are twice too many keypoints, so that there are extra to select
+  // from.
   class DynamicDetector {
    public:
     DynamicDetector(unsigned int min_features, unsigned int max_features, unsigned int max_retries);
@@ -34,6 +52,13 @@ namespace interest_point {
     void Detect(const cv::Mat& image,
                         std::vector<cv::KeyPoint>* keypoints,
                         cv::Mat* keypoints_description);
+    // Detects in several images, by default one after the other. A
+    // detector that can process images concurrently, on a GPU, does
+    // them all at once, and BatchSize() is how many it wants at a time.
+    virtual void DetectBatch(std::vector<cv::Mat> const& images,
+                             std::vector<std::vector<cv::KeyPoint> >* keypoints,
+                             std::vector<cv::Mat>* keypoints_descriptions);
+    virtual size_t BatchSize(void) const {return 1;}
     virtual void DetectImpl(const cv::Mat& image,
                             std::vector<cv::KeyPoint>* keypoints) = 0;
     virtual void ComputeImpl(const cv::Mat& image,
@@ -41,21 +66,38 @@ namespace interest_point {
                             cv::Mat* keypoints_description) = 0;
     virtual void TooFew(void) = 0;
     virtual void TooMany(void) = 0;
+
+   protected:
+    // Whether Detect() would stop retrying with this many keypoints
+    bool InRange(size_t num_keypoints) const {
+      return num_keypoints >= min_features_ && num_keypoints <= max_features_;
+    }
+
    private:
     unsigned int min_features_;
     unsigned int max_features_;
     unsigned int max_retries_;
   };
 
+  // Detect() adapts the detector threshold from one image to the
+  // next, so it must not be called from several threads at once. Use
+  // a copy per thread instead, a copy has the same settings and starts
+  // from the initial threshold.
   class FeatureDetector {
    private:
     DynamicDetector* detector_;
     std::string detector_name_;
+    int min_features_;
+    int max_features_;
+    int brisk_threshold_;
+    int retries_;
 
    public:
     FeatureDetector(std::string const& detector_name = "SURF",
                     int min_features = 400, int max_features = 1000,
                     int brisk_threshold = 15, int retries = 5);
+    FeatureDetector(FeatureDetector const& other);
+    FeatureDetector& operator=(FeatureDetector const& other);
     ~FeatureDetector(void);
 
     void Reset(std::string const& detector_name,
@@ -66,6 +108,14 @@ namespace interest_point {
                     std::vector<cv::KeyPoint>* keypoints,
                     cv::Mat* keypoints_description);
 
+    // The same as Detect() on each image, with the GPU detectors
+    // processing the images together. Best called with BatchSize()
+    // images at a time.
+    void DetectBatch(std::vector<cv::Mat> const& images,
+                     std::vector<std::vector<cv::KeyPoint> >* keypoints,
+                     std::vector<cv::Mat>* keypoints_descriptions);
+    size_t BatchSize() const {return detector_->BatchSize();}
+
     std::string GetDetectorName() const {return detector_name_;}
 
     friend bool operator== (FeatureDetector const& A, FeatureDetector const& B) {
@@ -81,6 +131,62 @@ namespace interest_point {
   void FindMatches(const cv::Mat & img1_descriptor_map,
                    const cv::Mat & img2_descriptor_map,
                    std::vector<cv::DMatch> * matches);
+
+  /**
+   * Exact matching of binary descriptors, see BruteForceHammingMatch().
+   * This is what FindMatches() uses for binary descriptors when
+   * --binary_matcher is BRUTEFORCE.
+   **/
+  void FindMatchesBruteForce(const cv::Mat & img1_descriptor_map,
+                             const cv::Mat & img2_descriptor_map,
+                             std::vector<cv::DMatch> * matches);
+
+  /**
+   * Keeps a prebuilt FLANN index (LSH for binary descriptors, KD-tree
+   * for float ones) for each of a set of train descriptor matrices,
+   * typically the map images, so repeated queries against the same
+   * image don't rebuild the index. The number of cached indices is
+   * bounded, the least recently used is dropped first. Safe to use
+   * from several threads. Copying gives an empty cache.
+   **/
+  class MatcherCache {
+   public:
+    // max_entries of zero means unbounded.
+    explicit MatcherCache(size_t max_entries = 0);
+    MatcherCache(MatcherCache const& other);
+    MatcherCache& operator=(MatcherCache const& other);
+
+    // Same as the free FindMatches(), with img2_descriptor_map the
+    // train descriptors known under the given id.
+    void FindMatches(const cv::Mat & img1_descriptor_map,
+                     int id, const cv::Mat & img2_descriptor_map,
+                     std::vector<cv::DMatch> * matches);
+
+    // Build the index for id ahead of time.
+    void Prebuild(int id, const cv::Mat & img2_descriptor_map);
+
+    void Clear();
+    void SetMaxEntries(size_t max_entries);
+    size_t Size() const;
+
+   private:
+    struct Entry {
+      cv::Ptr<cv::FlannBasedMatcher> matcher;
+      // Used to detect that the descriptors for an id were replaced
+      const uchar* data;
+      int rows;
+      std::mutex mutex;  // a FLANN matcher must not be queried concurrently
+    };
+    typedef std::list<int> LruList;
+
+    std::shared_ptr<Entry> Get(int id, const cv::Mat & img2_descriptor_map);
+    void Evict();
+
+    size_t max_entries_;
+    LruList lru_;  // most recently used first
+    std::map<int, std::pair<std::shared_ptr<Entry>, LruList::iterator> > entries_;
+    mutable std::mutex mutex_;
+  };
 }  // namespace interest_point
 
 #endif  // INTEREST_POINT_MATCHING_H_
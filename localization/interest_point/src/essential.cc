@@ -31,6 +31,175 @@
 #include <openMVG/robust_estimation/robust_estimator_ACRansacKernelAdaptator.hpp>
 #pragma GCC diagnostic pop
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+DEFINE_bool(essential_sprt, false,
+            "Estimate the essential matrix with RANSAC on the Sampson error, with an adaptive "
+            "number of iterations and SPRT, rather than AC-RANSAC.");
+
+namespace {
+
+// As many iterations as AC-RANSAC is given
+const int kMaxIterations = 4096;
+const double kConfidence = 0.99;
+
+// Correspondences are scored this many at a time, so the SPRT can stop
+// between blocks
+const int kBlockSize = 64;
+
+// The time to fit the sample, in units of scoring one correspondence, and
+// the average number of models per sample of the five point solver
+const double kModelTime = 200.0;
+const double kModelsPerSample = 4.0;
+
+// The SPRT decision threshold A, as in Matas and Chum, "Randomized RANSAC
+// with sequential probability ratio test", for an inlier ratio epsilon and
+// a probability delta that a point is consistent with a bad model.
+double SprtThreshold(double epsilon, double delta) {
+  double c = (1 - delta) * std::log((1 - delta) / (1 - epsilon)) + delta * std::log(delta / epsilon);
+  double k = kModelTime * c / kModelsPerSample + 1;
+  double a = k;
+  for (int i = 0; i < 10; i++)
+    a = k + std::log(a);
+  return a;
+}
+
+// The squared Sampson errors in pixels of the correspondences [begin, begin + n)
+// to the fundamental matrix f. The coordinates are stored by column, so
+// each expression runs over contiguous values.
+void SampsonErrors(Eigen::Matrix3d const& f, Eigen::ArrayX2d const& p1, Eigen::ArrayX2d const& p2,
+                   int begin, int n, Eigen::Array<double, kBlockSize, 1> * errors) {
+  auto u1 = p1.col(0).segment(begin, n), v1 = p1.col(1).segment(begin, n);
+  auto u2 = p2.col(0).segment(begin, n), v2 = p2.col(1).segment(begin, n);
+  Eigen::Array<double, kBlockSize, 1> a, b, c, d;
+  a.head(n) = f(0, 0) * u1 + f(0, 1) * v1 + f(0, 2);
+  b.head(n) = f(1, 0) * u1 + f(1, 1) * v1 + f(1, 2);
+  c.head(n) = u2 * a.head(n) + v2 * b.head(n) + (f(2, 0) * u1 + f(2, 1) * v1 + f(2, 2));
+  d.head(n) = f(0, 0) * u2 + f(1, 0) * v2 + f(2, 0);
+  a.head(n) = a.head(n).square() + b.head(n).square() + d.head(n).square()
+    + (f(0, 1) * u2 + f(1, 1) * v2 + f(2, 1)).square();
+  errors->head(n) = c.head(n).square() / a.head(n).max(std::numeric_limits<double>::min());
+}
+
+// RANSAC with a fixed threshold of precision pixels on the Sampson error.
+// A hypothesis is scored block by block and dropped as soon as the SPRT
+// decides it is bad, and the number of iterations shrinks with the inlier
+// ratio found so far.
+bool SprtEssential(Eigen::Matrix3d const& k1, Eigen::Matrix3d const& k2,
+                   Eigen::Matrix2Xd const& x1, Eigen::Matrix2Xd const& x2,
+                   Eigen::Matrix3d * e, std::vector<size_t> * vec_inliers,
+                   double * error_max, double precision) {
+  const int num_samples = openMVG::essential::kernel::FivePointKernel::MINIMUM_SAMPLES;
+  const int num_points = x1.cols();
+  vec_inliers->clear();
+  if (num_points < num_samples)
+    return false;
+
+  Eigen::ArrayX2d p1 = x1.transpose().array(), p2 = x2.transpose().array();
+  Eigen::Matrix2Xd n1 = (k1.inverse() * x1.colwise().homogeneous()).colwise().hnormalized();
+  Eigen::Matrix2Xd n2 = (k2.inverse() * x2.colwise().homogeneous()).colwise().hnormalized();
+  Eigen::Matrix3d k1_inv = k1.inverse(), k2_inv_t = k2.inverse().transpose();
+  double threshold = precision * precision;
+
+  // the same samples on every call
+  std::mt19937 generator(0);
+  std::uniform_int_distribution<int> distribution(0, num_points - 1);
+
+  double epsilon = 0.1, delta = 0.05;
+  double log_a = std::log(SprtThreshold(epsilon, delta));
+  double rejected_consistent = 0, rejected_tested = 0;
+  int best_count = 0, max_iterations = kMaxIterations;
+  Eigen::Matrix3d best_e;
+  Eigen::MatrixXd s1(2, num_samples), s2(2, num_samples);
+  std::vector<int> sample(num_samples);
+  std::vector<Eigen::Matrix3d> models;
+  Eigen::Array<double, kBlockSize, 1> errors;
+  for (int iteration = 0; iteration < max_iterations; iteration++) {
+    for (int i = 0; i < num_samples; i++) {
+      do {
+        sample[i] = distribution(generator);
+      } while (std::find(sample.begin(), sample.begin() + i, sample[i]) != sample.begin() + i);
+      s1.col(i) = n1.col(sample[i]);
+      s2.col(i) = n2.col(sample[i]);
+    }
+    models.clear();
+    openMVG::essential::kernel::FivePointSolver::Solve(s1, s2, &models);
+
+    for (Eigen::Matrix3d const& model : models) {
+      Eigen::Matrix3d f = k2_inv_t * model * k1_inv;
+      double log_consistent = std::log(delta / epsilon);
+      double log_inconsistent = std::log((1 - delta) / (1 - epsilon));
+      double log_lambda = 0;
+      int count = 0, tested = 0;
+      bool good = true;
+      for (int begin = 0; begin < num_points; begin += kBlockSize) {
+        int n = std::min(kBlockSize, num_points - begin);
+        SampsonErrors(f, p1, p2, begin, n, &errors);
+        int consistent = (errors.head(n) < threshold).count();
+        count += consistent;
+        tested += n;
+        log_lambda += consistent * log_consistent + (n - consistent) * log_inconsistent;
+        if (log_lambda > log_a) {
+          good = false;
+          break;
+        }
+      }
+
+      if (!good) {
+        // a rejected model tells how many points agree with a bad one
+        rejected_consistent += count;
+        rejected_tested += tested;
+        delta = std::min(std::max(rejected_consistent / rejected_tested, 0.001), 0.5 * epsilon);
+        log_a = std::log(SprtThreshold(epsilon, delta));
+        continue;
+      }
+      if (count <= best_count)
+        continue;
+
+      best_count = count;
+      best_e = model;
+      double ratio = static_cast<double>(count) / num_points;
+      if (ratio > epsilon) {
+        epsilon = ratio;
+        delta = std::min(delta, 0.5 * epsilon);
+        log_a = std::log(SprtThreshold(epsilon, delta));
+      }
+      double outlier_sample = 1 - std::pow(ratio, num_samples);
+      if (outlier_sample <= 0)
+        max_iterations = 0;
+      else if (outlier_sample < 1)
+        max_iterations = std::min(max_iterations,
+          static_cast<int>(std::ceil(std::log(1 - kConfidence) / std::log(outlier_sample))));
+    }
+  }
+
+  if (best_count == 0)
+    return false;
+
+  // recount the inliers of the best model, one at a time
+  *e = best_e;
+  *error_max = 0;
+  Eigen::Matrix3d f = k2_inv_t * best_e * k1_inv;
+  for (int begin = 0; begin < num_points; begin += kBlockSize) {
+    int n = std::min(kBlockSize, num_points - begin);
+    SampsonErrors(f, p1, p2, begin, n, &errors);
+    for (int i = 0; i < n; i++) {
+      if (errors[i] < threshold) {
+        vec_inliers->push_back(begin + i);
+        *error_max = std::max(*error_max, errors[i]);
+      }
+    }
+  }
+  *error_max = std::sqrt(*error_max);
+
+  return vec_inliers->size() > 1.5 * num_samples;
+}
+
+}  // namespace
+
 bool interest_point::RobustEssential(Eigen::Matrix3d const& k1, Eigen::Matrix3d const& k2,
                                      Eigen::Matrix2Xd const& x1, Eigen::Matrix2Xd const& x2,
                                      Eigen::Matrix3d * e,
@@ -41,6 +210,10 @@ bool interest_point::RobustEssential(Eigen::Matrix3d const& k1, Eigen::Matrix3d
                                      double precision) {
   CHECK(e) << "Missing e argument";
   CHECK(vec_inliers) << "Missing vec inliers argument";
+  CHECK(error_max) << "Missing error max argument";
+
+  if (FLAGS_essential_sprt && std::isfinite(precision))
+    return SprtEssential(k1, k2, x1, x2, e, vec_inliers, error_max, precision);
 
   typedef openMVG::essential::kernel::FivePointKernel SolverType;
   typedef openMVG::robust::ACKernelAdaptorEssential<
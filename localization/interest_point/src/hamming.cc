@@ -0,0 +1,209 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <interest_point/hamming.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include <string.h>
+
+#include <limits>
+#include <vector>
+
+namespace interest_point {
+
+  static inline int PopcountTail(const uint8_t* a, const uint8_t* b, int num_bytes) {
+    int count = 0;
+    int i = 0;
+    for (; i + 8 <= num_bytes; i += 8) {
+      uint64_t x, y;
+      memcpy(&x, a + i, 8);
+      memcpy(&y, b + i, 8);
+      count += __builtin_popcountll(x ^ y);
+    }
+    for (; i < num_bytes; i++)
+      count += __builtin_popcount(a[i] ^ b[i]);
+    return count;
+  }
+
+  int HammingDistance(const uint8_t* a, const uint8_t* b, int num_bytes) {
+    int i = 0;
+    int count = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    // Count bits per byte with vcnt and widen pairwise into 16 bit
+    // lanes. A 16 bit lane can't overflow for descriptors below 64 KB.
+    uint16x8_t acc = vdupq_n_u16(0);
+    for (; i + 16 <= num_bytes; i += 16) {
+      uint8x16_t x = veorq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+      acc = vpadalq_u8(acc, vcntq_u8(x));
+    }
+    uint64x2_t sum = vpaddlq_u32(vpaddlq_u16(acc));
+    count = static_cast<int>(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+#elif defined(__AVX2__)
+    // Nibble lookup table popcount, summed with sad into 64 bit lanes
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 32 <= num_bytes; i += 32) {
+      __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+                                   _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+      __m256i lo = _mm256_and_si256(x, low_mask);
+      __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask);
+      __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                    _mm256_shuffle_epi8(lookup, hi));
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+    }
+    count = static_cast<int>(_mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) +
+                             _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3));
+#endif
+    return count + PopcountTail(a + i, b + i, num_bytes - i);
+  }
+
+  int HammingNearest(const uint8_t* query, const uint8_t* train, int num_train, int train_stride,
+                     int num_bytes, int* distance) {
+    int best = -1;
+    int best_dist = std::numeric_limits<int>::max();
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    if (num_bytes % 16 == 0 && num_bytes <= 64) {
+      // A byte has at most 8 bits set, so the counts of up to 4 vectors
+      // sum in 8 bit lanes, and are widened once per row
+      int n = num_bytes / 16;
+      uint8x16_t q[4];
+      for (int j = 0; j < n; j++)
+        q[j] = vld1q_u8(query + 16 * j);
+      for (int t = 0; t < num_train; t++) {
+        const uint8_t* row = train + static_cast<size_t>(t) * train_stride;
+        uint8x16_t cnt = vcntq_u8(veorq_u8(q[0], vld1q_u8(row)));
+        for (int j = 1; j < n; j++)
+          cnt = vaddq_u8(cnt, vcntq_u8(veorq_u8(q[j], vld1q_u8(row + 16 * j))));
+        uint64x2_t sum = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(cnt)));
+        int d = static_cast<int>(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+        if (d < best_dist) {
+          best_dist = d;
+          best = t;
+        }
+      }
+      if (distance != NULL)
+        *distance = best_dist;
+      return best;
+    }
+#elif defined(__AVX2__)
+    if (num_bytes % 32 == 0 && num_bytes <= 64) {
+      const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                              0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+      const __m256i low_mask = _mm256_set1_epi8(0x0f);
+      int n = num_bytes / 32;
+      __m256i q[2];
+      for (int j = 0; j < n; j++)
+        q[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(query + 32 * j));
+      for (int t = 0; t < num_train; t++) {
+        const uint8_t* row = train + static_cast<size_t>(t) * train_stride;
+        __m256i cnt = _mm256_setzero_si256();
+        for (int j = 0; j < n; j++) {
+          __m256i x = _mm256_xor_si256(q[j], _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + 32 * j)));
+          __m256i lo = _mm256_and_si256(x, low_mask);
+          __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask);
+          cnt = _mm256_add_epi8(cnt, _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                                     _mm256_shuffle_epi8(lookup, hi)));
+        }
+        __m256i sum = _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+        int d = static_cast<int>(_mm256_extract_epi64(sum, 0) + _mm256_extract_epi64(sum, 1) +
+                                 _mm256_extract_epi64(sum, 2) + _mm256_extract_epi64(sum, 3));
+        if (d < best_dist) {
+          best_dist = d;
+          best = t;
+        }
+      }
+      if (distance != NULL)
+        *distance = best_dist;
+      return best;
+    }
+#endif
+    for (int t = 0; t < num_train; t++) {
+      int d = HammingDistance(query, train + static_cast<size_t>(t) * train_stride, num_bytes);
+      if (d < best_dist) {
+        best_dist = d;
+        best = t;
+      }
+    }
+    if (distance != NULL)
+      *distance = best_dist;
+    return best;
+  }
+
+  void BruteForceHammingMatch(const uint8_t* query, int num_query, int query_stride,
+                              const uint8_t* train, int num_train, int train_stride,
+                              int num_bytes, int max_distance, double ratio, bool mutual,
+                              std::vector<HammingMatch> * matches) {
+    matches->clear();
+    if (num_query <= 0 || num_train <= 0)
+      return;
+
+    const int kNone = std::numeric_limits<int>::max();
+    std::vector<int> best_train(num_query, -1);
+    std::vector<int> best_dist(num_query, kNone);
+    std::vector<int> second_dist(num_query, kNone);
+    std::vector<int> train_best_query(num_train, -1);
+    std::vector<int> train_best_dist(num_train, kNone);
+
+    for (int q = 0; q < num_query; q++) {
+      const uint8_t* qd = query + static_cast<size_t>(q) * query_stride;
+      int b1 = kNone, b2 = kNone, b1_train = -1;
+      for (int t = 0; t < num_train; t++) {
+        int d = HammingDistance(qd, train + static_cast<size_t>(t) * train_stride, num_bytes);
+        if (d < b1) {
+          b2 = b1;
+          b1 = d;
+          b1_train = t;
+        } else if (d < b2) {
+          b2 = d;
+        }
+        if (d < train_best_dist[t]) {
+          train_best_dist[t] = d;
+          train_best_query[t] = q;
+        }
+      }
+      best_train[q] = b1_train;
+      best_dist[q] = b1;
+      second_dist[q] = b2;
+    }
+
+    matches->reserve(num_query);
+    for (int q = 0; q < num_query; q++) {
+      int t = best_train[q];
+      if (best_dist[q] >= max_distance)
+        continue;
+      if (ratio < 1.0 && second_dist[q] != kNone &&
+          best_dist[q] >= ratio * second_dist[q])
+        continue;
+      if (mutual && train_best_query[t] != q)
+        continue;
+      HammingMatch m;
+      m.query = q;
+      m.train = t;
+      m.distance = best_dist[q];
+      matches->push_back(m);
+    }
+  }
+
+}  // namespace interest_point
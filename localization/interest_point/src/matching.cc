@@ -16,14 +16,23 @@
  * under the License.
  */
 
+#include <interest_point/hamming.h>
 #include <interest_point/matching.h>
+#include <opencv2/opencv_modules.hpp>
 #include <opencv2/xfeatures2d.hpp>
+#ifdef HAVE_OPENCV_CUDAFEATURES2D
+#include <opencv2/core/cuda.hpp>
+#include <opencv2/cudafeatures2d.hpp>
+#endif
 
 #include <Eigen/Core>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
+#include <utility>
 #include <vector>
 // Note: if any of these values are manually set by the user in
 // build_map, the localize script must be invoked with precisely the
@@ -34,6 +43,12 @@ DEFINE_int32(hamming_distance, 90,
              "A smaller value keeps fewer but more reliable binary descriptor matches.");
 DEFINE_double(goodness_ratio, 0.8,
               "A smaller value keeps fewer but more reliable float descriptor matches.");
+DEFINE_string(binary_matcher, "LSH",
+              "Matcher for binary descriptors. LSH: approximate FLANN matching. "
+              "BRUTEFORCE: exact SIMD Hamming matching with a mutual nearest neighbor check.");
+DEFINE_double(hamming_ratio, 0.9,
+              "With the BRUTEFORCE binary matcher, keep a match only if it is this much "
+              "closer than the second best. Use 1 to disable.");
 DEFINE_int32(surf_mode, 1,
              "0: Use default SURF, 1: use dynamic adaptive SURF, 2: Use grid adaptive SURF.");
 
@@ -41,15 +56,62 @@ DEFINE_int32(orgbrisk_octaves, 4,
              "Number of octaves, or scale spaces, that BRISK will evaluate.");
 DEFINE_double(orgbrisk_pattern_scale, 1.0,
              "The pattern scale to use for BRISK.");
+DEFINE_bool(detect_single_pass, false,
+            "Detect once per image and keep the strongest features on a grid, instead of "
+            "detecting again with another threshold when there are too few or too many.");
+DEFINE_int32(single_pass_grid_cols, 8,
+             "With --detect_single_pass, the number of grid columns to spread the features over.");
+DEFINE_int32(single_pass_grid_rows, 6,
+             "With --detect_single_pass, the number of grid rows to spread the features over.");
+DEFINE_int32(cuda_batch_size, 8,
+             "Number of images the CUDA detectors process at the same time.");
 
 namespace interest_point {
 
   DynamicDetector::DynamicDetector(unsigned int min_features, unsigned int max_features, unsigned int max_retries) :
          min_features_(min_features), max_features_(max_features), max_retries_(max_retries) {}
 
+  void SelectKeypointsOnGrid(cv::Size const& image_size, int cols, int rows, size_t max_keypoints,
+                             std::vector<cv::KeyPoint>* keypoints) {
+    if (keypoints->size() <= max_keypoints)
+      return;
+    cols = std::max(cols, 1);
+    rows = std::max(rows, 1);
+    std::vector<std::vector<cv::KeyPoint> > cells(cols * rows);
+    for (cv::KeyPoint const& key : *keypoints) {
+      int col = std::min(std::max(static_cast<int>(key.pt.x * cols / image_size.width), 0), cols - 1);
+      int row = std::min(std::max(static_cast<int>(key.pt.y * rows / image_size.height), 0), rows - 1);
+      cells[row * cols + col].push_back(key);
+    }
+    for (std::vector<cv::KeyPoint> & cell : cells)
+      std::sort(cell.begin(), cell.end(), [](cv::KeyPoint const& a, cv::KeyPoint const& b) {
+          return a.response > b.response;
+        });
+
+    // There are more keypoints than wanted, so this stops
+    keypoints->clear();
+    for (size_t i = 0; keypoints->size() < max_keypoints; i++)
+      for (std::vector<cv::KeyPoint> const& cell : cells)
+        if (i < cell.size() && keypoints->size() < max_keypoints)
+          keypoints->push_back(cell[i]);
+  }
+
   void DynamicDetector::Detect(const cv::Mat& image,
                                std::vector<cv::KeyPoint>* keypoints,
                                cv::Mat* keypoints_description) {
+    if (FLAGS_detect_single_pass) {
+      keypoints->clear();
+      DetectImpl(image, keypoints);
+      if (keypoints->size() < min_features_)
+        TooFew();
+      else if (keypoints->size() > 2 * max_features_)
+        TooMany();
+      SelectKeypointsOnGrid(image.size(), FLAGS_single_pass_grid_cols, FLAGS_single_pass_grid_rows,
+                            max_features_, keypoints);
+      ComputeImpl(image, keypoints, keypoints_description);
+      return;
+    }
+
     for (unsigned int i = 0; i < max_retries_; i++) {
       keypoints->clear();
       DetectImpl(image, keypoints);
@@ -63,6 +125,15 @@ namespace interest_point {
     ComputeImpl(image, keypoints, keypoints_description);
   }
 
+  void DynamicDetector::DetectBatch(std::vector<cv::Mat> const& images,
+                                    std::vector<std::vector<cv::KeyPoint> >* keypoints,
+                                    std::vector<cv::Mat>* keypoints_descriptions) {
+    keypoints->resize(images.size());
+    keypoints_descriptions->resize(images.size());
+    for (size_t i = 0; i < images.size(); i++)
+      Detect(images[i], &(*keypoints)[i], &(*keypoints_descriptions)[i]);
+  }
+
   class BriskDynamicDetector : public DynamicDetector {
    public:
     BriskDynamicDetector(unsigned int min_features, unsigned int max_features, unsigned int max_retries, int threshold)
@@ -129,6 +200,99 @@ namespace interest_point {
     float threshold_;
   };
 
+#ifdef HAVE_OPENCV_CUDAFEATURES2D
+  // ORB on the GPU. It keeps the number of features under the maximum
+  // by itself, and adapts its FAST threshold to find enough. A batch
+  // of images is uploaded and processed on one stream per image, so
+  // that their kernels overlap, with one ORB per stream as ORB keeps
+  // its buffers between calls.
+  class CudaOrbDynamicDetector : public DynamicDetector {
+   public:
+    CudaOrbDynamicDetector(unsigned int min_features, unsigned int max_features, unsigned int max_retries)
+         : DynamicDetector(min_features, max_features, max_retries), num_features_(max_features),
+           threshold_(20) {
+      Reset();
+    }
+
+    void Reset(void) {
+      orb_ = Create();
+      for (Slot & slot : slots_)
+        slot.orb = Create();
+    }
+
+    virtual void DetectImpl(const cv::Mat& image, std::vector<cv::KeyPoint>* keypoints) {
+      gpu_image_.upload(image);
+      orb_->detect(gpu_image_, *keypoints);
+    }
+    virtual void ComputeImpl(const cv::Mat& image, std::vector<cv::KeyPoint>* keypoints,
+                             cv::Mat* keypoints_description) {
+      // gpu_image_ still holds the image from DetectImpl
+      orb_->compute(gpu_image_, *keypoints, gpu_descriptors_);
+      gpu_descriptors_.download(*keypoints_description);
+    }
+    virtual void TooMany(void) {
+      threshold_ *= 1.3;
+      if (threshold_ > 200)
+        threshold_ = 200;
+      Reset();
+    }
+    virtual void TooFew(void) {
+      threshold_ *= 0.6;
+      if (threshold_ < 5)
+        threshold_ = 5;
+      Reset();
+    }
+
+    virtual void DetectBatch(std::vector<cv::Mat> const& images,
+                             std::vector<std::vector<cv::KeyPoint> >* keypoints,
+                             std::vector<cv::Mat>* keypoints_descriptions) {
+      keypoints->resize(images.size());
+      keypoints_descriptions->resize(images.size());
+      while (slots_.size() < images.size()) {
+        slots_.push_back(Slot());
+        slots_.back().orb = Create();
+      }
+      for (size_t i = 0; i < images.size(); i++) {
+        Slot & slot = slots_[i];
+        slot.image.upload(images[i], slot.stream);
+        slot.orb->detectAndComputeAsync(slot.image, cv::noArray(), slot.keypoints, slot.descriptors,
+                                        false, slot.stream);
+      }
+      // The images whose count is off are done again one at a time,
+      // which adapts the threshold for the next batch
+      for (size_t i = 0; i < images.size(); i++) {
+        Slot & slot = slots_[i];
+        slot.stream.waitForCompletion();
+        slot.orb->convert(slot.keypoints, (*keypoints)[i]);
+        slot.descriptors.download((*keypoints_descriptions)[i]);
+      }
+      for (size_t i = 0; i < images.size(); i++)
+        if (!InRange((*keypoints)[i].size()))
+          Detect(images[i], &(*keypoints)[i], &(*keypoints_descriptions)[i]);
+    }
+    virtual size_t BatchSize(void) const {
+      return std::max(FLAGS_cuda_batch_size, 1);
+    }
+
+   private:
+    cv::Ptr<cv::cuda::ORB> Create(void) const {
+      return cv::cuda::ORB::create(num_features_, 1.2f, 8, 31, 0, 2, cv::ORB::HARRIS_SCORE, 31, threshold_);
+    }
+
+    struct Slot {
+      cv::Ptr<cv::cuda::ORB> orb;
+      cv::cuda::Stream stream;
+      cv::cuda::GpuMat image, keypoints, descriptors;
+    };
+
+    cv::Ptr<cv::cuda::ORB> orb_;
+    cv::cuda::GpuMat gpu_image_, gpu_descriptors_;
+    std::vector<Slot> slots_;
+    int num_features_;
+    int threshold_;
+  };
+#endif
+
   FeatureDetector::FeatureDetector(std::string const& detector_name,
                                    int min_features, int max_features,
                                    int brisk_threshold, int retries) {
@@ -136,6 +300,19 @@ namespace interest_point {
     Reset(detector_name, min_features, max_features, brisk_threshold, retries);
   }
 
+  FeatureDetector::FeatureDetector(FeatureDetector const& other) {
+    detector_ = NULL;
+    Reset(other.detector_name_, other.min_features_, other.max_features_,
+          other.brisk_threshold_, other.retries_);
+  }
+
+  FeatureDetector& FeatureDetector::operator=(FeatureDetector const& other) {
+    if (this != &other)
+      Reset(other.detector_name_, other.min_features_, other.max_features_,
+            other.brisk_threshold_, other.retries_);
+    return *this;
+  }
+
   FeatureDetector::~FeatureDetector(void) {
     if (detector_)
       delete detector_;
@@ -145,6 +322,10 @@ namespace interest_point {
                               int min_features, int max_features,
                               int brisk_threshold, int retries) {
     detector_name_ = detector_name;
+    min_features_ = min_features;
+    max_features_ = max_features;
+    brisk_threshold_ = brisk_threshold;
+    retries_ = retries;
 
     if (detector_)
       delete detector_;
@@ -153,6 +334,12 @@ namespace interest_point {
       detector_ = new BriskDynamicDetector(min_features, max_features, retries, brisk_threshold);
     } else if (detector_name == "SURF") {
       detector_ = new SurfDynamicDetector(min_features, max_features, retries, 10.0);
+    } else if (detector_name == "CUDA_ORB") {
+#ifdef HAVE_OPENCV_CUDAFEATURES2D
+      detector_ = new CudaOrbDynamicDetector(min_features, max_features, retries);
+#else
+      LOG(FATAL) << "The CUDA_ORB detector needs OpenCV built with CUDA.";
+#endif
     } else {
       LOG(ERROR) << "Unimplemented feature detector " << detector_name;
       assert(false);
@@ -171,6 +358,90 @@ namespace interest_point {
     }
   }
 
+  void FeatureDetector::DetectBatch(std::vector<cv::Mat> const& images,
+                                    std::vector<std::vector<cv::KeyPoint> >* keypoints,
+                                    std::vector<cv::Mat>* keypoints_descriptions) {
+    detector_->DetectBatch(images, keypoints, keypoints_descriptions);
+
+    for (size_t i = 0; i < images.size(); i++) {
+      for (cv::KeyPoint& key : (*keypoints)[i]) {
+        key.pt.x -= images[i].cols/2.0;
+        key.pt.y -= images[i].rows/2.0;
+      }
+    }
+  }
+
+  // Select only inlier matches that meet a BRISK threshold of
+  // of FLAGS_hamming_distance.
+  // TODO(oalexan1) This needs further study.
+  static void FilterBinaryMatches(std::vector<cv::DMatch> * matches) {
+    std::vector<cv::DMatch> inlier_matches;
+    inlier_matches.reserve(matches->size());  // This saves time in allocation
+    for (cv::DMatch const& dmatch : *matches) {
+      if (dmatch.distance < FLAGS_hamming_distance) {
+        inlier_matches.push_back(dmatch);
+      }
+    }
+    matches->swap(inlier_matches);  // Doesn't invoke a copy of all elements.
+  }
+
+  static void RatioTestMatches(std::vector<std::vector<cv::DMatch> > const& possible_matches,
+                               std::vector<cv::DMatch> * matches) {
+    matches->clear();
+    matches->reserve(possible_matches.size());
+    for (std::vector<cv::DMatch> const& best_pair : possible_matches) {
+      if (best_pair.size() == 1) {
+        // This was the only best match, push it.
+        matches->push_back(best_pair.at(0));
+      } else if (best_pair.size() > 1) {
+        // Push back a match only if it is 25% better than the next best.
+        if (best_pair.at(0).distance < FLAGS_goodness_ratio * best_pair.at(1).distance) {
+          matches->push_back(best_pair[0]);
+        }
+      }
+    }
+  }
+
+  static bool UseBruteForceBinaryMatcher() {
+    if (FLAGS_binary_matcher == "BRUTEFORCE")
+      return true;
+    if (FLAGS_binary_matcher != "LSH")
+      LOG(FATAL) << "Unknown binary matcher " << FLAGS_binary_matcher;
+    return false;
+  }
+
+  void FindMatchesBruteForce(const cv::Mat & img1_descriptor_map,
+                             const cv::Mat & img2_descriptor_map,
+                             std::vector<cv::DMatch> * matches) {
+    CHECK(img1_descriptor_map.depth() == CV_8U &&
+          img2_descriptor_map.depth() == CV_8U)
+      << "Brute force Hamming matching needs binary descriptors.";
+    CHECK(img1_descriptor_map.cols == img2_descriptor_map.cols)
+      << "Descriptors have different lengths.";
+
+    matches->clear();
+    if (img1_descriptor_map.rows == 0 ||
+        img2_descriptor_map.rows == 0)
+      return;
+
+    std::vector<HammingMatch> hamming_matches;
+    BruteForceHammingMatch(img1_descriptor_map.ptr<uint8_t>(), img1_descriptor_map.rows,
+                           img1_descriptor_map.step[0],
+                           img2_descriptor_map.ptr<uint8_t>(), img2_descriptor_map.rows,
+                           img2_descriptor_map.step[0],
+                           img1_descriptor_map.cols, FLAGS_hamming_distance,
+                           FLAGS_hamming_ratio, true, &hamming_matches);
+    matches->reserve(hamming_matches.size());
+    for (HammingMatch const& m : hamming_matches)
+      matches->push_back(cv::DMatch(m.query, m.train, static_cast<float>(m.distance)));
+  }
+
+  static cv::Ptr<cv::FlannBasedMatcher> CreateMatcher(int depth) {
+    if (depth == CV_8U)
+      return cv::makePtr<cv::FlannBasedMatcher>(cv::makePtr<cv::flann::LshIndexParams>(3, 18, 2));
+    return cv::makePtr<cv::FlannBasedMatcher>();
+  }
+
   void FindMatches(const cv::Mat & img1_descriptor_map,
                    const cv::Mat & img2_descriptor_map, std::vector<cv::DMatch> * matches) {
     CHECK(img1_descriptor_map.depth() ==
@@ -185,40 +456,138 @@ namespace interest_point {
 
     if (img1_descriptor_map.depth() == CV_8U) {
       // Binary descriptor
+      if (UseBruteForceBinaryMatcher()) {
+        FindMatchesBruteForce(img1_descriptor_map, img2_descriptor_map, matches);
+        return;
+      }
 
       // cv::BFMatcher matcher(cv::NORM_HAMMING, true  /* Forward & Backward matching */);
       cv::FlannBasedMatcher matcher(cv::makePtr<cv::flann::LshIndexParams>(3, 18, 2));
       matcher.match(img1_descriptor_map, img2_descriptor_map, *matches);
-
-      // Select only inlier matches that meet a BRISK threshold of
-      // of FLAGS_hamming_distance.
-      // TODO(oalexan1) This needs further study.
-      std::vector<cv::DMatch> inlier_matches;
-      inlier_matches.reserve(matches->size());  // This saves time in allocation
-      for (cv::DMatch const& dmatch : *matches) {
-        if (dmatch.distance < FLAGS_hamming_distance) {
-          inlier_matches.push_back(dmatch);
-        }
-      }
-      matches->swap(inlier_matches);  // Doesn't invoke a copy of all elements.
+      FilterBinaryMatches(matches);
     } else {
       // Traditional floating point descriptor
       cv::FlannBasedMatcher matcher;
       std::vector<std::vector<cv::DMatch> > possible_matches;
       matcher.knnMatch(img1_descriptor_map, img2_descriptor_map, possible_matches, 2);
-      matches->clear();
-      matches->reserve(possible_matches.size());
-      for (std::vector<cv::DMatch> const& best_pair : possible_matches) {
-        if (best_pair.size() == 1) {
-          // This was the only best match, push it.
-          matches->push_back(best_pair.at(0));
-        } else {
-          // Push back a match only if it is 25% better than the next best.
-          if (best_pair.at(0).distance < FLAGS_goodness_ratio * best_pair.at(1).distance) {
-            matches->push_back(best_pair[0]);
-          }
+      RatioTestMatches(possible_matches, matches);
+    }
+  }
+
+  MatcherCache::MatcherCache(size_t max_entries) : max_entries_(max_entries) {}
+
+  MatcherCache::MatcherCache(MatcherCache const& other) : max_entries_(other.max_entries_) {}
+
+  MatcherCache& MatcherCache::operator=(MatcherCache const& other) {
+    if (this != &other) {
+      Clear();
+      SetMaxEntries(other.max_entries_);
+    }
+    return *this;
+  }
+
+  void MatcherCache::FindMatches(const cv::Mat & img1_descriptor_map,
+                                 int id, const cv::Mat & img2_descriptor_map,
+                                 std::vector<cv::DMatch> * matches) {
+    CHECK(img1_descriptor_map.depth() ==
+          img2_descriptor_map.depth())
+      << "Mixed descriptor types. Did you mash BRISK with SIFT/SURF?";
+
+    matches->clear();
+    if (img1_descriptor_map.rows == 0 ||
+        img2_descriptor_map.rows == 0)
+      return;
+
+    // Exact matching has no index to build
+    if (img1_descriptor_map.depth() == CV_8U && UseBruteForceBinaryMatcher()) {
+      FindMatchesBruteForce(img1_descriptor_map, img2_descriptor_map, matches);
+      return;
+    }
+
+    // The index for this id was built from img2_descriptor_map once,
+    // here we only search it.
+    std::shared_ptr<Entry> entry = Get(id, img2_descriptor_map);
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    if (img1_descriptor_map.depth() == CV_8U) {
+      entry->matcher->match(img1_descriptor_map, *matches);
+      FilterBinaryMatches(matches);
+    } else {
+      std::vector<std::vector<cv::DMatch> > possible_matches;
+      entry->matcher->knnMatch(img1_descriptor_map, possible_matches, 2);
+      RatioTestMatches(possible_matches, matches);
+    }
+  }
+
+  void MatcherCache::Prebuild(int id, const cv::Mat & img2_descriptor_map) {
+    if (img2_descriptor_map.depth() == CV_8U && UseBruteForceBinaryMatcher())
+      return;
+    if (img2_descriptor_map.rows > 0)
+      Get(id, img2_descriptor_map);
+  }
+
+  void MatcherCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    lru_.clear();
+  }
+
+  void MatcherCache::SetMaxEntries(size_t max_entries) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_entries_ = max_entries;
+    Evict();
+  }
+
+  size_t MatcherCache::Size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+  std::shared_ptr<MatcherCache::Entry> MatcherCache::Get(int id, const cv::Mat & img2_descriptor_map) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = entries_.find(id);
+      if (it != entries_.end()) {
+        std::shared_ptr<Entry> entry = it->second.first;
+        if (entry->data == img2_descriptor_map.data &&
+            entry->rows == img2_descriptor_map.rows) {
+          // Mark as most recently used
+          lru_.splice(lru_.begin(), lru_, it->second.second);
+          return entry;
         }
+        // The descriptors changed under this id, rebuild below
+        lru_.erase(it->second.second);
+        entries_.erase(it);
       }
     }
+
+    // Build the index without holding the lock, this is the slow part
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    entry->matcher = CreateMatcher(img2_descriptor_map.depth());
+    entry->matcher->add(std::vector<cv::Mat>(1, img2_descriptor_map));
+    entry->matcher->train();
+    entry->data = img2_descriptor_map.data;
+    entry->rows = img2_descriptor_map.rows;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(id);
+    if (it != entries_.end()) {
+      // Another thread got here first
+      lru_.erase(it->second.second);
+      entries_.erase(it);
+    }
+    lru_.push_front(id);
+    entries_[id] = std::make_pair(entry, lru_.begin());
+    Evict();
+    return entry;
+  }
+
+  // Must be called with mutex_ held
+  void MatcherCache::Evict() {
+    if (max_entries_ == 0)
+      return;
+    while (entries_.size() > max_entries_) {
+      entries_.erase(lru_.back());
+      lru_.pop_back();
+    }
   }
 }  // namespace interest_point
@@ -0,0 +1,69 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <interest_point/essential.h>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include <random>
+#include <utility>
+#include <vector>
+
+DECLARE_bool(essential_sprt);
+
+TEST(essential, sprt) {
+  Eigen::Matrix3d k;
+  k << 600, 0, 320, 0, 600, 240, 0, 0, 1;
+  Eigen::Matrix3d r = Eigen::AngleAxisd(0.1, Eigen::Vector3d(0.2, 1, 0.1).normalized()).toRotationMatrix();
+  Eigen::Vector3d t = Eigen::Vector3d(1, 0.1, 0.05).normalized();
+
+  // half of the matches are moved off their epipolar lines
+  const int num_points = 400;
+  std::mt19937 generator(1);
+  std::uniform_real_distribution<double> uniform(-1, 1);
+  Eigen::Matrix2Xd x1(2, num_points), x2(2, num_points);
+  for (int i = 0; i < num_points; i++) {
+    Eigen::Vector3d p(2 * uniform(generator), 1.5 * uniform(generator), 4 + 2 * uniform(generator));
+    x1.col(i) = (k * p).hnormalized();
+    x2.col(i) = (k * (r * p + t)).hnormalized();
+    if (i % 2)
+      x2.col(i) += 100 * Eigen::Vector2d(uniform(generator), uniform(generator));
+  }
+
+  FLAGS_essential_sprt = true;
+  Eigen::Matrix3d e;
+  std::vector<size_t> inliers;
+  double error_max;
+  std::pair<size_t, size_t> size(640, 480);
+  EXPECT_TRUE(interest_point::RobustEssential(k, k, x1, x2, &e, &inliers, size, size, &error_max, 2.5));
+  FLAGS_essential_sprt = false;
+
+  int correct = 0;
+  for (size_t i : inliers)
+    correct += (i % 2 == 0);
+  EXPECT_EQ(num_points / 2, correct);
+  EXPECT_GT(num_points / 2 + 10, static_cast<int>(inliers.size()));
+  EXPECT_GE(2.5, error_max);
+
+  Eigen::Matrix3d r_est;
+  Eigen::Vector3d t_est;
+  ASSERT_TRUE(interest_point::EstimateRTFromE(k, k, x1, x2, e, inliers, &r_est, &t_est));
+  EXPECT_NEAR(0, Eigen::AngleAxisd(r_est.transpose() * r).angle(), 1e-6);
+  EXPECT_NEAR(1, t_est.normalized().dot(t), 1e-6);
+}
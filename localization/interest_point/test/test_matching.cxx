@@ -16,6 +16,7 @@
  * under the License.
  */
 
+#include <interest_point/hamming.h>
 #include <interest_point/matching.h>
 
 #include <Eigen/Geometry>
@@ -24,6 +25,8 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include <string.h>
+
 #include <string>
 #include <vector>
 
@@ -77,3 +80,113 @@ TEST_F(MatchingTest, ORGBRISK) {
   EXPECT_EQ(64, descriptor1.cols);
   EXPECT_LT(190u, matches.size());
 }
+
+TEST_F(MatchingTest, MatcherCache) {
+  DetectKeyPoints("ORGBRISK");
+  interest_point::MatcherCache cache(1);
+  std::vector<cv::DMatch> cached_matches, cached_matches2;
+  cache.FindMatches(descriptor1, 0, descriptor2, &cached_matches);
+  EXPECT_EQ(1u, cache.Size());
+  EXPECT_LT(190u, cached_matches.size());
+
+  // The second query reuses the same index, so gives the same answer
+  cache.FindMatches(descriptor1, 0, descriptor2, &cached_matches2);
+  ASSERT_EQ(cached_matches.size(), cached_matches2.size());
+  for (size_t i = 0; i < cached_matches.size(); i++) {
+    EXPECT_EQ(cached_matches[i].queryIdx, cached_matches2[i].queryIdx);
+    EXPECT_EQ(cached_matches[i].trainIdx, cached_matches2[i].trainIdx);
+  }
+
+  // The cache is bounded
+  cache.Prebuild(1, descriptor1);
+  EXPECT_EQ(1u, cache.Size());
+  cache.Clear();
+  EXPECT_EQ(0u, cache.Size());
+}
+
+TEST(Hamming, Distance) {
+  // Compare against a bit by bit count, for lengths that exercise
+  // both the vector loop and the tail
+  std::vector<uint8_t> a(100), b(100);
+  for (size_t i = 0; i < a.size(); i++) {
+    a[i] = static_cast<uint8_t>(i * 37 + 11);
+    b[i] = static_cast<uint8_t>(i * 101 + 3);
+  }
+  for (int n = 0; n <= 100; n++) {
+    int expected = 0;
+    for (int i = 0; i < n; i++)
+      for (int bit = 0; bit < 8; bit++)
+        expected += ((a[i] ^ b[i]) >> bit) & 1;
+    EXPECT_EQ(expected, interest_point::HammingDistance(a.data(), b.data(), n));
+  }
+}
+
+TEST(Hamming, Nearest) {
+  // The first of the nearest rows, for sizes with and without the
+  // vector register path, and with a padded stride
+  const int num_train = 9, stride = 80;
+  std::vector<uint8_t> query(64), train(num_train * stride);
+  for (size_t i = 0; i < query.size(); i++)
+    query[i] = static_cast<uint8_t>(i * 53 + 7);
+  for (size_t i = 0; i < train.size(); i++)
+    train[i] = static_cast<uint8_t>(i * 29 + 5);
+  memcpy(&train[6 * stride], &train[4 * stride], stride);
+  for (int n : {8, 16, 32, 48, 64}) {
+    int expected = -1, expected_dist = 0;
+    for (int t = 0; t < num_train; t++) {
+      int d = interest_point::HammingDistance(query.data(), &train[t * stride], n);
+      if (expected < 0 || d < expected_dist) {
+        expected = t;
+        expected_dist = d;
+      }
+    }
+    int dist = -1;
+    EXPECT_EQ(expected, interest_point::HammingNearest(query.data(), train.data(), num_train, stride, n, &dist));
+    EXPECT_EQ(expected_dist, dist);
+  }
+  EXPECT_EQ(-1, interest_point::HammingNearest(query.data(), train.data(), 0, stride, 64, NULL));
+}
+
+TEST_F(MatchingTest, BruteForce) {
+  DetectKeyPoints("ORGBRISK");
+  interest_point::FindMatchesBruteForce(descriptor1, descriptor2, &matches);
+  EXPECT_LT(190u, matches.size());
+
+  // Matching is exact, so it is repeatable and each train feature is
+  // used at most once thanks to the mutual check
+  std::vector<cv::DMatch> matches2;
+  interest_point::FindMatchesBruteForce(descriptor1, descriptor2, &matches2);
+  ASSERT_EQ(matches.size(), matches2.size());
+  std::vector<int> train_used(descriptor2.rows, 0);
+  for (size_t i = 0; i < matches.size(); i++) {
+    EXPECT_EQ(matches[i].trainIdx, matches2[i].trainIdx);
+    EXPECT_EQ(1, ++train_used[matches[i].trainIdx]);
+  }
+}
+
+TEST(SelectKeypointsOnGrid, Spread) {
+  // Strong keypoints crowd the left half, weak ones are in the right half
+  std::vector<cv::KeyPoint> keypoints;
+  for (int i = 0; i < 100; i++)
+    keypoints.push_back(cv::KeyPoint(i % 50, i / 50 * 10, 1, -1, 100 + i));
+  for (int i = 0; i < 10; i++)
+    keypoints.push_back(cv::KeyPoint(60 + i, 5, 1, -1, i));
+
+  // No change without too many
+  std::vector<cv::KeyPoint> selected = keypoints;
+  interest_point::SelectKeypointsOnGrid(cv::Size(100, 20), 2, 1, 200, &selected);
+  EXPECT_EQ(keypoints.size(), selected.size());
+
+  // Both halves get half, each with its strongest
+  interest_point::SelectKeypointsOnGrid(cv::Size(100, 20), 2, 1, 20, &selected);
+  ASSERT_EQ(20u, selected.size());
+  int right = 0;
+  for (cv::KeyPoint const& key : selected) {
+    if (key.pt.x >= 50) {
+      right++;
+    } else {
+      EXPECT_LE(180, key.response);
+    }
+  }
+  EXPECT_EQ(10, right);
+}
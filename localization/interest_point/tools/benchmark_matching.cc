@@ -0,0 +1,117 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <common/init.h>
+#include <interest_point/matching.h>
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Compare the speed and repeatability of the binary descriptor
+// matchers on a pair of images.
+//
+// Usage: benchmark_matching image1.jpg image2.jpg
+
+DECLARE_string(binary_matcher);
+
+DEFINE_string(detector, "ORGBRISK",
+              "The binary feature detector to use.");
+DEFINE_int32(num_runs, 20,
+             "Time this many matching calls for each matcher.");
+
+namespace {
+
+typedef std::set<std::pair<int, int> > MatchSet;
+
+MatchSet ToSet(std::vector<cv::DMatch> const& matches) {
+  MatchSet out;
+  for (cv::DMatch const& m : matches)
+    out.insert(std::make_pair(m.queryIdx, m.trainIdx));
+  return out;
+}
+
+// Time FindMatches with the given matcher. Repeatability is the
+// fraction of the matches of the first run found in every other run.
+void Benchmark(std::string const& matcher, cv::Mat const& descriptors1,
+               cv::Mat const& descriptors2, MatchSet * first_run) {
+  FLAGS_binary_matcher = matcher;
+  double total_ms = 0;
+  size_t num_common = 0, num_matches = 0;
+  for (int run = 0; run < FLAGS_num_runs; run++) {
+    std::vector<cv::DMatch> matches;
+    auto start = std::chrono::steady_clock::now();
+    interest_point::FindMatches(descriptors1, descriptors2, &matches);
+    total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    MatchSet current = ToSet(matches);
+    if (run == 0) {
+      *first_run = current;
+      continue;
+    }
+    for (std::pair<int, int> const& m : *first_run)
+      num_common += current.count(m);
+    num_matches += first_run->size();
+  }
+  std::cout << matcher << ": " << total_ms / FLAGS_num_runs << " ms per call, "
+            << first_run->size() << " matches";
+  if (num_matches > 0)
+    std::cout << ", repeatability " << static_cast<double>(num_common) / num_matches;
+  std::cout << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  common::InitFreeFlyerApplication(&argc, &argv);
+  if (argc < 3) {
+    std::cerr << "Usage: benchmark_matching image1.jpg image2.jpg\n";
+    return 1;
+  }
+  if (FLAGS_num_runs < 1)
+    LOG(FATAL) << "Need at least one run.";
+
+  interest_point::FeatureDetector detector(FLAGS_detector);
+  std::vector<cv::KeyPoint> keypoints1, keypoints2;
+  cv::Mat descriptors1, descriptors2;
+  detector.Detect(cv::imread(argv[1], CV_LOAD_IMAGE_GRAYSCALE), &keypoints1, &descriptors1);
+  detector.Detect(cv::imread(argv[2], CV_LOAD_IMAGE_GRAYSCALE), &keypoints2, &descriptors2);
+  if (descriptors1.depth() != CV_8U)
+    LOG(FATAL) << "Detector " << FLAGS_detector << " does not give binary descriptors.";
+  std::cout << descriptors1.rows << " x " << descriptors2.rows << " descriptors of "
+            << descriptors1.cols << " bytes" << std::endl;
+
+  MatchSet lsh, brute_force;
+  Benchmark("LSH", descriptors1, descriptors2, &lsh);
+  Benchmark("BRUTEFORCE", descriptors1, descriptors2, &brute_force);
+
+  size_t common_matches = 0;
+  for (std::pair<int, int> const& m : brute_force)
+    common_matches += lsh.count(m);
+  std::cout << common_matches << " matches are shared by both matchers" << std::endl;
+
+  return 0;
+}
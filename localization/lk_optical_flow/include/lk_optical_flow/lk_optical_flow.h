@@ -20,6 +20,7 @@
 #define LK_OPTICAL_FLOW_LK_OPTICAL_FLOW_H_
 
 #include <camera/camera_params.h>
+#include <lk_optical_flow/lk_tracker.h>
 #include <ff_msgs/Feature2d.h>
 #include <ff_msgs/Feature2dArray.h>
 
@@ -27,8 +28,12 @@
 #include <config_reader/config_reader.h>
 
 #include <opencv2/core/core.hpp>
+#include <Eigen/Geometry>
 
+#include <deque>
+#include <mutex>  // NOLINT
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace lk_optical_flow {
@@ -44,17 +49,34 @@ class LKOpticalFlow {
                          ff_msgs::Feature2dArray* features);
   sensor_msgs::Image::Ptr ShowDebugWindow(const sensor_msgs::ImageConstPtr& msg);
 
+  // Adds a gyro sample, in the IMU frame, if imu_prediction is set
+  void AddImu(ros::Time const& stamp, Eigen::Vector3d const& omega);
+  bool ImuPrediction(void) const {return imu_prediction_;}
+
  private:
   void AddNewFeatures(const std::vector<cv::Point2f>& new_points);
   void GetNewFeatures(std::vector<cv::Point2f>* new_corners);
+  void GetNewFeaturesGrid(std::vector<cv::Point2f>* new_corners);
   void CreateFeatureArray(ff_msgs::Feature2dArray* features);
   void RefineCorners();
   void UpdateIdList(const size_t& num_itr);
+  // Sets curr_corners_ to where the gyro rotation since the last frame moves
+  // prev_corners_, and false if the gyro samples do not cover that time
+  bool PredictCorners(ros::Time const& stamp);
+  // Sets backwards_corners_ from the prediction in it to curr_corners_ less
+  // the predicted flow
+  void SeedBackwardsCorners();
 
   cv::Mat image_curr_, image_prev_;
+  // the image pyramids with their derivatives, if reuse_pyramid_
+  std::vector<cv::Mat> pyramid_curr_, pyramid_prev_;
+  // the pyramids for lk_tracker_ instead, if fixed_point_lk_
+  LKPyramid lk_pyramid_curr_, lk_pyramid_prev_;
+  LKTracker lk_tracker_;
 
-  sensor_msgs::ImageConstPtr image_prev_ptr_;
   std::vector<cv::Point2f> prev_corners_, curr_corners_, backwards_corners_;
+  // the corners detected in this frame, kept so as not to reallocate
+  std::vector<cv::Point2f> new_corners_;
 
   std::vector<uchar> status_, backwards_status_;
   std::vector<float> err_, backwards_err_;
@@ -66,12 +88,27 @@ class LKOpticalFlow {
   int max_lk_itr_;
   int max_gap_;
   float scale_factor_;
+  bool reuse_pyramid_, fixed_point_lk_;
+  // detect new corners only in the cells of this grid with fewer than
+  // detect_cell_features_ tracked, or over the whole image if zero
+  int detect_grid_cols_, detect_grid_rows_, detect_cell_features_;
+  std::vector<int> cell_count_;
+  std::vector<cv::Point2f> cell_corners_;
 
   float max_flow_magnitude_, font_size_, max_feature_rad_;
   int id_cnt_, id_max_;
   std::vector<int> id_list_;
 
   camera::CameraParameters camera_param_;
+
+  // the features are predicted from the gyro, and tracked with up to
+  // imu_prediction_pyr_level_ levels when they are
+  bool imu_prediction_;
+  int imu_prediction_pyr_level_;
+  Eigen::Matrix3d imu_to_body_, nav_cam_to_body_;
+  std::mutex imu_mutex_;
+  std::deque<std::pair<ros::Time, Eigen::Vector3d> > imu_;
+  ros::Time prev_stamp_;
 };
 }  // end namespace lk_optical_flow
 
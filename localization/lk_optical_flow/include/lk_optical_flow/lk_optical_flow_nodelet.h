@@ -27,6 +27,7 @@
 #include <image_transport/image_transport.h>
 #include <ros/publisher.h>
 #include <ros/subscriber.h>
+#include <sensor_msgs/Imu.h>
 
 namespace lk_optical_flow {
 
@@ -40,6 +41,8 @@ class LKOpticalFlowNodelet : public ff_util::FreeFlyerNodelet {
  private:
   void ReadParams(void);
   void ImageCallback(const sensor_msgs::ImageConstPtr& msg);
+  void ImuCallback(const sensor_msgs::ImuConstPtr& msg);
+  void Subscribe(ros::NodeHandle* nh);
   bool EnableService(ff_msgs::SetBool::Request & req, ff_msgs::SetBool::Response & res);
 
   boost::shared_ptr<LKOpticalFlow> inst_;
@@ -54,10 +57,11 @@ class LKOpticalFlowNodelet : public ff_util::FreeFlyerNodelet {
   image_transport::CameraSubscriber cam_sub_;
 
   ros::Publisher feature_pub_, reg_pub_;
-  ros::Subscriber filtered_feature_sub_;
+  ros::Subscriber filtered_feature_sub_, imu_sub_;
   ros::ServiceServer enable_srv_;
 
   bool debug_view_;
+  bool scaled_image_;
 };
 }  // namespace lk_optical_flow
 
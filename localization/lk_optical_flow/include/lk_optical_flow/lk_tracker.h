@@ -0,0 +1,119 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef LK_OPTICAL_FLOW_LK_TRACKER_H_
+#define LK_OPTICAL_FLOW_LK_TRACKER_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace lk_optical_flow {
+
+/**
+ * @brief The image pyramid of one frame, for LKTracker.
+ * @details Each level is padded on every side by the window size, with the
+ * border reflected, so that windows that reach past the image edge can be
+ * read without checks. The Scharr gradients are stored next to the level,
+ * interleaved x then y, in fixed point int16.
+ */
+class LKPyramid {
+ public:
+  LKPyramid(void) : num_levels_(0) {}
+
+  /**
+   * Builds the pyramid of an 8 bit grayscale image with up to max_level
+   * levels above the image itself, stopping before a level is smaller than
+   * the window. Buffers are kept from the last call with the same sizes.
+   * Returns the highest level built.
+   **/
+  int Build(uint8_t const* data, int width, int height, int stride,
+            int win_width, int win_height, int max_level);
+
+  bool Empty(void) const {return num_levels_ == 0;}
+  void Clear(void) {num_levels_ = 0;}
+  void Swap(LKPyramid* other);
+
+ private:
+  friend class LKTracker;
+
+  struct Level {
+    int width, height;      // of the image, without the border
+    int border_x, border_y;
+    int stride;             // of the padded image, and half that of the gradients
+    std::vector<uint8_t> image;
+    std::vector<int16_t> gradient;
+
+    uint8_t* Image(int x, int y) {
+      return &image[(y + border_y) * stride + x + border_x];
+    }
+    uint8_t const* Image(int x, int y) const {
+      return &image[(y + border_y) * stride + x + border_x];
+    }
+    int16_t const* Gradient(int x, int y) const {
+      return &gradient[2 * ((y + border_y) * stride + x + border_x)];
+    }
+  };
+
+  void Resize(Level* level, int width, int height, int win_width, int win_height);
+  void ReflectBorder(Level* level);
+  void ComputeGradient(Level* level);
+
+  std::vector<Level> levels_;
+  int num_levels_;
+};
+
+/**
+ * @brief Pyramidal Lucas Kanade tracking with a fixed window, in fixed point.
+ * @details The same algorithm as cv::calcOpticalFlowPyrLK with no flags,
+ * except near the image border. The window and its gradients are
+ * interpolated in integers and kept in buffers sized once for the window,
+ * with NEON for the inner loops on ARM. The rest is portable scalar code.
+ */
+class LKTracker {
+ public:
+  LKTracker(void);
+
+  void SetParams(int win_width, int win_height, int max_iterations, float epsilon, float min_eig_threshold);
+
+  /**
+   * Tracks the points from the prev pyramid to the next one. Points are
+   * interleaved x and y, and status is set to 1 for each point tracked.
+   * Uses the levels built in both pyramids, up to max_level if it is not
+   * negative. With initial_flow, the search starts from next_points, as
+   * with cv::OPTFLOW_USE_INITIAL_FLOW, instead of from prev_points.
+   **/
+  void Track(LKPyramid const& prev, LKPyramid const& next, int num_points,
+             float const* prev_points, float* next_points, uint8_t* status,
+             int max_level = -1, bool initial_flow = false);
+
+ private:
+  // refines the position in next of a point at one level, false if lost
+  bool TrackLevel(LKPyramid::Level const& prev, LKPyramid::Level const& next,
+                  float prev_x, float prev_y, float* next_x, float* next_y);
+
+  int win_width_, win_height_, max_iterations_;
+  float epsilon_, min_eig_threshold_;
+
+  // the window of the prev level, and its gradients, interleaved
+  std::vector<int16_t> win_image_, win_gradient_;
+};
+
+}  // end namespace lk_optical_flow
+
+#endif  // LK_OPTICAL_FLOW_LK_TRACKER_H_
@@ -18,6 +18,7 @@
 
 #include <lk_optical_flow/lk_optical_flow.h>
 #include <ff_msgs/CameraRegistration.h>
+#include <msg_conversions/msg_conversions.h>
 
 #include <opencv2/features2d/features2d.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -27,10 +28,19 @@
 
 namespace lk_optical_flow {
 
+// LKTracker takes the points as interleaved floats
+static_assert(sizeof(cv::Point2f) == 2 * sizeof(float), "cv::Point2f is not two floats.");
+
+// The longest the gyro samples may miss of the time between two frames
+static const double kMaxImuGap = 0.05;
+// The most gyro samples kept when no frames come
+static const size_t kMaxImuSamples = 500;
+
 LKOpticalFlow::LKOpticalFlow(void) :
   id_cnt_(0), camera_param_(Eigen::Vector2i::Zero(),
       Eigen::Vector2d::Ones(),
-      Eigen::Vector2d::Zero()) {
+      Eigen::Vector2d::Zero()), imu_prediction_(false),
+      imu_to_body_(Eigen::Matrix3d::Identity()), nav_cam_to_body_(Eigen::Matrix3d::Identity()) {
 }
 
 
@@ -50,8 +60,34 @@ void LKOpticalFlow::ReadParams(config_reader::ConfigReader* config) {
     ROS_FATAL("Unspecified win_size_height.");
   if (!config->GetInt("max_feature", &max_feature))
     ROS_FATAL("Unspecified max_feature.");
+  if (!config->GetBool("reuse_pyramid", &reuse_pyramid_))
+    ROS_FATAL("Unspecified reuse_pyramid.");
+  if (!config->GetBool("fixed_point_lk", &fixed_point_lk_))
+    ROS_FATAL("Unspecified fixed_point_lk.");
+  if (!config->GetInt("detect_grid_cols", &detect_grid_cols_))
+    ROS_FATAL("Unspecified detect_grid_cols.");
+  if (!config->GetInt("detect_grid_rows", &detect_grid_rows_))
+    ROS_FATAL("Unspecified detect_grid_rows.");
+  if (!config->GetInt("detect_cell_features", &detect_cell_features_))
+    ROS_FATAL("Unspecified detect_cell_features.");
+  if (!config->GetBool("imu_prediction", &imu_prediction_))
+    ROS_FATAL("Unspecified imu_prediction.");
+  if (!config->GetInt("imu_prediction_pyr_level", &imu_prediction_pyr_level_))
+    ROS_FATAL("Unspecified imu_prediction_pyr_level.");
+  if (imu_prediction_) {
+    Eigen::Vector3d trans;
+    Eigen::Quaterniond rot;
+    if (!msg_conversions::config_read_transform(config, "imu_transform", &trans, &rot))
+      ROS_FATAL("Unspecified imu_transform.");
+    imu_to_body_ = rot.toRotationMatrix();
+    if (!msg_conversions::config_read_transform(config, "nav_cam_transform", &trans, &rot))
+      ROS_FATAL("Unspecified nav_cam_transform.");
+    nav_cam_to_body_ = rot.toRotationMatrix();
+  }
   scale_factor_ = 2.0;
   max_feature_ = static_cast<size_t>(max_feature);
+  // the same termination and threshold as the OpenCV calls
+  lk_tracker_.SetParams(win_size_.width, win_size_.height, max_lk_itr_, 0.03, 0.001);
 
   scale_factor_ = 2.0;
   id_max_ = max_feature_ * 10000;
@@ -61,49 +97,162 @@ void LKOpticalFlow::ReadParams(config_reader::ConfigReader* config) {
 
 void LKOpticalFlow::OpticalFlow(const sensor_msgs::ImageConstPtr& msg,
                                   ff_msgs::Feature2dArray* features) {
-  // Convert the ros image message type into cv::Mat
+  // Convert the ros image message type into cv::Mat, sharing the message data
+  cv::Mat image;
   try {
-    image_curr_ = cv_bridge::toCvShare(msg, msg->encoding)->image;
+    image = cv_bridge::toCvShare(msg, msg->encoding)->image;
   } catch (cv_bridge::Exception& e) {
     ROS_ERROR("cv_bridge exception: %s", e.what());
     return;
   }
 
-  cv::resize(image_curr_, image_curr_, cv::Size(), 1.0 / scale_factor_, 1.0 / scale_factor_);
-  std::vector<cv::Point2f> new_corners;
-  GetNewFeatures(&new_corners);
+  // image_curr_ holds the frame before last, so is already the right size. An
+  // image the driver scaled down is only copied, since image_curr_ is kept.
+  if (image.cols * scale_factor_ == camera_param_.GetDistortedSize()[0])
+    image.copyTo(image_curr_);
+  else
+    cv::resize(image, image_curr_, cv::Size(), 1.0 / scale_factor_, 1.0 / scale_factor_);
+  // Build the pyramid once and keep it for the next frame. Otherwise each LK
+  // call builds the pyramids of both images, four per frame.
+  int pyr_level = max_lk_pyr_level_;
+  if (fixed_point_lk_)
+    lk_pyramid_curr_.Build(image_curr_.ptr(), image_curr_.cols, image_curr_.rows, static_cast<int>(image_curr_.step),
+                           win_size_.width, win_size_.height, max_lk_pyr_level_);
+  else if (reuse_pyramid_)
+    pyr_level = cv::buildOpticalFlowPyramid(image_curr_, pyramid_curr_, win_size_, max_lk_pyr_level_);
+  new_corners_.clear();
+  GetNewFeatures(&new_corners_);
   if (!curr_corners_.empty()) {
+    // Start from where the gyro says the features went, if it covers the
+    // time since the last frame. The search then needs fewer levels. The
+    // backwards search starts from the tracked features less the predicted
+    // flow, which the prediction is kept in backwards_corners_ for.
+    bool predicted = imu_prediction_ && PredictCorners(msg->header.stamp);
+    int flags = 0;
+    if (predicted) {
+      flags = cv::OPTFLOW_USE_INITIAL_FLOW;
+      pyr_level = std::min(pyr_level, imu_prediction_pyr_level_);
+      backwards_corners_ = curr_corners_;
+    }
     // Run LK optical flow algorithm for consecutive image frames
     cv::TermCriteria termcrit(CV_TERMCRIT_ITER|CV_TERMCRIT_EPS, max_lk_itr_, 0.03);
-    cv::calcOpticalFlowPyrLK(image_prev_, image_curr_, prev_corners_, curr_corners_, status_, err_,
-                             win_size_, max_lk_pyr_level_, termcrit,
-                             0, 0.001);
-    cv::calcOpticalFlowPyrLK(image_curr_, image_prev_, curr_corners_, backwards_corners_,
-                             backwards_status_, backwards_err_, win_size_, max_lk_pyr_level_, termcrit,
-                             0, 0.001);
+    if (fixed_point_lk_ && !lk_pyramid_prev_.Empty()) {
+      int n = prev_corners_.size();
+      curr_corners_.resize(n);
+      backwards_corners_.resize(n);
+      status_.resize(n);
+      backwards_status_.resize(n);
+      lk_tracker_.Track(lk_pyramid_prev_, lk_pyramid_curr_, n, reinterpret_cast<float const*>(&prev_corners_[0]),
+                        reinterpret_cast<float*>(&curr_corners_[0]), &status_[0], pyr_level, predicted);
+      if (predicted)
+        SeedBackwardsCorners();
+      lk_tracker_.Track(lk_pyramid_curr_, lk_pyramid_prev_, n, reinterpret_cast<float const*>(&curr_corners_[0]),
+                        reinterpret_cast<float*>(&backwards_corners_[0]), &backwards_status_[0], pyr_level,
+                        predicted);
+    } else if (!fixed_point_lk_ && reuse_pyramid_ && !pyramid_prev_.empty()) {
+      cv::calcOpticalFlowPyrLK(pyramid_prev_, pyramid_curr_, prev_corners_, curr_corners_, status_, err_,
+                               win_size_, pyr_level, termcrit, flags, 0.001);
+      if (predicted)
+        SeedBackwardsCorners();
+      cv::calcOpticalFlowPyrLK(pyramid_curr_, pyramid_prev_, curr_corners_, backwards_corners_,
+                               backwards_status_, backwards_err_, win_size_, pyr_level, termcrit,
+                               flags, 0.001);
+    } else {
+      cv::calcOpticalFlowPyrLK(image_prev_, image_curr_, prev_corners_, curr_corners_, status_, err_,
+                               win_size_, pyr_level, termcrit,
+                               flags, 0.001);
+      if (predicted)
+        SeedBackwardsCorners();
+      cv::calcOpticalFlowPyrLK(image_curr_, image_prev_, curr_corners_, backwards_corners_,
+                               backwards_status_, backwards_err_, win_size_, pyr_level, termcrit,
+                               flags, 0.001);
+    }
 
     // Remove corners with false status and with large displacements
     RefineCorners();
 
     // Add new corners from new_corners to maintain the maximum number of corners
-    AddNewFeatures(new_corners);
+    AddNewFeatures(new_corners_);
   } else {
     // printf("COLD START!\n");
     // Cold start, or we have all new features
-    curr_corners_ = new_corners;
-    prev_corners_ = new_corners;
+    curr_corners_ = new_corners_;
+    prev_corners_ = new_corners_;
     UpdateIdList(curr_corners_.size());
   }
 
   CreateFeatureArray(features);
   features->header.stamp = msg->header.stamp;
+  prev_stamp_ = msg->header.stamp;
 
-  // Update previous features and image
+  // Update previous features and image. Swapping keeps both buffers, and
+  // the pyramid's, for the next frame to write into.
   prev_corners_ = curr_corners_;
-  // We swap and we also need to copy the ImageConstPtr so the data behind the
-  // cv::Mat will not be deallocated by the smart pointer.
-  image_prev_ptr_ = msg;
   cv::swap(image_prev_, image_curr_);
+  if (fixed_point_lk_)
+    lk_pyramid_prev_.Swap(&lk_pyramid_curr_);
+  else
+    lk_pyramid_prev_.Clear();
+  if (reuse_pyramid_ && !fixed_point_lk_)
+    pyramid_prev_.swap(pyramid_curr_);
+  else
+    pyramid_prev_.clear();
+}
+
+void LKOpticalFlow::AddImu(ros::Time const& stamp, Eigen::Vector3d const& omega) {
+  std::lock_guard<std::mutex> lock(imu_mutex_);
+  imu_.push_back(std::make_pair(stamp, omega));
+  if (imu_.size() > kMaxImuSamples)
+    imu_.pop_front();
+}
+
+bool LKOpticalFlow::PredictCorners(ros::Time const& stamp) {
+  // Integrate the body rotation from the last frame to this one, holding
+  // each sample's rate until the next sample. The last sample before this
+  // frame is kept, to start the next frame's rotation from.
+  Eigen::Matrix3d rotation = Eigen::Matrix3d::Identity();
+  {
+    std::lock_guard<std::mutex> lock(imu_mutex_);
+    if (prev_stamp_.isZero() || imu_.empty() || stamp <= prev_stamp_ ||
+        (imu_.front().first - prev_stamp_).toSec() > kMaxImuGap ||
+        (stamp - imu_.back().first).toSec() > kMaxImuGap)
+      return false;
+    for (size_t i = 0; i < imu_.size(); i++) {
+      ros::Time begin = std::max(imu_[i].first, prev_stamp_);
+      ros::Time end = (i + 1 < imu_.size() ? std::min(imu_[i + 1].first, stamp) : stamp);
+      if (end <= begin)
+        continue;
+      Eigen::Vector3d angle = imu_to_body_ * imu_[i].second * (end - begin).toSec();
+      if (angle.norm() > 0)
+        rotation = rotation * Eigen::AngleAxisd(angle.norm(), angle.normalized()).toRotationMatrix();
+    }
+    while (imu_.size() > 1 && imu_[1].first <= stamp)
+      imu_.pop_front();
+  }
+
+  // The camera rotation, and the directions of the features in the camera
+  // before and after it. A feature stays where it is if it turns behind.
+  rotation = nav_cam_to_body_.transpose() * rotation * nav_cam_to_body_;
+  double focal = camera_param_.GetFocalLength();
+  curr_corners_.resize(prev_corners_.size());
+  for (size_t i = 0; i < prev_corners_.size(); i++) {
+    Eigen::Vector2d point;
+    camera_param_.Convert<camera::DISTORTED, camera::UNDISTORTED_C>
+    (Eigen::Vector2d(prev_corners_[i].x * scale_factor_, prev_corners_[i].y * scale_factor_), &point);
+    Eigen::Vector3d direction = rotation.transpose() * Eigen::Vector3d(point.x(), point.y(), focal);
+    curr_corners_[i] = prev_corners_[i];
+    if (direction.z() <= 0)
+      continue;
+    camera_param_.Convert<camera::UNDISTORTED_C, camera::DISTORTED>(focal * direction.head<2>() / direction.z(),
+                                                                     &point);
+    curr_corners_[i] = cv::Point2f(point.x() / scale_factor_, point.y() / scale_factor_);
+  }
+  return true;
+}
+
+void LKOpticalFlow::SeedBackwardsCorners() {
+  for (size_t i = 0; i < curr_corners_.size(); i++)
+    backwards_corners_[i] = curr_corners_[i] - backwards_corners_[i] + prev_corners_[i];
 }
 
 void LKOpticalFlow::GetNewFeatures(std::vector<cv::Point2f>* new_corners) {
@@ -116,6 +265,11 @@ void LKOpticalFlow::GetNewFeatures(std::vector<cv::Point2f>* new_corners) {
   if (curr_corners_.size() > 8 * max_feature_ / 10)
     return;
 
+  if (detect_grid_cols_ > 0 && detect_grid_rows_ > 0) {
+    GetNewFeaturesGrid(new_corners);
+    return;
+  }
+
   // Get new corners from LK
   cv::goodFeaturesToTrack(image_curr_, *new_corners, 100, 0.01, max_gap_, cv::Mat(), 3, false, 0.04);
   // printf("Get new corners.\n");
@@ -123,6 +277,37 @@ void LKOpticalFlow::GetNewFeatures(std::vector<cv::Point2f>* new_corners) {
   // printf("Found %lu new features, reduced to %lu.\n", raw_corners.size(), new_corners->size());
 }
 
+void LKOpticalFlow::GetNewFeaturesGrid(std::vector<cv::Point2f>* new_corners) {
+  // Count the tracked corners in each cell
+  int num_cells = detect_grid_cols_ * detect_grid_rows_;
+  cell_count_.assign(num_cells, 0);
+  for (auto const& it : curr_corners_) {
+    int col = std::min(std::max(static_cast<int>(it.x * detect_grid_cols_ / image_curr_.cols), 0),
+                       detect_grid_cols_ - 1);
+    int row = std::min(std::max(static_cast<int>(it.y * detect_grid_rows_ / image_curr_.rows), 0),
+                       detect_grid_rows_ - 1);
+    cell_count_[row * detect_grid_cols_ + col]++;
+  }
+
+  // Only look for corners in the cells short of their share, and only as
+  // many as they are short. The quality threshold is relative to the best
+  // corner in each cell, so weakly textured areas still get some.
+  for (int row = 0; row < detect_grid_rows_; row++) {
+    for (int col = 0; col < detect_grid_cols_; col++) {
+      int wanted = detect_cell_features_ - cell_count_[row * detect_grid_cols_ + col];
+      if (wanted <= 0)
+        continue;
+      int x0 = col * image_curr_.cols / detect_grid_cols_;
+      int y0 = row * image_curr_.rows / detect_grid_rows_;
+      cv::Rect cell(x0, y0, (col + 1) * image_curr_.cols / detect_grid_cols_ - x0,
+                    (row + 1) * image_curr_.rows / detect_grid_rows_ - y0);
+      cv::goodFeaturesToTrack(image_curr_(cell), cell_corners_, wanted, 0.01, max_gap_, cv::Mat(), 3, false, 0.04);
+      for (auto const& it : cell_corners_)
+        new_corners->push_back(it + cv::Point2f(x0, y0));
+    }
+  }
+}
+
 void LKOpticalFlow::AddNewFeatures(const std::vector<cv::Point2f>& new_corners) {
   // To ensure that push_back is fast, reserve space for all the features we
   // are going to add. Does nothing if vector is already larger.
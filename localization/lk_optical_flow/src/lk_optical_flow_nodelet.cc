@@ -32,14 +32,14 @@ void LKOpticalFlowNodelet::Initialize(ros::NodeHandle* nh) {
   // Initialize lua config reader
   config_.AddFile("optical_flow.config");
   config_.AddFile("cameras.config");
+  config_.AddFile("geometry.config");
   ReadParams();
   config_timer_ = nh->createTimer(ros::Duration(1), [this](ros::TimerEvent e) {
     config_.CheckFilesUpdated(std::bind(&LKOpticalFlowNodelet::ReadParams, this));
   }, false, true);
 
   // Create all our subscribers and publishers
-  image_transport::ImageTransport img_transp(*nh);
-  img_sub_ = img_transp.subscribe(TOPIC_HARDWARE_NAV_CAM, 1, &LKOpticalFlowNodelet::ImageCallback, this);
+  Subscribe(nh);
   if (debug_view_) {
     image_transport::ImageTransport img_transp_priv(*nh);
     img_pub_ = img_transp_priv.advertise(TOPIC_LOCALIZATION_OF_DEBUG, 1);
@@ -60,22 +60,44 @@ void LKOpticalFlowNodelet::ReadParams() {
 
   if (!config_.GetBool("debug_view", &debug_view_))
     ROS_FATAL("Unspecified debug_view.");
+  if (!config_.GetBool("scaled_image", &scaled_image_))
+    ROS_FATAL("Unspecified scaled_image.");
 
   inst_->ReadParams(&config_);
 }
 
 bool LKOpticalFlowNodelet::EnableService(ff_msgs::SetBool::Request & req, ff_msgs::SetBool::Response & res) {
   if (req.enable) {
-    image_transport::ImageTransport img_transp(getNodeHandle());
-    img_sub_ = img_transp.subscribe(TOPIC_HARDWARE_NAV_CAM, 1, &LKOpticalFlowNodelet::ImageCallback, this);
+    Subscribe(&getNodeHandle());
   } else {
     img_sub_.shutdown();
+    imu_sub_.shutdown();
   }
   res.success = true;
   return true;
 }
 
 
+// The driver can publish the nav_cam image already scaled down, which saves
+// reducing the full frame here
+void LKOpticalFlowNodelet::Subscribe(ros::NodeHandle* nh) {
+  image_transport::ImageTransport img_transp(*nh);
+  if (scaled_image_)
+    img_sub_ = img_transp.subscribe(TOPIC_HARDWARE_NAV_CAM TOPIC_HARDWARE_CAM_SUFFIX_SCALED, 1,
+                                    &LKOpticalFlowNodelet::ImageCallback, this);
+  else
+    img_sub_ = img_transp.subscribe(TOPIC_HARDWARE_NAV_CAM, 1, &LKOpticalFlowNodelet::ImageCallback, this);
+  // The gyro predicts where the features go between frames
+  if (inst_->ImuPrediction())
+    imu_sub_ = nh->subscribe(TOPIC_HARDWARE_IMU, 10, &LKOpticalFlowNodelet::ImuCallback, this,
+                             ros::TransportHints().tcpNoDelay());
+}
+
+void LKOpticalFlowNodelet::ImuCallback(const sensor_msgs::ImuConstPtr& msg) {
+  inst_->AddImu(msg->header.stamp, Eigen::Vector3d(msg->angular_velocity.x, msg->angular_velocity.y,
+                                                   msg->angular_velocity.z));
+}
+
 void LKOpticalFlowNodelet::ImageCallback(const sensor_msgs::ImageConstPtr& msg) {
   // Signal to the EKF that we are processing this image. (The EKF must perform
   // state augmentation at this instant.)
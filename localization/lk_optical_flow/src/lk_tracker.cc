@@ -0,0 +1,365 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <lk_optical_flow/lk_tracker.h>
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LK_TRACKER_NEON
+#endif
+
+namespace lk_optical_flow {
+
+namespace {
+
+// bilinear weights are in 14 bit fixed point, as in OpenCV, and the window
+// keeps 5 fractional bits of the image
+const int W_BITS = 14;
+const float FLT_SCALE = 1.0f / (1 << 20);
+// so that NEON may load whole vectors at the end of the last row
+const int SLACK = 16;
+
+int Reflect101(int i, int n) {
+  while (i < 0 || i >= n) {
+    if (i < 0)
+      i = -i;
+    if (i >= n)
+      i = 2 * n - 2 - i;
+  }
+  return i;
+}
+
+int Descale(int x, int n) {
+  return (x + (1 << (n - 1))) >> n;
+}
+
+#ifdef LK_TRACKER_NEON
+int32x4_t Widen(uint8_t const* p) {
+  return vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(vmovl_u8(vld1_u8(p)))));
+}
+
+int32x4_t Interpolate(int32x4_t v00, int32x4_t v01, int32x4_t v10, int32x4_t v11,
+                      int iw00, int iw01, int iw10, int iw11) {
+  int32x4_t v = vmulq_n_s32(v00, iw00);
+  v = vmlaq_n_s32(v, v01, iw01);
+  v = vmlaq_n_s32(v, v10, iw10);
+  return vmlaq_n_s32(v, v11, iw11);
+}
+
+float Sum(float32x4_t v) {
+  float s[4];
+  vst1q_f32(s, v);
+  return s[0] + s[1] + s[2] + s[3];
+}
+#endif
+
+}  // namespace
+
+void LKPyramid::Resize(Level* level, int width, int height, int win_width, int win_height) {
+  level->width = width;
+  level->height = height;
+  level->border_x = win_width + 1;
+  level->border_y = win_height + 1;
+  level->stride = width + 2 * level->border_x;
+  size_t size = level->stride * (height + 2 * level->border_y);
+  level->image.resize(size + SLACK);
+  level->gradient.resize(2 * size + SLACK);
+}
+
+void LKPyramid::ReflectBorder(Level* level) {
+  int w = level->width, h = level->height;
+  int bx = level->border_x, by = level->border_y;
+  for (int y = 0; y < h; y++) {
+    uint8_t* row = level->Image(0, y);
+    for (int x = 1; x <= bx; x++) {
+      row[-x] = row[Reflect101(-x, w)];
+      row[w - 1 + x] = row[Reflect101(w - 1 + x, w)];
+    }
+  }
+  for (int y = 1; y <= by; y++) {
+    memcpy(level->Image(-bx, -y), level->Image(-bx, Reflect101(-y, h)), level->stride);
+    memcpy(level->Image(-bx, h - 1 + y), level->Image(-bx, Reflect101(h - 1 + y, h)),
+           level->stride);
+  }
+}
+
+void LKPyramid::ComputeGradient(Level* level) {
+  // Scharr over the padded image, leaving the outermost pixels zero, which
+  // no window reaches
+  int s = level->stride, rows = level->height + 2 * level->border_y;
+  uint8_t const* image = &level->image[0];
+  int16_t* gradient = &level->gradient[0];
+  memset(gradient, 0, 2 * s * sizeof(int16_t));
+  memset(gradient + 2 * s * (rows - 1), 0, 2 * s * sizeof(int16_t));
+  for (int y = 1; y < rows - 1; y++) {
+    uint8_t const* p = image + y * s;
+    int16_t* g = gradient + 2 * y * s;
+    g[0] = g[1] = g[2 * s - 2] = g[2 * s - 1] = 0;
+    for (int x = 1; x < s - 1; x++) {
+      g[2 * x] = static_cast<int16_t>(3 * (p[x - s + 1] - p[x - s - 1] + p[x + s + 1] - p[x + s - 1]) +
+                                      10 * (p[x + 1] - p[x - 1]));
+      g[2 * x + 1] = static_cast<int16_t>(3 * (p[x + s - 1] - p[x - s - 1] + p[x + s + 1] - p[x - s + 1]) +
+                                          10 * (p[x + s] - p[x - s]));
+    }
+  }
+}
+
+int LKPyramid::Build(uint8_t const* data, int width, int height, int stride,
+                     int win_width, int win_height, int max_level) {
+  if (levels_.size() < static_cast<size_t>(max_level + 1))
+    levels_.resize(max_level + 1);
+
+  Level* level = &levels_[0];
+  Resize(level, width, height, win_width, win_height);
+  for (int y = 0; y < height; y++)
+    memcpy(level->Image(0, y), data + y * stride, width);
+  ReflectBorder(level);
+  ComputeGradient(level);
+  num_levels_ = 1;
+
+  for (int l = 1; l <= max_level; l++) {
+    Level const& src = levels_[l - 1];
+    int w = (src.width + 1) / 2, h = (src.height + 1) / 2;
+    if (w <= win_width || h <= win_height)
+      break;
+    level = &levels_[l];
+    Resize(level, w, h, win_width, win_height);
+    // 5x5 Gaussian, as cv::pyrDown, reading into the reflected border
+    int s = src.stride;
+    for (int y = 0; y < h; y++) {
+      uint8_t* dst = level->Image(0, y);
+      for (int x = 0; x < w; x++) {
+        uint8_t const* p = src.Image(2 * x, 2 * y);
+        int sum = 0;
+        for (int r = -2; r <= 2; r++) {
+          uint8_t const* q = p + r * s;
+          int row = q[-2] + 4 * (q[-1] + q[1]) + 6 * q[0] + q[2];
+          sum += row * (r == 0 ? 6 : (r == -1 || r == 1 ? 4 : 1));
+        }
+        dst[x] = static_cast<uint8_t>((sum + 128) >> 8);
+      }
+    }
+    ReflectBorder(level);
+    ComputeGradient(level);
+    num_levels_++;
+  }
+  return num_levels_ - 1;
+}
+
+void LKPyramid::Swap(LKPyramid* other) {
+  levels_.swap(other->levels_);
+  std::swap(num_levels_, other->num_levels_);
+}
+
+LKTracker::LKTracker(void) {
+  SetParams(31, 31, 10, 0.03, 0.001);
+}
+
+void LKTracker::SetParams(int win_width, int win_height, int max_iterations, float epsilon,
+                          float min_eig_threshold) {
+  win_width_ = win_width;
+  win_height_ = win_height;
+  max_iterations_ = max_iterations;
+  epsilon_ = epsilon;
+  min_eig_threshold_ = min_eig_threshold;
+  win_image_.resize(win_width * win_height);
+  win_gradient_.resize(2 * win_width * win_height);
+}
+
+void LKTracker::Track(LKPyramid const& prev, LKPyramid const& next, int num_points,
+                      float const* prev_points, float* next_points, uint8_t* status,
+                      int max_level, bool initial_flow) {
+  int top = std::min(prev.num_levels_, next.num_levels_) - 1;
+  if (max_level >= 0)
+    top = std::min(top, max_level);
+  for (int i = 0; i < num_points; i++) {
+    float x = prev_points[2 * i], y = prev_points[2 * i + 1];
+    float next_x = 0, next_y = 0;
+    bool tracked = false;
+    for (int l = top; l >= 0; l--) {
+      float scale = 1.0f / (1 << l);
+      if (l == top && initial_flow) {
+        next_x = next_points[2 * i] * scale;
+        next_y = next_points[2 * i + 1] * scale;
+      } else if (l == top) {
+        next_x = x * scale;
+        next_y = y * scale;
+      } else {
+        next_x *= 2;
+        next_y *= 2;
+      }
+      // only the last level decides if the point is lost
+      tracked = TrackLevel(prev.levels_[l], next.levels_[l], x * scale, y * scale, &next_x, &next_y);
+    }
+    next_points[2 * i] = next_x;
+    next_points[2 * i + 1] = next_y;
+    status[i] = tracked;
+  }
+}
+
+bool LKTracker::TrackLevel(LKPyramid::Level const& prev, LKPyramid::Level const& next,
+                           float prev_x, float prev_y, float* next_x, float* next_y) {
+  float half_w = (win_width_ - 1) * 0.5f, half_h = (win_height_ - 1) * 0.5f;
+  prev_x -= half_w;
+  prev_y -= half_h;
+  int ix = static_cast<int>(floorf(prev_x)), iy = static_cast<int>(floorf(prev_y));
+  if (ix < -win_width_ || ix >= prev.width || iy < -win_height_ || iy >= prev.height)
+    return false;
+
+  // Interpolate the window of prev, and its gradients
+  float a = prev_x - ix, b = prev_y - iy;
+  int iw00 = static_cast<int>(lrintf((1.0f - a) * (1.0f - b) * (1 << W_BITS)));
+  int iw01 = static_cast<int>(lrintf(a * (1.0f - b) * (1 << W_BITS)));
+  int iw10 = static_cast<int>(lrintf((1.0f - a) * b * (1 << W_BITS)));
+  int iw11 = (1 << W_BITS) - iw00 - iw01 - iw10;
+  int s = prev.stride, ds = 2 * prev.stride;
+  float a11 = 0, a12 = 0, a22 = 0;
+#ifdef LK_TRACKER_NEON
+  float32x4_t va11 = vdupq_n_f32(0), va12 = vdupq_n_f32(0), va22 = vdupq_n_f32(0);
+#endif
+  for (int y = 0; y < win_height_; y++) {
+    uint8_t const* src = prev.Image(ix, iy + y);
+    int16_t const* dsrc = prev.Gradient(ix, iy + y);
+    int16_t* win = &win_image_[y * win_width_];
+    int16_t* dwin = &win_gradient_[2 * y * win_width_];
+    int x = 0;
+#ifdef LK_TRACKER_NEON
+    for (; x + 4 <= win_width_; x += 4) {
+      int32x4_t v = Interpolate(Widen(src + x), Widen(src + x + 1), Widen(src + x + s), Widen(src + x + s + 1),
+                                iw00, iw01, iw10, iw11);
+      vst1_s16(win + x, vmovn_s32(vrshrq_n_s32(v, W_BITS - 5)));
+      int16x4x2_t d00 = vld2_s16(dsrc + 2 * x), d01 = vld2_s16(dsrc + 2 * x + 2);
+      int16x4x2_t d10 = vld2_s16(dsrc + 2 * x + ds), d11 = vld2_s16(dsrc + 2 * x + ds + 2);
+      int32x4_t gx = vrshrq_n_s32(Interpolate(vmovl_s16(d00.val[0]), vmovl_s16(d01.val[0]), vmovl_s16(d10.val[0]),
+                                              vmovl_s16(d11.val[0]), iw00, iw01, iw10, iw11), W_BITS);
+      int32x4_t gy = vrshrq_n_s32(Interpolate(vmovl_s16(d00.val[1]), vmovl_s16(d01.val[1]), vmovl_s16(d10.val[1]),
+                                              vmovl_s16(d11.val[1]), iw00, iw01, iw10, iw11), W_BITS);
+      int16x4x2_t g;
+      g.val[0] = vmovn_s32(gx);
+      g.val[1] = vmovn_s32(gy);
+      vst2_s16(dwin + 2 * x, g);
+      va11 = vaddq_f32(va11, vcvtq_f32_s32(vmulq_s32(gx, gx)));
+      va12 = vaddq_f32(va12, vcvtq_f32_s32(vmulq_s32(gx, gy)));
+      va22 = vaddq_f32(va22, vcvtq_f32_s32(vmulq_s32(gy, gy)));
+    }
+#endif
+    for (; x < win_width_; x++) {
+      int v = Descale(src[x] * iw00 + src[x + 1] * iw01 + src[x + s] * iw10 + src[x + s + 1] * iw11, W_BITS - 5);
+      int16_t const* d = dsrc + 2 * x;
+      int gx = Descale(d[0] * iw00 + d[2] * iw01 + d[ds] * iw10 + d[ds + 2] * iw11, W_BITS);
+      int gy = Descale(d[1] * iw00 + d[3] * iw01 + d[ds + 1] * iw10 + d[ds + 3] * iw11, W_BITS);
+      win[x] = static_cast<int16_t>(v);
+      dwin[2 * x] = static_cast<int16_t>(gx);
+      dwin[2 * x + 1] = static_cast<int16_t>(gy);
+      a11 += static_cast<float>(gx * gx);
+      a12 += static_cast<float>(gx * gy);
+      a22 += static_cast<float>(gy * gy);
+    }
+  }
+#ifdef LK_TRACKER_NEON
+  a11 += Sum(va11);
+  a12 += Sum(va12);
+  a22 += Sum(va22);
+#endif
+  a11 *= FLT_SCALE;
+  a12 *= FLT_SCALE;
+  a22 *= FLT_SCALE;
+
+  // Lost if the window has too little texture to track
+  float d = a11 * a22 - a12 * a12;
+  float min_eig = (a22 + a11 - sqrtf((a11 - a22) * (a11 - a22) + 4.0f * a12 * a12)) /
+                  (2 * win_width_ * win_height_);
+  if (min_eig < min_eig_threshold_ || d < FLT_EPSILON)
+    return false;
+  d = 1.0f / d;
+
+  // Gauss-Newton iterations on the position in next
+  float x_n = *next_x - half_w, y_n = *next_y - half_h;
+  float prev_delta_x = 0, prev_delta_y = 0;
+  s = next.stride;
+  for (int j = 0; j < max_iterations_; j++) {
+    int jx = static_cast<int>(floorf(x_n)), jy = static_cast<int>(floorf(y_n));
+    if (jx < -win_width_ || jx >= next.width || jy < -win_height_ || jy >= next.height)
+      return false;
+    a = x_n - jx;
+    b = y_n - jy;
+    iw00 = static_cast<int>(lrintf((1.0f - a) * (1.0f - b) * (1 << W_BITS)));
+    iw01 = static_cast<int>(lrintf(a * (1.0f - b) * (1 << W_BITS)));
+    iw10 = static_cast<int>(lrintf((1.0f - a) * b * (1 << W_BITS)));
+    iw11 = (1 << W_BITS) - iw00 - iw01 - iw10;
+
+    float b1 = 0, b2 = 0;
+#ifdef LK_TRACKER_NEON
+    float32x4_t vb1 = vdupq_n_f32(0), vb2 = vdupq_n_f32(0);
+#endif
+    for (int y = 0; y < win_height_; y++) {
+      uint8_t const* src = next.Image(jx, jy + y);
+      int16_t const* win = &win_image_[y * win_width_];
+      int16_t const* dwin = &win_gradient_[2 * y * win_width_];
+      int x = 0;
+#ifdef LK_TRACKER_NEON
+      for (; x + 4 <= win_width_; x += 4) {
+        int32x4_t v = Interpolate(Widen(src + x), Widen(src + x + 1), Widen(src + x + s), Widen(src + x + s + 1),
+                                  iw00, iw01, iw10, iw11);
+        int32x4_t diff = vsubq_s32(vrshrq_n_s32(v, W_BITS - 5), vmovl_s16(vld1_s16(win + x)));
+        int16x4x2_t g = vld2_s16(dwin + 2 * x);
+        vb1 = vaddq_f32(vb1, vcvtq_f32_s32(vmulq_s32(diff, vmovl_s16(g.val[0]))));
+        vb2 = vaddq_f32(vb2, vcvtq_f32_s32(vmulq_s32(diff, vmovl_s16(g.val[1]))));
+      }
+#endif
+      for (; x < win_width_; x++) {
+        int diff = Descale(src[x] * iw00 + src[x + 1] * iw01 + src[x + s] * iw10 + src[x + s + 1] * iw11,
+                           W_BITS - 5) - win[x];
+        b1 += static_cast<float>(diff * dwin[2 * x]);
+        b2 += static_cast<float>(diff * dwin[2 * x + 1]);
+      }
+    }
+#ifdef LK_TRACKER_NEON
+    b1 += Sum(vb1);
+    b2 += Sum(vb2);
+#endif
+    b1 *= FLT_SCALE;
+    b2 *= FLT_SCALE;
+
+    float delta_x = (a12 * b2 - a22 * b1) * d;
+    float delta_y = (a12 * b1 - a11 * b2) * d;
+    x_n += delta_x;
+    y_n += delta_y;
+    *next_x = x_n + half_w;
+    *next_y = y_n + half_h;
+    if (delta_x * delta_x + delta_y * delta_y <= epsilon_ * epsilon_)
+      break;
+    // stop halfway if it goes back and forth
+    if (j > 0 && fabsf(delta_x + prev_delta_x) < 0.01f && fabsf(delta_y + prev_delta_y) < 0.01f) {
+      *next_x -= delta_x * 0.5f;
+      *next_y -= delta_y * 0.5f;
+      break;
+    }
+    prev_delta_x = delta_x;
+    prev_delta_y = delta_y;
+  }
+  return true;
+}
+
+}  // end namespace lk_optical_flow
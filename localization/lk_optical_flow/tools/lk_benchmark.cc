@@ -0,0 +1,153 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Tracks features between consecutive nav_cam images in a bag, forwards and
+// backwards as the optical flow nodelet does, with both cv::calcOpticalFlowPyrLK
+// and LKTracker. Prints the time each takes per frame and how far apart their
+// tracks are.
+
+#include <common/init.h>
+#include <config_reader/config_reader.h>
+#include <ff_util/ff_names.h>
+#include <lk_optical_flow/lk_tracker.h>
+
+#include <cv_bridge/cv_bridge.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/Image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+DEFINE_string(image_topic, "/" TOPIC_HARDWARE_NAV_CAM, "The topic of the images to track in.");
+DEFINE_int32(max_frames, 0, "Stop after this many frames, if not zero.");
+
+namespace {
+
+double Seconds(std::chrono::steady_clock::time_point const& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char ** argv) {
+  common::InitFreeFlyerApplication(&argc, &argv);
+
+  if (argc < 2) {
+    LOG(INFO) << "Usage: " << argv[0] << " bag.bag";
+    exit(0);
+  }
+
+  config_reader::ConfigReader config;
+  config.AddFile("optical_flow.config");
+  if (!config.ReadFiles())
+    LOG(FATAL) << "Failed to read config files.";
+  int max_feature, max_gap, max_lk_pyr_level, max_lk_itr;
+  cv::Size win_size;
+  if (!config.GetInt("max_feature", &max_feature) || !config.GetInt("max_gap", &max_gap) ||
+      !config.GetInt("max_lk_pyr_level", &max_lk_pyr_level) || !config.GetInt("max_lk_itr", &max_lk_itr) ||
+      !config.GetInt("win_size_width", &win_size.width) || !config.GetInt("win_size_height", &win_size.height))
+    LOG(FATAL) << "Missing optical flow parameters.";
+
+  cv::TermCriteria termcrit(CV_TERMCRIT_ITER|CV_TERMCRIT_EPS, max_lk_itr, 0.03);
+  lk_optical_flow::LKTracker tracker;
+  tracker.SetParams(win_size.width, win_size.height, max_lk_itr, 0.03, 0.001);
+  lk_optical_flow::LKPyramid pyramid_prev, pyramid_curr;
+
+  rosbag::Bag bag;
+  bag.open(argv[1], rosbag::bagmode::Read);
+  rosbag::View view(bag, rosbag::TopicQuery(std::vector<std::string>(1, FLAGS_image_topic)));
+
+  cv::Mat image_prev, image_curr;
+  std::vector<cv::Point2f> corners, cv_next, cv_back, lk_next, lk_back;
+  std::vector<uchar> cv_status, cv_back_status, lk_status, lk_back_status;
+  std::vector<float> err;
+  int frames = 0, features = 0, both = 0, agree = 0;
+  double cv_time = 0, lk_time = 0, diff_sum = 0, diff_max = 0;
+  for (rosbag::MessageInstance const& m : view) {
+    sensor_msgs::ImageConstPtr msg = m.instantiate<sensor_msgs::Image>();
+    if (!msg)
+      continue;
+    cv::Mat image = cv_bridge::toCvShare(msg, "mono8")->image;
+    cv::resize(image, image_curr, cv::Size(), 0.5, 0.5);
+
+    // the fixed point pyramid of each frame is built once, and kept
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pyramid_curr.Build(image_curr.ptr(), image_curr.cols, image_curr.rows, static_cast<int>(image_curr.step),
+                       win_size.width, win_size.height, max_lk_pyr_level);
+    lk_time += Seconds(start);
+
+    if (!image_prev.empty())
+      cv::goodFeaturesToTrack(image_prev, corners, max_feature, 0.01, max_gap, cv::Mat(), 3, false, 0.04);
+    if (!image_prev.empty() && !corners.empty()) {
+      int n = corners.size();
+
+      start = std::chrono::steady_clock::now();
+      cv::calcOpticalFlowPyrLK(image_prev, image_curr, corners, cv_next, cv_status, err,
+                               win_size, max_lk_pyr_level, termcrit, 0, 0.001);
+      cv::calcOpticalFlowPyrLK(image_curr, image_prev, cv_next, cv_back, cv_back_status, err,
+                               win_size, max_lk_pyr_level, termcrit, 0, 0.001);
+      cv_time += Seconds(start);
+
+      lk_next.resize(n);
+      lk_back.resize(n);
+      lk_status.resize(n);
+      lk_back_status.resize(n);
+      start = std::chrono::steady_clock::now();
+      tracker.Track(pyramid_prev, pyramid_curr, n, reinterpret_cast<float const*>(&corners[0]),
+                    reinterpret_cast<float*>(&lk_next[0]), &lk_status[0]);
+      tracker.Track(pyramid_curr, pyramid_prev, n, reinterpret_cast<float const*>(&lk_next[0]),
+                    reinterpret_cast<float*>(&lk_back[0]), &lk_back_status[0]);
+      lk_time += Seconds(start);
+
+      for (int i = 0; i < n; i++) {
+        bool cv_ok = cv_status[i] && cv_back_status[i];
+        bool lk_ok = lk_status[i] && lk_back_status[i];
+        if (cv_ok == lk_ok)
+          agree++;
+        if (cv_ok && lk_ok) {
+          double diff = cv::norm(cv_next[i] - lk_next[i]);
+          diff_sum += diff;
+          diff_max = std::max(diff_max, diff);
+          both++;
+        }
+      }
+      features += n;
+      frames++;
+      if (FLAGS_max_frames > 0 && frames >= FLAGS_max_frames)
+        break;
+    }
+    cv::swap(image_prev, image_curr);
+    pyramid_prev.Swap(&pyramid_curr);
+  }
+  bag.close();
+
+  if (frames == 0)
+    LOG(FATAL) << "No pairs of images on " << FLAGS_image_topic << ".";
+  printf("%d frames, %.1f features per frame\n", frames, static_cast<double>(features) / frames);
+  printf("OpenCV:    %.3f ms per frame\n", 1000 * cv_time / frames);
+  printf("LKTracker: %.3f ms per frame, including its pyramid\n", 1000 * lk_time / frames);
+  printf("Tracked or lost by both: %.2f%%\n", 100.0 * agree / std::max(features, 1));
+  printf("Difference where both tracked: mean %.4f px, max %.4f px\n", diff_sum / std::max(both, 1), diff_max);
+}
@@ -25,6 +25,7 @@
 // FSW
 #include <ff_util/ff_names.h>
 #include <ff_util/ff_service.h>
+#include <ff_util/perf_timer.h>
 
 // STL includes
 #include <functional>
@@ -43,6 +44,9 @@ class Pipeline {
     std::string const& desc, bool req_of, bool req_ekf) :
       mode_(mode), cb_(cb), name_(name), desc_(desc),
         req_of_(req_of), req_ekf_(req_ekf) {
+    pt_latency_.Initialize("localization_pipeline_" + name + "_latency");
+    pt_period_.Initialize("localization_pipeline_" + name + "_period");
+    pt_features_.Initialize("localization_pipeline_" + name + "_features");
   }
 
   // Get the pipeline name
@@ -82,6 +86,26 @@ class Pipeline {
       cb_(name_, stable);
   }
 
+  // Report the time from each registration to its features, the time
+  // between features and how many there were
+  void MarkRegistration() {
+    registration_ = ros::Time::now();
+  }
+  void MarkFeatures(size_t num_features) {
+    ros::Time now = ros::Time::now();
+    if (!registration_.isZero()) {
+      pt_latency_.Add((now - registration_).toSec());
+      pt_latency_.Send();
+    }
+    if (!features_.isZero()) {
+      pt_period_.Add((now - features_).toSec());
+      pt_period_.Send();
+    }
+    features_ = now;
+    pt_features_.Add(num_features);
+    pt_features_.Send();
+  }
+
  private:
   uint8_t mode_;
   PipelineCallbackType cb_;
@@ -89,6 +113,8 @@ class Pipeline {
   std::string desc_;
   bool req_of_;
   bool req_ekf_;
+  ros::Time registration_, features_;
+  ff_util::PerfTimer pt_latency_, pt_period_, pt_features_;
 };
 
 }  // namespace localization_manager
@@ -57,6 +57,10 @@ class ARPipeline : public Pipeline {
   // Callback resets watchdog timer and performs some extra sanity checks
   void FeatureCallback(ff_msgs::VisualLandmarks::ConstPtr const& msg);
 
+  // Callback notes how long usable features have arrived without a gap, even
+  // when the tracker was enabled by someone else to warm up before a switch
+  void WarmupCallback(ff_msgs::VisualLandmarks::ConstPtr const& msg);
+
   // Let the localization manager know that we didn't haev enough valid measurements
   void MeasurementWatchdog(ros::TimerEvent const& event);
 
@@ -76,6 +80,8 @@ class ARPipeline : public Pipeline {
   ff_util::FreeFlyerServiceClient<ff_msgs::SetBool> service_;  // EKF set input service
   ros::Subscriber sub_m_;                                      // Subscriber: measurements
   ros::Subscriber sub_f_;                                      // Subscriber: features
+  ros::Subscriber sub_w_;                                      // Subscriber: warm up
+  ros::Time warm_since_, warm_last_;                           // Unbroken usable features
   ros::Timer timer_m_;                                         // Watchdog: measurements
   ros::Timer timer_f_;                                         // Watchdog: features
   ros::Timer timer_stable_;                                    // Stability timer
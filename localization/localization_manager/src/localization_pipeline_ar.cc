@@ -39,6 +39,8 @@ ARPipeline::ARPipeline(ros::NodeHandle *nh, ros::NodeHandle *nhp, uint8_t mode,
   service_.SetConnectedTimeout(cfg_.Get<double>("timeout_service_enable"));
   service_.SetTimeoutCallback(std::bind(&ARPipeline::EnableTimeoutCallback, this));
   service_.Create(nh, SERVICE_LOCALIZATION_AR_ENABLE);
+  // Features only arrive while the tracker is enabled, so this costs nothing otherwise
+  sub_w_ = nh_->subscribe(TOPIC_LOCALIZATION_AR_FEATURES, 1, &ARPipeline::WarmupCallback, this);
 }
 
 bool ARPipeline::ReconfigureCallback(dynamic_reconfigure::Config &config) {
@@ -69,8 +71,18 @@ bool ARPipeline::Enable(bool enable) {
     // Enable watchdog timers with the given durations
     StartTimer(timer_m_, cfg_.Get<double>("timeout_measurements"));
     StartTimer(timer_f_, cfg_.Get<double>("timeout_features"));
-    // The time required to wait for stability before sending a switch event
-    StartTimer(timer_stable_, cfg_.Get<double>("timeout_stability"));
+    // The time required to wait for stability before sending a switch event. If
+    // the tracker was warmed up and usable features have already arrived for
+    // that long, report stability as soon as this switch has been set up.
+    ros::Time now = ros::Time::now();
+    if (!warm_last_.isZero()
+      && (now - warm_last_).toSec() < cfg_.Get<double>("timeout_features")
+      && (now - warm_since_).toSec() >= cfg_.Get<double>("timeout_stability")) {
+      ROS_INFO_STREAM("AR tracking was warm for " << (now - warm_since_).toSec() << " seconds");
+      StartTimer(timer_stable_, 0.01);
+    } else {
+      StartTimer(timer_stable_, cfg_.Get<double>("timeout_stability"));
+    }
   } else {
     // The time required to wait for stability before sending a switch event
     StopTimer(timer_stable_);
@@ -87,14 +99,25 @@ bool ARPipeline::Enable(bool enable) {
 }
 
 void ARPipeline::MeasurementCallback(ff_msgs::CameraRegistration::ConstPtr const& msg) {
+  MarkRegistration();
   StartTimer(timer_m_, cfg_.Get<double>("timeout_measurements"));
 }
 
 void ARPipeline::FeatureCallback(ff_msgs::VisualLandmarks::ConstPtr const& msg) {
+  MarkFeatures(msg->landmarks.size());
   if (static_cast<int>(msg->landmarks.size()) >= cfg_.Get<int>("minimum_features"))
     StartTimer(timer_f_, cfg_.Get<double>("timeout_features"));
 }
 
+void ARPipeline::WarmupCallback(ff_msgs::VisualLandmarks::ConstPtr const& msg) {
+  if (static_cast<int>(msg->landmarks.size()) < cfg_.Get<int>("minimum_features"))
+    return;
+  ros::Time now = ros::Time::now();
+  if (warm_last_.isZero() || (now - warm_last_).toSec() >= cfg_.Get<double>("timeout_features"))
+    warm_since_ = now;
+  warm_last_ = now;
+}
+
 void ARPipeline::MeasurementWatchdog(ros::TimerEvent const& event) {
   MarkStable(false);
   StartTimer(timer_stable_, cfg_.Get<double>("timeout_stability"));
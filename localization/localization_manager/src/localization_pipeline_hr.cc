@@ -86,10 +86,12 @@ bool HRPipeline::Enable(bool enable) {
 }
 
 void HRPipeline::MeasurementCallback(ff_msgs::CameraRegistration::ConstPtr const& msg) {
+  MarkRegistration();
   StartTimer(timer_m_, cfg_.Get<double>("timeout_measurements"));
 }
 
 void HRPipeline::FeatureCallback(ff_msgs::DepthLandmarks::ConstPtr const& msg) {
+  MarkFeatures(msg->landmarks.size());
   if (static_cast<int>(msg->landmarks.size()) >= cfg_.Get<int>("minimum_features"))
     StartTimer(timer_f_, cfg_.Get<double>("timeout_features"));
 }
@@ -86,10 +86,12 @@ bool MLPipeline::Enable(bool enable) {
 }
 
 void MLPipeline::MeasurementCallback(ff_msgs::CameraRegistration::ConstPtr const& msg) {
+  MarkRegistration();
   StartTimer(timer_m_, cfg_.Get<double>("timeout_measurements"));
 }
 
 void MLPipeline::FeatureCallback(ff_msgs::VisualLandmarks::ConstPtr const& msg) {
+  MarkFeatures(msg->landmarks.size());
   if (static_cast<int>(msg->landmarks.size()) >= cfg_.Get<int>("minimum_features"))
     StartTimer(timer_f_, cfg_.Get<double>("timeout_features"));
 }
@@ -31,7 +31,7 @@
 
 #include <camera/camera_params.h>
 
-#include <opencv2/core/core_c.h>
+#include <opencv2/core/core.hpp>
 #include <alvar/Alvar.h>
 #include <alvar/Util.h>
 
@@ -45,9 +45,9 @@ namespace marker_tracking {
 class ALVAR_EXPORT Labeling {
  protected :
   /**
-   * \brief Pointer to binary image that is then labeled.
+   * \brief Binary image that is then labeled, kept at the size of the largest image seen.
    */
-  IplImage *bw_;
+  cv::Mat bw_;
 
   camera::CameraParameters cam_;
   int thresh_param1_, thresh_param2_;
@@ -68,10 +68,11 @@ class ALVAR_EXPORT Labeling {
 
   /**
    * \brief Labels image and filters blobs to obtain square-shaped objects from the scene.
+   * Only the given regions of the image are searched, and squares must lie inside one of them.
    */
-  virtual void LabelSquares(IplImage* image) = 0;
+  virtual void LabelSquares(cv::Mat const& image, std::vector<cv::Rect> const& regions) = 0;
 
-  bool CheckBorder(CvSeq* contour, int width, int height);
+  bool CheckBorder(std::vector<cv::Point> const& contour, cv::Rect const& region);
 
   void SetThreshParams(int param1, int param2);
 
@@ -84,16 +85,23 @@ class ALVAR_EXPORT Labeling {
  */
 class ALVAR_EXPORT LabelingCvSeq : public Labeling {
  protected :
-  int n_blobs_;
   int min_edge_;
   int min_area_;
-  CvMemStorage* storage_;
+
+  // Kept to reuse the memory from frame to frame
+  std::vector<std::vector<cv::Point> > contours_;
+  std::vector<cv::Point> square_;
+  std::vector<cv::Point2f> line_data_;
+
+  // Fits the corners of a square to the edges of its contour
+  void FitCorners(std::vector<cv::Point> const& contour, std::vector<cv::Point> const& square,
+                  std::vector<alvar::PointDouble>* corners);
 
  public:
   explicit LabelingCvSeq(camera::CameraParameters const& cam);
   virtual ~LabelingCvSeq();
 
-  void LabelSquares(IplImage* image);
+  void LabelSquares(cv::Mat const& image, std::vector<cv::Rect> const& regions);
 };
 
 }  // namespace marker_tracking
@@ -29,6 +29,7 @@
 #include <Eigen/Core>
 
 #include <opencv2/core/core_c.h>  // I don't need all of OpenCV
+#include <opencv2/core/core.hpp>
 #include <alvar/Marker.h>
 
 #include <vector>
@@ -43,6 +44,7 @@ namespace marker_tracking {
     std::vector<alvar::MarkerData> *markers_, *markers_old_;
     marker_tracking::LabelingCvSeq labeling_;
     alvar::Camera* alvar_cam_;
+    std::vector<cv::Rect> regions_;
 
    public:
     explicit MarkerCornerDetector(camera::CameraParameters const& camera);
@@ -51,6 +53,16 @@ namespace marker_tracking {
     void Detect(IplImage *image,
                 float max_new_marker_error,
                 float max_track_error);
+    void Detect(cv::Mat const& image,
+                float max_new_marker_error,
+                float max_track_error);
+    // Only searches the given regions of the image, for instance around
+    // where the markers are expected from the last pose. The regions are
+    // clipped to the image and merged where they overlap.
+    void Detect(cv::Mat const& image,
+                std::vector<cv::Rect> const& regions,
+                float max_new_marker_error,
+                float max_track_error);
 
     size_t NumMarkers() const;
     alvar::MarkerData& GetMarker(size_t i) const;
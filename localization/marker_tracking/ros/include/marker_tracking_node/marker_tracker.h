@@ -24,11 +24,13 @@
 #include <camera/camera_params.h>
 #include <ff_msgs/SetBool.h>
 #include <ff_msgs/VisualLandmarks.h>
+#include <ff_util/frame_budget.h>
 
 #include <image_transport/image_transport.h>
 #include <ros/publisher.h>
 
 #include <string>
+#include <vector>
 
 namespace marker_tracking_node {
 
@@ -43,10 +45,12 @@ class MarkerTracker {
 
  private:
   void VideoCallback(const sensor_msgs::ImageConstPtr& image_msg);
+  void ProcessImage(const sensor_msgs::ImageConstPtr& image_msg);
   bool EnableService(ff_msgs::SetBool::Request& req,
                      ff_msgs::SetBool::Response& res);
   void ReadParams(void);
   int EstimatePose(ff_msgs::VisualLandmarks* msg);
+  void PredictRegions(Eigen::Affine3d const& cam_t_world);
 
   config_reader::ConfigReader config_;
   ros::Timer config_timer_;
@@ -60,6 +64,13 @@ class MarkerTracker {
   const std::string& nodelet_name_;
   camera::CameraParameters camera_param_;
   std::shared_ptr<marker_tracking::MarkerCornerDetector> detector_;
+
+  // Where the markers are expected in the next image, from the last pose
+  bool roi_tracking_;
+  int roi_margin_, full_search_period_, frames_since_full_search_;
+  std::vector<cv::Rect> search_regions_;
+
+  ff_util::FrameBudget budget_;
 };
 
 };  // namespace marker_tracking_node
@@ -33,7 +33,11 @@
 #include <opencv2/calib3d.hpp>
 #include <opencv2/core/eigen.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <string>
+#include <vector>
 
 namespace marker_tracking_node {
 
@@ -43,8 +47,10 @@ MarkerTracker::MarkerTracker(ros::NodeHandle* nh, ros::NodeHandle* private_nh,
       nodelet_name_(nm),
       camera_param_(Eigen::Vector2i::Zero(),  // Here because I deleted the
                     Eigen::Vector2d::Ones(),  // default constructor
-                    Eigen::Vector2d::Zero()) {
+                    Eigen::Vector2d::Zero()),
+      frames_since_full_search_(0) {
   config_.AddFile("cameras.config");
+  config_.AddFile("localization/marker_tracking.config");
   ReadParams();
 
   // Resolve the full path to the AR tag file specified for the current world
@@ -105,6 +111,20 @@ void MarkerTracker::ReadParams(void) {
 
   camera_param_ = camera::CameraParameters(&config_, "dock_cam");
   detector_.reset(new marker_tracking::MarkerCornerDetector(camera_param_));
+
+  // Search only around the markers expected from the last pose
+  if (!config_.GetBool("roi_tracking", &roi_tracking_))
+    ROS_FATAL("Unspecified roi_tracking.");
+  if (!config_.GetInt("roi_margin", &roi_margin_))
+    ROS_FATAL("Unspecified roi_margin.");
+  if (!config_.GetInt("full_search_period", &full_search_period_))
+    ROS_FATAL("Unspecified full_search_period.");
+  search_regions_.clear();
+
+  double cpu_budget;
+  if (!config_.GetReal("cpu_budget", &cpu_budget))
+    ROS_FATAL("Unspecified cpu_budget.");
+  budget_.SetBudget(cpu_budget);
 }
 
 bool MarkerTracker::EnableService(ff_msgs::SetBool::Request& req,
@@ -142,8 +162,8 @@ int MarkerTracker::EstimatePose(ff_msgs::VisualLandmarks* msg) {
   cv::Mat rvec(3, 1, cv::DataType<double>::type);
   cv::Mat tvec(3, 1, cv::DataType<double>::type);
   cv::Mat distortion(4, 1, cv::DataType<double>::type, cv::Scalar(0));
-  cv::solvePnPRansac(object_points, image_points, camera_matrix, distortion,
-                     rvec, tvec);
+  bool solved = cv::solvePnPRansac(object_points, image_points, camera_matrix,
+                                   distortion, rvec, tvec);
   Eigen::Vector3d pos;
   cv::cv2eigen(tvec, pos);
   Eigen::Matrix3d rotation;
@@ -159,6 +179,7 @@ int MarkerTracker::EstimatePose(ff_msgs::VisualLandmarks* msg) {
   cam_t_global.setIdentity();
   cam_t_global.translate(pos);
   cam_t_global.rotate(rotation);
+  if (roi_tracking_ && solved) PredictRegions(cam_t_global);
   cam_t_global = cam_t_global.inverse();  // actually world to cam
 
   Eigen::Quaterniond quat(cam_t_global.rotation());
@@ -169,11 +190,57 @@ int MarkerTracker::EstimatePose(ff_msgs::VisualLandmarks* msg) {
   return 0;
 }
 
+// Projects the corners of every known marker with the last pose, and
+// searches the box around each marker that lands in front of the camera
+void MarkerTracker::PredictRegions(Eigen::Affine3d const& cam_t_world) {
+  search_regions_.clear();
+  Eigen::Matrix3d intrinsics =
+      camera_param_.GetIntrinsicMatrix<camera::UNDISTORTED_C>();
+  Eigen::Vector2i const& size = camera_param_.GetDistortedSize();
+  cv::Rect frame(0, 0, size[0], size[1]);
+  for (auto const& tag : ar_tags_) {
+    Eigen::Vector2d corner_min = Eigen::Vector2d::Constant(
+        std::numeric_limits<double>::max());
+    Eigen::Vector2d corner_max = -corner_min;
+    bool in_front = true;
+    for (int j = 0; j < 4; j++) {
+      Eigen::Vector3d p =
+          cam_t_world * tag.second.row(j).transpose().cast<double>();
+      if (p.z() <= 0) {
+        in_front = false;
+        break;
+      }
+      Eigen::Vector3d uv = intrinsics * p;
+      Eigen::Vector2d distorted;
+      camera_param_.Convert<camera::UNDISTORTED_C, camera::DISTORTED>(
+          uv.head<2>() / uv.z(), &distorted);
+      corner_min = corner_min.cwiseMin(distorted);
+      corner_max = corner_max.cwiseMax(distorted);
+    }
+    if (!in_front) continue;
+    cv::Rect region(cv::Point(std::floor(corner_min.x()) - roi_margin_,
+                              std::floor(corner_min.y()) - roi_margin_),
+                    cv::Point(std::ceil(corner_max.x()) + roi_margin_,
+                              std::ceil(corner_max.y()) + roi_margin_));
+    region &= frame;
+    if (region.area() > 0) search_regions_.push_back(region);
+  }
+}
+
 /*
   This callback is called when an image is received.
   It tries to detect the markers and pass that information to process marker.
 */
 void MarkerTracker::VideoCallback(const sensor_msgs::ImageConstPtr& image_msg) {
+  // skip the frame, before registering it, if tracking is over its budget
+  if (budget_.Skip())
+    return;
+  budget_.Start();
+  ProcessImage(image_msg);
+  budget_.Stop();
+}
+
+void MarkerTracker::ProcessImage(const sensor_msgs::ImageConstPtr& image_msg) {
   ff_msgs::CameraRegistration r;
   ros::Time timestamp = ros::Time::now();
   r.header = std_msgs::Header();
@@ -185,10 +252,22 @@ void MarkerTracker::VideoCallback(const sensor_msgs::ImageConstPtr& image_msg) {
   // Convert the image
   cv_bridge::CvImageConstPtr cv_ptr_ =
       cv_bridge::toCvShare(image_msg, sensor_msgs::image_encodings::MONO8);
-  IplImage ipl_image = cv_ptr_->image;
+  cv::Mat const& image = cv_ptr_->image;
 
-  // Detect our AR Tags
-  detector_->Detect(&ipl_image, 0.08, 0.2);
+  // Detect our AR Tags, around where they were last seen if we can, and over
+  // the whole image periodically or when they are lost
+  bool full_search = !roi_tracking_ || search_regions_.empty() ||
+                     frames_since_full_search_ >= full_search_period_;
+  if (!full_search) {
+    detector_->Detect(image, search_regions_, 0.08, 0.2);
+    frames_since_full_search_++;
+    full_search = !detector_->NumMarkers();
+  }
+  if (full_search) {
+    detector_->Detect(image, 0.08, 0.2);
+    frames_since_full_search_ = 0;
+  }
+  search_regions_.clear();
 
   // No markers? Early exit.
   if (!detector_->NumMarkers()) return;
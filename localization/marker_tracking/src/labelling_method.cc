@@ -25,23 +25,23 @@
 
 #include <Eigen/Core>
 #include <alvar/Line.h>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <vector>
 
 marker_tracking::Labeling::Labeling(camera::CameraParameters const& cam) :
-  bw_(NULL), cam_(cam) {
+  cam_(cam) {
   thresh_param1_ = 31;
   thresh_param2_ = 5;
 }
 
-marker_tracking::Labeling::~Labeling() {
-  if (bw_)
-    cvReleaseImage(&bw_);
-}
+marker_tracking::Labeling::~Labeling() {}
 
-bool marker_tracking::Labeling::CheckBorder(CvSeq* contour, int width, int height) {
+bool marker_tracking::Labeling::CheckBorder(std::vector<cv::Point> const& contour, cv::Rect const& region) {
   bool ret = true;
-  for (int i = 0; i < contour->total; ++i) {
-    CvPoint* pt = reinterpret_cast<CvPoint*>(cvGetSeqElem(contour, i));
-    if ((pt->x <= 1) || (pt->x >= width-2) || (pt->y <= 1) || (pt->y >= height-2)) ret = false;
+  for (cv::Point const& pt : contour) {
+    if ((pt.x <= region.x + 1) || (pt.x >= region.x + region.width - 2) ||
+        (pt.y <= region.y + 1) || (pt.y >= region.y + region.height - 2)) ret = false;
   }
   return ret;
 }
@@ -52,116 +52,80 @@ void marker_tracking::Labeling::SetThreshParams(int param1, int param2) {
 }
 
 marker_tracking::LabelingCvSeq::LabelingCvSeq(camera::CameraParameters const& cam) :
-  Labeling(cam), n_blobs_(0), min_edge_(20), min_area_(25) {
-  storage_ = cvCreateMemStorage(0);
-}
-
-marker_tracking::LabelingCvSeq::~LabelingCvSeq() {
-  if (storage_)
-    cvReleaseMemStorage(&storage_);
-}
-
-void marker_tracking::LabelingCvSeq::LabelSquares(IplImage* image) {
-  if (bw_ == NULL) {
-    bw_ = cvCreateImage(cvSize(image->width, image->height), IPL_DEPTH_8U, 1);
+  Labeling(cam), min_edge_(20), min_area_(25) {}
+
+marker_tracking::LabelingCvSeq::~LabelingCvSeq() {}
+
+void marker_tracking::LabelingCvSeq::LabelSquares(cv::Mat const& image, std::vector<cv::Rect> const& regions) {
+  assert(image.type() == CV_8UC1);
+  if (bw_.cols < image.cols || bw_.rows < image.rows)
+    bw_.create(image.size(), CV_8UC1);
+
+  blob_corners.clear();
+  for (cv::Rect const& region : regions) {
+    // Threshold only the region, and find the contours in image coordinates
+    cv::Mat bw = bw_(cv::Rect(0, 0, region.width, region.height));
+    cv::adaptiveThreshold(image(region), bw, 255, CV_ADAPTIVE_THRESH_MEAN_C, CV_THRESH_BINARY_INV,
+                          thresh_param1_, thresh_param2_);
+    cv::findContours(bw, contours_, CV_RETR_LIST, CV_CHAIN_APPROX_NONE, region.tl());
+
+    for (std::vector<cv::Point> const& contour : contours_) {
+      if (static_cast<int>(contour.size()) < min_edge_)
+        continue;
+
+      cv::approxPolyDP(contour, square_, cv::arcLength(contour, true) * 0.035, true);
+      if (square_.size() == 4 && CheckBorder(square_, region) &&
+          fabs(cv::contourArea(square_)) > min_area_ && cv::isContourConvex(square_)) {
+        blob_corners.push_back(std::vector<alvar::PointDouble>(4));
+        FitCorners(contour, square_, &blob_corners.back());
+      }
+    }
   }
+}
 
-  // Convert grayscale and threshold
-  assert(image->nChannels == 1);
-
-  cvAdaptiveThreshold(image, bw_, 255, CV_ADAPTIVE_THRESH_MEAN_C, CV_THRESH_BINARY_INV, thresh_param1_, thresh_param2_);
-
-  CvSeq* contours;
-  CvSeq* squares = cvCreateSeq(0, sizeof(CvSeq), sizeof(CvSeq), storage_);
-  CvSeq* square_contours = cvCreateSeq(0, sizeof(CvSeq), sizeof(CvSeq), storage_);
-
-  cvFindContours(bw_, storage_, &contours, sizeof(CvContour),
-                 CV_RETR_LIST, CV_CHAIN_APPROX_NONE, cvPoint(0, 0));
-
-  while (contours) {
-    if (contours->total < min_edge_) {
-      contours = contours->h_next;
-      continue;
+void marker_tracking::LabelingCvSeq::FitCorners(std::vector<cv::Point> const& contour,
+                                                std::vector<cv::Point> const& square,
+                                                std::vector<alvar::PointDouble>* corners) {
+  std::vector<alvar::Line> fitted_lines(4);
+  int total = contour.size();
+  for (int j = 0; j < 4; ++j) {
+    cv::Point const& pt0 = square[j];
+    cv::Point const& pt1 = square[(j + 1) % 4];
+    int k0 = -1, k1 = -1;
+    for (int k = 0; k < total; k++) {
+      if (pt0 == contour[k]) k0 = k;
+      if (pt1 == contour[k]) k1 = k;
     }
-
-    CvSeq* result = cvApproxPoly(contours, sizeof(CvContour), storage_,
-                                 CV_POLY_APPROX_DP, cvContourPerimeter(contours) * 0.035, 0);
-
-    if ( result->total == 4 && CheckBorder(result, image->width, image->height) &&
-         fabs(cvContourArea(result, CV_WHOLE_SEQ)) > min_area_ &&
-         cvCheckContourConvexity(result) ) {
-      cvSeqPush(squares, result);
-      cvSeqPush(square_contours, contours);
+    int len;
+    if (k1 >= k0)
+      len = k1 - k0 - 1;  // neither k0 nor k1 are included
+    else
+      len = total - k0 + k1 - 1;
+    if (len == 0) len = 1;
+
+    line_data_.resize(len);
+    for (int l = 0; l < len; l++) {
+      cv::Point const& p = contour[(k0 + l + 1) % total];
+      Eigen::Vector2d undistorted;
+      cam_.Convert<camera::DISTORTED, camera::UNDISTORTED>(Eigen::Vector2d(p.x, p.y), &undistorted);
+      line_data_[l] = cv::Point2f(undistorted[0], undistorted[1]);
     }
-    contours = contours->h_next;
-  }
-
-  n_blobs_ = squares->total;
-  blob_corners.resize(n_blobs_);
-
-  // For every detected 4-corner blob
-  for (int i = 0; i < n_blobs_; ++i) {
-    std::vector<alvar::Line> fitted_lines(4);
-    blob_corners[i].resize(4);
-    CvSeq* sq = reinterpret_cast<CvSeq*>(cvGetSeqElem(squares, i));
-    CvSeq* square_contour = reinterpret_cast<CvSeq*>(cvGetSeqElem(square_contours, i));
-
-    for (int j = 0; j < 4; ++j) {
-      CvPoint* pt0 = reinterpret_cast<CvPoint*>(cvGetSeqElem(sq, j));
-      CvPoint* pt1 = reinterpret_cast<CvPoint*>(cvGetSeqElem(sq, (j+1)%4));
-      int k0 = -1, k1 = -1;
-      for (int k = 0; k < square_contour->total; k++) {
-        CvPoint* pt2 = reinterpret_cast<CvPoint*>(cvGetSeqElem(square_contour, k));
-        if ((pt0->x == pt2->x) && (pt0->y == pt2->y)) k0=k;
-        if ((pt1->x == pt2->x) && (pt1->y == pt2->y)) k1=k;
-      }
-      int len;
-      if (k1 >= k0)
-        len = k1 - k0 - 1;  // neither k0 nor k1 are included
-      else
-        len = square_contour->total - k0 + k1 - 1;
-      if (len == 0) len = 1;
-
-      CvMat* line_data = cvCreateMat(1, len, CV_32FC2);
-      for (int l = 0; l < len; l++) {
-        int ll = (k0 + l + 1) % square_contour->total;
-        CvPoint* p = reinterpret_cast<CvPoint*>(cvGetSeqElem(square_contour, ll));
-        Eigen::Vector2d undistorted;
-        cam_.Convert<camera::DISTORTED, camera::UNDISTORTED>(Eigen::Vector2d(p->x, p->y), &undistorted);
-        CvPoint2D32f pp;
-        pp.x = undistorted[0];
-        pp.y = undistorted[1];
-
-        CV_MAT_ELEM(*line_data, CvPoint2D32f, 0, l) = pp;
-      }
-
-      // Fit edge and put to vector of edges
-      float params[4] = {0};
 
-      cvFitLine(line_data, CV_DIST_L2, 0, 0.01, 0.01, params);
-      fitted_lines[j] = alvar::Line(params);
+    // Fit edge and put to vector of edges
+    cv::Vec4f line;
+    cv::fitLine(line_data_, line, CV_DIST_L2, 0, 0.01, 0.01);
+    float params[4] = {line[0], line[1], line[2], line[3]};
+    fitted_lines[j] = alvar::Line(params);
+  }
 
-      cvReleaseMat(&line_data);
-    }
+  // Calculated four intersection points
+  for (size_t j = 0; j < 4; ++j) {
+    alvar::PointDouble intc = alvar::Intersection(fitted_lines[j], fitted_lines[(j + 1) % 4]);
 
-    // Calculated four intersection points
-    for (size_t j = 0; j < 4; ++j) {
-      alvar::PointDouble intc = alvar::Intersection(fitted_lines[j], fitted_lines[(j + 1) % 4]);
-
-      Eigen::Vector2d distorted;
-      cam_.Convert<camera::UNDISTORTED, camera::DISTORTED>(Eigen::Vector2d(intc.x, intc.y), &distorted);
-      intc.x = distorted[0];
-      intc.y = distorted[1];
-
-      // Should we make this always counter-clockwise or clockwise?
-      /*
-        if (image->origin && j == 1) blob_corners[i][3] = intc;
-        else if (image->origin && j == 3) blob_corners[i][1] = intc;
-        else blob_corners[i][j] = intc;
-      */
-      blob_corners[i][j] = intc;
-    }
+    Eigen::Vector2d distorted;
+    cam_.Convert<camera::UNDISTORTED, camera::DISTORTED>(Eigen::Vector2d(intc.x, intc.y), &distorted);
+    intc.x = distorted[0];
+    intc.y = distorted[1];
+    (*corners)[j] = intc;
   }
-
-  cvClearMemStorage(storage_);
 }
@@ -48,10 +48,41 @@ void MarkerCornerDetector::Detect(IplImage *image,
                                   float max_new_marker_error,
                                   float max_track_error) {
   assert(image->origin == 0);
+  Detect(cv::cvarrToMat(image), max_new_marker_error, max_track_error);
+}
+
+void MarkerCornerDetector::Detect(cv::Mat const& image,
+                                  float max_new_marker_error,
+                                  float max_track_error) {
+  Detect(image, std::vector<cv::Rect>(1, cv::Rect(0, 0, image.cols, image.rows)),
+         max_new_marker_error, max_track_error);
+}
+
+void MarkerCornerDetector::Detect(cv::Mat const& image,
+                                  std::vector<cv::Rect> const& regions,
+                                  float max_new_marker_error,
+                                  float max_track_error) {
   std::swap(markers_, markers_old_);
   markers_->clear();
 
-  labeling_.LabelSquares(image);
+  // Merge the regions that overlap, so that no square is found twice
+  regions_.clear();
+  cv::Rect frame(0, 0, image.cols, image.rows);
+  for (cv::Rect region : regions) {
+    region &= frame;
+    if (region.area() > 0)
+      regions_.push_back(region);
+  }
+  for (size_t i = 0; i < regions_.size(); i++) {
+    for (size_t j = i + 1; j < regions_.size(); j++) {
+      if ((regions_[i] & regions_[j]).area() == 0) continue;
+      regions_[i] |= regions_[j];
+      regions_.erase(regions_.begin() + j);
+      j = i;  // the grown region may overlap ones already checked
+    }
+  }
+
+  labeling_.LabelSquares(image, regions_);
   std::vector<std::vector<alvar::PointDouble> >& blob_corners = labeling_.blob_corners;
 
   int orientation;
@@ -92,12 +123,14 @@ void MarkerCornerDetector::Detect(IplImage *image,
     }
   }
 
-  // Identify the new markers that we haven't seen before.
+  // Identify the new markers that we haven't seen before. ALVAR reads the
+  // marker content through an IplImage header, which shares the pixels.
+  IplImage ipl_image = image;
   for (size_t i = 0; i < blob_corners.size(); i++) {
     if (blob_corners[i].empty()) continue;
 
     alvar::MarkerData marker(1 /*edge length*/, 5 /*resolution*/, 2 /*margin*/);
-    if (marker.UpdateContent(blob_corners[i], image, alvar_cam_) &&
+    if (marker.UpdateContent(blob_corners[i], &ipl_image, alvar_cam_) &&
         marker.DecodeContent(&orientation) &&
         (marker.GetError(alvar::Marker::MARGIN_ERROR |
                          alvar::Marker::DECODE_ERROR) <= max_new_marker_error)) {
@@ -68,3 +68,33 @@ TEST(MarkerDetector, TestDetection) {
     expected_it++;
   }
 }
+
+TEST(MarkerDetector, TestRegionDetection) {
+  std::string data_dir = std::string(TEST_DIR) + "/data/";
+  camera::CameraParameters cam(Eigen::Vector2i(816, 612),
+      Eigen::Vector2d::Constant(2), Eigen::Vector2d(408, 306));
+
+  marker_tracking::MarkerCornerDetector detector(cam);
+  cv::Mat image = cv::imread(data_dir + "IMG_20141217_160451.small.opt.jpg", CV_LOAD_IMAGE_GRAYSCALE);
+  detector.Detect(image, 0.08, 0.2);
+  ASSERT_EQ(1u, detector.NumMarkers());
+  std::vector<alvar::PointDouble> corners = detector.GetMarker(0).marker_corners_img;
+
+  // The box around the marker, with a margin, finds the same corners
+  cv::Rect box(corners[0].x, corners[0].y, 1, 1);
+  for (alvar::PointDouble const& corner : corners)
+    box |= cv::Rect(corner.x, corner.y, 1, 1);
+  box = cv::Rect(box.x - 20, box.y - 20, box.width + 40, box.height + 40);
+  marker_tracking::MarkerCornerDetector region_detector(cam);
+  region_detector.Detect(image, std::vector<cv::Rect>(1, box), 0.08, 0.2);
+  ASSERT_EQ(1u, region_detector.NumMarkers());
+  EXPECT_EQ(2u, region_detector.GetMarker(0).GetId());
+  for (size_t i = 0; i < 4; i++) {
+    EXPECT_NEAR(corners[i].x, region_detector.GetMarker(0).marker_corners_img[i].x, 0.5);
+    EXPECT_NEAR(corners[i].y, region_detector.GetMarker(0).marker_corners_img[i].y, 0.5);
+  }
+
+  // A region away from the marker finds nothing
+  region_detector.Detect(image, std::vector<cv::Rect>(1, cv::Rect(0, 0, 100, 100)), 0.08, 0.2);
+  EXPECT_EQ(0u, region_detector.NumMarkers());
+}
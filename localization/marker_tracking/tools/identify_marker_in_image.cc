@@ -44,12 +44,10 @@ int main(int argc, char** argv) {
   colors[3] = cv::Scalar(255);
 
   cv::Mat image;
-  IplImage ipl_image;
   for (int i = 1; i < argc; i++) {
     std::string image_filename(argv[i]);
     image = cv::imread(image_filename, CV_LOAD_IMAGE_GRAYSCALE);
-    ipl_image = image;
-    detector.Detect(&ipl_image, 0.08, 0.2);
+    detector.Detect(image, 0.08, 0.2);
     LOG(INFO) << image_filename << " : Detected " << detector.NumMarkers() << " markers.";
 
     for (size_t m_id = 0; m_id < detector.NumMarkers(); m_id++) {
@@ -0,0 +1,105 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_DESCRIPTOR_QUANTIZER_H_
+#define SPARSE_MAPPING_DESCRIPTOR_QUANTIZER_H_
+
+#include <opencv2/core/core.hpp>
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace sparse_mapping_protobuf {
+  class DescriptorQuantizer;
+}
+
+namespace sparse_mapping {
+
+  /**
+   * Compresses float descriptors, such as SURF, for storing them in
+   * the map file and matching against them. There are two kinds:
+   *
+   *  - SCALAR8: each dimension is rounded to 8 bits over its range in
+   *    the training descriptors. 4x smaller.
+   *  - PRODUCT: the descriptor is cut in num_subspaces equal pieces,
+   *    each replaced by the index of the nearest of 256 k-means
+   *    centers. One byte per piece, 16x smaller with 16 pieces of a
+   *    64 float descriptor.
+   *
+   * Matching is asymmetric: the query descriptors stay in floats and
+   * are compared to the codes directly, so the map descriptors are
+   * never decoded. For PRODUCT codes, each query first fills a table
+   * of its distances to all the centers, and the distance to a code
+   * is then one lookup per piece.
+   **/
+  class DescriptorQuantizer {
+   public:
+    enum Type {NONE = 0, SCALAR8 = 1, PRODUCT = 2};
+
+    DescriptorQuantizer();
+
+    // "SCALAR8" or "PQ", and NONE for anything else
+    static Type StringToType(std::string const& name);
+
+    // Train on the rows of the given CV_32F descriptors. num_subspaces
+    // is used only for PRODUCT and must divide the descriptor length.
+    void Train(std::vector<cv::Mat> const& descriptors, Type type, int num_subspaces);
+
+    Type GetType() const {return type_;}
+    int Dim() const {return dim_;}
+    // Bytes per code
+    int CodeSize() const {return type_ == PRODUCT ? num_subspaces_ : dim_;}
+
+    // CV_32F descriptors to CV_8U codes, one row per descriptor, and back
+    void Encode(cv::Mat const& descriptors, cv::Mat * codes) const;
+    void Decode(cv::Mat const& codes, cv::Mat * descriptors) const;
+
+    // L2 distance between a float descriptor and a code
+    double Distance(const float* query, const uint8_t* code) const;
+    // Same, faster when comparing one query to many codes. The table
+    // is filled for the query by DistanceTable(), it stays empty for
+    // SCALAR8 codes which need none.
+    void DistanceTable(const float* query, std::vector<float> * table) const;
+    double Distance(const float* query, std::vector<float> const& table, const uint8_t* code) const;
+
+    // Match the float query descriptors to the codes, with the same
+    // ratio test as interest_point::FindMatches().
+    void FindMatches(cv::Mat const& query, cv::Mat const& codes,
+                     std::vector<cv::DMatch> * matches) const;
+
+    void SaveProtobuf(sparse_mapping_protobuf::DescriptorQuantizer * proto) const;
+    void LoadProtobuf(sparse_mapping_protobuf::DescriptorQuantizer const& proto);
+
+   private:
+    float SquaredDistance(const float* query, std::vector<float> const& table, const uint8_t* code) const;
+
+    Type type_;
+    int dim_;
+    int num_subspaces_;
+    // SCALAR8, per dimension: value = offset + scale * code
+    std::vector<float> offset_;
+    std::vector<float> scale_;
+    // PRODUCT: num_subspaces x 256 centers of dim / num_subspaces floats
+    std::vector<float> codebook_;
+  };
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_DESCRIPTOR_QUANTIZER_H_
@@ -0,0 +1,93 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_DISTRIBUTED_H_
+#define SPARSE_MAPPING_DISTRIBUTED_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace sparse_mapping {
+
+  struct SparseMap;
+
+  // A queue of tasks in a directory on a file system shared by the
+  // machines building a map, such as NFS. The coordinator adds each
+  // task as a file under tasks/. A worker claims one by renaming it
+  // into claimed/, which only one of them can do, runs it, writes its
+  // outputs under results/ and then marks it done there. A task
+  // claimed for longer than the timeout with no result is put back,
+  // in case its worker died. The coordinator works on the tasks too
+  // while it waits, so a build with no workers still finishes.
+  class TaskQueue {
+   public:
+    explicit TaskQueue(std::string const& dir);
+
+    // Coordinator. Clear() removes the tasks and results of an earlier
+    // job. Finish() tells the workers to exit.
+    void Clear();
+    void Add(std::string const& name, std::string const& contents);
+    void Wait(std::function<void(std::string const& name, std::string const& contents)> const& run,
+              double timeout);
+    void Finish();
+
+    // Worker. Claim() returns false if no task is waiting. Finished()
+    // is true once the coordinator finished after the worker started.
+    bool Claim(std::string* name, std::string* contents);
+    void Complete(std::string const& name);
+    bool Finished() const;
+
+    // Where a task writes its output with the given suffix
+    std::string ResultFile(std::string const& name, std::string const& suffix) const;
+    std::string const& Dir() const { return dir_; }
+
+   private:
+    bool Done(std::string const& name) const;
+    void Requeue(double timeout);
+
+    std::string dir_;
+    std::vector<std::string> added_;
+    double finished_time_;
+  };
+
+  // Runs one task of the ones below, for a worker or the coordinator
+  void RunTask(TaskQueue* queue, std::string const& name, std::string const& contents);
+
+  // Claims and runs tasks until the coordinator finishes
+  void RunWorker(std::string const& dir);
+
+  // Detects the features of the map's images in tasks of
+  // images_per_task images, and gives them to the map, as
+  // SparseMap::DetectFeatures() would. The workers read the camera
+  // from their own cameras.config and the images from the same paths.
+  void DistributedDetect(TaskQueue* queue, int images_per_task, int min_features, int max_features,
+                         int threshold, int retries, double timeout, SparseMap* map);
+
+  // Matches the map's images, as MatchFeatures() does, in tasks of
+  // pairs_per_task pairs. The workers load the map from map_file in
+  // the queue's directory, and its feature store, if any, from the
+  // same path. The results are gathered into the essential and
+  // matches files for the steps after.
+  void DistributedMatch(TaskQueue* queue, int pairs_per_task, double timeout,
+                        std::string const& essential_file, std::string const& matches_file,
+                        SparseMap* map);
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_DISTRIBUTED_H_
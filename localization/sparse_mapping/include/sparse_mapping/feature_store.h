@@ -0,0 +1,127 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_FEATURE_STORE_H_
+#define SPARSE_MAPPING_FEATURE_STORE_H_
+
+#include <Eigen/Core>
+#include <opencv2/core/core.hpp>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sparse_mapping {
+
+  class MappedFile;
+
+  // A single file holding the keypoints and descriptors of many
+  // images, so that a map can be built without keeping all the
+  // descriptors in memory. Each image is one zlib compressed chunk:
+  //
+  //   FeatureStoreHeader
+  //   chunks             in the order the images were written
+  //   FeatureStoreEntry  per image, the index
+  //
+  // A chunk holds two doubles per keypoint, followed by the
+  // descriptor rows. Numbers are in host byte order.
+  const char kFeatureStoreMagic[8] = {'A', 'S', 'T', 'R', 'F', 'E', 'A', 'T'};
+  const uint32_t kFeatureStoreVersion = 1;
+
+  struct FeatureStoreEntry {
+    uint64_t offset;           // of the chunk, from the start of the file
+    uint64_t compressed_size;  // 0 if the image was never written
+    uint32_t num_features;
+    uint32_t padding;
+  };
+
+  struct FeatureStoreHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_frames;
+    int32_t descriptor_type;   // cv::Mat::type(), -1 if no image has features
+    uint32_t descriptor_cols;
+    uint64_t index_offset;
+  };
+
+  /**
+   * Writes and reads a feature store file. Writing goes through
+   * Create(), Write() for each image, from any number of threads, and
+   * Finish(). The file is only renamed into place by Finish(), so a
+   * store that is open elsewhere is never overwritten underneath.
+   *
+   * For reading, Open() maps the file and decompresses the chunks on
+   * demand. Recently used descriptors are kept in a cache of bounded
+   * size, so memory use does not grow with the number of images.
+   **/
+  class FeatureStore {
+   public:
+    FeatureStore();
+    ~FeatureStore();
+    FeatureStore(FeatureStore const&) = delete;
+    FeatureStore& operator=(FeatureStore const&) = delete;
+
+    void Create(std::string const& filename, int num_frames);
+    void Write(int cid, Eigen::Matrix2Xd const& keypoints, cv::Mat const& descriptors);
+    void Finish();
+
+    // Keep at most cache_size bytes of decompressed descriptors
+    void Open(std::string const& filename, size_t cache_size);
+
+    bool IsOpen() const {return file_ != NULL;}
+    std::string const& Filename() const {return filename_;}
+    int NumFrames() const {return header_.num_frames;}
+    int NumFeatures(int cid) const {return index_[cid].num_features;}
+    int DescriptorType() const {return header_.descriptor_type;}
+
+    // Both are safe to call from several threads. The returned
+    // descriptors stay valid after they leave the cache.
+    cv::Mat Descriptors(int cid) const;
+    void Keypoints(int cid, Eigen::Matrix2Xd * keypoints) const;
+
+   private:
+    void ReadChunk(int cid, Eigen::Matrix2Xd * keypoints, cv::Mat * descriptors) const;
+
+    std::string filename_;
+    FeatureStoreHeader header_;
+    std::vector<FeatureStoreEntry> index_;
+
+    // Writing
+    int fd_;
+    uint64_t write_offset_;
+    std::mutex write_mutex_;
+
+    // Reading
+    std::shared_ptr<MappedFile> file_;
+    size_t cache_size_;
+    mutable size_t cache_bytes_;
+    mutable std::list<int> lru_;  // most recently used first
+    mutable std::map<int, std::pair<cv::Mat, std::list<int>::iterator> > cache_;
+    mutable std::mutex cache_mutex_;
+  };
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_FEATURE_STORE_H_
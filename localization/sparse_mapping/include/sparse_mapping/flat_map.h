@@ -0,0 +1,111 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_FLAT_MAP_H_
+#define SPARSE_MAPPING_FLAT_MAP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+
+namespace sparse_mapping {
+
+  // A flat, memory-mappable alternative to the protobuf map file. It
+  // is a fixed header followed by 8 byte aligned sections, so that
+  // descriptors can be used directly from the mapping without
+  // parsing or copying:
+  //
+  //   FILENAMES        file names, each terminated by '\0'
+  //   FEATURE_OFFSETS  uint64 per frame + 1, index of the frame's first feature
+  //   DESCRIPTORS      one row per feature, all frames back to back
+  //   KEYPOINTS        two doubles per feature
+  //   POSES            3x4 row-major cam_t_global per frame
+  //   LANDMARKS        three doubles per landmark
+  //   TRACK_OFFSETS    uint64 per landmark + 1, index of its first observation
+  //   TRACKS           (cid, fid) uint32 pairs, grouped by landmark
+  //   DISTORTION       camera distortion coefficients as doubles
+  //   VOCAB_DB         the vocabulary database, as in the protobuf map
+  //
+  // Numbers are stored in host byte order, maps are not portable
+  // across endianness.
+  const char kFlatMapMagic[8] = {'A', 'S', 'T', 'R', 'F', 'L', 'A', 'T'};
+  const uint32_t kFlatMapVersion = 1;
+
+  enum FlatMapSection {
+    FLAT_FILENAMES = 0,
+    FLAT_FEATURE_OFFSETS,
+    FLAT_DESCRIPTORS,
+    FLAT_KEYPOINTS,
+    FLAT_POSES,
+    FLAT_LANDMARKS,
+    FLAT_TRACK_OFFSETS,
+    FLAT_TRACKS,
+    FLAT_DISTORTION,
+    FLAT_VOCAB_DB,
+    FLAT_NUM_SECTIONS
+  };
+
+  struct FlatMapSectionEntry {
+    uint64_t offset;  // from the start of the file
+    uint64_t size;    // in bytes
+  };
+
+  struct FlatMapHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t descriptor_depth;
+    uint32_t descriptor_cols;
+    uint32_t num_frames;
+    uint64_t num_features;
+    uint64_t num_landmarks;
+    uint64_t num_observations;
+    double focal_length[2];
+    double optical_offset[2];
+    int32_t distorted_size[2];
+    int32_t undistorted_size[2];
+    int32_t vocab_db_type;  // -1 if there is no database
+    uint32_t has_poses;
+    char detector_name[32];
+    FlatMapSectionEntry sections[FLAT_NUM_SECTIONS];
+  };
+
+  // A read-only view of a whole file, mapped into memory. Pages
+  // are private, so accidental writes never reach the file.
+  class MappedFile {
+   public:
+    explicit MappedFile(std::string const& filename);
+    ~MappedFile();
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    bool IsValid() const { return data_ != NULL; }
+    const uint8_t* Data() const { return data_; }
+    size_t Size() const { return size_; }
+
+   private:
+    uint8_t* data_;
+    size_t size_;
+  };
+
+  // True if the file starts with the flat map magic
+  bool IsFlatMapFile(std::string const& filename);
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_FLAT_MAP_H_
@@ -0,0 +1,104 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_LANDMARK_INDEX_H_
+#define SPARSE_MAPPING_LANDMARK_INDEX_H_
+
+#include <opencv2/core/core.hpp>
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace sparse_mapping {
+
+struct SparseMap;
+
+/**
+ * The map landmarks filed by vocabulary word, to match the features of
+ * an image straight to landmarks rather than to every similar map
+ * image, which matches a landmark once per image that sees it. Each
+ * landmark keeps a few of the descriptors of its observations, the
+ * medoid and then those farthest from the ones kept.
+ *
+ * Matching is done twice. Image features are first matched to the
+ * landmarks of their word, with a ratio test between the two nearest
+ * landmarks. Then the landmarks seen in the map images which see the
+ * most of those matches are searched for the other way around, among
+ * the image features of their words, which finds the matches the ratio
+ * test missed for lack of context. Only binary descriptors are indexed.
+ **/
+class LandmarkIndex {
+ public:
+  // The word of each row of descriptors, -1 if it has none
+  typedef std::function<void(cv::Mat const& descriptors, std::vector<int>* words)> Quantizer;
+
+  struct Options {
+    int max_descriptors;       // kept per landmark
+    int max_distance;          // Hamming distance of a match, at most
+    double ratio;              // of the best to the second best distance
+    int active_cameras;        // map images whose landmarks are searched for
+    int max_active_matches;    // found by the search, at most
+    Options() : max_descriptors(3), max_distance(90), ratio(0.8),
+                active_cameras(10), max_active_matches(500) {}
+  };
+
+  struct Match {
+    int query;      // row of the image descriptors
+    int pid;
+    int distance;
+  };
+
+  LandmarkIndex() {}
+
+  /**
+   * Builds the index of the landmarks of a map, from the descriptors of
+   * their observations. Takes about as much memory again as those
+   * descriptors while building.
+   **/
+  void Build(SparseMap const& map, Quantizer const& quantizer, Options const& options);
+
+  bool Empty() const {return desc_pid_.empty();}
+  size_t NumDescriptors() const {return desc_pid_.size();}
+
+  /**
+   * Matches image descriptors, with the given words, to the landmarks of
+   * the map the index was built from. Each landmark and each feature is
+   * matched at most once. If given, the number of matches found by the
+   * search from landmarks is returned in num_active, and the number of
+   * map images searched in num_cameras.
+   **/
+  void FindMatches(SparseMap const& map, cv::Mat const& descriptors, std::vector<int> const& words,
+                   std::vector<Match>* matches, int* num_active = NULL, int* num_cameras = NULL) const;
+
+ private:
+  // the range of descriptors filed under a word, empty if none
+  std::pair<int, int> WordRange(int word) const;
+
+  Options options_;
+  // the descriptors kept, those of each landmark together
+  cv::Mat descriptors_;
+  std::vector<int> desc_pid_, desc_word_;
+  std::vector<int> pid_begin_;   // first descriptor of each landmark, and the end
+  // the inverted file: sorted words, and the descriptors under each
+  std::vector<int> words_, word_begin_, word_desc_;
+};
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_LANDMARK_INDEX_H_
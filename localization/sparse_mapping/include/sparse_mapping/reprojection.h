@@ -20,6 +20,7 @@
 
 #include <Eigen/Geometry>
 #include <sparse_mapping/eigen_vectors.h>
+#include <sparse_mapping/track_table.h>
 #include <ceres/ceres.h>
 
 #include <map>
@@ -44,6 +45,16 @@ namespace sparse_mapping {
 
   ceres::LossFunction* GetLossFunction(std::string cost_fun, double th);
 
+/**
+ * The reprojection error of a point observed at the given normalized
+ * pixel, for the parameter blocks camera translation, camera
+ * angle-axis rotation, point and focal length. If analytic is set
+ * the Jacobians are computed in closed form, otherwise with automatic
+ * differentiation. The bundle adjustment functions below pick one with
+ * --ba_analytic_jacobians.
+ **/
+ceres::CostFunction* ReprojectionCostFunction(const Eigen::Vector2d & observed, bool analytic);
+
 /**
  * Perform bundle adjustment.
  *
@@ -52,17 +63,17 @@ namespace sparse_mapping {
  * pid_to_xyz are landmark locations
  * All should be set to initial guesses and are modified to improved guesses when the function returns.
  *
- * pid_to_cid_fid is maps from landmark id to camera id and feature id
+ * tracks maps from landmark id to camera id and feature id
  * cid_to_keypoint_map gives a list of observations for each camera
  * Ceres loss function and options can be specified, and summary returns results from ceres.
  * Optimize only the cameras with indices in [first, last].
  **/
-void BundleAdjust(std::vector<std::map<int, int> > const& pid_to_cid_fid,
+void BundleAdjust(TrackTable const& tracks,
                   std::vector<Eigen::Matrix2Xd > const& cid_to_keypoint_map,
                   double focal_length,
                   std::vector<Eigen::Affine3d> * cid_to_cam_t_global,
                   std::vector<Eigen::Vector3d> * pid_to_xyz,
-                  std::vector<std::map<int, int> > const& user_pid_to_cid_fid,
+                  TrackTable const& user_tracks,
                   std::vector<Eigen::Matrix2Xd > const& user_cid_to_keypoint_map,
                   std::vector<Eigen::Vector3d> * user_pid_to_xyz,
                   ceres::LossFunction * loss,
@@ -71,6 +82,31 @@ void BundleAdjust(std::vector<std::map<int, int> > const& pid_to_cid_fid,
                   int first = 0, int last = std::numeric_limits<int>::max(),
                   bool fix_cameras = false);
 
+/**
+ * As BundleAdjust(), but solve num_passes times, reusing one ceres
+ * problem. If filter_outliers is set, between passes the observations
+ * with reprojection error at least max(reproj_thresh, multiple_of_median
+ * times the median) are removed from the problem. So are the points left
+ * with fewer than two observations or seen behind a camera. The tracks
+ * themselves are not edited, use FilterPID() for that afterwards.
+ * There is one summary per pass solved.
+ **/
+void MultiPassBundleAdjust(TrackTable const& tracks,
+                           std::vector<Eigen::Matrix2Xd > const& cid_to_keypoint_map,
+                           double focal_length,
+                           std::vector<Eigen::Affine3d> * cid_to_cam_t_global,
+                           std::vector<Eigen::Vector3d> * pid_to_xyz,
+                           TrackTable const& user_tracks,
+                           std::vector<Eigen::Matrix2Xd > const& user_cid_to_keypoint_map,
+                           std::vector<Eigen::Vector3d> * user_pid_to_xyz,
+                           ceres::LossFunction * loss,
+                           ceres::Solver::Options const& options,
+                           int num_passes, bool filter_outliers,
+                           double reproj_thresh, double multiple_of_median,
+                           std::vector<ceres::Solver::Summary> * summaries,
+                           int first = 0, int last = std::numeric_limits<int>::max(),
+                           bool fix_cameras = false);
+
 
 /**
  * Perform bundle adjustment.
@@ -117,12 +153,32 @@ void EstimateCamera(camera::CameraModel * camera_estimate, std::vector<Eigen::Ve
                     const std::vector<Eigen::Vector2d> & observations,
                     const ceres::Solver::Options & options, ceres::Solver::Summary* summary);
 
+/**
+ * Refine cam_t_global, the transform of the landmarks to the camera, so that they project
+ * to their observations in an undistorted camera of the given focal lengths. The loss is
+ * the same Cauchy loss as in EstimateCamera, but minimized by a Levenberg-Marquardt solver
+ * on the 6x6 normal equations of the pose, which allocates nothing. Stops after at most
+ * max_iterations, returned in num_iterations if given.
+ *
+ * Returns false, leaving cam_t_global unchanged, if fewer than three landmarks are in
+ * front of the camera or the normal equations cannot be solved.
+ **/
+bool RefineCamera(Eigen::Ref<const Eigen::Matrix3Xd> const& landmarks,
+                  Eigen::Ref<const Eigen::Matrix2Xd> const& observations,
+                  Eigen::Vector2d const& focal, int max_iterations,
+                  Eigen::Affine3d* cam_t_global, int* num_iterations = NULL);
+
 /**
  * Estimate the camera matrix, with translation and rotation, that maps the points in landmarks
  * to the image coordinates observed in observations. This uses ransac with a three
  * point perspective algorithm, and does not use an initial guess for the camera pose.
  *
- * After the function is called, camera_estimate is updated to contain the results.
+ * After the function is called, camera_estimate is updated to contain the results,
+ * refined on the inliers with RefineCamera, or with EstimateCamera if that fails or
+ * with --refine_with_ceres. num_tries is an upper bound, it stops early once an all-inlier sample was drawn
+ * with probability --ransac_confidence. If match_distances are given (smaller is
+ * better), the best matches are sampled first. The iterations run are returned
+ * in num_iterations, if given.
  *
  * Returns zero on success, nonzero on failure.
  **/
@@ -130,7 +186,9 @@ int RansacEstimateCamera(const std::vector<Eigen::Vector3d> & landmarks,
                     const std::vector<Eigen::Vector2d> & observations,
                     int num_tries, int inlier_tolerance, camera::CameraModel * camera_estimate,
                     std::vector<Eigen::Vector3d> * inlier_landmarks_out = NULL,
-                    std::vector<Eigen::Vector2d> * inlier_observations_out = NULL);
+                    std::vector<Eigen::Vector2d> * inlier_observations_out = NULL,
+                    std::vector<double> const* match_distances = NULL,
+                    int* num_iterations = NULL);
 
 // ICP solver that given matching 3D points, finds an affine transform that
 // best fits in to out.
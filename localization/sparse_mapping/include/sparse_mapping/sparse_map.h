@@ -23,6 +23,7 @@
 #include <sparse_mapping/eigen_vectors.h>
 #include <sparse_mapping/vocab_tree.h>
 #include <sparse_mapping/sparse_mapping.h>
+#include <sparse_mapping/track_table.h>
 #include <camera/camera_model.h>
 #include <camera/camera_params.h>
 
@@ -30,6 +31,7 @@
 #include <opencv2/core/core.hpp>
 
 #include <map>
+#include <memory>
 #include <mutex>
 #include <numeric>
 #include <set>
@@ -45,16 +47,34 @@ namespace cv {
 
 namespace sparse_mapping {
 
+class DescriptorQuantizer;
+class DetectorPool;
+class FeatureStore;
+class LandmarkIndex;
+class MappedFile;
+
 // Non-member function InitializeCidFidToPid() that we will use within
 // this class and outside of it as well.
 void InitializeCidFidToPid(int num_cid,
                            std::vector<std::map<int, int> > const& pid_to_cid_fid,
                            std::vector<std::map<int, int> > * cid_fid_to_pid);
 
+/**
+ * What one localization did, for diagnostics.
+ **/
+struct LocalizeStats {
+  int num_candidates;         // map images matched to
+  int num_matches;            // to map landmarks, given to RANSAC
+  int num_ransac_iterations;
+  int num_inliers;
+};
+
 /**
  * Estimate the camera pose for a set of image descriptors and keypoints.
  * Non-member function. We will invoke it both from within
- * the SparseMap class and from outside of it.
+ * the SparseMap class and from outside of it. If gated_cids is given,
+ * only those map images are considered, see SparseMap::CamerasInGate.
+ * What it did is returned in stats, if given.
  **/
 bool Localize(cv::Mat const& test_descriptors,
               Eigen::Matrix2Xd const& test_keypoints,
@@ -68,9 +88,26 @@ bool Localize(cv::Mat const& test_descriptors,
               int num_similar,
               std::vector<std::string> const& cid_to_filename,
               std::vector<cv::Mat> const& cid_to_descriptor_map,
-              std::vector<std::map<int, int> > const& cid_fid_to_pid,
+              sparse_mapping::TrackTable const& tracks,
               std::vector<Eigen::Vector3d> const& pid_to_xyz,
-              int num_ransac_iterations, int ransac_inlier_tolerance);
+              int num_ransac_iterations, int ransac_inlier_tolerance,
+              interest_point::MatcherCache * matcher_cache = NULL,
+              DescriptorQuantizer const* quantizer = NULL,
+              std::vector<int> const* gated_cids = NULL,
+              LocalizeStats* stats = NULL);
+
+/**
+ * Where the camera to localize may be, from a prior such as the EKF
+ * pose and its covariance. Map images are kept if their camera center is
+ * within max_distance of center, and their optical axis within max_angle
+ * radians of direction.
+ **/
+struct CameraGate {
+  Eigen::Vector3d center;
+  Eigen::Vector3d direction;
+  double max_distance;
+  double max_angle;
+};
 
 /**
  * A class representing a sparse map, which consists of a collection
@@ -115,11 +152,26 @@ struct SparseMap {
    **/
   void DetectFeatures();
 
+  /**
+   * Take the features of every image, as DetectFeatures() would leave
+   * them, from a detection done elsewhere, such as by the workers of a
+   * distributed build. With -feature_store the descriptors are written
+   * to the store.
+   **/
+  void SetFeatures(std::vector<Eigen::Matrix2Xd> const& keypoints,
+                   std::vector<cv::Mat> const& descriptors);
+
   /**
    * Save the map to a protobuf file.
    **/
   void Save(const std::string & protobuf_file) const;
 
+  /**
+   * Save the map in the flat, memory-mappable format of flat_map.h.
+   * Load() recognizes such files by their header.
+   **/
+  void SaveFlat(const std::string & flat_file) const;
+
   /**
    * Estimate the camera pose for an image file.
    **/
@@ -133,6 +185,44 @@ struct SparseMap {
                          camera::CameraModel* pose,
                          std::vector<Eigen::Vector3d>* inlier_landmarks,
                          std::vector<Eigen::Vector2d>* inlier_observations);
+  /**
+   * Estimate the camera pose only against the map images in the gate.
+   * The vocabulary tree still ranks them when there are more than it
+   * would return.
+   **/
+  bool Localize(const cv::Mat & test_descriptors, const Eigen::Matrix2Xd & test_keypoints,
+                CameraGate const& gate, camera::CameraModel* pose,
+                std::vector<Eigen::Vector3d>* inlier_landmarks,
+                std::vector<Eigen::Vector2d>* inlier_observations);
+  /**
+   * Match the image features to the map landmarks directly, see
+   * landmark_index.h, in the Localize calls without a gate. Also
+   * enabled by --landmark_matching. The index is built on the first
+   * localization with it.
+   **/
+  void SetLandmarkMatching(bool enable) {landmark_matching_ = enable;}
+  /**
+   * The map images in the gate, nearest first.
+   **/
+  void CamerasInGate(CameraGate const& gate, std::vector<int>* cids);
+  /**
+   * What the last of the Localize calls above on the calling thread
+   * did. As long as the map is not changed, any number of threads
+   * may localize against it at once.
+   **/
+  LocalizeStats const& GetLocalizeStats() const;
+
+  /**
+   * Estimate the camera pose starting from a nearby pose, such as the
+   * one of the previous frame. The map landmarks are projected into
+   * the image at *pose and matched only to keypoints close to where
+   * they land, skipping the vocabulary tree and whole-image matching.
+   * Returns false, leaving *pose unchanged, if too few matches survive.
+   **/
+  bool LocalizeFromPrior(const cv::Mat & test_descriptors, const Eigen::Matrix2Xd & test_keypoints,
+                         camera::CameraModel* pose,
+                         std::vector<Eigen::Vector3d>* inlier_landmarks = NULL,
+                         std::vector<Eigen::Vector2d>* inlier_observations = NULL);
 
   // access map frames
   /**
@@ -151,17 +241,24 @@ struct SparseMap {
 
   void SetFrameGlobalTransform(int frame, const Eigen::Affine3d & transform) {
     cid_to_cam_t_global_[frame] = transform;
+    camera_grid_.cells.clear();
   }
   /**
    * Get the keypoint coordinates in the specified frame.
    **/
   const Eigen::Matrix2Xd & GetFrameKeypoints(int frame) const {return cid_to_keypoint_map_[frame];}
+  /**
+   * Get the descriptors of a frame. If the map keeps them in a
+   * feature store, they are read back from it.
+   **/
+  cv::Mat GetFrameDescriptors(int frame) const;
   /**
    * Get the descriptor for a frame and feature.
    **/
-  cv::Mat GetDescriptor(int frame, int fid) const { return cid_to_descriptor_map_[frame].row(fid);}
+  cv::Mat GetDescriptor(int frame, int fid) const { return GetFrameDescriptors(frame).row(fid);}
   /**
    * Returns map of feature ids to landmark ids for the specified frame.
+   * Not available for maps loaded in localization mode, use GetTracks().
    **/
   const std::map<int, int> & GetFrameFidToPidMap(int frame) const {return cid_fid_to_pid_[frame];}
 
@@ -179,6 +276,11 @@ struct SparseMap {
    * was seen in to the feature id within that frame.
    **/
   const std::map<int, int> & GetLandmarkCidToFidMap(int landmark) const {return pid_to_cid_fid_[landmark];}
+  /**
+   * Return the compact track table, valid in all modes once the map is
+   * loaded or InitializeCidFidToPid() was called.
+   **/
+  const TrackTable & GetTracks(void) const {return tracks_;}
 
   // access and modify parameters
   /**
@@ -221,14 +323,22 @@ struct SparseMap {
    **/
   void ApplyTransform(Eigen::Affine3d const& T) {
     sparse_mapping::TransformCamerasAndPoints(T, &cid_to_cam_t_global_, &pid_to_xyz_);
+    camera_grid_.cells.clear();
   }
 
   // Load map. If localization is true, load only the parts of the map
-  // needed for localization.
+  // needed for localization. Both the protobuf and the flat format
+  // are accepted.
   void Load(const std::string & protobuf_file, bool localization = false);
+  void LoadProtobuf(const std::string & protobuf_file, bool localization = false);
+  // The descriptors of a flat map are used in place from the mapped
+  // file rather than copied.
+  void LoadFlat(const std::string & flat_file, bool localization = false);
 
-  // construct from pid_to_cid_fid
+  // construct cid_fid_to_pid_ and tracks_ from pid_to_cid_fid_
   void InitializeCidFidToPid();
+  // one landmark per feature, before any matching
+  void InitializeRawTracks();
 
   // detect features with opencv
   void DetectFeaturesFromFile(std::string const& filename,
@@ -237,9 +347,45 @@ struct SparseMap {
   void DetectFeatures(cv::Mat const& image,
                       cv::Mat* descriptors,
                       Eigen::Matrix2Xd* keypoints);
+  // same, with the given detector instead of detector_
+  void DetectFeatures(cv::Mat const& image,
+                      interest_point::FeatureDetector* detector,
+                      cv::Mat* descriptors,
+                      Eigen::Matrix2Xd* keypoints) const;
+  // same, with a detector of its own for each thread localizing
+  void DetectFeaturesToLocalize(cv::Mat const& image,
+                                cv::Mat* descriptors,
+                                Eigen::Matrix2Xd* keypoints);
   // delete feature descriptors with no matching landmark
   void PruneMap(void);
 
+  /**
+   * True if the descriptors are kept in a feature store rather than
+   * in cid_to_descriptor_map_.
+   **/
+  bool HasFeatureStore() const {return feature_store_ != NULL;}
+  /**
+   * Copy the descriptors from the feature store, if any, into
+   * cid_to_descriptor_map_ and stop using the store. Needed before
+   * editing the frames, or by code which works on all descriptors.
+   **/
+  void ReadFeatureStore();
+
+  /**
+   * Store the descriptors quantized from now on, see
+   * descriptor_quantizer.h. The type is SCALAR8, PQ with the given
+   * number of subspaces, or NONE to store them in full again. The
+   * quantizer is trained on the current descriptors, which must be
+   * floats.
+   **/
+  void QuantizeDescriptors(std::string const& type, int num_subspaces);
+  /**
+   * True if cid_to_descriptor_map_ holds quantizer codes rather than
+   * descriptors. That is the case for quantized maps loaded in
+   * localization mode, otherwise the codes are decoded on load.
+   **/
+  bool HasDescriptorCodes() const {return descriptors_are_codes_;}
+
   /**
    * Set the number of similar images queried by the VocabDB.
    **/
@@ -252,9 +398,18 @@ struct SparseMap {
   std::vector<std::map<int, int> > pid_to_cid_fid_;
   std::vector<Eigen::Vector3d> pid_to_xyz_;
   std::vector<Eigen::Affine3d > cid_to_cam_t_global_;
+  // empty for every frame when the descriptors are in feature_store_
   std::vector<cv::Mat> cid_to_descriptor_map_;
-  // generated on load
+  std::shared_ptr<FeatureStore> feature_store_;
+  // Set if the map file stores quantized descriptors, Save() encodes
+  // them with it
+  std::shared_ptr<DescriptorQuantizer> quantizer_;
+  bool descriptors_are_codes_ = false;
+  // generated on load, except in localization mode
   std::vector<std::map<int, int> > cid_fid_to_pid_;
+  // Read-only copy of the tracks, used when localizing. In
+  // localization mode this is the only form the tracks are kept in.
+  TrackTable tracks_;
 
   interest_point::FeatureDetector detector_;
   camera::CameraParameters camera_params_;
@@ -262,6 +417,10 @@ struct SparseMap {
   int num_similar_;
   int num_ransac_iterations_;
   int ransac_inlier_tolerance_;
+  // Prebuilt matcher indices for the map images, keyed by cid
+  interest_point::MatcherCache matcher_cache_;
+  // Backing memory of the descriptors when loaded from a flat map
+  std::shared_ptr<MappedFile> mapped_file_;
 
   // e.g, 10th db image is 3rd image in cid_to_filename_
   std::map<int, int> db_to_cid_map_;
@@ -272,6 +431,28 @@ struct SparseMap {
   // a different descriptor.
   std::map< int, std::set<int> > cid_to_cid_;  // TODO(oalexan1): Need not be a member
 
+  // The camera centers bucketed in cubic cells, for CamerasInGate. Built
+  // when first needed, and cleared when the cameras move.
+  struct CameraGrid {
+    Eigen::Vector3d corner;
+    double cell_size;
+    int dims[3];
+    std::vector<std::vector<int> > cells;
+  };
+  void BuildCameraGrid();
+  CameraGrid camera_grid_;
+  // Copies of detector_ for the threads localizing images, made when
+  // first needed
+  std::shared_ptr<DetectorPool> localize_detectors_;
+  // The landmarks by vocabulary word, built when first needed
+  bool landmark_matching_ = false;
+  std::shared_ptr<LandmarkIndex> landmark_index_;
+  std::shared_ptr<LandmarkIndex> GetLandmarkIndex();
+  bool LocalizeWithLandmarks(const cv::Mat & test_descriptors, const Eigen::Matrix2Xd & test_keypoints,
+                             camera::CameraModel* pose,
+                             std::vector<Eigen::Vector3d>* inlier_landmarks,
+                             std::vector<Eigen::Vector2d>* inlier_observations);
+
   // These are used to register the map to real world coordinates
   // with information provided by the user.
   // TODO(oalexan1): These need not be members
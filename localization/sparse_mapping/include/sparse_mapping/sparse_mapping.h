@@ -24,6 +24,7 @@
 
 #include <Eigen/Geometry>
 
+#include <cstdint>
 #include <vector>
 #include <map>
 #include <string>
@@ -209,7 +210,14 @@ namespace sparse_mapping {
                           std::vector<Eigen::Vector3d> const & cam_ctrs,
                           std::vector<Eigen::Vector3d> const& pid_to_xyz);
 
-  // Filter points by reprojection error and other criteria
+  // Removes the points marked bad, keeping the others in order
+  void RemovePIDs(std::vector<uint8_t> const& is_bad,
+                  std::vector<std::map<int, int> > * pid_to_cid_fid,
+                  std::vector<Eigen::Vector3d> * pid_to_xyz);
+
+  // Filter points by reprojection error and other criteria. The points
+  // are checked in parallel, by blocks, with FLAGS_num_threads threads,
+  // and the outcome does not depend on the number of threads.
   void FilterPID(double reproj_thresh,
                  camera::CameraParameters const& camera_params,
                  std::vector<Eigen::Affine3d > const& cid_to_cam_t_global,
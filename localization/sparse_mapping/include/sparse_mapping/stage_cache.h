@@ -0,0 +1,67 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_STAGE_CACHE_H_
+#define SPARSE_MAPPING_STAGE_CACHE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace sparse_mapping {
+
+  // Hashes the contents of a file, 64 bit FNV-1a, continuing from hash.
+  // A missing file hashes as if empty, but differently from an empty one.
+  uint64_t HashFile(std::string const& file, uint64_t hash);
+  uint64_t HashString(std::string const& str, uint64_t hash);
+
+  // Keeps the output files of the stages of a map build in a directory,
+  // under a key hashed from what the stage read: its name, its parameters
+  // and the contents of its input files. When a stage is run again with
+  // the same key, its outputs are copied back instead. Since each stage
+  // reads what the one before it wrote, a build that stopped or had a
+  // late parameter changed redoes only the stages after the first that
+  // differs. With an empty directory nothing is cached.
+  class StageCache {
+   public:
+    explicit StageCache(std::string const& dir);
+
+    bool Enabled() const { return !dir_.empty(); }
+
+    std::string Key(std::string const& stage, std::string const& params,
+                    std::vector<std::string> const& inputs) const;
+
+    // Copies the outputs stored under key over the given files, in the
+    // same order, removing those that were missing when stored. Returns
+    // false, changing nothing, if the key was not stored.
+    bool Restore(std::string const& key, std::vector<std::string> const& outputs) const;
+
+    // Stores the outputs under key. The key is only restored once all of
+    // them are written, so a build killed meanwhile stores nothing.
+    bool Store(std::string const& key, std::vector<std::string> const& outputs) const;
+
+   private:
+    std::string Path(std::string const& key, std::string const& suffix) const;
+
+    std::string dir_;
+  };
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_STAGE_CACHE_H_
@@ -0,0 +1,53 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_STAGE_TIMER_H_
+#define SPARSE_MAPPING_STAGE_TIMER_H_
+
+#include <chrono>
+#include <functional>
+
+namespace sparse_mapping {
+
+  // Receives the name of a localization stage and the wall clock
+  // seconds it took. Stages are "detect", "query_db", "match",
+  // "ransac" and "refine".
+  typedef std::function<void(const char* stage, double seconds)> StageTimerCallback;
+
+  // Install a callback for the stage timings, or an empty one to
+  // stop timing. It is shared by the whole process and called from
+  // whichever thread ran the stage.
+  void SetStageTimerCallback(StageTimerCallback const& callback);
+  StageTimerCallback const& GetStageTimerCallback();
+
+  // Reports the time from construction to destruction under the
+  // given stage name. Costs one branch when no callback is set.
+  class ScopedStageTimer {
+   public:
+    explicit ScopedStageTimer(const char* stage);
+    ~ScopedStageTimer();
+
+   private:
+    const char* stage_;
+    bool enabled_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_STAGE_TIMER_H_
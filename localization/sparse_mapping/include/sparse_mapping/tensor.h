@@ -62,6 +62,32 @@ namespace sparse_mapping {
   void MatchFeatures(const std::string & essential_file, const std::string & matches_file,
                      sparse_mapping::SparseMap * s);
 
+  /**
+   * The steps of MatchFeatures(), for when the pairs are matched in
+   * pieces, such as by the workers of a distributed build. The pairs
+   * of images to match are chosen from the whole map, then each piece
+   * of them is matched and written in the format of the essential and
+   * matches files, which can be concatenated. The initial cameras are
+   * chained from the affines of consecutive images.
+   **/
+  void SelectMatchPairs(sparse_mapping::SparseMap * s, std::vector<std::pair<int, int> > * pairs);
+  void MatchFeaturePairs(std::vector<std::pair<int, int> > const& pairs,
+                         const std::string & essential_file, const std::string & matches_file,
+                         sparse_mapping::SparseMap * s);
+  void InitializeCamerasFromAffines(CIDPairAffineMap const& relative_affines, sparse_mapping::SparseMap * s);
+
+  /**
+   * The pairs (i, j), i < j, of cameras with has_pose set whose
+   * centers are at most max_distance apart and whose view directions
+   * differ by at most max_angle degrees. Neighbors are found with a
+   * k-d tree of the camera centers. MatchFeatures() uses this with
+   * the poses of -pair_prior_map.
+   **/
+  void GeometricPairs(std::vector<Eigen::Affine3d> const& cid_to_cam_t_global,
+                      std::vector<bool> const& has_pose,
+                      double max_distance, double max_angle,
+                      std::vector<std::pair<int, int> > * pairs);
+
   /**
    * Build the tracks based on the matches
    **/
@@ -79,6 +105,22 @@ namespace sparse_mapping {
    **/
   void CloseLoop(sparse_mapping::SparseMap * s);
 
+  /**
+   * Close loops between images the vocabulary database finds similar,
+   * far apart in the sequence. The candidates are verified by
+   * localizing one image against the points of the other, in
+   * parallel. The cameras are then moved by pose graph optimization,
+   * the matched tracks joined, and only the cameras near the loops
+   * bundle-adjusted. Builds a database in memory if the map has none.
+   **/
+  void CloseLoopsWithVocabDB(sparse_mapping::SparseMap * s);
+
+  /**
+   * Set the linear solver, preconditioner and threads of a bundle
+   * adjustment from the ba_* and num_threads flags.
+   **/
+  void SetBundleAdjustSolverOptions(ceres::Solver::Options * options);
+
   /**
    * Improve the map with bundle adjustment. Vary only the cameras
    * between given indices.
@@ -109,6 +151,36 @@ namespace sparse_mapping {
   void ExtractSubmap(std::vector<std::string> * keep_ptr,
                      sparse_mapping::SparseMap * map_ptr);
 
+  /**
+   * How CompactMap trades the size of a map for localization recall.
+   **/
+  struct CompactMapOptions {
+    // drop landmarks seen by fewer images, or with a larger mean
+    // reprojection error, in pixels, if positive
+    int min_observations = 3;
+    double max_reprojection_error = 2.0;
+    // keep at most this many landmarks per image, if positive, spread
+    // over a grid of this many cells per side
+    int max_landmarks_per_image = 500;
+    int coverage_grid = 4;
+    // drop an image within this distance, in meters, if positive, and
+    // angle, in degrees, of one kept before it which sees this
+    // fraction of its landmarks
+    double duplicate_distance = 0.05;
+    double duplicate_angle = 5.0;
+    double duplicate_overlap = 0.8;
+  };
+
+  /**
+   * Make a map smaller for localization. Landmarks are ranked by the
+   * number of images seeing them and their reprojection error, and
+   * each image keeps the best ones over all of its area. Near
+   * duplicate images are dropped. Features without a landmark are
+   * then pruned. The vocabulary database is dropped and must be
+   * rebuilt, and the map should not be bundle-adjusted again.
+   **/
+  void CompactMap(CompactMapOptions const& options, sparse_mapping::SparseMap * map_ptr);
+
   /**
    * Register the map to the world coordinate system or verify
    * how well registration did.
@@ -132,6 +204,9 @@ namespace sparse_mapping {
   void PrintTrackStats(std::vector<std::map<int, int> >const& pid_to_cid_fid,
                        std::string const& step);
 
+  // Fit an essential matrix to the given matches and keep the
+  // inliers. The affine is added to relative_b_t_a under match_mutex,
+  // which may be NULL if relative_b_t_a is not shared among threads.
   void BuildMapFindEssentialAndInliers(const Eigen::Matrix2Xd & keypoints1,
                                        const Eigen::Matrix2Xd & keypoints2,
                                        const std::vector<cv::DMatch> & matches,
@@ -0,0 +1,118 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_TILED_MAP_H_
+#define SPARSE_MAPPING_TILED_MAP_H_
+
+#include <Eigen/Core>
+
+#include <stdint.h>
+
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace sparse_mapping {
+
+struct SparseMap;
+
+/**
+ * A map split in tiles, such as one per module, each of them a map
+ * file of its own in the same world frame. The index is a text file,
+ * with a first line of "tiled_map 1" and then a line per tile:
+ *
+ *   name map_file xmin xmax ymin ymax zmin zmax
+ *
+ * The box is the part of the world the tile covers. The tile stores the
+ * images with camera centers in it, and usually some margin around it.
+ * Map files are relative to the directory of the index.
+ **/
+struct MapTile {
+  std::string name, map_file;
+  Eigen::Vector3d min, max;
+};
+
+bool IsTiledMapFile(std::string const& filename);
+bool ReadTiledMapIndex(std::string const& filename, std::vector<MapTile>* tiles);
+bool WriteTiledMapIndex(std::string const& filename, std::vector<MapTile> const& tiles);
+
+/**
+ * Loads the tiles of a tiled map when they are needed, and keeps at
+ * most max_loaded of them, dropping the least recently used. Tiles
+ * within prefetch_distance of the position given to Prefetch() are
+ * loaded on a thread of their own, so that the robot going from one
+ * module to the next does not wait for the next tile.
+ **/
+class TiledMap {
+ public:
+  TiledMap(std::string const& index_file, int max_loaded, double prefetch_distance);
+  ~TiledMap();
+
+  bool Empty() const {return tiles_.empty();}
+  int NumTiles() const {return tiles_.size();}
+  MapTile const& GetTile(int tile) const {return tiles_[tile];}
+
+  /**
+   * The tile with position in its box, or else the nearest one. -1 if
+   * there are no tiles.
+   **/
+  int FindTile(Eigen::Vector3d const& position) const;
+  /**
+   * The map of a tile, loading it now unless it is loaded already.
+   * The map stays valid while the pointer is held, even if the tile
+   * is dropped.
+   **/
+  std::shared_ptr<SparseMap> Get(int tile);
+  /**
+   * Start loading the tiles near position, that are not loaded yet.
+   **/
+  void Prefetch(Eigen::Vector3d const& position);
+  /**
+   * Called on each map once it is loaded, and now on those loaded
+   * already, to set its localization parameters.
+   **/
+  void SetConfigure(std::function<void(SparseMap*)> const& configure);
+
+ private:
+  std::shared_ptr<SparseMap> Load(int tile, std::unique_lock<std::mutex>* lock);
+  void Worker();
+
+  std::vector<MapTile> tiles_;
+  int max_loaded_;
+  double prefetch_distance_;
+  std::function<void(SparseMap*)> configure_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<std::shared_ptr<SparseMap> > maps_;
+  std::vector<uint64_t> last_used_;
+  std::vector<bool> loading_;
+  uint64_t use_count_;
+  std::deque<int> queue_;
+  bool stop_;
+  std::thread thread_;
+};
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_TILED_MAP_H_
@@ -0,0 +1,106 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_TRACK_TABLE_H_
+#define SPARSE_MAPPING_TRACK_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <vector>
+
+namespace sparse_mapping {
+
+  /**
+   * An immutable, compressed-sparse-row store of the map tracks. It
+   * answers the same queries as the pair of
+   * std::vector<std::map<int, int> > pid_to_cid_fid / cid_fid_to_pid
+   * tables, from a handful of flat arrays:
+   *
+   *  - for each landmark, its (cid, fid) observations sorted by cid,
+   *  - for each frame, a dense fid -> pid array, -1 where a feature
+   *    has no landmark.
+   *
+   * Looking up the landmark of a matched feature is then a single
+   * array read, which is what Localize() does for every match. Build
+   * the table once the tracks are final, it is not meant to be edited.
+   **/
+  class TrackTable {
+   public:
+    struct Observation {
+      int32_t cid;
+      int32_t fid;
+    };
+
+    TrackTable();
+    TrackTable(int num_cid, std::vector<std::map<int, int> > const& pid_to_cid_fid);
+
+    // Build from per-landmark maps of cid to fid.
+    void Build(int num_cid, std::vector<std::map<int, int> > const& pid_to_cid_fid);
+
+    // Build from tracks already in CSR form: the observations of
+    // landmark pid are cid_fid[2 * k], cid_fid[2 * k + 1] for
+    // k in [track_offsets[pid], track_offsets[pid + 1]).
+    void Build(int num_cid, size_t num_pid,
+               const uint64_t* track_offsets, const uint32_t* cid_fid);
+
+    void Clear();
+
+    size_t NumFrames() const {return frame_offsets_.empty() ? 0 : frame_offsets_.size() - 1;}
+    size_t NumLandmarks() const {return track_offsets_.empty() ? 0 : track_offsets_.size() - 1;}
+    size_t NumObservations() const {return observations_.size();}
+    bool Empty() const {return observations_.empty();}
+
+    // The observations of a landmark, in increasing order of cid.
+    const Observation* TrackBegin(int pid) const {return observations_.data() + track_offsets_[pid];}
+    const Observation* TrackEnd(int pid) const {return observations_.data() + track_offsets_[pid + 1];}
+    size_t TrackSize(int pid) const {return track_offsets_[pid + 1] - track_offsets_[pid];}
+
+    // The landmark seen by feature fid in frame cid, or -1 if none.
+    int Pid(int cid, int fid) const {
+      if (cid < 0 || static_cast<size_t>(cid) >= NumFrames())
+        return -1;
+      uint64_t begin = frame_offsets_[cid];
+      if (fid < 0 || static_cast<uint64_t>(fid) >= frame_offsets_[cid + 1] - begin)
+        return -1;
+      return frame_pids_[begin + fid];
+    }
+    bool HasPid(int cid, int fid) const {return Pid(cid, fid) >= 0;}
+
+    // Expand back into the map based tables, for code still using those.
+    void GetFidToPidMap(int cid, std::map<int, int> * fid_to_pid) const;
+    void GetCidToFidMap(int pid, std::map<int, int> * cid_to_fid) const;
+
+    // Renumber the features of frame cid. new_fid[fid] is the new id
+    // of feature fid, it must be valid for every feature that has a
+    // landmark.
+    void RenumberFeatures(int cid, std::vector<int> const& new_fid);
+
+   private:
+    void BuildFrames(int num_cid);
+
+    std::vector<uint64_t> track_offsets_;
+    std::vector<Observation> observations_;
+    std::vector<uint64_t> frame_offsets_;
+    std::vector<int32_t> frame_pids_;
+  };
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_TRACK_TABLE_H_
@@ -91,6 +91,16 @@ namespace sparse_mapping {
                std::string const& descriptor,
                int depth, int branching_factor, int restarts);
 
+  // Give the map in map_file the vocabulary database of the map in
+  // old_map_file, without retraining the vocabulary. The images of
+  // the old map which are in the new one by name, with the same
+  // descriptors, keep their database entries. The others are removed
+  // from it, and the new or changed images are inserted. Meant for
+  // maps made by merging or extracting from the old one.
+  void UpdateDB(std::string const& map_file,
+                std::string const& old_map_file,
+                std::string const& descriptor);
+
   void ResetDB(VocabDB* db);
 
   // Query similar images from database
@@ -100,6 +110,23 @@ namespace sparse_mapping {
                cv::Mat const& descriptors,
                std::vector<int> * indices);
 
+  // Batched version of the above. (*indices)[i] holds the result for
+  // descriptors[i]. The queries run in parallel on num_threads
+  // threads, FLAGS_num_threads if zero.
+  void QueryDB(std::string const& descriptor,
+               VocabDB * vocab_db,
+               int num_similar,
+               std::vector<cv::Mat> const& descriptors,
+               std::vector<std::vector<int> > * indices,
+               int num_threads = 0);
+
+  // The vocabulary word of each row of descriptors, or the node
+  // levels_up levels above it in the tree, which is coarser. Returns
+  // false, with words empty, if there is no vocabulary. Can run on
+  // several threads at once.
+  bool QuantizeDB(VocabDB const& vocab_db, int levels_up,
+                  cv::Mat const& descriptors, std::vector<int> * words);
+
   void BuildDBforDBoW2(sparse_mapping::SparseMap* map,
                        std::string const& descriptor,
                        int depth, int branching_factor, int restarts);
@@ -20,22 +20,92 @@
 #define LOCALIZATION_NODE_LOCALIZATION_H_
 
 #include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/tiled_map.h>
 
 #include <config_reader/config_reader.h>
 #include <cv_bridge/cv_bridge.h>
+#include <ff_msgs/LocalizationDiagnostics.h>
 #include <ff_msgs/VisualLandmarks.h>
+#include <ff_util/perf_timer.h>
+#include <ros/time.h>
+
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
 
 namespace localization_node {
 
 class Localizer {
  public:
   explicit Localizer(sparse_mapping::SparseMap* comp_map_ptr);
+  // Localize against the tile at the last known position
+  explicit Localizer(std::shared_ptr<sparse_mapping::TiledMap> tiles);
   ~Localizer();
   void ReadParams(config_reader::ConfigReader* config);
-  bool Localize(cv_bridge::CvImageConstPtr image_ptr, ff_msgs::VisualLandmarks* vl);
+  bool Localize(cv_bridge::CvImageConstPtr image_ptr, ff_msgs::VisualLandmarks* vl,
+                ff_msgs::LocalizationDiagnostics* diagnostics = NULL);
+
+  // The features of an image, from the first stage of Localize
+  struct Features {
+    ros::Time stamp;
+    cv::Mat descriptors;
+    Eigen::Matrix2Xd keypoints;
+    double start;       // when detection started, in wall seconds
+    double detect_seconds;
+    sparse_mapping::SparseMap* map;   // to localize against
+    std::shared_ptr<sparse_mapping::SparseMap> tile;  // holds map, if tiled
+  };
+  // The two stages of Localize, so that the features of one image can be
+  // detected while the image before is localized, on two threads
+  void Detect(cv_bridge::CvImageConstPtr image_ptr, Features* features);
+  // What was done is also returned in diagnostics, if given
+  bool Localize(Features const& features, ff_msgs::VisualLandmarks* vl,
+                ff_msgs::LocalizationDiagnostics* diagnostics = NULL);
+
+  // The body pose and its standard deviations, in m and rad, from the EKF.
+  // Images from around then are only matched to the map images it allows,
+  // when they are not tracked.
+  void SetPosePrior(ros::Time const& stamp, Eigen::Affine3d const& body_pose,
+                    double position_sigma, double attitude_sigma);
 
  private:
+  bool LocalizeFeatures(Features const& features, ff_msgs::VisualLandmarks* vl,
+                        ff_msgs::LocalizationDiagnostics* diagnostics);
+  void SendStageTimers(bool detect);
+  void SelectMap(ros::Time const& stamp, Features* features);
+
   sparse_mapping::SparseMap* map_;
+  // Start from the last solved pose when it is recent enough
+  bool tracking_;
+  double tracking_timeout_;
+  bool have_last_pose_;
+  ros::Time last_pose_time_;
+  Eigen::Affine3d last_cam_t_global_;
+  // Gate the map images by the pose prior, at prior_sigmas standard
+  // deviations, and no closer than the minimums
+  bool pose_prior_;
+  double prior_sigmas_, prior_min_distance_, prior_min_angle_, prior_timeout_;
+  Eigen::Affine3d nav_cam_to_body_;
+  std::mutex mutex_prior_;
+  bool have_prior_;
+  ros::Time prior_time_;
+  sparse_mapping::CameraGate prior_gate_;
+  // With a tiled map, the tile is picked from where the EKF or the last
+  // localization put the camera, at most tracking_timeout before the
+  // image. Without one, each tile is tried in turn.
+  std::shared_ptr<sparse_mapping::TiledMap> tiles_;
+  bool have_position_;
+  ros::Time position_time_;
+  Eigen::Vector3d position_;
+  int search_tile_;
+  // Latency of each localization stage, and of the whole of Localize()
+  std::map<std::string, ff_util::PerfTimer> stage_timers_;
+  ff_util::PerfTimer pt_localize_;
+  // The seconds of each stage for the image being localized
+  std::map<std::string, double> stage_seconds_;
+  // How many features, map images and inliers each image had
+  ff_util::PerfTimer pt_features_, pt_candidates_, pt_inliers_;
 };
 
 };  // namespace localization_node
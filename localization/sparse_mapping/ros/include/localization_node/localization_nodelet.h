@@ -22,13 +22,22 @@
 #include <localization_node/localization.h>
 
 #include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/tiled_map.h>
 #include <config_reader/config_reader.h>
 
+#include <ff_msgs/EkfState.h>
+#include <ff_msgs/LocalizationDiagnostics.h>
 #include <ff_msgs/SetBool.h>
 #include <ff_util/ff_nodelet.h>
+#include <ff_util/frame_budget.h>
+#include <ff_util/metrics.h>
+#include <ff_util/perf_timer.h>
 #include <nodelet/nodelet.h>
 #include <image_transport/image_transport.h>
-#include <thread>
+
+#include <condition_variable>  // NOLINT
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
 
 namespace localization_node {
 
@@ -44,27 +53,53 @@ class LocalizationNodelet : public ff_util::FreeFlyerNodelet {
   void ReadParams(void);
   void Run(void);
   void Localize(void);
+  void Match(void);
+  bool ReadyToDetect(void);
+  void Publish(ff_msgs::VisualLandmarks* vl, ff_msgs::LocalizationDiagnostics* diagnostics,
+               int camera_id, bool success);
   void ImageCallback(const sensor_msgs::ImageConstPtr& msg);
+  void EkfCallback(const ff_msgs::EkfState::ConstPtr& msg);
   bool EnableService(ff_msgs::SetBool::Request & req, ff_msgs::SetBool::Response & res);
 
   std::shared_ptr<Localizer> inst_;
   std::shared_ptr<sparse_mapping::SparseMap> map_;
+  std::shared_ptr<sparse_mapping::TiledMap> tiles_;
   std::shared_ptr<std::thread> thread_;
   config_reader::ConfigReader config_;
   ros::Timer config_timer_;
 
   std::shared_ptr<image_transport::ImageTransport> it_;
   image_transport::Subscriber image_sub_;
+  ros::Subscriber ekf_sub_;
   ros::ServiceServer enable_srv_;
-  ros::Publisher registration_publisher_, landmark_publisher_;
+  ros::Publisher registration_publisher_, landmark_publisher_, diagnostics_publisher_;
   bool enabled_;
   int count_;
 
   cv_bridge::CvImageConstPtr image_ptr_;
+  ff_util::FrameBudget budget_;
+  // The share of images dropped
+  ff_util::PerfTimer pt_dropped_;
+  ff_util::MetricTrace tr_landmarks_;
 
   volatile bool processing_image_;
   pthread_mutex_t mutex_features_;
   pthread_cond_t cond_features_;
+
+  // With pipelined set, Run detects the features of each image, and Match
+  // localizes them on its own thread while Run detects those of the next
+  // image. An image is only taken when its features will be ready about
+  // when Match is, from the average time of each stage, so that none of
+  // them waits long between the stages.
+  bool pipelined_;
+  std::shared_ptr<std::thread> match_thread_;
+  std::mutex mutex_match_;
+  std::condition_variable cond_match_;
+  bool match_pending_, matching_;
+  Localizer::Features pending_;
+  int pending_id_;
+  int64_t pending_budget_start_;
+  double detect_seconds_, match_seconds_, match_start_;
 };
 
 };  // namespace localization_node
@@ -19,22 +19,58 @@
 #include <localization_node/localization.h>
 
 #include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/stage_timer.h>
 #include <ff_msgs/VisualLandmarks.h>
 #include <msg_conversions/msg_conversions.h>
 #include <ros/ros.h>
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
 namespace localization_node {
 
 Localizer::Localizer(sparse_mapping::SparseMap* comp_map_ptr) :
-      map_(comp_map_ptr) {
+      map_(comp_map_ptr), tracking_(false), tracking_timeout_(0.0), have_last_pose_(false),
+      pose_prior_(false), prior_sigmas_(3.0), prior_min_distance_(1.0), prior_min_angle_(1.0),
+      prior_timeout_(0.0), have_prior_(false), have_position_(false), search_tile_(0) {
+  const char* stages[] = {"detect", "query_db", "match", "ransac", "refine"};
+  for (const char* stage : stages) {
+    stage_timers_[stage].Initialize(std::string("localization_") + stage);
+    // detection is timed on its own, it may run alongside the others
+    if (std::string(stage) != "detect")
+      stage_seconds_[stage] = 0.0;
+  }
+  pt_localize_.Initialize("localization");
+  pt_features_.Initialize("localization_features");
+  pt_candidates_.Initialize("localization_candidates");
+  pt_inliers_.Initialize("localization_inliers");
+  sparse_mapping::SetStageTimerCallback([this](const char* stage, double seconds) {
+      std::map<std::string, ff_util::PerfTimer>::iterator it = stage_timers_.find(stage);
+      if (it != stage_timers_.end())
+        it->second.Add(seconds);
+      std::map<std::string, double>::iterator frame = stage_seconds_.find(stage);
+      if (frame != stage_seconds_.end())
+        frame->second += seconds;
+    });
+}
+
+Localizer::Localizer(std::shared_ptr<sparse_mapping::TiledMap> tiles) :
+      Localizer(static_cast<sparse_mapping::SparseMap*>(NULL)) {
+  tiles_ = tiles;
 }
 
 Localizer::~Localizer(void) {
+  sparse_mapping::SetStageTimerCallback(sparse_mapping::StageTimerCallback());
 }
 
 void Localizer::ReadParams(config_reader::ConfigReader* config) {
   int num_similar, ransac_inlier_tolerance, ransac_iterations;
   int min_features, max_features, brisk_threshold, detection_retries;
+  bool landmark_matching;
   camera::CameraParameters cam_params(config, "nav_cam");
   if (!config->GetInt("num_similar", &num_similar))
     ROS_FATAL("num_similar not specified in localization.");
@@ -50,46 +86,220 @@ void Localizer::ReadParams(config_reader::ConfigReader* config) {
     ROS_FATAL("brisk_threshold not specified in localization.");
   if (!config->GetInt("detection_retries", &detection_retries))
     ROS_FATAL("detection_retries not specified in localization.");
-  map_->SetCameraParameters(cam_params);
-  map_->SetNumSimilar(num_similar);
-  map_->SetRansacInlierTolerance(ransac_inlier_tolerance);
-  map_->SetRansacIterations(ransac_iterations);
-  map_->SetBriskParams(min_features, max_features, brisk_threshold, detection_retries);
+  if (!config->GetBool("tracking", &tracking_))
+    ROS_FATAL("tracking not specified in localization.");
+  if (!config->GetReal("tracking_timeout", &tracking_timeout_))
+    ROS_FATAL("tracking_timeout not specified in localization.");
+  if (!config->GetBool("pose_prior", &pose_prior_))
+    ROS_FATAL("pose_prior not specified in localization.");
+  if (!config->GetReal("prior_sigmas", &prior_sigmas_))
+    ROS_FATAL("prior_sigmas not specified in localization.");
+  if (!config->GetReal("prior_min_distance", &prior_min_distance_))
+    ROS_FATAL("prior_min_distance not specified in localization.");
+  if (!config->GetReal("prior_min_angle", &prior_min_angle_))
+    ROS_FATAL("prior_min_angle not specified in localization.");
+  if (!config->GetReal("prior_timeout", &prior_timeout_))
+    ROS_FATAL("prior_timeout not specified in localization.");
+  if (!config->GetBool("landmark_matching", &landmark_matching))
+    ROS_FATAL("landmark_matching not specified in localization.");
+  Eigen::Vector3d trans;
+  Eigen::Quaterniond rot;
+  if (!msg_conversions::config_read_transform(config, "nav_cam_transform", &trans, &rot))
+    ROS_FATAL("Unspecified nav_cam_transform.");
+  {
+    std::lock_guard<std::mutex> lock(mutex_prior_);
+    nav_cam_to_body_ = Eigen::Translation3d(trans) * rot;
+    have_prior_ = false;
+  }
+  have_last_pose_ = false;
+  std::function<void(sparse_mapping::SparseMap*)> configure =
+    [cam_params, num_similar, ransac_inlier_tolerance, ransac_iterations,
+     min_features, max_features, brisk_threshold, detection_retries,
+     landmark_matching](sparse_mapping::SparseMap* map) {
+    map->SetCameraParameters(cam_params);
+    map->SetNumSimilar(num_similar);
+    map->SetRansacInlierTolerance(ransac_inlier_tolerance);
+    map->SetRansacIterations(ransac_iterations);
+    map->SetBriskParams(min_features, max_features, brisk_threshold, detection_retries);
+    map->SetLandmarkMatching(landmark_matching);
+  };
+  if (tiles_)
+    tiles_->SetConfigure(configure);
+  else
+    configure(map_);
+}
+
+void Localizer::SelectMap(ros::Time const& stamp, Features* features) {
+  features->map = map_;
+  if (!tiles_)
+    return;
+  Eigen::Vector3d position;
+  bool known;
+  {
+    std::lock_guard<std::mutex> lock(mutex_prior_);
+    known = have_position_ && std::abs((stamp - position_time_).toSec()) <= tracking_timeout_;
+    position = position_;
+  }
+  int tile;
+  if (known) {
+    tile = tiles_->FindTile(position);
+    tiles_->Prefetch(position);
+  } else {
+    tile = search_tile_;
+    search_tile_ = (search_tile_ + 1) % tiles_->NumTiles();
+  }
+  features->tile = tiles_->Get(tile);
+  features->map = features->tile.get();
+}
+
+bool Localizer::Localize(cv_bridge::CvImageConstPtr image_ptr, ff_msgs::VisualLandmarks* vl,
+                         ff_msgs::LocalizationDiagnostics* diagnostics) {
+  Features features;
+  Detect(image_ptr, &features);
+  return Localize(features, vl, diagnostics);
 }
 
-bool Localizer::Localize(cv_bridge::CvImageConstPtr image_ptr, ff_msgs::VisualLandmarks* vl) {
-  cv::Mat image_descriptors;
-  Eigen::Matrix2Xd image_keypoints;
-  map_->DetectFeatures(image_ptr->image, &image_descriptors, &image_keypoints);
+void Localizer::Detect(cv_bridge::CvImageConstPtr image_ptr, Features* features) {
+  features->start = ros::WallTime::now().toSec();
+  features->stamp = image_ptr->header.stamp;
+  SelectMap(features->stamp, features);
+  features->map->DetectFeatures(image_ptr->image, &features->descriptors, &features->keypoints);
+  features->detect_seconds = ros::WallTime::now().toSec() - features->start;
+  SendStageTimers(true);
+}
+
+bool Localizer::Localize(Features const& features, ff_msgs::VisualLandmarks* vl,
+                         ff_msgs::LocalizationDiagnostics* diagnostics) {
+  for (std::map<std::string, double>::iterator it = stage_seconds_.begin(); it != stage_seconds_.end(); it++)
+    it->second = 0.0;
+  ff_msgs::LocalizationDiagnostics local_diagnostics;
+  if (!diagnostics)
+    diagnostics = &local_diagnostics;
+  bool success = LocalizeFeatures(features, vl, diagnostics);
+  // the whole latency, including any wait between the stages
+  double seconds = ros::WallTime::now().toSec() - features.start;
+  pt_localize_.Add(seconds);
+  pt_localize_.Send();
+  SendStageTimers(false);
+
+  diagnostics->header.stamp = features.stamp;
+  diagnostics->dropped = false;
+  diagnostics->success = success;
+  diagnostics->num_features = features.keypoints.cols();
+  diagnostics->detect_ms = 1000 * features.detect_seconds;
+  diagnostics->query_db_ms = 1000 * stage_seconds_["query_db"];
+  diagnostics->match_ms = 1000 * stage_seconds_["match"];
+  diagnostics->ransac_ms = 1000 * stage_seconds_["ransac"];
+  diagnostics->refine_ms = 1000 * stage_seconds_["refine"];
+  diagnostics->total_ms = 1000 * seconds;
+  pt_features_.Add(diagnostics->num_features);
+  pt_features_.Send();
+  pt_candidates_.Add(diagnostics->num_candidates);
+  pt_candidates_.Send();
+  pt_inliers_.Add(diagnostics->num_inliers);
+  pt_inliers_.Send();
+  return success;
+}
+
+void Localizer::SetPosePrior(ros::Time const& stamp, Eigen::Affine3d const& body_pose,
+                             double position_sigma, double attitude_sigma) {
+  std::lock_guard<std::mutex> lock(mutex_prior_);
+  Eigen::Affine3d nav_cam_pose = body_pose * nav_cam_to_body_;
+  prior_gate_.center = nav_cam_pose.translation();
+  prior_gate_.direction = nav_cam_pose.linear().col(2);
+  prior_gate_.max_distance = std::max(prior_min_distance_, prior_sigmas_ * position_sigma);
+  prior_gate_.max_angle = std::max(prior_min_angle_, prior_sigmas_ * attitude_sigma);
+  prior_time_ = stamp;
+  have_prior_ = true;
+  position_ = prior_gate_.center;
+  position_time_ = stamp;
+  have_position_ = true;
+}
+
+static void FillStats(sparse_mapping::LocalizeStats const& stats, ff_msgs::LocalizationDiagnostics* diagnostics) {
+  diagnostics->num_candidates = stats.num_candidates;
+  diagnostics->num_matches = stats.num_matches;
+  diagnostics->num_ransac_iterations = stats.num_ransac_iterations;
+  diagnostics->num_inliers = stats.num_inliers;
+}
+
+// The detect timer is only used by the detection stage, and the others by
+// the localization stage, so each stage sends its own
+void Localizer::SendStageTimers(bool detect) {
+  for (std::map<std::string, ff_util::PerfTimer>::iterator it = stage_timers_.begin();
+       it != stage_timers_.end(); it++)
+    if ((it->first == "detect") == detect)
+      it->second.Send();
+}
+
+bool Localizer::LocalizeFeatures(Features const& features, ff_msgs::VisualLandmarks* vl,
+                                 ff_msgs::LocalizationDiagnostics* diagnostics) {
+  sparse_mapping::SparseMap* map = features.map;
+  cv::Mat const& image_descriptors = features.descriptors;
+  Eigen::Matrix2Xd const& image_keypoints = features.keypoints;
   camera::CameraModel camera(Eigen::Vector3d(),
                              Eigen::Matrix3d::Identity(),
-                             map_->GetCameraParameters());
+                             map->GetCameraParameters());
   std::vector<Eigen::Vector3d> landmarks;
   std::vector<Eigen::Vector2d> observations;
-  if (!map_->Localize(image_descriptors, image_keypoints,
-                               &camera, &landmarks, &observations)) {
-    // LOG(INFO) << "Failed to localize image.";
-    return false;
+
+  // Try first to follow on from the previous pose, which avoids the
+  // vocabulary tree and matching whole map images.
+  bool tracked = false;
+  ros::Time stamp = features.stamp;
+  if (tracking_ && have_last_pose_ && std::abs((stamp - last_pose_time_).toSec()) <= tracking_timeout_) {
+    camera.SetTransform(last_cam_t_global_);
+    tracked = map->LocalizeFromPrior(image_descriptors, image_keypoints,
+                                     &camera, &landmarks, &observations);
+    FillStats(map->GetLocalizeStats(), diagnostics);
+  }
+  diagnostics->tracked = tracked;
+  bool gated = false;
+  sparse_mapping::CameraGate gate;
+  if (pose_prior_) {
+    std::lock_guard<std::mutex> lock(mutex_prior_);
+    gated = have_prior_ && std::abs((stamp - prior_time_).toSec()) <= prior_timeout_;
+    gate = prior_gate_;
   }
+  if (!tracked) {
+    landmarks.clear();
+    observations.clear();
+    bool found = gated ? map->Localize(image_descriptors, image_keypoints, gate,
+                                       &camera, &landmarks, &observations)
+                       : map->Localize(image_descriptors, image_keypoints,
+                                       &camera, &landmarks, &observations);
+    diagnostics->gated = gated;
+    FillStats(map->GetLocalizeStats(), diagnostics);
+    if (!found) {
+      // LOG(INFO) << "Failed to localize image.";
+      have_last_pose_ = false;
+      return false;
+    }
+  }
+  have_last_pose_ = true;
+  last_pose_time_ = stamp;
+  last_cam_t_global_ = camera.GetTransform();
 
   Eigen::Affine3d global_pose = camera.GetTransform().inverse();
+  {
+    std::lock_guard<std::mutex> lock(mutex_prior_);
+    position_ = global_pose.translation();
+    position_time_ = stamp;
+    have_position_ = true;
+  }
   Eigen::Quaterniond quat(global_pose.rotation());
 
   vl->header = std_msgs::Header();
-  vl->header.stamp = image_ptr->header.stamp;
+  vl->header.stamp = features.stamp;
   vl->pose.position = msg_conversions::eigen_to_ros_point(global_pose.translation());
   vl->pose.orientation = msg_conversions::eigen_to_ros_quat(quat);
   assert(landmarks.size() == observations.size());
-  vl->landmarks.reserve(landmarks.size());
-  for (size_t i = 0; i < landmarks.size(); i++) {
-    ff_msgs::VisualLandmark l;
-    l.x = landmarks[i].x();
-    l.y = landmarks[i].y();
-    l.z = landmarks[i].z();
-    l.u = observations[i].x();
-    l.v = observations[i].y();
-    vl->landmarks.push_back(l);
-  }
+  // the points are contiguous in the vectors, so are read in place
+  int num_landmarks = landmarks.size();
+  msg_conversions::eigen_to_ros_landmarks(
+    Eigen::Map<const Eigen::Matrix3Xd>(landmarks.empty() ? NULL : landmarks[0].data(), 3, num_landmarks),
+    Eigen::Map<const Eigen::Matrix2Xd>(observations.empty() ? NULL : observations[0].data(), 2, num_landmarks),
+    &vl->landmarks);
 
   return true;
 }
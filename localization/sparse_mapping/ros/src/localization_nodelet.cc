@@ -20,9 +20,12 @@
 
 #include <common/init.h>
 #include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/tiled_map.h>
 
 #include <ros/ros.h>
 #include <ff_msgs/CameraRegistration.h>
+#include <ff_msgs/EkfState.h>
+#include <ff_msgs/LocalizationDiagnostics.h>
 #include <ff_msgs/VisualLandmarks.h>
 #include <geometry_msgs/TransformStamped.h>
 #include <gflags/gflags.h>
@@ -32,16 +35,22 @@
 #include <pluginlib/class_list_macros.h>
 #include <tf2_ros/transform_broadcaster.h>
 
+#include <cmath>
+
 namespace localization_node {
 
 LocalizationNodelet::LocalizationNodelet() : ff_util::FreeFlyerNodelet(NODE_MAPPED_LANDMARKS),
-        enabled_(false), count_(0), processing_image_(true) {
+        enabled_(false), count_(0), processing_image_(true), pipelined_(false),
+        match_pending_(false), matching_(false), pending_id_(0), pending_budget_start_(0),
+        detect_seconds_(0), match_seconds_(0), match_start_(0) {
   pthread_mutex_init(&mutex_features_, NULL);
   pthread_cond_init(&cond_features_, NULL);
 }
 
 LocalizationNodelet::~LocalizationNodelet(void) {
   thread_->join();
+  if (match_thread_)
+    match_thread_->join();
   pthread_mutex_destroy(&mutex_features_);
   pthread_cond_destroy(&cond_features_);
 }
@@ -51,6 +60,7 @@ void LocalizationNodelet::Initialize(ros::NodeHandle* nh) {
   common::InitFreeFlyerApplication(getMyArgv());
 
   config_.AddFile("cameras.config");
+  config_.AddFile("geometry.config");
   config_.AddFile("localization.config");
   config_.ReadFiles();
 
@@ -61,21 +71,45 @@ void LocalizationNodelet::Initialize(ros::NodeHandle* nh) {
 
   // Reset all internal shared pointers
   it_.reset(new image_transport::ImageTransport(*nh));
-  map_.reset(new sparse_mapping::SparseMap(map_file, true));
-  inst_.reset(new Localizer(map_.get()));
+  if (sparse_mapping::IsTiledMapFile(map_file)) {
+    int max_loaded;
+    double prefetch_distance;
+    if (!config_.GetInt("map_tiles_loaded", &max_loaded))
+      ROS_FATAL("map_tiles_loaded not specified in localization.");
+    if (!config_.GetReal("map_prefetch_distance", &prefetch_distance))
+      ROS_FATAL("map_prefetch_distance not specified in localization.");
+    tiles_.reset(new sparse_mapping::TiledMap(map_file, max_loaded, prefetch_distance));
+    if (tiles_->Empty())
+      ROS_FATAL("The tiled map has no tiles.");
+    inst_.reset(new Localizer(tiles_));
+  } else {
+    map_.reset(new sparse_mapping::SparseMap(map_file, true));
+    inst_.reset(new Localizer(map_.get()));
+  }
 
   registration_publisher_ = nh->advertise<ff_msgs::CameraRegistration>(
       TOPIC_LOCALIZATION_ML_REGISTRATION, 10);
   landmark_publisher_     = nh->advertise<ff_msgs::VisualLandmarks>(
       TOPIC_LOCALIZATION_ML_FEATURES, 10);
+  diagnostics_publisher_  = nh->advertise<ff_msgs::LocalizationDiagnostics>(
+      TOPIC_LOCALIZATION_ML_DIAGNOSTICS, 10);
+  pt_dropped_.Initialize("localization_dropped");
+  tr_landmarks_ = ff_util::MetricsRegistry::Instance().Trace("localization");
 
   // Subscribe to input video feed and publish output odometry info
   image_sub_ = it_->subscribe(TOPIC_HARDWARE_NAV_CAM, 1, &LocalizationNodelet::ImageCallback, this);
+  ekf_sub_ = nh->subscribe(TOPIC_GNC_EKF, 1, &LocalizationNodelet::EkfCallback, this);
+
+  ReadParams();
+
+  // only read once, since it decides which threads run
+  if (!config_.GetBool("pipelined", &pipelined_))
+    ROS_FATAL("pipelined not specified in localization.");
 
   // start a new thread to run everything
   thread_.reset(new std::thread(&localization_node::LocalizationNodelet::Run, this));
-
-  ReadParams();
+  if (pipelined_)
+    match_thread_.reset(new std::thread(&localization_node::LocalizationNodelet::Match, this));
 
   // only do this once, will cause a crash if done in middle of thread execution
   int num_threads;
@@ -95,6 +129,10 @@ void LocalizationNodelet::ReadParams(void) {
     return;
   }
   inst_->ReadParams(&config_);
+  double cpu_budget;
+  if (!config_.GetReal("cpu_budget", &cpu_budget))
+    ROS_FATAL("cpu_budget not specified in localization.");
+  budget_.SetBudget(cpu_budget);
 }
 
 bool LocalizationNodelet::EnableService(ff_msgs::SetBool::Request & req, ff_msgs::SetBool::Response & res) {
@@ -108,7 +146,17 @@ void LocalizationNodelet::ImageCallback(const sensor_msgs::ImageConstPtr& msg) {
   pthread_mutex_lock(&mutex_features_);
   bool cont = processing_image_;
   pthread_mutex_unlock(&mutex_features_);
-  if (cont) return;
+  // skip the frame, before registering it, if localizing is over its budget
+  bool dropped = cont || budget_.Skip() || (pipelined_ && !ReadyToDetect());
+  pt_dropped_.Add(dropped);
+  pt_dropped_.Send();
+  if (dropped) {
+    ff_msgs::LocalizationDiagnostics diagnostics;
+    diagnostics.header.stamp = msg->header.stamp;
+    diagnostics.dropped = true;
+    diagnostics_publisher_.publish(diagnostics);
+    return;
+  }
 
   ff_msgs::CameraRegistration r;
   r.header = std_msgs::Header();
@@ -130,13 +178,67 @@ void LocalizationNodelet::ImageCallback(const sensor_msgs::ImageConstPtr& msg) {
   pthread_mutex_unlock(&mutex_features_);
 }
 
+// The pose prior is only set while the EKF is confident, so that a lost
+// robot searches the whole map
+void LocalizationNodelet::EkfCallback(const ff_msgs::EkfState::ConstPtr& msg) {
+  if (msg->confidence != ff_msgs::EkfState::CONFIDENCE_GOOD)
+    return;
+  Eigen::Affine3d body_pose = msg_conversions::ros_pose_to_eigen_transform(msg->pose);
+  double position_sigma = std::sqrt(msg->cov_diag[12] + msg->cov_diag[13] + msg->cov_diag[14]);
+  double attitude_sigma = std::sqrt(msg->cov_diag[0] + msg->cov_diag[1] + msg->cov_diag[2]);
+  inst_->SetPosePrior(msg->header.stamp, body_pose, position_sigma, attitude_sigma);
+}
+
 void LocalizationNodelet::Localize(void) {
   ff_msgs::VisualLandmarks vl;
+  ff_msgs::LocalizationDiagnostics diagnostics;
+  bool success = inst_->Localize(image_ptr_, &vl, &diagnostics);
+  Publish(&vl, &diagnostics, count_, success);
+}
+
+// Whether the features of an image taken now would not wait for Match
+bool LocalizationNodelet::ReadyToDetect(void) {
+  std::lock_guard<std::mutex> lock(mutex_match_);
+  if (match_pending_)
+    return false;
+  return !matching_ || ros::WallTime::now().toSec() - match_start_ >= match_seconds_ - detect_seconds_;
+}
 
-  bool success = inst_->Localize(image_ptr_, &vl);
+void LocalizationNodelet::Match(void) {
+  ConfigureThread("match");
+  while (ros::ok()) {
+    std::unique_lock<std::mutex> lock(mutex_match_);
+    cond_match_.wait_for(lock, std::chrono::seconds(1), [this] { return match_pending_; });
+    if (!match_pending_)
+      continue;
+    Localizer::Features features;
+    std::swap(features, pending_);
+    int camera_id = pending_id_;
+    int64_t budget_start = pending_budget_start_;
+    match_pending_ = false;
+    matching_ = true;
+    match_start_ = ros::WallTime::now().toSec();
+    lock.unlock();
+
+    ff_msgs::VisualLandmarks vl;
+    ff_msgs::LocalizationDiagnostics diagnostics;
+    bool success = inst_->Localize(features, &vl, &diagnostics);
+    Publish(&vl, &diagnostics, camera_id, success);
+    budget_.Stop(budget_start);
+
+    lock.lock();
+    matching_ = false;
+    match_seconds_ = 0.8 * match_seconds_ + 0.2 * (ros::WallTime::now().toSec() - match_start_);
+  }
+}
 
-  vl.camera_id = count_;
-  landmark_publisher_.publish(vl);
+void LocalizationNodelet::Publish(ff_msgs::VisualLandmarks* vl, ff_msgs::LocalizationDiagnostics* diagnostics,
+                                  int camera_id, bool success) {
+  vl->camera_id = camera_id;
+  landmark_publisher_.publish(*vl);
+  tr_landmarks_.Emit(camera_id, (ros::Time::now() - vl->header.stamp).toNSec());
+  diagnostics->camera_id = camera_id;
+  diagnostics_publisher_.publish(*diagnostics);
   ros::spinOnce();
 
   // only send transform if succeeded
@@ -147,18 +249,19 @@ void LocalizationNodelet::Localize(void) {
   static tf2_ros::TransformBroadcaster br;
   geometry_msgs::TransformStamped transformStamped;
   transformStamped.header.stamp = ros::Time::now();
-  transformStamped.header.seq = count_;
+  transformStamped.header.seq = camera_id;
   transformStamped.header.frame_id = "world";
   transformStamped.child_frame_id = "localization";
-  transformStamped.transform.translation.x = vl.pose.position.x;
-  transformStamped.transform.translation.y = vl.pose.position.y;
-  transformStamped.transform.translation.z = vl.pose.position.z;
-  transformStamped.transform.rotation = vl.pose.orientation;
+  transformStamped.transform.translation.x = vl->pose.position.x;
+  transformStamped.transform.translation.y = vl->pose.position.y;
+  transformStamped.transform.translation.z = vl->pose.position.z;
+  transformStamped.transform.rotation = vl->pose.orientation;
 
   br.sendTransform(transformStamped);
 }
 
 void LocalizationNodelet::Run(void) {
+  ConfigureThread("run");
   struct timespec ts;
   bool running = false;
   while (ros::ok()) {
@@ -185,7 +288,25 @@ void LocalizationNodelet::Run(void) {
     if (!ready)
       continue;
     // unlock the mutex for localizing so we can ignore images we get during this
-    Localize();
+    if (pipelined_) {
+      // detect, and hand the features over to Match, which is idle or about
+      // to be since the image was only taken then
+      int64_t budget_start = ff_util::FrameBudget::Now();
+      Localizer::Features features;
+      inst_->Detect(image_ptr_, &features);
+      image_ptr_.reset();
+      std::lock_guard<std::mutex> lock(mutex_match_);
+      detect_seconds_ = 0.8 * detect_seconds_ + 0.2 * (ros::WallTime::now().toSec() - features.start);
+      std::swap(pending_, features);
+      pending_id_ = count_;
+      pending_budget_start_ = budget_start;
+      match_pending_ = true;
+      cond_match_.notify_one();
+    } else {
+      budget_.Start();
+      Localize();
+      budget_.Stop();
+    }
     count_++;
     pthread_mutex_lock(&mutex_features_);
     processing_image_ = false;
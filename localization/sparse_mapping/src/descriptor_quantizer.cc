@@ -0,0 +1,306 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/descriptor_quantizer.h>
+
+#include <sparse_map.pb.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+DECLARE_double(goodness_ratio);  // from interest_point/matching.cc
+
+namespace sparse_mapping {
+
+namespace {
+
+const int kNumCenters = 256;
+
+// Enough to place 256 centers, without k-means taking forever on
+// large maps
+const int kMaxTrainingRows = 100000;
+
+}  // namespace
+
+DescriptorQuantizer::DescriptorQuantizer() : type_(NONE), dim_(0), num_subspaces_(0) {}
+
+DescriptorQuantizer::Type DescriptorQuantizer::StringToType(std::string const& name) {
+  if (name == "SCALAR8")
+    return SCALAR8;
+  if (name == "PQ")
+    return PRODUCT;
+  return NONE;
+}
+
+void DescriptorQuantizer::Train(std::vector<cv::Mat> const& descriptors, Type type, int num_subspaces) {
+  type_ = type;
+  dim_ = 0;
+  num_subspaces_ = 0;
+  offset_.clear();
+  scale_.clear();
+  codebook_.clear();
+  if (type_ == NONE)
+    return;
+
+  // Gather the training rows, subsampled evenly across the images
+  int num_rows = 0;
+  for (cv::Mat const& d : descriptors) {
+    if (d.rows == 0)
+      continue;
+    if (d.depth() != CV_32F)
+      LOG(FATAL) << "Only float descriptors can be quantized.";
+    if (dim_ == 0)
+      dim_ = d.cols;
+    CHECK(d.cols == dim_) << "Descriptors have different lengths.";
+    num_rows += d.rows;
+  }
+  if (num_rows == 0)
+    LOG(FATAL) << "No descriptors to train the quantizer on.";
+  int stride = std::max(1, num_rows / kMaxTrainingRows);
+  cv::Mat samples(0, dim_, CV_32F);
+  int index = 0;
+  for (cv::Mat const& d : descriptors) {
+    for (int row = 0; row < d.rows; row++, index++) {
+      if (index % stride == 0)
+        samples.push_back(d.row(row));
+    }
+  }
+
+  if (type_ == SCALAR8) {
+    offset_.resize(dim_);
+    scale_.resize(dim_);
+    for (int c = 0; c < dim_; c++) {
+      double low, high;
+      cv::minMaxLoc(samples.col(c), &low, &high);
+      offset_[c] = low;
+      scale_[c] = std::max((high - low) / 255.0, 1e-12);
+    }
+    return;
+  }
+
+  if (num_subspaces <= 0 || dim_ % num_subspaces != 0)
+    LOG(FATAL) << "The number of subspaces, " << num_subspaces
+               << ", must divide the descriptor length, " << dim_ << ".";
+  num_subspaces_ = num_subspaces;
+  int sub_dim = dim_ / num_subspaces_;
+  int num_centers = std::min(kNumCenters, samples.rows);
+  codebook_.assign(num_subspaces_ * kNumCenters * sub_dim, 0.0f);
+  for (int s = 0; s < num_subspaces_; s++) {
+    cv::Mat data = samples.colRange(s * sub_dim, (s + 1) * sub_dim).clone();
+    cv::Mat labels, centers;
+    cv::kmeans(data, num_centers, labels,
+               cv::TermCriteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 25, 1e-4),
+               1, cv::KMEANS_PP_CENTERS, centers);
+    // With few samples the unused centers repeat the last one, and are
+    // never picked by Encode()
+    float* book = &codebook_[s * kNumCenters * sub_dim];
+    for (int k = 0; k < kNumCenters; k++)
+      memcpy(book + k * sub_dim, centers.ptr<float>(std::min(k, num_centers - 1)), sub_dim * sizeof(float));
+  }
+}
+
+void DescriptorQuantizer::Encode(cv::Mat const& descriptors, cv::Mat * codes) const {
+  CHECK(type_ != NONE) << "The quantizer is not trained.";
+  codes->create(descriptors.rows, CodeSize(), CV_8U);
+  if (descriptors.rows == 0)
+    return;
+  CHECK(descriptors.depth() == CV_32F && descriptors.cols == dim_)
+    << "Expecting float descriptors of length " << dim_ << ".";
+
+  int sub_dim = type_ == PRODUCT ? dim_ / num_subspaces_ : 0;
+  for (int row = 0; row < descriptors.rows; row++) {
+    const float* d = descriptors.ptr<float>(row);
+    uint8_t* code = codes->ptr<uint8_t>(row);
+    if (type_ == SCALAR8) {
+      for (int c = 0; c < dim_; c++) {
+        double q = std::round((d[c] - offset_[c]) / scale_[c]);
+        code[c] = static_cast<uint8_t>(std::min(255.0, std::max(0.0, q)));
+      }
+      continue;
+    }
+    for (int s = 0; s < num_subspaces_; s++) {
+      const float* piece = d + s * sub_dim;
+      const float* book = &codebook_[s * kNumCenters * sub_dim];
+      int best = 0;
+      float best_dist = std::numeric_limits<float>::max();
+      for (int k = 0; k < kNumCenters; k++) {
+        float dist = 0;
+        for (int c = 0; c < sub_dim; c++) {
+          float diff = piece[c] - book[k * sub_dim + c];
+          dist += diff * diff;
+        }
+        if (dist < best_dist) {
+          best_dist = dist;
+          best = k;
+        }
+      }
+      code[s] = best;
+    }
+  }
+}
+
+void DescriptorQuantizer::Decode(cv::Mat const& codes, cv::Mat * descriptors) const {
+  CHECK(type_ != NONE) << "The quantizer is not trained.";
+  descriptors->create(codes.rows, dim_, CV_32F);
+  if (codes.rows == 0)
+    return;
+  CHECK(codes.depth() == CV_8U && codes.cols == CodeSize())
+    << "Expecting codes of " << CodeSize() << " bytes.";
+
+  int sub_dim = type_ == PRODUCT ? dim_ / num_subspaces_ : 0;
+  for (int row = 0; row < codes.rows; row++) {
+    const uint8_t* code = codes.ptr<uint8_t>(row);
+    float* d = descriptors->ptr<float>(row);
+    if (type_ == SCALAR8) {
+      for (int c = 0; c < dim_; c++)
+        d[c] = offset_[c] + scale_[c] * code[c];
+      continue;
+    }
+    for (int s = 0; s < num_subspaces_; s++)
+      memcpy(d + s * sub_dim, &codebook_[(s * kNumCenters + code[s]) * sub_dim], sub_dim * sizeof(float));
+  }
+}
+
+// For PRODUCT, the squared distances of the query pieces to all the
+// centers
+void DescriptorQuantizer::DistanceTable(const float* query, std::vector<float> * table) const {
+  table->clear();
+  if (type_ != PRODUCT)
+    return;
+  int sub_dim = dim_ / num_subspaces_;
+  table->resize(num_subspaces_ * kNumCenters);
+  for (int s = 0; s < num_subspaces_; s++) {
+    const float* piece = query + s * sub_dim;
+    const float* book = &codebook_[s * kNumCenters * sub_dim];
+    for (int k = 0; k < kNumCenters; k++) {
+      float dist = 0;
+      for (int c = 0; c < sub_dim; c++) {
+        float diff = piece[c] - book[k * sub_dim + c];
+        dist += diff * diff;
+      }
+      (*table)[s * kNumCenters + k] = dist;
+    }
+  }
+}
+
+float DescriptorQuantizer::SquaredDistance(const float* query, std::vector<float> const& table,
+                                           const uint8_t* code) const {
+  float dist = 0;
+  if (type_ == PRODUCT) {
+    const float* t = table.data();
+    for (int s = 0; s < num_subspaces_; s++, t += kNumCenters)
+      dist += t[code[s]];
+    return dist;
+  }
+
+  // A table for 8-bit codes would have 256 entries per dimension,
+  // more work than it saves, so decode on the fly
+  for (int c = 0; c < dim_; c++) {
+    float diff = query[c] - (offset_[c] + scale_[c] * code[c]);
+    dist += diff * diff;
+  }
+  return dist;
+}
+
+double DescriptorQuantizer::Distance(const float* query, const uint8_t* code) const {
+  std::vector<float> table;
+  DistanceTable(query, &table);
+  return Distance(query, table, code);
+}
+
+double DescriptorQuantizer::Distance(const float* query, std::vector<float> const& table,
+                                     const uint8_t* code) const {
+  return std::sqrt(SquaredDistance(query, table, code));
+}
+
+void DescriptorQuantizer::FindMatches(cv::Mat const& query, cv::Mat const& codes,
+                                      std::vector<cv::DMatch> * matches) const {
+  matches->clear();
+  if (query.rows == 0 || codes.rows == 0)
+    return;
+  CHECK(query.depth() == CV_32F && query.cols == dim_)
+    << "Expecting float descriptors of length " << dim_ << ".";
+  CHECK(codes.depth() == CV_8U && codes.cols == CodeSize())
+    << "Expecting codes of " << CodeSize() << " bytes.";
+
+  std::vector<float> table;
+  for (int i = 0; i < query.rows; i++) {
+    const float* q = query.ptr<float>(i);
+    DistanceTable(q, &table);
+
+    int best = -1;
+    float first = std::numeric_limits<float>::max();
+    float second = std::numeric_limits<float>::max();
+    for (int j = 0; j < codes.rows; j++) {
+      float dist = SquaredDistance(q, table, codes.ptr<uint8_t>(j));
+      if (dist < first) {
+        second = first;
+        first = dist;
+        best = j;
+      } else if (dist < second) {
+        second = dist;
+      }
+    }
+
+    // Same test as for the float matches, on the distances themselves
+    first = std::sqrt(first);
+    if (codes.rows == 1 || first < FLAGS_goodness_ratio * std::sqrt(second))
+      matches->push_back(cv::DMatch(i, best, first));
+  }
+}
+
+void DescriptorQuantizer::SaveProtobuf(sparse_mapping_protobuf::DescriptorQuantizer * proto) const {
+  proto->Clear();
+  proto->set_type(type_);
+  proto->set_dim(dim_);
+  proto->set_num_subspaces(num_subspaces_);
+  for (size_t i = 0; i < offset_.size(); i++) {
+    proto->add_offset(offset_[i]);
+    proto->add_scale(scale_[i]);
+  }
+  for (float value : codebook_)
+    proto->add_codebook(value);
+}
+
+void DescriptorQuantizer::LoadProtobuf(sparse_mapping_protobuf::DescriptorQuantizer const& proto) {
+  type_ = static_cast<Type>(proto.type());
+  dim_ = proto.dim();
+  num_subspaces_ = proto.num_subspaces();
+  offset_.assign(proto.offset().begin(), proto.offset().end());
+  scale_.assign(proto.scale().begin(), proto.scale().end());
+  codebook_.assign(proto.codebook().begin(), proto.codebook().end());
+
+  bool valid = false;
+  if (type_ == SCALAR8)
+    valid = static_cast<int>(offset_.size()) == dim_ && static_cast<int>(scale_.size()) == dim_;
+  else if (type_ == PRODUCT)
+    valid = num_subspaces_ > 0 && dim_ % num_subspaces_ == 0 &&
+      static_cast<int>(codebook_.size()) == kNumCenters * dim_;
+  if (!valid)
+    LOG(FATAL) << "Invalid descriptor quantizer in map file.";
+}
+
+}  // namespace sparse_mapping
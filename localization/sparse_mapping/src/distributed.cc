@@ -0,0 +1,378 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/distributed.h>
+#include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/tensor.h>
+
+#include <camera/camera_params.h>
+#include <config_reader/config_reader.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+DECLARE_string(feature_store);
+
+namespace sparse_mapping {
+
+namespace {
+
+double Now() {
+  return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// The modification time of a file, or -1 if it is missing
+double ModTime(std::string const& file) {
+  struct stat info;
+  if (stat(file.c_str(), &info) != 0)
+    return -1;
+  return info.st_mtim.tv_sec + 1e-9 * info.st_mtim.tv_nsec;
+}
+
+void MakeDir(std::string const& dir) {
+  if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+    LOG(FATAL) << "Could not create the directory " << dir << ".";
+}
+
+std::vector<std::string> ListDir(std::string const& dir) {
+  std::vector<std::string> names;
+  DIR* d = opendir(dir.c_str());
+  if (d == NULL)
+    return names;
+  while (struct dirent* entry = readdir(d)) {
+    std::string name = entry->d_name;
+    if (name != "." && name != "..")
+      names.push_back(name);
+  }
+  closedir(d);
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+// Written beside and renamed, so that no one reads it half written
+void WriteFile(std::string const& file, std::string const& contents) {
+  std::string tmp = file + ".tmp";
+  {
+    std::ofstream out(tmp.c_str(), std::ios::binary);
+    out << contents;
+    if (!out.good())
+      LOG(FATAL) << "Could not write " << tmp << ".";
+  }
+  if (std::rename(tmp.c_str(), file.c_str()) != 0)
+    LOG(FATAL) << "Could not rename " << tmp << " to " << file << ".";
+}
+
+void Rename(std::string const& from, std::string const& to) {
+  if (std::rename(from.c_str(), to.c_str()) != 0)
+    LOG(FATAL) << "Could not rename " << from << " to " << to << ".";
+}
+
+void Append(std::string const& file, std::ofstream* out) {
+  std::ifstream in(file.c_str(), std::ios::binary);
+  if (!in.is_open())
+    LOG(FATAL) << "Missing the task result " << file << ".";
+  *out << in.rdbuf();
+}
+
+std::string TaskName(char const* type, size_t index) {
+  char name[64];
+  snprintf(name, sizeof(name), "%s-%06zu", type, index);
+  return name;
+}
+
+// The lines after the first one
+std::vector<std::string> TaskLines(std::istream* in) {
+  std::vector<std::string> lines;
+  std::string line;
+  std::getline(*in, line);
+  while (std::getline(*in, line)) {
+    if (!line.empty())
+      lines.push_back(line);
+  }
+  return lines;
+}
+
+void RunDetectTask(TaskQueue* queue, std::string const& name, std::istream* in) {
+  std::string detector;
+  int min_features, max_features, threshold, retries;
+  *in >> detector >> min_features >> max_features >> threshold >> retries;
+  std::vector<std::string> files = TaskLines(in);
+
+  config_reader::ConfigReader config;
+  config.AddFile("cameras.config");
+  if (!config.ReadFiles())
+    LOG(FATAL) << "Failed to read config files.";
+  camera::CameraParameters cam_params(&config, "nav_cam");
+
+  // the descriptors go back in the map, the coordinator fills the store
+  google::FlagSaver saver;
+  FLAGS_feature_store = "";
+  SparseMap part(files, detector, cam_params);
+  part.SetBriskParams(min_features, max_features, threshold, retries);
+  part.DetectFeatures();
+  std::string result = queue->ResultFile(name, ".map");
+  part.Save(result + ".tmp");
+  Rename(result + ".tmp", result);
+}
+
+// Matches with the given map, or else the one in the task, loaded once
+// for all the tasks of a job
+void RunMatchTask(TaskQueue* queue, std::string const& name, std::istream* in, SparseMap* map) {
+  static std::unique_ptr<SparseMap> loaded;
+  static std::pair<std::string, double> loaded_key;
+  std::string map_file;
+  *in >> map_file;
+  std::vector<std::pair<int, int> > pairs;
+  for (std::string const& line : TaskLines(in)) {
+    std::istringstream pair(line);
+    int i, j;
+    if (pair >> i >> j)
+      pairs.push_back(std::make_pair(i, j));
+  }
+  if (map == NULL) {
+    std::pair<std::string, double> key(map_file, ModTime(map_file));
+    if (!loaded || key != loaded_key) {
+      loaded.reset(new SparseMap(map_file));
+      loaded_key = key;
+    }
+    map = loaded.get();
+  }
+
+  std::string essential = queue->ResultFile(name, ".essential.csv");
+  std::string matches = queue->ResultFile(name, ".matches.txt");
+  MatchFeaturePairs(pairs, essential + ".tmp", matches + ".tmp", map);
+  Rename(essential + ".tmp", essential);
+  Rename(matches + ".tmp", matches);
+}
+
+}  // namespace
+
+TaskQueue::TaskQueue(std::string const& dir) : dir_(dir) {
+  MakeDir(dir_);
+  MakeDir(dir_ + "/tasks");
+  MakeDir(dir_ + "/claimed");
+  MakeDir(dir_ + "/results");
+  // by the time the marker is changed, not when it was, so clocks that
+  // differ between machines do not matter
+  finished_time_ = ModTime(dir_ + "/finished");
+}
+
+void TaskQueue::Clear() {
+  for (char const* sub : {"/tasks/", "/claimed/", "/results/"}) {
+    for (std::string const& name : ListDir(dir_ + sub))
+      unlink((dir_ + sub + name).c_str());
+  }
+  added_.clear();
+}
+
+void TaskQueue::Add(std::string const& name, std::string const& contents) {
+  std::string tmp = dir_ + "/" + name;
+  WriteFile(tmp, contents);
+  Rename(tmp, dir_ + "/tasks/" + name);
+  added_.push_back(name);
+}
+
+bool TaskQueue::Done(std::string const& name) const {
+  return ModTime(dir_ + "/results/" + name + ".done") >= 0;
+}
+
+void TaskQueue::Requeue(double timeout) {
+  for (std::string const& name : ListDir(dir_ + "/claimed")) {
+    std::string claimed = dir_ + "/claimed/" + name;
+    if (Done(name)) {
+      unlink(claimed.c_str());
+      continue;
+    }
+    double time = ModTime(claimed);
+    if (time >= 0 && Now() - time > timeout && std::rename(claimed.c_str(), (dir_ + "/tasks/" + name).c_str()) == 0)
+      LOG(WARNING) << "Task " << name << " took longer than " << timeout << " seconds, putting it back.";
+  }
+}
+
+void TaskQueue::Wait(std::function<void(std::string const& name, std::string const& contents)> const& run,
+                     double timeout) {
+  size_t num_done = 0;
+  while (true) {
+    size_t done = std::count_if(added_.begin(), added_.end(),
+                                [this](std::string const& name) { return Done(name); });
+    if (done != num_done)
+      LOG(INFO) << done << " of " << added_.size() << " tasks done.";
+    num_done = done;
+    if (num_done == added_.size())
+      return;
+    std::string name, contents;
+    if (Claim(&name, &contents)) {
+      run(name, contents);
+      Complete(name);
+      continue;
+    }
+    Requeue(timeout);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+  }
+}
+
+void TaskQueue::Finish() {
+  WriteFile(dir_ + "/finished", "");
+}
+
+bool TaskQueue::Claim(std::string* name, std::string* contents) {
+  for (std::string const& task : ListDir(dir_ + "/tasks")) {
+    std::string claimed = dir_ + "/claimed/" + task;
+    if (std::rename((dir_ + "/tasks/" + task).c_str(), claimed.c_str()) != 0)
+      continue;
+    // the claim starts now, not when the task was added
+    utime(claimed.c_str(), NULL);
+    std::ifstream in(claimed.c_str(), std::ios::binary);
+    std::ostringstream text;
+    text << in.rdbuf();
+    *name = task;
+    *contents = text.str();
+    return true;
+  }
+  return false;
+}
+
+void TaskQueue::Complete(std::string const& name) {
+  WriteFile(dir_ + "/results/" + name + ".done", "");
+  unlink((dir_ + "/claimed/" + name).c_str());
+}
+
+bool TaskQueue::Finished() const {
+  return ModTime(dir_ + "/finished") != finished_time_;
+}
+
+std::string TaskQueue::ResultFile(std::string const& name, std::string const& suffix) const {
+  return dir_ + "/results/" + name + suffix;
+}
+
+void RunTask(TaskQueue* queue, std::string const& name, std::string const& contents) {
+  LOG(INFO) << "Running task " << name << ".";
+  std::istringstream in(contents);
+  std::string type;
+  in >> type;
+  if (type == "detect")
+    RunDetectTask(queue, name, &in);
+  else if (type == "match")
+    RunMatchTask(queue, name, &in, NULL);
+  else
+    LOG(ERROR) << "Unknown task " << type << " in " << name << ".";
+}
+
+void RunWorker(std::string const& dir) {
+  TaskQueue queue(dir);
+  LOG(INFO) << "Waiting for tasks in " << dir << ".";
+  while (!queue.Finished()) {
+    std::string name, contents;
+    if (!queue.Claim(&name, &contents)) {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+      continue;
+    }
+    RunTask(&queue, name, contents);
+    queue.Complete(name);
+  }
+  LOG(INFO) << "The coordinator finished.";
+}
+
+void DistributedDetect(TaskQueue* queue, int images_per_task, int min_features, int max_features,
+                       int threshold, int retries, double timeout, SparseMap* map) {
+  size_t num_images = map->cid_to_filename_.size();
+  size_t per_task = std::max(images_per_task, 1);
+  queue->Clear();
+  for (size_t begin = 0; begin < num_images; begin += per_task) {
+    std::ostringstream task;
+    task << "detect " << map->detector_.GetDetectorName() << " " << min_features << " " << max_features << " "
+         << threshold << " " << retries << "\n";
+    for (size_t cid = begin; cid < std::min(begin + per_task, num_images); cid++)
+      task << map->cid_to_filename_[cid] << "\n";
+    queue->Add(TaskName("detect", begin / per_task), task.str());
+  }
+  queue->Wait(std::bind(RunTask, queue, std::placeholders::_1, std::placeholders::_2), timeout);
+
+  std::vector<Eigen::Matrix2Xd> keypoints(num_images);
+  std::vector<cv::Mat> descriptors(num_images);
+  for (size_t begin = 0; begin < num_images; begin += per_task) {
+    SparseMap part(queue->ResultFile(TaskName("detect", begin / per_task), ".map"));
+    size_t count = std::min(begin + per_task, num_images) - begin;
+    CHECK(part.GetNumFrames() == count) << "A detection task has " << part.GetNumFrames()
+                                          << " images instead of " << count << ".";
+    for (size_t i = 0; i < count; i++) {
+      keypoints[begin + i] = part.cid_to_keypoint_map_[i];
+      descriptors[begin + i] = part.GetFrameDescriptors(i).clone();
+    }
+  }
+  map->SetFeatures(keypoints, descriptors);
+}
+
+void DistributedMatch(TaskQueue* queue, int pairs_per_task, double timeout,
+                      std::string const& essential_file, std::string const& matches_file,
+                      SparseMap* map) {
+  std::vector<std::pair<int, int> > pairs;
+  SelectMatchPairs(map, &pairs);
+  size_t per_task = std::max(pairs_per_task, 1);
+  queue->Clear();
+
+  // the workers match against the map as it is now
+  std::string map_file = queue->Dir() + "/match.map";
+  map->Save(map_file);
+  size_t num_tasks = 0;
+  for (size_t begin = 0; begin < pairs.size(); begin += per_task) {
+    std::ostringstream task;
+    task << "match " << map_file << "\n";
+    for (size_t k = begin; k < std::min(begin + per_task, pairs.size()); k++)
+      task << pairs[k].first << " " << pairs[k].second << "\n";
+    queue->Add(TaskName("match", num_tasks++), task.str());
+  }
+  LOG(INFO) << "Matching " << pairs.size() << " image pairs in " << num_tasks << " tasks.";
+  queue->Wait([queue, map](std::string const& name, std::string const& contents) {
+      std::istringstream in(contents);
+      std::string type;
+      in >> type;
+      RunMatchTask(queue, name, &in, map);
+    }, timeout);
+
+  // the pieces of both files concatenate into the whole
+  {
+    std::ofstream essential(essential_file.c_str(), std::ios::binary);
+    std::ofstream matches(matches_file.c_str(), std::ios::binary);
+    for (size_t t = 0; t < num_tasks; t++) {
+      Append(queue->ResultFile(TaskName("match", t), ".essential.csv"), &essential);
+      Append(queue->ResultFile(TaskName("match", t), ".matches.txt"), &matches);
+    }
+  }
+  CIDPairAffineMap relative_affines;
+  ReadAffineCSV(essential_file, &relative_affines);
+  InitializeCamerasFromAffines(relative_affines, map);
+}
+
+}  // namespace sparse_mapping
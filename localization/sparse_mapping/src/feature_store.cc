@@ -0,0 +1,238 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/feature_store.h>
+#include <sparse_mapping/flat_map.h>
+
+#include <glog/logging.h>
+#include <zlib.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+namespace sparse_mapping {
+
+namespace {
+
+void WriteAt(int fd, const void* data, size_t size, uint64_t offset, std::string const& filename) {
+  const char* ptr = reinterpret_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t written = pwrite(fd, ptr, size, offset);
+    if (written <= 0)
+      LOG(FATAL) << "Failed to write feature store: " << filename;
+    ptr += written;
+    size -= written;
+    offset += written;
+  }
+}
+
+std::string TempName(std::string const& filename) {
+  return filename + ".tmp";
+}
+
+}  // namespace
+
+FeatureStore::FeatureStore() : fd_(-1), write_offset_(0), cache_size_(0), cache_bytes_(0) {
+  memset(&header_, 0, sizeof(header_));
+}
+
+FeatureStore::~FeatureStore() {
+  if (fd_ >= 0) {
+    // Never finished, do not leave a partial store behind
+    close(fd_);
+    unlink(TempName(filename_).c_str());
+  }
+}
+
+void FeatureStore::Create(std::string const& filename, int num_frames) {
+  CHECK(fd_ < 0 && !IsOpen()) << "The feature store is already in use.";
+  filename_ = filename;
+  fd_ = open(TempName(filename_).c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+             S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd_ < 0)
+    LOG(FATAL) << "Failed to open feature store for writing: " << TempName(filename_);
+
+  memset(&header_, 0, sizeof(header_));
+  memcpy(header_.magic, kFeatureStoreMagic, sizeof(header_.magic));
+  header_.version = kFeatureStoreVersion;
+  header_.num_frames = num_frames;
+  header_.descriptor_type = -1;
+  index_.assign(num_frames, FeatureStoreEntry());
+  write_offset_ = sizeof(header_);
+}
+
+void FeatureStore::Write(int cid, Eigen::Matrix2Xd const& keypoints, cv::Mat const& descriptors) {
+  CHECK(fd_ >= 0) << "The feature store is not open for writing.";
+  CHECK(cid >= 0 && cid < static_cast<int>(header_.num_frames)) << "Invalid image index " << cid << ".";
+  CHECK(keypoints.cols() == descriptors.rows)
+    << "Image " << cid << " has " << keypoints.cols() << " keypoints but " << descriptors.rows << " descriptors.";
+
+  // Compress without holding the lock, this is the slow part
+  size_t row_size = descriptors.rows > 0 ? descriptors.cols * descriptors.elemSize() : 0;
+  size_t keypoint_size = 2 * sizeof(double) * keypoints.cols();
+  std::vector<uint8_t> raw(keypoint_size + row_size * descriptors.rows);
+  if (keypoint_size > 0)
+    memcpy(raw.data(), keypoints.data(), keypoint_size);
+  for (int row = 0; row < descriptors.rows; row++)
+    memcpy(raw.data() + keypoint_size + row * row_size, descriptors.ptr<uint8_t>(row), row_size);
+
+  uLongf compressed_size = compressBound(raw.size());
+  std::vector<uint8_t> compressed(compressed_size);
+  if (compress2(compressed.data(), &compressed_size, raw.data(), raw.size(), Z_BEST_SPEED) != Z_OK)
+    LOG(FATAL) << "Failed to compress the features of image " << cid << ".";
+
+  uint64_t offset;
+  {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    if (descriptors.rows > 0) {
+      if (header_.descriptor_type < 0) {
+        header_.descriptor_type = descriptors.type();
+        header_.descriptor_cols = descriptors.cols;
+      }
+      CHECK(header_.descriptor_type == descriptors.type() &&
+            header_.descriptor_cols == static_cast<uint32_t>(descriptors.cols))
+        << "All images in a feature store must have descriptors of the same type and size.";
+    }
+    CHECK(index_[cid].compressed_size == 0) << "Image " << cid << " was written twice.";
+    offset = write_offset_;
+    write_offset_ += compressed_size;
+    index_[cid].offset = offset;
+    index_[cid].compressed_size = compressed_size;
+    index_[cid].num_features = keypoints.cols();
+  }
+
+  // Each chunk has its own range of the file, so writes can overlap
+  WriteAt(fd_, compressed.data(), compressed_size, offset, filename_);
+}
+
+void FeatureStore::Finish() {
+  CHECK(fd_ >= 0) << "The feature store is not open for writing.";
+  header_.index_offset = write_offset_;
+  WriteAt(fd_, index_.data(), index_.size() * sizeof(FeatureStoreEntry), write_offset_, filename_);
+  WriteAt(fd_, &header_, sizeof(header_), 0, filename_);
+  if (close(fd_) != 0)
+    LOG(FATAL) << "Failed to write feature store: " << filename_;
+  fd_ = -1;
+
+  // A store of the same name which is mapped elsewhere keeps its data
+  if (rename(TempName(filename_).c_str(), filename_.c_str()) != 0)
+    LOG(FATAL) << "Failed to rename " << TempName(filename_) << " to " << filename_ << ".";
+  LOG(INFO) << "Wrote feature store: " << filename_;
+}
+
+void FeatureStore::Open(std::string const& filename, size_t cache_size) {
+  CHECK(fd_ < 0) << "The feature store is open for writing.";
+  filename_ = filename;
+  cache_size_ = cache_size;
+  cache_bytes_ = 0;
+  cache_.clear();
+  lru_.clear();
+
+  file_ = std::make_shared<MappedFile>(filename);
+  if (!file_->IsValid() || file_->Size() < sizeof(header_))
+    LOG(FATAL) << "Failed to read feature store: " << filename;
+  memcpy(&header_, file_->Data(), sizeof(header_));
+  if (memcmp(header_.magic, kFeatureStoreMagic, sizeof(header_.magic)) != 0)
+    LOG(FATAL) << "Not a feature store: " << filename;
+  if (header_.version != kFeatureStoreVersion)
+    LOG(FATAL) << "Unsupported feature store version " << header_.version << " in " << filename;
+
+  uint64_t index_size = header_.num_frames * sizeof(FeatureStoreEntry);
+  if (header_.index_offset + index_size > file_->Size())
+    LOG(FATAL) << "Corrupt feature store, the index is out of bounds: " << filename;
+  index_.resize(header_.num_frames);
+  memcpy(index_.data(), file_->Data() + header_.index_offset, index_size);
+  for (FeatureStoreEntry const& entry : index_) {
+    if (entry.offset + entry.compressed_size > header_.index_offset)
+      LOG(FATAL) << "Corrupt feature store, a chunk is out of bounds: " << filename;
+  }
+}
+
+void FeatureStore::ReadChunk(int cid, Eigen::Matrix2Xd * keypoints, cv::Mat * descriptors) const {
+  CHECK(IsOpen()) << "The feature store is not open for reading.";
+  CHECK(cid >= 0 && cid < static_cast<int>(header_.num_frames)) << "Invalid image index " << cid << ".";
+  FeatureStoreEntry const& entry = index_[cid];
+
+  int num_features = entry.num_features;
+  size_t row_size = num_features > 0 ? header_.descriptor_cols * CV_ELEM_SIZE(header_.descriptor_type) : 0;
+  size_t keypoint_size = 2 * sizeof(double) * num_features;
+  std::vector<uint8_t> raw(keypoint_size + row_size * num_features);
+  if (!raw.empty()) {
+    uLongf raw_size = raw.size();
+    if (uncompress(raw.data(), &raw_size, file_->Data() + entry.offset, entry.compressed_size) != Z_OK ||
+        raw_size != raw.size())
+      LOG(FATAL) << "Corrupt feature store, cannot decompress image " << cid << ": " << filename_;
+  }
+
+  if (keypoints) {
+    keypoints->resize(Eigen::NoChange, num_features);
+    if (keypoint_size > 0)
+      memcpy(keypoints->data(), raw.data(), keypoint_size);
+  }
+  if (descriptors) {
+    if (header_.descriptor_type < 0) {
+      descriptors->release();
+      return;
+    }
+    descriptors->create(num_features, header_.descriptor_cols, header_.descriptor_type);
+    for (int row = 0; row < num_features; row++)
+      memcpy(descriptors->ptr<uint8_t>(row), raw.data() + keypoint_size + row * row_size, row_size);
+  }
+}
+
+cv::Mat FeatureStore::Descriptors(int cid) const {
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    auto it = cache_.find(cid);
+    if (it != cache_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second.second);
+      return it->second.first;
+    }
+  }
+
+  // Decompress without holding the lock, other threads may need
+  // other images meanwhile
+  cv::Mat descriptors;
+  ReadChunk(cid, NULL, &descriptors);
+
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  if (cache_.find(cid) == cache_.end()) {
+    lru_.push_front(cid);
+    cache_[cid] = std::make_pair(descriptors, lru_.begin());
+    cache_bytes_ += descriptors.total() * descriptors.elemSize();
+    // Always keep the newest entry, even if it alone is over the limit
+    while (cache_bytes_ > cache_size_ && lru_.size() > 1) {
+      auto last = cache_.find(lru_.back());
+      cache_bytes_ -= last->second.first.total() * last->second.first.elemSize();
+      cache_.erase(last);
+      lru_.pop_back();
+    }
+  }
+  return descriptors;
+}
+
+void FeatureStore::Keypoints(int cid, Eigen::Matrix2Xd * keypoints) const {
+  ReadChunk(cid, keypoints, NULL);
+}
+
+}  // namespace sparse_mapping
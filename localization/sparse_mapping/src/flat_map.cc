@@ -0,0 +1,396 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/flat_map.h>
+#include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/vocab_tree.h>
+
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <opencv2/core/core.hpp>
+#include <glog/logging.h>
+
+#include <sparse_map.pb.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sparse_mapping {
+
+MappedFile::MappedFile(std::string const& filename) : data_(NULL), size_(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    // Private and writable, so that writes are copy on write and
+    // never reach the file. Untouched pages stay shared with the
+    // page cache.
+    void* ptr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (ptr != MAP_FAILED) {
+      data_ = reinterpret_cast<uint8_t*>(ptr);
+      size_ = st.st_size;
+    }
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_)
+    munmap(data_, size_);
+}
+
+bool IsFlatMapFile(std::string const& filename) {
+  char magic[sizeof(kFlatMapMagic)];
+  std::ifstream f(filename.c_str(), std::ios::binary);
+  if (!f.read(magic, sizeof(magic)))
+    return false;
+  return memcmp(magic, kFlatMapMagic, sizeof(magic)) == 0;
+}
+
+namespace {
+
+// Sections start at multiples of 8 bytes so that doubles and 64 bit
+// integers can be read in place.
+uint64_t Align(uint64_t offset) {
+  return (offset + 7) & ~static_cast<uint64_t>(7);
+}
+
+void WritePadding(std::ofstream * out, uint64_t from, uint64_t to) {
+  static const char zeros[8] = {0};
+  if (to > from)
+    out->write(zeros, to - from);
+}
+
+template <typename T>
+const T* SectionPtr(MappedFile const& file, FlatMapHeader const& header,
+                    FlatMapSection section, uint64_t count) {
+  FlatMapSectionEntry const& entry = header.sections[section];
+  if (entry.size < count * sizeof(T) || entry.offset + entry.size > file.Size())
+    LOG(FATAL) << "Corrupt flat map, section " << section << " is out of bounds.";
+  return reinterpret_cast<const T*>(file.Data() + entry.offset);
+}
+
+}  // namespace
+
+void SparseMap::SaveFlat(const std::string & flat_file) const {
+  if (feature_store_)
+    LOG(FATAL) << "A flat map needs the descriptors in memory, do not use a feature store.";
+  if (descriptors_are_codes_)
+    LOG(FATAL) << "A flat map stores the descriptors in full, load the map without localization mode.";
+  uint32_t num_frames = cid_to_filename_.size();
+  CHECK(num_frames == cid_to_keypoint_map_.size())
+    << "Number of CIDs in filenames and keypoint map do not match";
+  CHECK(num_frames == cid_to_descriptor_map_.size())
+    << "Number of CIDs in filenames and descriptor map do not match";
+  CHECK(pid_to_cid_fid_.size() == pid_to_xyz_.size())
+    << "Number of landmarks and tracks do not match";
+
+  FlatMapHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kFlatMapMagic, sizeof(header.magic));
+  header.version = kFlatMapVersion;
+  header.num_frames = num_frames;
+  header.num_landmarks = pid_to_xyz_.size();
+
+  // All descriptors must share a type and length to be stored as one blob
+  header.descriptor_depth = cid_to_descriptor_map_.empty() ? 0 : cid_to_descriptor_map_[0].depth();
+  size_t row_bytes = 0;
+  for (cv::Mat const& d : cid_to_descriptor_map_) {
+    header.num_features += d.rows;
+    if (d.rows == 0)
+      continue;
+    if (row_bytes == 0) {
+      header.descriptor_cols = d.cols;
+      row_bytes = d.cols * d.elemSize();
+    }
+    CHECK(static_cast<uint32_t>(d.cols) == header.descriptor_cols && d.depth() == header.descriptor_depth)
+      << "Descriptors of all frames must have the same type and length";
+  }
+  for (size_t cid = 0; cid < num_frames; cid++)
+    CHECK(cid_to_keypoint_map_[cid].cols() == cid_to_descriptor_map_[cid].rows)
+      << "Number of keypoints and descriptors do not match for frame " << cid;
+  for (std::map<int, int> const& track : pid_to_cid_fid_)
+    header.num_observations += track.size();
+
+  header.focal_length[0] = camera_params_.GetFocalVector()[0];
+  header.focal_length[1] = camera_params_.GetFocalVector()[1];
+  header.optical_offset[0] = camera_params_.GetOpticalOffset()[0];
+  header.optical_offset[1] = camera_params_.GetOpticalOffset()[1];
+  header.distorted_size[0] = camera_params_.GetDistortedSize()[0];
+  header.distorted_size[1] = camera_params_.GetDistortedSize()[1];
+  header.undistorted_size[0] = camera_params_.GetUndistortedSize()[0];
+  header.undistorted_size[1] = camera_params_.GetUndistortedSize()[1];
+  header.has_poses = (cid_to_cam_t_global_.size() == num_frames);
+  std::string detector_name = detector_.GetDetectorName();
+  CHECK(detector_name.size() < sizeof(header.detector_name)) << "Detector name is too long";
+  strncpy(header.detector_name, detector_name.c_str(), sizeof(header.detector_name) - 1);
+
+  // The vocabulary database is small, serialize it up front
+  std::string vocab_db;
+  header.vocab_db_type = -1;
+  if (vocab_db_.binary_db != NULL) {
+    header.vocab_db_type = sparse_mapping_protobuf::Map::BINARYDB;
+    google::protobuf::io::StringOutputStream* output =
+      new google::protobuf::io::StringOutputStream(&vocab_db);
+    vocab_db_.SaveProtobuf(output);
+    delete output;  // flushes into vocab_db
+  }
+
+  std::string filenames;
+  for (std::string const& name : cid_to_filename_) {
+    filenames += name;
+    filenames.push_back('\0');
+  }
+
+  // Lay out the sections
+  uint64_t sizes[FLAT_NUM_SECTIONS];
+  sizes[FLAT_FILENAMES] = filenames.size();
+  sizes[FLAT_FEATURE_OFFSETS] = (num_frames + 1) * sizeof(uint64_t);
+  sizes[FLAT_DESCRIPTORS] = header.num_features * row_bytes;
+  sizes[FLAT_KEYPOINTS] = header.num_features * 2 * sizeof(double);
+  sizes[FLAT_POSES] = header.has_poses ? num_frames * 12 * sizeof(double) : 0;
+  sizes[FLAT_LANDMARKS] = header.num_landmarks * 3 * sizeof(double);
+  sizes[FLAT_TRACK_OFFSETS] = (header.num_landmarks + 1) * sizeof(uint64_t);
+  sizes[FLAT_TRACKS] = header.num_observations * 2 * sizeof(uint32_t);
+  sizes[FLAT_DISTORTION] = camera_params_.GetDistortion().size() * sizeof(double);
+  sizes[FLAT_VOCAB_DB] = vocab_db.size();
+  uint64_t offset = Align(sizeof(header));
+  for (int s = 0; s < FLAT_NUM_SECTIONS; s++) {
+    header.sections[s].offset = offset;
+    header.sections[s].size = sizes[s];
+    offset = Align(offset + sizes[s]);
+  }
+
+  LOG(INFO) << "Writing: " << flat_file;
+  std::ofstream out(flat_file.c_str(), std::ios::binary | std::ios::trunc);
+  if (!out)
+    LOG(FATAL) << "Failed to open flat map for writing: " << flat_file;
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  uint64_t pos = sizeof(header);
+
+  // Write the sections in order, each padded to its aligned offset
+  for (int s = 0; s < FLAT_NUM_SECTIONS; s++) {
+    WritePadding(&out, pos, header.sections[s].offset);
+    pos = header.sections[s].offset;
+    switch (s) {
+    case FLAT_FILENAMES:
+      out.write(filenames.data(), filenames.size());
+      break;
+    case FLAT_FEATURE_OFFSETS: {
+      uint64_t first = 0;
+      for (size_t cid = 0; cid <= num_frames; cid++) {
+        out.write(reinterpret_cast<const char*>(&first), sizeof(first));
+        if (cid < num_frames)
+          first += cid_to_descriptor_map_[cid].rows;
+      }
+      break;
+    }
+    case FLAT_DESCRIPTORS:
+      for (cv::Mat const& d : cid_to_descriptor_map_)
+        for (int r = 0; r < d.rows; r++)
+          out.write(reinterpret_cast<const char*>(d.ptr<uint8_t>(r)), row_bytes);
+      break;
+    case FLAT_KEYPOINTS:
+      for (Eigen::Matrix2Xd const& k : cid_to_keypoint_map_)
+        out.write(reinterpret_cast<const char*>(k.data()), k.size() * sizeof(double));
+      break;
+    case FLAT_POSES:
+      if (header.has_poses) {
+        for (Eigen::Affine3d const& pose : cid_to_cam_t_global_) {
+          Eigen::Matrix4d c = pose.matrix();
+          for (int row = 0; row < 3; row++)
+            for (int col = 0; col < 4; col++)
+              out.write(reinterpret_cast<const char*>(&c(row, col)), sizeof(double));
+        }
+      }
+      break;
+    case FLAT_LANDMARKS:
+      for (Eigen::Vector3d const& xyz : pid_to_xyz_)
+        out.write(reinterpret_cast<const char*>(xyz.data()), 3 * sizeof(double));
+      break;
+    case FLAT_TRACK_OFFSETS: {
+      uint64_t first = 0;
+      for (size_t pid = 0; pid <= pid_to_cid_fid_.size(); pid++) {
+        out.write(reinterpret_cast<const char*>(&first), sizeof(first));
+        if (pid < pid_to_cid_fid_.size())
+          first += pid_to_cid_fid_[pid].size();
+      }
+      break;
+    }
+    case FLAT_TRACKS:
+      for (std::map<int, int> const& track : pid_to_cid_fid_) {
+        for (std::pair<int, int> const& cid_fid : track) {
+          uint32_t pair[2] = {static_cast<uint32_t>(cid_fid.first), static_cast<uint32_t>(cid_fid.second)};
+          out.write(reinterpret_cast<const char*>(pair), sizeof(pair));
+        }
+      }
+      break;
+    case FLAT_DISTORTION:
+      for (int i = 0; i < camera_params_.GetDistortion().size(); i++) {
+        double value = camera_params_.GetDistortion()[i];
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+      }
+      break;
+    case FLAT_VOCAB_DB:
+      out.write(vocab_db.data(), vocab_db.size());
+      break;
+    }
+    pos += header.sections[s].size;
+  }
+  if (!out)
+    LOG(FATAL) << "Failed to write flat map: " << flat_file;
+}
+
+void SparseMap::LoadFlat(const std::string & flat_file, bool localization) {
+  std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(flat_file);
+  if (!file->IsValid())
+    LOG(FATAL) << "Failed to map file: " << flat_file;
+  if (file->Size() < sizeof(FlatMapHeader))
+    LOG(FATAL) << "Flat map is truncated: " << flat_file;
+  FlatMapHeader const& header = *reinterpret_cast<const FlatMapHeader*>(file->Data());
+  if (memcmp(header.magic, kFlatMapMagic, sizeof(header.magic)) != 0)
+    LOG(FATAL) << "Not a flat map: " << flat_file;
+  if (header.version != kFlatMapVersion)
+    LOG(FATAL) << "Unsupported flat map version " << header.version;
+
+  std::string detector_name(header.detector_name,
+                            strnlen(header.detector_name, sizeof(header.detector_name)));
+  detector_.Reset(detector_name);
+
+  typedef Eigen::Vector2d V2d;
+  typedef Eigen::Vector2i V2i;
+  camera_params_.SetFocalLength(V2d(header.focal_length[0], header.focal_length[1]));
+  camera_params_.SetOpticalOffset(V2d(header.optical_offset[0], header.optical_offset[1]));
+  camera_params_.SetDistortedSize(V2i(header.distorted_size[0], header.distorted_size[1]));
+  camera_params_.SetUndistortedSize(V2i(header.undistorted_size[0], header.undistorted_size[1]));
+  size_t num_distortion = header.sections[FLAT_DISTORTION].size / sizeof(double);
+  const double* distortion_ptr = SectionPtr<double>(*file, header, FLAT_DISTORTION, num_distortion);
+  Eigen::VectorXd distortion(num_distortion);
+  for (size_t i = 0; i < num_distortion; i++)
+    distortion[i] = distortion_ptr[i];
+  camera_params_.SetDistortion(distortion);
+
+  uint32_t num_frames = header.num_frames;
+  uint64_t num_landmarks = header.num_landmarks;
+
+  // Frame names
+  cid_to_filename_.resize(num_frames);
+  const char* names = SectionPtr<char>(*file, header, FLAT_FILENAMES, 0);
+  const char* names_end = names + header.sections[FLAT_FILENAMES].size;
+  for (uint32_t cid = 0; cid < num_frames; cid++) {
+    const char* end = reinterpret_cast<const char*>(memchr(names, '\0', names_end - names));
+    if (end == NULL)
+      LOG(FATAL) << "Corrupt flat map, bad frame names.";
+    cid_to_filename_[cid] = std::string(names, end);
+    names = end + 1;
+  }
+
+  // Descriptors point straight into the mapping, no copy
+  const uint64_t* feature_offsets =
+    SectionPtr<uint64_t>(*file, header, FLAT_FEATURE_OFFSETS, num_frames + 1);
+  if (feature_offsets[num_frames] != header.num_features)
+    LOG(FATAL) << "Corrupt flat map, bad feature offsets.";
+  size_t row_bytes = header.descriptor_cols * CV_ELEM_SIZE(header.descriptor_depth);
+  const uint8_t* descriptors =
+    SectionPtr<uint8_t>(*file, header, FLAT_DESCRIPTORS, header.num_features * row_bytes);
+  cid_to_descriptor_map_.resize(num_frames);
+  for (uint32_t cid = 0; cid < num_frames; cid++) {
+    int rows = feature_offsets[cid + 1] - feature_offsets[cid];
+    if (rows > 0)
+      cid_to_descriptor_map_[cid] =
+        cv::Mat(rows, header.descriptor_cols, header.descriptor_depth,
+                const_cast<uint8_t*>(descriptors + feature_offsets[cid] * row_bytes));
+    else
+      cid_to_descriptor_map_[cid].create(0, 0, header.descriptor_depth);
+  }
+
+  if (!localization) {
+    const double* keypoints =
+      SectionPtr<double>(*file, header, FLAT_KEYPOINTS, 2 * header.num_features);
+    cid_to_keypoint_map_.resize(num_frames);
+    for (uint32_t cid = 0; cid < num_frames; cid++) {
+      int cols = feature_offsets[cid + 1] - feature_offsets[cid];
+      cid_to_keypoint_map_[cid] =
+        Eigen::Map<const Eigen::Matrix2Xd>(keypoints + 2 * feature_offsets[cid], 2, cols);
+    }
+
+    cid_to_cam_t_global_.resize(num_frames);
+    if (header.has_poses) {
+      const double* poses = SectionPtr<double>(*file, header, FLAT_POSES, 12 * num_frames);
+      for (uint32_t cid = 0; cid < num_frames; cid++) {
+        const double* p = poses + 12 * cid;
+        cid_to_cam_t_global_[cid].linear() <<
+          p[0], p[1], p[2],
+          p[4], p[5], p[6],
+          p[8], p[9], p[10];
+        cid_to_cam_t_global_[cid].translation() << p[3], p[7], p[11];
+      }
+    }
+  }
+
+  // Landmarks and tracks
+  const double* xyz = SectionPtr<double>(*file, header, FLAT_LANDMARKS, 3 * num_landmarks);
+  pid_to_xyz_.resize(num_landmarks);
+  for (uint64_t pid = 0; pid < num_landmarks; pid++)
+    pid_to_xyz_[pid] = Eigen::Vector3d(xyz[3 * pid], xyz[3 * pid + 1], xyz[3 * pid + 2]);
+
+  const uint64_t* track_offsets =
+    SectionPtr<uint64_t>(*file, header, FLAT_TRACK_OFFSETS, num_landmarks + 1);
+  const uint32_t* tracks =
+    SectionPtr<uint32_t>(*file, header, FLAT_TRACKS, 2 * header.num_observations);
+  if (track_offsets[num_landmarks] != header.num_observations)
+    LOG(FATAL) << "Corrupt flat map, bad track offsets.";
+  if (!localization) {
+    pid_to_cid_fid_.clear();
+    pid_to_cid_fid_.resize(num_landmarks);
+    for (uint64_t pid = 0; pid < num_landmarks; pid++)
+      for (uint64_t k = track_offsets[pid]; k < track_offsets[pid + 1]; k++)
+        pid_to_cid_fid_[pid][tracks[2 * k]] = tracks[2 * k + 1];
+    InitializeCidFidToPid();
+  } else {
+    // The tracks are already in CSR form, build the table straight from them
+    tracks_.Build(num_frames, num_landmarks, track_offsets, tracks);
+  }
+  if (num_landmarks == 0)
+    LOG(WARNING) << "There appear to be no landmarks in map file.";
+
+  // The database is parsed from memory, there is no file reading
+  ResetDB(&vocab_db_);
+  if (header.vocab_db_type >= 0) {
+    FlatMapSectionEntry const& entry = header.sections[FLAT_VOCAB_DB];
+    const uint8_t* db = SectionPtr<uint8_t>(*file, header, FLAT_VOCAB_DB, entry.size);
+    google::protobuf::io::ArrayInputStream* input =
+      new google::protobuf::io::ArrayInputStream(db, entry.size);
+    vocab_db_.LoadProtobuf(input, header.vocab_db_type);
+    delete input;
+  }
+
+  // Keep the mapping alive for as long as the descriptors use it
+  mapped_file_ = file;
+}
+
+}  // namespace sparse_mapping
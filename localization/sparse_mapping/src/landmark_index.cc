@@ -0,0 +1,269 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/landmark_index.h>
+#include <sparse_mapping/sparse_map.h>
+
+#include <interest_point/hamming.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace sparse_mapping {
+
+namespace {
+
+int Distance(cv::Mat const& a, int row_a, cv::Mat const& b, int row_b) {
+  return interest_point::HammingDistance(a.ptr<uint8_t>(row_a), b.ptr<uint8_t>(row_b), a.cols);
+}
+
+// The rows of descriptors [begin, end) to keep, at most max_keep: the
+// medoid, then each time the one farthest from those kept
+void SelectDescriptors(cv::Mat const& descriptors, int begin, int end, int max_keep, std::vector<int>* keep) {
+  keep->clear();
+  int n = end - begin;
+  if (n <= max_keep) {
+    for (int i = begin; i < end; i++)
+      keep->push_back(i);
+    return;
+  }
+  std::vector<int> dist(n * n, 0);
+  for (int i = 0; i < n; i++)
+    for (int j = i + 1; j < n; j++)
+      dist[i * n + j] = dist[j * n + i] = Distance(descriptors, begin + i, descriptors, begin + j);
+  int medoid = 0, best_sum = std::numeric_limits<int>::max();
+  for (int i = 0; i < n; i++) {
+    int sum = 0;
+    for (int j = 0; j < n; j++)
+      sum += dist[i * n + j];
+    if (sum < best_sum) {
+      best_sum = sum;
+      medoid = i;
+    }
+  }
+  std::vector<int> nearest(dist.begin() + medoid * n, dist.begin() + (medoid + 1) * n);
+  keep->push_back(begin + medoid);
+  while (static_cast<int>(keep->size()) < max_keep) {
+    int far = std::max_element(nearest.begin(), nearest.end()) - nearest.begin();
+    if (nearest[far] == 0)
+      break;  // the rest are copies of those kept
+    keep->push_back(begin + far);
+    for (int j = 0; j < n; j++)
+      nearest[j] = std::min(nearest[j], dist[far * n + j]);
+  }
+}
+
+}  // namespace
+
+void LandmarkIndex::Build(SparseMap const& map, Quantizer const& quantizer, Options const& options) {
+  options_ = options;
+  TrackTable const& tracks = map.GetTracks();
+  int num_pid = tracks.NumLandmarks();
+  int num_cid = tracks.NumFrames();
+
+  // Gather the descriptors of each landmark's observations, reading the
+  // descriptors of each image once
+  std::vector<int> obs_begin(num_pid + 1, 0);
+  for (int pid = 0; pid < num_pid; pid++)
+    obs_begin[pid + 1] = obs_begin[pid] + tracks.TrackSize(pid);
+  cv::Mat observed;
+  std::vector<int> next(obs_begin.begin(), obs_begin.end() - 1);
+  for (int cid = 0; cid < num_cid; cid++) {
+    cv::Mat frame = map.GetFrameDescriptors(cid);
+    if (frame.empty())
+      continue;
+    CHECK(frame.depth() == CV_8U) << "Only binary descriptors can be indexed by landmark.";
+    if (observed.empty())
+      observed.create(obs_begin[num_pid], frame.cols, CV_8U);
+    int num_fid = map.GetFrameKeypoints(cid).cols();
+    for (int fid = 0; fid < num_fid && fid < frame.rows; fid++) {
+      int pid = tracks.Pid(cid, fid);
+      if (pid >= 0)
+        frame.row(fid).copyTo(observed.row(next[pid]++));
+    }
+  }
+
+  desc_pid_.clear();
+  pid_begin_.assign(num_pid + 1, 0);
+  std::vector<int> rows, keep;
+  for (int pid = 0; pid < num_pid; pid++) {
+    SelectDescriptors(observed, obs_begin[pid], next[pid], options.max_descriptors, &keep);
+    rows.insert(rows.end(), keep.begin(), keep.end());
+    desc_pid_.insert(desc_pid_.end(), keep.size(), pid);
+    pid_begin_[pid + 1] = rows.size();
+  }
+  descriptors_.release();
+  if (rows.empty()) {
+    words_.clear();
+    word_begin_.clear();
+    word_desc_.clear();
+    return;
+  }
+  descriptors_.create(rows.size(), observed.cols, CV_8U);
+  for (size_t i = 0; i < rows.size(); i++)
+    observed.row(rows[i]).copyTo(descriptors_.row(i));
+  observed.release();
+
+  quantizer(descriptors_, &desc_word_);
+  CHECK_EQ(desc_word_.size(), desc_pid_.size());
+
+  // The inverted file
+  word_desc_.resize(desc_word_.size());
+  for (size_t i = 0; i < word_desc_.size(); i++)
+    word_desc_[i] = i;
+  std::stable_sort(word_desc_.begin(), word_desc_.end(),
+                   [this](int a, int b) {return desc_word_[a] < desc_word_[b];});
+  words_.clear();
+  word_begin_.clear();
+  for (size_t i = 0; i < word_desc_.size(); i++) {
+    int word = desc_word_[word_desc_[i]];
+    if (word < 0)
+      continue;
+    if (words_.empty() || words_.back() != word) {
+      words_.push_back(word);
+      word_begin_.push_back(i);
+    }
+  }
+  word_begin_.push_back(word_desc_.size());
+  LOG(INFO) << "Indexed " << num_pid << " landmarks with " << desc_pid_.size()
+            << " descriptors in " << words_.size() << " words.";
+}
+
+std::pair<int, int> LandmarkIndex::WordRange(int word) const {
+  std::vector<int>::const_iterator it = std::lower_bound(words_.begin(), words_.end(), word);
+  if (it == words_.end() || *it != word)
+    return std::make_pair(0, 0);
+  size_t w = it - words_.begin();
+  return std::make_pair(word_begin_[w], word_begin_[w + 1]);
+}
+
+void LandmarkIndex::FindMatches(SparseMap const& map, cv::Mat const& descriptors, std::vector<int> const& words,
+                                std::vector<Match>* matches, int* num_active, int* num_cameras) const {
+  matches->clear();
+  if (num_active)
+    *num_active = 0;
+  if (num_cameras)
+    *num_cameras = 0;
+  if (Empty() || descriptors.empty())
+    return;
+  CHECK(descriptors.depth() == CV_8U && descriptors.cols == descriptors_.cols)
+    << "The descriptors do not match those of the landmark index.";
+  int num_pid = pid_begin_.size() - 1;
+
+  // Image features to landmarks. A landmark matched by several features
+  // keeps the nearest.
+  std::vector<Match> best(num_pid, Match{-1, -1, std::numeric_limits<int>::max()});
+  for (int i = 0; i < descriptors.rows; i++) {
+    std::pair<int, int> range = WordRange(words[i]);
+    int best_pid = -1, best_dist = std::numeric_limits<int>::max(), second = std::numeric_limits<int>::max();
+    for (int k = range.first; k < range.second; k++) {
+      int d = word_desc_[k];
+      int dist = Distance(descriptors, i, descriptors_, d);
+      if (dist < best_dist) {
+        if (desc_pid_[d] != best_pid)
+          second = best_dist;
+        best_dist = dist;
+        best_pid = desc_pid_[d];
+      } else if (dist < second && desc_pid_[d] != best_pid) {
+        second = dist;
+      }
+    }
+    if (best_pid < 0 || best_dist > options_.max_distance || best_dist >= options_.ratio * second)
+      continue;
+    if (best_dist < best[best_pid].distance)
+      best[best_pid] = Match{i, best_pid, best_dist};
+  }
+  std::vector<bool> query_used(descriptors.rows, false), pid_done(num_pid, false);
+  for (int pid = 0; pid < num_pid; pid++) {
+    if (best[pid].query < 0 || query_used[best[pid].query])
+      continue;
+    query_used[best[pid].query] = true;
+    pid_done[pid] = true;
+    matches->push_back(best[pid]);
+  }
+  if (matches->empty() || options_.active_cameras <= 0)
+    return;
+
+  // The map images seeing the most matched landmarks
+  TrackTable const& tracks = map.GetTracks();
+  std::vector<int> votes(tracks.NumFrames(), 0);
+  for (Match const& m : *matches)
+    for (TrackTable::Observation const* o = tracks.TrackBegin(m.pid); o != tracks.TrackEnd(m.pid); o++)
+      votes[o->cid]++;
+  std::vector<int> cids;
+  for (size_t cid = 0; cid < votes.size(); cid++)
+    if (votes[cid] > 0)
+      cids.push_back(cid);
+  int num_search = std::min(static_cast<int>(cids.size()), options_.active_cameras);
+  std::partial_sort(cids.begin(), cids.begin() + num_search, cids.end(),
+                    [&votes](int a, int b) {return votes[a] > votes[b];});
+  if (num_cameras)
+    *num_cameras = num_search;
+
+  // The image features of each word
+  std::vector<std::pair<int, int> > query_words;
+  query_words.reserve(descriptors.rows);
+  for (int i = 0; i < descriptors.rows; i++)
+    if (words[i] >= 0 && !query_used[i])
+      query_words.push_back(std::make_pair(words[i], i));
+  std::sort(query_words.begin(), query_words.end());
+
+  // Their other landmarks to the image features, from the best seen image
+  int found = 0;
+  for (int c = 0; c < num_search && found < options_.max_active_matches; c++) {
+    int cid = cids[c];
+    int num_fid = map.GetFrameKeypoints(cid).cols();
+    for (int fid = 0; fid < num_fid && found < options_.max_active_matches; fid++) {
+      int pid = tracks.Pid(cid, fid);
+      if (pid < 0 || pid_done[pid])
+        continue;
+      pid_done[pid] = true;
+      int best_query = -1, best_dist = std::numeric_limits<int>::max(), second = std::numeric_limits<int>::max();
+      for (int d = pid_begin_[pid]; d < pid_begin_[pid + 1]; d++) {
+        std::vector<std::pair<int, int> >::const_iterator it =
+          std::lower_bound(query_words.begin(), query_words.end(), std::make_pair(desc_word_[d], -1));
+        for (; it != query_words.end() && it->first == desc_word_[d]; it++) {
+          int dist = Distance(descriptors, it->second, descriptors_, d);
+          if (it->second == best_query) {
+            best_dist = std::min(best_dist, dist);
+          } else if (dist < best_dist) {
+            second = best_dist;
+            best_dist = dist;
+            best_query = it->second;
+          } else if (dist < second) {
+            second = dist;
+          }
+        }
+      }
+      if (best_query < 0 || query_used[best_query] || best_dist > options_.max_distance ||
+          best_dist >= options_.ratio * second)
+        continue;
+      query_used[best_query] = true;
+      matches->push_back(Match{best_query, pid, best_dist});
+      found++;
+    }
+  }
+  if (num_active)
+    *num_active = found;
+}
+
+}  // namespace sparse_mapping
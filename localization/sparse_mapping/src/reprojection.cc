@@ -18,7 +18,9 @@
 
 #include <sparse_mapping/reprojection.h>
 #include <sparse_mapping/sparse_mapping.h>
+#include <sparse_mapping/stage_timer.h>
 
+#include <common/arena.h>
 #include <common/thread.h>
 #include <camera/camera_model.h>
 
@@ -27,10 +29,23 @@
 #include <opencv2/core/eigen.hpp>
 #include <gflags/gflags.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <random>
 #include <thread>
 #include <unordered_map>
 
+DEFINE_double(ransac_confidence, 0.999,
+              "Stop RANSAC once an all-inlier sample was drawn with this probability.");
+DEFINE_bool(refine_with_ceres, false,
+            "Refine the camera pose found by RANSAC with a Ceres problem, rather than "
+            "with the fixed size solver of RefineCamera.");
+DEFINE_bool(ba_analytic_jacobians, true,
+            "Compute the reprojection error Jacobians in closed form during bundle "
+            "adjustment, instead of with automatic differentiation.");
+
 namespace sparse_mapping {
 
 ceres::LossFunction* GetLossFunction(std::string cost_fun, double th) {
@@ -90,18 +105,106 @@ struct ReprojectionError {
   Eigen::Vector2d observed;
 };
 
-void BundleAdjust(std::vector<std::map<int, int> > const& pid_to_cid_fid,
-                  std::vector<Eigen::Matrix2Xd > const& cid_to_keypoint_map,
-                  double focal_length,
-                  std::vector<Eigen::Affine3d > * cid_to_cam_t_global,
-                  std::vector<Eigen::Vector3d> * pid_to_xyz,
-                  std::vector<std::map<int, int> > const& user_pid_to_cid_fid,
-                  std::vector<Eigen::Matrix2Xd > const& user_cid_to_keypoint_map,
-                  std::vector<Eigen::Vector3d> * user_pid_to_xyz,
-                  ceres::LossFunction * loss,
-                  ceres::Solver::Options const& options,
-                  ceres::Solver::Summary* summary,
-                  int first, int last, bool fix_cameras) {
+// The same residual as ReprojectionError, with the Jacobians written
+// out. With p = R * X + t, the residual is f * (p0 / p2, p1 / p2) - obs,
+// so its derivative with respect to p is
+//
+//   D = f / p2 * [1 0 -p0/p2; 0 1 -p1/p2]
+//
+// and the Jacobians are D for t, D * R for X, and D * dp/daa for the
+// angle-axis rotation aa, where dp/daa = -R * [X]x * Jr(aa), with Jr the
+// right Jacobian of the rotation group.
+class AnalyticReprojectionError : public ceres::SizedCostFunction<2, 3, 3, 3, 1> {
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  explicit AnalyticReprojectionError(const Eigen::Vector2d & observed)
+    : observed_(observed) {}
+
+  bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const {
+    Eigen::Map<const Eigen::Vector3d> camera_p_global(parameters[0]);
+    Eigen::Map<const Eigen::Vector3d> camera_aa_global(parameters[1]);
+    Eigen::Map<const Eigen::Vector3d> point_global(parameters[2]);
+    double focal_length = parameters[3][0];
+
+    Eigen::Matrix3d R;
+    ceres::AngleAxisToRotationMatrix(camera_aa_global.data(), R.data());
+    Eigen::Vector3d p = R * point_global + camera_p_global;
+
+    double inv_z = 1.0 / p[2];
+    Eigen::Vector2d normalized(p[0] * inv_z, p[1] * inv_z);
+    Eigen::Map<Eigen::Vector2d> residual(residuals);
+    residual = focal_length * normalized - observed_;
+
+    if (jacobians == NULL)
+      return true;
+
+    Eigen::Matrix<double, 2, 3> D;
+    D << 1.0, 0.0, -normalized[0],
+         0.0, 1.0, -normalized[1];
+    D *= focal_length * inv_z;
+
+    typedef Eigen::Matrix<double, 2, 3, Eigen::RowMajor> Jacobian23;
+    if (jacobians[0] != NULL)
+      Eigen::Map<Jacobian23>(jacobians[0]) = D;
+    if (jacobians[1] != NULL)
+      Eigen::Map<Jacobian23>(jacobians[1]) = -D * R * Skew(point_global) * RightJacobian(camera_aa_global);
+    if (jacobians[2] != NULL)
+      Eigen::Map<Jacobian23>(jacobians[2]) = D * R;
+    if (jacobians[3] != NULL)
+      Eigen::Map<Eigen::Vector2d>(jacobians[3]) = normalized;
+
+    return true;
+  }
+
+ private:
+  static Eigen::Matrix3d Skew(Eigen::Vector3d const& v) {
+    Eigen::Matrix3d S;
+    S <<  0.0, -v[2],  v[1],
+         v[2],   0.0, -v[0],
+        -v[1],  v[0],   0.0;
+    return S;
+  }
+
+  // Jr(w) = I - (1 - cos |w|) / |w|^2 [w]x + (|w| - sin |w|) / |w|^3 [w]x^2,
+  // with the coefficients replaced by their series near zero
+  static Eigen::Matrix3d RightJacobian(Eigen::Vector3d const& w) {
+    double theta2 = w.squaredNorm();
+    double a, b;
+    if (theta2 < 1e-8) {
+      a = 0.5 - theta2 / 24.0;
+      b = 1.0 / 6.0 - theta2 / 120.0;
+    } else {
+      double theta = std::sqrt(theta2);
+      a = (1.0 - std::cos(theta)) / theta2;
+      b = (theta - std::sin(theta)) / (theta2 * theta);
+    }
+    Eigen::Matrix3d W = Skew(w);
+    return Eigen::Matrix3d::Identity() - a * W + b * W * W;
+  }
+
+  Eigen::Vector2d observed_;
+};
+
+ceres::CostFunction* ReprojectionCostFunction(const Eigen::Vector2d & observed, bool analytic) {
+  if (analytic)
+    return new AnalyticReprojectionError(observed);
+  return ReprojectionError::Create(observed);
+}
+
+void MultiPassBundleAdjust(TrackTable const& tracks,
+                           std::vector<Eigen::Matrix2Xd > const& cid_to_keypoint_map,
+                           double focal_length,
+                           std::vector<Eigen::Affine3d > * cid_to_cam_t_global,
+                           std::vector<Eigen::Vector3d> * pid_to_xyz,
+                           TrackTable const& user_tracks,
+                           std::vector<Eigen::Matrix2Xd > const& user_cid_to_keypoint_map,
+                           std::vector<Eigen::Vector3d> * user_pid_to_xyz,
+                           ceres::LossFunction * loss,
+                           ceres::Solver::Options const& options,
+                           int num_passes, bool filter_outliers,
+                           double reproj_thresh, double multiple_of_median,
+                           std::vector<ceres::Solver::Summary> * summaries,
+                           int first, int last, bool fix_cameras) {
   // Perform bundle adjustment. Keep fixed all cameras with cid
   // not within [first, last] and all xyz points which project only
   // onto fixed cameras.
@@ -118,54 +221,71 @@ void BundleAdjust(std::vector<std::map<int, int> > const& pid_to_cid_fid,
     aa_storage = vec;
   }
 
-  // Build problem
-  ceres::Problem problem;
+  // Build problem. Residuals are removed between passes, which
+  // needs fast removal.
+  ceres::Problem::Options problem_options;
+  problem_options.enable_fast_removal = true;
+  ceres::Problem problem(problem_options);
+
+  // The residual of each observation of the map tracks, to filter them
+  struct ObservationResidual {
+    int pid, cid, fid;
+    ceres::ResidualBlockId id;
+  };
+  std::vector<ObservationResidual> residuals;
+  residuals.reserve(tracks.NumObservations());
 
   // Ideally the block inside of the loop below must be a function call,
   // but the compiler does not handle that correctly with ceres.
   // So do this by changing where things are pointing.
   for (int pass = 0; pass < 2; pass++) {
-    std::vector<std::map<int, int> > const * p_pid_to_cid_fid;
+    TrackTable                       const * p_tracks;
     std::vector<Eigen::Matrix2Xd >   const * p_cid_to_keypoint_map;
     std::vector<Eigen::Vector3d>           * p_pid_to_xyz;
     ceres::LossFunction * local_loss;
     if (pass == 0) {
       local_loss            = loss;  // outside-supplied loss
-      p_pid_to_cid_fid      = &pid_to_cid_fid;
+      p_tracks              = &tracks;
       p_cid_to_keypoint_map = &cid_to_keypoint_map;
       p_pid_to_xyz          = pid_to_xyz;
     } else {
       local_loss            = NULL;  // l2, as user-supplied data is reliable
-      p_pid_to_cid_fid      = &user_pid_to_cid_fid;
+      p_tracks              = &user_tracks;
       p_cid_to_keypoint_map = &user_cid_to_keypoint_map;
       p_pid_to_xyz          = user_pid_to_xyz;
     }
 
     for (size_t pid = 0; pid < p_pid_to_xyz->size(); pid++) {
-      if ((*p_pid_to_cid_fid)[pid].size() < 2)
+      if (p_tracks->TrackSize(pid) < 2)
         LOG(FATAL) << "Found a track of size < 2.";
 
       // Don't vary points which project only into cameras which we don't vary.
       bool fix_pid = true;
-      for (std::map<int, int>::value_type const& cid_fid : (*p_pid_to_cid_fid)[pid]) {
-        if (cid_fid.first >= first && cid_fid.first <= last)
+      for (const TrackTable::Observation* it = p_tracks->TrackBegin(pid); it != p_tracks->TrackEnd(pid); it++) {
+        if (it->cid >= first && it->cid <= last)
           fix_pid = false;
       }
 
-      for (std::map<int, int>::value_type const& cid_fid : (*p_pid_to_cid_fid)[pid]) {
+      for (const TrackTable::Observation* it = p_tracks->TrackBegin(pid); it != p_tracks->TrackEnd(pid); it++) {
         ceres::CostFunction* cost_function =
-          ReprojectionError::Create((*p_cid_to_keypoint_map)[cid_fid.first].col(cid_fid.second));
-
-        problem.AddResidualBlock(cost_function,
-                                 local_loss,
-                                 &cid_to_cam_t_global->at(cid_fid.first).translation()[0],
-                                 &camera_aa_storage[3 * cid_fid.first],
-                                 &p_pid_to_xyz->at(pid)[0],
-                                 &focal_length);
-
-        if (fix_cameras || (cid_fid.first < first || cid_fid.first > last)) {
-          problem.SetParameterBlockConstant(&cid_to_cam_t_global->at(cid_fid.first).translation()[0]);
-          problem.SetParameterBlockConstant(&camera_aa_storage[3 * cid_fid.first]);
+          ReprojectionCostFunction((*p_cid_to_keypoint_map)[it->cid].col(it->fid),
+                                   FLAGS_ba_analytic_jacobians);
+
+        ceres::ResidualBlockId id =
+          problem.AddResidualBlock(cost_function,
+                                   local_loss,
+                                   &cid_to_cam_t_global->at(it->cid).translation()[0],
+                                   &camera_aa_storage[3 * it->cid],
+                                   &p_pid_to_xyz->at(pid)[0],
+                                   &focal_length);
+        if (pass == 0) {
+          ObservationResidual r = {static_cast<int>(pid), it->cid, it->fid, id};
+          residuals.push_back(r);
+        }
+
+        if (fix_cameras || (it->cid < first || it->cid > last)) {
+          problem.SetParameterBlockConstant(&cid_to_cam_t_global->at(it->cid).translation()[0]);
+          problem.SetParameterBlockConstant(&camera_aa_storage[3 * it->cid]);
         }
       }
       if (fix_pid || pass == 1) {
@@ -179,8 +299,57 @@ void BundleAdjust(std::vector<std::map<int, int> > const& pid_to_cid_fid,
     problem.SetParameterBlockConstant(&focal_length);
   }
 
-  // Solve the problem
-  ceres::Solve(options, &problem, summary);
+  summaries->clear();
+  for (int pass = 0; pass < num_passes; pass++) {
+    // Solve the problem
+    summaries->push_back(ceres::Solver::Summary());
+    ceres::Solve(options, &problem, &summaries->back());
+    if (!filter_outliers || pass + 1 == num_passes || residuals.empty())
+      break;
+
+    // Remove the observations that now reproject poorly, with the
+    // same threshold as FilterPID(), and the points they leave with
+    // fewer than two.
+    std::vector<double> errors(residuals.size());
+    std::vector<bool> behind(residuals.size());
+    for (size_t k = 0; k < residuals.size(); k++) {
+      ObservationResidual const& r = residuals[k];
+      Eigen::Matrix3d rotation;
+      camera::RodriguesToRotation(Eigen::Map<Eigen::Vector3d>(camera_aa_storage.data() + 3 * r.cid), &rotation);
+      Eigen::Vector3d P = rotation * (*pid_to_xyz)[r.pid] + cid_to_cam_t_global->at(r.cid).translation();
+      errors[k] = (cid_to_keypoint_map[r.cid].col(r.fid) - focal_length * P.hnormalized()).norm();
+      behind[k] = P[2] <= 0;
+    }
+    double thresh = std::max(GetErrThresh(errors, multiple_of_median), reproj_thresh);
+
+    std::vector<int> pid_count(pid_to_xyz->size(), 0);
+    std::vector<bool> bad_pid(pid_to_xyz->size(), false);
+    std::vector<ObservationResidual> kept;
+    kept.reserve(residuals.size());
+    for (size_t k = 0; k < residuals.size(); k++) {
+      if (behind[k])
+        bad_pid[residuals[k].pid] = true;
+      if (errors[k] >= thresh) {
+        problem.RemoveResidualBlock(residuals[k].id);
+      } else {
+        kept.push_back(residuals[k]);
+        pid_count[residuals[k].pid]++;
+      }
+    }
+    residuals.clear();
+    for (ObservationResidual const& r : kept) {
+      if (!bad_pid[r.pid] && pid_count[r.pid] >= 2)
+        residuals.push_back(r);
+      else
+        problem.RemoveResidualBlock(r.id);
+    }
+    for (size_t pid = 0; pid < pid_to_xyz->size(); pid++) {
+      if ((bad_pid[pid] || pid_count[pid] < 2) && problem.HasParameterBlock(&(*pid_to_xyz)[pid][0]))
+        problem.RemoveParameterBlock(&(*pid_to_xyz)[pid][0]);
+    }
+    LOG(INFO) << "Bundle adjustment pass " << pass << ": removed " << errors.size() - residuals.size()
+              << " of " << errors.size() << " observations, reprojection threshold " << thresh << " pixels.";
+  }
 
   // Write the rotations back to the transform
   for (size_t cid = 0; cid < cid_to_cam_t_global->size(); cid++) {
@@ -192,6 +361,25 @@ void BundleAdjust(std::vector<std::map<int, int> > const& pid_to_cid_fid,
   }
 }
 
+void BundleAdjust(TrackTable const& tracks,
+                  std::vector<Eigen::Matrix2Xd > const& cid_to_keypoint_map,
+                  double focal_length,
+                  std::vector<Eigen::Affine3d > * cid_to_cam_t_global,
+                  std::vector<Eigen::Vector3d> * pid_to_xyz,
+                  TrackTable const& user_tracks,
+                  std::vector<Eigen::Matrix2Xd > const& user_cid_to_keypoint_map,
+                  std::vector<Eigen::Vector3d> * user_pid_to_xyz,
+                  ceres::LossFunction * loss,
+                  ceres::Solver::Options const& options,
+                  ceres::Solver::Summary* summary,
+                  int first, int last, bool fix_cameras) {
+  std::vector<ceres::Solver::Summary> summaries;
+  MultiPassBundleAdjust(tracks, cid_to_keypoint_map, focal_length, cid_to_cam_t_global, pid_to_xyz,
+                        user_tracks, user_cid_to_keypoint_map, user_pid_to_xyz, loss, options,
+                        1, false, 0, 0, &summaries, first, last, fix_cameras);
+  *summary = summaries[0];
+}
+
 void BundleAdjust(std::vector<Eigen::Matrix2Xd> const& features_n,
                   double focal_length,
                   std::vector<Eigen::Affine3d> * cam_t_global_n,
@@ -222,7 +410,8 @@ void BundleAdjust(std::vector<Eigen::Matrix2Xd> const& features_n,
   ceres::Problem problem;
   for (ptrdiff_t pid = 0; pid < pid_to_xyz->cols(); pid++) {
     for (size_t cid = 0; cid < n_cameras; cid++) {
-      ceres::CostFunction* cost_function = ReprojectionError::Create(features_n[cid].col(pid));
+      ceres::CostFunction* cost_function = ReprojectionCostFunction(features_n[cid].col(pid),
+                                                                    FLAGS_ba_analytic_jacobians);
       problem.AddResidualBlock(cost_function, loss,
                                &cam_t_global_n->at(cid).translation()[0],
                                &aa.at(cid)[0],
@@ -260,8 +449,8 @@ void EstimateCamera(camera::CameraModel* camera_estimate,
   // Build problem
   ceres::Problem problem;
   for (size_t pid = 0; pid < landmarks->size(); pid++) {
-    ceres::CostFunction* cost_function = ReprojectionError::Create(
-                Eigen::Vector2d(observations[pid].x(), observations[pid].y()));
+    ceres::CostFunction* cost_function = ReprojectionCostFunction(
+                Eigen::Vector2d(observations[pid].x(), observations[pid].y()), FLAGS_ba_analytic_jacobians);
     problem.AddResidualBlock(cost_function, new ceres::CauchyLoss(1.0),
                              &guess.translation()[0],
                              &aa[0],
@@ -281,9 +470,121 @@ void EstimateCamera(camera::CameraModel* camera_estimate,
   camera_estimate->SetTransform(guess);
 }
 
+// Levenberg-Marquardt on the pose alone, with the pose perturbed on the
+// left: p = exp([w]x) * (R * X + t) + v. Then dp/dv = I, dp/dw = -[p]x,
+// and the Jacobian of a residual is D * [I -[p]x], with D as in
+// AnalyticReprojectionError. The Cauchy loss log(1 + s) is handled by
+// reweighting each residual by 1 / (1 + s), its derivative.
+bool RefineCamera(Eigen::Ref<const Eigen::Matrix3Xd> const& landmarks,
+                  Eigen::Ref<const Eigen::Matrix2Xd> const& observations,
+                  Eigen::Vector2d const& focal, int max_iterations,
+                  Eigen::Affine3d* cam_t_global, int* num_iterations) {
+  typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+  typedef Eigen::Matrix<double, 6, 1> Vector6d;
+  const double kMinStep = 1e-10;
+  if (num_iterations)
+    *num_iterations = 0;
+
+  Eigen::Matrix3d R = cam_t_global->linear();
+  Eigen::Vector3d t = cam_t_global->translation();
+
+  // The robust cost, and its normal equations if H is given. Points
+  // behind the camera are left out.
+  int n = landmarks.cols();
+  auto evaluate = [&landmarks, &observations, &focal, n](Eigen::Matrix3d const& R, Eigen::Vector3d const& t,
+                                                         Matrix6d* H, Vector6d* g, int* num_used) -> double {
+    double cost = 0;
+    int used = 0;
+    if (H) {
+      H->setZero();
+      g->setZero();
+    }
+    for (int i = 0; i < n; i++) {
+      Eigen::Vector3d p = R * landmarks.col(i) + t;
+      if (p[2] <= 0)
+        continue;
+      double inv_z = 1.0 / p[2];
+      Eigen::Vector2d r(focal[0] * p[0] * inv_z - observations(0, i),
+                        focal[1] * p[1] * inv_z - observations(1, i));
+      double s = r.squaredNorm();
+      cost += std::log1p(s);
+      used++;
+      if (!H)
+        continue;
+      Eigen::Matrix<double, 2, 3> D;
+      D << focal[0] * inv_z, 0.0, -focal[0] * p[0] * inv_z * inv_z,
+           0.0, focal[1] * inv_z, -focal[1] * p[1] * inv_z * inv_z;
+      Eigen::Matrix<double, 2, 6> J;
+      J.leftCols<3>() = D;
+      Eigen::Matrix3d p_cross;
+      p_cross << 0, -p[2], p[1],
+                 p[2], 0, -p[0],
+                 -p[1], p[0], 0;
+      J.rightCols<3>() = -D * p_cross;
+      double w = 1.0 / (1.0 + s);
+      H->noalias() += w * J.transpose() * J;
+      g->noalias() += w * J.transpose() * r;
+    }
+    if (num_used)
+      *num_used = used;
+    return cost;
+  };
+
+  Matrix6d H;
+  Vector6d g;
+  int used = 0;
+  double cost = evaluate(R, t, &H, &g, &used);
+  if (used < 3 || !std::isfinite(cost))
+    return false;
+  double lambda = 1e-4;
+  int iteration = 0;
+  for (; iteration < max_iterations; iteration++) {
+    Matrix6d A = H;
+    A.diagonal() *= 1.0 + lambda;
+    Eigen::LDLT<Matrix6d> ldlt(A);
+    if (ldlt.info() != Eigen::Success)
+      return false;
+    Vector6d step = ldlt.solve(-g);
+    if (!step.allFinite())
+      return false;
+
+    Eigen::Vector3d w = step.tail<3>();
+    double angle = w.norm();
+    Eigen::Matrix3d dR = Eigen::Matrix3d::Identity();
+    if (angle > 0)
+      dR = Eigen::AngleAxisd(angle, w / angle).toRotationMatrix();
+    Eigen::Matrix3d new_R = dR * R;
+    Eigen::Vector3d new_t = dR * t + step.head<3>();
+    double new_cost = evaluate(new_R, new_t, NULL, NULL, &used);
+    if (used >= 3 && new_cost < cost) {
+      R = new_R;
+      t = new_t;
+      lambda = std::max(1e-10, lambda / 10);
+      if (step.norm() < kMinStep || cost - new_cost < kMinStep * cost) {
+        cost = new_cost;
+        iteration++;
+        break;
+      }
+      cost = evaluate(R, t, &H, &g, &used);
+    } else {
+      lambda *= 10;
+      if (lambda > 1e10)
+        break;
+    }
+  }
+  if (num_iterations)
+    *num_iterations = iteration;
+
+  // Orthonormalize against the drift of the updates
+  cam_t_global->linear() = Eigen::Quaterniond(R).normalized().toRotationMatrix();
+  cam_t_global->translation() = t;
+  return true;
+}
+
 // random intger in [min, max)
 int RandomInt(int min, int max) {
-  static std::mt19937 generator;  // should be thread_local for thread safe, gcc 4.6 doesn't support
+  // one generator per thread, as RANSAC runs on several at once
+  static thread_local std::mt19937 generator;
   std::uniform_int_distribution<int> random_item(min, max - 1);
   return random_item(generator);
 }
@@ -312,79 +613,180 @@ void SelectRandomObservations(const std::vector<Eigen::Vector3d> & all_landmarks
 
 bool P3P(const std::vector<cv::Point3d> & landmarks, const std::vector<cv::Point2d> & observations,
          const camera::CameraParameters & params, Eigen::Vector3d * pos, Eigen::Matrix3d * rotation) {
-    cv::Mat camera_matrix(3, 3, cv::DataType<double>::type);
+    // Fixed size, on the stack, since this runs once per RANSAC iteration
+    cv::Matx33d camera_matrix;
     cv::eigen2cv(params.GetIntrinsicMatrix<camera::UNDISTORTED_C>(), camera_matrix);
-    cv::Mat rvec(3, 1, cv::DataType<double>::type, cv::Scalar(0));
-    cv::Mat tvec(3, 1, cv::DataType<double>::type, cv::Scalar(0));
-    cv::Mat distortion(4, 1, cv::DataType<double>::type, cv::Scalar(0));
+    cv::Vec3d rvec(0, 0, 0), tvec(0, 0, 0);
+    cv::Vec4d distortion(0, 0, 0, 0);
     bool result = cv::solvePnP(landmarks, observations, camera_matrix, distortion, rvec, tvec, false, CV_P3P);
     if (!result)
       return false;
-    cv::cv2eigen(tvec, *pos);
-    camera::RodriguesToRotation(Eigen::Vector3d(rvec.at<double>(0), rvec.at<double>(1), rvec.at<double>(2)), rotation);
+    *pos = Eigen::Vector3d(tvec[0], tvec[1], tvec[2]);
+    camera::RodriguesToRotation(Eigen::Vector3d(rvec[0], rvec[1], rvec[2]), rotation);
     return true;
 }
 
-size_t CountInliers(const std::vector<Eigen::Vector3d> & landmarks, const std::vector<Eigen::Vector2d> & observations,
-                 const camera::CameraModel & camera, int tolerance, std::vector<size_t>* inliers) {
-  int num_inliers = 0;
+// Count the landmarks that project within tolerance_sq squared pixels
+// of their observations, all at once rather than one CameraModel call
+// per point. Points behind the camera are never inliers. The projected
+// points are kept in the frame arena, as this runs once per RANSAC
+// iteration.
+static size_t CountInliers(Eigen::Ref<const Eigen::Matrix3Xd> const& landmarks,
+                           Eigen::Ref<const Eigen::Matrix2Xd> const& observations,
+                           Eigen::Affine3d const& cam_t_global, Eigen::Vector2d const& focal,
+                           double tolerance_sq, std::vector<size_t>* inliers) {
+  common::Arena& arena = common::FrameArena();
+  common::ArenaScope scope(&arena);
+  int n = landmarks.cols();
+  Eigen::Map<Eigen::Matrix3Xd> cam(arena.Allocate<double>(3 * n), 3, n);
+  cam.noalias() = cam_t_global.linear() * landmarks;
+  cam.colwise() += cam_t_global.translation();
+  Eigen::Map<Eigen::Array<bool, 1, Eigen::Dynamic> > good(arena.Allocate<bool>(n), n);
+  good = ((focal[0] * cam.row(0).array() / cam.row(2).array() - observations.row(0).array()).square() +
+          (focal[1] * cam.row(1).array() / cam.row(2).array() - observations.row(1).array()).square() <=
+          tolerance_sq) && (cam.row(2).array() > 0);
+
   if (inliers) {
-    // To save ourselves some allocation time. We'll prealloc for a 50% inlier
-    // success rate
-    inliers->reserve(observations.size()/2);
+    inliers->clear();
+    inliers->reserve(good.count());
+    for (int i = 0; i < good.size(); i++)
+      if (good[i]) inliers->push_back(i);
   }
+  return good.count();
+}
 
-  double tolerance_sq = tolerance * tolerance;
-
+size_t CountInliers(const std::vector<Eigen::Vector3d> & landmarks, const std::vector<Eigen::Vector2d> & observations,
+                 const camera::CameraModel & camera, int tolerance, std::vector<size_t>* inliers) {
+  common::Arena& arena = common::FrameArena();
+  common::ArenaScope scope(&arena);
+  Eigen::Map<Eigen::Matrix3Xd> landmark_mat(arena.Allocate<double>(3 * landmarks.size()), 3, landmarks.size());
+  Eigen::Map<Eigen::Matrix2Xd> observation_mat(arena.Allocate<double>(2 * observations.size()), 2,
+                                               observations.size());
   for (size_t i = 0; i < landmarks.size(); i++) {
-    Eigen::Vector2d pos = camera.ImageCoordinates(landmarks[i]);
-    if ((observations[i] - pos).squaredNorm() <= tolerance_sq) {
-      num_inliers++;
-      if (inliers)
-        inliers->push_back(i);
-    }
+    landmark_mat.col(i) = landmarks[i];
+    observation_mat.col(i) = observations[i];
   }
+  std::vector<size_t> local_inliers;
+  size_t num_inliers = CountInliers(landmark_mat, observation_mat, camera.GetTransform(),
+                                    camera.GetParameters().GetFocalVector(), tolerance * tolerance,
+                                    inliers ? &local_inliers : NULL);
+  if (inliers)
+    inliers->insert(inliers->end(), local_inliers.begin(), local_inliers.end());
   return num_inliers;
 }
 
+// The number of RANSAC iterations after which, with the given
+// confidence, an all-inlier sample of sample_size points was drawn.
+static int RequiredIterations(double inlier_ratio, int sample_size, double confidence) {
+  double good_sample = std::pow(inlier_ratio, sample_size);
+  if (good_sample >= 1.0)
+    return 1;
+  if (good_sample <= 0.0)
+    return std::numeric_limits<int>::max();
+  double n = std::log(1.0 - confidence) / std::log(1.0 - good_sample);
+  if (n >= std::numeric_limits<int>::max())
+    return std::numeric_limits<int>::max();
+  return std::max(1, static_cast<int>(std::ceil(n)));
+}
+
 int RansacEstimateCamera(const std::vector<Eigen::Vector3d> & landmarks,
                          const std::vector<Eigen::Vector2d> & observations,
                          int num_tries, int inlier_tolerance, camera::CameraModel * camera_estimate,
                          std::vector<Eigen::Vector3d> * inlier_landmarks_out,
-                         std::vector<Eigen::Vector2d> * inlier_observations_out) {
+                         std::vector<Eigen::Vector2d> * inlier_observations_out,
+                         std::vector<double> const* match_distances,
+                         int* num_iterations) {
   size_t best_inliers = 0;
+  if (num_iterations)
+    *num_iterations = 0;
   camera::CameraParameters params = camera_estimate->GetParameters();
+  const int kSampleSize = 4;
 
   // Need the minimum number of observations
-  if (observations.size() < 4)
+  if (observations.size() < static_cast<size_t>(kSampleSize))
     return 1;
 
-  // RANSAC to find the best camera with P3P
-  std::vector<cv::Point3d> subset_landmarks;
-  std::vector<cv::Point2d> subset_observations;
-  for (int i = 0; i < num_tries; i++) {
-    subset_landmarks.clear();
-    subset_observations.clear();
-    SelectRandomObservations(landmarks, observations, 4, &subset_landmarks, &subset_observations);
-
-    Eigen::Vector3d pos;
-    Eigen::Matrix3d rotation;
-    bool result = P3P(subset_landmarks, subset_observations, params, &pos, &rotation);
-    if (!result)
-      continue;
-    Eigen::Affine3d cam_t_global;
-    cam_t_global.setIdentity();
-    cam_t_global.translate(pos);
-    cam_t_global.rotate(rotation);
-    camera::CameraModel guess(cam_t_global, camera_estimate->GetParameters());
-
-    size_t inliers = CountInliers(landmarks, observations, guess, inlier_tolerance, NULL);
-    if (inliers > best_inliers) {
-      best_inliers = inliers;
-      *camera_estimate = guess;
+  // The temporaries of this frame are given back on return
+  common::Arena& arena = common::FrameArena();
+  common::ArenaScope scope(&arena);
+
+  // Visit the matches best first, if we know how good they are
+  int num_obs = observations.size();
+  common::ArenaVector<int> order(num_obs, 0, common::ArenaAllocator<int>(&arena));
+  for (int i = 0; i < num_obs; i++)
+    order[i] = i;
+  if (match_distances) {
+    CHECK(match_distances->size() == observations.size())
+      << "Need one match distance per observation.";
+    std::stable_sort(order.begin(), order.end(),
+                     [match_distances](int a, int b) { return (*match_distances)[a] < (*match_distances)[b]; });
+  }
+  Eigen::Map<Eigen::Matrix3Xd> landmark_mat(arena.Allocate<double>(3 * num_obs), 3, num_obs);
+  Eigen::Map<Eigen::Matrix2Xd> observation_mat(arena.Allocate<double>(2 * num_obs), 2, num_obs);
+  for (int i = 0; i < num_obs; i++) {
+    landmark_mat.col(i) = landmarks[order[i]];
+    observation_mat.col(i) = observations[order[i]];
+  }
+  Eigen::Vector2d focal = params.GetFocalVector();
+  double tolerance_sq = inlier_tolerance * inlier_tolerance;
+
+  // RANSAC to find the best camera with P3P. With match distances,
+  // sample PROSAC-style: draw from the best few matches first and
+  // grow the pool until it is all of them at half the budget.
+  int i = 0;
+  {
+    ScopedStageTimer timer("ransac");
+    std::vector<cv::Point3d> subset_landmarks(kSampleSize);
+    std::vector<cv::Point2d> subset_observations(kSampleSize);
+    int growth_tries = std::max(1, num_tries / 2);
+    int max_tries = num_tries;
+    for (; i < max_tries; i++) {
+      int pool = num_obs;
+      if (match_distances)
+        pool = std::min(num_obs, kSampleSize + static_cast<int>(
+                        static_cast<int64_t>(num_obs - kSampleSize) * i / growth_tries));
+
+      int sample[kSampleSize];
+      for (int k = 0; k < kSampleSize; k++) {
+        bool repeated = true;
+        while (repeated) {
+          sample[k] = RandomInt(0, pool);
+          repeated = false;
+          for (int l = 0; l < k; l++)
+            repeated = repeated || (sample[l] == sample[k]);
+        }
+        Eigen::Vector3d p = landmark_mat.col(sample[k]);
+        subset_landmarks[k] = cv::Point3d(p[0], p[1], p[2]);
+        subset_observations[k] = cv::Point2d(observation_mat(0, sample[k]), observation_mat(1, sample[k]));
+      }
+
+      Eigen::Vector3d pos;
+      Eigen::Matrix3d rotation;
+      bool result = P3P(subset_landmarks, subset_observations, params, &pos, &rotation);
+      if (!result)
+        continue;
+      Eigen::Affine3d cam_t_global;
+      cam_t_global.setIdentity();
+      cam_t_global.translate(pos);
+      cam_t_global.rotate(rotation);
+
+      size_t inliers = CountInliers(landmark_mat, observation_mat, cam_t_global, focal, tolerance_sq, NULL);
+      if (inliers > best_inliers) {
+        best_inliers = inliers;
+        camera_estimate->SetTransform(cam_t_global);
+
+        // Stop as soon as we are confident enough an outlier free
+        // sample was drawn. The best matches first only make that
+        // happen sooner.
+        max_tries = std::min(num_tries, RequiredIterations(static_cast<double>(inliers) / num_obs,
+                                                           kSampleSize, FLAGS_ransac_confidence));
+      }
     }
   }
 
+  if (num_iterations)
+    *num_iterations = i;
+  VLOG(2) << i << " Ransac iterations";
   VLOG(2) << observations.size() << " Ransac observations " << best_inliers << " inliers\n";
 
   // TODO(bcoltin): make adjustable constant? or return some sort of confidence?
@@ -397,33 +799,46 @@ int RansacEstimateCamera(const std::vector<Eigen::Vector3d> & landmarks,
   // vector, we could use those for doing the final camera estimate instead of
   // making another copy.
   std::vector<size_t> inliers;
-  CountInliers(landmarks, observations, *camera_estimate, inlier_tolerance, &inliers);
-  std::vector<Eigen::Vector3d> inlier_landmarks;
-  std::vector<Eigen::Vector2d> inlier_observations;
-  inlier_landmarks.reserve(inliers.size());
-  inlier_observations.reserve(inliers.size());
-  for (size_t idx : inliers) {
-    inlier_landmarks.push_back(landmarks[idx]);
-    inlier_observations.push_back(observations[idx]);
+  CountInliers(landmark_mat, observation_mat, camera_estimate->GetTransform(), focal, tolerance_sq, &inliers);
+  int num_inliers = inliers.size();
+  Eigen::Map<Eigen::Matrix3Xd> inlier_landmark_mat(arena.Allocate<double>(3 * num_inliers), 3, num_inliers);
+  Eigen::Map<Eigen::Matrix2Xd> inlier_observation_mat(arena.Allocate<double>(2 * num_inliers), 2, num_inliers);
+  for (int k = 0; k < num_inliers; k++) {
+    inlier_landmark_mat.col(k) = landmark_mat.col(inliers[k]);
+    inlier_observation_mat.col(k) = observation_mat.col(inliers[k]);
   }
   if (inlier_landmarks_out) {
-    inlier_landmarks_out->reserve(inliers.size());
-    std::copy(inlier_landmarks.begin(), inlier_landmarks.end(),
-        std::back_inserter(*inlier_landmarks_out));
+    inlier_landmarks_out->reserve(inlier_landmarks_out->size() + inliers.size());
+    for (size_t idx : inliers)
+      inlier_landmarks_out->push_back(landmarks[order[idx]]);
   }
   if (inlier_observations_out) {
-    inlier_observations_out->reserve(inliers.size());
-    std::copy(inlier_observations.begin(), inlier_observations.end(),
-        std::back_inserter(*inlier_observations_out));
+    inlier_observations_out->reserve(inlier_observations_out->size() + inliers.size());
+    for (size_t idx : inliers)
+      inlier_observations_out->push_back(observations[order[idx]]);
   }
 
+  // improve the estimate on the inliers, with Ceres only if asked for or
+  // if the solver of our own cannot
+  ScopedStageTimer timer("refine");
+  Eigen::Affine3d cam_t_global = camera_estimate->GetTransform();
+  if (!FLAGS_refine_with_ceres &&
+      RefineCamera(inlier_landmark_mat, inlier_observation_mat, focal, 100, &cam_t_global)) {
+    camera_estimate->SetTransform(cam_t_global);
+    return 0;
+  }
+  std::vector<Eigen::Vector3d> inlier_landmarks(num_inliers);
+  std::vector<Eigen::Vector2d> inlier_observations(num_inliers);
+  for (int k = 0; k < num_inliers; k++) {
+    inlier_landmarks[k] = inlier_landmark_mat.col(k);
+    inlier_observations[k] = inlier_observation_mat.col(k);
+  }
   ceres::Solver::Options options;
   options.linear_solver_type = ceres::ITERATIVE_SCHUR;
   options.num_threads = 1;  // it is no slower with only one thread
   options.max_num_iterations = 100;
   options.minimizer_progress_to_stdout = false;
   ceres::Solver::Summary summary;
-  // improve estimate with CERES solver
   EstimateCamera(camera_estimate, &inlier_landmarks, inlier_observations, options, &summary);
 
   return 0;
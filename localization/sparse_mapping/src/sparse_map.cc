@@ -17,12 +17,19 @@
  */
 
 #include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/descriptor_quantizer.h>
+#include <sparse_mapping/feature_store.h>
+#include <sparse_mapping/flat_map.h>
+#include <sparse_mapping/landmark_index.h>
 #include <camera/camera_params.h>
+#include <common/arena.h>
 #include <common/thread.h>
 #include <common/utils.h>
+#include <interest_point/hamming.h>
 #include <interest_point/matching.h>
 #include <sparse_mapping/reprojection.h>
 #include <sparse_mapping/sparse_mapping.h>
+#include <sparse_mapping/stage_timer.h>
 
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <opencv2/highgui/highgui.hpp>
@@ -35,6 +42,9 @@
 #include <unistd.h>
 #include <sys/time.h>
 
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>  // NOLINT
 #include <fstream>
 #include <queue>
 #include <set>
@@ -54,11 +64,106 @@ DEFINE_int32(early_break_landmarks, 100,
              "Breka early when we have this many landmarks.");
 DEFINE_int32(num_extra_localization_db_images, 0,
              "Match this many extra images from the Vocab DB, only keep num_similar.");
+DEFINE_int32(matcher_cache_size, 2000,
+             "Keep prebuilt matcher indices for at most this many map images. "
+             "Use 0 for no limit.");
+DEFINE_string(feature_store, "",
+              "If set, keep the image descriptors in this file while building a map, "
+              "reading them back as needed, rather than holding all of them in memory.");
+DEFINE_int32(feature_store_cache_mb, 1024,
+             "Keep at most this many megabytes of descriptors read from the feature store.");
 DEFINE_bool(verbose_localization, false,
             "If true, print more details on localization.");
+DEFINE_double(tracking_search_radius, 20.0,
+              "When localizing from a prior pose, look for the match of each "
+              "projected landmark within this many pixels.");
+DEFINE_double(tracking_ratio, 0.8,
+              "When localizing from a prior pose, the best match of a landmark "
+              "must be this much closer than the second best.");
+DEFINE_int32(tracking_min_inliers, 30,
+             "Localizing from a prior pose fails with fewer inliers than this.");
+DEFINE_bool(landmark_matching, false,
+            "Localize by matching the image features straight to the map landmarks, "
+            "then searching for the landmarks seen with those matched, rather than "
+            "matching to each similar map image. Needs a vocabulary database.");
+DEFINE_int32(landmark_descriptors, 3,
+             "With landmark matching, keep at most this many descriptors of each landmark.");
+DEFINE_int32(landmark_levels_up, 1,
+             "With landmark matching, match a feature to the landmarks under the vocabulary "
+             "tree node this many levels above its word. More levels find more matches, "
+             "at more cost.");
+DEFINE_int32(landmark_active_cameras, 10,
+             "With landmark matching, search for the landmarks of this many map images, "
+             "those which see the most of the landmarks first matched.");
+
+DECLARE_int32(hamming_distance);  // from interest_point/matching.cc
+DECLARE_double(goodness_ratio);
 
 namespace sparse_mapping {
 
+// Hands out one detector per worker thread. A detector adapts its
+// threshold as it goes, so it must only be used by one thread at a
+// time. Detectors are copied from the given one as they are first
+// needed, up to max_detectors, or without limit if that is zero.
+class DetectorPool {
+ public:
+  DetectorPool(interest_point::FeatureDetector const& detector, size_t max_detectors) :
+    prototype_(detector), max_detectors_(max_detectors) {}
+
+  interest_point::FeatureDetector* Acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (free_.empty() && (max_detectors_ == 0 || detectors_.size() < max_detectors_)) {
+      detectors_.emplace_back(new interest_point::FeatureDetector(prototype_));
+      return detectors_.back().get();
+    }
+    available_.wait(lock, [this] { return !free_.empty(); });
+    interest_point::FeatureDetector* detector = free_.back();
+    free_.pop_back();
+    return detector;
+  }
+
+  void Release(interest_point::FeatureDetector* detector) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_.push_back(detector);
+    }
+    available_.notify_one();
+  }
+
+ private:
+  interest_point::FeatureDetector prototype_;
+  size_t max_detectors_;
+  std::vector<std::unique_ptr<interest_point::FeatureDetector> > detectors_;
+  std::vector<interest_point::FeatureDetector*> free_;
+  std::mutex mutex_;
+  std::condition_variable available_;
+};
+
+namespace {
+
+// What the last localization on this thread did. Several threads may
+// localize against the same map at once.
+LocalizeStats & ThreadLocalizeStats() {
+  static thread_local LocalizeStats stats = LocalizeStats();
+  return stats;
+}
+
+// Guards building the camera grid on the first gated localization
+std::mutex camera_grid_mutex;
+// Guards building the landmark index, on the first localization with it
+std::mutex landmark_index_mutex;
+
+// Undistorts the keypoints of an image, relative to its center
+void UndistortKeypoints(camera::CameraParameters const& camera_params,
+                        std::vector<cv::KeyPoint> const& storage, Eigen::Matrix2Xd* keypoints) {
+  keypoints->resize(2, storage.size());
+  for (size_t j = 0; j < storage.size(); j++)
+    keypoints->col(j) << storage[j].pt.x, storage[j].pt.y;
+  camera_params.ConvertPoints<camera::DISTORTED_C, camera::UNDISTORTED_C>(*keypoints, keypoints);
+}
+
+}  // namespace
+
 SparseMap::SparseMap(const std::vector<std::string> & filenames,
                      const std::string & detector,
                      const camera::CameraParameters & params):
@@ -66,7 +171,8 @@ SparseMap::SparseMap(const std::vector<std::string> & filenames,
         detector_(detector), camera_params_(params),
         num_similar_(FLAGS_num_similar),
         num_ransac_iterations_(FLAGS_num_ransac_iterations),
-        ransac_inlier_tolerance_(FLAGS_ransac_inlier_tolerance) {
+        ransac_inlier_tolerance_(FLAGS_ransac_inlier_tolerance),
+        matcher_cache_(std::max(0, FLAGS_matcher_cache_size)) {
   cid_to_descriptor_map_.resize(cid_to_filename_.size());
   // TODO(bcoltin): only record scale and orientation for opensift?
   cid_to_keypoint_map_.resize(cid_to_filename_.size());
@@ -77,7 +183,8 @@ SparseMap::SparseMap(const std::string & protobuf_file, bool localization) :
                  Eigen::Vector2d(-1, -1)),
   num_similar_(FLAGS_num_similar),
         num_ransac_iterations_(FLAGS_num_ransac_iterations),
-        ransac_inlier_tolerance_(FLAGS_ransac_inlier_tolerance) {
+        ransac_inlier_tolerance_(FLAGS_ransac_inlier_tolerance),
+        matcher_cache_(std::max(0, FLAGS_matcher_cache_size)) {
   // The above camera params used bad values because we are expected to reload
   // later.
   Load(protobuf_file, localization);
@@ -91,7 +198,8 @@ SparseMap::SparseMap(const std::vector<Eigen::Affine3d>& cid_to_cam_t,
   detector_(detector), camera_params_(params),
   num_similar_(FLAGS_num_similar),
         num_ransac_iterations_(FLAGS_num_ransac_iterations),
-        ransac_inlier_tolerance_(FLAGS_ransac_inlier_tolerance) {
+        ransac_inlier_tolerance_(FLAGS_ransac_inlier_tolerance),
+        matcher_cache_(std::max(0, FLAGS_matcher_cache_size)) {
   if (filenames.size() != cid_to_cam_t.size())
     LOG(FATAL) << "Expecting as many images as cameras";
 
@@ -118,7 +226,8 @@ SparseMap::SparseMap(bool bundler_format, std::string const& filename,
                  Eigen::Vector2d(320, 240)),
   num_similar_(FLAGS_num_similar),
         num_ransac_iterations_(FLAGS_num_ransac_iterations),
-        ransac_inlier_tolerance_(FLAGS_ransac_inlier_tolerance) {
+        ransac_inlier_tolerance_(FLAGS_ransac_inlier_tolerance),
+        matcher_cache_(std::max(0, FLAGS_matcher_cache_size)) {
   int num_cams;
 
   if (bundler_format) {
@@ -206,17 +315,97 @@ SparseMap::SparseMap(bool bundler_format, std::string const& filename,
 
 // Detect features in given images
 void SparseMap::DetectFeatures() {
-  common::ThreadPool pool;
-  for (size_t cid = 0; cid < cid_to_filename_.size(); cid++) {
-    common::PrintProgressBar(stdout, static_cast<float>(cid) / static_cast<float>(cid_to_filename_.size() - 1));
+  // With a feature store the descriptors go to disk as soon as each
+  // image is done
+  feature_store_.reset();
+  if (!FLAGS_feature_store.empty()) {
+    feature_store_ = std::make_shared<FeatureStore>();
+    feature_store_->Create(FLAGS_feature_store, cid_to_filename_.size());
+  }
 
-    pool.AddTask(&SparseMap::DetectFeaturesFromFile, this,
-                 std::ref(cid_to_filename_[cid]),
-                 &cid_to_descriptor_map_[cid],
-                 &cid_to_keypoint_map_[cid]);
+  // This thread decodes the images while the workers detect features
+  // in the ones decoded before, each with its own detector. The task
+  // queue is bounded, so only a few decoded images wait at a time.
+  common::ThreadPool pool;
+  DetectorPool detectors(detector_, std::max(pool.NumThreads(), static_cast<size_t>(1)));
+  size_t batch_size = detector_.BatchSize();
+  if (batch_size > 1) {
+    // A GPU detector is given several images per task, to process them together
+    for (size_t begin = 0; begin < cid_to_filename_.size(); begin += batch_size) {
+      size_t end = std::min(begin + batch_size, cid_to_filename_.size());
+      std::vector<cv::Mat> images;
+      for (size_t cid = begin; cid < end; cid++) {
+        common::PrintProgressBar(stdout,
+                                 static_cast<float>(cid) / static_cast<float>(cid_to_filename_.size() - 1));
+        images.push_back(cv::imread(cid_to_filename_[cid], CV_LOAD_IMAGE_GRAYSCALE));
+      }
+      pool.AddTask([this, begin, images, &detectors]() {
+          std::vector<std::vector<cv::KeyPoint> > storage;
+          std::vector<cv::Mat> descriptors;
+          {
+            ScopedStageTimer timer("detect");
+            interest_point::FeatureDetector* detector = detectors.Acquire();
+            detector->DetectBatch(images, &storage, &descriptors);
+            detectors.Release(detector);
+          }
+          for (size_t i = 0; i < images.size(); i++) {
+            size_t cid = begin + i;
+            UndistortKeypoints(camera_params_, storage[i], &cid_to_keypoint_map_[cid]);
+            if (feature_store_)
+              feature_store_->Write(cid, cid_to_keypoint_map_[cid], descriptors[i]);
+            else
+              cid_to_descriptor_map_[cid] = descriptors[i];
+          }
+        });
+    }
+  } else {
+    for (size_t cid = 0; cid < cid_to_filename_.size(); cid++) {
+      common::PrintProgressBar(stdout, static_cast<float>(cid) / static_cast<float>(cid_to_filename_.size() - 1));
+
+      cv::Mat image = cv::imread(cid_to_filename_[cid], CV_LOAD_IMAGE_GRAYSCALE);
+      pool.AddTask([this, cid, image, &detectors]() {
+          interest_point::FeatureDetector* detector = detectors.Acquire();
+          cv::Mat descriptors;
+          DetectFeatures(image, detector, &descriptors, &cid_to_keypoint_map_[cid]);
+          detectors.Release(detector);
+          if (feature_store_)
+            feature_store_->Write(cid, cid_to_keypoint_map_[cid], descriptors);
+          else
+            cid_to_descriptor_map_[cid] = descriptors;
+        });
+    }
   }
   pool.Join();
 
+  if (feature_store_) {
+    feature_store_->Finish();
+    feature_store_->Open(FLAGS_feature_store, static_cast<size_t>(FLAGS_feature_store_cache_mb) << 20);
+  }
+
+  InitializeRawTracks();
+}
+
+void SparseMap::SetFeatures(std::vector<Eigen::Matrix2Xd> const& keypoints,
+                            std::vector<cv::Mat> const& descriptors) {
+  CHECK(keypoints.size() == cid_to_filename_.size() && descriptors.size() == cid_to_filename_.size())
+    << "Expecting the features of " << cid_to_filename_.size() << " images.";
+  cid_to_keypoint_map_ = keypoints;
+  cid_to_descriptor_map_.assign(cid_to_filename_.size(), cv::Mat());
+  feature_store_.reset();
+  if (FLAGS_feature_store.empty()) {
+    cid_to_descriptor_map_ = descriptors;
+  } else {
+    feature_store_ = std::make_shared<FeatureStore>();
+    feature_store_->Create(FLAGS_feature_store, cid_to_filename_.size());
+    for (size_t cid = 0; cid < cid_to_filename_.size(); cid++)
+      feature_store_->Write(cid, cid_to_keypoint_map_[cid], descriptors[cid]);
+    feature_store_->Finish();
+    feature_store_->Open(FLAGS_feature_store, static_cast<size_t>(FLAGS_feature_store_cache_mb) << 20);
+  }
+  InitializeRawTracks();
+}
+
+void SparseMap::InitializeRawTracks() {
   // Create temporary pid_to_cid_fid_, it will contain all the raw
   // features we found so far, without matches (matching and outlier
   // removal will later reduce the number of features, so this is
@@ -236,6 +425,38 @@ void SparseMap::DetectFeatures() {
 }
 
 void SparseMap::Load(const std::string & protobuf_file, bool localization) {
+  // Drop descriptors that may live in a previously mapped file
+  // before that file is unmapped
+  cid_to_descriptor_map_.clear();
+  mapped_file_.reset();
+  feature_store_.reset();
+  quantizer_.reset();
+  descriptors_are_codes_ = false;
+  cid_fid_to_pid_.clear();
+  tracks_.Clear();
+  camera_grid_.cells.clear();
+  localize_detectors_.reset();
+  landmark_index_.reset();
+
+  if (IsFlatMapFile(protobuf_file))
+    LoadFlat(protobuf_file, localization);
+  else
+    LoadProtobuf(protobuf_file, localization);
+
+  // Build the matcher indices now rather than on the first
+  // localization of each image. If the map has more images than the
+  // cache holds, the rest are built on demand.
+  matcher_cache_.Clear();
+  if (localization && !descriptors_are_codes_) {
+    size_t num_prebuild = cid_to_descriptor_map_.size();
+    if (FLAGS_matcher_cache_size > 0)
+      num_prebuild = std::min(num_prebuild, static_cast<size_t>(FLAGS_matcher_cache_size));
+    for (size_t cid = 0; cid < num_prebuild; cid++)
+      matcher_cache_.Prebuild(cid, cid_to_descriptor_map_[cid]);
+  }
+}
+
+void SparseMap::LoadProtobuf(const std::string & protobuf_file, bool localization) {
   sparse_mapping_protobuf::Map map;
   int input_fd = open(protobuf_file.c_str(), O_RDONLY);
   if (input_fd < 0)
@@ -273,6 +494,18 @@ void SparseMap::Load(const std::string & protobuf_file, bool localization) {
   int num_frames = map.num_frames();
   int num_landmarks = map.num_landmarks();
 
+  // The descriptors may be in a separate feature store
+  bool from_store = map.has_feature_store();
+
+  // Or quantized. In localization mode the codes are matched as they
+  // are, otherwise each frame is decoded once read.
+  if (map.has_quantizer() && !from_store) {
+    quantizer_ = std::make_shared<DescriptorQuantizer>();
+    quantizer_->LoadProtobuf(map.quantizer());
+    descriptors_are_codes_ = localization;
+  }
+  int code_depth = quantizer_ ? CV_8U : map.descriptor_depth();
+
   cid_to_filename_.resize(num_frames);
   cid_to_descriptor_map_.resize(num_frames);
   if (!localization) {
@@ -297,14 +530,14 @@ void SparseMap::Load(const std::string & protobuf_file, bool localization) {
 
     // Poke the first frame's first descriptor to see how long the
     // descriptor is.
-    if (frame.feature_size()) {
+    if (frame.feature_size() && !from_store) {
       size_t descriptor_length = frame.feature(0).description().size() /
-        cv::getElemSize(map.descriptor_depth());
+        cv::getElemSize(code_depth);
       cid_to_descriptor_map_[cid].create(frame.feature_size(),     // rows
                                          descriptor_length,        // columns
-                                         map.descriptor_depth());
+                                         code_depth);
     } else {
-      cid_to_descriptor_map_[cid].create(0, 0, map.descriptor_depth());
+      cid_to_descriptor_map_[cid].create(0, 0, code_depth);
     }
 
     for (int fid = 0; fid < frame.feature_size(); fid++) {
@@ -315,9 +548,14 @@ void SparseMap::Load(const std::string & protobuf_file, bool localization) {
         cid_to_keypoint_map_[cid].col(fid) << feature.x(), feature.y();
 
       // Copy the descriptors
-      memcpy(cid_to_descriptor_map_[cid].ptr<uint8_t>(fid),  // Destination
-             feature.description().data(),                   // Source
-             feature.description().size());                  // Length
+      if (!from_store)
+        memcpy(cid_to_descriptor_map_[cid].ptr<uint8_t>(fid),  // Destination
+               feature.description().data(),                   // Source
+               feature.description().size());                  // Length
+    }
+    if (quantizer_ && !descriptors_are_codes_) {
+      cv::Mat codes = cid_to_descriptor_map_[cid];
+      quantizer_->Decode(codes, &cid_to_descriptor_map_[cid]);
     }
 
     // Load pose
@@ -333,16 +571,29 @@ void SparseMap::Load(const std::string & protobuf_file, bool localization) {
     }
   }
 
+  if (from_store) {
+    feature_store_ = std::make_shared<FeatureStore>();
+    feature_store_->Open(map.feature_store(), static_cast<size_t>(FLAGS_feature_store_cache_mb) << 20);
+    if (feature_store_->NumFrames() < num_frames)
+      LOG(FATAL) << "The feature store " << map.feature_store() << " has fewer images than the map.";
+    // Only map building streams from the store
+    if (localization || FLAGS_feature_store.empty())
+      ReadFeatureStore();
+  }
+
   // if not, only feature detection step has been run... or something is wrong
   if (num_landmarks > 0) {
     pid_to_xyz_.resize(num_landmarks);
 
+    // In localization mode, collect the tracks in CSR form and keep
+    // only the track table.
+    std::vector<uint64_t> track_offsets;
+    std::vector<uint32_t> cid_fid;
     if (!localization) {
       pid_to_cid_fid_.resize(num_landmarks);
     } else {
-      // Create directly cid_fid_to_pid
-      cid_fid_to_pid_.clear();
-      cid_fid_to_pid_.resize(cid_to_filename_.size(), std::map<int, int>());
+      track_offsets.reserve(num_landmarks + 1);
+      track_offsets.push_back(0);
     }
 
     for (int i = 0; i < num_landmarks; i++) {
@@ -353,17 +604,22 @@ void SparseMap::Load(const std::string & protobuf_file, bool localization) {
       Eigen::Vector3d pos(l.loc().x(), l.loc().y(), l.loc().z());
       pid_to_xyz_[i] = pos;
       for (int j = 0; j < l.match_size(); j++) {
-        sparse_mapping_protobuf::Matching m = l.match(j);
-        if (!localization)
+        sparse_mapping_protobuf::Matching const& m = l.match(j);
+        if (!localization) {
           pid_to_cid_fid_[i][m.camera_id()] = m.feature_id();
-        else
-          cid_fid_to_pid_[m.camera_id()][m.feature_id()] = i;
+        } else {
+          cid_fid.push_back(m.camera_id());
+          cid_fid.push_back(m.feature_id());
+        }
       }
+      if (localization)
+        track_offsets.push_back(cid_fid.size() / 2);
     }
 
-    // If in localization mode, we already initialized cid_fid_to_pid_ right above.
     if (!localization)
       InitializeCidFidToPid();
+    else
+      tracks_.Build(cid_to_filename_.size(), num_landmarks, track_offsets.data(), cid_fid.data());
 
   } else {
     LOG(WARNING) << "There appear to be no landmarks in map file.";
@@ -378,16 +634,30 @@ void SparseMap::Load(const std::string & protobuf_file, bool localization) {
 
 void SparseMap::SetBriskParams(int min_features, int max_features, int threshold, int retries) {
   detector_.Reset(detector_.GetDetectorName(), min_features, max_features, threshold, retries);
+  localize_detectors_.reset();
 }
 
 void SparseMap::Save(const std::string & protobuf_file) const {
   sparse_mapping_protobuf::Map map;
   map.set_detector_name(detector_.GetDetectorName());
-  if (!cid_to_descriptor_map_.empty())
+  if (feature_store_)
+    map.set_descriptor_depth(CV_MAT_DEPTH(std::max(feature_store_->DescriptorType(), 0)));
+  else if (quantizer_)
+    map.set_descriptor_depth(CV_32F);
+  else if (!cid_to_descriptor_map_.empty())
     map.set_descriptor_depth(cid_to_descriptor_map_[0].depth());
   else
     map.set_descriptor_depth(0);
 
+  // While building with a feature store, refer to it rather than
+  // copying the descriptors in
+  bool to_store = feature_store_ && !FLAGS_feature_store.empty();
+  if (to_store)
+    map.set_feature_store(feature_store_->Filename());
+  bool quantize = quantizer_ && !to_store;
+  if (quantize)
+    quantizer_->SaveProtobuf(map.mutable_quantizer());
+
   sparse_mapping_protobuf::CameraModel* camera = map.mutable_camera();
   camera->add_focal_length(camera_params_.GetFocalVector()[0]);
   camera->add_focal_length(camera_params_.GetFocalVector()[1]);
@@ -432,13 +702,22 @@ void SparseMap::Save(const std::string & protobuf_file) const {
     }
 
     // set the features, required
+    cv::Mat descriptors;
+    if (!to_store)
+      descriptors = GetFrameDescriptors(cid);
+    if (quantize && !descriptors_are_codes_) {
+      cv::Mat full = descriptors;
+      quantizer_->Encode(full, &descriptors);
+    }
     for (int fid = 0; fid < cid_to_keypoint_map_[cid].cols(); fid++) {
       sparse_mapping_protobuf::Feature* f = frame.add_feature();
       f->set_x(cid_to_keypoint_map_[cid].col(fid).x());
       f->set_y(cid_to_keypoint_map_[cid].col(fid).y());
-      f->set_description(cid_to_descriptor_map_[cid].ptr<uint8_t>(fid),
-                         cid_to_descriptor_map_[cid].elemSize() *
-                         cid_to_descriptor_map_[cid].cols);
+      if (to_store)
+        f->set_description("");
+      else
+        f->set_description(descriptors.ptr<uint8_t>(fid),
+                           descriptors.elemSize() * descriptors.cols);
     }
 
     // set the camera pose if available.
@@ -507,6 +786,8 @@ void SparseMap::InitializeCidFidToPid() {
   sparse_mapping::InitializeCidFidToPid(cid_to_filename_.size(),
                                         pid_to_cid_fid_,
                                         &cid_fid_to_pid_);
+  tracks_.Build(cid_to_filename_.size(), pid_to_cid_fid_);
+  landmark_index_.reset();
 }
 
 void SparseMap::DetectFeaturesFromFile(std::string const& filename,
@@ -516,18 +797,79 @@ void SparseMap::DetectFeaturesFromFile(std::string const& filename,
   DetectFeatures(image, descriptors, keypoints);
 }
 
+cv::Mat SparseMap::GetFrameDescriptors(int frame) const {
+  if (feature_store_)
+    return feature_store_->Descriptors(frame);
+  return cid_to_descriptor_map_[frame];
+}
+
+void SparseMap::ReadFeatureStore() {
+  if (!feature_store_)
+    return;
+  for (size_t cid = 0; cid < cid_to_descriptor_map_.size(); cid++)
+    cid_to_descriptor_map_[cid] = feature_store_->Descriptors(cid);
+  feature_store_.reset();
+}
+
+void SparseMap::QuantizeDescriptors(std::string const& type, int num_subspaces) {
+  if (descriptors_are_codes_)
+    LOG(FATAL) << "The descriptors are already quantized, load the map without localization mode.";
+  DescriptorQuantizer::Type quantizer_type = DescriptorQuantizer::StringToType(type);
+  if (quantizer_type == DescriptorQuantizer::NONE) {
+    if (type != "NONE")
+      LOG(FATAL) << "Unknown descriptor quantization: " << type << ". Use SCALAR8, PQ, or NONE.";
+    quantizer_.reset();
+    return;
+  }
+  if (IsBinaryDescriptor(detector_.GetDetectorName()))
+    LOG(FATAL) << "Binary descriptors cannot be quantized.";
+
+  ReadFeatureStore();
+  quantizer_ = std::make_shared<DescriptorQuantizer>();
+  quantizer_->Train(cid_to_descriptor_map_, quantizer_type, num_subspaces);
+
+  // Keep in memory what a reload would give
+  for (cv::Mat & descriptors : cid_to_descriptor_map_) {
+    cv::Mat codes;
+    quantizer_->Encode(descriptors, &codes);
+    quantizer_->Decode(codes, &descriptors);
+  }
+  LOG(INFO) << "Quantized the descriptors with " << type << ", " << quantizer_->CodeSize()
+            << " bytes per descriptor instead of " << quantizer_->Dim() * sizeof(float) << ".";
+}
+
 void SparseMap::DetectFeatures(const cv::Mat & image, cv::Mat* descriptors,
                                Eigen::Matrix2Xd* keypoints) {
-  std::vector<cv::KeyPoint> storage;
-  detector_.Detect(image, &storage, descriptors);
-  keypoints->resize(2, storage.size());
-  Eigen::Vector2d output;
+  DetectFeatures(image, &detector_, descriptors, keypoints);
+}
 
-  for (size_t j = 0; j < storage.size(); j++) {
-    camera_params_.Convert<camera::DISTORTED_C, camera::UNDISTORTED_C>
-      (Eigen::Vector2d(storage[j].pt.x, storage[j].pt.y), &output);
-    keypoints->col(j) = output;
+void SparseMap::DetectFeaturesToLocalize(const cv::Mat & image, cv::Mat* descriptors,
+                                         Eigen::Matrix2Xd* keypoints) {
+  // Set up once, as the threads localizing against this map may all
+  // arrive at the same time
+  std::shared_ptr<DetectorPool> detectors = std::atomic_load(&localize_detectors_);
+  if (!detectors) {
+    std::shared_ptr<DetectorPool> fresh = std::make_shared<DetectorPool>(detector_, 0);
+    if (std::atomic_compare_exchange_strong(&localize_detectors_, &detectors, fresh))
+      detectors = fresh;
   }
+  interest_point::FeatureDetector* detector = detectors->Acquire();
+  DetectFeatures(image, detector, descriptors, keypoints);
+  detectors->Release(detector);
+}
+
+LocalizeStats const& SparseMap::GetLocalizeStats() const {
+  return ThreadLocalizeStats();
+}
+
+void SparseMap::DetectFeatures(const cv::Mat & image,
+                               interest_point::FeatureDetector* detector,
+                               cv::Mat* descriptors,
+                               Eigen::Matrix2Xd* keypoints) const {
+  ScopedStageTimer timer("detect");
+  std::vector<cv::KeyPoint> storage;
+  detector->Detect(image, &storage, descriptors);
+  UndistortKeypoints(camera_params_, storage, keypoints);
 }
 
 // A non-member Localize() function that can be invoked for a non-fully
@@ -544,20 +886,47 @@ bool Localize(cv::Mat const& test_descriptors,
               int num_similar,
               std::vector<std::string> const& cid_to_filename,
               std::vector<cv::Mat> const& cid_to_descriptor_map,
-              std::vector<std::map<int, int> > const& cid_fid_to_pid,
+              sparse_mapping::TrackTable const& tracks,
               std::vector<Eigen::Vector3d> const& pid_to_xyz,
-              int num_ransac_iterations, int ransac_inlier_tolerance) {
-  // Query the vocab tree.
+              int num_ransac_iterations, int ransac_inlier_tolerance,
+              interest_point::MatcherCache * matcher_cache,
+              DescriptorQuantizer const* quantizer,
+              std::vector<int> const* gated_cids,
+              LocalizeStats* stats) {
+  // Query the vocab tree, unless the gate leaves no more images than
+  // it would return.
   std::vector<int> indices;
-  sparse_mapping::QueryDB(detector_name,
-                          vocab_db,
-                          // Notice that we request more similar
-                          // images than what we need. We'll prune
-                          // them below.
-                          num_similar + FLAGS_num_extra_localization_db_images,
-                          test_descriptors,
-                          &indices);
-  if (indices.empty()) {
+  int num_query = num_similar + FLAGS_num_extra_localization_db_images;
+  if (gated_cids && static_cast<int>(gated_cids->size()) <= num_query) {
+    indices = *gated_cids;
+  } else {
+    ScopedStageTimer timer("query_db");
+    sparse_mapping::QueryDB(detector_name,
+                            vocab_db,
+                            // Notice that we request more similar
+                            // images than what we need. We'll prune
+                            // them below.
+                            num_query,
+                            test_descriptors,
+                            &indices);
+  }
+  if (gated_cids && !indices.empty() && static_cast<int>(gated_cids->size()) > num_query) {
+    // Keep only the gated ones, or the nearest gated images if the
+    // tree ranked none of them.
+    std::set<int> gated(gated_cids->begin(), gated_cids->end());
+    std::vector<int> indices2;
+    for (size_t i = 0; i < indices.size(); i++) {
+      if (gated.count(indices[i]))
+        indices2.push_back(indices[i]);
+    }
+    if (indices2.empty())
+      indices2.assign(gated_cids->begin(), gated_cids->begin() + num_query);
+    indices = indices2;
+  }
+  if (indices.empty() && gated_cids) {
+    // No tree, use all the gated images
+    indices = *gated_cids;
+  } else if (indices.empty()) {
     LOG(WARNING) << "Localizing against all keyframes.";
     // Use all images, as no tree is available.
     for (int cid = 0; cid < num_cid; cid++)
@@ -588,21 +957,33 @@ bool Localize(cv::Mat const& test_descriptors,
   std::vector<int> similarity_rank(indices.size(), 0);
   std::vector<std::vector<cv::DMatch> > all_matches(indices.size());
   int total = 0;
-  for (size_t i = 0; i < indices.size(); i++) {
-    int cid = indices[i];
-    interest_point::FindMatches(test_descriptors,
-                                cid_to_descriptor_map[cid],
-                                &all_matches[i]);
-
-    for (size_t j = 0; j < all_matches[i].size(); j++) {
-      if (cid_fid_to_pid[cid].count(all_matches[i][j].trainIdx) == 0) {
-        continue;
+  size_t num_matched = 0;
+  {
+    ScopedStageTimer timer("match");
+    for (size_t i = 0; i < indices.size(); i++) {
+      num_matched++;
+      int cid = indices[i];
+      if (quantizer)
+        quantizer->FindMatches(test_descriptors, cid_to_descriptor_map[cid], &all_matches[i]);
+      else if (matcher_cache)
+        matcher_cache->FindMatches(test_descriptors, cid,
+                                   cid_to_descriptor_map[cid],
+                                   &all_matches[i]);
+      else
+        interest_point::FindMatches(test_descriptors,
+                                    cid_to_descriptor_map[cid],
+                                    &all_matches[i]);
+
+      for (size_t j = 0; j < all_matches[i].size(); j++) {
+        if (!tracks.HasPid(cid, all_matches[i][j].trainIdx)) {
+          continue;
+        }
+        similarity_rank[i]++;
       }
-      similarity_rank[i]++;
+      total += similarity_rank[i];
+      if (total >= FLAGS_early_break_landmarks)
+        break;
     }
-    total += similarity_rank[i];
-    if (total >= FLAGS_early_break_landmarks)
-      break;
   }
 
   // TODO(oalexan1): Just finding matches among the images may not be
@@ -612,6 +993,7 @@ bool Localize(cv::Mat const& test_descriptors,
 
   std::vector<Eigen::Vector2d> observations;
   std::vector<Eigen::Vector3d> landmarks;
+  std::vector<double> match_distances;
   std::vector<int> highly_ranked = common::rv_order(similarity_rank);
   int end = std::min(static_cast<int>(highly_ranked.size()), num_similar);
   for (int i = 0; i < end; i++) {
@@ -619,21 +1001,36 @@ bool Localize(cv::Mat const& test_descriptors,
     if (FLAGS_verbose_localization) std::cout << " " << cid_to_filename[cid];
     std::vector<cv::DMatch>* matches = &all_matches[highly_ranked[i]];
     for (size_t j = 0; j < matches->size(); j++) {
-      if (cid_fid_to_pid[cid].count(matches->at(j).trainIdx) == 0)
+      const int landmark_id = tracks.Pid(cid, matches->at(j).trainIdx);
+      if (landmark_id < 0)
         continue;
       Eigen::Vector2d obs(test_keypoints.col(matches->at(j).queryIdx)[0],
                           test_keypoints.col(matches->at(j).queryIdx)[1]);
       observations.push_back(obs);
-      const int landmark_id = cid_fid_to_pid.at(cid).at(matches->at(j).trainIdx);
       landmarks.push_back(pid_to_xyz[landmark_id]);
+      match_distances.push_back(matches->at(j).distance);
     }
   }
   if (FLAGS_verbose_localization) std::cout << std::endl;
 
+  std::vector<Eigen::Vector3d> local_landmarks;
+  std::vector<Eigen::Vector2d> local_observations;
+  int iterations = 0;
   int ret = RansacEstimateCamera(landmarks, observations,
         num_ransac_iterations,
         ransac_inlier_tolerance, pose,
-        inlier_landmarks, inlier_observations);
+        &local_landmarks, &local_observations,
+        &match_distances, &iterations);
+  if (inlier_landmarks)
+    inlier_landmarks->insert(inlier_landmarks->end(), local_landmarks.begin(), local_landmarks.end());
+  if (inlier_observations)
+    inlier_observations->insert(inlier_observations->end(), local_observations.begin(), local_observations.end());
+  if (stats) {
+    stats->num_candidates = num_matched;
+    stats->num_matches = landmarks.size();
+    stats->num_ransac_iterations = iterations;
+    stats->num_inliers = local_landmarks.size();
+  }
   return (ret == 0);
 }
 
@@ -644,7 +1041,7 @@ bool SparseMap::Localize(std::string const& img_file,
   cv::Mat test_descriptors;
   Eigen::Matrix2Xd test_keypoints;
   int max_cid_to_use = -1;
-  DetectFeaturesFromFile(img_file, &test_descriptors, &test_keypoints);
+  DetectFeaturesToLocalize(cv::imread(img_file, CV_LOAD_IMAGE_GRAYSCALE), &test_descriptors, &test_keypoints);
   return sparse_mapping::Localize(test_descriptors, test_keypoints, pose,
                                   inlier_landmarks, inlier_observations,
                                   cid_to_filename_.size(),
@@ -654,61 +1051,61 @@ bool SparseMap::Localize(std::string const& img_file,
                                   num_similar_,
                                   cid_to_filename_,
                                   cid_to_descriptor_map_,
-                                  cid_fid_to_pid_,
+                                  tracks_,
                                   pid_to_xyz_,
                                   num_ransac_iterations_,
-                                  ransac_inlier_tolerance_);
+                                  ransac_inlier_tolerance_,
+                                  &matcher_cache_,
+                                  descriptors_are_codes_ ? quantizer_.get() : NULL,
+                                  NULL, &ThreadLocalizeStats());
 }
 
 // delete all the features that do not match to a landmark but are still around!
 void SparseMap::PruneMap(void) {
-  for (unsigned int cid = 0; cid < cid_fid_to_pid_.size(); cid++) {
-    std::vector<int> deleted_features;
-    for (int fid = 0; fid < cid_to_descriptor_map_[cid].rows; fid++) {
+  // The descriptors are renumbered below
+  ReadFeatureStore();
+  for (int cid = 0; cid < static_cast<int>(tracks_.NumFrames()); cid++) {
+    int num_fid = cid_to_descriptor_map_[cid].rows;
+    std::vector<int> new_fid(num_fid, -1);
+    int num_kept = 0;
+    for (int fid = 0; fid < num_fid; fid++) {
       // delete if no matching landmark!
-      if (cid_fid_to_pid_[cid].count(fid) == 0) {
-        deleted_features.push_back(fid);
-      }
+      if (tracks_.HasPid(cid, fid))
+        new_fid[fid] = num_kept++;
     }
-    if (deleted_features.size() == 0)
+    if (num_kept == num_fid)
       continue;
+
     // create new descriptor map
     cv::Mat next_descriptor_map;
-    next_descriptor_map.create(cid_to_descriptor_map_[cid].rows - deleted_features.size(),
-                               cid_to_descriptor_map_[cid].cols, cid_to_descriptor_map_[cid].depth());
-    int cur_row = 0;
-    for (int fid = 0; fid < cid_to_descriptor_map_[cid].rows; fid++) {
-      // delete if no matching landmark!
-      if (cid_fid_to_pid_[cid].count(fid) == 0) {
-        continue;
-      } else {
-        cid_to_descriptor_map_[cid].row(fid).copyTo(next_descriptor_map.row(cur_row));
-        // fix indexing
-        cid_fid_to_pid_[cid][cur_row] = cid_fid_to_pid_[cid][fid];
-        // in localization mode this is empty
-        if (pid_to_cid_fid_.size() > 0)
-          pid_to_cid_fid_[cid_fid_to_pid_[cid][fid]][cid] = cur_row;
-        cid_fid_to_pid_[cid].erase(fid);
-        cur_row++;
-      }
+    next_descriptor_map.create(num_kept, cid_to_descriptor_map_[cid].cols, cid_to_descriptor_map_[cid].type());
+    for (int fid = 0; fid < num_fid; fid++) {
+      if (new_fid[fid] >= 0)
+        cid_to_descriptor_map_[cid].row(fid).copyTo(next_descriptor_map.row(new_fid[fid]));
     }
     cid_to_descriptor_map_[cid] = next_descriptor_map;
 
-    // clean up other stuff
-    cur_row = 0;
-    for (int i = static_cast<int>(deleted_features.size() - 1); i >= 0; i--) {
-      int fid = deleted_features[i];
-      // these may not always exist if localizing
-      if (cid_to_keypoint_map_.size() > 0) {
-        int rows = cid_to_keypoint_map_[cid].rows();
-        int cols = cid_to_keypoint_map_[cid].cols();
-        if (fid < rows - 1)
-          cid_to_keypoint_map_[cid].block(0, fid, rows, cols - 1 - fid) =
-            cid_to_keypoint_map_[cid].block(0, fid + 1, rows, cols - 1 - fid);
-        cid_to_keypoint_map_[cid].conservativeResize(rows, cols - 1);
+    // these may not always exist if localizing
+    if (cid_to_keypoint_map_.size() > 0) {
+      Eigen::Matrix2Xd next_keypoints(2, num_kept);
+      for (int fid = 0; fid < num_fid; fid++) {
+        if (new_fid[fid] >= 0)
+          next_keypoints.col(new_fid[fid]) = cid_to_keypoint_map_[cid].col(fid);
       }
+      cid_to_keypoint_map_[cid] = next_keypoints;
+    }
+
+    // fix indexing, in localization mode pid_to_cid_fid_ is empty
+    for (int fid = 0; fid < num_fid; fid++) {
+      int pid = tracks_.Pid(cid, fid);
+      if (pid >= 0 && pid_to_cid_fid_.size() > 0)
+        pid_to_cid_fid_[pid][cid] = new_fid[fid];
     }
+    tracks_.RenumberFeatures(cid, new_fid);
   }
+
+  if (pid_to_cid_fid_.size() > 0)
+    sparse_mapping::InitializeCidFidToPid(cid_to_filename_.size(), pid_to_cid_fid_, &cid_fid_to_pid_);
 }
 
 bool SparseMap::Localize(const cv::Mat & image, camera::CameraModel* pose,
@@ -716,7 +1113,7 @@ bool SparseMap::Localize(const cv::Mat & image, camera::CameraModel* pose,
                          std::vector<Eigen::Vector2d>* inlier_observations) {
   cv::Mat test_descriptors;
   Eigen::Matrix2Xd test_keypoints;
-  DetectFeatures(image, &test_descriptors, &test_keypoints);
+  DetectFeaturesToLocalize(image, &test_descriptors, &test_keypoints);
   int max_cid_to_use = -1;
   return sparse_mapping::Localize(test_descriptors, test_keypoints, pose,
                                   inlier_landmarks, inlier_observations,
@@ -727,16 +1124,25 @@ bool SparseMap::Localize(const cv::Mat & image, camera::CameraModel* pose,
                                   num_similar_,
                                   cid_to_filename_,
                                   cid_to_descriptor_map_,
-                                  cid_fid_to_pid_,
+                                  tracks_,
                                   pid_to_xyz_,
                                   num_ransac_iterations_,
-                                  ransac_inlier_tolerance_);
+                                  ransac_inlier_tolerance_,
+                                  &matcher_cache_,
+                                  descriptors_are_codes_ ? quantizer_.get() : NULL,
+                                  NULL, &ThreadLocalizeStats());
 }
 
 bool SparseMap::Localize(const cv::Mat & test_descriptors, const Eigen::Matrix2Xd & test_keypoints,
                          camera::CameraModel* pose,
                          std::vector<Eigen::Vector3d>* inlier_landmarks,
                          std::vector<Eigen::Vector2d>* inlier_observations) {
+  if (landmark_matching_ || FLAGS_landmark_matching) {
+    if (vocab_db_.binary_db != NULL && !descriptors_are_codes_ && test_descriptors.depth() == CV_8U)
+      return LocalizeWithLandmarks(test_descriptors, test_keypoints, pose, inlier_landmarks, inlier_observations);
+    LOG_FIRST_N(WARNING, 1) << "Landmark matching needs a vocabulary database and binary descriptors "
+                            << "which are not quantized, matching to map images instead.";
+  }
   int max_cid_to_use = -1;
   return sparse_mapping::Localize(test_descriptors, test_keypoints, pose,
                                   inlier_landmarks, inlier_observations,
@@ -747,10 +1153,336 @@ bool SparseMap::Localize(const cv::Mat & test_descriptors, const Eigen::Matrix2X
                                   num_similar_,
                                   cid_to_filename_,
                                   cid_to_descriptor_map_,
-                                  cid_fid_to_pid_,
+                                  tracks_,
                                   pid_to_xyz_,
                                   num_ransac_iterations_,
-                                  ransac_inlier_tolerance_);
+                                  ransac_inlier_tolerance_,
+                                  &matcher_cache_,
+                                  descriptors_are_codes_ ? quantizer_.get() : NULL,
+                                  NULL, &ThreadLocalizeStats());
+}
+
+std::shared_ptr<LandmarkIndex> SparseMap::GetLandmarkIndex() {
+  std::shared_ptr<LandmarkIndex> index = std::atomic_load(&landmark_index_);
+  if (index)
+    return index;
+  // Building takes a while, so the other threads wait for it rather
+  // than each building their own
+  std::lock_guard<std::mutex> lock(landmark_index_mutex);
+  index = std::atomic_load(&landmark_index_);
+  if (index)
+    return index;
+  LandmarkIndex::Options options;
+  options.max_descriptors = FLAGS_landmark_descriptors;
+  options.max_distance = FLAGS_hamming_distance;
+  options.ratio = FLAGS_goodness_ratio;
+  options.active_cameras = FLAGS_landmark_active_cameras;
+  index = std::make_shared<LandmarkIndex>();
+  index->Build(*this, [this](cv::Mat const& descriptors, std::vector<int>* words) {
+      QuantizeDB(vocab_db_, FLAGS_landmark_levels_up, descriptors, words);
+    }, options);
+  std::atomic_store(&landmark_index_, index);
+  return index;
+}
+
+bool SparseMap::LocalizeWithLandmarks(const cv::Mat & test_descriptors, const Eigen::Matrix2Xd & test_keypoints,
+                                      camera::CameraModel* pose,
+                                      std::vector<Eigen::Vector3d>* inlier_landmarks,
+                                      std::vector<Eigen::Vector2d>* inlier_observations) {
+  LocalizeStats & stats = ThreadLocalizeStats();
+  stats = LocalizeStats();
+  std::shared_ptr<LandmarkIndex> index = GetLandmarkIndex();
+
+  std::vector<int> words;
+  {
+    ScopedStageTimer timer("query_db");
+    QuantizeDB(vocab_db_, FLAGS_landmark_levels_up, test_descriptors, &words);
+  }
+  std::vector<LandmarkIndex::Match> matches;
+  int num_active = 0;
+  {
+    ScopedStageTimer timer("match");
+    index->FindMatches(*this, test_descriptors, words, &matches, &num_active, &stats.num_candidates);
+  }
+  if (FLAGS_verbose_localization)
+    LOG(INFO) << matches.size() << " landmarks matched, " << num_active << " of them searched for from "
+              << stats.num_candidates << " map images.";
+
+  std::vector<Eigen::Vector2d> observations;
+  std::vector<Eigen::Vector3d> landmarks;
+  std::vector<double> match_distances;
+  for (LandmarkIndex::Match const& m : matches) {
+    observations.push_back(test_keypoints.col(m.query));
+    landmarks.push_back(pid_to_xyz_[m.pid]);
+    match_distances.push_back(m.distance);
+  }
+
+  std::vector<Eigen::Vector3d> local_landmarks;
+  std::vector<Eigen::Vector2d> local_observations;
+  int ret = RansacEstimateCamera(landmarks, observations,
+        num_ransac_iterations_, ransac_inlier_tolerance_, pose,
+        &local_landmarks, &local_observations,
+        &match_distances, &stats.num_ransac_iterations);
+  if (inlier_landmarks)
+    inlier_landmarks->insert(inlier_landmarks->end(), local_landmarks.begin(), local_landmarks.end());
+  if (inlier_observations)
+    inlier_observations->insert(inlier_observations->end(), local_observations.begin(), local_observations.end());
+  stats.num_matches = landmarks.size();
+  stats.num_inliers = local_landmarks.size();
+  return (ret == 0);
+}
+
+bool SparseMap::Localize(const cv::Mat & test_descriptors, const Eigen::Matrix2Xd & test_keypoints,
+                         CameraGate const& gate, camera::CameraModel* pose,
+                         std::vector<Eigen::Vector3d>* inlier_landmarks,
+                         std::vector<Eigen::Vector2d>* inlier_observations) {
+  std::vector<int> cids;
+  CamerasInGate(gate, &cids);
+  if (cids.empty()) {
+    ThreadLocalizeStats() = LocalizeStats();
+    return false;
+  }
+  int max_cid_to_use = -1;
+  return sparse_mapping::Localize(test_descriptors, test_keypoints, pose,
+                                  inlier_landmarks, inlier_observations,
+                                  cid_to_filename_.size(),
+                                  max_cid_to_use,
+                                  detector_.GetDetectorName(),
+                                  &vocab_db_,
+                                  num_similar_,
+                                  cid_to_filename_,
+                                  cid_to_descriptor_map_,
+                                  tracks_,
+                                  pid_to_xyz_,
+                                  num_ransac_iterations_,
+                                  ransac_inlier_tolerance_,
+                                  &matcher_cache_,
+                                  descriptors_are_codes_ ? quantizer_.get() : NULL,
+                                  &cids, &ThreadLocalizeStats());
+}
+
+void SparseMap::BuildCameraGrid() {
+  CameraGrid & grid = camera_grid_;
+  int num_cid = cid_to_cam_t_global_.size();
+  std::vector<Eigen::Vector3d> centers(num_cid);
+  for (int cid = 0; cid < num_cid; cid++)
+    centers[cid] = cid_to_cam_t_global_[cid].inverse().translation();
+
+  // Cells of half a meter, or larger so the grid is at most 64 cells on
+  // a side.
+  Eigen::Vector3d upper(0, 0, 0);
+  grid.corner = Eigen::Vector3d(0, 0, 0);
+  if (num_cid > 0) {
+    grid.corner = centers[0];
+    upper = centers[0];
+  }
+  for (int cid = 1; cid < num_cid; cid++) {
+    grid.corner = grid.corner.cwiseMin(centers[cid]);
+    upper = upper.cwiseMax(centers[cid]);
+  }
+  grid.cell_size = std::max(0.5, (upper - grid.corner).maxCoeff() / 64);
+  for (int i = 0; i < 3; i++)
+    grid.dims[i] = static_cast<int>((upper[i] - grid.corner[i]) / grid.cell_size) + 1;
+
+  grid.cells.clear();
+  grid.cells.resize(grid.dims[0] * grid.dims[1] * grid.dims[2]);
+  for (int cid = 0; cid < num_cid; cid++) {
+    int cell = 0;
+    for (int i = 2; i >= 0; i--)
+      cell = cell * grid.dims[i] + static_cast<int>((centers[cid][i] - grid.corner[i]) / grid.cell_size);
+    grid.cells[cell].push_back(cid);
+  }
+}
+
+void SparseMap::CamerasInGate(CameraGate const& gate, std::vector<int>* cids) {
+  cids->clear();
+  if (cid_to_cam_t_global_.empty())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(camera_grid_mutex);
+    if (camera_grid_.cells.empty())
+      BuildCameraGrid();
+  }
+  CameraGrid const& grid = camera_grid_;
+
+  // The cells the sphere around the center overlaps
+  int lower[3], upper[3];
+  for (int i = 0; i < 3; i++) {
+    lower[i] = std::max(0, static_cast<int>(std::floor((gate.center[i] - gate.max_distance - grid.corner[i])
+                                                       / grid.cell_size)));
+    upper[i] = std::min(grid.dims[i] - 1, static_cast<int>(std::floor((gate.center[i] + gate.max_distance
+                                                                       - grid.corner[i]) / grid.cell_size)));
+  }
+
+  double min_cos = std::cos(std::min(gate.max_angle, M_PI));
+  Eigen::Vector3d direction = gate.direction.normalized();
+  std::vector<std::pair<double, int> > found;
+  for (int z = lower[2]; z <= upper[2]; z++) {
+    for (int y = lower[1]; y <= upper[1]; y++) {
+      for (int x = lower[0]; x <= upper[0]; x++) {
+        for (int cid : grid.cells[(z * grid.dims[1] + y) * grid.dims[0] + x]) {
+          Eigen::Affine3d const& cam_t_global = cid_to_cam_t_global_[cid];
+          // the camera center, and its optical axis in the world
+          Eigen::Vector3d center = -cam_t_global.linear().transpose() * cam_t_global.translation();
+          double dist = (center - gate.center).norm();
+          if (dist > gate.max_distance)
+            continue;
+          if (cam_t_global.linear().row(2).dot(direction) < min_cos)
+            continue;
+          found.push_back(std::make_pair(dist, cid));
+        }
+      }
+    }
+  }
+  std::sort(found.begin(), found.end());
+  cids->reserve(found.size());
+  for (size_t i = 0; i < found.size(); i++)
+    cids->push_back(found[i].second);
+}
+
+// Distance between two descriptor rows, Hamming for binary
+// descriptors and L2 otherwise.
+static double DescriptorDistance(cv::Mat const& a, int row_a, cv::Mat const& b, int row_b) {
+  if (a.depth() == CV_8U)
+    return interest_point::HammingDistance(a.ptr<uint8_t>(row_a), b.ptr<uint8_t>(row_b), a.cols);
+  return cv::norm(a.row(row_a), b.row(row_b), cv::NORM_L2);
+}
+
+bool SparseMap::LocalizeFromPrior(const cv::Mat & test_descriptors, const Eigen::Matrix2Xd & test_keypoints,
+                                  camera::CameraModel* pose,
+                                  std::vector<Eigen::Vector3d>* inlier_landmarks,
+                                  std::vector<Eigen::Vector2d>* inlier_observations) {
+  ThreadLocalizeStats() = LocalizeStats();
+  int num_keypoints = test_keypoints.cols();
+  if (num_keypoints == 0 || tracks_.Empty())
+    return false;
+
+  // The temporaries of this frame are given back on return
+  common::Arena& arena = common::FrameArena();
+  common::ArenaScope scope(&arena);
+  common::ArenaAllocator<int> alloc(&arena);
+
+  // Bucket the keypoints in square cells as large as the search
+  // radius, so each landmark only looks at its 3x3 neighborhood. The
+  // keypoints are sorted by cell, those of cell c being from
+  // cell_start[c] to cell_start[c + 1].
+  double radius = std::max(1.0, FLAGS_tracking_search_radius);
+  Eigen::Vector2d corner = test_keypoints.rowwise().minCoeff();
+  Eigen::Vector2d extent = test_keypoints.rowwise().maxCoeff() - corner;
+  int grid_cols = static_cast<int>(extent.x() / radius) + 1;
+  int grid_rows = static_cast<int>(extent.y() / radius) + 1;
+  common::ArenaVector<int> cell(num_keypoints, 0, alloc);
+  common::ArenaVector<int> cell_start(grid_cols * grid_rows + 1, 0, alloc);
+  for (int i = 0; i < num_keypoints; i++) {
+    int gx = static_cast<int>((test_keypoints(0, i) - corner.x()) / radius);
+    int gy = static_cast<int>((test_keypoints(1, i) - corner.y()) / radius);
+    cell[i] = gy * grid_cols + gx;
+    cell_start[cell[i] + 1]++;
+  }
+  for (int c = 0; c < grid_cols * grid_rows; c++)
+    cell_start[c + 1] += cell_start[c];
+  common::ArenaVector<int> grid(num_keypoints, 0, alloc);
+  common::ArenaVector<int> cell_end(cell_start.begin(), cell_start.end() - 1, alloc);
+  for (int i = 0; i < num_keypoints; i++)
+    grid[cell_end[cell[i]]++] = i;
+
+  // For each keypoint, the closest landmark projected near it
+  ScopedStageTimer match_timer("match");
+  common::ArenaVector<int> best_pid(num_keypoints, -1, alloc);
+  common::ArenaVector<double> best_dist(num_keypoints, std::numeric_limits<double>::max(),
+                                        common::ArenaAllocator<double>(&arena));
+  // Distance tables to the map codes, made once per keypoint as needed
+  std::vector<std::vector<float> > tables(num_keypoints);
+
+  Eigen::Affine3d const& cam_t_global = pose->GetTransform();
+  Eigen::Vector2d const& focal = camera_params_.GetFocalVector();
+  Eigen::Vector2d const& half_size = camera_params_.GetUndistortedHalfSize();
+  double radius_sq = radius * radius;
+  for (size_t pid = 0; pid < pid_to_xyz_.size(); pid++) {
+    Eigen::Vector3d X = cam_t_global * pid_to_xyz_[pid];
+    if (X.z() <= 0)
+      continue;
+    Eigen::Vector2d pix = focal.cwiseProduct(X.hnormalized());
+    if (std::abs(pix.x()) > half_size.x() || std::abs(pix.y()) > half_size.y())
+      continue;
+
+    int gx = static_cast<int>(std::floor((pix.x() - corner.x()) / radius));
+    int gy = static_cast<int>(std::floor((pix.y() - corner.y()) / radius));
+    if (gx < -1 || gx > grid_cols || gy < -1 || gy > grid_rows)
+      continue;
+
+    // Compare against every map view of the landmark, keep the best
+    // and second best keypoints.
+    int first = -1;
+    double first_dist = std::numeric_limits<double>::max();
+    double second_dist = std::numeric_limits<double>::max();
+    for (int y = std::max(gy - 1, 0); y <= std::min(gy + 1, grid_rows - 1); y++) {
+      for (int x = std::max(gx - 1, 0); x <= std::min(gx + 1, grid_cols - 1); x++) {
+        for (int k = cell_start[y * grid_cols + x]; k < cell_start[y * grid_cols + x + 1]; k++) {
+          int i = grid[k];
+          if ((test_keypoints.col(i) - pix).squaredNorm() > radius_sq)
+            continue;
+          if (descriptors_are_codes_ && tables[i].empty())
+            quantizer_->DistanceTable(test_descriptors.ptr<float>(i), &tables[i]);
+          double dist = std::numeric_limits<double>::max();
+          for (const TrackTable::Observation* it = tracks_.TrackBegin(pid); it != tracks_.TrackEnd(pid); it++) {
+            cv::Mat const& map_descriptors = cid_to_descriptor_map_[it->cid];
+            if (descriptors_are_codes_)
+              dist = std::min(dist, quantizer_->Distance(test_descriptors.ptr<float>(i), tables[i],
+                                                         map_descriptors.ptr<uint8_t>(it->fid)));
+            else
+              dist = std::min(dist, DescriptorDistance(test_descriptors, i, map_descriptors, it->fid));
+          }
+          if (dist < first_dist) {
+            second_dist = first_dist;
+            first_dist = dist;
+            first = i;
+          } else if (dist < second_dist) {
+            second_dist = dist;
+          }
+        }
+      }
+    }
+    if (first < 0 || first_dist > FLAGS_tracking_ratio * second_dist)
+      continue;
+    if (first_dist < best_dist[first]) {
+      best_dist[first] = first_dist;
+      best_pid[first] = pid;
+    }
+  }
+
+  std::vector<Eigen::Vector3d> landmarks;
+  std::vector<Eigen::Vector2d> observations;
+  std::vector<double> match_distances;
+  for (int i = 0; i < num_keypoints; i++) {
+    if (best_pid[i] < 0)
+      continue;
+    landmarks.push_back(pid_to_xyz_[best_pid[i]]);
+    observations.push_back(test_keypoints.col(i));
+    match_distances.push_back(best_dist[i]);
+  }
+  ThreadLocalizeStats().num_matches = landmarks.size();
+  if (static_cast<int>(landmarks.size()) < FLAGS_tracking_min_inliers)
+    return false;
+
+  std::vector<Eigen::Vector3d> local_landmarks;
+  std::vector<Eigen::Vector2d> local_observations;
+  camera::CameraModel estimate(*pose);
+  int ret = RansacEstimateCamera(landmarks, observations, num_ransac_iterations_, ransac_inlier_tolerance_,
+                                 &estimate, &local_landmarks, &local_observations, &match_distances,
+                                 &ThreadLocalizeStats().num_ransac_iterations);
+  ThreadLocalizeStats().num_inliers = local_landmarks.size();
+  if (ret != 0)
+    return false;
+  if (static_cast<int>(local_landmarks.size()) < FLAGS_tracking_min_inliers)
+    return false;
+
+  *pose = estimate;
+  if (inlier_landmarks)
+    inlier_landmarks->insert(inlier_landmarks->end(), local_landmarks.begin(), local_landmarks.end());
+  if (inlier_observations)
+    inlier_observations->insert(inlier_observations->end(), local_observations.begin(), local_observations.end());
+  return true;
 }
 
 }  // namespace sparse_mapping
@@ -35,8 +35,11 @@
 #include <openMVG/tracks/tracks.hpp>
 #pragma GCC diagnostic pop
 
+#include <common/thread.h>
 #include <common/utils.h>
 
+#include <algorithm>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <set>
@@ -1022,6 +1025,37 @@ double sparse_mapping::ComputeRaysAngle(int pid,
   return max_angle;
 }
 
+void sparse_mapping::RemovePIDs(std::vector<uint8_t> const& is_bad,
+                                std::vector<std::map<int, int> > * pid_to_cid_fid,
+                                std::vector<Eigen::Vector3d> * pid_to_xyz) {
+  // Compact in place, rather than erasing one point at a time, which
+  // takes quadratic time
+  size_t num_kept = 0;
+  for (size_t pid = 0; pid < pid_to_xyz->size(); pid++) {
+    if (is_bad[pid])
+      continue;
+    if (num_kept != pid) {
+      (*pid_to_cid_fid)[num_kept].swap((*pid_to_cid_fid)[pid]);
+      (*pid_to_xyz)[num_kept] = (*pid_to_xyz)[pid];
+    }
+    num_kept++;
+  }
+  pid_to_cid_fid->resize(num_kept);
+  pid_to_xyz->resize(num_kept);
+}
+
+namespace {
+  // Points are handed to the threads in blocks this large
+  const size_t kPidBlock = 1024;
+
+  // Why a point is dropped
+  enum FilterFlags : uint8_t {
+    SMALL_ANGLE    = 1,
+    BEHIND_CAM     = 2,
+    INVALID_REPROJ = 4
+  };
+}  // namespace
+
 void sparse_mapping::FilterPID(double reproj_thresh,
                                camera::CameraParameters const& camera_params,
                                std::vector<Eigen::Affine3d > const& cid_to_cam_t_global,
@@ -1032,9 +1066,6 @@ void sparse_mapping::FilterPID(double reproj_thresh,
   // Remove points that don't project at valid camera pixels,
   // points behind the camera, and matches having large reprojection error.
 
-  // Reprojection error at each match point.
-  std::vector<double> errors;
-
   int num_cams = cid_to_cam_t_global.size();
   std::vector<Eigen::Vector3d> cam_ctrs(num_cams);
   for (int cid = 0; cid < num_cams; cid++) {
@@ -1045,90 +1076,96 @@ void sparse_mapping::FilterPID(double reproj_thresh,
   sparse_mapping::FilterStats s;
   s.total = (*pid_to_xyz).size();
 
-  std::vector<bool> is_bad((*pid_to_xyz).size(), false);
+  // Each thread writes the flags of its own points, bytes rather than a
+  // vector<bool> whose neighboring elements share a word, and the
+  // reprojection errors of each block are kept apart and joined in
+  // block order, so nothing depends on which thread did what.
+  size_t num_pid = pid_to_xyz->size();
+  size_t num_blocks = (num_pid + kPidBlock - 1) / kPidBlock;
+  size_t num_threads = std::max(1, static_cast<int>(FLAGS_num_threads));
+  std::vector<uint8_t> flags(num_pid, 0);
+  std::vector<std::vector<double> > block_errors(num_blocks);
   Eigen::Vector2d half_size = camera_params.GetUndistortedHalfSize();
-  for (size_t pid = 0; pid < (*pid_to_xyz).size(); pid++) {
-    bool small_angle = false, behind_cam = false, invalid_reproj = false;
-
-    double max_angle
-      = sparse_mapping::ComputeRaysAngle(pid, *pid_to_cid_fid,
-                                         cam_ctrs,  *pid_to_xyz);
-    if (max_angle < FLAGS_min_valid_angle) {
-      small_angle = true;
-      is_bad[pid] = true;
-    }
-
-    for (std::pair<int, int> cid_fid : (*pid_to_cid_fid)[pid]) {
-      Eigen::Vector2d pix = (cid_to_cam_t_global[cid_fid.first] *
-                             (*pid_to_xyz)[pid]).hnormalized() * camera_params.GetFocalLength();
-      errors.push_back((cid_to_keypoint_map[cid_fid.first].col(cid_fid.second) - pix).norm());
-      // Mark points which don't project at valid camera pixels
-      // TODO(zmoratto) : This can probably be done with a Eigen Array reduction
-      if (pix[0] < -half_size[0] || pix[0] >= half_size[0] || pix[1] < -half_size[1] || pix[1] >= half_size[1]) {
-        invalid_reproj = true;
-        is_bad[pid] = true;
-      }
-
-      // Mark points that are behind the camera
-      Eigen::Vector3d P = cid_to_cam_t_global[cid_fid.first] * (*pid_to_xyz)[pid];
-      if (P[2] <= 0) {
-        behind_cam = true;
-        is_bad[pid] = true;
+  double focal_length = camera_params.GetFocalLength();
+  common::WorkStealingFor(num_blocks, num_threads,
+    [&cid_to_cam_t_global, &cid_to_keypoint_map, pid_to_cid_fid, pid_to_xyz, &cam_ctrs,
+     &flags, &block_errors, &half_size, focal_length, num_pid](size_t block, size_t) {
+      std::vector<double> & errors = block_errors[block];
+      for (size_t pid = block * kPidBlock; pid < std::min(num_pid, (block + 1) * kPidBlock); pid++) {
+        double max_angle
+          = sparse_mapping::ComputeRaysAngle(pid, *pid_to_cid_fid,
+                                             cam_ctrs,  *pid_to_xyz);
+        if (max_angle < FLAGS_min_valid_angle)
+          flags[pid] |= SMALL_ANGLE;
+
+        for (std::pair<int, int> cid_fid : (*pid_to_cid_fid)[pid]) {
+          Eigen::Vector3d P = cid_to_cam_t_global[cid_fid.first] * (*pid_to_xyz)[pid];
+          Eigen::Vector2d pix = P.hnormalized() * focal_length;
+          errors.push_back((cid_to_keypoint_map[cid_fid.first].col(cid_fid.second) - pix).norm());
+          // Mark points which don't project at valid camera pixels
+          if (pix[0] < -half_size[0] || pix[0] >= half_size[0] || pix[1] < -half_size[1] || pix[1] >= half_size[1])
+            flags[pid] |= INVALID_REPROJ;
+
+          // Mark points that are behind the camera
+          if (P[2] <= 0)
+            flags[pid] |= BEHIND_CAM;
+        }
       }
-    }
-    s.small_angle    += static_cast<int>(small_angle);
-    s.behind_cam     += static_cast<int>(behind_cam);
-    s.invalid_reproj += static_cast<int>(invalid_reproj);
-  }
+    });
 
-  for (size_t pid = (*pid_to_xyz).size() - 1; pid < (*pid_to_xyz).size(); pid--) {
-    if (is_bad[pid]) {
-      std::vector<std::map<int, int> >::iterator cid_fid_it = (*pid_to_cid_fid).begin();
-      std::vector<Eigen::Vector3d>::iterator xyz_it = (*pid_to_xyz).begin();
-      std::advance(cid_fid_it, pid);
-      std::advance(xyz_it, pid);
-      (*pid_to_cid_fid).erase(cid_fid_it);
-      (*pid_to_xyz).erase(xyz_it);
-    }
+  // Reprojection error at each match point.
+  std::vector<double> errors;
+  for (std::vector<double> const& block : block_errors)
+    errors.insert(errors.end(), block.begin(), block.end());
+  block_errors.clear();
+  for (uint8_t flag : flags) {
+    s.small_angle    += static_cast<int>((flag & SMALL_ANGLE) != 0);
+    s.behind_cam     += static_cast<int>((flag & BEHIND_CAM) != 0);
+    s.invalid_reproj += static_cast<int>((flag & INVALID_REPROJ) != 0);
   }
+  RemovePIDs(flags, pid_to_cid_fid, pid_to_xyz);
 
   // Wipe all features who are further than the reprojection of the
   // corresponding 3D point than given threshold.
   double thresh = std::max(GetErrThresh(errors, multiple_of_median), reproj_thresh);
   LOG(INFO) << "Filtering features with reprojection error higher than: "
             << thresh << " pixels";
-  for (size_t pid = (*pid_to_xyz).size() - 1; pid < (*pid_to_xyz).size(); pid--) {
-    std::map<int, int> & cid_fid = (*pid_to_cid_fid)[pid];
-    std::map<int, int>::iterator itr = cid_fid.begin();
-    while (itr != cid_fid.end()) {
-      s.num_features++;
-      Eigen::Vector2d pix = (cid_to_cam_t_global[itr->first] *
-                             (*pid_to_xyz)[pid]).hnormalized() * camera_params.GetFocalLength();
-      double err
-        = (cid_to_keypoint_map[itr->first].col(itr->second) - pix).norm();
-
-      if (err >= thresh) {
-        std::map<int, int>::iterator toErase = itr;
-        ++itr;
-        cid_fid.erase(toErase);
-        s.big_reproj_err++;
-      } else {
-        ++itr;
-      }
-    }
+  num_pid = pid_to_xyz->size();
+  num_blocks = (num_pid + kPidBlock - 1) / kPidBlock;
+  std::vector<uint8_t> too_few(num_pid, 0);
+  std::vector<int> block_features(num_blocks, 0), block_big_err(num_blocks, 0);
+  common::WorkStealingFor(num_blocks, num_threads,
+    [&cid_to_cam_t_global, &cid_to_keypoint_map, pid_to_cid_fid, pid_to_xyz, &too_few,
+     &block_features, &block_big_err, focal_length, thresh, num_pid](size_t block, size_t) {
+      for (size_t pid = block * kPidBlock; pid < std::min(num_pid, (block + 1) * kPidBlock); pid++) {
+        std::map<int, int> & cid_fid = (*pid_to_cid_fid)[pid];
+        std::map<int, int>::iterator itr = cid_fid.begin();
+        while (itr != cid_fid.end()) {
+          block_features[block]++;
+          Eigen::Vector2d pix = (cid_to_cam_t_global[itr->first] *
+                                 (*pid_to_xyz)[pid]).hnormalized() * focal_length;
+          double err
+            = (cid_to_keypoint_map[itr->first].col(itr->second) - pix).norm();
+
+          if (err >= thresh) {
+            std::map<int, int>::iterator toErase = itr;
+            ++itr;
+            cid_fid.erase(toErase);
+            block_big_err[block]++;
+          } else {
+            ++itr;
+          }
+        }
 
-    // Wipe a 3D point altogether if it corresponds to less than 2 matches.
-    int total = (*pid_to_cid_fid)[pid].size();
-    if (total < 2) {
-      std::vector<std::map<int, int> >::iterator cid_fid_it
-        = (*pid_to_cid_fid).begin();
-      std::vector<Eigen::Vector3d>::iterator xyz_it = (*pid_to_xyz).begin();
-      std::advance(cid_fid_it, pid);
-      std::advance(xyz_it, pid);
-      (*pid_to_cid_fid).erase(cid_fid_it);
-      (*pid_to_xyz).erase(xyz_it);
-    }
+        // Wipe a 3D point altogether if it corresponds to less than 2 matches.
+        too_few[pid] = (cid_fid.size() < 2);
+      }
+    });
+  for (size_t block = 0; block < num_blocks; block++) {
+    s.num_features   += block_features[block];
+    s.big_reproj_err += block_big_err[block];
   }
+  RemovePIDs(too_few, pid_to_cid_fid, pid_to_xyz);
 
   if (print_stats)
     s.PrintStats();
@@ -0,0 +1,157 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/stage_cache.h>
+
+#include <glog/logging.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace sparse_mapping {
+
+namespace {
+
+const uint64_t kFnvOffset = 14695981039346656037ULL;
+const uint64_t kFnvPrime = 1099511628211ULL;
+
+uint64_t HashBytes(char const* data, size_t size, uint64_t hash) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= kFnvPrime;
+  }
+  return hash;
+}
+
+bool FileExists(std::string const& file) {
+  struct stat info;
+  return stat(file.c_str(), &info) == 0;
+}
+
+// Copies through a temporary file renamed at the end, so that dst is
+// never left half written
+bool CopyFile(std::string const& src, std::string const& dst) {
+  std::ifstream in(src.c_str(), std::ios::binary);
+  if (!in.is_open())
+    return false;
+  std::string tmp = dst + ".tmp";
+  {
+    std::ofstream out(tmp.c_str(), std::ios::binary);
+    out << in.rdbuf();
+    if (!out.good()) {
+      std::remove(tmp.c_str());
+      return false;
+    }
+  }
+  return std::rename(tmp.c_str(), dst.c_str()) == 0;
+}
+
+}  // namespace
+
+uint64_t HashString(std::string const& str, uint64_t hash) {
+  hash = HashBytes(str.data(), str.size(), hash);
+  // the length ends it, so that consecutive strings can't run together
+  uint64_t size = str.size();
+  return HashBytes(reinterpret_cast<char const*>(&size), sizeof(size), hash);
+}
+
+uint64_t HashFile(std::string const& file, uint64_t hash) {
+  std::ifstream in(file.c_str(), std::ios::binary);
+  char present = in.is_open();
+  hash = HashBytes(&present, 1, hash);
+  uint64_t size = 0;
+  std::vector<char> buffer(1 << 20);
+  while (in.good()) {
+    in.read(&buffer[0], buffer.size());
+    hash = HashBytes(&buffer[0], in.gcount(), hash);
+    size += in.gcount();
+  }
+  return HashBytes(reinterpret_cast<char const*>(&size), sizeof(size), hash);
+}
+
+StageCache::StageCache(std::string const& dir) : dir_(dir) {
+  if (Enabled() && mkdir(dir_.c_str(), 0755) != 0 && errno != EEXIST)
+    LOG(FATAL) << "Could not create the stage cache directory " << dir_ << ".";
+}
+
+std::string StageCache::Path(std::string const& key, std::string const& suffix) const {
+  return dir_ + "/" + key + suffix;
+}
+
+std::string StageCache::Key(std::string const& stage, std::string const& params,
+                            std::vector<std::string> const& inputs) const {
+  uint64_t hash = HashString(params, HashString(stage, kFnvOffset));
+  for (std::string const& input : inputs)
+    hash = HashFile(input, hash);
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));  // NOLINT
+  return stage + "-" + hex;
+}
+
+bool StageCache::Restore(std::string const& key, std::vector<std::string> const& outputs) const {
+  if (!Enabled())
+    return false;
+  // the manifest lists, for each output, whether it was stored
+  std::ifstream manifest(Path(key, ".done").c_str());
+  std::vector<int> stored(outputs.size());
+  for (size_t i = 0; i < outputs.size(); i++)
+    if (!(manifest >> stored[i]))
+      return false;
+  for (size_t i = 0; i < outputs.size(); i++) {
+    if (!stored[i]) {
+      std::remove(outputs[i].c_str());
+      continue;
+    }
+    std::ostringstream part;
+    part << "." << i;
+    if (!CopyFile(Path(key, part.str()), outputs[i]))
+      LOG(FATAL) << "Could not restore " << outputs[i] << " from the stage cache.";
+  }
+  return true;
+}
+
+bool StageCache::Store(std::string const& key, std::vector<std::string> const& outputs) const {
+  if (!Enabled())
+    return false;
+  std::ostringstream manifest;
+  for (size_t i = 0; i < outputs.size(); i++) {
+    bool present = FileExists(outputs[i]);
+    std::ostringstream part;
+    part << "." << i;
+    if (present && !CopyFile(outputs[i], Path(key, part.str()))) {
+      LOG(WARNING) << "Could not store " << outputs[i] << " in the stage cache.";
+      return false;
+    }
+    manifest << present << "\n";
+  }
+  std::string done = Path(key, ".done");
+  {
+    std::ofstream out((done + ".tmp").c_str());
+    out << manifest.str();
+    if (!out.good())
+      return false;
+  }
+  return std::rename((done + ".tmp").c_str(), done.c_str()) == 0;
+}
+
+}  // namespace sparse_mapping
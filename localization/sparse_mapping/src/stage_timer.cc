@@ -0,0 +1,51 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/stage_timer.h>
+
+namespace sparse_mapping {
+
+static StageTimerCallback& StageTimerCallbackStorage() {
+  static StageTimerCallback callback;
+  return callback;
+}
+
+void SetStageTimerCallback(StageTimerCallback const& callback) {
+  StageTimerCallbackStorage() = callback;
+}
+
+StageTimerCallback const& GetStageTimerCallback() {
+  return StageTimerCallbackStorage();
+}
+
+ScopedStageTimer::ScopedStageTimer(const char* stage) :
+  stage_(stage), enabled_(static_cast<bool>(GetStageTimerCallback())) {
+  if (enabled_)
+    start_ = std::chrono::steady_clock::now();
+}
+
+ScopedStageTimer::~ScopedStageTimer() {
+  if (!enabled_)
+    return;
+  std::chrono::duration<double> dt = std::chrono::steady_clock::now() - start_;
+  StageTimerCallback const& callback = GetStageTimerCallback();
+  if (callback)
+    callback(stage_, dt.count());
+}
+
+}  // namespace sparse_mapping
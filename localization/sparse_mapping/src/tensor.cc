@@ -30,6 +30,7 @@
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 #include <ceres/ceres.h>
+#include <ceres/rotation.h>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 // Get rid of warning beyond our control
@@ -45,10 +46,14 @@
 
 #include <opencv2/features2d/features2d.hpp>
 #include <opencv2/core/core.hpp>
+#include <opencv2/flann/miniflann.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <set>
 #include <thread>
 #include <vector>
@@ -67,6 +72,16 @@ DEFINE_int32(num_subsequent_images, std::numeric_limits<int32_t>::max()/2,  // a
              "many subsequent images.");
 DEFINE_int32(match_all_rate, -1,  // avoid overflow
              "If nonnegative, match one of every match_all_rate images to every other image.");
+DEFINE_string(pair_prior_map, "",
+              "If set, take rough camera poses from this map, looking up the images by name, "
+              "and match an image which has a pose only with those whose cameras are within "
+              "-pair_max_distance and -pair_max_angle of it, and the next three images.");
+DEFINE_double(pair_max_distance, 2.0,
+              "With -pair_prior_map, the largest distance between the centers of two cameras "
+              "whose images are matched, in the units of the prior map.");
+DEFINE_double(pair_max_angle, 60.0,
+              "With -pair_prior_map, the largest angle in degrees between the view directions "
+              "of two cameras whose images are matched.");
 DEFINE_bool(skip_filtering, false,
             "Skip filtering of outliers after bundle adjustment.");
 DEFINE_double(reproj_thresh, 5.0,
@@ -81,6 +96,43 @@ DEFINE_string(cost_function, "Cauchy",
               "Choose a bundle adjustment cost function from: Cauchy, PseudoHuber, Huber, L1, L2.");
 DEFINE_double(cost_function_threshold, 2.0,
               "Threshold to use with some cost functions, e.g., Cauchy.");
+DEFINE_string(ba_linear_solver, "iterative_schur",
+              "Bundle adjustment linear solver: iterative_schur or sparse_schur. "
+              "The latter needs ceres built with SuiteSparse or CXSparse.");
+DEFINE_string(ba_preconditioner, "schur_jacobi",
+              "Preconditioner for the iterative_schur solver: jacobi, schur_jacobi, "
+              "cluster_jacobi or cluster_tridiagonal. The cluster ones group cameras by "
+              "the points they share.");
+DEFINE_bool(ba_reuse_problem, true,
+            "Build the bundle adjustment problem once and drop outliers from it between "
+            "passes, rather than rebuilding it for every pass.");
+DEFINE_int32(local_ba_window, 0,
+             "If positive, incremental bundle adjustment floats only this many of the newest "
+             "cameras and the points they see, holding the older cameras constant.");
+DEFINE_int32(global_ba_rate, 0,
+             "With -local_ba_window, bundle-adjust all the cameras added so far once every "
+             "this many images. If zero, only the final bundle adjustment is global.");
+DEFINE_int32(merge_num_similar, 20,
+             "When merging maps, match each image near the seam only to the images near the "
+             "seam of the other map which are among its this many most similar ones in that "
+             "map's vocabulary database. Use 0, or give maps without a database, to match "
+             "all of them.");
+DEFINE_bool(merge_seam_ba, true,
+            "When merging maps, bundle-adjust the cameras near the seam and the points they "
+            "see before any bundle adjustment of the whole map.");
+DEFINE_int32(loop_num_similar, 20,
+             "When closing loops with the vocabulary database, verify this many of the most "
+             "similar images of each image as loop closures.");
+DEFINE_int32(loop_min_separation, 50,
+             "Consider only images at least this many apart in the sequence as loop closures.");
+DEFINE_int32(loop_min_inliers, 30,
+             "Accept a loop closure only if the later image localizes against the points of "
+             "the earlier one with this many inliers.");
+DEFINE_double(loop_weight, 1.0,
+              "The weight of loop closures relative to consecutive images in the pose graph.");
+DEFINE_int32(loop_ba_window, 10,
+             "After closing loops, bundle-adjust only the cameras within this many images of "
+             "either end of each loop, and the points they see.");
 DEFINE_int32(first_ba_index, 0,
              "Vary only cameras starting with this index during bundle adjustment.");
 DEFINE_int32(last_ba_index, std::numeric_limits<int>::max(),
@@ -88,6 +140,27 @@ DEFINE_int32(last_ba_index, std::numeric_limits<int>::max(),
 
 namespace sparse_mapping {
 
+// Solver settings shared by all the bundle adjustment calls
+void SetBundleAdjustSolverOptions(ceres::Solver::Options * options) {
+  if (!ceres::StringToLinearSolverType(FLAGS_ba_linear_solver, &options->linear_solver_type) ||
+      (options->linear_solver_type != ceres::ITERATIVE_SCHUR &&
+       options->linear_solver_type != ceres::SPARSE_SCHUR))
+    LOG(FATAL) << "Unsupported bundle adjustment linear solver: " << FLAGS_ba_linear_solver;
+
+  if (options->linear_solver_type == ceres::ITERATIVE_SCHUR) {
+    if (!ceres::StringToPreconditionerType(FLAGS_ba_preconditioner, &options->preconditioner_type) ||
+        options->preconditioner_type == ceres::IDENTITY)
+      LOG(FATAL) << "Unsupported bundle adjustment preconditioner: " << FLAGS_ba_preconditioner;
+    // Cameras which see the same points go in the same cluster
+    if (options->preconditioner_type == ceres::CLUSTER_JACOBI ||
+        options->preconditioner_type == ceres::CLUSTER_TRIDIAGONAL)
+      options->visibility_clustering_type = ceres::CANONICAL_VIEWS;
+  }
+
+  // Ceres picks the Schur elimination order itself, points first
+  options->num_threads = FLAGS_num_threads;
+}
+
 int ReadMatches(std::string const& matches_file,
                  openMVG::matching::PairWiseMatches * match_map) {
   // Read matches from disk into OpenMVG's format
@@ -135,10 +208,11 @@ void WriteMatches(openMVG::matching::PairWiseMatches const& match_map,
 
 void BuildMapPerformMatching(openMVG::matching::PairWiseMatches * match_map,
                              std::vector<Eigen::Matrix2Xd > const& cid_to_keypoint_map,
-                             std::vector<cv::Mat> const& cid_to_descriptor_map,
+                             cv::Mat const& descriptors1,
+                             cv::Mat const& descriptors2,
                              camera::CameraParameters const& camera_params,
                              CIDPairAffineMap * relative_affines,
-                             std::mutex * match_mutex,
+                             std::mutex * match_mutex /*may be NULL*/,
                              int i /*query cid index*/, int j /*train cid index*/,
                              bool compute_rays_angle, double * rays_angle) {
   CHECK(relative_affines) << "Forgot to provide relative_affines argument";
@@ -147,9 +221,7 @@ void BuildMapPerformMatching(openMVG::matching::PairWiseMatches * match_map,
   Eigen::Matrix2Xd const& keypoints2 = cid_to_keypoint_map[j];
 
   std::vector<cv::DMatch> matches, inlier_matches;
-  interest_point::FindMatches(cid_to_descriptor_map[i],
-                              cid_to_descriptor_map[j],
-                              &matches);
+  interest_point::FindMatches(descriptors1, descriptors2, &matches);
 
   // Do a check and verify that we meet our minimum before the
   // essential matrix fitting.
@@ -178,35 +250,139 @@ void BuildMapPerformMatching(openMVG::matching::PairWiseMatches * match_map,
   std::vector<openMVG::matching::IndMatch> mvg_matches;
   for (std::vector<cv::DMatch>::value_type const& match : inlier_matches)
     mvg_matches.push_back(openMVG::matching::IndMatch(match.queryIdx, match.trainIdx));
-  match_mutex->lock();
+  if (match_mutex) match_mutex->lock();
   (*match_map)[ std::make_pair(i, j) ] = mvg_matches;
-  match_mutex->unlock();
+  if (match_mutex) match_mutex->unlock();
 }
 
 
-/**
- * Create the initial map by feature matching and essential affine computation.
- **/
-void MatchFeatures(const std::string & essential_file,
-                   const std::string & matches_file,
-                   sparse_mapping::SparseMap * s) {
-  sparse_mapping::CIDPairAffineMap relative_affines;
+void GeometricPairs(std::vector<Eigen::Affine3d> const& cid_to_cam_t_global,
+                    std::vector<bool> const& has_pose,
+                    double max_distance, double max_angle,
+                    std::vector<std::pair<int, int> > * pairs) {
+  pairs->clear();
+  std::vector<int> cids;
+  for (size_t cid = 0; cid < has_pose.size(); cid++) {
+    if (has_pose[cid])
+      cids.push_back(cid);
+  }
+  if (cids.size() < 2)
+    return;
 
-  // Iterate through the cid pairings
-  common::ThreadPool thread_pool;
-  std::mutex match_mutex;
+  // Camera centers and view directions in world coordinates
+  cv::Mat centers(cids.size(), 3, CV_32F);
+  std::vector<Eigen::Vector3d> directions(cids.size());
+  for (size_t k = 0; k < cids.size(); k++) {
+    Eigen::Affine3d const& cam_t_global = cid_to_cam_t_global[cids[k]];
+    Eigen::Vector3d center = -cam_t_global.linear().transpose() * cam_t_global.translation();
+    for (int c = 0; c < 3; c++)
+      centers.at<float>(k, c) = center[c];
+    directions[k] = cam_t_global.linear().row(2).transpose();
+  }
 
-  openMVG::matching::PairWiseMatches match_map;
-  for (size_t cid = 0; cid < s->cid_to_keypoint_map_.size(); cid++) {
-    // Query the db for similar images
-    common::PrintProgressBar(stdout, static_cast<float>(cid) / static_cast<float>(s->cid_to_keypoint_map_.size() - 1));
-    std::vector<int> indices, queried_indices;
+  // Unlimited checks make the search exact. The L2 radius is squared.
+  cv::flann::Index tree(centers, cv::flann::KDTreeIndexParams(1));
+  double min_cos = cos(max_angle * M_PI / 180.0);
+  std::vector<int> indices(cids.size());
+  std::vector<float> dists(cids.size());
+  for (size_t k = 0; k < cids.size(); k++) {
+    int num_found = tree.radiusSearch(centers.row(k), indices, dists, max_distance * max_distance,
+                                      cids.size(), cv::flann::SearchParams(-1));
+    for (int i = 0; i < num_found; i++) {
+      size_t l = indices[i];
+      if (l > k && directions[k].dot(directions[l]) >= min_cos)
+        pairs->push_back(std::make_pair(cids[k], cids[l]));
+    }
+  }
+  std::sort(pairs->begin(), pairs->end());
+}
+
+// Find the poses in the prior map of the images of the map being
+// built, by name, or else by name without the directory.
+void ReadPriorPoses(std::string const& prior_map_file,
+                    std::vector<std::string> const& cid_to_filename,
+                    std::vector<Eigen::Affine3d> * cid_to_cam_t_global,
+                    std::vector<bool> * has_pose) {
+  auto base_name = [](std::string const& name) {
+    size_t pos = name.find_last_of('/');
+    return pos == std::string::npos ? name : name.substr(pos + 1);
+  };
+
+  sparse_mapping::SparseMap prior(prior_map_file);
+  std::map<std::string, int> name_to_cid, base_to_cid;
+  for (size_t cid = 0; cid < prior.cid_to_cam_t_global_.size(); cid++) {
+    name_to_cid[prior.cid_to_filename_[cid]] = cid;
+    base_to_cid[base_name(prior.cid_to_filename_[cid])] = cid;
+  }
+
+  int num_found = 0;
+  cid_to_cam_t_global->assign(cid_to_filename.size(), Eigen::Affine3d::Identity());
+  has_pose->assign(cid_to_filename.size(), false);
+  for (size_t cid = 0; cid < cid_to_filename.size(); cid++) {
+    auto it = name_to_cid.find(cid_to_filename[cid]);
+    if (it == name_to_cid.end()) {
+      it = base_to_cid.find(base_name(cid_to_filename[cid]));
+      if (it == base_to_cid.end())
+        continue;
+    }
+    (*cid_to_cam_t_global)[cid] = prior.cid_to_cam_t_global_[it->second];
+    (*has_pose)[cid] = true;
+    num_found++;
+  }
+  LOG(INFO) << "Found prior poses for " << num_found << " of " << cid_to_filename.size()
+            << " images in " << prior_map_file << ".";
+}
+
+void SelectMatchPairs(sparse_mapping::SparseMap * s,
+                      std::vector<std::pair<int, int> > * pairs_out) {
+  // First decide which pairs to match. This only queries the
+  // vocabulary database, for all images at once, the expensive work
+  // is done later.
+  std::vector<std::vector<int> > cid_to_queried_indices;
+  if (!s->HasFeatureStore()) {
     sparse_mapping::QueryDB(s->detector_.GetDetectorName(),
                             &s->vocab_db_, s->num_similar_,
-                            s->cid_to_descriptor_map_[cid],
-                            &queried_indices);
+                            s->cid_to_descriptor_map_,
+                            &cid_to_queried_indices);
+  } else {
+    // One image at a time, reading the descriptors back from the store
+    cid_to_queried_indices.resize(s->cid_to_filename_.size());
+    common::WorkStealingFor(cid_to_queried_indices.size(), FLAGS_num_threads,
+      [&cid_to_queried_indices, s](size_t cid, size_t /*thread*/) {
+        sparse_mapping::QueryDB(s->detector_.GetDetectorName(),
+                                &s->vocab_db_, s->num_similar_,
+                                s->GetFrameDescriptors(cid),
+                                &cid_to_queried_indices[cid]);
+      });
+  }
+
+  // With rough poses, images that have one are matched only with the
+  // geometrically plausible candidates
+  std::vector<Eigen::Affine3d> prior_cam_t_global;
+  std::vector<bool> has_prior;
+  std::vector<std::vector<int> > cid_to_candidates(s->cid_to_keypoint_map_.size());
+  if (!FLAGS_pair_prior_map.empty()) {
+    ReadPriorPoses(FLAGS_pair_prior_map, s->cid_to_filename_, &prior_cam_t_global, &has_prior);
+    std::vector<std::pair<int, int> > candidates;
+    GeometricPairs(prior_cam_t_global, has_prior, FLAGS_pair_max_distance, FLAGS_pair_max_angle,
+                   &candidates);
+    for (std::pair<int, int> const& candidate : candidates)
+      cid_to_candidates[candidate.first].push_back(candidate.second);
+    LOG(INFO) << "Selected " << candidates.size() << " image pairs from the prior poses.";
+  }
 
-    if (!queried_indices.empty()) {
+  std::vector<std::pair<int, int> > & pairs = *pairs_out;
+  pairs.clear();
+  for (size_t cid = 0; cid < s->cid_to_keypoint_map_.size(); cid++) {
+    std::vector<int> indices;
+    std::vector<int> const& queried_indices = cid_to_queried_indices[cid];
+
+    if (!has_prior.empty() && has_prior[cid]) {
+      std::set<int> partners(cid_to_candidates[cid].begin(), cid_to_candidates[cid].end());
+      for (size_t j = cid + 1; j < std::min(cid + 4, s->cid_to_filename_.size()); j++)
+        partners.insert(j);
+      indices.assign(partners.begin(), partners.end());
+    } else if (!queried_indices.empty()) {
       // always include the next three images
       if (cid + 1 < s->cid_to_filename_.size())
         indices.push_back(static_cast<int>(cid) + 1);
@@ -254,32 +430,79 @@ void MatchFeatures(const std::string & essential_file,
       }
     }
 
-    bool compute_rays_angle = false;
-    double rays_angle;
     for (size_t j = 0; j < indices.size(); j++) {
       // Need the check below for loop closing to pass in unit tests
-      if (s->cid_to_filename_[cid] != s->cid_to_filename_[indices[j]]) {
-        thread_pool.AddTask(&sparse_mapping::BuildMapPerformMatching,
-                            &match_map,
-                            s->cid_to_keypoint_map_,
-                            s->cid_to_descriptor_map_,
-                            std::cref(s->camera_params_),
-                            &relative_affines,
-                            &match_mutex,
-                            cid, indices[j],
-                            compute_rays_angle, &rays_angle);
-      }
+      if (s->cid_to_filename_[cid] != s->cid_to_filename_[indices[j]])
+        pairs.push_back(std::make_pair(static_cast<int>(cid), indices[j]));
     }
   }
-  thread_pool.Join();
+}
 
-  LOG(INFO) << "Number of affines found:        " << relative_affines.size() << "\n";
+// Matches the pairs, and keeps the inliers and the essential affine
+// of each pair that has enough of them
+void MatchPairList(std::vector<std::pair<int, int> > const& pairs,
+                   sparse_mapping::SparseMap * s,
+                   openMVG::matching::PairWiseMatches * match_map,
+                   sparse_mapping::CIDPairAffineMap * relative_affines) {
+  // Match the pairs. Pair costs vary a lot (number of features,
+  // essential matrix fitting failing early or not), so use work
+  // stealing to balance the threads. Each thread writes to its own
+  // buffers, which are merged at the end, so no locking is needed.
+  size_t num_threads = std::max(1, static_cast<int>(FLAGS_num_threads));
+  std::vector<openMVG::matching::PairWiseMatches> thread_match_maps(num_threads);
+  std::vector<sparse_mapping::CIDPairAffineMap> thread_affines(num_threads);
+  std::atomic<size_t> num_done(0);
+  size_t progress_step = std::max(static_cast<size_t>(1), pairs.size() / 100);
+  auto start_time = std::chrono::steady_clock::now();
+  LOG(INFO) << "Matching " << pairs.size() << " image pairs using "
+            << num_threads << " threads.";
+  common::WorkStealingFor(pairs.size(), num_threads,
+    [&pairs, &thread_match_maps, &thread_affines, &num_done, progress_step, s]
+    (size_t index, size_t tid) {
+      bool compute_rays_angle = false;
+      double rays_angle;
+      sparse_mapping::BuildMapPerformMatching(&thread_match_maps[tid],
+                                              s->cid_to_keypoint_map_,
+                                              s->GetFrameDescriptors(pairs[index].first),
+                                              s->GetFrameDescriptors(pairs[index].second),
+                                              s->camera_params_,
+                                              &thread_affines[tid],
+                                              NULL,
+                                              pairs[index].first, pairs[index].second,
+                                              compute_rays_angle, &rays_angle);
+      size_t done = ++num_done;
+      if (done % progress_step == 0 || done == pairs.size())
+        common::PrintProgressBar(stdout, static_cast<float>(done) / static_cast<float>(pairs.size()));
+    });
+  printf("\n");
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  LOG(INFO) << "Matched " << pairs.size() << " image pairs in " << elapsed << " seconds ("
+            << (elapsed > 0 ? pairs.size() / elapsed : 0.0) << " pairs/second).";
+
+  // Merge the per-thread results
+  match_map->clear();
+  relative_affines->clear();
+  for (size_t tid = 0; tid < num_threads; tid++) {
+    match_map->insert(thread_match_maps[tid].begin(), thread_match_maps[tid].end());
+    relative_affines->insert(thread_affines[tid].begin(), thread_affines[tid].end());
+  }
 
-  // Write the solution
-  sparse_mapping::WriteAffineCSV(relative_affines, essential_file);
+  LOG(INFO) << "Number of affines found:        " << relative_affines->size() << "\n";
+}
 
+void MatchFeaturePairs(std::vector<std::pair<int, int> > const& pairs,
+                       const std::string & essential_file,
+                       const std::string & matches_file,
+                       sparse_mapping::SparseMap * s) {
+  openMVG::matching::PairWiseMatches match_map;
+  sparse_mapping::CIDPairAffineMap relative_affines;
+  MatchPairList(pairs, s, &match_map, &relative_affines);
+  sparse_mapping::WriteAffineCSV(relative_affines, essential_file);
   WriteMatches(match_map, matches_file);
+}
 
+void InitializeCamerasFromAffines(sparse_mapping::CIDPairAffineMap const& relative_affines,
+                                  sparse_mapping::SparseMap * s) {
   // Initial cameras based on the affines (won't be used later,
   // just for visualization purposes).
   int num_images = s->cid_to_filename_.size();
@@ -287,13 +510,35 @@ void MatchFeatures(const std::string & essential_file,
   (s->cid_to_cam_t_global_)[0].setIdentity();
   for (int cid = 1; cid < num_images; cid++) {
     std::pair<int, int> P(cid-1, cid);
-    if (relative_affines.find(P) != relative_affines.end())
-      (s->cid_to_cam_t_global_)[cid] = relative_affines[P]*(s->cid_to_cam_t_global_)[cid-1];
+    auto it = relative_affines.find(P);
+    if (it != relative_affines.end())
+      (s->cid_to_cam_t_global_)[cid] = it->second*(s->cid_to_cam_t_global_)[cid-1];
     else
       (s->cid_to_cam_t_global_)[cid] = (s->cid_to_cam_t_global_)[cid-1];  // no choice
   }
 }
 
+/**
+ * Create the initial map by feature matching and essential affine computation.
+ **/
+void MatchFeatures(const std::string & essential_file,
+                   const std::string & matches_file,
+                   sparse_mapping::SparseMap * s) {
+  std::vector<std::pair<int, int> > pairs;
+  SelectMatchPairs(s, &pairs);
+
+  openMVG::matching::PairWiseMatches match_map;
+  sparse_mapping::CIDPairAffineMap relative_affines;
+  MatchPairList(pairs, s, &match_map, &relative_affines);
+
+  // Write the solution
+  sparse_mapping::WriteAffineCSV(relative_affines, essential_file);
+
+  WriteMatches(match_map, matches_file);
+
+  InitializeCamerasFromAffines(relative_affines, s);
+}
+
 void BuildTracks(const std::string & matches_file,
                  sparse_mapping::SparseMap * s) {
   openMVG::matching::PairWiseMatches match_map;
@@ -371,7 +616,11 @@ void IncrementalBA(std::string const& essential_file,
   std::vector<std::map<int, int> > pid_to_cid_fid_local;
   std::vector<Eigen::Affine3d > cid_to_cam_t_local;
   std::vector<Eigen::Vector3d> pid_to_xyz_local;
-  std::vector<std::map<int, int> > cid_fid_to_pid_local;
+  sparse_mapping::TrackTable tracks_local;
+
+  // Localize() needs all descriptors at hand
+  if (FLAGS_assume_nonsequential)
+    s->ReadFeatureStore();
 
   for (int cid = 1; cid < num_images; cid++) {
     // The array of cameras so far including this one
@@ -390,9 +639,7 @@ void IncrementalBA(std::string const& essential_file,
     if (FLAGS_assume_nonsequential) {
       // TODO(oalexan1): Experimental code. Solution for the problem
       // that an image need not be similar to the one before it.
-      sparse_mapping::InitializeCidFidToPid(cid,
-                                            pid_to_cid_fid_local,
-                                            &cid_fid_to_pid_local);
+      tracks_local.Build(cid, pid_to_cid_fid_local);
 
       // Use the Localize() API to infer the most likely initial guess
       // camera pose.
@@ -413,7 +660,7 @@ void IncrementalBA(std::string const& essential_file,
                    s->num_similar_,
                    s->cid_to_filename_,
                    s->cid_to_descriptor_map_,
-                   cid_fid_to_pid_local,
+                   tracks_local,
                    pid_to_xyz_local,
                    s->num_ransac_iterations_,
                    s->ransac_inlier_tolerance_) ) {
@@ -425,16 +672,49 @@ void IncrementalBA(std::string const& essential_file,
       }
     }
 
-    // Restrict tracks to images up to cid.
+    int start = 0;
+    if (FLAGS_local_ba_window > 0) {
+      // Float a fixed number of the newest cameras, and all of them
+      // every global_ba_rate images.
+      start = std::max(cid - FLAGS_local_ba_window + 1, 0);
+      if (FLAGS_global_ba_rate > 0 && (cid + 1) % FLAGS_global_ba_rate == 0)
+        start = 0;
+    } else {
+      // If cid+1 is divisible by 2^k, do at least 2^k cameras, ending
+      // with camera cid.  E.g., if current camera index is 23 = 3*8-1, do at
+      // least 8 cameras, so cameras 16, ..., 23. This way, we will try
+      // to occasionally do more than just several close cameras.
+      int val = cid+1;
+      int offset = 1;
+      while (val % 2 == 0) {
+        val /= 2;
+        offset *= 2;
+      }
+      offset = std::min(offset, max_num_cams);
+
+      start = cid-offset+1;
+      start = std::min(cid-min_num_cams+1, start);
+      if (start < 0) start = 0;
+    }
+
+    // Restrict tracks to images up to cid. With a local window keep
+    // only the tracks seen by the floated cameras, the others would
+    // not move, so the problem does not grow with the map.
     pid_to_cid_fid_local.clear();
     for (size_t p = 0; p < s->pid_to_cid_fid_.size(); p++) {
       std::map<int, int> & long_track = s->pid_to_cid_fid_[p];
       std::map<int, int> track;
+      bool in_window = false;
       for (std::map<int, int>::iterator it = long_track.begin();
            it != long_track.end() ; it++) {
-        if (it->first <= cid)
+        if (it->first <= cid) {
           track[it->first] = it->second;
+          if (it->first >= start)
+            in_window = true;
+        }
       }
+      if (FLAGS_local_ba_window > 0 && !in_window)
+        continue;
 
       // This is absolutely essential, using tracks of length >=3
       // only greatly increases the reliability.
@@ -452,36 +732,21 @@ void IncrementalBA(std::string const& essential_file,
                                 &pid_to_xyz_local);
 
     ceres::Solver::Options options;
-    options.linear_solver_type = ceres::ITERATIVE_SCHUR;
+    SetBundleAdjustSolverOptions(&options);
     options.max_num_iterations = 500;
     options.logging_type = ceres::SILENT;
-    options.num_threads = FLAGS_num_threads;
     ceres::Solver::Summary summary;
     ceres::LossFunction* loss = new ceres::CauchyLoss(0.5);
 
-    // If cid+1 is divisible by 2^k, do at least 2^k cameras, ending
-    // with camera cid.  E.g., if current camera index is 23 = 3*8-1, do at
-    // least 8 cameras, so cameras 16, ..., 23. This way, we will try
-    // to occasionally do more than just several close cameras.
-    int val = cid+1;
-    int offset = 1;
-    while (val % 2 == 0) {
-      val /= 2;
-      offset *= 2;
-    }
-    offset = std::min(offset, max_num_cams);
-
-    int start = cid-offset+1;
-    start = std::min(cid-min_num_cams+1, start);
-    if (start < 0) start = 0;
-
     LOG(INFO) << "Optimizing cameras from " << start << " to " << cid << " (total: "
         << cid-start+1 << ")";
 
-    sparse_mapping::BundleAdjust(pid_to_cid_fid_local, s->cid_to_keypoint_map_,
+    tracks_local.Build(num_images, pid_to_cid_fid_local);
+    sparse_mapping::BundleAdjust(tracks_local, s->cid_to_keypoint_map_,
                                  s->camera_params_.GetFocalLength(),
                                  &cid_to_cam_t_local, &pid_to_xyz_local,
-                                 s->user_pid_to_cid_fid_,
+                                 sparse_mapping::TrackTable(s->user_cid_to_keypoint_map_.size(),
+                                                            s->user_pid_to_cid_fid_),
                                  s->user_cid_to_keypoint_map_,
                                  &(s->user_pid_to_xyz_),
                                  loss, options, &summary,
@@ -609,28 +874,61 @@ void CloseLoop(sparse_mapping::SparseMap * s) {
 
 void BundleAdjust(bool fix_cameras,
                   sparse_mapping::SparseMap * map) {
-  for (int i = 0; i < FLAGS_num_ba_passes; i++) {
-    LOG(INFO) << "Beginning bundle adjustment, pass: " << i << ".\n";
+  ceres::Solver::Options options;
+  SetBundleAdjustSolverOptions(&options);
+  options.max_num_iterations = FLAGS_max_num_iterations;
+  options.minimizer_progress_to_stdout = true;
+
+  // Each problem takes ownership of its loss function
+  if (!FLAGS_ba_reuse_problem) {
+    for (int i = 0; i < FLAGS_num_ba_passes; i++) {
+      LOG(INFO) << "Beginning bundle adjustment, pass: " << i << ".\n";
+
+      ceres::Solver::Summary summary;
+      sparse_mapping::BundleAdjustment(map,
+                                       sparse_mapping::GetLossFunction(FLAGS_cost_function,
+                                                                       FLAGS_cost_function_threshold),
+                                       options, &summary,
+                                       FLAGS_first_ba_index, FLAGS_last_ba_index,
+                                       fix_cameras);
+
+      LOG(INFO) << summary.FullReport() << "\n";
+      LOG(INFO) << "Starting Average Reprojection Error: " << summary.initial_cost / map->GetNumObservations();
+      LOG(INFO) << "Final Average Reprojection Error:    " << summary.final_cost / map->GetNumObservations();
+    }
+    return;
+  }
 
-    // perform bundle adjustment
-    ceres::Solver::Options options;
-    // options.linear_solver_type = ceres::SPARSE_SCHUR; // Need to be building SuiteSparse
-    options.linear_solver_type = ceres::ITERATIVE_SCHUR;
-    // What should the preconditioner be?
-    options.num_threads = FLAGS_num_threads;
-    options.max_num_iterations = FLAGS_max_num_iterations;
-    options.minimizer_progress_to_stdout = true;
-    ceres::Solver::Summary summary;
-    sparse_mapping::BundleAdjustment(map,
-                                     sparse_mapping::GetLossFunction(FLAGS_cost_function,
-                                                                     FLAGS_cost_function_threshold),
-                                     options, &summary,
-                                     FLAGS_first_ba_index, FLAGS_last_ba_index,
-                                     fix_cameras);
+  // All passes on one problem, outliers get dropped from it in between
+  int num_obs = map->GetNumObservations();
+  std::vector<ceres::Solver::Summary> summaries;
+  sparse_mapping::MultiPassBundleAdjust(sparse_mapping::TrackTable(map->cid_to_keypoint_map_.size(),
+                                                                   map->pid_to_cid_fid_),
+                                        map->cid_to_keypoint_map_,
+                                        map->camera_params_.GetFocalLength(), &(map->cid_to_cam_t_global_),
+                                        &(map->pid_to_xyz_),
+                                        sparse_mapping::TrackTable(map->user_cid_to_keypoint_map_.size(),
+                                                                   map->user_pid_to_cid_fid_),
+                                        map->user_cid_to_keypoint_map_,
+                                        &(map->user_pid_to_xyz_),
+                                        sparse_mapping::GetLossFunction(FLAGS_cost_function,
+                                                                        FLAGS_cost_function_threshold),
+                                        options, FLAGS_num_ba_passes, !FLAGS_skip_filtering,
+                                        FLAGS_reproj_thresh, 3.0, &summaries,
+                                        FLAGS_first_ba_index, FLAGS_last_ba_index, fix_cameras);
+
+  for (size_t i = 0; i < summaries.size(); i++) {
+    LOG(INFO) << "Bundle adjustment, pass: " << i << ".\n";
+    LOG(INFO) << summaries[i].FullReport() << "\n";
+    LOG(INFO) << "Starting Average Reprojection Error: " << summaries[i].initial_cost / num_obs;
+    LOG(INFO) << "Final Average Reprojection Error:    " << summaries[i].final_cost / num_obs;
+  }
 
-    LOG(INFO) << summary.FullReport() << "\n";
-    LOG(INFO) << "Starting Average Reprojection Error: " << summary.initial_cost / map->GetNumObservations();
-    LOG(INFO) << "Final Average Reprojection Error:    " << summary.final_cost / map->GetNumObservations();
+  // Now edit the tracks themselves
+  if (!FLAGS_skip_filtering) {
+    FilterPID(FLAGS_reproj_thresh,  map->camera_params_, map->cid_to_cam_t_global_,
+              map->cid_to_keypoint_map_, &(map->pid_to_cid_fid_), &(map->pid_to_xyz_));
+    map->InitializeCidFidToPid();
   }
 }
 
@@ -639,10 +937,14 @@ void BundleAdjustment(sparse_mapping::SparseMap * s,
                       const ceres::Solver::Options & options,
                       ceres::Solver::Summary* summary,
                       int first, int last, bool fix_cameras) {
-  sparse_mapping::BundleAdjust(s->pid_to_cid_fid_, s->cid_to_keypoint_map_,
+  // The tracks may have changed since s->tracks_ was built
+  sparse_mapping::BundleAdjust(sparse_mapping::TrackTable(s->cid_to_keypoint_map_.size(), s->pid_to_cid_fid_),
+                               s->cid_to_keypoint_map_,
                                s->camera_params_.GetFocalLength(), &(s->cid_to_cam_t_global_),
                                &(s->pid_to_xyz_),
-                               s->user_pid_to_cid_fid_, s->user_cid_to_keypoint_map_,
+                               sparse_mapping::TrackTable(s->user_cid_to_keypoint_map_.size(),
+                                                          s->user_pid_to_cid_fid_),
+                               s->user_cid_to_keypoint_map_,
                                &(s->user_pid_to_xyz_),
                                loss, options, summary, first, last, fix_cameras);
 
@@ -657,6 +959,366 @@ void BundleAdjustment(sparse_mapping::SparseMap * s,
   // PrintTrackStats(s->pid_to_cid_fid_, "bundle adjustment and filtering");
 }
 
+// For each of the query_cids images, the db_search images among its
+// num_similar most similar ones in the vocabulary database of
+// db_map. All cids are in the merged map, which has the images of
+// db_map starting at db_offset.
+static void QuerySeamCandidates(sparse_mapping::SparseMap * db_map, int db_offset,
+                                std::set<int> const& db_search,
+                                std::vector<cv::Mat> const& cid_to_descriptor_map,
+                                std::set<int> const& query_cids, int num_similar,
+                                std::map<int, std::set<int> > * candidates) {
+  std::vector<int> cids(query_cids.begin(), query_cids.end());
+  std::vector<cv::Mat> descriptors;
+  for (int cid : cids)
+    descriptors.push_back(cid_to_descriptor_map[cid]);
+
+  // All the queries at once, on the thread pool
+  std::vector<std::vector<int> > indices;
+  sparse_mapping::QueryDB(db_map->detector_.GetDetectorName(), &db_map->vocab_db_, num_similar,
+                          descriptors, &indices, FLAGS_num_threads);
+  for (size_t i = 0; i < cids.size(); i++) {
+    for (int db_cid : indices[i]) {
+      if (db_search.find(db_cid + db_offset) != db_search.end())
+        (*candidates)[cids[i]].insert(db_cid + db_offset);
+    }
+  }
+}
+
+// Bundle-adjust only the given cameras and the points they see. The
+// other cameras seeing those points stay fixed, and the rest of the
+// map is left out of the problem entirely.
+static void LocalBundleAdjust(std::set<int> const& cids, sparse_mapping::SparseMap * map) {
+  // Renumber the cameras, the varied ones first
+  std::vector<int> sub_to_cid(cids.begin(), cids.end());
+  std::map<int, int> cid_to_sub;
+  for (size_t sub = 0; sub < sub_to_cid.size(); sub++)
+    cid_to_sub[sub_to_cid[sub]] = sub;
+  int num_varied = sub_to_cid.size();
+
+  std::vector<int> sub_to_pid;
+  std::vector<std::map<int, int> > sub_pid_to_cid_fid;
+  for (size_t pid = 0; pid < map->pid_to_cid_fid_.size(); pid++) {
+    std::map<int, int> const& cid_fid = map->pid_to_cid_fid_[pid];
+    if (cid_fid.size() < 2)
+      continue;
+    bool seen = false;
+    for (auto const& obs : cid_fid)
+      seen = seen || (cids.find(obs.first) != cids.end());
+    if (!seen)
+      continue;
+
+    std::map<int, int> sub_cid_fid;
+    for (auto const& obs : cid_fid) {
+      auto it = cid_to_sub.find(obs.first);
+      if (it == cid_to_sub.end()) {
+        it = cid_to_sub.insert(std::make_pair(obs.first, static_cast<int>(sub_to_cid.size()))).first;
+        sub_to_cid.push_back(obs.first);
+      }
+      sub_cid_fid[it->second] = obs.second;
+    }
+    sub_to_pid.push_back(pid);
+    sub_pid_to_cid_fid.push_back(sub_cid_fid);
+  }
+  if (sub_to_pid.empty())
+    return;
+
+  std::vector<Eigen::Matrix2Xd> sub_keypoints(sub_to_cid.size());
+  std::vector<Eigen::Affine3d> sub_cams(sub_to_cid.size());
+  for (size_t sub = 0; sub < sub_to_cid.size(); sub++) {
+    sub_keypoints[sub] = map->cid_to_keypoint_map_[sub_to_cid[sub]];
+    sub_cams[sub] = map->cid_to_cam_t_global_[sub_to_cid[sub]];
+  }
+  std::vector<Eigen::Vector3d> sub_xyz(sub_to_pid.size());
+  for (size_t sub = 0; sub < sub_to_pid.size(); sub++)
+    sub_xyz[sub] = map->pid_to_xyz_[sub_to_pid[sub]];
+
+  LOG(INFO) << "Bundle-adjusting " << num_varied << " cameras and " << sub_to_pid.size()
+            << " points, with " << sub_to_cid.size() - num_varied << " more cameras fixed.";
+  ceres::Solver::Options options;
+  SetBundleAdjustSolverOptions(&options);
+  options.max_num_iterations = FLAGS_max_num_iterations;
+  options.minimizer_progress_to_stdout = false;
+  std::vector<Eigen::Matrix2Xd> user_keypoints;
+  std::vector<Eigen::Vector3d> user_xyz;
+  std::vector<ceres::Solver::Summary> summaries;
+  sparse_mapping::MultiPassBundleAdjust(sparse_mapping::TrackTable(sub_to_cid.size(), sub_pid_to_cid_fid),
+                                        sub_keypoints, map->camera_params_.GetFocalLength(),
+                                        &sub_cams, &sub_xyz,
+                                        sparse_mapping::TrackTable(), user_keypoints, &user_xyz,
+                                        sparse_mapping::GetLossFunction(FLAGS_cost_function,
+                                                                        FLAGS_cost_function_threshold),
+                                        options, FLAGS_num_ba_passes, !FLAGS_skip_filtering,
+                                        FLAGS_reproj_thresh, 3.0, &summaries,
+                                        0, num_varied - 1);
+  if (!summaries.empty())
+    LOG(INFO) << "Local bundle adjustment cost went from " << summaries.front().initial_cost
+              << " to " << summaries.back().final_cost << ".";
+
+  for (int sub = 0; sub < num_varied; sub++)
+    map->cid_to_cam_t_global_[sub_to_cid[sub]] = sub_cams[sub];
+  for (size_t sub = 0; sub < sub_to_pid.size(); sub++)
+    map->pid_to_xyz_[sub_to_pid[sub]] = sub_xyz[sub];
+}
+
+namespace {
+
+// A loop closure found between image cid1 and the much later image
+// cid2: the pose of cid2 localized against the points of cid1, and
+// the features of cid2 matched to those points
+struct LoopClosure {
+  int cid1, cid2;
+  Eigen::Affine3d cam2_t_global;
+  std::vector<std::pair<int, int> > fid2_pid1;
+};
+
+// The error of the relative pose cam_j_t_global * cam_i_t_global^-1
+// of two cameras from its measured value, in angle axis and
+// translation, for pose graph optimization
+struct RelativePoseError {
+  RelativePoseError(Eigen::Affine3d const& measured, double weight) : weight(weight) {
+    Eigen::Quaterniond q(measured.linear());
+    measured_q_inv[0] = q.w();
+    measured_q_inv[1] = -q.x();
+    measured_q_inv[2] = -q.y();
+    measured_q_inv[3] = -q.z();
+    for (int c = 0; c < 3; c++)
+      measured_t[c] = measured.translation()[c];
+  }
+
+  template <typename T>
+  bool operator()(const T* aa_i, const T* t_i, const T* aa_j, const T* t_j, T* residuals) const {
+    T q_i[4], q_j[4], q_i_inv[4], q[4];
+    ceres::AngleAxisToQuaternion(aa_i, q_i);
+    ceres::AngleAxisToQuaternion(aa_j, q_j);
+    q_i_inv[0] = q_i[0];
+    for (int c = 1; c < 4; c++)
+      q_i_inv[c] = -q_i[c];
+    ceres::QuaternionProduct(q_j, q_i_inv, q);
+    T rotated[3], t[3];
+    ceres::UnitQuaternionRotatePoint(q, t_i, rotated);
+    for (int c = 0; c < 3; c++)
+      t[c] = t_j[c] - rotated[c] - T(measured_t[c]);
+
+    T m_inv[4] = {T(measured_q_inv[0]), T(measured_q_inv[1]), T(measured_q_inv[2]), T(measured_q_inv[3])};
+    T q_err[4], t_err[3];
+    ceres::QuaternionProduct(m_inv, q, q_err);
+    ceres::QuaternionToAngleAxis(q_err, residuals);
+    ceres::UnitQuaternionRotatePoint(m_inv, t, t_err);
+    for (int c = 0; c < 3; c++) {
+      residuals[c] *= T(weight);
+      residuals[3 + c] = T(weight) * t_err[c];
+    }
+    return true;
+  }
+
+  double measured_q_inv[4], measured_t[3], weight;
+};
+
+}  // namespace
+
+// Close loops found with the vocabulary database rather than with
+// repeated images
+void CloseLoopsWithVocabDB(sparse_mapping::SparseMap * s) {
+  int num_cid = s->cid_to_filename_.size();
+  if (num_cid <= FLAGS_loop_min_separation) {
+    LOG(INFO) << "Too few images to close a loop.";
+    return;
+  }
+  s->ReadFeatureStore();
+  if (s->vocab_db_.binary_db == NULL) {
+    LOG(INFO) << "Building a vocabulary database to find loop closures.";
+    sparse_mapping::BuildDBforDBoW2(s, s->detector_.GetDetectorName(), 6, 10, 1);
+  }
+  s->InitializeCidFidToPid();
+
+  // The candidates are the most similar images of each image, far
+  // enough from it in the sequence
+  std::vector<cv::Mat> descriptors(num_cid);
+  for (int cid = 0; cid < num_cid; cid++)
+    descriptors[cid] = s->GetFrameDescriptors(cid);
+  std::vector<std::vector<int> > indices;
+  sparse_mapping::QueryDB(s->detector_.GetDetectorName(), &s->vocab_db_, FLAGS_loop_num_similar,
+                          descriptors, &indices, FLAGS_num_threads);
+  std::set<std::pair<int, int> > candidate_set;
+  for (int cid = 0; cid < num_cid; cid++) {
+    for (int other : indices[cid]) {
+      if (std::abs(other - cid) >= FLAGS_loop_min_separation)
+        candidate_set.insert(std::make_pair(std::min(cid, other), std::max(cid, other)));
+    }
+  }
+  std::vector<std::pair<int, int> > candidates(candidate_set.begin(), candidate_set.end());
+  LOG(INFO) << "Verifying " << candidates.size() << " loop closure candidates.";
+
+  // Verify them in parallel, by localizing the later image against
+  // the points of the earlier one. Each writes its own slot.
+  std::vector<LoopClosure> found(candidates.size());
+  std::vector<uint8_t> verified(candidates.size(), 0);
+  common::WorkStealingFor(candidates.size(), std::max(1, static_cast<int>(FLAGS_num_threads)),
+    [s, &candidates, &descriptors, &found, &verified](size_t index, size_t) {
+      int cid1 = candidates[index].first, cid2 = candidates[index].second;
+      std::vector<cv::DMatch> matches;
+      interest_point::FindMatches(descriptors[cid2], descriptors[cid1], &matches);
+      std::vector<Eigen::Vector3d> landmarks;
+      std::vector<Eigen::Vector2d> observations;
+      std::vector<double> match_distances;
+      std::vector<std::pair<int, int> > fid2_pid1;
+      for (cv::DMatch const& match : matches) {
+        int pid = s->tracks_.Pid(cid1, match.trainIdx);
+        if (pid < 0)
+          continue;
+        landmarks.push_back(s->pid_to_xyz_[pid]);
+        observations.push_back(s->cid_to_keypoint_map_[cid2].col(match.queryIdx));
+        match_distances.push_back(match.distance);
+        fid2_pid1.push_back(std::make_pair(match.queryIdx, pid));
+      }
+      if (static_cast<int>(landmarks.size()) < FLAGS_loop_min_inliers)
+        return;
+
+      camera::CameraModel camera(s->cid_to_cam_t_global_[cid1], s->camera_params_);
+      if (sparse_mapping::RansacEstimateCamera(landmarks, observations, s->num_ransac_iterations_,
+                                               s->ransac_inlier_tolerance_, &camera, NULL, NULL,
+                                               &match_distances) != 0)
+        return;
+      std::vector<size_t> inliers;
+      sparse_mapping::CountInliers(landmarks, observations, camera, s->ransac_inlier_tolerance_, &inliers);
+      if (static_cast<int>(inliers.size()) < FLAGS_loop_min_inliers)
+        return;
+
+      LoopClosure & closure = found[index];
+      closure.cid1 = cid1;
+      closure.cid2 = cid2;
+      closure.cam2_t_global = camera.GetTransform();
+      for (size_t i : inliers)
+        closure.fid2_pid1.push_back(fid2_pid1[i]);
+      verified[index] = 1;
+    });
+  std::vector<LoopClosure> closures;
+  for (size_t index = 0; index < candidates.size(); index++) {
+    if (verified[index])
+      closures.push_back(found[index]);
+  }
+  found.clear();
+  LOG(INFO) << "Found " << closures.size() << " loop closures.";
+  if (closures.empty())
+    return;
+
+  // Pose graph optimization, with the relative poses of consecutive
+  // cameras as they are, and those of the loop closures, robustly as
+  // some may still be wrong. The first camera stays fixed.
+  std::vector<Eigen::Affine3d> old_cams = s->cid_to_cam_t_global_;
+  std::vector<Eigen::Vector3d> aa(num_cid), t(num_cid);
+  for (int cid = 0; cid < num_cid; cid++) {
+    camera::RotationToRodrigues(old_cams[cid].linear(), &aa[cid]);
+    t[cid] = old_cams[cid].translation();
+  }
+  ceres::Problem problem;
+  for (int cid = 0; cid + 1 < num_cid; cid++) {
+    problem.AddResidualBlock(new ceres::AutoDiffCostFunction<RelativePoseError, 6, 3, 3, 3, 3>(
+                               new RelativePoseError(old_cams[cid + 1] * old_cams[cid].inverse(), 1.0)),
+                             NULL, &aa[cid][0], &t[cid][0], &aa[cid + 1][0], &t[cid + 1][0]);
+  }
+  for (LoopClosure const& closure : closures) {
+    int i = closure.cid1, j = closure.cid2;
+    problem.AddResidualBlock(new ceres::AutoDiffCostFunction<RelativePoseError, 6, 3, 3, 3, 3>(
+                               new RelativePoseError(closure.cam2_t_global * old_cams[i].inverse(),
+                                                     FLAGS_loop_weight)),
+                             new ceres::CauchyLoss(1.0), &aa[i][0], &t[i][0], &aa[j][0], &t[j][0]);
+  }
+  problem.SetParameterBlockConstant(&aa[0][0]);
+  problem.SetParameterBlockConstant(&t[0][0]);
+  ceres::Solver::Options options;
+  options.linear_solver_type = ceres::CGNR;
+  options.preconditioner_type = ceres::JACOBI;
+  options.max_num_iterations = FLAGS_max_num_iterations;
+  options.num_threads = FLAGS_num_threads;
+  options.minimizer_progress_to_stdout = false;
+  ceres::Solver::Summary summary;
+  ceres::Solve(options, &problem, &summary);
+  LOG(INFO) << "Pose graph cost went from " << summary.initial_cost << " to " << summary.final_cost << ".";
+  for (int cid = 0; cid < num_cid; cid++) {
+    Eigen::Matrix3d r;
+    camera::RodriguesToRotation(aa[cid], &r);
+    s->cid_to_cam_t_global_[cid].linear() = r;
+    s->cid_to_cam_t_global_[cid].translation() = t[cid];
+  }
+
+  // Move each point with the first camera seeing it
+  for (size_t pid = 0; pid < s->pid_to_xyz_.size(); pid++) {
+    if (s->pid_to_cid_fid_[pid].empty())
+      continue;
+    int cid = s->pid_to_cid_fid_[pid].begin()->first;
+    s->pid_to_xyz_[pid] = s->cid_to_cam_t_global_[cid].inverse() * (old_cams[cid] * s->pid_to_xyz_[pid]);
+  }
+
+  // Join the tracks matched across each loop. A feature of the later
+  // image not in a track yet joins the track of the earlier point, and
+  // two tracks are merged unless they disagree on a feature.
+  std::vector<int> parent(s->pid_to_cid_fid_.size());
+  for (size_t pid = 0; pid < parent.size(); pid++)
+    parent[pid] = pid;
+  auto root = [&parent](int pid) -> int {
+    while (parent[pid] != pid)
+      pid = parent[pid] = parent[parent[pid]];
+    return pid;
+  };
+  std::map<std::pair<int, int>, int> added;
+  int num_joined = 0;
+  for (LoopClosure const& closure : closures) {
+    for (std::pair<int, int> const& match : closure.fid2_pid1) {
+      int pid1 = root(match.second);
+      std::pair<int, int> cid_fid2(closure.cid2, match.first);
+      int pid2 = s->tracks_.Pid(cid_fid2.first, cid_fid2.second);
+      if (pid2 < 0) {
+        auto it = added.find(cid_fid2);
+        if (it != added.end())
+          pid2 = it->second;
+      }
+      std::map<int, int> & track1 = s->pid_to_cid_fid_[pid1];
+      if (pid2 < 0) {
+        if (track1.insert(cid_fid2).second) {
+          added[cid_fid2] = pid1;
+          num_joined++;
+        }
+        continue;
+      }
+      pid2 = root(pid2);
+      if (pid2 == pid1)
+        continue;
+      std::map<int, int> & track2 = s->pid_to_cid_fid_[pid2];
+      bool agree = true;
+      for (auto const& obs : track2) {
+        auto it = track1.find(obs.first);
+        agree = agree && (it == track1.end() || it->second == obs.second);
+      }
+      if (!agree)
+        continue;
+      track1.insert(track2.begin(), track2.end());
+      track2.clear();
+      parent[pid2] = pid1;
+      num_joined++;
+    }
+  }
+  std::vector<uint8_t> merged(s->pid_to_cid_fid_.size(), 0);
+  for (size_t pid = 0; pid < merged.size(); pid++)
+    merged[pid] = s->pid_to_cid_fid_[pid].empty();
+  sparse_mapping::RemovePIDs(merged, &s->pid_to_cid_fid_, &s->pid_to_xyz_);
+  s->InitializeCidFidToPid();
+  LOG(INFO) << "Joined " << num_joined << " features and tracks across loops.";
+
+  // Last, bundle-adjust only the cameras around the ends of each loop
+  std::set<int> cids;
+  for (LoopClosure const& closure : closures) {
+    for (int end : {closure.cid1, closure.cid2}) {
+      for (int cid = std::max(0, end - FLAGS_loop_ba_window);
+           cid <= std::min(num_cid - 1, end + FLAGS_loop_ba_window); cid++)
+        cids.insert(cid);
+    }
+  }
+  LocalBundleAdjust(cids, s);
+  s->InitializeCidFidToPid();
+}
+
 // Merge two maps. See merge_maps.cc. The merged map needs to be
 // bundle-adjusted. We need to have write-access to A and B to be able
 // to initialize some auxiliary structures in these maps.
@@ -671,6 +1333,10 @@ void MergeMaps(sparse_mapping::SparseMap * A_in,
   sparse_mapping::SparseMap & B = *B_in;
   sparse_mapping::SparseMap & C = *C_out;
 
+  // The frames get renumbered
+  A.ReadFeatureStore();
+  B.ReadFeatureStore();
+
   // Basic sanity checks (not exhaustive)
   if ( !(A.camera_params_ == B.camera_params_) )
     LOG(FATAL) << "The input maps don't have the same camera parameters.";
@@ -728,15 +1394,38 @@ void MergeMaps(sparse_mapping::SparseMap * A_in,
   for (int cid = num_bcid-num; cid < num_bcid; cid++)
     if (cid >= 0) B_search.insert(num_acid + cid);
 
+  // If a map has a vocabulary database, the images of the other map
+  // need only be matched to their most similar images in it
+  bool A_has_db = FLAGS_merge_num_similar > 0 && A.vocab_db_.binary_db != NULL;
+  bool B_has_db = FLAGS_merge_num_similar > 0 && B.vocab_db_.binary_db != NULL;
+  std::map<int, std::set<int> > A_to_B, B_to_A;
+  if (B_has_db)
+    QuerySeamCandidates(&B, num_acid, B_search, C.cid_to_descriptor_map_, A_search,
+                        FLAGS_merge_num_similar, &A_to_B);
+  if (A_has_db)
+    QuerySeamCandidates(&A, 0, A_search, C.cid_to_descriptor_map_, B_search,
+                        FLAGS_merge_num_similar, &B_to_A);
+  auto is_candidate = [](std::map<int, std::set<int> > const& candidates, int cid1, int cid2) {
+    auto it = candidates.find(cid1);
+    return it != candidates.end() && it->second.find(cid2) != it->second.end();
+  };
+
   // Combine these into cid_to_cid_ and run the matching process.
   C.cid_to_cid_.clear();
+  int num_pairs = 0;
   for (auto it1 = A_search.begin(); it1 != A_search.end() ; it1++) {
     for (auto it2 = B_search.begin(); it2 != B_search.end(); it2++) {
       if (*it1 == *it2)
         LOG(FATAL) << "Book-keeping failure in map merging.";
+      if ((A_has_db || B_has_db) &&
+          !is_candidate(A_to_B, *it1, *it2) && !is_candidate(B_to_A, *it2, *it1))
+        continue;
       C.cid_to_cid_[*it1].insert(*it2);
+      num_pairs++;
     }
   }
+  LOG(INFO) << "Matching " << num_pairs << " of the " << A_search.size() * B_search.size()
+            << " image pairs across the seam.";
 
   // Must set this to 0, to not try to match images in same map,
   // that was done when each map was built.
@@ -778,8 +1467,9 @@ void MergeMaps(sparse_mapping::SparseMap * A_in,
         // Subtract num_acid from cid_b so it becomes a cid in B.
         cid_b -= num_acid;
 
-        int pid_a = A.cid_fid_to_pid_[cid_a][fid_a];
-        int pid_b = B.cid_fid_to_pid_[cid_b][fid_b];
+        int pid_a = A.tracks_.Pid(cid_a, fid_a);
+        int pid_b = B.tracks_.Pid(cid_b, fid_b);
+        if (pid_a < 0 || pid_b < 0) continue;
 
         VoteMap[pid_a][pid_b]++;
       }
@@ -1081,6 +1771,18 @@ void MergeMaps(sparse_mapping::SparseMap * A_in,
   // after the merging is complete but before using the new map.
   C.InitializeCidFidToPid();
 
+  // The two maps meet only through the cameras near the seam, fix
+  // those up first. This is cheap, and leaves less work to a global
+  // bundle adjustment.
+  if (FLAGS_merge_seam_ba) {
+    std::set<int> seam;
+    for (int cid : A_search)
+      seam.insert(cid2cid[cid]);
+    for (int cid : B_search)
+      seam.insert(cid2cid[cid]);
+    LocalBundleAdjust(seam, &C);
+  }
+
   // C.Save(output_map + ".reduced.map");
 
   return;
@@ -1093,6 +1795,7 @@ void ExtractSubmap(std::vector<std::string> * keep_ptr,
   // Create aliases to not use pointers all the time.
   sparse_mapping::SparseMap & map = *map_ptr;
   std::vector<std::string> & keep = *keep_ptr;
+  map.ReadFeatureStore();
 
   // Wipe things that we won't merge (or not yet)
   map.vocab_db_ = sparse_mapping::VocabDB();
@@ -1197,6 +1900,170 @@ void ExtractSubmap(std::vector<std::string> * keep_ptr,
   return;
 }
 
+// The landmarks each image sees
+static void LandmarksOfImages(sparse_mapping::SparseMap const& map, std::vector<std::set<int> > * cid_to_pids) {
+  cid_to_pids->clear();
+  cid_to_pids->resize(map.cid_to_filename_.size());
+  for (size_t pid = 0; pid < map.pid_to_cid_fid_.size(); pid++) {
+    for (auto const& cid_fid : map.pid_to_cid_fid_[pid])
+      (*cid_to_pids)[cid_fid.first].insert(pid);
+  }
+}
+
+// Make a map for localization smaller, by how useful its parts are
+// for localizing. See CompactMapOptions.
+void CompactMap(CompactMapOptions const& options, sparse_mapping::SparseMap * map_ptr) {
+  sparse_mapping::SparseMap & map = *map_ptr;
+  map.ReadFeatureStore();
+  size_t num_images = map.cid_to_filename_.size(), num_landmarks = map.pid_to_xyz_.size();
+  size_t num_features = 0;
+  for (cv::Mat const& descriptors : map.cid_to_descriptor_map_)
+    num_features += descriptors.rows;
+
+  int num_cid = map.cid_to_filename_.size();
+  std::vector<std::set<int> > cid_to_pids;
+  LandmarksOfImages(map, &cid_to_pids);
+
+  // Drop an image taken from about the same place and direction as
+  // one kept before it, which sees most of the same landmarks. Those
+  // stay in the map through the kept image.
+  std::vector<std::string> keep;
+  if (options.duplicate_distance > 0) {
+    double min_cos = cos(options.duplicate_angle * M_PI / 180.0);
+    std::vector<Eigen::Vector3d> centers(num_cid), axes(num_cid);
+    for (int cid = 0; cid < num_cid; cid++) {
+      Eigen::Affine3d const& cam_t_global = map.cid_to_cam_t_global_[cid];
+      centers[cid] = cam_t_global.inverse().translation();
+      axes[cid] = cam_t_global.linear().transpose() * Eigen::Vector3d::UnitZ();
+    }
+    std::vector<int> kept;
+    for (int cid = 0; cid < num_cid; cid++) {
+      bool duplicate = false;
+      // The latest kept images are the likeliest duplicates
+      for (auto it = kept.rbegin(); it != kept.rend() && !duplicate; it++) {
+        if ((centers[cid] - centers[*it]).norm() > options.duplicate_distance ||
+            axes[cid].dot(axes[*it]) < min_cos)
+          continue;
+        size_t shared = 0;
+        for (int pid : cid_to_pids[cid])
+          shared += cid_to_pids[*it].count(pid);
+        duplicate = shared >= options.duplicate_overlap * cid_to_pids[cid].size();
+      }
+      if (!duplicate) {
+        kept.push_back(cid);
+        keep.push_back(map.cid_to_filename_[cid]);
+      }
+    }
+  }
+  if (!keep.empty() && keep.size() < map.cid_to_filename_.size())
+    sparse_mapping::ExtractSubmap(&keep, &map);
+  num_cid = map.cid_to_filename_.size();
+  LandmarksOfImages(map, &cid_to_pids);
+
+  // The utility of a landmark grows with the images seeing it, and
+  // shrinks with its reprojection error
+  std::vector<camera::CameraModel> cameras;
+  for (int cid = 0; cid < num_cid; cid++)
+    cameras.push_back(camera::CameraModel(map.cid_to_cam_t_global_[cid], map.camera_params_));
+  int num_pid = map.pid_to_cid_fid_.size();
+  std::vector<double> utility(num_pid, -1);
+  for (int pid = 0; pid < num_pid; pid++) {
+    std::map<int, int> const& track = map.pid_to_cid_fid_[pid];
+    double error = 0;
+    for (auto const& cid_fid : track)
+      error += (cameras[cid_fid.first].ImageCoordinates(map.pid_to_xyz_[pid]) -
+                map.cid_to_keypoint_map_[cid_fid.first].col(cid_fid.second)).norm();
+    error /= std::max(track.size(), static_cast<size_t>(1));
+    if (static_cast<int>(track.size()) < options.min_observations ||
+        (options.max_reprojection_error > 0 && error > options.max_reprojection_error))
+      continue;
+    utility[pid] = track.size() / (1.0 + error);
+  }
+
+  // In each image keep the most useful landmarks, at most the cap,
+  // taking them in turn from each cell of a grid over the image so
+  // they stay spread out
+  std::set<std::pair<int, int> > selected;
+  int grid = std::max(1, options.coverage_grid);
+  for (int cid = 0; cid < num_cid && options.max_landmarks_per_image > 0; cid++) {
+    Eigen::Matrix2Xd const& keypoints = map.cid_to_keypoint_map_[cid];
+    std::vector<std::pair<int, int> > observations;  // fid, pid
+    for (int pid : cid_to_pids[cid]) {
+      if (utility[pid] >= 0) {
+        auto it = map.pid_to_cid_fid_[pid].find(cid);
+        if (it != map.pid_to_cid_fid_[pid].end())
+          observations.push_back(std::make_pair(it->second, pid));
+      }
+    }
+    if (observations.empty())
+      continue;
+    Eigen::Vector2d lower = keypoints.col(observations[0].first), upper = lower;
+    for (auto const& obs : observations) {
+      lower = lower.cwiseMin(keypoints.col(obs.first));
+      upper = upper.cwiseMax(keypoints.col(obs.first));
+    }
+    Eigen::Vector2d cell_size = ((upper - lower) / grid).cwiseMax(Eigen::Vector2d::Constant(1e-6));
+    std::vector<std::vector<std::pair<int, int> > > cells(grid * grid);
+    for (auto const& obs : observations) {
+      Eigen::Vector2d p = (keypoints.col(obs.first) - lower).cwiseQuotient(cell_size);
+      int x = std::min(grid - 1, static_cast<int>(p[0])), y = std::min(grid - 1, static_cast<int>(p[1]));
+      cells[y * grid + x].push_back(obs);
+    }
+    for (auto & cell : cells) {
+      std::sort(cell.begin(), cell.end(),
+                [&utility](std::pair<int, int> const& a, std::pair<int, int> const& b) {
+                  return utility[a.second] > utility[b.second];
+                });
+    }
+    int num_selected = 0;
+    for (size_t rank = 0; num_selected < options.max_landmarks_per_image; rank++) {
+      bool any = false;
+      for (size_t c = 0; c < cells.size() && num_selected < options.max_landmarks_per_image; c++) {
+        if (rank >= cells[c].size())
+          continue;
+        selected.insert(std::make_pair(cid, cells[c][rank].first));
+        num_selected++;
+        any = true;
+      }
+      if (!any)
+        break;
+    }
+  }
+
+  // Keep the selected observations of the useful landmarks, in tracks
+  // of at least two images
+  std::vector<std::map<int, int> > pid_to_cid_fid;
+  std::vector<Eigen::Vector3d> pid_to_xyz;
+  for (int pid = 0; pid < num_pid; pid++) {
+    if (utility[pid] < 0)
+      continue;
+    std::map<int, int> track;
+    for (auto const& cid_fid : map.pid_to_cid_fid_[pid]) {
+      if (options.max_landmarks_per_image <= 0 || selected.count(cid_fid) > 0)
+        track.insert(cid_fid);
+    }
+    if (track.size() < 2)
+      continue;
+    pid_to_cid_fid.push_back(track);
+    pid_to_xyz.push_back(map.pid_to_xyz_[pid]);
+  }
+  map.pid_to_cid_fid_ = pid_to_cid_fid;
+  map.pid_to_xyz_ = pid_to_xyz;
+  map.InitializeCidFidToPid();
+
+  // The features left without a landmark go too, and the database
+  // no longer matches the features
+  map.PruneMap();
+  map.vocab_db_ = sparse_mapping::VocabDB();
+
+  size_t num_features_left = 0;
+  for (cv::Mat const& descriptors : map.cid_to_descriptor_map_)
+    num_features_left += descriptors.rows;
+  LOG(INFO) << "Compacted the map from " << num_images << " to " << map.cid_to_filename_.size()
+            << " images, " << num_landmarks << " to " << map.pid_to_xyz_.size() << " landmarks, and "
+            << num_features << " to " << num_features_left << " features.";
+}
+
 // Register a map to world coordinates from user-supplied data, or simply
 // verify how well the map performs with this data.
 void RegistrationOrVerification(std::vector<std::string> const& data_files,
@@ -1341,14 +2208,9 @@ void RegistrationOrVerification(std::vector<std::string> const& data_files,
   }
 
   // Shift the keypoints. Undistort if necessary.
-  Eigen::Vector2d output;
-  for (size_t cid = 0; cid < map->user_cid_to_keypoint_map_.size(); cid++) {
-    for (int i = 0; i < map->user_cid_to_keypoint_map_[cid].cols(); i++) {
-      map->camera_params_.Convert<camera::DISTORTED, camera::UNDISTORTED_C>
-        (map->user_cid_to_keypoint_map_[cid].col(i), &output);
-      map->user_cid_to_keypoint_map_[cid].col(i) = output;
-    }
-  }
+  for (size_t cid = 0; cid < map->user_cid_to_keypoint_map_.size(); cid++)
+    map->camera_params_.ConvertPoints<camera::DISTORTED, camera::UNDISTORTED_C>
+      (map->user_cid_to_keypoint_map_[cid], &map->user_cid_to_keypoint_map_[cid]);
 
   // Initialize user_pid_to_xyz_
   map->user_pid_to_xyz_.resize(user_xyz.cols());
@@ -1719,11 +2581,11 @@ void BuildMapFindEssentialAndInliers(Eigen::Matrix2Xd const& keypoints1,
   Eigen::Affine3d result = cameras[1] * cameras[0].inverse();
   result.translation().normalize();
 
-  // Must use a lock to protect this map shared among the threads
-  match_mutex->lock();
+  // Must use a lock to protect this map if it is shared among the threads
+  if (match_mutex) match_mutex->lock();
   relative_affines->insert(std::make_pair(std::make_pair(cam_a_idx, cam_b_idx),
                                         result));
-  match_mutex->unlock();
+  if (match_mutex) match_mutex->unlock();
 
   cv::Mat valid = cv::Mat::zeros(pt_count, 1, CV_8UC1);
   for (size_t i = 0; i < vec_inliers.size(); i++) {
@@ -1783,21 +2645,32 @@ void Triangulate(std::vector<Eigen::Affine3d> const& cid_to_cam_t_global,
                         cid_to_cam_t_global[cid].translation(), &cid_to_p[cid]);
   }
 
-  pid_to_xyz->resize(pid_to_cid_fid->size());
-  for (int pid = pid_to_cid_fid->size() - 1; pid >= 0; pid--) {
-    openMVG::Triangulation tri;
-    for (std::pair<int, int> const& cid_fid : pid_to_cid_fid->at(pid)) {
-      tri.add(cid_to_p[cid_fid.first],  // they're holding a pointer to this
-              cid_to_keypoint_map[cid_fid.first].col(cid_fid.second));
-    }
-    Eigen::Vector3d solution = tri.compute();
-    if (std::isnan(solution[0]) || tri.minDepth() < 0) {
-      pid_to_xyz->erase(pid_to_xyz->begin() + pid);
-      pid_to_cid_fid->erase(pid_to_cid_fid->begin() + pid);
-    } else {
-      pid_to_xyz->at(pid) = solution;
-    }
-  }
+  // Each point is triangulated on its own, so split them in blocks
+  // among the threads. Each writes only its own points, and the failed
+  // ones are removed afterwards, in order, so the result does not
+  // depend on the threads.
+  const size_t kPidBlock = 1024;
+  size_t num_pid = pid_to_cid_fid->size();
+  size_t num_blocks = (num_pid + kPidBlock - 1) / kPidBlock;
+  pid_to_xyz->resize(num_pid);
+  std::vector<uint8_t> failed(num_pid, 0);
+  common::WorkStealingFor(num_blocks, std::max(1, static_cast<int>(FLAGS_num_threads)),
+    [&cid_to_p, &cid_to_keypoint_map, pid_to_cid_fid, pid_to_xyz, &failed, num_pid]
+    (size_t block, size_t) {
+      for (size_t pid = block * kPidBlock; pid < std::min(num_pid, (block + 1) * kPidBlock); pid++) {
+        openMVG::Triangulation tri;
+        for (std::pair<int, int> const& cid_fid : pid_to_cid_fid->at(pid)) {
+          tri.add(cid_to_p[cid_fid.first],  // they're holding a pointer to this
+                  cid_to_keypoint_map[cid_fid.first].col(cid_fid.second));
+        }
+        Eigen::Vector3d solution = tri.compute();
+        if (std::isnan(solution[0]) || tri.minDepth() < 0)
+          failed[pid] = 1;
+        else
+          pid_to_xyz->at(pid) = solution;
+      }
+    });
+  RemovePIDs(failed, pid_to_cid_fid, pid_to_xyz);
 }
 
 }  // namespace sparse_mapping
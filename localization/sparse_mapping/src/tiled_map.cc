@@ -0,0 +1,201 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/tiled_map.h>
+#include <sparse_mapping/sparse_map.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <utility>
+
+namespace sparse_mapping {
+
+static const char kTiledMapMagic[] = "tiled_map";
+
+bool IsTiledMapFile(std::string const& filename) {
+  std::ifstream is(filename.c_str());
+  std::string magic;
+  return (is >> magic) && magic == kTiledMapMagic;
+}
+
+bool ReadTiledMapIndex(std::string const& filename, std::vector<MapTile>* tiles) {
+  tiles->clear();
+  std::ifstream is(filename.c_str());
+  std::string magic;
+  int version;
+  if (!(is >> magic >> version) || magic != kTiledMapMagic || version != 1) {
+    LOG(ERROR) << "Not a tiled map index: " << filename;
+    return false;
+  }
+
+  // map files are relative to the index
+  std::string dir;
+  size_t slash = filename.rfind('/');
+  if (slash != std::string::npos)
+    dir = filename.substr(0, slash + 1);
+
+  MapTile tile;
+  while (is >> tile.name >> tile.map_file >> tile.min.x() >> tile.max.x() >> tile.min.y() >> tile.max.y()
+            >> tile.min.z() >> tile.max.z()) {
+    if (tile.map_file[0] != '/')
+      tile.map_file = dir + tile.map_file;
+    tiles->push_back(tile);
+  }
+  if (!is.eof()) {
+    LOG(ERROR) << "Could not parse tile " << tiles->size() << " of " << filename;
+    return false;
+  }
+  return true;
+}
+
+bool WriteTiledMapIndex(std::string const& filename, std::vector<MapTile> const& tiles) {
+  std::ofstream os(filename.c_str());
+  os.precision(17);
+  os << kTiledMapMagic << " 1\n";
+  for (size_t i = 0; i < tiles.size(); i++)
+    os << tiles[i].name << " " << tiles[i].map_file << " "
+       << tiles[i].min.x() << " " << tiles[i].max.x() << " "
+       << tiles[i].min.y() << " " << tiles[i].max.y() << " "
+       << tiles[i].min.z() << " " << tiles[i].max.z() << "\n";
+  return static_cast<bool>(os);
+}
+
+// Zero inside the box
+static double BoxDistance(MapTile const& tile, Eigen::Vector3d const& position) {
+  return (position - position.cwiseMax(tile.min).cwiseMin(tile.max)).norm();
+}
+
+TiledMap::TiledMap(std::string const& index_file, int max_loaded, double prefetch_distance) :
+  max_loaded_(std::max(1, max_loaded)), prefetch_distance_(prefetch_distance), use_count_(0), stop_(false) {
+  if (!ReadTiledMapIndex(index_file, &tiles_))
+    LOG(FATAL) << "Failed to read the tiled map " << index_file;
+  maps_.resize(tiles_.size());
+  last_used_.resize(tiles_.size(), 0);
+  loading_.resize(tiles_.size(), false);
+  thread_ = std::thread(&TiledMap::Worker, this);
+}
+
+TiledMap::~TiledMap() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  thread_.join();
+}
+
+int TiledMap::FindTile(Eigen::Vector3d const& position) const {
+  int best = -1;
+  double best_dist = std::numeric_limits<double>::max();
+  for (size_t i = 0; i < tiles_.size(); i++) {
+    double dist = BoxDistance(tiles_[i], position);
+    if (dist < best_dist) {
+      best_dist = dist;
+      best = i;
+    }
+  }
+  return best;
+}
+
+std::shared_ptr<SparseMap> TiledMap::Get(int tile) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock, [this, tile] { return !loading_[tile]; });
+  if (maps_[tile]) {
+    last_used_[tile] = ++use_count_;
+    return maps_[tile];
+  }
+  return Load(tile, &lock);
+}
+
+void TiledMap::Prefetch(Eigen::Vector3d const& position) {
+  // The nearest tiles, as many as are kept
+  std::vector<std::pair<double, int> > near;
+  for (size_t i = 0; i < tiles_.size(); i++) {
+    double dist = BoxDistance(tiles_[i], position);
+    if (dist <= prefetch_distance_)
+      near.push_back(std::make_pair(dist, i));
+  }
+  std::sort(near.begin(), near.end());
+  near.resize(std::min(near.size(), static_cast<size_t>(max_loaded_)));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < near.size(); i++) {
+    int tile = near[i].second;
+    if (!maps_[tile] && !loading_[tile] && std::find(queue_.begin(), queue_.end(), tile) == queue_.end())
+      queue_.push_back(tile);
+  }
+  cond_.notify_all();
+}
+
+void TiledMap::SetConfigure(std::function<void(SparseMap*)> const& configure) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  configure_ = configure;
+  for (size_t i = 0; i < maps_.size(); i++)
+    if (maps_[i] && configure_)
+      configure_(maps_[i].get());
+}
+
+// Called, and returns, with the lock held, which is released while the
+// map is read
+std::shared_ptr<SparseMap> TiledMap::Load(int tile, std::unique_lock<std::mutex>* lock) {
+  loading_[tile] = true;
+  lock->unlock();
+  LOG(INFO) << "Loading map tile " << tiles_[tile].name << ".";
+  std::shared_ptr<SparseMap> map(new SparseMap(tiles_[tile].map_file, true));
+  lock->lock();
+  loading_[tile] = false;
+  if (configure_)
+    configure_(map.get());
+  maps_[tile] = map;
+  last_used_[tile] = ++use_count_;
+
+  // drop the least recently used tiles over the limit
+  int num_loaded = 0;
+  for (size_t i = 0; i < maps_.size(); i++)
+    num_loaded += (maps_[i] != NULL);
+  while (num_loaded > max_loaded_) {
+    int oldest = -1;
+    for (size_t i = 0; i < maps_.size(); i++)
+      if (maps_[i] && static_cast<int>(i) != tile && (oldest < 0 || last_used_[i] < last_used_[oldest]))
+        oldest = i;
+    LOG(INFO) << "Dropping map tile " << tiles_[oldest].name << ".";
+    maps_[oldest].reset();
+    num_loaded--;
+  }
+  cond_.notify_all();
+  return map;
+}
+
+void TiledMap::Worker() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+    if (stop_)
+      return;
+    int tile = queue_.front();
+    queue_.pop_front();
+    if (!maps_[tile] && !loading_[tile])
+      Load(tile, &lock);
+  }
+}
+
+}  // namespace sparse_mapping
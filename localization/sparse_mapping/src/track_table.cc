@@ -0,0 +1,140 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/track_table.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace sparse_mapping {
+
+TrackTable::TrackTable() {}
+
+TrackTable::TrackTable(int num_cid, std::vector<std::map<int, int> > const& pid_to_cid_fid) {
+  Build(num_cid, pid_to_cid_fid);
+}
+
+void TrackTable::Clear() {
+  track_offsets_.clear();
+  observations_.clear();
+  frame_offsets_.clear();
+  frame_pids_.clear();
+}
+
+void TrackTable::Build(int num_cid, std::vector<std::map<int, int> > const& pid_to_cid_fid) {
+  Clear();
+  track_offsets_.resize(pid_to_cid_fid.size() + 1);
+  track_offsets_[0] = 0;
+  for (size_t pid = 0; pid < pid_to_cid_fid.size(); pid++)
+    track_offsets_[pid + 1] = track_offsets_[pid] + pid_to_cid_fid[pid].size();
+
+  observations_.reserve(track_offsets_.back());
+  for (size_t pid = 0; pid < pid_to_cid_fid.size(); pid++) {
+    for (std::map<int, int>::value_type const& cid_fid : pid_to_cid_fid[pid]) {
+      Observation obs = {cid_fid.first, cid_fid.second};
+      observations_.push_back(obs);
+    }
+  }
+
+  BuildFrames(num_cid);
+}
+
+void TrackTable::Build(int num_cid, size_t num_pid,
+                       const uint64_t* track_offsets, const uint32_t* cid_fid) {
+  Clear();
+  track_offsets_.assign(track_offsets, track_offsets + num_pid + 1);
+  CHECK(track_offsets_[0] == 0) << "Invalid track offsets.";
+
+  observations_.resize(track_offsets_.back());
+  for (size_t k = 0; k < observations_.size(); k++) {
+    observations_[k].cid = cid_fid[2 * k];
+    observations_[k].fid = cid_fid[2 * k + 1];
+  }
+
+  // Keep the per-track ordering the map based tables would have
+  for (size_t pid = 0; pid < num_pid; pid++)
+    std::sort(observations_.begin() + track_offsets_[pid],
+              observations_.begin() + track_offsets_[pid + 1],
+              [](Observation const& a, Observation const& b) { return a.cid < b.cid; });
+
+  BuildFrames(num_cid);
+}
+
+void TrackTable::BuildFrames(int num_cid) {
+  // Size each frame's fid -> pid array by the largest fid seen in it
+  std::vector<int32_t> frame_size(num_cid, 0);
+  for (Observation const& obs : observations_) {
+    CHECK(obs.cid >= 0 && obs.cid < num_cid)
+      << "Track observation in frame " << obs.cid << " but there are only " << num_cid << " frames.";
+    frame_size[obs.cid] = std::max(frame_size[obs.cid], obs.fid + 1);
+  }
+
+  frame_offsets_.resize(num_cid + 1);
+  frame_offsets_[0] = 0;
+  for (int cid = 0; cid < num_cid; cid++)
+    frame_offsets_[cid + 1] = frame_offsets_[cid] + frame_size[cid];
+
+  frame_pids_.assign(frame_offsets_.back(), -1);
+  size_t num_pid = NumLandmarks();
+  for (size_t pid = 0; pid < num_pid; pid++) {
+    for (uint64_t k = track_offsets_[pid]; k < track_offsets_[pid + 1]; k++) {
+      Observation const& obs = observations_[k];
+      frame_pids_[frame_offsets_[obs.cid] + obs.fid] = pid;
+    }
+  }
+}
+
+void TrackTable::GetFidToPidMap(int cid, std::map<int, int> * fid_to_pid) const {
+  fid_to_pid->clear();
+  uint64_t begin = frame_offsets_[cid], end = frame_offsets_[cid + 1];
+  for (uint64_t k = begin; k < end; k++) {
+    if (frame_pids_[k] >= 0)
+      fid_to_pid->insert(fid_to_pid->end(), std::make_pair(static_cast<int>(k - begin), frame_pids_[k]));
+  }
+}
+
+void TrackTable::GetCidToFidMap(int pid, std::map<int, int> * cid_to_fid) const {
+  cid_to_fid->clear();
+  for (const Observation* it = TrackBegin(pid); it != TrackEnd(pid); it++)
+    cid_to_fid->insert(cid_to_fid->end(), std::make_pair(it->cid, it->fid));
+}
+
+void TrackTable::RenumberFeatures(int cid, std::vector<int> const& new_fid) {
+  uint64_t begin = frame_offsets_[cid], end = frame_offsets_[cid + 1];
+  std::vector<int32_t> pids(frame_pids_.begin() + begin, frame_pids_.begin() + end);
+  std::fill(frame_pids_.begin() + begin, frame_pids_.begin() + end, -1);
+
+  for (size_t fid = 0; fid < pids.size(); fid++) {
+    int pid = pids[fid];
+    if (pid < 0)
+      continue;
+    CHECK(fid < new_fid.size() && new_fid[fid] >= 0 && new_fid[fid] <= static_cast<int>(fid))
+      << "Cannot renumber feature " << fid << " of frame " << cid << ".";
+    // Features can only move down, so the frame array does not grow
+    frame_pids_[begin + new_fid[fid]] = pid;
+    for (uint64_t k = track_offsets_[pid]; k < track_offsets_[pid + 1]; k++) {
+      if (observations_[k].cid == cid)
+        observations_[k].fid = new_fid[fid];
+    }
+  }
+}
+
+}  // namespace sparse_mapping
@@ -57,8 +57,10 @@
 #include <sparse_mapping/sparse_map.h>
 #include <sparse_mapping/sparse_mapping.h>
 #include <sparse_map.pb.h>
+#include <interest_point/hamming.h>
 #include <glog/logging.h>
 #include <opencv2/highgui/highgui.hpp>
+#include <common/thread.h>
 #include <common/utils.h>
 
 // DBoW2 utils
@@ -67,6 +69,10 @@
 #include <DBoW2/DBoW2.h>      // BoW db that works with both float and binary descriptors
 #pragma GCC diagnostic pop
 
+#include <string.h>
+
+#include <algorithm>
+#include <map>
 #include <vector>
 #include <string>
 
@@ -95,20 +101,182 @@ class ProtobufDatabase : public DBoW2::TemplatedDatabase<TDescriptor, F> {
      DBoW2::TemplatedDatabase<TDescriptor, F>(voc, flag, val) {}
   void SaveProtobuf(google::protobuf::io::ZeroCopyOutputStream* output) const;
   void LoadProtobuf(google::protobuf::io::ZeroCopyInputStream* input);
+
+  // The map image of an entry, -1 if the image was removed.
+  int EntryCid(DBoW2::EntryId id) const {
+    if (entry_cid.empty())
+      return id;
+    return id < entry_cid.size() ? entry_cid[id] : -1;
+  }
+  // Drop the given entries from the inverted file. Their ids stay
+  // taken, new entries get new ids.
+  void RemoveEntries(std::vector<bool> const& removed);
+
+  // Empty while every entry i is image i, as when the database is
+  // built from scratch.
+  std::vector<int> entry_cid;
 };
 
 typedef ProtobufVocabulary<DBoW2::FBrief::TDescriptor, DBoW2::FBrief> BinaryVocabulary;
 typedef ProtobufDatabase<DBoW2::FBrief::TDescriptor, DBoW2::FBrief> BriefDatabase;
+typedef DBoW2::TemplatedVocabulary<DBoW2::FBrief::TDescriptor, DBoW2::FBrief> BriefVocabulary;
+
+// Reads the tree and scoring of any vocabulary, which DBoW2 keeps
+// protected. Never instantiated.
+class BriefVocabularyAccess : public BriefVocabulary {
+ public:
+  typedef BriefVocabulary::Node Node;
+  static std::vector<Node> const& Nodes(BriefVocabulary const& voc) {
+    return voc.*(&BriefVocabularyAccess::m_nodes);
+  }
+  static DBoW2::GeneralScoring const* Scoring(BriefVocabulary const& voc) {
+    return voc.*(&BriefVocabularyAccess::m_scoring_object);
+  }
+};
+
+// The tree of a binary vocabulary, flattened for queries. The
+// descriptors of the children of each node are stored side by side,
+// so a descriptor is compared with all of them in one pass of
+// HammingNearest, rather than by a distance call per child and a copy
+// of the children's ids per level as in TemplatedVocabulary::transform.
+class BinaryTree {
+ public:
+  BinaryTree() : num_bytes_(0) {}
+  void Build(BriefVocabulary const& voc);
+
+  // The leaf each row of descriptors descends to, the first nearest
+  // child at each level as in DBoW2. All rows go down a level at a
+  // time, so the nodes near the root, which every row visits, stay in
+  // cache.
+  void Descend(cv::Mat const& descriptors, std::vector<DBoW2::NodeId> * leaves) const;
+
+  DBoW2::WordId Word(DBoW2::NodeId leaf) const {return word_[leaf];}
+  DBoW2::WordValue Weight(DBoW2::NodeId leaf) const {return weight_[leaf];}
+
+ private:
+  int num_bytes_;
+  // per node, where its children start in child_, and how many
+  std::vector<int> first_, count_;
+  std::vector<DBoW2::NodeId> child_;
+  std::vector<uint8_t> descriptors_;  // of child_, num_bytes_ each
+  std::vector<DBoW2::WordId> word_;
+  std::vector<DBoW2::WordValue> weight_;
+};
+
+void BinaryTree::Build(BriefVocabulary const& voc) {
+  std::vector<BriefVocabularyAccess::Node> const& nodes = BriefVocabularyAccess::Nodes(voc);
+  num_bytes_ = 0;
+  first_.assign(nodes.size(), 0);
+  count_.assign(nodes.size(), 0);
+  word_.assign(nodes.size(), 0);
+  weight_.assign(nodes.size(), 0);
+  child_.clear();
+  descriptors_.clear();
+  for (size_t id = 0; id < nodes.size(); id++) {
+    first_[id] = child_.size();
+    count_[id] = nodes[id].children.size();
+    word_[id] = nodes[id].word_id;
+    weight_[id] = nodes[id].weight;
+    for (DBoW2::NodeId child : nodes[id].children) {
+      DBoW2::FBrief::TDescriptor const& d = nodes[child].descriptor;
+      if (num_bytes_ == 0)
+        num_bytes_ = d.size;
+      CHECK(d.size == num_bytes_) << "Vocabulary descriptors differ in size.";
+      child_.push_back(child);
+      descriptors_.insert(descriptors_.end(), d.desc, d.desc + d.size);
+    }
+  }
+}
+
+void BinaryTree::Descend(cv::Mat const& descriptors, std::vector<DBoW2::NodeId> * leaves) const {
+  leaves->assign(descriptors.rows, 0);
+  if (count_.empty() || count_[0] == 0 || descriptors.rows == 0)
+    return;
+  CHECK(descriptors.depth() == CV_8U && static_cast<int>(descriptors.cols * descriptors.elemSize()) == num_bytes_)
+    << "Expecting " << num_bytes_ << " byte binary descriptors.";
+
+  std::vector<int> rows(descriptors.rows);
+  for (int r = 0; r < descriptors.rows; r++)
+    rows[r] = r;
+  while (!rows.empty()) {
+    size_t kept = 0;
+    for (int r : rows) {
+      DBoW2::NodeId node = (*leaves)[r];
+      int first = first_[node];
+      int nearest = interest_point::HammingNearest(descriptors.ptr(r), &descriptors_[first * num_bytes_],
+                                                   count_[node], num_bytes_, num_bytes_, NULL);
+      DBoW2::NodeId child = child_[first + nearest];
+      (*leaves)[r] = child;
+      if (count_[child] > 0)
+        rows[kept++] = r;
+    }
+    rows.resize(kept);
+  }
+}
 
 // Thin wrappers around DBoW2 databases, to avoid exposing the
-// originals in the header file for compilation speed.
+// originals in the header file for compilation speed. Queries go
+// through the flattened vocabulary tree.
 class BinaryDB : public BriefDatabase {
  public:
-  explicit BinaryDB(google::protobuf::io::ZeroCopyInputStream* input) : BriefDatabase(input) {}
+  explicit BinaryDB(google::protobuf::io::ZeroCopyInputStream* input) : BriefDatabase(input) {
+    tree_.Build(*getVocabulary());
+  }
   BinaryDB(BinaryVocabulary const& voc, bool flag, int val):
-       BriefDatabase(voc, flag, val){}
+       BriefDatabase(voc, flag, val) {
+    tree_.Build(*getVocabulary());
+  }
+
+  // As TemplatedVocabulary::transform, for the rows of descriptors
+  void Transform(cv::Mat const& descriptors, DBoW2::BowVector * bow) const;
+  // As TemplatedVocabulary::transform for one descriptor, for each row
+  void Quantize(cv::Mat const& descriptors, std::vector<DBoW2::WordId> * words) const;
+
+ private:
+  BinaryTree tree_;
 };
 
+void BinaryDB::Transform(cv::Mat const& descriptors, DBoW2::BowVector * bow) const {
+  bow->clear();
+  BriefVocabulary const& voc = *getVocabulary();
+  if (voc.empty())
+    return;
+
+  std::vector<DBoW2::NodeId> leaves;
+  tree_.Descend(descriptors, &leaves);
+
+  // Weigh and normalize the words the same way
+  DBoW2::LNorm norm;
+  bool must = BriefVocabularyAccess::Scoring(voc)->mustNormalize(norm);
+  DBoW2::WeightingType weighting = voc.getWeightingType();
+  for (DBoW2::NodeId leaf : leaves) {
+    DBoW2::WordValue weight = tree_.Weight(leaf);
+    if (weight <= 0)
+      continue;  // stopped word
+    if (weighting == DBoW2::TF || weighting == DBoW2::TF_IDF)
+      bow->addWeight(tree_.Word(leaf), weight);
+    else
+      bow->addIfNotExist(tree_.Word(leaf), weight);
+  }
+  if ((weighting == DBoW2::TF || weighting == DBoW2::TF_IDF) && !bow->empty() && !must) {
+    double nd = bow->size();
+    for (auto & word : *bow)
+      word.second /= nd;
+  }
+  if (must)
+    bow->normalize(norm);
+}
+
+void BinaryDB::Quantize(cv::Mat const& descriptors, std::vector<DBoW2::WordId> * words) const {
+  words->assign(descriptors.rows, 0);
+  if (getVocabulary()->empty())
+    return;
+  std::vector<DBoW2::NodeId> leaves;
+  tree_.Descend(descriptors, &leaves);
+  for (size_t r = 0; r < leaves.size(); r++)
+    (*words)[r] = tree_.Word(leaves[r]);
+}
+
 template<class TDescriptor, class F>
 void ProtobufVocabulary<TDescriptor, F>::LoadProtobuf(google::protobuf::io::ZeroCopyInputStream* input) {
   // C++ is a dumb language, we have to put this in front of all member variables inherited from
@@ -195,6 +363,18 @@ void ProtobufDatabase<TDescriptor, F>::LoadProtobuf(google::protobuf::io::ZeroCo
 
     this->m_ifile[wid].push_back(typename DBoW2::TemplatedDatabase<TDescriptor, F>::IFPair(eid, v));
   }
+
+  entry_cid.assign(db.entry_cid().begin(), db.entry_cid().end());
+}
+
+template<class TDescriptor, class F>
+void ProtobufDatabase<TDescriptor, F>::RemoveEntries(std::vector<bool> const& removed) {
+  typedef typename DBoW2::TemplatedDatabase<TDescriptor, F>::IFPair IFPair;
+  for (auto & row : this->m_ifile) {
+    row.erase(std::remove_if(row.begin(), row.end(), [&removed](IFPair const& pair) {
+          return pair.entry_id < removed.size() && removed[pair.entry_id];
+        }), row.end());
+  }
 }
 
 template<class TDescriptor, class F>
@@ -258,6 +438,8 @@ void ProtobufDatabase<TDescriptor, F>::SaveProtobuf(google::protobuf::io::ZeroCo
   sparse_mapping_protobuf::DBoWDB db;
 
   db.set_num_entries(this->m_nentries);
+  for (int cid : entry_cid)
+    db.add_entry_cid(cid);
 
   int num_inverted_index = 0;
   typename DBoW2::TemplatedDatabase<TDescriptor, F>::InvertedFile::const_iterator iit;
@@ -371,6 +553,108 @@ void MatDescrToVec(cv::Mat const& mat, DBoW2::BriefDescriptor * brief) {
     brief->desc[c] = mat.at<uchar>(0, c);
 }
 
+// Query a binary database with one image's descriptors. Only const
+// members of the database are used, so this can run concurrently.
+void UpdateDB(std::string const& map_file,
+              std::string const& old_map_file,
+              std::string const& descriptor) {
+  if (!IsBinaryDescriptor(descriptor))
+    LOG(FATAL) << "Using unsupported vocabulary database type.";
+
+  SparseMap map(map_file);
+  SparseMap old_map(old_map_file);
+  if (old_map.vocab_db_.binary_db == NULL)
+    LOG(FATAL) << "The map " << old_map_file << " has no vocabulary database to update.";
+
+  // Find the images which are in both maps, unchanged
+  std::map<std::string, int> name_to_old_cid;
+  for (size_t cid = 0; cid < old_map.GetNumFrames(); cid++)
+    name_to_old_cid[old_map.GetFrameFilename(cid)] = cid;
+  std::vector<int> old_cid_to_cid(old_map.GetNumFrames(), -1);
+  std::vector<bool> is_new(map.GetNumFrames(), true);
+  for (size_t cid = 0; cid < map.GetNumFrames(); cid++) {
+    auto it = name_to_old_cid.find(map.GetFrameFilename(cid));
+    if (it == name_to_old_cid.end())
+      continue;
+    cv::Mat descriptors = map.GetFrameDescriptors(cid);
+    cv::Mat old_descriptors = old_map.GetFrameDescriptors(it->second);
+    if (descriptors.size() != old_descriptors.size() || descriptors.type() != old_descriptors.type())
+      continue;
+    bool same = true;
+    for (int r = 0; r < descriptors.rows && same; r++)
+      same = memcmp(descriptors.ptr(r), old_descriptors.ptr(r), descriptors.cols * descriptors.elemSize()) == 0;
+    if (same && old_cid_to_cid[it->second] < 0) {
+      old_cid_to_cid[it->second] = cid;
+      is_new[cid] = false;
+    }
+  }
+
+  // Take over the old database. Renumber the entries of the images
+  // kept, and tombstone the others.
+  BinaryDB* db = old_map.vocab_db_.binary_db;
+  old_map.vocab_db_.binary_db = NULL;
+  std::vector<int> entry_cid(db->size());
+  for (size_t entry = 0; entry < entry_cid.size(); entry++)
+    entry_cid[entry] = db->EntryCid(entry);
+  std::vector<bool> removed(entry_cid.size(), false);
+  int num_removed = 0;
+  for (size_t entry = 0; entry < entry_cid.size(); entry++) {
+    int old_cid = entry_cid[entry];
+    if (old_cid >= 0 && old_cid < static_cast<int>(old_cid_to_cid.size()) && old_cid_to_cid[old_cid] >= 0) {
+      entry_cid[entry] = old_cid_to_cid[old_cid];
+    } else {
+      removed[entry] = (old_cid >= 0);
+      num_removed += removed[entry];
+      entry_cid[entry] = -1;
+    }
+  }
+  db->RemoveEntries(removed);
+
+  // Insert the new and changed images, with the trained vocabulary
+  int num_added = 0;
+  for (size_t cid = 0; cid < map.GetNumFrames(); cid++) {
+    if (!is_new[cid])
+      continue;
+    cv::Mat descriptors = map.GetFrameDescriptors(cid);
+    std::vector<DBoW2::FBrief::TDescriptor> features(descriptors.rows);
+    for (int r = 0; r < descriptors.rows; r++)
+      MatDescrToVec(descriptors.row(r), &features[r]);
+    DBoW2::EntryId entry = db->add(features);
+    CHECK(entry == entry_cid.size()) << "Unexpected vocabulary database entry id.";
+    entry_cid.push_back(cid);
+    num_added++;
+  }
+  db->entry_cid = entry_cid;
+
+  LOG(INFO) << "Updated the vocabulary database of " << old_map_file << ": kept "
+            << map.GetNumFrames() - num_added << " images, added " << num_added
+            << ", removed " << num_removed << ".";
+
+  ResetDB(&map.vocab_db_);
+  map.vocab_db_.binary_db = db;
+  map.vocab_db_.m_num_nodes = db->size();
+  map.Save(map_file);
+}
+
+static void QueryBinaryDB(BinaryDB const& db, int num_similar,
+                          cv::Mat const& descriptors,
+                          std::vector<int> * indices) {
+  indices->clear();
+
+  DBoW2::BowVector bow;
+  db.Transform(descriptors, &bow);
+
+  DBoW2::QueryResults ret;
+  db.query(bow, ret, num_similar);
+
+  indices->reserve(ret.size());
+  for (size_t j = 0; j < ret.size(); j++) {
+    int cid = db.EntryCid(ret[j].Id);
+    if (cid >= 0)
+      indices->push_back(cid);
+  }
+}
+
 void QueryDB(std::string const& descriptor,
                              VocabDB * vocab_db,
                              int num_similar,
@@ -384,21 +668,7 @@ void QueryDB(std::string const& descriptor,
 
   if (vocab_db->binary_db != NULL) {
     assert(IsBinaryDescriptor(descriptor));
-    BinaryDB & db = *(vocab_db->binary_db);  // shorten
-
-    std::vector<DBoW2::BriefDescriptor> descriptors_vec;
-    for (int r = 0; r < descriptors.rows; r++) {
-      DBoW2::BriefDescriptor descriptor;
-      MatDescrToVec(descriptors.row(r), &descriptor);
-      descriptors_vec.push_back(descriptor);
-    }
-
-    DBoW2::QueryResults ret;
-    db.query(descriptors_vec, ret, num_similar);
-
-    for (size_t j = 0; j < ret.size(); j++) {
-      indices->push_back(ret[j].Id);
-    }
+    QueryBinaryDB(*(vocab_db->binary_db), num_similar, descriptors, indices);
   } else {
     // no database specified
     return;
@@ -407,6 +677,43 @@ void QueryDB(std::string const& descriptor,
   return;
 }
 
+void QueryDB(std::string const& descriptor,
+             VocabDB * vocab_db,
+             int num_similar,
+             std::vector<cv::Mat> const& descriptors,
+             std::vector<std::vector<int> > * indices,
+             int num_threads) {
+  indices->clear();
+  indices->resize(descriptors.size());
+
+  if (vocab_db->binary_db == NULL)
+    return;  // no database specified, all results stay empty
+
+  assert(IsBinaryDescriptor(descriptor));
+  BinaryDB const& db = *(vocab_db->binary_db);  // shorten
+
+  // All threads descend the same tree, which stays hot in the shared
+  // cache, and each writes only to its own output slot.
+  common::WorkStealingFor(descriptors.size(), num_threads,
+    [&db, num_similar, &descriptors, indices](size_t i, size_t /*thread*/) {
+      QueryBinaryDB(db, num_similar, descriptors[i], &(*indices)[i]);
+    });
+}
+
+bool QuantizeDB(VocabDB const& vocab_db, int levels_up,
+                cv::Mat const& descriptors, std::vector<int> * words) {
+  words->clear();
+  if (vocab_db.binary_db == NULL)
+    return false;
+
+  BriefVocabulary const* voc = vocab_db.binary_db->getVocabulary();
+  std::vector<DBoW2::WordId> leaf_words;
+  vocab_db.binary_db->Quantize(descriptors, &leaf_words);
+  words->resize(descriptors.rows);
+  for (int r = 0; r < descriptors.rows; r++)
+    (*words)[r] = voc->getParentNode(leaf_words[r], levels_up);
+  return true;
+}
 
 void BuildDBforDBoW2(SparseMap* map,
                                      std::string const& descriptor,
@@ -105,6 +105,32 @@ void RunWithDB(std::string const& detector_name) {
   // Localize features with database.
   sparse_mapping::SparseMap map2(out_nvm);
   map2.SetNumSimilar(num_similar);
+
+  // The batched query must agree with one query per image
+  std::vector<std::vector<int> > batch_indices;
+  sparse_mapping::QueryDB(detector_name, &map2.vocab_db_, num_similar,
+                          map2.cid_to_descriptor_map_, &batch_indices, 2);
+  ASSERT_EQ(map2.GetNumFrames(), batch_indices.size());
+  for (size_t cid = 0; cid < map2.GetNumFrames(); cid++) {
+    std::vector<int> indices;
+    sparse_mapping::QueryDB(detector_name, &map2.vocab_db_, num_similar,
+                            map2.cid_to_descriptor_map_[cid], &indices);
+    EXPECT_EQ(indices, batch_indices[cid]);
+  }
+
+  // Updating the database from a map with the same images keeps every
+  // entry, so the queries do not change
+  std::string updated_nvm = "updated.nvm";
+  map2.Save(updated_nvm);
+  sparse_mapping::UpdateDB(updated_nvm, out_nvm, detector_name);
+  sparse_mapping::SparseMap updated_map(updated_nvm);
+  for (size_t cid = 0; cid < updated_map.GetNumFrames(); cid++) {
+    std::vector<int> indices;
+    sparse_mapping::QueryDB(detector_name, &updated_map.vocab_db_, num_similar,
+                            updated_map.cid_to_descriptor_map_[cid], &indices);
+    EXPECT_EQ(indices, batch_indices[cid]);
+  }
+  std::remove(updated_nvm.c_str());
   LOG(INFO) << "\n\n================================================\n";
   LOG(INFO) << "\nLocalizing using the database\n";
 
@@ -0,0 +1,99 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/tensor.h>
+#include <camera/camera_model.h>
+
+#include <Eigen/Geometry>
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+
+#include <random>
+#include <string>
+#include <vector>
+
+TEST(compact_map, utility_and_duplicates) {
+  // Cameras along x looking down z. The last one is where the one
+  // before it is, a duplicate.
+  camera::CameraModel camera(Eigen::Vector3d(0, 0, 0), Eigen::Matrix3d::Identity(),
+                             90 * M_PI / 180.0, 640, 480);
+  camera::CameraParameters const& params = camera.GetParameters();
+  double x[] = {0, 0.5, 1.0, 1.01};
+  int num_cid = 4, num_pid = 2000, num_bad = 40, num_short = 40;
+  std::vector<Eigen::Affine3d> cid_to_cam_t_global(num_cid);
+  std::vector<std::string> filenames(num_cid);
+  for (int cid = 0; cid < num_cid; cid++) {
+    cid_to_cam_t_global[cid] = Eigen::Translation3d(-x[cid], 0, 0) * Eigen::Affine3d::Identity();
+    filenames[cid] = "image" + std::to_string(cid) + ".jpg";
+  }
+  sparse_mapping::SparseMap map(cid_to_cam_t_global, filenames, "ORGBRISK", params);
+
+  // All the points are seen by all the cameras, except for a few
+  // seen by two only, and a few are badly observed by one camera
+  std::mt19937 generator(5);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  map.pid_to_xyz_.resize(num_pid);
+  map.pid_to_cid_fid_.resize(num_pid);
+  for (int cid = 0; cid < num_cid; cid++) {
+    map.cid_to_keypoint_map_[cid].resize(2, num_pid);
+    map.cid_to_descriptor_map_[cid] = cv::Mat(num_pid, 64, CV_8U, cv::Scalar(cid));
+  }
+  for (int pid = 0; pid < num_pid; pid++) {
+    map.pid_to_xyz_[pid] = Eigen::Vector3d(2 * uniform(generator), 1.5 * uniform(generator), 4);
+    for (int cid = 0; cid < num_cid; cid++) {
+      Eigen::Vector2d pix = (cid_to_cam_t_global[cid] * map.pid_to_xyz_[pid]).hnormalized() * params.GetFocalLength();
+      if (pid < num_bad && cid == 1)
+        pix.x() += 50;
+      map.cid_to_keypoint_map_[cid].col(pid) = pix + 0.1 * Eigen::Vector2d(uniform(generator), uniform(generator));
+      if (pid >= num_bad && pid < num_bad + num_short && cid > 1)
+        continue;
+      map.pid_to_cid_fid_[pid][cid] = pid;
+    }
+  }
+  map.InitializeCidFidToPid();
+
+  sparse_mapping::CompactMapOptions options;
+  options.max_landmarks_per_image = 300;
+  sparse_mapping::CompactMap(options, &map);
+
+  // The duplicate is gone, and the others keep only their best
+  // landmarks, with their features renumbered
+  ASSERT_EQ(map.GetNumFrames(), 3u);
+  EXPECT_EQ(map.cid_to_filename_[2], filenames[2]);
+  EXPECT_GT(map.GetNumLandmarks(), 0u);
+  for (int cid = 0; cid < 3; cid++) {
+    EXPECT_LE(map.cid_to_descriptor_map_[cid].rows, 300);
+    EXPECT_EQ(map.cid_to_descriptor_map_[cid].rows, map.cid_to_keypoint_map_[cid].cols());
+  }
+  for (size_t pid = 0; pid < map.GetNumLandmarks(); pid++) {
+    ASSERT_GE(map.pid_to_cid_fid_[pid].size(), 2u);
+    for (auto const& cid_fid : map.pid_to_cid_fid_[pid]) {
+      camera::CameraModel cam(map.cid_to_cam_t_global_[cid_fid.first], params);
+      EXPECT_LT((cam.ImageCoordinates(map.pid_to_xyz_[pid]) -
+                 map.cid_to_keypoint_map_[cid_fid.first].col(cid_fid.second)).norm(), 1.0);
+    }
+  }
+
+  // The landmarks kept still cover the whole first image
+  Eigen::Matrix2Xd const& keypoints = map.cid_to_keypoint_map_[0];
+  EXPECT_LT(keypoints.row(0).minCoeff(), -0.3 * params.GetFocalLength());
+  EXPECT_GT(keypoints.row(0).maxCoeff(), 0.3 * params.GetFocalLength());
+  EXPECT_LT(keypoints.row(1).minCoeff(), -0.2 * params.GetFocalLength());
+  EXPECT_GT(keypoints.row(1).maxCoeff(), 0.2 * params.GetFocalLength());
+}
@@ -0,0 +1,81 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/descriptor_quantizer.h>
+
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+namespace {
+
+// Well separated unit descriptors, like SURF
+cv::Mat MakeDescriptors(int rows, int seed) {
+  cv::Mat descriptors(rows, 64, CV_32F);
+  cv::RNG rng(seed);
+  rng.fill(descriptors, cv::RNG::UNIFORM, -1.0, 1.0);
+  for (int r = 0; r < rows; r++)
+    cv::normalize(descriptors.row(r), descriptors.row(r));
+  return descriptors;
+}
+
+void CheckQuantizer(sparse_mapping::DescriptorQuantizer::Type type, int code_size, double max_error) {
+  std::vector<cv::Mat> train(3);
+  for (size_t i = 0; i < train.size(); i++)
+    train[i] = MakeDescriptors(400, i);
+  sparse_mapping::DescriptorQuantizer quantizer;
+  quantizer.Train(train, type, 16);
+  EXPECT_EQ(quantizer.CodeSize(), code_size);
+
+  cv::Mat codes, decoded;
+  quantizer.Encode(train[0], &codes);
+  ASSERT_EQ(codes.rows, train[0].rows);
+  ASSERT_EQ(codes.cols, code_size);
+  quantizer.Decode(codes, &decoded);
+  double error = 0;
+  for (int r = 0; r < decoded.rows; r++)
+    error += cv::norm(decoded.row(r), train[0].row(r), cv::NORM_L2);
+  EXPECT_LT(error / decoded.rows, max_error);
+
+  // The asymmetric distance is the distance to the decoded descriptor
+  EXPECT_NEAR(quantizer.Distance(train[1].ptr<float>(0), codes.ptr<uint8_t>(5)),
+              cv::norm(train[1].row(0), decoded.row(5), cv::NORM_L2), 1e-4);
+
+  // Slightly perturbed copies match their originals
+  cv::Mat noise(train[0].size(), CV_32F), query;
+  cv::RNG rng(7);
+  rng.fill(noise, cv::RNG::NORMAL, 0.0, 0.01);
+  query = train[0] + noise;
+  std::vector<cv::DMatch> matches;
+  quantizer.FindMatches(query, codes, &matches);
+  int correct = 0;
+  for (cv::DMatch const& m : matches)
+    correct += (m.queryIdx == m.trainIdx);
+  EXPECT_GT(correct, 0.9 * query.rows);
+}
+
+}  // namespace
+
+TEST(descriptor_quantizer, scalar8) {
+  CheckQuantizer(sparse_mapping::DescriptorQuantizer::SCALAR8, 64, 0.02);
+}
+
+TEST(descriptor_quantizer, product) {
+  CheckQuantizer(sparse_mapping::DescriptorQuantizer::PRODUCT, 16, 0.4);
+}
@@ -0,0 +1,66 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/distributed.h>
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+TEST(distributed, task_queue) {
+  char dir_template[] = "/tmp/task_queue_XXXXXX";
+  std::string dir = mkdtemp(dir_template);
+
+  sparse_mapping::TaskQueue worker(dir);
+  sparse_mapping::TaskQueue coordinator(dir);
+  coordinator.Clear();
+  coordinator.Add("match-000000", "match a\n0 1\n");
+  coordinator.Add("match-000001", "match a\n1 2\n");
+
+  // each task is claimed once
+  std::string name, contents;
+  ASSERT_TRUE(worker.Claim(&name, &contents));
+  EXPECT_EQ(name, "match-000000");
+  EXPECT_EQ(contents, "match a\n0 1\n");
+  std::ofstream(worker.ResultFile(name, ".txt").c_str()) << "0 1";
+  worker.Complete(name);
+
+  // the coordinator runs what is left, and the task the worker dropped
+  // is put back after the timeout
+  ASSERT_TRUE(worker.Claim(&name, &contents));
+  EXPECT_EQ(name, "match-000001");
+  EXPECT_FALSE(worker.Claim(&name, &contents));
+  std::vector<std::string> run;
+  coordinator.Wait([&run](std::string const& name, std::string const& contents) {
+      run.push_back(name);
+    }, 0);
+  ASSERT_EQ(run.size(), 1u);
+  EXPECT_EQ(run[0], "match-000001");
+
+  EXPECT_FALSE(worker.Finished());
+  coordinator.Finish();
+  EXPECT_TRUE(worker.Finished());
+
+  // a worker started later waits for the next job to finish
+  sparse_mapping::TaskQueue late(dir);
+  EXPECT_FALSE(late.Finished());
+}
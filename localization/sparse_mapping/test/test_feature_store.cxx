@@ -0,0 +1,82 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/feature_store.h>
+
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+void MakeFeatures(int cid, Eigen::Matrix2Xd * keypoints, cv::Mat * descriptors) {
+  int num_features = (cid == 1) ? 0 : 50 + 10 * cid;
+  keypoints->resize(2, num_features);
+  descriptors->create(num_features, 64, CV_8U);
+  for (int i = 0; i < num_features; i++) {
+    keypoints->col(i) << i + 0.5 * cid, -i;
+    for (int c = 0; c < 64; c++)
+      descriptors->at<uint8_t>(i, c) = (i * c + cid) % 256;
+  }
+}
+
+}  // namespace
+
+TEST(feature_store, round_trip) {
+  std::string filename = "test_feature_store.bin";
+  int num_frames = 4;
+  {
+    sparse_mapping::FeatureStore store;
+    store.Create(filename, num_frames);
+    // Out of order, as threads would write
+    for (int cid = num_frames - 1; cid >= 0; cid--) {
+      Eigen::Matrix2Xd keypoints;
+      cv::Mat descriptors;
+      MakeFeatures(cid, &keypoints, &descriptors);
+      store.Write(cid, keypoints, descriptors);
+    }
+    store.Finish();
+  }
+
+  // A cache smaller than one image still works
+  sparse_mapping::FeatureStore store;
+  store.Open(filename, 100);
+  EXPECT_EQ(store.NumFrames(), num_frames);
+  EXPECT_EQ(store.DescriptorType(), CV_8U);
+  for (int pass = 0; pass < 2; pass++) {
+    for (int cid = 0; cid < num_frames; cid++) {
+      Eigen::Matrix2Xd keypoints, stored_keypoints;
+      cv::Mat descriptors;
+      MakeFeatures(cid, &keypoints, &descriptors);
+      store.Keypoints(cid, &stored_keypoints);
+      cv::Mat stored_descriptors = store.Descriptors(cid);
+
+      EXPECT_EQ(store.NumFeatures(cid), keypoints.cols());
+      EXPECT_TRUE(stored_keypoints == keypoints);
+      ASSERT_EQ(stored_descriptors.rows, descriptors.rows);
+      if (descriptors.rows > 0)
+        EXPECT_EQ(cv::countNonZero(stored_descriptors != descriptors), 0);
+    }
+  }
+  unlink(filename.c_str());
+}
@@ -0,0 +1,128 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/landmark_index.h>
+#include <sparse_mapping/sparse_map.h>
+#include <camera/camera_model.h>
+
+#include <Eigen/Geometry>
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The word of a descriptor is its first byte
+void FirstByte(cv::Mat const& descriptors, std::vector<int>* words) {
+  words->resize(descriptors.rows);
+  for (int r = 0; r < descriptors.rows; r++)
+    (*words)[r] = descriptors.at<uint8_t>(r, 0);
+}
+
+// Flips a few bits, leaving the word
+cv::Mat Noisy(cv::Mat const& descriptor, std::mt19937* generator) {
+  cv::Mat noisy = descriptor.clone();
+  std::uniform_int_distribution<int> bit(8, 8 * descriptor.cols - 1);
+  for (int i = 0; i < 10; i++) {
+    int b = bit(*generator);
+    noisy.at<uint8_t>(0, b / 8) ^= (1 << (b % 8));
+  }
+  return noisy;
+}
+
+}  // namespace
+
+TEST(landmark_index, active_search) {
+  camera::CameraModel camera(Eigen::Vector3d(0, 0, 0), Eigen::Matrix3d::Identity(),
+                             90 * M_PI / 180.0, 640, 480);
+  int num_cid = 4, num_pid = 300;
+  std::vector<Eigen::Affine3d> cid_to_cam_t_global(num_cid, Eigen::Affine3d::Identity());
+  std::vector<std::string> filenames(num_cid);
+  for (int cid = 0; cid < num_cid; cid++)
+    filenames[cid] = "image" + std::to_string(cid) + ".jpg";
+  sparse_mapping::SparseMap map(cid_to_cam_t_global, filenames, "ORGBRISK", camera.GetParameters());
+
+  // Landmarks 0 to 199 are seen by the first three images. Each of
+  // 100 to 199 has a twin in 200 to 299 which looks the same, seen in
+  // the last image only.
+  std::mt19937 generator(3);
+  std::uniform_int_distribution<int> byte(0, 255);
+  cv::Mat landmarks(num_pid, 64, CV_8U);
+  for (int pid = 0; pid < num_pid; pid++) {
+    for (int c = 0; c < landmarks.cols; c++)
+      landmarks.at<uint8_t>(pid, c) = byte(generator);
+    landmarks.at<uint8_t>(pid, 0) = pid % 8;
+    if (pid >= 200)
+      landmarks.row(pid - 100).copyTo(landmarks.row(pid));
+  }
+  map.pid_to_xyz_.assign(num_pid, Eigen::Vector3d(0, 0, 1));
+  map.pid_to_cid_fid_.resize(num_pid);
+  for (int cid = 0; cid < num_cid; cid++) {
+    int num_fid = (cid < 3 ? 200 : 100);
+    map.cid_to_keypoint_map_[cid] = Eigen::Matrix2Xd::Zero(2, num_fid);
+    map.cid_to_descriptor_map_[cid] = cv::Mat(num_fid, 64, CV_8U);
+    for (int fid = 0; fid < num_fid; fid++) {
+      int pid = (cid < 3 ? fid : 200 + fid);
+      if (pid < 100)
+        Noisy(landmarks.row(pid), &generator).copyTo(map.cid_to_descriptor_map_[cid].row(fid));
+      else
+        landmarks.row(pid).copyTo(map.cid_to_descriptor_map_[cid].row(fid));
+      map.pid_to_cid_fid_[pid][cid] = fid;
+    }
+  }
+  map.InitializeCidFidToPid();
+
+  // An image of the first 200
+  cv::Mat query(200, 64, CV_8U);
+  for (int i = 0; i < query.rows; i++)
+    Noisy(landmarks.row(i), &generator).copyTo(query.row(i));
+  std::vector<int> words;
+  FirstByte(query, &words);
+
+  sparse_mapping::LandmarkIndex::Options options;
+  options.max_descriptors = 2;
+  options.active_cameras = 0;
+  sparse_mapping::LandmarkIndex index;
+  index.Build(map, FirstByte, options);
+  // the same descriptor seen again is kept once
+  EXPECT_EQ(index.NumDescriptors(), 2u * 100 + 100 + 100);
+
+  // The twins are too alike for the ratio test
+  std::vector<sparse_mapping::LandmarkIndex::Match> matches;
+  index.FindMatches(map, query, words, &matches);
+  EXPECT_EQ(matches.size(), 100u);
+  for (auto const& m : matches) {
+    EXPECT_EQ(m.query, m.pid);
+    EXPECT_LT(m.pid, 100);
+  }
+
+  // The search from the first 100 finds the rest in their images, and
+  // never looks for the twins
+  options.active_cameras = 10;
+  index.Build(map, FirstByte, options);
+  int num_active = 0, num_cameras = 0;
+  index.FindMatches(map, query, words, &matches, &num_active, &num_cameras);
+  EXPECT_EQ(matches.size(), 200u);
+  EXPECT_EQ(num_active, 100);
+  EXPECT_EQ(num_cameras, 3);
+  for (auto const& m : matches)
+    EXPECT_EQ(m.query, m.pid);
+}
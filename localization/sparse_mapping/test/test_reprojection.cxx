@@ -17,11 +17,16 @@
  */
 
 #include <sparse_mapping/reprojection.h>
+#include <sparse_mapping/sparse_mapping.h>
 #include <camera/camera_model.h>
+#include <common/thread.h>
 
 #include <Eigen/Geometry>
+#include <ceres/rotation.h>
 #include <gtest/gtest.h>
 
+#include <map>
+#include <random>
 #include <vector>
 
 TEST(reprojection, pose_estimation) {
@@ -89,6 +94,14 @@ TEST(reprojection, pose_estimation) {
     << "Estimated position: " << estimate.GetPosition().transpose() << " Expected: "
     << true_camera_pos.transpose();
   EXPECT_NEAR(acos(observed_angle.dot(orig_angle)), 0, 0.05);
+
+  // again, sampling the good matches first
+  std::vector<double> match_distances(observations.size(), 1.0);
+  match_distances[match_distances.size() - 1] = match_distances[match_distances.size() - 2] = 2.0;
+  camera::CameraModel estimate2(guess_pos, guess_rot, camera.GetParameters());
+  sparse_mapping::RansacEstimateCamera(landmarks, observations, 50, 4, &estimate2,
+                                       NULL, NULL, &match_distances);
+  EXPECT_NEAR((true_camera_pos - estimate2.GetPosition()).norm(), 0, 0.1);
 }
 
 TEST(reprojection, affine_estimation) {
@@ -122,3 +135,150 @@ TEST(reprojection, affine_estimation) {
   EXPECT_NEAR(A.translation()[1], S[1], 1e-3);
   EXPECT_NEAR(A.translation()[2], S[2], 1e-3);
 }
+
+TEST(reprojection, analytic_jacobians) {
+  // The closed form Jacobians must match automatic differentiation,
+  // including for rotations small enough to use the series
+  std::vector<Eigen::Vector3d> rotations;
+  rotations.push_back(Eigen::Vector3d(0.3, -0.8, 1.2));
+  rotations.push_back(Eigen::Vector3d(-2.0, 0.5, 0.1));
+  rotations.push_back(Eigen::Vector3d(1e-5, -2e-5, 1e-5));
+  rotations.push_back(Eigen::Vector3d(0, 0, 0));
+
+  Eigen::Vector2d observed(0.1, -0.2);
+  ceres::CostFunction* analytic = sparse_mapping::ReprojectionCostFunction(observed, true);
+  ceres::CostFunction* autodiff = sparse_mapping::ReprojectionCostFunction(observed, false);
+  for (size_t i = 0; i < rotations.size(); i++) {
+    // Place the point well in front of the camera
+    Eigen::Matrix3d R;
+    ceres::AngleAxisToRotationMatrix(rotations[i].data(), R.data());
+    Eigen::Vector3d xyz(0.4, -0.3, 2.0);
+    Eigen::Vector3d translation = Eigen::Vector3d(0.1, 0.2, 5.0) - R * xyz;
+    double focal_length = 1.3;
+    double const* parameters[] = {translation.data(), rotations[i].data(), xyz.data(), &focal_length};
+
+    double residuals[2][2];
+    double jacobians[2][4][6];
+    double* analytic_jacobians[] = {jacobians[0][0], jacobians[0][1], jacobians[0][2], jacobians[0][3]};
+    double* autodiff_jacobians[] = {jacobians[1][0], jacobians[1][1], jacobians[1][2], jacobians[1][3]};
+    ASSERT_TRUE(analytic->Evaluate(parameters, residuals[0], analytic_jacobians));
+    ASSERT_TRUE(autodiff->Evaluate(parameters, residuals[1], autodiff_jacobians));
+
+    for (int r = 0; r < 2; r++)
+      EXPECT_NEAR(residuals[0][r], residuals[1][r], 1e-12);
+    int block_sizes[] = {3, 3, 3, 1};
+    for (int block = 0; block < 4; block++) {
+      for (int k = 0; k < 2 * block_sizes[block]; k++)
+        EXPECT_NEAR(jacobians[0][block][k], jacobians[1][block][k], 1e-8)
+          << "rotation " << i << ", block " << block << ", entry " << k;
+    }
+
+    // Without Jacobians only the residual is computed
+    ASSERT_TRUE(analytic->Evaluate(parameters, residuals[0], NULL));
+    EXPECT_NEAR(residuals[0][0], residuals[1][0], 1e-12);
+  }
+  delete analytic;
+  delete autodiff;
+}
+
+TEST(reprojection, refine_camera) {
+  // Noisy observations, a few of them far off, seen from a camera a bit
+  // away from the guess
+  camera::CameraModel camera(Eigen::Vector3d(0.3, -0.2, 0.1),
+                             Eigen::Matrix3d(Eigen::AngleAxisd(0.2, Eigen::Vector3d(1, 2, 3).normalized())),
+                             90 * M_PI / 180.0, 640, 480);
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  int num_points = 200, num_outliers = 20;
+  Eigen::Matrix3Xd landmarks(3, num_points);
+  Eigen::Matrix2Xd observations(2, num_points);
+  for (int i = 0; i < num_points; i++) {
+    landmarks.col(i) = camera.GetPosition() + camera.GetRotation().transpose() *
+      Eigen::Vector3d(3 * uniform(generator), 2 * uniform(generator), 5 + 2 * uniform(generator));
+    observations.col(i) = camera.ImageCoordinates(landmarks.col(i)) +
+      0.5 * Eigen::Vector2d(uniform(generator), uniform(generator));
+    if (i < num_outliers)
+      observations.col(i) += Eigen::Vector2d(60, -40);
+  }
+  Eigen::Affine3d truth = camera.GetTransform();
+  Eigen::Affine3d guess = Eigen::Translation3d(0.1, 0.2, -0.1) *
+    Eigen::AngleAxisd(0.05, Eigen::Vector3d::UnitY()) * truth;
+
+  Eigen::Affine3d refined = guess;
+  int iterations = 0;
+  ASSERT_TRUE(sparse_mapping::RefineCamera(landmarks, observations, camera.GetParameters().GetFocalVector(),
+                                           100, &refined, &iterations));
+  EXPECT_GT(iterations, 0);
+  EXPECT_LT((refined.translation() - truth.translation()).norm(), 0.01);
+  EXPECT_LT(Eigen::AngleAxisd(refined.linear() * truth.linear().transpose()).angle(), 0.002);
+
+  // The same optimum as with Ceres
+  std::vector<Eigen::Vector3d> landmark_vec(num_points);
+  std::vector<Eigen::Vector2d> observation_vec(num_points);
+  for (int i = 0; i < num_points; i++) {
+    landmark_vec[i] = landmarks.col(i);
+    observation_vec[i] = observations.col(i);
+  }
+  camera::CameraModel estimate(guess, camera.GetParameters());
+  ceres::Solver::Options options;
+  options.max_num_iterations = 100;
+  ceres::Solver::Summary summary;
+  sparse_mapping::EstimateCamera(&estimate, &landmark_vec, observation_vec, options, &summary);
+  EXPECT_LT((refined.translation() - estimate.GetTransform().translation()).norm(), 1e-3);
+  EXPECT_LT(Eigen::AngleAxisd(refined.linear() * estimate.GetTransform().linear().transpose()).angle(), 2e-4);
+
+  // Nothing in front of the camera
+  Eigen::Affine3d behind = Eigen::AngleAxisd(M_PI, Eigen::Vector3d::UnitX()) * truth;
+  Eigen::Affine3d unchanged = behind;
+  EXPECT_FALSE(sparse_mapping::RefineCamera(landmarks, observations, camera.GetParameters().GetFocalVector(),
+                                            100, &unchanged));
+  EXPECT_TRUE(unchanged.isApprox(behind));
+}
+
+TEST(reprojection, filter_pid_threads) {
+  // Cameras along x looking down z, and points in front of them, a few
+  // of them behind or with a bad observation
+  camera::CameraModel camera(Eigen::Vector3d(0, 0, 0), Eigen::Matrix3d::Identity(),
+                             90 * M_PI / 180.0, 640, 480);
+  camera::CameraParameters const& params = camera.GetParameters();
+  int num_cid = 4, num_pid = 5000;
+  std::vector<Eigen::Affine3d> cid_to_cam_t_global(num_cid);
+  for (int cid = 0; cid < num_cid; cid++)
+    cid_to_cam_t_global[cid] = Eigen::Translation3d(-0.5 * cid, 0, 0) * Eigen::Affine3d::Identity();
+
+  std::mt19937 generator(3);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  std::vector<Eigen::Vector3d> pid_to_xyz(num_pid);
+  std::vector<std::map<int, int> > pid_to_cid_fid(num_pid);
+  std::vector<Eigen::Matrix2Xd> cid_to_keypoint_map(num_cid, Eigen::Matrix2Xd(2, num_pid));
+  for (int pid = 0; pid < num_pid; pid++) {
+    pid_to_xyz[pid] = Eigen::Vector3d(uniform(generator), uniform(generator), 4 + uniform(generator));
+    if (pid % 97 == 0)
+      pid_to_xyz[pid].z() = -pid_to_xyz[pid].z();
+    for (int cid = 0; cid < num_cid; cid++) {
+      Eigen::Vector2d pix = (cid_to_cam_t_global[cid] * pid_to_xyz[pid]).hnormalized() * params.GetFocalLength();
+      if (pid % 13 == 0 && cid == 1)
+        pix.x() += 50;
+      cid_to_keypoint_map[cid].col(pid) = pix + 0.1 * Eigen::Vector2d(uniform(generator), uniform(generator));
+      pid_to_cid_fid[pid][cid] = pid;
+    }
+  }
+
+  // The same points are kept whatever the number of threads
+  std::vector<std::map<int, int> > cid_fid[2] = {pid_to_cid_fid, pid_to_cid_fid};
+  std::vector<Eigen::Vector3d> xyz[2] = {pid_to_xyz, pid_to_xyz};
+  int threads[2] = {1, 4};
+  for (int i = 0; i < 2; i++) {
+    FLAGS_num_threads = threads[i];
+    sparse_mapping::FilterPID(2.0, params, cid_to_cam_t_global, cid_to_keypoint_map,
+                              &cid_fid[i], &xyz[i], false);
+  }
+  ASSERT_EQ(xyz[0].size(), xyz[1].size());
+  EXPECT_LT(xyz[0].size(), static_cast<size_t>(num_pid - num_pid / 97));
+  EXPECT_GT(xyz[0].size(), static_cast<size_t>(num_pid / 2));
+  for (size_t pid = 0; pid < xyz[0].size(); pid++) {
+    EXPECT_EQ(xyz[0][pid], xyz[1][pid]);
+    EXPECT_EQ(cid_fid[0][pid], cid_fid[1][pid]);
+    EXPECT_GT(xyz[0][pid].z(), 0);
+  }
+}
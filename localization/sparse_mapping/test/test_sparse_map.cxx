@@ -23,10 +23,13 @@
 
 #include <gtest/gtest.h>
 
+#include <cstdio>
+
 #include <memory>
 #include <string>
 #include <vector>
 #include <map>
+#include <utility>
 
 #define EXPECT_VECTOR3D_NEAR(p1, p2, t) EXPECT_NEAR(p1[0], p2[0], t); EXPECT_NEAR(p1[1], p2[1], t); \
   EXPECT_NEAR(p1[2], p2[2], t);
@@ -222,6 +225,38 @@ TEST_P(SparseMapTest, MapBuilding) {
       EXPECT_EQ(cidpid2[it->first], it->second);
     }
   }
+
+  // The flat format must round trip everything the protobuf one does
+  map_loopback.SaveFlat("temp3.map");
+  sparse_mapping::SparseMap map_flat("temp3.map");
+  CompareFeatures(map_loopback, map_flat);
+  ASSERT_EQ(map_loopback.GetNumLandmarks(), map_flat.GetNumLandmarks());
+  for (size_t frame = 0; frame < map_loopback.GetNumFrames(); frame++) {
+    EXPECT_TRUE(map_loopback.GetFrameGlobalTransform(frame).matrix().isApprox(
+          map_flat.GetFrameGlobalTransform(frame).matrix()));
+    EXPECT_EQ(map_loopback.GetFrameFidToPidMap(frame), map_flat.GetFrameFidToPidMap(frame));
+  }
+  for (size_t pid = 0; pid < map_loopback.GetNumLandmarks(); pid++) {
+    EXPECT_VECTOR3D_NEAR(map_loopback.GetLandmarkPosition(pid),
+        map_flat.GetLandmarkPosition(pid), 1e-12);
+    EXPECT_EQ(map_loopback.GetLandmarkCidToFidMap(pid), map_flat.GetLandmarkCidToFidMap(pid));
+  }
+  EXPECT_NEAR(map_flat.GetCameraParameters().GetFocalLength(), 258.5, 1e-5);
+
+  // And localize from the mapped descriptors
+  sparse_mapping::SparseMap map_flat_localization("temp3.map", true);
+  EXPECT_TRUE(map_flat_localization.Localize(map_loopback.GetFrameFilename(1), &guess));
+
+  // Starting from a nearby pose must find the same one without the vocab db
+  cv::Mat descriptors;
+  Eigen::Matrix2Xd keypoints;
+  map_flat_localization.DetectFeaturesFromFile(map_loopback.GetFrameFilename(1), &descriptors, &keypoints);
+  Eigen::Affine3d prior_transform = map_loopback.GetFrameGlobalTransform(1);
+  prior_transform.translation() += 0.1 * default_distance * Eigen::Vector3d(1, -1, 1).normalized();
+  camera::CameraModel prior(prior_transform, map_loopback.GetCameraParameters());
+  EXPECT_TRUE(map_flat_localization.LocalizeFromPrior(descriptors, keypoints, &prior));
+  EXPECT_VECTOR3D_NEAR(prior.GetPosition(), map_loopback.GetFrameGlobalTransform(1).inverse().translation(), 0.01);
+  std::remove("temp3.map");
 }
 
 const Parameters test_parameters[] = {
@@ -232,3 +267,63 @@ const Parameters test_parameters[] = {
 INSTANTIATE_TEST_CASE_P(SparseMapTest, SparseMapTest,
     ::testing::ValuesIn(test_parameters));
 
+
+TEST(SparseMapTest, GeometricPairs) {
+  // Cameras one unit apart along x, all looking down z, except for
+  // camera 2 which looks backward. Camera 4 has no pose.
+  int num_cams = 5;
+  std::vector<Eigen::Affine3d> cid_to_cam_t_global(num_cams, Eigen::Affine3d::Identity());
+  std::vector<bool> has_pose(num_cams, true);
+  for (int cid = 0; cid < num_cams; cid++)
+    cid_to_cam_t_global[cid].translation() = Eigen::Vector3d(-cid, 0, 0);
+  cid_to_cam_t_global[2].linear() = Eigen::AngleAxisd(M_PI, Eigen::Vector3d::UnitY()).toRotationMatrix();
+  cid_to_cam_t_global[2].translation() = -cid_to_cam_t_global[2].linear() * Eigen::Vector3d(2, 0, 0);
+  has_pose[4] = false;
+
+  std::vector<std::pair<int, int> > pairs;
+  sparse_mapping::GeometricPairs(cid_to_cam_t_global, has_pose, 1.5, 30.0, &pairs);
+  std::vector<std::pair<int, int> > expected = {{0, 1}};
+  EXPECT_EQ(pairs, expected);
+
+  sparse_mapping::GeometricPairs(cid_to_cam_t_global, has_pose, 3.5, 30.0, &pairs);
+  expected = {{0, 1}, {0, 3}, {1, 3}};
+  EXPECT_EQ(pairs, expected);
+}
+
+TEST(SparseMapTest, CamerasInGate) {
+  // Cameras one unit apart along x, all looking down z, except for
+  // camera 2 which looks backward
+  int num_cams = 6;
+  std::vector<Eigen::Affine3d> cid_to_cam_t_global(num_cams, Eigen::Affine3d::Identity());
+  std::vector<std::string> filenames(num_cams);
+  for (int cid = 0; cid < num_cams; cid++)
+    cid_to_cam_t_global[cid].translation() = Eigen::Vector3d(-cid, 0, 0);
+  cid_to_cam_t_global[2].linear() = Eigen::AngleAxisd(M_PI, Eigen::Vector3d::UnitY()).toRotationMatrix();
+  cid_to_cam_t_global[2].translation() = -cid_to_cam_t_global[2].linear() * Eigen::Vector3d(2, 0, 0);
+  camera::CameraParameters params(Eigen::Vector2i(640, 480), Eigen::Vector2d::Constant(300),
+                                  Eigen::Vector2d(320, 240));
+  sparse_mapping::SparseMap map(cid_to_cam_t_global, filenames, "ORGBRISK", params);
+
+  sparse_mapping::CameraGate gate;
+  gate.center = Eigen::Vector3d(2.2, 0, 0);
+  gate.direction = Eigen::Vector3d::UnitZ();
+  gate.max_distance = 1.5;
+  gate.max_angle = 0.5;
+  std::vector<int> cids;
+  map.CamerasInGate(gate, &cids);
+  std::vector<int> expected = {3, 1};
+  EXPECT_EQ(cids, expected);
+
+  gate.max_angle = M_PI;
+  map.CamerasInGate(gate, &cids);
+  expected = {2, 3, 1};
+  EXPECT_EQ(cids, expected);
+
+  // moving the cameras rebuilds the grid
+  map.ApplyTransform(Eigen::Affine3d(Eigen::Translation3d(10, 0, 0)));
+  map.CamerasInGate(gate, &cids);
+  EXPECT_TRUE(cids.empty());
+  gate.center.x() += 10;
+  map.CamerasInGate(gate, &cids);
+  EXPECT_EQ(cids, expected);
+}
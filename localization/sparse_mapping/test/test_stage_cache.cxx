@@ -0,0 +1,96 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/stage_cache.h>
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+void WriteFile(std::string const& file, std::string const& contents) {
+  std::ofstream out(file.c_str(), std::ios::binary);
+  out << contents;
+}
+
+std::string ReadFile(std::string const& file) {
+  std::ifstream in(file.c_str(), std::ios::binary);
+  std::ostringstream contents;
+  contents << in.rdbuf();
+  return contents.str();
+}
+
+bool Exists(std::string const& file) {
+  return access(file.c_str(), F_OK) == 0;
+}
+
+}  // namespace
+
+TEST(stage_cache, hash) {
+  char dir_template[] = "/tmp/stage_cache_XXXXXX";
+  std::string dir = mkdtemp(dir_template);
+  std::string a = dir + "/a", b = dir + "/b", empty = dir + "/empty";
+  WriteFile(a, "features");
+  WriteFile(b, "features");
+  WriteFile(empty, "");
+
+  EXPECT_EQ(sparse_mapping::HashFile(a, 0), sparse_mapping::HashFile(b, 0));
+  EXPECT_NE(sparse_mapping::HashFile(a, 0), sparse_mapping::HashFile(a, 1));
+  EXPECT_NE(sparse_mapping::HashFile(empty, 0), sparse_mapping::HashFile(dir + "/missing", 0));
+  // strings are delimited by their length
+  EXPECT_NE(sparse_mapping::HashString("b", sparse_mapping::HashString("a", 0)),
+            sparse_mapping::HashString("", sparse_mapping::HashString("ab", 0)));
+}
+
+TEST(stage_cache, store_restore) {
+  char dir_template[] = "/tmp/stage_cache_XXXXXX";
+  std::string dir = mkdtemp(dir_template);
+  std::string map = dir + "/out.map", matches = dir + "/out.map.matches.txt";
+
+  sparse_mapping::StageCache cache(dir + "/cache");
+  ASSERT_TRUE(cache.Enabled());
+  WriteFile(map, "detected");
+  std::string key = cache.Key("match", "ratio=0.8\n", {map});
+  EXPECT_NE(key, cache.Key("match", "ratio=0.9\n", {map}));
+  EXPECT_NE(key, cache.Key("track", "ratio=0.8\n", {map}));
+  EXPECT_FALSE(cache.Restore(key, {map, matches}));
+
+  // the matches were not written, and are removed again on restore
+  WriteFile(map, "matched");
+  EXPECT_TRUE(cache.Store(key, {map, matches}));
+  WriteFile(map, "other");
+  WriteFile(matches, "stale");
+  EXPECT_TRUE(cache.Restore(key, {map, matches}));
+  EXPECT_EQ(ReadFile(map), "matched");
+  EXPECT_FALSE(Exists(matches));
+
+  // a different input gives a different key
+  WriteFile(map, "detected again");
+  EXPECT_NE(key, cache.Key("match", "ratio=0.8\n", {map}));
+
+  sparse_mapping::StageCache disabled("");
+  EXPECT_FALSE(disabled.Enabled());
+  EXPECT_FALSE(disabled.Restore(key, {map}));
+}
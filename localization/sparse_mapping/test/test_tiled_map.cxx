@@ -0,0 +1,68 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/tiled_map.h>
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+TEST(tiled_map, index) {
+  std::vector<sparse_mapping::MapTile> tiles(3);
+  const char* names[] = {"node1", "lab", "jem"};
+  for (int i = 0; i < 3; i++) {
+    tiles[i].name = names[i];
+    tiles[i].map_file = std::string("iss_") + names[i] + ".map";
+    tiles[i].min = Eigen::Vector3d(10 * i, -2, -2);
+    tiles[i].max = Eigen::Vector3d(10 * i + 10, 2, 2);
+  }
+  std::string filename = "temp_tiled_map.tiles";
+  ASSERT_TRUE(sparse_mapping::WriteTiledMapIndex(filename, tiles));
+  EXPECT_TRUE(sparse_mapping::IsTiledMapFile(filename));
+
+  std::vector<sparse_mapping::MapTile> read;
+  ASSERT_TRUE(sparse_mapping::ReadTiledMapIndex(filename, &read));
+  ASSERT_EQ(read.size(), tiles.size());
+  for (size_t i = 0; i < tiles.size(); i++) {
+    EXPECT_EQ(read[i].name, tiles[i].name);
+    EXPECT_EQ(read[i].map_file, tiles[i].map_file);
+    EXPECT_EQ(read[i].min, tiles[i].min);
+    EXPECT_EQ(read[i].max, tiles[i].max);
+  }
+
+  // no tile is loaded until it is needed
+  sparse_mapping::TiledMap map(filename, 2, 1.0);
+  EXPECT_EQ(map.NumTiles(), 3);
+  EXPECT_EQ(map.FindTile(Eigen::Vector3d(5, 0, 0)), 0);
+  EXPECT_EQ(map.FindTile(Eigen::Vector3d(15, 1, -1)), 1);
+  EXPECT_EQ(map.FindTile(Eigen::Vector3d(50, 0, 0)), 2);
+  EXPECT_EQ(map.FindTile(Eigen::Vector3d(12, 5, 0)), 1);
+  unlink(filename.c_str());
+
+  // other files are not tiled maps
+  std::ofstream os(filename.c_str());
+  os << "not a tiled map\n";
+  os.close();
+  EXPECT_FALSE(sparse_mapping::IsTiledMapFile(filename));
+  EXPECT_FALSE(sparse_mapping::ReadTiledMapIndex(filename, &read));
+  unlink(filename.c_str());
+}
@@ -0,0 +1,86 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <sparse_mapping/track_table.h>
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <vector>
+
+TEST(track_table, matches_maps) {
+  std::vector<std::map<int, int> > pid_to_cid_fid(3);
+  pid_to_cid_fid[0][0] = 4;
+  pid_to_cid_fid[0][2] = 1;
+  pid_to_cid_fid[1][1] = 0;
+  pid_to_cid_fid[1][2] = 7;
+  pid_to_cid_fid[2][0] = 2;
+  pid_to_cid_fid[2][1] = 3;
+  pid_to_cid_fid[2][3] = 5;
+
+  int num_cid = 5;
+  sparse_mapping::TrackTable tracks(num_cid, pid_to_cid_fid);
+  EXPECT_EQ(tracks.NumFrames(), 5u);
+  EXPECT_EQ(tracks.NumLandmarks(), 3u);
+  EXPECT_EQ(tracks.NumObservations(), 7u);
+
+  for (size_t pid = 0; pid < pid_to_cid_fid.size(); pid++) {
+    std::map<int, int> cid_to_fid;
+    tracks.GetCidToFidMap(pid, &cid_to_fid);
+    EXPECT_EQ(cid_to_fid, pid_to_cid_fid[pid]);
+    EXPECT_EQ(tracks.TrackSize(pid), pid_to_cid_fid[pid].size());
+  }
+
+  std::vector<std::map<int, int> > cid_fid_to_pid(num_cid);
+  for (size_t pid = 0; pid < pid_to_cid_fid.size(); pid++)
+    for (auto const& cid_fid : pid_to_cid_fid[pid])
+      cid_fid_to_pid[cid_fid.first][cid_fid.second] = pid;
+  for (int cid = 0; cid < num_cid; cid++) {
+    std::map<int, int> fid_to_pid;
+    tracks.GetFidToPidMap(cid, &fid_to_pid);
+    EXPECT_EQ(fid_to_pid, cid_fid_to_pid[cid]);
+    for (int fid = -1; fid < 10; fid++) {
+      int expected = cid_fid_to_pid[cid].count(fid) ? cid_fid_to_pid[cid][fid] : -1;
+      EXPECT_EQ(tracks.Pid(cid, fid), expected);
+    }
+  }
+  EXPECT_EQ(tracks.Pid(num_cid, 0), -1);
+
+  // The same table from CSR arrays
+  std::vector<uint64_t> offsets = {0, 2, 4, 7};
+  std::vector<uint32_t> cid_fid = {2, 1, 0, 4, 1, 0, 2, 7, 3, 5, 0, 2, 1, 3};
+  sparse_mapping::TrackTable tracks2;
+  tracks2.Build(num_cid, 3, offsets.data(), cid_fid.data());
+  for (size_t pid = 0; pid < pid_to_cid_fid.size(); pid++) {
+    std::map<int, int> cid_to_fid;
+    tracks2.GetCidToFidMap(pid, &cid_to_fid);
+    EXPECT_EQ(cid_to_fid, pid_to_cid_fid[pid]);
+    EXPECT_EQ(tracks2.TrackBegin(pid)->cid, pid_to_cid_fid[pid].begin()->first);
+  }
+
+  // Drop the features without a landmark in frame 2
+  std::vector<int> new_fid = {-1, 0, -1, -1, -1, -1, -1, 1};
+  tracks.RenumberFeatures(2, new_fid);
+  EXPECT_EQ(tracks.Pid(2, 0), 0);
+  EXPECT_EQ(tracks.Pid(2, 1), 1);
+  EXPECT_EQ(tracks.Pid(2, 7), -1);
+  std::map<int, int> cid_to_fid;
+  tracks.GetCidToFidMap(1, &cid_to_fid);
+  EXPECT_EQ(cid_to_fid[2], 1);
+}
@@ -0,0 +1,189 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <common/init.h>
+#include <common/thread.h>
+#include <camera/camera_params.h>
+#include <sparse_mapping/reprojection.h>
+#include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/sparse_mapping.h>
+#include <sparse_mapping/stage_timer.h>
+#include <sparse_mapping/tensor.h>
+
+#include <sparse_map.pb.h>
+
+#include <ceres/ceres.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>  // NOLINT
+#include <string>
+#include <vector>
+
+// Time the map building and localization steps on a fixed set of
+// images, and write the throughputs as JSON, so that runs on
+// different revisions can be compared. For example, with the images
+// shipped for the unit tests:
+//
+//   benchmark_map -camera_params_file test/data/iss_tango_undistorted.xml \
+//     test/data/m0004000.jpg test/data/m0004025.jpg test/data/m0004050.jpg
+//
+// All images are matched to each other, then localized against the
+// resulting map -localize_repeats times.
+
+DEFINE_string(camera_params_file, "",
+              "The camera parameters of the images, as an xml file.");
+DEFINE_string(detector, "ORGBRISK",
+              "The feature detector to use: ORGBRISK or SURF.");
+DEFINE_string(output_map, "benchmark.map",
+              "The map built while benchmarking. It is overwritten.");
+DEFINE_string(output_json, "benchmark.json",
+              "Write the results to this file.");
+DEFINE_int32(localize_repeats, 5,
+             "Localize each image this many times.");
+
+namespace {
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double Rate(double count, double seconds) {
+  return seconds > 0 ? count / seconds : 0.0;
+}
+
+// The given fraction of the sorted values, linearly interpolated
+double Percentile(std::vector<double> values, double fraction) {
+  if (values.empty())
+    return 0.0;
+  std::sort(values.begin(), values.end());
+  double pos = fraction * (values.size() - 1);
+  size_t below = static_cast<size_t>(pos);
+  size_t above = std::min(below + 1, values.size() - 1);
+  return values[below] + (pos - below) * (values[above] - values[below]);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  common::InitFreeFlyerApplication(&argc, &argv);
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+  if (argc < 3 || FLAGS_camera_params_file.empty()) {
+    LOG(INFO) << "Usage: " << argv[0] << " -camera_params_file <camera.xml> <images>";
+    return 0;
+  }
+  std::vector<std::string> images(argv + 1, argv + argc);
+  int num_images = images.size();
+  camera::CameraParameters camera_params(FLAGS_camera_params_file);
+
+  // Detection
+  sparse_mapping::SparseMap map(images, FLAGS_detector, camera_params);
+  auto start = std::chrono::steady_clock::now();
+  map.DetectFeatures();
+  double detect_seconds = Seconds(start);
+
+  // Matching. Without a vocabulary database every pair is matched.
+  int num_pairs = num_images * (num_images - 1) / 2;
+  start = std::chrono::steady_clock::now();
+  sparse_mapping::MatchFeatures(sparse_mapping::EssentialFile(FLAGS_output_map),
+                                sparse_mapping::MatchesFile(FLAGS_output_map), &map);
+  double match_seconds = Seconds(start);
+
+  sparse_mapping::BuildTracks(sparse_mapping::MatchesFile(FLAGS_output_map), &map);
+  start = std::chrono::steady_clock::now();
+  sparse_mapping::IncrementalBA(sparse_mapping::EssentialFile(FLAGS_output_map), &map);
+  double incremental_ba_seconds = Seconds(start);
+
+  // One global bundle adjustment, with the same settings as build_map
+  ceres::Solver::Options options;
+  sparse_mapping::SetBundleAdjustSolverOptions(&options);
+  options.max_num_iterations = 100;
+  options.minimizer_progress_to_stdout = false;
+  ceres::Solver::Summary summary;
+  sparse_mapping::BundleAdjustment(&map, new ceres::CauchyLoss(1.0), options, &summary);
+  int ba_iterations = summary.iterations.size();
+  double ba_seconds = summary.total_time_in_seconds;
+  map.Save(FLAGS_output_map);
+
+  // Localization, against the map loaded as the robot would
+  sparse_mapping::SparseMap loc_map(FLAGS_output_map, true);
+  std::mutex stage_mutex;
+  std::map<std::string, double> stage_seconds;
+  sparse_mapping::SetStageTimerCallback([&stage_mutex, &stage_seconds](const char* stage, double seconds) {
+      std::lock_guard<std::mutex> lock(stage_mutex);
+      stage_seconds[stage] += seconds;
+    });
+  std::vector<double> latencies;
+  int num_success = 0;
+  for (int repeat = 0; repeat < FLAGS_localize_repeats; repeat++) {
+    for (std::string const& image : images) {
+      camera::CameraModel camera(Eigen::Vector3d(), Eigen::Matrix3d::Identity(), camera_params);
+      start = std::chrono::steady_clock::now();
+      num_success += loc_map.Localize(image, &camera);
+      latencies.push_back(Seconds(start));
+    }
+  }
+  sparse_mapping::SetStageTimerCallback(sparse_mapping::StageTimerCallback());
+  double localize_seconds = 0;
+  for (double t : latencies)
+    localize_seconds += t;
+  int num_localizations = latencies.size();
+
+  FILE* f = fopen(FLAGS_output_json.c_str(), "w");
+  if (f == NULL)
+    LOG(FATAL) << "Cannot write: " << FLAGS_output_json;
+  fprintf(f, "{\n");
+  fprintf(f, "  \"detector\": \"%s\",\n", FLAGS_detector.c_str());
+  fprintf(f, "  \"num_threads\": %d,\n", FLAGS_num_threads);
+  fprintf(f, "  \"num_images\": %d,\n", num_images);
+  fprintf(f, "  \"detection\": {\"seconds\": %g, \"images_per_sec\": %g},\n",
+          detect_seconds, Rate(num_images, detect_seconds));
+  fprintf(f, "  \"matching\": {\"pairs\": %d, \"seconds\": %g, \"pairs_per_sec\": %g},\n",
+          num_pairs, match_seconds, Rate(num_pairs, match_seconds));
+  fprintf(f, "  \"incremental_ba\": {\"seconds\": %g},\n", incremental_ba_seconds);
+  fprintf(f, "  \"bundle_adjustment\": {\"iterations\": %d, \"seconds\": %g, \"iterations_per_sec\": %g},\n",
+          ba_iterations, ba_seconds, Rate(ba_iterations, ba_seconds));
+  fprintf(f, "  \"localization\": {\"count\": %d, \"successes\": %d, \"seconds\": %g, "
+          "\"localizations_per_sec\": %g, \"p50_ms\": %g, \"p95_ms\": %g,\n",
+          num_localizations, num_success, localize_seconds, Rate(num_localizations, localize_seconds),
+          1000 * Percentile(latencies, 0.50), 1000 * Percentile(latencies, 0.95));
+  fprintf(f, "    \"stage_mean_ms\": {");
+  for (auto it = stage_seconds.begin(); it != stage_seconds.end(); it++)
+    fprintf(f, "%s\"%s\": %g", it == stage_seconds.begin() ? "" : ", ", it->first.c_str(),
+            1000 * Rate(it->second, num_localizations));
+  fprintf(f, "}}\n");
+  fprintf(f, "}\n");
+  fclose(f);
+
+  LOG(INFO) << "Detection: " << Rate(num_images, detect_seconds) << " images/sec, matching: "
+            << Rate(num_pairs, match_seconds) << " pairs/sec, bundle adjustment: "
+            << Rate(ba_iterations, ba_seconds) << " iterations/sec, localization: "
+            << Rate(num_localizations, localize_seconds) << "/sec, p95 "
+            << 1000 * Percentile(latencies, 0.95) << " ms.";
+  LOG(INFO) << "Wrote: " << FLAGS_output_json;
+
+  google::protobuf::ShutdownProtobufLibrary();
+
+  return 0;
+}
@@ -19,10 +19,12 @@
 #include <common/thread.h>
 #include <config_reader/config_reader.h>
 #include <camera/camera_params.h>
+#include <sparse_mapping/distributed.h>
 #include <sparse_mapping/sparse_map.h>
 #include <sparse_mapping/reprojection.h>
 #include <sparse_mapping/tensor.h>
 #include <sparse_mapping/sparse_mapping.h>
+#include <sparse_mapping/stage_cache.h>
 
 #include <opencv2/features2d/features2d.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -35,12 +37,34 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <functional>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <vector>
 
 // outputs
 DEFINE_string(output_map, "output.map",
               "Output file containing the matches and control network.");
 
+DECLARE_string(feature_store);
+
+DEFINE_string(cache_dir, "",
+              "Keep the outputs of each step in this directory, under a hash of the step's "
+              "parameters and inputs, and restore them instead of running a step again with "
+              "the same ones. A stopped build run again resumes after its last finished step.");
+
+DEFINE_string(distributed_dir, "",
+              "Share the detection and matching out as tasks in this directory, on a file system "
+              "all the machines mount at the same path, to workers started with -worker.");
+DEFINE_bool(worker, false,
+            "Run the tasks in -distributed_dir of a build on another machine, until it finishes.");
+DEFINE_int32(task_images, 50, "With -distributed_dir, the images to detect features in per task.");
+DEFINE_int32(task_pairs, 1000, "With -distributed_dir, the image pairs to match per task.");
+DEFINE_double(task_timeout, 3600,
+              "With -distributed_dir, the seconds after which a claimed task with no result is "
+              "given to another worker.");
+
 // parameters used in feature detection step only
 DEFINE_int32(sample_rate, 1,
               "Add one of every n input frames to the map.");
@@ -51,10 +75,10 @@ DEFINE_bool(save_individual_maps, false,
 // output map parameters
 DEFINE_string(detector, "SURF",
               "Feature detector to use. Options are [FAST, STAR, SIFT, SURF, ORB, "
-              "BRISK, ORGBRISK, MSER, GFTT, HARRIS, Dense].");
+              "BRISK, ORGBRISK, CUDA_ORB, MSER, GFTT, HARRIS, Dense].");
 DEFINE_string(rebuild_detector, "ORGBRISK",
               "Feature detector to use. Options are [FAST, STAR, SIFT, SURF, ORB, "
-              "BRISK, ORGBRISK, MSER, GFTT, HARRIS, Dense].");
+              "BRISK, ORGBRISK, CUDA_ORB, MSER, GFTT, HARRIS, Dense].");
 
 // control options
 DEFINE_bool(feature_detection, false,
@@ -67,6 +91,9 @@ DEFINE_bool(incremental_ba, false,
               "If true, perform incremental bundle adjustment.");
 DEFINE_bool(loop_closure, false,
               "If true, take a map where images start repeating, and close the loop.");
+DEFINE_bool(loop_closure_vocab, false,
+              "With -loop_closure, find the loops with the vocabulary database instead of "
+              "repeated images, and close all of them.");
 DEFINE_bool(tensor_initialization, false,
               "If true, perform update output_nvm with tensor initialization.");
 DEFINE_bool(bundle_adjustment, false,
@@ -99,6 +126,17 @@ DEFINE_int32(db_restarts, 1, "Number of restarts when building the tree.");
 DEFINE_int32(db_depth, 0, "Depth of the tree to build. Default: 4");
 DEFINE_int32(db_branching_factor, 0, "Branching factor of the tree to build. "
              "Default: 10");
+DEFINE_string(quantize_descriptors, "",
+              "Quantize the float descriptors of the map for a smaller map file and faster "
+              "localization. Options: SCALAR8 (8 bits per value), PQ (product quantization, "
+              "one byte per subspace), NONE (store them in full again).");
+DEFINE_int32(pq_subspaces, 16,
+             "With -quantize_descriptors PQ, the number of subspaces. Must divide the "
+             "descriptor length.");
+DEFINE_string(vocab_db_from, "",
+              "Instead of building a new vocabulary database, update the one of this map. "
+              "Images that are in it unchanged keep their entries. Use with maps made by "
+              "merging or extracting from this map.");
 
 void DetectAllFeatures(int argc, char** argv) {
   // Check for user mistakes
@@ -146,8 +184,15 @@ void DetectAllFeatures(int argc, char** argv) {
 
   // This will invoke a detection process
   sparse_mapping::SparseMap map(files, FLAGS_detector, cam_params);
-  map.SetBriskParams(1000, 20000, 10, 3);
-  map.DetectFeatures();
+  int min_features = 1000, max_features = 20000, threshold = 10, retries = 3;
+  map.SetBriskParams(min_features, max_features, threshold, retries);
+  if (!FLAGS_distributed_dir.empty()) {
+    sparse_mapping::TaskQueue queue(FLAGS_distributed_dir);
+    sparse_mapping::DistributedDetect(&queue, FLAGS_task_images, min_features, max_features, threshold, retries,
+                                      FLAGS_task_timeout, &map);
+  } else {
+    map.DetectFeatures();
+  }
 
   map.Save(FLAGS_output_map);
   if (FLAGS_save_individual_maps) map.Save(FLAGS_output_map + ".detect.map");
@@ -157,8 +202,15 @@ void MatchFeatures() {
   LOG(INFO) << "Matching features.";
 
   sparse_mapping::SparseMap map(FLAGS_output_map);
-  sparse_mapping::MatchFeatures(sparse_mapping::EssentialFile(FLAGS_output_map),
-                                sparse_mapping::MatchesFile(FLAGS_output_map), &map);
+  if (!FLAGS_distributed_dir.empty()) {
+    sparse_mapping::TaskQueue queue(FLAGS_distributed_dir);
+    sparse_mapping::DistributedMatch(&queue, FLAGS_task_pairs, FLAGS_task_timeout,
+                                     sparse_mapping::EssentialFile(FLAGS_output_map),
+                                     sparse_mapping::MatchesFile(FLAGS_output_map), &map);
+  } else {
+    sparse_mapping::MatchFeatures(sparse_mapping::EssentialFile(FLAGS_output_map),
+                                  sparse_mapping::MatchesFile(FLAGS_output_map), &map);
+  }
   map.Save(FLAGS_output_map);
   if (FLAGS_save_individual_maps) map.Save(FLAGS_output_map + ".match.map");
 }
@@ -188,7 +240,10 @@ void CloseLoop() {
 
   sparse_mapping::SparseMap map(FLAGS_output_map);
 
-  sparse_mapping::CloseLoop(&map);
+  if (FLAGS_loop_closure_vocab)
+    sparse_mapping::CloseLoopsWithVocabDB(&map);
+  else
+    sparse_mapping::CloseLoop(&map);
   map.Save(FLAGS_output_map);
   if (FLAGS_save_individual_maps) map.Save(FLAGS_output_map + ".closed.map");
 }
@@ -279,11 +334,22 @@ void VocabDB() {
     detector = m.detector_.GetDetectorName();
   }
 
+  if (!FLAGS_vocab_db_from.empty()) {
+    sparse_mapping::UpdateDB(FLAGS_output_map, FLAGS_vocab_db_from, detector);
+    return;
+  }
+
   sparse_mapping::BuildDB(FLAGS_output_map,
                           detector, depth, branching_factor,
                           FLAGS_db_restarts);
 }
 
+void QuantizeDescriptors() {
+  sparse_mapping::SparseMap map(FLAGS_output_map);
+  map.QuantizeDescriptors(FLAGS_quantize_descriptors, FLAGS_pq_subspaces);
+  map.Save(FLAGS_output_map);
+}
+
 // Do either registration or verification
 void RegistrationOrVerification(std::vector<std::string> const& data_files) {
   if (FLAGS_registration && FLAGS_verification)
@@ -310,6 +376,80 @@ void RegistrationOrVerification(std::vector<std::string> const& data_files) {
   if (FLAGS_save_individual_maps) map.Save(FLAGS_output_map + ".registered.map");
 }
 
+// The flags each step depends on, besides its input files, for the cache
+const std::vector<std::string> kDetectFlags = {
+  "sample_rate", "num_repeat_images", "surf_mode", "orgbrisk_octaves", "orgbrisk_pattern_scale",
+  "detect_single_pass", "single_pass_grid_cols", "single_pass_grid_rows"};
+const std::vector<std::string> kMatchFlags = {
+  "num_subsequent_images", "match_all_rate", "min_valid", "max_pairwise_matches", "pair_prior_map",
+  "pair_max_distance", "pair_max_angle", "hamming_distance", "goodness_ratio", "binary_matcher",
+  "hamming_ratio", "essential_sprt"};
+const std::vector<std::string> kBundleFlags = {
+  "reproj_thresh", "skip_filtering", "max_num_iterations", "num_ba_passes", "cost_function",
+  "cost_function_threshold", "ba_linear_solver", "ba_preconditioner", "ba_reuse_problem",
+  "first_ba_index", "last_ba_index"};
+const std::vector<std::string> kIncrementalFlags = {"assume_nonsequential", "local_ba_window", "global_ba_rate"};
+const std::vector<std::string> kLoopFlags = {
+  "loop_closure_vocab", "loop_num_similar", "loop_min_separation", "loop_min_inliers", "loop_weight",
+  "loop_ba_window"};
+const std::vector<std::string> kRebuildFlags = {"rebuild_detector", "rebuild_refloat_cameras"};
+const std::vector<std::string> kVocabFlags = {"db_restarts", "db_depth", "db_branching_factor", "vocab_db_from"};
+const std::vector<std::string> kQuantizeFlags = {"quantize_descriptors", "pq_subspaces"};
+
+std::string FlagValues(std::vector<std::vector<std::string>> const& lists) {
+  std::ostringstream values;
+  for (std::vector<std::string> const& flags : lists) {
+    for (std::string const& flag : flags) {
+      std::string value;
+      if (!google::GetCommandLineOption(flag.c_str(), &value))
+        LOG(FATAL) << "Unknown flag " << flag << ".";
+      values << flag << "=" << value << "\n";
+    }
+  }
+  return values.str();
+}
+
+// Runs a step, unless with -cache_dir it was run before on the same inputs
+// with the same parameters, and then restores its outputs instead
+void RunStage(std::string const& name, std::string const& params, std::vector<std::string> const& inputs,
+              std::vector<std::string> const& outputs, std::string const& individual_suffix,
+              std::function<void()> const& stage) {
+  sparse_mapping::StageCache cache(FLAGS_cache_dir);
+  if (!cache.Enabled()) {
+    stage();
+    return;
+  }
+  std::string key = cache.Key(name, params, inputs);
+  if (cache.Restore(key, outputs)) {
+    LOG(INFO) << "Skipping " << name << ", its outputs are restored from " << key << ".";
+    if (FLAGS_save_individual_maps && !individual_suffix.empty())
+      sparse_mapping::SparseMap(FLAGS_output_map).Save(FLAGS_output_map + individual_suffix);
+    return;
+  }
+  stage();
+  if (!cache.Store(key, outputs))
+    LOG(WARNING) << "Could not cache the outputs of " << name << ".";
+}
+
+// The parameters of the detection, which also depends on the image names
+// and the camera
+std::string DetectParams(int argc, char** argv) {
+  std::ostringstream params;
+  params << FlagValues({{"detector"}, kDetectFlags});
+  for (int i = 1; i < argc; i++)
+    params << argv[i] << "\n";
+  config_reader::ConfigReader config;
+  config.AddFile("cameras.config");
+  if (!config.ReadFiles())
+    LOG(FATAL) << "Failed to read config files.";
+  camera::CameraParameters cam_params(&config, "nav_cam");
+  params.precision(17);
+  params << cam_params.GetDistortedSize().transpose() << " " << cam_params.GetUndistortedSize().transpose() << " "
+         << cam_params.GetFocalVector().transpose() << " " << cam_params.GetOpticalOffset().transpose() << " "
+         << cam_params.GetDistortion().transpose() << "\n";
+  return params.str();
+}
+
 void MapInfo() {
   sparse_mapping::SparseMap map(FLAGS_output_map);
 
@@ -327,12 +467,20 @@ int main(int argc, char** argv) {
   common::InitFreeFlyerApplication(&argc, &argv);
   GOOGLE_PROTOBUF_VERIFY_VERSION;
 
+  if (FLAGS_worker) {
+    if (FLAGS_distributed_dir.empty())
+      LOG(FATAL) << "A worker needs -distributed_dir.";
+    sparse_mapping::RunWorker(FLAGS_distributed_dir);
+    google::protobuf::ShutdownProtobufLibrary();
+    return 0;
+  }
+
   // If the user selected no steps ... they selected all steps
   if (!FLAGS_feature_detection && !FLAGS_feature_matching &&
       !FLAGS_track_building && !FLAGS_incremental_ba &&
       !FLAGS_loop_closure && !FLAGS_tensor_initialization &&
       !FLAGS_bundle_adjustment && !FLAGS_rebuild &&
-      !FLAGS_vocab_db &&
+      !FLAGS_vocab_db && FLAGS_quantize_descriptors.empty() &&
       !FLAGS_registration && !FLAGS_verification && !FLAGS_info) {
     FLAGS_feature_detection = true;
     FLAGS_feature_matching = true;
@@ -343,29 +491,49 @@ int main(int argc, char** argv) {
     FLAGS_vocab_db = true;
   }
 
+  // Each step reads the map the one before wrote, and the matching also
+  // leaves the essential matrices and matches for the steps after it
+  std::string const& map_file = FLAGS_output_map;
+  if (!FLAGS_cache_dir.empty() && !FLAGS_feature_store.empty()) {
+    // the descriptors in the store are not part of the map cached
+    LOG(WARNING) << "Not caching the steps, -cache_dir does not work with -feature_store.";
+    FLAGS_cache_dir = "";
+  }
+  std::string essential_file = sparse_mapping::EssentialFile(map_file);
+  std::string matches_file = sparse_mapping::MatchesFile(map_file);
   if (FLAGS_feature_detection) {
-    DetectAllFeatures(argc, argv);
+    std::vector<std::string> images(argv + 1, argv + argc);
+    RunStage("detect", (FLAGS_cache_dir.empty() ? "" : DetectParams(argc, argv)), images, {map_file},
+             ".detect.map", [argc, argv]() { DetectAllFeatures(argc, argv); });
   }
   if (FLAGS_feature_matching) {
-    MatchFeatures();
+    RunStage("match", FlagValues({kMatchFlags}), {map_file, FLAGS_pair_prior_map},
+             {map_file, essential_file, matches_file}, ".match.map", MatchFeatures);
   }
   if (FLAGS_track_building) {
-    BuildTracks();
+    RunStage("track", "", {map_file, matches_file}, {map_file}, ".track.map", BuildTracks);
   }
   if (FLAGS_incremental_ba) {
-    IncrementalBA();
+    RunStage("incremental", FlagValues({kIncrementalFlags, kBundleFlags}), {map_file, essential_file},
+             {map_file}, ".incremental.map", IncrementalBA);
   }
   if (FLAGS_loop_closure) {
-    CloseLoop();
+    RunStage("loop", FlagValues({kLoopFlags, kBundleFlags}), {map_file}, {map_file}, ".closed.map", CloseLoop);
   }
   if (FLAGS_bundle_adjustment) {
-    BundleAdjust();
+    RunStage("bundle", FlagValues({{"fix_cameras"}, kBundleFlags}), {map_file}, {map_file}, ".bundle.map",
+             BundleAdjust);
   }
   if (FLAGS_rebuild) {
-    Rebuild();
+    // the images it reads again are the ones the map was detected from
+    RunStage("rebuild", FlagValues({kRebuildFlags, kDetectFlags, kMatchFlags, kBundleFlags}),
+             {map_file, FLAGS_pair_prior_map}, {map_file, essential_file, matches_file}, ".brisk.map", Rebuild);
   }
   if (FLAGS_vocab_db) {
-    VocabDB();
+    RunStage("vocab_db", FlagValues({kVocabFlags}), {map_file, FLAGS_vocab_db_from}, {map_file}, "", VocabDB);
+  }
+  if (!FLAGS_quantize_descriptors.empty()) {
+    RunStage("quantize", FlagValues({kQuantizeFlags}), {map_file}, {map_file}, "", QuantizeDescriptors);
   }
 
   if (FLAGS_registration || FLAGS_verification) {
@@ -380,6 +548,9 @@ int main(int argc, char** argv) {
     MapInfo();
   }
 
+  if (!FLAGS_distributed_dir.empty())
+    sparse_mapping::TaskQueue(FLAGS_distributed_dir).Finish();
+
   google::protobuf::ShutdownProtobufLibrary();
 
   return 0;
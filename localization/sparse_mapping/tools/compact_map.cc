@@ -0,0 +1,158 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <common/init.h>
+#include <common/thread.h>
+#include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/tensor.h>
+#include <sparse_mapping/vocab_tree.h>
+
+#include <sparse_map.pb.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <sys/time.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Make a map smaller for localization onboard, keeping the landmarks
+// most useful for localizing, spread over each image, and dropping
+// near duplicate images. With evaluation images given, they are
+// localized against both maps, to show what the smaller map costs.
+
+// Usage:
+// compact_map -input_map <input map> -output_map <output map> [ <evaluation images> ]
+
+DEFINE_string(input_map, "",
+              "The map to compact, with its tracks.");
+DEFINE_string(output_map, "",
+              "Save the compacted map here.");
+DEFINE_int32(min_observations, 3,
+             "Drop the landmarks seen by fewer images.");
+DEFINE_double(max_reprojection_error, 2.0,
+              "Drop the landmarks with a larger mean reprojection error, in pixels. Use 0 to keep all.");
+DEFINE_int32(max_landmarks_per_image, 500,
+             "Keep the most useful this many landmarks in each image. Use 0 for no limit.");
+DEFINE_int32(coverage_grid, 4,
+             "Keep the landmarks of each image spread over a grid of this many cells per side.");
+DEFINE_double(duplicate_distance, 0.05,
+              "Drop an image within this many meters of one kept before it, looking the same "
+              "way and seeing mostly the same landmarks. Use 0 to keep all images.");
+DEFINE_double(duplicate_angle, 5.0,
+              "... with optical axes at most this many degrees apart.");
+DEFINE_double(duplicate_overlap, 0.8,
+              "... and which sees at least this fraction of its landmarks.");
+
+namespace {
+
+struct Evaluation {
+  int num_localized;
+  double seconds;
+};
+
+// Localize all the images against the map, on all threads
+Evaluation Evaluate(sparse_mapping::SparseMap * map, std::vector<std::string> const& images) {
+  std::vector<uint8_t> localized(images.size(), 0);
+  struct timeval a, b;
+  gettimeofday(&a, NULL);
+  common::WorkStealingFor(images.size(), FLAGS_num_threads,
+    [map, &images, &localized](size_t i, size_t) {
+      camera::CameraModel camera(Eigen::Vector3d(), Eigen::Matrix3d::Identity(), map->GetCameraParameters());
+      localized[i] = map->Localize(images[i], &camera);
+    });
+  gettimeofday(&b, NULL);
+  Evaluation evaluation;
+  evaluation.num_localized = std::count(localized.begin(), localized.end(), 1);
+  evaluation.seconds = b.tv_sec - a.tv_sec + (b.tv_usec - a.tv_usec) / 1000000.0;
+  return evaluation;
+}
+
+void PrintMap(std::string const& name, std::string const& map_file, sparse_mapping::SparseMap const& map) {
+  size_t num_features = 0;
+  for (size_t cid = 0; cid < map.GetNumFrames(); cid++)
+    num_features += map.GetFrameDescriptors(cid).rows;
+  std::ifstream is(map_file.c_str(), std::ios::binary | std::ios::ate);
+  printf("%s: %zu images, %zu landmarks, %zu features, %.1f MB\n", name.c_str(), map.GetNumFrames(),
+         map.GetNumLandmarks(), num_features, static_cast<double>(is.tellg()) / (1024 * 1024));
+}
+
+void PrintEvaluation(std::string const& name, Evaluation const& evaluation, size_t num_images) {
+  printf("%s: localized %d / %zu images, %.1f ms per image on %d threads\n", name.c_str(),
+         evaluation.num_localized, num_images, 1000 * evaluation.seconds / std::max(num_images, static_cast<size_t>(1)),
+         static_cast<int>(FLAGS_num_threads));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  common::InitFreeFlyerApplication(&argc, &argv);
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+  if (FLAGS_input_map == "" || FLAGS_output_map == "") {
+    LOG(INFO) << "Usage: " << argv[0]
+              << " -input_map <input map> -output_map <output map> [ <evaluation images> ]";
+    return 0;
+  }
+  std::vector<std::string> images;
+  for (int i = 1; i < argc; i++)
+    images.push_back(argv[i]);
+
+  sparse_mapping::SparseMap map(FLAGS_input_map);
+  std::string detector = map.detector_.GetDetectorName();
+  bool has_db = (map.vocab_db_.binary_db != NULL);
+  PrintMap("Input map", FLAGS_input_map, map);
+  Evaluation before = Evaluation();
+  if (!images.empty()) {
+    before = Evaluate(&map, images);
+    PrintEvaluation("Input map", before, images.size());
+  }
+
+  sparse_mapping::CompactMapOptions options;
+  options.min_observations = FLAGS_min_observations;
+  options.max_reprojection_error = FLAGS_max_reprojection_error;
+  options.max_landmarks_per_image = FLAGS_max_landmarks_per_image;
+  options.coverage_grid = FLAGS_coverage_grid;
+  options.duplicate_distance = FLAGS_duplicate_distance;
+  options.duplicate_angle = FLAGS_duplicate_angle;
+  options.duplicate_overlap = FLAGS_duplicate_overlap;
+  sparse_mapping::CompactMap(options, &map);
+  map.Save(FLAGS_output_map);
+
+  // The vocabulary stays that of the input map, with the remaining
+  // images indexed again
+  if (has_db)
+    sparse_mapping::UpdateDB(FLAGS_output_map, FLAGS_input_map, detector);
+
+  // Evaluate the map as it will be loaded onboard
+  sparse_mapping::SparseMap compacted(FLAGS_output_map, true);
+  PrintMap("Compacted map", FLAGS_output_map, compacted);
+  if (!images.empty()) {
+    Evaluation after = Evaluate(&compacted, images);
+    PrintEvaluation("Compacted map", after, images.size());
+    printf("Recall: %.1f%% of what the input map localizes\n",
+           100.0 * after.num_localized / std::max(before.num_localized, 1));
+  }
+
+  google::protobuf::ShutdownProtobufLibrary();
+
+  return 0;
+}
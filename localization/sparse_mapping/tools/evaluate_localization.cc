@@ -17,6 +17,7 @@
  */
 
 #include <common/init.h>
+#include <common/thread.h>
 #include <sparse_mapping/sparse_map.h>
 #include <sparse_mapping/reprojection.h>
 
@@ -24,7 +25,28 @@
 #include <glog/logging.h>
 
 #include <sys/time.h>
-#include <thread>
+#include <string>
+#include <vector>
+
+namespace {
+
+// An image to localize, with where it was taken
+struct Test {
+  std::string name;
+  Eigen::Vector3d pos;
+  Eigen::Matrix3d rot;
+};
+
+struct Result {
+  bool success;
+  double time, dist_error, angle_error;
+};
+
+double Seconds(struct timeval const& a, struct timeval const& b) {
+  return b.tv_sec - a.tv_sec + (b.tv_usec - a.tv_usec) / 1000000.0;
+}
+
+}  // namespace
 
 int main(int argc, char** argv) {
   common::InitFreeFlyerApplication(&argc, &argv);
@@ -39,20 +61,12 @@ int main(int argc, char** argv) {
 
   sparse_mapping::SparseMap map(map_file);
 
-  int failures = 0;
-  int trials = 0;
-
-  double pos_error_sum     = 0.0;
-  double pos_error_sum_2   = 0.0;
-  double angle_error_sum   = 0.0;
-  double angle_error_sum_2 = 0.0;
-  double total_time        = 0.0;
-  double total_time_2      = 0.0;
-
+  std::vector<Test> tests;
   FILE* f = fopen(test_file.c_str(), "r");
   while (true) {
+    Test test;
     double x, y, z;
-    Eigen::Matrix3d rot;
+    Eigen::Matrix3d & rot = test.rot;
     char name[255];
     int values = fscanf(f, "%s (%lf, %lf, %lf) [%lf %lf %lf, %lf %lf %lf, %lf %lf %lf]\n",
                   name,
@@ -62,35 +76,62 @@ int main(int argc, char** argv) {
                   &rot(2, 0), &rot(2, 1), &rot(2, 2));
     if (values < 1)
       break;
-    Eigen::Vector3d pos(x, y, z);
-
-    trials++;
-    camera::CameraModel camera(Eigen::Vector3d(), Eigen::Matrix3d::Identity(), map.GetCameraParameters());
-    struct timeval a, b;
-    gettimeofday(&a, NULL);
-    if (!map.Localize(name, &camera)) {
-      printf("%s Failure\n", name);
+    test.name = name;
+    test.pos = Eigen::Vector3d(x, y, z);
+    tests.push_back(test);
+  }
+  fclose(f);
+
+  // The images are localized against the map on all threads at once,
+  // and the results printed in order when all are done
+  std::vector<Result> results(tests.size());
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  common::WorkStealingFor(tests.size(), FLAGS_num_threads,
+    [&map, &tests, &results](size_t i, size_t) {
+      Test const& test = tests[i];
+      Result & result = results[i];
+      camera::CameraModel camera(Eigen::Vector3d(), Eigen::Matrix3d::Identity(), map.GetCameraParameters());
+      struct timeval a, b;
+      gettimeofday(&a, NULL);
+      result.success = map.Localize(test.name, &camera);
+      gettimeofday(&b, NULL);
+      if (!result.success)
+        return;
+      result.time = Seconds(a, b);
+      result.dist_error = (test.pos - camera.GetPosition()).norm();
+      Eigen::Vector3d expected_angle = test.rot * Eigen::Vector3d::UnitX();
+      Eigen::Vector3d estimated_angle = camera.GetRotation() * Eigen::Vector3d::UnitX();
+      result.angle_error = acos(estimated_angle.dot(expected_angle));
+    });
+  gettimeofday(&end, NULL);
+
+  int failures = 0;
+  int trials = tests.size();
+
+  double pos_error_sum     = 0.0;
+  double pos_error_sum_2   = 0.0;
+  double angle_error_sum   = 0.0;
+  double angle_error_sum_2 = 0.0;
+  double total_time        = 0.0;
+  double total_time_2      = 0.0;
+
+  for (size_t i = 0; i < tests.size(); i++) {
+    Result const& result = results[i];
+    if (!result.success) {
+      printf("%s Failure\n", tests[i].name.c_str());
       failures++;
       continue;
     }
-    gettimeofday(&b, NULL);
-
-    double dist_error  = (pos - camera.GetPosition()).norm();
-    pos_error_sum   += dist_error;
-    pos_error_sum_2 += dist_error * dist_error;
-
-    Eigen::Vector3d expected_angle = rot * Eigen::Vector3d::UnitX();
-    Eigen::Vector3d estimated_angle = camera.GetRotation() * Eigen::Vector3d::UnitX();
-    double angle_error = acos(estimated_angle.dot(expected_angle));
-    angle_error_sum   += angle_error;
-    angle_error_sum_2 += angle_error * angle_error;
-    double t = b.tv_sec - a.tv_sec + (b.tv_usec - a.tv_usec) / 1000000.0;
-    total_time += t;
-    total_time_2 += t * t;
-
-    printf("%s %g %g %g\n", name, t, dist_error, angle_error);
+    pos_error_sum   += result.dist_error;
+    pos_error_sum_2 += result.dist_error * result.dist_error;
+    angle_error_sum   += result.angle_error;
+    angle_error_sum_2 += result.angle_error * result.angle_error;
+    total_time += result.time;
+    total_time_2 += result.time * result.time;
+
+    printf("%s %g %g %g\n", tests[i].name.c_str(), result.time, result.dist_error, result.angle_error);
   }
-  fclose(f);
 
   int suc = trials - failures;
   printf("Success Rate: %d / %d\n", suc, trials);
@@ -100,6 +141,7 @@ int main(int argc, char** argv) {
           sqrt(angle_error_sum_2 / suc - pow(angle_error_sum / suc, 2)));
   printf("Time: %g +/- %g s\n", total_time / suc,
           sqrt(total_time_2 / suc - pow(total_time / suc, 2)));
+  printf("Wall time: %g s on %d threads\n", Seconds(start, end), static_cast<int>(FLAGS_num_threads));
 
   return 0;
 }
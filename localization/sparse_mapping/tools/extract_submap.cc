@@ -21,6 +21,8 @@
 #include <sparse_mapping/sparse_map.h>
 #include <sparse_mapping/sparse_mapping.h>
 #include <sparse_mapping/reprojection.h>
+#include <sparse_mapping/tiled_map.h>
+#include <sparse_mapping/vocab_tree.h>
 
 #include <opencv2/features2d/features2d.hpp>
 
@@ -32,7 +34,9 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <string>
 #include <thread>
+#include <vector>
 
 // Given a map, extract a sub-map with only given images.
 // Alternatively, extract only the images with camera
@@ -51,6 +55,15 @@
 // extract_submaps -input_map <input map> -output_map <output map> <images to keep>
 // or:
 // extract_submaps -input_map <input map> -output_map <output map> -xyz_box "xmin xmax ymin ymax zmin zmax"
+// or, to split the map in tiles the localization node loads as it needs them:
+// extract_submaps -input_map <input map> -output_map <tile index> -tiles <boxes file>
+//
+// The boxes file has one line per tile, such as per module:
+// name xmin xmax ymin ymax zmin zmax
+// Each tile has the images with camera centers in its box, grown by
+// -tile_margin, and is saved next to the index as <index>_<name>.map.
+// Tiles are not bundle adjusted, so they stay in the frame of the input
+// map, and keep its vocabulary database.
 
 DEFINE_string(input_map, "",
               "The input map to use.");
@@ -61,18 +74,89 @@ DEFINE_string(output_map, "",
 DEFINE_string(xyz_box, "",
               "Output file containing the extracted map.");
 
+DEFINE_string(tiles, "",
+              "Split the map in tiles, with the boxes in this file.");
+
+DEFINE_double(tile_margin, 1.0,
+              "Grow the box of each tile by this much, in meters, to overlap its neighbors.");
+
 DEFINE_bool(skip_bundle_adjustment, false,
             "If specified, in the format xmin xmax ymin ymax zmin zmax, "
             "extract the images with camera center in this box.");
 
+// The names of the images with camera centers in the box
+void ImagesInBox(sparse_mapping::SparseMap const& map, Eigen::Vector3d const& min, Eigen::Vector3d const& max,
+                 std::vector<std::string>* images) {
+  images->clear();
+  for (size_t cid = 0; cid < map.cid_to_filename_.size(); cid++) {
+    Eigen::Vector3d ctr = map.GetFrameGlobalTransform(cid).inverse().translation();
+    if ((ctr.array() >= min.array()).all() && (ctr.array() <= max.array()).all())
+      images->push_back(map.cid_to_filename_[cid]);
+  }
+}
+
+void ExtractTiles() {
+  std::ifstream is(FLAGS_tiles.c_str());
+  if (!is)
+    LOG(FATAL) << "Could not read " << FLAGS_tiles;
+  std::vector<sparse_mapping::MapTile> tiles;
+  sparse_mapping::MapTile tile;
+  while (is >> tile.name >> tile.min.x() >> tile.max.x() >> tile.min.y() >> tile.max.y()
+            >> tile.min.z() >> tile.max.z())
+    tiles.push_back(tile);
+  if (!is.eof() || tiles.empty())
+    LOG(FATAL) << "Could not parse the tile boxes in " << FLAGS_tiles;
+
+  std::string base = FLAGS_output_map;
+  size_t dot = base.rfind('.');
+  if (dot != std::string::npos && base.find('/', dot) == std::string::npos)
+    base = base.substr(0, dot);
+  size_t slash = base.rfind('/');
+  std::string base_name = (slash == std::string::npos) ? base : base.substr(slash + 1);
+
+  std::string detector;
+  bool has_db;
+  {
+    sparse_mapping::SparseMap map(FLAGS_input_map);
+    detector = map.detector_.GetDetectorName();
+    has_db = (map.vocab_db_.binary_db != NULL);
+  }
+
+  Eigen::Vector3d margin = Eigen::Vector3d::Constant(FLAGS_tile_margin);
+  for (size_t i = 0; i < tiles.size(); i++) {
+    sparse_mapping::SparseMap out(FLAGS_input_map);
+    std::vector<std::string> images_to_keep;
+    ImagesInBox(out, tiles[i].min - margin, tiles[i].max + margin, &images_to_keep);
+    if (images_to_keep.empty())
+      LOG(FATAL) << "No images in tile " << tiles[i].name;
+    LOG(INFO) << "Tile " << tiles[i].name << " has " << images_to_keep.size() << " images.";
+    sparse_mapping::ExtractSubmap(&images_to_keep, &out);
+
+    tiles[i].map_file = base_name + "_" + tiles[i].name + ".map";
+    std::string map_file = base + "_" + tiles[i].name + ".map";
+    out.Save(map_file);
+    if (has_db)
+      sparse_mapping::UpdateDB(map_file, FLAGS_input_map, detector);
+  }
+
+  if (!sparse_mapping::WriteTiledMapIndex(FLAGS_output_map, tiles))
+    LOG(FATAL) << "Could not write " << FLAGS_output_map;
+}
+
 int main(int argc, char** argv) {
   common::InitFreeFlyerApplication(&argc, &argv);
   GOOGLE_PROTOBUF_VERIFY_VERSION;
 
-  if ((argc <= 1 && FLAGS_xyz_box == "") || FLAGS_input_map == "" || FLAGS_output_map == "") {
+  if ((argc <= 1 && FLAGS_xyz_box == "" && FLAGS_tiles == "") || FLAGS_input_map == "" || FLAGS_output_map == "") {
     LOG(INFO) << "Usage: " << argv[0]
               << " -input_map <input map> -output_map <output map> [ <images to keep> ] "
-              << "[ -xyz_box str]";
+              << "[ -xyz_box str] [ -tiles boxes_file ]";
+    return 0;
+  }
+
+  if (FLAGS_tiles != "") {
+    ExtractTiles();
+    google::protobuf::ShutdownProtobufLibrary();
     return 0;
   }
 
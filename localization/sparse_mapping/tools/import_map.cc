@@ -29,6 +29,7 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <memory>
 #include <thread>
 
 // outputs
@@ -38,6 +39,12 @@ DEFINE_string(output_map, "output.map",
               "Output file containing the matches and control network.");
 DEFINE_bool(bundler_map, false,
             "If true, read the bundler or theia format.");
+DEFINE_bool(convert_map, false,
+            "If true, input_map is a sparse map, in either the protobuf or the flat format, "
+            "and it is re-saved as output_map.");
+DEFINE_bool(flat, false,
+            "If true, write output_map in the flat, memory-mappable format, which loads "
+            "much faster. Otherwise write a protobuf map.");
 
 int main(int argc, char** argv) {
   common::InitFreeFlyerApplication(&argc, &argv);
@@ -50,8 +57,16 @@ int main(int argc, char** argv) {
   }
 
   std::cout << "input and output " << FLAGS_input_map << ' ' << FLAGS_output_map << std::endl;
-  sparse_mapping::SparseMap map(FLAGS_bundler_map, FLAGS_input_map, files);
-  map.Save(FLAGS_output_map);
+  std::shared_ptr<sparse_mapping::SparseMap> map;
+  if (FLAGS_convert_map)
+    map.reset(new sparse_mapping::SparseMap(FLAGS_input_map));
+  else
+    map.reset(new sparse_mapping::SparseMap(FLAGS_bundler_map, FLAGS_input_map, files));
+
+  if (FLAGS_flat)
+    map->SaveFlat(FLAGS_output_map);
+  else
+    map->Save(FLAGS_output_map);
 
   google::protobuf::ShutdownProtobufLibrary();
 
@@ -201,47 +201,6 @@ void EvalDiff(sparse_mapping::SparseMap const& meas,
   }
 }
 
-// Avoid using this EvaluatePoint function, keeps on crashing
-// for some reason.
-void EvaluatePoint(const sparse_mapping::SparseMap & source_meas,
-    sparse_mapping::SparseMap* ref_comp, int cid, FILE* results,
-    pthread_mutex_t* results_mutex) {
-  std::string img_file = source_meas.GetFrameFilename(cid);
-
-  // localize frame
-  camera::CameraModel camera(Eigen::Vector3d(0, 0, 0), Eigen::Matrix3d::Identity(),
-                                     ref_comp->GetCameraParameters());
-  if (!ref_comp->Localize(img_file, &camera)) {
-    // Localization failed
-    pthread_mutex_lock(results_mutex);
-    std::cout << "Errors for " << img_file << ": "
-              << 1e+6 << " cm " << 1e+6 << " degrees" << std::endl;
-    pthread_mutex_unlock(results_mutex);
-    return;
-  }
-
-  camera::CameraModel measured(source_meas.GetFrameGlobalTransform(cid),
-                               ref_comp->GetCameraParameters());
-  Eigen::Vector3d expected_angle = measured.GetRotation() * Eigen::Vector3d::UnitX();
-  Eigen::Vector3d estimated_angle =  camera.GetRotation() * Eigen::Vector3d::UnitX();
-  double angle_err = acos(estimated_angle.dot(expected_angle)) * (180.0 / M_PI);
-
-  pthread_mutex_lock(results_mutex);
-  std::cout << "Measured position: " << measured.GetPosition().transpose() << std::endl;
-  std::cout << "Computed position: " << camera.GetPosition().transpose() << std::endl;
-  std::cout << "Errors for " << img_file << ": " << (camera.GetPosition() -
-      measured.GetPosition()).norm() * 100 << " cm " << angle_err << " degrees" << std::endl;
-  if (results != NULL) {
-    Eigen::Vector3d a = measured.GetPosition();
-    Eigen::Vector3d b = camera.GetPosition();
-    fprintf(results, "%s %g %g %g %g %g %g %g %g\n", img_file.c_str(),
-               (camera.GetPosition() - measured.GetPosition()).norm() * 100,
-               angle_err, a.x(), a.y(), a.z(), b.x(), b.y(), b.z());
-    fflush(results);
-  }
-  pthread_mutex_unlock(results_mutex);
-}
-
 int main(int argc, char** argv) {
   common::InitFreeFlyerApplication(&argc, &argv);
   GOOGLE_PROTOBUF_VERIFY_VERSION;
@@ -255,32 +214,30 @@ int main(int argc, char** argv) {
   if (FLAGS_quit_after_registration)
     return 0;
 
-  // FILE* results = NULL;
-  // if (FLAGS_results_file.size() > 0) {
-  //   results = fopen(FLAGS_results_file.c_str(), "w");
-  // }
-
-  Eigen::IOFormat CSVFormat(3, 0, ", ", ",   ");
+  FILE* results = NULL;
+  if (FLAGS_results_file.size() > 0)
+    results = fopen(FLAGS_results_file.c_str(), "w");
 
   sparse_mapping::SparseMap source_meas(FLAGS_source_measured);
 
-  // pthread_mutex_t write_mutex;
-  // pthread_mutex_init(&write_mutex, NULL);
-  // common::ThreadPool pool;
-  for (size_t cid = 0; cid < source_meas.GetNumFrames(); cid++) {
+  // Localize all the images on all threads at once against the one
+  // loaded map, then print the results in order
+  int num_cid = source_meas.GetNumFrames();
+  std::vector<camera::CameraModel> cameras(num_cid,
+    camera::CameraModel(Eigen::Vector3d(), Eigen::Matrix3d::Identity(), ref_comp.GetCameraParameters()));
+  std::vector<uint8_t> localized(num_cid, 0);
+  common::WorkStealingFor(num_cid, FLAGS_num_threads,
+    [&source_meas, &ref_comp, &cameras, &localized](size_t cid, size_t) {
+      localized[cid] = ref_comp.Localize(source_meas.GetFrameFilename(cid), &cameras[cid]);
+    });
+
+  for (int cid = 0; cid < num_cid; cid++) {
     std::string img_file = source_meas.GetFrameFilename(cid);
-
-    // localize frame
-    camera::CameraModel camera(Eigen::Vector3d(), Eigen::Matrix3d::Identity(),
-                               ref_comp.GetCameraParameters());
-    if (!ref_comp.Localize(img_file, &camera)) {
-      // Localization failed
-      // pthread_mutex_lock(results_mutex);
+    camera::CameraModel const& camera = cameras[cid];
+    if (!localized[cid]) {
       std::cout << "Errors for " << img_file << ": "
                 << 1e+6 << " cm " << 1e+6 << " degrees" << std::endl;
       continue;
-      // pthread_mutex_unlock(results_mutex);
-      // return;
     }
 
     camera::CameraModel measured(source_meas.GetFrameGlobalTransform(cid),
@@ -289,33 +246,22 @@ int main(int argc, char** argv) {
     Eigen::Vector3d estimated_angle =  camera.GetRotation() * Eigen::Vector3d::UnitX();
     double angle_err = acos(estimated_angle.dot(expected_angle)) * (180.0 / M_PI);
 
-    // pthread_mutex_lock(results_mutex);
     std::cout << "Measured position: " << measured.GetPosition().transpose() << std::endl;
     std::cout << "Computed position: " << camera.GetPosition().transpose() << std::endl;
     std::cout << "Errors for " << img_file << ": "
               << (camera.GetPosition() - measured.GetPosition()).norm() * 100
               << " cm " << angle_err << " degrees" << std::endl;
 
-    // The code below was causing a crash and was turned off.
-    // if (results != NULL) {
-    //   Eigen::Vector3d a = measured.GetPosition();
-    //   Eigen::Vector3d b = camera.GetPosition();
-    //   fprintf(results, "%s %g %g %g %g %g %g %g %g\n", img_file.c_str(),
-    //           (camera.GetPosition() - measured.GetPosition()).norm() * 100,
-    //           angle_err, a.x(), a.y(), a.z(), b.x(), b.y(), b.z());
-    //   fflush(results);
-    //   }
-    //   pthread_mutex_unlock(results_mutex);
-
-    // LOG_EVERY_N(INFO, 100) << "\t" << 100 * static_cast<float>(cid) /
-    //   static_cast<float>(source_meas.GetNumFrames())
-    // << "% Progress";
-
-    // pool.AddTask(&EvaluatePoint, std::ref(source_meas), std::ref(ref_comp), cid, results, &write_mutex);
+    if (results != NULL) {
+      Eigen::Vector3d a = measured.GetPosition();
+      Eigen::Vector3d b = camera.GetPosition();
+      fprintf(results, "%s %g %g %g %g %g %g %g %g\n", img_file.c_str(),
+              (camera.GetPosition() - measured.GetPosition()).norm() * 100,
+              angle_err, a.x(), a.y(), a.z(), b.x(), b.y(), b.z());
+    }
   }
-  // pool.Join();
-  // pthread_mutex_destroy(&write_mutex);
-  // fclose(results);
+  if (results != NULL)
+    fclose(results);
 
   google::protobuf::ShutdownProtobufLibrary();
 
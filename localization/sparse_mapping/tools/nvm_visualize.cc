@@ -35,7 +35,13 @@
 #include <iomanip>
 #include <iostream>
 #include <fstream>
+#include <list>
+#include <map>
 #include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 DEFINE_bool(jump_to_3d_view, false,
             "Skip displaying images and features, go directly to the 3D view.");
@@ -56,6 +62,19 @@ DEFINE_int32(last, std::numeric_limits<int>::max(),
              "The index after the last image to plot in the 3D view.");
 DEFINE_double(scale, 0.5,
               "The scale of images in the 3D view.");
+DEFINE_double(chunk_size, 0.0,
+              "If positive, split the 3D view of the map in cubes this many meters wide, "
+              "for large maps. Only the cubes near the viewer show all their points and "
+              "the camera images.");
+DEFINE_double(detail_distance, 3.0,
+              "With -chunk_size, show in full the cubes within this many meters of the viewer.");
+DEFINE_int32(far_point_stride, 20,
+             "With -chunk_size, show only every this many points of the other cubes, and "
+             "their cameras as wireframes.");
+DEFINE_double(thumbnail_scale, 0.25,
+              "With -chunk_size, show the camera images scaled down by this much.");
+DEFINE_int32(max_thumbnails, 500,
+             "With -chunk_size, keep at most this many camera thumbnails loaded.");
 
 cv::Affine3f EigenToCVAffine(const Eigen::Affine3d & e) {
   Eigen::Matrix3f r_e = e.rotation().cast<float>();
@@ -66,32 +85,150 @@ cv::Affine3f EigenToCVAffine(const Eigen::Affine3d & e) {
   return cv::Affine3f(r, t);
 }
 
-void Draw3DFrame(cv::viz::Viz3d* window, const sparse_mapping::SparseMap & map,
-                 int cid, cv::Vec3f const& center) {
-  std::ostringstream str;
-
+// Show a camera with its image, or as a wireframe if the image is empty
+void DrawCamera(cv::viz::Viz3d* window, const sparse_mapping::SparseMap & map,
+                int cid, cv::Vec3f const& center, cv::Mat const& image) {
   // Convert to an affine, perhaps change the origin
   cv::Affine3f camera_pose = EigenToCVAffine(map.GetFrameGlobalTransform(cid).inverse());
   camera_pose.translation(camera_pose.translation() - center);
 
-  // Load up the image
-  cv::Mat image = cv::imread(map.GetFrameFilename(cid), CV_LOAD_IMAGE_GRAYSCALE);
+  Eigen::Vector2i size = map.GetCameraParameters().GetDistortedSize();
   double f = map.GetCameraParameters().GetFocalLength();
+  cv::Vec2f fov(2 * atan(size[0] * 0.5 / f), 2 * atan(size[1] * 0.5 / f));
+  if (image.empty())
+    window->showWidget(std::string("frame") + std::to_string(cid),
+                       cv::viz::WCameraPosition(fov, FLAGS_scale), camera_pose);
+  else
+    window->showWidget(std::string("frame") + std::to_string(cid),
+                       cv::viz::WCameraPosition(fov, image, FLAGS_scale), camera_pose);
+}
 
-  if (!FLAGS_only_3d_points) {
-    if (FLAGS_skip_3d_images) {
-      window->showWidget(std::string("frame") + std::to_string(cid),
-                         cv::viz::WCameraPosition(cv::Vec2f(2*atan(image.cols * 0.5 / f),
-                             2*atan(image.rows * 0.5 / f)),
-                             FLAGS_scale), camera_pose);
-    } else {
-      window->showWidget(std::string("frame") + std::to_string(cid),
-                         cv::viz::WCameraPosition(cv::Vec2f(2*atan(image.cols * 0.5 / f),
-                             2*atan(image.rows * 0.5 / f)),
-                             image, FLAGS_scale), camera_pose);
+void Draw3DFrame(cv::viz::Viz3d* window, const sparse_mapping::SparseMap & map,
+                 int cid, cv::Vec3f const& center) {
+  if (FLAGS_only_3d_points)
+    return;
+  cv::Mat image;
+  if (!FLAGS_skip_3d_images)
+    image = cv::imread(map.GetFrameFilename(cid), CV_LOAD_IMAGE_GRAYSCALE);
+  DrawCamera(window, map, cid, center, image);
+}
+
+// The 3D view of a large map, in cubes. The cubes near the viewer show
+// all their points and their cameras with thumbnails of the images,
+// read when first needed. The others show only some of their points
+// and camera wireframes. The cubes are redrawn as the viewer moves.
+class ChunkedView {
+ public:
+  ChunkedView(cv::viz::Viz3d* window, sparse_mapping::SparseMap const* map) :
+    window_(window), map_(map), have_viewer_(false) {}
+
+  // Bucket the cameras between first and last, and all the points,
+  // shown relative to center
+  void Build(int first, int last, cv::Vec3f const& center) {
+    chunks_.clear();
+    center_ = center;
+    have_viewer_ = false;
+    int num_frames = map_->GetNumFrames();
+    for (int cid = first; cid < last && num_frames > 0; cid++) {
+      int cid2 = ((cid % num_frames) + num_frames) % num_frames;
+      Eigen::Vector3d position = map_->GetFrameGlobalTransform(cid2).inverse().translation();
+      chunks_[KeyOf(position)].cids.push_back(cid2);
     }
+    for (size_t pid = 0; pid < map_->GetNumLandmarks() && !FLAGS_skip_3d_points; pid++) {
+      Eigen::Vector3d const& position = map_->GetLandmarkPosition(pid);
+      if (position.norm() <= 1e4)
+        chunks_[KeyOf(position)].pids.push_back(pid);
+    }
+    LOG(INFO) << "Split the map in " << chunks_.size() << " cubes of " << FLAGS_chunk_size << " m.";
   }
-}
+
+  // Redraw the cubes which changed level of detail. Cheap unless the
+  // viewer moved by a good part of a cube, or if forced.
+  void Update(bool force) {
+    cv::Vec3d translation = window_->getViewerPose().translation();
+    Eigen::Vector3d viewer(translation[0] + center_[0], translation[1] + center_[1], translation[2] + center_[2]);
+    if (!force && have_viewer_ && (viewer - last_viewer_).norm() < FLAGS_chunk_size / 4)
+      return;
+    last_viewer_ = viewer;
+    have_viewer_ = true;
+    for (auto & key_chunk : chunks_) {
+      Chunk & chunk = key_chunk.second;
+      Eigen::Vector3d middle = (Eigen::Vector3d(std::get<0>(key_chunk.first), std::get<1>(key_chunk.first),
+                                                std::get<2>(key_chunk.first)) + Eigen::Vector3d::Constant(0.5)) *
+                               FLAGS_chunk_size;
+      int level = ((middle - viewer).norm() <= FLAGS_detail_distance) ? 1 : 0;
+      if (force || level != chunk.level)
+        Show(key_chunk.first, level, &chunk);
+    }
+  }
+
+ private:
+  typedef std::tuple<int, int, int> Key;
+  struct Chunk {
+    Chunk() : level(-1) {}
+    std::vector<int> cids, pids;
+    int level;  // 1 if shown in full, 0 if not, -1 if not shown yet
+  };
+
+  Key KeyOf(Eigen::Vector3d const& position) const {
+    return Key(static_cast<int>(floor(position[0] / FLAGS_chunk_size)),
+               static_cast<int>(floor(position[1] / FLAGS_chunk_size)),
+               static_cast<int>(floor(position[2] / FLAGS_chunk_size)));
+  }
+
+  void Show(Key const& key, int level, Chunk* chunk) {
+    chunk->level = level;
+    int stride = level > 0 ? 1 : std::max(1, static_cast<int>(FLAGS_far_point_stride));
+    if (!chunk->pids.empty()) {
+      cv::Mat cloud(1, (chunk->pids.size() + stride - 1) / stride, CV_32FC3);
+      cv::Point3f* data = cloud.ptr<cv::Point3f>();
+      for (size_t i = 0; i < chunk->pids.size(); i += stride) {
+        Eigen::Vector3d const& position = map_->GetLandmarkPosition(chunk->pids[i]);
+        *(data++) = cv::Point3f(position[0] - center_[0], position[1] - center_[1], position[2] - center_[2]);
+      }
+      window_->showWidget("cloud_" + Name(key), cv::viz::WCloud(cloud));
+    }
+    for (size_t i = 0; i < chunk->cids.size() && !FLAGS_only_3d_points; i++) {
+      int cid = chunk->cids[i];
+      DrawCamera(window_, *map_, cid, center_,
+                 (level > 0 && !FLAGS_skip_3d_images) ? Thumbnail(cid) : cv::Mat());
+    }
+  }
+
+  static std::string Name(Key const& key) {
+    return std::to_string(std::get<0>(key)) + "_" + std::to_string(std::get<1>(key)) + "_" +
+           std::to_string(std::get<2>(key));
+  }
+
+  // The scaled down image of a camera, read if not among the latest used
+  cv::Mat Thumbnail(int cid) {
+    auto it = thumbnails_.find(cid);
+    if (it != thumbnails_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second.second);
+      return it->second.first;
+    }
+    cv::Mat image = cv::imread(map_->GetFrameFilename(cid), CV_LOAD_IMAGE_GRAYSCALE), thumbnail;
+    if (image.empty())
+      return image;
+    cv::resize(image, thumbnail, cv::Size(), FLAGS_thumbnail_scale, FLAGS_thumbnail_scale, cv::INTER_AREA);
+    lru_.push_front(cid);
+    thumbnails_[cid] = std::make_pair(thumbnail, lru_.begin());
+    while (static_cast<int>(lru_.size()) > std::max(1, static_cast<int>(FLAGS_max_thumbnails))) {
+      thumbnails_.erase(lru_.back());
+      lru_.pop_back();
+    }
+    return thumbnail;
+  }
+
+  cv::viz::Viz3d* window_;
+  sparse_mapping::SparseMap const* map_;
+  cv::Vec3f center_;
+  std::map<Key, Chunk> chunks_;
+  bool have_viewer_;
+  Eigen::Vector3d last_viewer_;
+  std::list<int> lru_;  // most recently used first
+  std::map<int, std::pair<cv::Mat, std::list<int>::iterator> > thumbnails_;
+};
 
 typedef struct {
   cv::viz::Viz3d* window;
@@ -191,6 +328,7 @@ int remainder(int cid, int num) {
 
 sparse_mapping::SparseMap * map_ptr;
 cv::viz::Viz3d * win_ptr;
+ChunkedView * view_ptr = NULL;
 
 // Set the origin be the centroid of all camera centers, for easier rotation
 void Recenter() {
@@ -207,6 +345,12 @@ void Recenter() {
   }
   center = center/count;
 
+  if (view_ptr != NULL) {
+    view_ptr->Build(FLAGS_first, FLAGS_last, center);
+    view_ptr->Update(true);
+    win_ptr->resetCamera();
+    return;
+  }
   for (int cid = FLAGS_first; cid < FLAGS_last; cid++) {
     int cid2 = remainder(cid, num_frames);
     Draw3DFrame(win_ptr, *map_ptr, cid2, center);
@@ -347,6 +491,13 @@ int main(int argc, char** argv) {
   LOG(INFO) << "\t" << map.GetNumFrames() << " cameras and "
             << map.GetNumLandmarks() << " points";
 
+  // Only the localization of the given images needs the descriptors
+  if (FLAGS_chunk_size > 0 && argc < 3) {
+    map.ReadFeatureStore();
+    for (cv::Mat & descriptors : map.cid_to_descriptor_map_)
+      descriptors.release();
+  }
+
   camera::CameraParameters camera_param = map.GetCameraParameters();
 
   int cid = 0;
@@ -449,19 +600,29 @@ int main(int argc, char** argv) {
   if ( FLAGS_last == std::numeric_limits<int>::max())
     FLAGS_last = num_frames;
 
+  // Need these to later manipulate the gui
+  map_ptr = &map;
+  win_ptr = &window;
+
+  // A large map is shown in cubes, in full only near the viewer
+  cv::Vec3f center(0, 0, 0);
+  ChunkedView view(&window, &map);
+  if (FLAGS_chunk_size > 0) {
+    view_ptr = &view;
+    view.Build(FLAGS_first, FLAGS_last, center);
+    if (!FLAGS_fit_view_to_points_bdbox && num_frames > 0)
+      window.setViewerPose(EigenToCVAffine(map.GetFrameGlobalTransform(0)).inv());
+    view.Update(true);
+  }
+
   // Adding widgets for all the cameras
   // Draw only frames withing specified range
-  cv::Vec3f center(0, 0, 0);
-  for (int cid = FLAGS_first; cid < FLAGS_last; cid++) {
+  for (int cid = FLAGS_first; cid < FLAGS_last && view_ptr == NULL; cid++) {
     int cid2 = remainder(cid, num_frames);
     Draw3DFrame(&window, map, cid2, center);
   }
 
-  // Need these to later manipulate the gui
-  map_ptr = &map;
-  win_ptr = &window;
-
-  if (!FLAGS_skip_3d_points) {
+  if (!FLAGS_skip_3d_points && view_ptr == NULL) {
     // Add a widget to display all the points
     cv::Mat cloud(1, map.GetNumLandmarks(), CV_32FC3);
     cv::Point3f* data = cloud.ptr<cv::Point3f>();
@@ -486,6 +647,8 @@ int main(int argc, char** argv) {
 
   while (!window.wasStopped()) {
     window.spinOnce();
+    if (view_ptr != NULL)
+      view_ptr->Update(false);
   }
 
   return 0;
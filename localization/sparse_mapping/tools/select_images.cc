@@ -25,6 +25,7 @@
 
 #include <opencv2/features2d/features2d.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
 
 #include <sparse_map.pb.h>
 
@@ -39,6 +40,47 @@
 // From a given set of images, eliminate images such that the sequence
 // is still contiguous, but has fewer images.
 
+DEFINE_bool(prefilter, true,
+            "Skip the feature matching for an image that is obviously the same as the "
+            "last one kept, judging by their thumbnails.");
+DEFINE_int32(thumbnail_width, 64,
+             "The width of the thumbnails compared by the prefilter.");
+DEFINE_double(prefilter_correlation, 0.95,
+              "The prefilter finds an image redundant if the correlation of its thumbnail "
+              "with that of the last image kept is at least this.");
+DEFINE_double(prefilter_shift, 0.02,
+              "... and if the shift between the two thumbnails, as a fraction of their width, "
+              "is at most this.");
+
+namespace {
+
+// A small copy of the image, with zero mean and unit norm
+cv::Mat Thumbnail(cv::Mat const& image) {
+  int width = std::max(8, static_cast<int>(FLAGS_thumbnail_width));
+  int height = std::max(8, width * image.rows / std::max(image.cols, 1));
+  cv::Mat small, thumbnail;
+  cv::resize(image, small, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+  small.convertTo(thumbnail, CV_32F);
+  thumbnail -= cv::mean(thumbnail)[0];
+  double norm = cv::norm(thumbnail);
+  if (norm > 0)
+    thumbnail /= norm;
+  return thumbnail;
+}
+
+// Whether the camera barely moved between the two thumbnails: they
+// look alike, and their content shifted little
+bool Redundant(cv::Mat const& thumbnail1, cv::Mat const& thumbnail2) {
+  if (thumbnail1.size() != thumbnail2.size())
+    return false;
+  if (thumbnail1.dot(thumbnail2) < FLAGS_prefilter_correlation)
+    return false;
+  cv::Point2d shift = cv::phaseCorrelate(thumbnail1, thumbnail2);
+  return cv::norm(shift) <= FLAGS_prefilter_shift * thumbnail1.cols;
+}
+
+}  // namespace
+
 int main(int argc, char** argv) {
   common::InitFreeFlyerApplication(&argc, &argv);
   GOOGLE_PROTOBUF_VERIFY_VERSION;
@@ -50,6 +92,7 @@ int main(int argc, char** argv) {
 
   interest_point::FeatureDetector detector;
   cv::Mat image1, image2, image_last, descriptors1, descriptors2, descriptors_last;
+  cv::Mat thumbnail1, thumbnail2, thumbnail_last;
   std::vector<cv::KeyPoint> storage;
 
   detector.Reset("ORGBRISK", 100, 20000, 20, 3);
@@ -58,20 +101,35 @@ int main(int argc, char** argv) {
   common::PrintProgressBar(stdout, 0.0);
   image1 = cv::imread(argv[1], CV_LOAD_IMAGE_GRAYSCALE);
   detector.Detect(image1, &storage, &descriptors1);
-  int deleted_count = 0;
+  thumbnail1 = Thumbnail(image1);
+  int deleted_count = 0, prefiltered_count = 0;
   for (int i = 1; i < argc; i++) {
     for (int j = i + 1; j < argc; j++) {
       std::vector<cv::DMatch> matches;
       storage.clear();
       descriptors2 = cv::Mat();
       image2 = cv::imread(argv[j], CV_LOAD_IMAGE_GRAYSCALE);
-      detector.Detect(image2, &storage, &descriptors2);
-      interest_point::FindMatches(descriptors1, descriptors2, &matches);
+      thumbnail2 = Thumbnail(image2);
       common::PrintProgressBar(stdout, static_cast<float>(j - 1) / (argc - 2));
+      // Features are only detected and matched where the thumbnails
+      // leave a doubt. An image kept without them gets them once
+      // something is matched to it.
+      bool redundant = FLAGS_prefilter && Redundant(thumbnail1, thumbnail2);
+      if (redundant) {
+        prefiltered_count++;
+      } else {
+        if (descriptors1.empty())
+          detector.Detect(image1, &storage, &descriptors1);
+        storage.clear();
+        detector.Detect(image2, &storage, &descriptors2);
+        interest_point::FindMatches(descriptors1, descriptors2, &matches);
+      }
       // if many descriptors match, we can ignore
-      if (matches.size() >= static_cast<unsigned int>(descriptors1.rows / 4) || matches.size() >= 2000) {
+      if (redundant || matches.size() >= static_cast<unsigned int>(descriptors1.rows / 4) ||
+          matches.size() >= 2000) {
         image_last = image2;
         descriptors_last = descriptors2;
+        thumbnail_last = thumbnail2;
         // we can delete everything up to here in this special case
         if (j == argc - 1) {
           for (int k = i + 1; k < argc; k++) {
@@ -88,6 +146,7 @@ int main(int argc, char** argv) {
         if (j == i + 1) {
           image1 = image2;
           descriptors1 = descriptors2;
+          thumbnail1 = thumbnail2;
           if (matches.size() < static_cast<unsigned int>(descriptors1.rows / 10) && matches.size() < 300) {
             LOG(WARNING) << "Few matches between " << argv[i] << " and " << argv[j];
           }
@@ -95,6 +154,7 @@ int main(int argc, char** argv) {
           // skipped over files
           image1 = image_last;
           descriptors1 = descriptors_last;
+          thumbnail1 = thumbnail_last;
           // delete the skipped files
           for (int k = i + 1; k < j - 1; k++) {
             if (std::remove(argv[k])) {
@@ -110,6 +170,7 @@ int main(int argc, char** argv) {
   }
 
   printf("Deleted %d / %d files.\n", deleted_count, argc - 1);
+  printf("Skipped feature matching for %d images judged redundant by their thumbnails.\n", prefiltered_count);
 
   google::protobuf::ShutdownProtobufLibrary();
 
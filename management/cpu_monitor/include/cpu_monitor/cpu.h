@@ -24,10 +24,36 @@
 
 namespace cpu_monitor {
 
+// A file in /proc or /sys which is kept open, and read again from its start
+// with pread each time, so that sampling it doesn't open it every time.
+class ProcFile {
+ private:
+  int fd_;
+
+ public:
+  ProcFile(void);
+  ~ProcFile(void);
+
+  bool Open(const std::string &path);
+  void Close(void);
+  bool IsOpen(void) const;
+
+  // Reads as much of the file as fits in buffer, null terminated. Returns
+  // the number of bytes read, or -1 on error.
+  int Read(char *buffer, int size);
+  // Reads an integer from the start of the file, or returns -1.
+  int ReadInt(void);
+
+ private:
+  ProcFile(const ProcFile &) = delete;
+  ProcFile &operator=(const ProcFile &) = delete;
+};
+
 class Core {
  private:
   std::string sys_cpu_path_;
   int id_;
+  ProcFile online_, min_freq_, cur_freq_, max_freq_;
 
  public:
   explicit Core(const std::string sys_cpu_path, int id);
@@ -41,13 +67,14 @@ class Core {
   int GetMaxFreq(void);
 
  private:
-  int GetIntValue(const std::string &file);
+  int GetIntValue(ProcFile *file);
 };
 
 class ThermalZone {
  private:
   std::string sys_thermal_path_;
   int id_;
+  ProcFile temp_;
 
  public:
   explicit ThermalZone(const std::string sys_thermal_path, int id);
@@ -35,12 +35,15 @@
 
 #include <config_reader/config_reader.h>
 #include <cpu_monitor/cpu.h>
+#include <cpu_monitor/process_monitor.h>
+#include <ff_msgs/CpuProcessesStamped.h>
 #include <ff_msgs/CpuState.h>
 #include <ff_msgs/CpuStateStamped.h>
 #include <ff_util/ff_names.h>
 #include <ff_util/ff_nodelet.h>
 
 #include <cstdint>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -83,16 +86,29 @@ class CpuMonitor : public ff_util::FreeFlyerNodelet {
 
   Cpu freq_cpus_;
 
+  // kept open and read again each time
+  ProcFile proc_stat_;
+  std::vector<char> proc_stat_buffer_;
+
+  ProcessMonitor process_monitor_;
+  // the nodelets in each manager, asked for again every so often
+  std::map<std::string, std::vector<std::string>> nodelets_;
+  int nodelets_age_;
+
   config_reader::ConfigReader config_params_;
 
   double temperature_scale_;
 
   ff_msgs::CpuStateStamped cpu_state_msg_;
+  ff_msgs::CpuProcessesStamped cpu_processes_msg_;
+
+  bool process_stats_;
+  int process_max_, thread_max_;
 
   int pub_queue_size_, update_freq_hz_, cpu_ave_load_limit_, cpu_temp_limit_;
   unsigned int ncpus_;
 
-  ros::Publisher cpu_state_pub_;
+  ros::Publisher cpu_state_pub_, cpu_processes_pub_;
   ros::Timer reload_params_timer_, stats_timer_;
 
   std::string processor_name_;
@@ -102,6 +118,11 @@ class CpuMonitor : public ff_util::FreeFlyerNodelet {
     * regular intervals for the numbers to make sense over time. */
   int CollectLoadStats();
 
+  /** Publish the loads of the busiest ROS processes and their threads,
+    * with the nodelets in each nodelet manager. */
+  void PublishProcesses();
+  const std::vector<std::string> &GetNodelets(const std::string &manager);
+
   void PublishStatsCallback(ros::TimerEvent const &te);
 };
 
@@ -0,0 +1,88 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef CPU_MONITOR_PROCESS_MONITOR_H_
+#define CPU_MONITOR_PROCESS_MONITOR_H_
+
+#include <cpu_monitor/cpu.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cpu_monitor {
+
+// Samples the cpu time of the ROS processes on this processor, and of each
+// of their threads, from /proc/<pid>/stat and /proc/<pid>/task/<tid>/stat.
+// The stat files stay open between samples. A process is a ROS process if
+// its command line sets __name, which every node and nodelet manager has.
+class ProcessMonitor {
+ public:
+  struct Thread {
+    int tid;
+    std::string name;  // as set with pthread_setname_np, or the command
+    double load;       // percent of one core
+  };
+
+  struct Process {
+    int pid;
+    std::string name;  // the node name, resolved in its namespace
+    bool manager;      // a nodelet manager
+    double load;       // percent of one core, of all its threads
+    std::vector<Thread> threads;
+  };
+
+ private:
+  struct Sample {
+    ProcFile stat;
+    std::uint64_t ticks;
+    bool seen;
+  };
+
+  struct ProcessInfo {
+    bool ros;
+    Process process;
+    Sample sample;
+    std::map<int, std::unique_ptr<Sample>> threads;
+  };
+
+  std::string proc_path_;
+  double ticks_per_sec_;
+  double last_time_;
+  std::map<int, std::unique_ptr<ProcessInfo>> processes_;
+
+ public:
+  explicit ProcessMonitor(const std::string proc_path = "/proc");
+  ~ProcessMonitor(void);
+
+  // Samples the processes, and sets the loads since the last call. Loads
+  // are zero on the first call for each process or thread.
+  bool Collect(std::vector<Process> *processes);
+
+ private:
+  bool ReadCommand(int pid, ProcessInfo *info);
+  void ReadThreads(int pid, ProcessInfo *info, double period);
+  // the user and system ticks in a stat file, and the command if name is set
+  static bool ReadStat(ProcFile *file, std::uint64_t *ticks, std::string *name);
+};
+
+}  // namespace cpu_monitor
+
+#endif  // CPU_MONITOR_PROCESS_MONITOR_H_
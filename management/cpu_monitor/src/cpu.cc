@@ -18,7 +18,11 @@
 
 #include <cpu_monitor/cpu.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <cerrno>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
@@ -26,6 +30,57 @@
 
 namespace cpu_monitor {
 
+ProcFile::ProcFile(void) : fd_(-1) {
+}
+
+ProcFile::~ProcFile(void) {
+  Close();
+}
+
+bool ProcFile::Open(const std::string &path) {
+  Close();
+  fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  return fd_ >= 0;
+}
+
+void ProcFile::Close(void) {
+  if (fd_ >= 0)
+    close(fd_);
+  fd_ = -1;
+}
+
+bool ProcFile::IsOpen(void) const {
+  return fd_ >= 0;
+}
+
+int ProcFile::Read(char *buffer, int size) {
+  if (fd_ < 0 || size <= 0)
+    return -1;
+
+  // files in /proc are made again when read from offset zero
+  int length = 0;
+  while (length < size - 1) {
+    ssize_t n = pread(fd_, buffer + length, size - 1 - length, length);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (n == 0)
+      break;
+    length += n;
+  }
+  buffer[length] = '\0';
+  return length;
+}
+
+int ProcFile::ReadInt(void) {
+  char buffer[32];
+  if (Read(buffer, sizeof(buffer)) <= 0)
+    return -1;
+  return std::atoi(buffer);
+}
+
 Core::Core(const std::string sys_cpu_path, int id)
   : sys_cpu_path_(sys_cpu_path)
   , id_(id) {
@@ -43,59 +98,53 @@ bool Core::Init(void) {
   files.push_back(sys_cpu_path_ + "/cpufreq/scaling_max_freq");
   files.push_back(sys_cpu_path_ + "/cpufreq/scaling_min_freq");
 
-  for (int i = 0; i < static_cast<int>(files.size()); i++) {
-    std::ifstream is(files[i]);
+  // Keep them open, to be read again each time.
+  std::vector<ProcFile *> fds;
 
-    if (!is.is_open()) {
+  fds.push_back(&online_);
+  fds.push_back(&cur_freq_);
+  fds.push_back(&max_freq_);
+  fds.push_back(&min_freq_);
+
+  for (int i = 0; i < static_cast<int>(files.size()); i++) {
+    if (!fds[i]->Open(files[i])) {
       std::cerr << "Error opening file '" << files[i] << "': " <<
         std::strerror(errno) << std::endl;
 
       return false;
     }
-
-    is.close();
   }
 
   return true;
 }
 
 int Core::GetMinFreq(void) {
-  return GetIntValue(sys_cpu_path_ + "/cpufreq/scaling_min_freq");
+  return GetIntValue(&min_freq_);
 }
 
 int Core::GetCurFreq(void) {
-  return GetIntValue(sys_cpu_path_ + "/cpufreq/scaling_cur_freq");
+  return GetIntValue(&cur_freq_);
 }
 
 int Core::GetMaxFreq(void) {
-  return GetIntValue(sys_cpu_path_ + "/cpufreq/scaling_max_freq");
+  return GetIntValue(&max_freq_);
 }
 
 bool Core::IsOn(void) {
-  return GetIntValue(sys_cpu_path_ + "/online") == 1 ? true : false;
+  return GetIntValue(&online_) == 1 ? true : false;
 }
 
 int Core::GetId(void) {
   return id_;
 }
 
-int Core::GetIntValue(const std::string &file) {
-  std::string line;
-  std::ifstream is(file);
+int Core::GetIntValue(ProcFile *file) {
+  int value = file->ReadInt();
 
-  if (!is.is_open()) {
-    std::cerr << "error opening file '" << file << "': " <<
+  if (value < 0)
+    std::cerr << "error reading file in '" << sys_cpu_path_ << "': " <<
       std::strerror(errno) << std::endl;
 
-    return -1;
-  }
-
-  std::getline(is, line);
-
-  int value = std::stoi(line);
-
-  is.close();
-
   return value;
 }
 
@@ -108,18 +157,14 @@ ThermalZone::~ThermalZone(void) {
 }
 
 bool ThermalZone::Init(void) {
-  // Check if 'temp' file exists.
-  std::ifstream temp(sys_thermal_path_ + "/temp");
-
-  if (!temp.is_open()) {
+  // Check if 'temp' file exists, and keep it open.
+  if (!temp_.Open(sys_thermal_path_ + "/temp")) {
     std::cerr << "Error opening file: "
       << std::strerror(errno) << std::endl;
 
     return false;
   }
 
-  temp.close();
-
   return true;
 }
 
@@ -128,21 +173,16 @@ int ThermalZone::GetId(void) {
 }
 
 double ThermalZone::GetTemperature(double scale) {
-  std::string line;
-  std::ifstream is(sys_thermal_path_ + "/temp");
+  char buffer[32];
 
-  if (!is.is_open()) {
-    std::cerr << "Error opening file: " <<
+  if (temp_.Read(buffer, sizeof(buffer)) <= 0) {
+    std::cerr << "Error reading file: " <<
       std::strerror(errno) << std::endl;
 
     return -1.0;
   }
 
-  std::getline(is, line);
-
-  int value = std::stoi(line);
-
-  is.close();
+  int value = std::atoi(buffer);
 
   return value * scale;
 }
@@ -2,18 +2,28 @@
 
 #include <cpu_monitor/cpu_monitor.h>
 
+#include <nodelet/NodeletList.h>
+
+#include <algorithm>
+
 namespace cpu_monitor {
 
 namespace {
 constexpr char kProcStat[] = "/proc/stat";
 constexpr char SysCpuPath[] = "/sys/devices/system/cpu";
 constexpr char SysThermalPath[] = "/sys/class/thermal";
+// how many samples the nodelet lists of the managers are kept for
+constexpr int kNodeletsMaxAge = 10;
 }  // namespace
 
 CpuMonitor::CpuMonitor() :
   ff_util::FreeFlyerNodelet(),
   freq_cpus_(SysCpuPath, SysThermalPath),
+  nodelets_age_(0),
   temperature_scale_(1.0),
+  process_stats_(false),
+  process_max_(10),
+  thread_max_(5),
   pub_queue_size_(10),
   update_freq_hz_(1),
   cpu_ave_load_limit_(95) {
@@ -40,6 +50,9 @@ void CpuMonitor::Initialize(ros::NodeHandle *nh) {
   // All state messages are latching
   cpu_state_pub_ = nh->advertise<ff_msgs::CpuStateStamped>(
                     TOPIC_MANAGEMENT_CPU_MONITOR_STATE, pub_queue_size_, true);
+  cpu_processes_pub_ = nh->advertise<ff_msgs::CpuProcessesStamped>(
+                    TOPIC_MANAGEMENT_CPU_MONITOR_PROCESSES, pub_queue_size_,
+                    true);
 
   // Timer for checking cpu stats. Timer is not one shot and start it right away
   stats_timer_ = nh->createTimer(ros::Duration(update_freq_hz_),
@@ -51,6 +64,15 @@ void CpuMonitor::Initialize(ros::NodeHandle *nh) {
 
   load_cpus_.resize(ncpus_ + 1);
 
+  // The cpu lines are first, so the rest of the file needn't be read
+  if (!proc_stat_.Open(kProcStat)) {
+    ROS_FATAL("CPU Monitor: Unable to open %s: %s", kProcStat,
+              std::strerror(errno));
+    exit(EXIT_FAILURE);
+    return;
+  }
+  proc_stat_buffer_.resize(256 * (ncpus_ + 2));
+
   // Intialize cpu freq class
   if (!freq_cpus_.Init()) {
     ROS_FATAL("CPU Monitor: Cpu.init failed: %s", std::strerror(errno));
@@ -66,6 +88,7 @@ void CpuMonitor::Initialize(ros::NodeHandle *nh) {
 
   // Intialize cpu state message
   cpu_state_msg_.name = GetName();
+  cpu_processes_msg_.name = GetName();
 
   // Five load fields: nice, user, sys, virt, total
   cpu_state_msg_.load_fields.resize(5);
@@ -120,6 +143,22 @@ bool CpuMonitor::ReadParams() {
     return false;
   }
 
+  // get whether to publish the loads of the processes
+  if (!config_params_.GetBool("process_stats", &process_stats_)) {
+    ROS_FATAL("CPU Monitor process stats not specified!");
+    return false;
+  }
+
+  if (!config_params_.GetInt("process_max", &process_max_)) {
+    ROS_FATAL("CPU Monitor process max not specified!");
+    return false;
+  }
+
+  if (!config_params_.GetInt("thread_max", &thread_max_)) {
+    ROS_FATAL("CPU Monitor thread max not specified!");
+    return false;
+  }
+
   return true;
 }
 
@@ -131,19 +170,21 @@ int CpuMonitor::CollectLoadStats() {
                 guest_period, system_all_period;
 
   uint32_t cpuid = 0;
-  char buffer[256];
 
-  FILE * statf = fopen(kProcStat, "r");
-  if (statf == NULL) {
-    perror("fopen");
+  if (proc_stat_.Read(proc_stat_buffer_.data(),
+                      proc_stat_buffer_.size()) < 0) {
+    perror("pread");
     return -1;
   }
 
+  char *buffer = proc_stat_buffer_.data();
   for (unsigned int i = 0; i < load_cpus_.size(); i++) {
-    if (fgets(buffer, sizeof(buffer), statf) == NULL) {
-      fprintf(stderr, "fgets screwed up\n");
+    char *end = strchr(buffer, '\n');
+    if (end == NULL) {
+      fprintf(stderr, "%s ended early\n", kProcStat);
       break;
     }
+    *end = '\0';
 
     if (i == 0) {
       sscanf(buffer, "cpu  %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 \
@@ -207,12 +248,76 @@ int CpuMonitor::CollectLoadStats() {
                             cpu->user_percentage +
                             cpu->system_percentage +
                             cpu->virt_percentage;
+
+    buffer = end + 1;
   }
 
-  fclose(statf);
   return 0;
 }
 
+const std::vector<std::string> &CpuMonitor::GetNodelets(
+                                              const std::string &manager) {
+  auto it = nodelets_.find(manager);
+  if (it != nodelets_.end())
+    return it->second;
+
+  // Every nodelet manager lists what it has loaded
+  nodelet::NodeletList list;
+  std::vector<std::string> &nodelets = nodelets_[manager];
+  if (ros::service::call(manager + "/list", list))
+    nodelets = list.response.nodelets;
+  return nodelets;
+}
+
+void CpuMonitor::PublishProcesses() {
+  std::vector<ProcessMonitor::Process> processes;
+  if (!process_monitor_.Collect(&processes)) {
+    ROS_ERROR("CPU Monitor: Unable to read the processes.");
+    return;
+  }
+
+  // Nodelets may be loaded or unloaded at any time
+  if (++nodelets_age_ >= kNodeletsMaxAge) {
+    nodelets_.clear();
+    nodelets_age_ = 0;
+  }
+
+  std::sort(processes.begin(), processes.end(),
+            [](ProcessMonitor::Process const &a,
+               ProcessMonitor::Process const &b) {return a.load > b.load;});
+  if (static_cast<int>(processes.size()) > process_max_)
+    processes.resize(process_max_);
+
+  cpu_processes_msg_.processes.resize(processes.size());
+  for (unsigned int i = 0; i < processes.size(); i++) {
+    ProcessMonitor::Process &p = processes[i];
+    ff_msgs::CpuProcess &msg = cpu_processes_msg_.processes[i];
+    msg.name = p.name;
+    msg.pid = p.pid;
+    msg.load = p.load;
+    msg.nodelets.clear();
+    if (p.manager)
+      msg.nodelets = GetNodelets(p.name);
+
+    std::sort(p.threads.begin(), p.threads.end(),
+              [](ProcessMonitor::Thread const &a,
+                 ProcessMonitor::Thread const &b) {return a.load > b.load;});
+    if (static_cast<int>(p.threads.size()) > thread_max_)
+      p.threads.resize(thread_max_);
+    msg.thread_names.resize(p.threads.size());
+    msg.thread_ids.resize(p.threads.size());
+    msg.thread_loads.resize(p.threads.size());
+    for (unsigned int j = 0; j < p.threads.size(); j++) {
+      msg.thread_names[j] = p.threads[j].name;
+      msg.thread_ids[j] = p.threads[j].tid;
+      msg.thread_loads[j] = p.threads[j].load;
+    }
+  }
+
+  cpu_processes_msg_.header.stamp = ros::Time::now();
+  cpu_processes_pub_.publish(cpu_processes_msg_);
+}
+
 void CpuMonitor::PublishStatsCallback(ros::TimerEvent const &te) {
   // Get cpu load stats first
   if (CollectLoadStats() < 0) {
@@ -277,6 +382,9 @@ void CpuMonitor::PublishStatsCallback(ros::TimerEvent const &te) {
   // Send cpu stats
   cpu_state_msg_.header.stamp = ros::Time::now();
   cpu_state_pub_.publish(cpu_state_msg_);
+
+  if (process_stats_)
+    PublishProcesses();
 }
 
 }  // namespace cpu_monitor
@@ -0,0 +1,234 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <cpu_monitor/process_monitor.h>
+
+#include <dirent.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cpu_monitor {
+
+namespace {
+
+// calls f with each numeric entry of a directory, such as the pids in /proc
+template <typename F>
+bool ForEachId(const std::string &path, F f) {
+  DIR *dir = opendir(path.c_str());
+  if (dir == NULL)
+    return false;
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    char *end;
+    int id = strtol(entry->d_name, &end, 10);
+    if (*end == '\0' && id > 0)
+      f(id);
+  }
+
+  closedir(dir);
+  return true;
+}
+
+double Now(void) {
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+ProcessMonitor::ProcessMonitor(const std::string proc_path)
+  : proc_path_(proc_path)
+  , ticks_per_sec_(sysconf(_SC_CLK_TCK))
+  , last_time_(0) {
+}
+
+ProcessMonitor::~ProcessMonitor(void) {
+}
+
+bool ProcessMonitor::Collect(std::vector<Process> *processes) {
+  processes->clear();
+
+  double now = Now();
+  double period = (last_time_ > 0) ? now - last_time_ : 0;
+  last_time_ = now;
+
+  for (auto &p : processes_)
+    p.second->sample.seen = false;
+
+  bool found = ForEachId(proc_path_, [this, period, processes](int pid) {
+    bool first = false;
+    auto it = processes_.find(pid);
+    if (it == processes_.end()) {
+      std::unique_ptr<ProcessInfo> info(new ProcessInfo());
+      // the process may have exited already
+      if (!ReadCommand(pid, info.get()))
+        return;
+      it = processes_.insert(std::make_pair(pid, std::move(info))).first;
+      first = true;
+    }
+
+    ProcessInfo *info = it->second.get();
+    info->sample.seen = true;
+    if (!info->ros)
+      return;
+
+    // a pid reused while we weren't looking reads as a failure here, and
+    // the new process is read next time
+    std::uint64_t ticks;
+    if (!ReadStat(&info->sample.stat, &ticks, NULL)) {
+      info->sample.seen = false;
+      return;
+    }
+
+    info->process.load = 0;
+    if (!first && period > 0 && ticks >= info->sample.ticks)
+      info->process.load = 100.0 * (ticks - info->sample.ticks) /
+        (ticks_per_sec_ * period);
+    info->sample.ticks = ticks;
+
+    ReadThreads(pid, info, first ? 0 : period);
+    processes->push_back(info->process);
+  });
+
+  // forget processes which exited
+  for (auto it = processes_.begin(); it != processes_.end();) {
+    if (it->second->sample.seen)
+      it++;
+    else
+      it = processes_.erase(it);
+  }
+
+  return found;
+}
+
+bool ProcessMonitor::ReadCommand(int pid, ProcessInfo *info) {
+  std::string dir = proc_path_ + "/" + std::to_string(pid);
+
+  ProcFile cmdline;
+  if (!cmdline.Open(dir + "/cmdline"))
+    return false;
+  char buffer[4096];
+  int length = cmdline.Read(buffer, sizeof(buffer));
+  if (length < 0)
+    return false;
+
+  // the arguments are separated by nulls
+  std::string name, ns = "/";
+  bool nodelet = false, manager = false;
+  for (int i = 0; i < length; i += strlen(buffer + i) + 1) {
+    std::string arg(buffer + i);
+    if (i == 0)
+      nodelet = arg.size() >= 7 && arg.compare(arg.size() - 7, 7, "nodelet") == 0;
+    else if (arg == "manager")
+      manager = true;
+    else if (arg.compare(0, 8, "__name:=") == 0)
+      name = arg.substr(8);
+    else if (arg.compare(0, 6, "__ns:=") == 0)
+      ns = arg.substr(6);
+  }
+
+  info->ros = !name.empty();
+  info->sample.seen = false;
+  info->sample.ticks = 0;
+  if (!info->ros)
+    return true;
+
+  if (ns.empty() || ns[ns.size() - 1] != '/')
+    ns += "/";
+  if (ns[0] != '/')
+    ns = "/" + ns;
+  info->process.pid = pid;
+  info->process.name = ns + name;
+  info->process.manager = nodelet && manager;
+  info->process.load = 0;
+  return info->sample.stat.Open(dir + "/stat");
+}
+
+void ProcessMonitor::ReadThreads(int pid, ProcessInfo *info, double period) {
+  for (auto &t : info->threads)
+    t.second->seen = false;
+  info->process.threads.clear();
+
+  std::string dir = proc_path_ + "/" + std::to_string(pid) + "/task/";
+  ForEachId(dir, [this, &dir, info, period](int tid) {
+    bool first = false;
+    auto it = info->threads.find(tid);
+    if (it == info->threads.end()) {
+      std::unique_ptr<Sample> sample(new Sample());
+      if (!sample->stat.Open(dir + std::to_string(tid) + "/stat"))
+        return;
+      it = info->threads.insert(std::make_pair(tid, std::move(sample))).first;
+      first = true;
+    }
+
+    Sample *sample = it->second.get();
+    Thread thread;
+    std::uint64_t ticks;
+    if (!ReadStat(&sample->stat, &ticks, &thread.name))
+      return;
+    sample->seen = true;
+
+    thread.tid = tid;
+    thread.load = 0;
+    if (!first && period > 0 && ticks >= sample->ticks)
+      thread.load = 100.0 * (ticks - sample->ticks) / (ticks_per_sec_ * period);
+    sample->ticks = ticks;
+    info->process.threads.push_back(thread);
+  });
+
+  for (auto it = info->threads.begin(); it != info->threads.end();) {
+    if (it->second->seen)
+      it++;
+    else
+      it = info->threads.erase(it);
+  }
+}
+
+bool ProcessMonitor::ReadStat(ProcFile *file, std::uint64_t *ticks,
+                              std::string *name) {
+  char buffer[1024];
+  if (file->Read(buffer, sizeof(buffer)) <= 0)
+    return false;
+
+  // the command is in parentheses, and may itself have spaces or parentheses
+  char *open = strchr(buffer, '(');
+  char *close = strrchr(buffer, ')');
+  if (open == NULL || close == NULL || close < open)
+    return false;
+  if (name != NULL)
+    name->assign(open + 1, close - open - 1);
+
+  // skip from the state to cmajflt, then utime and stime
+  std::uint64_t utime, stime;
+  if (sscanf(close + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %"
+             SCNu64 " %" SCNu64, &utime, &stime) != 2)
+    return false;
+  *ticks = utime + stime;
+  return true;
+}
+
+}  // namespace cpu_monitor
@@ -26,13 +26,22 @@
 
 #include <config_reader/config_reader.h>
 
+#include <data_bagger/packager.h>
+#include <data_bagger/recorder.h>
+
 #include <ff_msgs/DataToDiskState.h>
 #include <ff_msgs/DataTopicsList.h>
+#include <ff_msgs/FaultState.h>
+
+#include <std_msgs/String.h>
 
 #include <ff_util/ff_names.h>
 #include <ff_util/ff_nodelet.h>
 
+#include <algorithm>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace data_bagger {
 
@@ -47,7 +56,17 @@ class DataBagger : public ff_util::FreeFlyerNodelet {
 
  private:
   void OnStartupTimer(ros::TimerEvent const& event);
+  void OnRecordingTimer(ros::TimerEvent const& event);
   void GetTopicNames();
+  bool StartRecording(ros::NodeHandle *nh);
+  bool ReadRecordingTopic(config_reader::ConfigReader::Table *entry);
+  bool ReadPackageParams();
+  bool ReadPackageRule(config_reader::ConfigReader::Table *entry);
+  void ReadCompression(std::string const& param, std::string const& fallback,
+                       rosbag::compression::CompressionType *compression);
+  void FaultStateCallback(ff_msgs::FaultStateConstPtr const& state);
+  void TriggerCallback(std_msgs::StringConstPtr const& reason);
+  void PackageCallback(std_msgs::StringConstPtr const& bag);
 
   config_reader::ConfigReader config_params_;
 
@@ -56,8 +75,31 @@ class DataBagger : public ff_util::FreeFlyerNodelet {
   int pub_queue_size_;
   unsigned int startup_time_secs_;
 
+  // packaging of bags for downlink, off unless enabled, and kept until the
+  // recorder closes its last bag
+  bool packaging_, package_recorded_;
+  Packager::Options package_options_;
+  std::vector<Packager::Rule> package_rules_;
+  std::unique_ptr<Packager> packager_;
+
+  // in-process recording, off when there are no topics
+  std::vector<std::string> recording_topics_;
+  std::vector<Recorder::Profile> recording_profiles_;
+  std::string recording_dir_;
+  unsigned int recording_chunk_size_;
+  rosbag::compression::CompressionType recording_compression_;
+  // in triggered mode only the last seconds are kept, until a trigger
+  bool recording_triggered_;
+  unsigned int trigger_buffer_bytes_;
+  float trigger_buffer_secs_, trigger_post_secs_;
+  std::vector<uint32_t> fault_ids_;
+  bool fault_state_seen_;
+  std::unique_ptr<Recorder> recorder_;
+  uint64_t recording_dropped_;
+
   ros::Publisher pub_data_state_, pub_data_topics_;
-  ros::Timer startup_timer_;
+  ros::Subscriber sub_fault_state_, sub_trigger_, sub_package_;
+  ros::Timer startup_timer_, recording_timer_;
 };
 
 }  //  namespace data_bagger
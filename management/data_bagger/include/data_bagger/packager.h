@@ -0,0 +1,119 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef DATA_BAGGER_PACKAGER_H_
+#define DATA_BAGGER_PACKAGER_H_
+
+#include <rosbag/bag.h>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace data_bagger {
+
+/**
+ * @brief Packages recorded bags for downlink, in the background.
+ * @details Each topic of a bag goes to the package its rule gives it, or to
+ * the default package, where package 1 is downlinked first and package 0
+ * strips the topic. A rule can also decimate its topic, and transcode a raw
+ * image topic to JPEG, on topic/compressed, or to H.264 or H.265 video, on
+ * topic/video, as the image sampler streams them. Each package is written
+ * to bags of at most a number of bytes, named for the bag, the package and
+ * the part, so that name order is downlink order, for example
+ * 20261014_101500_p1_0.bag.
+ *
+ * Bags are packaged one at a time by a thread of its own, at a low nice
+ * level and idle I/O priority, so it only takes the time the rest of the
+ * robot leaves.
+ */
+class Packager {
+ public:
+  enum Transcode {RAW, JPEG, VIDEO};
+
+  struct Rule {
+    Rule() : package(1), decimation(1), transcode(RAW) {}
+
+    std::string topic;
+    int package;              // 1 is downlinked first, 0 strips the topic
+    unsigned int decimation;  // keeps every one of this many messages
+    Transcode transcode;
+  };
+
+  struct Options {
+    Options() : default_package(0), max_bytes(10 * 1024 * 1024),
+                compression(rosbag::compression::BZ2), jpeg_quality(50),
+                video_codec("h264"), video_bitrate(500000), video_gop(30),
+                nice(19) {}
+
+    std::string dir;          // where the packages are written
+    int default_package;      // of the topics with no rule
+    uint64_t max_bytes;       // of each part of a package
+    rosbag::compression::CompressionType compression;
+    int jpeg_quality;
+    std::string video_codec, video_encoder;
+    int video_bitrate, video_gop;
+    int nice;                 // of the packaging thread
+  };
+
+  Packager(Options const& options, std::vector<Rule> const& rules);
+  ~Packager();
+
+  /**
+   * Queues a bag to be packaged. Can be called from any thread.
+   **/
+  void Add(std::string const& bag);
+
+  /**
+   * Packages a bag now, on the calling thread. Returns false, having written
+   * what it could, if the bag could not be read or a package written.
+   **/
+  bool Package(std::string const& bag);
+
+  // Whether video can be encoded, which needs the image sampler with libav
+  static bool HasVideo();
+
+ private:
+  struct Output;
+  class Encoder;
+
+  Rule const& Find(std::string const& topic) const;
+  void Work();
+
+  Options options_;
+  std::vector<Rule> rules_;
+  Rule default_rule_;
+
+  std::mutex mutex_;
+  std::condition_variable added_;
+  std::deque<std::string> bags_;
+  std::atomic<bool> running_;
+  std::thread worker_;
+};
+
+}  // namespace data_bagger
+
+#endif  // DATA_BAGGER_PACKAGER_H_
@@ -0,0 +1,194 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef DATA_BAGGER_RECORDER_H_
+#define DATA_BAGGER_RECORDER_H_
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <topic_tools/shape_shifter.h>
+
+#include <ff_util/spsc_queue.h>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace data_bagger {
+
+/**
+ * @brief Records topics to a bag from inside the nodelet manager.
+ * @details Every topic is subscribed to as a shape shifter, so its messages
+ * stay serialized, and is given its own lock-free queue, filled by its
+ * subscriber callback and emptied by one writer thread. The callbacks never
+ * wait on the disk; a message that finds its queue full is dropped and
+ * counted. The writer batches the messages into large bag chunks, which
+ * rosbag compresses one chunk at a time.
+ *
+ * Each topic has a profile. Its rate cap and decimation apply to every
+ * message. The writer empties the critical queues completely on every pass,
+ * before the other queues in priority order. It also trims drop oldest
+ * queues once they fill up. While a queue other than a critical one is
+ * more than half full, bulk image topics set to thumbnail are recorded as
+ * thumbnails.
+ *
+ * Started buffered, the recorder keeps the last seconds of every topic in
+ * memory instead, up to a number of bytes per topic, and only writes them to
+ * a bag when triggered. It then keeps recording for a while after.
+ */
+class Recorder {
+ public:
+  static const size_t kQueueSize = 1024;
+
+  enum Priority {CRITICAL, NORMAL, BULK};
+
+  // what is dropped once the queue of a topic is full
+  enum Overflow {
+    DROP_NEWEST,   // the messages that do not fit
+    DROP_OLDEST,   // the oldest half of the queue, so recent ones are kept
+    THUMBNAIL      // records images at a quarter of their size under load
+  };
+
+  struct Profile {
+    Profile() : priority(NORMAL), max_rate(0), decimation(1),
+                overflow(DROP_NEWEST) {}
+
+    Priority priority;
+    float max_rate;           // messages per second, 0 for no cap
+    unsigned int decimation;  // records every one of this many messages
+    Overflow overflow;
+  };
+
+  Recorder();
+  ~Recorder();
+
+  /**
+   * Subscribes to a topic. Topics can only be added before Start.
+   **/
+  void AddTopic(ros::NodeHandle* nh, std::string const& topic,
+                Profile const& profile = Profile());
+
+  /**
+   * Opens the bag and starts the writer. Returns false if the bag could not
+   * be opened.
+   **/
+  bool Start(std::string const& filename, uint32_t chunk_size,
+             rosbag::compression::CompressionType compression);
+
+  /**
+   * Starts the writer with no bag. Each topic keeps at most buffer_secs and
+   * buffer_bytes of its latest messages, until a trigger.
+   **/
+  void StartBuffered(std::string const& dir, size_t buffer_bytes,
+                     double buffer_secs, double post_trigger_secs,
+                     uint32_t chunk_size,
+                     rosbag::compression::CompressionType compression);
+
+  /**
+   * Writes what is buffered to a new bag in the directory, named for the
+   * time and the reason, and records on for the post trigger seconds. A
+   * trigger while that bag is open keeps it open longer. Can be called from
+   * any thread.
+   **/
+  void Trigger(std::string const& reason);
+
+  /**
+   * Stops the subscribers, writes what is queued and closes the bag.
+   **/
+  void Stop();
+
+  /**
+   * Sets a function to be called with the name of each bag once it is
+   * closed, from the writer thread or from Stop.
+   **/
+  void SetClosedCallback(std::function<void(std::string const&)> const& cb) {
+    closed_callback_ = cb;
+  }
+
+  uint64_t Written() const {return written_;}
+  uint64_t Dropped() const;
+
+  // The time now in UTC, as used to name the bags
+  static std::string TimeName();
+
+ private:
+  struct Message {
+    topic_tools::ShapeShifter::ConstPtr msg;
+    boost::shared_ptr<ros::M_string> connection_header;
+    ros::Time time;
+  };
+
+  struct Topic {
+    std::string name;
+    Profile profile;
+    ros::Subscriber sub;
+    ff_util::SpscQueue<Message, kQueueSize> queue;
+    std::atomic<uint64_t> dropped;
+    // only used by the callback
+    unsigned int count;
+    ros::Time last_time;
+    // only used by the writer, when buffered
+    std::deque<Message> buffer;
+    size_t buffer_size;
+  };
+
+  void Callback(Topic* topic,
+              ros::MessageEvent<topic_tools::ShapeShifter const> const& event);
+  bool Open(std::string const& filename);
+  void StartWriter();
+  // writes what the queues hold, returns false if there was nothing
+  bool WriteQueued();
+  void Buffer(Topic* topic, Message const& m);
+  // opens or closes the bag of a buffered recorder
+  void CheckTrigger();
+  void Close();
+  void Write();
+
+  std::vector<std::unique_ptr<Topic>> topics_;
+  rosbag::Bag bag_;
+  bool bag_open_;
+  uint32_t chunk_size_;
+  rosbag::compression::CompressionType compression_;
+  std::function<void(std::string const&)> closed_callback_;
+
+  // buffered recording
+  bool buffered_;
+  std::string dir_;
+  size_t buffer_bytes_;
+  double buffer_secs_;
+  ros::Duration post_trigger_;
+  ros::Time record_until_;
+  std::mutex trigger_mutex_;
+  std::string trigger_reason_;
+  std::atomic<bool> triggered_;
+  std::atomic<bool> running_;
+  std::atomic<bool> pressure_;   // a queue other than a critical one is filling
+  std::atomic<uint64_t> written_;
+  std::thread writer_;
+};
+
+}  // namespace data_bagger
+
+#endif  // DATA_BAGGER_RECORDER_H_
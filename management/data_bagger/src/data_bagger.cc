@@ -22,7 +22,17 @@ namespace data_bagger {
 DataBagger::DataBagger() :
   ff_util::FreeFlyerNodelet(),
   pub_queue_size_(10),
-  startup_time_secs_(20) {
+  startup_time_secs_(20),
+  recording_chunk_size_(4 * 1024 * 1024),
+  recording_compression_(rosbag::compression::LZ4),
+  recording_triggered_(false),
+  trigger_buffer_bytes_(16 * 1024 * 1024),
+  trigger_buffer_secs_(30),
+  trigger_post_secs_(10),
+  fault_state_seen_(false),
+  recording_dropped_(0),
+  packaging_(false),
+  package_recorded_(false) {
 }
 
 DataBagger::~DataBagger() {
@@ -52,6 +62,19 @@ void DataBagger::Initialize(ros::NodeHandle *nh) {
                                    this,
                                    true,
                                    true);
+
+  // Bags are packaged for downlink when asked, and as they are recorded if
+  // package_recorded is set
+  if (packaging_) {
+    packager_.reset(new Packager(package_options_, package_rules_));
+    sub_package_ = nh->subscribe(TOPIC_MANAGEMENT_DATA_BAGGER_PACKAGE, 5,
+                                 &DataBagger::PackageCallback, this);
+  }
+
+  if (!recording_topics_.empty() && !StartRecording(nh)) {
+    // TODO(Katie) assert fault
+    return;
+  }
 }
 
 bool DataBagger::ReadParams() {
@@ -71,9 +94,290 @@ bool DataBagger::ReadParams() {
     startup_time_secs_ = 20;
   }
 
+  // Topics recorded in process, none if the list is missing
+  config_reader::ConfigReader::Table topics;
+  if (config_params_.GetTable("recording_topics", &topics)) {
+    for (int i = 0; i < topics.GetSize(); i++) {
+      config_reader::ConfigReader::Table entry(&topics, (i + 1));
+      if (!ReadRecordingTopic(&entry))
+        NODELET_WARN("Recording topic %i is incomplete, not recording it.",
+                     i + 1);
+    }
+  } else {
+    NODELET_WARN("Unable to read recording topics.");
+  }
+
+  if (!config_params_.GetStr("recording_dir", &recording_dir_)) {
+    NODELET_WARN("Unable to read recording directory.");
+    recording_dir_ = "/data/bags";
+  }
+
+  if (!config_params_.GetUInt("recording_chunk_size",
+                              &recording_chunk_size_)) {
+    NODELET_WARN("Unable to read recording chunk size.");
+    recording_chunk_size_ = 4 * 1024 * 1024;
+  }
+
+  ReadCompression("recording_compression", "lz4", &recording_compression_);
+
+  std::string mode;
+  if (!config_params_.GetStr("recording_mode", &mode)) {
+    NODELET_WARN("Unable to read recording mode.");
+    mode = "continuous";
+  }
+  recording_triggered_ = (mode == "triggered");
+
+  if (!config_params_.GetUInt("trigger_buffer_bytes",
+                              &trigger_buffer_bytes_)) {
+    NODELET_WARN("Unable to read trigger buffer bytes.");
+    trigger_buffer_bytes_ = 16 * 1024 * 1024;
+  }
+
+  if (!config_params_.GetPosReal("trigger_buffer_secs",
+                                 &trigger_buffer_secs_)) {
+    NODELET_WARN("Unable to read trigger buffer seconds.");
+    trigger_buffer_secs_ = 30;
+  }
+
+  if (!config_params_.GetReal("trigger_post_secs", &trigger_post_secs_)) {
+    NODELET_WARN("Unable to read trigger post seconds.");
+    trigger_post_secs_ = 10;
+  }
+
+  return ReadPackageParams();
+}
+
+void DataBagger::ReadCompression(std::string const& param,
+                                 std::string const& fallback,
+                        rosbag::compression::CompressionType *compression) {
+  std::string name;
+  if (!config_params_.GetStr(param.c_str(), &name)) {
+    NODELET_WARN("Unable to read %s.", param.c_str());
+    name = fallback;
+  }
+
+  if (name != "none" && name != "bz2" && name != "lz4") {
+    NODELET_WARN("Unknown %s %s, using %s.", param.c_str(), name.c_str(),
+                 fallback.c_str());
+    name = fallback;
+  }
+
+  if (name == "none")
+    *compression = rosbag::compression::Uncompressed;
+  else if (name == "bz2")
+    *compression = rosbag::compression::BZ2;
+  else
+    *compression = rosbag::compression::LZ4;
+}
+
+bool DataBagger::ReadPackageParams() {
+  if (!config_params_.GetBool("packaging", &packaging_)) {
+    NODELET_WARN("Unable to read packaging.");
+    packaging_ = false;
+  }
+  if (!packaging_)
+    return true;
+
+  Packager::Options &options = package_options_;
+  if (!config_params_.GetStr("package_dir", &options.dir)) {
+    NODELET_WARN("Unable to read package directory.");
+    options.dir = "/data/downlink";
+  }
+
+  if (!config_params_.GetBool("package_recorded", &package_recorded_)) {
+    NODELET_WARN("Unable to read package recorded.");
+    package_recorded_ = false;
+  }
+
+  // Topics with no rule go to the default package, or are stripped
+  config_reader::ConfigReader::Table rules;
+  if (config_params_.GetTable("package_rules", &rules)) {
+    for (int i = 0; i < rules.GetSize(); i++) {
+      config_reader::ConfigReader::Table entry(&rules, (i + 1));
+      if (!ReadPackageRule(&entry))
+        NODELET_WARN("Package rule %i is incomplete, ignoring it.", i + 1);
+    }
+  } else {
+    NODELET_WARN("Unable to read package rules.");
+  }
+
+  if (!config_params_.GetInt("package_default", &options.default_package)) {
+    NODELET_WARN("Unable to read package default.");
+    options.default_package = 0;
+  }
+
+  unsigned int max_bytes;
+  if (config_params_.GetUInt("package_max_bytes", &max_bytes)) {
+    options.max_bytes = max_bytes;
+  } else {
+    NODELET_WARN("Unable to read package max bytes.");
+  }
+
+  ReadCompression("package_compression", "bz2", &options.compression);
+
+  if (!config_params_.GetInt("package_jpeg_quality", &options.jpeg_quality,
+                             1, 100))
+    NODELET_WARN("Unable to read package jpeg quality.");
+
+  if (!config_params_.GetStr("package_video_codec", &options.video_codec) ||
+      !config_params_.GetStr("package_video_encoder",
+                             &options.video_encoder) ||
+      !config_params_.GetInt("package_video_bitrate",
+                             &options.video_bitrate) ||
+      !config_params_.GetInt("package_video_gop", &options.video_gop, 1,
+                             1000))
+    NODELET_WARN("Unable to read the package video parameters.");
+
+  if (!config_params_.GetInt("package_nice", &options.nice, -20, 19))
+    NODELET_WARN("Unable to read package nice.");
+
+  return true;
+}
+
+bool DataBagger::ReadPackageRule(config_reader::ConfigReader::Table *entry) {
+  Packager::Rule rule;
+  std::string transcode;
+  if (!entry->GetStr("topic", &rule.topic) ||
+      !entry->GetInt("package", &rule.package) ||
+      !entry->GetUInt("decimation", &rule.decimation) ||
+      !entry->GetStr("transcode", &transcode))
+    return false;
+
+  if (transcode == "none") {
+    rule.transcode = Packager::RAW;
+  } else if (transcode == "jpeg") {
+    rule.transcode = Packager::JPEG;
+  } else if (transcode == "video") {
+    rule.transcode = Packager::VIDEO;
+  } else {
+    return false;
+  }
+
+  package_rules_.push_back(rule);
+  return true;
+}
+
+bool DataBagger::ReadRecordingTopic(
+                                    config_reader::ConfigReader::Table *entry) {
+  std::string topic, priority, overflow;
+  Recorder::Profile profile;
+  if (!entry->GetStr("topic", &topic) ||
+      !entry->GetStr("priority", &priority) ||
+      !entry->GetReal("max_rate", &profile.max_rate) ||
+      !entry->GetUInt("decimation", &profile.decimation) ||
+      !entry->GetStr("overflow", &overflow))
+    return false;
+
+  if (priority == "critical") {
+    profile.priority = Recorder::CRITICAL;
+  } else if (priority == "normal") {
+    profile.priority = Recorder::NORMAL;
+  } else if (priority == "bulk") {
+    profile.priority = Recorder::BULK;
+  } else {
+    return false;
+  }
+
+  if (overflow == "drop_newest") {
+    profile.overflow = Recorder::DROP_NEWEST;
+  } else if (overflow == "drop_oldest") {
+    profile.overflow = Recorder::DROP_OLDEST;
+  } else if (overflow == "thumbnail") {
+    profile.overflow = Recorder::THUMBNAIL;
+  } else {
+    return false;
+  }
+
+  recording_topics_.push_back(topic);
+  recording_profiles_.push_back(profile);
   return true;
 }
 
+bool DataBagger::StartRecording(ros::NodeHandle *nh) {
+  std::string filename = recording_dir_ + "/" + Recorder::TimeName() + ".bag";
+
+  recorder_.reset(new Recorder());
+  if (packager_ && package_recorded_) {
+    Packager* packager = packager_.get();
+    recorder_->SetClosedCallback([packager](std::string const& bag) {
+      packager->Add(bag);
+    });
+  }
+  for (size_t i = 0; i < recording_topics_.size(); i++)
+    recorder_->AddTopic(nh, recording_topics_[i], recording_profiles_[i]);
+
+  if (recording_triggered_) {
+    // Bags are written when sys monitor reports a new fault or when asked
+    filename = recording_dir_;
+    recorder_->StartBuffered(recording_dir_, trigger_buffer_bytes_,
+                             trigger_buffer_secs_, trigger_post_secs_,
+                             recording_chunk_size_, recording_compression_);
+    sub_fault_state_ = nh->subscribe(TOPIC_MANAGEMENT_SYS_MONITOR_STATE, 5,
+                                     &DataBagger::FaultStateCallback, this);
+    sub_trigger_ = nh->subscribe(TOPIC_MANAGEMENT_DATA_BAGGER_TRIGGER, 5,
+                                 &DataBagger::TriggerCallback, this);
+  } else if (!recorder_->Start(filename, recording_chunk_size_,
+                               recording_compression_)) {
+    NODELET_ERROR("Data bagger: Unable to start recording to %s.",
+                  filename.c_str());
+    recorder_.reset();
+    return false;
+  }
+
+  // The state tells the ground what is being recorded
+  data_state_msg_.header.stamp = ros::Time::now();
+  data_state_msg_.name = filename;
+  data_state_msg_.topic_save_settings.resize(recording_topics_.size());
+  for (size_t i = 0; i < recording_topics_.size(); i++) {
+    data_state_msg_.topic_save_settings[i].topic_name = recording_topics_[i];
+    data_state_msg_.topic_save_settings[i].downlinkOption =
+                                              ff_msgs::SaveSettings::DELAYED;
+    data_state_msg_.topic_save_settings[i].frequency =
+                                              recording_profiles_[i].max_rate;
+  }
+  pub_data_state_.publish(data_state_msg_);
+
+  recording_timer_ = nh->createTimer(ros::Duration(10),
+                                     &DataBagger::OnRecordingTimer,
+                                     this);
+  return true;
+}
+
+void DataBagger::FaultStateCallback(
+                                  ff_msgs::FaultStateConstPtr const& state) {
+  // Only faults that were not in the last state trigger a bag, the ones there
+  // before the data bagger started do not
+  std::vector<uint32_t> ids;
+  for (ff_msgs::Fault const& fault : state->faults) {
+    ids.push_back(fault.id);
+    if (fault_state_seen_ &&
+        std::find(fault_ids_.begin(), fault_ids_.end(), fault.id) ==
+                                                            fault_ids_.end())
+      recorder_->Trigger("fault_" + std::to_string(fault.id));
+  }
+  fault_ids_.swap(ids);
+  fault_state_seen_ = true;
+}
+
+void DataBagger::TriggerCallback(std_msgs::StringConstPtr const& reason) {
+  recorder_->Trigger(reason->data.empty() ? "command" : reason->data);
+}
+
+void DataBagger::PackageCallback(std_msgs::StringConstPtr const& bag) {
+  NODELET_INFO("Data bagger: Packaging %s", bag->data.c_str());
+  packager_->Add(bag->data);
+}
+
+void DataBagger::OnRecordingTimer(ros::TimerEvent const& event) {
+  uint64_t dropped = recorder_->Dropped();
+  if (dropped > recording_dropped_) {
+    NODELET_WARN("Data bagger: %llu messages dropped while recording.",
+                 static_cast<unsigned long long>(dropped -  // NOLINT
+                                                 recording_dropped_));
+    recording_dropped_ = dropped;
+  }
+}
+
 void DataBagger::OnStartupTimer(ros::TimerEvent const& event) {
   GetTopicNames();
 }
@@ -0,0 +1,271 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <data_bagger/packager.h>
+
+#include <cv_bridge/cv_bridge.h>
+#include <ff_util/thread_policy.h>
+#include <opencv2/highgui/highgui.hpp>
+#include <ros/ros.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/CompressedImage.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/image_encodings.h>
+
+#ifdef DATA_BAGGER_VIDEO
+#include <image_sampler/video_encoder.h>
+#endif
+
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace data_bagger {
+
+namespace {
+
+// the idle I/O class of ioprio_set, which glibc has no header for
+const int kIoprioWhoProcess = 1;
+const int kIoprioClassIdle = 3;
+const int kIoprioClassShift = 13;
+
+// topics are compared without their leading slash, which the bags of the
+// recorder do not have and those of rosbag record do
+std::string Relative(std::string const& topic) {
+  return (!topic.empty() && topic[0] == '/') ? topic.substr(1) : topic;
+}
+
+}  // namespace
+
+// One package of the bag being packaged, written to parts of at most the
+// maximum size, each one named .active until it is closed
+struct Packager::Output {
+  std::string base;
+  int part;
+  std::string name;
+  rosbag::Bag bag;
+  bool open;
+
+  Output() : part(-1), open(false) {}
+  ~Output() {Close();}
+
+  void Close() {
+    if (!open)
+      return;
+    open = false;
+    try {
+      bag.close();
+    } catch (rosbag::BagException const& e) {
+      ROS_ERROR("Data bagger: Unable to write %s: %s", name.c_str(), e.what());
+      return;
+    }
+    if (rename((name + ".active").c_str(), name.c_str()))
+      ROS_ERROR("Data bagger: Unable to rename %s.active", name.c_str());
+    else
+      ROS_INFO("Data bagger: Packaged %s", name.c_str());
+  }
+
+  // opens the next part if there is none, or if the last one is full
+  void Open(Options const& options) {
+    if (open && bag.getSize() < options.max_bytes)
+      return;
+    Close();
+    name = base + "_" + std::to_string(++part) + ".bag";
+    bag.open(name + ".active", rosbag::bagmode::Write);
+    bag.setCompression(options.compression);
+    open = true;
+  }
+};
+
+// What is kept for one topic of the bag being packaged: its decimation
+// count, and its video encoder, which starts each part on a key frame
+class Packager::Encoder {
+ public:
+  Encoder(Rule const& rule, Options const& options)
+    : rule_(rule), count_(0), part_(-1) {
+#ifdef DATA_BAGGER_VIDEO
+    if (rule.transcode == VIDEO)
+      video_.reset(new image_sampler::VideoEncoder(options.video_codec, options.video_encoder,
+                                                   options.video_bitrate, options.video_gop));
+#endif
+    params_.push_back(cv::IMWRITE_JPEG_QUALITY);
+    params_.push_back(options.jpeg_quality);
+  }
+
+  Rule const& rule() const {return rule_;}
+
+  // whether the next message is kept
+  bool Keep() {return count_++ % rule_.decimation == 0;}
+
+  void Write(rosbag::MessageInstance const& m, Output* output) {
+    if (rule_.transcode == RAW || m.getDataType() != "sensor_msgs/Image") {
+      output->bag.write(m.getTopic(), m.getTime(), m, m.getConnectionHeader());
+      return;
+    }
+
+    sensor_msgs::ImageConstPtr image = m.instantiate<sensor_msgs::Image>();
+    if (!image)
+      return;
+    std::string encoding = (sensor_msgs::image_encodings::numChannels(image->encoding) == 1 ?
+                            sensor_msgs::image_encodings::MONO8 : sensor_msgs::image_encodings::BGR8);
+    cv_bridge::CvImageConstPtr cv_image;
+    try {
+      cv_image = cv_bridge::toCvShare(image, encoding);
+    } catch (cv_bridge::Exception & e) {
+      ROS_ERROR_STREAM_THROTTLE(10, "Data bagger: Unable to package " << image->encoding
+                                << " images of " << m.getTopic() << ": " << e.what());
+      return;
+    }
+
+    sensor_msgs::CompressedImage compressed;
+    compressed.header = image->header;
+#ifdef DATA_BAGGER_VIDEO
+    if (video_) {
+      compressed.format = video_->Format();
+      bool key = (output->part != part_);
+      part_ = output->part;
+      if (video_->Encode(cv_image->image, image->header.stamp, key, &compressed.data) && !compressed.data.empty())
+        output->bag.write(m.getTopic() + "/video", m.getTime(), compressed);
+      return;
+    }
+#endif
+    compressed.format = "jpeg";
+    if (cv::imencode(".jpg", cv_image->image, compressed.data, params_))
+      output->bag.write(m.getTopic() + "/compressed", m.getTime(), compressed);
+  }
+
+ private:
+  Rule rule_;
+  unsigned int count_;
+  int part_;
+  std::vector<int> params_;
+#ifdef DATA_BAGGER_VIDEO
+  std::unique_ptr<image_sampler::VideoEncoder> video_;
+#endif
+};
+
+Packager::Packager(Options const& options, std::vector<Rule> const& rules)
+  : options_(options), rules_(rules), running_(true) {
+  default_rule_.package = options.default_package;
+  for (Rule& rule : rules_) {
+    rule.topic = Relative(rule.topic);
+    rule.decimation = std::max(1u, rule.decimation);
+    if (rule.transcode == VIDEO && !HasVideo()) {
+      ROS_WARN("Data bagger: Built without video, packaging %s as JPEG", rule.topic.c_str());
+      rule.transcode = JPEG;
+    }
+  }
+  worker_ = std::thread(&Packager::Work, this);
+}
+
+Packager::~Packager() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  added_.notify_one();
+  worker_.join();
+}
+
+bool Packager::HasVideo() {
+#ifdef DATA_BAGGER_VIDEO
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Packager::Add(std::string const& bag) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bags_.push_back(bag);
+  }
+  added_.notify_one();
+}
+
+Packager::Rule const& Packager::Find(std::string const& topic) const {
+  std::string relative = Relative(topic);
+  for (Rule const& rule : rules_)
+    if (rule.topic == relative)
+      return rule;
+  return default_rule_;
+}
+
+bool Packager::Package(std::string const& filename) {
+  std::string stem = filename.substr(filename.rfind('/') + 1);
+  if (stem.size() > 4 && stem.compare(stem.size() - 4, 4, ".bag") == 0)
+    stem.resize(stem.size() - 4);
+
+  std::map<int, Output> outputs;
+  std::map<std::string, std::unique_ptr<Encoder>> encoders;
+  try {
+    rosbag::Bag bag(filename, rosbag::bagmode::Read);
+    rosbag::View view(bag);
+    for (rosbag::MessageInstance const& m : view) {
+      if (!running_) {
+        ROS_WARN("Data bagger: Stopped packaging %s", filename.c_str());
+        return false;
+      }
+
+      std::unique_ptr<Encoder>& encoder = encoders[m.getTopic()];
+      if (!encoder)
+        encoder.reset(new Encoder(Find(m.getTopic()), options_));
+      if (encoder->rule().package <= 0 || !encoder->Keep())
+        continue;
+
+      Output& output = outputs[encoder->rule().package];
+      if (output.base.empty())
+        output.base = options_.dir + "/" + stem + "_p" + std::to_string(encoder->rule().package);
+      output.Open(options_);
+      encoder->Write(m, &output);
+    }
+  } catch (rosbag::BagException const& e) {
+    ROS_ERROR("Data bagger: Unable to package %s: %s", filename.c_str(), e.what());
+    return false;
+  }
+  return true;
+}
+
+void Packager::Work() {
+  // packaging only gets the time and the disk that nothing else wants
+  ff_util::ThreadPolicy policy;
+  policy.nice = options_.nice;
+  std::string error;
+  if (!ff_util::ApplyThreadPolicy(policy, 0, &error))
+    ROS_WARN("Data bagger: Unable to lower the packaging priority: %s", error.c_str());
+  if (syscall(SYS_ioprio_set, kIoprioWhoProcess, 0, kIoprioClassIdle << kIoprioClassShift))
+    ROS_WARN("Data bagger: Unable to set the packaging I/O priority to idle.");
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_) {
+    if (bags_.empty()) {
+      added_.wait(lock);
+      continue;
+    }
+    std::string bag = bags_.front();
+    bags_.pop_front();
+    lock.unlock();
+    Package(bag);
+    lock.lock();
+  }
+}
+
+}  // namespace data_bagger
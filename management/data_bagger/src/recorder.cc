@@ -0,0 +1,343 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <data_bagger/recorder.h>
+
+#include <sensor_msgs/Image.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>  // NOLINT
+#include <cstring>
+#include <ctime>
+#include <utility>
+
+namespace data_bagger {
+
+namespace {
+
+// messages written from one topic before moving on to the next, so that one
+// busy topic cannot hold the others back
+const int kBatchSize = 64;
+// how long the writer sleeps when every queue is empty
+const int kIdleMs = 5;
+// thumbnails keep every this many pixels of every this many rows
+const unsigned int kThumbnailStep = 2;
+
+// A thumbnail of a raw image, kept as a shape shifter like every other
+// message, or NULL if it is not an image that can be sampled
+topic_tools::ShapeShifter::ConstPtr Thumbnail(
+                                      topic_tools::ShapeShifter const& msg) {
+  if (msg.getDataType() != "sensor_msgs/Image")
+    return topic_tools::ShapeShifter::ConstPtr();
+  sensor_msgs::ImageConstPtr image = msg.instantiate<sensor_msgs::Image>();
+  // bayer images would lose their pattern
+  if (!image || image->width == 0 || image->encoding.find("bayer") == 0)
+    return topic_tools::ShapeShifter::ConstPtr();
+
+  sensor_msgs::Image thumb;
+  thumb.header = image->header;
+  thumb.encoding = image->encoding;
+  thumb.is_bigendian = image->is_bigendian;
+  thumb.width = (image->width + kThumbnailStep - 1) / kThumbnailStep;
+  thumb.height = (image->height + kThumbnailStep - 1) / kThumbnailStep;
+  size_t pixel = image->step / image->width;
+  thumb.step = thumb.width * pixel;
+  thumb.data.resize(thumb.step * thumb.height);
+  for (unsigned int y = 0; y < thumb.height; y++) {
+    uint8_t const* src = &image->data[y * kThumbnailStep * image->step];
+    uint8_t* dst = &thumb.data[y * thumb.step];
+    for (unsigned int x = 0; x < thumb.width; x++)
+      std::memcpy(dst + x * pixel, src + x * kThumbnailStep * pixel, pixel);
+  }
+
+  uint32_t size = ros::serialization::serializationLength(thumb);
+  std::vector<uint8_t> buffer(size);
+  ros::serialization::OStream out(buffer.data(), size);
+  ros::serialization::serialize(out, thumb);
+  boost::shared_ptr<topic_tools::ShapeShifter> shifter(
+                                              new topic_tools::ShapeShifter());
+  shifter->morph(msg.getMD5Sum(), msg.getDataType(),
+                 msg.getMessageDefinition(), "");
+  ros::serialization::IStream in(buffer.data(), size);
+  shifter->read(in);
+  return shifter;
+}
+
+}  // namespace
+
+Recorder::Recorder() : bag_open_(false), chunk_size_(0),
+  compression_(rosbag::compression::Uncompressed), buffered_(false),
+  buffer_bytes_(0), buffer_secs_(0), triggered_(false), running_(false),
+  pressure_(false), written_(0) {
+}
+
+Recorder::~Recorder() {
+  Stop();
+}
+
+void Recorder::AddTopic(ros::NodeHandle* nh, std::string const& topic,
+                        Profile const& profile) {
+  if (running_) {
+    ROS_ERROR("Data bagger: Cannot add %s while recording", topic.c_str());
+    return;
+  }
+
+  topics_.emplace_back(new Topic());
+  Topic* t = topics_.back().get();
+  t->name = topic;
+  t->profile = profile;
+  t->profile.decimation = std::max(1u, profile.decimation);
+  t->dropped = 0;
+  t->count = 0;
+
+  boost::function<void(
+      ros::MessageEvent<topic_tools::ShapeShifter const> const&)> f =
+    [this, t](ros::MessageEvent<topic_tools::ShapeShifter const> const& e) {
+      Callback(t, e);
+    };
+  ros::SubscribeOptions ops;
+  ops.initByFullCallbackType<
+      ros::MessageEvent<topic_tools::ShapeShifter const> const&>(
+                                                        topic, kQueueSize, f);
+  ops.transport_hints = ros::TransportHints().tcpNoDelay();
+  t->sub = nh->subscribe(ops);
+}
+
+bool Recorder::Start(std::string const& filename, uint32_t chunk_size,
+                     rosbag::compression::CompressionType compression) {
+  chunk_size_ = chunk_size;
+  compression_ = compression;
+  if (!Open(filename))
+    return false;
+  StartWriter();
+  return true;
+}
+
+void Recorder::StartBuffered(std::string const& dir, size_t buffer_bytes,
+                             double buffer_secs, double post_trigger_secs,
+                             uint32_t chunk_size,
+                             rosbag::compression::CompressionType compression) {
+  chunk_size_ = chunk_size;
+  compression_ = compression;
+  buffered_ = true;
+  dir_ = dir;
+  buffer_bytes_ = buffer_bytes;
+  buffer_secs_ = buffer_secs;
+  post_trigger_ = ros::Duration(post_trigger_secs);
+  for (std::unique_ptr<Topic> const& topic : topics_)
+    topic->buffer_size = 0;
+  StartWriter();
+}
+
+void Recorder::Trigger(std::string const& reason) {
+  std::lock_guard<std::mutex> lock(trigger_mutex_);
+  // the first reason names the bag
+  if (!triggered_) {
+    trigger_reason_ = reason;
+    for (char& c : trigger_reason_)
+      if (!isalnum(c))
+        c = '_';
+  }
+  triggered_ = true;
+}
+
+std::string Recorder::TimeName() {
+  char name[32];
+  time_t now = time(NULL);
+  struct tm utc;
+  strftime(name, sizeof(name), "%Y%m%d_%H%M%S", gmtime_r(&now, &utc));
+  return name;
+}
+
+bool Recorder::Open(std::string const& filename) {
+  try {
+    bag_.open(filename, rosbag::bagmode::Write);
+  } catch (rosbag::BagException const& e) {
+    ROS_ERROR("Data bagger: Unable to open %s: %s", filename.c_str(),
+              e.what());
+    return false;
+  }
+  bag_.setChunkThreshold(chunk_size_);
+  bag_.setCompression(compression_);
+  bag_open_ = true;
+  return true;
+}
+
+void Recorder::StartWriter() {
+  // the writer takes the topics in priority order
+  std::stable_sort(topics_.begin(), topics_.end(),
+                   [](std::unique_ptr<Topic> const& a,
+                      std::unique_ptr<Topic> const& b) {
+                     return a->profile.priority < b->profile.priority;
+                   });
+
+  running_ = true;
+  writer_ = std::thread(&Recorder::Write, this);
+}
+
+void Recorder::Stop() {
+  for (std::unique_ptr<Topic> const& topic : topics_)
+    topic->sub.shutdown();
+  if (!running_)
+    return;
+  running_ = false;
+  writer_.join();
+  if (bag_open_)
+    Close();
+}
+
+void Recorder::Close() {
+  std::string filename = bag_.getFileName();
+  bag_.close();
+  bag_open_ = false;
+  if (closed_callback_)
+    closed_callback_(filename);
+}
+
+uint64_t Recorder::Dropped() const {
+  uint64_t dropped = 0;
+  for (std::unique_ptr<Topic> const& topic : topics_)
+    dropped += topic->dropped;
+  return dropped;
+}
+
+void Recorder::Callback(Topic* topic,
+              ros::MessageEvent<topic_tools::ShapeShifter const> const& event) {
+  if (!running_)
+    return;
+
+  Profile const& profile = topic->profile;
+  if (topic->count++ % profile.decimation != 0)
+    return;
+  Message m;
+  m.time = event.getReceiptTime();
+  if (profile.max_rate > 0 && !topic->last_time.isZero() &&
+      (m.time - topic->last_time).toSec() < 1.0 / profile.max_rate)
+    return;
+  topic->last_time = m.time;
+
+  m.msg = event.getConstMessage();
+  m.connection_header = event.getConnectionHeaderPtr();
+  if (profile.overflow == THUMBNAIL && profile.priority == BULK &&
+      pressure_) {
+    m.msg = Thumbnail(*m.msg);
+    if (!m.msg) {
+      topic->dropped++;
+      return;
+    }
+  }
+  if (!topic->queue.Push(m))
+    topic->dropped++;
+}
+
+bool Recorder::WriteQueued() {
+  bool wrote = false, pressure = false;
+  for (std::unique_ptr<Topic> const& topic : topics_) {
+    size_t size = topic->queue.Size();
+    if (topic->profile.priority != CRITICAL && size > kQueueSize / 2)
+      pressure = true;
+
+    // a full drop oldest queue loses its oldest half at once
+    if (topic->profile.overflow == DROP_OLDEST && size > 3 * kQueueSize / 4) {
+      for (size_t i = 0; i < size / 2; i++)
+        topic->queue.Pop();
+      topic->dropped += size / 2;
+    }
+
+    int batch = topic->profile.priority == CRITICAL ?
+                static_cast<int>(kQueueSize) : kBatchSize;
+    for (int i = 0; i < batch; i++) {
+      Message* m = topic->queue.Front();
+      if (m == NULL)
+        break;
+      if (bag_open_)
+        bag_.write(topic->name, m->time, *m->msg, m->connection_header);
+      else
+        Buffer(topic.get(), *m);
+      topic->queue.Pop();
+      written_++;
+      wrote = true;
+    }
+  }
+  pressure_ = pressure;
+  return wrote;
+}
+
+void Recorder::Buffer(Topic* topic, Message const& m) {
+  topic->buffer.push_back(m);
+  topic->buffer_size += m.msg->size();
+  while (topic->buffer_size > buffer_bytes_ ||
+         (m.time - topic->buffer.front().time).toSec() > buffer_secs_) {
+    topic->buffer_size -= topic->buffer.front().msg->size();
+    topic->buffer.pop_front();
+  }
+}
+
+void Recorder::CheckTrigger() {
+  if (triggered_) {
+    std::string reason;
+    {
+      std::lock_guard<std::mutex> lock(trigger_mutex_);
+      reason = trigger_reason_;
+      triggered_ = false;
+    }
+    record_until_ = ros::Time::now() + post_trigger_;
+    if (bag_open_ || !Open(dir_ + "/" + TimeName() + "_" + reason + ".bag"))
+      return;
+    ROS_INFO("Data bagger: Recording triggered by %s", reason.c_str());
+
+    // what was buffered goes in first, in the order it was received
+    std::vector<std::pair<Topic*, Message*>> buffered;
+    for (std::unique_ptr<Topic> const& topic : topics_)
+      for (Message& m : topic->buffer)
+        buffered.push_back(std::make_pair(topic.get(), &m));
+    std::stable_sort(buffered.begin(), buffered.end(),
+                     [](std::pair<Topic*, Message*> const& a,
+                        std::pair<Topic*, Message*> const& b) {
+                       return a.second->time < b.second->time;
+                     });
+    for (std::pair<Topic*, Message*> const& p : buffered)
+      bag_.write(p.first->name, p.second->time, *p.second->msg,
+                 p.second->connection_header);
+    written_ += buffered.size();
+    for (std::unique_ptr<Topic> const& topic : topics_) {
+      topic->buffer.clear();
+      topic->buffer_size = 0;
+    }
+  } else if (bag_open_ && ros::Time::now() > record_until_) {
+    Close();
+  }
+}
+
+void Recorder::Write() {
+  try {
+    while (running_) {
+      if (buffered_)
+        CheckTrigger();
+      if (!WriteQueued())
+        std::this_thread::sleep_for(std::chrono::milliseconds(kIdleMs));
+    }
+    // the subscribers are shut down by now, so this ends
+    while (WriteQueued()) {}
+  } catch (rosbag::BagException const& e) {
+    ROS_ERROR("Data bagger: Recording stopped: %s", e.what());
+  }
+}
+
+}  // namespace data_bagger
@@ -32,11 +32,13 @@
 #include <sys/statvfs.h>
 
 #include <config_reader/config_reader.h>
+#include <disk_monitor/io_monitor.h>
 #include <ff_msgs/DiskState.h>
 #include <ff_msgs/DiskStateStamped.h>
 #include <ff_util/ff_names.h>
 #include <ff_util/ff_nodelet.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <vector>
@@ -56,11 +58,17 @@ class DiskMonitor : public ff_util::FreeFlyerNodelet {
  private:
   void OnCheckTimer(ros::TimerEvent const& event);
   bool CheckAndPublish();
+  void CheckIo();
 
   config_reader::ConfigReader config_params_;
 
   ff_msgs::DiskStateStamped disk_stats_msg_;
 
+  IoMonitor io_monitor_;
+  bool io_stats_;
+  int io_process_max_;
+  double io_await_limit_, io_queue_limit_;
+
   int pub_queue_size_, update_freq_;
 
   ros::Publisher pub_disk_stats_;
@@ -0,0 +1,92 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef DISK_MONITOR_IO_MONITOR_H_
+#define DISK_MONITOR_IO_MONITOR_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace disk_monitor {
+
+// Samples the I/O of block devices from /proc/diskstats, and the storage I/O
+// of the ROS processes on this processor from /proc/<pid>/io. A process is a
+// ROS process if its command line sets __name, as for the cpu monitor.
+class IoMonitor {
+ public:
+  struct Device {
+    std::string name;
+    double read_rate, write_rate;  // bytes per second
+    double reads, writes;          // requests per second
+    double await;                  // ms per request, queued and serviced
+    double queue_depth;            // requests in flight, on average
+    unsigned int in_flight;        // requests in flight now
+    double utilization;            // percent of the time busy
+  };
+
+  struct Process {
+    int pid;
+    std::string name;              // the node name, resolved in its namespace
+    double read_rate, write_rate;  // bytes per second
+  };
+
+ private:
+  // the counters of a line of /proc/diskstats
+  struct DeviceSample {
+    std::uint64_t reads, read_sectors, read_ms;
+    std::uint64_t writes, write_sectors, write_ms;
+    std::uint64_t in_flight, io_ms, queue_ms;
+  };
+
+  struct ProcessInfo {
+    bool ros, seen;
+    std::string name;
+    std::uint64_t read_bytes, write_bytes;
+  };
+
+  std::string proc_path_;
+  std::vector<std::string> devices_;
+  double last_time_;
+  std::map<std::string, DeviceSample> device_samples_;
+  std::map<int, ProcessInfo> processes_;
+
+ public:
+  explicit IoMonitor(const std::string proc_path = "/proc");
+
+  // The devices to sample, by their names in /proc/diskstats
+  void SetDevices(std::vector<std::string> const& names);
+
+  // Samples the devices and the processes at the given time in seconds, and
+  // sets the rates since the last call. Rates are zero on the first call, and
+  // on the first call for each process. Devices which are not found, and
+  // processes whose I/O can't be read, are left out.
+  bool Collect(double time, std::vector<Device> *devices,
+               std::vector<Process> *processes);
+
+ private:
+  bool ReadDevices(double period, std::vector<Device> *devices);
+  void ReadProcesses(double period, std::vector<Process> *processes);
+  bool ReadCommand(int pid, ProcessInfo *info);
+  bool ReadIo(int pid, std::uint64_t *read_bytes, std::uint64_t *write_bytes);
+};
+
+}  // namespace disk_monitor
+
+#endif  // DISK_MONITOR_IO_MONITOR_H_
@@ -23,7 +23,11 @@
 namespace disk_monitor {
 DiskMonitor::DiskMonitor() :
   ff_util::FreeFlyerNodelet(),
-  pub_queue_size_(10) {
+  pub_queue_size_(10),
+  io_stats_(false),
+  io_process_max_(10),
+  io_await_limit_(0),
+  io_queue_limit_(0) {
   // don't specify node name so we use the name from the launch file
 }
 
@@ -109,6 +113,43 @@ bool DiskMonitor::ReadParams() {
     paths_.push_back(temp_path);
   }
 
+  // Get whether to sample the I/O of the devices and processes
+  if (!config_params_.GetBool("io_stats", &io_stats_)) {
+    ROS_FATAL("Disk monitor: io stats not specified!");
+    return false;
+  }
+
+  if (!io_stats_)
+    return true;
+
+  if (!config_params_.GetInt("io_process_max", &io_process_max_)) {
+    ROS_FATAL("Disk monitor: io process max not specified!");
+    return false;
+  }
+
+  if (!config_params_.GetPosReal("io_await_limit", &io_await_limit_)) {
+    ROS_FATAL("Disk monitor: io await limit not specified!");
+    return false;
+  }
+
+  if (!config_params_.GetPosReal("io_queue_limit", &io_queue_limit_)) {
+    ROS_FATAL("Disk monitor: io queue limit not specified!");
+    return false;
+  }
+
+  // Get the names of the block devices we are sampling
+  config_reader::ConfigReader::Table io_devices(&processor_config,
+                                                "io_devices");
+  std::vector<std::string> devices;
+  for (int i = 1; i < (io_devices.GetSize() + 1); i++) {
+    if (!io_devices.GetStr(i, &temp_path)) {
+      ROS_FATAL("Disk monitor: One of the io devices wasn't a string!");
+      return false;
+    }
+    devices.push_back(temp_path);
+  }
+  io_monitor_.SetDevices(devices);
+
   return true;
 }
 
@@ -143,12 +184,70 @@ bool DiskMonitor::CheckAndPublish() {
     disk_stats_msg_.disks[i].used = total - avail;
   }
 
+  if (io_stats_)
+    CheckIo();
+
   disk_stats_msg_.header.stamp = ros::Time::now();
   pub_disk_stats_.publish(disk_stats_msg_);
 
   return true;
 }
 
+void DiskMonitor::CheckIo() {
+  std::vector<IoMonitor::Device> devices;
+  std::vector<IoMonitor::Process> processes;
+  if (!io_monitor_.Collect(ros::WallTime::now().toSec(), &devices,
+                           &processes))
+    ROS_ERROR_THROTTLE(60, "Disk monitor: Unable to read the io devices.");
+
+  // Check the latency and queue of the devices before they stall the nodes
+  // waiting on them, such as the bagger filling the page cache
+  std::string fault;
+  disk_stats_msg_.devices.resize(devices.size());
+  for (unsigned int i = 0; i < devices.size(); i++) {
+    IoMonitor::Device const& d = devices[i];
+    ff_msgs::DiskIoDevice &msg = disk_stats_msg_.devices[i];
+    msg.name = d.name;
+    msg.read_rate = d.read_rate;
+    msg.write_rate = d.write_rate;
+    msg.reads = d.reads;
+    msg.writes = d.writes;
+    msg.await = d.await;
+    msg.queue_depth = d.queue_depth;
+    msg.in_flight = d.in_flight;
+    msg.utilization = d.utilization;
+
+    if (d.await > io_await_limit_)
+      fault += d.name + " await is " + std::to_string(d.await) +
+               " ms which is greater than " + std::to_string(io_await_limit_) +
+               ". ";
+    if (d.queue_depth > io_queue_limit_)
+      fault += d.name + " queue depth is " + std::to_string(d.queue_depth) +
+               " which is greater than " + std::to_string(io_queue_limit_) +
+               ". ";
+  }
+
+  if (!fault.empty())
+    this->AssertFault("IO_LATENCY_TOO_HIGH", fault);
+  else
+    this->ClearFault("IO_LATENCY_TOO_HIGH");
+
+  std::sort(processes.begin(), processes.end(),
+            [](IoMonitor::Process const& a, IoMonitor::Process const& b) {
+              return a.write_rate + a.read_rate > b.write_rate + b.read_rate;});
+  if (static_cast<int>(processes.size()) > io_process_max_)
+    processes.resize(io_process_max_);
+
+  disk_stats_msg_.processes.resize(processes.size());
+  for (unsigned int i = 0; i < processes.size(); i++) {
+    ff_msgs::DiskIoProcess &msg = disk_stats_msg_.processes[i];
+    msg.name = processes[i].name;
+    msg.pid = processes[i].pid;
+    msg.read_rate = processes[i].read_rate;
+    msg.write_rate = processes[i].write_rate;
+  }
+}
+
 }  // namespace disk_monitor
 
 PLUGINLIB_EXPORT_CLASS(disk_monitor::DiskMonitor, nodelet::Nodelet)
@@ -0,0 +1,243 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <disk_monitor/io_monitor.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace disk_monitor {
+
+namespace {
+
+// the unit of the sector counts in /proc/diskstats, whatever the device
+constexpr double kSectorBytes = 512;
+
+// reads a whole file, as /proc files must be read with read and not stat
+bool ReadFile(const std::string &path, std::string *contents) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  contents->clear();
+  char buffer[4096];
+  ssize_t length;
+  while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+    contents->append(buffer, length);
+
+  close(fd);
+  return length == 0;
+}
+
+// counters go back to zero when a device is removed and added again
+double Delta(std::uint64_t last, std::uint64_t now) {
+  return (now >= last) ? static_cast<double>(now - last) : 0;
+}
+
+}  // namespace
+
+IoMonitor::IoMonitor(const std::string proc_path)
+  : proc_path_(proc_path)
+  , last_time_(0) {
+}
+
+void IoMonitor::SetDevices(std::vector<std::string> const& names) {
+  devices_ = names;
+  device_samples_.clear();
+}
+
+bool IoMonitor::Collect(double time, std::vector<Device> *devices,
+                        std::vector<Process> *processes) {
+  devices->clear();
+  processes->clear();
+
+  double period = (last_time_ > 0 && time > last_time_) ? time - last_time_ : 0;
+  last_time_ = time;
+
+  bool found = devices_.empty() || ReadDevices(period, devices);
+  ReadProcesses(period, processes);
+  return found;
+}
+
+bool IoMonitor::ReadDevices(double period, std::vector<Device> *devices) {
+  std::string contents;
+  if (!ReadFile(proc_path_ + "/diskstats", &contents))
+    return false;
+
+  // major minor name, then the counters, of which kernels after 4.18 have
+  // four more for discards, and after 5.5 two more for flushes
+  size_t start = 0;
+  while (start < contents.size()) {
+    size_t end = contents.find('\n', start);
+    if (end == std::string::npos)
+      end = contents.size();
+    std::string line = contents.substr(start, end - start);
+    start = end + 1;
+
+    char name[64];
+    DeviceSample s;
+    if (sscanf(line.c_str(), " %*u %*u %63s %" SCNu64 " %*u %" SCNu64 " %" SCNu64
+               " %" SCNu64 " %*u %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+               " %" SCNu64, name, &s.reads, &s.read_sectors, &s.read_ms,
+               &s.writes, &s.write_sectors, &s.write_ms, &s.in_flight,
+               &s.io_ms, &s.queue_ms) != 10)
+      continue;
+    if (std::find(devices_.begin(), devices_.end(), name) == devices_.end())
+      continue;
+
+    Device device;
+    device.name = name;
+    device.read_rate = device.write_rate = 0;
+    device.reads = device.writes = 0;
+    device.await = device.queue_depth = device.utilization = 0;
+    device.in_flight = s.in_flight;
+
+    auto it = device_samples_.find(device.name);
+    if (it != device_samples_.end() && period > 0) {
+      DeviceSample const& l = it->second;
+      double requests = Delta(l.reads, s.reads) + Delta(l.writes, s.writes);
+      device.read_rate = kSectorBytes * Delta(l.read_sectors, s.read_sectors) / period;
+      device.write_rate = kSectorBytes * Delta(l.write_sectors, s.write_sectors) / period;
+      device.reads = Delta(l.reads, s.reads) / period;
+      device.writes = Delta(l.writes, s.writes) / period;
+      if (requests > 0)
+        device.await = (Delta(l.read_ms, s.read_ms) + Delta(l.write_ms, s.write_ms)) / requests;
+      device.queue_depth = Delta(l.queue_ms, s.queue_ms) / (1000 * period);
+      device.utilization = std::min(100.0, 100 * Delta(l.io_ms, s.io_ms) / (1000 * period));
+    }
+    device_samples_[device.name] = s;
+    devices->push_back(device);
+  }
+
+  return !devices->empty();
+}
+
+void IoMonitor::ReadProcesses(double period, std::vector<Process> *processes) {
+  for (auto &p : processes_)
+    p.second.seen = false;
+
+  DIR *dir = opendir(proc_path_.c_str());
+  if (dir != NULL) {
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+      char *end;
+      int pid = strtol(entry->d_name, &end, 10);
+      if (*end != '\0' || pid <= 0)
+        continue;
+
+      bool first = false;
+      auto it = processes_.find(pid);
+      if (it == processes_.end()) {
+        ProcessInfo info;
+        // the process may have exited already
+        if (!ReadCommand(pid, &info))
+          continue;
+        it = processes_.insert(std::make_pair(pid, info)).first;
+        first = true;
+      }
+
+      ProcessInfo &info = it->second;
+      info.seen = true;
+      if (!info.ros)
+        continue;
+
+      // /proc/<pid>/io needs the same rights as ptrace, so it can be read
+      // for the processes of the same user, or for all of them as root
+      std::uint64_t read_bytes, write_bytes;
+      if (!ReadIo(pid, &read_bytes, &write_bytes))
+        continue;
+
+      Process process;
+      process.pid = pid;
+      process.name = info.name;
+      process.read_rate = process.write_rate = 0;
+      if (!first && period > 0) {
+        process.read_rate = Delta(info.read_bytes, read_bytes) / period;
+        process.write_rate = Delta(info.write_bytes, write_bytes) / period;
+      }
+      info.read_bytes = read_bytes;
+      info.write_bytes = write_bytes;
+      processes->push_back(process);
+    }
+    closedir(dir);
+  }
+
+  // forget processes which exited
+  for (auto it = processes_.begin(); it != processes_.end();) {
+    if (it->second.seen)
+      it++;
+    else
+      it = processes_.erase(it);
+  }
+}
+
+bool IoMonitor::ReadCommand(int pid, ProcessInfo *info) {
+  std::string cmdline;
+  if (!ReadFile(proc_path_ + "/" + std::to_string(pid) + "/cmdline", &cmdline))
+    return false;
+
+  // the arguments are separated by nulls
+  std::string name, ns = "/";
+  for (size_t i = 0; i < cmdline.size(); i += strlen(cmdline.c_str() + i) + 1) {
+    std::string arg(cmdline.c_str() + i);
+    if (arg.compare(0, 8, "__name:=") == 0)
+      name = arg.substr(8);
+    else if (arg.compare(0, 6, "__ns:=") == 0)
+      ns = arg.substr(6);
+  }
+
+  info->ros = !name.empty();
+  info->seen = false;
+  info->read_bytes = info->write_bytes = 0;
+  if (!info->ros)
+    return true;
+
+  if (ns.empty() || ns[ns.size() - 1] != '/')
+    ns += "/";
+  if (ns[0] != '/')
+    ns = "/" + ns;
+  info->name = ns + name;
+  return true;
+}
+
+bool IoMonitor::ReadIo(int pid, std::uint64_t *read_bytes,
+                       std::uint64_t *write_bytes) {
+  std::string contents;
+  if (!ReadFile(proc_path_ + "/" + std::to_string(pid) + "/io", &contents))
+    return false;
+
+  // read_bytes and write_bytes count what reaches the block layer, unlike
+  // rchar and wchar, which count cached reads and writes too
+  size_t read_pos = contents.find("\nread_bytes:");
+  size_t write_pos = contents.find("\nwrite_bytes:");
+  if (read_pos == std::string::npos || write_pos == std::string::npos)
+    return false;
+  return sscanf(contents.c_str() + read_pos, " read_bytes: %" SCNu64, read_bytes) == 1 &&
+         sscanf(contents.c_str() + write_pos, " write_bytes: %" SCNu64, write_bytes) == 1;
+}
+
+}  // namespace disk_monitor
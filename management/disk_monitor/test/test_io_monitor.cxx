@@ -0,0 +1,127 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <disk_monitor/io_monitor.h>
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A fake /proc with a device and two processes, one of them a ROS node
+class IoMonitorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir[] = "/tmp/io_monitor_XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    proc_ = dir;
+    Process(100, {"/usr/bin/bash"});
+    Process(200, {"/opt/ros/lib/nodelet/nodelet", "manager", "__name:=llp_manager", "__ns:=/"});
+  }
+
+  void TearDown() override {
+    ASSERT_EQ(0, system(("rm -rf " + proc_).c_str()));
+  }
+
+  void Process(int pid, std::vector<std::string> const& args) {
+    std::string dir = proc_ + "/" + std::to_string(pid);
+    mkdir(dir.c_str(), 0755);
+    std::ofstream cmdline(dir + "/cmdline");
+    for (std::string const& arg : args)
+      cmdline << arg << '\0';
+    Io(pid, 0, 0);
+  }
+
+  void Io(int pid, int read_bytes, int write_bytes) {
+    std::ofstream(proc_ + "/" + std::to_string(pid) + "/io")
+      << "rchar: 1\nwchar: 2\nsyscr: 3\nsyscw: 4\nread_bytes: " << read_bytes
+      << "\nwrite_bytes: " << write_bytes << "\ncancelled_write_bytes: 0\n";
+  }
+
+  void Stats(int reads, int read_ms, int writes, int write_ms, int io_ms, int queue_ms) {
+    std::ofstream(proc_ + "/diskstats")
+      << "   7       0 loop0 1 0 2 0 0 0 0 0 0 0 0 0 0 0 0\n"
+      << " 179       0 mmcblk0 " << reads << " 0 " << 8 * reads << " " << read_ms << " "
+      << writes << " 0 " << 16 * writes << " " << write_ms << " 3 " << io_ms << " "
+      << queue_ms << " 0 0 0 0\n"
+      << " 179       1 mmcblk0p1 1 0 2 0 0 0 0 0 0 0 0\n";
+  }
+
+  std::string proc_;
+};
+
+}  // namespace
+
+TEST_F(IoMonitorTest, rates) {
+  disk_monitor::IoMonitor monitor(proc_);
+  monitor.SetDevices(std::vector<std::string>(1, "mmcblk0"));
+  std::vector<disk_monitor::IoMonitor::Device> devices;
+  std::vector<disk_monitor::IoMonitor::Process> processes;
+
+  // The first sample has no rates
+  Stats(100, 100, 100, 300, 1000, 2000);
+  ASSERT_TRUE(monitor.Collect(10.0, &devices, &processes));
+  ASSERT_EQ(1u, devices.size());
+  EXPECT_EQ("mmcblk0", devices[0].name);
+  EXPECT_EQ(0, devices[0].write_rate);
+  EXPECT_EQ(3u, devices[0].in_flight);
+  ASSERT_EQ(1u, processes.size());
+  EXPECT_EQ("/llp_manager", processes[0].name);
+  EXPECT_EQ(200, processes[0].pid);
+  EXPECT_EQ(0, processes[0].write_rate);
+
+  // 50 requests in two seconds, which took 1000 ms, with 6000 ms in the queue
+  Stats(120, 200, 130, 1200, 2000, 8000);
+  Io(200, 4096, 65536);
+  ASSERT_TRUE(monitor.Collect(12.0, &devices, &processes));
+  ASSERT_EQ(1u, devices.size());
+  EXPECT_DOUBLE_EQ(512.0 * 8 * 20 / 2, devices[0].read_rate);
+  EXPECT_DOUBLE_EQ(512.0 * 16 * 30 / 2, devices[0].write_rate);
+  EXPECT_DOUBLE_EQ(10, devices[0].reads);
+  EXPECT_DOUBLE_EQ(15, devices[0].writes);
+  EXPECT_DOUBLE_EQ(20, devices[0].await);
+  EXPECT_DOUBLE_EQ(3, devices[0].queue_depth);
+  EXPECT_DOUBLE_EQ(50, devices[0].utilization);
+  ASSERT_EQ(1u, processes.size());
+  EXPECT_DOUBLE_EQ(2048, processes[0].read_rate);
+  EXPECT_DOUBLE_EQ(32768, processes[0].write_rate);
+}
+
+TEST_F(IoMonitorTest, missing) {
+  // Devices which aren't there, and processes which can't be read, are left out
+  disk_monitor::IoMonitor monitor(proc_);
+  monitor.SetDevices(std::vector<std::string>(1, "sda"));
+  std::vector<disk_monitor::IoMonitor::Device> devices;
+  std::vector<disk_monitor::IoMonitor::Process> processes;
+  Stats(100, 100, 100, 300, 1000, 2000);
+  unlink((proc_ + "/200/io").c_str());
+  EXPECT_FALSE(monitor.Collect(10.0, &devices, &processes));
+  EXPECT_TRUE(devices.empty());
+  EXPECT_TRUE(processes.empty());
+
+  // No devices to sample is not an error
+  monitor.SetDevices(std::vector<std::string>());
+  EXPECT_TRUE(monitor.Collect(11.0, &devices, &processes));
+}
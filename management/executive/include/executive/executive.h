@@ -48,6 +48,7 @@
 #include <ff_util/ff_flight.h>
 #include <ff_util/ff_names.h>
 #include <ff_util/ff_nodelet.h>
+#include <ff_util/spsc_queue.h>
 
 #include <pluginlib/class_list_macros.h>
 #include <ros/ros.h>
@@ -68,6 +69,17 @@ using ff_msgs::CommandConstants;
 namespace executive {
 class OpState;
 
+// The categories commands are queued in, most urgent first, when they are
+// prioritized. Teleop commands are the ones that move the robot, and are
+// canceled by a fault or safety command that comes after them.
+enum CmdCategory {
+  FAULT_CMD,
+  SAFETY_CMD,
+  TELEOP_CMD,
+  PLAN_CMD,     // plans, and everything else
+  NUM_CMD_CATEGORIES
+};
+
 /**
  * Executive class is the mediator, responsible for
  * receiving broadcasted messages and forwarding to
@@ -85,6 +97,10 @@ class Executive : public ff_util::FreeFlyerNodelet {
 
   // callbacks, handled by states
   void CmdCallback(ff_msgs::CommandStampedPtr const& cmd);
+  // with prioritize_commands, commands are queued by the first on the
+  // multithreaded queue, and the second handles the most urgent
+  void QueueCmdCallback(ff_msgs::CommandStampedPtr const& cmd);
+  void DispatchCmd();
   void DockStateCallback(ff_msgs::DockStatePtr const& state);
   void GuestScienceAckCallback(ff_msgs::AckStampedConstPtr const& ack);
   void PlanCallback(ff_msgs::CompressedFileConstPtr const& plan);
@@ -278,6 +294,17 @@ class Executive : public ff_util::FreeFlyerNodelet {
 
   ros::Timer reload_params_timer_, wait_timer_;
 
+  // Commands waiting to be handled, by category, each with the order it
+  // came in, and the ones that did not fit, to be rejected
+  struct QueuedCmd {
+    ff_msgs::CommandStampedPtr cmd;
+    uint64_t seq;
+  };
+  bool prioritize_commands_;
+  uint64_t cmd_seq_;
+  ff_util::SpscQueue<QueuedCmd, 16> cmd_queues_[NUM_CMD_CATEGORIES];
+  ff_util::SpscQueue<ff_msgs::CommandStampedPtr, 64> cmd_overflow_;
+
   sequencer::Sequencer sequencer_;
 
   std::shared_ptr<ff_util::ConfigClient> choreographer_cfg_;
@@ -290,6 +317,9 @@ class Executive : public ff_util::FreeFlyerNodelet {
   double arm_feedback_timeout_, motion_feedback_timeout_;
   double dock_result_timeout_, perch_result_timeout_, switch_result_timeout_;
 
+  // Only parse plan commands when they are reached
+  bool plan_lazy_commands_;
+
   int pub_queue_size_;
   int sub_queue_size_;
 
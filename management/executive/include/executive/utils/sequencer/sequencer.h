@@ -43,6 +43,16 @@ enum class ItemType {
   SEGMENT
 };
 
+// one step of a plan, compiled when the plan is loaded. a station with no
+// commands is a step of type NONE, completed as soon as it is reached.
+struct TimelineItem {
+  ItemType type;
+  int milestone;      // the station or segment in the plan
+  int command;        // within the station, -1 means none
+  bool first, last;   // the first or last command of its station
+  double start, end;  // planned, in seconds from the start of the plan
+};
+
 class Sequencer {
  public:
   Sequencer();
@@ -51,6 +61,8 @@ class Sequencer {
   ItemType CurrentType(bool reset_time = true) noexcept;
   ff_msgs::CommandStamped::Ptr CurrentCommand() noexcept;
   jsonloader::Segment CurrentSegment() noexcept;
+  // the setpoints of the current segment, converted when the plan was loaded
+  std::vector<ff_msgs::ControlState> const& CurrentTrajectory() const noexcept;
 
   // give feedback about the end of the current item (command/segment)
   // this advances the current item if it is a successful ack.
@@ -67,28 +79,42 @@ class Sequencer {
   // I can haz validity?
   bool valid() const noexcept;
   jsonloader::Plan const& plan() const noexcept;
+  std::vector<TimelineItem> const& timeline() const noexcept;
 
  private:
   int AppendStatus(ff_msgs::Status const& msg) noexcept;
 
   void Reset() noexcept;
 
+  // flattens plan into the timeline, and converts its segments and, unless
+  // they are lazy, its commands. nothing is changed if that fails.
+  bool Compile(jsonloader::Plan const& plan, bool lazy_commands) noexcept;
+
+  // complete the stations with no commands at the current step, and log
+  // the start of the station if the step is its first command
+  void Enter() noexcept;
+
   friend bool LoadPlan(ff_msgs::CompressedFile::ConstPtr const& cf,
-                       Sequencer * seq);
+                       Sequencer * seq, bool lazy_commands);
 
   bool valid_;
 
   jsonloader::Plan plan_;
   ff_msgs::PlanStatusStamped status_;
 
+  // the steps of the plan, with the command of each converted, or null if
+  // it is not a command or not converted yet, and the setpoints of each
+  // segment
+  std::vector<TimelineItem> timeline_;
+  std::vector<ff_msgs::CommandStamped::Ptr> commands_;
+  std::vector<std::vector<ff_msgs::ControlState>> trajectories_;
+
   // when we started the current item
   ros::Time start_;
 
-  // milestone is a station or segment within a plan
-  int current_milestone_;
-
-  // command within a station -1 means none
-  int current_command_;
+  // the current step of the timeline, and whether it has been entered
+  std::size_t current_;
+  bool entered_;
 
   // which waypoint within a segment we are at, 0 means the first one
   int current_index_;
@@ -99,8 +125,10 @@ class Sequencer {
 };
 
 // load a plan from a compressed file.
-// returns true if everything be cool, otherwise not.
-bool LoadPlan(ff_msgs::CompressedFile::ConstPtr const& cf, Sequencer *seq);
+// returns true if everything be cool, otherwise not. with lazy_commands the
+// commands are only parsed when the sequencer gets to them.
+bool LoadPlan(ff_msgs::CompressedFile::ConstPtr const& cf, Sequencer *seq,
+              bool lazy_commands);
 
 std::vector<ff_msgs::ControlState>
 Segment2Trajectory(jsonloader::Segment const& segment);
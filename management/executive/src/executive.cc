@@ -17,6 +17,7 @@
  */
 
 #include <jsonloader/planio.h>
+#include <ros/callback_queue_interface.h>
 
 #include "executive/executive.h"
 #include "executive/op_state.h"
@@ -24,26 +25,130 @@
 
 namespace executive {
 
+namespace {
+
+// Handles the most urgent queued command on the executive's queue
+class DispatchCmdCallback : public ros::CallbackInterface {
+ public:
+  explicit DispatchCmdCallback(Executive* exec) : exec_(exec) {}
+
+  CallResult call() {
+    exec_->DispatchCmd();
+    return Success;
+  }
+
+ private:
+  Executive* exec_;
+};
+
+CmdCategory GetCmdCategory(ff_msgs::CommandStamped const& cmd) {
+  std::string const& name = cmd.cmd_name;
+  if (cmd.cmd_origin == "sys_monitor" ||
+      name == CommandConstants::CMD_NAME_FAULT)
+    return FAULT_CMD;
+  if (name == CommandConstants::CMD_NAME_STOP_ALL_MOTION ||
+      name == CommandConstants::CMD_NAME_IDLE_PROPULSION ||
+      name == CommandConstants::CMD_NAME_STOP_ARM ||
+      name == CommandConstants::CMD_NAME_PAUSE_PLAN ||
+      name == CommandConstants::CMD_NAME_SHUTDOWN)
+    return SAFETY_CMD;
+  if (name == CommandConstants::CMD_NAME_SIMPLE_MOVE6DOF ||
+      name == CommandConstants::CMD_NAME_ARM_PAN_AND_TILT ||
+      name == CommandConstants::CMD_NAME_GRIPPER_CONTROL ||
+      name == CommandConstants::CMD_NAME_STOW_ARM ||
+      name == CommandConstants::CMD_NAME_DOCK ||
+      name == CommandConstants::CMD_NAME_UNDOCK ||
+      name == CommandConstants::CMD_NAME_PERCH ||
+      name == CommandConstants::CMD_NAME_UNPERCH ||
+      name == CommandConstants::CMD_NAME_PREPARE ||
+      name == CommandConstants::CMD_NAME_AUTO_RETURN ||
+      name == CommandConstants::CMD_NAME_RUN_PLAN)
+    return TELEOP_CMD;
+  return PLAN_CMD;
+}
+
+}  // namespace
+
 Executive::Executive() :
   ff_util::FreeFlyerNodelet(NODE_EXECUTIVE, true),
   state_(OpStateRepo::Instance()->ready()),
+  prioritize_commands_(false),
+  cmd_seq_(0),
   action_active_timeout_(1),
   arm_feedback_timeout_(4),
   motion_feedback_timeout_(1),
   dock_result_timeout_(360),
   perch_result_timeout_(360),
   switch_result_timeout_(30),
+  plan_lazy_commands_(false),
   pub_queue_size_(10),
   sub_queue_size_(10) {
 }
 
 Executive::~Executive() {
+  // Drop the dispatches still queued, which point at this executive
+  if (prioritize_commands_) {
+    cmd_sub_.shutdown();
+    nh_.getCallbackQueue()->removeByID(reinterpret_cast<uint64_t>(this));
+  }
 }
 
 void Executive::CmdCallback(ff_msgs::CommandStampedPtr const& cmd) {
   SetOpState(state_->HandleCmd(cmd));
 }
 
+void Executive::QueueCmdCallback(ff_msgs::CommandStampedPtr const& cmd) {
+  QueuedCmd queued;
+  queued.cmd = cmd;
+  queued.seq = cmd_seq_++;
+  if (!cmd_queues_[GetCmdCategory(*cmd)].Push(queued) &&
+      !cmd_overflow_.Push(cmd)) {
+    ROS_ERROR("Executive: Dropped command %s, the queues are full.",
+              cmd->cmd_name.c_str());
+    return;
+  }
+
+  // One dispatch per command, so that each is handled in its own callback
+  nh_.getCallbackQueue()->addCallback(
+      ros::CallbackInterfacePtr(new DispatchCmdCallback(this)),
+      reinterpret_cast<uint64_t>(this));
+}
+
+void Executive::DispatchCmd() {
+  ff_msgs::CommandStampedPtr* rejected;
+  while ((rejected = cmd_overflow_.Front()) != NULL) {
+    PublishCmdAck((*rejected)->cmd_id,
+                  (*rejected)->cmd_origin,
+                  ff_msgs::AckCompletedStatus::EXEC_FAILED,
+                  "Executive command queue is full.");
+    cmd_overflow_.Pop();
+  }
+
+  for (int i = 0; i < NUM_CMD_CATEGORIES; i++) {
+    QueuedCmd* queued = cmd_queues_[i].Front();
+    if (queued == NULL)
+      continue;
+
+    QueuedCmd next = *queued;
+    cmd_queues_[i].Pop();
+
+    // Teleop commands sent before a fault or stop would only undo it
+    if (i == FAULT_CMD || i == SAFETY_CMD) {
+      while ((queued = cmd_queues_[TELEOP_CMD].Front()) != NULL &&
+             queued->seq < next.seq) {
+        PublishCmdAck(queued->cmd->cmd_id,
+                      queued->cmd->cmd_origin,
+                      ff_msgs::AckCompletedStatus::CANCELED,
+                      "Preempted by " + next.cmd->cmd_name + ".");
+        cmd_queues_[TELEOP_CMD].Pop();
+      }
+    }
+
+    CmdCallback(next.cmd);
+    return;
+  }
+}
+
 
 // TODO(Katie) Add more here. Stop using feedback and result to set mobility
 // state. Instead use Dock state, Choreographer state, and Perch state
@@ -207,18 +312,14 @@ bool Executive::FillDockGoal(ff_msgs::CommandStampedPtr const& cmd,
 
 bool Executive::FillMotionGoal(Action action,
                                ff_msgs::CommandStampedPtr const& cmd) {
-  jsonloader::Segment segment;
   // Flight mode needs to be set for all motion actions
   motion_goal_.flight_mode = agent_state_.flight_mode;
 
   switch (action) {
     case EXECUTE:
-      segment = sequencer_.CurrentSegment();
-
       motion_goal_.command = ff_msgs::MotionGoal::EXEC;
-      // Convert JSON to a segment type
-      motion_goal_.segment =
-                    sequencer::Segment2Trajectory(sequencer_.CurrentSegment());
+      // The segment was converted when the plan was loaded
+      motion_goal_.segment = sequencer_.CurrentTrajectory();
 
       motion_goal_.states.clear();
 
@@ -564,7 +665,7 @@ void Executive::SetMobilityState(uint8_t state, uint32_t sub_state) {
 
 bool Executive::SetPlan() {
   if (plan_) {
-    if (sequencer::LoadPlan(plan_, &sequencer_)) {
+    if (sequencer::LoadPlan(plan_, &sequencer_, plan_lazy_commands_)) {
       // Set plan execution state to paused, apparently this was the way
       // spheres worked
       SetPlanExecState(ff_msgs::ExecState::PAUSED);
@@ -1898,6 +1999,12 @@ void Executive::Initialize(ros::NodeHandle *nh) {
   config_params_.AddFile("management/executive.config");
   ReadParams();
 
+  // Only read at startup, since the command subscriber is set up once
+  if (!config_params_.GetBool("prioritize_commands", &prioritize_commands_)) {
+    ROS_ERROR("Executive: Prioritize commands not specified.");
+    prioritize_commands_ = false;
+  }
+
   // Set up a timer to check and reload timeouts if they are changed.
   reload_params_timer_ = nh_.createTimer(ros::Duration(1),
       [this](ros::TimerEvent e) {
@@ -1948,8 +2055,15 @@ void Executive::Initialize(ros::NodeHandle *nh) {
   motion_ac_.Create(nh, ACTION_MOBILITY_MOTION);
 
   // initialize subs
-  cmd_sub_ = nh_.subscribe(TOPIC_COMMAND, sub_queue_size_,
-                           &Executive::CmdCallback, this);
+  if (prioritize_commands_) {
+    cmd_sub_ = GetPlatformHandle(true)->subscribe(TOPIC_COMMAND,
+                                                  sub_queue_size_,
+                                                  &Executive::QueueCmdCallback,
+                                                  this);
+  } else {
+    cmd_sub_ = nh_.subscribe(TOPIC_COMMAND, sub_queue_size_,
+                             &Executive::CmdCallback, this);
+  }
 
   dock_state_sub_ = nh_.subscribe(TOPIC_BEHAVIORS_DOCKING_STATE,
                                   sub_queue_size_,
@@ -2106,6 +2220,11 @@ void Executive::ReadParams() {
                                                     &switch_result_timeout_)) {
     ROS_ERROR("Executive: Switch result timeout not specified.");
   }
+
+  if (!config_params_.GetBool("plan_lazy_commands", &plan_lazy_commands_)) {
+    ROS_ERROR("Executive: Plan lazy commands not specified.");
+    plan_lazy_commands_ = false;
+  }
 }
 
 void Executive::PublishAgentState() {
@@ -560,7 +560,12 @@ OpState* OpStatePlanExec::StartNextPlanItem() {
       first_segment_ = false;
     }
   } else if (it == sequencer::ItemType::COMMAND) {
-    return HandleCmd(exec_->GetPlanCommand());
+    ff_msgs::CommandStampedPtr cmd = exec_->GetPlanCommand();
+    if (!cmd) {
+      return HandleCommandComplete(false, "Plan command is invalid.",
+                                   ff_msgs::AckCompletedStatus::BAD_SYNTAX);
+    }
+    return HandleCmd(cmd);
   } else {
     // Plan is empty so it must have completed successfully
     // This covers the crazy case of a paused plan where the wait command was
@@ -24,6 +24,7 @@
 
 #include <msg_conversions/msg_conversions.h>
 
+#include <jsonloader/command_repo.h>
 #include <jsonloader/planio.h>
 
 #include <ff_msgs/CommandConstants.h>
@@ -80,9 +81,51 @@ inline ff_msgs::Status MakeStatus(std::uint8_t status, int point, int command, i
   return s;
 }
 
+double TimeOf(jsonloader::Waypoint const& w) {
+  return w.ctime().sec() + w.ctime().nsec() * 1e-9;
+}
+
+// how long a command is planned to take, only waits are known
+double DurationOf(jsonloader::Command const* plan_cmd) {
+  jsonloader::StationKeepCommand const* sk_cmd =
+      dynamic_cast<jsonloader::StationKeepCommand const*>(plan_cmd);
+  return (sk_cmd == nullptr ? 0.0 : sk_cmd->duration());
+}
+
+// converts a plan command, null if it is invalid
+ff_msgs::CommandStamped::Ptr GenCommand(jsonloader::Command const* plan_cmd) {
+  ff_msgs::CommandStamped::Ptr cmd;
+  if (plan_cmd == nullptr) {
+    ROS_ERROR("plan command is invalid");
+    return cmd;
+  }
+
+  auto it = internal::kCmdGenMap.find(plan_cmd->type());
+  if (it == internal::kCmdGenMap.end()) {
+    ROS_ERROR("do not know how to generate command %s",
+              plan_cmd->type().data());
+    return cmd;
+  }
+
+  cmd.reset(new ff_msgs::CommandStamped());
+  cmd->cmd_src = "plan";
+  cmd->cmd_origin = "plan";
+  if (!it->second.fn(plan_cmd, cmd.get())) {
+    ROS_ERROR("error convertiong command %s",
+              plan_cmd->type().data());
+    cmd.reset();
+    return cmd;
+  }
+
+  cmd->subsys_name = it->second.subsystem;
+  cmd->cmd_name = it->second.name;
+  return cmd;
+}
+
 }  // namespace
 
-bool LoadPlan(ff_msgs::CompressedFile::ConstPtr const& cf, Sequencer *seq) {
+bool LoadPlan(ff_msgs::CompressedFile::ConstPtr const& cf, Sequencer *seq,
+              bool lazy_commands) {
   std::string out;
 
   // sanity check
@@ -96,13 +139,17 @@ bool LoadPlan(ff_msgs::CompressedFile::ConstPtr const& cf, Sequencer *seq) {
     return false;  // default is empty & non-valid
   }
 
-  jsonloader::Plan plan(jsonloader::LoadPlan(out));
+  jsonloader::Plan plan(jsonloader::LoadPlan(out, lazy_commands));
   if (!plan.valid()) {
     return false;
   }
 
   // TODO(tfmorse): double check that the waypint type is valid
 
+  if (!seq->Compile(plan, lazy_commands)) {
+    return false;
+  }
+
   seq->Reset();
   seq->plan_ = std::move(plan);
   seq->status_.name = seq->plan_.name();
@@ -122,176 +169,203 @@ Segment2Trajectory(jsonloader::Segment const& seg) {
 }
 
 Sequencer::Sequencer()
-  : valid_(false), start_(0, 0),
-    current_milestone_(0), current_command_(-1),
-    current_index_(0), station_idx_(0) {
+  : valid_(false), start_(0, 0), current_(0), entered_(false),
+    current_index_(0), station_idx_(0), station_duration_(0) {
 }
 
 void Sequencer::Reset() noexcept {
   valid_ = false;
   start_ = { 0, 0 };
-  current_milestone_ = 0;
-  current_command_ = -1;
+  current_ = 0;
+  entered_ = false;
   current_index_ = 0;
   station_idx_ = 0;
+  station_duration_ = 0;
+}
+
+bool Sequencer::Compile(jsonloader::Plan const& plan,
+                        bool lazy_commands) noexcept {
+  std::vector<TimelineItem> timeline;
+  std::vector<ff_msgs::CommandStamped::Ptr> commands;
+  std::vector<std::vector<ff_msgs::ControlState>> trajectories;
+  trajectories.reserve(plan.segments().size());
+
+  double t = 0;
+  for (std::size_t m = 0; m < plan.NumMilestones(); m++) {
+    if (m % 2 == 1) {  // Segment
+      jsonloader::Segment const& seg = plan.segments()[m / 2];
+      TimelineItem item = { ItemType::SEGMENT, static_cast<int>(m), -1,
+                            false, false, t, t };
+      if (!seg.waypoints().empty())
+        item.end += TimeOf(seg.waypoints().back()) -
+                    TimeOf(seg.waypoints().front());
+      t = item.end;
+      timeline.push_back(item);
+      commands.emplace_back();
+      trajectories.push_back(Segment2Trajectory(seg));
+      continue;
+    }
+
+    jsonloader::Station const& s = plan.stations()[m / 2];
+    std::size_t n = s.NumCommands();
+    if (n == 0) {
+      TimelineItem item = { ItemType::NONE, static_cast<int>(m), -1,
+                            false, false, t, t };
+      timeline.push_back(item);
+      commands.emplace_back();
+      continue;
+    }
+
+    for (std::size_t c = 0; c < n; c++) {
+      TimelineItem item = { ItemType::COMMAND, static_cast<int>(m),
+                            static_cast<int>(c), c == 0, c + 1 == n, t, t };
+      ff_msgs::CommandStamped::Ptr cmd;
+      if (!lazy_commands) {
+        jsonloader::Command const* plan_cmd = s.GetCommand(c);
+        cmd = GenCommand(plan_cmd);
+        if (!cmd) {
+          ROS_ERROR("command %zu of station %zu is invalid", c, m);
+          return false;
+        }
+        item.end += DurationOf(plan_cmd);
+      }
+      t = item.end;
+      timeline.push_back(item);
+      commands.push_back(cmd);
+    }
+  }
+
+  timeline_.swap(timeline);
+  commands_.swap(commands);
+  trajectories_.swap(trajectories);
+  return true;
+}
+
+void Sequencer::Enter() noexcept {
+  entered_ = true;
+
+  // update plan status for the skipped stations, CUZ WE ON FIAH
+  while (current_ < timeline_.size() &&
+         timeline_[current_].type == ItemType::NONE) {
+    AppendStatus(MakeStatus(ff_msgs::AckCompletedStatus::OK,
+                            timeline_[current_].milestone, -1, 0));
+    current_++;
+  }
+
+  // log a temporary entry for the current station, keep track of the index
+  if (current_ < timeline_.size() && timeline_[current_].first) {
+    station_idx_ =
+        AppendStatus(  // feel like lisp yet?
+            MakeStatus(ff_msgs::AckCompletedStatus::NOT,
+                       timeline_[current_].milestone, -1, 0));
+    station_duration_ = 0;
+  }
 }
 
 jsonloader::Plan const& Sequencer::plan() const noexcept {
   return plan_;
 }
 
+std::vector<TimelineItem> const& Sequencer::timeline() const noexcept {
+  return timeline_;
+}
+
 ItemType Sequencer::CurrentType(bool reset_time) noexcept {
   if (!valid_)
     return ItemType::NONE;
 
-  // whyyyy? I returned false, bro!
-  if (current_milestone_ < 0 ||
-      static_cast<std::size_t>(current_milestone_) >= plan_.NumMilestones())
-    return ItemType::NONE;
-
-  // CUZ WE'RE SPECIAL SNOWFLAKES, YO.
-  // but srsly, we have to skip over the first station if there are no commands
-  // in it and append a fake "completed" status for the ground. since this is
-  // the first entry into this class, here is where we do it.
-  if (current_milestone_ == 0) {
-    jsonloader::Milestone const& m = plan_.GetMilestone(current_milestone_);
-    jsonloader::Station const& s = dynamic_cast<jsonloader::Station const&>(m);
-    if (s.commands().size() == 0) {
-      AppendStatus(MakeStatus(ff_msgs::AckCompletedStatus::OK, 0, -1, 0));
-      current_milestone_++;
-    } else {
-      station_idx_ =
-        AppendStatus(MakeStatus(ff_msgs::AckCompletedStatus::NOT, 0, -1, 0));
-      if (current_command_ <= 0)
-        current_command_ = 0;
-    }
-  }
+  // the first station is skipped here if there are no commands in it, since
+  // this is the first entry into this class.
+  if (!entered_)
+    Enter();
 
   // a one-station plan with no commands in the station. (╯°□°）╯︵ ┻━┻
-  if (static_cast<std::size_t>(current_milestone_) >= plan_.NumMilestones())
+  if (current_ >= timeline_.size())
     return ItemType::NONE;
 
   // http://imgur.com/vGyMAnB
   if (reset_time)
     start_ = ros::Time::now();
 
-  if (plan_.GetMilestone(current_milestone_).IsSegment())
-    return ItemType::SEGMENT;
-
   // IN FEEDBACK WE TRUST (and tequila)
-  return ItemType::COMMAND;
+  return timeline_[current_].type;
 }
 
 jsonloader::Segment Sequencer::CurrentSegment() noexcept {
-  jsonloader::Milestone const& m = plan_.GetMilestone(current_milestone_);
-  if (!m.IsSegment()) {
+  if (current_ >= timeline_.size() ||
+      timeline_[current_].type != ItemType::SEGMENT) {
     ROS_WARN("requesting a segment, but current milestone is not a segment.");
     return jsonloader::Segment();
   }
 
   // TODO(tfmorse) bump waypoints for feedback waypoint index, maybe?
 
-  return dynamic_cast<jsonloader::Segment const&>(m);
+  return plan_.segments()[timeline_[current_].milestone / 2];
 }
 
-ff_msgs::CommandStamped::Ptr Sequencer::CurrentCommand() noexcept {
-  ff_msgs::CommandStamped::Ptr cmd(new ff_msgs::CommandStamped());
-  cmd->subsys_name = "INVALID";
-  cmd->cmd_name = "INVALID";
-  cmd->cmd_src = "plan";
-  cmd->cmd_origin = "plan";
-  cmd->args.clear();
-
-  jsonloader::Milestone const& m = plan_.GetMilestone(current_milestone_);
-  if (!m.IsStation()) {
-    ROS_WARN("requesting a command, but current milestone is not a station.");
-    cmd.reset();
-    return cmd;
+std::vector<ff_msgs::ControlState> const&
+Sequencer::CurrentTrajectory() const noexcept {
+  static const std::vector<ff_msgs::ControlState> empty;
+  if (current_ >= timeline_.size() ||
+      timeline_[current_].type != ItemType::SEGMENT) {
+    ROS_WARN("requesting a segment, but current milestone is not a segment.");
+    return empty;
   }
 
-  jsonloader::Station const& s = dynamic_cast<jsonloader::Station const&>(m);
-  jsonloader::Command * plan_cmd = s.commands()[current_command_].get();
+  return trajectories_[timeline_[current_].milestone / 2];
+}
 
-  auto it = internal::kCmdGenMap.find(plan_cmd->type());
-  if (it == internal::kCmdGenMap.end()) {
-    ROS_ERROR("do not know how to generate command %s",
-              plan_cmd->type().data());
-    cmd.reset();
+ff_msgs::CommandStamped::Ptr Sequencer::CurrentCommand() noexcept {
+  ff_msgs::CommandStamped::Ptr cmd;
+  if (current_ >= timeline_.size() ||
+      timeline_[current_].type != ItemType::COMMAND) {
+    ROS_WARN("requesting a command, but current milestone is not a station.");
     return cmd;
   }
 
-  if (!it->second.fn(plan_cmd, cmd.get())) {
-    ROS_ERROR("error convertiong command %s",
-              plan_cmd->type().data());
-    cmd.reset();
-    return cmd;
+  // lazy commands are only parsed and converted when they are reached
+  TimelineItem const& item = timeline_[current_];
+  if (!commands_[current_]) {
+    jsonloader::Station const& s = plan_.stations()[item.milestone / 2];
+    commands_[current_] = GenCommand(s.GetCommand(item.command));
+    if (!commands_[current_])
+      return cmd;
   }
 
   // success. 성공. erfolg. успех
-  cmd->subsys_name = it->second.subsystem;
-  cmd->cmd_name = it->second.name;
+  cmd.reset(new ff_msgs::CommandStamped(*commands_[current_]));
   return cmd;
 }
 
 bool Sequencer::Feedback(ff_msgs::AckCompletedStatus const& ack) noexcept {
+  if (!entered_)
+    Enter();
+  if (current_ >= timeline_.size())
+    return false;
+
   // WE DUN!
   ros::Time end = ros::Time::now();
   ros::Duration d = end - start_;
 
   // update the current thing's status
-  AppendStatus(MakeStatus(ack.status, current_milestone_, current_command_, d.sec));
-
-  // skip ahead
-  jsonloader::Milestone const& m = plan_.GetMilestone(current_milestone_);
-  if (m.IsSegment()) {
-    current_milestone_++;
-    current_command_ = -1;
-    current_index_ = 0;
-  } else {
-    jsonloader::Station const& s = dynamic_cast<jsonloader::Station const&>(m);
-    current_command_++;
-    station_duration_ += d.sec;
+  TimelineItem const& item = timeline_[current_];
+  AppendStatus(MakeStatus(ack.status, item.milestone, item.command, d.sec));
 
-    if (static_cast<std::size_t>(current_command_) < s.commands().size())
-      return true;
+  if (item.type == ItemType::COMMAND) {
+    station_duration_ += d.sec;
 
     // update station status, since all the commands are done
-    status_.history[station_idx_].duration = station_duration_;
-    status_.history[station_idx_].status.status = ack.status;
-
-    current_command_ = -1;
-    current_milestone_++;
-    station_idx_ = 0;
-  }
-
-  if (static_cast<std::size_t>(current_milestone_) >= plan_.NumMilestones())
-    return false;
-
-  // check for an empty station to skip
-  jsonloader::Milestone const& nm = plan_.GetMilestone(current_milestone_);
-  if (nm.IsSegment()) {
-    return true;
-  }
-
-  jsonloader::Station const& s = dynamic_cast<jsonloader::Station const&>(nm);
-  if (s.commands().size() > 0) {
-    current_command_ = 0;
-
-    // log a temporary entry for the current station, keep track of the index
-    station_idx_ =
-        AppendStatus(  // feel like lisp yet?
-            MakeStatus(ff_msgs::AckCompletedStatus::NOT,
-                       current_milestone_, -1, 0));
-    station_duration_ = 0;
-    return true;
+    if (item.last && station_idx_ >= 0) {
+      status_.history[station_idx_].duration = station_duration_;
+      status_.history[station_idx_].status.status = ack.status;
+    }
   }
 
-  // update plan status for the skipped station, CUZ WE ON FIAH
-  AppendStatus(MakeStatus(ff_msgs::AckCompletedStatus::OK,
-                          current_milestone_, -1, 0));
-
-  current_milestone_++;
-  return static_cast<std::size_t>(current_milestone_) < plan_.NumMilestones();
+  // skip ahead, over any empty station
+  current_++;
+  current_index_ = 0;
+  Enter();
+  return current_ < timeline_.size();
 }
 
 void Sequencer::Feedback(ff_msgs::ControlFeedback const& progress) noexcept {
@@ -300,8 +374,11 @@ void Sequencer::Feedback(ff_msgs::ControlFeedback const& progress) noexcept {
 
 int Sequencer::AppendStatus(ff_msgs::Status const& msg) noexcept {
   status_.history.push_back(msg);
-  if (status_.history.size() > kMaxHistory)
+  if (status_.history.size() > kMaxHistory) {
     status_.history.erase(status_.history.begin());
+    // the station entry moves down with the rest, or is gone
+    station_idx_ = (station_idx_ > 0 ? station_idx_ - 1 : -1);
+  }
   // return index to pushed item
   return status_.history.size() - 1;
 }
@@ -311,12 +388,14 @@ bool Sequencer::valid() const noexcept {
 }
 
 ff_msgs::PlanStatusStamped const& Sequencer::plan_status() noexcept {
-  status_.point = current_milestone_;
-  status_.command = current_command_;
-  if (static_cast<std::size_t>(current_milestone_) >= plan_.NumMilestones()) {
-    status_.status.status = ff_msgs::AckStatus::COMPLETED;
-  } else {
+  if (current_ < timeline_.size()) {
+    status_.point = timeline_[current_].milestone;
+    status_.command = (entered_ ? timeline_[current_].command : -1);
     status_.status.status = ff_msgs::AckStatus::EXECUTING;
+  } else {
+    status_.point = plan_.NumMilestones();
+    status_.command = -1;
+    status_.status.status = ff_msgs::AckStatus::COMPLETED;
   }
   return status_;
 }
@@ -9,12 +9,24 @@
 #include <ros/publisher.h>
 #include <ros/subscriber.h>
 
+#include <config_reader/config_reader.h>
 #include <ff_util/ff_nodelet.h>
 #include <ff_msgs/ConfigureCamera.h>
 #include <ff_msgs/EnableCamera.h>
 #include <ff_msgs/CameraState.h>
+#include <opencv2/core/core.hpp>
+#include <sensor_msgs/Image.h>
 
+#ifdef IMAGE_SAMPLER_VIDEO
+#include <image_sampler/video_encoder.h>
+#endif
+
+#include <condition_variable>  // NOLINT
+#include <memory>
+#include <mutex>  // NOLINT
 #include <string>
+#include <thread>  // NOLINT
+#include <vector>
 
 #define NUM_CAMERAS 2
 #define NAV_CAM_ID  0
@@ -41,6 +53,14 @@ class ImageSampler : public ff_util::FreeFlyerNodelet {
   void ImageCallback(const sensor_msgs::ImageConstPtr & msg, int camera);
   void UpdateState(int camera, bool streaming, int width, int height, float rate);
 
+  // Scales the image into out, reusing its buffer if no one else holds it,
+  // from the smallest level of the image's pyramid at least as large
+  void Scale(int camera, const sensor_msgs::ImageConstPtr & msg, int width, int height,
+             sensor_msgs::ImagePtr* out);
+  void PublishStream(int camera, const sensor_msgs::ImageConstPtr & img);
+  void EncodeThread();
+  void EncodeVideo(int camera, const sensor_msgs::ImageConstPtr & img, const cv::Mat & image);
+
  private:
   image_transport::Subscriber image_sub_[NUM_CAMERAS];
   image_transport::CameraPublisher record_image_pub_[NUM_CAMERAS];
@@ -58,6 +78,30 @@ class ImageSampler : public ff_util::FreeFlyerNodelet {
   ros::Time stream_last_publish_time_[NUM_CAMERAS];
 
   ff_msgs::CameraState camera_states_[2 * NUM_CAMERAS];
+
+  // Levels of the pyramid of the current frame after its own, each half the
+  // size of the one before, built as needed and kept for the next frame
+  std::vector<cv::Mat> pyramid_[NUM_CAMERAS];
+  unsigned int pyramid_built_[NUM_CAMERAS];
+  sensor_msgs::ImagePtr record_image_[NUM_CAMERAS], stream_image_[NUM_CAMERAS];
+
+  // The stream encoded as JPEG or video on a thread, the latest image of
+  // each camera waiting for it
+  config_reader::ConfigReader config_;
+  bool jpeg_encode_, video_encode_;
+  int jpeg_quality_;
+  ros::Publisher stream_raw_pub_[NUM_CAMERAS], stream_info_pub_[NUM_CAMERAS];
+  ros::Publisher stream_jpeg_pub_[NUM_CAMERAS], stream_video_pub_[NUM_CAMERAS];
+#ifdef IMAGE_SAMPLER_VIDEO
+  std::unique_ptr<VideoEncoder> video_encoder_[NUM_CAMERAS];
+  // the subscribers to the last video frame, a key frame is sent for new ones
+  int video_subscribers_[NUM_CAMERAS];
+#endif
+  std::thread encode_thread_;
+  std::mutex encode_mutex_;
+  std::condition_variable encode_cv_;
+  sensor_msgs::ImageConstPtr encode_image_[NUM_CAMERAS];
+  bool encode_stop_;
 };
 
 }  // namespace image_sampler
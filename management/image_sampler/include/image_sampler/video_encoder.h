@@ -0,0 +1,75 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef IMAGE_SAMPLER_VIDEO_ENCODER_H_
+#define IMAGE_SAMPLER_VIDEO_ENCODER_H_
+
+#include <opencv2/core/core.hpp>
+#include <ros/time.h>
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+struct AVCodecContext;
+struct AVFrame;
+struct SwsContext;
+
+namespace image_sampler {
+
+/**
+ * @brief Encodes the images of one stream as H.264 or H.265 with libav.
+ * @details The named encoder is tried first, so that a hardware encoder may
+ * be picked in the config, then the software one for the codec, tuned for
+ * latency. There are no B frames, so each image gives at most one packet, in
+ * Annex B with the parameter sets repeated before each key frame, so that a
+ * decoder may start from any key frame. The encoder is opened again when the
+ * size of the images changes.
+ */
+class VideoEncoder {
+ public:
+  VideoEncoder(std::string const& codec, std::string const& encoder, int bit_rate, int gop_size);
+  ~VideoEncoder(void);
+
+  /**
+   * Encodes a mono8 or bgr8 image, as a key frame if key is set, into
+   * packet. Returns false on error, and true with packet empty when the
+   * encoder has no output for this image.
+   **/
+  bool Encode(cv::Mat const& image, ros::Time const& stamp, bool key, std::vector<uint8_t>* packet);
+
+  // the format of the packets, for sensor_msgs::CompressedImage
+  std::string const& Format(void) const {return codec_;}
+
+ private:
+  bool Open(int width, int height);
+  bool OpenCodec(char const* encoder, int width, int height);
+  void Close(void);
+
+  std::string codec_, encoder_;
+  int bit_rate_, gop_size_;
+  AVCodecContext* context_;
+  AVFrame* frame_;
+  SwsContext* sws_context_;
+  int64_t last_pts_;
+};
+
+}  // namespace image_sampler
+
+#endif  // IMAGE_SAMPLER_VIDEO_ENCODER_H_
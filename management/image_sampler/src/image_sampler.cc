@@ -23,18 +23,73 @@
 #include <cv_bridge/cv_bridge.h>
 #include <gflags/gflags.h>
 #include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
 #include <ff_msgs/CameraStatesStamped.h>
+#include <sensor_msgs/CompressedImage.h>
+#include <sensor_msgs/image_encodings.h>
+
+#include <string>
+#include <vector>
 
 namespace image_sampler {
 
 ImageSampler::ImageSampler() :
-    ff_util::FreeFlyerNodelet(NODE_IMG_SAMPLER) {
+    ff_util::FreeFlyerNodelet(NODE_IMG_SAMPLER), jpeg_encode_(false), video_encode_(false), jpeg_quality_(80),
+    encode_stop_(false) {
+  for (int i = 0; i < NUM_CAMERAS; i++) {
+    pyramid_built_[i] = 0;
+#ifdef IMAGE_SAMPLER_VIDEO
+    video_subscribers_[i] = 0;
+#endif
+  }
 }
 
 ImageSampler::~ImageSampler() {
+  if (encode_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(encode_mutex_);
+      encode_stop_ = true;
+    }
+    encode_cv_.notify_one();
+    encode_thread_.join();
+  }
 }
 
 void ImageSampler::Initialize(ros::NodeHandle *nh) {
+  config_.AddFile("management/image_sampler.config");
+  if (!config_.ReadFiles()) {
+    AssertFault("INITIALIZATION_FAILED", "Unable to read the image sampler config.");
+    return;
+  }
+  if (!config_.GetBool("jpeg_encode", &jpeg_encode_) || !config_.GetInt("jpeg_quality", &jpeg_quality_, 1, 100)) {
+    AssertFault("INITIALIZATION_FAILED", "Unspecified JPEG encoding parameters.");
+    return;
+  }
+  std::string video_codec, video_encoder;
+  int video_bitrate, video_gop;
+  if (!config_.GetBool("video_encode", &video_encode_) || !config_.GetStr("video_codec", &video_codec) ||
+      !config_.GetStr("video_encoder", &video_encoder) || !config_.GetInt("video_bitrate", &video_bitrate) ||
+      !config_.GetInt("video_gop", &video_gop, 1, 1000)) {
+    AssertFault("INITIALIZATION_FAILED", "Unspecified video encoding parameters.");
+    return;
+  }
+  if (video_encode_ && video_codec != "h264" && video_codec != "hevc") {
+    AssertFault("INITIALIZATION_FAILED", "The video codec must be h264 or hevc.");
+    return;
+  }
+#ifdef IMAGE_SAMPLER_VIDEO
+  if (video_encode_) {
+    for (int i = 0; i < NUM_CAMERAS; i++)
+      video_encoder_[i].reset(new VideoEncoder(video_codec, video_encoder, video_bitrate, video_gop));
+  }
+#else
+  if (video_encode_) {
+    AssertFault("INITIALIZATION_FAILED", "The image sampler was built without libav to encode video.");
+    return;
+  }
+#endif
+
   camera_states_[NAV_CAM_ID].camera_name =  "nav_cam";
   camera_states_[DOCK_CAM_ID].camera_name = "dock_cam";
 
@@ -65,9 +120,27 @@ void ImageSampler::Initialize(ros::NodeHandle *nh) {
 
   image_transport::ImageTransport img_transp(*nh);
   record_image_pub_[NAV_CAM_ID]  = img_transp.advertiseCamera(TOPIC_MANAGEMENT_IMG_SAMPLER_NAV_CAM_RECORD,  1);
-  stream_image_pub_[NAV_CAM_ID]  = img_transp.advertiseCamera(TOPIC_MANAGEMENT_IMG_SAMPLER_NAV_CAM_STREAM,  1);
   record_image_pub_[DOCK_CAM_ID] = img_transp.advertiseCamera(TOPIC_MANAGEMENT_IMG_SAMPLER_DOCK_CAM_RECORD, 1);
-  stream_image_pub_[DOCK_CAM_ID] = img_transp.advertiseCamera(TOPIC_MANAGEMENT_IMG_SAMPLER_DOCK_CAM_STREAM, 1);
+  const char* stream_topics[NUM_CAMERAS];
+  stream_topics[NAV_CAM_ID] = TOPIC_MANAGEMENT_IMG_SAMPLER_NAV_CAM_STREAM;
+  stream_topics[DOCK_CAM_ID] = TOPIC_MANAGEMENT_IMG_SAMPLER_DOCK_CAM_STREAM;
+  for (int i = 0; i < NUM_CAMERAS; i++) {
+    if (!jpeg_encode_ && !video_encode_) {
+      stream_image_pub_[i] = img_transp.advertiseCamera(stream_topics[i], 1);
+      continue;
+    }
+    // The same topics the image transport would advertise, raw and compressed,
+    // and the video next to them
+    std::string topic = nh->resolveName(stream_topics[i]);
+    stream_raw_pub_[i] = nh->advertise<sensor_msgs::Image>(topic, 1);
+    stream_info_pub_[i] = nh->advertise<sensor_msgs::CameraInfo>(image_transport::getCameraInfoTopic(topic), 1);
+    if (jpeg_encode_)
+      stream_jpeg_pub_[i] = nh->advertise<sensor_msgs::CompressedImage>(topic + "/compressed", 1);
+    if (video_encode_)
+      stream_video_pub_[i] = nh->advertise<sensor_msgs::CompressedImage>(topic + "/video", 1);
+  }
+  if (jpeg_encode_ || video_encode_)
+    encode_thread_ = std::thread(&ImageSampler::EncodeThread, this);
 
   configure_srv_[NAV_CAM_ID]  = nh->advertiseService(SERVICE_MANAGEMENT_IMG_SAMPLER_CONFIG_NAV,
                                                      &ImageSampler::ConfigureServiceNavCam,  this);
@@ -186,34 +259,143 @@ void ImageSampler::DockCamCallback(const sensor_msgs::ImageConstPtr & msg) {
 
 void ImageSampler::ImageCallback(const sensor_msgs::ImageConstPtr & msg, int camera) {
   assert(camera >= 0 && camera < NUM_CAMERAS);
+  // both outputs are scaled from the same pyramid, built as far as they need
+  pyramid_built_[camera] = 0;
+  sensor_msgs::ImagePtr record;
   if (camera_states_[camera].recording &&
       msg->header.stamp - record_last_publish_time_[camera] >= record_publication_interval_[camera]) {
     record_last_publish_time_[camera] = msg->header.stamp;
-    cv::Mat image_curr = cv_bridge::toCvShare(msg, msg->encoding)->image;
+    Scale(camera, msg, record_output_width_[camera], record_output_height_[camera], &record_image_[camera]);
+    record = record_image_[camera];
 
-    cv::Mat rescaled_image;
-    cv::resize(image_curr, rescaled_image, cv::Size(record_output_width_[camera], record_output_height_[camera]));
-
-    sensor_msgs::Image::Ptr out_img = cv_bridge::CvImage(msg->header, msg->encoding, rescaled_image).toImageMsg();
-    sensor_msgs::CameraInfo cinfo;
-    cinfo.header = msg->header;
-    record_image_pub_[camera].publish(*out_img, cinfo);
+    sensor_msgs::CameraInfoPtr cinfo = boost::make_shared<sensor_msgs::CameraInfo>();
+    cinfo->header = msg->header;
+    record_image_pub_[camera].publish(record, cinfo);
   }
   if (camera_states_[camera].streaming &&
       msg->header.stamp - stream_last_publish_time_[camera] >= stream_publication_interval_[camera]) {
     stream_last_publish_time_[camera] = msg->header.stamp;
-    cv::Mat image_curr = cv_bridge::toCvShare(msg, msg->encoding)->image;
+    if (record && record->width == static_cast<unsigned int>(stream_output_width_[camera]) &&
+        record->height == static_cast<unsigned int>(stream_output_height_[camera])) {
+      PublishStream(camera, record);
+    } else {
+      Scale(camera, msg, stream_output_width_[camera], stream_output_height_[camera], &stream_image_[camera]);
+      PublishStream(camera, stream_image_[camera]);
+    }
+  }
+}
+
+void ImageSampler::Scale(int camera, const sensor_msgs::ImageConstPtr & msg, int width, int height,
+                         sensor_msgs::ImagePtr* out) {
+  cv::Mat src = cv_bridge::toCvShare(msg, msg->encoding)->image;
+
+  // halve by area while the next level is still at least as large
+  std::vector<cv::Mat> & pyramid = pyramid_[camera];
+  for (unsigned int level = 0; src.cols / 2 >= width && src.rows / 2 >= height; level++) {
+    if (level >= pyramid_built_[camera]) {
+      if (pyramid.size() <= level)
+        pyramid.resize(level + 1);
+      cv::resize(src, pyramid[level], cv::Size(src.cols / 2, src.rows / 2), 0, 0, cv::INTER_AREA);
+      pyramid_built_[camera] = level + 1;
+    }
+    src = pyramid[level];
+  }
+
+  // the last message is written again unless it is still queued or held
+  if (!*out || !out->unique())
+    *out = boost::make_shared<sensor_msgs::Image>();
+  sensor_msgs::Image & img = **out;
+  img.header = msg->header;
+  img.encoding = msg->encoding;
+  img.is_bigendian = msg->is_bigendian;
+  img.width = width;
+  img.height = height;
+  img.step = width * src.elemSize();
+  img.data.resize(img.step * height);
+  cv::Mat dst(height, width, src.type(), &img.data[0], img.step);
+  if (src.cols == width && src.rows == height)
+    src.copyTo(dst);
+  else
+    cv::resize(src, dst, dst.size(), 0, 0, (width < src.cols ? cv::INTER_AREA : cv::INTER_LINEAR));
+}
 
-    cv::Mat rescaled_image;
-    cv::resize(image_curr, rescaled_image, cv::Size(stream_output_width_[camera], stream_output_height_[camera]));
+void ImageSampler::PublishStream(int camera, const sensor_msgs::ImageConstPtr & img) {
+  sensor_msgs::CameraInfoPtr cinfo = boost::make_shared<sensor_msgs::CameraInfo>();
+  cinfo->header = img->header;
+  if (!jpeg_encode_ && !video_encode_) {
+    stream_image_pub_[camera].publish(img, cinfo);
+    return;
+  }
+  stream_raw_pub_[camera].publish(img);
+  stream_info_pub_[camera].publish(cinfo);
+  if (stream_jpeg_pub_[camera].getNumSubscribers() == 0 && stream_video_pub_[camera].getNumSubscribers() == 0)
+    return;
+  {
+    // an image not encoded yet is dropped for the newer one
+    std::lock_guard<std::mutex> lock(encode_mutex_);
+    encode_image_[camera] = img;
+  }
+  encode_cv_.notify_one();
+}
 
-    sensor_msgs::Image::Ptr out_img = cv_bridge::CvImage(msg->header, msg->encoding, rescaled_image).toImageMsg();
-    sensor_msgs::CameraInfo cinfo;
-    cinfo.header = msg->header;
-    stream_image_pub_[camera].publish(*out_img, cinfo);
+void ImageSampler::EncodeThread() {
+  std::vector<int> params;
+  params.push_back(CV_IMWRITE_JPEG_QUALITY);
+  params.push_back(jpeg_quality_);
+  while (true) {
+    sensor_msgs::ImageConstPtr images[NUM_CAMERAS];
+    {
+      std::unique_lock<std::mutex> lock(encode_mutex_);
+      encode_cv_.wait(lock, [this]() {
+        return encode_stop_ || encode_image_[NAV_CAM_ID] || encode_image_[DOCK_CAM_ID];
+      });
+      if (encode_stop_)
+        return;
+      for (int i = 0; i < NUM_CAMERAS; i++)
+        images[i].swap(encode_image_[i]);
+    }
+
+    for (int i = 0; i < NUM_CAMERAS; i++) {
+      if (!images[i])
+        continue;
+      std::string encoding = (sensor_msgs::image_encodings::numChannels(images[i]->encoding) == 1 ?
+                              sensor_msgs::image_encodings::MONO8 : sensor_msgs::image_encodings::BGR8);
+      cv_bridge::CvImageConstPtr cv_image;
+      try {
+        cv_image = cv_bridge::toCvShare(images[i], encoding);
+      } catch (cv_bridge::Exception & e) {
+        ROS_ERROR_STREAM("Unable to encode " << images[i]->encoding << ": " << e.what());
+        continue;
+      }
+      if (video_encode_)
+        EncodeVideo(i, images[i], cv_image->image);
+      if (!jpeg_encode_ || stream_jpeg_pub_[i].getNumSubscribers() == 0)
+        continue;
+      sensor_msgs::CompressedImagePtr jpeg = boost::make_shared<sensor_msgs::CompressedImage>();
+      jpeg->header = images[i]->header;
+      jpeg->format = "jpeg";
+      if (cv::imencode(".jpg", cv_image->image, jpeg->data, params))
+        stream_jpeg_pub_[i].publish(jpeg);
+    }
   }
 }
 
+void ImageSampler::EncodeVideo(int camera, const sensor_msgs::ImageConstPtr & img, const cv::Mat & image) {
+#ifdef IMAGE_SAMPLER_VIDEO
+  // a subscriber that just joined can only decode from a key frame
+  int subscribers = stream_video_pub_[camera].getNumSubscribers();
+  bool key = subscribers > video_subscribers_[camera];
+  video_subscribers_[camera] = subscribers;
+  if (subscribers == 0)
+    return;
+  sensor_msgs::CompressedImagePtr video = boost::make_shared<sensor_msgs::CompressedImage>();
+  video->header = img->header;
+  video->format = video_encoder_[camera]->Format();
+  if (video_encoder_[camera]->Encode(image, img->header.stamp, key, &video->data) && !video->data.empty())
+    stream_video_pub_[camera].publish(video);
+#endif
+}
+
 }  // namespace image_sampler
 
 PLUGINLIB_EXPORT_CLASS(image_sampler::ImageSampler, nodelet::Nodelet)
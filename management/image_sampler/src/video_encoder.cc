@@ -0,0 +1,163 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <image_sampler/video_encoder.h>
+
+#include <ros/console.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+#include <cstring>
+#include <mutex>  // NOLINT
+
+namespace image_sampler {
+
+VideoEncoder::VideoEncoder(std::string const& codec, std::string const& encoder, int bit_rate, int gop_size) :
+    codec_(codec), encoder_(encoder), bit_rate_(bit_rate), gop_size_(gop_size),
+    context_(NULL), frame_(NULL), sws_context_(NULL), last_pts_(-1) {
+  static std::once_flag registered;
+  std::call_once(registered, avcodec_register_all);
+}
+
+VideoEncoder::~VideoEncoder(void) {
+  Close();
+  sws_freeContext(sws_context_);
+}
+
+bool VideoEncoder::OpenCodec(char const* encoder, int width, int height) {
+  AVCodecID id = (codec_ == "hevc" ? AV_CODEC_ID_HEVC : AV_CODEC_ID_H264);
+  AVCodec* codec = (encoder == NULL ? avcodec_find_encoder(id) : avcodec_find_encoder_by_name(encoder));
+  if (codec == NULL || codec->id != id)
+    return false;
+  context_ = avcodec_alloc_context3(codec);
+  if (context_ == NULL)
+    return false;
+  context_->bit_rate = bit_rate_;
+  context_->width = width;
+  context_->height = height;
+  context_->gop_size = gop_size_;
+  context_->max_b_frames = 0;
+  context_->time_base.num = 1;
+  context_->time_base.den = 1000;
+  context_->pix_fmt = AV_PIX_FMT_YUV420P;
+  // no global header, so the parameter sets come before each key frame
+
+  AVDictionary* dict = NULL;
+  if (encoder == NULL) {
+    av_dict_set(&dict, "preset", "ultrafast", 0);
+    av_dict_set(&dict, "tune", "zerolatency", 0);
+    av_dict_set(&dict, "forced-idr", "1", 0);
+  }
+  int result = avcodec_open2(context_, codec, &dict);
+  av_dict_free(&dict);
+  if (result < 0) {
+    ROS_WARN_STREAM("Failed to open encoder " << codec->name << " with error " << result << ".");
+    avcodec_free_context(&context_);
+    return false;
+  }
+  return true;
+}
+
+bool VideoEncoder::Open(int width, int height) {
+  Close();
+  if (codec_ != "h264" && codec_ != "hevc") {
+    ROS_ERROR_STREAM("Unknown video codec " << codec_ << ".");
+    return false;
+  }
+  if (!encoder_.empty() && !OpenCodec(encoder_.c_str(), width, height))
+    ROS_WARN_STREAM("Could not open encoder " << encoder_ << ", using the software " << codec_ << " encoder.");
+  if (context_ == NULL && !OpenCodec(NULL, width, height)) {
+    ROS_ERROR_STREAM("Could not open a " << codec_ << " encoder.");
+    return false;
+  }
+
+  frame_ = av_frame_alloc();
+  if (frame_ == NULL) {
+    Close();
+    return false;
+  }
+  frame_->format = context_->pix_fmt;
+  frame_->width = width;
+  frame_->height = height;
+  if (av_frame_get_buffer(frame_, 32) < 0) {
+    ROS_ERROR("Failed to allocate the video frame.");
+    Close();
+    return false;
+  }
+  ROS_INFO_STREAM("Streaming " << width << "x" << height << " video with " << context_->codec->name << ".");
+  return true;
+}
+
+void VideoEncoder::Close(void) {
+  av_frame_free(&frame_);
+  if (context_ != NULL)
+    avcodec_close(context_);
+  avcodec_free_context(&context_);
+}
+
+bool VideoEncoder::Encode(cv::Mat const& image, ros::Time const& stamp, bool key, std::vector<uint8_t>* packet) {
+  packet->clear();
+  if (image.type() != CV_8UC1 && image.type() != CV_8UC3)
+    return false;
+  // a new size needs a new stream, which starts with a key frame
+  if (context_ == NULL || context_->width != image.cols || context_->height != image.rows) {
+    if (!Open(image.cols, image.rows))
+      return false;
+    key = true;
+  }
+
+  AVPixelFormat format = (image.channels() == 1 ? AV_PIX_FMT_GRAY8 : AV_PIX_FMT_BGR24);
+  sws_context_ = sws_getCachedContext(sws_context_, image.cols, image.rows, format,
+                                      image.cols, image.rows, AV_PIX_FMT_YUV420P, SWS_POINT, NULL, NULL, NULL);
+  if (sws_context_ == NULL || av_frame_make_writable(frame_) < 0)
+    return false;
+  uint8_t const* src[1] = {image.data};
+  int src_stride[1] = {static_cast<int>(image.step)};
+  sws_scale(sws_context_, src, src_stride, 0, image.rows, frame_->data, frame_->linesize);
+
+  // the timestamps have to increase, even if two images share a millisecond
+  int64_t pts = static_cast<int64_t>(stamp.toNSec() / 1000000);
+  if (pts <= last_pts_)
+    pts = last_pts_ + 1;
+  last_pts_ = pts;
+  frame_->pts = pts;
+  frame_->pict_type = (key ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE);
+  frame_->key_frame = key;
+
+  AVPacket pkt;
+  av_init_packet(&pkt);
+  pkt.data = NULL;
+  pkt.size = 0;
+  int got_packet = 0;
+  int result = avcodec_encode_video2(context_, &pkt, frame_, &got_packet);
+  if (result < 0) {
+    ROS_ERROR_STREAM("Failed to encode video frame with error " << result << ".");
+    return false;
+  }
+  if (got_packet) {
+    packet->assign(pkt.data, pkt.data + pkt.size);
+    av_free_packet(&pkt);
+  }
+  return true;
+}
+
+}  // namespace image_sampler
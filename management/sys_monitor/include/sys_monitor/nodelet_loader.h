@@ -0,0 +1,111 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SYS_MONITOR_NODELET_LOADER_H_
+#define SYS_MONITOR_NODELET_LOADER_H_
+
+#include <chrono>  // NOLINT
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <set>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace sys_monitor {
+
+/**
+ * Loads nodelets in parallel, each one as soon as the nodes it depends on
+ * have sent their first heartbeat. A nodelet manager loads one nodelet at a
+ * time, so there is one thread per manager, calling the load function. The
+ * dependencies may be on nodes that are not loaded here. Started() is called
+ * from one thread, and reports when every nodelet has started, along with
+ * the chain of dependencies that took the longest.
+ */
+class NodeletLoader {
+ public:
+  struct Nodelet {
+    std::string name;
+    std::string manager;
+    std::string type;
+    std::vector<std::string> depends;
+  };
+  typedef std::function<bool(Nodelet const&)> LoadFn;
+
+  NodeletLoader();
+  // Waits for the loads in progress, and drops the rest
+  ~NodeletLoader();
+
+  // Starts loading the nodelets with nothing to wait on. Returns false, and
+  // loads nothing, if a nodelet is listed twice or the dependencies between
+  // the nodelets form a cycle.
+  bool Start(std::vector<Nodelet> const& nodelets, LoadFn const& load,
+             std::string *err);
+
+  // Notes the first heartbeat of a node, and loads the nodelets that were
+  // only waiting on it
+  void Started(std::string const& node);
+
+  // Whether all the nodelets have sent a heartbeat
+  bool Finished() const;
+
+  // The time from Start() to each nodelet starting, on the critical path
+  // and overall, and the nodelets which failed to load or have not started
+  std::string Report() const;
+
+ private:
+  struct Entry {
+    Nodelet nodelet;
+    int manager;
+    int waiting;          // the dependencies which have not started yet
+    double loaded;        // seconds from Start(), or negative if not yet
+    double started;
+    bool failed;
+  };
+
+  struct Manager {
+    std::string name;
+    std::deque<int> ready;
+    std::thread thread;
+  };
+
+  double Elapsed() const;
+  void Ready(int entry);
+  void Work(Manager *manager);
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_;
+
+  LoadFn load_;
+  std::chrono::steady_clock::time_point start_;
+  std::vector<Entry> entries_;
+  std::map<std::string, int> index_;
+  std::map<std::string, std::vector<int>> waiters_;
+  std::set<std::string> started_;
+  std::vector<std::unique_ptr<Manager>> managers_;
+  size_t num_started_;
+};
+
+}  // namespace sys_monitor
+
+#endif  // SYS_MONITOR_NODELET_LOADER_H_
@@ -29,6 +29,7 @@
 #include <ff_msgs/CommandConstants.h>
 #include <ff_msgs/CommandStamped.h>
 #include <ff_msgs/Heartbeat.h>
+#include <ff_msgs/HeartbeatBatch.h>
 #include <ff_msgs/Fault.h>
 #include <ff_msgs/FaultConfig.h>
 #include <ff_msgs/FaultInfo.h>
@@ -37,7 +38,11 @@
 #include <ff_util/ff_names.h>
 #include <ff_util/ff_nodelet.h>
 
+#include <sys_monitor/nodelet_loader.h>
+#include <sys_monitor/timing_wheel.h>
+
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -87,11 +92,12 @@ class SysMonitor : public ff_util::FreeFlyerNodelet {
     void ResetTimer();
     void StopTimer();
     void previous_hb(ff_msgs::HeartbeatConstPtr hb);
-    void TimerCallBack(ros::TimerEvent const& te);
+    void TimerCallBack();
 
    private:
-    ros::Timer timer_;
     SysMonitor *const monitor_;
+    int const timer_id_;
+    uint64_t const timeout_ticks_;
     uint missed_count_;
     uint const misses_allowed_;
     uint const fault_id_;
@@ -134,6 +140,18 @@ class SysMonitor : public ff_util::FreeFlyerNodelet {
    */
   void HeartbeatCallback(ff_msgs::HeartbeatConstPtr const& heartbeat);
 
+  /**
+   * Handles each heartbeat of a batch as if it was sent on its own
+   * @param batch received message
+   */
+  void HeartbeatBatchCallback(ff_msgs::HeartbeatBatchConstPtr const& batch);
+
+  /**
+   * Moves the watchdog timing wheel on to the current time, and calls back the
+   * watchdogs which timed out
+   */
+  void WatchdogTickCallback(ros::TimerEvent const& te);
+
   virtual void Initialize(ros::NodeHandle *nh);
 
   void OutputFaultTables();
@@ -162,6 +180,12 @@ class SysMonitor : public ff_util::FreeFlyerNodelet {
   bool ReadCommand(config_reader::ConfigReader::Table *entry,
                    ff_msgs::CommandStampedPtr cmd);
 
+  /**
+   * Reads the nodelets to load at startup, and what each depends on, and
+   * starts loading them. False is returned if they couldn't be read.
+   */
+  bool StartNodelets();
+
   bool NodeletService(ff_msgs::UnloadLoadNodelet::Request &req,
                       ff_msgs::UnloadLoadNodelet::Response &res);
   int LoadNodelet(ff_msgs::UnloadLoadNodelet::Request &req);
@@ -176,16 +200,27 @@ class SysMonitor : public ff_util::FreeFlyerNodelet {
   ros::NodeHandle nh_;
   ros::Publisher pub_cmd_;
   ros::Publisher pub_fault_config_, pub_fault_state_;
-  ros::Timer reload_params_timer_, startup_timer_;
+  ros::Timer reload_params_timer_, startup_timer_, watchdog_timer_;
   ros::ServiceServer unload_load_nodelet_service_;
-  ros::Subscriber sub_hb_;
+  ros::Subscriber sub_hb_, sub_hb_batch_;
 
   std::map<unsigned int, std::shared_ptr<Fault>> all_faults_;
   std::map<std::string, WatchdogPtr> watch_dogs_;
 
+  // All the watchdog timers, on one wheel turned by watchdog_timer_, and the
+  // watchdog of each timer id
+  TimingWheel wheel_;
+  std::vector<Watchdog*> watchdog_ids_;
+  ros::Time wheel_start_;
+  double watchdog_tick_;
+  std::vector<int> expired_;
+
   // TODO(Katie) possibly remove this
   std::vector<std::string> unwatched_heartbeats_;
 
+  // Loads the startup nodelets as their dependencies heartbeat
+  std::unique_ptr<NodeletLoader> nodelet_loader_;
+
   config_reader::ConfigReader config_params_;
 
   int pub_queue_size_;
@@ -0,0 +1,76 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SYS_MONITOR_TIMING_WHEEL_H_
+#define SYS_MONITOR_TIMING_WHEEL_H_
+
+#include <cstdint>
+#include <list>
+#include <vector>
+
+namespace sys_monitor {
+
+/**
+ * Timers counted in ticks on a hierarchical timing wheel. Scheduling and
+ * cancelling a timer take constant time, and so does each tick, apart from
+ * moving the timers of a slot one level down once every 256 ticks or more.
+ * Three levels of 256 slots reach 2^24 ticks ahead, and later timers expire
+ * then. Not thread safe.
+ */
+class TimingWheel {
+ public:
+  TimingWheel();
+
+  // Adds a timer, not scheduled, and returns its id
+  int Add();
+  // Removes all the timers
+  void Clear();
+
+  // Expires the timer in ticks from now, at least one, replacing any
+  // earlier schedule
+  void Schedule(int id, uint64_t ticks);
+  void Cancel(int id);
+  bool Scheduled(int id) const;
+
+  // Moves on to tick, adding the timers which expired to expired in order
+  void Advance(uint64_t tick, std::vector<int> *expired);
+  uint64_t Now() const;
+
+ private:
+  static const int kLevels = 3;
+  static const int kBits = 8;
+  static const int kSlots = 1 << kBits;
+
+  struct Timer {
+    bool scheduled;
+    uint64_t expires;
+    int level, slot;
+    std::list<int>::iterator it;
+  };
+
+  void Place(int id);
+  void Cascade(int level);
+
+  uint64_t now_;
+  std::vector<Timer> timers_;
+  std::list<int> slots_[kLevels][kSlots];
+};
+
+}  // namespace sys_monitor
+
+#endif  // SYS_MONITOR_TIMING_WHEEL_H_
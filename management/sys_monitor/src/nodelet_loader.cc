@@ -0,0 +1,226 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sys_monitor/nodelet_loader.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace sys_monitor {
+
+NodeletLoader::NodeletLoader() : stop_(false), num_started_(0) {
+}
+
+NodeletLoader::~NodeletLoader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (size_t i = 0; i < managers_.size(); i++) {
+    if (managers_[i]->thread.joinable())
+      managers_[i]->thread.join();
+  }
+}
+
+bool NodeletLoader::Start(std::vector<Nodelet> const& nodelets,
+                          LoadFn const& load, std::string *err) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!entries_.empty()) {
+    *err = "Nodelets are already loading.";
+    return false;
+  }
+
+  std::vector<Entry> entries(nodelets.size());
+  std::map<std::string, int> index, managers;
+  for (size_t i = 0; i < nodelets.size(); i++) {
+    if (!index.emplace(nodelets[i].name, i).second) {
+      *err = "Nodelet " + nodelets[i].name + " is listed twice.";
+      return false;
+    }
+    entries[i].nodelet = nodelets[i];
+    entries[i].manager = managers.emplace(nodelets[i].manager,
+                                          managers.size()).first->second;
+    entries[i].waiting = nodelets[i].depends.size();
+    entries[i].loaded = -1;
+    entries[i].started = -1;
+    entries[i].failed = false;
+  }
+
+  // Remove the nodelets with nothing left to wait on, in turn, among the
+  // ones listed. Any that are left wait on each other.
+  std::vector<int> waiting(entries.size(), 0), order;
+  std::map<std::string, std::vector<int>> dependents;
+  for (size_t i = 0; i < entries.size(); i++) {
+    for (std::string const& dep : entries[i].nodelet.depends) {
+      if (index.count(dep)) {
+        dependents[dep].push_back(i);
+        waiting[i]++;
+      }
+    }
+    if (waiting[i] == 0)
+      order.push_back(i);
+  }
+  for (size_t i = 0; i < order.size(); i++) {
+    for (int d : dependents[entries[order[i]].nodelet.name]) {
+      if (--waiting[d] == 0)
+        order.push_back(d);
+    }
+  }
+  if (order.size() != entries.size()) {
+    *err = "Circular nodelet dependencies between";
+    for (size_t i = 0; i < entries.size(); i++)
+      if (waiting[i] > 0)
+        *err += " " + entries[i].nodelet.name;
+    return false;
+  }
+
+  load_ = load;
+  start_ = std::chrono::steady_clock::now();
+  entries_.swap(entries);
+  index_.swap(index);
+  for (size_t i = 0; i < entries_.size(); i++)
+    for (std::string const& dep : entries_[i].nodelet.depends)
+      waiters_[dep].push_back(i);
+
+  managers_.resize(managers.size());
+  for (auto const& m : managers) {
+    managers_[m.second].reset(new Manager());
+    managers_[m.second]->name = m.first;
+  }
+  for (size_t i = 0; i < entries_.size(); i++)
+    if (entries_[i].waiting == 0)
+      Ready(i);
+  for (size_t i = 0; i < managers_.size(); i++)
+    managers_[i]->thread = std::thread(&NodeletLoader::Work, this,
+                                       managers_[i].get());
+  return true;
+}
+
+void NodeletLoader::Started(std::string const& node) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!started_.insert(node).second)
+    return;
+
+  double now = Elapsed();
+  auto it = index_.find(node);
+  if (it != index_.end()) {
+    entries_[it->second].started = now;
+    num_started_++;
+  }
+
+  auto waiters = waiters_.find(node);
+  if (waiters == waiters_.end())
+    return;
+  for (int i : waiters->second)
+    if (--entries_[i].waiting == 0)
+      Ready(i);
+  lock.unlock();
+  cv_.notify_all();
+}
+
+bool NodeletLoader::Finished() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_started_ == entries_.size();
+}
+
+std::string NodeletLoader::Report() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  char buffer[64];
+
+  // Walk back from the last nodelet to start, through the dependencies that
+  // started last
+  int last = -1;
+  for (size_t i = 0; i < entries_.size(); i++)
+    if (entries_[i].started >= 0 &&
+        (last < 0 || entries_[i].started > entries_[last].started))
+      last = i;
+  std::vector<int> path;
+  for (int i = last; i >= 0;) {
+    path.push_back(i);
+    int next = -1;
+    for (std::string const& dep : entries_[i].nodelet.depends) {
+      auto it = index_.find(dep);
+      if (it != index_.end() && entries_[it->second].started >= 0 &&
+          (next < 0 || entries_[it->second].started > entries_[next].started))
+        next = it->second;
+    }
+    i = next;
+  }
+
+  std::string report;
+  snprintf(buffer, sizeof(buffer), "%zu of %zu nodelets started",
+           num_started_, entries_.size());
+  report = buffer;
+  if (last >= 0) {
+    snprintf(buffer, sizeof(buffer), " in %.2f s", entries_[last].started);
+    report += buffer;
+    report += ", critical path:";
+    for (size_t i = path.size(); i-- > 0;) {
+      Entry const& e = entries_[path[i]];
+      snprintf(buffer, sizeof(buffer), " %.2f s (loaded %.2f s)",
+               e.started, e.loaded);
+      report += (i + 1 == path.size() ? " " : " -> ") + e.nodelet.name + buffer;
+    }
+  }
+
+  std::string failed, not_started;
+  for (size_t i = 0; i < entries_.size(); i++) {
+    if (entries_[i].failed)
+      failed += " " + entries_[i].nodelet.name;
+    else if (entries_[i].started < 0)
+      not_started += " " + entries_[i].nodelet.name;
+  }
+  if (!failed.empty())
+    report += ". Failed to load:" + failed;
+  if (!not_started.empty())
+    report += ". Not started:" + not_started;
+  return report;
+}
+
+double NodeletLoader::Elapsed() const {
+  return std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start_).count();
+}
+
+void NodeletLoader::Ready(int entry) {
+  managers_[entries_[entry].manager]->ready.push_back(entry);
+}
+
+void NodeletLoader::Work(Manager *manager) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this, manager] {
+      return stop_ || !manager->ready.empty();
+    });
+    if (stop_)
+      return;
+
+    int i = manager->ready.front();
+    manager->ready.pop_front();
+    Nodelet nodelet = entries_[i].nodelet;
+    lock.unlock();
+    bool loaded = load_(nodelet);
+    lock.lock();
+    entries_[i].loaded = Elapsed();
+    entries_[i].failed = !loaded;
+  }
+}
+
+}  // namespace sys_monitor
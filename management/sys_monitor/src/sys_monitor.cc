@@ -18,6 +18,8 @@
 
 #include "sys_monitor/sys_monitor.h"
 
+#include <algorithm>
+
 namespace sys_monitor {
 SysMonitor::SysMonitor() :
   ff_util::FreeFlyerNodelet(NODE_SYS_MONITOR, true),
@@ -149,6 +151,14 @@ void SysMonitor::HeartbeatCallback(ff_msgs::HeartbeatConstPtr const& hb) {
     return;
   }
 
+  // Load the startup nodelets that were waiting on this node
+  if (nodelet_loader_ && !nodelet_loader_->Finished()) {
+    nodelet_loader_->Started(hb->node);
+    if (nodelet_loader_->Finished()) {
+      NODELET_INFO("Startup: %s", nodelet_loader_->Report().c_str());
+    }
+  }
+
   // Check to see if node heartbeat is set up in watchdogs
   if (watch_dogs_.count(hb->node) > 0) {
     WatchdogPtr wd = watch_dogs_.at(hb->node);
@@ -251,6 +261,27 @@ void SysMonitor::HeartbeatCallback(ff_msgs::HeartbeatConstPtr const& hb) {
   }
 }
 
+void SysMonitor::HeartbeatBatchCallback(
+                                ff_msgs::HeartbeatBatchConstPtr const& batch) {
+  for (uint i = 0; i < batch->heartbeats.size(); i++) {
+    HeartbeatCallback(
+              boost::make_shared<ff_msgs::Heartbeat>(batch->heartbeats[i]));
+  }
+}
+
+void SysMonitor::WatchdogTickCallback(ros::TimerEvent const& te) {
+  double elapsed = (ros::Time::now() - wheel_start_).toSec();
+  if (elapsed < 0) {
+    return;
+  }
+  uint64_t tick = elapsed / watchdog_tick_;
+  expired_.clear();
+  wheel_.Advance(tick, &expired_);
+  for (uint i = 0; i < expired_.size(); i++) {
+    watchdog_ids_[expired_[i]]->TimerCallBack();
+  }
+}
+
 void SysMonitor::Initialize(ros::NodeHandle *nh) {
   nh_ = *nh;
 
@@ -262,6 +293,11 @@ void SysMonitor::Initialize(ros::NodeHandle *nh) {
     return;
   }
 
+  if (!StartNodelets()) {
+    exit(EXIT_FAILURE);
+    return;
+  }
+
   // Create a callback timer which checks to see if the config files have been
   // changed.
   reload_params_timer_ = nh_.createTimer(ros::Duration(1),
@@ -279,6 +315,11 @@ void SysMonitor::Initialize(ros::NodeHandle *nh) {
 
   sub_hb_ = nh_.subscribe(TOPIC_HEARTBEAT, sub_queue_size_,
                                           &SysMonitor::HeartbeatCallback, this);
+  sub_hb_batch_ = nh_.subscribe(TOPIC_HEARTBEAT_BATCH, sub_queue_size_,
+                                    &SysMonitor::HeartbeatBatchCallback, this);
+
+  watchdog_timer_ = nh_.createTimer(ros::Duration(watchdog_tick_),
+                          &SysMonitor::WatchdogTickCallback, this, false, true);
 
   pub_cmd_ = nh_.advertise<ff_msgs::CommandStamped>(TOPIC_COMMAND,
                                                         pub_queue_size_, false);
@@ -401,6 +442,10 @@ void SysMonitor::PublishFaultResponse(unsigned int fault_id) {
 }
 
 void SysMonitor::StartupTimerCallback(ros::TimerEvent const& te) {
+  if (nodelet_loader_ && !nodelet_loader_->Finished()) {
+    NODELET_WARN("Startup: %s", nodelet_loader_->Report().c_str());
+  }
+
   for (auto it = watch_dogs_.begin(); it != watch_dogs_.end(); ++it) {
     if (!it->second->heartbeat_started()) {
       std::string err_msg = "Never received heartbeat from " + it->first;
@@ -416,6 +461,9 @@ bool SysMonitor::ReadParams() {
   if (watch_dogs_.size() > 0) {
     watch_dogs_.clear();
   }
+  wheel_.Clear();
+  watchdog_ids_.clear();
+  wheel_start_ = ros::Time::now();
 
   // Read config files into lua
   if (!config_params_.ReadFiles()) {
@@ -430,6 +478,17 @@ bool SysMonitor::ReadParams() {
     return false;
   }
 
+  // Get the resolution of the watchdog timers. A missed heartbeat is noticed
+  // at most this much later than its timeout.
+  if (!config_params_.GetReal("watchdog_tick_sec", &watchdog_tick_) ||
+      watchdog_tick_ <= 0) {
+    NODELET_FATAL("Unable to read watchdog tick.");
+    return false;
+  }
+  if (watchdog_timer_) {
+    watchdog_timer_.setPeriod(ros::Duration(watchdog_tick_));
+  }
+
   // Get the list of nodes not running so that we don't monitor or trigger the
   // faults associated with those nodes
   std::vector<std::string> nodes_not_running;
@@ -749,6 +808,87 @@ bool SysMonitor::ReadCommand(config_reader::ConfigReader::Table *entry,
   return true;
 }
 
+bool SysMonitor::StartNodelets() {
+  if (!config_params_.CheckValExists("startup_nodelets")) {
+    return true;
+  }
+
+  std::vector<NodeletLoader::Nodelet> nodelets;
+  config_reader::ConfigReader::Table nodelets_tbl(&config_params_,
+                                                  "startup_nodelets");
+  int tbl_size = nodelets_tbl.GetSize() + 1;
+  // Lua indices start at one
+  for (int i = 1; i < tbl_size; i++) {
+    config_reader::ConfigReader::Table entry(&nodelets_tbl, i);
+    NodeletLoader::Nodelet nodelet;
+    if (!entry.GetStr("name", &nodelet.name) ||
+        !entry.GetStr("manager", &nodelet.manager)) {
+      NODELET_FATAL("Name or manager not found at %i in startup nodelets.", i);
+      return false;
+    }
+
+    // The type is the one in the types table, unless it is given
+    if (!entry.GetStr("type", &nodelet.type)) {
+      if (watch_dogs_.count(nodelet.name) > 0) {
+        nodelet.type = watch_dogs_.at(nodelet.name)->nodelet_type();
+      }
+      if (nodelet.type == "") {
+        NODELET_FATAL("Type of startup nodelet %s not found.",
+                                                        nodelet.name.c_str());
+        return false;
+      }
+    }
+
+    if (entry.CheckValExists("depends")) {
+      config_reader::ConfigReader::Table depends_tbl(&entry, "depends");
+      int depends_tbl_size = depends_tbl.GetSize() + 1;
+      std::string depend;
+      for (int j = 1; j < depends_tbl_size; j++) {
+        if (depends_tbl.GetStr(j, &depend)) {
+          nodelet.depends.push_back(depend);
+        }
+      }
+    }
+    nodelets.push_back(nodelet);
+  }
+
+  if (nodelets.empty()) {
+    return true;
+  }
+
+  // The managers may still be starting, so each load waits for its manager
+  // for up to the startup time
+  std::string platform = GetPlatform(), err_msg;
+  ros::Duration wait(startup_time_);
+  nodelet_loader_.reset(new NodeletLoader());
+  if (!nodelet_loader_->Start(nodelets,
+      [platform, wait](NodeletLoader::Nodelet const& nodelet) {
+        nodelet::NodeletLoad load;
+        if (platform == "") {
+          load.request.name = "/" + nodelet.name;
+        } else {
+          load.request.name = "/" + platform + "/" + nodelet.name;
+        }
+        load.request.type = nodelet.type;
+
+        std::string service = nodelet.manager + "/load_nodelet";
+        if (!ros::service::waitForService(service, wait) ||
+            !ros::service::call(service, load) || !load.response.success) {
+          ROS_ERROR("Unable to load nodelet %s in %s manager.",
+                    nodelet.name.c_str(), nodelet.manager.c_str());
+          return false;
+        }
+        return true;
+      }, &err_msg)) {
+    NODELET_FATAL("Unable to load startup nodelets: %s", err_msg.c_str());
+    nodelet_loader_.reset();
+    return false;
+  }
+
+  NODELET_INFO("Loading %zu startup nodelets.", nodelets.size());
+  return true;
+}
+
 bool SysMonitor::NodeletService(ff_msgs::UnloadLoadNodelet::Request &req,
                                 ff_msgs::UnloadLoadNodelet::Response &res) {
   bool successful = true;
@@ -864,6 +1004,9 @@ SysMonitor::Watchdog::Watchdog(SysMonitor *const sys_monitor,
                                uint const allowed_misses,
                                uint const fault_id) :
   monitor_(sys_monitor),
+  timer_id_(sys_monitor->wheel_.Add()),
+  timeout_ticks_(std::max(timeout.toSec() / sys_monitor->watchdog_tick_ + 0.5,
+                          1.0)),
   missed_count_(0),
   misses_allowed_(allowed_misses),
   fault_id_(fault_id),
@@ -874,8 +1017,7 @@ SysMonitor::Watchdog::Watchdog(SysMonitor *const sys_monitor,
   nodelet_name_(nodelet_name),
   nodelet_type_(""),
   previous_hb_() {
-  timer_ = monitor_->nh_.createTimer(timeout,
-                      &SysMonitor::Watchdog::TimerCallBack, this, false, false);
+  monitor_->watchdog_ids_.push_back(this);
 }
 
 uint SysMonitor::Watchdog::fault_id() {
@@ -939,28 +1081,28 @@ void SysMonitor::Watchdog::ResetTimer() {
     heartbeat_started_ = true;
   }
 
-  timer_.stop();
-  timer_.start();
+  monitor_->wheel_.Schedule(timer_id_, timeout_ticks_);
   missed_count_ = 0;
 }
 
 void SysMonitor::Watchdog::StopTimer() {
-  timer_.stop();
+  monitor_->wheel_.Cancel(timer_id_);
 }
 
 void SysMonitor::Watchdog::previous_hb(ff_msgs::HeartbeatConstPtr hb) {
   previous_hb_ = hb;
 }
 
-void SysMonitor::Watchdog::TimerCallBack(ros::TimerEvent const& te) {
+void SysMonitor::Watchdog::TimerCallBack() {
   if (missed_count_++ >= misses_allowed_) {
     std::string err_msg = "Didn't receive a heartbeat from " + nodelet_name_;
     monitor_->AddFault(fault_id_, err_msg);
     monitor_->PublishFaultResponse(fault_id_);
-    // Stop timer so the fault is only triggered once. Timer will be restarted
-    // once a heartbeart from the node is received
-    timer_.stop();
+    // Leave the timer stopped so the fault is only triggered once. Timer will
+    // be restarted once a heartbeart from the node is received
     hb_fault_occurring_ = true;
+  } else {
+    monitor_->wheel_.Schedule(timer_id_, timeout_ticks_);
   }
 }
 
@@ -0,0 +1,112 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "sys_monitor/timing_wheel.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace sys_monitor {
+
+TimingWheel::TimingWheel() : now_(0) {
+}
+
+int TimingWheel::Add() {
+  Timer t;
+  t.scheduled = false;
+  t.expires = 0;
+  t.level = t.slot = 0;
+  timers_.push_back(t);
+  return timers_.size() - 1;
+}
+
+void TimingWheel::Clear() {
+  timers_.clear();
+  for (int l = 0; l < kLevels; l++)
+    for (int s = 0; s < kSlots; s++)
+      slots_[l][s].clear();
+}
+
+void TimingWheel::Schedule(int id, uint64_t ticks) {
+  Cancel(id);
+  uint64_t max = (static_cast<uint64_t>(1) << (kBits * kLevels)) - 1;
+  timers_[id].expires = now_ + std::min(std::max(ticks,
+                                        static_cast<uint64_t>(1)), max);
+  timers_[id].scheduled = true;
+  Place(id);
+}
+
+void TimingWheel::Cancel(int id) {
+  Timer &t = timers_[id];
+  if (!t.scheduled)
+    return;
+  slots_[t.level][t.slot].erase(t.it);
+  t.scheduled = false;
+}
+
+bool TimingWheel::Scheduled(int id) const {
+  return timers_[id].scheduled;
+}
+
+uint64_t TimingWheel::Now() const {
+  return now_;
+}
+
+void TimingWheel::Place(int id) {
+  // The lowest level whose slot for the timer comes round before it expires
+  Timer &t = timers_[id];
+  int level = 0;
+  while (level < kLevels - 1 &&
+         (t.expires >> (kBits * level)) - (now_ >> (kBits * level)) >=
+         static_cast<uint64_t>(kSlots))
+    level++;
+  t.level = level;
+  t.slot = (t.expires >> (kBits * level)) & (kSlots - 1);
+  std::list<int> &slot = slots_[t.level][t.slot];
+  t.it = slot.insert(slot.end(), id);
+}
+
+void TimingWheel::Cascade(int level) {
+  // Moves the timers of the slot which has come round to the levels below
+  std::list<int> slot;
+  slot.swap(slots_[level][(now_ >> (kBits * level)) & (kSlots - 1)]);
+  for (int id : slot)
+    Place(id);
+}
+
+void TimingWheel::Advance(uint64_t tick, std::vector<int> *expired) {
+  while (now_ < tick) {
+    now_++;
+
+    // Higher levels first, since their timers may go to a slot below that
+    // comes round now as well
+    for (int level = kLevels - 1; level > 0; level--)
+      if ((now_ & ((static_cast<uint64_t>(1) << (kBits * level)) - 1)) == 0)
+        Cascade(level);
+
+    std::list<int> &slot = slots_[0][now_ & (kSlots - 1)];
+    while (!slot.empty()) {
+      int id = slot.front();
+      slot.pop_front();
+      timers_[id].scheduled = false;
+      expired->push_back(id);
+    }
+  }
+}
+
+}  // namespace sys_monitor
@@ -60,6 +60,7 @@ class PlannerImplementation : public ff_util::FreeFlyerNodelet {
     WAITING,
     PLANNING
   };
+  static constexpr double DEFAULT_REGISTRATION_DEADLINE = 10.0;
 
  public:
   // The constructor takes the planner name and a brief description of it
@@ -169,13 +170,20 @@ class PlannerImplementation : public ff_util::FreeFlyerNodelet {
     if (!client_z_.IsConnected()) return;  // Zone
     if (!client_r_.IsConnected()) return;  // Register
     if (state_ != INITIALIZING) return;    // Don't initialize twice
-    // Register this planner
+    // Register this planner without holding up the queue for the round trip
     NODELET_DEBUG_STREAM("Registering planner");
-    client_r_.Call(registration_);
+    client_r_.CallAsync(registration_, std::bind(&PlannerImplementation::RegisteredCallback, this,
+      std::placeholders::_1, std::placeholders::_2), DEFAULT_REGISTRATION_DEADLINE);
     // Move to waiting state
     state_ = WAITING;
   }
 
+  // Called back with the result of the registration
+  void RegisteredCallback(bool success, ff_msgs::RegisterPlanner const& registration) {
+    if (!success)
+      NODELET_ERROR_STREAM("Could not register the planner with the choreographer.");
+  }
+
   // Timeout on a trajectory generation request
   void TimeoutCallback(void) {
     NODELET_ERROR_STREAM("Timeout connecting to required service.");
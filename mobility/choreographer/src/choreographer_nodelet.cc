@@ -27,6 +27,7 @@
 #include <ff_util/ff_action.h>
 #include <ff_util/ff_service.h>
 #include <ff_util/ff_flight.h>
+#include <ff_util/ff_compression.h>
 #include <ff_util/ff_fsm.h>
 #include <ff_util/config_server.h>
 #include <ff_util/conversion.h>
@@ -35,12 +36,15 @@
 #include <nav_msgs/Path.h>
 #include <geometry_msgs/PointStamped.h>
 #include <geometry_msgs/Inertia.h>
+#include <visualization_msgs/MarkerArray.h>
 
 // Hardware messages
 #include <ff_hw_msgs/PmcState.h>
 
 // Messages
 #include <ff_msgs/MotionState.h>
+#include <ff_msgs/OctomapDelta.h>
+#include <ff_msgs/Segment.h>
 #include <ff_msgs/FlightMode.h>
 #include <ff_msgs/ControlCommand.h>
 
@@ -56,11 +60,15 @@
 #include <ff_msgs/ValidateAction.h>
 
 // STL includes
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <memory>
 #include <functional>
 #include <map>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 /**
  * \ingroup mobility
@@ -107,6 +115,34 @@ class ChoreographerNodelet : public ff_util::FreeFlyerNodelet {
   // The various types of control
   enum ControlType { IDLE, STOP, NOMINAL };
 
+  // Voxel states of the octomap delta stream
+  enum VoxelState { VOXEL_UNKNOWN = 0, VOXEL_FREE = 1, VOXEL_OCCUPIED = 2 };
+
+  // A segment the mapper has validated
+  struct ValidatedSegment {
+    std::string goal;                         // Serialized relative goal
+    size_t hash;                              // Hash of the goal
+    ros::Time stamp;                          // When it was validated
+    std::vector<Eigen::Vector3d> positions;   // Of the setpoints
+    Eigen::AlignedBox3d box;                  // Around the positions
+
+    // Is the point within radius of the lines between setpoints
+    bool Near(Eigen::Vector3d const& p, double radius) const {
+      if (box.exteriorDistance(p) > radius)
+        return false;
+      for (size_t i = 0; i < positions.size(); i++) {
+        Eigen::Vector3d a = positions[i];
+        Eigen::Vector3d d = (i + 1 < positions.size() ? positions[i + 1] : a) - a;
+        double t = d.squaredNorm() > 0 ? d.dot(p - a) / d.squaredNorm() : 0.0;
+        if ((a + std::min(std::max(t, 0.0), 1.0) * d - p).norm() <= radius)
+          return true;
+      }
+      return false;
+    }
+  };
+  typedef std::unordered_map<size_t, ValidatedSegment> ValidationCache;
+  static constexpr size_t kValidationCacheSize = 16;
+
   // Constructor
   ChoreographerNodelet() : ff_util::FreeFlyerNodelet(NODE_CHOREOGRAPHER, true),
     fsm_(STATE::INITIALIZING, std::bind(&ChoreographerNodelet::UpdateCallback,
@@ -312,6 +348,21 @@ class ChoreographerNodelet : public ff_util::FreeFlyerNodelet {
           return Result(RESPONSE::CANCELLED);
         return Result(RESPONSE::CONTROL_FAILED);
       });
+    // [29]
+    fsm_.Add(STATE::CONTROLLING,
+      VALIDATE_SUCCESS,
+      [this](FSM::Event const& event) -> FSM::State {
+        // The next chunk of a streamed segment was validated
+        StreamAppend();
+        return STATE::CONTROLLING;
+      });
+    // [30]
+    fsm_.Add(STATE::CONTROLLING,
+      VALIDATE_FAILED,
+      [this](FSM::Event const& event) -> FSM::State {
+        Control(STOP);
+        return Result(RESPONSE::VALIDATE_FAILED);
+      });
     // [28]
     fsm_.Add(STATE::CONTROLLING,
       TOLERANCE_POS | TOLERANCE_ATT | TOLERANCE_VEL | TOLERANCE_OMEGA,
@@ -501,6 +552,10 @@ class ChoreographerNodelet : public ff_util::FreeFlyerNodelet {
     pub_inertia_ = nh->advertise<geometry_msgs::Inertia>(
       TOPIC_MOBILITY_INERTIA, 1, true);
 
+    // Publish the chunks of streamed segments to control
+    pub_append_ = nh->advertise<ff_msgs::Segment>(
+      TOPIC_GNC_CTL_APPEND, 5);
+
     // Subscribe to collisions from the sentinel node
     sub_collisions_ = nh->subscribe(TOPIC_MOBILITY_COLLISIONS, 5,
       &ChoreographerNodelet::CollisionCallback, this);
@@ -509,6 +564,23 @@ class ChoreographerNodelet : public ff_util::FreeFlyerNodelet {
     sub_pmc_state_= nh->subscribe(TOPIC_HARDWARE_PMC_STATE, 5,
       &ChoreographerNodelet::PmcStateCallback, this);
 
+    // Changes to the zones and the map invalidate cached validations. The
+    // mapper only streams map changes while someone listens.
+    if (cfg_.Get<bool>("enable_validation_cache")) {
+      sub_zones_ = nh->subscribe(TOPIC_MOBILITY_ZONES, 1,
+        &ChoreographerNodelet::ZonesCallback, this);
+      sub_octomap_delta_ = nh->subscribe(TOPIC_MAPPER_OCTOMAP_DELTA, 10,
+        &ChoreographerNodelet::OctomapDeltaCallback, this);
+    }
+
+    // Periodic timer to send the chunks of a streamed segment (no autostart)
+    timer_stream_ = nh->createTimer(ros::Rate(10.0),
+        &ChoreographerNodelet::StreamCallback, this, false, false);
+
+    // One shot timer to report a cached validation (no autostart)
+    timer_validate_ = nh->createTimer(ros::Duration(0.001),
+        &ChoreographerNodelet::ValidateCachedCallback, this, true, false);
+
     // Allow planners to register themselves
     server_register_ = nh->advertiseService(SERVICE_MOBILITY_PLANNER_REGISTER,
       &ChoreographerNodelet::PlannerRegisterCallback, this);
@@ -564,6 +636,7 @@ class ChoreographerNodelet : public ff_util::FreeFlyerNodelet {
       &ChoreographerNodelet::PreemptCallback, this));
     server_.SetCancelCallback(std::bind(
       &ChoreographerNodelet::CancelCallback, this));
+    server_.SetFeedbackRate(cfg_.Get<double>("feedback_rate"));
     server_.Create(nh, ACTION_MOBILITY_MOTION);
 
     // Publish the default flight mode so the system boots predictably
@@ -801,19 +874,133 @@ class ChoreographerNodelet : public ff_util::FreeFlyerNodelet {
 
   // VALIDATE
 
-  // Validate the current working segment and flight mode
+  // Validate the current working segment and flight mode, or only its first
+  // chunk if it is to be streamed
   bool Validate(ff_util::Segment const& segment) {
+    size_t end = ChunkEnd(segment, 0);
+    validating_chunk_ = (end < segment.size());
+    if (validating_chunk_)
+      return SendValidate(ff_util::Segment(segment.begin(), segment.begin() + end));
+    return SendValidate(segment);
+  }
+
+  // Send a validate goal for a segment
+  bool SendValidate(ff_util::Segment const& segment) {
     static ff_msgs::ValidateGoal goal;
     goal.flight_mode = goal_flight_mode_;
     goal.faceforward = cfg_.Get<bool>("enable_faceforward");
     goal.segment = segment;
     goal.max_time = ros::Duration(
       cfg_.Get<double>("timeout_validate_deadline"));
+    // A segment validated before is reported once we are in the new state
+    pending_.goal.clear();
+    if (cfg_.Get<bool>("enable_validation_cache")
+      && CacheKey(goal, &pending_.goal)) {
+      ValidationCache::iterator it = validated_.find(pending_.hash);
+      if (it != validated_.end() && it->second.goal == pending_.goal
+        && (ros::Time::now() - it->second.stamp).toSec()
+          < cfg_.Get<double>("validation_cache_timeout")) {
+        NODELET_DEBUG_STREAM("Segment validated before, not sending it");
+        pending_.goal.clear();
+        timer_validate_.stop();
+        timer_validate_.start();
+        return true;
+      }
+      pending_.positions.clear();
+      for (ff_util::Setpoint const& setpoint : segment)
+        pending_.positions.push_back(Eigen::Vector3d(setpoint.pose.position.x,
+          setpoint.pose.position.y, setpoint.pose.position.z));
+    }
     client_v_.SetDeadlineTimeout(
       cfg_.Get<double>("timeout_validate_deadline"));
     return client_v_.SendGoal(goal);
   }
 
+  // The serialized goal with times from the first setpoint, and its hash.
+  // Returns false if the times go backwards, which the mapper rejects.
+  bool CacheKey(ff_msgs::ValidateGoal const& goal, std::string *key) {
+    static ff_msgs::ValidateGoal relative;
+    relative = goal;
+    for (size_t i = 0; i < relative.segment.size(); i++) {
+      ros::Duration offset = goal.segment[i].when - goal.segment.front().when;
+      if (offset < ros::Duration(0))
+        return false;
+      relative.segment[i].when = ros::Time(0) + offset;
+    }
+    uint32_t size = ros::serialization::serializationLength(relative);
+    key->resize(size);
+    ros::serialization::OStream stream(
+      reinterpret_cast<uint8_t*>(&(*key)[0]), size);
+    ros::serialization::serialize(stream, relative);
+    pending_.hash = std::hash<std::string>()(*key);
+    return true;
+  }
+
+  // Called once a cached validation is to be reported
+  void ValidateCachedCallback(const ros::TimerEvent&) {
+    return fsm_.Update(VALIDATE_SUCCESS);
+  }
+
+  // Any change to the zones may change the result of validation
+  void ZonesCallback(visualization_msgs::MarkerArray::ConstPtr const& msg) {
+    validated_.clear();
+  }
+
+  // Drop the cached segments near voxels that are now occupied or unknown.
+  // The encoding is described in mapper/octomap_delta.h. A keyframe lists
+  // all the leaves, so the segments near any occupied leaf are dropped.
+  void OctomapDeltaCallback(ff_msgs::OctomapDelta::ConstPtr const& msg) {
+    static const int key_offset = 1 << 15, max_depth = 16;
+    bool in_sequence = (msg->version == map_version_ + 1);
+    map_version_ = msg->version;
+    if (validated_.empty())
+      return;
+    if (!msg->keyframe && !in_sequence) {
+      validated_.clear();
+      return;
+    }
+    double margin = cfg_.Get<double>("validation_cache_margin");
+    size_t pos = 0;
+    uint64_t packed = 0;
+    for (uint32_t i = 0; i < msg->num_voxels && !validated_.empty(); i++) {
+      uint64_t delta = 0;
+      int shift = 0;
+      while (pos < msg->data.size() && shift < 64) {
+        uint8_t byte = msg->data[pos++];
+        delta |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        shift += 7;
+        if ((byte & 0x80) == 0)
+          break;
+      }
+      if (pos >= msg->data.size()) {
+        validated_.clear();
+        return;
+      }
+      packed += delta;
+      uint8_t code = msg->data[pos++];
+      int depth = code >> 2;
+      if (depth > max_depth || (code & 0x3) == VOXEL_FREE)
+        continue;
+      // The center of the voxel, which a pruned leaf of a keyframe covers
+      // from its lowest key up
+      int side = 1 << (max_depth - depth);
+      double size = side * msg->resolution;
+      Eigen::Vector3d center;
+      for (int k = 0; k < 3; k++) {
+        int key = (packed >> (16 * k)) & 0xFFFF & ~(side - 1);
+        center[k] = (key - key_offset) * msg->resolution + 0.5 * size;
+      }
+      double radius = margin + 0.5 * std::sqrt(3.0) * size;
+      for (ValidationCache::iterator it = validated_.begin();
+        it != validated_.end();) {
+        if (it->second.Near(center, radius))
+          it = validated_.erase(it);
+        else
+          ++it;
+      }
+    }
+  }
+
   // Validate feedback -- forward to the motion state
   void VFeedbackCallback(ff_msgs::ValidateFeedbackConstPtr const& feedback) {
     switch (fsm_.GetState()) {
@@ -832,7 +1019,25 @@ class ChoreographerNodelet : public ff_util::FreeFlyerNodelet {
     ff_msgs::ValidateResultConstPtr const& result) {
     switch (result_code) {
     case ff_util::FreeFlyerActionState::SUCCESS:
-      segment_ = result->segment;
+      if (!validating_chunk_)
+        segment_ = result->segment;
+      // Remember the segment, making room by dropping the oldest
+      if (!pending_.goal.empty()) {
+        pending_.stamp = ros::Time::now();
+        pending_.box.setEmpty();
+        for (Eigen::Vector3d const& p : pending_.positions)
+          pending_.box.extend(p);
+        ValidationCache::iterator oldest = validated_.begin();
+        for (ValidationCache::iterator it = validated_.begin();
+          it != validated_.end(); ++it)
+          if (it->second.stamp < oldest->second.stamp)
+            oldest = it;
+        if (validated_.size() >= kValidationCacheSize
+          && validated_.find(pending_.hash) == validated_.end())
+          validated_.erase(oldest);
+        validated_[pending_.hash] = pending_;
+        pending_.goal.clear();
+      }
       return fsm_.Update(VALIDATE_SUCCESS);
     default:
       return fsm_.Update(VALIDATE_FAILED);
@@ -952,6 +1157,16 @@ class ChoreographerNodelet : public ff_util::FreeFlyerNodelet {
       default:
         break;
       }
+      // Drop the setpoints control reaches from the ones before them, so
+      // that less is sent to the mapper, control and the bags
+      double pos = cfg_.Get<double>("compression_tolerance_pos");
+      if (pos > 0.0) {
+        size_t size = segment_.size();
+        segment_ = ff_util::Compression::Compress(segment_, pos,
+          cfg_.Get<double>("compression_tolerance_att"));
+        NODELET_DEBUG_STREAM("Compressed " << size << " setpoints to "
+          << segment_.size());
+      }
       return fsm_.Update(PLAN_SUCCESS);
     }
     return fsm_.Update(PLAN_FAILED);
@@ -1006,8 +1221,13 @@ class ChoreographerNodelet : public ff_util::FreeFlyerNodelet {
   // Send specific control
   bool Control(ControlType type,
     ff_util::Segment const& segment = ff_util::Segment()) {
+    // Any segment being streamed is replaced
+    timer_stream_.stop();
+    stream_segment_.clear();
+    stream_next_ = 0;
     // Package and send the segment to control
     ff_msgs::ControlGoal goal;
+    ros::Duration diff;
     switch (type) {
     default:
       return false;
@@ -1031,17 +1251,32 @@ class ChoreographerNodelet : public ff_util::FreeFlyerNodelet {
         reftime.nsec = 0;
       }
       // Calculate the difference
-      ros::Duration diff = reftime - goal.segment.front().when;
+      diff = reftime - goal.segment.front().when;
       NODELET_DEBUG_STREAM("Time shift:" << diff);
       // Now shift the timestamps are all setpoints accordingly
       for (ff_util::Segment::iterator it = goal.segment.begin();
         it != goal.segment.end(); it++) it->when += diff;
+      // Only send the first chunk of a long segment, the rest follows
+      stream_next_ = ChunkEnd(goal.segment, 0);
+      if (stream_next_ < goal.segment.size()) {
+        goal.streaming = true;
+        stream_segment_ = goal.segment;
+        goal.segment.resize(stream_next_);
+      } else {
+        stream_next_ = 0;
+      }
       // We are now ready to execute the segment
       break;
     }
     // Send the goal
     if (!client_c_.SendGoal(goal))
       return false;
+    if (goal.streaming) {
+      stream_validating_ = false;
+      timer_stream_.start();
+      // Show all of the segment, not just the first chunk
+      goal.segment = stream_segment_;
+    }
     // Publish the segment to rviz for user introspection
     nav_msgs::Path path;
     path.header.stamp = ros::Time::now();
@@ -1060,6 +1295,63 @@ class ChoreographerNodelet : public ff_util::FreeFlyerNodelet {
     return true;
   }
 
+  // STREAMING
+
+  // The end of the chunk of a segment that starts at setpoint first, which
+  // is the end of the segment if streaming is disabled
+  size_t ChunkEnd(ff_util::Segment const& segment, size_t first) {
+    double length = cfg_.Get<double>("streaming_chunk");
+    if (length <= 0.0)
+      return segment.size();
+    size_t end = first + 1;
+    while (end < segment.size()
+      && (segment[end].when - segment[first].when).toSec() < length)
+      end++;
+    // Not worth leaving a chunk of one setpoint for the end
+    if (end + 1 == segment.size())
+      end++;
+    return end;
+  }
+
+  // Validate or send the next chunk once less than a chunk is left ahead
+  void StreamCallback(const ros::TimerEvent&) {
+    if (fsm_.GetState() != STATE::CONTROLLING || stream_next_ == 0
+      || stream_validating_)
+      return;
+    double ahead = (stream_segment_[stream_next_ - 1].when
+      - ros::Time::now()).toSec();
+    if (ahead > cfg_.Get<double>("streaming_chunk"))
+      return;
+    stream_end_ = ChunkEnd(stream_segment_, stream_next_);
+    if (!cfg_.Get<bool>("enable_validation"))
+      return StreamAppend();
+    // Include the last setpoint sent, so the step into the chunk is checked
+    stream_validating_ = true;
+    validating_chunk_ = true;
+    if (!SendValidate(ff_util::Segment(stream_segment_.begin() + stream_next_ - 1,
+      stream_segment_.begin() + stream_end_)))
+      fsm_.Update(VALIDATE_FAILED);
+  }
+
+  // Send the next chunk to control, and end the stream after the last one
+  void StreamAppend() {
+    if (stream_next_ == 0 || stream_end_ <= stream_next_)
+      return;
+    stream_validating_ = false;
+    static ff_msgs::Segment msg;
+    msg.segment.assign(stream_segment_.begin() + stream_next_,
+      stream_segment_.begin() + stream_end_);
+    pub_append_.publish(msg);
+    NODELET_DEBUG_STREAM("Streamed setpoints " << stream_next_ << " to " << stream_end_);
+    stream_next_ = stream_end_;
+    if (stream_next_ < stream_segment_.size())
+      return;
+    msg.segment.clear();
+    pub_append_.publish(msg);
+    timer_stream_.stop();
+    stream_next_ = 0;
+  }
+
   // Control feedback - simple pass through for control -> feedback
   void CFeedbackCallback(ff_msgs::ControlFeedbackConstPtr const& feedback) {
     switch (fsm_.GetState()) {
@@ -1220,7 +1512,7 @@ class ChoreographerNodelet : public ff_util::FreeFlyerNodelet {
   // Runtime configuration
   ff_util::ConfigServer cfg_;
   // Timeout on speed preps
-  ros::Timer timer_speed_, timer_feedback_;
+  ros::Timer timer_speed_, timer_feedback_, timer_validate_, timer_stream_;
   // TF2
   tf2_ros::Buffer tf_buffer_;
   std::shared_ptr<tf2_ros::TransformListener> tf_listener_;
@@ -1229,13 +1521,25 @@ class ChoreographerNodelet : public ff_util::FreeFlyerNodelet {
   PlannerInfo info_;
   // Publishers and subscribers
   ros::Publisher pub_state_, pub_segment_, pub_flight_mode_, pub_inertia_;
+  ros::Publisher pub_append_;
   ros::Subscriber sub_collisions_, sub_pmc_state_;
+  ros::Subscriber sub_zones_, sub_octomap_delta_;
   ros::ServiceServer server_register_, server_set_state_, server_set_inertia_;
   // Cached between callbacks
   ff_msgs::FlightMode flight_mode_, goal_flight_mode_;  // Flight mode
   std::vector<geometry_msgs::PoseStamped> states_;      // Plan request
   ff_util::Segment segment_;                            // Segment
   geometry_msgs::PointStamped obstacle_;                // Obstacle
+  // Validation cache
+  ValidationCache validated_;                           // Validated segments
+  ValidatedSegment pending_;                            // Being validated
+  uint32_t map_version_ = 0;                            // Last map delta
+  bool validating_chunk_ = false;                       // Not all the segment
+  // Streaming
+  ff_util::Segment stream_segment_;                     // Shifted segment
+  size_t stream_next_ = 0;                              // Next to send, or 0
+  size_t stream_end_ = 0;                               // End of that chunk
+  bool stream_validating_ = false;                      // Next is validating
 };
 
 // Declare the plugin
@@ -0,0 +1,93 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef MAPPER_DISTANCE_FIELD_H_
+#define MAPPER_DISTANCE_FIELD_H_
+
+#include <octomap/octomap.h>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace octoclass {
+
+// Euclidean distance from voxels to their nearest obstacle voxel, kept up to
+// date as obstacles are added and removed. Only the changes are propagated,
+// with the dynamic brushfire algorithm of:
+//
+//   Lau, Sprunk and Burgard, "Efficient grid-based spatial representations
+//   for robot navigation in dynamic environments", RAS 61(10), 2013.
+//
+// Voxels are octomap keys at the finest depth. Distances are only stored up
+// to a maximum, which bounds the work per changed obstacle.
+class DistanceField {
+ public:
+    DistanceField();
+
+    // Forget all obstacles. A max_distance of zero disables the field.
+    void Reset(const double resolution,
+               const double max_distance);
+    bool IsEnabled() const {return max_sq_dist_ > 0;}
+    double MaxDistance() const {return max_distance_;}
+
+    // Changes take effect on the next call to Update()
+    void SetObstacle(const octomap::OcTreeKey &key);
+    void RemoveObstacle(const octomap::OcTreeKey &key);
+    bool IsObstacle(const octomap::OcTreeKey &key) const;
+    void Update();
+
+    // Distance in meters to the nearest obstacle, at most MaxDistance()
+    double Distance(const octomap::OcTreeKey &key) const;
+
+ private:
+    struct Cell {
+        octomap::OcTreeKey obstacle;  // Nearest obstacle, if has_obstacle
+        int sq_dist;                  // Squared distance to it, in voxels
+        bool has_obstacle;
+        bool raise;                   // Its obstacle was removed, waiting to propagate that
+    };
+    typedef std::unordered_map<octomap::OcTreeKey, Cell, octomap::OcTreeKey::KeyHash> CellMap;
+    typedef std::pair<int, octomap::OcTreeKey> OpenEntry;
+    struct Farther {
+        bool operator()(const OpenEntry &a, const OpenEntry &b) const {return a.first > b.first;}
+    };
+
+    void Raise(const octomap::OcTreeKey &key);
+    void Lower(const octomap::OcTreeKey &key,
+               const Cell &cell);
+    void ClearCell(const octomap::OcTreeKey &key,
+                   Cell *cell);
+    // The 26 neighbors of a key, fewer at the edges of the key space
+    static void GetNeighbors(const octomap::OcTreeKey &key,
+                             std::vector<octomap::OcTreeKey> *neighbors);
+    static int SquaredDistance(const octomap::OcTreeKey &a,
+                               const octomap::OcTreeKey &b);
+
+    double resolution_;
+    double max_distance_;
+    int max_sq_dist_;  // In voxels squared
+    CellMap cells_;
+    octomap::KeySet obstacles_;
+    std::priority_queue<OpenEntry, std::vector<OpenEntry>, Farther> open_;
+    std::vector<octomap::OcTreeKey> cleared_;  // Cells cleared during the current update
+};
+
+}  // namespace octoclass
+
+#endif  // MAPPER_DISTANCE_FIELD_H_
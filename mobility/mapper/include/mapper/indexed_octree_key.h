@@ -21,7 +21,9 @@
 
 #include <octomap/octomap.h>
 #include <octomap/OcTree.h>
-#include <unordered_set>
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
 namespace octoclass {
 
@@ -82,32 +84,114 @@ class IndexedOcTreeKey {
     };
 };
 
-typedef std::tr1::unordered_set<IndexedOcTreeKey, IndexedOcTreeKey::KeyHash> KeySet;
-
-
-// Class for saving pairs of keys/indexes
+// Class for saving pairs of keys/indexes. The keys are packed into 48 bits
+// and stored in a flat table with linear probing, so inserting a key does
+// not allocate, and finding one touches a single cache line most times.
 class IndexedKeySet{
  public:
-    KeySet set_;
+    IndexedKeySet() : size_(0) {}
 
     // Methods
+    // Keeps the first index given to a key, like inserting into a set
     void Insert(const octomap::OcTreeKey &key, uint &index) {
-        set_.insert(IndexedOcTreeKey(key, index));
+        if (2*(size_ + 1) > slots_.size()) {
+            Rehash(std::max(static_cast<size_t>(kMinSlots), 2*slots_.size()));
+        }
+        const uint64_t packed = Pack(key);
+        size_t slot = Slot(packed);
+        while (slots_[slot] != Empty()) {
+            if (slots_[slot] == packed) {
+                return;
+            }
+            slot = (slot + 1) & (slots_.size() - 1);
+        }
+        slots_[slot] = packed;
+        indexes_[slot] = index;
+        size_++;
     }
 
     bool Key2Index(const octomap::OcTreeKey &key,
                    uint *index_out) {
-        std::tr1::unordered_set<IndexedOcTreeKey, IndexedOcTreeKey::KeyHash>::const_iterator key2index;
-        key2index = set_.find(IndexedOcTreeKey(key, 0));
-        if (key2index == set_.end()) {
+        if (size_ == 0) {
             return false;
-        } else {
-            *index_out = key2index->index_;
-            return true;
+        }
+        const uint64_t packed = Pack(key);
+        for (size_t slot = Slot(packed); slots_[slot] != Empty(); slot = (slot + 1) & (slots_.size() - 1)) {
+            if (slots_[slot] == packed) {
+                *index_out = indexes_[slot];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t Size() { return size_; }
+
+    // Make room for n keys without growing the table
+    void Reserve(const size_t n) {
+        size_t slots = kMinSlots;
+        while (slots < 2*n) {
+            slots *= 2;
+        }
+        if (slots > slots_.size()) {
+            Rehash(slots);
+        }
+    }
+
+    // Make room for the voxels of a bounding box, up to kMaxReserve. Boxes
+    // mostly hold pruned nodes, larger than a voxel, so the result is bound
+    // instead of grown to the full count.
+    void ReserveBox(const octomap::point3d &box_min,
+                    const octomap::point3d &box_max,
+                    const double resolution) {
+        double voxels = 1.0;
+        for (int i = 0; i < 3; i++) {
+            voxels *= std::max(1.0, std::ceil((box_max(i) - box_min(i))/resolution));
+        }
+        Reserve(static_cast<size_t>(std::min(voxels, static_cast<double>(kMaxReserve))));
+    }
+
+    void Clear() {
+        std::fill(slots_.begin(), slots_.end(), Empty());
+        size_ = 0;
+    }
+
+ private:
+    enum {kMinSlots = 16, kMaxReserve = 1 << 18};
+    static uint64_t Empty() {return ~static_cast<uint64_t>(0);}  // No key packs to this
+
+    static uint64_t Pack(const octomap::OcTreeKey &key) {
+        return static_cast<uint64_t>(key.k[0]) |
+               (static_cast<uint64_t>(key.k[1]) << 16) |
+               (static_cast<uint64_t>(key.k[2]) << 32);
+    }
+
+    // Fibonacci hashing, so that neighboring keys spread over the table
+    size_t Slot(const uint64_t packed) const {
+        return static_cast<size_t>((packed*0x9E3779B97F4A7C15ULL) >> 32) & (slots_.size() - 1);
+    }
+
+    void Rehash(const size_t n_slots) {
+        std::vector<uint64_t> old_slots(n_slots, Empty());
+        std::vector<uint> old_indexes(n_slots);
+        slots_.swap(old_slots);  // The old table is now in old_slots
+        indexes_.swap(old_indexes);
+        for (size_t i = 0; i < old_slots.size(); i++) {
+            if (old_slots[i] == Empty()) {
+                continue;
+            }
+            size_t slot = Slot(old_slots[i]);
+            while (slots_[slot] != Empty()) {
+                slot = (slot + 1) & (slots_.size() - 1);
+            }
+            slots_[slot] = old_slots[i];
+            indexes_[slot] = old_indexes[i];
         }
     }
 
-    size_t Size() { return set_.size(); }
+    std::vector<uint64_t> slots_;  // Packed keys, Empty() if free. The size is a power of two.
+    std::vector<uint> indexes_;
+    size_t size_;
 };
 
 }  // namespace octoclass
@@ -36,6 +36,7 @@
 #include <std_srvs/Trigger.h>
 
 // Keepout zones for the planner
+#include <jsonloader/keepout_bvh.h>
 #include <boost/filesystem.hpp>
 #include <boost/range/iterator_range_core.hpp>
 #include <pluginlib/class_list_macros.h>
@@ -46,6 +47,7 @@
 #include <ff_util/ff_flight.h>
 #include <ff_util/ff_serialization.h>
 #include <ff_util/config_server.h>
+#include <ff_util/marker_publisher.h>
 
 // Action servers
 #include <ff_msgs/ValidateAction.h>
@@ -148,6 +150,9 @@ class MapperNodelet : public ff_util::FreeFlyerNodelet {
   // Thread for fading memory of the octomap
   void FadeTask();
 
+  // Thread for updating the global map from the local one around the robot
+  void GlobalMapTask();
+
   // Threads for constantly updating the tfTree values
   void HazTfTask();
   void PerchTfTask();
@@ -166,6 +171,12 @@ class MapperNodelet : public ff_util::FreeFlyerNodelet {
   // Markers for keep in / keep out zones
   void UpdateKeepInOutMarkers();
 
+  // Build the hierarchies of the keep in / keep out zones
+  void UpdateKeepInOutZones();
+
+  // Check a segment against the enabled zones, returning a response code
+  int32_t CheckKeepInOutZones(ff_util::Segment const& segment);
+
  private:
   // Declare global variables (structures defined in structs.h)
   globalVariables globals_;  // These variables are all mutex-protected
@@ -175,6 +186,7 @@ class MapperNodelet : public ff_util::FreeFlyerNodelet {
   // Thread variables
   std::thread h_haz_tf_thread_, h_perch_tf_thread_, h_body_tf_thread_;
   std::thread h_octo_thread_, h_fade_thread_, h_collision_check_thread_;
+  std::thread h_global_map_thread_;
 
   // Subscriber variables
   ros::Subscriber haz_sub_, perch_sub_, segment_sub_;
@@ -184,7 +196,22 @@ class MapperNodelet : public ff_util::FreeFlyerNodelet {
   ros::ServiceServer map_inflation_srv_, reset_map_srv_;
 
   // Thread rates (hz)
-  double tf_update_rate_, fading_memory_update_rate_;
+  double tf_update_rate_, fading_memory_update_rate_, global_map_update_rate_;
+
+  // Number of threads raycasting each point cloud into the octomap
+  int raycast_threads_;
+
+  // Voxels per map voxel side when downsampling point clouds, 0 to keep them dense
+  int downsample_subdivision_;
+
+  // Clear the free space of organized clouds by projecting voxels into their depth image
+  bool depth_image_insertion_;
+
+  // Check a trajectory against the whole map once, then only against the new obstacles
+  bool incremental_collision_check_;
+
+  // Seconds between the keyframes of the octomap delta stream
+  double octomap_delta_keyframe_period_;
 
   // // Path planning services
   // ros::ServiceServer RRT_srv, octoRRT_srv, PRM_srv, graph_srv, Astar_srv;
@@ -194,6 +221,8 @@ class MapperNodelet : public ff_util::FreeFlyerNodelet {
   State state_;                            // State of the mapper (structure defined in struct.h)
   std::string zone_dir_;                   // Zone file directory
   ff_msgs::SetZones::Request zones_;       // Zone set request
+  jsonloader::KeepoutBvh keepins_;         // Keep in zones of the request
+  jsonloader::KeepoutBvh keepouts_;        // Keep out zones of the request
   ff_util::FreeFlyerActionServer <ff_msgs::ValidateAction> server_v_;
   ff_util::Segment segment_;               // Segment
   ros::ServiceServer get_zones_srv_;       // Get zone service
@@ -203,13 +232,14 @@ class MapperNodelet : public ff_util::FreeFlyerNodelet {
 
   // Marker publishers
   ros::Publisher sentinel_pub_;
-  ros::Publisher obstacle_marker_pub_;
-  ros::Publisher free_space_marker_pub_;
-  ros::Publisher inflated_obstacle_marker_pub_;
-  ros::Publisher inflated_free_space_marker_pub_;
+  ff_util::MarkerPublisher obstacle_marker_pub_;
+  ff_util::MarkerPublisher free_space_marker_pub_;
+  ff_util::MarkerPublisher inflated_obstacle_marker_pub_;
+  ff_util::MarkerPublisher inflated_free_space_marker_pub_;
   ros::Publisher path_marker_pub_;
   ros::Publisher cam_frustum_pub_;
-  ros::Publisher map_keep_in_out_pub_;
+  ff_util::MarkerPublisher map_keep_in_out_pub_;
+  ros::Publisher octomap_delta_pub_;
 };
 
 }  // namespace mapper
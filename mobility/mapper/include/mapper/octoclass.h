@@ -26,18 +26,65 @@
 #include <pcl/point_types.h>
 #include <sensor_msgs/point_cloud2_iterator.h>
 #include <visualization_msgs/MarkerArray.h>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 #include <iostream>
+#include "mapper/distance_field.h"
 #include "mapper/indexed_octree_key.h"
 #include "mapper/linear_algebra.h"
+#include "mapper/octomap_delta.h"
 
 namespace octoclass {
 
+// Map settings needed to raycast a point cloud, copied from the map while
+// holding its lock so that the raycasting itself can run without it
+struct RaycastSettings {
+    double resolution;
+    double min_range, max_range;
+    float inflate_radius;
+    std::vector<Eigen::Vector3d> sphere;  // Discretized inflation sphere
+};
+
+// Nodes measured by one point cloud, to be applied to the trees
+struct RaycastUpdate {
+    double resolution;                  // The keys are only valid at this resolution,
+    float inflate_radius;               // and the inflation at this radius
+    octomap::KeySet occupied;           // Endpoints within range
+    octomap::KeySet occupied_inflated;  // Inflated endpoints also updated in the slim tree
+    octomap::KeySet free;               // Free in both trees
+};
+
+// Depth image of a pinhole camera, row major, with the depth along the
+// optical axis in meters. Pixels without a measurement are NaN.
+struct DepthImage {
+    int width = 0, height = 0;
+    double fx, fy, cx, cy;
+    std::vector<float> depth;
+    float At(const int u, const int v) const {return depth[v*width + u];}
+};
+
+// Copy of the trees at one time. Readers get it with OctoClass::GetSnapshot()
+// and can search it without the map lock while the trees are updated.
+struct OctomapSnapshot {
+    OctomapSnapshot(const octomap::OcTree &tree_in,
+                    const octomap::OcTree &tree_inflated_in,
+                    const double inflate_radius_in)
+        : tree(tree_in), tree_inflated(tree_inflated_in), inflate_radius(inflate_radius_in) {}
+    const octomap::OcTree tree;
+    const octomap::OcTree tree_inflated;
+    const double inflate_radius;        // Inflation of tree_inflated
+};
+typedef std::shared_ptr<const OctomapSnapshot> OctomapSnapshotPtr;
+
 // 3D occupancy grid
 class OctoClass{
  public:
     octomap::OcTree tree_ = octomap::OcTree(0.1);  // create empty tree with resolution 0.1
     octomap::OcTree tree_inflated_ = octomap::OcTree(0.1);  // create empty tree with resolution 0.1
+    octomap::OcTree tree_global_ = octomap::OcTree(0.1);    // coarse inflated map, see SetGlobalMap()
     double memory_time_;  // Fading memory of the tree in seconds
     algebra_3d::FrustumPlanes cam_frustum_;
 
@@ -52,6 +99,9 @@ class OctoClass{
     void SetResolution(const double resolution_in);  // Resolution of the octomap
     void ResetMap();  // Reset the octomap structure
     void SetMapInflation(const double inflate_radius);  // Set the inflation radius
+    double GetMapInflation() const {return inflate_radius_;}
+    void SetDistanceFieldMax(const double max_distance);  // Zero disables the obstacle distance field
+    bool HasDistanceField() const {return distance_field_.IsEnabled();}
     void SetCamFrustum(const double fov,
                        const double aspect_ratio);
     void SetOccupancyThreshold(const double occupancy_threshold);
@@ -59,11 +109,52 @@ class OctoClass{
                                  const double probability_miss);
     void SetClampingThresholds(const double clamping_threshold_min,
                                const double clamping_threshold_max);
+    // Two layers: with a global resolution above zero, tree_ and tree_inflated_ only
+    // keep a cube of local_radius around the robot, for the collision checks, and
+    // the BBX, neighbor and node size queries of the planner use tree_global_. Its
+    // resolution is rounded to the map resolution times a power of two, so that
+    // its voxels are made of whole voxels of the local trees.
+    void SetGlobalMap(const double global_resolution,
+                      const double local_radius);
+    bool HasGlobalMap() const {return global_resolution_ > 0;}
+    // Copy the local inflated map into the global one, at its resolution, then
+    // delete the nodes of the local trees outside the cube around the robot
+    void UpdateGlobalMap(const Eigen::Vector3d &robot_position);
     void PointsOctomapToPointCloud2(const octomap::point3d_list& points,
                                     sensor_msgs::PointCloud2& cloud);  // Convert from octomap to pointcloud2
     void PclToRayOctomap(const pcl::PointCloud< pcl::PointXYZ > &cloud,
                           const tf::StampedTransform &tf_cam2world,
                           const algebra_3d::FrustumPlanes &frustum);    // Map obstacles and free area
+    // PclToRayOctomap() split in two, so that only ApplyRaycastUpdate() needs the map lock.
+    // ComputeRaycastUpdate() splits the cloud across num_threads threads and touches no tree.
+    RaycastSettings GetRaycastSettings() const;
+    static void ComputeRaycastUpdate(const RaycastSettings &settings,
+                                     const pcl::PointCloud< pcl::PointXYZ > &cloud,
+                                     const tf::StampedTransform &tf_cam2world,
+                                     const algebra_3d::FrustumPlanes &frustum,
+                                     const int num_threads,
+                                     RaycastUpdate *update);
+    // Same update from a depth image, at roughly the cost of one pass over the
+    // voxels of the frustum instead of one ray per point. The endpoints are
+    // discretized from the pixels, and voxels of the frustum are free when
+    // they project in front of the depth measured around them.
+    static void ComputeDepthImageUpdate(const RaycastSettings &settings,
+                                        const DepthImage &image,
+                                        const tf::StampedTransform &tf_cam2world,
+                                        const algebra_3d::FrustumPlanes &frustum,
+                                        const int num_threads,
+                                        RaycastUpdate *update);
+    // The depth image of an organized cloud in the camera frame, with pinhole
+    // intrinsics fitted to its points, which are projected again with them.
+    // False if the cloud is not organized or the fit fails.
+    static bool DepthImageFromCloud(const pcl::PointCloud< pcl::PointXYZ > &cloud,
+                                    DepthImage *image);
+    // Returns false, and drops the update, if the resolution or inflation changed meanwhile
+    bool ApplyRaycastUpdate(const RaycastUpdate &update);
+    // Keep the first valid point of each cubic voxel of the given size, aligned with the map grid
+    static void VoxelDownsample(const pcl::PointCloud< pcl::PointXYZ > &cloud,
+                                const double voxel_size,
+                                pcl::PointCloud< pcl::PointXYZ > *downsampled);
     void ComputeUpdate(const octomap::KeySet &occ_inflated,  // Inflated endpoints
                        const octomap::KeySet &occ_slim,      // Non-inflated endpoints
                        const octomap::point3d& origin,
@@ -71,7 +162,7 @@ class OctoClass{
                        octomap::KeySet *occ_slim_in_range,
                        octomap::KeySet *free_slim,
                        octomap::KeySet *free_inflated);  // Raycasting method for inflated maps
-    void FadeMemory(const double &rate);  // Run fading memory method
+    void FadeMemory();  // Delete the nodes which faded out by now
     void InflateObstacles(const double &thickness);  // DEPRECATED: it was used to inflate the whole map (too expensive)
     // Returns all colliding nodes in the pcl
     void FindCollidingNodesTree(const pcl::PointCloud< pcl::PointXYZ > &point_cloud,
@@ -79,6 +170,31 @@ class OctoClass{
     // Returns points from the pcl that collides with inflated tree
     void FindCollidingNodesInflated(const pcl::PointCloud< pcl::PointXYZ > &point_cloud,
                                     std::vector<octomap::point3d> *colliding_nodes);
+    // Returns points from the pcl that collides with the given tree, such as one of a snapshot
+    static void FindCollidingNodes(const octomap::OcTree &tree,
+                                   const pcl::PointCloud< pcl::PointXYZ > &point_cloud,
+                                   std::vector<octomap::point3d> *colliding_nodes);
+    // Returns points from the pcl within radius of an obstacle, using the distance field
+    void FindCollidingNodesDistance(const pcl::PointCloud< pcl::PointXYZ > &point_cloud,
+                                    const double &radius,
+                                    std::vector<octomap::point3d> *colliding_nodes);
+
+    // Snapshots: the writers publish a copy of the trees after changing them, while
+    // holding the map lock. GetSnapshot() needs no lock, and is null when disabled.
+    void SetSnapshots(const bool use_snapshots);
+    void PublishSnapshot();
+    OctomapSnapshotPtr GetSnapshot() const;
+
+    // Keys of tree_ measured occupied since the last call, for checking only
+    // what changed against a trajectory. Fading and freeing add no collisions.
+    void TakeNewObstacles(std::vector<octomap::OcTreeKey> *keys);
+
+    // Stream of the changes to tree_, see octomap_delta.h. EncodeDelta() returns
+    // false if nothing changed. Without listeners, ResetDelta() stops recording
+    // changes until the next keyframe.
+    bool EncodeDelta(const bool keyframe,
+                     ff_msgs::OctomapDelta *delta);
+    void ResetDelta() {delta_encoder_.Reset();}
 
     // Visualization methods
     void TreeVisMarkers(visualization_msgs::MarkerArray *obstacles,
@@ -105,6 +221,11 @@ class OctoClass{
                         const octomap::point3d &p2);  // line collision
     bool CheckCollision(const Eigen::Vector3d &p1,
                         const Eigen::Vector3d &p2);  // line collision
+    // Point collision for a robot of the given radius, which should be less than the distance field maximum
+    bool CheckCollision(const Eigen::Vector3d &p,
+                        const double &radius);
+    // Distance to the nearest obstacle, capped at the distance field maximum
+    double GetObstacleDistance(const Eigen::Vector3d &p);
 
     // Calculate the volume of free nodes in the bounding box
     void BBXFreeVolume(const Eigen::Vector3d &box_min,
@@ -142,7 +263,51 @@ class OctoClass{
     std::vector<Eigen::Vector3d> sphere_;  // Discretized sphere used in map inflation
     std::vector<double> depth_volumes_;     // Volume per depth in the tree
 
+    // Global layer, disabled when global_resolution_ is zero
+    double global_resolution_ = 0.0;        // As requested, before rounding
+    double local_radius_ = 0.0;
+    std::vector<double> global_depth_volumes_;
+
+    // Fading memory: when each node of tree_ was last measured, and when it
+    // is due to fade out. A node measured again is rescheduled when its
+    // time comes, so the queue holds one entry per node.
+    typedef std::unordered_map<octomap::OcTreeKey, double, octomap::OcTreeKey::KeyHash> StampMap;
+    typedef std::pair<double, octomap::OcTreeKey> FadeEntry;
+    struct LaterFade {
+        bool operator()(const FadeEntry &a, const FadeEntry &b) const {return a.first > b.first;}
+    };
+    typedef std::priority_queue<FadeEntry, std::vector<FadeEntry>, LaterFade> FadeQueue;
+    StampMap fade_stamps_;
+    FadeQueue fade_queue_;
+
+    // Distance from the voxels to the occupied nodes of tree_
+    DistanceField distance_field_;
+    double distance_field_max_ = 0.0;
+
+    // Latest snapshot, only accessed with std::atomic_load and std::atomic_store
+    OctomapSnapshotPtr snapshot_;
+    bool use_snapshots_ = false;
+
+    octomap::KeySet new_obstacles_;  // Measured occupied since TakeNewObstacles()
+    OctomapDeltaEncoder delta_encoder_;
+
     // Methods
+    void ResetGlobalMap();  // Round the global resolution for the current one, and clear it
+    // The tree answering the planner queries, and its resolution and volumes per depth
+    const octomap::OcTree &PlanningTree() const {return HasGlobalMap() ? tree_global_ : tree_inflated_;}
+    double PlanningResolution() const {return PlanningTree().getResolution();}
+    const std::vector<double> &PlanningVolumes() const {
+        return HasGlobalMap() ? global_depth_volumes_ : depth_volumes_;
+    }
+    void CropLocalMap(const octomap::point3d &box_min,
+                      const octomap::point3d &box_max);  // Delete the local nodes outside the box
+    void RefreshNode(const octomap::OcTreeKey &key,
+                     const double &now);  // Fade a node up to now, before measuring it
+    void UpdateObstacle(const octomap::OcTreeKey &key,
+                        const octomap::OcTreeNode* node);  // Sync the distance field and deltas with a node of tree_
+    double FadeRate(const bool &is_occ) const;
+    double TimeToFade(const double &log_odds,
+                      const bool &is_occ) const;
     double VectorNormSquared(const double &x,
                              const double &y,
                              const double &z);
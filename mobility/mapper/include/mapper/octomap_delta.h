@@ -0,0 +1,95 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef MAPPER_OCTOMAP_DELTA_H_
+#define MAPPER_OCTOMAP_DELTA_H_
+
+#include <ff_msgs/OctomapDelta.h>
+#include <octomap/octomap.h>
+#include <octomap/OcTree.h>
+#include <unordered_map>
+#include <vector>
+
+namespace octoclass {
+
+// Streams an octree as ff_msgs::OctomapDelta messages: a keyframe with all
+// the leaves, then only the voxels whose state changed. The data holds one
+// entry per voxel, sorted by key:
+//
+//   varint  packed key minus the packed key of the previous entry, where the
+//           packed key is k[0] | k[1] << 16 | k[2] << 32
+//   uint8   depth << 2 | state
+//
+// Varints are little endian base 128, with the high bit set on all but the
+// last byte. Changes are always at the finest depth, keyframes also have the
+// pruned leaves, which stand for all the voxels below them.
+enum VoxelState {
+    VOXEL_UNKNOWN = 0,
+    VOXEL_FREE = 1,
+    VOXEL_OCCUPIED = 2
+};
+
+class OctomapDeltaEncoder {
+ public:
+    OctomapDeltaEncoder();
+
+    // The voxel of a key may have changed
+    void MarkChanged(const octomap::OcTreeKey &key);
+    // Forget the changes, the next message is a keyframe
+    void Reset();
+    // Encode the changes since the last message, or all of the tree if
+    // keyframe is set or after Reset(). Returns false if there is nothing
+    // to send.
+    bool Encode(const octomap::OcTree &tree,
+                const bool keyframe,
+                ff_msgs::OctomapDelta *msg);
+
+ private:
+    typedef std::unordered_map<octomap::OcTreeKey, uint8_t, octomap::OcTreeKey::KeyHash> StateMap;
+
+    octomap::KeySet changed_;
+    StateMap sent_;  // Last state sent for the voxels changed since the keyframe
+    uint32_t version_;
+    bool need_keyframe_;
+};
+
+// Rebuilds the octree from the messages of an OctomapDeltaEncoder
+class OctomapDeltaDecoder {
+ public:
+    OctomapDeltaDecoder();
+
+    // Returns false if the message is not the next one in the stream, or is
+    // malformed. Messages are then ignored until the next keyframe, which
+    // clears the tree and sets its resolution.
+    bool Apply(const ff_msgs::OctomapDelta &msg,
+               octomap::OcTree *tree);
+    bool HasMap() const {return has_map_;}
+
+ private:
+    static void SetVoxels(const octomap::OcTreeKey &key,
+                          const unsigned int depth,
+                          const uint8_t state,
+                          octomap::OcTree *tree);
+
+    uint32_t version_;
+    bool has_map_;
+};
+
+}  // namespace octoclass
+
+#endif  // MAPPER_OCTOMAP_DELTA_H_
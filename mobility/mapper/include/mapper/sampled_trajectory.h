@@ -24,8 +24,8 @@
 #include <octomap/octomap.h>
 #include <octomap/OcTree.h>
 #include <visualization_msgs/MarkerArray.h>
-#include <pcl/kdtree/kdtree_flann.h>
-#include <pcl/kdtree/impl/kdtree_flann.hpp>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
 #include <ros/ros.h>
 #include <Eigen/Dense>
 #include <iostream>
@@ -33,6 +33,7 @@
 
 #include "mapper/polynomials.h"
 #include "mapper/linear_algebra.h"
+#include "mapper/segment_bvh.h"
 #include "mapper/visualization_functions.h"
 
 namespace sampled_traj {
@@ -41,16 +42,12 @@ namespace sampled_traj {
 // and is compressed with the function compressSamples
 //  Time has the corresponding times within Pos
 //  nPoints has the number of points in the Pos vector
-//  ThickTraj is of the octree type to avoid repeated nodes
-// that occurs when concatenating trajectories between two
-// waypoints
+//  Bvh holds capsules around the segments between the
+// compressed samples, for checking them against the map
 class SampledTrajectory3D{
  public:
     // Sampled trajectory variables
     pcl::PointCloud<pcl::PointXYZ> pos_;
-    pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_ptr_ =
-            pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>);
-    pcl::KdTreeFLANN<pcl::PointXYZ> kdtree_pos_;
     std::vector<double> time_;
     int n_points_;
 
@@ -61,10 +58,10 @@ class SampledTrajectory3D{
     double max_dev_;          // Max deviation for compression
 
     // Thick trajectory variables
-    octomap::OcTree thick_traj_ = octomap::OcTree(0.1);  // Create empty tree with resolution 0.1
-    pcl::PointCloud< pcl::PointXYZ > point_cloud_traj_;
+    SegmentBvh bvh_;
+    bool full_check_ = false;   // The whole map is yet to be checked against bvh_
     double resolution_;
-    double thickness_;
+    double thickness_;          // Radius of the capsules around the segments
 
 
     // Constructor
@@ -80,15 +77,10 @@ class SampledTrajectory3D{
     void SetResolution(const double &resolution);
     void DeleteSample(const int &index);
     void CompressSamples();
-    void Bresenham(const Eigen::Vector3d &p0,
-                   const Eigen::Vector3d &pf,
-                   std::vector<octomap::point3d> *points);  // Bresenham line algorithm por printing a line
-    void ThickBresenham(const Eigen::Vector3d &p0,
-                        const Eigen::Vector3d &pf);          // Thick bresenham line algorithm por printing a line
-    void ThickTrajToPcl();
-    void CreateKdTree();
-    void SortCollisions(const std::vector<octomap::point3d> &colliding_nodes,
-                        std::vector<geometry_msgs::PointStamped> *samples);
+    void CreateBvh();  // Capsules around the compressed samples
+    static void SortCollisions(const SegmentBvh &bvh,
+                               const std::vector<SegmentCollision> &collisions,
+                               std::vector<geometry_msgs::PointStamped> *samples);
     void TrajVisMarkers(visualization_msgs::MarkerArray* marker_array);
     void SamplesVisMarkers(visualization_msgs::MarkerArray* marker_array);
     void CompressedVisMarkers(visualization_msgs::MarkerArray* marker_array);
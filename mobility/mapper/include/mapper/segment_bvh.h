@@ -0,0 +1,122 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef MAPPER_SEGMENT_BVH_H_
+#define MAPPER_SEGMENT_BVH_H_
+
+#include <octomap/octomap.h>
+#include <octomap/OcTree.h>
+#include <Eigen/Dense>
+#include <vector>
+
+namespace sampled_traj {
+
+// An occupied map node touched by the trajectory
+struct SegmentCollision {
+    octomap::point3d center;  // Center of the map node
+    double size;              // Edge length of the map node
+    int segment;              // First segment touching it
+    double t;                 // Closest point of that segment, from 0 (start) to 1 (end)
+};
+
+// Bounding volume hierarchy over the capsules around consecutive points of a
+// trajectory, so that the trajectory can be checked against the occupied
+// nodes of an octree without rasterizing it. Each node bounds a set of
+// segments with an axis aligned box, and above every node the subtrees of
+// the map which miss that box are skipped.
+class SegmentBvh {
+ public:
+    SegmentBvh();
+
+    // Segments between consecutive points, swept by a sphere of the given radius
+    void Build(const std::vector<Eigen::Vector3d> &points,
+               const std::vector<double> &times,
+               const double radius);
+    void Clear();
+    bool Empty() const {return nodes_.empty();}
+    int NumSegments() const {return static_cast<int>(points_.size()) - 1;}
+
+    // Segment flown at the given time, clamped to the first and last ones
+    int SegmentAtTime(const double time) const;
+
+    // First segment from from_segment on within radius + extra_radius of a box, or -1
+    int FirstIntersection(const Eigen::Vector3d &box_min,
+                          const Eigen::Vector3d &box_max,
+                          const double extra_radius,
+                          const int from_segment,
+                          double *t) const;
+
+    // All occupied leaves of the tree within radius + extra_radius of the
+    // segments from from_segment on, ordered by time along the trajectory
+    void FindCollisions(const octomap::OcTree &tree,
+                        const double extra_radius,
+                        const int from_segment,
+                        std::vector<SegmentCollision> *collisions) const;
+    // Same, among the voxels of the given keys only
+    void FindCollisions(const octomap::OcTree &tree,
+                        const std::vector<octomap::OcTreeKey> &keys,
+                        const double extra_radius,
+                        const int from_segment,
+                        std::vector<SegmentCollision> *collisions) const;
+
+    // Position and time of a point on a segment
+    Eigen::Vector3d PointAt(const int segment,
+                            const double t) const;
+    double TimeAt(const int segment,
+                  const double t) const;
+
+    // Squared distance between a segment and a box, and the parameter of the
+    // closest point along the segment
+    static double SegmentBoxSqDistance(const Eigen::Vector3d &p0,
+                                       const Eigen::Vector3d &p1,
+                                       const Eigen::Vector3d &box_min,
+                                       const Eigen::Vector3d &box_max,
+                                       double *t);
+
+ private:
+    struct Node {
+        Eigen::Vector3d box_min, box_max;  // Bounds of the segments, without the radius
+        int first_segment, last_segment;   // Lowest and highest segment indexes within the node
+        int left, right;                   // Children, or -1 at the leaves
+    };
+
+    int BuildNode(std::vector<int> *segments,
+                  const int begin,
+                  const int end);
+    void Descend(const octomap::OcTree &tree,
+                 const octomap::OcTreeNode *node,
+                 const Eigen::Vector3d &center,
+                 const double size,
+                 const double extra_radius,
+                 const int from_segment,
+                 std::vector<SegmentCollision> *collisions) const;
+    void SortByTime(std::vector<SegmentCollision> *collisions) const;
+    bool Overlaps(const int node,
+                  const Eigen::Vector3d &box_min,
+                  const Eigen::Vector3d &box_max,
+                  const double pad) const;
+
+    std::vector<Eigen::Vector3d> points_;
+    std::vector<double> times_;
+    double radius_;
+    std::vector<Node> nodes_;  // Root at index 0
+};
+
+}  // namespace sampled_traj
+
+#endif  // MAPPER_SEGMENT_BVH_H_
@@ -85,19 +85,9 @@ void MapperNodelet::SegmentCallback(const ff_msgs::Segment::ConstPtr &msg) {
         // compress trajectory into points with max deviation of 1cm from original trajectory
         globals_.sampled_traj.CompressSamples();
 
-        //  Transform compressed trajectory into a set of pixels in octomap
-        //  Octomap insertion avoids repeated points
-        globals_.sampled_traj.thick_traj_.clear();
-        for (int i = 0; i < globals_.sampled_traj.n_compressed_points_-1; i++) {
-            globals_.sampled_traj.ThickBresenham(globals_.sampled_traj.compressed_pos_[i],
-                                                globals_.sampled_traj.compressed_pos_[i+1]);
-        }
-
-        // populate trajectory node centers in a point cloud
-        globals_.sampled_traj.ThickTrajToPcl();
-
-        // populate kdtree for finding nearest neighbor w.r.t. collisions
-        globals_.sampled_traj.CreateKdTree();
+        // Bound the capsules around the compressed trajectory, which are
+        // checked against the map without voxelizing them
+        globals_.sampled_traj.CreateBvh();
     pthread_mutex_unlock(&mutexes_.sampled_traj);
 
     // Notify the collision checker to check for collision
@@ -171,7 +161,7 @@ void MapperNodelet::GoalCallback(ff_msgs::ValidateGoalConstPtr const& validate_g
         // Do something based on the result
         switch (r) {
         case ff_util::SUCCESS:
-            return Complete(RESPONSE::SUCCESS);
+            return Complete(CheckKeepInOutZones(segment_));
         case ff_util::ERROR_MINIMUM_FREQUENCY:
             return Complete(RESPONSE::MINIMUM_FREQUENCY_NOT_MET);
         case ff_util::ERROR_STATIONARY_ENDPOINT:
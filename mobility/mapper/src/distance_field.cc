@@ -0,0 +1,175 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "mapper/distance_field.h"
+
+namespace octoclass {
+
+DistanceField::DistanceField() : resolution_(0.0), max_distance_(0.0), max_sq_dist_(0) {}
+
+void DistanceField::Reset(const double resolution,
+                          const double max_distance) {
+    resolution_ = resolution;
+    max_distance_ = std::max(0.0, max_distance);
+    const double max_voxels = max_distance_/resolution_;
+    max_sq_dist_ = static_cast<int>(std::floor(max_voxels*max_voxels));
+    cells_.clear();
+    obstacles_.clear();
+    open_ = std::priority_queue<OpenEntry, std::vector<OpenEntry>, Farther>();
+    cleared_.clear();
+}
+
+void DistanceField::SetObstacle(const octomap::OcTreeKey &key) {
+    if (!IsEnabled() || !obstacles_.insert(key).second) {
+        return;
+    }
+    Cell &cell = cells_[key];
+    cell.obstacle = key;
+    cell.sq_dist = 0;
+    cell.has_obstacle = true;
+    cell.raise = false;
+    open_.push(std::make_pair(0, key));
+}
+
+void DistanceField::RemoveObstacle(const octomap::OcTreeKey &key) {
+    if (!IsEnabled() || obstacles_.erase(key) == 0) {
+        return;
+    }
+    Cell &cell = cells_[key];
+    ClearCell(key, &cell);
+    open_.push(std::make_pair(0, key));
+}
+
+bool DistanceField::IsObstacle(const octomap::OcTreeKey &key) const {
+    return obstacles_.find(key) != obstacles_.end();
+}
+
+void DistanceField::Update() {
+    // Cells are visited in order of distance, so that the raise wave of a
+    // removed obstacle runs ahead of the lower waves refilling its area
+    while (!open_.empty()) {
+        const OpenEntry entry = open_.top();
+        open_.pop();
+        CellMap::iterator it = cells_.find(entry.second);
+        if (it == cells_.end()) {
+            continue;
+        }
+        if (it->second.raise) {
+            Raise(entry.second);
+        } else if (it->second.has_obstacle && entry.first <= it->second.sq_dist &&
+                   IsObstacle(it->second.obstacle)) {
+            Lower(entry.second, it->second);
+        }
+    }
+
+    // Cells which no obstacle reached again are beyond the maximum distance
+    for (size_t i = 0; i < cleared_.size(); i++) {
+        CellMap::iterator it = cells_.find(cleared_[i]);
+        if (it != cells_.end() && !it->second.has_obstacle) {
+            cells_.erase(it);
+        }
+    }
+    cleared_.clear();
+}
+
+double DistanceField::Distance(const octomap::OcTreeKey &key) const {
+    CellMap::const_iterator it = cells_.find(key);
+    if (it == cells_.end() || !it->second.has_obstacle) {
+        return max_distance_;
+    }
+    return std::min(max_distance_, std::sqrt(static_cast<double>(it->second.sq_dist))*resolution_);
+}
+
+void DistanceField::Raise(const octomap::OcTreeKey &key) {
+    std::vector<octomap::OcTreeKey> neighbors;
+    GetNeighbors(key, &neighbors);
+    for (size_t i = 0; i < neighbors.size(); i++) {
+        CellMap::iterator it = cells_.find(neighbors[i]);
+        if (it == cells_.end() || !it->second.has_obstacle || it->second.raise) {
+            continue;
+        }
+        // Neighbors of the removed obstacle are cleared in turn, and the
+        // ones with another obstacle start a lower wave from there
+        const int sq_dist = it->second.sq_dist;
+        if (!IsObstacle(it->second.obstacle)) {
+            ClearCell(neighbors[i], &it->second);
+        }
+        open_.push(std::make_pair(sq_dist, neighbors[i]));
+    }
+    cells_[key].raise = false;
+}
+
+void DistanceField::Lower(const octomap::OcTreeKey &key,
+                          const Cell &cell) {
+    const octomap::OcTreeKey obstacle = cell.obstacle;
+    std::vector<octomap::OcTreeKey> neighbors;
+    GetNeighbors(key, &neighbors);
+    for (size_t i = 0; i < neighbors.size(); i++) {
+        const int sq_dist = SquaredDistance(neighbors[i], obstacle);
+        if (sq_dist > max_sq_dist_) {
+            continue;
+        }
+        Cell &n = cells_[neighbors[i]];  // Invalidates cell, which is not used below
+        if (n.raise || (n.has_obstacle && n.sq_dist <= sq_dist)) {
+            continue;
+        }
+        n.obstacle = obstacle;
+        n.sq_dist = sq_dist;
+        n.has_obstacle = true;
+        n.raise = false;
+        open_.push(std::make_pair(sq_dist, neighbors[i]));
+    }
+}
+
+void DistanceField::ClearCell(const octomap::OcTreeKey &key,
+                              Cell *cell) {
+    cell->has_obstacle = false;
+    cell->sq_dist = max_sq_dist_ + 1;
+    cell->raise = true;
+    cleared_.push_back(key);
+}
+
+void DistanceField::GetNeighbors(const octomap::OcTreeKey &key,
+                                 std::vector<octomap::OcTreeKey> *neighbors) {
+    neighbors->clear();
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dz = -1; dz <= 1; dz++) {
+                const int x = key[0] + dx, y = key[1] + dy, z = key[2] + dz;
+                if ((dx == 0 && dy == 0 && dz == 0) ||
+                    x < 0 || y < 0 || z < 0 || x > 0xFFFF || y > 0xFFFF || z > 0xFFFF) {
+                    continue;
+                }
+                neighbors->push_back(octomap::OcTreeKey(x, y, z));
+            }
+        }
+    }
+}
+
+int DistanceField::SquaredDistance(const octomap::OcTreeKey &a,
+                                   const octomap::OcTreeKey &b) {
+    const int dx = static_cast<int>(a[0]) - b[0];
+    const int dy = static_cast<int>(a[1]) - b[1];
+    const int dz = static_cast<int>(a[2]) - b[2];
+    return dx*dx + dy*dy + dz*dz;
+}
+
+}  // namespace octoclass
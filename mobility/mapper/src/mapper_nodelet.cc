@@ -35,6 +35,7 @@ MapperNodelet::~MapperNodelet() {
     h_body_tf_thread_.join();
     h_octo_thread_.join();
     h_fade_thread_.join();
+    h_global_map_thread_.join();
     h_collision_check_thread_.join();
     // destroy mutexes and semaphores
     mutexes_.destroy();
@@ -52,17 +53,21 @@ void MapperNodelet::Initialize(ros::NodeHandle *nh) {
         &MapperNodelet::DiagnosticsCallback, this, false, true);
 
     // load parameters
-    double map_resolution, memory_time, max_range, min_range, inflate_radius;
+    double map_resolution, memory_time, max_range, min_range, inflate_radius, distance_field_max;
     double cam_fov, aspect_ratio;
     double occupancy_threshold, probability_hit, probability_miss;
     double clamping_threshold_max, clamping_threshold_min;
     double traj_resolution, compression_max_dev;
-    bool use_haz_cam, use_perch_cam;
+    double global_map_resolution, local_map_radius;
+    bool use_haz_cam, use_perch_cam, use_snapshots;
     map_resolution = cfg_.Get<double>("map_resolution");
     max_range = cfg_.Get<double>("max_range");
     min_range = cfg_.Get<double>("min_range");
     memory_time = cfg_.Get<double>("memory_time");
     inflate_radius = cfg_.Get<double>("inflate_radius");
+    distance_field_max = cfg_.Get<double>("distance_field_max");
+    global_map_resolution = cfg_.Get<double>("global_map_resolution");
+    local_map_radius = cfg_.Get<double>("local_map_radius");
     cam_fov = cfg_.Get<double>("cam_fov");
     aspect_ratio = cfg_.Get<double>("cam_aspect_ratio");
     occupancy_threshold = cfg_.Get<double>("occupancy_threshold");
@@ -74,8 +79,15 @@ void MapperNodelet::Initialize(ros::NodeHandle *nh) {
     traj_resolution = cfg_.Get<double>("traj_compression_resolution");
     tf_update_rate_ = cfg_.Get<double>("tf_update_rate");
     fading_memory_update_rate_ = cfg_.Get<double>("fading_memory_update_rate");
+    global_map_update_rate_ = cfg_.Get<double>("global_map_update_rate");
+    raycast_threads_ = cfg_.Get<int>("raycast_threads");
+    downsample_subdivision_ = cfg_.Get<int>("downsample_subdivision");
+    depth_image_insertion_ = cfg_.Get<bool>("depth_image_insertion");
     use_haz_cam = cfg_.Get<bool>("use_haz_cam");
     use_perch_cam = cfg_.Get<bool>("use_perch_cam");
+    use_snapshots = cfg_.Get<bool>("use_octomap_snapshots");
+    incremental_collision_check_ = cfg_.Get<bool>("incremental_collision_check");
+    octomap_delta_keyframe_period_ = cfg_.Get<double>("octomap_delta_keyframe_period");
 
     // update tree parameters
     globals_.octomap.SetResolution(map_resolution);
@@ -83,6 +95,9 @@ void MapperNodelet::Initialize(ros::NodeHandle *nh) {
     globals_.octomap.SetMinRange(min_range);
     globals_.octomap.SetMemory(memory_time);
     globals_.octomap.SetMapInflation(inflate_radius);
+    globals_.octomap.SetDistanceFieldMax(distance_field_max);
+    globals_.octomap.SetGlobalMap(global_map_resolution, local_map_radius);
+    globals_.octomap.SetSnapshots(use_snapshots);
     globals_.octomap.SetCamFrustum(cam_fov, aspect_ratio);
     globals_.octomap.SetOccupancyThreshold(occupancy_threshold);
     globals_.octomap.SetHitMissProbabilities(probability_hit, probability_miss);
@@ -98,6 +113,7 @@ void MapperNodelet::Initialize(ros::NodeHandle *nh) {
     h_body_tf_thread_ = std::thread(&MapperNodelet::BodyTfTask, this);
     h_octo_thread_ = std::thread(&MapperNodelet::OctomappingTask, this);
     h_fade_thread_ = std::thread(&MapperNodelet::FadeTask, this);
+    h_global_map_thread_ = std::thread(&MapperNodelet::GlobalMapTask, this);
     h_collision_check_thread_ = std::thread(&MapperNodelet::CollisionCheckTask, this);
 
     // Create services ------------------------------------------
@@ -136,20 +152,18 @@ void MapperNodelet::Initialize(ros::NodeHandle *nh) {
     // Publishers -----------------------------------------------
     sentinel_pub_ =
         nh->advertise<geometry_msgs::PointStamped>(TOPIC_MOBILITY_COLLISIONS, 10);
-    obstacle_marker_pub_ =
-        nh->advertise<visualization_msgs::MarkerArray>(TOPIC_MAPPER_OCTOMAP_MARKERS, 10);
-    free_space_marker_pub_ =
-        nh->advertise<visualization_msgs::MarkerArray>(TOPIC_MAPPER_OCTOMAP_FREE_MARKERS, 10);
-    inflated_obstacle_marker_pub_ =
-        nh->advertise<visualization_msgs::MarkerArray>(TOPIC_MAPPER_OCTOMAP_INFLATED_MARKERS, 10);
-    inflated_free_space_marker_pub_ =
-        nh->advertise<visualization_msgs::MarkerArray>(TOPIC_MAPPER_OCTOMAP_INFLATED_FREE_MARKERS, 10);
+    // These only send the markers that changed, and all of them to a new subscriber
+    obstacle_marker_pub_.Initialize(nh, TOPIC_MAPPER_OCTOMAP_MARKERS, 10);
+    free_space_marker_pub_.Initialize(nh, TOPIC_MAPPER_OCTOMAP_FREE_MARKERS, 10);
+    inflated_obstacle_marker_pub_.Initialize(nh, TOPIC_MAPPER_OCTOMAP_INFLATED_MARKERS, 10);
+    inflated_free_space_marker_pub_.Initialize(nh, TOPIC_MAPPER_OCTOMAP_INFLATED_FREE_MARKERS, 10);
     path_marker_pub_ =
         nh->advertise<visualization_msgs::MarkerArray>(TOPIC_MAPPER_DISCRETE_TRAJECTORY_MARKERS, 10);
     cam_frustum_pub_ =
         nh->advertise<visualization_msgs::Marker>(TOPIC_MAPPER_FRUSTRUM_MARKERS, 10);
-    map_keep_in_out_pub_ =
-        nh->advertise<visualization_msgs::MarkerArray>(TOPIC_MOBILITY_ZONES, 10, true);
+    map_keep_in_out_pub_.Initialize(nh, TOPIC_MOBILITY_ZONES, 10);
+    octomap_delta_pub_ =
+        nh->advertise<ff_msgs::OctomapDelta>(TOPIC_MAPPER_OCTOMAP_DELTA, 10);
 
     // Loading keep-in and keep-out zones -------------------------
     LoadKeepInOutZones();
@@ -179,7 +193,7 @@ void MapperNodelet::LoadKeepInOutZones() {
       if (e.extension() != ".bin")
         continue;
       ff_msgs::SetZones::Request zones;
-      if (ff_util::Serialization::ReadFile(e.native(), zones)) {
+      if (ff_util::Serialization::ReadFileMapped(e.native(), zones)) {
         if (zones.timestamp >= zones_.timestamp) {
           found = true;
           zones_ = zones;
@@ -191,13 +205,62 @@ void MapperNodelet::LoadKeepInOutZones() {
     // Special case: nothing was loaded.
     if (!found)
       NODELET_WARN_STREAM("No zone files loaded");
-    // Update the RVIZ markers
+    // Update the zones checked and the RVIZ markers
+    UpdateKeepInOutZones();
     UpdateKeepInOutMarkers();
 }
 
+// Build the hierarchies that segments are checked against
+void MapperNodelet::UpdateKeepInOutZones() {
+    jsonloader::Keepout::Sequence keepins, keepouts;
+    for (ff_msgs::Zone const& zone : zones_.zones) {
+        jsonloader::Keepout::BoundingBox box(
+          Eigen::Vector3f(zone.min.x, zone.min.y, zone.min.z),
+          Eigen::Vector3f(zone.max.x, zone.max.y, zone.max.z));
+        // Zones may have been given with any two opposite vertices
+        box = jsonloader::Keepout::BoundingBox(box.min().cwiseMin(box.max()),
+          box.min().cwiseMax(box.max()));
+        if (zone.type == ff_msgs::Zone::KEEPOUT)
+            keepouts.push_back(box);
+        else if (zone.type == ff_msgs::Zone::KEEPIN)
+            keepins.push_back(box);
+    }
+    keepins_.Build(keepins);
+    keepouts_.Build(keepouts);
+}
+
+// Check the straight lines between setpoints against the zones
+int32_t MapperNodelet::CheckKeepInOutZones(ff_util::Segment const& segment) {
+    bool check_keepouts = cfg_.Get<bool>("enable_keepouts") && !keepouts_.Empty();
+    bool check_keepins = cfg_.Get<bool>("enable_keepins") && !keepins_.Empty();
+    if (!check_keepouts && !check_keepins)
+        return RESPONSE::SUCCESS;
+    for (uint i = 0; i < segment.size(); i++) {
+        geometry_msgs::Point const& p = segment[i].pose.position;
+        Eigen::Vector3f b(p.x, p.y, p.z);
+        Eigen::Vector3f a = b;
+        if (i > 0) {
+            geometry_msgs::Point const& q = segment[i - 1].pose.position;
+            a = Eigen::Vector3f(q.x, q.y, q.z);
+        }
+        float t;
+        if (check_keepouts && keepouts_.Intersects(a, b, &t)) {
+            Eigen::Vector3f x = a + t * (b - a);
+            NODELET_WARN_STREAM("Validate failed: enters a keep-out zone at "
+              << x.transpose() << " after setpoint " << i);
+            return RESPONSE::VIOLATES_KEEP_OUT;
+        }
+        if (check_keepins && !keepins_.Covers(a, b)) {
+            NODELET_WARN_STREAM("Validate failed: leaves the keep-in zones "
+              "before setpoint " << i);
+            return RESPONSE::VIOLATES_KEEP_IN;
+        }
+    }
+    return RESPONSE::SUCCESS;
+}
+
 // Publish the markers for the keepins and keepouts
 void MapperNodelet::UpdateKeepInOutMarkers() {
-    static visualization_msgs::MarkerArray old_markers;
     visualization_msgs::MarkerArray markers;
     visualization_msgs::Marker marker;
     marker.pose.orientation.x = 0;
@@ -241,12 +304,8 @@ void MapperNodelet::UpdateKeepInOutMarkers() {
         markers.markers.push_back(marker);
         marker.id++;
     }
-    for (uint i = markers.markers.size(); i < old_markers.markers.size(); i++) {
-        markers.markers.push_back(old_markers.markers.at(i));
-        markers.markers.back().action = visualization_msgs::Marker::DELETE;
-    }
-    map_keep_in_out_pub_.publish(markers);
-    old_markers = markers;
+    // Zones that are gone are deleted by the publisher
+    map_keep_in_out_pub_.Publish(markers);
 }
 
 PLUGINLIB_EXPORT_CLASS(mapper::MapperNodelet, nodelet::Nodelet);
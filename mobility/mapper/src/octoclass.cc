@@ -16,14 +16,199 @@
  * under the License.
  */
 
+#include <cmath>
 #include <utility>
 #include <algorithm>
+#include <functional>
+#include <thread>  // NOLINT
+#include <unordered_set>
 #include <vector>
 #include <limits>
+#include <memory>
+#include <queue>
 #include "mapper/octoclass.h"
 
 namespace octoclass {
 
+namespace {
+
+// Run task(0), ..., task(num_threads - 1) in parallel, task(0) in the calling thread
+void RunInThreads(const int num_threads, const std::function<void(int)> &task) {
+    std::vector<std::thread> workers;
+    for (int t = 1; t < num_threads; t++) {
+        workers.push_back(std::thread(task, t));
+    }
+    task(0);
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+// Discretize the points [begin, end) of the cloud into endpoint keys,
+// and the inflation of the endpoints within range
+void DiscretizePoints(const octomap::OcTree &tree,
+                      const RaycastSettings &settings,
+                      const pcl::PointCloud< pcl::PointXYZ > &cloud,
+                      const algebra_3d::FrustumPlanes &frustum,
+                      const Eigen::Vector3d &cam_origin,
+                      const size_t begin,
+                      const size_t end,
+                      octomap::KeySet *endpoints,
+                      octomap::KeySet *endpoints_inflated) {
+    const double min_threshold_sqr = settings.min_range*settings.min_range;
+    const double max_range_sqr = settings.max_range*settings.max_range;
+    pcl::PointXYZ point;
+    for (size_t i = begin; i < end; i++) {
+        point = cloud.points[i];
+
+        // Check if the point is invalid
+        if (std::isnan(point.x) || std::isnan(point.y) || std::isnan(point.z)) {
+            continue;
+        }
+
+        // Check if point is within camera frustum
+        if (!frustum.IsPointWithinFrustum(Eigen::Vector3d(point.x, point.y, point.z))) {
+            continue;
+        }
+
+        // points too close to origin of camera are not added
+        const double range_sqr = (Eigen::Vector3d(point.x, point.y, point.z) - cam_origin).squaredNorm();
+        if ((range_sqr < min_threshold_sqr)) {
+            continue;
+        }
+
+        // create discretized octocloud
+        octomap::OcTreeKey k = tree.coordToKey(octomap::point3d(point.x, point.y, point.z));
+        // Add non-repeated nodes to keysets (inflated and non-inflated)
+        std::pair<octomap::KeySet::iterator, bool> ret = endpoints->insert(k);
+        octomap::OcTreeKey key;
+        if (ret.second && range_sqr < max_range_sqr) {  // k was not in set, inflate it
+            const octomap::point3d central_point = tree.keyToCoord(k);
+            for (uint s = 0; s < settings.sphere.size(); s++) {
+                const octomap::point3d cur_point = central_point +
+                    octomap::point3d(settings.sphere[s][0], settings.sphere[s][1], settings.sphere[s][2]);
+                if (!frustum.IsPointWithinFrustum(Eigen::Vector3d(cur_point.x(),
+                                                                  cur_point.y(),
+                                                                  cur_point.z()))) {
+                    continue;
+                }
+                if (tree.coordToKeyChecked(cur_point, key)) {
+                   endpoints_inflated->insert(key);
+                }
+            }
+        }
+    }
+}
+
+// Raycast from origin to the endpoints in [begin, end). Rays longer than
+// max_range are cut there, and their endpoint is not occupied.
+void CastRays(const octomap::OcTree &tree,
+              const octomap::KeySet &occ_inflated,  // Inflated endpoints
+              const octomap::OcTreeKey *begin,          // Non-inflated endpoints
+              const octomap::OcTreeKey *end,
+              const octomap::point3d& origin,
+              const double &max_range,
+              octomap::KeySet *occ_slim_in_range,
+              octomap::KeySet *free_slim,
+              octomap::KeySet *free_inflated) {
+    octomap::KeyRay keyray;
+    for (const octomap::OcTreeKey *occIt = begin; occIt != end; ++occIt) {
+        const octomap::point3d& p = tree.keyToCoord(*occIt);
+
+        // If in line of sight, add free cells
+        if ((max_range < 0.0) || ((p - origin).norm() <= max_range)) {  // is not max_range_ meas.
+            octomap::OcTreeKey key;
+            if (tree.coordToKeyChecked(p, key)) {
+                occ_slim_in_range->insert(key);
+            }
+
+            // Ray keys are already checked using coordToKeyChecked
+            tree.computeRayKeys(origin, p, keyray);
+        } else {  // user set a max_range_ and length is above
+            octomap::point3d direction = (p - origin).normalized();
+            octomap::point3d new_end = origin + direction * static_cast<float>(max_range);
+            tree.computeRayKeys(origin, new_end, keyray);
+        }
+        free_slim->insert(keyray.begin(), keyray.end());
+        for (octomap::KeyRay::iterator it = keyray.begin(); it != keyray.end(); ++it) {
+            if (occ_inflated.find(*it) == occ_inflated.end()) {   // If not occupied
+                free_inflated->insert(*it);
+            } else {  // If occupied
+                break;
+            }
+        }
+    }
+}
+
+// The voxels of the key box [key_min, key_max] with z keys in [z_begin, z_end)
+// that project in front of the depth image. A voxel is free in the slim tree
+// when it is a voxel short of the nearest depth measured over its footprint in
+// the image, and free in both trees when it is also short of the inflation.
+void ProjectVoxels(const octomap::OcTree &tree,
+                   const RaycastSettings &settings,
+                   const DepthImage &image,
+                   const Eigen::Affine3d &world2cam,
+                   const algebra_3d::FrustumPlanes &frustum,
+                   const octomap::OcTreeKey &key_min,
+                   const octomap::OcTreeKey &key_max,
+                   const int z_begin,
+                   const int z_end,
+                   octomap::KeySet *free_slim,
+                   octomap::KeySet *free_inflated) {
+    const int max_radius = 16;  // Pixels, bounds the footprint of the voxels next to the camera
+    const double margin_slim = settings.resolution;
+    const double margin_inflated = settings.resolution + settings.inflate_radius;
+    const double min_range_sqr = settings.min_range*settings.min_range;
+    const double max_range_sqr = settings.max_range*settings.max_range;
+    octomap::OcTreeKey key;
+    for (int z = z_begin; z < z_end; z++) {
+        for (int y = key_min[1]; y <= key_max[1]; y++) {
+            for (int x = key_min[0]; x <= key_max[0]; x++) {
+                key = octomap::OcTreeKey(x, y, z);
+                const octomap::point3d c = tree.keyToCoord(key);
+                const Eigen::Vector3d world(c.x(), c.y(), c.z());
+                const Eigen::Vector3d cam = world2cam * world;
+                if (cam[2] <= 0 || (settings.max_range >= 0 && cam.squaredNorm() > max_range_sqr)) {
+                    continue;
+                }
+                const int u = static_cast<int>(round(image.fx * cam[0] / cam[2] + image.cx));
+                const int v = static_cast<int>(round(image.fy * cam[1] / cam[2] + image.cy));
+                if (u < 0 || v < 0 || u >= image.width || v >= image.height ||
+                    std::isnan(image.At(u, v)) || !frustum.IsPointWithinFrustum(world)) {
+                    continue;
+                }
+
+                // Nearest measurement over the pixels the voxel covers
+                const int radius = std::min(max_radius,
+                    static_cast<int>(ceil(0.5 * settings.resolution * image.fx / cam[2])));
+                float depth = std::numeric_limits<float>::infinity();
+                for (int j = std::max(0, v - radius); j <= std::min(image.height - 1, v + radius); j++) {
+                    for (int i = std::max(0, u - radius); i <= std::min(image.width - 1, u + radius); i++) {
+                        const float d = image.At(i, j);
+                        if (!std::isnan(d)) {
+                            depth = std::min(depth, d);
+                        }
+                    }
+                }
+
+                // Rays of points closer than the minimum range are not cast
+                const double ray_scale = Eigen::Vector3d(cam[0] / cam[2], cam[1] / cam[2], 1).squaredNorm();
+                if (depth * depth * ray_scale < min_range_sqr) {
+                    continue;
+                }
+                if (cam[2] < depth - margin_slim) {
+                    free_slim->insert(key);
+                }
+                if (cam[2] < depth - margin_inflated) {
+                    free_inflated->insert(key);
+                }
+            }
+        }
+    }
+}
+
+}  // namespace
+
 OctoClass::OctoClass(const double resolution) {
     tree_.setResolution(resolution);
     tree_inflated_.setResolution(resolution);
@@ -37,6 +222,12 @@ OctoClass::OctoClass() {
 
 void OctoClass::SetMemory(const double memory) {
     memory_time_ = memory;
+
+    // The fading rates changed, have FadeMemory() reschedule all nodes
+    fade_queue_ = FadeQueue();
+    for (StampMap::const_iterator it = fade_stamps_.begin(); it != fade_stamps_.end(); ++it) {
+        fade_queue_.push(std::make_pair(it->second, it->first));
+    }
     ROS_DEBUG("Fading memory time: %f seconds", memory_time_);
 }
 
@@ -55,6 +246,7 @@ void OctoClass::SetResolution(const double resolution_in) {
     tree_.setResolution(resolution_);
     tree_inflated_.setResolution(resolution_);
     this->ResetMap();
+    this->ResetGlobalMap();
 
     // Set the volumes for the node sizes
     depth_volumes_.resize(tree_depth_+1);
@@ -117,6 +309,36 @@ void OctoClass::SetMapInflation(const double inflate_radius) {
     // }
 }
 
+void OctoClass::SetDistanceFieldMax(const double max_distance) {
+    distance_field_max_ = max_distance;
+    distance_field_.Reset(resolution_, distance_field_max_);
+    ROS_DEBUG("Distance field maximum: %f meters", distance_field_max_);
+    if (!distance_field_.IsEnabled()) {
+        return;
+    }
+
+    // Add the obstacles already mapped, one per voxel of the pruned leaves
+    for (octomap::OcTree::leaf_iterator it = tree_.begin_leafs(),
+                                       end= tree_.end_leafs();
+                                       it!= end; ++it) {
+        if (!tree_.isNodeOccupied(*it)) {
+            continue;
+        }
+        const int voxels = static_cast<int>(round(it.getSize()/resolution_));
+        const octomap::point3d corner = it.getCoordinate() -
+            octomap::point3d(1, 1, 1) * static_cast<float>(0.5*(it.getSize() - resolution_));
+        for (int x = 0; x < voxels; x++) {
+            for (int y = 0; y < voxels; y++) {
+                for (int z = 0; z < voxels; z++) {
+                    distance_field_.SetObstacle(tree_.coordToKey(corner +
+                        octomap::point3d(x, y, z) * static_cast<float>(resolution_)));
+                }
+            }
+        }
+    }
+    distance_field_.Update();
+}
+
 void OctoClass::SetCamFrustum(const double fov,
                               const double aspect_ratio) {
     cam_frustum_ = algebra_3d::FrustumPlanes(fov, aspect_ratio);
@@ -126,12 +348,19 @@ void OctoClass::SetCamFrustum(const double fov,
 void OctoClass::ResetMap() {
     tree_.clear();
     tree_inflated_.clear();
+    tree_global_.clear();
+    fade_stamps_.clear();
+    fade_queue_ = FadeQueue();
+    distance_field_.Reset(resolution_, distance_field_max_);
+    new_obstacles_.clear();
+    delta_encoder_.Reset();
     ROS_DEBUG("Map was reset!");
 }
 
 void OctoClass::SetOccupancyThreshold(const double occupancy_threshold) {
     tree_.setOccupancyThres(occupancy_threshold);
     tree_inflated_.setOccupancyThres(occupancy_threshold);
+    tree_global_.setOccupancyThres(occupancy_threshold);
     ROS_DEBUG("Occupancy probability threshold: %f", occupancy_threshold);
 }
 
@@ -141,6 +370,8 @@ void OctoClass::SetHitMissProbabilities(const double probability_hit,
     tree_.setProbMiss(probability_miss);
     tree_inflated_.setProbHit(probability_hit);
     tree_inflated_.setProbMiss(probability_miss);
+    tree_global_.setProbHit(probability_hit);
+    tree_global_.setProbMiss(probability_miss);
     ROS_DEBUG("Probability hit: %f", probability_hit);
     ROS_DEBUG("Probability miss: %f", probability_miss);
 }
@@ -151,10 +382,181 @@ void OctoClass::SetClampingThresholds(const double clamping_threshold_min,
     tree_.setClampingThresMax(clamping_threshold_max);
     tree_inflated_.setClampingThresMin(clamping_threshold_min);
     tree_inflated_.setClampingThresMax(clamping_threshold_max);
+    tree_global_.setClampingThresMin(clamping_threshold_min);
+    tree_global_.setClampingThresMax(clamping_threshold_max);
     ROS_DEBUG("Clamping threshold minimum: %f", clamping_threshold_min);
     ROS_DEBUG("Clamping threshold maximum: %f", clamping_threshold_max);
 }
 
+void OctoClass::SetGlobalMap(const double global_resolution,
+                             const double local_radius) {
+    global_resolution_ = std::max(0.0, global_resolution);
+    local_radius_ = local_radius;
+    ResetGlobalMap();
+}
+
+void OctoClass::ResetGlobalMap() {
+    tree_global_.clear();
+    if (!HasGlobalMap()) {
+        ROS_DEBUG("Global map disabled");
+        return;
+    }
+
+    // The coarsest depth whose nodes are no larger than requested, at least
+    // one level above the local voxels
+    int levels = 1;
+    while (levels < tree_depth_ && resolution_ * (1 << (levels + 1)) <= global_resolution_) {
+        levels++;
+    }
+    tree_global_.setResolution(resolution_ * (1 << levels));
+    global_depth_volumes_.resize(tree_depth_+1);
+    for (unsigned i= 0; i < global_depth_volumes_.size(); ++i) {
+        global_depth_volumes_[i] = pow(tree_global_.getNodeSize(i), 3);
+    }
+    ROS_DEBUG("Global map resolution: %f meters, local radius: %f meters",
+              tree_global_.getResolution(), local_radius_);
+}
+
+void OctoClass::UpdateGlobalMap(const Eigen::Vector3d &robot_position) {
+    if (!HasGlobalMap()) {
+        return;
+    }
+
+    // The local cube, grown to the global voxels it touches
+    const double size = tree_global_.getResolution();
+    const octomap::point3d box_min(floor((robot_position[0] - local_radius_)/size)*size,
+                                   floor((robot_position[1] - local_radius_)/size)*size,
+                                   floor((robot_position[2] - local_radius_)/size)*size);
+    const octomap::point3d box_max(ceil((robot_position[0] + local_radius_)/size)*size,
+                                   ceil((robot_position[1] + local_radius_)/size)*size,
+                                   ceil((robot_position[2] + local_radius_)/size)*size);
+    const octomap::point3d margin(0.25*resolution_, 0.25*resolution_, 0.25*resolution_);
+
+    // Free volume and occupancy of the local map within each global voxel. Leaves
+    // larger than a global voxel are spread over the global voxels they cover.
+    struct Cell {
+        double free_volume = 0;
+        bool occupied = false;
+    };
+    std::unordered_map<octomap::OcTreeKey, Cell, octomap::OcTreeKey::KeyHash> cells;
+    for (octomap::OcTree::leaf_bbx_iterator it = tree_inflated_.begin_leafs_bbx(box_min + margin, box_max - margin),
+                                          end = tree_inflated_.end_leafs_bbx(); it != end; ++it) {
+        const bool occupied = tree_inflated_.isNodeOccupied(*it);
+        const double leaf_size = it.getSize();
+        if (leaf_size <= size) {
+            Cell &cell = cells[tree_global_.coordToKey(it.getCoordinate())];
+            cell.occupied |= occupied;
+            cell.free_volume += occupied ? 0.0 : leaf_size * leaf_size * leaf_size;
+            continue;
+        }
+        const int voxels = static_cast<int>(round(leaf_size/size));
+        const octomap::point3d corner = it.getCoordinate() -
+            octomap::point3d(1, 1, 1) * static_cast<float>(0.5*(leaf_size - size));
+        for (int x = 0; x < voxels; x++) {
+            for (int y = 0; y < voxels; y++) {
+                for (int z = 0; z < voxels; z++) {
+                    const octomap::point3d center = corner + octomap::point3d(x, y, z) * static_cast<float>(size);
+                    if (center.x() < box_min.x() || center.y() < box_min.y() || center.z() < box_min.z() ||
+                        center.x() > box_max.x() || center.y() > box_max.y() || center.z() > box_max.z()) {
+                        continue;
+                    }
+                    Cell &cell = cells[tree_global_.coordToKey(center)];
+                    cell.occupied |= occupied;
+                    cell.free_volume += occupied ? 0.0 : size * size * size;
+                }
+            }
+        }
+    }
+
+    // A global voxel is occupied if any of its local voxels is, and free if
+    // all of them are. Otherwise it keeps what it was, as when the robot is
+    // back in a place the local map forgot.
+    const double full = 0.999 * size * size * size;
+    for (auto it = cells.begin(); it != cells.end(); ++it) {
+        if (it->second.occupied) {
+            tree_global_.setNodeValue(it->first, tree_global_.getClampingThresMaxLog());
+        } else if (it->second.free_volume >= full) {
+            tree_global_.setNodeValue(it->first, tree_global_.getClampingThresMinLog());
+        }
+    }
+    tree_global_.prune();
+
+    CropLocalMap(box_min, box_max);
+}
+
+void OctoClass::CropLocalMap(const octomap::point3d &box_min,
+                             const octomap::point3d &box_max) {
+    // Leaves entirely outside the box. Those crossing its sides are kept whole.
+    auto outside = [&box_min, &box_max](const octomap::point3d &center, const double size) {
+        const float half = 0.5*size;
+        return center.x() + half <= box_min.x() || center.y() + half <= box_min.y() ||
+               center.z() + half <= box_min.z() || center.x() - half >= box_max.x() ||
+               center.y() - half >= box_max.y() || center.z() - half >= box_max.z();
+    };
+    typedef std::pair<octomap::OcTreeKey, unsigned int> KeyDepth;
+    std::vector<KeyDepth> deleted;
+    for (octomap::OcTree::leaf_iterator it = tree_inflated_.begin_leafs(),
+                                       end= tree_inflated_.end_leafs(); it != end; ++it) {
+        if (outside(it.getCoordinate(), it.getSize())) {
+            deleted.push_back(std::make_pair(it.getKey(), it.getDepth()));
+        }
+    }
+    for (size_t i = 0; i < deleted.size(); i++) {
+        tree_inflated_.deleteNode(deleted[i].first, deleted[i].second);
+    }
+
+    // The distance field and the deltas follow tree_ voxel by voxel
+    deleted.clear();
+    bool keyframe = false;
+    for (octomap::OcTree::leaf_iterator it = tree_.begin_leafs(),
+                                       end= tree_.end_leafs(); it != end; ++it) {
+        if (!outside(it.getCoordinate(), it.getSize())) {
+            continue;
+        }
+        deleted.push_back(std::make_pair(it.getKey(), it.getDepth()));
+        if (it.getDepth() == static_cast<unsigned int>(tree_depth_)) {
+            distance_field_.RemoveObstacle(it.getKey());
+            delta_encoder_.MarkChanged(it.getKey());
+            continue;
+        }
+        keyframe = true;
+        if (!tree_.isNodeOccupied(*it)) {
+            continue;
+        }
+        const int voxels = static_cast<int>(round(it.getSize()/resolution_));
+        const octomap::point3d corner = it.getCoordinate() -
+            octomap::point3d(1, 1, 1) * static_cast<float>(0.5*(it.getSize() - resolution_));
+        for (int x = 0; x < voxels; x++) {
+            for (int y = 0; y < voxels; y++) {
+                for (int z = 0; z < voxels; z++) {
+                    distance_field_.RemoveObstacle(tree_.coordToKey(corner +
+                        octomap::point3d(x, y, z) * static_cast<float>(resolution_)));
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < deleted.size(); i++) {
+        tree_.deleteNode(deleted[i].first, deleted[i].second);
+    }
+    // A pruned leaf went, whose voxels the deltas cannot list
+    if (keyframe) {
+        delta_encoder_.Reset();
+    }
+    distance_field_.Update();
+
+    // Drop the fading of the deleted nodes, which FadeMemory() would only
+    // do once their time comes, if at all
+    fade_queue_ = FadeQueue();
+    for (StampMap::iterator it = fade_stamps_.begin(); it != fade_stamps_.end();) {
+        if (tree_.search(it->first) == NULL) {
+            it = fade_stamps_.erase(it);
+        } else {
+            fade_queue_.push(std::make_pair(it->second, it->first));
+            ++it;
+        }
+    }
+}
+
 // Function obtained from https://github.com/OctoMap/octomap_ros
 void OctoClass::PointsOctomapToPointCloud2(const octomap::point3d_list& points,
                                            sensor_msgs::PointCloud2& cloud) {
@@ -194,92 +596,307 @@ void OctoClass::PointsOctomapToPointCloud2(const octomap::point3d_list& points,
 void OctoClass::PclToRayOctomap(const pcl::PointCloud< pcl::PointXYZ > &cloud,
                                 const tf::StampedTransform &tf_cam2world,
                                 const algebra_3d::FrustumPlanes &frustum) {
-    // set camera origin
+    RaycastUpdate update;
+    ComputeRaycastUpdate(GetRaycastSettings(), cloud, tf_cam2world, frustum, 1, &update);
+    ApplyRaycastUpdate(update);
+}
+
+RaycastSettings OctoClass::GetRaycastSettings() const {
+    RaycastSettings settings;
+    settings.resolution = resolution_;
+    settings.min_range = min_range_;
+    settings.max_range = max_range_;
+    settings.inflate_radius = inflate_radius_;
+    settings.sphere = sphere_;
+    return settings;
+}
+
+void OctoClass::ComputeRaycastUpdate(const RaycastSettings &settings,
+                                     const pcl::PointCloud< pcl::PointXYZ > &cloud,
+                                     const tf::StampedTransform &tf_cam2world,
+                                     const algebra_3d::FrustumPlanes &frustum,
+                                     const int num_threads,
+                                     RaycastUpdate *update) {
+    // An empty tree of the same resolution does the key conversions, so the
+    // map itself is never read. It is only read from by the workers.
+    const octomap::OcTree tree(settings.resolution);
     const tf::Vector3 v = tf_cam2world.getOrigin();
     const octomap::point3d cam_origin = octomap::point3d(v.getX(), v.getY(), v.getZ());
-    const double min_threshold_sqr = min_range_*min_range_;
-    const uint32_t width = cloud.width;
-    const uint32_t height = cloud.height;
-    static double range_sqr;
-
-    // discretize point cloud
-    // octomap::Pointcloud octoCloud, inflatedSafeCloud;
-    // octoCloud.reserve(cloud.height*cloud.width);
+    const int threads = std::max(1, num_threads);
+
+    // discretize point cloud, each thread taking a slice of the points
+    std::vector<octomap::KeySet> thread_endpoints(threads), thread_inflated(threads);
+    const Eigen::Vector3d origin(v.getX(), v.getY(), v.getZ());
+    RunInThreads(threads, [&tree, &settings, &cloud, &frustum, &origin, threads,
+                           &thread_endpoints, &thread_inflated](int t) {
+        const size_t begin = cloud.points.size() * t / threads;
+        const size_t end = cloud.points.size() * (t + 1) / threads;
+        DiscretizePoints(tree, settings, cloud, frustum, origin, begin, end,
+                       &thread_endpoints[t], &thread_inflated[t]);
+    });
     octomap::KeySet endpoints, endpoints_inflated;
-    static octomap::point3d central_point, cur_point;
-    const double max_range_sqr = max_range_*max_range_;
-    pcl::PointXYZ point;
-    for (uint32_t i = 0; i < height; i++) {
-        for (uint32_t j = 0; j < width; j++) {
-            point = cloud.at(j, i);
+    for (int t = 0; t < threads; t++) {
+        endpoints.insert(thread_endpoints[t].begin(), thread_endpoints[t].end());
+        endpoints_inflated.insert(thread_inflated[t].begin(), thread_inflated[t].end());
+    }
+    thread_endpoints.clear();
+    thread_inflated.clear();
+
+    // Calculate free nodes, each thread casting the rays to a slice of the endpoints
+    const std::vector<octomap::OcTreeKey> endpoint_list(endpoints.begin(), endpoints.end());
+    std::vector<octomap::KeySet> thread_occ(threads), thread_free(threads), thread_free_inflated(threads);
+    RunInThreads(threads, [&tree, &settings, &endpoint_list, &endpoints_inflated, &cam_origin, threads,
+                           &thread_occ, &thread_free, &thread_free_inflated](int t) {
+        const size_t begin = endpoint_list.size() * t / threads;
+        const size_t end = endpoint_list.size() * (t + 1) / threads;
+        CastRays(tree, endpoints_inflated, endpoint_list.data() + begin, endpoint_list.data() + end,
+                 cam_origin, settings.max_range, &thread_occ[t], &thread_free[t], &thread_free_inflated[t]);
+    });
+    octomap::KeySet free_cells;
+    update->resolution = settings.resolution;
+    update->inflate_radius = settings.inflate_radius;
+    update->occupied.clear();
+    update->occupied_inflated.clear();
+    update->free.clear();
+    for (int t = 0; t < threads; t++) {
+        update->occupied.insert(thread_occ[t].begin(), thread_occ[t].end());
+        free_cells.insert(thread_free[t].begin(), thread_free[t].end());
+        update->free.insert(thread_free_inflated[t].begin(), thread_free_inflated[t].end());
+    }
 
-            // Check if the point is invalid
-            if (std::isnan(point.x) || std::isnan(point.y) || std::isnan(point.z)) {
-                continue;
-            }
+    // Only add nodes that are being added to the slim tree as well
+    for (octomap::KeySet::iterator it = endpoints_inflated.begin(); it != endpoints_inflated.end(); ++it) {
+        if (free_cells.find(*it) != free_cells.end() || endpoints.find(*it) != endpoints.end()) {
+            update->occupied_inflated.insert(*it);
+        }
+    }
+}
 
-            // Check if point is within camera frustum
-            if (!frustum.IsPointWithinFrustum(Eigen::Vector3d(point.x, point.y, point.z))) {
+void OctoClass::ComputeDepthImageUpdate(const RaycastSettings &settings,
+                                        const DepthImage &image,
+                                        const tf::StampedTransform &tf_cam2world,
+                                        const algebra_3d::FrustumPlanes &frustum,
+                                        const int num_threads,
+                                        RaycastUpdate *update) {
+    const octomap::OcTree tree(settings.resolution);
+    const tf::Vector3 v = tf_cam2world.getOrigin();
+    const tf::Quaternion q = tf_cam2world.getRotation();
+    Eigen::Affine3d cam2world = Eigen::Affine3d::Identity();
+    cam2world.translation() << v.getX(), v.getY(), v.getZ();
+    cam2world.rotate(Eigen::Quaterniond(q.getW(), q.getX(), q.getY(), q.getZ()));
+    const Eigen::Affine3d world2cam = cam2world.inverse();
+    const int threads = std::max(1, num_threads);
+
+    // The measured points in the world, and the farthest depth to clear up to
+    pcl::PointCloud< pcl::PointXYZ > cloud;
+    cloud.points.reserve(image.depth.size());
+    double far = 0;
+    for (int r = 0; r < image.height; r++) {
+        for (int c = 0; c < image.width; c++) {
+            const float d = image.At(c, r);
+            if (std::isnan(d) || d <= 0) {
                 continue;
             }
+            const Eigen::Vector3d p = cam2world * Eigen::Vector3d(d * (c - image.cx) / image.fx,
+                                                                  d * (r - image.cy) / image.fy, d);
+            cloud.points.push_back(pcl::PointXYZ(p[0], p[1], p[2]));
+            far = std::max(far, static_cast<double>(d));
+        }
+    }
+    if (settings.max_range >= 0) {
+        far = std::min(far, settings.max_range);
+    }
 
-            // points too close to origin of camera are not added
-            range_sqr = this->VectorNormSquared(v.getX()-point.x,
-                                                v.getY()-point.y,
-                                                v.getZ()-point.z);
-            if ((range_sqr < min_threshold_sqr)) {
-                continue;
-            }
+    // Discretize the endpoints, as for a point cloud
+    std::vector<octomap::KeySet> thread_endpoints(threads), thread_inflated(threads);
+    const Eigen::Vector3d origin = cam2world.translation();
+    RunInThreads(threads, [&tree, &settings, &cloud, &frustum, &origin, threads,
+                           &thread_endpoints, &thread_inflated](int t) {
+        const size_t begin = cloud.points.size() * t / threads;
+        const size_t end = cloud.points.size() * (t + 1) / threads;
+        DiscretizePoints(tree, settings, cloud, frustum, origin, begin, end,
+                       &thread_endpoints[t], &thread_inflated[t]);
+    });
+    octomap::KeySet endpoints, endpoints_inflated;
+    for (int t = 0; t < threads; t++) {
+        endpoints.insert(thread_endpoints[t].begin(), thread_endpoints[t].end());
+        endpoints_inflated.insert(thread_inflated[t].begin(), thread_inflated[t].end());
+    }
+    thread_endpoints.clear();
+    thread_inflated.clear();
+
+    // The box of the frustum up to the farthest depth, in keys
+    Eigen::Vector3d box_min = origin, box_max = origin;
+    const double corners[4][2] = {{0, 0}, {image.width - 1.0, 0},
+                                  {0, image.height - 1.0}, {image.width - 1.0, image.height - 1.0}};
+    for (int i = 0; i < 4; i++) {
+        const Eigen::Vector3d p = cam2world * Eigen::Vector3d(far * (corners[i][0] - image.cx) / image.fx,
+                                                              far * (corners[i][1] - image.cy) / image.fy, far);
+        box_min = box_min.cwiseMin(p);
+        box_max = box_max.cwiseMax(p);
+    }
+    octomap::OcTreeKey key_min, key_max;
+    std::vector<octomap::KeySet> thread_free(threads), thread_free_inflated(threads);
+    if (far > 0 && tree.coordToKeyChecked(octomap::point3d(box_min[0], box_min[1], box_min[2]), key_min) &&
+        tree.coordToKeyChecked(octomap::point3d(box_max[0], box_max[1], box_max[2]), key_max)) {
+        RunInThreads(threads, [&tree, &settings, &image, &world2cam, &frustum, &key_min, &key_max, threads,
+                               &thread_free, &thread_free_inflated](int t) {
+            const int depth = key_max[2] - key_min[2] + 1;
+            ProjectVoxels(tree, settings, image, world2cam, frustum, key_min, key_max,
+                          key_min[2] + depth * t / threads, key_min[2] + depth * (t + 1) / threads,
+                          &thread_free[t], &thread_free_inflated[t]);
+        });
+    }
+    octomap::KeySet free_cells;
+    update->resolution = settings.resolution;
+    update->inflate_radius = settings.inflate_radius;
+    update->occupied.clear();
+    update->occupied_inflated.clear();
+    update->free.clear();
+    for (int t = 0; t < threads; t++) {
+        free_cells.insert(thread_free[t].begin(), thread_free[t].end());
+        update->free.insert(thread_free_inflated[t].begin(), thread_free_inflated[t].end());
+    }
 
-            // create discretized octocloud
-            octomap::OcTreeKey k = tree_.coordToKey(octomap::point3d(point.x,
-                                                                     point.y,
-                                                                     point.z));
-            // Add non-repeated nodes to keysets (inflated and non-inflated)
-            std::pair<octomap::KeySet::iterator, bool> ret = endpoints.insert(k);
-            octomap::OcTreeKey key;
-            if (ret.second) {  // insertion took place => k was not in set
-                // insert points in inflated octomap
-                if (range_sqr < max_range_sqr) {
-                    central_point = tree_.keyToCoord(k);
-                    for (uint j = 0; j < sphere_.size(); j++) {
-                        cur_point = central_point + octomap::point3d(sphere_[j][0], sphere_[j][1], sphere_[j][2]);
-                        if (!frustum.IsPointWithinFrustum(Eigen::Vector3d(cur_point.x(),
-                                                                          cur_point.y(),
-                                                                          cur_point.z()))) {
-                            continue;
-                        }
-                        if (tree_.coordToKeyChecked(cur_point, key)) {
-                           endpoints_inflated.insert(key);
-                        }
-                    }
-                }
+    // The endpoints within range are occupied, and never free
+    for (octomap::KeySet::iterator it = endpoints.begin(); it != endpoints.end(); ++it) {
+        if (settings.max_range < 0 || (tree.keyToCoord(*it) - octomap::point3d(origin[0], origin[1], origin[2])).norm()
+                                      <= settings.max_range) {
+            update->occupied.insert(*it);
+        }
+        update->free.erase(*it);
+    }
+    for (octomap::KeySet::iterator it = endpoints_inflated.begin(); it != endpoints_inflated.end(); ++it) {
+        update->free.erase(*it);
+        if (free_cells.find(*it) != free_cells.end() || endpoints.find(*it) != endpoints.end()) {
+            update->occupied_inflated.insert(*it);
+        }
+    }
+}
+
+bool OctoClass::DepthImageFromCloud(const pcl::PointCloud< pcl::PointXYZ > &cloud,
+                                    DepthImage *image) {
+    if (cloud.height <= 1 || cloud.points.size() != cloud.width * cloud.height) {
+        return false;
+    }
+
+    // Fit u = fx x / z + cx and v = fy y / z + cy by least squares
+    Eigen::Matrix2d a_u = Eigen::Matrix2d::Zero(), a_v = Eigen::Matrix2d::Zero();
+    Eigen::Vector2d b_u = Eigen::Vector2d::Zero(), b_v = Eigen::Vector2d::Zero();
+    image->width = cloud.width;
+    image->height = cloud.height;
+    image->depth.assign(cloud.points.size(), std::numeric_limits<float>::quiet_NaN());
+    for (int r = 0; r < image->height; r++) {
+        for (int c = 0; c < image->width; c++) {
+            const pcl::PointXYZ &point = cloud.points[r * image->width + c];
+            if (std::isnan(point.x) || std::isnan(point.y) || std::isnan(point.z) || point.z <= 0) {
+                continue;
             }
+            image->depth[r * image->width + c] = point.z;
+            const Eigen::Vector2d x(point.x / point.z, 1), y(point.y / point.z, 1);
+            a_u += x * x.transpose();
+            b_u += x * c;
+            a_v += y * y.transpose();
+            b_v += y * r;
         }
     }
+    if (a_u.determinant() <= 0 || a_v.determinant() <= 0) {
+        return false;
+    }
+    const Eigen::Vector2d k_u = a_u.ldlt().solve(b_u), k_v = a_v.ldlt().solve(b_v);
+    image->fx = k_u[0];
+    image->cx = k_u[1];
+    image->fy = k_v[0];
+    image->cy = k_v[1];
+
+    if (image->fx <= 0 || image->fy <= 0) {
+        return false;
+    }
 
-    // Calculate free nodes
-    octomap::KeySet occ_cells_in_range, free_cells, inflated_free_cells;
-    ComputeUpdate(endpoints_inflated, endpoints, cam_origin, max_range_,
-                  &occ_cells_in_range, &free_cells, &inflated_free_cells);
+    // With lens distortion the points are not on the pixels of the fitted
+    // camera, so they are projected again, keeping the nearest per pixel
+    std::vector<float> depth(image->depth.size(), std::numeric_limits<float>::quiet_NaN());
+    for (size_t i = 0; i < cloud.points.size(); i++) {
+        if (std::isnan(image->depth[i])) {
+            continue;
+        }
+        const pcl::PointXYZ &point = cloud.points[i];
+        const int u = static_cast<int>(round(image->fx * point.x / point.z + image->cx));
+        const int v = static_cast<int>(round(image->fy * point.y / point.z + image->cy));
+        if (u < 0 || v < 0 || u >= image->width || v >= image->height) {
+            continue;
+        }
+        float &d = depth[v * image->width + u];
+        if (std::isnan(d) || point.z < d) {
+            d = point.z;
+        }
+    }
+    image->depth.swap(depth);
+    return true;
+}
 
-    for (octomap::KeySet::iterator it = endpoints_inflated.begin(); it != endpoints_inflated.end(); ++it) {
-        // Only add nodes that are being added to the slim tree as well
-        if (free_cells.find(*it) != free_cells.end()) {
-            tree_inflated_.updateNode(*it, true);
-        } else if (endpoints.find(*it) != endpoints.end()) {
-            tree_inflated_.updateNode(*it, true);
+void OctoClass::VoxelDownsample(const pcl::PointCloud< pcl::PointXYZ > &cloud,
+                                const double voxel_size,
+                                pcl::PointCloud< pcl::PointXYZ > *downsampled) {
+    // Cells are indexed on 21 bits per axis, which covers kilometers even at
+    // millimeter voxels. They are aligned with the octomap grid, whose
+    // voxel boundaries are at multiples of the resolution.
+    const double inv_size = 1.0 / voxel_size;
+    const int64_t offset = 1 << 20, mask = (1 << 21) - 1;
+    std::unordered_set<uint64_t> occupied_cells;
+    occupied_cells.reserve(cloud.points.size() / 4);
+    downsampled->points.clear();
+    downsampled->points.reserve(cloud.points.size() / 4);
+    for (size_t i = 0; i < cloud.points.size(); i++) {
+        const pcl::PointXYZ &point = cloud.points[i];
+        if (std::isnan(point.x) || std::isnan(point.y) || std::isnan(point.z)) {
+            continue;
         }
+        const uint64_t cell =
+            ((static_cast<int64_t>(std::floor(point.x * inv_size)) + offset) & mask) |
+            (((static_cast<int64_t>(std::floor(point.y * inv_size)) + offset) & mask) << 21) |
+            (((static_cast<int64_t>(std::floor(point.z * inv_size)) + offset) & mask) << 42);
+        if (occupied_cells.insert(cell).second) {
+            downsampled->points.push_back(point);
+        }
+    }
+    downsampled->header = cloud.header;
+    downsampled->width = downsampled->points.size();
+    downsampled->height = 1;
+    downsampled->is_dense = true;
+}
+
+bool OctoClass::ApplyRaycastUpdate(const RaycastUpdate &update) {
+    if (update.resolution != resolution_ || update.inflate_radius != inflate_radius_) {
+        ROS_DEBUG("Map settings changed while raycasting, dropping the point cloud");
+        return false;
     }
-    for (octomap::KeySet::iterator it = occ_cells_in_range.begin(); it != occ_cells_in_range.end(); ++it) {
-        // const octomap::point3d& p = tree_.keyToCoord(*it);
-        // if ((p - cam_origin).norm() <= max_range_) {
-            tree_.updateNode(*it, true);
-        // }
+    for (octomap::KeySet::const_iterator it = update.occupied_inflated.begin();
+         it != update.occupied_inflated.end(); ++it) {
+        tree_inflated_.updateNode(*it, true);
     }
-    for (octomap::KeySet::iterator it = inflated_free_cells.begin(); it != inflated_free_cells.end(); ++it) {
-            tree_inflated_.updateNode(*it, false);
-            tree_.updateNode(*it, false);
+    const double now = ros::Time::now().toSec();
+    for (octomap::KeySet::const_iterator it = update.occupied.begin(); it != update.occupied.end(); ++it) {
+        RefreshNode(*it, now);
+        UpdateObstacle(*it, tree_.updateNode(*it, true));
+    }
+    for (octomap::KeySet::const_iterator it = update.free.begin(); it != update.free.end(); ++it) {
+        tree_inflated_.updateNode(*it, false);
+        RefreshNode(*it, now);
+        UpdateObstacle(*it, tree_.updateNode(*it, false));
+    }
+    distance_field_.Update();
+    return true;
+}
+
+void OctoClass::UpdateObstacle(const octomap::OcTreeKey &key,
+                               const octomap::OcTreeNode* node) {
+    delta_encoder_.MarkChanged(key);
+    if (node != NULL && tree_.isNodeOccupied(node)) {
+        distance_field_.SetObstacle(key);
+        new_obstacles_.insert(key);
+    } else {
+        distance_field_.RemoveObstacle(key);
     }
 }
 
@@ -290,73 +907,85 @@ void OctoClass::ComputeUpdate(const octomap::KeySet &occ_inflated,  // Inflated
                               octomap::KeySet *occ_slim_in_range,
                               octomap::KeySet *free_slim,
                               octomap::KeySet *free_inflated) {
-    octomap::KeyRay keyray;
-    for (octomap::KeySet::const_iterator occIt = occ_slim.begin(); occIt != occ_slim.end(); ++occIt) {
-        const octomap::point3d& p = tree_inflated_.keyToCoord(*occIt);
+    const std::vector<octomap::OcTreeKey> endpoint_list(occ_slim.begin(), occ_slim.end());
+    CastRays(tree_inflated_, occ_inflated, endpoint_list.data(), endpoint_list.data() + endpoint_list.size(),
+             origin, max_range, occ_slim_in_range, free_slim, free_inflated);
+}
 
-        // If in line of sight, add free cells
-        if ((max_range < 0.0) || ((p - origin).norm() <= max_range)) {  // is not max_range_ meas.
-            octomap::OcTreeKey key;
-            if (tree_.coordToKeyChecked(p, key)) {
-                occ_slim_in_range->insert(key);
-            }
+// Only the nodes due to fade out are visited. The others fade lazily, when
+// they are measured again (see RefreshNode()) or when their turn comes.
+void OctoClass::FadeMemory() {
+    const double now = ros::Time::now().toSec();
+    while (!fade_queue_.empty() && fade_queue_.top().first <= now) {
+        const octomap::OcTreeKey key = fade_queue_.top().second;
+        fade_queue_.pop();
+        StampMap::iterator stamp = fade_stamps_.find(key);
+        if (stamp == fade_stamps_.end()) {
+            continue;
+        }
+        octomap::OcTreeNode* n = tree_.search(key);
+        if (n == NULL) {
+            fade_stamps_.erase(stamp);
+            continue;
+        }
 
-            // Ray keys are already checked using coordToKeyChecked
-            tree_inflated_.computeRayKeys(origin, p, keyray);
-            free_slim->insert(keyray.begin(), keyray.end());
-            for (octomap::KeyRay::iterator it = keyray.begin(); it != keyray.end(); ++it) {
-                if (occ_inflated.find(*it) == occ_inflated.end()) {   // If not occupied
-                    free_inflated->insert(*it);
-                } else {  // If occupied
-                    break;
-                }
-            }
-        } else {  // user set a max_range_ and length is above
-            octomap::point3d direction = (p - origin).normalized();
-            octomap::point3d new_end = origin + direction * static_cast<float>(max_range);
-            tree_inflated_.computeRayKeys(origin, new_end, keyray);
-            free_slim->insert(keyray.begin(), keyray.end());
-            for (octomap::KeyRay::iterator it = keyray.begin(); it != keyray.end(); ++it) {
-                if (occ_inflated.find(*it) == occ_inflated.end()) {  // If not occupied
-                    free_inflated->insert(*it);
-                } else {  // If occupied
-                    break;
-                }
-            }
+        // Measured again since it was queued, so it fades out later
+        const double expiry = stamp->second + TimeToFade(n->getLogOdds(), tree_.isNodeOccupied(n));
+        if (expiry > now) {
+            fade_queue_.push(std::make_pair(expiry, key));
+            continue;
         }
+
+        // Faded to unknown, delete node
+        tree_.deleteNode(key);
+        distance_field_.RemoveObstacle(key);
+        delta_encoder_.MarkChanged(key);
+        fade_stamps_.erase(stamp);
     }
+    distance_field_.Update();
 }
 
-void OctoClass::FadeMemory(const double &rate) {  // rate at which this function is being called
-    const double clamp_log_max = tree_.getClampingThresMaxLog();
-    const double clamp_log_min = tree_.getClampingThresMinLog();
-    const double occ_thres = tree_.getOccupancyThres();
-    // const double probLogHit = tree.getProbHitLog();
-    const double prob_log_range_obs = clamp_log_max - occ_thres;
-    const double prob_log_range_free = clamp_log_min - occ_thres;
-    const double fading_obs_log_prob_per_run = -prob_log_range_obs/(memory_time_*rate);
-    const double fading_free_log_prob_per_run = -prob_log_range_free/(memory_time_*rate);
+void OctoClass::RefreshNode(const octomap::OcTreeKey &key, const double &now) {
+    std::pair<StampMap::iterator, bool> ret = fade_stamps_.insert(std::make_pair(key, now));
+    if (ret.second) {  // New node, FadeMemory() schedules it on its next run
+        fade_queue_.push(std::make_pair(now, key));
+        return;
+    }
 
-    static bool is_occ;
-    static octomap::OcTreeKey key;
-    for (octomap::OcTree::leaf_iterator it = tree_.begin_leafs(),
-                                       end= tree_.end_leafs();
-                                       it!= end; ++it) {
-        // fade obstacles and free areas
-        key = it.getKey();
-        octomap::OcTreeNode* n = tree_.search(key);
-        is_occ = tree_.isNodeOccupied(n);
-        if (is_occ) {
-            tree_.updateNodeLogOdds(n, fading_obs_log_prob_per_run);
-        } else {
-            tree_.updateNodeLogOdds(n, fading_free_log_prob_per_run);
+    // Apply the fading since the last measurement, before adding this one
+    const octomap::OcTreeNode* n = tree_.search(key);
+    if (n != NULL && memory_time_ > 0) {
+        const bool is_occ = tree_.isNodeOccupied(n);
+        const float fading = FadeRate(is_occ) * (now - ret.first->second);
+        // By key, a node found in a pruned parent would fade its siblings too
+        n = tree_.updateNode(key, fading);
+        if (is_occ != tree_.isNodeOccupied(n)) {
+            tree_.deleteNode(key);
         }
+    }
+    ret.first->second = now;
+}
 
-        // tree nodes that are unknown
-        if (is_occ != tree_.isNodeOccupied(n)) {  // if it was occupied then disoccupied, delete node
-            tree_.deleteNode(key, it.getDepth());
-        }
+// Log-odds change per second, toward the occupancy threshold
+double OctoClass::FadeRate(const bool &is_occ) const {
+    const double occ_thres = tree_.getOccupancyThres();
+    if (is_occ) {
+        return -(tree_.getClampingThresMaxLog() - occ_thres)/memory_time_;
+    }
+    return -(tree_.getClampingThresMinLog() - occ_thres)/memory_time_;
+}
+
+// Seconds until a node of the given log-odds crosses the occupancy threshold
+double OctoClass::TimeToFade(const double &log_odds, const bool &is_occ) const {
+    if (memory_time_ <= 0) {
+        return std::numeric_limits<double>::infinity();
     }
+    const double rate = FadeRate(is_occ);
+    const double distance = log_odds - tree_.getOccupancyThresLog();
+    if ((is_occ && rate >= 0) || (!is_occ && rate <= 0)) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return std::max(0.0, -distance/rate);
 }
 
 void OctoClass::InflateObstacles(const double &thickness) {
@@ -412,58 +1041,80 @@ void OctoClass::InflateObstacles(const double &thickness) {
 
 void OctoClass::FindCollidingNodesTree(const pcl::PointCloud< pcl::PointXYZ > &point_cloud,
                                        std::vector<octomap::point3d> *colliding_nodes) {
-    static octomap::point3d query, node_center;
-    static octomap::OcTreeNode* node;
-    static octomap::OcTreeKey key;
-    octomap::KeySet endpoints;
+    FindCollidingNodes(tree_, point_cloud, colliding_nodes);
+}
 
-    const int cloudsize = point_cloud.size();
+void OctoClass::FindCollidingNodesInflated(const pcl::PointCloud< pcl::PointXYZ > &point_cloud,
+                                           std::vector<octomap::point3d> *colliding_nodes) {
+    FindCollidingNodes(tree_inflated_, point_cloud, colliding_nodes);
+}
 
+void OctoClass::FindCollidingNodes(const octomap::OcTree &tree,
+                                   const pcl::PointCloud< pcl::PointXYZ > &point_cloud,
+                                   std::vector<octomap::point3d> *colliding_nodes) {
+    octomap::KeySet endpoints;
+    const int cloudsize = point_cloud.size();
     for (int j = 0; j < cloudsize; j++) {
-        query = octomap::point3d(point_cloud.points[j].x,
-                                 point_cloud.points[j].y,
-                                 point_cloud.points[j].z);
-        key = tree_.coordToKey(query);
+        const octomap::point3d query(point_cloud.points[j].x,
+                                     point_cloud.points[j].y,
+                                     point_cloud.points[j].z);
+        const octomap::OcTreeKey key = tree.coordToKey(query);
         std::pair<octomap::KeySet::iterator, bool> ret = endpoints.insert(key);
 
         // check if current node has not been evaluated yet
         if (ret.second) {  // insertion took place => new node being evaluated
-            node = tree_.search(query);
+            const octomap::OcTreeNode* node = tree.search(key);
             if (node == NULL) {
                 continue;
-            } else if (tree_.isNodeOccupied(node)) {
-                node_center = tree_.keyToCoord(key);
-                colliding_nodes->push_back(node_center);
+            } else if (tree.isNodeOccupied(node)) {
+                colliding_nodes->push_back(tree.keyToCoord(key));
             }
         }
     }
 }
 
-void OctoClass::FindCollidingNodesInflated(const pcl::PointCloud< pcl::PointXYZ > &point_cloud,
-                                           std::vector<octomap::point3d> *colliding_nodes) {
-    static octomap::point3d query, node_center;
-    static octomap::OcTreeNode* node;
-    static octomap::OcTreeKey key;
-    octomap::KeySet endpoints;
+void OctoClass::PublishSnapshot() {
+    if (!use_snapshots_) {
+        return;
+    }
+    OctomapSnapshotPtr snapshot = std::make_shared<const OctomapSnapshot>(tree_, tree_inflated_, inflate_radius_);
+    std::atomic_store(&snapshot_, snapshot);
+}
 
-    const int cloudsize = point_cloud.size();
+OctomapSnapshotPtr OctoClass::GetSnapshot() const {
+    return std::atomic_load(&snapshot_);
+}
 
-    for (int j = 0; j < cloudsize; j++) {
-        query = octomap::point3d(point_cloud.points[j].x,
-                                 point_cloud.points[j].y,
-                                 point_cloud.points[j].z);
-        key = tree_inflated_.coordToKey(query);
-        std::pair<octomap::KeySet::iterator, bool> ret = endpoints.insert(key);
+void OctoClass::TakeNewObstacles(std::vector<octomap::OcTreeKey> *keys) {
+    keys->assign(new_obstacles_.begin(), new_obstacles_.end());
+    new_obstacles_.clear();
+}
+
+bool OctoClass::EncodeDelta(const bool keyframe,
+                            ff_msgs::OctomapDelta *delta) {
+    return delta_encoder_.Encode(tree_, keyframe, delta);
+}
+
+void OctoClass::SetSnapshots(const bool use_snapshots) {
+    use_snapshots_ = use_snapshots;
+    if (use_snapshots_) {
+        PublishSnapshot();
+    } else {
+        std::atomic_store(&snapshot_, OctomapSnapshotPtr());
+    }
+}
 
+void OctoClass::FindCollidingNodesDistance(const pcl::PointCloud< pcl::PointXYZ > &point_cloud,
+                                           const double &radius,
+                                           std::vector<octomap::point3d> *colliding_nodes) {
+    octomap::KeySet endpoints;
+    for (size_t j = 0; j < point_cloud.size(); j++) {
+        const octomap::OcTreeKey key = tree_.coordToKey(octomap::point3d(point_cloud.points[j].x,
+                                                                         point_cloud.points[j].y,
+                                                                         point_cloud.points[j].z));
         // check if current node has not been evaluated yet
-        if (ret.second) {  // insertion took place => new node being evaluated
-            node = tree_inflated_.search(query);
-            if (node == NULL) {
-                continue;
-            } else if (tree_inflated_.isNodeOccupied(node)) {
-                node_center = tree_inflated_.keyToCoord(key);
-                colliding_nodes->push_back(node_center);
-            }
+        if (endpoints.insert(key).second && distance_field_.Distance(key) <= radius) {
+            colliding_nodes->push_back(tree_.keyToCoord(key));
         }
     }
 }
@@ -685,6 +1336,20 @@ bool OctoClass::CheckCollision(const Eigen::Vector3d &p) {
     return CheckCollision(octomap::point3d(p[0], p[1], p[2]));
 }
 
+// Returns 1 if unknown or within radius of an obstacle, from the distance field
+bool OctoClass::CheckCollision(const Eigen::Vector3d &p,
+                               const double &radius) {
+    const octomap::OcTreeKey key = tree_.coordToKey(octomap::point3d(p[0], p[1], p[2]));
+    if (tree_.search(key) == NULL) {
+        return true;
+    }
+    return distance_field_.Distance(key) <= radius;
+}
+
+double OctoClass::GetObstacleDistance(const Eigen::Vector3d &p) {
+    return distance_field_.Distance(tree_.coordToKey(octomap::point3d(p[0], p[1], p[2])));
+}
+
 bool OctoClass::CheckCollision(const octomap::point3d &p1,
                                const octomap::point3d &p2) {
     octomap::KeyRay ray;
@@ -723,6 +1388,8 @@ bool OctoClass::CheckCollision(const Eigen::Vector3d &p1,
 void OctoClass::BBXFreeVolume(const Eigen::Vector3d &box_min,
                               const Eigen::Vector3d &box_max,
                               double *volume) {
+    const octomap::OcTree &tree = PlanningTree();
+    const std::vector<double> &volumes = PlanningVolumes();
     // Initialize vector with zeros
     std::vector<uint> n_nodes_per_depth(tree_depth_ + 1);
     for (uint i = 0; i < n_nodes_per_depth.size(); i++) {
@@ -733,16 +1400,16 @@ void OctoClass::BBXFreeVolume(const Eigen::Vector3d &box_min,
     octomap::OcTree::leaf_bbx_iterator it;
     uint depth;
     const octomap::OcTreeNode* n;
-    for (it = tree_inflated_.begin_leafs_bbx(octomap::point3d(box_min[0], box_min[1], box_min[2]),
-                                             octomap::point3d(box_max[0], box_max[1], box_max[2]));
-                                             it != tree_inflated_.end_leafs_bbx(); ++it) {
-        n = tree_inflated_.search(it.getKey());
+    for (it = tree.begin_leafs_bbx(octomap::point3d(box_min[0], box_min[1], box_min[2]),
+                                   octomap::point3d(box_max[0], box_max[1], box_max[2]));
+                                   it != tree.end_leafs_bbx(); ++it) {
+        n = tree.search(it.getKey());
         if (n == NULL) {
             continue;
         }
 
         // Count free nodes per depth
-        if (!tree_inflated_.isNodeOccupied(n)) {
+        if (!tree.isNodeOccupied(n)) {
             depth = it.getDepth();
             n_nodes_per_depth[depth] = n_nodes_per_depth[depth] + 1;
         }
@@ -752,7 +1419,7 @@ void OctoClass::BBXFreeVolume(const Eigen::Vector3d &box_min,
     *volume = 0;
     for (uint i = 0; i < n_nodes_per_depth.size(); i++) {
         // ROS_INFO("Nodes in depth %d: %d", int(i), int(n_nodes_per_depth[i]));
-        *volume = *volume + static_cast<double>(n_nodes_per_depth[i]) * depth_volumes_[i];
+        *volume = *volume + static_cast<double>(n_nodes_per_depth[i]) * volumes[i];
     }
     // ROS_INFO("Volume calculated: %f", volume);
 }
@@ -761,6 +1428,8 @@ void OctoClass::BBXFreeVolume(const Eigen::Vector3d &box_min,
 void OctoClass::BBXOccVolume(const Eigen::Vector3d &box_min,
                              const Eigen::Vector3d &box_max,
                              double *volume) {
+    const octomap::OcTree &tree = PlanningTree();
+    const std::vector<double> &volumes = PlanningVolumes();
     // Initialize vector with zeros
     std::vector<uint> n_nodes_per_depth(tree_depth_ + 1);
     for (uint i = 0; i < n_nodes_per_depth.size(); i++) {
@@ -771,16 +1440,16 @@ void OctoClass::BBXOccVolume(const Eigen::Vector3d &box_min,
     octomap::OcTree::leaf_bbx_iterator it;
     uint depth;
     const octomap::OcTreeNode* n;
-    for (it = tree_inflated_.begin_leafs_bbx(octomap::point3d(box_min[0], box_min[1], box_min[2]),
-                                           octomap::point3d(box_max[0], box_max[1], box_max[2]));
-                                           it != tree_inflated_.end_leafs_bbx(); ++it) {
-        n = tree_inflated_.search(it.getKey());
+    for (it = tree.begin_leafs_bbx(octomap::point3d(box_min[0], box_min[1], box_min[2]),
+                                   octomap::point3d(box_max[0], box_max[1], box_max[2]));
+                                   it != tree.end_leafs_bbx(); ++it) {
+        n = tree.search(it.getKey());
         if (n == NULL) {
             continue;
         }
 
         // Count free nodes per depth
-        if (tree_inflated_.isNodeOccupied(n)) {
+        if (tree.isNodeOccupied(n)) {
             depth = it.getDepth();
             n_nodes_per_depth[depth] = n_nodes_per_depth[depth] + 1;
         }
@@ -790,7 +1459,7 @@ void OctoClass::BBXOccVolume(const Eigen::Vector3d &box_min,
     *volume = 0;
     for (uint i = 0; i < n_nodes_per_depth.size(); i++) {
         // ROS_INFO("Nodes in depth %d: %d", int(i), int(n_nodes_per_depth[i]));
-        *volume = *volume + static_cast<double>(n_nodes_per_depth[i]) * depth_volumes_[i];
+        *volume = *volume + static_cast<double>(n_nodes_per_depth[i]) * volumes[i];
     }
     // ROS_INFO("Volume calculated: %f", volume);
 }
@@ -800,24 +1469,25 @@ void OctoClass::BBXFreeNodes(const Eigen::Vector3d &box_min,
                              const Eigen::Vector3d &box_max,
                              std::vector<octomap::OcTreeKey> *node_keys,
                              std::vector<double> *node_sizes) {
+    const octomap::OcTree &tree = PlanningTree();
     octomap::OcTree::leaf_bbx_iterator it;
     // uint depth;
     const octomap::OcTreeNode* n;
     // octomap::point3d nodeCenter;
     octomap::OcTreeKey key;
-    for (it = tree_inflated_.begin_leafs_bbx(octomap::point3d(box_min[0], box_min[1], box_min[2]),
-                                           octomap::point3d(box_max[0], box_max[1], box_max[2]));
-                                           it != tree_inflated_.end_leafs_bbx(); ++it) {
+    for (it = tree.begin_leafs_bbx(octomap::point3d(box_min[0], box_min[1], box_min[2]),
+                                   octomap::point3d(box_max[0], box_max[1], box_max[2]));
+                                   it != tree.end_leafs_bbx(); ++it) {
         key = it.getKey();
-        n = tree_inflated_.search(key);
+        n = tree.search(key);
         if (n == NULL) {
             continue;
         }
 
-        if (!tree_inflated_.isNodeOccupied(n)) {
+        if (!tree.isNodeOccupied(n)) {
             // nodeCenter = tree.keyToCoord(key);
             node_keys->push_back(key);
-            node_sizes->push_back(tree_inflated_.getNodeSize(it.getDepth()));
+            node_sizes->push_back(tree.getNodeSize(it.getDepth()));
         }
     }
 }
@@ -827,22 +1497,26 @@ void OctoClass::BBXFreeNodes(const Eigen::Vector3d &box_min,
                              const Eigen::Vector3d &box_max,
                              IndexedKeySet *indexed_node_keys,
                              std::vector<double> *node_sizes) {
+    const octomap::OcTree &tree = PlanningTree();
+    const double resolution = PlanningResolution();
     octomap::OcTree::leaf_bbx_iterator it;
     const octomap::OcTreeNode* n;
     octomap::OcTreeKey key;
     uint index = 0;
-    for (it = tree_inflated_.begin_leafs_bbx(octomap::point3d(box_min[0], box_min[1], box_min[2]),
-                                           octomap::point3d(box_max[0], box_max[1], box_max[2]));
-                                           it != tree_inflated_.end_leafs_bbx(); ++it) {
+    indexed_node_keys->ReserveBox(octomap::point3d(box_min[0], box_min[1], box_min[2]),
+                                  octomap::point3d(box_max[0], box_max[1], box_max[2]), resolution);
+    for (it = tree.begin_leafs_bbx(octomap::point3d(box_min[0], box_min[1], box_min[2]),
+                                   octomap::point3d(box_max[0], box_max[1], box_max[2]));
+                                   it != tree.end_leafs_bbx(); ++it) {
         key = it.getKey();
-        n = tree_inflated_.search(key);
+        n = tree.search(key);
         if (n == NULL) {
             continue;
         }
 
-        if (!tree_inflated_.isNodeOccupied(n)) {
+        if (!tree.isNodeOccupied(n)) {
             indexed_node_keys->Insert(key, index);
-            node_sizes->push_back(tree_inflated_.getNodeSize(it.getDepth()));
+            node_sizes->push_back(tree.getNodeSize(it.getDepth()));
             index++;
         }
     }
@@ -851,11 +1525,13 @@ void OctoClass::BBXFreeNodes(const Eigen::Vector3d &box_min,
 void OctoClass::GetNodeNeighbors(const octomap::OcTreeKey &node_key,
                                  const double &node_size,
                                  std::vector<octomap::OcTreeKey> *neighbor_keys) {
+    const octomap::OcTree &tree = PlanningTree();
+    const double resolution = PlanningResolution();
     // const double size = getNodeSize(node_key);
-    const Eigen::Vector3d Bounds = Eigen::Vector3d((node_size + resolution_)/2.0,
-                                                   (node_size + resolution_)/2.0,
-                                                   (node_size + resolution_)/2.0);
-    octomap::point3d node_pos = tree_inflated_.keyToCoord(node_key);
+    const Eigen::Vector3d Bounds = Eigen::Vector3d((node_size + resolution)/2.0,
+                                                   (node_size + resolution)/2.0,
+                                                   (node_size + resolution)/2.0);
+    octomap::point3d node_pos = tree.keyToCoord(node_key);
     Eigen::Vector3d pos = Eigen::Vector3d(node_pos.x(), node_pos.y(), node_pos.z());
 
     // Get free nodes within a bounding box
@@ -877,18 +1553,20 @@ void OctoClass::GetNodeNeighbors(const octomap::OcTreeKey &node_key,
 
 // Returns size of node. Returns zero if node doesn't exist
 double OctoClass::GetNodeSize(const octomap::OcTreeKey &key) {
+    const octomap::OcTree &tree = PlanningTree();
+    const double resolution = PlanningResolution();
     const octomap::OcTreeNode* n;
-    n = tree_inflated_.search(key);
+    n = tree.search(key);
     if (n == NULL) {
         return 0.0;
     } else {
-        const octomap::point3d bounds = octomap::point3d(resolution_/4.0,
-                                                         resolution_/4.0,
-                                                         resolution_/4.0);
-        const octomap::point3d pos = tree_inflated_.keyToCoord(key);
+        const octomap::point3d bounds = octomap::point3d(resolution/4.0,
+                                                         resolution/4.0,
+                                                         resolution/4.0);
+        const octomap::point3d pos = tree.keyToCoord(key);
         octomap::OcTree::leaf_bbx_iterator it;
-        it = tree_inflated_.begin_leafs_bbx(pos-bounds, pos+bounds);
-        return tree_inflated_.getNodeSize(it.getDepth());
+        it = tree.begin_leafs_bbx(pos-bounds, pos+bounds);
+        return tree.getNodeSize(it.getDepth());
     }
 }
 
@@ -0,0 +1,204 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "mapper/octomap_delta.h"
+
+namespace octoclass {
+
+namespace {
+
+typedef std::pair<uint64_t, uint8_t> Entry;  // Packed key, depth and state
+
+uint64_t PackKey(const octomap::OcTreeKey &key) {
+    return static_cast<uint64_t>(key[0]) |
+           (static_cast<uint64_t>(key[1]) << 16) |
+           (static_cast<uint64_t>(key[2]) << 32);
+}
+
+octomap::OcTreeKey UnpackKey(const uint64_t packed) {
+    return octomap::OcTreeKey(packed & 0xFFFF, (packed >> 16) & 0xFFFF, (packed >> 32) & 0xFFFF);
+}
+
+uint8_t NodeState(const octomap::OcTree &tree,
+                  const octomap::OcTreeNode *node) {
+    if (node == NULL) {
+        return VOXEL_UNKNOWN;
+    }
+    return tree.isNodeOccupied(node) ? VOXEL_OCCUPIED : VOXEL_FREE;
+}
+
+void WriteVarint(uint64_t value,
+                 std::vector<uint8_t> *data) {
+    while (value >= 0x80) {
+        data->push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    data->push_back(static_cast<uint8_t>(value));
+}
+
+bool ReadVarint(const std::vector<uint8_t> &data,
+                size_t *pos,
+                uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*pos >= data.size()) {
+            return false;
+        }
+        const uint8_t byte = data[(*pos)++];
+        *value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+OctomapDeltaEncoder::OctomapDeltaEncoder() : version_(0), need_keyframe_(true) {}
+
+void OctomapDeltaEncoder::MarkChanged(const octomap::OcTreeKey &key) {
+    if (!need_keyframe_) {
+        changed_.insert(key);
+    }
+}
+
+void OctomapDeltaEncoder::Reset() {
+    changed_.clear();
+    sent_.clear();
+    need_keyframe_ = true;
+}
+
+bool OctomapDeltaEncoder::Encode(const octomap::OcTree &tree,
+                                 const bool keyframe,
+                                 ff_msgs::OctomapDelta *msg) {
+    const unsigned int max_depth = tree.getTreeDepth();
+    std::vector<Entry> entries;
+    const bool is_keyframe = keyframe || need_keyframe_;
+    if (is_keyframe) {
+        Reset();
+        for (octomap::OcTree::leaf_iterator it = tree.begin_leafs(),
+                                           end = tree.end_leafs();
+                                           it != end; ++it) {
+            entries.push_back(std::make_pair(PackKey(it.getKey()),
+                                             (it.getDepth() << 2) | NodeState(tree, &(*it))));
+        }
+    } else {
+        // Voxels changed back to what was sent are skipped
+        for (octomap::KeySet::const_iterator it = changed_.begin(); it != changed_.end(); ++it) {
+            const uint8_t state = NodeState(tree, tree.search(*it));
+            std::pair<StateMap::iterator, bool> sent = sent_.insert(std::make_pair(*it, state));
+            if (!sent.second) {
+                if (sent.first->second == state) {
+                    continue;
+                }
+                sent.first->second = state;
+            }
+            entries.push_back(std::make_pair(PackKey(*it), (max_depth << 2) | state));
+        }
+        changed_.clear();
+        if (entries.empty()) {
+            return false;
+        }
+    }
+    need_keyframe_ = false;
+
+    // Sorted keys are close to each other, so most differences take a byte or two
+    std::sort(entries.begin(), entries.end());
+    msg->data.clear();
+    msg->data.reserve(3*entries.size());
+    uint64_t previous = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        WriteVarint(entries[i].first - previous, &msg->data);
+        msg->data.push_back(entries[i].second);
+        previous = entries[i].first;
+    }
+    msg->header.stamp = ros::Time::now();
+    msg->header.frame_id = "world";
+    msg->version = ++version_;
+    msg->keyframe = is_keyframe;
+    msg->resolution = tree.getResolution();
+    msg->num_voxels = entries.size();
+    return true;
+}
+
+OctomapDeltaDecoder::OctomapDeltaDecoder() : version_(0), has_map_(false) {}
+
+bool OctomapDeltaDecoder::Apply(const ff_msgs::OctomapDelta &msg,
+                                octomap::OcTree *tree) {
+    if (msg.keyframe) {
+        tree->clear();
+        tree->setResolution(msg.resolution);
+    } else if (!has_map_ || msg.version != version_ + 1) {
+        return false;
+    }
+    has_map_ = false;
+
+    const unsigned int max_depth = tree->getTreeDepth();
+    size_t pos = 0;
+    uint64_t packed = 0, delta;
+    for (uint32_t i = 0; i < msg.num_voxels; i++) {
+        if (!ReadVarint(msg.data, &pos, &delta) || pos >= msg.data.size()) {
+            return false;
+        }
+        packed += delta;
+        const uint8_t code = msg.data[pos++];
+        const unsigned int depth = code >> 2;
+        if (depth > max_depth || packed >> 48 != 0) {
+            return false;
+        }
+        SetVoxels(UnpackKey(packed), depth, code & 0x3, tree);
+    }
+    tree->updateInnerOccupancy();
+    tree->prune();
+
+    version_ = msg.version;
+    has_map_ = true;
+    return true;
+}
+
+void OctomapDeltaDecoder::SetVoxels(const octomap::OcTreeKey &key,
+                                    const unsigned int depth,
+                                    const uint8_t state,
+                                    octomap::OcTree *tree) {
+    const unsigned int max_depth = tree->getTreeDepth();
+    if (state == VOXEL_UNKNOWN) {
+        tree->deleteNode(key, depth);
+        return;
+    }
+    const float value = (state == VOXEL_OCCUPIED) ? tree->getClampingThresMaxLog()
+                                                  : tree->getClampingThresMinLog();
+
+    // A pruned leaf stands for all the voxels below it, from its lowest key on
+    const int levels = max_depth - depth;
+    const int side = 1 << levels;
+    const int mask = ~(side - 1);
+    const int base[3] = {key[0] & mask, key[1] & mask, key[2] & mask};
+    for (int x = 0; x < side; x++) {
+        for (int y = 0; y < side; y++) {
+            for (int z = 0; z < side; z++) {
+                tree->setNodeValue(octomap::OcTreeKey(base[0] + x, base[1] + y, base[2] + z), value, true);
+            }
+        }
+    }
+}
+
+}  // namespace octoclass
@@ -77,8 +77,6 @@ void SampledTrajectory3D::SetMaxDev(const double &max_dev) {
 void SampledTrajectory3D::SetResolution(const double &resolution) {
     resolution_ = resolution;
     thickness_ = 1.4*resolution;
-    thick_traj_.setResolution(resolution_);
-    thick_traj_.clear();
     ROS_DEBUG("Trajectory resolution is set to: %f", resolution_);
 }
 
@@ -166,311 +164,66 @@ void SampledTrajectory3D::CompressSamples() {
 }
 
 
-// It is highly likely that the original Author was Bob Pendelton
-// I translated this algorithm from Matlab into C++ based on:
-// http://www.mathworks.com/matlabcentral/fileexchange/21057-3d-bresenham-s-line-generation?focused=5102923&tab=function
-void SampledTrajectory3D::Bresenham(const Eigen::Vector3d &p0,
-                                    const Eigen::Vector3d &pf,
-                                    std::vector<octomap::point3d> *points) {
-    // Get initial and final pixel positions
-    static int x1, x2, y1, y2, z1, z2;
-    x1 = round(p0[0]/resolution_);
-    x2 = round(pf[0]/resolution_);
-    y1 = round(p0[1]/resolution_);
-    y2 = round(pf[1]/resolution_);
-    z1 = round(p0[2]/resolution_);
-    z2 = round(pf[2]/resolution_);
-
-    // Get the output vector length
-    static int dx, dy, dz;
-    dx = x2 - x1;
-    dy = y2 - y1;
-    dz = z2 - z1;
-    const int d = std::max({abs(dx), abs(dy), abs(dz)}) + 1;
-    // Eigen::MatrixXi Pixels(d,3);
-    points->reserve(d);
-
-    // Extra variables
-    static int ax, ay, az, sx, sy, sz, x, y, z, xd, yd, zd;
-    ax = abs(dx)*2;
-    ay = abs(dy)*2;
-    az = abs(dz)*2;
-    sx = (dx > 0) - (dx < 0);  // ign of dx
-    sy = (dy > 0) - (dy < 0);  // ign of dy
-    sz = (dz > 0) - (dz < 0);  // ign of dz
-    x = x1;
-    y = y1;
-    z = z1;
-    // idx = 0;
-
-    octomap::point3d point;
-    if (ax >= std::max(ay, az)) {  //  dominant
-        yd = ay - ax/2;
-        zd = az - ax/2;
-
-        while (true) {
-            // Pixel << x, y, z;
-            // Pixels.row(idx) = Pixel;
-            // idx = idx + 1;
-            point = octomap::point3d(static_cast<double>(x)*resolution_,
-                                     static_cast<double>(y)*resolution_,
-                                     static_cast<double>(z)*resolution_);
-            points->push_back(point);
-
-            if (x == x2) {
-                break;
-            }
-
-            if (yd >=0) {  // Move along y
-                y = y + sy;
-                yd = yd - ax;
-            }
-
-            if (zd >= 0) {  // Move along z
-                z = z + sz;
-                zd = zd - ax;
-            }
-
-            x = x + sx;  // Move along x
-            yd = yd + ay;
-            zd = zd + az;
-        }
-    } else if (ay >= std::max(ax, az)) {  //  dominant
-        xd = ax - ay/2;
-        zd = az - ay/2;
-
-        while (true) {
-            // Pixel << x, y, z;
-            // Pixels.row(idx) = Pixel;
-            // idx = idx + 1;
-            point = octomap::point3d(static_cast<double>(x)*resolution_,
-                                     static_cast<double>(y)*resolution_,
-                                     static_cast<double>(z)*resolution_);
-            points->push_back(point);
-
-            if (y == y2) {
-                break;
-            }
-
-            if (xd >= 0) {
-                x = x + sx;
-                xd = xd - ay;
-            }
-
-            if (zd >= 0) {
-                z = z + sz;
-                zd = zd - ay;
-            }
-
-            y = y + sy;
-            xd = xd + ax;
-            zd = zd + az;
-        }
-    } else if (az >= std::max(ax, ay)) {  //  dominant
-        xd = ax - az/2;
-        yd = ay - az/2;
-
-        while (true) {
-            // Pixel << x, y, z;
-            // Pixels.row(idx) = Pixel;
-            // idx = idx + 1;
-            point = octomap::point3d(static_cast<double>(x)*resolution_,
-                                     static_cast<double>(y)*resolution_,
-                                     static_cast<double>(z)*resolution_);
-            points->push_back(point);
-
-            if (z == z2) {
-                break;
-            }
-
-            if (xd >= 0) {
-                x = x + sx;
-                xd = xd - az;
-            }
-
-            if (yd >= 0) {
-                y = y + sy;
-                yd = yd - az;
-            }
-
-            z = z + sz;
-            xd = xd + ax;
-            yd = yd + ay;
-        }
-    }
-}
-
-// Algorithm for getting a "thick" line based on bresenham
-// TODO(marcelino): Some voxels are painted twice, which can be improved.
-void SampledTrajectory3D::ThickBresenham(const Eigen::Vector3d &p0,
-                                         const Eigen::Vector3d &pf) {
-    // Get vector in the direction of the trajectory (if length is greater than 0)
-    static Eigen::Vector3d v1 = pf - p0;
-    if (v1.norm() > 0) {
-        v1 = v1/v1.norm();
-    } else {
-        v1 << 1, 0, 0;
-    }
-
-
-    // Set all pixels in a sphere around the origin
-    // The pixels are assigned as initialEdge, finalEdge or trajectory padding
-    std::vector<octomap::point3d> padding, init_edge_padding, final_edge_padding;
-    static octomap::point3d xyz, v1_point3d;
-    const int max_xyz = static_cast<int>(round(thickness_/resolution_));
-    const float max_dist = thickness_*thickness_;
-    static float d_origin, d_plane;
-    v1_point3d = octomap::point3d(v1[0], v1[1], v1[2]);
-    for (int x = -max_xyz; x <= max_xyz; x++) {
-        for (int y = -max_xyz; y <= max_xyz; y++) {
-            for (int z = -max_xyz; z <= max_xyz; z++) {
-                xyz = octomap::point3d(x*resolution_, y*resolution_, z*resolution_);
-
-                d_origin = xyz.dot(xyz);  // Distance from origin squared
-                if (d_origin > max_dist) {
-                    continue;
-                }
-
-                // Assign to proper vector
-                d_plane = v1_point3d.dot(xyz);
-                if (d_plane > 0.85*resolution_) {
-                    final_edge_padding.push_back(xyz);
-                } else if (d_plane < -0.5*resolution_) {
-                    init_edge_padding.push_back(xyz);
-                } else {
-                    padding.push_back(xyz);
-                }
-            }
-        }
-    }
-
-    // Get the standard bresenham
-    std::vector<octomap::point3d> thin_bresenham;
-    this->Bresenham(p0, pf, &thin_bresenham);
-
-    // Vector that is used to displace pixels based on origin at 0
-    // to pixels in octree based origin (there is no pixel at the)
-    // origin in octrees
-    static octomap::point3d ds;
-    ds = octomap::point3d(resolution_/2.0, resolution_/2.0, resolution_/2.0);
-
-    // Add padding around thin_bresenham to get thick_bresenham
-    const bool lazy_eval = true;
-    for (uint i = 0; i < thin_bresenham.size(); i++) {
-        for (uint j = 0; j < padding.size(); j++) {
-            // Pixels.push_back(thin_bresenham[i] + padding[j] + ds);
-            thick_traj_.updateNode(thin_bresenham[i] + padding[j] + ds, true, lazy_eval);
-        }
-    }
-
-    // Add edge padding
-    for (uint j = 0; j < init_edge_padding.size(); j++) {
-        // Pixels.push_back(thin_bresenham[0] + init_edge_padding[j] + ds);
-        thick_traj_.updateNode(thin_bresenham[0] + init_edge_padding[j] + ds, true, lazy_eval);
-    }
-    for (uint j = 0; j < final_edge_padding.size(); j++) {
-        // Pixels.push_back(thin_bresenham[thin_bresenhamthin_bresenham.size()-1] + final_edge_padding[j] + ds);
-        thick_traj_.updateNode(thin_bresenham[thin_bresenham.size()-1] + final_edge_padding[j] + ds, true, lazy_eval);
-    }
-    // std::cout << init_edge_padding.size() << std::endl;
-    // Pixels = padding;
-}
-
-void SampledTrajectory3D::ThickTrajToPcl() {
-    pcl::PointXYZ point;
-    point_cloud_traj_.clear();
-
-    // Iterate through trajectory points
-    for (octomap::OcTree::leaf_iterator it = thick_traj_.begin_leafs(),
-                                       end = thick_traj_.end_leafs();
-                                       it != end; ++it) {
-        point.x = it.getX();
-        point.y = it.getY();
-        point.z = it.getZ();
-        point_cloud_traj_.push_back(point);
-    }
-}
-
-void SampledTrajectory3D::CreateKdTree() {
-    *cloud_ptr_ = pos_;
-    kdtree_pos_.setInputCloud(cloud_ptr_);
+void SampledTrajectory3D::CreateBvh() {
+    bvh_.Build(compressed_pos_, compressed_time_, thickness_);
+    full_check_ = true;
 }
 
-void SampledTrajectory3D::SortCollisions(const std::vector<octomap::point3d> &colliding_nodes,
+void SampledTrajectory3D::SortCollisions(const SegmentBvh &bvh,
+                                         const std::vector<SegmentCollision> &collisions,
                                          std::vector<geometry_msgs::PointStamped> *samples) {
-    pcl::PointXYZ search_point;
-    int K = 1;  // Search for 1 nearest neighbor
-    std::vector<int> point_idx(K);
-    std::vector<float> point_sqr_dist(K);
+    // Place each collision at the closest point of the trajectory
     geometry_msgs::PointStamped sample;
-    samples->resize(colliding_nodes.size());
-
-    for (uint i = 0; i < colliding_nodes.size(); i++) {
-        search_point.x = colliding_nodes[i].x();
-        search_point.y = colliding_nodes[i].y();
-        search_point.z = colliding_nodes[i].z();
-        kdtree_pos_.nearestKSearch(search_point, K, point_idx, point_sqr_dist);
-        sample.point.x = cloud_ptr_->points[point_idx[0]].x;
-        sample.point.y = cloud_ptr_->points[point_idx[0]].y;
-        sample.point.z = cloud_ptr_->points[point_idx[0]].z;
-        sample.header.stamp = ros::Time(time_[point_idx[0]]);
-        sample.header.seq = point_idx[0];
+    samples->resize(collisions.size());
+    for (uint i = 0; i < collisions.size(); i++) {
+        const Eigen::Vector3d point = bvh.PointAt(collisions[i].segment, collisions[i].t);
+        sample.point.x = point[0];
+        sample.point.y = point[1];
+        sample.point.z = point[2];
+        sample.header.stamp = ros::Time(bvh.TimeAt(collisions[i].segment, collisions[i].t));
+        sample.header.seq = collisions[i].segment;
         (*samples)[i] = sample;
     }
     std::sort(samples->begin(), samples->end(), ComparePointStamped);
 }
 
 
-void SampledTrajectory3D::TrajVisMarkers(visualization_msgs::MarkerArray* marker_array) {    // Publish occupied nodes
-    // Markers: each marker array stores a set of nodes with similar size
-    // visualization_msgs::MarkerArray occupiedNodesVis;
-    const int tree_depth = thick_traj_.getTreeDepth();
-    marker_array->markers.resize(tree_depth+1);
+void SampledTrajectory3D::TrajVisMarkers(visualization_msgs::MarkerArray* marker_array) {
+    // The capsules are drawn as lines as wide as they are
     const ros::Time rostime = ros::Time::now();
+    visualization_msgs::Marker marker;
 
     // Set color parameters
     std_msgs::ColorRGBA color;
     color = visualization_functions::Color::Orange();
     color.a = 0.15;
 
-    // Publish all leafs from the tree
-    for (octomap::OcTree::leaf_iterator it = thick_traj_.begin_leafs(),
-                                       end = thick_traj_.end_leafs();
-                                       it != end; ++it) {
-        if (thick_traj_.isNodeOccupied(*it)) {
-            // Get depth in the tree
-            unsigned idx = it.getDepth();
-            geometry_msgs::Point point_center;
-            point_center.x = it.getX();
-            point_center.y = it.getY();
-            point_center.z = it.getZ();
-            marker_array->markers[idx].points.push_back(point_center);
-
-            // Get color based on height
-            // double h = (1.0 - std::min(std::max((PointCenter.z-minZ)/ (maxZ - minZ), 0.0), 1.0))*colorFactor;
-            marker_array->markers[idx].colors.push_back(color);
+    for (int i = 0; i < n_compressed_points_-1; i++) {
+        for (int j = i; j <= i+1; j++) {
+            geometry_msgs::Point point;
+            point.x = compressed_pos_[j][0];
+            point.y = compressed_pos_[j][1];
+            point.z = compressed_pos_[j][2];
+            marker.points.push_back(point);
+            marker.colors.push_back(color);
         }
     }
 
     // Set marker properties
-    for (unsigned i= 0; i < marker_array->markers.size(); ++i) {
-        double size = thick_traj_.getNodeSize(i);
-
-        marker_array->markers[i].header.frame_id = "world";
-        marker_array->markers[i].header.stamp = rostime;
-        marker_array->markers[i].ns = "thick_traj";
-        marker_array->markers[i].id = i;
-        marker_array->markers[i].type = visualization_msgs::Marker::CUBE_LIST;
-        marker_array->markers[i].scale.x = size;
-        marker_array->markers[i].scale.y = size;
-        marker_array->markers[i].scale.z = size;
-        marker_array->markers[i].pose.orientation.w = 1.0;
-
-        if (marker_array->markers[i].points.size() > 0)
-            marker_array->markers[i].action = visualization_msgs::Marker::ADD;
-        else
-            marker_array->markers[i].action = visualization_msgs::Marker::DELETE;
-    }
+    marker.header.frame_id = "world";
+    marker.header.stamp = rostime;
+    marker.ns = "thick_traj";
+    marker.id = 0;
+    marker.type = visualization_msgs::Marker::LINE_LIST;
+    marker.scale.x = 2.0*thickness_;
+    marker.pose.orientation.w = 1.0;
+
+    if (marker.points.size() > 0)
+        marker.action = visualization_msgs::Marker::ADD;
+    else
+        marker.action = visualization_msgs::Marker::DELETE;
+
+    marker_array->markers.push_back(marker);
 }
 
 void SampledTrajectory3D::SamplesVisMarkers(visualization_msgs::MarkerArray* marker_array) {
@@ -564,8 +317,7 @@ void SampledTrajectory3D::ClearObject() {
     this->compressed_pos_.clear();
     this->compressed_time_.clear();
     this->n_compressed_points_ = 0;
-    this->thick_traj_.clear();
-    this->point_cloud_traj_.clear();
+    this->bvh_.Clear();
 }
 
 // Return the sample with lowest time
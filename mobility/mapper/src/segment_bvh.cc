@@ -0,0 +1,348 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "mapper/segment_bvh.h"
+
+namespace sampled_traj {
+
+namespace {
+
+double PointBoxSqDistance(const Eigen::Vector3d &p,
+                          const Eigen::Vector3d &box_min,
+                          const Eigen::Vector3d &box_max) {
+    double sq_dist = 0.0;
+    for (int i = 0; i < 3; i++) {
+        if (p[i] < box_min[i]) {
+            sq_dist += (box_min[i] - p[i])*(box_min[i] - p[i]);
+        } else if (p[i] > box_max[i]) {
+            sq_dist += (p[i] - box_max[i])*(p[i] - box_max[i]);
+        }
+    }
+    return sq_dist;
+}
+
+bool CompareCollisionTime(const std::pair<double, SegmentCollision> &a,
+                          const std::pair<double, SegmentCollision> &b) {
+    return a.first < b.first;
+}
+
+}  // namespace
+
+SegmentBvh::SegmentBvh() : radius_(0.0) {}
+
+void SegmentBvh::Build(const std::vector<Eigen::Vector3d> &points,
+                       const std::vector<double> &times,
+                       const double radius) {
+    Clear();
+    if (points.empty() || points.size() != times.size()) {
+        return;
+    }
+    points_ = points;
+    times_ = times;
+    radius_ = radius;
+
+    // A single point is a segment of zero length
+    if (points_.size() == 1) {
+        points_.push_back(points_[0]);
+        times_.push_back(times_[0]);
+    }
+
+    std::vector<int> segments(NumSegments());
+    for (int i = 0; i < NumSegments(); i++) {
+        segments[i] = i;
+    }
+    nodes_.reserve(2*segments.size());
+    BuildNode(&segments, 0, segments.size());
+}
+
+void SegmentBvh::Clear() {
+    points_.clear();
+    times_.clear();
+    nodes_.clear();
+}
+
+int SegmentBvh::SegmentAtTime(const double time) const {
+    if (points_.size() < 2) {
+        return 0;
+    }
+    const int after = std::upper_bound(times_.begin(), times_.end(), time) - times_.begin();
+    return std::min(std::max(after - 1, 0), NumSegments() - 1);
+}
+
+int SegmentBvh::FirstIntersection(const Eigen::Vector3d &box_min,
+                                  const Eigen::Vector3d &box_max,
+                                  const double extra_radius,
+                                  const int from_segment,
+                                  double *t) const {
+    if (nodes_.empty()) {
+        return -1;
+    }
+    const double pad = radius_ + extra_radius;
+    const double sq_pad = pad*pad;
+    int first = -1;
+    double seg_t;
+    std::vector<int> stack(1, 0);
+    while (!stack.empty()) {
+        const int index = stack.back();
+        stack.pop_back();
+        const Node &node = nodes_[index];
+        // Only segments before the one found so far are of interest
+        if ((first >= 0 && node.first_segment >= first) || node.last_segment < from_segment ||
+            !Overlaps(index, box_min, box_max, pad)) {
+            continue;
+        }
+        if (node.left < 0) {
+            const int s = node.first_segment;
+            if (SegmentBoxSqDistance(points_[s], points_[s+1], box_min, box_max, &seg_t) <= sq_pad) {
+                first = s;
+                *t = seg_t;
+            }
+            continue;
+        }
+        // Visit the earlier segments first
+        stack.push_back(node.right);
+        stack.push_back(node.left);
+    }
+    return first;
+}
+
+void SegmentBvh::FindCollisions(const octomap::OcTree &tree,
+                                const double extra_radius,
+                                const int from_segment,
+                                std::vector<SegmentCollision> *collisions) const {
+    collisions->clear();
+    const octomap::OcTreeNode *root = tree.getRoot();
+    if (nodes_.empty() || root == NULL) {
+        return;
+    }
+    // The root of an octree is centered at the origin
+    Descend(tree, root, Eigen::Vector3d::Zero(), tree.getNodeSize(0), extra_radius, from_segment, collisions);
+    SortByTime(collisions);
+}
+
+void SegmentBvh::FindCollisions(const octomap::OcTree &tree,
+                                const std::vector<octomap::OcTreeKey> &keys,
+                                const double extra_radius,
+                                const int from_segment,
+                                std::vector<SegmentCollision> *collisions) const {
+    collisions->clear();
+    if (nodes_.empty()) {
+        return;
+    }
+    const double res = tree.getResolution();
+    const Eigen::Vector3d half_size = Eigen::Vector3d::Constant(0.5*res);
+    double t;
+    for (size_t i = 0; i < keys.size(); i++) {
+        // The voxel may have been freed, or pruned into a larger node, since
+        const octomap::OcTreeNode *node = tree.search(keys[i]);
+        if (node == NULL || !tree.isNodeOccupied(node)) {
+            continue;
+        }
+        const octomap::point3d p = tree.keyToCoord(keys[i]);
+        const Eigen::Vector3d center(p.x(), p.y(), p.z());
+        const int segment = FirstIntersection(center - half_size, center + half_size, extra_radius, from_segment, &t);
+        if (segment < 0) {
+            continue;
+        }
+        SegmentCollision collision;
+        collision.center = p;
+        collision.size = res;
+        collision.segment = segment;
+        collision.t = t;
+        collisions->push_back(collision);
+    }
+    SortByTime(collisions);
+}
+
+void SegmentBvh::SortByTime(std::vector<SegmentCollision> *collisions) const {
+    std::vector<std::pair<double, SegmentCollision> > timed(collisions->size());
+    for (size_t i = 0; i < collisions->size(); i++) {
+        timed[i] = std::make_pair(TimeAt((*collisions)[i].segment, (*collisions)[i].t), (*collisions)[i]);
+    }
+    std::stable_sort(timed.begin(), timed.end(), CompareCollisionTime);
+    for (size_t i = 0; i < timed.size(); i++) {
+        (*collisions)[i] = timed[i].second;
+    }
+}
+
+Eigen::Vector3d SegmentBvh::PointAt(const int segment,
+                                    const double t) const {
+    return points_[segment] + t*(points_[segment+1] - points_[segment]);
+}
+
+double SegmentBvh::TimeAt(const int segment,
+                          const double t) const {
+    return times_[segment] + t*(times_[segment+1] - times_[segment]);
+}
+
+// The squared distance is convex and piecewise quadratic along the segment,
+// with pieces delimited by where each coordinate enters or leaves the box.
+// The minimum is found exactly by minimizing the quadratic of each piece.
+double SegmentBvh::SegmentBoxSqDistance(const Eigen::Vector3d &p0,
+                                        const Eigen::Vector3d &p1,
+                                        const Eigen::Vector3d &box_min,
+                                        const Eigen::Vector3d &box_max,
+                                        double *t) {
+    const Eigen::Vector3d d = p1 - p0;
+    double breaks[8];
+    int n_breaks = 0;
+    breaks[n_breaks++] = 0.0;
+    breaks[n_breaks++] = 1.0;
+    for (int i = 0; i < 3; i++) {
+        if (d[i] == 0.0) {
+            continue;
+        }
+        const double t_min = (box_min[i] - p0[i])/d[i];
+        const double t_max = (box_max[i] - p0[i])/d[i];
+        if (t_min > 0.0 && t_min < 1.0) {
+            breaks[n_breaks++] = t_min;
+        }
+        if (t_max > 0.0 && t_max < 1.0) {
+            breaks[n_breaks++] = t_max;
+        }
+    }
+    std::sort(breaks, breaks + n_breaks);
+
+    double best_sq_dist = std::numeric_limits<double>::infinity();
+    *t = 0.0;
+    for (int k = 0; k + 1 < n_breaks; k++) {
+        const double t_a = breaks[k], t_b = breaks[k+1];
+        const Eigen::Vector3d mid = p0 + 0.5*(t_a + t_b)*d;
+
+        // Within the piece, the clamped coordinates contribute (p0 + t*d - bound)^2
+        double a = 0.0, b = 0.0;
+        for (int i = 0; i < 3; i++) {
+            double bound;
+            if (mid[i] < box_min[i]) {
+                bound = box_min[i];
+            } else if (mid[i] > box_max[i]) {
+                bound = box_max[i];
+            } else {
+                continue;
+            }
+            a += d[i]*d[i];
+            b += d[i]*(p0[i] - bound);
+        }
+        const double t_piece = (a > 0.0) ? std::min(t_b, std::max(t_a, -b/a)) : t_a;
+        const double sq_dist = PointBoxSqDistance(p0 + t_piece*d, box_min, box_max);
+        if (sq_dist < best_sq_dist) {
+            best_sq_dist = sq_dist;
+            *t = t_piece;
+        }
+    }
+    return best_sq_dist;
+}
+
+int SegmentBvh::BuildNode(std::vector<int> *segments,
+                          const int begin,
+                          const int end) {
+    const int index = nodes_.size();
+    nodes_.push_back(Node());
+    Node node;
+    node.box_min = points_[(*segments)[begin]];
+    node.box_max = node.box_min;
+    node.first_segment = (*segments)[begin];
+    node.last_segment = node.first_segment;
+    for (int i = begin; i < end; i++) {
+        const int s = (*segments)[i];
+        node.box_min = node.box_min.cwiseMin(points_[s]).cwiseMin(points_[s+1]);
+        node.box_max = node.box_max.cwiseMax(points_[s]).cwiseMax(points_[s+1]);
+        node.first_segment = std::min(node.first_segment, s);
+        node.last_segment = std::max(node.last_segment, s);
+    }
+    node.left = -1;
+    node.right = -1;
+
+    if (end - begin > 1) {
+        // Split at the median of the segment midpoints, along the longest axis
+        int axis;
+        (node.box_max - node.box_min).maxCoeff(&axis);
+        const int mid = (begin + end)/2;
+        const std::vector<Eigen::Vector3d> &points = points_;
+        std::nth_element(segments->begin() + begin, segments->begin() + mid, segments->begin() + end,
+                         [&points, axis](const int a, const int b) {
+                             return points[a][axis] + points[a+1][axis] < points[b][axis] + points[b+1][axis];
+                         });
+        node.left = BuildNode(segments, begin, mid);
+        node.right = BuildNode(segments, mid, end);
+        // The earlier segments are searched first
+        if (nodes_[node.right].first_segment < nodes_[node.left].first_segment) {
+            std::swap(node.left, node.right);
+        }
+    }
+    nodes_[index] = node;
+    return index;
+}
+
+void SegmentBvh::Descend(const octomap::OcTree &tree,
+                         const octomap::OcTreeNode *node,
+                         const Eigen::Vector3d &center,
+                         const double size,
+                         const double extra_radius,
+                         const int from_segment,
+                         std::vector<SegmentCollision> *collisions) const {
+    // Nothing below a map node which no capsule reaches can collide
+    const Eigen::Vector3d half_size = Eigen::Vector3d::Constant(0.5*size);
+    double t;
+    const int segment = FirstIntersection(center - half_size, center + half_size, extra_radius, from_segment, &t);
+    if (segment < 0) {
+        return;
+    }
+
+    if (!tree.nodeHasChildren(node)) {
+        if (tree.isNodeOccupied(node)) {
+            SegmentCollision collision;
+            collision.center = octomap::point3d(center[0], center[1], center[2]);
+            collision.size = size;
+            collision.segment = segment;
+            collision.t = t;
+            collisions->push_back(collision);
+        }
+        return;
+    }
+
+    // Children are numbered with bit 0 along x, bit 1 along y and bit 2 along z
+    const double offset = 0.25*size;
+    for (unsigned int i = 0; i < 8; i++) {
+        if (!tree.nodeChildExists(node, i)) {
+            continue;
+        }
+        const Eigen::Vector3d child_center = center + Eigen::Vector3d((i & 1) ? offset : -offset,
+                                                                      (i & 2) ? offset : -offset,
+                                                                      (i & 4) ? offset : -offset);
+        Descend(tree, tree.getNodeChild(node, i), child_center, 0.5*size, extra_radius, from_segment, collisions);
+    }
+}
+
+bool SegmentBvh::Overlaps(const int node,
+                          const Eigen::Vector3d &box_min,
+                          const Eigen::Vector3d &box_max,
+                          const double pad) const {
+    const Node &n = nodes_[node];
+    for (int i = 0; i < 3; i++) {
+        if (n.box_min[i] - pad > box_max[i] || n.box_max[i] + pad < box_min[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace sampled_traj
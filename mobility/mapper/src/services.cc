@@ -27,6 +27,7 @@ bool MapperNodelet::UpdateResolution(ff_msgs::SetFloat::Request &req,
                                      ff_msgs::SetFloat::Response &res) {
     pthread_mutex_lock(&mutexes_.octomap);
         globals_.octomap.SetResolution(req.data);
+        globals_.octomap.PublishSnapshot();
     pthread_mutex_unlock(&mutexes_.octomap);
 
     res.success = true;
@@ -48,6 +49,7 @@ bool MapperNodelet::MapInflation(ff_msgs::SetFloat::Request &req,
                                  ff_msgs::SetFloat::Response &res) {
     pthread_mutex_lock(&mutexes_.octomap);
         globals_.octomap.SetMapInflation(req.data);
+        globals_.octomap.PublishSnapshot();
     pthread_mutex_unlock(&mutexes_.octomap);
 
     res.success = true;
@@ -58,6 +60,7 @@ bool MapperNodelet::ResetMap(std_srvs::Trigger::Request &req,
                              std_srvs::Trigger::Response &res) {
     pthread_mutex_lock(&mutexes_.octomap);
         globals_.octomap.ResetMap();
+        globals_.octomap.PublishSnapshot();
     pthread_mutex_unlock(&mutexes_.octomap);
 
     res.success = true;
@@ -81,6 +84,7 @@ if (req.timestamp >= zones_.timestamp) {
   fs::path zone_file(std::to_string(zones_.timestamp.sec) + ".bin");
   if (!ff_util::Serialization::WriteFile(
     (zone_dir_ / zone_file).native(), zones_)) return false;
+  UpdateKeepInOutZones();
   UpdateKeepInOutMarkers();
   return true;
 }
@@ -25,6 +25,7 @@ namespace mapper {
 
 // Thread for fading memory of the octomap
 void MapperNodelet::FadeTask() {
+    ConfigureThread("fade");
     ROS_DEBUG("Fading Memory Thread started with rate %f: ", fading_memory_update_rate_);
 
     // Rate at which this thread will run
@@ -36,7 +37,8 @@ void MapperNodelet::FadeTask() {
 
         pthread_mutex_lock(&mutexes_.octomap);
             if (globals_.octomap.memory_time_ > 0) {
-                globals_.octomap.FadeMemory(fading_memory_update_rate_);
+                globals_.octomap.FadeMemory();
+                globals_.octomap.PublishSnapshot();
             }
         pthread_mutex_unlock(&mutexes_.octomap);
 
@@ -48,8 +50,44 @@ void MapperNodelet::FadeTask() {
     ROS_DEBUG("Exiting Fading Memory Thread...");
 }
 
+// Thread for the global map, which also bounds the local one
+void MapperNodelet::GlobalMapTask() {
+    ConfigureThread("global_map");
+    ROS_DEBUG("Global Map Thread started with rate %f: ", global_map_update_rate_);
+
+    // Rate at which this thread will run
+    ros::Rate loop_rate(global_map_update_rate_);
+
+    while (ros::ok()) {
+        // Get time for when this task started
+        const ros::Time t0 = ros::Time::now();
+
+        pthread_mutex_lock(&mutexes_.tf);
+            const tf::StampedTransform tf_body2world = globals_.tf_body2world;
+        pthread_mutex_unlock(&mutexes_.tf);
+
+        // Wait for the robot to be localized
+        if (tf_body2world.stamp_.toSec() != 0) {
+            const tf::Vector3 v = tf_body2world.getOrigin();
+            pthread_mutex_lock(&mutexes_.octomap);
+                if (globals_.octomap.HasGlobalMap()) {
+                    globals_.octomap.UpdateGlobalMap(Eigen::Vector3d(v.getX(), v.getY(), v.getZ()));
+                    globals_.octomap.PublishSnapshot();
+                }
+            pthread_mutex_unlock(&mutexes_.octomap);
+        }
+
+        ros::Duration global_map_time = ros::Time::now() - t0;
+        ROS_DEBUG("Global map execution time: %f", global_map_time.toSec());
+
+        loop_rate.sleep();
+    }
+    ROS_DEBUG("Exiting Global Map Thread...");
+}
+
 // Thread for constantly updating the tfTree values
 void MapperNodelet::HazTfTask() {
+    ConfigureThread("haz_tf");
     ROS_DEBUG("haz_cam tf Thread started with rate %f: ", tf_update_rate_);
     tf_listener::TfClass obj_cam2world;
     // TfClass obj_haz2body;
@@ -73,6 +111,7 @@ void MapperNodelet::HazTfTask() {
 
 // Thread for constantly updating the tfTree values
 void MapperNodelet::PerchTfTask() {
+    ConfigureThread("perch_tf");
     ROS_DEBUG("perch_cam tf Thread started with rate %f: ", tf_update_rate_);
     tf_listener::TfClass obj_perch2world;
     ros::Rate loop_rate(tf_update_rate_);
@@ -92,6 +131,7 @@ void MapperNodelet::PerchTfTask() {
 
 // Thread for updating the tfTree values
 void MapperNodelet::BodyTfTask() {
+    ConfigureThread("body_tf");
     ROS_DEBUG("body tf Thread started with rate %f: ", tf_update_rate_);
     tf_listener::TfClass obj_body2world;
     ros::Rate loop_rate(tf_update_rate_);
@@ -110,6 +150,7 @@ void MapperNodelet::BodyTfTask() {
 }
 
 void MapperNodelet::CollisionCheckTask() {
+    ConfigureThread("collision_check");
     ROS_DEBUG("collisionCheck Thread started!");
 
     // Rate at which the collision checker will run
@@ -119,25 +160,26 @@ void MapperNodelet::CollisionCheckTask() {
     visualization_msgs::MarkerArray traj_markers, samples_markers;
     visualization_msgs::MarkerArray compressed_samples_markers, collision_markers;
 
-    // pcl variables
-    int cloudsize;
-
     while (ros::ok()) {
-        // Wait until there is a new trajectory or a new update on the map
+        // Wait until there is a new trajectory or a new update on the map. The
+        // updates posted while the previous check ran are all covered by this one.
         sem_wait(&semaphores_.collision_check);
+        while (sem_trywait(&semaphores_.collision_check) == 0) {}
 
         // Get time for when this task started
         ros::Time time_now = ros::Time::now();
 
-        // Copy trajectory into local point cloud
-        pcl::PointCloud< pcl::PointXYZ > point_cloud_traj;
+        // Copy the bounds of the trajectory, a few nodes per segment
+        sampled_traj::SegmentBvh bvh;
         std::vector<octomap::point3d> colliding_nodes;
         traj_markers.markers.clear();
         collision_markers.markers.clear();
         samples_markers.markers.clear();
         compressed_samples_markers.markers.clear();
         pthread_mutex_lock(&mutexes_.sampled_traj);
-            point_cloud_traj = globals_.sampled_traj.point_cloud_traj_;
+            bvh = globals_.sampled_traj.bvh_;
+            const bool full_check = globals_.sampled_traj.full_check_ || !incremental_collision_check_;
+            globals_.sampled_traj.full_check_ = false;
             std::vector<double> time = globals_.sampled_traj.time_;
             // pcl::PointCloud<pcl::PointXYZ> pos = globals_.sampled_traj.pos_;
 
@@ -151,9 +193,15 @@ void MapperNodelet::CollisionCheckTask() {
         pthread_mutex_unlock(&mutexes_.sampled_traj);
 
 
-        // Stop execution if there are no points in the trajectory structure
-        cloudsize = point_cloud_traj.size();
-        if (cloudsize <= 0) {
+        // Obstacles measured since the last check. Taken before the snapshot,
+        // which is published with them, so that none is missed.
+        std::vector<octomap::OcTreeKey> new_obstacles;
+        pthread_mutex_lock(&mutexes_.octomap);
+            globals_.octomap.TakeNewObstacles(&new_obstacles);
+        pthread_mutex_unlock(&mutexes_.octomap);
+
+        // Stop execution if there are no segments in the trajectory structure
+        if (bvh.Empty()) {
             visualization_functions::DrawCollidingNodes(colliding_nodes, "world", 0.0, &collision_markers);
             path_marker_pub_.publish(traj_markers);
             path_marker_pub_.publish(collision_markers);
@@ -172,18 +220,43 @@ void MapperNodelet::CollisionCheckTask() {
             continue;
         }
 
-        // Check if trajectory collides with points in the point-cloud
-        pthread_mutex_lock(&mutexes_.octomap);
-            double res = globals_.octomap.tree_inflated_.getResolution();
-            globals_.octomap.FindCollidingNodesInflated(point_cloud_traj, &colliding_nodes);
-        pthread_mutex_unlock(&mutexes_.octomap);
+        // Check if the trajectory capsules, grown by the inflation radius, reach
+        // an occupied node of the non-inflated map. A snapshot of the map needs
+        // no lock, so the check never waits for a map update. Only the segments
+        // not flown yet are checked, and after the first check of a trajectory
+        // only against the obstacles measured since.
+        const int from_segment = bvh.SegmentAtTime(time_now.toSec());
+        double res;
+        std::vector<sampled_traj::SegmentCollision> collisions;
+        octoclass::OctomapSnapshotPtr snapshot = globals_.octomap.GetSnapshot();
+        if (snapshot) {
+            res = snapshot->tree.getResolution();
+            if (full_check) {
+                bvh.FindCollisions(snapshot->tree, snapshot->inflate_radius, from_segment, &collisions);
+            } else {
+                bvh.FindCollisions(snapshot->tree, new_obstacles, snapshot->inflate_radius, from_segment,
+                                   &collisions);
+            }
+        } else {
+            pthread_mutex_lock(&mutexes_.octomap);
+                res = globals_.octomap.tree_.getResolution();
+                if (full_check) {
+                    bvh.FindCollisions(globals_.octomap.tree_, globals_.octomap.GetMapInflation(), from_segment,
+                                       &collisions);
+                } else {
+                    bvh.FindCollisions(globals_.octomap.tree_, new_obstacles, globals_.octomap.GetMapInflation(),
+                                       from_segment, &collisions);
+                }
+            pthread_mutex_unlock(&mutexes_.octomap);
+        }
+        for (uint i = 0; i < collisions.size(); i++) {
+            colliding_nodes.push_back(collisions[i].center);
+        }
 
         if (colliding_nodes.size() > 0) {
-            // Sort collision time (use kdtree for nearest neighbor)
+            // Sort collision time (the closest point of the trajectory to each node)
             std::vector<geometry_msgs::PointStamped> sorted_collisions;
-            pthread_mutex_lock(&mutexes_.sampled_traj);
-                globals_.sampled_traj.SortCollisions(colliding_nodes, &sorted_collisions);
-            pthread_mutex_unlock(&mutexes_.sampled_traj);
+            sampled_traj::SampledTrajectory3D::SortCollisions(bvh, collisions, &sorted_collisions);
 
             double collision_time = (sorted_collisions[0].header.stamp - ros::Time::now()).toSec();
             // uint lastCollisionIdx = sorted_collisions.back().header.seq;
@@ -211,9 +284,11 @@ void MapperNodelet::CollisionCheckTask() {
 }
 
 void MapperNodelet::OctomappingTask() {
+    ConfigureThread("octomapping");
     ROS_DEBUG("OctomappingTask Thread started!");
     tf::StampedTransform tf_cam2world;
     pcl::PointCloud< pcl::PointXYZ > pcl_world;
+    ros::Time last_keyframe;
 
     while (ros::ok()) {
         // Wait until there is new pcl data
@@ -243,24 +318,50 @@ void MapperNodelet::OctomappingTask() {
         Eigen::Affine3d transform = Eigen::Affine3d::Identity();
         transform.translation() << v.getX(), v.getY(), v.getZ();
         transform.rotate(Eigen::Quaterniond(q.getW(), q.getX(), q.getY(), q.getZ()));
-        pcl::transformPointCloud(point_cloud, pcl_world, transform);
 
-        // Save into octomap
+        // Save into octomap. The raycasting runs without the lock, so that
+        // the collision checker is only blocked while the nodes are updated.
         algebra_3d::FrustumPlanes world_frustum;
+        octoclass::RaycastSettings raycast_settings;
         pthread_mutex_lock(&mutexes_.octomap);
             globals_.octomap.cam_frustum_.TransformFrustum(transform, &world_frustum);
-            globals_.octomap.PclToRayOctomap(pcl_world, tf_cam2world, world_frustum);
+            raycast_settings = globals_.octomap.GetRaycastSettings();
+        pthread_mutex_unlock(&mutexes_.octomap);
+
+        // An organized cloud can clear the free space from its depth image instead of by raycasting
+        octoclass::RaycastUpdate raycast_update;
+        octoclass::DepthImage depth_image;
+        if (depth_image_insertion_ && octoclass::OctoClass::DepthImageFromCloud(point_cloud, &depth_image)) {
+            octoclass::OctoClass::ComputeDepthImageUpdate(raycast_settings, depth_image, tf_cam2world, world_frustum,
+                                                          raycast_threads_, &raycast_update);
+        } else {
+            pcl::transformPointCloud(point_cloud, pcl_world, transform);
+
+            // Points falling in the same map voxel give the same endpoint, keep one
+            if (downsample_subdivision_ > 0) {
+                pcl::PointCloud< pcl::PointXYZ > pcl_dense;
+                pcl_dense.swap(pcl_world);
+                octoclass::OctoClass::VoxelDownsample(pcl_dense, raycast_settings.resolution / downsample_subdivision_,
+                                                      &pcl_world);
+            }
+
+            octoclass::OctoClass::ComputeRaycastUpdate(raycast_settings, pcl_world, tf_cam2world, world_frustum,
+                                                       raycast_threads_, &raycast_update);
+        }
+        pthread_mutex_lock(&mutexes_.octomap);
+            globals_.octomap.ApplyRaycastUpdate(raycast_update);
             globals_.octomap.tree_.prune();   // prune the tree before visualizing
+            globals_.octomap.PublishSnapshot();
             // globals_.octomap.tree.writeBinary("simple_tree.bt");
         pthread_mutex_unlock(&mutexes_.octomap);
 
 
         // Publish visualization markers iff at least one node is subscribed to it
         bool pub_obstacles, pub_free, pub_obstacles_inflated, pub_free_inflated;
-        pub_obstacles = (obstacle_marker_pub_.getNumSubscribers() > 0);
-        pub_free = (free_space_marker_pub_.getNumSubscribers() > 0);
-        pub_obstacles_inflated = (inflated_obstacle_marker_pub_.getNumSubscribers() > 0);
-        pub_free_inflated = (inflated_free_space_marker_pub_.getNumSubscribers() > 0);
+        pub_obstacles = obstacle_marker_pub_.HasSubscribers();
+        pub_free = free_space_marker_pub_.HasSubscribers();
+        pub_obstacles_inflated = inflated_obstacle_marker_pub_.HasSubscribers();
+        pub_free_inflated = inflated_free_space_marker_pub_.HasSubscribers();
 
         if (pub_obstacles || pub_free) {
             visualization_msgs::MarkerArray obstacle_markers;
@@ -269,10 +370,10 @@ void MapperNodelet::OctomappingTask() {
                 globals_.octomap.TreeVisMarkers(&obstacle_markers, &free_markers);
             pthread_mutex_unlock(&mutexes_.octomap);
             if (pub_obstacles) {
-                obstacle_marker_pub_.publish(obstacle_markers);
+                obstacle_marker_pub_.Publish(obstacle_markers);
             }
             if (pub_free) {
-                free_space_marker_pub_.publish(free_markers);
+                free_space_marker_pub_.Publish(free_markers);
             }
         }
 
@@ -283,13 +384,33 @@ void MapperNodelet::OctomappingTask() {
                 globals_.octomap.InflatedVisMarkers(&inflated_markers, &inflated_free_markers);
             pthread_mutex_unlock(&mutexes_.octomap);
             if (pub_obstacles_inflated) {
-                inflated_obstacle_marker_pub_.publish(inflated_markers);
+                inflated_obstacle_marker_pub_.Publish(inflated_markers);
             }
             if (pub_free_inflated) {
-                inflated_free_space_marker_pub_.publish(inflated_free_markers);
+                inflated_free_space_marker_pub_.Publish(inflated_free_markers);
             }
         }
 
+        // The delta stream is much smaller than the markers over the space to
+        // ground link. Changes made by the fading thread go out with the next one.
+        if (octomap_delta_pub_.getNumSubscribers() > 0) {
+            ff_msgs::OctomapDelta delta;
+            const bool keyframe = (t0 - last_keyframe).toSec() >= octomap_delta_keyframe_period_;
+            pthread_mutex_lock(&mutexes_.octomap);
+                const bool changed = globals_.octomap.EncodeDelta(keyframe, &delta);
+            pthread_mutex_unlock(&mutexes_.octomap);
+            if (changed) {
+                octomap_delta_pub_.publish(delta);
+                if (delta.keyframe) {
+                    last_keyframe = t0;
+                }
+            }
+        } else {
+            pthread_mutex_lock(&mutexes_.octomap);
+                globals_.octomap.ResetDelta();
+            pthread_mutex_unlock(&mutexes_.octomap);
+        }
+
         if (cam_frustum_pub_.getNumSubscribers() > 0) {
             visualization_msgs::Marker frustum_markers;
             pthread_mutex_lock(&mutexes_.octomap);
@@ -0,0 +1,319 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Replay the depth clouds and the tf of a bag through the mapper, without
+// ROS spinning, and write the throughputs as JSON, so that runs on different
+// revisions can be compared. For example:
+//
+//   benchmark_mapper -resolutions 0.05,0.1,0.2 recorded.bag
+//
+// The clouds are read and transformed before timing. Each one then goes
+// through the same steps as the OctomappingTask thread, with the bag time as
+// the ros time so that the memory fades as it did on the robot. After each
+// cloud the path of the body over the whole bag is checked for collisions,
+// both against the whole map and against the new obstacles only.
+
+#include <common/init.h>
+#include <ff_util/ff_names.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <tf/transform_datatypes.h>
+#include <tf2/buffer_core.h>
+#include <tf2_msgs/TFMessage.h>
+
+#include <pcl/common/transforms.h>
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mapper/octoclass.h"
+#include "mapper/pcl_conversions.h"
+#include "mapper/segment_bvh.h"
+
+DEFINE_string(cloud_topic, TOPIC_HARDWARE_PICOFLEXX_PREFIX TOPIC_HARDWARE_NAME_HAZ_CAM TOPIC_HARDWARE_PICOFLEXX_SUFFIX,
+              "The depth cloud topic.");
+DEFINE_string(cam_frame, FRAME_NAME_HAZ_CAM,
+              "The frame of the depth camera.");
+DEFINE_string(body_frame, "body",
+              "The frame whose path is checked for collisions.");
+DEFINE_string(resolutions, "0.05,0.1,0.2",
+              "Comma separated map resolutions to benchmark, in meters.");
+DEFINE_string(output_json, "benchmark_mapper.json",
+              "Write the results to this file.");
+DEFINE_int32(max_clouds, 0,
+             "Replay only this many clouds. Zero replays all of them.");
+// The defaults below are those of mapper.config, except for the memory time,
+// so that the fading is measured
+DEFINE_double(max_range, 4.0, "Maximum reliable range of the depth camera.");
+DEFINE_double(min_range, 0.2, "Minimum reliable range of the depth camera.");
+DEFINE_double(memory_time, 30.0,
+              "How long the map remembers, in seconds. It remembers forever when this is <= 0.");
+DEFINE_double(inflate_radius, 0.25, "How much the map is inflated.");
+DEFINE_double(distance_field_max, 0.5, "Distances to obstacles are kept up to date up to this far.");
+DEFINE_double(cam_fov, 0.85, "Camera horizontal field-of-view, in radians.");
+DEFINE_double(cam_aspect_ratio, 1.3099, "Depth camera's width divided by height.");
+DEFINE_double(traj_compression_resolution, 0.02,
+              "The path is checked as capsules of radius 1.4 times this, plus the inflation radius.");
+DEFINE_double(fading_memory_update_rate, 1.0, "Frequency at which the memory fades, in bag time.");
+DEFINE_int32(raycast_threads, 2, "Number of threads that raycast each cloud.");
+DEFINE_int32(downsample_subdivision, 1,
+             "Keep one point per map voxel divided this many times along each side. Zero keeps every point.");
+DEFINE_bool(use_octomap_snapshots, true, "Publish a snapshot of the map after each update.");
+DEFINE_bool(depth_image_insertion, false, "Clear the free space of organized clouds from their depth image.");
+
+namespace {
+
+struct Cloud {
+  pcl::PointCloud<pcl::PointXYZ> points;  // In the camera frame
+  tf::StampedTransform tf_cam2world;
+};
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double Rate(double count, double seconds) {
+  return seconds > 0 ? count / seconds : 0.0;
+}
+
+double Sum(std::vector<double> const& values) {
+  double sum = 0;
+  for (double v : values)
+    sum += v;
+  return sum;
+}
+
+// The given fraction of the sorted values, linearly interpolated
+double Percentile(std::vector<double> values, double fraction) {
+  if (values.empty())
+    return 0.0;
+  std::sort(values.begin(), values.end());
+  double pos = fraction * (values.size() - 1);
+  size_t below = static_cast<size_t>(pos);
+  size_t above = std::min(below + 1, values.size() - 1);
+  return values[below] + (pos - below) * (values[above] - values[below]);
+}
+
+// Latencies in milliseconds
+void WriteLatencies(FILE* f, const char* name, std::vector<double> const& seconds, bool last) {
+  fprintf(f, "      \"%s\": {\"count\": %d, \"mean_ms\": %g, \"p50_ms\": %g, \"p95_ms\": %g, \"max_ms\": %g}%s\n",
+          name, static_cast<int>(seconds.size()),
+          seconds.empty() ? 0.0 : 1e3 * Sum(seconds) / seconds.size(),
+          1e3 * Percentile(seconds, 0.5), 1e3 * Percentile(seconds, 0.95),
+          seconds.empty() ? 0.0 : 1e3 * *std::max_element(seconds.begin(), seconds.end()),
+          last ? "" : ",");
+}
+
+// All of the tf of the bag, static or not, to look up the poses at the cloud times
+void ReadTf(rosbag::Bag const& bag, tf2::BufferCore* buffer) {
+  std::vector<std::string> topics = {TOPIC_TF_DYNAMIC, TOPIC_TF_STATIC};
+  rosbag::View view(bag, rosbag::TopicQuery(topics));
+  for (rosbag::MessageInstance const m : view) {
+    tf2_msgs::TFMessageConstPtr tf_msg = m.instantiate<tf2_msgs::TFMessage>();
+    if (!tf_msg)
+      continue;
+    bool is_static = (m.getTopic() == TOPIC_TF_STATIC);
+    for (geometry_msgs::TransformStamped const& t : tf_msg->transforms)
+      buffer->setTransform(t, "benchmark_mapper", is_static);
+  }
+}
+
+bool LookupTransform(tf2::BufferCore const& buffer, std::string const& frame, ros::Time const& stamp,
+                     tf::StampedTransform* transform) {
+  try {
+    tf::transformStampedMsgToTF(buffer.lookupTransform(FRAME_NAME_WORLD, frame, stamp), *transform);
+  } catch (tf2::TransformException const& e) {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  common::InitFreeFlyerApplication(&argc, &argv);
+
+  if (argc != 2) {
+    LOG(INFO) << "Usage: " << argv[0] << " [options] <bag>";
+    return 0;
+  }
+
+  std::vector<double> resolutions;
+  std::stringstream ss(FLAGS_resolutions);
+  for (std::string item; std::getline(ss, item, ',');)
+    resolutions.push_back(std::stod(item));
+  if (resolutions.empty())
+    LOG(FATAL) << "No resolution to benchmark.";
+
+  rosbag::Bag bag;
+  bag.open(argv[1], rosbag::bagmode::Read);
+  rosbag::View everything(bag);
+  tf2::BufferCore tf_buffer(everything.getEndTime() - everything.getBeginTime() + ros::Duration(1.0));
+  ReadTf(bag, &tf_buffer);
+
+  // The clouds with a pose, and the path of the body at their times
+  std::vector<Cloud> clouds;
+  std::vector<Eigen::Vector3d> path;
+  std::vector<double> path_times;
+  int num_points = 0, num_skipped = 0;
+  rosbag::View cloud_view(bag, rosbag::TopicQuery(FLAGS_cloud_topic));
+  for (rosbag::MessageInstance const m : cloud_view) {
+    if (FLAGS_max_clouds > 0 && static_cast<int>(clouds.size()) >= FLAGS_max_clouds)
+      break;
+    sensor_msgs::PointCloud2ConstPtr msg = m.instantiate<sensor_msgs::PointCloud2>();
+    if (!msg)
+      continue;
+    Cloud cloud;
+    tf::StampedTransform tf_body2world;
+    if (!LookupTransform(tf_buffer, FLAGS_cam_frame, msg->header.stamp, &cloud.tf_cam2world) ||
+        !LookupTransform(tf_buffer, FLAGS_body_frame, msg->header.stamp, &tf_body2world)) {
+      num_skipped++;
+      continue;
+    }
+    pcl_conversions::FromROSMsg(*msg, &cloud.points);
+    num_points += cloud.points.size();
+    clouds.push_back(cloud);
+    const tf::Vector3 p = tf_body2world.getOrigin();
+    if (path_times.empty() || msg->header.stamp.toSec() > path_times.back()) {
+      path.push_back(Eigen::Vector3d(p.x(), p.y(), p.z()));
+      path_times.push_back(msg->header.stamp.toSec());
+    }
+  }
+  bag.close();
+  if (clouds.empty())
+    LOG(FATAL) << "No cloud on " << FLAGS_cloud_topic << " with a pose in " << argv[1];
+  if (num_skipped > 0)
+    LOG(WARNING) << "Skipped " << num_skipped << " clouds without a pose.";
+  LOG(INFO) << "Replaying " << clouds.size() << " clouds with " << num_points << " points.";
+
+  FILE* f = fopen(FLAGS_output_json.c_str(), "w");
+  if (!f)
+    LOG(FATAL) << "Cannot write: " << FLAGS_output_json;
+  fprintf(f, "{\n");
+  fprintf(f, "  \"bag\": \"%s\",\n", argv[1]);
+  fprintf(f, "  \"num_clouds\": %d,\n", static_cast<int>(clouds.size()));
+  fprintf(f, "  \"num_points\": %d,\n", num_points);
+  fprintf(f, "  \"raycast_threads\": %d,\n", FLAGS_raycast_threads);
+  fprintf(f, "  \"path_segments\": %d,\n", static_cast<int>(path.size()) - 1);
+  fprintf(f, "  \"resolutions\": [\n");
+
+  for (size_t r = 0; r < resolutions.size(); r++) {
+    octoclass::OctoClass octomap(resolutions[r]);
+    octomap.SetMaxRange(FLAGS_max_range);
+    octomap.SetMinRange(FLAGS_min_range);
+    octomap.SetMemory(FLAGS_memory_time);
+    octomap.SetMapInflation(FLAGS_inflate_radius);
+    octomap.SetDistanceFieldMax(FLAGS_distance_field_max);
+    octomap.SetSnapshots(FLAGS_use_octomap_snapshots);
+    octomap.SetCamFrustum(FLAGS_cam_fov, FLAGS_cam_aspect_ratio);
+
+    sampled_traj::SegmentBvh bvh;
+    bvh.Build(path, path_times, 1.4 * FLAGS_traj_compression_resolution);
+
+    std::vector<double> update_seconds, fade_seconds, full_check_seconds, incremental_check_seconds;
+    int num_collisions = 0;
+    double last_fade = clouds.front().tf_cam2world.stamp_.toSec();
+    for (Cloud const& cloud : clouds) {
+      // The mapper time follows the bag
+      ros::Time::setNow(cloud.tf_cam2world.stamp_);
+
+      // Fade at the rate of the FadeTask thread, in bag time
+      if (FLAGS_memory_time > 0 &&
+          cloud.tf_cam2world.stamp_.toSec() - last_fade >= 1.0 / FLAGS_fading_memory_update_rate) {
+        auto start = std::chrono::steady_clock::now();
+        octomap.FadeMemory();
+        octomap.PublishSnapshot();
+        fade_seconds.push_back(Seconds(start));
+        last_fade = cloud.tf_cam2world.stamp_.toSec();
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      tf::Quaternion q = cloud.tf_cam2world.getRotation();
+      tf::Vector3 v = cloud.tf_cam2world.getOrigin();
+      Eigen::Affine3d transform = Eigen::Affine3d::Identity();
+      transform.translation() << v.getX(), v.getY(), v.getZ();
+      transform.rotate(Eigen::Quaterniond(q.getW(), q.getX(), q.getY(), q.getZ()));
+      algebra_3d::FrustumPlanes world_frustum;
+      octomap.cam_frustum_.TransformFrustum(transform, &world_frustum);
+      octoclass::RaycastSettings raycast_settings = octomap.GetRaycastSettings();
+      octoclass::RaycastUpdate raycast_update;
+      octoclass::DepthImage depth_image;
+      if (FLAGS_depth_image_insertion && octoclass::OctoClass::DepthImageFromCloud(cloud.points, &depth_image)) {
+        octoclass::OctoClass::ComputeDepthImageUpdate(raycast_settings, depth_image, cloud.tf_cam2world, world_frustum,
+                                                      FLAGS_raycast_threads, &raycast_update);
+      } else {
+        pcl::PointCloud<pcl::PointXYZ> pcl_world;
+        pcl::transformPointCloud(cloud.points, pcl_world, transform);
+        if (FLAGS_downsample_subdivision > 0) {
+          pcl::PointCloud<pcl::PointXYZ> pcl_dense;
+          pcl_dense.swap(pcl_world);
+          octoclass::OctoClass::VoxelDownsample(pcl_dense, raycast_settings.resolution / FLAGS_downsample_subdivision,
+                                                &pcl_world);
+        }
+        octoclass::OctoClass::ComputeRaycastUpdate(raycast_settings, pcl_world, cloud.tf_cam2world, world_frustum,
+                                                   FLAGS_raycast_threads, &raycast_update);
+      }
+      octomap.ApplyRaycastUpdate(raycast_update);
+      octomap.tree_.prune();
+      octomap.PublishSnapshot();
+      update_seconds.push_back(Seconds(start));
+
+      // The two checks of the CollisionCheckTask thread, from the start of the path
+      std::vector<octomap::OcTreeKey> new_obstacles;
+      octomap.TakeNewObstacles(&new_obstacles);
+      std::vector<sampled_traj::SegmentCollision> collisions;
+      start = std::chrono::steady_clock::now();
+      bvh.FindCollisions(octomap.tree_, new_obstacles, octomap.GetMapInflation(), 0, &collisions);
+      incremental_check_seconds.push_back(Seconds(start));
+      start = std::chrono::steady_clock::now();
+      bvh.FindCollisions(octomap.tree_, octomap.GetMapInflation(), 0, &collisions);
+      full_check_seconds.push_back(Seconds(start));
+      num_collisions = collisions.size();
+    }
+
+    double total_update_seconds = Sum(update_seconds);
+    LOG(INFO) << "Resolution " << resolutions[r] << ": " << Rate(num_points, total_update_seconds)
+              << " points/sec, " << octomap.tree_.size() << " nodes.";
+    fprintf(f, "    {\n");
+    fprintf(f, "      \"resolution\": %g,\n", resolutions[r]);
+    fprintf(f, "      \"map_nodes\": %d,\n", static_cast<int>(octomap.tree_.size()));
+    fprintf(f, "      \"path_collisions\": %d,\n", num_collisions);
+    fprintf(f, "      \"points_per_sec\": %g,\n", Rate(num_points, total_update_seconds));
+    fprintf(f, "      \"clouds_per_sec\": %g,\n", Rate(clouds.size(), total_update_seconds));
+    WriteLatencies(f, "update", update_seconds, false);
+    WriteLatencies(f, "fade", fade_seconds, false);
+    WriteLatencies(f, "full_collision_check", full_check_seconds, false);
+    WriteLatencies(f, "incremental_collision_check", incremental_check_seconds, true);
+    fprintf(f, "    }%s\n", r + 1 < resolutions.size() ? "," : "");
+  }
+
+  fprintf(f, "  ]\n");
+  fprintf(f, "}\n");
+  fclose(f);
+  LOG(INFO) << "Wrote: " << FLAGS_output_json;
+
+  return 0;
+}
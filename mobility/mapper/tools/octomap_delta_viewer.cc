@@ -0,0 +1,71 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Rebuilds the mapper's octomap from its delta stream, on the ground, and
+// publishes the same markers as the mapper for rviz. Only the deltas cross
+// the space to ground link.
+
+#include <common/init.h>
+#include <ff_msgs/OctomapDelta.h>
+#include <ff_util/ff_names.h>
+#include <gflags/gflags.h>
+#include <ros/ros.h>
+#include <visualization_msgs/MarkerArray.h>
+
+#include <memory>
+
+#include "mapper/octoclass.h"
+#include "mapper/octomap_delta.h"
+
+DEFINE_string(input_topic, TOPIC_MAPPER_OCTOMAP_DELTA,
+              "The octomap delta topic name.");
+DEFINE_string(obstacle_topic, "/ground/mapper/obstacle_markers",
+              "Publish the occupied voxels on this topic.");
+DEFINE_string(free_topic, "/ground/mapper/free_space_markers",
+              "Publish the free voxels on this topic.");
+
+std::shared_ptr<octoclass::OctoClass> map;
+octoclass::OctomapDeltaDecoder decoder;
+ros::Publisher obstacle_pub, free_pub;
+
+void delta_callback(ff_msgs::OctomapDeltaConstPtr const& delta) {
+  if (!map || (delta->keyframe && map->tree_.getResolution() != delta->resolution))
+    map.reset(new octoclass::OctoClass(delta->resolution));
+  if (!decoder.Apply(*delta, &map->tree_)) {
+    ROS_WARN_THROTTLE(10, "Octomap delta %u is out of sequence, waiting for a keyframe.", delta->version);
+    return;
+  }
+
+  visualization_msgs::MarkerArray obstacle_markers, free_markers;
+  map->TreeVisMarkers(&obstacle_markers, &free_markers);
+  obstacle_pub.publish(obstacle_markers);
+  free_pub.publish(free_markers);
+}
+
+int main(int argc, char** argv) {
+  common::InitFreeFlyerApplication(&argc, &argv);
+  ros::init(argc, argv, "octomap_delta_viewer");
+
+  ros::NodeHandle nh;
+  obstacle_pub = nh.advertise<visualization_msgs::MarkerArray>(FLAGS_obstacle_topic, 1, true);
+  free_pub = nh.advertise<visualization_msgs::MarkerArray>(FLAGS_free_topic, 1, true);
+  ros::Subscriber delta_sub = nh.subscribe(FLAGS_input_topic, 10, &delta_callback);
+  ros::spin();
+
+  return 0;
+}
@@ -0,0 +1,114 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PLANNER_QP_SOLVER_H_
+#define PLANNER_QP_SOLVER_H_
+
+#include <ff_msgs/Zone.h>
+
+#include <traj_opt_basic/types.h>
+#include <traj_opt_pro/nonlinear_trajectory.h>
+
+#include <decomp_util/ellipse_decomp.h>
+#include <jps3d/planner/jps_3d_util.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <array>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/**
+ * \ingroup planner
+ */
+namespace planner_qp {
+
+typedef std::vector<std::pair<traj_opt::MatD, traj_opt::VecD> > Constraints;
+
+/**
+ * @brief The map the QP planner searches, and the corridors through it
+ * @details The map is built from the keep-in and keep-out zones, and the
+ * corridors are the convex decomposition of the jump point search path. None
+ * of this needs ROS to be running, so the planner nodelet and the benchmark
+ * share it. The map is kept between plans, and so are the corridors of the
+ * path sections, until the obstacles near them change.
+ */
+class Map {
+ public:
+  /**
+   * Builds the map at resolution res, with the keep-out zones and points
+   * dilated by radius. Returns false if there are no keep-in zones. The
+   * map is not rebuilt if nothing changed since the last call. If only the
+   * points did, the cached corridors within radius of the cells that gained
+   * or lost a point are dropped, and the others kept.
+   **/
+  bool Build(std::vector<ff_msgs::Zone> const& zones, vec_Vec3f const& points,
+             double res, double radius);
+
+  /**
+   * Finds the path from start to goal, and one corridor per section of it,
+   * as A x <= b over position and yaw. The corridors do not constrain
+   * anything when the two are within a cell of each other. Returns false if
+   * no path is found. Only the sections not in the cache are decomposed.
+   **/
+  bool Corridors(traj_opt::Vec3 const& start, traj_opt::Vec3 const& goal,
+                 vec_Vec3f* path, Constraints* cons);
+
+  double Resolution() const { return res_; }
+  size_t CachedCorridors() const { return corridors_.size(); }
+
+ private:
+  // A path section, by its endpoints in millimeters
+  typedef std::array<int64_t, 6> SectionKey;
+  typedef vec_LinearConstraint3f::value_type Corridor;
+
+  // Drops the cached corridors within margin of any of the points
+  void DropCorridorsNear(vec_Vec3f const& points, double margin);
+
+  double res_{0.5};
+  std::vector<double> settings_;          // Zones, resolution and radius of the map
+  std::unordered_set<int64_t> cells_;     // The cells of the points in the map
+  std::map<SectionKey, Corridor> corridors_;
+  std::shared_ptr<JPS::VoxelMapUtil> jps_map_util_;
+  std::unique_ptr<EllipseDecomp> decomp_util_;
+  std::unique_ptr<JPS::JPS3DUtil> jps_planner_;
+};
+
+/**
+ * Optimizes the trajectory from start to goal through the corridors along
+ * path. With more than one candidate, time allocations that blend from
+ * equal times to times proportional to the path length in each corridor are
+ * optimized on their own threads too, and stop after max_time seconds. Only
+ * the first candidate is warm started from previous. Returns the lowest cost
+ * candidate that solved, or else the first, which is null if it threw. The
+ * error of each candidate that threw is set in errors.
+ **/
+boost::shared_ptr<traj_opt::NonlinearTrajectory> Optimize(
+    traj_opt::Vec4 const& start, traj_opt::Vec4 const& goal,
+    vec_Vec3f const& path, Constraints const& cons, int candidates,
+    double max_time,
+    boost::shared_ptr<traj_opt::NonlinearTrajectory> const& previous,
+    std::vector<std::string>* errors);
+
+}  // namespace planner_qp
+
+#endif  // PLANNER_QP_SOLVER_H_
@@ -19,6 +19,7 @@
 // Standard includes
 #include <ros/ros.h>
 
+#include <common/async_log_ros.h>
 #include <ff_util/config_server.h>
 #include <ff_util/ff_nodelet.h>
 
@@ -37,15 +38,24 @@
 #include <traj_opt_pro/nonlinear_trajectory.h>
 #include <traj_opt_ros/ros_bridge.h>
 
-#include <decomp_util/ellipse_decomp.h>
-#include <jps3d/planner/jps_3d_util.h>
+// Map, corridors and candidate solves
+#include <planner_qp/solver.h>
 
 //  TF
 #include <tf/tf.h>
 // #include "pcl_ros/point_cloud.h"  //  NO_LINT()
 
+#include <ff_msgs/OctomapDelta.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>  // NOLINT
+#include <string>
+#include <vector>
+
 #define DEBUG false
-#define OUTPUT_DEBUG NODELET_DEBUG_STREAM
+#define OUTPUT_DEBUG(...) ASYNC_ROS_DEBUG_STREAM_NAMED(getName(), __VA_ARGS__)
 /**
  * \ingroup planner
  */
@@ -72,6 +82,7 @@ class Planner : public planner::PlannerImplementation {
   ros::Publisher cloud_pub_;
   ros::NodeHandle *nh_;
   ros::Subscriber pcl_sub_;
+  ros::Subscriber sub_octomap_delta_;
 
  protected:
   virtual bool InitializePlanner(ros::NodeHandle *nh) {
@@ -85,6 +96,12 @@ class Planner : public planner::PlannerImplementation {
                         &Planner::DiagnosticsCallback, this, false, true);
     nh_ = nh;
 
+    // The occupied voxels of the mapper are the obstacles of the map. The
+    // mapper only streams map changes while someone listens.
+    if (cfg_.Get<bool>("use_mapper_obstacles"))
+      sub_octomap_delta_ = nh->subscribe(TOPIC_MAPPER_OCTOMAP_DELTA, 10,
+                                         &Planner::OctomapDeltaCallback, this);
+
     /*
     pcl_sub_ = nh->subscribe("mob/planner_qp/world_frame_haz_cloud", 1,
                              &Planner::haz_cam_callback, this);
@@ -184,23 +201,27 @@ class Planner : public planner::PlannerImplementation {
   double map_res_{0.5};     // map resolution
 
  private:
-  std::shared_ptr<JPS::VoxelMapUtil> jps_map_util_;
-  std::unique_ptr<EllipseDecomp> decomp_util_;
-  std::unique_ptr<JPS::JPS3DUtil> jps_planner_;
+  Map map_;
 
   double norm_vector3(const geometry_msgs::Vector3 &vec) {
     return std::sqrt(vec.x * vec.x + vec.y * vec.y + vec.z * vec.z);
   }
   ff_msgs::ControlState getState(double time, double dt) {
     if (trajectory_ == NULL) return ff_msgs::ControlState();
+    traj_opt::MatD state_mat;
+    trajectory_->getCommand(time, 3, state_mat);
+    return getState(time, dt, state_mat);
+  }
+  // from the command at time, sampled already
+  ff_msgs::ControlState getState(double time, double dt,
+                                 traj_opt::MatD state_mat) {
+    if (trajectory_ == NULL) return ff_msgs::ControlState();
 
     tf::Vector3 axis = axis_;
     if (std::isnan(axis.getX())) axis.setZero();
     tf::Quaternion orientation = start_orientation_;
 
     ff_msgs::ControlState state;
-    traj_opt::MatD state_mat;
-    trajectory_->getCommand(time, 3, state_mat);
     state.when = ros::Time(time);
 
     tf::Vector3 axis_world_frame = tf::Transform(start_orientation_) * axis;
@@ -272,10 +293,19 @@ class Planner : public planner::PlannerImplementation {
     Eigen::Array<traj_opt::decimal_t, 4, 1> worst =
         Eigen::Array<traj_opt::decimal_t, 4, 1>::Zero();
 
-    ff_msgs::ControlState last_state;
+    // sample all the commands at once
+    std::vector<traj_opt::decimal_t> times;
     for (double t = 0; t <= trajectory_->getTotalTime();
-         t += 0.01) {  // should be sample rate of control
-      ff_msgs::ControlState state = getState(t, 0.01);
+         t += 0.01)  // should be sample rate of control
+      times.push_back(t);
+    std::vector<traj_opt::MatD> commands;
+    trajectory_->getCommands(
+        Eigen::Map<traj_opt::VecD>(times.data(), times.size()), 3, commands);
+
+    ff_msgs::ControlState last_state;
+    for (uint i = 0; i < times.size(); i++) {
+      double t = times.at(i);
+      ff_msgs::ControlState state = getState(t, 0.01, commands.at(i));
       Eigen::Array<traj_opt::decimal_t, 4, 1> current_normalized;
       // same a normalization for limits
 
@@ -323,7 +353,12 @@ class Planner : public planner::PlannerImplementation {
                            ff_msgs::PlanResult *result) {
     OUTPUT_DEBUG("PlannerQP: Planning from " << start.transpose()
                                              << " to: " << goal.transpose());
-    // clear trajectory
+    // keep the last solution to start from, then clear trajectory
+    bool warm_start;
+    if (!cfg_.Get<bool>("warm_start", warm_start)) warm_start = false;
+    boost::shared_ptr<traj_opt::NonlinearTrajectory> previous;
+    if (warm_start && trajectory_ != NULL && trajectory_->isSolved())
+      previous = trajectory_;
     trajectory_ = boost::shared_ptr<traj_opt::NonlinearTrajectory>();
 
     // try to get zones
@@ -332,79 +367,13 @@ class Planner : public planner::PlannerImplementation {
       ROS_ERROR("Planner::QP: Planner failed to load keepins and keepouts");
       return false;
     }
-    // get sample increment
-    double radius;
-    if (!cfg_.Get<double>("robot_radius", radius)) radius = 0.26;
-
     traj_opt::Vec3 start3 = start.block<3, 1>(0, 0);
     traj_opt::Vec3 goal3 = goal.block<3, 1>(0, 0);
 
-    traj_opt::Vec3 diff = goal3 - start3;
-    diff << std::abs(diff(0)), std::abs(diff(1)), std::abs(diff(2));
-    diff -= traj_opt::Vec3::Ones() * map_res_;
-
+    // get the path and its corridors
     vec_Vec3f path;
-    bool close = false;
-
-    if (diff(0) < 0 && diff(1) < 0 && diff(2) < 0) {
-      ROS_INFO_STREAM(
-          "Start and goal are within map resolution: " << diff.transpose());
-      path.push_back(start3);
-      path.push_back(goal3);
-      close = true;
-      // result->response = RESPONSE::ALREADY_THERE;
-    } else {
-      OUTPUT_DEBUG("PlannerQP: JPS running");
-      if (!jps_planner_->plan(start3, goal3)) {
-        ROS_ERROR("Planner::QP: Jump point search failed!");
-        return false;
-      }
-      path = jps_planner_->getPath();
-    }
-    // get constraints and repackage as dynamic sized arrays
-    OUTPUT_DEBUG("PlannerQP: decomp running on path length " << path.size());
-    decomp_util_->decomp(path);
-
-    for (auto &p : path) OUTPUT_DEBUG("PlannerQP: Path: " << p.transpose());
-    vec_LinearConstraint3f cons_3d = decomp_util_->get_constraints();
-    std::vector<std::pair<traj_opt::MatD, traj_opt::VecD> > cons;
-    for (auto &ci : cons_3d) {
-      traj_opt::MatD A = traj_opt::MatD::Zero(ci.first.rows(), 4);
-      traj_opt::VecD b =
-          traj_opt::VecD::Zero(ci.second.rows(), ci.second.cols());
-      // OUTPUT_DEBUG("PlannerQP: Ci size " << ci.second.rows() << " "<<
-      // ci.second.cols() );
-      if (!close) {
-        A.block(0, 0, ci.first.rows(), ci.first.cols()) = ci.first;
-        b.block(0, 0, ci.second.rows(), ci.second.cols()) = ci.second;
-      }
-      OUTPUT_DEBUG("PlannerQP: A: " << A);
-      OUTPUT_DEBUG("PlannerQP: b: " << b.transpose());
-      cons.push_back(std::pair<traj_opt::MatD, traj_opt::VecD>(A, b));
-    }
-
-    // Package higher order waypoints
-    traj_opt::Waypoint start_way, goal_way;
-    start_way.pos = start;
-    start_way.use_pos = true;
-    start_way.use_vel = true;
-    start_way.use_acc = true;
-    start_way.use_jrk = true;
-    start_way.knot_id = 0;
-
-    goal_way.pos = goal;
-    goal_way.use_pos = true;
-    goal_way.use_vel = true;
-    goal_way.use_acc = true;
-    goal_way.use_jrk = true;
-    goal_way.knot_id = -1;
-
-    std::vector<traj_opt::Waypoint> con;
-    con.push_back(start_way);
-    con.push_back(goal_way);
-
-    boost::shared_ptr<std::vector<double> > ds =
-        boost::make_shared<std::vector<double> >(cons.size(), 1.0);
+    Constraints cons;
+    if (!map_.Corridors(start3, goal3, &path, &cons)) return false;
 
     for (uint i = 1; i < path.size(); i++) {
       // ds->at(i-1) = (path.at(i)- path.at(i-1)).norm();
@@ -420,15 +389,26 @@ class Planner : public planner::PlannerImplementation {
       // diff2: " << diff2.transpose());
     }
 
-    try {
-      trajectory_.reset(new traj_opt::NonlinearTrajectory(con, cons, 7, 3, ds));
-    } catch (std::runtime_error &e) {
-      ROS_ERROR_STREAM("QP::Planner failed with error: " << e.what());
-      return false;
-    } catch (...) {
-      ROS_ERROR_STREAM("QP::Planner failed with unknown error");
+    // optimize the candidate time allocations
+    int candidates;
+    if (!cfg_.Get<int>("candidates", candidates)) candidates = 1;
+    std::vector<std::string> errors;
+    ros::WallTime solve_start = ros::WallTime::now();
+    trajectory_ = Optimize(start, goal, path, cons, candidates, max_time_,
+                           previous, &errors);
+    for (uint c = 0; c < errors.size(); c++) {
+      if (!errors.at(c).empty() && errors.size() > 1)
+        ROS_WARN_STREAM("QP::Planner candidate " << c << " failed with error: "
+                                                 << errors.at(c));
+    }
+    if (trajectory_ == NULL) {
+      ROS_ERROR_STREAM("QP::Planner failed with error: " << errors.front());
       return false;
     }
+    OUTPUT_DEBUG("PlannerQP: Solved " << errors.size() << " candidates in "
+                 << (ros::WallTime::now() - solve_start).toSec() * 1000.0
+                 << " ms"
+                 << (trajectory_->isWarmStarted() ? ", warm started" : ""));
     std::string pass = trajectory_->isSolved() ? "solved" : "failed";
     // viz topics
     // VisualizeRectangularPolytopes::fromGraph(graph.get(),
@@ -496,17 +476,19 @@ class Planner : public planner::PlannerImplementation {
     if (DEBUG)
       std::cout << "Total time of trajectory: " << trajectory_->getTotalTime()
                 << std::endl;
+    std::vector<traj_opt::decimal_t> times;
     do {
-      ff_msgs::ControlState state = getState(time, planner_dt_);
-      // << " acc " <<  acc.transpose() << std::endl;
-      // add to list
-      controls->push_back(state);
-
+      times.push_back(time);
       time += planner_dt_;
     } while (time < trajectory_->getTotalTime());
-    time = trajectory_->getTotalTime();
-    ff_msgs::ControlState state = getState(time, planner_dt_);
-    controls->push_back(state);
+    times.push_back(trajectory_->getTotalTime());
+
+    // sample all the commands at once, then add to list
+    std::vector<traj_opt::MatD> commands;
+    trajectory_->getCommands(
+        Eigen::Map<traj_opt::VecD>(times.data(), times.size()), 3, commands);
+    for (uint i = 0; i < times.size(); i++)
+      controls->push_back(getState(times.at(i), planner_dt_, commands.at(i)));
 
     return true;
   }
@@ -642,132 +624,13 @@ class Planner : public planner::PlannerImplementation {
     bool got = GetZones(zones);
     if (!got) return false;
 
-    Vec3f min, max, zmin, zmax;
-    min << 1000.0, 1000.0, 1000.0;
-    max << -1000.0, -1000.0, -1000.0;
-    uint num_keepin = 0;
-    for (auto &zone : zones) {
-      if (zone.type == ff_msgs::Zone::KEEPIN) {
-        zmin << zone.min.x, zone.min.y, zone.min.z;
-        zmax << zone.max.x, zone.max.y, zone.max.z;
-        for (int i = 0; i < 3; i++) {
-          min(i) = std::min(min(i), zmin(i));
-          min(i) = std::min(min(i), zmax(i));
-          max(i) = std::max(max(i), zmin(i));
-          max(i) = std::max(max(i), zmax(i));
-        }
-        num_keepin++;
-      }
-    }
-    if (num_keepin == 0) {
-      ROS_ERROR("Zero keepin zones!! Plan failed");
-      return false;
-    }
-    min -= Vec3f::Ones() * map_res_ * 2.0;
-    max += Vec3f::Ones() * map_res_ * 2.0;
-
-    Vec3f origin = min;
-    Vec3f dimf = (max - min) / map_res_;
-    Vec3i dim(std::ceil(dimf(0)), std::ceil(dimf(1)), std::ceil(dimf(2)));
-    int num_cell = dim(0) * dim(1) * dim(2);
-
-    std::vector<signed char> map(num_cell, 0);
-
-    jps_map_util_.reset(new JPS::VoxelMapUtil());
-    jps_map_util_->setMap(origin, dim, map, map_res_);
-
-    vec_Vec3f keepout_points = haz_cam_points_;
-
-    // add contour
-    for (auto &zone : zones) {
-      zmin << std::min(zone.min.x, zone.max.x),
-          std::min(zone.min.y, zone.max.y), std::min(zone.min.z, zone.max.z);
-      zmax << std::max(zone.min.x, zone.max.x),
-          std::max(zone.min.y, zone.max.y), std::max(zone.min.z, zone.max.z);
-      Vec3f tmp = Vec3f::Zero();
-      for (int i = 0; i < 3; i++) {
-        int j = (i + 1) % 3;
-        int k = (i + 2) % 3;
-        if (zone.type == ff_msgs::Zone::KEEPIN) {
-          for (auto zx = zmin(j); zx <= zmax(j); zx += map_res_) {
-            for (auto zy = zmin(k); zy <= zmax(k); zy += map_res_) {
-              tmp(j) = zx;
-              tmp(k) = zy;
-              tmp(i) = zmin(i) - map_res_ * 1.001;
-              map[jps_map_util_->getIndex(jps_map_util_->floatToInt(tmp))] =
-                  100;
-              tmp(i) = zmax(i) + map_res_ * 1.001;
-              map[jps_map_util_->getIndex(jps_map_util_->floatToInt(tmp))] =
-                  100;
-            }
-          }
-        }
-      }
-    }
-
-    for (auto &zone : zones) {
-      zmin << std::min(zone.min.x, zone.max.x),
-          std::min(zone.min.y, zone.max.y), std::min(zone.min.z, zone.max.z);
-      zmax << std::max(zone.min.x, zone.max.x),
-          std::max(zone.min.y, zone.max.y), std::max(zone.min.z, zone.max.z);
-      // add points on surface
-      Vec3f tmp = Vec3f::Zero();
-      for (int i = 0; i < 3; i++) {
-        int j = (i + 1) % 3;
-        int k = (i + 2) % 3;
-        for (auto zx = zmin(j); zx <= zmax(j); zx += map_res_)
-          for (auto zy = zmin(k); zy <= zmax(k); zy += map_res_) {
-            if (zone.type == ff_msgs::Zone::KEEPOUT) {
-              tmp(j) = zx;
-              tmp(k) = zy;
-              tmp(i) = zmin(i);
-              keepout_points.push_back(tmp);
-              tmp(i) = zmax(i);
-              keepout_points.push_back(tmp);
-            } else {
-              for (auto zz = zmin(i); zz <= zmax(i); zz += map_res_) {
-                tmp(j) = zx;
-                tmp(k) = zy;
-                tmp(i) = zz;
-                map[jps_map_util_->getIndex(jps_map_util_->floatToInt(tmp))] =
-                    0;
-              }
-            }
-          }
-      }
-      OUTPUT_DEBUG("PlannerQP: Keepout: " << zmin.transpose() << " to "
-                                          << zmax.transpose());
-    }
-    // reset map
-    jps_map_util_->setMap(origin, dim, map, map_res_);
-    // for(auto &p:keepout_points)
-    // OUTPUT_DEBUG("PlannerQP: Keepout point: " << p.transpose());
-    OUTPUT_DEBUG("PlannerQP: add3DPoints: " << keepout_points.size());
-    // dialate
     double radius;
     if (!cfg_.Get<double>("robot_radius", radius)) radius = 0.26;
 
-    jps_map_util_->freeUnKnown();
-    jps_map_util_->dilate(radius, radius);
-    jps_map_util_->add3DPoints(keepout_points);
-    OUTPUT_DEBUG("PlannerQP: Map origin " << origin.transpose() << " dim "
-                                          << dim.transpose() << " resolution "
-                                          << map_res_);
-    OUTPUT_DEBUG("PlannerQP: Dilating");
-    jps_map_util_->dilating();
-
-    jps_planner_.reset(new JPS::JPS3DUtil(false));
-    jps_planner_->setMapUtil(jps_map_util_.get());
-
-    decomp_util_.reset(new EllipseDecomp(
-        jps_map_util_->getOrigin(),
-        jps_map_util_->getDim().cast<decimal_t>() * jps_map_util_->getRes(),
-        false));
-    decomp_util_->set_obstacles(jps_map_util_->getCloud());
-
     // debugCloud();
 
-    return true;
+    if (sub_octomap_delta_) ObstaclePoints(map_res_, &haz_cam_points_);
+    return map_.Build(zones, haz_cam_points_, map_res_, radius);
   }
   /*  void debugCloud(){
       // vec_Vec3f free = jps_map_util_->getFreeCloud();
@@ -808,6 +671,97 @@ class Planner : public planner::PlannerImplementation {
  private:
   vec_Vec3f haz_cam_points_;
 
+  // Voxel states of the octomap delta stream
+  enum VoxelState { VOXEL_UNKNOWN = 0, VOXEL_FREE = 1, VOXEL_OCCUPIED = 2 };
+
+  // The occupied voxels of the mapper, by their packed lowest key and depth
+  std::mutex obstacles_mutex_;
+  std::map<uint64_t, int> obstacles_;
+  double obstacles_res_{0.0};
+  uint32_t map_version_{0};
+  bool map_in_sequence_{false};
+
+  // Keeps the occupied voxels of the map. The encoding is described in
+  // mapper/octomap_delta.h. A keyframe lists all the leaves, and a delta the
+  // leaves that changed. Deltas are ignored from a gap to the next keyframe.
+  void OctomapDeltaCallback(ff_msgs::OctomapDelta::ConstPtr const &msg) {
+    static const int max_depth = 16;
+    static const uint64_t key_mask = (uint64_t(1) << 48) - 1;
+    std::lock_guard<std::mutex> lock(obstacles_mutex_);
+    bool in_sequence = map_in_sequence_ && (msg->version == map_version_ + 1);
+    map_version_ = msg->version;
+    if (msg->keyframe) {
+      obstacles_.clear();
+      obstacles_res_ = msg->resolution;
+    } else if (!in_sequence) {
+      map_in_sequence_ = false;
+      return;
+    }
+    map_in_sequence_ = true;
+    size_t pos = 0;
+    uint64_t packed = 0;
+    for (uint32_t i = 0; i < msg->num_voxels; i++) {
+      uint64_t delta = 0;
+      int shift = 0;
+      while (pos < msg->data.size() && shift < 64) {
+        uint8_t byte = msg->data[pos++];
+        delta |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        shift += 7;
+        if ((byte & 0x80) == 0) break;
+      }
+      if (pos >= msg->data.size()) {
+        map_in_sequence_ = false;
+        return;
+      }
+      packed += delta;
+      uint8_t code = msg->data[pos++];
+      int depth = code >> 2;
+      if (depth > max_depth) continue;
+      // The lowest key of the voxel, which covers side keys on each axis
+      uint64_t side = uint64_t(1) << (max_depth - depth);
+      uint64_t mask = (0xFFFF & ~(side - 1)) * 0x000100010001;
+      uint64_t key = packed & mask & key_mask;
+      // A voxel replaces what it covers, and what covers it
+      if (depth < max_depth) {
+        for (auto it = obstacles_.begin(); it != obstacles_.end();) {
+          bool inside = ((it->first & key_mask) & mask) == key;
+          if (inside)
+            it = obstacles_.erase(it);
+          else
+            ++it;
+        }
+      }
+      for (int d = 0; d <= depth; d++) {
+        uint64_t s = uint64_t(1) << (max_depth - d);
+        uint64_t m = (0xFFFF & ~(s - 1)) * 0x000100010001;
+        obstacles_.erase((key & m) | (static_cast<uint64_t>(d) << 48));
+      }
+      if ((code & 0x3) == VOXEL_OCCUPIED)
+        obstacles_[key | (static_cast<uint64_t>(depth) << 48)] = depth;
+    }
+  }
+
+  // The centers of the occupied voxels, with voxels larger than res sampled
+  // at res, so that the map has its cells at them
+  void ObstaclePoints(double res, vec_Vec3f *points) {
+    static const int key_offset = 1 << 15, max_depth = 16;
+    std::lock_guard<std::mutex> lock(obstacles_mutex_);
+    points->clear();
+    for (auto const &obstacle : obstacles_) {
+      double size = (1 << (max_depth - obstacle.second)) * obstacles_res_;
+      int n = std::max(1, static_cast<int>(std::ceil(size / res)));
+      double step = size / n;
+      Vec3f lowest;
+      for (int k = 0; k < 3; k++)
+        lowest(k) = (static_cast<int>((obstacle.first >> (16 * k)) & 0xFFFF) - key_offset) *
+                    obstacles_res_ + 0.5 * step;
+      for (int x = 0; x < n; x++)
+        for (int y = 0; y < n; y++)
+          for (int z = 0; z < n; z++)
+            points->push_back(lowest + step * Vec3f(x, y, z));
+    }
+  }
+
   // Andrew: uncomment this out when you want to use the haz cam point cloud
   /*
   void haz_cam_callback(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &msg) {
@@ -0,0 +1,380 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <planner_qp/solver.h>
+
+#include <ros/console.h>
+
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <thread>  // NOLINT
+
+namespace planner_qp {
+
+namespace {
+
+// Cached corridors, dropped all at once beyond that
+const size_t kMaxCorridors = 512;
+
+// Packs the cell of a point at some resolution, 21 bits per axis
+int64_t PackCell(Vec3f const& p, double res) {
+  const int64_t offset = 1 << 20, mask = (1 << 21) - 1;
+  return ((static_cast<int64_t>(std::floor(p(0) / res)) + offset) & mask) |
+         (((static_cast<int64_t>(std::floor(p(1) / res)) + offset) & mask) << 21) |
+         (((static_cast<int64_t>(std::floor(p(2) / res)) + offset) & mask) << 42);
+}
+
+Vec3f CellCenter(int64_t cell, double res) {
+  const int64_t offset = 1 << 20, mask = (1 << 21) - 1;
+  Vec3f p;
+  for (int i = 0; i < 3; i++)
+    p(i) = (((cell >> (21 * i)) & mask) - offset + 0.5) * res;
+  return p;
+}
+
+}  // namespace
+
+bool Map::Build(std::vector<ff_msgs::Zone> const& zones,
+                vec_Vec3f const& points, double res, double radius) {
+  // nothing to do if the map is the same, and only the corridors near the
+  // points that changed to drop if only those did
+  std::vector<double> settings = {res, radius};
+  for (auto &zone : zones) {
+    settings.insert(settings.end(), {static_cast<double>(zone.type), zone.min.x, zone.min.y, zone.min.z,
+                                     zone.max.x, zone.max.y, zone.max.z});
+  }
+  std::unordered_set<int64_t> cells;
+  for (auto &p : points) cells.insert(PackCell(p, res));
+  if (jps_planner_ != NULL && settings == settings_) {
+    if (cells == cells_) return true;
+    vec_Vec3f changed;
+    for (int64_t c : cells)
+      if (cells_.find(c) == cells_.end()) changed.push_back(CellCenter(c, res));
+    for (int64_t c : cells_)
+      if (cells.find(c) == cells.end()) changed.push_back(CellCenter(c, res));
+    DropCorridorsNear(changed, radius + res);
+  } else {
+    corridors_.clear();
+  }
+  settings_.clear();
+  cells_.clear();
+  jps_planner_.reset();
+
+  res_ = res;
+
+  Vec3f min, max, zmin, zmax;
+  min << 1000.0, 1000.0, 1000.0;
+  max << -1000.0, -1000.0, -1000.0;
+  uint num_keepin = 0;
+  for (auto &zone : zones) {
+    if (zone.type == ff_msgs::Zone::KEEPIN) {
+      zmin << zone.min.x, zone.min.y, zone.min.z;
+      zmax << zone.max.x, zone.max.y, zone.max.z;
+      for (int i = 0; i < 3; i++) {
+        min(i) = std::min(min(i), zmin(i));
+        min(i) = std::min(min(i), zmax(i));
+        max(i) = std::max(max(i), zmin(i));
+        max(i) = std::max(max(i), zmax(i));
+      }
+      num_keepin++;
+    }
+  }
+  if (num_keepin == 0) {
+    ROS_ERROR("Zero keepin zones!! Plan failed");
+    return false;
+  }
+  min -= Vec3f::Ones() * res_ * 2.0;
+  max += Vec3f::Ones() * res_ * 2.0;
+
+  Vec3f origin = min;
+  Vec3f dimf = (max - min) / res_;
+  Vec3i dim(std::ceil(dimf(0)), std::ceil(dimf(1)), std::ceil(dimf(2)));
+  int num_cell = dim(0) * dim(1) * dim(2);
+
+  std::vector<signed char> map(num_cell, 0);
+
+  jps_map_util_.reset(new JPS::VoxelMapUtil());
+  jps_map_util_->setMap(origin, dim, map, res_);
+
+  vec_Vec3f keepout_points = points;
+
+  // add contour
+  for (auto &zone : zones) {
+    zmin << std::min(zone.min.x, zone.max.x),
+        std::min(zone.min.y, zone.max.y), std::min(zone.min.z, zone.max.z);
+    zmax << std::max(zone.min.x, zone.max.x),
+        std::max(zone.min.y, zone.max.y), std::max(zone.min.z, zone.max.z);
+    Vec3f tmp = Vec3f::Zero();
+    for (int i = 0; i < 3; i++) {
+      int j = (i + 1) % 3;
+      int k = (i + 2) % 3;
+      if (zone.type == ff_msgs::Zone::KEEPIN) {
+        for (auto zx = zmin(j); zx <= zmax(j); zx += res_) {
+          for (auto zy = zmin(k); zy <= zmax(k); zy += res_) {
+            tmp(j) = zx;
+            tmp(k) = zy;
+            tmp(i) = zmin(i) - res_ * 1.001;
+            map[jps_map_util_->getIndex(jps_map_util_->floatToInt(tmp))] =
+                100;
+            tmp(i) = zmax(i) + res_ * 1.001;
+            map[jps_map_util_->getIndex(jps_map_util_->floatToInt(tmp))] =
+                100;
+          }
+        }
+      }
+    }
+  }
+
+  for (auto &zone : zones) {
+    zmin << std::min(zone.min.x, zone.max.x),
+        std::min(zone.min.y, zone.max.y), std::min(zone.min.z, zone.max.z);
+    zmax << std::max(zone.min.x, zone.max.x),
+        std::max(zone.min.y, zone.max.y), std::max(zone.min.z, zone.max.z);
+    // add points on surface
+    Vec3f tmp = Vec3f::Zero();
+    for (int i = 0; i < 3; i++) {
+      int j = (i + 1) % 3;
+      int k = (i + 2) % 3;
+      for (auto zx = zmin(j); zx <= zmax(j); zx += res_)
+        for (auto zy = zmin(k); zy <= zmax(k); zy += res_) {
+          if (zone.type == ff_msgs::Zone::KEEPOUT) {
+            tmp(j) = zx;
+            tmp(k) = zy;
+            tmp(i) = zmin(i);
+            keepout_points.push_back(tmp);
+            tmp(i) = zmax(i);
+            keepout_points.push_back(tmp);
+          } else {
+            for (auto zz = zmin(i); zz <= zmax(i); zz += res_) {
+              tmp(j) = zx;
+              tmp(k) = zy;
+              tmp(i) = zz;
+              map[jps_map_util_->getIndex(jps_map_util_->floatToInt(tmp))] =
+                  0;
+            }
+          }
+        }
+    }
+    ROS_DEBUG_STREAM("PlannerQP: Keepout: " << zmin.transpose() << " to "
+                                            << zmax.transpose());
+  }
+  // reset map
+  jps_map_util_->setMap(origin, dim, map, res_);
+  ROS_DEBUG_STREAM("PlannerQP: add3DPoints: " << keepout_points.size());
+  // dialate
+  jps_map_util_->freeUnKnown();
+  jps_map_util_->dilate(radius, radius);
+  jps_map_util_->add3DPoints(keepout_points);
+  ROS_DEBUG_STREAM("PlannerQP: Map origin " << origin.transpose() << " dim "
+                                            << dim.transpose() << " resolution "
+                                            << res_);
+  ROS_DEBUG_STREAM("PlannerQP: Dilating");
+  jps_map_util_->dilating();
+
+  jps_planner_.reset(new JPS::JPS3DUtil(false));
+  jps_planner_->setMapUtil(jps_map_util_.get());
+
+  decomp_util_.reset(new EllipseDecomp(
+      jps_map_util_->getOrigin(),
+      jps_map_util_->getDim().cast<decimal_t>() * jps_map_util_->getRes(),
+      false));
+  decomp_util_->set_obstacles(jps_map_util_->getCloud());
+
+  settings_.swap(settings);
+  cells_.swap(cells);
+  return true;
+}
+
+void Map::DropCorridorsNear(vec_Vec3f const& points, double margin) {
+  if (points.empty()) return;
+  size_t before = corridors_.size();
+  for (auto it = corridors_.begin(); it != corridors_.end();) {
+    // a point is near if it is within margin of every face
+    auto const& A = it->second.first;
+    auto const& b = it->second.second;
+    VecDf norms = A.rowwise().norm();
+    bool near = false;
+    for (size_t i = 0; i < points.size() && !near; i++) {
+      VecDf d = A * points[i] - b;
+      near = (d.array() <= margin * norms.array()).all();
+    }
+    if (near)
+      it = corridors_.erase(it);
+    else
+      ++it;
+  }
+  ROS_DEBUG_STREAM("PlannerQP: " << points.size() << " cells changed, dropped "
+                   << before - corridors_.size() << " of " << before << " corridors");
+}
+
+bool Map::Corridors(traj_opt::Vec3 const& start, traj_opt::Vec3 const& goal,
+                    vec_Vec3f* path, Constraints* cons) {
+  if (jps_planner_ == NULL) return false;
+
+  traj_opt::Vec3 diff = goal - start;
+  diff << std::abs(diff(0)), std::abs(diff(1)), std::abs(diff(2));
+  diff -= traj_opt::Vec3::Ones() * res_;
+
+  bool close = false;
+  path->clear();
+  if (diff(0) < 0 && diff(1) < 0 && diff(2) < 0) {
+    ROS_INFO_STREAM(
+        "Start and goal are within map resolution: " << diff.transpose());
+    path->push_back(start);
+    path->push_back(goal);
+    close = true;
+  } else {
+    ROS_DEBUG_STREAM("PlannerQP: JPS running");
+    if (!jps_planner_->plan(start, goal)) {
+      ROS_ERROR("Planner::QP: Jump point search failed!");
+      return false;
+    }
+    *path = jps_planner_->getPath();
+  }
+  // get the constraints of each section, which do not depend on the others,
+  // from the cache or the decomposition, and repackage as dynamic sized arrays
+  vec_LinearConstraint3f cons_3d;
+  int decomposed = 0;
+  for (size_t i = 0; i + 1 < path->size(); i++) {
+    SectionKey key;
+    for (int j = 0; j < 3; j++) {
+      key[j] = std::llround(path->at(i)(j) * 1000.0);
+      key[j + 3] = std::llround(path->at(i + 1)(j) * 1000.0);
+    }
+    auto it = corridors_.find(key);
+    if (it == corridors_.end()) {
+      vec_Vec3f section = {path->at(i), path->at(i + 1)};
+      decomp_util_->decomp(section);
+      vec_LinearConstraint3f section_cons = decomp_util_->get_constraints();
+      if (section_cons.empty()) return false;
+      if (corridors_.size() >= kMaxCorridors) corridors_.clear();
+      it = corridors_.insert(std::make_pair(key, section_cons.front())).first;
+      decomposed++;
+    }
+    cons_3d.push_back(it->second);
+  }
+  ROS_DEBUG_STREAM("PlannerQP: decomposed " << decomposed << " of "
+                   << cons_3d.size() << " path sections");
+
+  for (auto &p : *path) ROS_DEBUG_STREAM("PlannerQP: Path: " << p.transpose());
+  cons->clear();
+  for (auto &ci : cons_3d) {
+    traj_opt::MatD A = traj_opt::MatD::Zero(ci.first.rows(), 4);
+    traj_opt::VecD b =
+        traj_opt::VecD::Zero(ci.second.rows(), ci.second.cols());
+    if (!close) {
+      A.block(0, 0, ci.first.rows(), ci.first.cols()) = ci.first;
+      b.block(0, 0, ci.second.rows(), ci.second.cols()) = ci.second;
+    }
+    ROS_DEBUG_STREAM("PlannerQP: A: " << A);
+    ROS_DEBUG_STREAM("PlannerQP: b: " << b.transpose());
+    cons->push_back(std::pair<traj_opt::MatD, traj_opt::VecD>(A, b));
+  }
+  return true;
+}
+
+boost::shared_ptr<traj_opt::NonlinearTrajectory> Optimize(
+    traj_opt::Vec4 const& start, traj_opt::Vec4 const& goal,
+    vec_Vec3f const& path, Constraints const& cons, int candidates,
+    double max_time,
+    boost::shared_ptr<traj_opt::NonlinearTrajectory> const& previous,
+    std::vector<std::string>* errors) {
+  // Package higher order waypoints
+  traj_opt::Waypoint start_way, goal_way;
+  start_way.pos = start;
+  start_way.use_pos = true;
+  start_way.use_vel = true;
+  start_way.use_acc = true;
+  start_way.use_jrk = true;
+  start_way.knot_id = 0;
+
+  goal_way.pos = goal;
+  goal_way.use_pos = true;
+  goal_way.use_vel = true;
+  goal_way.use_acc = true;
+  goal_way.use_jrk = true;
+  goal_way.knot_id = -1;
+
+  std::vector<traj_opt::Waypoint> con;
+  con.push_back(start_way);
+  con.push_back(goal_way);
+
+  boost::shared_ptr<std::vector<double> > ds =
+      boost::make_shared<std::vector<double> >(cons.size(), 1.0);
+
+  // with more than one candidate, also optimize time allocations that
+  // blend from equal times to times proportional to the path length in
+  // each corridor, all with the same total time so their costs compare
+  std::vector<boost::shared_ptr<std::vector<double> > > allocations(1, ds);
+  if (candidates > 1 && path.size() == cons.size() + 1) {
+    std::vector<double> lengths(cons.size());
+    double total = 0.0;
+    for (uint i = 0; i < cons.size(); i++) {
+      lengths.at(i) = (path.at(i + 1) - path.at(i)).norm();
+      total += lengths.at(i);
+    }
+    for (int c = 1; c < candidates && total > 0.0; c++) {
+      double alpha = static_cast<double>(c) / (candidates - 1);
+      boost::shared_ptr<std::vector<double> > dc =
+          boost::make_shared<std::vector<double> >(cons.size());
+      for (uint i = 0; i < cons.size(); i++)
+        dc->at(i) = (1.0 - alpha) + alpha * lengths.at(i) * cons.size() / total;
+      allocations.push_back(dc);
+    }
+  }
+  // candidates stop at the max generation time, and only the first is
+  // warm started since the solvers would share a factorization otherwise
+  if (allocations.size() == 1) max_time = 0.0;
+  std::vector<boost::shared_ptr<traj_opt::NonlinearTrajectory> > solutions(
+      allocations.size());
+  errors->assign(allocations.size(), std::string());
+  auto optimize = [&con, &cons, &allocations, &previous, &solutions,
+                   errors, max_time](uint c) {
+    try {
+      solutions.at(c).reset(new traj_opt::NonlinearTrajectory(
+          con, cons, 7, 3, allocations.at(c),
+          boost::shared_ptr<traj_opt::VecDVec>(),
+          c == 0 ? previous
+                 : boost::shared_ptr<traj_opt::NonlinearTrajectory>(),
+          max_time));
+    } catch (std::runtime_error &e) {
+      errors->at(c) = e.what();
+    } catch (...) {
+      errors->at(c) = "unknown error";
+    }
+  };
+  std::vector<std::thread> workers;
+  for (uint c = 1; c < allocations.size(); c++)
+    workers.push_back(std::thread(optimize, c));
+  optimize(0);
+  for (auto &w : workers) w.join();
+
+  // keep the lowest cost solved candidate, or the first one if none are
+  boost::shared_ptr<traj_opt::NonlinearTrajectory> best;
+  for (uint c = 0; c < solutions.size(); c++) {
+    if (solutions.at(c) == NULL || !solutions.at(c)->isSolved()) continue;
+    if (best == NULL || solutions.at(c)->getCost() < best->getCost())
+      best = solutions.at(c);
+  }
+  if (best == NULL) best = solutions.front();
+  return best;
+}
+
+}  // namespace planner_qp
@@ -0,0 +1,271 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Plans standard ISS goal sets with the QP and trapezoidal planners, with no
+// ROS in the loop: module to module moves, moves through a dense scene of
+// keep-out boxes in the US lab, and module to module moves that also turn
+// to face forward. Each goal is planned a number of times, and the positions
+// of the plan are checked against the zones as the mapper validates them.
+// Prints the distribution of planning times, and the solver iterations,
+// costs, path lengths and validation times of each scenario. QP trajectories
+// are not time scaled, which does not change their path or cost.
+
+#include <common/init.h>
+#include <ff_msgs/SetZones.h>
+#include <ff_util/ff_serialization.h>
+#include <jsonloader/keepout_bvh.h>
+#include <planner_qp/solver.h>
+#include <planner_trapezoidal/planner_trapezoidal.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+DEFINE_int32(runs, 10, "Plans of each goal, by each planner.");
+DEFINE_int32(keepouts, 40, "Keep-out boxes in the dense scene.");
+DEFINE_int32(seed, 1, "Seed of the keep-out boxes in the dense scene.");
+DEFINE_int32(candidates, 1, "Time allocations the QP planner optimizes.");
+DEFINE_double(map_resolution, 0.1, "Resolution of the QP planner map, in m.");
+DEFINE_double(robot_radius, 0.1, "Radius the QP planner dilates zones by, in m.");
+DEFINE_double(vel, 0.2, "Velocity limit, in m/s.");
+DEFINE_double(accel, 0.02, "Acceleration limit, in m/s^2.");
+DEFINE_double(omega, 0.1745, "Angular velocity limit, in rad/s.");
+DEFINE_double(alpha, 0.1745, "Angular acceleration limit, in rad/s^2.");
+DEFINE_double(rate, 1.0, "Control rate the trapezoidal planner samples for, in Hz.");
+DEFINE_double(epsilon, 1e-3, "Threshold of the trapezoidal planner.");
+DEFINE_double(faceforward_shim, 0.2, "Shortest face-forward move of the trapezoidal planner, in m.");
+
+namespace {
+
+struct Goal {
+  Eigen::Vector3d start, end;
+  double start_yaw, end_yaw;
+};
+
+struct Scenario {
+  std::string name;
+  std::vector<Goal> goals;
+  bool dense;             // with the keep-out boxes in the US lab
+  bool faceforward;
+};
+
+// The plans of one planner in one scenario
+struct Stats {
+  std::vector<double> plan_time, validate_time;
+  double iterations = 0, cost = 0, length = 0;
+  int plans = 0, failed = 0, invalid = 0;
+};
+
+double Seconds(std::chrono::steady_clock::time_point const& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double Percentile(std::vector<double> v, double p) {
+  if (v.empty())
+    return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, static_cast<size_t>(p * v.size()))];
+}
+
+Eigen::Affine3d Pose(Eigen::Vector3d const& p, double yaw) {
+  Eigen::Affine3d pose = Eigen::Affine3d::Identity();
+  pose.translation() = p;
+  pose.linear() = Eigen::AngleAxisd(yaw, Eigen::Vector3d::UnitZ()).toRotationMatrix();
+  return pose;
+}
+
+// The centers of the modules, within the default keep-in zones
+std::vector<Scenario> Scenarios(void) {
+  Eigen::Vector3d lab(2.0, 0.0, 4.85), node1(-4.46, 0.0, 4.8), node2(10.9, 0.0, 4.8),
+                  jem(11.0, 6.0, 4.8), columbus(10.9, -8.0, 4.9), airlock(-4.46, -4.4, 4.9);
+  std::vector<Goal> modules = {
+    {lab, node2, 0, 0}, {node2, jem, 0, 0}, {node2, columbus, 0, 0},
+    {lab, node1, 0, 0}, {node1, airlock, 0, 0}, {jem, lab, 0, 0}};
+  std::vector<Goal> dense = {
+    {Eigen::Vector3d(-0.8, 0.0, 4.85), Eigen::Vector3d(4.8, 0.0, 4.85), 0, 0},
+    {Eigen::Vector3d(0.0, 0.6, 4.3), Eigen::Vector3d(4.5, -0.6, 5.4), 0, 0},
+    {Eigen::Vector3d(4.5, 0.6, 5.4), Eigen::Vector3d(-0.5, -0.6, 4.3), 0, 0}};
+  std::vector<Goal> turns = modules;
+  for (size_t i = 0; i < turns.size(); i++)
+    turns[i].end_yaw = (i % 2 ? -1 : 1) * M_PI / 2;
+  return {{"module", modules, false, false}, {"dense", dense, true, false}, {"faceforward", turns, false, true}};
+}
+
+// Keep-out boxes in the US lab that stay clear of the ends of the goals
+std::vector<ff_msgs::Zone> DenseKeepouts(std::vector<Goal> const& goals) {
+  std::mt19937 generator(FLAGS_seed);
+  std::uniform_real_distribution<double> x(-0.5, 4.5), y(-0.8, 0.8), z(4.1, 5.6), size(0.1, 0.2);
+  std::vector<ff_msgs::Zone> zones;
+  while (static_cast<int>(zones.size()) < FLAGS_keepouts) {
+    Eigen::Vector3d c(x(generator), y(generator), z(generator));
+    double s = size(generator);
+    bool clear = true;
+    for (Goal const& g : goals)
+      clear = clear && (c - g.start).lpNorm<Eigen::Infinity>() > s + 2 * FLAGS_robot_radius
+                    && (c - g.end).lpNorm<Eigen::Infinity>() > s + 2 * FLAGS_robot_radius;
+    if (!clear)
+      continue;
+    ff_msgs::Zone zone;
+    zone.name = "dense";
+    zone.index = zones.size();
+    zone.type = ff_msgs::Zone::KEEPOUT;
+    zone.min.x = c.x() - s; zone.min.y = c.y() - s; zone.min.z = c.z() - s;
+    zone.max.x = c.x() + s; zone.max.y = c.y() + s; zone.max.z = c.z() + s;
+    zones.push_back(zone);
+  }
+  return zones;
+}
+
+// Checks the straight lines between positions as the mapper does, and adds
+// the time taken
+bool Validate(jsonloader::KeepoutBvh const& keepins, jsonloader::KeepoutBvh const& keepouts,
+              std::vector<Eigen::Vector3f> const& positions, Stats* stats) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  bool valid = true;
+  for (size_t i = 1; i < positions.size() && valid; i++)
+    valid = !keepouts.Intersects(positions[i - 1], positions[i]) &&
+            (keepins.Empty() || keepins.Covers(positions[i - 1], positions[i]));
+  stats->validate_time.push_back(Seconds(start));
+  for (size_t i = 1; i < positions.size(); i++)
+    stats->length += (positions[i] - positions[i - 1]).norm();
+  return valid;
+}
+
+bool PlanQP(std::vector<ff_msgs::Zone> const& zones, Goal const& goal,
+            std::vector<Eigen::Vector3f>* positions, Stats* stats) {
+  // the nodelet builds its map for every plan too
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  planner_qp::Map map;
+  if (!map.Build(zones, vec_Vec3f(), FLAGS_map_resolution, FLAGS_robot_radius))
+    return false;
+  vec_Vec3f path;
+  planner_qp::Constraints cons;
+  if (!map.Corridors(goal.start, goal.end, &path, &cons))
+    return false;
+  traj_opt::Vec4 start4, end4;
+  start4 << goal.start, 0;
+  end4 << goal.end, goal.end_yaw - goal.start_yaw;
+  std::vector<std::string> errors;
+  boost::shared_ptr<traj_opt::NonlinearTrajectory> trajectory = planner_qp::Optimize(
+    start4, end4, path, cons, FLAGS_candidates, 0.0, boost::shared_ptr<traj_opt::NonlinearTrajectory>(), &errors);
+  stats->plan_time.push_back(Seconds(start));
+  if (trajectory == NULL || !trajectory->isSolved())
+    return false;
+  stats->iterations += trajectory->getIterations();
+  stats->cost += trajectory->getCost();
+
+  // positions as often as the planner checks its time scaling
+  std::vector<traj_opt::decimal_t> times;
+  for (double t = 0; t < trajectory->getTotalTime(); t += 0.01)
+    times.push_back(t);
+  times.push_back(trajectory->getTotalTime());
+  traj_opt::MatD p;
+  trajectory->sample(Eigen::Map<traj_opt::VecD>(times.data(), times.size()), 0, p);
+  positions->clear();
+  for (int i = 0; i < p.cols(); i++)
+    positions->push_back(p.block<3, 1>(0, i).cast<float>());
+  return true;
+}
+
+bool PlanTrapezoidal(Goal const& goal, bool faceforward, std::vector<Eigen::Vector3f>* positions, Stats* stats) {
+  planner_trapezoidal::limits limits = {FLAGS_vel, FLAGS_omega, FLAGS_accel, FLAGS_alpha, FLAGS_epsilon};
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<planner_trapezoidal::move> moves;
+  planner_trapezoidal::InsertMoves(moves, 0.0, Pose(goal.start, goal.start_yaw), Pose(goal.end, goal.end_yaw),
+                                   limits, faceforward, FLAGS_faceforward_shim);
+  // setpoints as the nodelet samples them
+  positions->clear();
+  std::vector<double> ts;
+  for (planner_trapezoidal::move const& m : moves) {
+    m.Times(0.5 / FLAGS_rate, ts);
+    for (double t : ts)
+      positions->push_back(m.Sample(t).p.cast<float>());
+  }
+  stats->plan_time.push_back(Seconds(start));
+  return !moves.empty();
+}
+
+void Print(std::string const& scenario, std::string const& planner, Stats const& s) {
+  int solved = std::max(s.plans - s.failed, 1);
+  printf("%-12s %-12s %6d %6d %6d %9.3f %9.3f %9.3f %8.1f %10.4g %8.2f %9.4f\n",
+         scenario.c_str(), planner.c_str(), s.plans, s.failed, s.invalid,
+         1000 * Percentile(s.plan_time, 0.5), 1000 * Percentile(s.plan_time, 0.9),
+         1000 * Percentile(s.plan_time, 1.0), s.iterations / solved, s.cost / solved, s.length / solved,
+         1000 * Percentile(s.validate_time, 0.5));
+}
+
+}  // namespace
+
+int main(int argc, char ** argv) {
+  common::InitFreeFlyerApplication(&argc, &argv);
+
+  if (argc < 2) {
+    LOG(INFO) << "Usage: " << argv[0] << " zones.bin";
+    exit(0);
+  }
+
+  ff_msgs::SetZones::Request request;
+  if (!ff_util::Serialization::ReadFile(argv[1], request))
+    LOG(FATAL) << "Cannot open zone file " << argv[1] << ".";
+
+  printf("%-12s %-12s %6s %6s %6s %9s %9s %9s %8s %10s %8s %9s\n", "scenario", "planner", "plans", "failed",
+         "invalid", "p50 ms", "p90 ms", "max ms", "iters", "cost", "length", "valid ms");
+  for (Scenario const& scenario : Scenarios()) {
+    std::vector<ff_msgs::Zone> zones = request.zones;
+    if (scenario.dense) {
+      std::vector<ff_msgs::Zone> keepouts = DenseKeepouts(scenario.goals);
+      zones.insert(zones.end(), keepouts.begin(), keepouts.end());
+    }
+    jsonloader::Keepout::Sequence keepin_boxes, keepout_boxes;
+    for (ff_msgs::Zone const& zone : zones) {
+      jsonloader::Keepout::BoundingBox box(Eigen::Vector3f(zone.min.x, zone.min.y, zone.min.z),
+                                           Eigen::Vector3f(zone.max.x, zone.max.y, zone.max.z));
+      box = jsonloader::Keepout::BoundingBox(box.min().cwiseMin(box.max()), box.min().cwiseMax(box.max()));
+      if (zone.type == ff_msgs::Zone::KEEPOUT)
+        keepout_boxes.push_back(box);
+      else if (zone.type == ff_msgs::Zone::KEEPIN)
+        keepin_boxes.push_back(box);
+    }
+    jsonloader::KeepoutBvh keepins(keepin_boxes), keepouts(keepout_boxes);
+
+    Stats qp, trapezoidal;
+    std::vector<Eigen::Vector3f> positions;
+    for (Goal const& goal : scenario.goals) {
+      for (int run = 0; run < FLAGS_runs; run++) {
+        qp.plans++;
+        if (!PlanQP(zones, goal, &positions, &qp))
+          qp.failed++;
+        else if (!Validate(keepins, keepouts, positions, &qp))
+          qp.invalid++;
+        trapezoidal.plans++;
+        if (!PlanTrapezoidal(goal, scenario.faceforward, &positions, &trapezoidal))
+          trapezoidal.failed++;
+        else if (!Validate(keepins, keepouts, positions, &trapezoidal))
+          trapezoidal.invalid++;
+      }
+    }
+    Print(scenario.name, "qp", qp);
+    Print(scenario.name, "trapezoidal", trapezoidal);
+  }
+}
@@ -86,11 +86,21 @@ class BasisBundle {  // bundles the basis with its derrivatives
                         // derr
   boost::shared_ptr<Basis> getBasis(int i);
 
+  // values of all basis functions, or of their derrivative derr, at x
+  // normalized to 0 to 1, in one product with their tabulated monomial
+  // coefficients. Returns false if derr is not tabulated.
+  bool getVals(decimal_t x, int derr, VecD &vals) const;
+  // the same at each of the points x, one row per point
+  bool getVals(const VecD &x, int derr, MatD &vals) const;
+
   std::vector<boost::shared_ptr<Basis>> derrivatives;
   std::vector<boost::shared_ptr<Basis>> integrals;
 
  protected:
+  void tabulate();  // fills coeffs_ from derrivatives
   uint n_p, k_r;
+  // per derrivative, row i holds the monomial coefficients of basis i
+  std::vector<MatD> coeffs_;
 
   //  std::vector<LegendreBasis> derrivatives;
 };
@@ -111,6 +121,7 @@ class StandardBasis : public Basis {
   friend std::ostream &operator<<(std::ostream &os, const StandardBasis &lb);
   virtual decimal_t innerproduct(uint i, uint j) const;
   virtual Poly getPoly(uint i) const;
+  uint size() const { return polys.size(); }
 
  protected:
   std::vector<Poly> polys;  // basis polynomials
@@ -36,6 +36,8 @@ class Trajectory {
  public:
   virtual ~Trajectory() {}
   virtual bool evaluate(decimal_t t, uint derr, VecD &out) const = 0;
+  // evaluates at each of the times t, one column per time
+  virtual bool sample(const VecD &t, uint derr, MatD &out) const;
   virtual decimal_t getTotalTime() const = 0;
   virtual decimal_t getCost() = 0;
   // execute time
@@ -44,6 +46,9 @@ class Trajectory {
   // returns a matrix (dim X num_derivatives + 1) of the trajectory evalutated
   // at time t
   bool getCommand(decimal_t t, uint num_derivatives, MatD &data);
+  // the same at each of the times t, with one sample per derrivative
+  bool getCommands(const VecD &t, uint num_derivatives,
+                   std::vector<MatD> &data);
 
   void setDim(uint ndim) { dim_ = ndim; }
   void setExecuteTime(decimal_t t) { exec_t = t; }
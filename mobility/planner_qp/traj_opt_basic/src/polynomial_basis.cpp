@@ -24,6 +24,7 @@
 #include <boost/pointer_cast.hpp>
 #include <boost/range/irange.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
 #include <vector>
@@ -114,6 +115,51 @@ decimal_t BasisBundle::getVal(decimal_t x, decimal_t dt, uint coeff,
     }
   }
 }
+bool BasisBundle::getVals(decimal_t x, int derr, VecD &vals) const {
+  if (derr < 0 || derr >= static_cast<int>(coeffs_.size())) return false;
+  if (x > 1.0 || x < 0.0)
+    throw std::out_of_range(
+        "Tried to evaluate basis out of normalized range [0,1]");
+  const MatD &coeffs = coeffs_.at(derr);
+  VecD powers(coeffs.cols());
+  powers(0) = 1.0;
+  for (int k = 1; k < powers.rows(); k++) powers(k) = powers(k - 1) * x;
+  vals = coeffs * powers;
+  return true;
+}
+bool BasisBundle::getVals(const VecD &x, int derr, MatD &vals) const {
+  if (derr < 0 || derr >= static_cast<int>(coeffs_.size())) return false;
+  if (x.rows() > 0 && (x.maxCoeff() > 1.0 || x.minCoeff() < 0.0))
+    throw std::out_of_range(
+        "Tried to evaluate basis out of normalized range [0,1]");
+  const MatD &coeffs = coeffs_.at(derr);
+  MatD powers(x.rows(), coeffs.cols());
+  powers.col(0).setOnes();
+  for (int k = 1; k < powers.cols(); k++)
+    powers.col(k) = powers.col(k - 1).cwiseProduct(x);
+  vals = powers * coeffs.transpose();
+  return true;
+}
+void BasisBundle::tabulate() {
+  coeffs_.clear();
+  for (auto &base : derrivatives) {
+    boost::shared_ptr<StandardBasis> standard =
+        boost::dynamic_pointer_cast<StandardBasis>(base);
+    if (standard == NULL) {
+      coeffs_.clear();
+      return;
+    }
+    Poly::size_type cols = 1;
+    for (uint i = 0; i < standard->size(); i++)
+      cols = std::max(cols, standard->getPoly(i).size());
+    MatD coeffs = MatD::Zero(standard->size(), cols);
+    for (uint i = 0; i < standard->size(); i++) {
+      Poly poly = standard->getPoly(i);
+      for (Poly::size_type k = 0; k < poly.size(); k++) coeffs(i, k) = poly[k];
+    }
+    coeffs_.push_back(coeffs);
+  }
+}
 // BasisBundle::~BasisBundle() {}
 
 Basis::Basis(uint n_p_) : n_p(n_p_) { type_ = PolyType::STANDARD; }
@@ -179,5 +225,6 @@ BasisBundle::BasisBundle(PolyType type, uint n_p_, uint k_r_)
       derrivatives.push_back(base);
     }
   }
+  tabulate();
 }
 }  // namespace traj_opt
@@ -28,6 +28,26 @@ decimal_t Trajectory::getExecuteTime() const {
     return exec_t;
 }
 
+bool Trajectory::sample(const VecD &t, uint derr, MatD &out) const {
+  out = MatD::Zero(dim_, t.rows());
+  for (int i = 0; i < t.rows(); i++) {
+    VecD col;
+    if (!evaluate(t(i), derr, col)) return false;
+    out.col(i) = col;
+  }
+  return true;
+}
+bool Trajectory::getCommands(const VecD &t, uint num_derivatives,
+                             std::vector<MatD> &data) {
+  if (dim_ < 1) return false;
+  data.assign(t.rows(), MatD::Zero(dim_, num_derivatives + 1));
+  for (uint i = 0; i <= num_derivatives; i++) {
+    MatD samples;
+    if (!sample(t, i, samples)) return false;
+    for (int j = 0; j < t.rows(); j++) data.at(j).col(i) = samples.col(j);
+  }
+  return true;
+}
 bool Trajectory::getCommand(decimal_t t, uint num_derivatives, MatD &data) {
   // check input
   if (dim_ < 1) return false;
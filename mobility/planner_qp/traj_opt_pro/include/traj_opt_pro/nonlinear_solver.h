@@ -121,6 +121,22 @@ class CostFunction {
   friend class NonlinearSolver;
 };
 
+// The LU of the KKT system, kept with the sparsity pattern it was analyzed
+// for. The pattern is the same every iteration, and across solves of
+// problems with the same structure, so only the numeric factorization is
+// redone while it matches.
+class KKTFactorization {
+ public:
+  bool factorize(const SpMat &M);
+  VecD solve(const VecD &b) { return lu.solve(b); }
+
+ private:
+  bool matches(const SpMat &M) const;
+  Eigen::SparseLU<SpMat> lu;
+  std::vector<int> outer, inner;
+  bool analyzed{false};
+};
+
 class NonlinearSolver {
  private:
   std::vector<Variable> vars;
@@ -132,11 +148,27 @@ class NonlinearSolver {
   bool presolve();              // initializes equality constraints
   bool specialized_presolve();  // hacky presolve for endpoint basis
   decimal_t duality();          // measure duality gap
+  // factorizes the KKT system with the slack and inequality dual rows
+  // eliminated, G by constraint and H the hessian of the lagrangian
+  bool factorize_reduced(const ETV &A, const ETV &G, const ETV &H);
+  VecD newton_step(const SpMat &b);  // solves the last factorized system
   decimal_t cost_linesearch(const VecD &delta);
 
   void draw_matrix(const SpMat &mat);
   bool presolved_{false};
   decimal_t epsilon_;
+  decimal_t max_time_{0.0};  // of a solve in seconds, no limit if zero
+  boost::shared_ptr<KKTFactorization> kkt_;
+  std::vector<decimal_t> solution_;  // values at the end of the last solve
+  int iterations_{0};                // newton steps of the last solve
+
+  // the reduced system is over the primal and equality dual variables only,
+  // and is much smaller when there are many inequalities
+  bool reduced_kkt_{true};
+  std::vector<int> reduced_id_;  // of each variable, -1 if eliminated
+  int reduced_size_{0};
+  SpMat reduced_G_;   // inequality gradients, one row per constraint
+  VecD reduced_D_;    // u / s of each inequality
 
  public:
   static ETV transpose(const ETV &vec);
@@ -159,9 +191,20 @@ class NonlinearSolver {
   void addConstraint(std::vector<EqConstraint::EqPair> con, decimal_t rhs);
 
   void setCost(boost::shared_ptr<CostFunction> func) { cost = func; }
+  // stops iterating after this long, unsolved unless converged by then
+  void setMaxTime(decimal_t seconds) { max_time_ = seconds; }
+  // eliminate the slack and inequality dual steps before factorizing
+  void setReducedKKT(bool reduced) { reduced_kkt_ = reduced; }
+  int getIterations() const { return iterations_; }
 
   bool solve(bool verbose = false,
              decimal_t epsilon = 1e-8);  // returns sucess / failure
+
+  // Starts the next solve from the last solution of other, and shares its
+  // factorization, if both have the same variables and constraints. Duals
+  // and slacks are kept at least min_dual so the iterations start inside.
+  // Returns false, leaving the cold start, if the structure differs.
+  bool warmStart(const NonlinearSolver &other, decimal_t min_dual = 1e-2);
 };
 
 }  // namespace traj_opt
@@ -79,13 +79,18 @@ class PolyCost;
 class TimeBound;
 class NonlinearTrajectory : public Trajectory {
  public:
-  // standard contruction
+  // standard contruction, warm started from the solution of warm if it was
+  // built for the same number of segments and constraints, and solved for
+  // at most max_time seconds if not zero
   NonlinearTrajectory(
       const std::vector<Waypoint> &waypoints,
       const std::vector<std::pair<MatD, VecD> > &cons, int deg = 7,
       int min_dim = 3, boost::shared_ptr<std::vector<decimal_t> > ds =
                            boost::shared_ptr<std::vector<decimal_t> >(),
-      boost::shared_ptr<VecDVec> path = boost::shared_ptr<VecDVec>());
+      boost::shared_ptr<VecDVec> path = boost::shared_ptr<VecDVec>(),
+      boost::shared_ptr<NonlinearTrajectory> warm =
+          boost::shared_ptr<NonlinearTrajectory>(),
+      decimal_t max_time = 0.0);
   // nonconvex pointcloud test
   NonlinearTrajectory(const std::vector<Waypoint> &waypoints,
                       const Vec3Vec &points, int segs, decimal_t dt);
@@ -93,9 +98,13 @@ class NonlinearTrajectory : public Trajectory {
 
   decimal_t getTotalTime() const;
   bool evaluate(decimal_t t, uint derr, VecD &out) const;
+  // one product per segment with the tabulated basis
+  bool sample(const VecD &t, uint derr, MatD &out) const;
   decimal_t getCost();
   TrajData serialize();
   bool isSolved() { return solved_; }
+  bool isWarmStarted() { return warm_started_; }
+  int getIterations() const { return solver.getIterations(); }
   Vec4Vec getBeads();
   void scaleTime(decimal_t ratio);
 
@@ -114,6 +123,10 @@ class NonlinearTrajectory : public Trajectory {
   void addTimeBound(boost::shared_ptr<std::vector<decimal_t> > ds =
                         boost::shared_ptr<std::vector<decimal_t> >());
   void make_convex(boost::shared_ptr<std::vector<decimal_t> > ds);
+  // segment of time t, which is made relative to the segment start
+  int find_segment(decimal_t *t) const;
+  // (dim X deg + 1) coefficients of segment j, scaled by its time
+  MatD segment_coeffs(int j) const;
   NonlinearSolver solver{10000};
   NLTraj traj;
   NLTimes times;
@@ -126,6 +139,7 @@ class NonlinearTrajectory : public Trajectory {
   int seg_, deg_;
   BasisBundlePro basis;
   bool solved_{false};
+  bool warm_started_{false};
   friend class AxbConstraint;
   friend class BallConstraint;
 };
@@ -110,6 +110,25 @@ decimal_t IneqConstraint::linesearch(const VecD &delta, decimal_t max_h) {
   return max_h;
 }
 
+// KKT factorization
+bool KKTFactorization::matches(const SpMat &M) const {
+  if (!analyzed || static_cast<int>(outer.size()) != M.outerSize() + 1 ||
+      static_cast<int>(inner.size()) != M.nonZeros())
+    return false;
+  return std::equal(outer.begin(), outer.end(), M.outerIndexPtr()) &&
+         std::equal(inner.begin(), inner.end(), M.innerIndexPtr());
+}
+bool KKTFactorization::factorize(const SpMat &M) {
+  if (!matches(M)) {
+    lu.analyzePattern(M);
+    outer.assign(M.outerIndexPtr(), M.outerIndexPtr() + M.outerSize() + 1);
+    inner.assign(M.innerIndexPtr(), M.innerIndexPtr() + M.nonZeros());
+    analyzed = true;
+  }
+  lu.factorize(M);
+  return lu.info() == Eigen::Success;
+}
+
 // Nonlinear solver
 void NonlinearSolver::addConstraint(boost::shared_ptr<EqConstraint> con) {
   con->id = static_cast<int>(eq_con.size());
@@ -176,11 +195,13 @@ bool NonlinearSolver::iterate() {
   coeffs.insert(coeffs.end(), A.begin(), A.end());
   coeffs.insert(coeffs.end(), AT.begin(), AT.end());
 
-  // add G
-  ETV G;
+  // add G, and by constraint for the reduced system
+  ETV G, Gr;
   for (auto &ineq : ineq_con) {
     ETV Gi = ineq->gradient();
     G.insert(G.end(), Gi.begin(), Gi.end());
+    if (reduced_kkt_)
+      for (auto &t : Gi) Gr.push_back(ET(ineq->id, t.col(), t.value()));
     bcoeffs.push_back(ineq->slack());
     bcoeffs.push_back(ineq->sports_util(nu(ineq->id)));
     // S,I and Z
@@ -198,8 +219,7 @@ bool NonlinearSolver::iterate() {
 
   // add to left hand side
 
-  ETV co = cost->hessian();
-  coeffs.insert(coeffs.end(), co.begin(), co.end());
+  ETV H = cost->hessian();
   ETV na = cost->gradient();
   bcoeffs.insert(bcoeffs.end(), na.begin(), na.end());
   // end Add Cost
@@ -209,16 +229,16 @@ bool NonlinearSolver::iterate() {
     ETV coi = ineq->hessian();
     ETV gu = ineq->gradientS();
 
-    coeffs.insert(coeffs.end(), coi.begin(), coi.end());
+    H.insert(H.end(), coi.begin(), coi.end());
     bcoeffs.insert(bcoeffs.end(), gu.begin(), gu.end());
   }
+  coeffs.insert(coeffs.end(), H.begin(), H.end());
   for (auto &eq : eq_con) {
     ETV av = eq->audio_video();
     bcoeffs.insert(bcoeffs.end(), av.begin(), av.end());
   }
 
   // pack non summands
-  M.setFromTriplets(coeffs.begin(), coeffs.end());
   b.setFromTriplets(bcoeffs.begin(), bcoeffs.end());
 
   // pass to backend
@@ -226,23 +246,29 @@ bool NonlinearSolver::iterate() {
   //    std::cout << "Frontend took " << tm.toc() << std::endl;
   //    tm.tic();
 
-  // backend bottleneck
-  Eigen::SparseLU<SpMat> solver;
+  // backend bottleneck, the pattern is only analyzed when it changes
+  if (!kkt_) kkt_ = boost::make_shared<KKTFactorization>();
   //    Eigen::SparseQR<SpMat,Eigen::COLAMDOrdering<int> > solver;
   //    Eigen::PardisoLU<SpMat> solver;
 
   //        std::cout << "M: " << M << std::endl;
   //        std::cout << "b: " << b << std::endl;
   //    draw_matrix(M);
-  solver.compute(M);
+  bool factorized;
+  if (reduced_kkt_) {
+    factorized = factorize_reduced(A, Gr, H);
+  } else {
+    M.setFromTriplets(coeffs.begin(), coeffs.end());
+    factorized = kkt_->factorize(M);
+  }
   //    std::cout << "Back end took " << tm.toc() << std::endl;
 
-  if (solver.info() != Eigen::Success) {
+  if (!factorized) {
     std::cout << "Back end failed" << std::endl;
     //        std::cout << M << std::endl;
     return false;
   }
-  VecD delta_x = solver.solve(b);
+  VecD delta_x = newton_step(b);
 
   //    VecD err = M*delta_x;
   //    err-=b;
@@ -297,7 +323,7 @@ bool NonlinearSolver::iterate() {
     b.coeffRef(suv.row(), suv.col()) = suv.value();
   }
   //     std::cout << "updated b: " << b << std::endl;
-  delta_x = solver.solve(b);
+  delta_x = newton_step(b);
 
   // redo line search
   max_h = 1.0;
@@ -355,8 +381,80 @@ bool NonlinearSolver::iterate() {
 
   return (mu > epsilon_) && (max_h > 1e-15);
 }
+bool NonlinearSolver::factorize_reduced(const ETV &A, const ETV &G,
+                                        const ETV &H) {
+  int num_u = ineq_con.size();
+  int num_r = reduced_size_;
+  ETV K;
+  K.reserve(H.size() + 2 * A.size());
+  for (auto &t : H)
+    K.push_back(
+        ET(reduced_id_.at(t.row()), reduced_id_.at(t.col()), t.value()));
+  for (auto &t : A) {
+    int row = reduced_id_.at(t.row());
+    int col = reduced_id_.at(t.col());
+    K.push_back(ET(row, col, t.value()));
+    K.push_back(ET(col, row, t.value()));
+  }
+  ETV Gr;
+  Gr.reserve(G.size());
+  for (auto &t : G)
+    Gr.push_back(ET(t.row(), reduced_id_.at(t.col()), t.value()));
+  reduced_G_.resize(num_u, num_r);
+  reduced_G_.setFromTriplets(Gr.begin(), Gr.end());
+  reduced_D_.resize(num_u);
+  for (auto &con : ineq_con)
+    reduced_D_(con->id) = con->var_u->val / con->var_s->val;
+
+  // [H + G' D G, A'; A, 0] with D = U / S
+  SpMat M(num_r, num_r);
+  M.setFromTriplets(K.begin(), K.end());
+  SpMat DG = reduced_D_.asDiagonal() * reduced_G_;
+  M += SpMat(reduced_G_.transpose() * DG);
+  return kkt_->factorize(M);
+}
+VecD NonlinearSolver::newton_step(const SpMat &b) {
+  VecD rhs = VecD(b);
+  if (!reduced_kkt_) return kkt_->solve(rhs);
+
+  // fold the slack and dual rows into the right hand side
+  VecD w(ineq_con.size());
+  for (auto &con : ineq_con)
+    w(con->id) = reduced_D_(con->id) *
+                 (rhs(con->var_u->id) - rhs(con->var_s->id) / con->var_u->val);
+  VecD r = reduced_G_.transpose() * w;
+  for (uint i = 0; i < vars.size(); i++)
+    if (reduced_id_.at(i) >= 0) r(reduced_id_.at(i)) += rhs(i);
+  VecD y = kkt_->solve(r);
+
+  // and recover their steps from the rest
+  VecD delta = VecD::Zero(vars.size());
+  for (uint i = 0; i < vars.size(); i++)
+    if (reduced_id_.at(i) >= 0) delta(i) = y(reduced_id_.at(i));
+  VecD gy = reduced_G_ * y;
+  for (auto &con : ineq_con) {
+    decimal_t u = con->var_u->val;
+    decimal_t r_u = rhs(con->var_u->id);
+    decimal_t r_s = rhs(con->var_s->id);
+    decimal_t du = reduced_D_(con->id) * (gy(con->id) - r_u + r_s / u);
+    delta(con->var_u->id) = du;
+    delta(con->var_s->id) = (r_s - con->var_s->val * du) / u;
+  }
+  return delta;
+}
 bool NonlinearSolver::solve(bool verbose, decimal_t epsilon) {
   epsilon_ = epsilon;
+  if (reduced_kkt_) {
+    // reduced system indices of the primal and equality dual variables
+    reduced_id_.assign(vars.size(), 0);
+    for (auto &con : ineq_con) {
+      reduced_id_.at(con->var_u->id) = -1;
+      reduced_id_.at(con->var_s->id) = -1;
+    }
+    reduced_size_ = 0;
+    for (auto &id : reduced_id_)
+      if (id >= 0) id = reduced_size_++;
+  }
   int max_iterations = 50;
   decimal_t nu = 0.5;
 
@@ -384,6 +482,7 @@ bool NonlinearSolver::solve(bool verbose, decimal_t epsilon) {
 
   // bool costreg=false;
   int its = 0;
+  iterations_ = 0;
   for (int i = 0; i < max_iterations; i++) {
     its = i;
     if (verbose) {
@@ -407,6 +506,8 @@ bool NonlinearSolver::solve(bool verbose, decimal_t epsilon) {
       //            std::cout << "Cost: " << cost->evaluate() << std::endl;
       //            tm.tic();
     }
+    if (max_time_ > 0.0 && tm_t.toc() > max_time_) break;
+    iterations_++;
     if (!iterate()) break;
 
     // check cost regression
@@ -430,6 +531,8 @@ bool NonlinearSolver::solve(bool verbose, decimal_t epsilon) {
     //            std::cout << "Iteration took: " << tm.toc() << std::endl;
   }
   decimal_t mu = duality();
+  solution_.resize(vars.size());
+  for (uint i = 0; i < vars.size(); i++) solution_.at(i) = vars.at(i).val;
   if (verbose) {
     std::cout << "Solver terminated." << std::endl;
     //        if(costreg)
@@ -460,6 +563,20 @@ bool NonlinearSolver::solve(bool verbose, decimal_t epsilon) {
     std::cout << "Total time: " << tm_t.toc() * 1000.0 << " ms." << std::endl;
   return mu <= epsilon_;
 }
+bool NonlinearSolver::warmStart(const NonlinearSolver &other,
+                                decimal_t min_dual) {
+  if (other.solution_.size() != vars.size() ||
+      other.eq_con.size() != eq_con.size() ||
+      other.ineq_con.size() != ineq_con.size())
+    return false;
+  for (uint i = 0; i < vars.size(); i++) vars.at(i).val = other.solution_.at(i);
+  for (auto &con : ineq_con) {
+    con->var_u->val = std::max(con->var_u->val, min_dual);
+    con->var_s->val = std::max(con->var_s->val, min_dual);
+  }
+  kkt_ = other.kkt_;
+  return true;
+}
 bool NonlinearSolver::specialized_presolve() {
   // int num_v = eq_con.size();
   // int num_u = ineq_con.size();
@@ -62,7 +62,8 @@ NonlinearTrajectory::NonlinearTrajectory(
     const std::vector<Waypoint> &waypoints,
     const std::vector<std::pair<MatD, VecD>> &cons, int deg, int min_dim,
     boost::shared_ptr<std::vector<decimal_t>> ds,
-    boost::shared_ptr<VecDVec> path)
+    boost::shared_ptr<VecDVec> path,
+    boost::shared_ptr<NonlinearTrajectory> warm, decimal_t max_time)
     : seg_(cons.size()), deg_(deg), basis(PolyType::ENDPOINT, deg_, min_dim) {
   dim_ = waypoints.front().pos.rows();
   assert(dim_ == cons.front().first.cols());
@@ -91,6 +92,10 @@ NonlinearTrajectory::NonlinearTrajectory(
   cost = boost::make_shared<PolyCost>(traj, times, basis, min_dim);
 
   solver.setCost(cost);
+  if (warm != NULL && warm->seg_ == seg_ && warm->deg_ == deg_ &&
+      warm->dim_ == dim_)
+    warm_started_ = solver.warmStart(warm->solver);
+  solver.setMaxTime(max_time);
   // call solver
   // solved_ = solver.solve(true);
   solved_ = solver.solve(false);
@@ -403,17 +408,54 @@ decimal_t NonlinearTrajectory::getTotalTime() const {
   for (auto &v : times) T += v->getVal();
   return T;
 }
-bool NonlinearTrajectory::evaluate(decimal_t t, uint derr, VecD &out) const {
-  t = boost::algorithm::clamp(t, 0.0, getTotalTime());
+int NonlinearTrajectory::find_segment(decimal_t *t) const {
+  *t = boost::algorithm::clamp(*t, 0.0, getTotalTime());
   int j = 0;
-  while (j < seg_ && t > times.at(j)->getVal()) {
-    t -= times.at(j)->getVal();
+  while (j < seg_ && *t > times.at(j)->getVal()) {
+    *t -= times.at(j)->getVal();
     j++;
   }
-  j = boost::algorithm::clamp(j, 0, seg_ - 1);
+  return boost::algorithm::clamp(j, 0, seg_ - 1);
+}
+MatD NonlinearTrajectory::segment_coeffs(int j) const {
+  decimal_t dt = times.at(j)->getVal();
+  MatD coeffs(dim_, deg_ + 1);
+  for (int d = 0; d < dim_; d++)
+    for (int i = 0; i <= deg_; i++)
+      coeffs(d, i) = traj.at(d).at(j).at(i)->getVal() * std::pow(dt, i / 2);
+  return coeffs;
+}
+bool NonlinearTrajectory::sample(const VecD &t, uint derr, MatD &out) const {
+  // group the times by segment
+  std::vector<std::vector<int> > by_segment(seg_);
+  VecD rel = t;
+  for (int k = 0; k < t.rows(); k++)
+    by_segment.at(find_segment(&rel(k))).push_back(k);
+
+  out = MatD::Zero(dim_, t.rows());
+  for (int j = 0; j < seg_; j++) {
+    const std::vector<int> &ks = by_segment.at(j);
+    if (ks.empty()) continue;
+    decimal_t dt = times.at(j)->getVal();
+    VecD s(ks.size());
+    for (uint k = 0; k < ks.size(); k++) s(k) = rel(ks.at(k)) / dt;
+    MatD vals;
+    if (!basis.getVals(s, derr, vals)) return Trajectory::sample(t, derr, out);
+    MatD seg = segment_coeffs(j) * vals.transpose() / std::pow(dt, derr);
+    for (uint k = 0; k < ks.size(); k++) out.col(ks.at(k)) = seg.col(k);
+  }
+  return true;
+}
+bool NonlinearTrajectory::evaluate(decimal_t t, uint derr, VecD &out) const {
+  int j = find_segment(&t);
   // decimal_t val=0;
   decimal_t dt = times.at(j)->getVal();
   decimal_t s = t / dt;
+  VecD vals;
+  if (basis.getVals(s, derr, vals)) {
+    out = segment_coeffs(j) * vals / std::pow(dt, derr);
+    return true;
+  }
   out = VecD::Zero(dim_);
   for (int d = 0; d < dim_; d++) {
     for (int i = 0; i <= deg_; i++) {
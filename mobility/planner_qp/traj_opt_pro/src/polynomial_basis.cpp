@@ -289,5 +289,6 @@ BasisBundlePro::BasisBundlePro(PolyType type, uint n_p_, uint k_r_) {
       derrivatives.push_back(base);
     }
   }
+  tabulate();
 }
 }  // namespace traj_opt
@@ -0,0 +1,111 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PLANNER_TRAPEZOIDAL_PLANNER_TRAPEZOIDAL_H_
+#define PLANNER_TRAPEZOIDAL_PLANNER_TRAPEZOIDAL_H_
+
+// FSW includes
+#include <ff_util/ff_flight.h>
+
+// Eigen includes
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+// C++ includes
+#include <vector>
+
+/**
+ * \ingroup planner
+ */
+namespace planner_trapezoidal {
+
+// Structure to store the trapezoid
+struct trapezoid {
+  double v;   // Velocity limit
+  double a;   // Acceleration limit
+  double h;   // Constant velocity
+  double r;   // Ramp time
+  double c;   // Constant velocity time
+
+  // Displacement (x), velocity (dx) and acceleration (ddx) at time t of a
+  // profile that lasts until time e, after which it is at rest
+  void Sample(double t, double e, double epsilon,
+    double &x, double &dx, double &ddx) const;
+};
+
+// A motion between two poses, as a linear and a rotational trapezoid along
+// fixed directions. It is only sampled into setpoints when the plan is sent.
+struct move {
+  double duration;            // Time taken
+  double epsilon;             // Threshold below which magnitudes are ignored
+  Eigen::Affine3d p0;         // Starting pose
+  Eigen::Vector3d lin_d;      // Direction of translation
+  Eigen::Vector3d rot_d;      // Axis of rotation
+  double lin_m, rot_m;        // Magnitudes of translation and rotation
+  trapezoid lin, rot;         // Profiles of translation and rotation
+
+  // The state at time t from the start of the move
+  ff_util::State Sample(double t) const;
+
+  // The times at which the profiles change phase, and samples up to period
+  // apart, in order
+  void Times(double period, std::vector<double> &ts) const;
+};
+
+// The limits the ramps are solved for
+struct limits {
+  double lin_v;               // Max linear velocity
+  double rot_v;               // Max angular velocity
+  double lin_a;               // Max linear acceleration
+  double rot_a;               // Max angular acceleration
+  double epsilon;             // Threshold below which magnitudes are ignored
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Given some linear or angular displacement (d) and a maximum acceleration   //
+// (a) and velocity (v), return the time taken (t) to achieve the motion as   //
+// quickly as possible. Also return the time (r) needed to accelerate to or   //
+// decelerate from the cruise phase, which lasts a given time (c) at a        //
+// constant velocity (h).                                                     //
+////////////////////////////////////////////////////////////////////////////////
+double GreedyRamp(double d, double v, double a, double epsilon,
+  double &r, double &c, double &h);
+
+////////////////////////////////////////////////////////////////////////////////
+// Smear a linear or angular displacement (d) over some time (t) taking       //
+// into account a maximum acceleration (a) and velocity (v). The algorithm    //
+// finds resultant time (r) needed  to accelerate to / decelerate from        //
+// cruise time (c) at a constant velocity (h).                                //
+////////////////////////////////////////////////////////////////////////////////
+void FairRamp(double t, double d, double v, double a, double epsilon,
+  double &r, double &c, double &h);
+
+// Insert a trapezoid between two poses, taking at least dt if it is positive
+void InsertTrapezoid(std::vector<move> &moves, double dt,
+  const Eigen::Affine3d & p0, const Eigen::Affine3d & p1, limits const& l);
+
+// Insert the moves between two poses. When faceforward is set and the
+// translation is longer than shim, the robot first turns to face the
+// direction of motion, then translates, then turns to the final attitude.
+void InsertMoves(std::vector<move> &moves, double dt,
+  const Eigen::Affine3d & p0, const Eigen::Affine3d & p1, limits const& l,
+  bool faceforward, double shim);
+
+}  // namespace planner_trapezoidal
+
+#endif  // PLANNER_TRAPEZOIDAL_PLANNER_TRAPEZOIDAL_H_
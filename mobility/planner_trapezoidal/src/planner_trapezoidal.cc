@@ -0,0 +1,238 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <planner_trapezoidal/planner_trapezoidal.h>
+
+// C++ includes
+#include <algorithm>
+#include <cmath>
+
+namespace planner_trapezoidal {
+
+void trapezoid::Sample(double t, double e, double epsilon,
+  double &x, double &dx, double &ddx) const {
+  if (t >= e) {                           // End of ramp
+    ddx = 0.0;
+    dx = 0.0;
+    x = a * r * r + h * c;
+  } else if (t >= r + c) {                // Ramp-down
+    t -= r + c;
+    ddx = -a;
+    dx = h - a * t;
+    x = 0.5 * a * r * r + h * c + h * t - 0.5 * a * t * t;
+  } else if (t >= r && c > epsilon) {     // Cruise-phase
+    t -= r;
+    ddx = 0.0;
+    dx = h;
+    x = 0.5 * a * r * r + h * t;
+  } else if (t >= 0.0) {                  // Ramp-up
+    ddx = a;
+    dx = a * t;
+    x = 0.5 * a * t * t;
+  }
+}
+
+ff_util::State move::Sample(double t) const {
+  ff_util::State state;
+  state.t = t;
+  state.p = p0.translation();
+  state.v = Eigen::Vector3d(0.0, 0.0, 0.0);
+  state.a = Eigen::Vector3d(0.0, 0.0, 0.0);
+  state.q = p0.rotation();
+  state.w = Eigen::Vector3d(0.0, 0.0, 0.0);
+  state.b = Eigen::Vector3d(0.0, 0.0, 0.0);
+  double x = 0.0, dx = 0.0, ddx = 0.0;
+  // Deal with the linear component
+  if (lin_m > epsilon) {
+    lin.Sample(t, duration, epsilon, x, dx, ddx);
+    state.p = p0.translation() + lin_d * x;
+    state.v = lin_d * dx;
+    state.a = lin_d * ddx;
+  }
+  // Deal with the angular component
+  if (rot_m > epsilon) {
+    rot.Sample(t, duration, epsilon, x, dx, ddx);
+    state.q = p0.rotation() * Eigen::Quaterniond(Eigen::AngleAxisd(x, rot_d));
+    state.w = rot_d * dx;
+    state.b = rot_d * ddx;
+  }
+  return state;
+}
+
+void move::Times(double period, std::vector<double> &ts) const {
+  ts.clear();
+  if (lin_m > epsilon) {
+    ts.push_back(lin.r);              // End of ramp-up
+    if (lin.c > epsilon)
+      ts.push_back(lin.r + lin.c);    // End of cruise-phase
+  }
+  if (rot_m > epsilon) {
+    ts.push_back(rot.r);              // End of ramp-up
+    if (rot.c > epsilon)
+      ts.push_back(rot.r + rot.c);    // End of cruise-phase
+  }
+  for (double t = 0.0; t < duration; t += period)
+    ts.push_back(t);
+  ts.push_back(duration);
+  std::sort(ts.begin(), ts.end());
+}
+
+double GreedyRamp(double d,         // Distance
+                  double v,         // Max velocity
+                  double a,         // Max acceleration
+                  double epsilon,   // Threshold
+                  double &r,        // Ramp time
+                  double &c,        // Time at constant velocity
+                  double &h) {      // Constant velocity
+  if (d < epsilon)                  // Doesn't work for small / negative numbers
+    return 0.0;
+  h = sqrt(a * d);                  // The max vel required if one had zero dwell
+  if (h > v) {                      // If the required velocity is too high
+    h = v;                          // Clamp the velocity to maximum
+    r = h / a;                      // Time taken to ramp up and down to max vel
+    c = (d - h * h / a) / h;        // Dwell time at maxmimum velocity
+  } else {                          // If we don't need to achieve max velocity
+    r = d / h;                      // Time taken to ramp up/down to right vel
+    c = 0.0;                        // Time at constant velocity
+  }
+  return (r * 2.0 + c);             // Minimum time required to complete action
+}
+
+void FairRamp(double t,         // Time
+              double d,         // Distance
+              double v,         // Max velocity
+              double a,         // Max acceleration
+              double epsilon,   // Threshold
+              double &r,        // Ramp time
+              double &c,        // Time at constant velocity
+              double &h) {      // Constant velocity
+  if (t < epsilon ||
+      d < epsilon)              // This doesn't work for small / negative numbers
+    return;
+  // If a triangle ramp-up results in correct displacement, then pyramidal
+  if (fabs(t * t * a / 4.0 - d) < epsilon) {
+    h = sqrt(a * d);
+    r = t / 2.0;
+    c = 0.0;
+  // In the case of a trapezoidal ramp, things are more complex to calculate
+  } else {
+    h = (a * t - sqrt(a * a * t * t - 4.0 * d * a)) / 2.0;
+    r = h / a;
+    c = (d - r * h) / h;
+  }
+}
+
+void InsertTrapezoid(std::vector<move> &moves, double dt,
+  const Eigen::Affine3d & p0, const Eigen::Affine3d & p1, limits const& l) {
+  // Find the delta transform between the two poses
+  Eigen::AngleAxisd error_ang(p0.rotation().inverse()* p1.rotation());
+  Eigen::Vector3d error_vec(p1.translation() - p0.translation());
+  // Make sure that we are taking the minimum angle of rotatin
+  error_ang.angle() = fmod(error_ang.angle(), 2.0 * M_PI);
+  if (error_ang.angle() > M_PI)
+    error_ang.angle() -= 2.0 * M_PI;
+  if (error_ang.angle() < -M_PI)
+    error_ang.angle() += 2.0 * M_PI;
+  if (error_ang.angle() < 0) {
+    error_ang.angle() *= -1.0;
+    error_ang.axis() *= -1.0;
+  }
+  // Get the linear and rotational directions
+  move m;
+  m.epsilon = l.epsilon;
+  m.p0 = p0;
+  m.lin_d = error_vec.normalized();
+  m.rot_d = error_ang.axis().normalized();
+  // Get the linear and rotational magnitudes
+  m.lin_m = error_vec.norm();
+  m.rot_m = error_ang.angle();
+  // Special case: the beginning and end poses are the same
+  if (m.lin_m < l.epsilon && m.rot_m < l.epsilon)
+    return;
+  // Greedy phase - calculate the linear and rotational ramps separately
+  double lin_t = 0.0, lin_r = 0.0, lin_c = 0.0, lin_h = 0.0;
+  lin_t = GreedyRamp(m.lin_m, l.lin_v, l.lin_a, l.epsilon, lin_r, lin_c, lin_h);
+  double rot_t = 0.0, rot_r = 0.0, rot_c = 0.0, rot_h = 0.0;
+  rot_t = GreedyRamp(m.rot_m, l.rot_v, l.rot_a, l.epsilon, rot_r, rot_c, rot_h);
+  // Now determine whether the angular or linear component dominates...
+  double tmin = (lin_t > rot_t ? lin_t : rot_t);
+  if (dt > 0 && tmin < dt)
+    tmin = dt;
+  // Now recalculate the ramps using the dominating time
+  FairRamp(tmin, m.lin_m, l.lin_v, l.lin_a, l.epsilon, lin_r, lin_c, lin_h);
+  FairRamp(tmin, m.rot_m, l.rot_v, l.rot_a, l.epsilon, rot_r, rot_c, rot_h);
+  m.duration = tmin;
+  m.lin = {l.lin_v, l.lin_a, lin_h, lin_r, lin_c};
+  m.rot = {l.rot_v, l.rot_a, rot_h, rot_r, rot_c};
+  moves.push_back(m);
+}
+
+void InsertMoves(std::vector<move> &moves, double dt,
+  const Eigen::Affine3d & tf_1, const Eigen::Affine3d & tf_4, limits const& l,
+  bool faceforward, double shim) {
+  Eigen::Vector3d delta = tf_4.translation() - tf_1.translation();
+  // Fully-holonomic smear of delta across all axes
+  if (!faceforward || delta.norm() <= shim)
+    return InsertTrapezoid(moves, dt, tf_1, tf_4, l);
+  // Generate a forward-only segment when translations are non-zero. Get the
+  // current vector representing the forward direction
+  Eigen::Vector3d vfwd = delta.normalized();
+  Eigen::Vector3d vdown(0.0, 0.0, 1.0);
+  Eigen::Vector3d vright(0.0, 1.0, 0.0);
+  // Check that the direction of motion is not along the Z axis. In this
+  // case the approach of taking the cross product with the world Z will
+  // fail and we need to choose a different axis
+  if (fabs(vdown.dot(vfwd)) < 1.0 - l.epsilon) {
+    vright = vdown.cross(vfwd);
+    vdown = vfwd.cross(vright);
+    if (vdown.z() < 0) {
+      vright = -vright;
+      vdown = vfwd.cross(vright);
+    }
+  } else {
+    vdown = vfwd.cross(vright);
+    vright = vdown.cross(vfwd);
+    if (vright.y() < 0) {
+      vdown = -vdown;
+      vright = vdown.cross(vfwd);
+    }
+  }
+  // Make sure all vectors are nomalized
+  vfwd = vfwd.normalized();
+  vright = vright.normalized();
+  vdown = vdown.normalized();
+  // Construct a rotation matrix
+  Eigen::Matrix3d dcm;
+  dcm << vfwd.x(), vright.x(), vdown.x(),
+         vfwd.y(), vright.y(), vdown.y(),
+         vfwd.z(), vright.z(), vdown.z();
+  Eigen::Quaterniond q(dcm);
+  // Intermediary transforms
+  Eigen::Affine3d tf_2;
+  tf_2.translation() = tf_1.translation();
+  tf_2.linear() = q.toRotationMatrix();
+  Eigen::Affine3d tf_3;
+  tf_3.translation() = tf_4.translation();
+  tf_3.linear() = q.toRotationMatrix();
+  // Initial rotation into direction orientation
+  InsertTrapezoid(moves, dt, tf_1, tf_2, l);
+  InsertTrapezoid(moves, dt, tf_2, tf_3, l);
+  InsertTrapezoid(moves, dt, tf_3, tf_4, l);
+}
+
+}  // namespace planner_trapezoidal
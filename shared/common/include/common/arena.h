@@ -0,0 +1,138 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef COMMON_ARENA_H_
+#define COMMON_ARENA_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace common {
+
+  // Memory for the temporaries of one frame, handed out by bumping an
+  // offset into blocks kept from frame to frame. Nothing is freed on
+  // its own, all of it is given back at once by Rewind(), so after the
+  // first few frames no frame calls malloc. Not thread safe, each
+  // thread has its own, FrameArena().
+  class Arena {
+   public:
+    // The position of the next allocation, to rewind to
+    struct Mark {
+      size_t block;
+      size_t offset;
+    };
+
+    explicit Arena(size_t block_size = 1024 * 1024);
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Never returns NULL. Requests larger than the block size get a
+    // block of their own, which is also kept.
+    void* Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    template <typename T>
+    T* Allocate(size_t count) {
+      return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    Mark GetMark() const { return Mark{block_, offset_}; }
+
+    // Gives back everything allocated since the mark. Objects in that
+    // memory must have been destroyed.
+    void Rewind(Mark const& mark);
+    void Reset() { Rewind(Mark{0, 0}); }
+
+    // Bytes in use, and held in blocks
+    size_t Used() const;
+    size_t Capacity() const;
+
+   private:
+    struct Block {
+      char* data;
+      size_t size;
+    };
+
+    size_t block_size_;
+    std::vector<Block> blocks_;
+    size_t block_;
+    size_t offset_;
+  };
+
+  // Rewinds the arena when leaving the scope, so that nested scopes,
+  // in functions calling each other, each give back only their own
+  class ArenaScope {
+   public:
+    explicit ArenaScope(Arena* arena) : arena_(arena), mark_(arena->GetMark()) {}
+    ~ArenaScope() { arena_->Rewind(mark_); }
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+   private:
+    Arena* arena_;
+    Arena::Mark mark_;
+  };
+
+  // The arena of the calling thread, for temporaries that do not
+  // outlive the frame being processed
+  Arena& FrameArena();
+
+  // An allocator drawing from an arena, whose deallocate does nothing,
+  // so that standard containers may be used for frame temporaries
+  template <typename T>
+  class ArenaAllocator {
+   public:
+    typedef T value_type;
+
+    ArenaAllocator() : arena_(&FrameArena()) {}
+    explicit ArenaAllocator(Arena* arena) : arena_(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}  // NOLINT
+
+    T* allocate(size_t n) { return arena_->Allocate<T>(n); }
+    void deallocate(T*, size_t) {}
+
+    Arena* arena() const { return arena_; }
+
+    template <typename U>
+    struct rebind {
+      typedef ArenaAllocator<U> other;
+    };
+
+   private:
+    Arena* arena_;
+  };
+
+  template <typename T, typename U>
+  bool operator==(ArenaAllocator<T> const& a, ArenaAllocator<U> const& b) {
+    return a.arena() == b.arena();
+  }
+
+  template <typename T, typename U>
+  bool operator!=(ArenaAllocator<T> const& a, ArenaAllocator<U> const& b) {
+    return a.arena() != b.arena();
+  }
+
+  // A vector of frame temporaries
+  template <typename T>
+  using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+}  // namespace common
+
+#endif  // COMMON_ARENA_H_
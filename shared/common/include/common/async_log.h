@@ -0,0 +1,163 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef COMMON_ASYNC_LOG_H_
+#define COMMON_ASYNC_LOG_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>  // NOLINT
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace common {
+
+  // Severities, in the same order as those of rosconsole and glog
+  enum LogLevel {
+    LOG_DEBUG = 0,
+    LOG_INFO  = 1,
+    LOG_WARN  = 2,
+    LOG_ERROR = 3,
+    LOG_FATAL = 4
+  };
+
+  // One message waiting to be written. The file and function are those of
+  // the call site, and are kept as pointers to the literals. The context is
+  // for the sink, for example the rosconsole logger of the call site.
+  struct LogRecord {
+    static constexpr size_t kMaxMessage = 480;
+
+    int level;
+    char const* file;
+    int line;
+    char const* function;
+    void* context;
+    uint32_t suppressed;      // Messages from the same site dropped before
+    std::chrono::system_clock::time_point time;
+    char message[kMaxMessage];
+  };
+
+  // Writes log messages from a background thread. Log copies the message
+  // into a fixed ring without taking a lock or allocating, and returns, so
+  // the caller never waits on formatting, the console or rosout. When the
+  // ring is full the message is dropped and counted rather than blocking.
+  // There is one per process, made with the first message.
+  class AsyncLog {
+   public:
+    typedef std::function<void(LogRecord const&)> Sink;
+
+    static AsyncLog & Instance();
+
+    // The ring holds num_records messages, rounded up to a power of two.
+    // Without a sink the messages are written with glog.
+    explicit AsyncLog(size_t num_records = 1024);
+    ~AsyncLog();
+    AsyncLog(const AsyncLog&) = delete;
+    AsyncLog& operator=(const AsyncLog&) = delete;
+
+    // Sets where the messages are written, from the background thread
+    void SetSink(Sink sink);
+
+    // Queues a message, cut to LogRecord::kMaxMessage, and returns false if
+    // it was dropped because the ring is full
+    bool Log(int level, char const* file, int line, char const* function,
+             void* context, uint32_t suppressed, std::string const& message);
+    bool Logf(int level, char const* file, int line, char const* function,
+              void* context, uint32_t suppressed, char const* format, ...)
+      __attribute__((format(printf, 8, 9)));
+
+    // Blocks until every message queued so far has been written
+    void Flush();
+
+    // How many messages were dropped because the ring was full
+    uint64_t Dropped() const { return dropped_; }
+
+    // The message of a record, with the count of those suppressed before it
+    static std::string Message(LogRecord const& record);
+
+   private:
+    struct Slot {
+      std::atomic<size_t> sequence;
+      LogRecord record;
+    };
+
+    LogRecord* Acquire(size_t* pos);
+    void Release(size_t pos);
+    void Write(LogRecord const& record);
+    void WriterLoop();
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    std::atomic<size_t> enqueue_pos_;
+    std::atomic<size_t> dequeue_pos_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<bool> shutdown_;
+    std::mutex sink_mutex_;
+    Sink sink_;
+    std::mutex flush_mutex_;
+    std::condition_variable flushed_;
+    std::thread writer_;
+  };
+
+  // Limits the messages from one call site to one per period. The messages
+  // in between are counted, and the count is passed with the next message.
+  class LogSite {
+   public:
+    LogSite() : next_(0), suppressed_(0) {}
+
+    // Returns whether a message can be written now, and if so how many were
+    // suppressed since the last one
+    bool Allow(double period, uint32_t* suppressed);
+
+   private:
+    std::atomic<int64_t> next_;
+    std::atomic<uint32_t> suppressed_;
+  };
+
+}  // namespace common
+
+// Logs through glog from the background thread, for code without ROS. See
+// common/async_log_ros.h for the rosconsole versions.
+#define ASYNC_LOG_STREAM(level, args)                                        \
+  do {                                                                       \
+    std::ostringstream __async_log_oss;                                      \
+    __async_log_oss << args;                                                 \
+    common::AsyncLog::Instance().Log(level, __FILE__, __LINE__,              \
+      __func__, nullptr, 0, __async_log_oss.str());                          \
+  } while (0)
+
+#define ASYNC_LOG_STREAM_THROTTLE(period, level, args)                        \
+  do {                                                                       \
+    static common::LogSite __async_log_site;                                 \
+    uint32_t __async_log_suppressed = 0;                                     \
+    if (__async_log_site.Allow(period, &__async_log_suppressed)) {           \
+      std::ostringstream __async_log_oss;                                    \
+      __async_log_oss << args;                                               \
+      common::AsyncLog::Instance().Log(level, __FILE__, __LINE__,            \
+        __func__, nullptr, __async_log_suppressed, __async_log_oss.str());   \
+    }                                                                        \
+  } while (0)
+
+#endif  // COMMON_ASYNC_LOG_H_
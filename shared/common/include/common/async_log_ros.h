@@ -0,0 +1,151 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef COMMON_ASYNC_LOG_ROS_H_
+#define COMMON_ASYNC_LOG_ROS_H_
+
+// Versions of the ROS_* logging macros that queue the message on the
+// AsyncLog ring instead of writing it from the calling thread. The level
+// check is the same as rosconsole's, so disabled messages are not even
+// formatted. Only the writing to the console, the log file and rosout is
+// moved to the background thread, and it keeps the logger, file and line of
+// the call site. FATAL is left synchronous on purpose.
+
+#include <common/async_log.h>
+
+#include <ros/console.h>
+
+#include <sstream>
+#include <string>
+
+namespace common {
+
+  // Writes a record through rosconsole, from the background thread
+  inline void WriteRosLog(LogRecord const& record) {
+    ::ros::console::print(nullptr, record.context, static_cast< ::ros::console::Level>(record.level),
+                          record.file, record.line, record.function, "%s", AsyncLog::Message(record).c_str());
+  }
+
+  // The process log, once rosconsole has been made its sink
+  inline AsyncLog & AsyncRosLog() {
+    static bool installed = (AsyncLog::Instance().SetSink(&WriteRosLog), true);
+    (void)installed;
+    return AsyncLog::Instance();
+  }
+
+}  // namespace common
+
+#define ASYNC_ROS_LOG(level, name, ...)                                       \
+  do {                                                                       \
+    ROSCONSOLE_DEFINE_LOCATION(true, level, name);                           \
+    if (ROS_UNLIKELY(__rosconsole_define_location__enabled))                 \
+      common::AsyncRosLog().Logf(level, __FILE__, __LINE__,                  \
+        __ROSCONSOLE_FUNCTION__, __rosconsole_define_location__loc.logger_,  \
+        0, __VA_ARGS__);                                                     \
+  } while (0)
+
+#define ASYNC_ROS_LOG_STREAM(level, name, args)                               \
+  do {                                                                       \
+    ROSCONSOLE_DEFINE_LOCATION(true, level, name);                           \
+    if (ROS_UNLIKELY(__rosconsole_define_location__enabled)) {               \
+      std::ostringstream __async_log_oss;                                    \
+      __async_log_oss << args;                                               \
+      common::AsyncRosLog().Log(level, __FILE__, __LINE__,                   \
+        __ROSCONSOLE_FUNCTION__, __rosconsole_define_location__loc.logger_,  \
+        0, __async_log_oss.str());                                           \
+    }                                                                        \
+  } while (0)
+
+#define ASYNC_ROS_LOG_THROTTLE(period, level, name, ...)                      \
+  do {                                                                       \
+    ROSCONSOLE_DEFINE_LOCATION(true, level, name);                           \
+    static common::LogSite __async_log_site;                                 \
+    uint32_t __async_log_suppressed = 0;                                     \
+    if (ROS_UNLIKELY(__rosconsole_define_location__enabled) &&               \
+        __async_log_site.Allow(period, &__async_log_suppressed))             \
+      common::AsyncRosLog().Logf(level, __FILE__, __LINE__,                  \
+        __ROSCONSOLE_FUNCTION__, __rosconsole_define_location__loc.logger_,  \
+        __async_log_suppressed, __VA_ARGS__);                                \
+  } while (0)
+
+#define ASYNC_ROS_LOG_STREAM_THROTTLE(period, level, name, args)              \
+  do {                                                                       \
+    ROSCONSOLE_DEFINE_LOCATION(true, level, name);                           \
+    static common::LogSite __async_log_site;                                 \
+    uint32_t __async_log_suppressed = 0;                                     \
+    if (ROS_UNLIKELY(__rosconsole_define_location__enabled) &&               \
+        __async_log_site.Allow(period, &__async_log_suppressed)) {           \
+      std::ostringstream __async_log_oss;                                    \
+      __async_log_oss << args;                                               \
+      common::AsyncRosLog().Log(level, __FILE__, __LINE__,                   \
+        __ROSCONSOLE_FUNCTION__, __rosconsole_define_location__loc.logger_,  \
+        __async_log_suppressed, __async_log_oss.str());                      \
+    }                                                                        \
+  } while (0)
+
+#define ASYNC_ROS_NAME(name) (std::string(ROSCONSOLE_NAME_PREFIX) + "." + (name))
+
+#define ASYNC_ROS_DEBUG(...) ASYNC_ROS_LOG(::ros::console::levels::Debug, ROSCONSOLE_DEFAULT_NAME, __VA_ARGS__)
+#define ASYNC_ROS_DEBUG_STREAM(args) \
+  ASYNC_ROS_LOG_STREAM(::ros::console::levels::Debug, ROSCONSOLE_DEFAULT_NAME, args)
+#define ASYNC_ROS_DEBUG_NAMED(name, ...) \
+  ASYNC_ROS_LOG(::ros::console::levels::Debug, ASYNC_ROS_NAME(name), __VA_ARGS__)
+#define ASYNC_ROS_DEBUG_STREAM_NAMED(name, args) \
+  ASYNC_ROS_LOG_STREAM(::ros::console::levels::Debug, ASYNC_ROS_NAME(name), args)
+#define ASYNC_ROS_DEBUG_THROTTLE(period, ...) \
+  ASYNC_ROS_LOG_THROTTLE(period, ::ros::console::levels::Debug, ROSCONSOLE_DEFAULT_NAME, __VA_ARGS__)
+#define ASYNC_ROS_DEBUG_STREAM_THROTTLE(period, args) \
+  ASYNC_ROS_LOG_STREAM_THROTTLE(period, ::ros::console::levels::Debug, ROSCONSOLE_DEFAULT_NAME, args)
+
+#define ASYNC_ROS_INFO(...) ASYNC_ROS_LOG(::ros::console::levels::Info, ROSCONSOLE_DEFAULT_NAME, __VA_ARGS__)
+#define ASYNC_ROS_INFO_STREAM(args) \
+  ASYNC_ROS_LOG_STREAM(::ros::console::levels::Info, ROSCONSOLE_DEFAULT_NAME, args)
+#define ASYNC_ROS_INFO_NAMED(name, ...) \
+  ASYNC_ROS_LOG(::ros::console::levels::Info, ASYNC_ROS_NAME(name), __VA_ARGS__)
+#define ASYNC_ROS_INFO_STREAM_NAMED(name, args) \
+  ASYNC_ROS_LOG_STREAM(::ros::console::levels::Info, ASYNC_ROS_NAME(name), args)
+#define ASYNC_ROS_INFO_THROTTLE(period, ...) \
+  ASYNC_ROS_LOG_THROTTLE(period, ::ros::console::levels::Info, ROSCONSOLE_DEFAULT_NAME, __VA_ARGS__)
+#define ASYNC_ROS_INFO_STREAM_THROTTLE(period, args) \
+  ASYNC_ROS_LOG_STREAM_THROTTLE(period, ::ros::console::levels::Info, ROSCONSOLE_DEFAULT_NAME, args)
+
+#define ASYNC_ROS_WARN(...) ASYNC_ROS_LOG(::ros::console::levels::Warn, ROSCONSOLE_DEFAULT_NAME, __VA_ARGS__)
+#define ASYNC_ROS_WARN_STREAM(args) \
+  ASYNC_ROS_LOG_STREAM(::ros::console::levels::Warn, ROSCONSOLE_DEFAULT_NAME, args)
+#define ASYNC_ROS_WARN_NAMED(name, ...) \
+  ASYNC_ROS_LOG(::ros::console::levels::Warn, ASYNC_ROS_NAME(name), __VA_ARGS__)
+#define ASYNC_ROS_WARN_STREAM_NAMED(name, args) \
+  ASYNC_ROS_LOG_STREAM(::ros::console::levels::Warn, ASYNC_ROS_NAME(name), args)
+#define ASYNC_ROS_WARN_THROTTLE(period, ...) \
+  ASYNC_ROS_LOG_THROTTLE(period, ::ros::console::levels::Warn, ROSCONSOLE_DEFAULT_NAME, __VA_ARGS__)
+#define ASYNC_ROS_WARN_STREAM_THROTTLE(period, args) \
+  ASYNC_ROS_LOG_STREAM_THROTTLE(period, ::ros::console::levels::Warn, ROSCONSOLE_DEFAULT_NAME, args)
+
+#define ASYNC_ROS_ERROR(...) ASYNC_ROS_LOG(::ros::console::levels::Error, ROSCONSOLE_DEFAULT_NAME, __VA_ARGS__)
+#define ASYNC_ROS_ERROR_STREAM(args) \
+  ASYNC_ROS_LOG_STREAM(::ros::console::levels::Error, ROSCONSOLE_DEFAULT_NAME, args)
+#define ASYNC_ROS_ERROR_NAMED(name, ...) \
+  ASYNC_ROS_LOG(::ros::console::levels::Error, ASYNC_ROS_NAME(name), __VA_ARGS__)
+#define ASYNC_ROS_ERROR_STREAM_NAMED(name, args) \
+  ASYNC_ROS_LOG_STREAM(::ros::console::levels::Error, ASYNC_ROS_NAME(name), args)
+#define ASYNC_ROS_ERROR_THROTTLE(period, ...) \
+  ASYNC_ROS_LOG_THROTTLE(period, ::ros::console::levels::Error, ROSCONSOLE_DEFAULT_NAME, __VA_ARGS__)
+#define ASYNC_ROS_ERROR_STREAM_THROTTLE(period, args) \
+  ASYNC_ROS_LOG_STREAM_THROTTLE(period, ::ros::console::levels::Error, ROSCONSOLE_DEFAULT_NAME, args)
+
+#endif  // COMMON_ASYNC_LOG_ROS_H_
@@ -20,10 +20,13 @@
 #define COMMON_THREAD_H_
 
 #include <gflags/gflags.h>
-#include <pthread.h>
 
-#include <list>
+#include <condition_variable>  // NOLINT
+#include <deque>
 #include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 DECLARE_int32(num_threads);
 
@@ -34,13 +37,19 @@ GOOGLE_ALLOW_RVALUE_REFERENCES_PUSH
 
 namespace common {
 
-  void* HolderFunction(void* ptr);
-
+  // A pool of long-lived worker threads fed from a bounded task
+  // queue. Workers are created once in the constructor and live until
+  // the pool is destroyed, so adding a task costs a lock and a
+  // condition notify instead of a thread creation.
   class ThreadPool {
    public:
-    typedef std::tuple<std::function<void(void)>, pthread_mutex_t*, pthread_cond_t*, bool> VarsTuple;
+    typedef std::function<void(void)> Task;
 
+    // Creates FLAGS_num_threads workers. The queue holds up to
+    // queue_size pending tasks, if zero it defaults to four tasks per
+    // worker.
     ThreadPool();
+    explicit ThreadPool(size_t num_threads, size_t queue_size = 0);
     ~ThreadPool();
     // The following identifies this thread as non copyable and non
     // moveable. Our threads are holding pointers to this exact
@@ -49,8 +58,8 @@ namespace common {
     ThreadPool& operator=(const ThreadPool&) = delete;
 
     // This pushes back a function and it's arguments to be
-    // executed. This method will block if the number of threads is
-    // already maxed. You can also push back mixed types of functions.
+    // executed. This method will block if the task queue is already
+    // full. You can also push back mixed types of functions.
     //
     // Example:
     // void Monkey(std::vector const& input, int val, std::vector * output);
@@ -61,30 +70,41 @@ namespace common {
     // will be copied. Other alternatives are to use a pointer.
     template <typename Function, typename... Args>
     void AddTask(Function&& f, Args&&... args) {
-      WaitTillJobOpening();
-
-      // Bind up the function the user has given us
-      var_bindings_.emplace_back(std::bind(f, args...),
-                                 &cond_mutex_,
-                                 &cond_, false);
-
-      // Create the thread and start doing work
-      threads_.push_back(pthread_t());
-      pthread_create(&threads_.back(), NULL, HolderFunction, &var_bindings_.back());
+      Enqueue(Task(std::bind(f, args...)));
     }
 
+    // Blocks until every task added so far has finished. The workers
+    // stay alive, so the pool can be reused afterwards.
     void Join();
 
-   private:
-    void WaitTillJobOpening();
+    size_t NumThreads() const { return workers_.size(); }
 
-    size_t max_concurrent_jobs_;
-    std::list<pthread_t> threads_;
-    std::list<VarsTuple> var_bindings_;
-    pthread_mutex_t cond_mutex_;
-    pthread_cond_t cond_;
+   private:
+    void Enqueue(Task && task);
+    void WorkerLoop();
+
+    size_t max_queued_tasks_;
+    size_t active_tasks_;
+    bool shutdown_;
+    std::vector<std::thread> workers_;
+    std::deque<Task> tasks_;
+    std::mutex mutex_;
+    std::condition_variable task_available_;   // signaled to workers
+    std::condition_variable queue_not_full_;   // signaled to producers
+    std::condition_variable all_done_;         // signaled to Join
   };
 
+  // Runs task(index, thread_index) for every index in [0, num_tasks)
+  // on num_threads threads (FLAGS_num_threads if zero). Each thread
+  // starts with a contiguous slice of the indices and, once its own
+  // slice is exhausted, steals the back half of the next non-empty
+  // slice. This keeps all threads busy when task costs
+  // are very uneven. thread_index is in [0, num_threads) and is
+  // stable for the duration of one call, so it can be used to pick a
+  // per-thread output buffer that needs no locking.
+  void WorkStealingFor(size_t num_tasks, size_t num_threads,
+                       std::function<void(size_t, size_t)> const& task);
+
 }  // namespace common
 
 GOOGLE_ALLOW_RVALUE_REFERENCES_POP
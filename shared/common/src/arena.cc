@@ -0,0 +1,82 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <common/arena.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+namespace common {
+
+  Arena::Arena(size_t block_size) : block_size_(block_size), block_(0), offset_(0) {}
+
+  Arena::~Arena() {
+    for (Block& block : blocks_)
+      free(block.data);
+  }
+
+  void* Arena::Allocate(size_t bytes, size_t alignment) {
+    // Continue in the current block, then in the later ones kept from
+    // earlier frames, then in a new one
+    for (; block_ < blocks_.size(); block_++, offset_ = 0) {
+      Block const& block = blocks_[block_];
+      uintptr_t start = reinterpret_cast<uintptr_t>(block.data) + offset_;
+      size_t padding = (alignment - start % alignment) % alignment;
+      if (offset_ + padding + bytes <= block.size) {
+        offset_ += padding + bytes;
+        return block.data + offset_ - bytes;
+      }
+    }
+    Block block;
+    block.size = std::max(block_size_, bytes + alignment);
+    block.data = static_cast<char*>(malloc(block.size));
+    CHECK(block.data) << "Out of memory for a block of " << block.size << " bytes.";
+    blocks_.push_back(block);
+    uintptr_t start = reinterpret_cast<uintptr_t>(block.data);
+    offset_ = (alignment - start % alignment) % alignment + bytes;
+    return block.data + offset_ - bytes;
+  }
+
+  void Arena::Rewind(Mark const& mark) {
+    block_ = mark.block;
+    offset_ = mark.offset;
+  }
+
+  size_t Arena::Used() const {
+    size_t used = offset_;
+    for (size_t i = 0; i < block_ && i < blocks_.size(); i++)
+      used += blocks_[i].size;
+    return used;
+  }
+
+  size_t Arena::Capacity() const {
+    size_t capacity = 0;
+    for (Block const& block : blocks_)
+      capacity += block.size;
+    return capacity;
+  }
+
+  Arena& FrameArena() {
+    static thread_local Arena arena;
+    return arena;
+  }
+
+}  // namespace common
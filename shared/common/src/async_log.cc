@@ -0,0 +1,193 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <common/async_log.h>
+
+#include <glog/logging.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+common::AsyncLog & common::AsyncLog::Instance() {
+  static AsyncLog log;
+  return log;
+}
+
+common::AsyncLog::AsyncLog(size_t num_records)
+  : enqueue_pos_(0), dequeue_pos_(0), dropped_(0), shutdown_(false) {
+  size_t size = 2;
+  while (size < num_records)
+    size <<= 1;
+  slots_.reset(new Slot[size]);
+  mask_ = size - 1;
+  for (size_t i = 0; i < size; i++)
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  writer_ = std::thread(&AsyncLog::WriterLoop, this);
+}
+
+common::AsyncLog::~AsyncLog() {
+  shutdown_ = true;
+  writer_.join();
+}
+
+void common::AsyncLog::SetSink(Sink sink) {
+  std::lock_guard<std::mutex> lock(sink_mutex_);
+  sink_ = sink;
+}
+
+bool common::AsyncLog::Log(int level, char const* file, int line, char const* function,
+                           void* context, uint32_t suppressed, std::string const& message) {
+  size_t pos;
+  LogRecord* record = Acquire(&pos);
+  if (record == nullptr)
+    return false;
+  record->level = level;
+  record->file = file;
+  record->line = line;
+  record->function = function;
+  record->context = context;
+  record->suppressed = suppressed;
+  record->time = std::chrono::system_clock::now();
+  size_t length = std::min(message.size(), LogRecord::kMaxMessage - 1);
+  memcpy(record->message, message.data(), length);
+  record->message[length] = '\0';
+  Release(pos);
+  return true;
+}
+
+bool common::AsyncLog::Logf(int level, char const* file, int line, char const* function,
+                            void* context, uint32_t suppressed, char const* format, ...) {
+  size_t pos;
+  LogRecord* record = Acquire(&pos);
+  if (record == nullptr)
+    return false;
+  record->level = level;
+  record->file = file;
+  record->line = line;
+  record->function = function;
+  record->context = context;
+  record->suppressed = suppressed;
+  record->time = std::chrono::system_clock::now();
+  va_list args;
+  va_start(args, format);
+  vsnprintf(record->message, LogRecord::kMaxMessage, format, args);
+  va_end(args);
+  Release(pos);
+  return true;
+}
+
+void common::AsyncLog::Flush() {
+  size_t target = enqueue_pos_.load();
+  std::unique_lock<std::mutex> lock(flush_mutex_);
+  while (dequeue_pos_.load() < target)
+    flushed_.wait_for(lock, std::chrono::milliseconds(10));
+}
+
+std::string common::AsyncLog::Message(LogRecord const& record) {
+  std::string message(record.message);
+  if (record.suppressed > 0)
+    message += " (" + std::to_string(record.suppressed) + " similar messages suppressed)";
+  return message;
+}
+
+// A bounded queue for many producers and one consumer. Each slot has a
+// sequence number, which is its position when it is free to be written, and
+// one more than that once it holds a record. A producer claims a position by
+// moving enqueue_pos_ on, fills the slot and then publishes it, so producers
+// never wait for each other and a full ring is noticed without waiting.
+common::LogRecord* common::AsyncLog::Acquire(size_t* pos) {
+  size_t p = enqueue_pos_.load(std::memory_order_relaxed);
+  while (true) {
+    Slot & slot = slots_[p & mask_];
+    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(p);
+    if (diff == 0) {
+      if (enqueue_pos_.compare_exchange_weak(p, p + 1, std::memory_order_relaxed)) {
+        *pos = p;
+        return &slot.record;
+      }
+    } else if (diff < 0) {
+      dropped_++;
+      return nullptr;
+    } else {
+      p = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void common::AsyncLog::Release(size_t pos) {
+  slots_[pos & mask_].sequence.store(pos + 1, std::memory_order_release);
+}
+
+void common::AsyncLog::Write(LogRecord const& record) {
+  std::lock_guard<std::mutex> lock(sink_mutex_);
+  if (sink_) {
+    sink_(record);
+    return;
+  }
+  if (record.level == LOG_DEBUG && !VLOG_IS_ON(1))
+    return;
+  // Fatal messages are not fatal from here, the caller has long moved on
+  google::LogSeverity severity = google::GLOG_ERROR;
+  switch (record.level) {
+  case LOG_DEBUG:
+  case LOG_INFO:
+    severity = google::GLOG_INFO;
+    break;
+  case LOG_WARN:
+    severity = google::GLOG_WARNING;
+    break;
+  default:
+    break;
+  }
+  google::LogMessage(record.file, record.line, severity).stream() << Message(record);
+}
+
+void common::AsyncLog::WriterLoop() {
+  size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+  while (true) {
+    Slot & slot = slots_[pos & mask_];
+    if (slot.sequence.load(std::memory_order_acquire) == pos + 1) {
+      Write(slot.record);
+      slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+      dequeue_pos_.store(++pos);
+      continue;
+    }
+    // Nothing ready to be written
+    flushed_.notify_all();
+    if (shutdown_ && enqueue_pos_.load() == pos)
+      return;
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+}
+
+bool common::LogSite::Allow(double period, uint32_t* suppressed) {
+  int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+  int64_t next = next_.load(std::memory_order_relaxed);
+  if (now < next ||
+      !next_.compare_exchange_strong(next, now + static_cast<int64_t>(period * 1e9), std::memory_order_relaxed)) {
+    suppressed_++;
+    return false;
+  }
+  *suppressed = suppressed_.exchange(0);
+  return true;
+}
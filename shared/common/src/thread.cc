@@ -21,80 +21,154 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
-#include <sys/time.h>
-#include <thread>
+#include <algorithm>
+#include <utility>
 
 DEFINE_int32(num_threads, (std::thread::hardware_concurrency() == 0 ? 2 : std::thread::hardware_concurrency()),
              "Number of threads to use for processing.");
 
-void* common::HolderFunction(void* ptr) {
-  common::ThreadPool::VarsTuple* vars = reinterpret_cast<common::ThreadPool::VarsTuple*>(ptr);
-
-  // Run the function
-  std::get<0>(*vars)();
-
-  // Set out boolean so someone can know they can delete this
-  std::get<3>(*vars) = true;
-
-  // Signal that we are finished
-  pthread_mutex_lock(std::get<1>(*vars));
-  pthread_cond_signal(std::get<2>(*vars));
-  pthread_mutex_unlock(std::get<1>(*vars));
-
-  return NULL;
-}
-
 common::ThreadPool::ThreadPool()
-  : max_concurrent_jobs_(FLAGS_num_threads) {
-  pthread_mutex_init(&cond_mutex_, NULL);
-  pthread_cond_init(&cond_, NULL);
-  if (max_concurrent_jobs_ <= 0) {
+  : ThreadPool(FLAGS_num_threads > 0 ? FLAGS_num_threads : 0) {}
+
+common::ThreadPool::ThreadPool(size_t num_threads, size_t queue_size)
+  : max_queued_tasks_(queue_size > 0 ? queue_size : 4 * num_threads),
+    active_tasks_(0), shutdown_(false) {
+  if (num_threads == 0) {
     LOG(ERROR) << "Thread pool without threads created...";
+    // Keep a single worker so that AddTask can never deadlock
+    num_threads = 1;
+    max_queued_tasks_ = 4;
   }
+  workers_.reserve(num_threads);
+  for (size_t i = 0; i < num_threads; i++)
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this);
 }
 
 common::ThreadPool::~ThreadPool() {
   Join();
-  pthread_cond_destroy(&cond_);
-  pthread_mutex_destroy(&cond_mutex_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  task_available_.notify_all();
+  for (std::thread & worker : workers_)
+    worker.join();
 }
 
 void common::ThreadPool::Join() {
-  while (threads_.size()) {
-    pthread_join(threads_.front(), NULL);
-    threads_.pop_front();
-    var_bindings_.pop_front();
+  std::unique_lock<std::mutex> lock(mutex_);
+  all_done_.wait(lock, [this] { return tasks_.empty() && active_tasks_ == 0; });
+}
+
+void common::ThreadPool::Enqueue(Task && task) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    queue_not_full_.wait(lock, [this] { return tasks_.size() < max_queued_tasks_; });
+    tasks_.push_back(std::move(task));
   }
+  task_available_.notify_one();
 }
 
-void common::ThreadPool::WaitTillJobOpening() {
-  while (threads_.size() >= max_concurrent_jobs_) {
-    // Wait for a condition event to signal a free job or time out
-    // after one second. I do a time out because somehow I still have
-    // a deadlock. I think it occurs if a task just finishes faster
-    // than we can get back into a state to wait for condition.
-    pthread_mutex_lock(&cond_mutex_);
-    struct timeval tv;
-    struct timespec ts;
-    gettimeofday(&tv, NULL);
-    ts.tv_sec = tv.tv_sec + 1;
-    ts.tv_nsec = 0;
-    pthread_cond_timedwait(&cond_, &cond_mutex_, &ts);
-    pthread_mutex_unlock(&cond_mutex_);
-
-    // Iterate through and clean out all the finished jobs
-    std::list<pthread_t>::iterator thread_it = threads_.begin();
-    std::list<VarsTuple>::iterator vars_it = var_bindings_.begin();
-    while (thread_it != threads_.end()) {
-      if (std::get<3>(*vars_it)) {
-        // Thread says it has finished. Join.
-        pthread_join(*thread_it, NULL);
-        thread_it = threads_.erase(thread_it);
-        vars_it = var_bindings_.erase(vars_it);
+void common::ThreadPool::WorkerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    task_available_.wait(lock, [this] { return shutdown_ || !tasks_.empty(); });
+    if (tasks_.empty())
+      return;  // shutdown_ was set and there is nothing left to do
+
+    Task task = std::move(tasks_.front());
+    tasks_.pop_front();
+    active_tasks_++;
+    lock.unlock();
+    queue_not_full_.notify_one();
+
+    // Run the function
+    task();
+
+    // Destroy the bound arguments before reporting completion, so
+    // that anything they reference can be released after Join()
+    task = Task();
+
+    lock.lock();
+    active_tasks_--;
+    if (tasks_.empty() && active_tasks_ == 0)
+      all_done_.notify_all();
+  }
+}
+
+namespace {
+  // The range of indices still owned by one worker. The owner takes
+  // from the front, thieves take from the back.
+  struct WorkRange {
+    std::mutex mutex;
+    size_t begin;
+    size_t end;
+  };
+}  // namespace
+
+void common::WorkStealingFor(size_t num_tasks, size_t num_threads,
+                             std::function<void(size_t, size_t)> const& task) {
+  if (num_tasks == 0)
+    return;
+  if (num_threads == 0)
+    num_threads = (FLAGS_num_threads > 0 ? FLAGS_num_threads : 1);
+  num_threads = std::min(num_threads, num_tasks);
+
+  // Split the work evenly to begin with
+  std::vector<WorkRange> ranges(num_threads);
+  for (size_t t = 0; t < num_threads; t++) {
+    ranges[t].begin = (num_tasks * t) / num_threads;
+    ranges[t].end   = (num_tasks * (t + 1)) / num_threads;
+  }
+
+  auto worker = [&ranges, &task, num_threads](size_t tid) {
+    WorkRange & own = ranges[tid];
+    while (true) {
+      // Take the next index from our own range
+      size_t index = 0;
+      bool found = false;
+      {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.begin < own.end) {
+          index = own.begin++;
+          found = true;
+        }
+      }
+      if (found) {
+        task(index, tid);
+        continue;
+      }
+
+      // Our range is empty. Steal the back half of another range,
+      // visiting the neighbours in order so that thieves spread out.
+      size_t stolen_begin = 0, stolen_end = 0;
+      for (size_t k = 1; k < num_threads && !found; k++) {
+        WorkRange & victim = ranges[(tid + k) % num_threads];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        size_t remaining = victim.end - victim.begin;
+        if (remaining == 0)
+          continue;
+        stolen_end = victim.end;
+        stolen_begin = victim.end - (remaining + 1) / 2;
+        victim.end = stolen_begin;
+        found = true;
+      }
+      if (found) {
+        // Only one lock is held at a time, so thieves can't deadlock
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.begin = stolen_begin;
+        own.end = stolen_end;
       } else {
-        thread_it++;
-        vars_it++;
+        return;  // nothing left anywhere
       }
     }
-  }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  for (size_t t = 1; t < num_threads; t++)
+    threads.emplace_back(worker, t);
+  worker(0);
+  for (std::thread & thread : threads)
+    thread.join();
 }
@@ -0,0 +1,86 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <common/arena.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+TEST(arena, allocate) {
+  common::Arena arena(1024);
+  double* a = arena.Allocate<double>(10);
+  char* b = arena.Allocate<char>(3);
+  double* c = arena.Allocate<double>(10);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(a) % alignof(double));
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(c) % alignof(double));
+  EXPECT_LE(reinterpret_cast<char*>(a + 10), b);
+  EXPECT_LE(b + 3, reinterpret_cast<char*>(c));
+  EXPECT_EQ(1024u, arena.Capacity());
+
+  // Larger than a block, and another block after it
+  char* big = arena.Allocate<char>(4000);
+  EXPECT_NE(nullptr, big);
+  arena.Allocate<char>(1000);
+  EXPECT_GE(arena.Capacity(), 1024u + 4000u + 1000u);
+
+  // The blocks are kept, and handed out again in the same order
+  size_t capacity = arena.Capacity();
+  arena.Reset();
+  EXPECT_EQ(0u, arena.Used());
+  EXPECT_EQ(a, arena.Allocate<double>(10));
+  arena.Allocate<char>(3);
+  arena.Allocate<double>(10);
+  EXPECT_EQ(big, arena.Allocate<char>(4000));
+  arena.Allocate<char>(1000);
+  EXPECT_EQ(capacity, arena.Capacity());
+}
+
+TEST(arena, scope) {
+  common::Arena arena(1024);
+  arena.Allocate<int>(4);
+  size_t used = arena.Used();
+  int* inner;
+  {
+    common::ArenaScope scope(&arena);
+    inner = arena.Allocate<int>(100);
+    {
+      common::ArenaScope nested(&arena);
+      arena.Allocate<int>(1000);
+    }
+    EXPECT_LT(reinterpret_cast<char*>(inner + 100), reinterpret_cast<char*>(arena.Allocate<int>(1)) + 1);
+  }
+  EXPECT_EQ(used, arena.Used());
+  EXPECT_EQ(inner, arena.Allocate<int>(100));
+}
+
+TEST(arena, vector) {
+  common::Arena arena(256);
+  common::ArenaVector<int> v{common::ArenaAllocator<int>(&arena)};
+  for (int i = 0; i < 1000; i++)
+    v.push_back(i);
+  for (int i = 0; i < 1000; i++)
+    EXPECT_EQ(i, v[i]);
+  EXPECT_GE(arena.Used(), 1000 * sizeof(int));
+
+  // From the arena of this thread, by default
+  common::ArenaScope scope(&common::FrameArena());
+  common::ArenaVector<double> w(10, 1.0);
+  EXPECT_EQ(&common::FrameArena(), w.get_allocator().arena());
+  EXPECT_EQ(10.0, w[0] * w.size());
+}
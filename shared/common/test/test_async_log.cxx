@@ -0,0 +1,101 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <common/async_log.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(async_log, order_and_flush) {
+  common::AsyncLog log(16);
+  std::vector<std::string> messages;
+  log.SetSink([&messages](common::LogRecord const& record) { messages.push_back(record.message); });
+
+  // Messages from one thread come out in order, and are cut to the record
+  for (int i = 0; i < 10; i++)
+    while (!log.Logf(common::LOG_INFO, __FILE__, __LINE__, __func__, nullptr, 0, "message %d", i))
+      std::this_thread::yield();
+  EXPECT_TRUE(log.Log(common::LOG_INFO, __FILE__, __LINE__, __func__, nullptr, 0,
+                      std::string(2 * common::LogRecord::kMaxMessage, 'x')));
+  log.Flush();
+  ASSERT_EQ(11u, messages.size());
+  for (int i = 0; i < 10; i++)
+    EXPECT_EQ("message " + std::to_string(i), messages[i]);
+  EXPECT_EQ(common::LogRecord::kMaxMessage - 1, messages[10].size());
+}
+
+TEST(async_log, drop_when_full) {
+  common::AsyncLog log(4);
+  std::mutex block;
+  std::atomic<int> written(0);
+  log.SetSink([&block, &written](common::LogRecord const& record) {
+    std::lock_guard<std::mutex> lock(block);
+    written++;
+  });
+
+  // With the sink held up the ring fills, and Log returns without waiting
+  block.lock();
+  int queued = 0;
+  for (int i = 0; i < 20; i++)
+    queued += log.Log(common::LOG_WARN, __FILE__, __LINE__, __func__, nullptr, 0, "full");
+  EXPECT_LE(queued, 5);
+  EXPECT_EQ(20u - queued, log.Dropped());
+  block.unlock();
+  log.Flush();
+  EXPECT_EQ(queued, written);
+}
+
+TEST(async_log, many_threads) {
+  common::AsyncLog log(64);
+  std::atomic<int> written(0);
+  log.SetSink([&written](common::LogRecord const& record) { written++; });
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&log]() {
+      for (int i = 0; i < 1000; i++)
+        log.Logf(common::LOG_DEBUG, __FILE__, __LINE__, __func__, nullptr, 0, "%d", i);
+    });
+  }
+  for (std::thread & thread : threads)
+    thread.join();
+  log.Flush();
+  EXPECT_EQ(4000u, written + log.Dropped());
+}
+
+TEST(async_log, throttle) {
+  common::LogSite site;
+  uint32_t suppressed = 10;
+  EXPECT_TRUE(site.Allow(0.2, &suppressed));
+  EXPECT_EQ(0u, suppressed);
+  for (int i = 0; i < 5; i++)
+    EXPECT_FALSE(site.Allow(0.2, &suppressed));
+  std::this_thread::sleep_for(std::chrono::milliseconds(250));
+  EXPECT_TRUE(site.Allow(0.2, &suppressed));
+  EXPECT_EQ(5u, suppressed);
+
+  common::LogRecord record;
+  snprintf(record.message, sizeof(record.message), "hello");
+  record.suppressed = suppressed;
+  EXPECT_EQ("hello (5 similar messages suppressed)", common::AsyncLog::Message(record));
+}
@@ -20,6 +20,9 @@
 
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <vector>
 
 void Simple(int a, int b) {
@@ -70,3 +73,54 @@ TEST(thread, thread_pool) {
   pool.Join();
   EXPECT_EQ(4u, vec.size());
 }
+
+void Increment(std::atomic<int> * counter) {
+  (*counter)++;
+}
+
+TEST(thread, thread_pool_many_tasks) {
+  FLAGS_num_threads = 4;
+  common::ThreadPool pool;
+  EXPECT_EQ(4u, pool.NumThreads());
+
+  // More tasks than the queue can hold, the producer must block and
+  // resume rather than lose work.
+  std::atomic<int> counter(0);
+  for (int i = 0; i < 10000; i++)
+    pool.AddTask(Increment, &counter);
+  pool.Join();
+  EXPECT_EQ(10000, counter.load());
+
+  // The workers survive a Join, so the pool can be reused
+  for (int i = 0; i < 100; i++)
+    pool.AddTask(Increment, &counter);
+  pool.Join();
+  EXPECT_EQ(10100, counter.load());
+}
+
+TEST(thread, work_stealing_for) {
+  // Very uneven task costs, every index must still run exactly once
+  const size_t num_tasks = 1000;
+  std::vector<std::atomic<int> > visits(num_tasks);
+  for (std::atomic<int> & v : visits) v = 0;
+  std::vector<int> per_thread(4, 0);
+  common::WorkStealingFor(num_tasks, 4, [&visits, &per_thread](size_t index, size_t thread) {
+      if (index < 10)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      visits[index]++;
+      per_thread[thread]++;
+    });
+  for (size_t i = 0; i < num_tasks; i++)
+    EXPECT_EQ(1, visits[i].load());
+  EXPECT_EQ(static_cast<int>(num_tasks),
+            per_thread[0] + per_thread[1] + per_thread[2] + per_thread[3]);
+
+  // Degenerate sizes
+  common::WorkStealingFor(0, 4, [](size_t, size_t) { FAIL(); });
+  std::atomic<int> count(0);
+  common::WorkStealingFor(3, 8, [&count](size_t, size_t thread) {
+      EXPECT_LT(thread, 3u);
+      count++;
+    });
+  EXPECT_EQ(3, count.load());
+}
@@ -126,13 +126,26 @@ class ConfigReader {
   bool GetReal(const char *exp, float *val, float min, float max);
   bool GetReal(const char *exp, double *val, double min, double max);
 
+  // Binds a variable to a value, so that it is set each time the bindings are
+  // read, with the getter of its type. Bind once, for instance after adding
+  // the files, and keep the variables alive as long as the reader.
+  void Bind(const char *exp, bool *val);
+  void Bind(const char *exp, int *val);
+  void Bind(const char *exp, unsigned int *val);
+  void Bind(const char *exp, float *val);
+  void Bind(const char *exp, double *val);
+  void Bind(const char *exp, std::string *str);
+  // Sets all the bound variables, false if any could not be read
+  bool ReadBindings();
+
  protected:
   class FileHeader{
    public:
     std::string filename_;      // name of file
     unsigned flags_;           // flags from FileFlags
+    bool imported_;            // required by another file, not added
     WatchFiles::Watch watch_;  // file modification watch
-    FileHeader() {}
+    FileHeader() : flags_(0), imported_(false) {}
     FileHeader(const FileHeader &fh);
   };
 
@@ -150,6 +163,11 @@ class ConfigReader {
   bool IsTopValid();
   void OutputGetValueError(const char *exp, const char *type);
 
+  // Snapshots of the values the files set, see config_snapshot.cc
+  std::string SnapshotFile();
+  bool ReadSnapshot();
+  void WriteSnapshot();
+
   bool ReadTable(const char *exp, Table *table);
   bool ReadStr(const char *exp, std::string *str);
   bool ReadBool(const char *exp, bool *val);
@@ -170,6 +188,7 @@ class ConfigReader {
   WatchFiles watch_files_;  // class used to monitor files for changes
   bool modified_;  // true if config files need to be re-read
   std::string path_;
+  std::vector<std::function<bool(void)>> bindings_;  // set by ReadBindings
 };
 
 bool FileExists(const char *filename);
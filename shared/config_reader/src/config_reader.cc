@@ -453,6 +453,7 @@ bool ConfigReader::Table::GetReal(int index, double *val, double min,
 ConfigReader::FileHeader::FileHeader(const FileHeader &fh) {
   filename_ = fh.filename_;
   flags_ = fh.flags_;
+  imported_ = fh.imported_;
   watch_ = fh.watch_;
 }
 
@@ -522,14 +523,22 @@ bool ConfigReader::ReadFiles() {
 
   modified_ = false;
 
-  bool ok = true;
-
   for (unsigned i = 0; i < files_.size(); i++) {
     FileHeader &fh = files_[i];
     if (fh.watch_.isFileModified()) {
       fh.watch_.rewatch(fh.filename_.c_str());
     }
+  }
+
+  // Values saved from the same files, unchanged since, need no Lua to be run
+  if (ReadSnapshot()) {
+    return true;
+  }
+
+  bool ok = true;
 
+  for (unsigned i = 0; i < files_.size(); i++) {
+    FileHeader &fh = files_[i];
     if (!ReadFile(fh.filename_.c_str(), fh.flags_)) {
       ok = false;
     }
@@ -537,6 +546,7 @@ bool ConfigReader::ReadFiles() {
 
   if (ok) {
     AddImports();
+    WriteSnapshot();
   }
 
   return ok;
@@ -675,6 +685,47 @@ bool ConfigReader::GetReal(const char *exp, double *val, double min, double max)
   return ReadReal(exp, val, min, max);
 }
 
+void ConfigReader::Bind(const char *exp, bool *val) {
+  std::string e(exp);
+  bindings_.push_back([this, e, val]() {return GetBool(e.c_str(), val);});
+}
+
+void ConfigReader::Bind(const char *exp, int *val) {
+  std::string e(exp);
+  bindings_.push_back([this, e, val]() {return GetInt(e.c_str(), val);});
+}
+
+void ConfigReader::Bind(const char *exp, unsigned int *val) {
+  std::string e(exp);
+  bindings_.push_back([this, e, val]() {return GetUInt(e.c_str(), val);});
+}
+
+void ConfigReader::Bind(const char *exp, float *val) {
+  std::string e(exp);
+  bindings_.push_back([this, e, val]() {return GetReal(e.c_str(), val);});
+}
+
+void ConfigReader::Bind(const char *exp, double *val) {
+  std::string e(exp);
+  bindings_.push_back([this, e, val]() {return GetReal(e.c_str(), val);});
+}
+
+void ConfigReader::Bind(const char *exp, std::string *str) {
+  std::string e(exp);
+  bindings_.push_back([this, e, str]() {return GetStr(e.c_str(), str);});
+}
+
+bool ConfigReader::ReadBindings() {
+  // Read them all, so that every value missing is reported
+  bool ok = true;
+  for (unsigned i = 0; i < bindings_.size(); i++) {
+    if (!bindings_[i]()) {
+      ok = false;
+    }
+  }
+  return ok;
+}
+
 /**********************************Protected***********************************/
 bool ConfigReader::InitLua() {
   if (l_) {
@@ -812,6 +863,7 @@ void ConfigReader::AddImports() {
       FileHeader fh;
       fh.filename_ = temp_filename;
       fh.flags_ = 0;
+      fh.imported_ = true;
       fh.watch_.watch(&watch_files_, fh.filename_.c_str());
       files_.push_back(fh);
     }
@@ -0,0 +1,473 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Snapshots of the values set by a list of config files, so that readers of
+// the same files need not run the Lua again. A snapshot is kept for each list
+// of files and robot environment in the directory ASTROBEE_CONFIG_CACHE names,
+// and written by the first reader which runs the Lua. It records the size and
+// modification time of each file the Lua read, the imports included, and is
+// only used while they all match. The globals the files set are saved as a
+// tree of typed keys and values, with tables seen before written as
+// references, so shared and recursive tables come back as they were. Values
+// the getters cannot read, such as functions, come back as placeholders, so
+// that they still exist. Metatables are not saved, which the config files
+// only use for methods. The file is in the native byte order.
+
+#include "config_reader/config_reader.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+extern char **environ;
+
+namespace config_reader {
+
+namespace {
+
+const uint32_t kSnapshotMagic = 0x50414e53;  // SNAP
+const uint32_t kSnapshotVersion = 1;
+
+// Tags of the values in a snapshot
+const char kTagBool = 'b';
+const char kTagNumber = 'd';
+const char kTagString = 's';
+const char kTagTable = 't';
+const char kTagRef = 'r';
+const char kTagOpaque = 'f';
+const char kTagEnd = 'e';
+
+struct FileStat {
+  int64_t size, sec, nsec;  // size is -1 if the file does not exist
+};
+
+FileStat StatFile(const char *filename) {
+  FileStat fs = {-1, 0, 0};
+  struct stat st;
+  if (stat(filename, &st) == 0) {
+    fs.size = st.st_size;
+    fs.sec = st.st_mtim.tv_sec;
+    fs.nsec = st.st_mtim.tv_nsec;
+  }
+  return fs;
+}
+
+uint64_t Hash(uint64_t hash, std::string const& str) {
+  // FNV-1a, with the terminating zero so that strings are kept apart
+  for (size_t i = 0; i <= str.size(); i++) {
+    hash ^= static_cast<unsigned char>(str.c_str()[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Stands in for values which cannot be saved
+int Opaque(lua_State *l) {
+  return 0;
+}
+
+class SnapshotWriter {
+ public:
+  // Uses the top of the stack to find the tables already written
+  explicit SnapshotWriter(lua_State *l) : l_(l), next_id_(1) {
+    lua_newtable(l_);
+    seen_ = lua_gettop(l_);
+  }
+
+  template <typename T>
+  void Put(T const& val) {
+    data_.append(reinterpret_cast<char const*>(&val), sizeof(val));
+  }
+
+  void PutStr(char const* str, size_t len) {
+    Put(static_cast<uint32_t>(len));
+    data_.append(str, len);
+  }
+
+  void PutStr(std::string const& str) {
+    PutStr(str.data(), str.size());
+  }
+
+  // Writes the value at a positive stack index
+  void PutValue(int index) {
+    switch (lua_type(l_, index)) {
+      case LUA_TBOOLEAN:
+        Put(kTagBool);
+        Put(static_cast<uint8_t>(lua_toboolean(l_, index)));
+        break;
+      case LUA_TNUMBER:
+        Put(kTagNumber);
+        Put(static_cast<double>(lua_tonumber(l_, index)));
+        break;
+      case LUA_TSTRING: {
+        size_t len;
+        char const* str = lua_tolstring(l_, index, &len);
+        Put(kTagString);
+        PutStr(str, len);
+        break;
+      }
+      case LUA_TTABLE:
+        PutTable(index, NULL);
+        break;
+      default:
+        Put(kTagOpaque);
+        break;
+    }
+  }
+
+  // Writes the table at a positive stack index, without the string keys in
+  // skip if given
+  void PutTable(int index, std::set<std::string> const* skip) {
+    lua_checkstack(l_, 4);
+    lua_pushvalue(l_, index);
+    lua_rawget(l_, seen_);
+    if (lua_isnumber(l_, -1)) {
+      Put(kTagRef);
+      Put(static_cast<uint32_t>(lua_tonumber(l_, -1)));
+      lua_pop(l_, 1);
+      return;
+    }
+    lua_pop(l_, 1);
+
+    uint32_t id = next_id_++;
+    lua_pushvalue(l_, index);
+    lua_pushnumber(l_, id);
+    lua_rawset(l_, seen_);
+    Put(kTagTable);
+    Put(id);
+
+    lua_pushnil(l_);
+    while (lua_next(l_, index)) {
+      int top = lua_gettop(l_);
+      if (!skip || lua_type(l_, top - 1) != LUA_TSTRING ||
+          !skip->count(lua_tostring(l_, top - 1))) {
+        PutValue(top - 1);
+        PutValue(top);
+      }
+      lua_pop(l_, 1);
+    }
+    Put(kTagEnd);
+  }
+
+  std::string const& data() const {return data_;}
+
+ private:
+  lua_State *l_;
+  int seen_;
+  uint32_t next_id_;
+  std::string data_;
+};
+
+class SnapshotReader {
+ public:
+  SnapshotReader(char const* data, size_t size) :
+    p_(data), end_(data + size) {}
+
+  template <typename T>
+  bool Get(T *val) {
+    if (static_cast<size_t>(end_ - p_) < sizeof(T))
+      return false;
+    memcpy(val, p_, sizeof(T));
+    p_ += sizeof(T);
+    return true;
+  }
+
+  bool GetStr(char const** str, uint32_t *len) {
+    if (!Get(len) || static_cast<size_t>(end_ - p_) < *len)
+      return false;
+    *str = p_;
+    p_ += *len;
+    return true;
+  }
+
+  bool GetStr(std::string *str) {
+    char const* s;
+    uint32_t len;
+    if (!GetStr(&s, &len))
+      return false;
+    str->assign(s, len);
+    return true;
+  }
+
+  // Pushes the next value, with the tables read so far in the table at a
+  // positive stack index. False if the snapshot is cut short or corrupt.
+  bool GetValue(lua_State *l, int tables) {
+    lua_checkstack(l, 4);
+    char tag;
+    if (!Get(&tag))
+      return false;
+    switch (tag) {
+      case kTagBool: {
+        uint8_t val;
+        if (!Get(&val))
+          return false;
+        lua_pushboolean(l, val);
+        return true;
+      }
+      case kTagNumber: {
+        double val;
+        if (!Get(&val))
+          return false;
+        lua_pushnumber(l, val);
+        return true;
+      }
+      case kTagString: {
+        char const* str;
+        uint32_t len;
+        if (!GetStr(&str, &len))
+          return false;
+        lua_pushlstring(l, str, len);
+        return true;
+      }
+      case kTagOpaque:
+        lua_pushcfunction(l, &Opaque);
+        return true;
+      case kTagRef: {
+        uint32_t id;
+        if (!Get(&id))
+          return false;
+        lua_rawgeti(l, tables, id);
+        return lua_istable(l, -1);
+      }
+      case kTagTable: {
+        uint32_t id;
+        if (!Get(&id))
+          return false;
+        lua_newtable(l);
+        lua_pushvalue(l, -1);
+        lua_rawseti(l, tables, id);
+        while (p_ < end_ && *p_ != kTagEnd) {
+          if (!GetValue(l, tables) || !GetValue(l, tables))
+            return false;
+          if (lua_isnil(l, -2))
+            return false;
+          lua_rawset(l, -3);
+        }
+        return Get(&tag);
+      }
+      default:
+        return false;
+    }
+  }
+
+ private:
+  char const* p_;
+  char const* end_;
+};
+
+}  // namespace
+
+std::string ConfigReader::SnapshotFile() {
+  char const* dir = getenv("ASTROBEE_CONFIG_CACHE");
+  if (dir == NULL || dir[0] == '\0') {
+    return "";
+  }
+
+  // The files added, and the environment they are read in
+  uint64_t hash = Hash(14695981039346656037ULL, path_);
+  for (unsigned i = 0; i < files_.size(); i++) {
+    if (!files_[i].imported_) {
+      hash = Hash(hash, files_[i].filename_);
+      hash = Hash(hash, std::to_string(files_[i].flags_));
+    }
+  }
+  std::vector<std::string> env;
+  for (char **e = environ; *e != NULL; e++) {
+    if (strncmp(*e, "ASTROBEE_", 9) == 0) {
+      env.push_back(*e);
+    }
+  }
+  std::sort(env.begin(), env.end());
+  for (unsigned i = 0; i < env.size(); i++) {
+    hash = Hash(hash, env[i]);
+  }
+
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.snapshot",
+    static_cast<unsigned long long>(hash));  // NOLINT
+  return dir + std::string(name);
+}
+
+bool ConfigReader::ReadSnapshot() {
+  std::string filename = SnapshotFile();
+  if (filename.empty()) {
+    return false;
+  }
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  SnapshotReader reader(static_cast<char const*>(data), st.st_size);
+  bool ok = true;
+  uint32_t magic, version, num_files;
+  if (!reader.Get(&magic) || !reader.Get(&version) ||
+      magic != kSnapshotMagic || version != kSnapshotVersion ||
+      !reader.Get(&num_files)) {
+    ok = false;
+  }
+
+  // Check the files are the ones added, and unchanged
+  std::vector<FileHeader> imports;
+  unsigned added = 0;
+  for (uint32_t i = 0; ok && i < num_files; i++) {
+    FileHeader fh;
+    uint8_t imported;
+    FileStat fs;
+    if (!reader.Get(&imported) || !reader.Get(&fh.flags_) ||
+        !reader.GetStr(&fh.filename_) || !reader.Get(&fs.size) ||
+        !reader.Get(&fs.sec) || !reader.Get(&fs.nsec)) {
+      ok = false;
+      break;
+    }
+    FileStat now = StatFile(fh.filename_.c_str());
+    if (now.size != fs.size || now.sec != fs.sec || now.nsec != fs.nsec) {
+      ok = false;
+      break;
+    }
+    fh.imported_ = imported;
+    if (fh.imported_) {
+      imports.push_back(fh);
+      continue;
+    }
+    while (added < files_.size() && files_[added].imported_) {
+      added++;
+    }
+    if (added == files_.size() ||
+        files_[added].filename_ != fh.filename_) {
+      ok = false;
+      break;
+    }
+    added++;
+  }
+  while (ok && added < files_.size()) {
+    if (!files_[added++].imported_) {
+      ok = false;
+    }
+  }
+
+  // Read the globals into a table, then copy them over, so that nothing is
+  // set unless the whole snapshot could be read
+  if (ok) {
+    lua_settop(l_, 0);
+    lua_newtable(l_);
+    if (!reader.GetValue(l_, 1) || !lua_istable(l_, -1)) {
+      LOG(WARNING) << "ConfigReader: Snapshot " << filename << " is corrupt.";
+      ok = false;
+    } else {
+      lua_pushnil(l_);
+      while (lua_next(l_, 2)) {
+        lua_pushvalue(l_, -2);
+        lua_insert(l_, -2);
+        lua_settable(l_, LUA_GLOBALSINDEX);
+      }
+    }
+    lua_settop(l_, 0);
+  }
+  munmap(data, st.st_size);
+  if (!ok) {
+    return false;
+  }
+
+  // Watch the files the snapshot was read from, as AddImports would
+  for (unsigned i = 0; i < imports.size(); i++) {
+    bool found = false;
+    for (unsigned j = 0; j < files_.size() && !found; j++) {
+      found = (files_[j].filename_ == imports[i].filename_);
+    }
+    if (!found) {
+      imports[i].watch_.watch(&watch_files_, imports[i].filename_.c_str());
+      files_.push_back(imports[i]);
+    }
+  }
+  return true;
+}
+
+void ConfigReader::WriteSnapshot() {
+  std::string filename = SnapshotFile();
+  if (filename.empty()) {
+    return;
+  }
+
+  // The globals Lua starts with are not saved
+  std::set<std::string> builtin;
+  lua_State *fresh = lua_open();
+  if (!fresh) {
+    return;
+  }
+  luaL_openlibs(fresh);
+  lua_pushnil(fresh);
+  while (lua_next(fresh, LUA_GLOBALSINDEX)) {
+    if (lua_type(fresh, -2) == LUA_TSTRING) {
+      builtin.insert(lua_tostring(fresh, -2));
+    }
+    lua_pop(fresh, 1);
+  }
+  lua_close(fresh);
+
+  lua_settop(l_, 0);
+  SnapshotWriter writer(l_);
+  writer.Put(kSnapshotMagic);
+  writer.Put(kSnapshotVersion);
+  writer.Put(static_cast<uint32_t>(files_.size()));
+  for (unsigned i = 0; i < files_.size(); i++) {
+    FileStat fs = StatFile(files_[i].filename_.c_str());
+    writer.Put(static_cast<uint8_t>(files_[i].imported_));
+    writer.Put(files_[i].flags_);
+    writer.PutStr(files_[i].filename_);
+    writer.Put(fs.size);
+    writer.Put(fs.sec);
+    writer.Put(fs.nsec);
+  }
+  lua_pushvalue(l_, LUA_GLOBALSINDEX);
+  writer.PutTable(lua_gettop(l_), &builtin);
+  lua_settop(l_, 0);
+
+  // Written aside and renamed, so that readers never see part of a snapshot
+  mkdir(getenv("ASTROBEE_CONFIG_CACHE"), 0755);
+  std::string tmp = filename + "." + std::to_string(getpid());
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (f == NULL) {
+    LOG(WARNING) << "ConfigReader: Unable to write snapshot " << tmp;
+    return;
+  }
+  bool ok = (fwrite(writer.data().data(), 1, writer.data().size(), f)
+    == writer.data().size());
+  ok = (fclose(f) == 0) && ok;
+  if (!ok || rename(tmp.c_str(), filename.c_str()) != 0) {
+    LOG(WARNING) << "ConfigReader: Unable to write snapshot " << filename;
+    unlink(tmp.c_str());
+  }
+}
+
+}  // namespace config_reader
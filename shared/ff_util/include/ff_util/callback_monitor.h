@@ -0,0 +1,91 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef FF_UTIL_CALLBACK_MONITOR_H_
+#define FF_UTIL_CALLBACK_MONITOR_H_
+
+#include <ros/callback_queue_interface.h>
+#include <diagnostic_msgs/KeyValue.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ff_util {
+
+// A histogram of durations, which any thread may add to. The buckets double
+// from 50us, and the last one holds everything longer.
+class LatencyHistogram {
+ public:
+  static constexpr int kNumBuckets = 16;
+
+  LatencyHistogram();
+
+  void Add(double seconds);
+
+  // The measurements since the last call
+  struct Window {
+    uint64_t counts[kNumBuckets];
+    uint64_t count;
+    double max;
+    // the upper bound of the bucket holding the percentile, at most max
+    double Percentile(double p) const;
+  };
+  void Take(Window* window);
+
+ private:
+  std::atomic<uint64_t> counts_[kNumBuckets];
+  std::atomic<uint64_t> max_ns_;
+};
+
+// Stands in for a callback queue, passing every callback on to it wrapped
+// to measure how long it waits in the queue and how long it runs. The
+// callbacks are grouped by kind, subscriptions, timers and services, and the
+// number waiting is tracked. Node handles given this queue report on every
+// callback made through them, without changes to the code making them.
+class CallbackMonitor : public ros::CallbackQueueInterface {
+ public:
+  enum Kind { SUBSCRIPTION, TIMER, SERVICE, OTHER, NUM_KINDS };
+
+  explicit CallbackMonitor(ros::CallbackQueueInterface* queue);
+  virtual ~CallbackMonitor();
+
+  virtual void addCallback(const ros::CallbackInterfacePtr& callback, uint64_t owner_id = 0);
+  virtual void removeByID(uint64_t owner_id);
+
+  // Appends the latencies and queue depth since the last call
+  void Report(std::vector<diagnostic_msgs::KeyValue>* keyval);
+
+ private:
+  class Callback;
+
+  // shared with the callbacks, which may outlive the monitor in the queue
+  struct State {
+    State() : depth(0), depth_max(0) {}
+    LatencyHistogram wait[NUM_KINDS], run[NUM_KINDS];
+    std::atomic<int> depth, depth_max;
+  };
+
+  ros::CallbackQueueInterface* queue_;
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace ff_util
+
+#endif  // FF_UTIL_CALLBACK_MONITOR_H_
@@ -0,0 +1,80 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef FF_UTIL_CAPTURE_CLOCK_H_
+#define FF_UTIL_CAPTURE_CLOCK_H_
+
+#include <ros/ros.h>
+
+#include <sys/time.h>
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+
+namespace ff_util {
+
+// Maps the times at which the camera drivers say their frames were captured
+// into the ROS clock, so that frames are not stamped with when they arrived.
+class CaptureClock {
+ public:
+  // The window is how long, in seconds, the smallest delay of a device clock
+  // is trusted before it is measured again
+  explicit CaptureClock(double window = 10.0);
+
+  // A time on CLOCK_MONOTONIC, as V4L2 buffers with the monotonic flag have
+  static ros::Time FromMonotonic(struct timeval const& tv);
+
+  // A time in microseconds on a device clock of unknown epoch. The offset to
+  // ROS time is the smallest seen between the device time and the arrival of
+  // its frame, so the frames keep the spacing of the device clock and are
+  // only late by the smallest transfer time.
+  ros::Time FromDevice(int64_t device_usec, ros::Time const& arrival);
+
+  void Reset();
+
+ private:
+  int64_t window_;          // in nanoseconds
+  int64_t offset_;          // ROS time minus device time, in nanoseconds
+  int64_t offset_stamp_;    // when the offset was measured
+  bool init_;
+};
+
+// Frames from cameras triggered together share the timestamp of the first
+// frame of their group, if they were captured within the tolerance of it.
+// Groups are shared by name between all the nodelets in a process.
+class CaptureSyncGroup {
+ public:
+  // Get the group of this name, created with this tolerance in seconds
+  static std::shared_ptr<CaptureSyncGroup> Get(std::string const& name, double tolerance);
+
+  // The shared timestamp of a frame captured at this time
+  ros::Time Stamp(ros::Time const& capture);
+
+ private:
+  explicit CaptureSyncGroup(double tolerance);
+
+  std::mutex mutex_;
+  ros::Duration tolerance_;
+  ros::Time last_;
+};
+
+}  // namespace ff_util
+
+#endif  // FF_UTIL_CAPTURE_CLOCK_H_
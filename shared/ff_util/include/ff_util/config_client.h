@@ -23,12 +23,19 @@
 
 #include <ff_util/ff_names.h>
 
+#include <dynamic_reconfigure/Config.h>
 #include <dynamic_reconfigure/Reconfigure.h>
 
+#include <map>
+#include <mutex>  // NOLINT
 #include <string>
 #include <list>
+#include <vector>
 
 namespace ff_util {
+
+typedef boost::function<void(dynamic_reconfigure::Config const& config)> ConfigChangeCallback;
+
 class ConfigClient {
  public:
   // Constructor and destructor
@@ -36,6 +43,13 @@ class ConfigClient {
   virtual ~ConfigClient();
   // Call a reconfigure with all set variables
   bool Reconfigure();
+  // Reconfigure several nodes at once, each with the variables set on its
+  // client, so that the calls take as long as the slowest of them
+  static bool Reconfigure(std::vector<ConfigClient*> const& clients);
+  // Keep a copy of the node's parameters, from its parameter_updates topic,
+  // so that Get reads memory rather than the parameter server. The callback,
+  // if any, is called with each update the node publishes.
+  void Subscribe(ConfigChangeCallback callback = ConfigChangeCallback());
   // Getters and Setters
   template<typename T> bool Set(const std::string &name, const T &value);
   template<typename T> bool Get(const std::string &name, T &value);
@@ -46,11 +60,24 @@ class ConfigClient {
     }
     return tmp;
   }
+
  private:
   // Private members
   ros::NodeHandle nh_;
   ros::ServiceClient service_;
   dynamic_reconfigure::ReconfigureRequest request_;
+  // The parameters last published by the node, when subscribed
+  void UpdateCallback(dynamic_reconfigure::ConfigConstPtr const& config);
+  void UpdateCache(dynamic_reconfigure::Config const& config);
+  template<typename T> bool GetCached(std::map<std::string, T> const& cache,
+                                      const std::string &name, T &value);
+  ros::Subscriber sub_;
+  ConfigChangeCallback callback_;
+  std::mutex mutex_;
+  std::map<std::string, bool> bools_;
+  std::map<std::string, int> ints_;
+  std::map<std::string, double> doubles_;
+  std::map<std::string, std::string> strs_;
 };
 
 template<> bool ConfigClient::Get<int>(const std::string &name, int &value);
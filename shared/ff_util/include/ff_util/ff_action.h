@@ -27,8 +27,10 @@
 #include <actionlib/client/simple_action_client.h>
 
 // C++11 includes
+#include <algorithm>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 
 namespace ff_util {
@@ -62,7 +64,7 @@ class FreeFlyerActionServer {
   typedef std::function < void (void) > CancelCallbackType;
 
   // Constructor
-  FreeFlyerActionServer() {}
+  FreeFlyerActionServer() : feedback_rate_(0.0), feedback_pending_(false) {}
 
   // Destructor
   ~FreeFlyerActionServer() {}
@@ -79,17 +81,48 @@ class FreeFlyerActionServer {
     sas_->registerGoalCallback(boost::bind(&FreeFlyerActionServer::GoalCallback, this));
     sas_->registerPreemptCallback(boost::bind(&FreeFlyerActionServer::PreemptCallback, this));
     sas_->start();
+    nh_ = *nh;
+    SetFeedbackRate(feedback_rate_);
+  }
+
+  // Send feedback at most rate times a second, or all of it if the rate is zero (default). Feedback
+  // coming sooner than that after the last is kept, replacing any older, and sent when its turn comes.
+  void SetFeedbackRate(double rate) {
+    feedback_rate_ = rate;
+    timer_feedback_ = ros::Timer();
+    if (!sas_ || feedback_rate_ <= 0.0) return;
+    timer_feedback_ = nh_.createTimer(ros::Duration(1.0 / feedback_rate_),
+      &FreeFlyerActionServer::FeedbackTimerCallback, this, false, true);
   }
 
   // Send incremental feedback for the current goal
   void SendFeedback(Feedback const& feedback) {
     if (!sas_) return;
+    if (feedback_rate_ <= 0.0)
+      return sas_->publishFeedback(feedback);
+    // Actionlib is called without the lock, as it calls back into this class with its own held
+    {
+      std::lock_guard<std::mutex> lock(feedback_mutex_);
+      ros::Time now = ros::Time::now();
+      if (feedback_pending_ || (now - feedback_last_).toSec() < 1.0 / feedback_rate_) {
+        // Copied into the message kept, which keeps its buffers from one feedback to the next
+        feedback_ = feedback;
+        feedback_pending_ = true;
+        return;
+      }
+      feedback_last_ = now;
+    }
     sas_->publishFeedback(feedback);
   }
 
   // Send the final result for the current goal
   void SendResult(FreeFlyerActionState::Enum result_code, Result const& result) {
     if (!sas_) return;
+    {
+      // Feedback kept for the goal goes with it
+      std::lock_guard<std::mutex> lock(feedback_mutex_);
+      feedback_pending_ = false;
+    }
     switch (result_code) {
     case FreeFlyerActionState::SUCCESS:     // Everything worked
       sas_->setSucceeded(result);
@@ -121,6 +154,10 @@ class FreeFlyerActionServer {
   // A new action has been called. We have to care of a special case where the goal is
   // cancelled / preempted between arrival and the time this callback is called.
   void GoalCallback() {
+    {
+      std::lock_guard<std::mutex> lock(feedback_mutex_);
+      feedback_pending_ = false;
+    }
     boost::shared_ptr<const Goal> goal = sas_->acceptNewGoal();
     if (cb_goal_)
       cb_goal_(goal);
@@ -131,6 +168,28 @@ class FreeFlyerActionServer {
   GoalCallbackType cb_goal_;
   PreemptCallbackType cb_preempt_;
   CancelCallbackType cb_cancel_;
+
+ private:
+  // Sends the feedback kept, if there is any and the goal is still active
+  void FeedbackTimerCallback(ros::TimerEvent const& event) {
+    {
+      std::lock_guard<std::mutex> lock(feedback_mutex_);
+      if (!feedback_pending_) return;
+      feedback_pending_ = false;
+      feedback_last_ = ros::Time::now();
+      std::swap(feedback_, feedback_sent_);
+    }
+    if (sas_->isActive())
+      sas_->publishFeedback(feedback_sent_);
+  }
+
+  ros::NodeHandle nh_;
+  ros::Timer timer_feedback_;
+  double feedback_rate_;
+  std::mutex feedback_mutex_;
+  Feedback feedback_, feedback_sent_;
+  bool feedback_pending_;
+  ros::Time feedback_last_;
 };
 
 //////////////////////////////////////// ACTION CLIENT CODE ///////////////////////////////////
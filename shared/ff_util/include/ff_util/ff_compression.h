@@ -0,0 +1,56 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef FF_UTIL_FF_COMPRESSION_H_
+#define FF_UTIL_FF_COMPRESSION_H_
+
+#include <ff_util/ff_flight.h>
+
+namespace ff_util {
+
+// Reduces segments to the setpoints that control needs to fly them within
+// a position and attitude error bound. Between setpoints control holds the
+// acceleration of the last one, as State::Propagate does, and the mapper
+// samples segments with the same model. So a setpoint can be dropped when
+// propagating the last setpoint kept reaches it within the bound. The kept
+// setpoints are unchanged, and the motion between them is reconstructed
+// exactly as control flies it.
+class Compression {
+ public:
+  // The setpoints that are kept, including the first and last ones, for
+  // bounds in meters and radians above zero. Kept setpoints are at most
+  // 1 / FlightUtil::MIN_CONTROL_RATE apart where the segment allows it, as
+  // segments are checked for that.
+  static Segment Compress(Segment const& segment,
+    double position, double attitude);
+
+  // The setpoint that control flies at time t
+  static Setpoint Sample(Segment const& knots, ros::Time const& t);
+
+  // The setpoints of every knot, and setpoints up to period seconds apart
+  // in between
+  static Segment Expand(Segment const& knots, double period);
+
+  // Does propagating the knot reach the setpoint within the bounds
+  static bool Reaches(State const& knot, State const& setpoint,
+    double position, double attitude);
+};
+
+}  // namespace ff_util
+
+#endif  // FF_UTIL_FF_COMPRESSION_H_
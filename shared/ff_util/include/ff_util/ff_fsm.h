@@ -20,13 +20,16 @@
 #define FF_UTIL_FF_FSM_H_
 
 // C++11 includes
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <functional>
-#include <utility>
 #include <vector>
-#include <map>
 
 namespace ff_util {
 
+// Events are single bits, and transitions are kept in a table indexed by the
+// state and the bit of the event, so that an update is one indexed load
 class FSM {
  public:
   typedef   int8_t State;
@@ -44,42 +47,33 @@ class FSM {
   void Add(State const& s1,
            Event const& mask,
            TransitionCallback callback) {
-    for (size_t i = 0; i < 8 * sizeof(Event); i++) {
-      if (mask & (1 << i)) {
-        fsm_[std::make_pair(s1, 1 << i)] = callback;
-      }
-    }
+    int16_t index = Store(callback);
+    Set(s1, mask, index);
   }
 
   // 2-state transition
   void Add(State const& s1, State const& s2,
            Event const& mask,
            TransitionCallback callback) {
-    for (size_t i = 0; i < 8 * sizeof(Event); i++) {
-      if (mask & (1 << i)) {
-        fsm_[std::make_pair(s1, 1 << i)] = callback;
-        fsm_[std::make_pair(s2, 1 << i)] = callback;
-      }
-    }
+    int16_t index = Store(callback);
+    Set(s1, mask, index);
+    Set(s2, mask, index);
   }
 
   // 3-state transition
   void Add(State const& s1, State const& s2, State const& s3,
            Event const& mask,
            TransitionCallback callback) {
-    for (size_t i = 0; i < 8 * sizeof(Event); i++) {
-      if (mask & (1 << i)) {
-        fsm_[std::make_pair(s1, 1 << i)] = callback;
-        fsm_[std::make_pair(s2, 1 << i)] = callback;
-        fsm_[std::make_pair(s3, 1 << i)] = callback;
-      }
-    }
+    int16_t index = Store(callback);
+    Set(s1, mask, index);
+    Set(s2, mask, index);
+    Set(s3, mask, index);
   }
 
   // Catch-all for a single event. Takes priority.
   void Add(Event const& mask, CatchallCallback callback) {
-    for (size_t i = 0; i < 8 * sizeof(Event); i++)
-      if (mask & (1 << i)) catchall_[1 << i] = callback;
+    for (size_t i = 0; i < kEvents; i++)
+      if (mask & (1u << i)) catchall_[i] = callback;
   }
 
   // Get the current state
@@ -94,27 +88,57 @@ class FSM {
 
   // Update the state machine - we only expect one event here
   void Update(Event const& event) {
+    // Events of more than one bit match nothing
+    if (event == 0 || (event & (event - 1)) != 0)
+      return;
+    size_t bit = __builtin_ctz(event);
     // Case 1 : A catch-all event occured
-    if (catchall_.find(event) != catchall_.end()) {
-      state_ = catchall_[event](state_, event);
+    if (catchall_[bit]) {
+      state_ = catchall_[bit](state_, event);
       if (callback_)
         callback_(state_, event);
       return;
     }
     // Case 2: Valid transition in the state machine
-    std::pair<State, Event> key = std::make_pair(state_, event);
-    if (fsm_.find(key) != fsm_.end()) {
-      state_ = fsm_[key](event);    // Call the transition function
-      if (callback_)                // Post-update callback
+    size_t key = Key(state_, bit);
+    if (key < table_.size() && table_[key] >= 0) {
+      state_ = callbacks_[table_[key]](event);  // Call the transition function
+      if (callback_)                            // Post-update callback
         callback_(state_, event);
     }
     // Case 3: Quietly ignore
   }
 
  private:
+  static const size_t kEvents = 8 * sizeof(Event);
+
+  // Negative states are placed after the positive ones
+  static size_t Key(State const& state, size_t bit) {
+    return static_cast<uint8_t>(state) * kEvents + bit;
+  }
+
+  // Callbacks are kept in a deque, so that adding transitions from within one
+  // does not move it
+  int16_t Store(TransitionCallback const& callback) {
+    callbacks_.push_back(callback);
+    return callbacks_.size() - 1;
+  }
+
+  void Set(State const& state, Event const& mask, int16_t index) {
+    for (size_t i = 0; i < kEvents; i++) {
+      if (mask & (1u << i)) {
+        size_t key = Key(state, i);
+        if (key >= table_.size())
+          table_.resize((key / kEvents + 1) * kEvents, -1);
+        table_[key] = index;
+      }
+    }
+  }
+
   State state_;
-  std::map<std::pair<State, Event>, TransitionCallback> fsm_;
-  std::map<Event, CatchallCallback> catchall_;
+  std::vector<int16_t> table_;                // callback of each state and event
+  std::deque<TransitionCallback> callbacks_;
+  CatchallCallback catchall_[kEvents];
   UpdateCallback callback_;
 };
 
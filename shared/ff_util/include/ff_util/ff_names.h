@@ -78,6 +78,7 @@
 
 #define TOPIC_COMMAND                               "command"
 #define TOPIC_HEARTBEAT                             "heartbeat"
+#define TOPIC_HEARTBEAT_BATCH                       "heartbeat_batch"
 #define TOPIC_PERFORMANCE                           "performance"
 #define TOPIC_TRIGGER                               "trigger"
 #define TOPIC_JOINT_GOALS                           "joint_goals"
@@ -112,9 +113,12 @@
 
 #define TOPIC_GNC_EKF                               "gnc/ekf"
 #define TOPIC_GNC_EKF_FEATURES                      "gnc/ekf/features"
+#define TOPIC_GNC_EKF_COMPACT                       "gnc/ekf/compact"
+#define TOPIC_GNC_EKF_PREDICTED                     "gnc/ekf/predicted"
 #define TOPIC_GNC_CTL_SHAPER                        "gnc/ctl/shaper"
 #define TOPIC_GNC_CTL_TRAJ                          "gnc/ctl/traj"
 #define TOPIC_GNC_CTL_SEGMENT                       "gnc/ctl/segment"
+#define TOPIC_GNC_CTL_APPEND                        "gnc/ctl/append"
 #define TOPIC_GNC_CTL_PROGRESS                      "gnc/ctl/progress"
 #define TOPIC_GNC_CTL_COMMAND                       "gnc/ctl/command"
 
@@ -152,6 +156,7 @@
 #define TOPIC_MANAGEMENT_ACK                        "mgt/ack"
 #define TOPIC_MANAGEMENT_ACCESS_CONTROL_STATE       "mgt/access_control/state"
 #define TOPIC_MANAGEMENT_CPU_MONITOR_STATE          "mgt/cpu_monitor/state"
+#define TOPIC_MANAGEMENT_CPU_MONITOR_PROCESSES      "mgt/cpu_monitor/processes"
 #define TOPIC_MANAGEMENT_DISK_MONITOR_STATE         "mgt/disk_monitor/state"
 #define TOPIC_MANAGEMENT_EXEC_AGENT_STATE           "mgt/executive/agent_state"
 #define TOPIC_MANAGEMENT_EXEC_CF_ACK                "mgt/executive/cf_ack"
@@ -162,6 +167,8 @@
 #define TOPIC_MANAGEMENT_SYS_MONITOR_STATE          "mgt/sys_monitor/state"
 #define TOPIC_MANAGEMENT_DATA_BAGGER_STATE          "mgt/data_bagger/state"
 #define TOPIC_MANAGEMENT_DATA_BAGGER_TOPICS         "mgt/data_bagger/topics"
+#define TOPIC_MANAGEMENT_DATA_BAGGER_TRIGGER        "mgt/data_bagger/trigger"
+#define TOPIC_MANAGEMENT_DATA_BAGGER_PACKAGE        "mgt/data_bagger/package"
 #define TOPIC_MANAGEMENT_CAMERA_STATE               "mgt/camera_state"
 #define TOPIC_MANAGEMENT_IMG_SAMPLER_NAV_CAM_RECORD  "mgt/img_sampler/nav_cam/image_record"
 #define TOPIC_MANAGEMENT_IMG_SAMPLER_NAV_CAM_STREAM  "mgt/img_sampler/nav_cam/image_stream"
@@ -218,6 +225,7 @@
 #define TOPIC_MAPPER_OCTOMAP_INFLATED_FREE_MARKERS  "mob/mapper/inflated_free_space_markers"
 #define TOPIC_MAPPER_FRUSTRUM_MARKERS               "mob/mapper/frustum_markers"
 #define TOPIC_MAPPER_DISCRETE_TRAJECTORY_MARKERS    "mob/mapper/discrete_trajectory_markers"
+#define TOPIC_MAPPER_OCTOMAP_DELTA                  "mob/mapper/octomap_delta"
 
 //////////////////
 // LOCALIZATION //
@@ -250,6 +258,7 @@
 
 #define TOPIC_LOCALIZATION_ML_FEATURES              "loc/ml/features"
 #define TOPIC_LOCALIZATION_ML_REGISTRATION          "loc/ml/registration"
+#define TOPIC_LOCALIZATION_ML_DIAGNOSTICS           "loc/ml/diagnostics"
 #define TOPIC_LOCALIZATION_AR_FEATURES              "loc/ar/features"
 #define TOPIC_LOCALIZATION_AR_REGISTRATION          "loc/ar/registration"
 #define TOPIC_LOCALIZATION_OF_FEATURES              "loc/of/features"
@@ -336,8 +345,11 @@
 #define TOPIC_HARDWARE_PMC_TELEMETRY                "hw/pmc/telemetry"
 #define TOPIC_HARDWARE_PMC_STATE                    "hw/pmc/state"
 #define TOPIC_HARDWARE_IMU                          "hw/imu"
+#define TOPIC_HARDWARE_IMU_BATCH                    "hw/imu_batch"
 #define TOPIC_HARDWARE_NAV_CAM                      "hw/cam_nav"
 #define TOPIC_HARDWARE_DOCK_CAM                     "hw/cam_dock"
+#define TOPIC_HARDWARE_CAM_SUFFIX_SCALED            "_scaled"
+#define TOPIC_HARDWARE_CAM_SUFFIX_ROI               "_roi"
 #define TOPIC_HARDWARE_SCI_CAM                      "hw/cam_sci"
 #define TOPIC_HARDWARE_LIGHT_FRONT                  "hw/light_front"
 #define TOPIC_HARDWARE_LIGHT_AFT                    "hw/light_aft"
@@ -32,9 +32,13 @@
 #include <ff_msgs/Heartbeat.h>
 #include <ff_msgs/Trigger.h>
 
+#include <ff_util/callback_monitor.h>
 #include <ff_util/ff_names.h>
+#include <ff_util/thread_policy.h>
 
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <thread>
@@ -53,6 +57,8 @@
 
 namespace ff_util {
 
+class HeartbeatBatcher;
+
 class FreeFlyerNodelet : public nodelet::Nodelet {
  public:
   enum ResolveType : uint8_t {
@@ -98,6 +104,11 @@ class FreeFlyerNodelet : public nodelet::Nodelet {
   std::string GetName();
   std::string GetPlatform();
 
+  // Schedules the calling thread, which this nodelet started, by the policy
+  // named "<node>/<thread>" in threads.config, if any, and logs how it is
+  // scheduled
+  void ConfigureThread(std::string const& thread);
+
   // The set function does all of the internal work. We have moved this out
   // of the onInit() call, so that it can be invoked when a nodelet is not used
   // for example, in simulation, where the dynamic loading is within gazebo...
@@ -116,6 +127,9 @@ class FreeFlyerNodelet : public nodelet::Nodelet {
   // Called in heartbeat callback or by nodes that do not to use the hb timer
   void PublishHeartbeat();
 
+  // Called in heartbeat callback, when the callbacks are timed
+  void PublishCallbackStats();
+
   // We capture the init function and start up heartbeats, etc, then call Initialize()
   void onInit();
 
@@ -129,8 +143,24 @@ class FreeFlyerNodelet : public nodelet::Nodelet {
 
   unsigned int heartbeat_queue_size_;
 
+  // Whether the callbacks made through the node handles are timed
+  bool callback_stats_;
+  std::unique_ptr<CallbackMonitor> monitor_, monitor_mt_;
+  std::vector<diagnostic_msgs::KeyValue> callback_keys_;
+  std::mutex callback_keys_mutex_;
+
+  // Whether heartbeats without faults are sent in batches, through a batcher
+  // shared by the nodelets of this process, and whether the last heartbeat
+  // had faults
+  bool heartbeat_batch_;
+  bool heartbeat_faulted_;
+  HeartbeatBatcher* batcher_;
+
   config_reader::ConfigReader param_config_;
 
+  // The policies of threads.config, of the manager and of any thread
+  std::vector<ThreadPolicy> thread_policies_;
+
   // Heartbeat message, also used to report faults
   ff_msgs::Heartbeat heartbeat_;
 
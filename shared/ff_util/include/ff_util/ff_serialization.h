@@ -22,9 +22,17 @@
 // ROS includes
 #include <ros/ros.h>
 
+// System includes
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 // STL includes
+#include <cstring>
 #include <fstream>
 #include <string>
+#include <vector>
 
 namespace ff_util {
 
@@ -62,6 +70,195 @@ class Serialization {
     ifs.close();
     return true;
   }
+  // Read a ROS message written by WriteFile straight from the mapped file,
+  // with no copy of it. False if the file is too short for the message.
+  template < class RosMessage >
+  static bool ReadFileMapped(std::string const& file_name, RosMessage & msg) {
+    MappedFile file;
+    if (!file.Open(file_name))
+      return false;
+    return Deserialize(file.Data(), file.Size(), msg);
+  }
+  // Read a ROS message from a buffer, false if the buffer is too short
+  template < class RosMessage >
+  static bool Deserialize(uint8_t const* data, size_t size, RosMessage & msg) {
+    try {
+      ros::serialization::IStream istream(const_cast < uint8_t* > (data), size);
+      ros::serialization::deserialize(istream, msg);
+    } catch (ros::serialization::StreamOverrunException const& e) {
+      return false;
+    }
+    return true;
+  }
+
+  // A whole file mapped read only, until closed or destroyed
+  class MappedFile {
+   public:
+    MappedFile() : data_(nullptr), size_(0) {}
+    ~MappedFile() {
+      Close();
+    }
+    bool Open(std::string const& file_name) {
+      Close();
+      int fd = open(file_name.c_str(), O_RDONLY);
+      if (fd < 0)
+        return false;
+      struct stat st;
+      if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+      }
+      void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (data == MAP_FAILED)
+        return false;
+      data_ = static_cast < uint8_t const* > (data);
+      size_ = st.st_size;
+      return true;
+    }
+    void Close() {
+      if (data_)
+        munmap(const_cast < uint8_t* > (data_), size_);
+      data_ = nullptr;
+      size_ = 0;
+    }
+    uint8_t const* Data() const {
+      return data_;
+    }
+    size_t Size() const {
+      return size_;
+    }
+
+   private:
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+    uint8_t const* data_;
+    size_t size_;
+  };
+
+  // Many messages of one type in one file, with an index, so that each is
+  // read from the mapped file only when asked for. The file starts with a
+  // format version and the MD5 sum of the message definition, and one
+  // written for another message, or another version, is not opened.
+  template < class RosMessage >
+  class Archive {
+   public:
+    static constexpr uint32_t kVersion = 1;
+
+    // Write the messages to a file, replacing it
+    static bool Write(std::string const& file_name, std::vector < RosMessage > const& msgs) {
+      std::vector < uint32_t > index(2 * msgs.size());
+      size_t offset = HeaderSize(msgs.size());
+      for (size_t i = 0; i < msgs.size(); i++) {
+        index[2 * i] = offset;
+        index[2 * i + 1] = ros::serialization::serializationLength(msgs[i]);
+        offset += index[2 * i + 1];
+        if (offset > UINT32_MAX)
+          return false;
+      }
+      std::vector < uint8_t > buffer(offset);
+      uint8_t* header = buffer.data();
+      WriteHeader(header, msgs.size());
+      memcpy(header + kIndexOffset, index.data(), index.size() * sizeof(uint32_t));
+      for (size_t i = 0; i < msgs.size(); i++) {
+        ros::serialization::OStream ostream(header + index[2 * i], index[2 * i + 1]);
+        ros::serialization::serialize(ostream, msgs[i]);
+      }
+      std::ofstream ofs(file_name, std::ios::out | std::ios::binary);
+      if (!ofs.is_open())
+        return false;
+      ofs.write(reinterpret_cast < char* > (buffer.data()), buffer.size());
+      return ofs.good();
+    }
+
+    Archive() : size_(0) {}
+
+    // Map the file, false if it is not an archive of this message
+    bool Open(std::string const& file_name) {
+      Close();
+      if (!file_.Open(file_name))
+        return false;
+      uint32_t size;
+      if (!ReadHeader(file_.Data(), file_.Size(), &size)) {
+        file_.Close();
+        return false;
+      }
+      // Every message must lie within the file
+      for (uint32_t i = 0; i < size; i++) {
+        uint32_t offset, length;
+        Entry(i, &offset, &length);
+        if (offset < HeaderSize(size) || offset > file_.Size() || length > file_.Size() - offset) {
+          file_.Close();
+          return false;
+        }
+      }
+      size_ = size;
+      return true;
+    }
+    void Close() {
+      file_.Close();
+      size_ = 0;
+    }
+    // The number of messages
+    size_t Size() const {
+      return size_;
+    }
+    // Deserialize one message, false if there is no such message
+    bool Read(size_t i, RosMessage & msg) const {
+      if (i >= size_)
+        return false;
+      uint32_t offset, length;
+      Entry(i, &offset, &length);
+      return Deserialize(file_.Data() + offset, length, msg);
+    }
+    // Deserialize all the messages
+    bool ReadAll(std::vector < RosMessage > & msgs) const {
+      msgs.resize(size_);
+      for (size_t i = 0; i < size_; i++)
+        if (!Read(i, msgs[i]))
+          return false;
+      return true;
+    }
+
+   private:
+    // Magic, version, MD5 sum and count, then the offset and length of each message
+    static constexpr size_t kMd5Size = 32;
+    static constexpr size_t kIndexOffset = 4 + 4 + kMd5Size + 4;
+
+    static size_t HeaderSize(size_t size) {
+      return kIndexOffset + 2 * size * sizeof(uint32_t);
+    }
+    static void WriteHeader(uint8_t* data, uint32_t size) {
+      uint32_t version = kVersion;
+      memcpy(data, "FFSA", 4);
+      memcpy(data + 4, &version, 4);
+      std::string md5 = ros::message_traits::md5sum < RosMessage > ();
+      md5.resize(kMd5Size, '\0');
+      memcpy(data + 8, md5.data(), kMd5Size);
+      memcpy(data + 8 + kMd5Size, &size, 4);
+    }
+    static bool ReadHeader(uint8_t const* data, size_t length, uint32_t* size) {
+      if (length < kIndexOffset || memcmp(data, "FFSA", 4) != 0)
+        return false;
+      uint32_t version;
+      memcpy(&version, data + 4, 4);
+      if (version != kVersion)
+        return false;
+      std::string md5 = ros::message_traits::md5sum < RosMessage > ();
+      md5.resize(kMd5Size, '\0');
+      if (memcmp(data + 8, md5.data(), kMd5Size) != 0)
+        return false;
+      memcpy(size, data + 8 + kMd5Size, 4);
+      return length >= HeaderSize(*size);
+    }
+    void Entry(size_t i, uint32_t* offset, uint32_t* length) const {
+      memcpy(offset, file_.Data() + kIndexOffset + 8 * i, 4);
+      memcpy(length, file_.Data() + kIndexOffset + 8 * i + 4, 4);
+    }
+
+    MappedFile file_;
+    size_t size_;
+  };
 };
 
 }  // namespace ff_util
@@ -21,14 +21,41 @@
 
 // ROS includes
 #include <ros/ros.h>
+#include <ros/callback_queue_interface.h>
+
+// Boost includes
+#include <boost/make_shared.hpp>
 
 // C++11 includes
 #include <string>
 #include <functional>
 #include <memory>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <vector>
+#include <thread>              // NOLINT
+#include <mutex>               // NOLINT
+#include <condition_variable>  // NOLINT
 
 namespace ff_util {
 
+// A callback that calls a function from a ROS callback queue. It is used to hand the result of an asynchronous
+// service call back to the thread spinning the queue of the caller.
+class FunctionCallback : public ros::CallbackInterface {
+ public:
+  explicit FunctionCallback(std::function<void(void)> function) : function_(function) {}
+
+  CallResult call() {
+    function_();
+    return Success;
+  }
+
+ private:
+  std::function<void(void)> function_;
+};
+
 //////////////////////////////////////// ACTION CLIENT CODE ////////////////////////////////////////////////
 
 // This is a simple wrapper around a ROS service client, which forces the connection to be persistent, and
@@ -45,11 +72,13 @@ class FreeFlyerServiceClient {
   };
   static constexpr double DEFAULT_TIMEOUT_CONNECTED   = 10.0;
   static constexpr double DEFAULT_POLL_DURATION       = 0.1;
+  static constexpr size_t DEFAULT_ASYNC_THREADS       = 1;
 
  public:
   // Callback types
   typedef std::function < void (void) > ConnectedCallbackType;
   typedef std::function < void (void) > TimeoutCallbackType;
+  typedef std::function < void (bool, ServiceSpec const&) > ResponseCallbackType;
 
   // Setters for callbacks
   void SetTimeoutCallback(TimeoutCallbackType cb_timeout)          { cb_timeout_ = cb_timeout;     }
@@ -58,13 +87,19 @@ class FreeFlyerServiceClient {
   // Setters for timeouts
   void SetConnectedTimeout(double to_connected)  { to_connected_ = ros::Duration(to_connected); }
 
+  // Setter for the number of threads making asynchronous calls, which must be called before the first one
+  void SetAsyncThreads(size_t async_threads)     { async_threads_ = async_threads; }
+
   // Constructor
   FreeFlyerServiceClient() : state_(WAITING_FOR_CREATE),
     to_connected_(DEFAULT_TIMEOUT_CONNECTED),
-    to_poll_(DEFAULT_POLL_DURATION) {}
+    to_poll_(DEFAULT_POLL_DURATION), nh_(nullptr),
+    async_threads_(DEFAULT_ASYNC_THREADS), async_id_(0), async_stop_(false) {}
 
-  // Destructor
-  ~FreeFlyerServiceClient() {}
+  // Destructor, which drops the asynchronous calls that have not returned
+  ~FreeFlyerServiceClient() {
+    StopAsync();
+  }
 
   // Try and connect to the service client, and return whether the connection is active. In the blocking
   // case (NOT RECOMMENDED) if the server exists, then the return value should be true. The non-blocking
@@ -97,6 +132,34 @@ class FreeFlyerServiceClient {
     return service_.call(service);
   }
 
+  // Make the call from a worker thread, so that the thread of the caller is not blocked for the round trip. The
+  // callback is called from the callback queue of the node handle, with whether the call succeeded and the
+  // response. If a deadline is given and it passes first, the callback is called with false and the request,
+  // and the call is dropped if it has not been sent yet. Returns false without a callback if not connected.
+  bool CallAsync(ServiceSpec const& service, ResponseCallbackType cb, double deadline = 0.0) {
+    if (!IsConnected())
+      return false;
+    std::shared_ptr < AsyncCall > call = std::make_shared < AsyncCall > ();
+    call->request = service;
+    call->service = service;
+    call->client = service_;
+    call->cb = cb;
+    call->cancelled = false;
+    std::lock_guard < std::mutex > lock(async_mutex_);
+    call->id = async_id_++;
+    AsyncPending & pending = async_pending_[call->id];
+    pending.call = call;
+    if (deadline > 0.0)
+      pending.timer = nh_->createTimer(ros::Duration(deadline), std::bind(
+        &FreeFlyerServiceClient::DeadlineCallback, this, std::placeholders::_1, call->id), true, true);
+    // Start the workers on the first call
+    while (async_workers_.size() < std::max(async_threads_, size_t(1)))
+      async_workers_.push_back(std::thread(&FreeFlyerServiceClient::AsyncWorker, this));
+    async_queue_.push_back(call);
+    async_cv_.notify_one();
+    return true;
+  }
+
  protected:
   // Simple wrapper around an optional timer
   void StartOptionalTimer(ros::Timer & timer, ros::Duration const& duration) {
@@ -134,6 +197,84 @@ class FreeFlyerServiceClient {
       cb_timeout_();
   }
 
+  // An asynchronous call. The service is only touched by the worker until the call returns, and the request is
+  // kept aside to be handed back if the deadline passes while the call is in progress.
+  struct AsyncCall {
+    uint64_t id;
+    ServiceSpec request;
+    ServiceSpec service;
+    ros::ServiceClient client;
+    ResponseCallbackType cb;
+    std::atomic < bool > cancelled;
+  };
+
+  // An asynchronous call that has not called back yet, and its deadline
+  struct AsyncPending {
+    std::shared_ptr < AsyncCall > call;
+    ros::Timer timer;
+  };
+
+  // Make the queued calls and return their results to the queue of the caller
+  void AsyncWorker() {
+    while (true) {
+      std::shared_ptr < AsyncCall > call;
+      {
+        std::unique_lock < std::mutex > lock(async_mutex_);
+        async_cv_.wait(lock, [this]() { return async_stop_ || !async_queue_.empty(); });
+        if (async_stop_)
+          return;
+        call = async_queue_.front();
+        async_queue_.pop_front();
+      }
+      // Don't send calls whose deadline has already passed
+      if (call->cancelled)
+        continue;
+      bool success = call->client.call(call->service);
+      nh_->getCallbackQueue()->addCallback(boost::make_shared < FunctionCallback > (std::bind(
+        &FreeFlyerServiceClient::AsyncComplete, this, call->id, success, false)),
+          reinterpret_cast < uint64_t > (this));
+    }
+  }
+
+  // Called when the deadline of an asynchronous call passes
+  void DeadlineCallback(ros::TimerEvent const& event, uint64_t id) {
+    AsyncComplete(id, false, true);
+  }
+
+  // Called back from the queue of the caller with the result of a call, or when its deadline passes, whichever
+  // comes first. The other one finds that the call is no longer pending and does nothing.
+  void AsyncComplete(uint64_t id, bool success, bool expired) {
+    AsyncPending pending;
+    {
+      std::lock_guard < std::mutex > lock(async_mutex_);
+      typename std::map < uint64_t, AsyncPending >::iterator it = async_pending_.find(id);
+      if (it == async_pending_.end())
+        return;
+      pending = it->second;
+      async_pending_.erase(it);
+    }
+    pending.timer.stop();
+    pending.call->cancelled = true;
+    if (pending.call->cb)
+      pending.call->cb(success, expired ? pending.call->request : pending.call->service);
+  }
+
+  // Stop the workers and drop all the calls that have not called back yet
+  void StopAsync() {
+    {
+      std::lock_guard < std::mutex > lock(async_mutex_);
+      async_stop_ = true;
+      async_queue_.clear();
+      async_pending_.clear();
+    }
+    async_cv_.notify_all();
+    for (size_t i = 0; i < async_workers_.size(); i++)
+      async_workers_[i].join();
+    async_workers_.clear();
+    if (nh_)
+      nh_->getCallbackQueue()->removeByID(reinterpret_cast < uint64_t > (this));
+  }
+
  protected:
   State state_;
   ros::Duration to_connected_;
@@ -145,6 +286,14 @@ class FreeFlyerServiceClient {
   ros::Timer timer_poll_;
   std::string topic_;
   ros::NodeHandle *nh_;
+  size_t async_threads_;
+  uint64_t async_id_;
+  bool async_stop_;
+  std::mutex async_mutex_;
+  std::condition_variable async_cv_;
+  std::deque < std::shared_ptr < AsyncCall > > async_queue_;
+  std::map < uint64_t, AsyncPending > async_pending_;
+  std::vector < std::thread > async_workers_;
 };
 
 }  // namespace ff_util
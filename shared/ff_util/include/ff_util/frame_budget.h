@@ -0,0 +1,67 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef FF_UTIL_FRAME_BUDGET_H_
+#define FF_UTIL_FRAME_BUDGET_H_
+
+#include <atomic>
+#include <chrono>
+
+namespace ff_util {
+
+// Skips frames so that processing them takes at most a share of the time.
+// After a frame that took t seconds, the frames that arrive in the t / budget
+// seconds from its start are skipped. A detector with a budget of 0.5 then
+// leaves at least half a core to the others, however slow its frames are.
+// Skip may be called from another thread than Start and Stop.
+class FrameBudget {
+ public:
+  FrameBudget() : budget_(1.0), start_(0), next_(0) {}
+  // The share of the time, from 0 to 1, where 1 never skips a frame
+  void SetBudget(double budget) {
+    budget_ = budget;
+  }
+  // Whether to skip a frame that arrives now
+  bool Skip() const {
+    return budget_ > 0.0 && budget_ < 1.0 && Now() < next_.load();
+  }
+  // Around the processing of each frame that is not skipped
+  void Start() {
+    start_ = Now();
+  }
+  void Stop() {
+    Stop(start_);
+  }
+  // For frames that overlap, which keep the time each one started
+  static int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+  void Stop(int64_t start) {
+    next_ = start + static_cast<int64_t>((Now() - start) / budget_);
+  }
+
+ private:
+  std::atomic<double> budget_;
+  int64_t start_;
+  std::atomic<int64_t> next_;
+};
+
+}  // namespace ff_util
+
+#endif  // FF_UTIL_FRAME_BUDGET_H_
@@ -0,0 +1,73 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef FF_UTIL_MARKER_PUBLISHER_H_
+#define FF_UTIL_MARKER_PUBLISHER_H_
+
+#include <ros/ros.h>
+
+#include <visualization_msgs/MarkerArray.h>
+
+#include <map>
+#include <mutex>  // NOLINT
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ff_util {
+
+// Publishes marker arrays as the changes since the last array sent: the
+// markers that were added or modified, and deletions for those that are gone.
+// Markers are compared without their stamp, so markers rebuilt each time with
+// the current time are only sent when they change. A subscriber that connects
+// is sent every current marker, so the topic does not need to be latched.
+class MarkerPublisher {
+ public:
+  MarkerPublisher() {}
+
+  void Initialize(ros::NodeHandle *nh, std::string const& topic, uint32_t queue_size);
+
+  // Whether it is worth building the markers at all
+  bool HasSubscribers() const;
+
+  // Sends the changes from the markers last sent to these ones, returning the
+  // number of markers in the message, or zero if nothing changed. Markers
+  // with a lifetime are sent every time, as they would otherwise expire.
+  size_t Publish(visualization_msgs::MarkerArray const& markers);
+
+  // Forgets the markers sent, so that all the next ones are sent
+  void Clear();
+
+ private:
+  typedef std::pair<std::string, int32_t> Key;
+  struct Sent {
+    visualization_msgs::Marker marker;
+    std::vector<uint8_t> data;        // serialized without the stamp
+  };
+
+  void Connect(ros::SingleSubscriberPublisher const& pub);
+  static void Serialize(visualization_msgs::Marker const& marker, std::vector<uint8_t> *data);
+
+  ros::Publisher pub_;
+  std::mutex mutex_;
+  std::map<Key, Sent> sent_;
+};
+
+}  // namespace ff_util
+
+#endif  // FF_UTIL_MARKER_PUBLISHER_H_
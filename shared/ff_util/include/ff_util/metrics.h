@@ -0,0 +1,214 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef FF_UTIL_METRICS_H_
+#define FF_UTIL_METRICS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>  // NOLINT
+#include <string>
+#include <vector>
+
+namespace ff_util {
+
+// Counters, gauges and histograms kept in one shared memory segment per
+// process, /dev/shm/ff_metrics.<pid>, so that recording a value is a few
+// relaxed atomic operations and never a message. The metrics_collector tool
+// reads every segment and publishes them all at a low rate. Handles are
+// cheap to copy, and a handle that could not be registered does nothing.
+// The segment also holds a ring of trace events, which trace_dump turns into
+// a trace that Perfetto or chrome://tracing can open.
+
+// Monotonic time in nanoseconds, for timing with histograms
+uint64_t MetricsNow();
+
+namespace metrics {
+
+enum Type : uint32_t { COUNTER = 1, GAUGE = 2, HISTOGRAM = 3, TRACE = 4 };
+
+static constexpr uint64_t kMagic = 0x3153434952544d46;  // "FMTRICS1"
+static constexpr uint32_t kCapacity = 256;
+static constexpr uint32_t kNameLength = 64;
+// Log-linear buckets: values below 8 are exact, and each power of two above
+// that is split into 8, so a bucket is within 12.5% of the values in it
+static constexpr uint32_t kSubBits = 3;
+static constexpr uint32_t kBuckets = (64 - kSubBits + 1) << kSubBits;
+static constexpr uint32_t kEvents = 4096;
+
+struct Slot {
+  std::atomic<uint32_t> ready;
+  uint32_t type;
+  char name[kNameLength];
+  std::atomic<uint64_t> count;      // counter value, or histogram samples
+  std::atomic<int64_t> value;       // gauge value
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> min;
+  std::atomic<uint64_t> max;
+  std::atomic<uint64_t> buckets[kBuckets];
+};
+
+// A trace event, written under a sequence number that is odd while the
+// event is being written, so that a reader can tell it was overwritten
+struct Event {
+  std::atomic<uint64_t> seq;
+  std::atomic<uint64_t> time;       // MetricsNow() of the event
+  std::atomic<int64_t> age;         // since the sample was captured, or -1
+  std::atomic<uint32_t> id;         // sample id
+  std::atomic<uint32_t> stage;      // slot of the stage
+};
+
+struct Segment {
+  uint64_t magic;
+  uint32_t pid;
+  std::atomic<uint32_t> used;       // slots registered, in order
+  char process[kNameLength];
+  Slot slots[kCapacity];
+  std::atomic<uint64_t> events_next;
+  Event events[kEvents];
+};
+
+// The bucket a value falls in, and the smallest value in a bucket
+uint32_t Bucket(uint64_t value);
+uint64_t BucketMin(uint32_t bucket);
+
+}  // namespace metrics
+
+class MetricCounter {
+ public:
+  MetricCounter() : slot_(nullptr) {}
+  explicit MetricCounter(metrics::Slot *slot) : slot_(slot) {}
+  void Add(uint64_t n = 1) {
+    if (slot_) slot_->count.fetch_add(n, std::memory_order_relaxed);
+  }
+
+ private:
+  metrics::Slot *slot_;
+};
+
+class MetricGauge {
+ public:
+  MetricGauge() : slot_(nullptr) {}
+  explicit MetricGauge(metrics::Slot *slot) : slot_(slot) {}
+  void Set(int64_t value) {
+    if (slot_) slot_->value.store(value, std::memory_order_relaxed);
+  }
+
+ private:
+  metrics::Slot *slot_;
+};
+
+class MetricHistogram {
+ public:
+  MetricHistogram() : slot_(nullptr) {}
+  explicit MetricHistogram(metrics::Slot *slot) : slot_(slot) {}
+  // Records a value, in nanoseconds when timing
+  void Record(uint64_t value);
+
+ private:
+  metrics::Slot *slot_;
+};
+
+// A stage of the flow of traced samples, such as the camera frames whose
+// landmarks end up in a thruster command. Each event records the id of a
+// sample and its age, which is also kept in a histogram of the stage.
+class MetricTrace {
+ public:
+  MetricTrace() : slot_(nullptr), segment_(nullptr), last_(0) {}
+  MetricTrace(metrics::Slot *slot, metrics::Segment *segment)
+    : slot_(slot), segment_(segment), last_(0) {}
+  // Records that the sample passed this stage, with its age in nanoseconds
+  void Emit(uint32_t id, int64_t age = -1);
+  // The same, for a stage that sees each sample many times, but only the first
+  // time a handle sees an id, and never for id zero. Returns true if it emitted.
+  bool EmitOnce(uint32_t id, int64_t age = -1);
+
+ private:
+  metrics::Slot *slot_;
+  metrics::Segment *segment_;
+  uint32_t last_;
+};
+
+// Records the time from construction to destruction in a histogram
+class MetricTimer {
+ public:
+  explicit MetricTimer(MetricHistogram const& histogram)
+    : histogram_(histogram), start_(MetricsNow()) {}
+  ~MetricTimer() { histogram_.Record(MetricsNow() - start_); }
+
+ private:
+  MetricHistogram histogram_;
+  uint64_t start_;
+};
+
+// Creates the segment of this process on the first registration, and
+// removes it when the process exits. Registering a name again returns the
+// same metric. Registration takes a lock, so do it once, outside of loops.
+class MetricsRegistry {
+ public:
+  static MetricsRegistry & Instance();
+
+  MetricCounter Counter(std::string const& name);
+  MetricGauge Gauge(std::string const& name);
+  MetricHistogram Histogram(std::string const& name);
+  MetricTrace Trace(std::string const& name);
+
+  // The shared memory name of the segment, or empty if it is not mapped
+  std::string const& Name() const { return name_; }
+
+ private:
+  MetricsRegistry();
+  metrics::Slot* Register(std::string const& name, metrics::Type type);
+
+  std::mutex mutex_;
+  std::string name_;
+  metrics::Segment *segment_;
+};
+
+// A copy of one metric, read from a segment
+struct MetricSnapshot {
+  std::string name;
+  metrics::Type type;
+  uint64_t count;
+  int64_t value;
+  uint64_t sum, min, max;
+  std::vector<uint64_t> buckets;
+  // An estimate from the buckets, with p in [0, 1]
+  double Percentile(double p) const;
+};
+
+// A copy of one trace event
+struct TraceSnapshot {
+  uint64_t time;
+  int64_t age;
+  uint32_t id;
+  std::string stage;
+};
+
+// The shared memory names of every metrics segment on this machine
+std::vector<std::string> ListMetricsSegments();
+
+// Copies the metrics in a segment, and if asked for, the trace events still
+// in it, oldest first. Returns false if it cannot be read.
+bool ReadMetricsSegment(std::string const& name, uint32_t *pid,
+  std::string *process, std::vector<MetricSnapshot> *metrics,
+  std::vector<TraceSnapshot> *events = nullptr);
+
+}  // namespace ff_util
+
+#endif  // FF_UTIL_METRICS_H_
@@ -23,36 +23,53 @@
 
 #include <ff_msgs/Performance.h>
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <string>
+#include <vector>
 
 namespace ff_util {
 
 class PerfTimer {
  public:
-  void Initialize(std::string const& name) {
+  PerfTimer() : init_(false), window_(0), next_(0) {}
+  // Percentiles are over the last window measurements
+  void Initialize(std::string const& name, size_t window = 200) {
     ros::NodeHandle nh("/performance");
     pub_ = nh.advertise<ff_msgs::Performance>(name, 5);
+    window_ = window;
+    samples_.clear();
+    samples_.reserve(window_);
+    next_ = 0;
     init_ = true;
   }
   void Clear() {
     if (!init_) return;
     msg_.count = msg_.mean = msg_.var = msg_.stddev = 0.0;
     msg_.last = msg_.max = msg_.min = -1.0;
+    msg_.p50 = msg_.p95 = msg_.p99 = -1.0;
+    samples_.clear();
+    next_ = 0;
   }
   void Tick() {
     if (!init_) return;
-    start_ = std::chrono::system_clock::now();
+    start_ = std::chrono::steady_clock::now();
   }
   void Tock() {
     if (!init_) return;
-    std::chrono::time_point<std::chrono::system_clock> end;
-    end = std::chrono::system_clock::now();
+    std::chrono::time_point<std::chrono::steady_clock> end;
+    end = std::chrono::steady_clock::now();
     std::chrono::duration<double> dt = end - start_;
+    Add(dt.count());
+  }
+  // Add a measurement timed elsewhere, in seconds
+  void Add(double seconds) {
+    if (!init_) return;
     // Add the measurement and the count
     msg_.stamp = ros::Time::now();
     msg_.count += 1.0;
-    msg_.last = dt.count();
+    msg_.last = seconds;
     if (msg_.last > msg_.max || msg_.min < 0.0) msg_.max = msg_.last;
     if (msg_.last < msg_.min || msg_.min < 0.0) msg_.min = msg_.last;
     if (msg_.count > 1) {
@@ -65,17 +82,42 @@ class PerfTimer {
       msg_.var = 0;
     }
     msg_.stddev = sqrt(msg_.var);
+    // Keep the last window measurements, overwriting the oldest
+    if (window_ == 0) return;
+    if (samples_.size() < window_) {
+      samples_.push_back(seconds);
+    } else {
+      samples_[next_] = seconds;
+      next_ = (next_ + 1) % window_;
+    }
   }
   void Send() {
     if (!init_) return;
+    if (!samples_.empty()) {
+      sorted_ = samples_;
+      std::sort(sorted_.begin(), sorted_.end());
+      msg_.p50 = Percentile(0.50);
+      msg_.p95 = Percentile(0.95);
+      msg_.p99 = Percentile(0.99);
+    }
     pub_.publish(msg_);
   }
 
  private:
-  std::chrono::time_point<std::chrono::system_clock> start_;
+  // Nearest rank percentile of sorted_
+  double Percentile(double p) const {
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted_.size()));
+    return sorted_[std::min(sorted_.size(), std::max<size_t>(rank, 1)) - 1];
+  }
+
+  std::chrono::time_point<std::chrono::steady_clock> start_;
   ff_msgs::Performance msg_;
   ros::Publisher pub_;
   bool init_;
+  size_t window_;
+  size_t next_;
+  std::vector<double> samples_;
+  std::vector<double> sorted_;
 };
 
 }  // namespace ff_util
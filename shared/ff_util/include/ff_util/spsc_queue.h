@@ -0,0 +1,92 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef FF_UTIL_SPSC_QUEUE_H_
+#define FF_UTIL_SPSC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+
+namespace ff_util {
+
+/**
+ * @brief Lock-free ring buffer for one producer thread and one consumer thread.
+ * @details Push() is only called by the producer, Front() and Pop() only by the
+ * consumer. Neither ever waits for the other. The capacity N must be a power of two.
+ */
+template <typename T, size_t N>
+class SpscQueue {
+ public:
+  SpscQueue() : head_(0), tail_(0) {}
+
+  /**
+   * Returns false, and drops the item, if the queue is full.
+   **/
+  bool Push(T const& item) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) >= N)
+      return false;
+    items_[tail & (N - 1)] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * The oldest item, or NULL if the queue is empty. It stays valid until Pop().
+   **/
+  T* Front() {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire))
+      return NULL;
+    return &items_[head & (N - 1)];
+  }
+
+  /**
+   * Removes the item returned by Front(), which must not be NULL.
+   **/
+  void Pop() {
+    size_t head = head_.load(std::memory_order_relaxed);
+    items_[head & (N - 1)] = T();  // release what the item holds now rather than when overwritten
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  /**
+   * The number of items queued, which may have changed by the time it is used.
+   **/
+  size_t Size() const {
+    size_t head = head_.load(std::memory_order_acquire);
+    return tail_.load(std::memory_order_acquire) - head;
+  }
+
+  bool Empty() const {
+    return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+  }
+
+ private:
+  static_assert(N > 0 && (N & (N - 1)) == 0, "The capacity must be a power of two.");
+
+  T items_[N];
+  // padded apart, so that the two threads do not write to the same cache line
+  std::atomic<size_t> head_;  // next item to pop, written by the consumer
+  char padding_[64];
+  std::atomic<size_t> tail_;  // next slot to push, written by the producer
+};
+
+}  // end namespace ff_util
+
+#endif  // FF_UTIL_SPSC_QUEUE_H_
@@ -0,0 +1,62 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef FF_UTIL_THREAD_POLICY_H_
+#define FF_UTIL_THREAD_POLICY_H_
+
+#include <config_reader/config_reader.h>
+
+#include <sched.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+namespace ff_util {
+
+// How a thread is scheduled: the cores it may run on (any if empty), the
+// policy, its real time priority for SCHED_FIFO and SCHED_RR, and its nice
+// level for SCHED_OTHER
+struct ThreadPolicy {
+  std::string name;
+  std::vector<int> cores;
+  int policy = SCHED_OTHER;
+  int priority = 0;
+  int nice = 0;
+};
+
+// Reads the entries of the thread_policies table, skipping and logging those
+// that are malformed. Returns false if there is no table.
+bool ReadThreadPolicies(config_reader::ConfigReader* config,
+                        std::vector<ThreadPolicy>* policies);
+
+// Applies a policy to one thread of this process, by its kernel id, zero
+// being the calling thread. Returns false, with the reason, if any part of it
+// could not be applied, having applied the rest.
+bool ApplyThreadPolicy(ThreadPolicy const& policy, pid_t tid, std::string* error);
+
+// Applies a policy to every thread of this process, so that those they start
+// inherit it too
+bool ApplyProcessPolicy(ThreadPolicy const& policy, std::string* error);
+
+// Describes how a thread is scheduled now, eg. "cores 2,3 SCHED_FIFO 60"
+std::string DescribeThread(pid_t tid = 0);
+
+}  // namespace ff_util
+
+#endif  // FF_UTIL_THREAD_POLICY_H_
@@ -0,0 +1,82 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ff_util/capture_clock.h>
+
+#include <time.h>
+
+#include <map>
+#include <string>
+
+namespace ff_util {
+
+CaptureClock::CaptureClock(double window)
+  : window_(static_cast<int64_t>(window * 1e9)), offset_(0), offset_stamp_(0), init_(false) {}
+
+ros::Time CaptureClock::FromMonotonic(struct timeval const& tv) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  ros::Time stamp = ros::Time::now();
+  int64_t age = (static_cast<int64_t>(now.tv_sec) - tv.tv_sec) * 1000000000LL
+              + now.tv_nsec - static_cast<int64_t>(tv.tv_usec) * 1000LL;
+  if (age < 0 || age > static_cast<int64_t>(stamp.toNSec()))
+    return stamp;
+  return stamp - ros::Duration().fromNSec(age);
+}
+
+ros::Time CaptureClock::FromDevice(int64_t device_usec, ros::Time const& arrival) {
+  int64_t device = device_usec * 1000LL;
+  int64_t now = static_cast<int64_t>(arrival.toNSec());
+  int64_t offset = now - device;
+  // Keep the smallest delay, but measure it again once it is old, in case
+  // the device clock drifts or restarts
+  if (!init_ || offset < offset_ || now - offset_stamp_ > window_) {
+    offset_ = offset;
+    offset_stamp_ = now;
+    init_ = true;
+  }
+  ros::Time stamp;
+  stamp.fromNSec(static_cast<uint64_t>(device + offset_));
+  return stamp;
+}
+
+void CaptureClock::Reset() {
+  init_ = false;
+}
+
+std::shared_ptr<CaptureSyncGroup> CaptureSyncGroup::Get(std::string const& name, double tolerance) {
+  static std::mutex groups_mutex;
+  static std::map<std::string, std::shared_ptr<CaptureSyncGroup>> groups;
+  std::lock_guard<std::mutex> lock(groups_mutex);
+  std::shared_ptr<CaptureSyncGroup> & group = groups[name];
+  if (!group)
+    group.reset(new CaptureSyncGroup(tolerance));
+  return group;
+}
+
+CaptureSyncGroup::CaptureSyncGroup(double tolerance) : tolerance_(tolerance) {}
+
+ros::Time CaptureSyncGroup::Stamp(ros::Time const& capture) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!last_.isZero() && capture >= last_ - tolerance_ && capture <= last_ + tolerance_)
+    return last_;
+  last_ = capture;
+  return capture;
+}
+
+}  // namespace ff_util
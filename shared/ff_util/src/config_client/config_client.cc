@@ -26,6 +26,7 @@
 #include <dynamic_reconfigure/StrParameter.h>
 #include <dynamic_reconfigure/BoolParameter.h>
 
+#include <thread>  // NOLINT
 #include <vector>
 
 namespace ff_util {
@@ -35,7 +36,43 @@ ConfigClient::ConfigClient(ros::NodeHandle *platform_nh, const std::string &node
   service_ = nh_.serviceClient<dynamic_reconfigure::Reconfigure>("set_parameters", true);
 }
 
-ConfigClient::~ConfigClient() {}
+ConfigClient::~ConfigClient() {
+  sub_.shutdown();
+}
+
+void ConfigClient::Subscribe(ConfigChangeCallback callback) {
+  callback_ = callback;
+  sub_ = nh_.subscribe("parameter_updates", 1, &ConfigClient::UpdateCallback, this);
+}
+
+void ConfigClient::UpdateCallback(dynamic_reconfigure::ConfigConstPtr const& config) {
+  UpdateCache(*config);
+  if (callback_)
+    callback_(*config);
+}
+
+void ConfigClient::UpdateCache(dynamic_reconfigure::Config const& config) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto const& p : config.bools)
+    bools_[p.name] = p.value;
+  for (auto const& p : config.ints)
+    ints_[p.name] = p.value;
+  for (auto const& p : config.doubles)
+    doubles_[p.name] = p.value;
+  for (auto const& p : config.strs)
+    strs_[p.name] = p.value;
+}
+
+template<typename T>
+bool ConfigClient::GetCached(std::map<std::string, T> const& cache,
+                             const std::string &name, T &value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  typename std::map<std::string, T>::const_iterator it = cache.find(name);
+  if (it == cache.end())
+    return false;
+  value = it->second;
+  return true;
+}
 
 // Templated functions
 
@@ -56,6 +93,8 @@ bool ConfigClient::Set(const std::string &name, const T &value) {
 
 template<>
 bool ConfigClient::Get(const std::string &name, bool &value) {
+  if (GetCached(bools_, name, value))
+    return true;
   if (!nh_.getParam(name, value)) {
     ROS_WARN_STREAM("Could not get parameter " << name);
     return false;
@@ -76,6 +115,8 @@ bool ConfigClient::Set(const std::string &name, const bool &value) {
 
 template<>
 bool ConfigClient::Get(const std::string &name, int &value) {
+  if (GetCached(ints_, name, value))
+    return true;
   if (!nh_.getParam(name, value)) {
     ROS_WARN_STREAM("Could not get parameter " << name);
     return false;
@@ -96,6 +137,8 @@ bool ConfigClient::Set(const std::string &name, const int &value) {
 
 template<>
 bool ConfigClient::Get(const std::string &name, std::string &value) {
+  if (GetCached(strs_, name, value))
+    return true;
   if (!nh_.getParam(name, value)) {
     ROS_WARN_STREAM("Could not get parameter " << name);
     return false;
@@ -116,6 +159,8 @@ bool ConfigClient::Set(const std::string &name, const std::string &value) {
 
 template<>
 bool ConfigClient::Get(const std::string &name, double &value) {
+  if (GetCached(doubles_, name, value))
+    return true;
   if (!nh_.getParam(name, value)) {
     ROS_WARN_STREAM("Could not get parameter " << name);
     return false;
@@ -148,6 +193,9 @@ bool ConfigClient::Reconfigure() {
   // Call the reconfigure service
   dynamic_reconfigure::ReconfigureResponse response;
   if (service_.call(request_, response)) {
+    // The node has taken the values, so keep them until it publishes them
+    if (sub_)
+      UpdateCache(request_.config);
     request_.config.ints.clear();
     request_.config.bools.clear();
     request_.config.doubles.clear();
@@ -158,5 +206,22 @@ bool ConfigClient::Reconfigure() {
   return false;
 }
 
+bool ConfigClient::Reconfigure(std::vector<ConfigClient*> const& clients) {
+  std::vector<char> success(clients.size(), false);
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < clients.size(); i++)
+    threads.emplace_back([&clients, &success, i]() {
+      success[i] = clients[i]->Reconfigure();
+    });
+  if (!clients.empty())
+    success[0] = clients[0]->Reconfigure();
+  for (std::thread & thread : threads)
+    thread.join();
+  for (char s : success)
+    if (!s)
+      return false;
+  return true;
+}
+
 }  // namespace ff_util
 
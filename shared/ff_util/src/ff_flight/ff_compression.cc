@@ -0,0 +1,90 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ff_util/ff_compression.h>
+
+// STL includes
+#include <algorithm>
+
+namespace ff_util {
+
+  // Segments of fewer than three setpoints have nothing to drop
+  Segment Compression::Compress(Segment const& segment,
+    double position, double attitude) {
+    if (segment.size() < 3)
+      return segment;
+    Segment knots(1, segment.front());
+    State knot(segment.front());
+    size_t last = 0;
+    double gap = 1.0 / FlightUtil::MIN_CONTROL_RATE;
+    for (size_t i = 1; i + 1 < segment.size(); i++) {
+      State setpoint(segment[i]);
+      if (setpoint.t - knot.t <= gap
+        && Reaches(knot, setpoint, position, attitude))
+        continue;
+      // Keep the last setpoint that was reached, and check this one again
+      // from it, unless it is already the knot
+      size_t k = (i - 1 > last ? i - 1 : i);
+      knots.push_back(segment[k]);
+      knot = State(segment[k]);
+      last = k;
+      if (k < i)
+        i--;
+    }
+    knots.push_back(segment.back());
+    return knots;
+  }
+
+  // Propagate the last knot at or before t, or hold the first one
+  Setpoint Compression::Sample(Segment const& knots, ros::Time const& t) {
+    if (knots.empty())
+      return Setpoint();
+    Segment::const_iterator it = std::upper_bound(knots.begin(), knots.end(),
+      t, [](ros::Time const& when, Setpoint const& sp) {
+        return when < sp.when;
+      });
+    if (it == knots.begin())
+      return knots.front();
+    State knot(*(--it));
+    return knot.Propagate((t - it->when).toSec()).ToSetpoint();
+  }
+
+  // The knots are kept as they are, so that the motion is the same
+  Segment Compression::Expand(Segment const& knots, double period) {
+    Segment segment;
+    for (size_t i = 0; i < knots.size(); i++) {
+      segment.push_back(knots[i]);
+      if (i + 1 == knots.size() || period <= 0.0)
+        continue;
+      State knot(knots[i]);
+      double dt = (knots[i + 1].when - knots[i].when).toSec();
+      for (double t = period; t < dt; t += period)
+        segment.push_back(knot.Propagate(t).ToSetpoint());
+    }
+    return segment;
+  }
+
+  bool Compression::Reaches(State const& knot, State const& setpoint,
+    double position, double attitude) {
+    State state(knot);
+    state = state.Propagate(setpoint.t - knot.t);
+    return (state.p - setpoint.p).norm() <= position
+      && state.q.angularDistance(setpoint.q) <= attitude;
+  }
+
+}  // namespace ff_util
@@ -0,0 +1,188 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ff_util/callback_monitor.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace ff_util {
+
+namespace {
+
+constexpr double kFirstBucket = 50e-6;
+
+double Now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The callback classes of roscpp are internal, but their names tell them apart
+CallbackMonitor::Kind KindOf(ros::CallbackInterface const& callback) {
+  const char* name = typeid(callback).name();
+  if (strstr(name, "Subscription"))
+    return CallbackMonitor::SUBSCRIPTION;
+  if (strstr(name, "Timer"))
+    return CallbackMonitor::TIMER;
+  if (strstr(name, "Service"))
+    return CallbackMonitor::SERVICE;
+  return CallbackMonitor::OTHER;
+}
+
+void AddKey(std::vector<diagnostic_msgs::KeyValue>* keyval, std::string const& key, std::string const& value) {
+  diagnostic_msgs::KeyValue kv;
+  kv.key = key;
+  kv.value = value;
+  keyval->push_back(kv);
+}
+
+std::string Milliseconds(double seconds) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.3f", seconds * 1000.0);
+  return buffer;
+}
+
+}  // namespace
+
+LatencyHistogram::LatencyHistogram() : max_ns_(0) {
+  for (int i = 0; i < kNumBuckets; i++)
+    counts_[i] = 0;
+}
+
+void LatencyHistogram::Add(double seconds) {
+  int bucket = 0;
+  double bound = kFirstBucket;
+  while (bucket < kNumBuckets - 1 && seconds > bound) {
+    bound *= 2.0;
+    bucket++;
+  }
+  counts_[bucket]++;
+
+  uint64_t ns = static_cast<uint64_t>(std::max(seconds, 0.0) * 1e9);
+  uint64_t max = max_ns_.load();
+  while (ns > max && !max_ns_.compare_exchange_weak(max, ns)) {}
+}
+
+void LatencyHistogram::Take(Window* window) {
+  window->count = 0;
+  for (int i = 0; i < kNumBuckets; i++) {
+    window->counts[i] = counts_[i].exchange(0);
+    window->count += window->counts[i];
+  }
+  window->max = max_ns_.exchange(0) * 1e-9;
+}
+
+double LatencyHistogram::Window::Percentile(double p) const {
+  if (count == 0)
+    return 0.0;
+  uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p * count + 0.5));
+  uint64_t seen = 0;
+  double bound = kFirstBucket;
+  for (int i = 0; i < kNumBuckets - 1; i++, bound *= 2.0) {
+    seen += counts[i];
+    if (seen >= rank)
+      return std::min(bound, max);
+  }
+  return max;
+}
+
+class CallbackMonitor::Callback : public ros::CallbackInterface {
+ public:
+  Callback(std::shared_ptr<State> const& state, Kind kind, ros::CallbackInterfacePtr const& callback) :
+    state_(state), kind_(kind), callback_(callback), queued_(Now()), waiting_(true) {
+    int depth = ++state_->depth;
+    int max = state_->depth_max.load();
+    while (depth > max && !state_->depth_max.compare_exchange_weak(max, depth)) {}
+  }
+
+  virtual ~Callback() {
+    // removed from the queue without being called
+    if (waiting_)
+      state_->depth--;
+  }
+
+  virtual CallResult call() {
+    double start = Now();
+    if (waiting_) {
+      waiting_ = false;
+      state_->depth--;
+      state_->wait[kind_].Add(start - queued_);
+    }
+    CallResult result = callback_->call();
+    if (result == TryAgain) {
+      // it goes back in the queue, and keeps the time it was first queued
+      waiting_ = true;
+      state_->depth++;
+    } else {
+      state_->run[kind_].Add(Now() - start);
+    }
+    return result;
+  }
+
+  virtual bool ready() {
+    return callback_->ready();
+  }
+
+ private:
+  std::shared_ptr<State> state_;
+  Kind kind_;
+  ros::CallbackInterfacePtr callback_;
+  double queued_;
+  bool waiting_;
+};
+
+CallbackMonitor::CallbackMonitor(ros::CallbackQueueInterface* queue) :
+  queue_(queue), state_(new State()) {
+}
+
+CallbackMonitor::~CallbackMonitor() {
+}
+
+void CallbackMonitor::addCallback(const ros::CallbackInterfacePtr& callback, uint64_t owner_id) {
+  queue_->addCallback(ros::CallbackInterfacePtr(new Callback(state_, KindOf(*callback), callback)), owner_id);
+}
+
+void CallbackMonitor::removeByID(uint64_t owner_id) {
+  queue_->removeByID(owner_id);
+}
+
+void CallbackMonitor::Report(std::vector<diagnostic_msgs::KeyValue>* keyval) {
+  static const char* names[NUM_KINDS] = {"sub", "timer", "srv", "other"};
+  for (int k = 0; k < NUM_KINDS; k++) {
+    LatencyHistogram::Window wait, run;
+    state_->wait[k].Take(&wait);
+    state_->run[k].Take(&run);
+    if (run.count == 0 && wait.count == 0)
+      continue;
+    std::string prefix = std::string("cb_") + names[k];
+    AddKey(keyval, prefix + "_count", std::to_string(run.count));
+    AddKey(keyval, prefix + "_wait_p50_ms", Milliseconds(wait.Percentile(0.50)));
+    AddKey(keyval, prefix + "_wait_p99_ms", Milliseconds(wait.Percentile(0.99)));
+    AddKey(keyval, prefix + "_wait_max_ms", Milliseconds(wait.max));
+    AddKey(keyval, prefix + "_run_p50_ms", Milliseconds(run.Percentile(0.50)));
+    AddKey(keyval, prefix + "_run_p99_ms", Milliseconds(run.Percentile(0.99)));
+    AddKey(keyval, prefix + "_run_max_ms", Milliseconds(run.max));
+  }
+  AddKey(keyval, "cb_queue_depth", std::to_string(state_->depth.load()));
+  AddKey(keyval, "cb_queue_depth_max", std::to_string(state_->depth_max.exchange(state_->depth.load())));
+}
+
+}  // namespace ff_util
@@ -25,14 +25,94 @@
 #include <nodelet/nodelet.h>
 #include <diagnostic_msgs/DiagnosticStatus.h>
 #include <diagnostic_msgs/DiagnosticArray.h>
+#include <ff_msgs/HeartbeatBatch.h>
 
 #include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
 #include <string>
 
 namespace ff_util {
 
 namespace fs = boost::filesystem;
 
+// Collects the heartbeats without faults of the nodelets in this process
+// which share a namespace, and publishes them together once each of them has
+// sent one, or once the oldest has waited kMaxAge, checked by a timer which
+// is never stopped, as stopping it with the mutex held could wait on its
+// callback. One per namespace, never freed, as nodelets may be unloaded in
+// any order.
+class HeartbeatBatcher {
+ public:
+  static HeartbeatBatcher* Get(ros::NodeHandle & nh) {
+    static std::mutex mutex;
+    static std::map<std::string, HeartbeatBatcher*> batchers;
+    std::lock_guard<std::mutex> lock(mutex);
+    HeartbeatBatcher* & batcher = batchers[nh.getNamespace()];
+    if (!batcher)
+      batcher = new HeartbeatBatcher(nh);
+    return batcher;
+  }
+
+  void Add(std::string const& node) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    nodes_.insert(node);
+  }
+
+  void Remove(std::string const& node) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    nodes_.erase(node);
+    if (!pending_.empty() && pending_.size() >= nodes_.size())
+      Publish();
+  }
+
+  void Update(ff_msgs::Heartbeat const& hb) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_.empty())
+      oldest_ = hb.header.stamp;
+    pending_[hb.node] = hb;
+    if (pending_.size() >= nodes_.size())
+      Publish();
+  }
+
+ private:
+  static constexpr double kMaxAge = 0.25;
+
+  explicit HeartbeatBatcher(ros::NodeHandle & nh) : nh_(nh) {
+    pub_ = nh_.advertise<ff_msgs::HeartbeatBatch>(TOPIC_HEARTBEAT_BATCH, 5,
+      true);
+    timer_ = nh_.createTimer(ros::Duration(kMaxAge / 2),
+      &HeartbeatBatcher::TimerCallback, this, false, true);
+  }
+
+  void TimerCallback(ros::TimerEvent const& ev) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!pending_.empty() &&
+        (ros::Time::now() - oldest_).toSec() >= kMaxAge)
+      Publish();
+  }
+
+  // Called with the mutex held
+  void Publish() {
+    ff_msgs::HeartbeatBatch batch;
+    batch.header.stamp = ros::Time::now();
+    batch.heartbeats.reserve(pending_.size());
+    for (auto const& entry : pending_)
+      batch.heartbeats.push_back(entry.second);
+    pending_.clear();
+    pub_.publish(batch);
+  }
+
+  std::mutex mutex_;
+  ros::NodeHandle nh_;
+  ros::Publisher pub_;
+  ros::Timer timer_;
+  std::set<std::string> nodes_;
+  std::map<std::string, ff_msgs::Heartbeat> pending_;
+  ros::Time oldest_;
+};
+
 FreeFlyerNodelet::FreeFlyerNodelet(
   std::string const& node, bool autostart_hb_timer) :
   nodelet::Nodelet(),
@@ -40,6 +120,10 @@ FreeFlyerNodelet::FreeFlyerNodelet(
   initialized_(false),
   sleeping_(false),
   heartbeat_queue_size_(5),
+  callback_stats_(false),
+  heartbeat_batch_(false),
+  heartbeat_faulted_(false),
+  batcher_(NULL),
   node_(node) {
 }
 
@@ -47,10 +131,16 @@ FreeFlyerNodelet::FreeFlyerNodelet(bool autostart_hb_timer) :
   nodelet::Nodelet(),
   autostart_hb_timer_(autostart_hb_timer),
   initialized_(false),
+  callback_stats_(false),
+  heartbeat_batch_(false),
+  heartbeat_faulted_(false),
+  batcher_(NULL),
   node_("") {
 }
 
 FreeFlyerNodelet::~FreeFlyerNodelet() {
+  if (batcher_)
+    batcher_->Remove(node_);
 }
 
 // Called directly by Gazebo and indirectly through onInit() by nodelet
@@ -81,8 +171,34 @@ void FreeFlyerNodelet::Setup(ros::NodeHandle & nh, ros::NodeHandle & nh_mt) {
   // Read in faults for this node
   param_config_.AddFile("faults.config");
   param_config_.AddFile("context.config");
+  param_config_.AddFile("threads.config");
   ReadConfig();
 
+  // Schedule the threads of the manager by its policy, once for all of the
+  // nodelets in it, before they start threads of their own
+  static std::once_flag manager_scheduled;
+  std::call_once(manager_scheduled, [this]() {
+    std::string manager = ros::this_node::getName();
+    manager = manager.substr(manager.rfind('/') + 1);
+    for (ThreadPolicy const& policy : thread_policies_) {
+      if (policy.name != manager)
+        continue;
+      std::string error;
+      if (!ApplyProcessPolicy(policy, &error))
+        FF_WARN("Manager " << manager << " is not fully scheduled: " << error);
+    }
+    FF_INFO("Manager " << manager << ": " << DescribeThread());
+  });
+
+  // Time the callbacks made through the node handles, which the private
+  // node handles below and those of the node inherit
+  if (callback_stats_) {
+    monitor_.reset(new CallbackMonitor(nh_.getCallbackQueue()));
+    nh_.setCallbackQueue(monitor_.get());
+    monitor_mt_.reset(new CallbackMonitor(nh_mt_.getCallbackQueue()));
+    nh_mt_.setCallbackQueue(monitor_mt_.get());
+  }
+
   // Setup the private node handles
   nh_private_ =
     ros::NodeHandle(ros::NodeHandle(nh_, PRIVATE_PREFIX), node_);
@@ -100,6 +216,12 @@ void FreeFlyerNodelet::Setup(ros::NodeHandle & nh, ros::NodeHandle & nh_mt) {
   pub_diagnostics_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>(
     TOPIC_DIAGNOSTICS, 5);
 
+  // Send heartbeats without faults with those of the other nodelets
+  if (heartbeat_batch_) {
+    batcher_ = HeartbeatBatcher::Get(nh_);
+    batcher_->Add(node_);
+  }
+
   // Setup a heartbeat timer for this node if auto start was requested
   if (autostart_hb_timer_) {
     // Don't autostart until nodelet finishes initialization function
@@ -133,6 +255,20 @@ void FreeFlyerNodelet::ReadConfig() {
     heartbeat_queue_size_ = 5;
   }
 
+  // Read in whether to report callback latencies, which is off by default
+  if (!param_config_.GetBool("callback_stats", &callback_stats_)) {
+    callback_stats_ = false;
+  }
+
+  // Read in whether to batch heartbeats, which is off by default
+  if (!param_config_.GetBool("heartbeat_batch", &heartbeat_batch_)) {
+    heartbeat_batch_ = false;
+  }
+
+  // Read in how to schedule the manager and threads, none by default
+  thread_policies_.clear();
+  ReadThreadPolicies(&param_config_, &thread_policies_);
+
   // Check if there is a fault table for this node, some nodes may not have
   // faults
   if (param_config_.CheckValExists(node_.c_str())) {
@@ -249,6 +385,36 @@ void FreeFlyerNodelet::HeartbeatCallback(ros::TimerEvent const& ev) {
   if (s > 1.0)
     ROS_INFO_STREAM(node_ << ": " << s);
   PublishHeartbeat();
+  if (monitor_)
+    PublishCallbackStats();
+}
+
+void FreeFlyerNodelet::PublishCallbackStats() {
+  // The latencies since the last heartbeat
+  std::vector<diagnostic_msgs::KeyValue> keyval, mt;
+  monitor_->Report(&keyval);
+  monitor_mt_->Report(&mt);
+  for (diagnostic_msgs::KeyValue & kv : mt) {
+    kv.key = "mt_" + kv.key;
+    keyval.push_back(kv);
+  }
+  {
+    // Kept to add to SendDiagnostics, which may be called on other threads
+    std::lock_guard<std::mutex> lock(callback_keys_mutex_);
+    callback_keys_ = keyval;
+  }
+
+  diagnostic_msgs::DiagnosticStatus ds;
+  ds.level = diagnostic_msgs::DiagnosticStatus::OK;
+  ds.message = "Callback latencies";
+  ds.name = node_ + "::callbacks";
+  if (!platform_.empty())
+    ds.name = platform_ + "::" + ds.name;
+  ds.values = keyval;
+  diagnostic_msgs::DiagnosticArray da;
+  da.header.stamp = ros::Time::now();
+  da.status.push_back(ds);
+  pub_diagnostics_.publish(da);
 }
 
 void FreeFlyerNodelet::InitCallback(ros::TimerEvent const& ev) {
@@ -315,7 +481,14 @@ bool FreeFlyerNodelet::TriggerCallback(
 void FreeFlyerNodelet::PublishHeartbeat() {
   if (initialized_) {
     heartbeat_.header.stamp = ros::Time::now();
-    pub_heartbeat_.publish(heartbeat_);
+    // Faults, and the heartbeat that clears them, are sent on their own so
+    // the system monitor hears of them at once
+    bool faulted = !heartbeat_.faults.empty();
+    if (batcher_ && !faulted && !heartbeat_faulted_)
+      batcher_->Update(heartbeat_);
+    else
+      pub_heartbeat_.publish(heartbeat_);
+    heartbeat_faulted_ = faulted;
   }
 }
 
@@ -334,6 +507,11 @@ void FreeFlyerNodelet::SendDiagnostics(
   if (!platform_.empty())
     ds.name = platform_ + "::" + ds.name;
   ds.values = keyval;
+  // Append the callback latencies, if they are timed
+  {
+    std::lock_guard<std::mutex> lock(callback_keys_mutex_);
+    ds.values.insert(ds.values.end(), callback_keys_.begin(), callback_keys_.end());
+  }
   // Append the faults to the KV
   for (unsigned int i = 0; i < heartbeat_.faults.size(); i++) {
     diagnostic_msgs::KeyValue fault;
@@ -375,5 +553,17 @@ std::string FreeFlyerNodelet::GetPlatform() {
   return platform_;
 }
 
+void FreeFlyerNodelet::ConfigureThread(std::string const& thread) {
+  std::string name = node_ + "/" + thread;
+  for (ThreadPolicy const& policy : thread_policies_) {
+    if (policy.name != name)
+      continue;
+    std::string error;
+    if (!ApplyThreadPolicy(policy, 0, &error))
+      FF_WARN("Thread " << name << " is not fully scheduled: " << error);
+  }
+  FF_INFO("Thread " << name << ": " << DescribeThread());
+}
+
 
 }  // namespace ff_util
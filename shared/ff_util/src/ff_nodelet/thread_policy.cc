@@ -0,0 +1,192 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ff_util/thread_policy.h>
+
+#include <ros/ros.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ff_util {
+
+namespace {
+
+bool ParsePolicy(std::string const& name, int* policy) {
+  if (name == "other")
+    *policy = SCHED_OTHER;
+  else if (name == "fifo")
+    *policy = SCHED_FIFO;
+  else if (name == "rr")
+    *policy = SCHED_RR;
+  else
+    return false;
+  return true;
+}
+
+char const* PolicyName(int policy) {
+  switch (policy) {
+  case SCHED_OTHER: return "SCHED_OTHER";
+  case SCHED_FIFO:  return "SCHED_FIFO";
+  case SCHED_RR:    return "SCHED_RR";
+  case SCHED_BATCH: return "SCHED_BATCH";
+  case SCHED_IDLE:  return "SCHED_IDLE";
+  default:          return "unknown";
+  }
+}
+
+}  // namespace
+
+bool ReadThreadPolicies(config_reader::ConfigReader* config,
+                        std::vector<ThreadPolicy>* policies) {
+  if (!config->CheckValExists("thread_policies"))
+    return false;
+  config_reader::ConfigReader::Table table(config, "thread_policies");
+  for (int i = 1; i < table.GetSize() + 1; i++) {
+    config_reader::ConfigReader::Table entry(&table, i);
+    ThreadPolicy policy;
+    if (!entry.GetStr("name", &policy.name)) {
+      ROS_WARN_STREAM("Thread policy " << i << " has no name.");
+      continue;
+    }
+    std::string name;
+    if (entry.GetStr("policy", &name) && !ParsePolicy(name, &policy.policy)) {
+      ROS_WARN_STREAM("Thread policy " << policy.name << " has an unknown policy " << name << ".");
+      continue;
+    }
+    if (entry.CheckValExists("cores")) {
+      config_reader::ConfigReader::Table cores(&entry, "cores");
+      for (int j = 1; j < cores.GetSize() + 1; j++) {
+        int core;
+        if (cores.GetInt(j, &core))
+          policy.cores.push_back(core);
+      }
+    }
+    entry.GetInt("priority", &policy.priority);
+    entry.GetInt("nice", &policy.nice);
+    if (policy.policy != SCHED_OTHER && (policy.priority < sched_get_priority_min(policy.policy) ||
+                                         policy.priority > sched_get_priority_max(policy.policy))) {
+      ROS_WARN_STREAM("Thread policy " << policy.name << " has an invalid priority " << policy.priority << ".");
+      continue;
+    }
+    policies->push_back(policy);
+  }
+  return true;
+}
+
+bool ApplyThreadPolicy(ThreadPolicy const& policy, pid_t tid, std::string* error) {
+  if (tid == 0)
+    tid = syscall(SYS_gettid);
+  std::ostringstream err;
+  if (!policy.cores.empty()) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int core : policy.cores) {
+      if (core >= 0 && core < CPU_SETSIZE)
+        CPU_SET(core, &cpus);
+      else
+        err << "no core " << core << "; ";
+    }
+    if (sched_setaffinity(tid, sizeof(cpus), &cpus))
+      err << "cores: " << strerror(errno) << "; ";
+  }
+  sched_param param;
+  param.sched_priority = (policy.policy == SCHED_OTHER ? 0 : policy.priority);
+  if (sched_setscheduler(tid, policy.policy, &param))
+    err << PolicyName(policy.policy) << ": " << strerror(errno) << "; ";
+  if (policy.policy == SCHED_OTHER && setpriority(PRIO_PROCESS, tid, policy.nice))
+    err << "nice: " << strerror(errno) << "; ";
+  if (error)
+    *error = err.str();
+  return err.str().empty();
+}
+
+bool ApplyProcessPolicy(ThreadPolicy const& policy, std::string* error) {
+  DIR* dir = opendir("/proc/self/task");
+  if (!dir) {
+    if (error)
+      *error = strerror(errno);
+    return false;
+  }
+  bool ok = true;
+  std::string err, errors;
+  while (dirent* task = readdir(dir)) {
+    pid_t tid = atoi(task->d_name);
+    if (tid <= 0)
+      continue;
+    if (!ApplyThreadPolicy(policy, tid, &err)) {
+      ok = false;
+      errors = err;
+    }
+  }
+  closedir(dir);
+  if (error)
+    *error = errors;
+  return ok;
+}
+
+std::string DescribeThread(pid_t tid) {
+  if (tid == 0)
+    tid = syscall(SYS_gettid);
+  std::ostringstream out;
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  out << "cores ";
+  if (sched_getaffinity(tid, sizeof(cpus), &cpus)) {
+    out << "unknown";
+  } else {
+    // As ranges, eg. 0-3,6
+    char const* separator = "";
+    for (int core = 0; core < CPU_SETSIZE; core++) {
+      if (!CPU_ISSET(core, &cpus))
+        continue;
+      int last = core;
+      while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &cpus))
+        last++;
+      out << separator << core;
+      if (last > core)
+        out << "-" << last;
+      separator = ",";
+      core = last;
+    }
+  }
+  int policy = sched_getscheduler(tid);
+  out << ", " << PolicyName(policy);
+  sched_param param;
+  if (policy == SCHED_FIFO || policy == SCHED_RR) {
+    if (!sched_getparam(tid, &param))
+      out << " " << param.sched_priority;
+  } else {
+    errno = 0;
+    int nice = getpriority(PRIO_PROCESS, tid);
+    if (!errno)
+      out << " nice " << nice;
+  }
+  return out.str();
+}
+
+}  // namespace ff_util
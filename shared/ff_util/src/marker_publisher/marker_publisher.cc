@@ -0,0 +1,111 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ff_util/marker_publisher.h>
+
+namespace ff_util {
+
+void MarkerPublisher::Initialize(ros::NodeHandle *nh, std::string const& topic, uint32_t queue_size) {
+  pub_ = nh->advertise<visualization_msgs::MarkerArray>(topic, queue_size,
+    boost::bind(&MarkerPublisher::Connect, this, _1));
+}
+
+bool MarkerPublisher::HasSubscribers() const {
+  return pub_.getNumSubscribers() > 0;
+}
+
+size_t MarkerPublisher::Publish(visualization_msgs::MarkerArray const& markers) {
+  visualization_msgs::MarkerArray msg;
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<Key, Sent> current;
+  for (size_t i = 0; i < markers.markers.size(); i++) {
+    visualization_msgs::Marker const& marker = markers.markers[i];
+    Key key(marker.ns, marker.id);
+    switch (marker.action) {
+    case visualization_msgs::Marker::ADD: {
+      // Markers that expire are not kept, so that they are always sent
+      if (!marker.lifetime.isZero()) {
+        msg.markers.push_back(marker);
+        continue;
+      }
+      Sent & sent = current[key];
+      sent.marker = marker;
+      Serialize(marker, &sent.data);
+      std::map<Key, Sent>::const_iterator it = sent_.find(key);
+      if (it == sent_.end() || it->second.data != sent.data)
+        msg.markers.push_back(marker);
+      break;
+    }
+    // Anything else is passed on, and what it removes is forgotten
+    case visualization_msgs::Marker::DELETE:
+      current.erase(key);
+      if (sent_.erase(key) > 0)
+        msg.markers.push_back(marker);
+      break;
+    default:
+      current.clear();
+      sent_.clear();
+      msg.markers.push_back(marker);
+      break;
+    }
+  }
+  // Delete the markers sent before that are not in this array
+  for (std::map<Key, Sent>::const_iterator it = sent_.begin(); it != sent_.end(); it++) {
+    if (current.find(it->first) != current.end())
+      continue;
+    visualization_msgs::Marker marker;
+    marker.header.frame_id = it->second.marker.header.frame_id;
+    marker.header.stamp = ros::Time::now();
+    marker.ns = it->first.first;
+    marker.id = it->first.second;
+    marker.action = visualization_msgs::Marker::DELETE;
+    msg.markers.push_back(marker);
+  }
+  sent_.swap(current);
+  if (!msg.markers.empty())
+    pub_.publish(msg);
+  return msg.markers.size();
+}
+
+void MarkerPublisher::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sent_.clear();
+}
+
+// Bring a new subscriber up to date, without sending anything to the others
+void MarkerPublisher::Connect(ros::SingleSubscriberPublisher const& pub) {
+  visualization_msgs::MarkerArray msg;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::map<Key, Sent>::const_iterator it = sent_.begin(); it != sent_.end(); it++)
+      msg.markers.push_back(it->second.marker);
+  }
+  if (!msg.markers.empty())
+    pub.publish(msg);
+}
+
+void MarkerPublisher::Serialize(visualization_msgs::Marker const& marker, std::vector<uint8_t> *data) {
+  visualization_msgs::Marker copy = marker;
+  copy.header.stamp = ros::Time();
+  copy.header.seq = 0;
+  data->resize(ros::serialization::serializationLength(copy));
+  ros::serialization::OStream stream(data->data(), data->size());
+  ros::serialization::serialize(stream, copy);
+}
+
+}  // namespace ff_util
@@ -0,0 +1,285 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ff_util/metrics.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace ff_util {
+
+namespace {
+
+char const kPrefix[] = "ff_metrics.";
+
+// Called at exit, so that the segment of a process does not outlive it
+void Unlink() {
+  std::string const& name = MetricsRegistry::Instance().Name();
+  if (!name.empty())
+    shm_unlink(name.c_str());
+}
+
+}  // namespace
+
+uint64_t MetricsNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+namespace metrics {
+
+uint32_t Bucket(uint64_t value) {
+  if (value < (1u << kSubBits))
+    return static_cast<uint32_t>(value);
+  uint32_t e = 63 - __builtin_clzll(value);
+  return ((e - kSubBits + 1) << kSubBits)
+    + static_cast<uint32_t>((value >> (e - kSubBits)) & ((1u << kSubBits) - 1));
+}
+
+uint64_t BucketMin(uint32_t bucket) {
+  if (bucket < (1u << kSubBits))
+    return bucket;
+  uint32_t e = (bucket >> kSubBits) + kSubBits - 1;
+  uint64_t sub = bucket & ((1u << kSubBits) - 1);
+  return ((1ull << kSubBits) + sub) << (e - kSubBits);
+}
+
+}  // namespace metrics
+
+void MetricHistogram::Record(uint64_t value) {
+  if (!slot_) return;
+  slot_->count.fetch_add(1, std::memory_order_relaxed);
+  slot_->sum.fetch_add(value, std::memory_order_relaxed);
+  slot_->buckets[metrics::Bucket(value)].fetch_add(1, std::memory_order_relaxed);
+  uint64_t min = slot_->min.load(std::memory_order_relaxed);
+  while (value < min && !slot_->min.compare_exchange_weak(min, value,
+    std::memory_order_relaxed)) {}
+  uint64_t max = slot_->max.load(std::memory_order_relaxed);
+  while (value > max && !slot_->max.compare_exchange_weak(max, value,
+    std::memory_order_relaxed)) {}
+}
+
+void MetricTrace::Emit(uint32_t id, int64_t age) {
+  if (!slot_) return;
+  if (age >= 0)
+    MetricHistogram(slot_).Record(age);
+  uint64_t n = segment_->events_next.fetch_add(1, std::memory_order_relaxed);
+  metrics::Event & event = segment_->events[n % metrics::kEvents];
+  event.seq.store(2 * n + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  event.time.store(MetricsNow(), std::memory_order_relaxed);
+  event.age.store(age, std::memory_order_relaxed);
+  event.id.store(id, std::memory_order_relaxed);
+  event.stage.store(slot_ - segment_->slots, std::memory_order_relaxed);
+  event.seq.store(2 * n + 2, std::memory_order_release);
+}
+
+bool MetricTrace::EmitOnce(uint32_t id, int64_t age) {
+  if (id == 0 || id == last_) return false;
+  last_ = id;
+  Emit(id, age);
+  return true;
+}
+
+MetricsRegistry & MetricsRegistry::Instance() {
+  // Never destroyed, so that handles held by static objects stay valid
+  static MetricsRegistry *registry = new MetricsRegistry();
+  return *registry;
+}
+
+MetricsRegistry::MetricsRegistry() : segment_(nullptr) {
+  std::string name = std::string("/") + kPrefix + std::to_string(getpid());
+  int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Could not create metrics segment %s\n", name.c_str());
+    return;
+  }
+  void *addr = MAP_FAILED;
+  if (ftruncate(fd, sizeof(metrics::Segment)) == 0)
+    addr = mmap(nullptr, sizeof(metrics::Segment), PROT_READ | PROT_WRITE,
+      MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    fprintf(stderr, "Could not map metrics segment %s\n", name.c_str());
+    shm_unlink(name.c_str());
+    return;
+  }
+  // The new segment is zeroed, so only the header needs writing
+  segment_ = static_cast<metrics::Segment*>(addr);
+  segment_->pid = getpid();
+  std::ifstream comm("/proc/self/comm");
+  std::string process;
+  std::getline(comm, process);
+  strncpy(segment_->process, process.c_str(), metrics::kNameLength - 1);
+  name_ = name;
+  std::atomic_thread_fence(std::memory_order_release);
+  segment_->magic = metrics::kMagic;
+  atexit(Unlink);
+}
+
+metrics::Slot* MetricsRegistry::Register(std::string const& name,
+  metrics::Type type) {
+  if (!segment_) return nullptr;
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint32_t used = segment_->used.load(std::memory_order_relaxed);
+  for (uint32_t i = 0; i < used; i++) {
+    metrics::Slot & slot = segment_->slots[i];
+    if (name.compare(0, metrics::kNameLength - 1, slot.name) == 0)
+      return (slot.type == type ? &slot : nullptr);
+  }
+  if (used == metrics::kCapacity) {
+    fprintf(stderr, "No room for metric %s\n", name.c_str());
+    return nullptr;
+  }
+  metrics::Slot & slot = segment_->slots[used];
+  strncpy(slot.name, name.c_str(), metrics::kNameLength - 1);
+  slot.type = type;
+  slot.min.store(UINT64_MAX, std::memory_order_relaxed);
+  slot.ready.store(1, std::memory_order_release);
+  segment_->used.store(used + 1, std::memory_order_release);
+  return &slot;
+}
+
+MetricCounter MetricsRegistry::Counter(std::string const& name) {
+  return MetricCounter(Register(name, metrics::COUNTER));
+}
+
+MetricGauge MetricsRegistry::Gauge(std::string const& name) {
+  return MetricGauge(Register(name, metrics::GAUGE));
+}
+
+MetricHistogram MetricsRegistry::Histogram(std::string const& name) {
+  return MetricHistogram(Register(name, metrics::HISTOGRAM));
+}
+
+MetricTrace MetricsRegistry::Trace(std::string const& name) {
+  return MetricTrace(Register(name, metrics::TRACE), segment_);
+}
+
+double MetricSnapshot::Percentile(double p) const {
+  // The buckets are not read at the same instant as the count
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < buckets.size(); i++)
+    total += buckets[i];
+  if (total == 0) return 0.0;
+  uint64_t rank = std::min(total - 1, static_cast<uint64_t>(p * total));
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < buckets.size(); i++) {
+    seen += buckets[i];
+    if (seen > rank) {
+      // The middle of the bucket, but never outside what was recorded
+      double lo = metrics::BucketMin(i);
+      double hi = (i + 1 < metrics::kBuckets ? metrics::BucketMin(i + 1) : lo);
+      double v = 0.5 * (lo + hi);
+      return std::max(static_cast<double>(min), std::min(static_cast<double>(max), v));
+    }
+  }
+  return static_cast<double>(max);
+}
+
+std::vector<std::string> ListMetricsSegments() {
+  std::vector<std::string> names;
+  DIR *dir = opendir("/dev/shm");
+  if (!dir) return names;
+  for (struct dirent *entry = readdir(dir); entry; entry = readdir(dir))
+    if (strncmp(entry->d_name, kPrefix, sizeof(kPrefix) - 1) == 0)
+      names.push_back(std::string("/") + entry->d_name);
+  closedir(dir);
+  return names;
+}
+
+bool ReadMetricsSegment(std::string const& name, uint32_t *pid,
+  std::string *process, std::vector<MetricSnapshot> *metrics,
+  std::vector<TraceSnapshot> *events) {
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) return false;
+  struct stat st;
+  void *addr = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(metrics::Segment)))
+    addr = mmap(nullptr, sizeof(metrics::Segment), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return false;
+  metrics::Segment const* segment = static_cast<metrics::Segment const*>(addr);
+  bool valid = (segment->magic == metrics::kMagic);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (valid) {
+    *pid = segment->pid;
+    *process = std::string(segment->process, strnlen(segment->process, metrics::kNameLength));
+    metrics->clear();
+    uint32_t used = segment->used.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < used && i < metrics::kCapacity; i++) {
+      metrics::Slot const& slot = segment->slots[i];
+      if (!slot.ready.load(std::memory_order_acquire))
+        continue;
+      MetricSnapshot m;
+      m.name = std::string(slot.name, strnlen(slot.name, metrics::kNameLength));
+      m.type = static_cast<metrics::Type>(slot.type);
+      m.count = slot.count.load(std::memory_order_relaxed);
+      m.value = slot.value.load(std::memory_order_relaxed);
+      m.sum = slot.sum.load(std::memory_order_relaxed);
+      m.min = slot.min.load(std::memory_order_relaxed);
+      m.max = slot.max.load(std::memory_order_relaxed);
+      if (m.type == metrics::HISTOGRAM || m.type == metrics::TRACE) {
+        // Trailing empty buckets are left out
+        m.buckets.resize(metrics::kBuckets);
+        for (uint32_t b = 0; b < metrics::kBuckets; b++)
+          m.buckets[b] = slot.buckets[b].load(std::memory_order_relaxed);
+        while (!m.buckets.empty() && m.buckets.back() == 0)
+          m.buckets.pop_back();
+      }
+      metrics->push_back(m);
+    }
+  }
+  if (valid && events) {
+    events->clear();
+    uint64_t next = segment->events_next.load(std::memory_order_acquire);
+    uint64_t n = std::max<uint64_t>(next, metrics::kEvents) - metrics::kEvents;
+    for (; n < next; n++) {
+      metrics::Event const& event = segment->events[n % metrics::kEvents];
+      if (event.seq.load(std::memory_order_acquire) != 2 * n + 2)
+        continue;
+      TraceSnapshot e;
+      e.time = event.time.load(std::memory_order_relaxed);
+      e.age = event.age.load(std::memory_order_relaxed);
+      e.id = event.id.load(std::memory_order_relaxed);
+      uint32_t stage = event.stage.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      // Skip events written over while they were read
+      if (event.seq.load(std::memory_order_relaxed) != 2 * n + 2 || stage >= metrics::kCapacity)
+        continue;
+      metrics::Slot const& slot = segment->slots[stage];
+      e.stage = std::string(slot.name, strnlen(slot.name, metrics::kNameLength));
+      events->push_back(e);
+    }
+  }
+  munmap(addr, sizeof(metrics::Segment));
+  return valid;
+}
+
+}  // namespace ff_util
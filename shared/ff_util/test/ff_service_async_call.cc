@@ -0,0 +1,145 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Required for the test framework
+#include <gtest/gtest.h>
+
+// Required for the test cases
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+
+// Service interface
+#include <ff_util/ff_service.h>
+#include <ff_msgs/SetBool.h>
+
+// C++11 incliudes
+#include <functional>
+#include <memory>
+
+// SERVER CALLBACKS
+
+// Takes longer to answer when asked to disable, and runs on its own queue and
+// thread so that it does not hold up the client
+class Server {
+ public:
+  Server() : spinner_(1, &queue_) {}
+
+  void Initialize(ros::NodeHandle *nh) {
+    nh_ = *nh;
+    nh_.setCallbackQueue(&queue_);
+    service_ = nh_.advertiseService("set_bool", &Server::ServiceCallback, this);
+    spinner_.start();
+  }
+
+ protected:
+  bool ServiceCallback(ff_msgs::SetBool::Request &req, ff_msgs::SetBool::Response &res) {
+    ROS_INFO("S:ServiceCallback()");
+    if (!req.enable)
+      ros::Duration(1.0).sleep();
+    res.success = req.enable;
+    return true;
+  }
+
+ private:
+  ros::NodeHandle nh_;
+  ros::CallbackQueue queue_;
+  ros::AsyncSpinner spinner_;
+  ros::ServiceServer service_;
+};
+
+// CLIENT CALLBACKS
+
+// Makes a slow call that runs past its deadline, and then a fast one, while
+// checking that its timer keeps firing during the slow call
+class Client {
+ public:
+  Client() : ticks_(0), slow_(false) {}
+
+  void Initialize(ros::NodeHandle *nh) {
+    service_.SetConnectedCallback(std::bind(&Client::ConnectedCallback, this));
+    service_.SetTimeoutCallback(std::bind(&Client::TimeoutCallback, this));
+    service_.SetConnectedTimeout(2.0);
+    service_.Create(nh, "set_bool");
+    timer_ = nh->createTimer(ros::Duration(0.05), &Client::TimerCallback, this, false, false);
+  }
+
+ protected:
+  void ConnectedCallback() {
+    ROS_INFO("C:ConnectedCallback()");
+    ff_msgs::SetBool srv;
+    srv.request.enable = false;
+    slow_ = true;
+    timer_.start();
+    EXPECT_TRUE(service_.CallAsync(srv, std::bind(&Client::SlowCallback, this,
+      std::placeholders::_1, std::placeholders::_2), 0.5));
+  }
+
+  void TimeoutCallback() {
+    ROS_INFO("C:TimeoutCallback()");
+    EXPECT_TRUE(false);
+    ros::shutdown();
+  }
+
+  void TimerCallback(ros::TimerEvent const& event) {
+    if (slow_)
+      ticks_++;
+  }
+
+  void SlowCallback(bool success, ff_msgs::SetBool const& srv) {
+    ROS_INFO("C:SlowCallback()");
+    slow_ = false;
+    EXPECT_FALSE(success);
+    EXPECT_FALSE(srv.request.enable);
+    // The queue of the client kept spinning while the call was in progress
+    EXPECT_GT(ticks_, 5);
+    ff_msgs::SetBool fast;
+    fast.request.enable = true;
+    EXPECT_TRUE(service_.CallAsync(fast, std::bind(&Client::FastCallback, this,
+      std::placeholders::_1, std::placeholders::_2), 5.0));
+  }
+
+  void FastCallback(bool success, ff_msgs::SetBool const& srv) {
+    ROS_INFO("C:FastCallback()");
+    EXPECT_TRUE(success);
+    EXPECT_TRUE(srv.response.success);
+    ros::shutdown();
+  }
+
+ private:
+  ff_util::FreeFlyerServiceClient < ff_msgs::SetBool > service_;
+  ros::Timer timer_;
+  size_t ticks_;
+  bool slow_;
+};
+
+// Perform a test of the asynchronous service call
+TEST(ff_service, async_call) {
+  Server server;
+  Client client;
+  ros::NodeHandle nh("~");
+  server.Initialize(&nh);
+  client.Initialize(&nh);
+  ros::spin();
+}
+
+// Required for the test framework
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "ff_service_async_call");
+  return RUN_ALL_TESTS();
+}
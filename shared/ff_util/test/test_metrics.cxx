@@ -0,0 +1,125 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ff_util/metrics.h>
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+TEST(Metrics, Buckets) {
+  // Every value is at least the smallest value of its bucket, and less than
+  // that of the next, which is within 12.5% of it above 8
+  uint64_t values[] = {0, 1, 7, 8, 9, 15, 16, 100, 1000, 123456789, UINT64_MAX};
+  for (uint64_t v : values) {
+    uint32_t b = ff_util::metrics::Bucket(v);
+    ASSERT_LT(b, ff_util::metrics::kBuckets);
+    EXPECT_LE(ff_util::metrics::BucketMin(b), v);
+    if (b + 1 < ff_util::metrics::kBuckets) {
+      EXPECT_GT(ff_util::metrics::BucketMin(b + 1), v);
+    }
+  }
+  for (uint32_t b = 0; b + 1 < ff_util::metrics::kBuckets; b++)
+    EXPECT_EQ(b, ff_util::metrics::Bucket(ff_util::metrics::BucketMin(b)));
+}
+
+TEST(Metrics, Segment) {
+  ff_util::MetricsRegistry & registry = ff_util::MetricsRegistry::Instance();
+  ASSERT_FALSE(registry.Name().empty());
+  ff_util::MetricCounter counter = registry.Counter("test_counter");
+  ff_util::MetricGauge gauge = registry.Gauge("test_gauge");
+  ff_util::MetricHistogram histogram = registry.Histogram("test_histogram");
+  // Registering again gives the same metric, and a clash of types none
+  registry.Counter("test_counter").Add(2);
+  registry.Histogram("test_counter").Record(1);
+  gauge.Set(-5);
+  // Several threads record at once into the same metrics
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++)
+    threads.push_back(std::thread([&counter, &histogram]() {
+      for (uint64_t i = 1; i <= 1000; i++) {
+        counter.Add();
+        histogram.Record(i * 1000);
+      }
+    }));
+  for (std::thread & thread : threads)
+    thread.join();
+  {
+    ff_util::MetricTimer timer(registry.Histogram("test_timer"));
+  }
+  // Read the segment back, as the collector does
+  std::vector<std::string> names = ff_util::ListMetricsSegments();
+  ASSERT_NE(std::find(names.begin(), names.end(), registry.Name()), names.end());
+  uint32_t pid;
+  std::string process;
+  std::vector<ff_util::MetricSnapshot> metrics;
+  ASSERT_TRUE(ff_util::ReadMetricsSegment(registry.Name(), &pid, &process, &metrics));
+  EXPECT_EQ(static_cast<uint32_t>(getpid()), pid);
+  ASSERT_EQ(4u, metrics.size());
+  EXPECT_EQ("test_counter", metrics[0].name);
+  EXPECT_EQ(4002u, metrics[0].count);
+  EXPECT_EQ(-5, metrics[1].value);
+  ff_util::MetricSnapshot const& h = metrics[2];
+  EXPECT_EQ(ff_util::metrics::HISTOGRAM, h.type);
+  EXPECT_EQ(4000u, h.count);
+  EXPECT_EQ(1000u, h.min);
+  EXPECT_EQ(1000000u, h.max);
+  EXPECT_EQ(4u * 500500000u, h.sum);
+  EXPECT_NEAR(500000, h.Percentile(0.5), 500000 * 0.125);
+  EXPECT_NEAR(990000, h.Percentile(0.99), 990000 * 0.125);
+  EXPECT_EQ(1u, metrics[3].count);
+}
+
+TEST(Metrics, Trace) {
+  ff_util::MetricsRegistry & registry = ff_util::MetricsRegistry::Instance();
+  ff_util::MetricTrace camera = registry.Trace("test_camera");
+  ff_util::MetricTrace control = registry.Trace("test_control");
+  // Wrap the ring once, so only the newest events are left
+  for (uint32_t id = 1; id <= ff_util::metrics::kEvents; id++) {
+    camera.Emit(id, 0);
+    EXPECT_TRUE(control.EmitOnce(id, 1000 * id));
+    EXPECT_FALSE(control.EmitOnce(id, 1000 * id));
+  }
+  uint32_t pid;
+  std::string process;
+  std::vector<ff_util::MetricSnapshot> metrics;
+  std::vector<ff_util::TraceSnapshot> events;
+  ASSERT_TRUE(ff_util::ReadMetricsSegment(registry.Name(), &pid, &process, &metrics, &events));
+  ASSERT_EQ(ff_util::metrics::kEvents, events.size());
+  uint32_t first = ff_util::metrics::kEvents / 2 + 1;
+  EXPECT_EQ(first, events.front().id);
+  EXPECT_EQ("test_camera", events.front().stage);
+  EXPECT_EQ(ff_util::metrics::kEvents, events.back().id);
+  EXPECT_EQ("test_control", events.back().stage);
+  EXPECT_EQ(1000 * ff_util::metrics::kEvents, events.back().age);
+  for (size_t i = 1; i < events.size(); i++)
+    EXPECT_LE(events[i - 1].time, events[i].time);
+  // The ages of the events of a stage are in its histogram
+  for (ff_util::MetricSnapshot const& m : metrics) {
+    if (m.name != "test_control")
+      continue;
+    EXPECT_EQ(ff_util::metrics::TRACE, m.type);
+    EXPECT_EQ(ff_util::metrics::kEvents, m.count);
+    EXPECT_EQ(1000u * ff_util::metrics::kEvents, m.max);
+  }
+}
@@ -0,0 +1,109 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Reads the metrics segment of every process on this machine, and publishes
+// all their metrics as one diagnostic array at a low rate. Segments left by
+// processes that are gone are removed.
+
+#include <common/init.h>
+#include <ff_util/ff_names.h>
+#include <ff_util/metrics.h>
+#include <gflags/gflags.h>
+
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <ros/ros.h>
+
+#include <signal.h>
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <string>
+#include <vector>
+
+DEFINE_double(rate, 0.5, "Rate at which to publish the metrics, in Hz.");
+DEFINE_string(topic, TOPIC_DIAGNOSTICS, "The topic to publish the metrics on.");
+
+namespace {
+
+void Add(diagnostic_msgs::DiagnosticStatus *status, std::string const& key,
+  double value) {
+  diagnostic_msgs::KeyValue kv;
+  kv.key = key;
+  kv.value = std::to_string(value);
+  status->values.push_back(kv);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  common::InitFreeFlyerApplication(&argc, &argv);
+  ros::init(argc, argv, "metrics_collector");
+
+  ros::NodeHandle nh;
+  ros::Publisher pub = nh.advertise<diagnostic_msgs::DiagnosticArray>(FLAGS_topic, 5);
+  std::vector<ff_util::MetricSnapshot> metrics;
+  ros::Rate rate(FLAGS_rate);
+  while (ros::ok()) {
+    diagnostic_msgs::DiagnosticArray msg;
+    msg.header.stamp = ros::Time::now();
+    std::vector<std::string> names = ff_util::ListMetricsSegments();
+    for (size_t i = 0; i < names.size(); i++) {
+      uint32_t pid;
+      std::string process;
+      if (!ff_util::ReadMetricsSegment(names[i], &pid, &process, &metrics))
+        continue;
+      if (kill(pid, 0) != 0 && errno == ESRCH) {
+        ROS_INFO_STREAM("Removing metrics of exited process " << pid);
+        shm_unlink(names[i].c_str());
+        continue;
+      }
+      diagnostic_msgs::DiagnosticStatus status;
+      status.level = diagnostic_msgs::DiagnosticStatus::OK;
+      status.name = process + "::metrics";
+      status.hardware_id = std::to_string(pid);
+      for (size_t j = 0; j < metrics.size(); j++) {
+        ff_util::MetricSnapshot const& m = metrics[j];
+        switch (m.type) {
+        case ff_util::metrics::COUNTER:
+          Add(&status, m.name, m.count);
+          break;
+        case ff_util::metrics::GAUGE:
+          Add(&status, m.name, m.value);
+          break;
+        case ff_util::metrics::HISTOGRAM:
+        case ff_util::metrics::TRACE:
+          // Histograms hold nanoseconds, and are sent in microseconds. Those
+          // of trace stages hold the ages of the samples.
+          Add(&status, m.name + "_count", m.count);
+          if (m.count == 0)
+            break;
+          Add(&status, m.name + "_mean_us", 1e-3 * m.sum / m.count);
+          Add(&status, m.name + "_p50_us", 1e-3 * m.Percentile(0.50));
+          Add(&status, m.name + "_p99_us", 1e-3 * m.Percentile(0.99));
+          Add(&status, m.name + "_max_us", 1e-3 * m.max);
+          break;
+        }
+      }
+      msg.status.push_back(status);
+    }
+    if (!msg.status.empty())
+      pub.publish(msg);
+    rate.sleep();
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Writes the trace events in the metrics segments of every process on this
+// machine as a JSON trace, which Perfetto and chrome://tracing open. Events
+// of the same sample id are joined by a flow, from its first stage to its
+// last, so the time between the stages a camera frame passes through shows.
+
+#include <common/init.h>
+#include <ff_util/metrics.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+DEFINE_string(output, "trace.json", "The file to write the trace to.");
+
+namespace {
+
+struct Event {
+  ff_util::TraceSnapshot event;
+  uint32_t pid;
+  uint32_t tid;
+  bool operator<(Event const& other) const { return event.time < other.event.time; }
+};
+
+// Starts an event, leaving it open for the fields that depend on its type
+void Write(FILE *f, std::string const& name, Event const& e, char const* ph, bool first) {
+  fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"trace\",\"ph\":\"%s\",\"ts\":%.3f,"
+    "\"pid\":%u,\"tid\":%u", first ? "" : ",\n", name.c_str(), ph,
+    1e-3 * e.event.time, e.pid, e.tid);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  common::InitFreeFlyerApplication(&argc, &argv);
+
+  std::vector<Event> events;
+  std::vector<std::string> names = ff_util::ListMetricsSegments();
+  std::map<uint32_t, std::string> processes;
+  for (size_t i = 0; i < names.size(); i++) {
+    uint32_t pid;
+    std::string process;
+    std::vector<ff_util::MetricSnapshot> metrics;
+    std::vector<ff_util::TraceSnapshot> trace;
+    if (!ff_util::ReadMetricsSegment(names[i], &pid, &process, &metrics, &trace))
+      continue;
+    processes[pid] = process;
+    // One thread of the trace for each stage
+    std::map<std::string, uint32_t> stages;
+    for (size_t j = 0; j < trace.size(); j++) {
+      Event e;
+      e.event = trace[j];
+      e.pid = pid;
+      e.tid = stages.insert(std::make_pair(trace[j].stage, stages.size() + 1)).first->second;
+      events.push_back(e);
+    }
+  }
+  if (events.empty())
+    LOG(FATAL) << "No trace events found.";
+  std::sort(events.begin(), events.end());
+
+  FILE *f = fopen(FLAGS_output.c_str(), "w");
+  if (!f)
+    LOG(FATAL) << "Could not open " << FLAGS_output << ".";
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  bool first = true;
+  std::map<uint32_t, std::string>::const_iterator it;
+  for (it = processes.begin(); it != processes.end(); it++) {
+    fprintf(f, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,"
+      "\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", it->first, it->second.c_str());
+    first = false;
+  }
+  // The last event of each id ends its flow
+  std::map<uint32_t, size_t> last;
+  for (size_t i = 0; i < events.size(); i++)
+    last[events[i].event.id] = i;
+  std::map<uint32_t, bool> started;
+  for (size_t i = 0; i < events.size(); i++) {
+    Event const& e = events[i];
+    Write(f, e.event.stage, e, "X", first);
+    first = false;
+    fprintf(f, ",\"dur\":1,\"args\":{\"id\":%u", e.event.id);
+    if (e.event.age >= 0)
+      fprintf(f, ",\"age_ms\":%.3f", 1e-6 * e.event.age);
+    fprintf(f, "}}");
+    if (e.event.id == 0)
+      continue;
+    char const* ph = "t";
+    if (!started[e.event.id])
+      ph = "s";
+    else if (last[e.event.id] == i)
+      ph = "f";
+    if (last[e.event.id] == i && !started[e.event.id])
+      continue;
+    started[e.event.id] = true;
+    Write(f, "sample", e, ph, false);
+    fprintf(f, ",\"id\":%u,\"bp\":\"e\"}", e.event.id);
+  }
+  fprintf(f, "\n]}\n");
+  fclose(f);
+  printf("Wrote %zu events from %zu processes to %s\n", events.size(), processes.size(),
+    FLAGS_output.c_str());
+  return 0;
+}
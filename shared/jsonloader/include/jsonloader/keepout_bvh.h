@@ -0,0 +1,79 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef JSONLOADER_KEEPOUT_BVH_H_
+#define JSONLOADER_KEEPOUT_BVH_H_
+
+#include <jsonloader/keepout.h>
+
+#include <Eigen/Geometry>
+
+#include <vector>
+
+namespace jsonloader {
+
+// Bounding volume hierarchy over the boxes of keepin or keepout zones, so
+// that points and segments are tested against detailed zone files without
+// going through every box. Build it once when the zones change.
+class KeepoutBvh {
+ public:
+  using BoundingBox = Keepout::BoundingBox;
+  using Points = Eigen::Matrix3Xf;
+
+  KeepoutBvh();
+  // Boxes grown by margin on every side, or shrunk if it is negative
+  explicit KeepoutBvh(Keepout::Sequence const& boxes, float margin = 0.0f);
+
+  void Build(Keepout::Sequence const& boxes, float margin = 0.0f);
+  void Clear();
+  bool Empty() const;
+
+  // Is the point in or on any box
+  bool Contains(Eigen::Vector3f const& point) const;
+
+  // The same for each column of points, going down the hierarchy once
+  // with all of them
+  void Contains(Points const& points, std::vector<bool> *inside) const;
+
+  // Does the segment from a to b touch any box. If so, t is the fraction
+  // of the segment where it first does.
+  bool Intersects(Eigen::Vector3f const& a, Eigen::Vector3f const& b,
+                  float *t = nullptr) const;
+
+  // Is every point of the segment from a to b in or on some box
+  bool Covers(Eigen::Vector3f const& a, Eigen::Vector3f const& b) const;
+
+ private:
+  struct Node {
+    BoundingBox box;
+    int left, right;    // children, -1 for a leaf
+    int first, count;   // boxes of a leaf
+  };
+
+  int BuildNode(int first, int count);
+  void ContainsNode(int node, Points const& points,
+                    std::vector<int> const& candidates,
+                    std::vector<bool> *inside) const;
+
+  std::vector<BoundingBox> boxes_;
+  std::vector<Node> nodes_;
+};
+
+}  // end namespace jsonloader
+
+#endif  // JSONLOADER_KEEPOUT_BVH_H_
@@ -48,6 +48,9 @@ class Station : public Milestone {
   using CommandSeq = std::vector<CommandPtr>;
 
   explicit Station(Json::Value const& obj);
+  // The commands are given as the text of each, and only parsed when they
+  // are first asked for. The sequence of obj is not read.
+  Station(Json::Value const& obj, std::vector<std::string> && commands);
   Station(Station && other);  // move constructor
 
   virtual bool IsSegment() const noexcept { return false; };
@@ -61,9 +64,16 @@ class Station : public Milestone {
   Eigen::Vector3f const& position() const noexcept;
   Eigen::Vector3f const& orientation() const noexcept;
 
+  // Parses the commands not parsed yet, which are null if invalid.
   CommandSeq const& commands() const noexcept;
 
+  // Parses the command if it is not parsed yet. Returns null if invalid.
+  std::size_t NumCommands() const noexcept;
+  Command const* GetCommand(std::size_t index) const noexcept;
+
  private:
+  bool ParseCommand(std::size_t index) const noexcept;
+
   bool valid_;
 
   float tolerance_;
@@ -73,7 +83,9 @@ class Station : public Milestone {
   Eigen::Vector3f position_;  // position as x,y,z
   Eigen::Vector3f orientation_;  // orientation as r,p,y
 
-  CommandSeq commands_;
+  // the text of the commands that are not parsed yet, not thread safe
+  mutable std::vector<std::string> command_data_;
+  mutable CommandSeq commands_;
 };
 
 // Decouple from ros::Time
@@ -172,6 +184,11 @@ class Plan {
   std::string const& waypoint_type() const noexcept;
 
  private:
+  friend Plan LoadPlan(std::string const& data, bool lazy_commands);
+
+  bool AddStation(Station && s, int i);
+  bool AddSegment(Segment const& s, int i);
+
   bool valid_;
 
   std::string name_;
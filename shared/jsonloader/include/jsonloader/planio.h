@@ -33,6 +33,12 @@ namespace jsonloader {
 
 Plan LoadPlan(std::string const& data);
 
+// With lazy_commands, only the skeleton of the plan is parsed as it is
+// loaded: its fields, stations and segments. The text of each command is
+// kept in its station, and parsed when the command is first asked for, so
+// an invalid command does not make the plan invalid here.
+Plan LoadPlan(std::string const& data, bool lazy_commands);
+
 bool LoadData(std::string const& data, Json::Value *json);
 
 }  // end namespace jsonloader
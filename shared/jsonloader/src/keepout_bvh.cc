@@ -0,0 +1,231 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <jsonloader/keepout_bvh.h>
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr int kLeafSize = 4;
+
+// The part of the segment a + t d, t in [0, 1], inside the box, by slabs
+bool SegmentInBox(Eigen::Vector3f const& a, Eigen::Vector3f const& d,
+                  jsonloader::KeepoutBvh::BoundingBox const& box,
+                  float *t0, float *t1) {
+  *t0 = 0.0f;
+  *t1 = 1.0f;
+  for (int i = 0; i < 3; i++) {
+    if (std::abs(d[i]) < std::numeric_limits<float>::epsilon()) {
+      if (a[i] < box.min()[i] || a[i] > box.max()[i])
+        return false;
+      continue;
+    }
+    float near = (box.min()[i] - a[i]) / d[i];
+    float far = (box.max()[i] - a[i]) / d[i];
+    if (near > far)
+      std::swap(near, far);
+    *t0 = std::max(*t0, near);
+    *t1 = std::min(*t1, far);
+    if (*t0 > *t1)
+      return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+jsonloader::KeepoutBvh::KeepoutBvh()
+{ }
+
+jsonloader::KeepoutBvh::KeepoutBvh(Keepout::Sequence const& boxes,
+                                   float margin) {
+  Build(boxes, margin);
+}
+
+void jsonloader::KeepoutBvh::Build(Keepout::Sequence const& boxes,
+                                   float margin) {
+  Clear();
+  for (BoundingBox const& box : boxes) {
+    BoundingBox grown(box.min() - Eigen::Vector3f::Constant(margin),
+                      box.max() + Eigen::Vector3f::Constant(margin));
+    if (!grown.isEmpty())
+      boxes_.push_back(grown);
+  }
+  if (!boxes_.empty())
+    BuildNode(0, boxes_.size());
+}
+
+void jsonloader::KeepoutBvh::Clear() {
+  boxes_.clear();
+  nodes_.clear();
+}
+
+bool jsonloader::KeepoutBvh::Empty() const {
+  return nodes_.empty();
+}
+
+int jsonloader::KeepoutBvh::BuildNode(int first, int count) {
+  int index = nodes_.size();
+  nodes_.push_back(Node());
+  BoundingBox box;
+  for (int i = first; i < first + count; i++)
+    box.extend(boxes_[i]);
+  nodes_[index].box = box;
+  nodes_[index].first = first;
+  nodes_[index].count = count;
+  nodes_[index].left = nodes_[index].right = -1;
+  if (count <= kLeafSize)
+    return index;
+
+  // split at the median center along the longest side
+  int axis;
+  box.sizes().maxCoeff(&axis);
+  std::nth_element(boxes_.begin() + first, boxes_.begin() + first + count / 2,
+                   boxes_.begin() + first + count,
+                   [axis](BoundingBox const& p, BoundingBox const& q) {
+                     return p.center()[axis] < q.center()[axis];
+                   });
+  int left = BuildNode(first, count / 2);
+  int right = BuildNode(first + count / 2, count - count / 2);
+  nodes_[index].left = left;
+  nodes_[index].right = right;
+  return index;
+}
+
+bool jsonloader::KeepoutBvh::Contains(Eigen::Vector3f const& point) const {
+  if (nodes_.empty())
+    return false;
+  std::vector<int> stack(1, 0);
+  while (!stack.empty()) {
+    Node const& node = nodes_[stack.back()];
+    stack.pop_back();
+    if (!node.box.contains(point))
+      continue;
+    if (node.left < 0) {
+      for (int i = node.first; i < node.first + node.count; i++)
+        if (boxes_[i].contains(point))
+          return true;
+    } else {
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+    }
+  }
+  return false;
+}
+
+void jsonloader::KeepoutBvh::Contains(Points const& points,
+                                      std::vector<bool> *inside) const {
+  inside->assign(points.cols(), false);
+  if (nodes_.empty())
+    return;
+  std::vector<int> all(points.cols());
+  std::iota(all.begin(), all.end(), 0);
+  ContainsNode(0, points, all, inside);
+}
+
+void jsonloader::KeepoutBvh::ContainsNode(int index, Points const& points,
+                                          std::vector<int> const& candidates,
+                                          std::vector<bool> *inside) const {
+  // keep the points in this node that are not known to be inside yet
+  Node const& node = nodes_[index];
+  std::vector<int> in;
+  in.reserve(candidates.size());
+  for (int c : candidates)
+    if (!(*inside)[c] && node.box.contains(points.col(c)))
+      in.push_back(c);
+  if (in.empty())
+    return;
+  if (node.left < 0) {
+    for (int i = node.first; i < node.first + node.count; i++)
+      for (int c : in)
+        if (boxes_[i].contains(points.col(c)))
+          (*inside)[c] = true;
+    return;
+  }
+  ContainsNode(node.left, points, in, inside);
+  ContainsNode(node.right, points, in, inside);
+}
+
+bool jsonloader::KeepoutBvh::Intersects(Eigen::Vector3f const& a,
+                                        Eigen::Vector3f const& b,
+                                        float *t) const {
+  Eigen::Vector3f d = b - a;
+  float first = std::numeric_limits<float>::infinity();
+  std::vector<int> stack;
+  if (!nodes_.empty())
+    stack.push_back(0);
+  while (!stack.empty()) {
+    Node const& node = nodes_[stack.back()];
+    stack.pop_back();
+    float t0, t1;
+    // skip nodes entered after the first touch found so far
+    if (!SegmentInBox(a, d, node.box, &t0, &t1) || t0 >= first)
+      continue;
+    if (node.left < 0) {
+      for (int i = node.first; i < node.first + node.count; i++)
+        if (SegmentInBox(a, d, boxes_[i], &t0, &t1))
+          first = std::min(first, t0);
+    } else {
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+    }
+  }
+  if (first > 1.0f)
+    return false;
+  if (t)
+    *t = first;
+  return true;
+}
+
+bool jsonloader::KeepoutBvh::Covers(Eigen::Vector3f const& a,
+                                    Eigen::Vector3f const& b) const {
+  // the parts of the segment in each box, which must cover all of it
+  Eigen::Vector3f d = b - a;
+  std::vector<std::pair<float, float>> parts;
+  std::vector<int> stack;
+  if (!nodes_.empty())
+    stack.push_back(0);
+  while (!stack.empty()) {
+    Node const& node = nodes_[stack.back()];
+    stack.pop_back();
+    float t0, t1;
+    if (!SegmentInBox(a, d, node.box, &t0, &t1))
+      continue;
+    if (node.left < 0) {
+      for (int i = node.first; i < node.first + node.count; i++)
+        if (SegmentInBox(a, d, boxes_[i], &t0, &t1))
+          parts.push_back(std::make_pair(t0, t1));
+    } else {
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+    }
+  }
+  std::sort(parts.begin(), parts.end());
+  float covered = 0.0f;
+  for (auto const& part : parts) {
+    if (part.first > covered)
+      return false;
+    covered = std::max(covered, part.second);
+  }
+  return !parts.empty() && covered >= 1.0f;
+}
@@ -106,31 +106,11 @@ jsonloader::Plan::Plan(Json::Value const& obj)
   int i = 0;
   for (Json::Value const& v : obj["sequence"]) {
     if (i % 2 == 0) {  // Station
-      Station s(v);
-      if (!s.valid()) {
-        LOG(ERROR) << "invalid plan: invalid station " << i;
+      if (!AddStation(Station(v), i))
         return;
-      }
-
-      stations_.push_back(std::move(s));
     } else {  // Segment
-      Segment s(v);
-      if (!s.valid()) {
-        LOG(ERROR) << "invalid plan: invalid segment " << i;
-        return;
-      }
-
-      if (waypoint_type_ == "") {
-        waypoint_type_ = s.waypoint_type();
-      } else if (waypoint_type_ != s.waypoint_type()) {
-        LOG(ERROR) << "invalid plan: waypoint types inconsistent: "
-                   << "expected: " << waypoint_type_ << ", "
-                   << "actual: " << s.waypoint_type()
-                   << " (segment " << i << ")";
+      if (!AddSegment(Segment(v), i))
         return;
-      }
-
-      segments_.push_back(s);
     }
 
     i++;
@@ -139,6 +119,36 @@ jsonloader::Plan::Plan(Json::Value const& obj)
   valid_ = true;
 }
 
+bool jsonloader::Plan::AddStation(Station && s, int i) {
+  if (!s.valid()) {
+    LOG(ERROR) << "invalid plan: invalid station " << i;
+    return false;
+  }
+
+  stations_.push_back(std::move(s));
+  return true;
+}
+
+bool jsonloader::Plan::AddSegment(Segment const& s, int i) {
+  if (!s.valid()) {
+    LOG(ERROR) << "invalid plan: invalid segment " << i;
+    return false;
+  }
+
+  if (waypoint_type_ == "") {
+    waypoint_type_ = s.waypoint_type();
+  } else if (waypoint_type_ != s.waypoint_type()) {
+    LOG(ERROR) << "invalid plan: waypoint types inconsistent: "
+               << "expected: " << waypoint_type_ << ", "
+               << "actual: " << s.waypoint_type()
+               << " (segment " << i << ")";
+    return false;
+  }
+
+  segments_.push_back(s);
+  return true;
+}
+
 bool jsonloader::Plan::valid() const noexcept {
   return valid_;
 }
@@ -367,13 +377,65 @@ jsonloader::Station::Station(Json::Value const& obj)
   valid_ = true;
 }
 
+jsonloader::Station::Station(Json::Value const& obj,
+                             std::vector<std::string> && commands)
+  : valid_(false) {
+  if (!Validate(obj, stationFields)) {
+    LOG(ERROR) << "invalid station.";
+    return;
+  }
+
+  tolerance_ = obj["tolerance"].asFloat();
+  stop_on_arrival_ = obj["stopOnArrival"].asBool();
+
+  Json::Value const& dof = obj["coordinate"];
+  position_ << dof["x"].asFloat(),
+               dof["y"].asFloat(),
+               dof["z"].asFloat();
+  orientation_ << dof["roll"].asFloat(),
+                  dof["pitch"].asFloat(),
+                  dof["yaw"].asFloat();
+
+  command_data_ = std::move(commands);
+  commands_.resize(command_data_.size());
+
+  valid_ = true;
+}
+
 jsonloader::Station::Station(jsonloader::Station && o)
   : valid_(o.valid_), tolerance_(o.tolerance_),
     stop_on_arrival_(o.stop_on_arrival_),
     position_(std::move(o.position_)),
     orientation_(std::move(o.orientation_)),
+    command_data_(std::move(o.command_data_)),
     commands_(std::move(o.commands_)) { }
 
+bool jsonloader::Station::ParseCommand(std::size_t index) const noexcept {
+  if (commands_[index] != nullptr)
+    return true;
+  if (index >= command_data_.size() || command_data_[index].empty())
+    return false;
+
+  // the text is dropped either way, so an invalid command is logged once
+  std::string data;
+  data.swap(command_data_[index]);
+
+  Json::Value v;
+  if (!Json::Reader().parse(data, v, false)) {
+    LOG(ERROR) << "invalid plan: command is not json: " << data;
+    return false;
+  }
+
+  Command * cmd = Command::Make(v);
+  if (cmd == nullptr) {
+    LOG(ERROR) << "invalid plan: command invalid: " << data;
+    return false;
+  }
+
+  commands_[index].reset(cmd);
+  return true;
+}
+
 bool jsonloader::Station::valid() const noexcept {
   return valid_;
 }
@@ -396,6 +458,19 @@ Eigen::Vector3f const& jsonloader::Station::orientation() const noexcept {
 
 jsonloader::Station::CommandSeq const&
 jsonloader::Station::commands() const noexcept {
+  for (std::size_t i = 0; i < command_data_.size(); i++)
+    ParseCommand(i);
   return commands_;
 }
 
+std::size_t jsonloader::Station::NumCommands() const noexcept {
+  return commands_.size();
+}
+
+jsonloader::Command const*
+jsonloader::Station::GetCommand(std::size_t index) const noexcept {
+  if (index >= commands_.size() || !ParseCommand(index))
+    return nullptr;
+  return commands_[index].get();
+}
+
@@ -22,6 +22,145 @@
 
 #include <json/json.h>
 
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// The begin and end of a value in the text of a plan
+using Span = std::pair<std::size_t, std::size_t>;
+
+const std::size_t kNone = std::string::npos;
+
+std::size_t SkipSpace(std::string const& data, std::size_t pos) {
+  while (pos < data.size() && (data[pos] == ' ' || data[pos] == '\t' ||
+                               data[pos] == '\n' || data[pos] == '\r'))
+    pos++;
+  return pos;
+}
+
+// Returns the end of the string with its quote at pos, or kNone
+std::size_t SkipString(std::string const& data, std::size_t pos) {
+  for (pos++; pos < data.size(); pos++) {
+    if (data[pos] == '\\')
+      pos++;
+    else if (data[pos] == '"')
+      return pos + 1;
+  }
+  return kNone;
+}
+
+// Returns the end of the value at pos, or kNone. Only strings and nesting
+// are followed, the values themselves are checked when they are parsed.
+std::size_t SkipValue(std::string const& data, std::size_t pos) {
+  if (pos >= data.size())
+    return kNone;
+  if (data[pos] == '"')
+    return SkipString(data, pos);
+
+  if (data[pos] == '{' || data[pos] == '[') {
+    int depth = 0;
+    while (pos < data.size()) {
+      char c = data[pos];
+      if (c == '"') {
+        pos = SkipString(data, pos);
+        if (pos == kNone)
+          return kNone;
+        continue;
+      }
+      if (c == '{' || c == '[') {
+        depth++;
+      } else if (c == '}' || c == ']') {
+        if (--depth == 0)
+          return pos + 1;
+      }
+      pos++;
+    }
+    return kNone;
+  }
+
+  std::size_t end = data.find_first_of(",]} \t\n\r", pos);
+  if (end == pos)
+    return kNone;
+  return (end == kNone ? data.size() : end);
+}
+
+// Splits the array in span into the spans of its elements
+bool ScanArray(std::string const& data, Span const& span,
+               std::vector<Span> *elems) {
+  std::size_t pos = SkipSpace(data, span.first);
+  if (pos >= span.second || data[pos] != '[')
+    return false;
+
+  pos = SkipSpace(data, pos + 1);
+  if (pos < span.second && data[pos] == ']')
+    return true;
+
+  while (pos < span.second) {
+    std::size_t end = SkipValue(data, pos);
+    if (end == kNone || end > span.second)
+      return false;
+    elems->emplace_back(pos, end);
+
+    pos = SkipSpace(data, end);
+    if (pos >= span.second)
+      return false;
+    if (data[pos] == ']')
+      return true;
+    if (data[pos] != ',')
+      return false;
+    pos = SkipSpace(data, pos + 1);
+  }
+  return false;
+}
+
+// Finds the value of key in the object in span
+bool FindMember(std::string const& data, Span const& span,
+                std::string const& key, Span *value) {
+  std::size_t pos = SkipSpace(data, span.first);
+  if (pos >= span.second || data[pos] != '{')
+    return false;
+
+  pos = SkipSpace(data, pos + 1);
+  while (pos < span.second && data[pos] == '"') {
+    std::size_t key_end = SkipString(data, pos);
+    if (key_end == kNone || key_end > span.second)
+      return false;
+    bool match = (data.compare(pos + 1, key_end - pos - 2, key) == 0);
+
+    pos = SkipSpace(data, key_end);
+    if (pos >= span.second || data[pos] != ':')
+      return false;
+    pos = SkipSpace(data, pos + 1);
+    std::size_t end = SkipValue(data, pos);
+    if (end == kNone || end > span.second)
+      return false;
+    if (match) {
+      *value = Span(pos, end);
+      return true;
+    }
+
+    pos = SkipSpace(data, end);
+    if (pos >= span.second || data[pos] != ',')
+      return false;
+    pos = SkipSpace(data, pos + 1);
+  }
+  return false;
+}
+
+// Parses the object in span with the value in hole replaced by []
+bool LoadDataWithout(std::string const& data, Span const& span,
+                     Span const& hole, Json::Value *json) {
+  std::string text;
+  text.reserve(span.second - span.first - (hole.second - hole.first) + 2);
+  text.append(data, span.first, hole.first - span.first);
+  text.append("[]");
+  text.append(data, hole.second, span.second - hole.second);
+  return jsonloader::LoadData(text, json);
+}
+
+}  // end namespace
 
 jsonloader::Plan jsonloader::LoadPlan(std::string const& data) {
   Json::Value v, null_obj(Json::objectValue);
@@ -32,6 +171,63 @@ jsonloader::Plan jsonloader::LoadPlan(std::string const& data) {
   return jsonloader::Plan(v);
 }
 
+jsonloader::Plan jsonloader::LoadPlan(std::string const& data,
+                                      bool lazy_commands) {
+  if (!lazy_commands)
+    return LoadPlan(data);
+
+  // index the sequence, then read the plan as if it was empty
+  Json::Value v, null_obj(Json::objectValue);
+  Span all, sequence;
+  std::vector<Span> milestones;
+  all.first = SkipSpace(data, 0);
+  all.second = SkipValue(data, all.first);
+  if (all.second == kNone ||
+      !FindMember(data, all, "sequence", &sequence) ||
+      !ScanArray(data, sequence, &milestones)) {
+    LOG(ERROR) << "Error parsing json: cannot find the plan sequence.";
+    return jsonloader::Plan(null_obj);
+  }
+
+  if (!LoadDataWithout(data, all, sequence, &v))
+    return jsonloader::Plan(null_obj);
+
+  jsonloader::Plan plan(v);
+  if (!plan.valid())
+    return plan;
+  plan.valid_ = false;
+
+  for (std::size_t i = 0; i < milestones.size(); i++) {
+    Span const& m = milestones[i];
+    Json::Value obj;
+    if (i % 2 == 0) {  // Station, with its commands only split up
+      Span cmds;
+      std::vector<Span> spans;
+      if (!FindMember(data, m, "sequence", &cmds) ||
+          !ScanArray(data, cmds, &spans) ||
+          !LoadDataWithout(data, m, cmds, &obj)) {
+        LOG(ERROR) << "invalid plan: invalid station " << i;
+        return plan;
+      }
+
+      std::vector<std::string> commands;
+      commands.reserve(spans.size());
+      for (Span const& s : spans)
+        commands.emplace_back(data, s.first, s.second - s.first);
+
+      if (!plan.AddStation(Station(obj, std::move(commands)), i))
+        return plan;
+    } else {  // Segment
+      if (!LoadData(data.substr(m.first, m.second - m.first), &obj) ||
+          !plan.AddSegment(Segment(obj), i))
+        return plan;
+    }
+  }
+
+  plan.valid_ = true;
+  return plan;
+}
+
 bool jsonloader::LoadData(std::string const& data, Json::Value *json) {
   Json::Reader r;
   if (!r.parse(data, *json, false)) {
@@ -0,0 +1,153 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <jsonloader/keepout_bvh.h>
+
+#include <Eigen/Geometry>
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+namespace {
+
+std::mt19937 generator;
+
+float Uniform(float lo, float hi) {
+  return std::uniform_real_distribution<float>(lo, hi)(generator);
+}
+
+Eigen::Vector3f RandomPoint(float lo, float hi) {
+  return Eigen::Vector3f(Uniform(lo, hi), Uniform(lo, hi), Uniform(lo, hi));
+}
+
+// Random small boxes, many more than fit in a leaf
+jsonloader::Keepout::Sequence RandomBoxes(int n) {
+  jsonloader::Keepout::Sequence boxes;
+  for (int i = 0; i < n; i++) {
+    Eigen::Vector3f min = RandomPoint(-10, 10);
+    boxes.push_back(jsonloader::Keepout::BoundingBox(min, min + RandomPoint(0.1, 2)));
+  }
+  return boxes;
+}
+
+bool BruteContains(jsonloader::Keepout::Sequence const& boxes, Eigen::Vector3f const& p) {
+  for (auto const& box : boxes)
+    if (box.contains(p))
+      return true;
+  return false;
+}
+
+}  // namespace
+
+TEST(KeepoutBvh, Empty) {
+  jsonloader::KeepoutBvh bvh;
+  EXPECT_TRUE(bvh.Empty());
+  EXPECT_FALSE(bvh.Contains(Eigen::Vector3f::Zero()));
+  EXPECT_FALSE(bvh.Intersects(Eigen::Vector3f::Zero(), Eigen::Vector3f::Ones()));
+  EXPECT_FALSE(bvh.Covers(Eigen::Vector3f::Zero(), Eigen::Vector3f::Ones()));
+}
+
+TEST(KeepoutBvh, ContainsMatchesBruteForce) {
+  generator.seed(1);
+  jsonloader::Keepout::Sequence boxes = RandomBoxes(200);
+  jsonloader::KeepoutBvh bvh(boxes);
+  EXPECT_FALSE(bvh.Empty());
+
+  jsonloader::KeepoutBvh::Points points(3, 2000);
+  for (int i = 0; i < points.cols(); i++)
+    points.col(i) = RandomPoint(-12, 12);
+  std::vector<bool> inside;
+  bvh.Contains(points, &inside);
+  ASSERT_EQ(inside.size(), points.cols());
+  int hits = 0;
+  for (int i = 0; i < points.cols(); i++) {
+    bool expected = BruteContains(boxes, points.col(i));
+    EXPECT_EQ(bvh.Contains(Eigen::Vector3f(points.col(i))), expected);
+    EXPECT_EQ(inside[i], expected);
+    hits += expected;
+  }
+  EXPECT_GT(hits, 0);
+}
+
+TEST(KeepoutBvh, Margin) {
+  jsonloader::Keepout::Sequence boxes;
+  boxes.push_back(jsonloader::Keepout::BoundingBox(Eigen::Vector3f(0, 0, 0), Eigen::Vector3f(1, 1, 1)));
+  jsonloader::KeepoutBvh grown(boxes, 0.5);
+  EXPECT_TRUE(grown.Contains(Eigen::Vector3f(1.4, 0.5, 0.5)));
+  jsonloader::KeepoutBvh shrunk(boxes, -0.25);
+  EXPECT_FALSE(shrunk.Contains(Eigen::Vector3f(0.1, 0.5, 0.5)));
+  EXPECT_TRUE(shrunk.Contains(Eigen::Vector3f(0.5, 0.5, 0.5)));
+  // shrunk past nothing, so dropped
+  jsonloader::KeepoutBvh gone(boxes, -1.0);
+  EXPECT_TRUE(gone.Empty());
+}
+
+TEST(KeepoutBvh, Intersects) {
+  jsonloader::Keepout::Sequence boxes;
+  boxes.push_back(jsonloader::Keepout::BoundingBox(Eigen::Vector3f(2, -1, -1), Eigen::Vector3f(3, 1, 1)));
+  boxes.push_back(jsonloader::Keepout::BoundingBox(Eigen::Vector3f(6, -1, -1), Eigen::Vector3f(7, 1, 1)));
+  jsonloader::KeepoutBvh bvh(boxes);
+
+  float t = -1;
+  EXPECT_TRUE(bvh.Intersects(Eigen::Vector3f(0, 0, 0), Eigen::Vector3f(10, 0, 0), &t));
+  EXPECT_NEAR(t, 0.2, 1e-6);
+  EXPECT_TRUE(bvh.Intersects(Eigen::Vector3f(10, 0, 0), Eigen::Vector3f(0, 0, 0), &t));
+  EXPECT_NEAR(t, 0.3, 1e-6);
+  // between the boxes, and passing over them
+  EXPECT_FALSE(bvh.Intersects(Eigen::Vector3f(4, 0, 0), Eigen::Vector3f(5, 0, 0)));
+  EXPECT_FALSE(bvh.Intersects(Eigen::Vector3f(0, 2, 0), Eigen::Vector3f(10, 2, 0)));
+  // a segment that stops short, and one that is only a point
+  EXPECT_FALSE(bvh.Intersects(Eigen::Vector3f(0, 0, 0), Eigen::Vector3f(1.9, 0, 0)));
+  EXPECT_TRUE(bvh.Intersects(Eigen::Vector3f(2.5, 0, 0), Eigen::Vector3f(2.5, 0, 0)));
+}
+
+TEST(KeepoutBvh, IntersectsMatchesSampling) {
+  generator.seed(2);
+  jsonloader::Keepout::Sequence boxes = RandomBoxes(100);
+  jsonloader::KeepoutBvh bvh(boxes);
+  for (int i = 0; i < 200; i++) {
+    Eigen::Vector3f a = RandomPoint(-12, 12), b = RandomPoint(-12, 12);
+    float t;
+    if (bvh.Intersects(a, b, &t)) {
+      EXPECT_TRUE(BruteContains(boxes, a + (t + 1e-4) * (b - a)) ||
+                  BruteContains(boxes, a + t * (b - a)));
+      // nothing is touched before the first hit, unless a is in a box
+      for (int j = 0; t > 0 && j < 100; j++)
+        EXPECT_FALSE(BruteContains(boxes, a + (0.99 * t * j / 100) * (b - a)));
+    } else {
+      for (int j = 0; j <= 100; j++)
+        EXPECT_FALSE(BruteContains(boxes, a + (j / 100.0f) * (b - a)));
+    }
+  }
+}
+
+TEST(KeepoutBvh, Covers) {
+  // two overlapping boxes along x, and one apart
+  jsonloader::Keepout::Sequence boxes;
+  boxes.push_back(jsonloader::Keepout::BoundingBox(Eigen::Vector3f(0, -1, -1), Eigen::Vector3f(2, 1, 1)));
+  boxes.push_back(jsonloader::Keepout::BoundingBox(Eigen::Vector3f(1.5, -1, -1), Eigen::Vector3f(4, 1, 1)));
+  boxes.push_back(jsonloader::Keepout::BoundingBox(Eigen::Vector3f(5, -1, -1), Eigen::Vector3f(6, 1, 1)));
+  jsonloader::KeepoutBvh bvh(boxes);
+  EXPECT_TRUE(bvh.Covers(Eigen::Vector3f(0.5, 0, 0), Eigen::Vector3f(3.5, 0, 0)));
+  EXPECT_TRUE(bvh.Covers(Eigen::Vector3f(5.5, 0, 0), Eigen::Vector3f(5.5, 0.5, 0)));
+  // across the gap, and out through a side
+  EXPECT_FALSE(bvh.Covers(Eigen::Vector3f(0.5, 0, 0), Eigen::Vector3f(5.5, 0, 0)));
+  EXPECT_FALSE(bvh.Covers(Eigen::Vector3f(0.5, 0, 0), Eigen::Vector3f(0.5, 2, 0)));
+}
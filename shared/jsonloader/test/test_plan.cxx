@@ -246,3 +246,66 @@ TEST(PlanIO, PlanEvolution) {
     ASSERT_TRUE(plan.valid());
   }
 }
+
+// The skeleton of a plan loaded with lazy commands should be the same, and
+// so should its commands once they are parsed
+TEST(PlanIO, LoadPlanLazyCommands) {
+  std::vector<std::string> files = { kDataDir + "compiled_plan.fplan" };
+  const std::string evolution_path = kDataDir + "plan_evolution/";
+  for (fs::directory_entry & e :
+       boost::make_iterator_range(fs::directory_iterator(evolution_path), {}))
+    if (e.path().extension().string() == ".fplan")
+      files.push_back(e.path().string());
+
+  for (std::string const& f : files) {
+    LOG(INFO) << "Loading " << f;
+    std::string data = SlurpFile(f);
+    jsonloader::Plan eager(jsonloader::LoadPlan(data));
+    jsonloader::Plan lazy(jsonloader::LoadPlan(data, true));
+    ASSERT_TRUE(eager.valid());
+    ASSERT_TRUE(lazy.valid());
+
+    EXPECT_EQ(lazy.name(), eager.name());
+    EXPECT_EQ(lazy.waypoint_type(), eager.waypoint_type());
+    ASSERT_EQ(lazy.stations().size(), eager.stations().size());
+    ASSERT_EQ(lazy.segments().size(), eager.segments().size());
+
+    for (std::size_t i = 0; i < eager.stations().size(); i++) {
+      jsonloader::Station const& es = eager.stations()[i];
+      jsonloader::Station const& ls = lazy.stations()[i];
+      EXPECT_EQ(ls.position(), es.position());
+      ASSERT_EQ(ls.NumCommands(), es.NumCommands());
+      for (std::size_t j = 0; j < es.NumCommands(); j++) {
+        ASSERT_NE(ls.GetCommand(j), nullptr);
+        EXPECT_EQ(ls.GetCommand(j)->type(), es.GetCommand(j)->type());
+      }
+    }
+
+    for (std::size_t i = 0; i < eager.segments().size(); i++)
+      EXPECT_EQ(lazy.segments()[i].waypoints().size(),
+                eager.segments()[i].waypoints().size());
+  }
+}
+
+TEST(PlanIO, LoadPlanLazyInvalidCommand) {
+  static const std::string data = u8R"({
+    "type": "FreeFlyerPlan", "name": "bad", "valid": true,
+    "site": { "type": "Site", "id": "iss" },
+    "defaultTolerance": 1.0, "defaultSpeed": 0.1,
+    "sequence": [ {
+      "type": "Station",
+      "coordinate": { "type": "Point6Dof", "x": 1.0, "y": 2.0, "z": 3.0,
+                      "roll": 0.0, "pitch": 0.0, "yaw": 0.0 },
+      "stopOnArrival": true, "tolerance": 0.5,
+      "sequence": [ { "type": "NotACommand", "name": "x, \"]}" } ]
+    } ]
+  })";
+
+  // an invalid command is only found when it is parsed
+  EXPECT_FALSE(jsonloader::LoadPlan(data).valid());
+  jsonloader::Plan p(jsonloader::LoadPlan(data, true));
+  ASSERT_TRUE(p.valid());
+  ASSERT_EQ(p.stations().size(), 1);
+  ASSERT_EQ(p.stations()[0].NumCommands(), 1);
+  EXPECT_EQ(p.stations()[0].GetCommand(0), nullptr);
+}
@@ -30,6 +30,12 @@
 #include <geometry_msgs/Transform.h>
 #include <geometry_msgs/Vector3.h>
 
+#include <ff_msgs/DepthLandmark.h>
+#include <ff_msgs/Feature2d.h>
+#include <ff_msgs/VisualLandmark.h>
+
+#include <vector>
+
 namespace msg_conversions {
 
   Eigen::Vector3d        ros_point_to_eigen_vector(const geometry_msgs::Point & p);
@@ -52,6 +58,23 @@ namespace msg_conversions {
   Eigen::Affine3d           ros_pose_to_eigen_transform(const geometry_msgs::Pose & p);
   Eigen::Affine3d           ros_to_eigen_transform(const geometry_msgs::Transform & p);
 
+  // whole arrays of landmarks and features, one point per column. The output is
+  // sized once and filled in place. The points and observations must have the
+  // same number of columns, as must the points and ids.
+  void eigen_to_ros_landmarks(const Eigen::Ref<const Eigen::Matrix3Xd> & points,
+                              const Eigen::Ref<const Eigen::Matrix2Xd> & observations,
+                              std::vector<ff_msgs::VisualLandmark>* landmarks);
+  void eigen_to_ros_landmarks(const Eigen::Ref<const Eigen::Matrix3Xd> & points,
+                              std::vector<ff_msgs::DepthLandmark>* landmarks);
+  void eigen_to_ros_features(const Eigen::Ref<const Eigen::Matrix2Xd> & points, const std::vector<uint16_t> & ids,
+                             std::vector<ff_msgs::Feature2d>* features);
+  void ros_to_eigen_landmarks(const std::vector<ff_msgs::VisualLandmark> & landmarks,
+                              Eigen::Matrix3Xd* points, Eigen::Matrix2Xd* observations);
+  void ros_to_eigen_landmarks(const std::vector<ff_msgs::DepthLandmark> & landmarks, Eigen::Matrix3Xd* points);
+  // ids may be null
+  void ros_to_eigen_features(const std::vector<ff_msgs::Feature2d> & features,
+                             Eigen::Matrix2Xd* points, std::vector<uint16_t>* ids);
+
   // load from config file
   bool config_read_quat(config_reader::ConfigReader* config,
                                 const char* name, Eigen::Quaterniond* quat);
@@ -18,6 +18,8 @@
 
 #include <msg_conversions/msg_conversions.h>
 
+#include <cassert>
+
 namespace msg_conversions {
 
 Eigen::Vector3d ros_point_to_eigen_vector(const geometry_msgs::Point & p) {
@@ -258,4 +260,80 @@ Eigen::Affine3d ros_to_eigen_transform(const geometry_msgs::Transform & p) {
   return transform;
 }
 
+void eigen_to_ros_landmarks(const Eigen::Ref<const Eigen::Matrix3Xd> & points,
+                            const Eigen::Ref<const Eigen::Matrix2Xd> & observations,
+                            std::vector<ff_msgs::VisualLandmark>* landmarks) {
+  assert(points.cols() == observations.cols());
+  landmarks->resize(points.cols());
+  for (int i = 0; i < points.cols(); i++) {
+    ff_msgs::VisualLandmark & l = (*landmarks)[i];
+    l.x = points(0, i);
+    l.y = points(1, i);
+    l.z = points(2, i);
+    l.u = observations(0, i);
+    l.v = observations(1, i);
+  }
+}
+
+void eigen_to_ros_landmarks(const Eigen::Ref<const Eigen::Matrix3Xd> & points,
+                            std::vector<ff_msgs::DepthLandmark>* landmarks) {
+  landmarks->resize(points.cols());
+  for (int i = 0; i < points.cols(); i++) {
+    ff_msgs::DepthLandmark & l = (*landmarks)[i];
+    l.u = points(0, i);
+    l.v = points(1, i);
+    l.w = points(2, i);
+  }
+}
+
+void eigen_to_ros_features(const Eigen::Ref<const Eigen::Matrix2Xd> & points, const std::vector<uint16_t> & ids,
+                           std::vector<ff_msgs::Feature2d>* features) {
+  assert(points.cols() == static_cast<int>(ids.size()));
+  features->resize(points.cols());
+  for (int i = 0; i < points.cols(); i++) {
+    ff_msgs::Feature2d & f = (*features)[i];
+    f.id = ids[i];
+    f.x = points(0, i);
+    f.y = points(1, i);
+  }
+}
+
+void ros_to_eigen_landmarks(const std::vector<ff_msgs::VisualLandmark> & landmarks,
+                            Eigen::Matrix3Xd* points, Eigen::Matrix2Xd* observations) {
+  points->resize(3, landmarks.size());
+  observations->resize(2, landmarks.size());
+  for (size_t i = 0; i < landmarks.size(); i++) {
+    const ff_msgs::VisualLandmark & l = landmarks[i];
+    (*points)(0, i) = l.x;
+    (*points)(1, i) = l.y;
+    (*points)(2, i) = l.z;
+    (*observations)(0, i) = l.u;
+    (*observations)(1, i) = l.v;
+  }
+}
+
+void ros_to_eigen_landmarks(const std::vector<ff_msgs::DepthLandmark> & landmarks, Eigen::Matrix3Xd* points) {
+  points->resize(3, landmarks.size());
+  for (size_t i = 0; i < landmarks.size(); i++) {
+    const ff_msgs::DepthLandmark & l = landmarks[i];
+    (*points)(0, i) = l.u;
+    (*points)(1, i) = l.v;
+    (*points)(2, i) = l.w;
+  }
+}
+
+void ros_to_eigen_features(const std::vector<ff_msgs::Feature2d> & features,
+                           Eigen::Matrix2Xd* points, std::vector<uint16_t>* ids) {
+  points->resize(2, features.size());
+  if (ids)
+    ids->resize(features.size());
+  for (size_t i = 0; i < features.size(); i++) {
+    const ff_msgs::Feature2d & f = features[i];
+    (*points)(0, i) = f.x;
+    (*points)(1, i) = f.y;
+    if (ids)
+      (*ids)[i] = f.id;
+  }
+}
+
 }  // end namespace msg_conversions
@@ -36,6 +36,9 @@
 // FSW includes
 #include <ff_util/ff_nodelet.h>
 
+// Plugin scheduler
+#include <astrobee_gazebo/plugin_scheduler.h>
+
 // Gazebo includes
 #include <gazebo/common/common.hh>
 #include <gazebo/physics/physics.hh>
@@ -48,8 +51,10 @@
 #include <Eigen/Geometry>
 
 // STL includes
+#include <functional>
 #include <string>
 #include <limits>
+#include <set>
 #include <thread>
 
 namespace gazebo {
@@ -78,6 +83,17 @@ class FreeFlyerModelPlugin : public ff_util::FreeFlyerNodelet, public ModelPlugi
   // Get the extrinsics frame
   std::string GetFrame(std::string target = "");
 
+  // Call back from the world update of the robot at a rate, or on every step
+  // if it is zero, after the physics step if end is set
+  void ScheduleUpdate(std::string const& task, double rate,
+    std::function<void()> callback, bool end = false);
+
+  // Stop calling back a scheduled update
+  void UnscheduleUpdate(std::string const& task);
+
+  // Get the state of the robot, from a scheduled update
+  PluginScheduler::State const& GetState();
+
   // Callback when the model has loaded
   virtual void LoadCallback(ros::NodeHandle *nh,
     physics::ModelPtr model, sdf::ElementPtr sdf) = 0;
@@ -91,6 +107,8 @@ class FreeFlyerModelPlugin : public ff_util::FreeFlyerNodelet, public ModelPlugi
   physics::ModelPtr model_;
   ros::CallbackQueue queue_;
   std::thread thread_;
+  PluginScheduler::Ptr scheduler_;
+  std::set<std::string> tasks_;
 };
 
 
@@ -123,13 +141,24 @@ class FreeFlyerSensorPlugin : public ff_util::FreeFlyerNodelet, public SensorPlu
   // Were extrinsics found
   bool ExtrinsicsFound();
 
+  // Call back from the world update of the robot at a rate, or on every step
+  // if it is zero, after the physics step if end is set
+  void ScheduleUpdate(std::string const& task, double rate,
+    std::function<void()> callback, bool end = false);
+
+  // Stop calling back a scheduled update
+  void UnscheduleUpdate(std::string const& task);
+
+  // Get the state of the robot, from a scheduled update
+  PluginScheduler::State const& GetState();
+
   // Callback when the sensor has loaded
   virtual void LoadCallback(ros::NodeHandle *nh,
     sensors::SensorPtr sensor, sdf::ElementPtr sdf) = 0;
 
   // Manage the extrinsics based on the sensor type
  private:
-  void SetupExtrinsics(const common::UpdateInfo &info);
+  void SetupExtrinsics();
 
  private:
   std::string name_, frame_;
@@ -140,9 +169,10 @@ class FreeFlyerSensorPlugin : public ff_util::FreeFlyerNodelet, public SensorPlu
   sdf::ElementPtr sdf_;
   physics::WorldPtr world_;
   physics::ModelPtr model_;
-  event::ConnectionPtr connection_;
   ros::CallbackQueue queue_;
   std::thread thread_;
+  PluginScheduler::Ptr scheduler_;
+  std::set<std::string> tasks_;
 };
 
 }  // namespace gazebo
@@ -0,0 +1,120 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef ASTROBEE_GAZEBO_PLUGIN_SCHEDULER_H_
+#define ASTROBEE_GAZEBO_PLUGIN_SCHEDULER_H_
+
+// ROS includes
+#include <ros/ros.h>
+
+// Transformation helper code
+#include <tf2_ros/buffer.h>
+
+// Gazebo includes
+#include <gazebo/common/common.hh>
+#include <gazebo/physics/physics.hh>
+#include <gazebo/math/gzmath.hh>
+
+// STL includes
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <vector>
+
+namespace gazebo {
+
+// Calls the world update callbacks of the plugins of a robot, each at its
+// own rate. With scheduler_shared set in simulation/scheduler.config all the
+// plugins of a model share one scheduler, and so one pair of world update
+// connections and one lookup of the robot state per step. Otherwise each
+// plugin has its own, which is the same as connecting directly. Either way
+// the wall time spent in each callback is printed every report period.
+class PluginScheduler {
+ public:
+  typedef std::shared_ptr<PluginScheduler> Ptr;
+  typedef std::function<void()> Callback;
+
+  // The state of the robot, read once per update
+  struct State {
+    math::Pose model_pose;              // World pose of the model
+    math::Pose link_pose;               // World pose of the body link
+    math::Vector3 linear_vel;           // World velocities of the model
+    math::Vector3 angular_vel;
+    math::Vector3 relative_linear_vel;  // Body velocities of the link
+    math::Vector3 relative_angular_vel;
+  };
+
+  // Get the scheduler for a model, shared or not depending on the config
+  static Ptr Get(physics::ModelPtr model);
+
+  // A buffer and listener for TF2 transforms shared by all plugins, so that
+  // /tf is only subscribed to once however many plugins look it up
+  static tf2_ros::Buffer& GetBuffer();
+
+  explicit PluginScheduler(physics::ModelPtr model);
+  ~PluginScheduler();
+
+  // Call the callback at the rate, or on every step if it is zero, before
+  // the world update or after it if end is set. A task replaces any other of
+  // the same name, and may add or remove tasks from its callback.
+  void Add(std::string const& name, double rate, Callback callback,
+    bool end = false);
+
+  // Stop calling a task
+  void Remove(std::string const& name);
+
+  // Get the state of the robot in the current update. Only valid from the
+  // callback of a task, as the world is not stepping then.
+  State const& GetState();
+
+ private:
+  struct Task {
+    std::string name;
+    double period;
+    bool end;
+    Callback callback;
+    common::Time next;
+    std::atomic<bool> active;
+    // Cost since the last report
+    size_t calls;
+    double total, max;
+  };
+  typedef std::shared_ptr<Task> TaskPtr;
+
+  void Connect(bool end);
+  void Update(bool end);
+  void Report(common::Time const& now, std::vector<TaskPtr> const& tasks);
+
+  physics::ModelPtr model_;
+  physics::WorldPtr world_;
+  double report_period_;
+  std::mutex mutex_;
+  std::vector<TaskPtr> tasks_;
+  event::ConnectionPtr begin_, end_;
+  common::Time last_, next_report_;
+  State state_;
+  uint64_t step_, state_step_;
+};
+
+}  // namespace gazebo
+
+#endif  // ASTROBEE_GAZEBO_PLUGIN_SCHEDULER_H_
@@ -0,0 +1,87 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef ASTROBEE_GAZEBO_RAY_CASTER_H_
+#define ASTROBEE_GAZEBO_RAY_CASTER_H_
+
+// Gazebo includes
+#include <gazebo/physics/physics.hh>
+
+// Transformation helper code
+#include <Eigen/Eigen>
+#include <Eigen/Geometry>
+
+// STL includes
+#include <vector>
+
+namespace gazebo {
+
+// Casts rays against the collision meshes of the static models of a world,
+// with a bounding volume hierarchy over their triangles. It is built once,
+// and is only read after that, so it can be used from any thread without
+// locking the physics engine. Moving models are not in it, as they are not
+// part of a map either. Models with a simplified collision mesh in their SDF
+// get that mesh here, rather than the one they are drawn with.
+class RayCaster {
+ public:
+  RayCaster();
+
+  // Adds the mesh collisions of all static models in the world, returning the
+  // number of triangles added
+  size_t AddWorld(physics::WorldPtr world);
+
+  // Adds triangles, three indices into the vertices each, moved by the pose
+  void AddTriangles(std::vector<Eigen::Vector3d> const& vertices,
+    std::vector<unsigned int> const& indices, Eigen::Affine3d const& pose);
+
+  // Builds the hierarchy over the triangles added so far
+  void Build();
+
+  // The distance to the first triangle hit by the ray from origin along the
+  // unit vector dir, within max_dist, false if there is none
+  bool Cast(Eigen::Vector3d const& origin, Eigen::Vector3d const& dir,
+    double max_dist, double *dist) const;
+
+  size_t NumTriangles() const {return triangles_.size();}
+  bool Empty() const {return nodes_.empty();}
+
+ private:
+  struct Triangle {
+    Eigen::Vector3f v0, e1, e2;     // a vertex and the edges from it
+  };
+
+  // Either two children, the first right after the node, or a leaf
+  struct Node {
+    Eigen::AlignedBox3f box;
+    unsigned int first;             // first triangle, or the second child
+    unsigned int count;             // number of triangles, zero if inner
+  };
+
+  unsigned int Split(unsigned int first, unsigned int count);
+  bool Hit(Triangle const& t, Eigen::Vector3f const& origin,
+    Eigen::Vector3f const& dir, float *dist) const;
+
+  std::vector<Triangle> triangles_;
+  std::vector<Eigen::AlignedBox3f> boxes_;
+  std::vector<Eigen::Vector3f> centers_;
+  std::vector<Node, Eigen::aligned_allocator<Node>> nodes_;
+};
+
+}  // namespace gazebo
+
+#endif  // ASTROBEE_GAZEBO_RAY_CASTER_H_
@@ -29,6 +29,10 @@ FreeFlyerModelPlugin::FreeFlyerModelPlugin(std::string const& name, bool hb) :
   ff_util::FreeFlyerNodelet(name, hb), name_(name) {}
 
 FreeFlyerModelPlugin::~FreeFlyerModelPlugin() {
+  if (scheduler_) {
+    for (std::string const& task : tasks_)
+      scheduler_->Remove(task);
+  }
   thread_.join();
 }
 
@@ -50,6 +54,9 @@ void FreeFlyerModelPlugin::Load(physics::ModelPtr model, sdf::ElementPtr sdf) {
   nh_.setCallbackQueue(&queue_);
   thread_ = std::thread(&FreeFlyerModelPlugin::WorkerThread, this, 0.01);
 
+  // Get the scheduler for the world updates of this robot
+  scheduler_ = PluginScheduler::Get(model_);
+
   // Call initialize on the freeflyer nodelet to start heartbeat and faults
   Setup(nh_, nh_);
 
@@ -86,6 +93,24 @@ std::string FreeFlyerModelPlugin::GetFrame(std::string target) {
   return GetModel()->GetName() + "/" + frame;
 }
 
+// Call back from the world update of the robot
+void FreeFlyerModelPlugin::ScheduleUpdate(std::string const& task,
+  double rate, std::function<void()> callback, bool end) {
+  tasks_.insert(name_ + "/" + task);
+  scheduler_->Add(name_ + "/" + task, rate, callback, end);
+}
+
+// Stop calling back a scheduled update
+void FreeFlyerModelPlugin::UnscheduleUpdate(std::string const& task) {
+  tasks_.erase(name_ + "/" + task);
+  scheduler_->Remove(name_ + "/" + task);
+}
+
+// Get the state of the robot
+PluginScheduler::State const& FreeFlyerModelPlugin::GetState() {
+  return scheduler_->GetState();
+}
+
 // Sensor plugin
 
 FreeFlyerSensorPlugin::FreeFlyerSensorPlugin(
@@ -94,6 +119,10 @@ FreeFlyerSensorPlugin::FreeFlyerSensorPlugin(
       extrinsics_found_(false) {}
 
 FreeFlyerSensorPlugin::~FreeFlyerSensorPlugin() {
+  if (scheduler_) {
+    for (std::string const& task : tasks_)
+      scheduler_->Remove(task);
+  }
   thread_.join();
 }
 
@@ -116,6 +145,9 @@ void FreeFlyerSensorPlugin::Load(sensors::SensorPtr sensor, sdf::ElementPtr sdf)
   nh_.setCallbackQueue(&queue_);
   thread_ = std::thread(&FreeFlyerSensorPlugin::WorkerThread, this, 0.01);
 
+  // Get the scheduler for the world updates of this robot
+  scheduler_ = PluginScheduler::Get(model_);
+
   // Call initialize on the freeflyer nodelet to start heartbeat and faults
   Setup(nh_, nh_);
 
@@ -124,11 +156,9 @@ void FreeFlyerSensorPlugin::Load(sensors::SensorPtr sensor, sdf::ElementPtr sdf)
 
   // Only try and set the extrinsics after the world has loaded. Otherwise,
   // they only get partially set.
-  if (!frame_.empty()) {
-    connection_ = event::Events::ConnectWorldUpdateBegin(
-      std::bind(&FreeFlyerSensorPlugin::SetupExtrinsics,
-        this, std::placeholders::_1));
-  }
+  if (!frame_.empty())
+    ScheduleUpdate("extrinsics", 0.0,
+      std::bind(&FreeFlyerSensorPlugin::SetupExtrinsics, this));
 }
 
 // Put laser data to the interface
@@ -165,16 +195,32 @@ bool FreeFlyerSensorPlugin::ExtrinsicsFound() {
   return extrinsics_found_;
 }
 
+// Call back from the world update of the robot
+void FreeFlyerSensorPlugin::ScheduleUpdate(std::string const& task,
+  double rate, std::function<void()> callback, bool end) {
+  tasks_.insert(name_ + "/" + task);
+  scheduler_->Add(name_ + "/" + task, rate, callback, end);
+}
+
+// Stop calling back a scheduled update
+void FreeFlyerSensorPlugin::UnscheduleUpdate(std::string const& task) {
+  tasks_.erase(name_ + "/" + task);
+  scheduler_->Remove(name_ + "/" + task);
+}
+
+// Get the state of the robot
+PluginScheduler::State const& FreeFlyerSensorPlugin::GetState() {
+  return scheduler_->GetState();
+}
+
 // Manage the extrinsics based on the sensor type
-void FreeFlyerSensorPlugin::SetupExtrinsics(const common::UpdateInfo &info) {
-  // Create a buffer and listener for TF2 transforms
-  static tf2_ros::Buffer buffer;
-  static tf2_ros::TransformListener listener(buffer);
+void FreeFlyerSensorPlugin::SetupExtrinsics() {
   // Get extrinsics from framestore
   try {
     // Lookup the transform for this sensor
-    geometry_msgs::TransformStamped tf = buffer.lookupTransform(
-      GetFrame("body"), GetFrame(), ros::Time(0));
+    geometry_msgs::TransformStamped tf =
+      PluginScheduler::GetBuffer().lookupTransform(
+        GetFrame("body"), GetFrame(), ros::Time(0));
 
     // Handle the transform for all sensor types
     ignition::math::Pose3d pose(
@@ -204,7 +250,7 @@ void FreeFlyerSensorPlugin::SetupExtrinsics(const common::UpdateInfo &info) {
         tf.transform.translation.z,
         pose_temp.w(), pose_temp.x(), pose_temp.y(), pose_temp.z());
     math::Pose tf_bs = pose;
-    math::Pose tf_wb = model_->GetWorldPose();
+    math::Pose tf_wb = GetState().model_pose;
     math::Pose tf_ws = tf_bs + tf_wb;
     ignition::math::Pose3d world_pose(tf_ws.pos.x, tf_ws.pos.y,
       tf_ws.pos.z, tf_ws.rot.w, tf_ws.rot.x, tf_ws.rot.y, tf_ws.rot.z);
@@ -231,7 +277,7 @@ void FreeFlyerSensorPlugin::SetupExtrinsics(const common::UpdateInfo &info) {
     }
 
     // We have the transform, no more need to listen for it
-    event::Events::DisconnectWorldUpdateBegin(connection_);
+    UnscheduleUpdate("extrinsics");
 
     // Mark that the extrinsics were found
     extrinsics_found_ = true;
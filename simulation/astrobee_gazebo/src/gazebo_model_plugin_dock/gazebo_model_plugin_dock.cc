@@ -47,9 +47,8 @@ class GazeboModelPluginDock : public FreeFlyerModelPlugin {
 
   // Manage the extrinsics based on the sensor type
   void ExtrinsicsCallback(ros::TimerEvent const& event) {
-    // Create a buffer and listener for TF2 transforms
-    static tf2_ros::Buffer buffer;
-    static tf2_ros::TransformListener listener(buffer);
+    // Use the TF2 buffer shared by all plugins
+    tf2_ros::Buffer &buffer = PluginScheduler::GetBuffer();
     // Get extrinsics from framestore
     try {
       // Lookup the transform for this sensor
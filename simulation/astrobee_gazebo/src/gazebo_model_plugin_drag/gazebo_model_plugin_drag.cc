@@ -47,20 +47,14 @@ class GazeboModelPluginDrag : public FreeFlyerModelPlugin {
     if (sdf->HasElement("density"))
       density_ = sdf->Get<double>("density");
     // Called before each iteration of simulated world update
-    next_tick_ = GetWorld()->GetSimTime();
-    update_ = event::Events::ConnectWorldUpdateBegin(
+    ScheduleUpdate("drag", 0.0,
       std::bind(&GazeboModelPluginDrag::WorldUpdateCallback, this));
   }
 
-  // Called on simulation reset
-  virtual void Reset() {
-    next_tick_ = GetWorld()->GetSimTime();
-  }
-
   // Called on each sensor update event
   void WorldUpdateCallback() {
     // Calculate drag
-    drag_ = GetLink()->GetRelativeLinearVel();
+    drag_ = GetState().relative_linear_vel;
     drag_ = -0.5 * coefficient_ * area_ * density_
           * drag_.GetLength() * drag_.GetLength() * drag_.Normalize();
     // Apply the force and torque to the model
@@ -69,9 +63,7 @@ class GazeboModelPluginDrag : public FreeFlyerModelPlugin {
 
  private:
   double coefficient_, area_, density_;              // Drag parameters
-  common::Time next_tick_;
   math::Vector3 drag_;
-  event::ConnectionPtr update_;
 };
 
 // Register this plugin with the simulator
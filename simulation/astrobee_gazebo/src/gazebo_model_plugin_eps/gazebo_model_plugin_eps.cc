@@ -175,9 +175,7 @@ class GazeboModelPluginEps : public FreeFlyerModelPlugin {
     }
 
   // Destructor
-  virtual ~GazeboModelPluginEps() {
-    event::Events::DisconnectWorldUpdateEnd(connection_);
-  }
+  virtual ~GazeboModelPluginEps() {}
 
  protected:
   // Called when the plugin is loaded into the simulator
@@ -203,8 +201,8 @@ class GazeboModelPluginEps : public FreeFlyerModelPlugin {
     timer_update_ = nh->createTimer(ros::Rate(rate_),
       &GazeboModelPluginEps::UpdateCallback, this, false, false);
     // Defer the extrinsics setup to allow plugins to load
-    connection_ = event::Events::ConnectWorldUpdateEnd(
-      std::bind(&GazeboModelPluginEps::BerthCallback, this));
+    ScheduleUpdate("berths", 0.0,
+      std::bind(&GazeboModelPluginEps::BerthCallback, this), true);
   }
 
   // When the FSM state changes we get a callback here, so that we can send
@@ -232,9 +230,8 @@ class GazeboModelPluginEps : public FreeFlyerModelPlugin {
 
   // Manage the extrinsics based on the sensor type
   void BerthCallback() {
-    // Create a buffer and listener for TF2 transforms
-    static tf2_ros::Buffer buffer;
-    static tf2_ros::TransformListener listener(buffer);
+    // Use the TF2 buffer shared by all plugins
+    tf2_ros::Buffer &buffer = PluginScheduler::GetBuffer();
     static geometry_msgs::TransformStamped tf;
     // Get extrinsics from framestore
     try {
@@ -262,10 +259,10 @@ class GazeboModelPluginEps : public FreeFlyerModelPlugin {
         tf.transform.rotation.x,
         tf.transform.rotation.y,
         tf.transform.rotation.z);
-      // Kill the connection when we have a dock pose
-      event::Events::DisconnectWorldUpdateEnd(connection_);
+      // Stop looking up the berths when we have a dock pose
+      UnscheduleUpdate("berths");
       // Start an update check for force application
-      connection_ = event::Events::ConnectWorldUpdateBegin(
+      ScheduleUpdate("lock", 0.0,
         std::bind(&GazeboModelPluginEps::LockCallback, this));
       // Once we have berth locations start timer for checking dock status
       timer_update_.start();
@@ -349,7 +346,6 @@ class GazeboModelPluginEps : public FreeFlyerModelPlugin {
  private:
   ff_util::FSM fsm_;
   double rate_, distance_, delay_;
-  event::ConnectionPtr connection_;
   std::map<std::string, ignition::math::Pose3d> berths_;
   std::map<std::string, ignition::math::Pose3d>::iterator nearest_;
   ignition::math::Vector3d force_;
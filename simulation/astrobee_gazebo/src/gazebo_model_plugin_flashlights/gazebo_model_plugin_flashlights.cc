@@ -46,9 +46,7 @@ class GazeboModelPluginFlashlights : public FreeFlyerModelPlugin {
   GazeboModelPluginFlashlights() : FreeFlyerModelPlugin("flashlights"),
     rate_(10.0), width_(0.03), height_(0.02), depth_(0.005) {}
 
-  virtual ~GazeboModelPluginFlashlights() {
-    event::Events::DisconnectWorldUpdateEnd(connection_);
-  }
+  virtual ~GazeboModelPluginFlashlights() {}
 
  protected:
   // Called when the plugin is loaded into the simulator
@@ -87,18 +85,13 @@ class GazeboModelPluginFlashlights : public FreeFlyerModelPlugin {
         boost::bind(&GazeboModelPluginFlashlights::ToggleCallback, this,
           _1, _2, "flashlight_aft"));
 
-    // Called before each iteration of simulated world update
-    next_tick_ = GetWorld()->GetSimTime();
-    connection_ = event::Events::ConnectWorldUpdateEnd(std::bind(
-      &GazeboModelPluginFlashlights::UpdateCallback, this));
+    // Called after each iteration of simulated world update
+    ScheduleUpdate("lights", rate_, std::bind(
+      &GazeboModelPluginFlashlights::UpdateCallback, this), true);
   }
 
   // Called on every discrete time tick in the simulated world
   void UpdateCallback() {
-    // Keep throttline callbacks
-    if (GetWorld()->GetSimTime() < next_tick_)
-      return;
-    next_tick_ += 1.0 / rate_;
     // Update the flashlight
     Update("flashlight_front");
     Update("flashlight_aft");
@@ -115,15 +108,13 @@ class GazeboModelPluginFlashlights : public FreeFlyerModelPlugin {
 
   // Update implementation
   void Update(std::string const& name) {
-    // Create a buffer and listener for TF2 transforms
-    static tf2_ros::Buffer buffer;
-    static tf2_ros::TransformListener listener(buffer);
     // Check that we have the light
     if (lights_.find(name) == lights_.end()) {
       try {
         // Find the transform for this light
-        geometry_msgs::TransformStamped tf = buffer.lookupTransform(
-          GetFrame("body"), GetFrame(name), ros::Time(0));
+        geometry_msgs::TransformStamped tf =
+          PluginScheduler::GetBuffer().lookupTransform(
+            GetFrame("body"), GetFrame(name), ros::Time(0));
         // Add a light
         lights_[name] = ignition::math::Pose3d(
           tf.transform.translation.x,
@@ -164,7 +155,7 @@ class GazeboModelPluginFlashlights : public FreeFlyerModelPlugin {
           ignition::math::Vector3d(depth_, width_, height_));
         msg_v.mutable_material()->mutable_script()->set_name("Astrobee/Flashlight");
         msgs::Set(msg_v.mutable_pose(),
-          lights_[name] + GetModel()->GetLink()->GetWorldPose().Ign());
+          lights_[name] + GetState().link_pose.Ign());
         msg_v.set_is_static(false);
         msg_v.set_visible(true);
         msg_v.set_cast_shadows(false);
@@ -185,7 +176,7 @@ class GazeboModelPluginFlashlights : public FreeFlyerModelPlugin {
         msgs::Set(msg_l.mutable_diffuse(), common::Color(0.5, 0.5, 0.5, 1));
         msgs::Set(msg_l.mutable_specular(), common::Color(0.1, 0.1, 0.1, 1));
         msgs::Set(msg_l.mutable_pose(),
-          lights_[name] + GetModel()->GetLink()->GetWorldPose().Ign());
+          lights_[name] + GetState().link_pose.Ign());
         pub_factory_->Publish(msg_l);
       // Silently ignore all invalid transform
       } catch (tf2::TransformException &ex) {}
@@ -195,14 +186,14 @@ class GazeboModelPluginFlashlights : public FreeFlyerModelPlugin {
       msg_v.set_name(name);
       msg_v.set_parent_name(GetModel()->GetLink("body")->GetScopedName());
       msgs::Set(msg_v.mutable_pose(),
-        lights_[name] + GetModel()->GetLink()->GetWorldPose().Ign());
+        lights_[name] + GetState().link_pose.Ign());
       pub_visual_->Publish(msg_v);
       // Update the gazebo light
       static msgs::Light msg_l;
       msg_l.set_name(name + "_light");
       msgs::Set(msg_l.mutable_pose(),
         ignition::math::Pose3d(0.0, 0, 0, 0.70710678, 0, -0.70710678, 0)
-          + lights_[name] + GetModel()->GetLink()->GetWorldPose().Ign());
+          + lights_[name] + GetState().link_pose.Ign());
       pub_light_->Publish(msg_l);
       // Update the marker
       markers_[name].header.stamp = ros::Time();
@@ -239,10 +230,8 @@ class GazeboModelPluginFlashlights : public FreeFlyerModelPlugin {
 
  private:
   double rate_, width_, height_, depth_;
-  common::Time next_tick_;
   transport::NodePtr gz_;
   transport::PublisherPtr pub_visual_, pub_factory_, pub_light_;
-  event::ConnectionPtr connection_;
   ros::NodeHandle nh_;
   ros::ServiceServer srv_f_, srv_a_;
   ros::Publisher pub_rviz_;
@@ -121,20 +121,18 @@ class GazeboModelPluginLaser : public FreeFlyerModelPlugin {
       &GazeboModelPluginLaser::ToggleCallback, this);
 
     // Defer the extrinsics setup to allow plugins to load
-    connection_ = event::Events::ConnectWorldUpdateEnd(std::bind(
-      &GazeboModelPluginLaser::ExtrinsicsCallback, this));
+    ScheduleUpdate("extrinsics", 0.0, std::bind(
+      &GazeboModelPluginLaser::ExtrinsicsCallback, this), true);
   }
 
   // Manage the extrinsics based on the sensor type
   void ExtrinsicsCallback() {
-    // Create a buffer and listener for TF2 transforms
-    static tf2_ros::Buffer buffer;
-    static tf2_ros::TransformListener listener(buffer);
     // Get extrinsics from framestore
     try {
       // Lookup the transform for this sensor
-      geometry_msgs::TransformStamped tf = buffer.lookupTransform(
-        GetFrame("body"), GetFrame("laser"), ros::Time(0));
+      geometry_msgs::TransformStamped tf =
+        PluginScheduler::GetBuffer().lookupTransform(
+          GetFrame("body"), GetFrame("laser"), ros::Time(0));
       // Handle the transform for all sensor types
       pose_ = pose_ + ignition::math::Pose3d(
         tf.transform.translation.x,
@@ -144,11 +142,10 @@ class GazeboModelPluginLaser : public FreeFlyerModelPlugin {
         tf.transform.rotation.x,
         tf.transform.rotation.y,
         tf.transform.rotation.z);
-      // Kill the connection
-      event::Events::DisconnectWorldUpdateEnd(connection_);
-      // Update the connection
-      next_tick_ = GetWorld()->GetSimTime();
-      connection_ = event::Events::ConnectWorldUpdateBegin(
+      // Stop looking up the extrinsics
+      UnscheduleUpdate("extrinsics");
+      // Update the laser pose at its rate
+      ScheduleUpdate("laser", rate_,
         std::bind(&GazeboModelPluginLaser::UpdateCallback, this));
       gzmsg << "Extrinsics set for laser\n";
     } catch (tf2::TransformException &ex) {
@@ -178,14 +175,8 @@ class GazeboModelPluginLaser : public FreeFlyerModelPlugin {
 
   // Called on every discrete time tick in the simulated world
   void UpdateCallback() {
-    // Throttle callback rate
-    if (GetWorld()->GetSimTime() < next_tick_)
-      return;
-    next_tick_ += 1.0 / rate_;
-
     // Update gazebo
-    msgs::Set(msg_.mutable_pose(),
-      pose_ + GetModel()->GetLink()->GetWorldPose().Ign());
+    msgs::Set(msg_.mutable_pose(), pose_ + GetState().link_pose.Ign());
     pub_->Publish(msg_);
 
     // Update RVIZ
@@ -195,11 +186,9 @@ class GazeboModelPluginLaser : public FreeFlyerModelPlugin {
 
  private:
   double rate_, range_, width_;
-  common::Time next_tick_;
   transport::NodePtr gz_;
   transport::PublisherPtr pub_;
   msgs::Visual msg_;
-  event::ConnectionPtr connection_;
   ros::Timer timer_;
   ros::NodeHandle nh_;
   ros::ServiceServer srv_;
@@ -175,16 +175,10 @@ class GazeboModelPluginPerchingArm : public FreeFlyerModelPlugin {
       &GazeboModelPluginPerchingArm::CalibrateGripperCallback, this);
 
     // Called before each iteration of simulated world update
-    next_tick_ = GetWorld()->GetSimTime();
-    update_ = event::Events::ConnectWorldUpdateBegin(
+    ScheduleUpdate("joints", rate_,
       std::bind(&GazeboModelPluginPerchingArm::UpdateCallback, this));
   }
 
-  // Called on simulation reset
-  void Reset() {
-    next_tick_ = GetWorld()->GetSimTime();
-  }
-
   // GET THE VIRTUAL GRIPPER JOINT STATE
 
   // Get the position and veloctity of a virtual "gripper" joint, which
@@ -302,10 +296,6 @@ class GazeboModelPluginPerchingArm : public FreeFlyerModelPlugin {
 
   // Called on every discrete time tick in the simulated world
   void UpdateCallback() {
-    // Throttle callback rate
-    if (GetWorld()->GetSimTime() < next_tick_)
-      return;
-    next_tick_ += 1.0 / rate_;
     // Package all joint states, inclusind the left and right proximal
     // and distal joints of the gripper (for visualization reasons)
     msg_.header.stamp = ros::Time::now();
@@ -369,13 +359,11 @@ class GazeboModelPluginPerchingArm : public FreeFlyerModelPlugin {
  private:
   double rate_;                   // Rate of joint state update
   std::string bay_;               // Prefix to avoid name collisions
-  common::Time next_tick_;        // Next update tick
   ros::Publisher pub_;            // Joint state publisher
   ros::Subscriber sub_;           // Joint goal subscriber
   ros::ServiceServer srv_p_;      // Set max pan velocity
   ros::ServiceServer srv_t_;      // Set max tilt velcoity
   ros::ServiceServer srv_c_;      // Calibrate gripper
-  event::ConnectionPtr update_;   // Callback for world updates
   physics::Joint_V joints_;       // List of joints in system
   sensor_msgs::JointState msg_;   // Joint state message
   common::PID pid_prox_p_;        // PID : arm proximal position
@@ -38,6 +38,9 @@
 #include <astrobee_gazebo/astrobee_gazebo.h>
 
 // STL includes
+#include <chrono>  // NOLINT
+#include <condition_variable>  // NOLINT
+#include <mutex>  // NOLINT
 #include <string>
 
 namespace gazebo {
@@ -52,7 +55,8 @@ class GazeboModelPluginPmc : public FreeFlyerModelPlugin {
 
   // Constructor
   GazeboModelPluginPmc() : FreeFlyerModelPlugin("pmc_actuator", true),
-    pmc_enabled_(true) {}
+    pmc_enabled_(true), lockstep_(false), lockstep_timeout_(1.0),
+    commands_(0), commands_stepped_(0) {}
 
   // Destructor
   virtual ~GazeboModelPluginPmc() {}
@@ -62,6 +66,7 @@ class GazeboModelPluginPmc : public FreeFlyerModelPlugin {
   void LoadCallback(ros::NodeHandle *nh,
     physics::ModelPtr model, sdf::ElementPtr sdf) {
     config_params.AddFile("hw/pmc_actuator.config");
+    config_params.AddFile("simulation/lockstep.config");
     if (!GetParams()) {
       ROS_ERROR("PMC Actuator: Failed to get parameters.");
       AssertFault("INITIALIZATION_FAULT", "Could not get PMC parameters");
@@ -91,10 +96,18 @@ class GazeboModelPluginPmc : public FreeFlyerModelPlugin {
     timer_ = nh->createTimer(ros::Duration(20.0/control_rate_hz_),
       &GazeboModelPluginPmc::WatchdogCallback, this, false, true);
 
-    // Called before each iteration of simulated world update
-    next_tick_ = GetWorld()->GetSimTime();
-    update_ = event::Events::ConnectWorldUpdateBegin(
-      std::bind(&GazeboModelPluginPmc::WorldUpdateCallback, this));
+    // In lockstep the world is stepped as fast as the commands come back
+    if (lockstep_) {
+      GetWorld()->GetPhysicsEngine()->SetRealTimeUpdateRate(0.0);
+      ROS_INFO("PMC Actuator: stepping in lockstep with the PMC commands.");
+    }
+
+    // Step the blowers at the control rate, and apply their wrench before
+    // each iteration of simulated world update
+    ScheduleUpdate("control", control_rate_hz_,
+      std::bind(&GazeboModelPluginPmc::ControlCallback, this));
+    ScheduleUpdate("wrench", 0.0,
+      std::bind(&GazeboModelPluginPmc::WrenchCallback, this));
 
     // Set all initial PMC states to UNKNOWN and publish
     state_.header.frame_id = frame_id_;
@@ -138,15 +151,19 @@ class GazeboModelPluginPmc : public FreeFlyerModelPlugin {
       ROS_FATAL("PMC Actuator: state_tol_rads_per_sec not specified!");
       return false;
     }
+    // get the lockstep settings
+    if (!config_params.GetBool("lockstep", &lockstep_)) {
+      ROS_FATAL("PMC Actuator: lockstep not specified!");
+      return false;
+    }
+    if (!config_params.GetPosReal("lockstep_timeout", &lockstep_timeout_)) {
+      ROS_FATAL("PMC Actuator: lockstep_timeout not specified!");
+      return false;
+    }
     // Success
     return true;
   }
 
-  // Called on simulation reset
-  virtual void Reset() {
-    next_tick_ = GetWorld()->GetSimTime();
-  }
-
   // This is called whenever the controller has new force/torque to apply
   void CommandCallback(ff_hw_msgs::PmcCommand const& msg) {
     // Immediately reset the watchdog timer
@@ -158,6 +175,25 @@ class GazeboModelPluginPmc : public FreeFlyerModelPlugin {
       SendCommand(msg);
     else
       SendCommand(null_command_);
+    // Let a world update waiting for this command go on
+    if (lockstep_) {
+      std::lock_guard<std::mutex> lock(lockstep_mutex_);
+      commands_++;
+      lockstep_cv_.notify_one();
+    }
+  }
+
+  // In lockstep, wait for a command to have come in since the last tick. We
+  // only wait once the flight software has sent a first command, and never
+  // for longer than the timeout, so the world still steps without it.
+  void WaitForCommand() {
+    std::unique_lock<std::mutex> lock(lockstep_mutex_);
+    if (commands_ > 0 && commands_ == commands_stepped_ &&
+      !lockstep_cv_.wait_for(lock,
+        std::chrono::duration<double>(lockstep_timeout_),
+        [this]() { return commands_ != commands_stepped_; }))
+      ROS_WARN_THROTTLE(5, "PMC Actuator: no command in lockstep, stepping.");
+    commands_stepped_ = commands_;
   }
 
   // If this is *ever* called, it means a FAM command was not received - note
@@ -246,30 +282,31 @@ class GazeboModelPluginPmc : public FreeFlyerModelPlugin {
     return true;
   }
 
-  // Called on each sensor update event
-  void WorldUpdateCallback() {
-    // Throttle callback rate
-    if (GetWorld()->GetSimTime() >= next_tick_) {
-      next_tick_ += 1.0 / control_rate_hz_;
-      // Set the angular velocity
-      blowers_.SetAngularVelocity(
-        GetLink()->GetRelativeAngularVel().x,
-        GetLink()->GetRelativeAngularVel().y,
-        GetLink()->GetRelativeAngularVel().z);
-      // Set the battery voltage
-      blowers_.SetBatteryVoltage(14.0);
-      // Step the system
-      blowers_.Step();
-      // Extract and apply the force and torque for the blowers
-      force_ = math::Vector3(0, 0, 0);
-      torque_ = math::Vector3(0, 0, 0);
-      for (size_t i = 0; i < NUMBER_OF_PMCS; i++) {
-        force_ += math::Vector3(blowers_.states_[i].force_B[0],
-          blowers_.states_[i].force_B[1], blowers_.states_[i].force_B[2]);
-        torque_ += math::Vector3(blowers_.states_[i].torque_B[0],
-          blowers_.states_[i].torque_B[1], blowers_.states_[i].torque_B[2]);
-      }
+  // Called on every control tick in the simulated world
+  void ControlCallback() {
+    // Hold the world until the command for the last tick is in
+    if (lockstep_)
+      WaitForCommand();
+    // Set the angular velocity
+    math::Vector3 const& omega = GetState().relative_angular_vel;
+    blowers_.SetAngularVelocity(omega.x, omega.y, omega.z);
+    // Set the battery voltage
+    blowers_.SetBatteryVoltage(14.0);
+    // Step the system
+    blowers_.Step();
+    // Extract and apply the force and torque for the blowers
+    force_ = math::Vector3(0, 0, 0);
+    torque_ = math::Vector3(0, 0, 0);
+    for (size_t i = 0; i < NUMBER_OF_PMCS; i++) {
+      force_ += math::Vector3(blowers_.states_[i].force_B[0],
+        blowers_.states_[i].force_B[1], blowers_.states_[i].force_B[2]);
+      torque_ += math::Vector3(blowers_.states_[i].torque_B[0],
+        blowers_.states_[i].torque_B[1], blowers_.states_[i].torque_B[2]);
     }
+  }
+
+  // Called on each world update event
+  void WrenchCallback() {
     // Apply the force and torque to the model
     GetLink()->AddRelativeForce(force_);
     GetLink()->AddRelativeTorque(torque_);
@@ -277,7 +314,6 @@ class GazeboModelPluginPmc : public FreeFlyerModelPlugin {
 
  private:
   config_reader::ConfigReader config_params;        // LUA configuration reader
-  common::Time next_tick_;                          // Delta timer for gazebo
   ros::Publisher pub_telemetry_, pub_state_;        // State/telemetry pubs
   ros::Subscriber sub_command_;                     // Command subscriber
   ros::Timer timer_;                                // Watchdog timer
@@ -285,7 +321,6 @@ class GazeboModelPluginPmc : public FreeFlyerModelPlugin {
   math::Vector3 torque_;                            // Current body-frame torque
   gnc_autocode::GncBlowersAutocode blowers_;        // Autocode blower iface
   ff_hw_msgs::PmcCommand null_command_;             // PMC null command
-  event::ConnectionPtr update_;                     // Update event from gazeo
   ff_hw_msgs::PmcTelemetry telemetry_vector_;       // Telemetry
   ff_hw_msgs::PmcState state_;                      // State of the PMCs
   bool pmc_enabled_;                                // Is the PMC enabled?
@@ -294,6 +329,12 @@ class GazeboModelPluginPmc : public FreeFlyerModelPlugin {
   double state_tol_rads_per_sec_;                   // RPM tolerance
   double control_rate_hz_;                          // Control rate
   std::string frame_id_;                            // Frame
+  bool lockstep_;                                   // Step with the commands?
+  double lockstep_timeout_;                         // Longest wait, seconds
+  std::mutex lockstep_mutex_;                       // Guards the counts
+  std::condition_variable lockstep_cv_;             // Signals a new command
+  uint64_t commands_;                               // Commands received
+  uint64_t commands_stepped_;                       // Commands at last tick
 };
 
 // Register this plugin with the simulator
@@ -63,57 +63,47 @@ class GazeboModelPluginTruth : public FreeFlyerModelPlugin {
       TOPIC_LOCALIZATION_TRUTH_TWIST, 100);
 
     // Called before each iteration of simulated world update
-    next_tick_ = GetWorld()->GetSimTime();
-    update_ = event::Events::ConnectWorldUpdateBegin(
+    ScheduleUpdate("truth", rate_,
       std::bind(&GazeboModelPluginTruth::Update, this));
   }
 
-  // Called on simulation reset
-  virtual void Reset() {
-    next_tick_ = GetWorld()->GetSimTime();
-  }
-
   // Called on every discrete time tick in the simulated world
   virtual void Update() {
-    if (GetWorld()->GetSimTime() >= next_tick_) {
-      next_tick_ += 1.0 / rate_;
-      static tf2_ros::TransformBroadcaster br;
-      msg_.header.stamp = ros::Time::now();
-      msg_.transform.translation.x = GetModel()->GetWorldPose().pos.x;
-      msg_.transform.translation.y = GetModel()->GetWorldPose().pos.y;
-      msg_.transform.translation.z = GetModel()->GetWorldPose().pos.z;
-      msg_.transform.rotation.x = GetModel()->GetWorldPose().rot.x;
-      msg_.transform.rotation.y = GetModel()->GetWorldPose().rot.y;
-      msg_.transform.rotation.z = GetModel()->GetWorldPose().rot.z;
-      msg_.transform.rotation.w = GetModel()->GetWorldPose().rot.w;
-      br.sendTransform(msg_);
-      // Pose
-      ros_truth_pose_.header = msg_.header;
-      ros_truth_pose_.pose.position.x = GetModel()->GetWorldPose().pos.x;
-      ros_truth_pose_.pose.position.y = GetModel()->GetWorldPose().pos.y;
-      ros_truth_pose_.pose.position.z = GetModel()->GetWorldPose().pos.z;
-      ros_truth_pose_.pose.orientation.x = GetModel()->GetWorldPose().rot.x;
-      ros_truth_pose_.pose.orientation.y = GetModel()->GetWorldPose().rot.y;
-      ros_truth_pose_.pose.orientation.z = GetModel()->GetWorldPose().rot.z;
-      ros_truth_pose_.pose.orientation.w = GetModel()->GetWorldPose().rot.w;
-      pub_truth_pose_.publish(ros_truth_pose_);
-      // Twist
-      ros_truth_twist_.header = msg_.header;
-      ros_truth_twist_.twist.linear.x = GetModel()->GetWorldLinearVel().x;
-      ros_truth_twist_.twist.linear.y = GetModel()->GetWorldLinearVel().y;
-      ros_truth_twist_.twist.linear.z = GetModel()->GetWorldLinearVel().z;
-      ros_truth_twist_.twist.angular.x = GetModel()->GetWorldAngularVel().x;
-      ros_truth_twist_.twist.angular.y = GetModel()->GetWorldAngularVel().y;
-      ros_truth_twist_.twist.angular.z = GetModel()->GetWorldAngularVel().z;
-      pub_truth_twist_.publish(ros_truth_twist_);
-    }
+    static tf2_ros::TransformBroadcaster br;
+    PluginScheduler::State const& state = GetState();
+    msg_.header.stamp = ros::Time::now();
+    msg_.transform.translation.x = state.model_pose.pos.x;
+    msg_.transform.translation.y = state.model_pose.pos.y;
+    msg_.transform.translation.z = state.model_pose.pos.z;
+    msg_.transform.rotation.x = state.model_pose.rot.x;
+    msg_.transform.rotation.y = state.model_pose.rot.y;
+    msg_.transform.rotation.z = state.model_pose.rot.z;
+    msg_.transform.rotation.w = state.model_pose.rot.w;
+    br.sendTransform(msg_);
+    // Pose
+    ros_truth_pose_.header = msg_.header;
+    ros_truth_pose_.pose.position.x = state.model_pose.pos.x;
+    ros_truth_pose_.pose.position.y = state.model_pose.pos.y;
+    ros_truth_pose_.pose.position.z = state.model_pose.pos.z;
+    ros_truth_pose_.pose.orientation.x = state.model_pose.rot.x;
+    ros_truth_pose_.pose.orientation.y = state.model_pose.rot.y;
+    ros_truth_pose_.pose.orientation.z = state.model_pose.rot.z;
+    ros_truth_pose_.pose.orientation.w = state.model_pose.rot.w;
+    pub_truth_pose_.publish(ros_truth_pose_);
+    // Twist
+    ros_truth_twist_.header = msg_.header;
+    ros_truth_twist_.twist.linear.x = state.linear_vel.x;
+    ros_truth_twist_.twist.linear.y = state.linear_vel.y;
+    ros_truth_twist_.twist.linear.z = state.linear_vel.z;
+    ros_truth_twist_.twist.angular.x = state.angular_vel.x;
+    ros_truth_twist_.twist.angular.y = state.angular_vel.y;
+    ros_truth_twist_.twist.angular.z = state.angular_vel.z;
+    pub_truth_twist_.publish(ros_truth_twist_);
   }
 
  private:
   double rate_;
-  common::Time next_tick_;
   geometry_msgs::TransformStamped msg_;
-  event::ConnectionPtr update_;
   geometry_msgs::PoseStamped ros_truth_pose_;
   geometry_msgs::TwistStamped ros_truth_twist_;
   ros::Publisher pub_truth_pose_;
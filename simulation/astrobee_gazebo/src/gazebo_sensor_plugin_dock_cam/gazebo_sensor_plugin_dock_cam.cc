@@ -28,6 +28,7 @@
 
 // FSW includes
 #include <config_reader/config_reader.h>
+#include <is_camera/frame_ring.h>
 
 // STL includes
 #include <string>
@@ -71,6 +72,21 @@ class GazeboSensorPluginDockCam : public FreeFlyerSensorPlugin {
     }
     msg_.data.resize(msg_.step * msg_.height);
 
+    // Frames are also written to shared memory, as the camera driver does.
+    // Color frames go in as they are rendered, three bytes per pixel.
+    config_reader::ConfigReader config;
+    config.AddFile("cameras.config");
+    int slots = 0;
+    if (!config.ReadFiles() || !config.GetInt("frame_ring_slots", &slots))
+      ROS_ERROR("Could not read frame_ring_slots from cameras.config.");
+    if (slots > 0) {
+      std::string ring_name = "/frame_ring_dock_cam";
+      if (!GetPlatform().empty())
+        ring_name += "_" + GetPlatform();
+      if (!ring_.Create(ring_name, slots, msg_.step * msg_.height))
+        ROS_ERROR_STREAM("Could not create the frame ring " << ring_name);
+    }
+
     // Create a publisher
     pub_ = nh->advertise < sensor_msgs::Image > (TOPIC_HARDWARE_DOCK_CAM, 100,
       boost::bind(&GazeboSensorPluginDockCam::ToggleCallback, this),
@@ -79,11 +95,13 @@ class GazeboSensorPluginDockCam : public FreeFlyerSensorPlugin {
     // Connect to the camera update event.
     update_ = sensor_->ConnectUpdated(
       std::bind(&GazeboSensorPluginDockCam::UpdateCallback, this));
+    if (ring_.IsOpen())
+      sensor_->SetActive(true);
   }
 
-  // Turn camera on or off based on topic subscription
+  // Turn camera on or off based on topic subscription, or the frame ring
   void ToggleCallback() {
-    if (pub_.getNumSubscribers() > 0)
+    if (pub_.getNumSubscribers() > 0 || ring_.IsOpen())
       sensor_->SetActive(true);
     else
       sensor_->SetActive(false);
@@ -95,6 +113,15 @@ class GazeboSensorPluginDockCam : public FreeFlyerSensorPlugin {
       return;
     msg_.header.stamp.sec = sensor_->LastMeasurementTime().sec;
     msg_.header.stamp.nsec = sensor_->LastMeasurementTime().nsec;
+    if (ring_.IsOpen()) {
+      uint8_t* slot = ring_.BeginWrite(msg_.width, msg_.height, msg_.step);
+      if (slot) {
+        memcpy(slot, sensor_->ImageData(), msg_.step * msg_.height);
+        ring_.EndWrite(msg_.header.stamp.sec, msg_.header.stamp.nsec);
+      }
+      if (pub_.getNumSubscribers() == 0)
+        return;
+    }
     memmove(msg_.data.data(), sensor_->ImageData(), msg_.step * msg_.height);
     pub_.publish(msg_);
   }
@@ -104,6 +131,7 @@ class GazeboSensorPluginDockCam : public FreeFlyerSensorPlugin {
   sensors::WideAngleCameraSensorPtr sensor_;
   sensor_msgs::Image msg_;
   event::ConnectionPtr update_;
+  is_camera::FrameRing ring_;
 };
 
 GZ_REGISTER_SENSOR_PLUGIN(GazeboSensorPluginDockCam)
@@ -26,6 +26,10 @@
 #include <sensor_msgs/Image.h>
 #include <sensor_msgs/image_encodings.h>
 
+// FSW includes
+#include <config_reader/config_reader.h>
+#include <is_camera/frame_ring.h>
+
 // STL includes
 #include <string>
 
@@ -54,17 +58,62 @@ class GazeboSensorPluginNavCam : public FreeFlyerSensorPlugin {
       ROS_FATAL_STREAM("Camera format must be L8");
 
     // Create a publisher
-    pub_img_ = nh->advertise<sensor_msgs::Image>(TOPIC_HARDWARE_NAV_CAM, 100);
+    pub_img_ = nh->advertise<sensor_msgs::Image>(TOPIC_HARDWARE_NAV_CAM, 100,
+      boost::bind(&GazeboSensorPluginNavCam::ToggleCallback, this),
+      boost::bind(&GazeboSensorPluginNavCam::ToggleCallback, this));
+
+    // Frames are also written to shared memory, as the camera driver does
+    config_reader::ConfigReader config;
+    config.AddFile("cameras.config");
+    int slots = 0;
+    if (!config.ReadFiles() || !config.GetInt("frame_ring_slots", &slots))
+      ROS_ERROR("Could not read frame_ring_slots from cameras.config.");
+    if (slots > 0) {
+      std::string ring_name = "/frame_ring_nav_cam";
+      if (!GetPlatform().empty())
+        ring_name += "_" + GetPlatform();
+      if (!ring_.Create(ring_name, slots,
+        sensor_->ImageWidth() * sensor_->ImageHeight()))
+        ROS_ERROR_STREAM("Could not create the frame ring " << ring_name);
+    }
 
     // Connect to the camera update event.
     connection_ = sensor_->ConnectUpdated(
       std::bind(&GazeboSensorPluginNavCam::UpdateCallback, this));
+
+    // Only render while someone reads the images
+    ToggleCallback();
+  }
+
+  // Turn camera on or off based on topic subscription, or the frame ring
+  void ToggleCallback() {
+    if (pub_img_.getNumSubscribers() > 0 || ring_.IsOpen())
+      sensor_->SetActive(true);
+    else
+      sensor_->SetActive(false);
   }
 
   // Called when a new image must be rendered
   void UpdateCallback() {
     // Only publish the image if the extrnsics are set
-    if (!ExtrinsicsFound()) return;
+    if (!sensor_->IsActive() || !ExtrinsicsFound()) return;
+    uint32_t width = sensor_->ImageWidth();
+    uint32_t height = sensor_->ImageHeight();
+    const uint8_t* data =
+      reinterpret_cast<const uint8_t*>(sensor_->ImageData());
+    // With a frame ring the render buffer is copied into the ring, and the
+    // message is only filled when someone subscribes to it
+    if (ring_.IsOpen()) {
+      uint8_t* slot = ring_.BeginWrite(width, height, width);
+      if (slot) {
+        std::copy(data, data + width * height, slot);
+        ring_.EndWrite(sensor_->LastMeasurementTime().sec,
+          sensor_->LastMeasurementTime().nsec);
+        data = slot;
+      }
+      if (pub_img_.getNumSubscribers() == 0)
+        return;
+    }
     // Construct and send the imahe
     static sensor_msgs::Image msg;
     msg.is_bigendian = false;
@@ -72,14 +121,11 @@ class GazeboSensorPluginNavCam : public FreeFlyerSensorPlugin {
     msg.header.stamp.sec = sensor_->LastMeasurementTime().sec;
     msg.header.stamp.nsec = sensor_->LastMeasurementTime().nsec;
     msg.encoding = sensor_msgs::image_encodings::MONO8;
-    msg.height = sensor_->ImageHeight();
-    msg.width = sensor_->ImageWidth();
+    msg.height = height;
+    msg.width = width;
     msg.step = msg.width;
     msg.data.resize(msg.step * msg.height);
-    std::copy(
-      reinterpret_cast<const uint8_t*>(sensor_->ImageData()),
-      reinterpret_cast<const uint8_t*>(sensor_->ImageData())
-        + msg.step * msg.height, msg.data.begin());
+    std::copy(data, data + msg.step * msg.height, msg.data.begin());
     pub_img_.publish(msg);
   }
 
@@ -87,6 +133,7 @@ class GazeboSensorPluginNavCam : public FreeFlyerSensorPlugin {
   ros::Publisher pub_img_;
   sensors::WideAngleCameraSensorPtr sensor_;
   event::ConnectionPtr connection_;
+  is_camera::FrameRing ring_;
 };
 
 GZ_REGISTER_SENSOR_PLUGIN(GazeboSensorPluginNavCam)
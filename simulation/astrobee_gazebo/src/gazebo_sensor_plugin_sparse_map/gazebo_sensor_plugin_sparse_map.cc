@@ -21,6 +21,7 @@
 
 // Sensor plugin interface
 #include <astrobee_gazebo/astrobee_gazebo.h>
+#include <astrobee_gazebo/ray_caster.h>
 
 // FSW includes
 #include <config_reader/config_reader.h>
@@ -35,7 +36,10 @@
 #include <camera/camera_params.h>
 
 // STL includes
+#include <memory>
+#include <random>
 #include <string>
+#include <vector>
 
 namespace gazebo {
 
@@ -43,7 +47,7 @@ class GazeboSensorPluginSparseMap : public FreeFlyerSensorPlugin {
  public:
   GazeboSensorPluginSparseMap() :
     FreeFlyerSensorPlugin("localization_node", "nav_cam", true),
-      active_(true), processing_(false) {}
+      active_(true), processing_(false), use_caster_(false) {}
 
   virtual ~GazeboSensorPluginSparseMap() {}
 
@@ -91,6 +95,19 @@ class GazeboSensorPluginSparseMap : public FreeFlyerSensorPlugin {
     if (!config_.GetUInt("num_features", &num_features_))
       ROS_FATAL("Could not read the num_features parameter.");
 
+    if (!config_.GetUInt("grid_step", &grid_step_) || grid_step_ == 0)
+      ROS_FATAL("Could not read the grid_step parameter.");
+
+    if (!config_.GetBool("static_ray_caster", &use_caster_))
+      ROS_FATAL("Could not read the static_ray_caster parameter.");
+
+    // The camera model does not change, so its rays are computed once, on
+    // a grid of pixels, along with where they are seen in the image
+    camera::CameraParameters cam_params(&config_, "nav_cam");
+    camera_.reset(new camera::CameraModel(Eigen::Vector3d(0, 0, 0),
+      Eigen::Matrix3d::Identity(), cam_params));
+    BuildGrid();
+
     // Create a publisher for the registration messages
     pub_reg_ = nh->advertise<ff_msgs::CameraRegistration>(
       TOPIC_LOCALIZATION_ML_REGISTRATION, 100);
@@ -128,11 +145,24 @@ class GazeboSensorPluginSparseMap : public FreeFlyerSensorPlugin {
 
   // Send a registration pulse
   void SendRegistration(ros::TimerEvent const& event) {
-    if (processing_ || !active_ || !ExtrinsicsFound()) return;
-    // Initialize and lock the physics engine
-    GetWorld()->GetPhysicsEngine()->InitForThread();
+    if (processing_ || !active_ || !ExtrinsicsFound() || grid_.empty()) return;
+    // The static world is only loaded once the robot is in it, so the ray
+    // caster is built on the first pulse. Without a mesh it is turned off.
+    if (use_caster_ && caster_.Empty()) {
+      caster_.AddWorld(GetWorld());
+      caster_.Build();
+      ROS_INFO_STREAM("Casting rays against " << caster_.NumTriangles()
+        << " static triangles.");
+      use_caster_ = !caster_.Empty();
+    }
+    // Initialize and lock the physics engine, unless the caster is used
     boost::unique_lock<boost::recursive_mutex> lock(*(
-      GetWorld()->GetPhysicsEngine()->GetPhysicsUpdateMutex()));
+      GetWorld()->GetPhysicsEngine()->GetPhysicsUpdateMutex()),
+      boost::defer_lock);
+    if (!use_caster_) {
+      GetWorld()->GetPhysicsEngine()->InitForThread();
+      lock.lock();
+    }
 
     // We are now processing an image
     processing_ = true;
@@ -168,11 +198,6 @@ class GazeboSensorPluginSparseMap : public FreeFlyerSensorPlugin {
           sensor_->Pose().Rot().Z()));
     Eigen::Affine3d wTs = wTb * bTs;
 
-    // Initialize the camera paremeters
-    camera::CameraParameters cam_params(&config_, "nav_cam");
-    camera::CameraModel camera(Eigen::Vector3d(0, 0, 0),
-      Eigen::Matrix3d::Identity(), cam_params);
-
     // Assemble the feature message
     msg_feat_.camera_id = msg_reg.camera_id;
     msg_feat_.pose.position.x = wTs.translation().x();
@@ -186,36 +211,35 @@ class GazeboSensorPluginSparseMap : public FreeFlyerSensorPlugin {
     msg_feat_.landmarks.clear();
 
     // Create a new ray in the world
+    std::uniform_int_distribution<size_t> pick(0, grid_.size() - 1);
     size_t i = 0;
     for (; i < num_samp_ && msg_feat_.landmarks.size() < num_features_; i++) {
-      // Get a ray through a random image coordinate
-      Eigen::Vector3d ray = camera.Ray(
-        (static_cast<double>(rand() % 1000) / 1000 - 0.5)  // NOLINT
-          * camera.GetParameters().GetDistortedSize()[0],
-        (static_cast<double>(rand() % 1000) / 1000 - 0.5)  // NOLINT
-          * camera.GetParameters().GetDistortedSize()[1]);
-
-      // Get the camera coordinate of the ray near and far clips
-      Eigen::Vector3d n_c = near_clip_ * ray;
-      Eigen::Vector3d f_c = far_clip_ * ray;
+      // Get a ray through a random pixel of the grid
+      GridRay const& ray = grid_[pick(rng_)];
 
       // Get the world coordinate of the ray near and far clips
-      Eigen::Vector3d n_w = wTs * n_c;
-      Eigen::Vector3d f_w = wTs * f_c;
+      Eigen::Vector3d n_w = wTs * (near_clip_ * ray.dir);
+      Eigen::Vector3d f_w = wTs * (far_clip_ * ray.dir);
 
       // Collision detection
       double dist;
-      std::string entity;
-
-      // Set the start anf end points of the ray
-      shape_->SetPoints(
-        ignition::math::Vector3d(n_w.x(), n_w.y(), n_w.z()),
-        ignition::math::Vector3d(f_w.x(), f_w.y(), f_w.z()));
-      shape_->GetIntersection(dist, entity);
-
-      // If we don't have an entity then we didnt collide
-      if (entity.empty())
-        continue;
+      if (use_caster_) {
+        if (!caster_.Cast(n_w, (f_w - n_w).normalized(),
+          far_clip_ - near_clip_, &dist))
+          continue;
+      } else {
+        std::string entity;
+
+        // Set the start anf end points of the ray
+        shape_->SetPoints(
+          ignition::math::Vector3d(n_w.x(), n_w.y(), n_w.z()),
+          ignition::math::Vector3d(f_w.x(), f_w.y(), f_w.z()));
+        shape_->GetIntersection(dist, entity);
+
+        // If we don't have an entity then we didnt collide
+        if (entity.empty())
+          continue;
+      }
 
       // Get the landmark coordinate
       Eigen::Vector3d p_w = n_w + dist * (f_w - n_w).normalized();
@@ -225,8 +249,8 @@ class GazeboSensorPluginSparseMap : public FreeFlyerSensorPlugin {
       landmark.x = p_w.x();
       landmark.y = p_w.y();
       landmark.z = p_w.z();
-      landmark.u = camera.ImageCoordinates(f_c)[0];
-      landmark.v = camera.ImageCoordinates(f_c)[1];
+      landmark.u = ray.u;
+      landmark.v = ray.v;
       msg_feat_.landmarks.push_back(landmark);
     }
 
@@ -235,6 +259,24 @@ class GazeboSensorPluginSparseMap : public FreeFlyerSensorPlugin {
     timer_delay_.start();
   }
 
+  // Compute the ray through every grid_step pixels of the image, as the
+  // samples were drawn before, and the image coordinate it projects to
+  void BuildGrid() {
+    Eigen::Vector2i size = camera_->GetParameters().GetDistortedSize();
+    grid_.clear();
+    grid_.reserve((size[0] / grid_step_ + 1) * (size[1] / grid_step_ + 1));
+    for (int y = -size[1] / 2; y < size[1] / 2; y += grid_step_) {
+      for (int x = -size[0] / 2; x < size[0] / 2; x += grid_step_) {
+        GridRay ray;
+        ray.dir = camera_->Ray(x, y);
+        Eigen::Vector2d uv = camera_->ImageCoordinates(far_clip_ * ray.dir);
+        ray.u = uv[0];
+        ray.v = uv[1];
+        grid_.push_back(ray);
+      }
+    }
+  }
+
   // Called when featured must be sent
   void SendFeatures(ros::TimerEvent const& event) {
     if (!processing_ || !active_ || !ExtrinsicsFound()) return;
@@ -250,6 +292,12 @@ class GazeboSensorPluginSparseMap : public FreeFlyerSensorPlugin {
   }
 
  private:
+  // A ray of the camera and its image coordinates
+  struct GridRay {
+    Eigen::Vector3d dir;
+    double u, v;
+  };
+
   config_reader::ConfigReader config_;
   ros::Publisher pub_reg_, pub_feat_;
   ros::ServiceServer srv_enable_;
@@ -265,6 +313,12 @@ class GazeboSensorPluginSparseMap : public FreeFlyerSensorPlugin {
   double far_clip_;
   unsigned int num_features_;
   unsigned int num_samp_;
+  unsigned int grid_step_;
+  std::unique_ptr<camera::CameraModel> camera_;
+  std::vector<GridRay> grid_;
+  std::mt19937 rng_;
+  bool use_caster_;
+  RayCaster caster_;
 };
 
 GZ_REGISTER_SENSOR_PLUGIN(GazeboSensorPluginSparseMap)
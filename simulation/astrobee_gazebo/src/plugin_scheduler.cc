@@ -0,0 +1,218 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <astrobee_gazebo/plugin_scheduler.h>
+
+// Transformation helper code
+#include <tf2_ros/transform_listener.h>
+
+// Config reader
+#include <config_reader/config_reader.h>
+
+// STL includes
+#include <algorithm>
+#include <map>
+#include <sstream>
+
+namespace gazebo {
+
+namespace {
+
+// The scheduler config, read once for all the plugins
+struct Settings {
+  Settings() : shared(false), report_period(0.0) {
+    config_reader::ConfigReader config;
+    config.AddFile("simulation/scheduler.config");
+    if (!config.ReadFiles()) {
+      ROS_WARN("Plugin scheduler: unable to load lua parameters, "
+        "running every plugin on its own.");
+      return;
+    }
+    if (!config.GetBool("scheduler_shared", &shared))
+      ROS_WARN("Plugin scheduler: scheduler_shared not specified!");
+    if (!config.GetReal("scheduler_report_period", &report_period))
+      ROS_WARN("Plugin scheduler: scheduler_report_period not specified!");
+  }
+  bool shared;
+  double report_period;
+};
+
+Settings const& GetSettings() {
+  static Settings settings;
+  return settings;
+}
+
+}  // namespace
+
+PluginScheduler::Ptr PluginScheduler::Get(physics::ModelPtr model) {
+  if (!GetSettings().shared)
+    return std::make_shared<PluginScheduler>(model);
+  // The scheduler lives as long as one plugin of the model holds it
+  static std::mutex mutex;
+  static std::map<std::string, std::weak_ptr<PluginScheduler>> schedulers;
+  std::lock_guard<std::mutex> lock(mutex);
+  Ptr scheduler = schedulers[model->GetScopedName()].lock();
+  if (!scheduler) {
+    scheduler = std::make_shared<PluginScheduler>(model);
+    schedulers[model->GetScopedName()] = scheduler;
+  }
+  return scheduler;
+}
+
+tf2_ros::Buffer& PluginScheduler::GetBuffer() {
+  static tf2_ros::Buffer buffer;
+  static tf2_ros::TransformListener listener(buffer);
+  return buffer;
+}
+
+PluginScheduler::PluginScheduler(physics::ModelPtr model) :
+  model_(model), world_(model->GetWorld()),
+    report_period_(GetSettings().report_period),
+      step_(0), state_step_(std::numeric_limits<uint64_t>::max()) {
+  last_ = world_->GetSimTime();
+  next_report_ = last_ + report_period_;
+}
+
+PluginScheduler::~PluginScheduler() {
+  if (begin_)
+    event::Events::DisconnectWorldUpdateBegin(begin_);
+  if (end_)
+    event::Events::DisconnectWorldUpdateEnd(end_);
+}
+
+void PluginScheduler::Add(std::string const& name, double rate,
+  Callback callback, bool end) {
+  TaskPtr task = std::make_shared<Task>();
+  task->name = name;
+  task->period = (rate > 0.0 ? 1.0 / rate : 0.0);
+  task->end = end;
+  task->callback = callback;
+  task->next = world_->GetSimTime();
+  task->active = true;
+  task->calls = 0;
+  task->total = 0.0;
+  task->max = 0.0;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (std::vector<TaskPtr>::iterator it = tasks_.begin();
+    it != tasks_.end(); it++) {
+    if ((*it)->name != name)
+      continue;
+    (*it)->active = false;
+    tasks_.erase(it);
+    break;
+  }
+  tasks_.push_back(task);
+  Connect(end);
+}
+
+void PluginScheduler::Remove(std::string const& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (std::vector<TaskPtr>::iterator it = tasks_.begin();
+    it != tasks_.end(); it++) {
+    if ((*it)->name != name)
+      continue;
+    (*it)->active = false;
+    tasks_.erase(it);
+    return;
+  }
+}
+
+PluginScheduler::State const& PluginScheduler::GetState() {
+  if (state_step_ != step_) {
+    state_.model_pose = model_->GetWorldPose();
+    state_.linear_vel = model_->GetWorldLinearVel();
+    state_.angular_vel = model_->GetWorldAngularVel();
+    physics::LinkPtr link = model_->GetLink();
+    state_.link_pose = link->GetWorldPose();
+    state_.relative_linear_vel = link->GetRelativeLinearVel();
+    state_.relative_angular_vel = link->GetRelativeAngularVel();
+    state_step_ = step_;
+  }
+  return state_;
+}
+
+// Called with the mutex held
+void PluginScheduler::Connect(bool end) {
+  if (!end && !begin_) {
+    begin_ = event::Events::ConnectWorldUpdateBegin(
+      std::bind(&PluginScheduler::Update, this, false));
+  }
+  if (end && !end_) {
+    end_ = event::Events::ConnectWorldUpdateEnd(
+      std::bind(&PluginScheduler::Update, this, true));
+  }
+}
+
+void PluginScheduler::Update(bool end) {
+  common::Time now = world_->GetSimTime();
+  // The state is read again after the physics step
+  step_ = 2 * world_->GetIterations() + (end ? 1 : 0);
+  // Take a copy of the tasks so that callbacks can add or remove them
+  std::vector<TaskPtr> tasks;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Restart the tasks when the world is reset
+    if (now < last_) {
+      for (TaskPtr const& task : tasks_)
+        task->next = now;
+      next_report_ = now + report_period_;
+    }
+    last_ = now;
+    tasks = tasks_;
+  }
+  for (TaskPtr const& task : tasks) {
+    if (task->end != end || !task->active)
+      continue;
+    // Throttle the callback rate
+    if (task->period > 0.0) {
+      if (now < task->next)
+        continue;
+      task->next += task->period;
+    }
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+    task->callback();
+    double cost = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+    task->calls++;
+    task->total += cost;
+    task->max = std::max(task->max, cost);
+  }
+  if (report_period_ > 0.0 && now >= next_report_)
+    Report(now, tasks);
+}
+
+// Print the cost of each task since the last report
+void PluginScheduler::Report(common::Time const& now,
+  std::vector<TaskPtr> const& tasks) {
+  next_report_ = now + report_period_;
+  std::ostringstream oss;
+  oss << "Plugin cost for " << model_->GetName() << " over the last "
+      << report_period_ << " s:";
+  for (TaskPtr const& task : tasks) {
+    oss << "\n  " << task->name << ": " << task->calls << " calls, "
+        << 1000.0 * task->total / std::max(task->calls, size_t(1))
+        << " ms mean, " << 1000.0 * task->max << " ms max";
+    task->calls = 0;
+    task->total = 0.0;
+    task->max = 0.0;
+  }
+  ROS_INFO_STREAM(oss.str());
+}
+
+}  // namespace gazebo
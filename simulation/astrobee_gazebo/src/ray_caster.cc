@@ -0,0 +1,235 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <astrobee_gazebo/ray_caster.h>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gazebo {
+
+// Triangles in a leaf
+static constexpr unsigned int kLeafSize = 4;
+
+RayCaster::RayCaster() {}
+
+size_t RayCaster::AddWorld(physics::WorldPtr world) {
+  size_t before = triangles_.size();
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<unsigned int> indices;
+  for (physics::ModelPtr const& model : world->GetModels()) {
+    if (!model->IsStatic())
+      continue;
+    for (physics::LinkPtr const& link : model->GetLinks()) {
+      for (physics::CollisionPtr const& collision : link->GetCollisions()) {
+        physics::MeshShapePtr shape =
+          boost::dynamic_pointer_cast<physics::MeshShape>(collision->GetShape());
+        if (!shape)
+          continue;
+        common::Mesh const* mesh = common::MeshManager::Instance()->Load(
+          common::find_file(shape->GetMeshURI()));
+        if (!mesh) {
+          gzerr << "RayCaster could not load " << shape->GetMeshURI() << "\n";
+          continue;
+        }
+        math::Pose pose = collision->GetWorldPose();
+        ignition::math::Vector3d size = shape->Size();
+        Eigen::Affine3d transform = Eigen::Translation3d(
+            pose.pos.x, pose.pos.y, pose.pos.z) *
+          Eigen::Quaterniond(pose.rot.w, pose.rot.x, pose.rot.y, pose.rot.z) *
+          Eigen::Scaling(size.X(), size.Y(), size.Z());
+        for (unsigned int i = 0; i < mesh->GetSubMeshCount(); i++) {
+          common::SubMesh const* sub = mesh->GetSubMesh(i);
+          if (sub->GetPrimitiveType() != common::SubMesh::TRIANGLES)
+            continue;
+          vertices.resize(sub->GetVertexCount());
+          for (unsigned int j = 0; j < vertices.size(); j++) {
+            ignition::math::Vector3d v = sub->Vertex(j);
+            vertices[j] = Eigen::Vector3d(v.X(), v.Y(), v.Z());
+          }
+          indices.resize(sub->GetIndexCount());
+          for (unsigned int j = 0; j < indices.size(); j++)
+            indices[j] = sub->GetIndex(j);
+          AddTriangles(vertices, indices, transform);
+        }
+      }
+    }
+  }
+  return triangles_.size() - before;
+}
+
+void RayCaster::AddTriangles(std::vector<Eigen::Vector3d> const& vertices,
+  std::vector<unsigned int> const& indices, Eigen::Affine3d const& pose) {
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    if (indices[i] >= vertices.size() || indices[i + 1] >= vertices.size() ||
+        indices[i + 2] >= vertices.size())
+      continue;
+    Eigen::Vector3f a = (pose * vertices[indices[i]]).cast<float>();
+    Eigen::Vector3f b = (pose * vertices[indices[i + 1]]).cast<float>();
+    Eigen::Vector3f c = (pose * vertices[indices[i + 2]]).cast<float>();
+    Triangle t;
+    t.v0 = a;
+    t.e1 = b - a;
+    t.e2 = c - a;
+    triangles_.push_back(t);
+  }
+}
+
+void RayCaster::Build() {
+  nodes_.clear();
+  if (triangles_.empty())
+    return;
+  boxes_.resize(triangles_.size());
+  centers_.resize(triangles_.size());
+  for (size_t i = 0; i < triangles_.size(); i++) {
+    Triangle const& t = triangles_[i];
+    boxes_[i] = Eigen::AlignedBox3f(t.v0);
+    boxes_[i].extend(t.v0 + t.e1);
+    boxes_[i].extend(t.v0 + t.e2);
+    centers_[i] = boxes_[i].center();
+  }
+  nodes_.reserve(2 * triangles_.size() / kLeafSize + 1);
+  Split(0, triangles_.size());
+  boxes_.clear();
+  boxes_.shrink_to_fit();
+  centers_.clear();
+  centers_.shrink_to_fit();
+}
+
+// Makes the node over count triangles from first, splitting them in two
+// halves along the longest axis of their centers, and returns its index
+unsigned int RayCaster::Split(unsigned int first, unsigned int count) {
+  unsigned int index = nodes_.size();
+  nodes_.push_back(Node());
+  Eigen::AlignedBox3f box, centers;
+  for (unsigned int i = first; i < first + count; i++) {
+    box.extend(boxes_[i]);
+    centers.extend(centers_[i]);
+  }
+  nodes_[index].box = box;
+  Eigen::Vector3f::Index axis;
+  centers.sizes().maxCoeff(&axis);
+  if (count <= kLeafSize || centers.sizes()[axis] <= 0) {
+    nodes_[index].first = first;
+    nodes_[index].count = count;
+    return index;
+  }
+  // Order the triangles, their boxes and centers together about the middle
+  std::vector<unsigned int> order(count);
+  for (unsigned int i = 0; i < count; i++)
+    order[i] = first + i;
+  unsigned int half = count / 2;
+  std::nth_element(order.begin(), order.begin() + half, order.end(),
+    [this, axis](unsigned int a, unsigned int b) {
+      return centers_[a][axis] < centers_[b][axis];
+    });
+  std::vector<Triangle> triangles(count);
+  std::vector<Eigen::AlignedBox3f> boxes(count);
+  std::vector<Eigen::Vector3f> center(count);
+  for (unsigned int i = 0; i < count; i++) {
+    triangles[i] = triangles_[order[i]];
+    boxes[i] = boxes_[order[i]];
+    center[i] = centers_[order[i]];
+  }
+  std::copy(triangles.begin(), triangles.end(), triangles_.begin() + first);
+  std::copy(boxes.begin(), boxes.end(), boxes_.begin() + first);
+  std::copy(center.begin(), center.end(), centers_.begin() + first);
+  // The first child comes right after this node
+  Split(first, half);
+  unsigned int second = Split(first + half, count - half);
+  nodes_[index].first = second;
+  nodes_[index].count = 0;
+  return index;
+}
+
+// Moller-Trumbore intersection, with the distance along dir
+bool RayCaster::Hit(Triangle const& t, Eigen::Vector3f const& origin,
+  Eigen::Vector3f const& dir, float *dist) const {
+  Eigen::Vector3f p = dir.cross(t.e2);
+  float det = t.e1.dot(p);
+  if (std::fabs(det) < std::numeric_limits<float>::epsilon())
+    return false;
+  float inv = 1.0f / det;
+  Eigen::Vector3f s = origin - t.v0;
+  float u = s.dot(p) * inv;
+  if (u < 0.0f || u > 1.0f)
+    return false;
+  Eigen::Vector3f q = s.cross(t.e1);
+  float v = dir.dot(q) * inv;
+  if (v < 0.0f || u + v > 1.0f)
+    return false;
+  *dist = t.e2.dot(q) * inv;
+  return *dist >= 0.0f;
+}
+
+bool RayCaster::Cast(Eigen::Vector3d const& origin, Eigen::Vector3d const& dir,
+  double max_dist, double *dist) const {
+  if (nodes_.empty())
+    return false;
+  Eigen::Vector3f o = origin.cast<float>();
+  Eigen::Vector3f d = dir.cast<float>();
+  Eigen::Vector3f inv = d.cwiseInverse();
+  float best = max_dist;
+  bool hit = false;
+  // The distance at which the ray enters a box, infinite if it misses it
+  auto enter = [&o, &inv, &best](Eigen::AlignedBox3f const& box) {
+    Eigen::Vector3f t0 = (box.min() - o).cwiseProduct(inv);
+    Eigen::Vector3f t1 = (box.max() - o).cwiseProduct(inv);
+    float near = std::max(t0.cwiseMin(t1).maxCoeff(), 0.0f);
+    float far = std::min(t0.cwiseMax(t1).minCoeff(), best);
+    return near <= far ? near : std::numeric_limits<float>::infinity();
+  };
+  unsigned int stack[64];
+  unsigned int size = 0;
+  if (enter(nodes_[0].box) <= best)
+    stack[size++] = 0;
+  while (size > 0) {
+    Node const& node = nodes_[stack[--size]];
+    if (node.count > 0) {
+      for (unsigned int i = node.first; i < node.first + node.count; i++) {
+        float t;
+        if (Hit(triangles_[i], o, d, &t) && t <= best) {
+          best = t;
+          hit = true;
+        }
+      }
+      continue;
+    }
+    // Visit the nearer child first, so that the farther one is likely culled
+    unsigned int a = &node - &nodes_[0] + 1, b = node.first;
+    float ta = enter(nodes_[a].box), tb = enter(nodes_[b].box);
+    if (ta > tb) {
+      std::swap(a, b);
+      std::swap(ta, tb);
+    }
+    if (tb <= best && size < 64)
+      stack[size++] = b;
+    if (ta <= best && size < 64)
+      stack[size++] = a;
+  }
+  if (hit)
+    *dist = best;
+  return hit;
+}
+
+}  // namespace gazebo
@@ -0,0 +1,62 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef EKF_BAG_BOUNDED_QUEUE_H_
+#define EKF_BAG_BOUNDED_QUEUE_H_
+
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <mutex>
+
+namespace ekf_bag {
+
+/**
+ * A queue passing items between threads, which blocks the producer while it is full,
+ * and the consumer while it is empty.
+ **/
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity) : capacity_(capacity) {}
+
+  void Push(T const& item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] {return items_.size() < capacity_;});
+    items_.push_back(item);
+    not_empty_.notify_one();
+  }
+
+  T Pop(void) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] {return !items_.empty();});
+    T item = items_.front();
+    items_.pop_front();
+    not_full_.notify_one();
+    return item;
+  }
+
+ private:
+  size_t capacity_;
+  std::deque<T> items_;
+  std::mutex mutex_;
+  std::condition_variable not_full_, not_empty_;
+};
+
+}  // end namespace ekf_bag
+
+#endif  // EKF_BAG_BOUNDED_QUEUE_H_
@@ -0,0 +1,78 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef EKF_BAG_COLUMNAR_WRITER_H_
+#define EKF_BAG_COLUMNAR_WRITER_H_
+
+#include <ekf_bag/bounded_queue.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace ekf_bag {
+
+/**
+ * Writes tables of doubles to a binary file in chunks, each column of a chunk
+ * stored contiguously so that it can be read straight into a numpy array. Rows
+ * are gathered here, and the chunks are written by a background thread.
+ *
+ * The file begins with the eight bytes "EKFCOLS1". Each chunk then has, all
+ * little endian, the uint32 length and bytes of the table name, the uint32
+ * number of rows and of columns, the uint32 length and bytes of each column
+ * name, and the float64 values of each column in turn.
+ **/
+class ColumnarWriter {
+ public:
+  ColumnarWriter(void);
+  ~ColumnarWriter(void);
+
+  // starts writing the file, with chunks of up to chunk_rows rows
+  bool Open(const char* filename, size_t chunk_rows = 4096);
+  // adds a table, returning the index to append rows to it with
+  int AddTable(std::string const& name, std::vector<std::string> const& columns);
+  // appends a row, with a value for each column of the table
+  void Append(int table, double const* values);
+  // writes the rows not yet written and closes the file
+  void Close(void);
+
+ private:
+  struct Table {
+    std::string name;
+    std::vector<std::string> columns;
+    std::vector<double> rows;  // row major, until written
+  };
+  typedef BoundedQueue<std::shared_ptr<std::vector<char> > > ChunkQueue;  // NULL marks the end
+
+  void Flush(Table* table);
+  void WriteChunks(void);
+
+  FILE* f_;
+  size_t chunk_rows_;
+  std::vector<Table> tables_;
+  ChunkQueue chunks_;
+  std::thread thread_;
+};
+
+}  // end namespace ekf_bag
+
+#endif  // EKF_BAG_COLUMNAR_WRITER_H_
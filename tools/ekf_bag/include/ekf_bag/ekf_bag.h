@@ -21,13 +21,17 @@
 
 #include <config_reader/config_reader.h>
 #include <ekf/ekf.h>
+#include <ekf_bag/bounded_queue.h>
 #include <sparse_mapping/sparse_map.h>
 #include <localization_node/localization.h>
 #include <lk_optical_flow/lk_optical_flow.h>
 
 #include <rosbag/bag.h>
+#include <rosbag/view.h>
 #include <sensor_msgs/Imu.h>
 
+#include <memory>
+
 namespace ekf_bag {
 
 class EkfBag {
@@ -35,9 +39,23 @@ class EkfBag {
   EkfBag(const char* bagfile, const char* mapfile);
   virtual ~EkfBag(void);
 
-  void Run(void);
+  /**
+   * Replays the bag through the EKF. If pipelined, reading the bag, processing
+   * the images and stepping the EKF run on three threads, with the same results.
+   **/
+  void Run(bool pipelined = false);
+
+  /**
+   * Replays only the messages from start seconds after the bag begins, for
+   * duration seconds, or to the end if duration is not positive. The bias is
+   * still estimated from the start of the bag, and the ground truth from just
+   * before the window is used until the first one in it.
+   **/
+  void SetWindow(double start, double duration);
 
  protected:
+  // adds the config files the replay reads
+  static void AddConfigFiles(config_reader::ConfigReader* config);
   virtual void ReadParams(config_reader::ConfigReader* config);
 
   virtual void UpdateImu(const ros::Time & time, const sensor_msgs::Imu & imu);
@@ -49,6 +67,14 @@ class EkfBag {
   virtual void UpdateOpticalFlow(const ff_msgs::Feature2dArray & of) {}
   virtual void UpdateSparseMap(const ff_msgs::VisualLandmarks & vl) {}
 
+  // the inputs to the EKF, in replay order, which subclasses may send elsewhere
+  virtual void EkfSetBias(const Eigen::Vector3f & gyro_bias, const Eigen::Vector3f & accel_bias);
+  virtual void EkfOpticalFlowRegister(const ff_msgs::CameraRegistration & reg);
+  virtual void EkfOpticalFlowUpdate(const ff_msgs::Feature2dArray & of);
+  virtual void EkfSparseMapRegister(const ff_msgs::CameraRegistration & reg);
+  virtual void EkfSparseMapUpdate(const ff_msgs::VisualLandmarks & vl);
+  virtual void EkfStep(const sensor_msgs::Imu & imu, const geometry_msgs::Quaternion & quat);
+
   rosbag::Bag bag_;
   sparse_mapping::SparseMap map_;
   localization_node::Localizer loc_;
@@ -61,17 +87,52 @@ class EkfBag {
   geometry_msgs::Pose ground_truth_;
 
  private:
+  // the features found in an image, sent to the EKF later
+  typedef struct {
+    bool of, vl;  // whether each kind was processed
+    bool image_ok;  // false if the image could not be converted for the sparse map
+    ff_msgs::Feature2dArray of_features;
+    ff_msgs::VisualLandmarks vl_features;
+  } ImageFeatures;
+
+  // a message from the bag, with its image's features once processed
+  typedef struct {
+    ros::Time time;
+    float progress;
+    sensor_msgs::ImuConstPtr imu;
+    sensor_msgs::ImageConstPtr image;
+    geometry_msgs::PoseStampedConstPtr ground_truth;
+    ImageFeatures features;
+  } BagEvent;
+  typedef BoundedQueue<std::shared_ptr<BagEvent> > EventQueue;  // NULL marks the end
+
   void EstimateBias(void);
+  // the most recent ground truth before the window, if any
+  void SeedGroundTruth(void);
+  // adds the replayed topics in the window to view
+  void AddReplayQuery(rosbag::View* view);
+
+  void ProcessImage(const sensor_msgs::ImageConstPtr & image, bool of, bool vl, ImageFeatures* features);
+
+  // the pipeline stages
+  void ReadBag(EventQueue* out);
+  void ProcessImages(EventQueue* in, EventQueue* out);
 
   // configuration parameters
   float sparse_map_delay_, of_delay_;
 
+  // the replayed part of the bag
+  ros::Time window_start_, window_end_;
+
   // variables used for sending visual features
   bool processing_of_, processing_sparse_map_;
   int of_id_, vl_id_;  // message ids
   ros::Time of_send_time_, vl_send_time_;  // time to send features
   ff_msgs::Feature2dArray of_features_;  // save to send later
   ff_msgs::VisualLandmarks vl_features_;
+
+  // the features of the image being passed to UpdateImage, if already processed
+  const ImageFeatures* processed_features_;
 };
 
 }  // end namespace ekf_bag
@@ -19,16 +19,23 @@
 #ifndef EKF_BAG_EKF_BAG_CSV_H_
 #define EKF_BAG_EKF_BAG_CSV_H_
 
+#include <ekf_bag/columnar_writer.h>
 #include <ekf_bag/ekf_bag.h>
 #include <ekf_bag/tracked_features.h>
 
+#include <vector>
+
 namespace ekf_bag {
 
 class EkfBagCsv : public EkfBag {
  public:
-  EkfBagCsv(const char* bagfile, const char* mapfile, const char* csvfile);
+  // if columnar, writes the tables of a ColumnarWriter instead of text lines
+  EkfBagCsv(const char* bagfile, const char* mapfile, const char* csvfile, bool columnar = false);
   virtual ~EkfBagCsv(void);
 
+  // the track lengths and reprojection errors seen so far
+  const FeatureStatistics & Statistics(void) const {return stats_;}
+
  protected:
   virtual void UpdateGroundTruth(const geometry_msgs::PoseStamped & pose);
 
@@ -39,10 +46,21 @@ class EkfBagCsv : public EkfBag {
   virtual void ReadParams(config_reader::ConfigReader* config);
 
   TrackedOFFeatures tracked_of_;
+  TrackedSMFeatures tracked_sm_;
+  FeatureStatistics stats_;
 
  private:
   FILE* f_;
 
+  // appends a row numbered in the order the lines of text would be
+  void AppendRow(int table);
+
+  bool columnar_;
+  ColumnarWriter columns_;
+  int ekf_table_, of_table_, of_features_table_, vl_table_, vl_landmarks_table_, gt_table_;
+  int rows_;
+  std::vector<double> row_;
+
   bool start_time_set_;
   ros::Time start_time_;
 };
@@ -0,0 +1,104 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef EKF_BAG_EKF_SWEEP_H_
+#define EKF_BAG_EKF_SWEEP_H_
+
+#include <ekf_bag/ekf_bag.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ekf_bag {
+
+/**
+ * Replays a bag through one EKF per config file, to compare parameters.
+ * The bag is read and its images processed only once, and the EKFs step
+ * in parallel on the same inputs, one thread each.
+ **/
+class EkfSweep : public EkfBag {
+ public:
+  /**
+   * Each config file is read after the ones the replay reads, so it only
+   * needs the parameters that differ.
+   **/
+  EkfSweep(const char* bagfile, const char* mapfile, std::vector<std::string> const& config_files);
+  virtual ~EkfSweep(void);
+
+  void Sweep(bool pipelined = false);
+
+  /**
+   * Writes a line for each config, with the errors of its EKF against the ground truth.
+   **/
+  void WriteStats(FILE* f) const;
+
+ protected:
+  virtual void UpdateGroundTruth(const geometry_msgs::PoseStamped & pose);
+
+  virtual void EkfSetBias(const Eigen::Vector3f & gyro_bias, const Eigen::Vector3f & accel_bias);
+  virtual void EkfOpticalFlowRegister(const ff_msgs::CameraRegistration & reg);
+  virtual void EkfOpticalFlowUpdate(const ff_msgs::Feature2dArray & of);
+  virtual void EkfSparseMapRegister(const ff_msgs::CameraRegistration & reg);
+  virtual void EkfSparseMapUpdate(const ff_msgs::VisualLandmarks & vl);
+  virtual void EkfStep(const sensor_msgs::Imu & imu, const geometry_msgs::Quaternion & quat);
+
+ private:
+  typedef struct {
+    enum {SET_BIAS, OF_REGISTER, OF_UPDATE, VL_REGISTER, VL_UPDATE, STEP, GROUND_TRUTH} type;
+    Eigen::Vector3f gyro_bias, accel_bias;
+    ff_msgs::CameraRegistration reg;
+    ff_msgs::Feature2dArray of;
+    ff_msgs::VisualLandmarks vl;
+    sensor_msgs::Imu imu;
+    geometry_msgs::Quaternion quat;
+    geometry_msgs::Pose ground_truth;
+  } Input;
+  typedef BoundedQueue<std::shared_ptr<const Input> > InputQueue;  // NULL marks the end
+
+  typedef struct {
+    int count;  // number of EKF states compared
+    double pos_sq_sum, pos_max;  // meters
+    double att_sq_sum, att_max;  // radians
+  } ErrorStats;
+
+  struct Config {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    Config(void);
+
+    std::string file;
+    ekf::Ekf ekf;
+    InputQueue queue;
+    std::thread thread;
+    bool have_ground_truth;
+    geometry_msgs::Pose ground_truth;
+    ErrorStats stats;
+  };
+
+  void Send(Input* input);
+
+  static void RunConfig(Config* c);
+
+  std::vector<std::unique_ptr<Config> > configs_;
+};
+
+}  // end namespace ekf_bag
+
+#endif  // EKF_BAG_EKF_SWEEP_H_
@@ -24,6 +24,8 @@
 #include <ff_msgs/VisualLandmarks.h>
 #include <Eigen/Core>
 #include <Eigen/Geometry>
+#include <stdint.h>
+#include <stdio.h>
 #include <map>
 #include <vector>
 
@@ -34,6 +36,7 @@ struct OFFeature {
   float time;
   float x;
   float y;
+  int frames;
 };
 
 struct SMFeature {
@@ -42,14 +45,48 @@ struct SMFeature {
   float time;
 };
 
+/**
+ * Statistics of the features seen over a bag, kept online so that they take
+ * the same memory however long the bag is: a histogram of how long optical
+ * flow tracks last, and the moments of the sparse map reprojection errors.
+ **/
+class FeatureStatistics {
+ public:
+  // track lengths go in bins of bin_seconds, the last holding all longer ones
+  explicit FeatureStatistics(float bin_seconds = 0.5, int num_bins = 20);
+
+  void AddTrack(float seconds, int frames);
+  void AddReprojectionError(float pixels);
+
+  int64_t NumTracks(void) const {return num_tracks_;}
+  const std::vector<int64_t> & TrackHistogram(void) const {return track_histogram_;}
+  int64_t NumErrors(void) const {return num_errors_;}
+  double ErrorMean(void) const {return error_mean_;}
+  double ErrorStdDev(void) const;
+  double ErrorMax(void) const {return error_max_;}
+
+  void Print(FILE* f) const;
+
+ private:
+  float bin_seconds_;
+  std::vector<int64_t> track_histogram_;
+  int64_t num_tracks_;
+  double track_seconds_, track_frames_;
+  // Welford's running mean and sum of squared differences
+  int64_t num_errors_;
+  double error_mean_, error_m2_, error_max_;
+};
+
 class TrackedOFFeatures {
  public:
   TrackedOFFeatures(void) :
                  params_(Eigen::Vector2i(-1, -1), Eigen::Vector2d::Constant(-1),
-                 Eigen::Vector2d(-1, -1)) {}
+                 Eigen::Vector2d(-1, -1)), stats_(NULL) {}
   ~TrackedOFFeatures(void) {}
 
   void SetCameraParameters(const camera::CameraParameters & params) {params_ = params;}
+  // adds the tracks that end, when they are dropped, if set
+  void SetStatistics(FeatureStatistics* stats) {stats_ = stats;}
 
   void UpdateFeatures(const ff_msgs::Feature2dArray & of, float time);
   std::map<int, struct OFFeature>::iterator begin() {return f_.begin();}
@@ -58,6 +95,7 @@ class TrackedOFFeatures {
  private:
   std::map<int, struct OFFeature> f_;
   camera::CameraParameters params_;
+  FeatureStatistics* stats_;
 };
 
 class TrackedSMFeatures {
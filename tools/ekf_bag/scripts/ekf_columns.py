@@ -0,0 +1,51 @@
+#!/usr/bin/python
+#
+# Copyright (c) 2017, United States Government, as represented by the
+# Administrator of the National Aeronautics and Space Administration.
+# 
+# All rights reserved.
+# 
+# The Astrobee platform is licensed under the Apache License, Version 2.0
+# (the "License"); you may not use this file except in compliance with the
+# License. You may obtain a copy of the License at
+# 
+#     http://www.apache.org/licenses/LICENSE-2.0
+# 
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+# WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+# License for the specific language governing permissions and limitations
+# under the License.
+
+import struct
+
+import numpy as np
+
+# reads the tables written by ekf_to_csv -columnar. returns a map from each
+# table name to a map from each column name to a numpy array
+def read_columns(filename):
+  data = open(filename, 'rb').read()
+  if data[:8] != b'EKFCOLS1':
+    raise IOError('%s was not written by ekf_to_csv -columnar.' % (filename))
+  chunks = {}
+  pos = 8
+  def read_string(pos):
+    (length,) = struct.unpack_from('<I', data, pos)
+    return (data[pos + 4 : pos + 4 + length].decode(), pos + 4 + length)
+  while pos < len(data):
+    (name, pos) = read_string(pos)
+    (rows, cols) = struct.unpack_from('<II', data, pos)
+    pos += 8
+    columns = []
+    for i in range(cols):
+      (column, pos) = read_string(pos)
+      columns.append(column)
+    values = np.frombuffer(data, dtype='<f8', count=rows * cols, offset=pos).reshape(cols, rows)
+    pos += 8 * rows * cols
+    chunks.setdefault(name, []).append(dict(zip(columns, values)))
+  tables = {}
+  for (name, parts) in chunks.items():
+    tables[name] = {}
+    for column in parts[0].keys():
+      tables[name][column] = np.concatenate([p[column] for p in parts])
+  return tables
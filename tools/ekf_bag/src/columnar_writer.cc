@@ -0,0 +1,117 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ekf_bag/columnar_writer.h>
+
+#include <string.h>
+
+namespace ekf_bag {
+
+namespace {
+
+void AppendBytes(std::vector<char>* chunk, void const* data, size_t size) {
+  char const* bytes = static_cast<char const*>(data);
+  chunk->insert(chunk->end(), bytes, bytes + size);
+}
+
+void AppendString(std::vector<char>* chunk, std::string const& s) {
+  uint32_t len = s.size();
+  AppendBytes(chunk, &len, sizeof(len));
+  AppendBytes(chunk, s.data(), s.size());
+}
+
+}  // namespace
+
+ColumnarWriter::ColumnarWriter(void) : f_(NULL), chunk_rows_(0), chunks_(8) {}
+
+ColumnarWriter::~ColumnarWriter(void) {
+  Close();
+}
+
+bool ColumnarWriter::Open(const char* filename, size_t chunk_rows) {
+  f_ = fopen(filename, "wb");
+  if (f_ == NULL)
+    return false;
+  // whole chunks are written at once, so a large buffer saves system calls
+  setvbuf(f_, NULL, _IOFBF, 1 << 20);
+  fwrite("EKFCOLS1", 1, 8, f_);
+  chunk_rows_ = chunk_rows;
+  thread_ = std::thread(&ColumnarWriter::WriteChunks, this);
+  return true;
+}
+
+int ColumnarWriter::AddTable(std::string const& name, std::vector<std::string> const& columns) {
+  Table table;
+  table.name = name;
+  table.columns = columns;
+  table.rows.reserve(chunk_rows_ * columns.size());
+  tables_.push_back(table);
+  return tables_.size() - 1;
+}
+
+void ColumnarWriter::Append(int table, double const* values) {
+  Table & t = tables_[table];
+  t.rows.insert(t.rows.end(), values, values + t.columns.size());
+  if (t.rows.size() >= chunk_rows_ * t.columns.size())
+    Flush(&t);
+}
+
+void ColumnarWriter::Flush(Table* table) {
+  uint32_t cols = table->columns.size();
+  uint32_t rows = table->rows.size() / cols;
+  if (rows == 0)
+    return;
+  std::shared_ptr<std::vector<char> > chunk(new std::vector<char>());
+  chunk->reserve(64 + 16 * cols + sizeof(double) * rows * cols);
+  AppendString(chunk.get(), table->name);
+  AppendBytes(chunk.get(), &rows, sizeof(rows));
+  AppendBytes(chunk.get(), &cols, sizeof(cols));
+  for (uint32_t c = 0; c < cols; c++)
+    AppendString(chunk.get(), table->columns[c]);
+  // transpose the rows into columns
+  size_t start = chunk->size();
+  chunk->resize(start + sizeof(double) * rows * cols);
+  double* out = reinterpret_cast<double*>(&(*chunk)[start]);
+  for (uint32_t c = 0; c < cols; c++)
+    for (uint32_t r = 0; r < rows; r++)
+      memcpy(out++, &table->rows[r * cols + c], sizeof(double));
+  table->rows.clear();
+  chunks_.Push(chunk);
+}
+
+void ColumnarWriter::WriteChunks(void) {
+  while (true) {
+    std::shared_ptr<std::vector<char> > chunk = chunks_.Pop();
+    if (!chunk)
+      break;
+    fwrite(chunk->data(), 1, chunk->size(), f_);
+  }
+}
+
+void ColumnarWriter::Close(void) {
+  if (f_ == NULL)
+    return;
+  for (size_t i = 0; i < tables_.size(); i++)
+    Flush(&tables_[i]);
+  chunks_.Push(std::shared_ptr<std::vector<char> >());
+  thread_.join();
+  fclose(f_);
+  f_ = NULL;
+}
+
+}  // namespace ekf_bag
@@ -24,12 +24,30 @@
 #include <camera/camera_params.h>
 #include <common/utils.h>
 #include <Eigen/Core>
+#include <glog/logging.h>
 #include <rosbag/view.h>
 
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
 namespace ekf_bag {
 
+// enough messages to buffer a few images between the pipeline stages
+static const size_t kEventQueueSize = 100;
+
+static std::vector<std::string> ReplayTopics(void) {
+  std::vector<std::string> topics;
+  topics.push_back(std::string("/") + TOPIC_HARDWARE_IMU);
+  topics.push_back(std::string("/") + TOPIC_HARDWARE_NAV_CAM);
+  topics.push_back(std::string("/") + TOPIC_LOCALIZATION_TRUTH);
+  return topics;
+}
+
 EkfBag::EkfBag(const char* bagfile, const char* mapfile) :
-          map_(mapfile, true), loc_(&map_) {
+          map_(mapfile, true), loc_(&map_), window_start_(ros::TIME_MIN), window_end_(ros::TIME_MAX),
+          processed_features_(NULL) {
   bag_.open(bagfile, rosbag::bagmode::Read);
 }
 
@@ -37,13 +55,17 @@ EkfBag::~EkfBag(void) {
   bag_.close();
 }
 
-void EkfBag::ReadParams(config_reader::ConfigReader* config) {
+void EkfBag::AddConfigFiles(config_reader::ConfigReader* config) {
   config->AddFile("tools/ekf_bag.config");
   config->AddFile("gnc.config");
   config->AddFile("cameras.config");
   config->AddFile("geometry.config");
   config->AddFile("localization.config");
   config->AddFile("optical_flow.config");
+}
+
+void EkfBag::ReadParams(config_reader::ConfigReader* config) {
+  AddConfigFiles(config);
 
   if (!config->ReadFiles()) {
     ROS_FATAL("Failed to read config files.");
@@ -60,6 +82,34 @@ void EkfBag::ReadParams(config_reader::ConfigReader* config) {
   loc_.ReadParams(config);
 }
 
+void EkfBag::SetWindow(double start, double duration) {
+  rosbag::View all(bag_, rosbag::TopicQuery(ReplayTopics()));
+  window_start_ = all.getBeginTime() + ros::Duration(std::max(start, 0.0));
+  window_end_ = (duration > 0) ? window_start_ + ros::Duration(duration) : ros::TIME_MAX;
+}
+
+void EkfBag::AddReplayQuery(rosbag::View* view) {
+  // the bag's own index finds the chunks in the window, without reading those before
+  view->addQuery(bag_, rosbag::TopicQuery(ReplayTopics()), window_start_, window_end_);
+}
+
+void EkfBag::SeedGroundTruth(void) {
+  if (window_start_ == ros::TIME_MIN)
+    return;
+  std::vector<std::string> topics;
+  topics.push_back(std::string("/") + TOPIC_LOCALIZATION_TRUTH);
+  ros::Time start = window_start_ - ros::Duration(std::min(window_start_.toSec(), 5.0));
+  rosbag::View before(bag_, rosbag::TopicQuery(topics), start, window_start_ - ros::Duration(0, 1));
+  geometry_msgs::PoseStampedConstPtr last;
+  for (rosbag::MessageInstance const m : before) {
+    geometry_msgs::PoseStampedConstPtr pose = m.instantiate<geometry_msgs::PoseStamped>();
+    if (pose)
+      last = pose;
+  }
+  if (last)
+    UpdateGroundTruth(*last.get());
+}
+
 void EkfBag::EstimateBias(void) {
   std::vector<std::string> topics;
   topics.push_back(std::string("/") + TOPIC_HARDWARE_IMU);
@@ -87,40 +137,95 @@ void EkfBag::EstimateBias(void) {
   }
   accel = accel / count;
   gyro = gyro / count;
-  ekf_.SetBias(gyro, accel);
+  EkfSetBias(gyro, accel);
+}
+
+void EkfBag::EkfSetBias(const Eigen::Vector3f & gyro_bias, const Eigen::Vector3f & accel_bias) {
+  ekf_.SetBias(gyro_bias, accel_bias);
   ekf_.Reset();
 }
 
+void EkfBag::EkfOpticalFlowRegister(const ff_msgs::CameraRegistration & reg) {
+  ekf_.OpticalFlowRegister(reg);
+}
+
+void EkfBag::EkfOpticalFlowUpdate(const ff_msgs::Feature2dArray & of) {
+  ekf_.OpticalFlowUpdate(of);
+}
+
+void EkfBag::EkfSparseMapRegister(const ff_msgs::CameraRegistration & reg) {
+  ekf_.SparseMapRegister(reg);
+}
+
+void EkfBag::EkfSparseMapUpdate(const ff_msgs::VisualLandmarks & vl) {
+  ekf_.SparseMapUpdate(vl);
+}
+
+void EkfBag::EkfStep(const sensor_msgs::Imu & imu, const geometry_msgs::Quaternion & quat) {
+  ekf_.PrepareStep(imu, quat);
+  ff_msgs::EkfState state;
+  int ret = ekf_.Step(&state);
+  if (ret)
+    UpdateEKF(state);
+}
+
 void EkfBag::UpdateImu(const ros::Time & time, const sensor_msgs::Imu & imu) {
   // send the visual messages when it's time
   if (processing_of_ && time >= of_send_time_) {
-    ekf_.OpticalFlowUpdate(of_features_);
+    EkfOpticalFlowUpdate(of_features_);
     processing_of_ = false;
   }
   if (processing_sparse_map_ && time >= vl_send_time_) {
-    ekf_.SparseMapUpdate(vl_features_);
+    EkfSparseMapUpdate(vl_features_);
     processing_sparse_map_ = false;
   }
 
   // Pass a quaternion in to do MGTF gravity correction if needed
-  ekf_.PrepareStep(imu, ground_truth_.orientation);
-  ff_msgs::EkfState state;
-  int ret = ekf_.Step(&state);
-  if (ret)
-    UpdateEKF(state);
+  EkfStep(imu, ground_truth_.orientation);
+}
+
+void EkfBag::ProcessImage(const sensor_msgs::ImageConstPtr & image_msg, bool of, bool vl,
+                          ImageFeatures* features) {
+  features->of = of;
+  features->vl = vl;
+  features->image_ok = true;
+  if (of) {
+    features->of_features.feature_array.clear();
+    of_.OpticalFlow(image_msg, &features->of_features);
+  }
+  if (vl) {
+    cv_bridge::CvImageConstPtr image;
+    try {
+      image = cv_bridge::toCvShare(image_msg, sensor_msgs::image_encodings::MONO8);
+    } catch (cv_bridge::Exception& e) {
+      ROS_ERROR("cv_bridge exception: %s", e.what());
+      features->image_ok = false;
+      return;
+    }
+    features->vl_features.landmarks.clear();
+    loc_.Localize(image, &features->vl_features);
+  }
 }
 
 void EkfBag::UpdateImage(const ros::Time & time, const sensor_msgs::ImageConstPtr & image_msg) {
-  if (!processing_of_) {
+  // do the processing now unless the pipeline already did, but send it later
+  ImageFeatures features;
+  const ImageFeatures* f = processed_features_;
+  if (f == NULL) {
+    ProcessImage(image_msg, !processing_of_, !processing_sparse_map_, &features);
+    f = &features;
+  } else if (f->of == processing_of_ || f->vl == processing_sparse_map_) {
+    LOG(FATAL) << "The pipeline processed different images than the EKF expects.";
+  }
+
+  if (f->of) {
     // send of registration
     ff_msgs::CameraRegistration r;
     r.header = std_msgs::Header();
     r.header.stamp = time;
     r.camera_id = ++of_id_;
-    ekf_.OpticalFlowRegister(r);
-    // do the processing now, but send it later
-    of_features_.feature_array.clear();
-    of_.OpticalFlow(image_msg, &of_features_);
+    EkfOpticalFlowRegister(r);
+    of_features_ = f->of_features;
     of_features_.camera_id = of_id_;
     processing_of_ = true;
     of_send_time_ = time + ros::Duration(of_delay_);
@@ -128,23 +233,16 @@ void EkfBag::UpdateImage(const ros::Time & time, const sensor_msgs::ImageConstPt
     UpdateOpticalFlow(of_features_);
   }
   // now do sparse map
-  if (!processing_sparse_map_) {
+  if (f->vl) {
     // send registration
     ff_msgs::CameraRegistration r;
     r.header = std_msgs::Header();
     r.header.stamp = time;
     r.camera_id = ++vl_id_;
-    ekf_.SparseMapRegister(r);
-    // do processing now, but send it later
-    cv_bridge::CvImageConstPtr image;
-    try {
-      image = cv_bridge::toCvShare(image_msg, sensor_msgs::image_encodings::MONO8);
-    } catch (cv_bridge::Exception& e) {
-      ROS_ERROR("cv_bridge exception: %s", e.what());
+    EkfSparseMapRegister(r);
+    if (!f->image_ok)
       return;
-    }
-    vl_features_.landmarks.clear();
-    loc_.Localize(image, &vl_features_);
+    vl_features_ = f->vl_features;
     vl_features_.camera_id = vl_id_;
     processing_sparse_map_ = true;
     vl_send_time_ = time + ros::Duration(sparse_map_delay_);
@@ -157,18 +255,94 @@ void EkfBag::UpdateGroundTruth(const geometry_msgs::PoseStamped & pose) {
   ground_truth_ = pose.pose;  // Cache the pose for MGTF gravity correction
 }
 
-void EkfBag::Run(void) {
-  EstimateBias();
+void EkfBag::ReadBag(EventQueue* out) {
+  rosbag::View view;
+  AddReplayQuery(&view);
 
-  std::vector<std::string> topics;
-  topics.push_back(std::string("/") + TOPIC_HARDWARE_IMU);
-  topics.push_back(std::string("/") + TOPIC_HARDWARE_NAV_CAM);
-  topics.push_back(std::string("/") + TOPIC_LOCALIZATION_TRUTH);
-  rosbag::View view(bag_, rosbag::TopicQuery(topics));
+  int progress = 0;
+  for (rosbag::MessageInstance const m : view) {
+    progress++;
+
+    std::shared_ptr<BagEvent> e(new BagEvent());
+    e->time = m.getTime();
+    e->progress = static_cast<float>(progress) / view.size();
+    if (m.isType<sensor_msgs::Image>())
+      e->image = m.instantiate<sensor_msgs::Image>();
+    else if (m.isType<sensor_msgs::Imu>())
+      e->imu = m.instantiate<sensor_msgs::Imu>();
+    else if (m.isType<geometry_msgs::PoseStamped>())
+      e->ground_truth = m.instantiate<geometry_msgs::PoseStamped>();
+    else
+      continue;
+    out->Push(e);
+  }
+  out->Push(NULL);
+}
+
+void EkfBag::ProcessImages(EventQueue* in, EventQueue* out) {
+  // follow the same schedule as UpdateImu and UpdateImage, so that the
+  // same images are processed as when replaying serially
+  bool processing_of = false, processing_sparse_map = false;
+  ros::Time of_send_time, vl_send_time;
+
+  std::shared_ptr<BagEvent> e;
+  while ((e = in->Pop()) != NULL) {
+    if (e->imu) {
+      if (processing_of && e->time >= of_send_time)
+        processing_of = false;
+      if (processing_sparse_map && e->time >= vl_send_time)
+        processing_sparse_map = false;
+    } else if (e->image) {
+      ProcessImage(e->image, !processing_of, !processing_sparse_map, &e->features);
+      if (e->features.of) {
+        processing_of = true;
+        of_send_time = e->time + ros::Duration(of_delay_);
+      }
+      if (e->features.vl && e->features.image_ok) {
+        processing_sparse_map = true;
+        vl_send_time = e->time + ros::Duration(sparse_map_delay_);
+      }
+    }
+    out->Push(e);
+  }
+  out->Push(NULL);
+}
+
+void EkfBag::Run(bool pipelined) {
+  EstimateBias();
+  SeedGroundTruth();
 
   processing_of_ = processing_sparse_map_ = false;
   of_id_ = vl_id_ = 0;
 
+  if (pipelined) {
+    EventQueue read(kEventQueueSize), processed(kEventQueueSize);
+    std::thread reader(&EkfBag::ReadBag, this, &read);
+    std::thread vision(&EkfBag::ProcessImages, this, &read, &processed);
+
+    // step the EKF on this thread
+    std::shared_ptr<BagEvent> e;
+    while ((e = processed.Pop()) != NULL) {
+      if (e->image) {
+        processed_features_ = &e->features;
+        UpdateImage(e->time, e->image);
+        processed_features_ = NULL;
+        common::PrintProgressBar(stdout, e->progress);
+      } else if (e->imu) {
+        UpdateImu(e->time, *e->imu.get());
+      } else if (e->ground_truth) {
+        UpdateGroundTruth(*e->ground_truth.get());
+      }
+    }
+    reader.join();
+    vision.join();
+    printf("\n");
+    return;
+  }
+
+  rosbag::View view;
+  AddReplayQuery(&view);
+
   int progress = 0;
   for (rosbag::MessageInstance const m : view) {
     progress++;
@@ -21,6 +21,9 @@
 #include <camera/camera_params.h>
 #include <Eigen/Core>
 
+#include <string>
+#include <vector>
+
 namespace ekf_bag {
 
 Eigen::Vector3f QuatToEuler(const geometry_msgs::Quaternion & q) {
@@ -43,14 +46,48 @@ Eigen::Vector3f QuatToEuler(const Eigen::Quaternionf & q) {
   return euler;
 }
 
-EkfBagCsv::EkfBagCsv(const char* bagfile, const char* mapfile, const char* csvfile) :
-          EkfBag(bagfile, mapfile),
+std::vector<std::string> Columns(std::string const& names) {
+  std::vector<std::string> columns;
+  size_t start = 0;
+  while (start < names.size()) {
+    size_t end = names.find(' ', start);
+    if (end == std::string::npos)
+      end = names.size();
+    columns.push_back(names.substr(start, end - start));
+    start = end + 1;
+  }
+  return columns;
+}
+
+EkfBagCsv::EkfBagCsv(const char* bagfile, const char* mapfile, const char* csvfile, bool columnar) :
+          EkfBag(bagfile, mapfile), f_(NULL), columnar_(columnar), rows_(0),
           start_time_set_(false) {
   // virtual function has to be called in subclass since not initialized in superclass
   config_reader::ConfigReader config;
   ReadParams(&config);
 
-  f_ = fopen(csvfile, "r");
+  if (columnar_) {
+    if (!columns_.Open(csvfile)) {
+      fprintf(stderr, "Failed to open file %s.", csvfile);
+      exit(0);
+    }
+    // each table starts with the row number, which orders the rows of all the tables
+    std::vector<std::string> ekf = Columns("row t x y z roll pitch yaw vx vy vz ox oy oz ax ay az "
+                                           "abx aby abz gbx gby gbz confidence status ml_count of_count");
+    for (int i = 1; i <= 15; i++)
+      ekf.push_back("cov_" + std::to_string(i));
+    for (int i = 1; i <= 50; i++)
+      ekf.push_back("mahal_" + std::to_string(i));
+    ekf_table_ = columns_.AddTable("EKF", ekf);
+    of_table_ = columns_.AddTable("OF", Columns("row t count"));
+    of_features_table_ = columns_.AddTable("OF_FEATURES", Columns("row id time x y"));
+    vl_table_ = columns_.AddTable("VL", Columns("row t count x y z roll pitch yaw"));
+    vl_landmarks_table_ = columns_.AddTable("VL_LANDMARKS", Columns("row u v x y z"));
+    gt_table_ = columns_.AddTable("GT", Columns("row t x y z roll pitch yaw"));
+    return;
+  }
+
+  f_ = fopen(csvfile, "w");
   if (f_ == NULL) {
     fprintf(stderr, "Failed to open file %s.", csvfile);
     exit(0);
@@ -58,7 +95,14 @@ EkfBagCsv::EkfBagCsv(const char* bagfile, const char* mapfile, const char* csvfi
 }
 
 EkfBagCsv::~EkfBagCsv(void) {
-  fclose(f_);
+  if (columnar_)
+    columns_.Close();
+  else
+    fclose(f_);
+}
+
+void EkfBagCsv::AppendRow(int table) {
+  columns_.Append(table, &row_[0]);
 }
 
 void EkfBagCsv::ReadParams(config_reader::ConfigReader* config) {
@@ -66,15 +110,31 @@ void EkfBagCsv::ReadParams(config_reader::ConfigReader* config) {
 
   camera::CameraParameters cam_params(config, "nav_cam");
   tracked_of_.SetCameraParameters(cam_params);
+  tracked_of_.SetStatistics(&stats_);
+  tracked_sm_.SetCameraParameters(cam_params);
 }
 
 void EkfBagCsv::UpdateEKF(const ff_msgs::EkfState & s) {
   EkfBag::UpdateEKF(s);
+  tracked_sm_.UpdatePose(s.pose);
 
   if (!start_time_set_) {
     start_time_ = s.header.stamp;
     start_time_set_ = true;
   }
+  if (columnar_) {
+    Eigen::Vector3f euler = QuatToEuler(s.pose.orientation);
+    row_ = {static_cast<double>(rows_++), (s.header.stamp - start_time_).toSec(),
+            s.pose.position.x, s.pose.position.y, s.pose.position.z, euler.x(), euler.y(), euler.z(),
+            s.velocity.x, s.velocity.y, s.velocity.z, s.omega.x, s.omega.y, s.omega.z,
+            s.accel.x, s.accel.y, s.accel.z, s.accel_bias.x, s.accel_bias.y, s.accel_bias.z,
+            s.gyro_bias.x, s.gyro_bias.y, s.gyro_bias.z, static_cast<double>(s.confidence),
+            static_cast<double>(s.status), static_cast<double>(s.ml_count), static_cast<double>(s.of_count)};
+    row_.insert(row_.end(), s.cov_diag.begin(), s.cov_diag.begin() + 15);
+    row_.insert(row_.end(), s.ml_mahal_dists.begin(), s.ml_mahal_dists.begin() + 50);
+    AppendRow(ekf_table_);
+    return;
+  }
   fprintf(f_, "EKF %g ", (s.header.stamp - start_time_).toSec());
   fprintf(f_, "%g %g %g ", s.pose.position.x, s.pose.position.y, s.pose.position.z);
   Eigen::Vector3f euler = QuatToEuler(s.pose.orientation);
@@ -101,6 +161,17 @@ void EkfBagCsv::UpdateOpticalFlow(const ff_msgs::Feature2dArray & of) {
     return;
   float t = (of.header.stamp - start_time_).toSec();
   tracked_of_.UpdateFeatures(of, t);
+  if (columnar_) {
+    double row = rows_++;
+    row_ = {row, t, static_cast<double>(of.feature_array.size())};
+    AppendRow(of_table_);
+    for (auto it = tracked_of_.begin(); it != tracked_of_.end(); it++) {
+      const auto & a = (*it).second;
+      row_ = {row, static_cast<double>(a.id), a.time, a.x, a.y};
+      AppendRow(of_features_table_);
+    }
+    return;
+  }
   fprintf(f_, "OF %g ", t);
   fprintf(f_, "%d ", static_cast<int>(of.feature_array.size()));
   for (auto it = tracked_of_.begin(); it != tracked_of_.end(); it++) {
@@ -116,8 +187,11 @@ void EkfBagCsv::UpdateSparseMap(const ff_msgs::VisualLandmarks & vl) {
   if (!start_time_set_)
     return;
   const camera::CameraParameters & params = map_.GetCameraParameters();
-  fprintf(f_, "VL %g ", (vl.header.stamp - start_time_).toSec());
-  fprintf(f_, "%d ", static_cast<int>(vl.landmarks.size()));
+  // the error of each landmark against the latest pose of the EKF
+  tracked_sm_.SetCameraToBody(ekf_.GetNavCamToBody());
+  tracked_sm_.UpdateFeatures(vl, (vl.header.stamp - start_time_).toSec());
+  for (auto it = tracked_sm_.begin(); it != tracked_sm_.end(); it++)
+    stats_.AddReprojectionError((tracked_sm_.FeatureToCurrentPixel(*it) - it->pixel.cast<double>()).norm());
   Eigen::Vector3f trans = ekf_.GetNavCamToBody().translation().cast<float>();
   Eigen::Quaternionf q1(0, trans.x(), trans.y(), trans.z());
   Eigen::Quaternionf q2(vl.pose.orientation.w, vl.pose.orientation.x, vl.pose.orientation.y, vl.pose.orientation.z);
@@ -127,8 +201,24 @@ void EkfBagCsv::UpdateSparseMap(const ff_msgs::VisualLandmarks & vl) {
   Eigen::Quaternionf t = (q2 * q1) * q2.conjugate();
   Eigen::Vector3f r(vl.pose.position.x, vl.pose.position.y, vl.pose.position.z);
   r -= Eigen::Vector3f(t.x(), t.y(), t.z());
-  fprintf(f_, "%g %g %g ", r.x(), r.y(), r.z());
   Eigen::Vector3f euler = QuatToEuler(q2);
+  if (columnar_) {
+    double row = rows_++;
+    row_ = {row, (vl.header.stamp - start_time_).toSec(), static_cast<double>(vl.landmarks.size()),
+            r.x(), r.y(), r.z(), euler.x(), euler.y(), euler.z()};
+    AppendRow(vl_table_);
+    for (unsigned int i = 0; i < vl.landmarks.size(); i++) {
+      Eigen::Vector2d input(vl.landmarks[i].u, vl.landmarks[i].v);
+      Eigen::Vector2d output;
+      params.Convert<camera::UNDISTORTED_C, camera::DISTORTED_C>(input, &output);
+      row_ = {row, output.x(), output.y(), vl.landmarks[i].x, vl.landmarks[i].y, vl.landmarks[i].z};
+      AppendRow(vl_landmarks_table_);
+    }
+    return;
+  }
+  fprintf(f_, "VL %g ", (vl.header.stamp - start_time_).toSec());
+  fprintf(f_, "%d ", static_cast<int>(vl.landmarks.size()));
+  fprintf(f_, "%g %g %g ", r.x(), r.y(), r.z());
   fprintf(f_, "%g %g %g ", euler.x(), euler.y(), euler.z());
   for (unsigned int i = 0; i < vl.landmarks.size(); i++) {
     Eigen::Vector2d input(vl.landmarks[i].u, vl.landmarks[i].v);
@@ -142,8 +232,15 @@ void EkfBagCsv::UpdateSparseMap(const ff_msgs::VisualLandmarks & vl) {
 void EkfBagCsv::UpdateGroundTruth(const geometry_msgs::PoseStamped & gt) {
   EkfBag::UpdateGroundTruth(gt);
 
-  if (f_ == NULL || !start_time_set_)
+  if (!start_time_set_)
+    return;
+  if (columnar_) {
+    Eigen::Vector3f euler = QuatToEuler(gt.pose.orientation);
+    row_ = {static_cast<double>(rows_++), (gt.header.stamp - start_time_).toSec(),
+            gt.pose.position.x, gt.pose.position.y, gt.pose.position.z, euler.x(), euler.y(), euler.z()};
+    AppendRow(gt_table_);
     return;
+  }
   fprintf(f_, "GT %g ", (gt.header.stamp - start_time_).toSec());
   fprintf(f_, "%g %g %g ", gt.pose.position.x, gt.pose.position.y, gt.pose.position.z);
   Eigen::Vector3f euler = QuatToEuler(gt.pose.orientation);
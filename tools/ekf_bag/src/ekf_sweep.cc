@@ -0,0 +1,184 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ekf_bag/ekf_sweep.h>
+
+#include <Eigen/Geometry>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace ekf_bag {
+
+// enough inputs for a few seconds, so that the EKFs need not step in lockstep
+static const size_t kInputQueueSize = 1000;
+
+EkfSweep::Config::Config(void) : queue(kInputQueueSize), have_ground_truth(false) {
+  memset(&stats, 0, sizeof(stats));
+}
+
+EkfSweep::EkfSweep(const char* bagfile, const char* mapfile, std::vector<std::string> const& config_files) :
+          EkfBag(bagfile, mapfile) {
+  // virtual function has to be called in subclass since not initialized in superclass
+  config_reader::ConfigReader config;
+  ReadParams(&config);
+
+  // the autocode is set up one instance at a time, so this happens before any threads start
+  for (size_t i = 0; i < config_files.size(); i++) {
+    std::unique_ptr<Config> c(new Config());
+    c->file = config_files[i];
+    config_reader::ConfigReader reader;
+    AddConfigFiles(&reader);
+    reader.AddFile(c->file.c_str());
+    if (!reader.ReadFiles())
+      LOG(FATAL) << "Failed to read config file " << c->file << ".";
+    c->ekf.ReadParams(&reader);
+    configs_.push_back(std::move(c));
+  }
+}
+
+EkfSweep::~EkfSweep(void) {}
+
+void EkfSweep::Sweep(bool pipelined) {
+  for (size_t i = 0; i < configs_.size(); i++)
+    configs_[i]->thread = std::thread(&EkfSweep::RunConfig, configs_[i].get());
+  Run(pipelined);
+  for (size_t i = 0; i < configs_.size(); i++) {
+    configs_[i]->queue.Push(NULL);
+    configs_[i]->thread.join();
+  }
+}
+
+void EkfSweep::WriteStats(FILE* f) const {
+  fprintf(f, "# config count pos_rmse pos_max att_rmse att_max (meters, degrees)\n");
+  for (size_t i = 0; i < configs_.size(); i++) {
+    const ErrorStats & s = configs_[i]->stats;
+    int n = std::max(s.count, 1);
+    fprintf(f, "%s %d %g %g %g %g\n", configs_[i]->file.c_str(), s.count,
+            sqrt(s.pos_sq_sum / n), s.pos_max,
+            sqrt(s.att_sq_sum / n) * 180 / M_PI, s.att_max * 180 / M_PI);
+  }
+}
+
+void EkfSweep::Send(Input* input) {
+  std::shared_ptr<const Input> shared(input);
+  for (size_t i = 0; i < configs_.size(); i++)
+    configs_[i]->queue.Push(shared);
+}
+
+void EkfSweep::UpdateGroundTruth(const geometry_msgs::PoseStamped & pose) {
+  EkfBag::UpdateGroundTruth(pose);
+  Input* in = new Input();
+  in->type = Input::GROUND_TRUTH;
+  in->ground_truth = pose.pose;
+  Send(in);
+}
+
+void EkfSweep::EkfSetBias(const Eigen::Vector3f & gyro_bias, const Eigen::Vector3f & accel_bias) {
+  Input* in = new Input();
+  in->type = Input::SET_BIAS;
+  in->gyro_bias = gyro_bias;
+  in->accel_bias = accel_bias;
+  Send(in);
+}
+
+void EkfSweep::EkfOpticalFlowRegister(const ff_msgs::CameraRegistration & reg) {
+  Input* in = new Input();
+  in->type = Input::OF_REGISTER;
+  in->reg = reg;
+  Send(in);
+}
+
+void EkfSweep::EkfOpticalFlowUpdate(const ff_msgs::Feature2dArray & of) {
+  Input* in = new Input();
+  in->type = Input::OF_UPDATE;
+  in->of = of;
+  Send(in);
+}
+
+void EkfSweep::EkfSparseMapRegister(const ff_msgs::CameraRegistration & reg) {
+  Input* in = new Input();
+  in->type = Input::VL_REGISTER;
+  in->reg = reg;
+  Send(in);
+}
+
+void EkfSweep::EkfSparseMapUpdate(const ff_msgs::VisualLandmarks & vl) {
+  Input* in = new Input();
+  in->type = Input::VL_UPDATE;
+  in->vl = vl;
+  Send(in);
+}
+
+void EkfSweep::EkfStep(const sensor_msgs::Imu & imu, const geometry_msgs::Quaternion & quat) {
+  Input* in = new Input();
+  in->type = Input::STEP;
+  in->imu = imu;
+  in->quat = quat;
+  Send(in);
+}
+
+void EkfSweep::RunConfig(Config* c) {
+  std::shared_ptr<const Input> in;
+  while ((in = c->queue.Pop()) != NULL) {
+    switch (in->type) {
+      case Input::SET_BIAS:
+        c->ekf.SetBias(in->gyro_bias, in->accel_bias);
+        c->ekf.Reset();
+        break;
+      case Input::OF_REGISTER:
+        c->ekf.OpticalFlowRegister(in->reg);
+        break;
+      case Input::OF_UPDATE:
+        c->ekf.OpticalFlowUpdate(in->of);
+        break;
+      case Input::VL_REGISTER:
+        c->ekf.SparseMapRegister(in->reg);
+        break;
+      case Input::VL_UPDATE:
+        c->ekf.SparseMapUpdate(in->vl);
+        break;
+      case Input::GROUND_TRUTH:
+        c->ground_truth = in->ground_truth;
+        c->have_ground_truth = true;
+        break;
+      case Input::STEP: {
+        c->ekf.PrepareStep(in->imu, in->quat);
+        ff_msgs::EkfState state;
+        if (!c->ekf.Step(&state) || !c->have_ground_truth)
+          break;
+        // compare with the most recent ground truth
+        const geometry_msgs::Point & p = state.pose.position, & t = c->ground_truth.position;
+        double pos = Eigen::Vector3d(p.x - t.x, p.y - t.y, p.z - t.z).norm();
+        const geometry_msgs::Quaternion & q = state.pose.orientation, & r = c->ground_truth.orientation;
+        double att = Eigen::Quaterniond(q.w, q.x, q.y, q.z).angularDistance(Eigen::Quaterniond(r.w, r.x, r.y, r.z));
+        ErrorStats & s = c->stats;
+        s.count++;
+        s.pos_sq_sum += pos * pos;
+        s.pos_max = std::max(s.pos_max, pos);
+        s.att_sq_sum += att * att;
+        s.att_max = std::max(s.att_max, att);
+        break;
+      }
+    }
+  }
+}
+
+}  // end namespace ekf_bag
@@ -22,30 +22,81 @@
 
 #include <Eigen/Core>
 
+#include <algorithm>
+#include <cmath>
+
 namespace ekf_bag {
 
+FeatureStatistics::FeatureStatistics(float bin_seconds, int num_bins) :
+                 bin_seconds_(bin_seconds), track_histogram_(num_bins, 0), num_tracks_(0),
+                 track_seconds_(0), track_frames_(0), num_errors_(0), error_mean_(0),
+                 error_m2_(0), error_max_(0) {}
+
+void FeatureStatistics::AddTrack(float seconds, int frames) {
+  int bin = std::min(static_cast<int>(seconds / bin_seconds_), static_cast<int>(track_histogram_.size()) - 1);
+  track_histogram_[std::max(bin, 0)]++;
+  num_tracks_++;
+  track_seconds_ += seconds;
+  track_frames_ += frames;
+}
+
+void FeatureStatistics::AddReprojectionError(float pixels) {
+  num_errors_++;
+  double delta = pixels - error_mean_;
+  error_mean_ += delta / num_errors_;
+  error_m2_ += delta * (pixels - error_mean_);
+  error_max_ = std::max(error_max_, static_cast<double>(pixels));
+}
+
+double FeatureStatistics::ErrorStdDev(void) const {
+  if (num_errors_ < 2)
+    return 0;
+  return sqrt(error_m2_ / (num_errors_ - 1));
+}
+
+void FeatureStatistics::Print(FILE* f) const {
+  fprintf(f, "%lld optical flow tracks", static_cast<long long>(num_tracks_));  // NOLINT
+  if (num_tracks_ > 0)
+    fprintf(f, ", lasting %g s and %g frames on average", track_seconds_ / num_tracks_,
+            track_frames_ / num_tracks_);
+  fprintf(f, "\n");
+  for (unsigned int i = 0; i < track_histogram_.size(); i++) {
+    if (i + 1 < track_histogram_.size())
+      fprintf(f, "  %5.2f - %5.2f s: ", i * bin_seconds_, (i + 1) * bin_seconds_);
+    else
+      fprintf(f, "  %5.2f s -      : ", i * bin_seconds_);
+    fprintf(f, "%lld\n", static_cast<long long>(track_histogram_[i]));  // NOLINT
+  }
+  fprintf(f, "%lld sparse map features, reprojection error mean %g px, std. dev. %g px, max %g px\n",
+          static_cast<long long>(num_errors_), error_mean_, ErrorStdDev(), error_max_);  // NOLINT
+}
+
 void TrackedOFFeatures::UpdateFeatures(const ff_msgs::Feature2dArray & of, float time) {
   std::map<int, ff_msgs::Feature2d > cur_features;
   for (unsigned int i = 0; i < of.feature_array.size(); i++) {
     cur_features.insert(std::pair<int, ff_msgs::Feature2d >(of.feature_array[i].id, of.feature_array[i]));
   }
 
-  for (std::map<int, struct OFFeature>::iterator it = f_.begin(); it != f_.end(); it++) {
-    int count = cur_features.count(it->first);
-    if (count == 0) {
+  // drop the tracks that ended, so only the current ones are kept
+  for (std::map<int, struct OFFeature>::iterator it = f_.begin(); it != f_.end();) {
+    if (cur_features.count(it->first) == 0) {
+      if (stats_ != NULL)
+        stats_->AddTrack(time - it->second.time, it->second.frames);
       it = f_.erase(it);
-      it--;  // erase returns the next element, so we would skip it
+    } else {
+      it++;
     }
   }
   for (std::map<int, ff_msgs::Feature2d >::const_iterator it = cur_features.begin(); it != cur_features.end(); it++) {
     Eigen::Vector2d input(it->second.x, it->second.y);
     Eigen::Vector2d output;
     params_.Convert<camera::UNDISTORTED_C, camera::DISTORTED_C>(input, &output);
-    struct OFFeature f = {it->second.id, time, static_cast<float>(output.x()), static_cast<float>(output.y())};
+    struct OFFeature f = {it->second.id, time, static_cast<float>(output.x()), static_cast<float>(output.y()), 0};
     auto t = f_.emplace(f.id, f);
     // if is already present
     t.first->second.x = output.x();
     t.first->second.y = output.y();
+    t.first->second.frames++;
   }
 }
 
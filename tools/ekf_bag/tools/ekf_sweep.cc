@@ -0,0 +1,52 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <common/init.h>
+#include <ekf_bag/ekf_sweep.h>
+#include <gflags/gflags.h>
+
+#include <string>
+#include <vector>
+
+DEFINE_bool(pipelined, false, "Read the bag and process the images on separate threads.");
+DEFINE_double(start, 0, "Replay from this many seconds after the bag begins.");
+DEFINE_double(duration, 0, "Replay only this many seconds, if positive.");
+
+int main(int argc, char ** argv) {
+  common::InitFreeFlyerApplication(&argc, &argv);
+
+  if (argc < 5) {
+    LOG(INFO) << "Usage: " << argv[0] << " map.map bag.bag output.txt config1.config [config2.config ...]";
+    exit(0);
+  }
+
+  std::vector<std::string> configs(argv + 4, argv + argc);
+  ekf_bag::EkfSweep sweep(argv[2], argv[1], configs);
+  if (FLAGS_start > 0 || FLAGS_duration > 0)
+    sweep.SetWindow(FLAGS_start, FLAGS_duration);
+  sweep.Sweep(FLAGS_pipelined);
+
+  FILE* f = fopen(argv[3], "w");
+  if (f == NULL) {
+    LOG(ERROR) << "Failed to open file " << argv[3] << ".";
+    return 1;
+  }
+  sweep.WriteStats(f);
+  fclose(f);
+  return 0;
+}
@@ -18,6 +18,12 @@
 
 #include <common/init.h>
 #include <ekf_bag/ekf_bag_csv.h>
+#include <gflags/gflags.h>
+
+DEFINE_bool(pipelined, false, "Read the bag, process the images and step the EKF on separate threads.");
+DEFINE_double(start, 0, "Replay from this many seconds after the bag begins.");
+DEFINE_double(duration, 0, "Replay only this many seconds, if positive.");
+DEFINE_bool(columnar, false, "Write binary tables of columns, which columns_to_csv converts to text.");
 
 int main(int argc, char ** argv) {
   common::InitFreeFlyerApplication(&argc, &argv);
@@ -27,8 +33,11 @@ int main(int argc, char ** argv) {
     exit(0);
   }
 
-  ekf_bag::EkfBagCsv bag(argv[2], argv[1], argv[3]);
+  ekf_bag::EkfBagCsv bag(argv[2], argv[1], argv[3], FLAGS_columnar);
 
-  bag.Run();
+  if (FLAGS_start > 0 || FLAGS_duration > 0)
+    bag.SetWindow(FLAGS_start, FLAGS_duration);
+  bag.Run(FLAGS_pipelined);
+  bag.Statistics().Print(stdout);
 }
 
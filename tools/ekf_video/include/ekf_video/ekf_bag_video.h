@@ -19,6 +19,7 @@
 #ifndef EKF_VIDEO_EKF_BAG_VIDEO_H_
 #define EKF_VIDEO_EKF_BAG_VIDEO_H_
 
+#include <ekf_bag/bounded_queue.h>
 #include <ekf_bag/ekf_bag.h>
 #include <ekf_bag/tracked_features.h>
 #include <ekf_video/video_writer.h>
@@ -26,9 +27,16 @@
 #include <ff_msgs/EkfState.h>
 #include <geometry_msgs/Pose.h>
 
+#include <Eigen/Core>
+
+#include <future>  // NOLINT
 #include <list>
+#include <memory>
 #include <string>
+#include <thread>  // NOLINT
+#include <vector>
 
+class QImage;
 class QPainter;
 class QRect;
 
@@ -39,7 +47,13 @@ namespace ekf_video {
 
 class EkfBagVideo : public ekf_bag::EkfBag {
  public:
-  EkfBagVideo(const char* bagfile, const char* mapfile, const char* videofile);
+  /**
+   * With render_threads more than zero, the frames are drawn on that many
+   * threads and encoded on another one, in the same order, while the replay
+   * goes on. encoder names the libavcodec encoder to try first, if not NULL.
+   **/
+  EkfBagVideo(const char* bagfile, const char* mapfile, const char* videofile,
+              int render_threads = 0, const char* encoder = NULL);
   virtual ~EkfBagVideo(void);
 
  protected:
@@ -52,24 +66,49 @@ class EkfBagVideo : public ekf_bag::EkfBag {
   virtual void ReadParams(config_reader::ConfigReader* config);
 
  private:
-  void DrawImage(QPainter & p, const sensor_msgs::ImageConstPtr & ros_image, const QRect & rect);
-  void DrawTable(QPainter & p, const QRect & rect);
-
-  void DrawVelocity(QPainter & p, const QRect & rect);
-  void DrawOmega(QPainter & p, const QRect & rect);
-  void DrawAccelBias(QPainter & p, const QRect & rect);
-  void DrawGyroBias(QPainter & p, const QRect & rect);
-  void DrawPositionCov(QPainter & p, const QRect & rect);
-  void DrawVelocityCov(QPainter & p, const QRect & rect);
-  void DrawAngleCov(QPainter & p, const QRect & rect);
-
-  void DrawStatus(QPainter & p, const QRect & rect);
-  void DrawSMFeatureCount(QPainter & p, const QRect & rect);
-  void DrawOFFeatureCount(QPainter & p, const QRect & rect);
-
-  void DrawMahalanobis(QPainter & p, const QRect & rect);
-
-  void DrawBarGraph(QPainter & p, const QRect & rect,
+  // everything a frame shows, copied when its image is replayed so it can be drawn later
+  typedef struct {
+    sensor_msgs::ImageConstPtr image;
+    ff_msgs::EkfState state;
+    std::vector<geometry_msgs::Pose> pose_history;
+    std::vector<Eigen::Vector2f> of_points, sm_points;  // relative to the image center
+    int of_count, ml_count;
+    int mahal_bins[MAHAL_NUM_BINS];
+  } Overlay;
+
+  // a frame being drawn by a render thread, which the encoder thread waits for
+  typedef struct {
+    Overlay overlay;
+    std::promise<std::shared_ptr<QImage> > image;
+    std::future<std::shared_ptr<QImage> > drawn;  // of image, taken before it is shared
+  } Frame;
+  typedef ekf_bag::BoundedQueue<std::shared_ptr<Frame> > FrameQueue;  // NULL marks the end
+
+  void Snapshot(const sensor_msgs::ImageConstPtr & ros_image, Overlay* o);
+  static void Render(const Overlay & o, QImage* image);
+
+  // the pipeline threads
+  void RenderFrames(void);
+  void EncodeFrames(void);
+
+  static void DrawImage(QPainter & p, const Overlay & o, const QRect & rect);
+  static void DrawTable(QPainter & p, const Overlay & o, const QRect & rect);
+
+  static void DrawVelocity(QPainter & p, const Overlay & o, const QRect & rect);
+  static void DrawOmega(QPainter & p, const Overlay & o, const QRect & rect);
+  static void DrawAccelBias(QPainter & p, const Overlay & o, const QRect & rect);
+  static void DrawGyroBias(QPainter & p, const Overlay & o, const QRect & rect);
+  static void DrawPositionCov(QPainter & p, const Overlay & o, const QRect & rect);
+  static void DrawVelocityCov(QPainter & p, const Overlay & o, const QRect & rect);
+  static void DrawAngleCov(QPainter & p, const Overlay & o, const QRect & rect);
+
+  static void DrawStatus(QPainter & p, const Overlay & o, const QRect & rect);
+  static void DrawSMFeatureCount(QPainter & p, const Overlay & o, const QRect & rect);
+  static void DrawOFFeatureCount(QPainter & p, const Overlay & o, const QRect & rect);
+
+  static void DrawMahalanobis(QPainter & p, const Overlay & o, const QRect & rect);
+
+  static void DrawBarGraph(QPainter & p, const QRect & rect,
                     int data_count, const float* data,
                     float y_min, float y_max,
                     const char* title, const char* xlabel, const char* ylabel,
@@ -77,6 +116,12 @@ class EkfBagVideo : public ekf_bag::EkfBag {
 
   VideoWriter video_;
 
+  // frames waiting for a render thread, and all frames in order for the encoder,
+  // whose sizes bound the frames in memory
+  std::unique_ptr<FrameQueue> render_queue_, encode_queue_;
+  std::vector<std::thread> render_threads_;
+  std::thread encode_thread_;
+
   ekf_bag::TrackedOFFeatures tracked_of_;
   ekf_bag::TrackedSMFeatures tracked_sm_;
 
@@ -24,6 +24,7 @@
 struct AVCodecContext;
 struct AVFormatContext;
 struct AVFrame;
+struct AVStream;
 
 class QImage;
 
@@ -31,13 +32,19 @@ namespace ekf_video {
 
 class VideoWriter {
  public:
-  VideoWriter(const char* videofile, int width, int height);
+  /**
+   * Writes H.264 video. If encoder names a libavcodec encoder, such as
+   * h264_nvenc, it is tried first, and libx264 is used if it can't be opened.
+   **/
+  VideoWriter(const char* videofile, int width, int height, const char* encoder = NULL);
   virtual ~VideoWriter(void);
 
   virtual void AddFrame(const QImage & image);
 
  private:
-  void OpenVideo(const char* videofile);
+  void OpenVideo(const char* videofile, const char* encoder);
+  // opens codec_context_ with the named encoder, or libx264 if NULL
+  bool OpenCodec(AVStream* stream, const char* encoder);
   void CloseVideo();
 
   int EncodeFrame(AVFrame* frame, int* output_received);
@@ -30,17 +30,54 @@
 
 namespace ekf_video {
 
-EkfBagVideo::EkfBagVideo(const char* bagfile, const char* mapfile, const char* videofile) :
-          EkfBag(bagfile, mapfile), video_(videofile, 1920, 1080) {
+EkfBagVideo::EkfBagVideo(const char* bagfile, const char* mapfile, const char* videofile,
+                         int render_threads, const char* encoder) :
+          EkfBag(bagfile, mapfile), video_(videofile, 1920, 1080, encoder) {
   // virtual function has to be called in subclass since not initialized in superclass
   config_reader::ConfigReader config;
   ReadParams(&config);
 
   start_time_set_ = false;
   pose_count_ = 0;
+  of_count_ = ml_count_ = 0;
+  memset(mahal_bins_, 0, sizeof(int) * MAHAL_NUM_BINS);
+
+  if (render_threads > 0) {
+    // a few frames per thread keeps them all busy, with little memory
+    render_queue_.reset(new FrameQueue(2 * render_threads));
+    encode_queue_.reset(new FrameQueue(4 * render_threads));
+    for (int i = 0; i < render_threads; i++)
+      render_threads_.push_back(std::thread(&EkfBagVideo::RenderFrames, this));
+    encode_thread_ = std::thread(&EkfBagVideo::EncodeFrames, this);
+  }
 }
 
 EkfBagVideo::~EkfBagVideo(void) {
+  if (!encode_queue_)
+    return;
+  // finish the frames already replayed before the video is closed
+  for (size_t i = 0; i < render_threads_.size(); i++)
+    render_queue_->Push(NULL);
+  encode_queue_->Push(NULL);
+  for (std::thread & t : render_threads_)
+    t.join();
+  encode_thread_.join();
+}
+
+void EkfBagVideo::RenderFrames(void) {
+  std::shared_ptr<Frame> f;
+  while ((f = render_queue_->Pop()) != NULL) {
+    std::shared_ptr<QImage> image(new QImage(1920, 1080, QImage::Format_ARGB32));
+    Render(f->overlay, image.get());
+    f->image.set_value(image);
+  }
+}
+
+void EkfBagVideo::EncodeFrames(void) {
+  // frames are taken in replay order, waiting for each to be drawn
+  std::shared_ptr<Frame> f;
+  while ((f = encode_queue_->Pop()) != NULL)
+    video_.AddFrame(*f->drawn.get());
 }
 
 void EkfBagVideo::ReadParams(config_reader::ConfigReader* config) {
@@ -59,7 +96,8 @@ void EkfBagVideo::ReadParams(config_reader::ConfigReader* config) {
   tracked_sm_.SetCameraToBody(nav_cam_to_body);
 }
 
-void EkfBagVideo::DrawImage(QPainter & p, const sensor_msgs::ImageConstPtr & ros_image, const QRect & rect) {
+void EkfBagVideo::DrawImage(QPainter & p, const Overlay & o, const QRect & rect) {
+  const sensor_msgs::ImageConstPtr & ros_image = o.image;
   const QImage gray(ros_image->data.data(), ros_image->width, ros_image->height,
                     ros_image->step, QImage::Format_Grayscale8);
   // draw on image
@@ -71,30 +109,26 @@ void EkfBagVideo::DrawImage(QPainter & p, const sensor_msgs::ImageConstPtr & ros
 
   // draw optical flow
   p.setBrush(QColor::fromRgb(0x99, 0x99, 0xFF, 0xA0));
-  for (auto it = tracked_of_.begin(); it != tracked_of_.end(); it++) {
-    const auto & a = (*it).second;
-    p.drawEllipse(QPointF(a.x, a.y), 4, 4);
-  }
+  for (const Eigen::Vector2f & a : o.of_points)
+    p.drawEllipse(QPointF(a.x(), a.y()), 4, 4);
 
   // draw sparse mapping
   p.setBrush(QColor::fromRgb(0xFF, 0x00, 0x66, 0xA0));
-  for (auto it = tracked_sm_.begin(); it != tracked_sm_.end(); it++) {
-    Eigen::Vector2d pixel = tracked_sm_.FeatureToCurrentPixel(*it);
+  for (const Eigen::Vector2f & pixel : o.sm_points)
     if (pixel.x() < rect.width() / 2 && pixel.y() < rect.height() / 2)
       p.drawEllipse(QPointF(pixel.x(), pixel.y()), 4, 4);
-  }
 
   p.resetTransform();
 }
 
-void EkfBagVideo::DrawTable(QPainter & p, const QRect & rect) {
+void EkfBagVideo::DrawTable(QPainter & p, const Overlay & o, const QRect & rect) {
   // draw robot pose
   p.translate(rect.center().x(), rect.center().y());
   p.scale(rect.width() / 2.13333, rect.height() / 2.13333);
 
-  if (pose_history_.size() > 0) {
+  if (o.pose_history.size() > 0) {
     p.fillRect(QRectF(-1.0, -1.0, 2.0, 2.0), QBrush(QColor::fromRgb(0xDD, 0xDD, 0xDD)));
-    auto & pose = pose_history_.back();
+    auto & pose = o.pose_history.back();
     Eigen::Quaternionf o(pose.orientation.w, pose.orientation.x, pose.orientation.y, pose.orientation.z);
     auto euler = o.toRotationMatrix().eulerAngles(0, 1, 2);
     float zrot = (euler[2] + M_PI) * 180.0 / M_PI;
@@ -109,11 +143,11 @@ void EkfBagVideo::DrawTable(QPainter & p, const QRect & rect) {
     p.translate(-pose.position.x, -pose.position.y);
 
     int i = 0;
-    for (auto it = pose_history_.begin(); it != pose_history_.end(); it++) {
+    for (auto it = o.pose_history.begin(); it != o.pose_history.end(); it++) {
       pen.setColor(QColor::fromRgb(0x10, 0xDD, 0x10, (unsigned char)(255 * (i / 200.0))));
       p.setPen(pen);
       auto second = std::next(it);
-      if (second == pose_history_.end())
+      if (second == o.pose_history.end())
         break;
       p.drawLine(QLineF(it->position.x, it->position.y, second->position.x, second->position.y));
       i++;
@@ -221,11 +255,11 @@ void EkfBagVideo::DrawBarGraph(QPainter & p, const QRect & rect,
   p.resetTransform();
 }
 
-void EkfBagVideo::DrawMahalanobis(QPainter & p, const QRect & rect) {
+void EkfBagVideo::DrawMahalanobis(QPainter & p, const Overlay & o, const QRect & rect) {
   float data[MAHAL_NUM_BINS];
   std::string data_labels[MAHAL_NUM_BINS + 1];
   for (int i = 0; i < MAHAL_NUM_BINS; i++) {
-    data[i] = static_cast<float>(mahal_bins_[i]);
+    data[i] = static_cast<float>(o.mahal_bins[i]);
     std::stringstream stream;
     stream << std::fixed << std::setprecision(1) << (i * MAHAL_BIN_SIZE);
     data_labels[i] = stream.str();
@@ -235,25 +269,25 @@ void EkfBagVideo::DrawMahalanobis(QPainter & p, const QRect & rect) {
       NULL, NULL, data_labels, false);
 }
 
-void EkfBagVideo::DrawSMFeatureCount(QPainter & p, const QRect & rect) {
-  float count = static_cast<float>(ml_count_);
+void EkfBagVideo::DrawSMFeatureCount(QPainter & p, const Overlay & o, const QRect & rect) {
+  float count = static_cast<float>(o.ml_count);
   std::string data_label("Map Features");
   DrawBarGraph(p, rect, 1, &count, 0.0, 50.0, NULL, NULL, NULL, &data_label, true);
 }
 
-void EkfBagVideo::DrawOFFeatureCount(QPainter & p, const QRect & rect) {
-  float count = static_cast<float>(of_count_);
+void EkfBagVideo::DrawOFFeatureCount(QPainter & p, const Overlay & o, const QRect & rect) {
+  float count = static_cast<float>(o.of_count);
   std::string data_label("VO Features");
   DrawBarGraph(p, rect, 1, &count, 0.0, 50.0, NULL, NULL, NULL, &data_label, true);
 }
 
-void EkfBagVideo::DrawStatus(QPainter & p, const QRect & rect) {
+void EkfBagVideo::DrawStatus(QPainter & p, const Overlay & o, const QRect & rect) {
   QColor color = QColor::fromRgb(0xFF, 0x00, 0x00);
   std::string text("Lost");
-  if (state_.confidence == ff_msgs::EkfState::CONFIDENCE_GOOD) {
+  if (o.state.confidence == ff_msgs::EkfState::CONFIDENCE_GOOD) {
     color = QColor::fromRgb(0x00, 0xFF, 0x00);
     text = std::string("Good");
-  } else if (state_.confidence == ff_msgs::EkfState::CONFIDENCE_POOR) {
+  } else if (o.state.confidence == ff_msgs::EkfState::CONFIDENCE_POOR) {
     color = QColor::fromRgb(0xFF, 0xFF, 0x00);
     text = std::string("Poor");
   }
@@ -273,100 +307,130 @@ void EkfBagVideo::DrawStatus(QPainter & p, const QRect & rect) {
   p.drawText(rect, Qt::AlignCenter, text.c_str());
 }
 
-void EkfBagVideo::DrawVelocity(QPainter & p, const QRect & rect) {
+void EkfBagVideo::DrawVelocity(QPainter & p, const Overlay & o, const QRect & rect) {
   std::string data_labels[] = {std::string("x"), std::string("y"), std::string("z")};
-  float data[] = {static_cast<float>(state_.velocity.x),
-                  static_cast<float>(state_.velocity.y),
-                  static_cast<float>(state_.velocity.z)};
+  float data[] = {static_cast<float>(o.state.velocity.x),
+                  static_cast<float>(o.state.velocity.y),
+                  static_cast<float>(o.state.velocity.z)};
   DrawBarGraph(p, rect, 3, data, -0.25, 0.25, "Velocity", NULL, "m/s", data_labels, true);
 }
 
-void EkfBagVideo::DrawAccelBias(QPainter & p, const QRect & rect) {
+void EkfBagVideo::DrawAccelBias(QPainter & p, const Overlay & o, const QRect & rect) {
   std::string data_labels[] = {std::string("x"), std::string("y"), std::string("z")};
-  float data[] = {static_cast<float>(state_.accel_bias.x),
-                  static_cast<float>(state_.accel_bias.y),
-                  static_cast<float>(state_.accel_bias.z)};
+  float data[] = {static_cast<float>(o.state.accel_bias.x),
+                  static_cast<float>(o.state.accel_bias.y),
+                  static_cast<float>(o.state.accel_bias.z)};
   DrawBarGraph(p, rect, 3, data, -0.01, 0.01, "Accel Bias", NULL, "m/s^2", data_labels, true);
 }
 
-void EkfBagVideo::DrawOmega(QPainter & p, const QRect & rect) {
+void EkfBagVideo::DrawOmega(QPainter & p, const Overlay & o, const QRect & rect) {
   std::string data_labels[] = {std::string("\u03D1"), std::string("\u03C6"), std::string("\u03C8")};
-  float data[] = {static_cast<float>(state_.omega.x * 180.0 / M_PI),
-                  static_cast<float>(state_.omega.y * 180.0 / M_PI),
-                  static_cast<float>(state_.omega.z * 180.0 / M_PI)};
+  float data[] = {static_cast<float>(o.state.omega.x * 180.0 / M_PI),
+                  static_cast<float>(o.state.omega.y * 180.0 / M_PI),
+                  static_cast<float>(o.state.omega.z * 180.0 / M_PI)};
   DrawBarGraph(p, rect, 3, data, -45.0, 45.0, "Angular Velocity", NULL, "\u00B0/s", data_labels, true);
 }
 
-void EkfBagVideo::DrawGyroBias(QPainter & p, const QRect & rect) {
+void EkfBagVideo::DrawGyroBias(QPainter & p, const Overlay & o, const QRect & rect) {
   std::string data_labels[] = {std::string("\u03D1"), std::string("\u03C6"), std::string("\u03C8")};
-  float data[] = {static_cast<float>(state_.gyro_bias.x * 180.0 / M_PI),
-                  static_cast<float>(state_.gyro_bias.y * 180.0 / M_PI),
-                  static_cast<float>(state_.gyro_bias.z * 180.0 / M_PI)};
+  float data[] = {static_cast<float>(o.state.gyro_bias.x * 180.0 / M_PI),
+                  static_cast<float>(o.state.gyro_bias.y * 180.0 / M_PI),
+                  static_cast<float>(o.state.gyro_bias.z * 180.0 / M_PI)};
   DrawBarGraph(p, rect, 3, data, -0.1, 0.1, "Gyro Bias", NULL, "\u00B0/s", data_labels, true);
 }
 
-void EkfBagVideo::DrawPositionCov(QPainter & p, const QRect & rect) {
+void EkfBagVideo::DrawPositionCov(QPainter & p, const Overlay & o, const QRect & rect) {
   std::string data_labels[] = {std::string("x"), std::string("y"), std::string("z")};
-  float data[] = {static_cast<float>(sqrt(state_.cov_diag[12]) * 100.0),
-                  static_cast<float>(sqrt(state_.cov_diag[13]) * 100.0),
-                  static_cast<float>(sqrt(state_.cov_diag[14]) * 100.0)};
+  float data[] = {static_cast<float>(sqrt(o.state.cov_diag[12]) * 100.0),
+                  static_cast<float>(sqrt(o.state.cov_diag[13]) * 100.0),
+                  static_cast<float>(sqrt(o.state.cov_diag[14]) * 100.0)};
   DrawBarGraph(p, rect, 3, data, 0.0, 2.0, "Position Std. Dev.", NULL, "cm", data_labels, true);
 }
 
-void EkfBagVideo::DrawVelocityCov(QPainter & p, const QRect & rect) {
+void EkfBagVideo::DrawVelocityCov(QPainter & p, const Overlay & o, const QRect & rect) {
   std::string data_labels[] = {std::string("x"), std::string("y"), std::string("z")};
-  float data[] = {static_cast<float>(sqrt(state_.cov_diag[7]) * 100.0),
-                  static_cast<float>(sqrt(state_.cov_diag[8]) * 100.0),
-                  static_cast<float>(sqrt(state_.cov_diag[9]) * 100.0)};
+  float data[] = {static_cast<float>(sqrt(o.state.cov_diag[7]) * 100.0),
+                  static_cast<float>(sqrt(o.state.cov_diag[8]) * 100.0),
+                  static_cast<float>(sqrt(o.state.cov_diag[9]) * 100.0)};
   DrawBarGraph(p, rect, 3, data, 0.0, 0.2, "Velocity Std. Dev.", NULL, "cm/s", data_labels, true);
 }
 
-void EkfBagVideo::DrawAngleCov(QPainter & p, const QRect & rect) {
+void EkfBagVideo::DrawAngleCov(QPainter & p, const Overlay & o, const QRect & rect) {
   std::string data_labels[] = {std::string("\u03D1"), std::string("\u03C6"), std::string("\u03C8")};
-  float data[] = {static_cast<float>(sqrt(state_.cov_diag[0]) * 180.0 / M_PI),
-                  static_cast<float>(sqrt(state_.cov_diag[1]) * 180.0 / M_PI),
-                  static_cast<float>(sqrt(state_.cov_diag[2]) * 180.0 / M_PI)};
+  float data[] = {static_cast<float>(sqrt(o.state.cov_diag[0]) * 180.0 / M_PI),
+                  static_cast<float>(sqrt(o.state.cov_diag[1]) * 180.0 / M_PI),
+                  static_cast<float>(sqrt(o.state.cov_diag[2]) * 180.0 / M_PI)};
   DrawBarGraph(p, rect, 3, data, 0.0, 0.1, "Orientation Std. Dev.", NULL, "\u00B0", data_labels, true);
 }
 
-void EkfBagVideo::UpdateImage(const ros::Time & time, const sensor_msgs::ImageConstPtr & ros_image) {
-  EkfBag::UpdateImage(time, ros_image);
-
-  if (!start_time_set_) {
-    start_time_ = time;
-    start_time_set_ = true;
-  }
+void EkfBagVideo::Snapshot(const sensor_msgs::ImageConstPtr & ros_image, Overlay* o) {
+  o->image = ros_image;
+  o->state = state_;
+  o->pose_history.assign(pose_history_.begin(), pose_history_.end());
+  o->of_points.clear();
+  for (auto it = tracked_of_.begin(); it != tracked_of_.end(); it++)
+    o->of_points.push_back(Eigen::Vector2f((*it).second.x, (*it).second.y));
+  o->sm_points.clear();
+  for (auto it = tracked_sm_.begin(); it != tracked_sm_.end(); it++)
+    o->sm_points.push_back(tracked_sm_.FeatureToCurrentPixel(*it).cast<float>());
+  o->of_count = of_count_;
+  o->ml_count = ml_count_;
+  memcpy(o->mahal_bins, mahal_bins_, sizeof(int) * MAHAL_NUM_BINS);
+}
 
-  QImage image(1920, 1080, QImage::Format_ARGB32);
-  image.fill(QColor::fromRgb(0, 0, 0));
-  QPainter p(&image);
+void EkfBagVideo::Render(const Overlay & o, QImage* image) {
+  image->fill(QColor::fromRgb(0, 0, 0));
+  QPainter p(image);
 
-  DrawImage(p, ros_image, QRect(0, 0, 1280, 960));
+  DrawImage(p, o, QRect(0, 0, 1280, 960));
 
   // draw side widgets
   // starts at pixel 1280, width is 640
-  DrawTable(p, QRect(1280, 0, 640, 640));
+  DrawTable(p, o, QRect(1280, 0, 640, 640));
 
-  DrawVelocity(p, QRect(1280, 640, 320, 110));
-  DrawAccelBias(p, QRect(1280, 750, 320, 110));
-  DrawPositionCov(p, QRect(1280, 860, 320, 110));
-  DrawVelocityCov(p, QRect(1280, 970, 320, 110));
+  DrawVelocity(p, o, QRect(1280, 640, 320, 110));
+  DrawAccelBias(p, o, QRect(1280, 750, 320, 110));
+  DrawPositionCov(p, o, QRect(1280, 860, 320, 110));
+  DrawVelocityCov(p, o, QRect(1280, 970, 320, 110));
 
-  DrawOmega(p, QRect(1600, 640, 320, 110));
-  DrawGyroBias(p, QRect(1600, 750, 320, 110));
-  DrawAngleCov(p, QRect(1600, 860, 320, 110));
+  DrawOmega(p, o, QRect(1600, 640, 320, 110));
+  DrawGyroBias(p, o, QRect(1600, 750, 320, 110));
+  DrawAngleCov(p, o, QRect(1600, 860, 320, 110));
   // gyro_bias
   // accel
   // accel_bias
 
   // bottom
-  DrawStatus(p, QRect(0, 960, 120, 120));
-  DrawSMFeatureCount(p, QRect(120, 960, 120, 120));
-  DrawOFFeatureCount(p, QRect(240, 960, 120, 120));
-  DrawMahalanobis(p, QRect(360, 960, 920, 120));
+  DrawStatus(p, o, QRect(0, 960, 120, 120));
+  DrawSMFeatureCount(p, o, QRect(120, 960, 120, 120));
+  DrawOFFeatureCount(p, o, QRect(240, 960, 120, 120));
+  DrawMahalanobis(p, o, QRect(360, 960, 920, 120));
 
   p.end();
-  video_.AddFrame(image);
+}
+
+void EkfBagVideo::UpdateImage(const ros::Time & time, const sensor_msgs::ImageConstPtr & ros_image) {
+  EkfBag::UpdateImage(time, ros_image);
+
+  if (!start_time_set_) {
+    start_time_ = time;
+    start_time_set_ = true;
+  }
+
+  if (!encode_queue_) {
+    Overlay o;
+    Snapshot(ros_image, &o);
+    QImage image(1920, 1080, QImage::Format_ARGB32);
+    Render(o, &image);
+    video_.AddFrame(image);
+    return;
+  }
+
+  std::shared_ptr<Frame> f(new Frame());
+  Snapshot(ros_image, &f->overlay);
+  f->drawn = f->image.get_future();
+  encode_queue_->Push(f);
+  render_queue_->Push(f);
 }
 
 void EkfBagVideo::UpdateEKF(const ff_msgs::EkfState & s) {
@@ -41,40 +41,21 @@ void InitializeLibAv(void) {
   avcodec_register_all();
 }
 
-VideoWriter::VideoWriter(const char* videofile, int width, int height) :
+VideoWriter::VideoWriter(const char* videofile, int width, int height, const char* encoder) :
      width_(width), height_(height) {
   InitializeLibAv();
-  OpenVideo(videofile);
+  OpenVideo(videofile, encoder);
 }
 
 VideoWriter::~VideoWriter(void) {
   CloseVideo();
 }
 
-void VideoWriter::OpenVideo(const char* videofile) {
-  // open container
-  avformat_alloc_output_context2(&format_context_, NULL, NULL, videofile);
-  if (format_context_ == NULL) {
-    fprintf(stderr, "Could not allocate format context.\n");
-    exit(1);
-  }
-  assert(format_context_->oformat->video_codec != AV_CODEC_ID_NONE);
-
-  // open codec
-  AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_H264);
-  if (codec == NULL) {
-    fprintf(stderr, "Could not open encoder.\n");
-    exit(1);
-  }
+bool VideoWriter::OpenCodec(AVStream* stream, const char* encoder) {
+  AVCodec* codec = (encoder == NULL) ? avcodec_find_encoder(AV_CODEC_ID_H264) : avcodec_find_encoder_by_name(encoder);
+  if (codec == NULL)
+    return false;
   assert(codec->type == AVMEDIA_TYPE_VIDEO);
-  AVStream* stream = avformat_new_stream(format_context_, codec);
-  if (stream == NULL) {
-    fprintf(stderr, "Could not open stream.\n");
-    exit(1);
-  }
-  stream->id = 0;
-  stream->time_base.num = 1;
-  stream->time_base.den = 15;
   codec_context_ = stream->codec;
 
   avcodec_get_context_defaults3(codec_context_, codec);
@@ -86,18 +67,55 @@ void VideoWriter::OpenVideo(const char* videofile) {
   codec_context_->time_base.num = 1;
   codec_context_->time_base.den = 15;
   codec_context_->pix_fmt = AV_PIX_FMT_YUV420P;
+  // let the encoder pick its number of threads
+  codec_context_->thread_count = 0;
   if (format_context_->oformat->flags & AVFMT_GLOBALHEADER)
     codec_context_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
   AVDictionary* dict = NULL;
-  av_dict_set(&dict, "preset", "veryslow", 0);
-  av_dict_set_int(&dict, "crf", 10, 0);
+  if (encoder == NULL) {
+    av_dict_set(&dict, "preset", "veryslow", 0);
+    av_dict_set_int(&dict, "crf", 10, 0);
+  } else {
+    // hardware encoders have no crf, so give them a bit rate near what crf 10 makes
+    codec_context_->bit_rate = 20000000;
+  }
   int result = avcodec_open2(codec_context_, codec, &dict);
+  av_dict_free(&dict);
   if (result < 0) {
-    fprintf(stderr, "Failed to open codec with error %d.\n", result);
+    fprintf(stderr, "Failed to open codec %s with error %d.\n", codec->name, result);
+    return false;
+  }
+  return true;
+}
+
+void VideoWriter::OpenVideo(const char* videofile, const char* encoder) {
+  // open container
+  avformat_alloc_output_context2(&format_context_, NULL, NULL, videofile);
+  if (format_context_ == NULL) {
+    fprintf(stderr, "Could not allocate format context.\n");
+    exit(1);
+  }
+  assert(format_context_->oformat->video_codec != AV_CODEC_ID_NONE);
+
+  // open codec
+  AVStream* stream = avformat_new_stream(format_context_, NULL);
+  if (stream == NULL) {
+    fprintf(stderr, "Could not open stream.\n");
+    exit(1);
+  }
+  stream->id = 0;
+  stream->time_base.num = 1;
+  stream->time_base.den = 15;
+  if (encoder != NULL && !OpenCodec(stream, encoder)) {
+    fprintf(stderr, "Could not open encoder %s, using libx264.\n", encoder);
+    avcodec_close(stream->codec);
+    encoder = NULL;
+  }
+  if (encoder == NULL && !OpenCodec(stream, NULL)) {
+    fprintf(stderr, "Could not open encoder.\n");
     exit(1);
   }
-  av_dict_free(&dict);
 
   // allocate frame
   frame_ = av_frame_alloc();
@@ -108,7 +126,7 @@ void VideoWriter::OpenVideo(const char* videofile) {
   frame_->format = codec_context_->pix_fmt;
   frame_->width = codec_context_->width;
   frame_->height = codec_context_->height;
-  result = av_frame_get_buffer(frame_, 32);
+  int result = av_frame_get_buffer(frame_, 32);
   if (result < 0) {
     fprintf(stderr, "Failed to allocate picture.\n");
     exit(1);
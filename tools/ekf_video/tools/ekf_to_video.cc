@@ -18,11 +18,21 @@
 
 #include <common/init.h>
 #include <ekf_video/ekf_bag_video.h>
+#include <gflags/gflags.h>
 
 #include <QtCore>
 #include <QtGui>
 
+#include <string>
+
+DEFINE_bool(pipelined, false, "Read the bag, process the images and step the EKF on separate threads.");
+DEFINE_int32(render_threads, 0, "Draw the frames on this many threads, and encode them on another, if not zero.");
+DEFINE_string(encoder, "", "The libavcodec encoder to try before libx264, such as h264_nvenc.");
+DEFINE_double(start, 0, "Replay from this many seconds after the bag begins.");
+DEFINE_double(duration, 0, "Replay only this many seconds, if positive.");
+
 int main(int argc, char *argv[]) {
+  common::InitFreeFlyerApplication(&argc, &argv);
   QGuiApplication a(argc, argv);
   if (argc < 4) {
     LOG(INFO) << "Usage: " << argv[0] << " map.map bag.bag output.mp4";
@@ -31,7 +41,17 @@ int main(int argc, char *argv[]) {
 
   // have to run in this strange way because Qt requires a QApplication
   // This will run the task from the application event loop.
-  QTimer::singleShot(0, [argv]() {ekf_video::EkfBagVideo bag(argv[2], argv[1], argv[3]); bag.Run(); exit(0);});
+  QTimer::singleShot(0, [argv]() {
+    {
+      ekf_video::EkfBagVideo bag(argv[2], argv[1], argv[3], FLAGS_render_threads,
+                                 FLAGS_encoder.empty() ? NULL : FLAGS_encoder.c_str());
+      if (FLAGS_start > 0 || FLAGS_duration > 0)
+        bag.SetWindow(FLAGS_start, FLAGS_duration);
+      bag.Run(FLAGS_pipelined);
+    }
+    // the video is finished once bag is destroyed
+    exit(0);
+  });
 
   return a.exec();
 }
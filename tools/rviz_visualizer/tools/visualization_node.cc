@@ -18,6 +18,7 @@
 
 #include <common/init.h>
 #include <config_reader/config_reader.h>
+#include <ff_util/marker_publisher.h>
 #include <msg_conversions/msg_conversions.h>
 
 #include <ros/ros.h>
@@ -28,14 +29,14 @@
 
 #include <string>
 
-static ros::Publisher pub_vis;
+static ff_util::MarkerPublisher pub_vis;
 visualization_msgs::MarkerArray marks;
 
 void PublishMarkers() {
   for (unsigned int i = 0; i < marks.markers.size(); i++)
     marks.markers[i].header.stamp = ros::Time();
 
-  pub_vis.publish(marks);
+  pub_vis.Publish(marks);
 }
 
 void ReadParams(config_reader::ConfigReader *config) {
@@ -104,11 +105,12 @@ int main(int argc, char **argv) {
   config.AddFile("tools/visualization_node.config");
   ReadParams(&config);
 
+  // Only the boxes that changed are sent when the config file is edited
   ros::Timer config_timer = nh.createTimer(ros::Duration(1), [&config](ros::TimerEvent e) {
-      config.CheckFilesUpdated(std::bind(&ReadParams, &config));}, false, true);
+      config.CheckFilesUpdated([&config]() {ReadParams(&config); PublishMarkers();});}, false, true);
 
-  // Use a ltached topic to prevent unecessary chatter on the messaging backbone
-  pub_vis = nh.advertise<visualization_msgs::MarkerArray>("table", 1, true);
+  // A new subscriber is sent all the markers, so the topic need not be latched
+  pub_vis.Initialize(&nh, "table", 1);
 
   // Publish the table markers
   PublishMarkers();
@@ -95,6 +95,21 @@
 // Maximum buffer size
 #define MAX_BUFFER_SIZE (HEADER_LEN + MAX_NUM_PACKETS * PACKET_LEN)
 
+// A batched datagram starts with a header of doubles, with a negative magic
+// number where a single frame has its date, then has each frame as a date, a
+// count of packets and the packets themselves
+#define BATCH_MAGIC       0
+#define BATCH_SEQ         1
+#define BATCH_FRAMES      2
+#define BATCH_LEN         3
+#define BATCH_MAGIC_VALUE -1.0
+#define FRAME_DATE        0
+#define FRAME_COUNT       1
+#define FRAME_LEN         2
+
+// Maximum size of a batched datagram, in doubles, within a UDP payload
+#define MAX_DATAGRAM_SIZE 8000
+
 using udp = boost::asio::ip::udp;
 namespace fs  = boost::filesystem;
 
@@ -127,6 +142,16 @@ class VisualeyezUtils {
   // Read calibration data from a binary file for a given set of targets
   static bool ReadConfig(std::string file_name, VZTargetMarkers & targets);
 
+  // Pack frames into a batched datagram, the first with sequence number seq,
+  // returning the number of doubles used, or zero if they do not fit
+  static size_t PackFrames(std::vector<ff_msgs::VisualeyezDataArray> const& frames,
+    uint32_t seq, double *buffer, size_t max_len);
+
+  // Unpack a datagram of len doubles, either a single frame or a batch. For a
+  // batch, batched is set along with the sequence number of its first frame.
+  static bool UnpackDatagram(double const* buffer, size_t len,
+    std::vector<ff_msgs::VisualeyezDataArray> *frames, bool *batched, uint32_t *seq);
+
   // This algorithm solves the Procrustes problem in that it finds an affine transform
   // (rotation, translation, scale) that maps the "in" matrix to the "out" matrix
   // Code from: https://github.com/oleg-alexandrov/projects/blob/master/eigen/Kabsch.cpp
@@ -207,9 +232,16 @@ class VisualeyezClient {
   // Destructor
   ~VisualeyezClient();
 
-  // Sends a single message
+  // Sends a single message, or adds it to the batch being sent
   void Send(ff_msgs::VisualeyezDataArray const& msg);
 
+  // Send batches of this many frames, with sequence numbers, or plain single
+  // frames if it is zero
+  void SetBatch(size_t frames);
+
+  // Send the frames batched so far
+  void Flush();
+
  protected:
   // Called when message is sent
   void SendCallback(const boost::system::error_code& error, std::size_t bytes_transferred);
@@ -220,6 +252,10 @@ class VisualeyezClient {
   udp::socket socket_;                                /*!< Network socket.    */
   udp::endpoint remote_endpoint_;                     /*!< Remote endpoint.   */
   boost::array<double, MAX_BUFFER_SIZE> tx_buffer_;    /*!< Receive buffer     */
+  size_t batch_;                                      /*!< Frames per batch   */
+  uint32_t seq_;                                      /*!< Next sequence num  */
+  std::vector<ff_msgs::VisualeyezDataArray> pending_; /*!< Frames to batch    */
+  std::vector<double> batch_buffer_;                  /*!< Batch buffer       */
 };
 
 }  // namespace visualeyez
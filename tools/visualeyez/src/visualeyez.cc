@@ -156,7 +156,86 @@ namespace visualeyez {
     return true;
   }
 
-  VisualeyezClient::VisualeyezClient() : socket_(io_service_) {
+  // Pack frames into a batched datagram
+  size_t VisualeyezUtils::PackFrames(std::vector<ff_msgs::VisualeyezDataArray> const& frames,
+    uint32_t seq, double *buffer, size_t max_len) {
+    size_t len = BATCH_LEN;
+    for (size_t i = 0; i < frames.size(); i++)
+      len += FRAME_LEN + frames[i].measurements.size() * PACKET_LEN;
+    if (len > max_len)
+      return 0;
+    buffer[BATCH_MAGIC] = BATCH_MAGIC_VALUE;
+    buffer[BATCH_SEQ] = seq;
+    buffer[BATCH_FRAMES] = frames.size();
+    double *frame = buffer + BATCH_LEN;
+    for (size_t i = 0; i < frames.size(); i++) {
+      frame[FRAME_DATE] = frames[i].header.stamp.toSec();
+      frame[FRAME_COUNT] = frames[i].measurements.size();
+      double *packet = frame + FRAME_LEN;
+      for (size_t j = 0; j < frames[i].measurements.size(); j++, packet += PACKET_LEN) {
+        packet[PACKET_TCMID] = frames[i].measurements[j].tcmid;
+        packet[PACKET_LEDID] = frames[i].measurements[j].ledid;
+        packet[PACKET_POS_X] = frames[i].measurements[j].position.x;
+        packet[PACKET_POS_Y] = frames[i].measurements[j].position.y;
+        packet[PACKET_POS_Z] = frames[i].measurements[j].position.z;
+      }
+      frame = packet;
+    }
+    return len;
+  }
+
+  // Unpack a single frame or a batch of them
+  bool VisualeyezUtils::UnpackDatagram(double const* buffer, size_t len,
+    std::vector<ff_msgs::VisualeyezDataArray> *frames, bool *batched, uint32_t *seq) {
+    frames->clear();
+    *batched = (len >= BATCH_LEN && buffer[BATCH_MAGIC] == BATCH_MAGIC_VALUE);
+    // A single frame, with the date of its capture as a header
+    if (!*batched) {
+      if (len < HEADER_LEN || (len - HEADER_LEN) % PACKET_LEN != 0)
+        return false;
+      size_t n = (len - HEADER_LEN) / PACKET_LEN;
+      frames->resize(1);
+      ff_msgs::VisualeyezDataArray & msg = frames->back();
+      msg.header.stamp = ros::Time(buffer[HEADER_DATE]);
+      msg.measurements.resize(n);
+      for (size_t i = 0; i < n; i++) {
+        double const* packet = buffer + HEADER_LEN + i * PACKET_LEN;
+        msg.measurements[i].tcmid = static_cast<uint8_t>(packet[PACKET_TCMID]);
+        msg.measurements[i].ledid = static_cast<uint8_t>(packet[PACKET_LEDID]);
+        msg.measurements[i].position.x = packet[PACKET_POS_X];
+        msg.measurements[i].position.y = packet[PACKET_POS_Y];
+        msg.measurements[i].position.z = packet[PACKET_POS_Z];
+      }
+      return true;
+    }
+    // A batch of frames, each with its date and number of packets
+    *seq = static_cast<uint32_t>(buffer[BATCH_SEQ]);
+    size_t num_frames = static_cast<size_t>(buffer[BATCH_FRAMES]);
+    size_t offset = BATCH_LEN;
+    frames->resize(num_frames);
+    for (size_t f = 0; f < num_frames; f++) {
+      if (offset + FRAME_LEN > len)
+        return false;
+      size_t n = static_cast<size_t>(buffer[offset + FRAME_COUNT]);
+      if (offset + FRAME_LEN + n * PACKET_LEN > len)
+        return false;
+      ff_msgs::VisualeyezDataArray & msg = (*frames)[f];
+      msg.header.stamp = ros::Time(buffer[offset + FRAME_DATE]);
+      msg.measurements.resize(n);
+      offset += FRAME_LEN;
+      for (size_t i = 0; i < n; i++, offset += PACKET_LEN) {
+        msg.measurements[i].tcmid = static_cast<uint8_t>(buffer[offset + PACKET_TCMID]);
+        msg.measurements[i].ledid = static_cast<uint8_t>(buffer[offset + PACKET_LEDID]);
+        msg.measurements[i].position.x = buffer[offset + PACKET_POS_X];
+        msg.measurements[i].position.y = buffer[offset + PACKET_POS_Y];
+        msg.measurements[i].position.z = buffer[offset + PACKET_POS_Z];
+      }
+    }
+    return offset == len;
+  }
+
+  VisualeyezClient::VisualeyezClient() : socket_(io_service_), batch_(0), seq_(0),
+    batch_buffer_(MAX_DATAGRAM_SIZE) {
     // Extract the port from the config file
     std::string host;
     unsigned int port;
@@ -168,6 +247,9 @@ namespace visualeyez {
       ROS_FATAL("Server port not specified in config file.");
     if (!config_params.GetStr("client_host", &host))
       ROS_FATAL("Server address not specified in config file.");
+    unsigned int batch = 0;
+    if (config_params.GetUInt("client_batch", &batch))
+      batch_ = batch;
     // Open the socket
     socket_ = udp::socket(io_service_, udp::endpoint(udp::v4(), 0));
     // Bind the socket to a specific endpoint
@@ -191,6 +273,18 @@ namespace visualeyez {
       ROS_WARN("Cannot process more than MAX_NUM_PACKETS at once");
       return;
     }
+    // Batch the frame, sending what was batched first if it would not fit
+    if (batch_ > 0) {
+      pending_.push_back(msg);
+      if (VisualeyezUtils::PackFrames(pending_, seq_, batch_buffer_.data(), batch_buffer_.size()) == 0) {
+        pending_.pop_back();
+        Flush();
+        pending_.push_back(msg);
+      }
+      if (pending_.size() >= batch_)
+        Flush();
+      return;
+    }
     // Prepare the header
     tx_buffer_[HEADER_DATE] = msg.header.stamp.toSec();
     // Add the data
@@ -210,6 +304,26 @@ namespace visualeyez {
           boost::asio::placeholders::bytes_transferred));
   }
 
+  // Send batches of frames, or single frames
+  void VisualeyezClient::SetBatch(size_t frames) {
+    Flush();
+    batch_ = frames;
+  }
+
+  // Send the frames batched so far in one datagram
+  void VisualeyezClient::Flush() {
+    if (pending_.empty())
+      return;
+    size_t len = VisualeyezUtils::PackFrames(pending_, seq_, batch_buffer_.data(), batch_buffer_.size());
+    seq_ += pending_.size();
+    pending_.clear();
+    boost::system::error_code error;
+    socket_.send_to(boost::asio::buffer(batch_buffer_.data(), sizeof(double) * len),
+      remote_endpoint_, 0, error);
+    if (error)
+      ROS_WARN_STREAM("Could not send batch: " << error.message());
+  }
+
   // Called when messahe is sent
   void VisualeyezClient::SendCallback(const boost::system::error_code& error,
     std::size_t bytes_transferred) {
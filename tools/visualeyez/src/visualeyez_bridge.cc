@@ -40,8 +40,16 @@
 // Visualeyez includes
 #include <visualeyez/visualeyez.h>
 
+// Linux includes
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <errno.h>
+
 // STL includes
+#include <algorithm>
+#include <cstring>
 #include <string>
+#include <vector>
 
 using udp = boost::asio::ip::udp;
 
@@ -50,14 +58,21 @@ using udp = boost::asio::ip::udp;
  */
 namespace visualeyez {
 
+// Datagrams taken from the socket in one call
+#define RX_DATAGRAMS 16
+
 //!  A class for receiving UDP visualeyez measurements
 /*!
-  To be written
+  Datagrams are read in groups on a dedicated thread, each stamped by the
+  kernel when it arrived. A datagram is either a single frame or a batch of
+  frames with sequence numbers, from which lost frames are counted.
 */
 class VisualeyezBridge : public nodelet::Nodelet {
  public:
   // Constructor
-  VisualeyezBridge() : socket_(io_service_) {
+  VisualeyezBridge() : socket_(io_service_), running_(false), have_seq_(false),
+    next_seq_(0), frames_(0), lost_(0), latency_sum_(0.0), latency_max_(0.0),
+    rx_buffer_(RX_DATAGRAMS * MAX_DATAGRAM_SIZE) {
     // Extract the port from the config file
     std::string addr; unsigned int port;
     config_reader::ConfigReader config_params;
@@ -70,63 +85,125 @@ class VisualeyezBridge : public nodelet::Nodelet {
       ROS_FATAL("Server address not specified in config file.");
     // Open the socket
     socket_ = udp::socket(io_service_, udp::endpoint(udp::v4(), port));
-    // Start listening
-    Listen();
+    // Ask for receive stamps, and time out reads so that the thread can stop
+    int fd = socket_.native_handle();
+    int on = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0)
+      ROS_WARN("Could not enable receive timestamps");
+    struct timeval tv = {0, 200000};
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+      ROS_WARN("Could not set the receive timeout");
   }
 
   // Destructor
-  virtual ~VisualeyezBridge() {}
-
-  // Start listening for incoming packets
-  void Listen() {
-    socket_.async_receive_from(
-      boost::asio::buffer(rx_buffer_, MAX_BUFFER_SIZE), rx_endpoint_,
-      boost::bind(&VisualeyezBridge::Receive, this,
-        boost::asio::placeholders::error,
-        boost::asio::placeholders::bytes_transferred));
+  virtual ~VisualeyezBridge() {
+    running_ = false;
+    if (thread_.joinable())
+      thread_.join();
   }
 
  protected:
   // Called when ROS is loaded and ready
   void onInit() {
-    // Setup the publisher before be start the ASIO service.
+    // Setup the publisher before we start receiving
     pub_ = getNodeHandle().advertise<ff_msgs::VisualeyezDataArray>(
       TOPIC_VISUALEYEZ_DATA, 1);
-    // Now that the publisher is ready we can start the ASIO run service.
-    thread_ = boost::thread(boost::bind(&boost::asio::io_service::run, &io_service_));
+    // Now that the publisher is ready we can start the receive thread
+    running_ = true;
+    thread_ = boost::thread(boost::bind(&VisualeyezBridge::Listen, this));
   }
 
-  //  Presumably the messages arrive in checksummed packets, and these packets get reassembled in order. Since
-  //  we know each LED measurement has a specific size, we can determine the size of the measurement matrix by
-  //  just looking at the size of the packet
-  void Receive(const boost::system::error_code& error, std::size_t size) {
-    if (!error && size % (PACKET_LEN * sizeof(double)) == (HEADER_LEN * sizeof(double))) {
-      size_t n = size / (PACKET_LEN * sizeof(double));
-      msg_.header.stamp = ros::Time(rx_buffer_[HEADER_DATE]);
-      msg_.measurements.resize(n);
-      for (size_t i = 0; i < n; i++) {
-        msg_.measurements[i].tcmid = static_cast<uint8_t>(rx_buffer_[HEADER_LEN+i*PACKET_LEN+PACKET_TCMID]);
-        msg_.measurements[i].ledid = static_cast<uint8_t>(rx_buffer_[HEADER_LEN+i*PACKET_LEN+PACKET_LEDID]);
-        msg_.measurements[i].position.x = rx_buffer_[HEADER_LEN+i*PACKET_LEN+PACKET_POS_X];
-        msg_.measurements[i].position.y = rx_buffer_[HEADER_LEN+i*PACKET_LEN+PACKET_POS_Y];
-        msg_.measurements[i].position.z = rx_buffer_[HEADER_LEN+i*PACKET_LEN+PACKET_POS_Z];
+  // Read datagrams until stopped, as many as are waiting in each call
+  void Listen() {
+    int fd = socket_.native_handle();
+    std::vector<struct mmsghdr> msgs(RX_DATAGRAMS);
+    std::vector<struct iovec> iovs(RX_DATAGRAMS);
+    std::vector<char> control(RX_DATAGRAMS * CMSG_SPACE(sizeof(struct timespec)));
+    while (running_) {
+      for (size_t i = 0; i < RX_DATAGRAMS; i++) {
+        iovs[i].iov_base = &rx_buffer_[i * MAX_DATAGRAM_SIZE];
+        iovs[i].iov_len = MAX_DATAGRAM_SIZE * sizeof(double);
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = &control[i * CMSG_SPACE(sizeof(struct timespec))];
+        msgs[i].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(struct timespec));
+      }
+      int n = recvmmsg(fd, msgs.data(), RX_DATAGRAMS, MSG_WAITFORONE, NULL);
+      if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+          ROS_WARN_STREAM_THROTTLE(1.0, "Could not receive: " << strerror(errno));
+        continue;
+      }
+      for (int i = 0; i < n; i++) {
+        // The time the datagram arrived, or now if the kernel did not say
+        ros::Time arrival = ros::Time(ros::WallTime::now().toSec());
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg != NULL;
+          cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+          if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            arrival = ros::Time(ts.tv_sec, ts.tv_nsec);
+          }
+        }
+        Receive(&rx_buffer_[i * MAX_DATAGRAM_SIZE], msgs[i].msg_len, arrival);
       }
-      pub_.publish(msg_);
-    } else {
+    }
+  }
+
+  //  Each datagram holds whole frames, and each LED measurement has a specific size, so the frames can be
+  //  unpacked from the size of the datagram and the counts within it
+  void Receive(double const* buffer, std::size_t size, ros::Time const& arrival) {
+    bool batched = false;
+    uint32_t seq = 0;
+    if (size % sizeof(double) != 0 || !VisualeyezUtils::UnpackDatagram(
+      buffer, size / sizeof(double), &frames_rx_, &batched, &seq)) {
       ROS_WARN_STREAM("Malformed packet of " << size << " bytes");
+      return;
+    }
+    // Count the frames skipped since the last batch
+    if (batched) {
+      if (have_seq_ && seq > next_seq_)
+        lost_ += seq - next_seq_;
+      have_seq_ = true;
+      next_seq_ = seq + frames_rx_.size();
+    }
+    // Publish each frame with the time it was captured
+    for (size_t i = 0; i < frames_rx_.size(); i++) {
+      double latency = (arrival - frames_rx_[i].header.stamp).toSec();
+      latency_sum_ += latency;
+      latency_max_ = std::max(latency_max_, latency);
+      frames_++;
+      pub_.publish(frames_rx_[i]);
+    }
+    // Report what was received every so often
+    if ((arrival - report_).toSec() > 10.0) {
+      if (frames_ > 0)
+        ROS_INFO_STREAM("Received " << frames_ << " frames, lost " << lost_ << ", latency mean "
+          << latency_sum_ / frames_ << " s, max " << latency_max_ << " s");
+      report_ = arrival;
+      frames_ = 0;
+      lost_ = 0;
+      latency_sum_ = 0.0;
+      latency_max_ = 0.0;
     }
-    // Restart listening
-    Listen();
   }
 
  private:
-  boost::thread thread_;                              /*!< Service thread.    */
+  boost::thread thread_;                              /*!< Receive thread.    */
   boost::asio::io_service io_service_;                /*!< ASIO service.      */
   udp::socket socket_;                                /*!< Network socket.    */
-  udp::endpoint rx_endpoint_;                         /*!< Remote endpoint.   */
-  boost::array<double, MAX_BUFFER_SIZE> rx_buffer_;    /*!< Receive buffer     */
+  volatile bool running_;                             /*!< Keep receiving     */
+  bool have_seq_;                                     /*!< Seen a batch       */
+  uint32_t next_seq_;                                 /*!< Expected sequence  */
+  size_t frames_;                                     /*!< Frames received    */
+  size_t lost_;                                       /*!< Frames lost        */
+  double latency_sum_;                                /*!< Sum of latencies   */
+  double latency_max_;                                /*!< Worst latency      */
+  ros::Time report_;                                  /*!< Last report        */
+  std::vector<double> rx_buffer_;                     /*!< Receive buffers    */
+  std::vector<ff_msgs::VisualeyezDataArray> frames_rx_;  /*!< Unpacked frames */
   ros::Publisher pub_;                                /*!< ROS publisher      */
-  ff_msgs::VisualeyezDataArray msg_;                  /*!< ROS message        */
 };
 
 // Register the nodelet with the system
@@ -116,6 +116,55 @@ TEST(test_visualeyez_util, KabschWithoutScale) {
   EXPECT_LT((S-A.translation()).cwiseAbs().maxCoeff(), 1e-13);
 }
 
+// Pack a batch of frames, then unpack it and a single legacy frame
+TEST(test_visualeyez_util, Datagram) {
+  std::vector<ff_msgs::VisualeyezDataArray> frames_i(3), frames_o;
+  for (size_t f = 0; f < frames_i.size(); f++) {
+    frames_i[f].header.stamp = ros::Time(1000.0 + f);
+    frames_i[f].measurements.resize(f + 1);
+    for (size_t i = 0; i < frames_i[f].measurements.size(); i++) {
+      frames_i[f].measurements[i].tcmid = f;
+      frames_i[f].measurements[i].ledid = i;
+      frames_i[f].measurements[i].position.x = 1.0 * i;
+      frames_i[f].measurements[i].position.y = 2.0 * i;
+      frames_i[f].measurements[i].position.z = 3.0 * i;
+    }
+  }
+  std::vector<double> buffer(MAX_DATAGRAM_SIZE);
+  // A batch that does not fit should not be packed
+  EXPECT_EQ(visualeyez::VisualeyezUtils::PackFrames(frames_i, 42, buffer.data(), 10), 0);
+  size_t len = visualeyez::VisualeyezUtils::PackFrames(frames_i, 42, buffer.data(), buffer.size());
+  EXPECT_EQ(len, BATCH_LEN + 3 * FRAME_LEN + 6 * PACKET_LEN);
+  bool batched = false;
+  uint32_t seq = 0;
+  EXPECT_TRUE(visualeyez::VisualeyezUtils::UnpackDatagram(buffer.data(), len, &frames_o, &batched, &seq));
+  EXPECT_TRUE(batched);
+  EXPECT_EQ(seq, 42);
+  ASSERT_EQ(frames_o.size(), frames_i.size());
+  for (size_t f = 0; f < frames_i.size(); f++) {
+    EXPECT_EQ(frames_o[f].header.stamp, frames_i[f].header.stamp);
+    ASSERT_EQ(frames_o[f].measurements.size(), frames_i[f].measurements.size());
+    for (size_t i = 0; i < frames_i[f].measurements.size(); i++) {
+      EXPECT_EQ(frames_o[f].measurements[i].tcmid, frames_i[f].measurements[i].tcmid);
+      EXPECT_EQ(frames_o[f].measurements[i].ledid, frames_i[f].measurements[i].ledid);
+      EXPECT_EQ(frames_o[f].measurements[i].position.z, frames_i[f].measurements[i].position.z);
+    }
+  }
+  // A truncated batch is malformed
+  EXPECT_FALSE(visualeyez::VisualeyezUtils::UnpackDatagram(buffer.data(), len - 1, &frames_o, &batched, &seq));
+  // A single frame is a date followed by its packets
+  double single[HEADER_LEN + PACKET_LEN] = {1000.0, 1, 2, 0.5, 0.25, 0.125};
+  EXPECT_TRUE(visualeyez::VisualeyezUtils::UnpackDatagram(single, HEADER_LEN + PACKET_LEN,
+    &frames_o, &batched, &seq));
+  EXPECT_FALSE(batched);
+  ASSERT_EQ(frames_o.size(), 1);
+  ASSERT_EQ(frames_o[0].measurements.size(), 1);
+  EXPECT_EQ(frames_o[0].header.stamp, ros::Time(1000.0));
+  EXPECT_EQ(frames_o[0].measurements[0].ledid, 2);
+  EXPECT_EQ(frames_o[0].measurements[0].position.y, 0.25);
+}
+
+
 // Run all the tests that were declared with TEST()
 int main(int argc, char **argv) {
   // Initialize ROS and create a single node handle in order to use ros::Time::now()
@@ -62,6 +62,16 @@ typedef std::vector<Sweep> SweepVec;
 typedef std::pair<SweepVec, ImuVec> DataPair;         // pair of Light data and Imu data - change imu
 typedef std::map<std::string, DataPair> DataPairMap;         // map of trackers
 
+// The running mean of the angles each sensor saw in one axis of a lighthouse,
+// which stands in for all of its sweeps while the body is still
+struct LightMean {
+  Light light;
+  double sum;
+  size_t count;
+};
+typedef std::map<std::pair<std::string, uint8_t>, std::map<uint8_t, LightMean> > SweepMeans;
+typedef std::map<std::string, SweepMeans> SweepMeansMap;     // map of trackers
+
 
 class ViveCalibrate {
  public:
@@ -82,6 +92,14 @@ class ViveCalibrate {
   // Solve the problem based on the assumption tge body of tracker's is still.
   bool Solve();
 
+  // Incrementally, each sweep is folded into the mean angles of its sensors
+  // as it comes in, so the data kept does not grow with the capture. With
+  // refine, the sweeps are also kept for the final batch solve.
+  void SetIncremental(bool incremental, bool refine);
+
+  // Solve from the mean angles so far, passing the estimate to cb
+  bool SolveIncremental(CallbackFn cb);
+
   // Thread that solves
   static void WorkerThread(CallbackFn cb,
     std::mutex * calibration_mutex,
@@ -94,6 +112,9 @@ class ViveCalibrate {
   std::mutex mutex_;            // Mutex for data access
   bool active_;                 // If the calibration procedure is active
   Calibration calibration_;     // Structure that saves all the data
+  bool incremental_;            // Fold sweeps into means
+  bool refine_;                 // Keep sweeps for the final solve
+  SweepMeansMap means_;         // Mean angles of each sensor
 };
 
 }  // namespace vive
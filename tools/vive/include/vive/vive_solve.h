@@ -40,6 +40,7 @@
 #include <Eigen/Geometry>
 
 // STD C++ includes
+#include <condition_variable>  // NOLINT
 #include <map>
 #include <mutex>
 #include <vector>
@@ -110,6 +111,9 @@ class ViveSolve {
   bool Update(Environment const& environment);
 
  private:
+  // Solves the latest observations handed over by ProcessLight, one at a time
+  void SolveThread();
+
   std::map<std::string, SolvedPose> poses_;
   SolvedPose tracker_pose_;
   Environment environment_;
@@ -117,6 +121,17 @@ class ViveSolve {
   Extrinsics extrinsics_;
   std::mutex solveMutex_;
   Tracker tracker_;
+  // Observations waiting for the solver, replaced by newer ones if it is busy
+  std::thread solver_;
+  std::mutex pendingMutex_;
+  std::condition_variable pendingCond_;
+  LightData pending_;
+  bool hasPending_;
+  bool stop_;
+  // Solver statistics since the last report
+  size_t solves_, failures_, dropped_;
+  double latencySum_, latencyMax_;
+  ros::WallTime lastReport_;
 };
 
 // Computes the full pose of a tracker for each lighthouse
@@ -33,12 +33,14 @@ typedef std::map<std::string, PosesMap> PosesMapMap;
 typedef std::map<std::string, std::vector<LightData> > LightDataVector;
 
 // Constructor just sets the callback function
-ViveCalibrate::ViveCalibrate(CallbackFn cb) : cb_(cb), active_(false) {}
+ViveCalibrate::ViveCalibrate(CallbackFn cb) : cb_(cb), active_(false),
+  incremental_(false), refine_(true) {}
 
 // Reset
 bool ViveCalibrate::Reset() {
   if (!mutex_.try_lock()) return false;
   data_pair_map_.clear();
+  means_.clear();
   mutex_.unlock();
   return true;
 }
@@ -81,9 +83,19 @@ bool ViveCalibrate::AddLight(const ff_msgs::ViveLight::ConstPtr& msg) {
   sweep.axis = msg->axis;
 
   // Store the data
-  if (msg->samples.size() > 0) {
+  if (msg->samples.size() > 0 && (!incremental_ || refine_)) {
     data_pair_map_[msg->header.frame_id].first.push_back(sweep);
   }
+  if (incremental_) {
+    std::map<uint8_t, LightMean> & means =
+      means_[msg->header.frame_id][std::make_pair(sweep.lighthouse, sweep.axis)];
+    for (LightVec::iterator li_it = sweep.lights.begin(); li_it != sweep.lights.end(); li_it++) {
+      LightMean & mean = means[li_it->sensor_id];
+      mean.light = *li_it;
+      mean.sum += li_it->angle;
+      mean.count++;
+    }
+  }
 
   mutex_.unlock();
   return true;
@@ -102,6 +114,12 @@ bool ViveCalibrate::Solve() {
   if (active_) return false;
   active_ = true;
 
+  // Without the sweeps, the final solution is the one from the means
+  if (incremental_ && !refine_) {
+    active_ = false;
+    return SolveIncremental(cb_);
+  }
+
   // Wait for thread to join, in case of old solution
   std::thread thread = std::thread(ViveCalibrate::WorkerThread,
     cb_,
@@ -114,6 +132,42 @@ bool ViveCalibrate::Solve() {
   return true;
 }
 
+void ViveCalibrate::SetIncremental(bool incremental, bool refine) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  incremental_ = incremental;
+  refine_ = refine;
+}
+
+// Each (lighthouse, axis) of a tracker becomes a single sweep of mean angles
+bool ViveCalibrate::SolveIncremental(CallbackFn cb) {
+  if (active_) return false;
+  DataPairMap data_pair_map;
+  Calibration calibration;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!incremental_ || means_.empty()) return false;
+    for (SweepMeansMap::iterator tr_it = means_.begin(); tr_it != means_.end(); tr_it++) {
+      for (SweepMeans::iterator sw_it = tr_it->second.begin(); sw_it != tr_it->second.end(); sw_it++) {
+        Sweep sweep;
+        sweep.lighthouse = sw_it->first.first;
+        sweep.axis = sw_it->first.second;
+        for (std::map<uint8_t, LightMean>::iterator li_it = sw_it->second.begin();
+          li_it != sw_it->second.end(); li_it++) {
+          Light light = li_it->second.light;
+          light.angle = li_it->second.sum / static_cast<double>(li_it->second.count);
+          sweep.lights.push_back(light);
+        }
+        data_pair_map[tr_it->first].first.push_back(sweep);
+      }
+    }
+    calibration = calibration_;
+  }
+  active_ = true;
+  WorkerThread(cb, &mutex_, data_pair_map, calibration);
+  active_ = false;
+  return true;
+}
+
 struct CalibHorizontalAngle{
   explicit CalibHorizontalAngle(LightVec horizontal_observations, PoseVM world_tracker_transforms) :
   horizontal_observations_(horizontal_observations), world_tracker_transforms_(world_tracker_transforms) {}
@@ -177,6 +177,20 @@ class ServerNodelet : public ff_util::FreeFlyerNodelet {
 
     // Publishing all the static transforms obtained from calibration
     ViveUtils::SendTransforms(calibration_data_);
+
+    // Optionally solve the calibration as the data comes in
+    bool incremental = false, refine = true;
+    double period = 2.0;
+    if (!handle->GetBool("calibration_incremental", &incremental))
+      NODELET_WARN_STREAM("Cannot read calibration_incremental - Batch calibration");
+    if (!handle->GetBool("calibration_refine", &refine))
+      NODELET_WARN_STREAM("Cannot read calibration_refine - Refining");
+    if (!handle->GetPosReal("calibration_period", &period))
+      NODELET_WARN_STREAM("Cannot read calibration_period - Using 2 seconds");
+    calibrator_.SetIncremental(incremental, refine);
+    if (incremental)
+      timer_calibration_ = nh->createTimer(ros::Duration(period),
+        &ServerNodelet::CalibrationTimerCallback, this, false, true);
   }
 
   // When the FSM state changes we get a callback here, so that we can debug
@@ -228,6 +242,25 @@ class ServerNodelet : public ff_util::FreeFlyerNodelet {
     return;
   }
 
+  // Called periodically to update the calibration estimate while calibrating
+  void CalibrationTimerCallback(const ros::TimerEvent&) {
+    if (fsm_.GetState() != CALIBRATING) return;
+    calibrator_.SolveIncremental(std::bind(&ServerNodelet::ProgressCallback,
+      this, std::placeholders::_1));
+  }
+
+  // Called back with each incremental estimate, which is shown but not saved
+  void ProgressCallback(Calibration const& calibration) {
+    ViveUtils::SendTransforms(calibration);
+    for (std::map<std::string, Transform>::const_iterator lh_it =
+      calibration.environment.lighthouses.begin();
+      lh_it != calibration.environment.lighthouses.end(); lh_it++)
+      NODELET_INFO_STREAM("Lighthouse " << lh_it->first << " at ["
+        << lh_it->second.translation.x << ", "
+        << lh_it->second.translation.y << ", "
+        << lh_it->second.translation.z << "]");
+  }
+
   // Called back when the calibration procedure completes
   void CalibrationCallback(Calibration const& calibration) {
     ViveUtils::WriteConfig(calib_file_, calibration);
@@ -352,6 +385,7 @@ class ServerNodelet : public ff_util::FreeFlyerNodelet {
   ff_util::ConfigServer cfg_;           // Config server
   ros::ServiceServer service_;          // Service
   ros::Timer timer_;                    // Tracking timer
+  ros::Timer timer_calibration_;        // Incremental calibration timer
 
   // Visualization tools
   VisualMap vive_visualization_;        // visualization object
@@ -23,6 +23,7 @@
 #include <Eigen/Dense>
 #include <Eigen/Geometry>
 
+#include <algorithm>
 #include <thread>
 
 /**
@@ -33,12 +34,66 @@ namespace vive {
   // x,y,z, w,x,y,z
   double start_pose[6] = {0, 0, 1, 0, 0, 0};
 
-ViveSolve::ViveSolve() {
-  // Do nothing
+ViveSolve::ViveSolve() : hasPending_(false), stop_(false), solves_(0),
+  failures_(0), dropped_(0), latencySum_(0.0), latencyMax_(0.0) {
+  for (size_t i = 0; i < 6; i++) tracker_pose_.transform[i] = start_pose[i];
+  tracker_pose_.valid = false;
 }
 
 ViveSolve::~ViveSolve() {
-  // Do nothing
+  if (solver_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(pendingMutex_);
+      stop_ = true;
+    }
+    pendingCond_.notify_one();
+    solver_.join();
+  }
+}
+
+void ViveSolve::SolveThread() {
+  lastReport_ = ros::WallTime::now();
+  while (true) {
+    LightData observations;
+    {
+      std::unique_lock<std::mutex> lock(pendingMutex_);
+      pendingCond_.wait(lock, [this]() { return hasPending_ || stop_; });
+      if (stop_)
+        return;
+      observations.swap(pending_);
+      hasPending_ = false;
+    }
+    // The environment may be updated while we solve, so we solve with a copy
+    solveMutex_.lock();
+    Environment environment = environment_;
+    solveMutex_.unlock();
+    // The solve starts from the last pose solved for this tracker
+    ros::WallTime start = ros::WallTime::now();
+    if (!ComputeTransformBundle(observations, &tracker_pose_, &extrinsics_,
+      &environment, &solveMutex_))
+      failures_++;
+    double latency = (ros::WallTime::now() - start).toSec();
+    solves_++;
+    latencySum_ += latency;
+    latencyMax_ = std::max(latencyMax_, latency);
+    // Report how the solver keeps up every few seconds
+    double elapsed = (ros::WallTime::now() - lastReport_).toSec();
+    if (elapsed >= 10.0) {
+      size_t dropped;
+      {
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        dropped = dropped_;
+        dropped_ = 0;
+      }
+      ROS_INFO("Tracker %s: %.1f solves/s, %zu failed, %zu superseded, "
+        "latency mean %.1f ms max %.1f ms", tracker_.serial.c_str(),
+        solves_ / elapsed, failures_, dropped,
+        1e3 * latencySum_ / solves_, 1e3 * latencyMax_);
+      solves_ = failures_ = 0;
+      latencySum_ = latencyMax_ = 0.0;
+      lastReport_ = ros::WallTime::now();
+    }
+  }
 }
 
 void ViveSolve::ProcessImu(const sensor_msgs::Imu::ConstPtr& msg) {
@@ -97,13 +152,17 @@ void ViveSolve::ProcessLight(const ff_msgs::ViveLight::ConstPtr& msg) {
     observations_[msg->lighthouse].axis[HORIZONTAL].stamp;
   if (observations_[msg->lighthouse].axis[HORIZONTAL].lights.size() > 3
     && observations_[msg->lighthouse].axis[VERTICAL].lights.size() > 3) {
-    std::thread poseSolver(&ComputeTransformBundle,
-      observations_,
-      &tracker_pose_,
-      &extrinsics_,
-      &environment_,
-      &solveMutex_);
-    poseSolver.detach();
+    // Hand the observations to the solver, replacing any it has not started
+    if (!solver_.joinable())
+      solver_ = std::thread(&ViveSolve::SolveThread, this);
+    {
+      std::lock_guard<std::mutex> lock(pendingMutex_);
+      if (hasPending_)
+        dropped_++;
+      pending_ = observations_;
+      hasPending_ = true;
+    }
+    pendingCond_.notify_one();
   }
   return;
 }
@@ -189,7 +248,9 @@ bool ViveSolve::Initialize(Environment const& environment,
 }
 
 bool ViveSolve::Update(Environment const& environment) {
+  solveMutex_.lock();
   environment_ = environment;
+  solveMutex_.unlock();
   return true;
 }
 
@@ -64,7 +64,9 @@ class WDock {
 
   int64_t MakeTimestamp();
 
-  void ProcessDdsEventLoop();
+  // Waits on the DDS waitset for up to timeout, handling each command as soon
+  // as it arrives
+  void ProcessDdsEventLoop(kn::milliseconds timeout = kn::milliseconds(0));
 
   void PublishCmdAck(std::string const& cmd_id,
                      rapid::AckStatus status = rapid::ACK_COMPLETED,
@@ -72,7 +74,9 @@ class WDock {
                                                         rapid::ACK_COMPLETED_OK,
                      std::string const& message = "");
 
-  void PublishDockState();
+  // Only sends the dock state if it changed since it was last sent, unless
+  // forced
+  void PublishDockState(bool force = false);
 
   // TODO(Katie) Remove the following functions once real code is in
   void SetBerthOne();
@@ -95,6 +99,15 @@ class WDock {
   std::shared_ptr<kn::DdsEntitiesFactorySvc> dds_entities_factory_;
 
   std::string ack_pub_suffix_, dock_state_pub_suffix_, sub_suffix_;
+
+  // The dock state last sent, to tell if it changed
+  std::string DockStateKey();
+  std::string dock_state_sent_;
+
+  // When the command being handled arrived and was sent, in microseconds,
+  // to measure how long until it is acked
+  int64_t cmd_received_, cmd_sent_;
+  int64_t num_acks_, ack_latency_sum_, ack_latency_max_;
 };
 
 }  // end namespace w_dock
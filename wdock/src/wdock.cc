@@ -19,6 +19,9 @@
 
 #include "wdock/wdock.h"
 
+#include <algorithm>
+#include <sstream>
+
 namespace {
 
 typedef std::vector<kn::DdsNodeParameters> NodeVector;
@@ -57,7 +60,12 @@ WDock::WDock(int argc, char** argv, std::string const& entity_name) :
     dds_event_loop_(entity_name),
     ack_pub_suffix_(""),
     dock_state_pub_suffix_(""),
-    sub_suffix_("") {
+    sub_suffix_(""),
+    cmd_received_(0),
+    cmd_sent_(0),
+    num_acks_(0),
+    ack_latency_sum_(0),
+    ack_latency_max_(0) {
   int fakeArgc = 1;
 
   // Make path to QOS and NDDS files
@@ -123,7 +131,7 @@ WDock::WDock(int argc, char** argv, std::string const& entity_name) :
   dock_state_supplier_->event().berthTwo.maxCapacity = 0;
   dock_state_supplier_->event().berthTwo.currentCapacity = 0;
 
-  PublishDockState();
+  PublishDockState(true);
 
   // Set up the ack publisher
   ack_state_supplier_.reset(new w_dock::WDock::AckStateSupplier(
@@ -155,6 +163,8 @@ WDock::~WDock() {
 }
 
 void WDock::operator() (rapid::Command const* rapid_cmd) {
+  cmd_received_ = MakeTimestamp();
+  cmd_sent_ = rapid_cmd->hdr.timeStamp;
   std::cout << "Received command from GDS." << std::endl;
   if (strcmp(rapid_cmd->cmdName, "wake") == 0) {
     std::cout << "Received command wake. Berth: " << rapid_cmd->arguments[0]._u.i << std::endl;
@@ -213,10 +223,9 @@ int64_t WDock::MakeTimestamp() {
   return microseconds;
 }
 
-void WDock::ProcessDdsEventLoop() {
-  // process events as fast as possible since we are controlling the wait else
-  // where
-  dds_event_loop_.processEvents(kn::milliseconds(0));
+void WDock::ProcessDdsEventLoop(kn::milliseconds timeout) {
+  // the event loop blocks on its waitset, so a command wakes it at once
+  dds_event_loop_.processEvents(timeout);
 }
 
 void WDock::PublishCmdAck(std::string const& cmd_id, rapid::AckStatus status,
@@ -229,9 +238,39 @@ void WDock::PublishCmdAck(std::string const& cmd_id, rapid::AckStatus status,
   std::strncpy(ack_state_supplier_->event().message, message.data(), 128);
   std::cout << "Sending command ack!" << std::endl;
   ack_state_supplier_->sendEvent();
+
+  // How long the command took to ack, from when it arrived and from when it
+  // was sent, which relies on the clocks agreeing
+  if (cmd_received_ > 0) {
+    int64_t latency = MakeTimestamp() - cmd_received_;
+    num_acks_++;
+    ack_latency_sum_ += latency;
+    ack_latency_max_ = std::max(ack_latency_max_, latency);
+    std::cout << "Acked " << cmd_id << " " << latency << " us after it arrived, "
+              << (ack_state_supplier_->event().hdr.timeStamp - cmd_sent_)
+              << " us after it was sent. Mean " << ack_latency_sum_ / num_acks_
+              << " us, max " << ack_latency_max_ << " us over " << num_acks_
+              << " acks." << std::endl;
+    cmd_received_ = 0;
+  }
+}
+
+std::string WDock::DockStateKey() {
+  std::ostringstream key;
+  auto const& b1 = dock_state_supplier_->event().berthOne;
+  auto const& b2 = dock_state_supplier_->event().berthTwo;
+  key << b1.occupied << " " << b1.astrobeeName << " " << b1.awake << " "
+      << b1.numBatteries << " " << b1.maxCapacity << " " << b1.currentCapacity
+      << " " << b2.occupied << " " << b2.astrobeeName << " " << b2.awake << " "
+      << b2.numBatteries << " " << b2.maxCapacity << " " << b2.currentCapacity;
+  return key.str();
 }
 
-void WDock::PublishDockState() {
+void WDock::PublishDockState(bool force) {
+  std::string key = DockStateKey();
+  if (!force && key == dock_state_sent_)
+    return;
+  dock_state_sent_ = key;
   dock_state_supplier_->event().hdr.timeStamp = MakeTimestamp();
   std::cout << "Sending dock state!" << std::endl;
   dock_state_supplier_->sendEvent();
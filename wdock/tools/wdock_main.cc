@@ -29,9 +29,10 @@ int main(int argc, char** argv) {
 
   wan_dock.SetBerthOne();
   wan_dock.SetBerthTwo();
+  // Block on the waitset rather than sleeping, so commands are handled as
+  // soon as they arrive
   while (true) {
-    wan_dock.ProcessDdsEventLoop();
-    sleep(1);
+    wan_dock.ProcessDdsEventLoop(kn::milliseconds(1000));
   }
 
   return 1;